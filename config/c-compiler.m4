@@ -489,3 +489,81 @@ if test x"$Ac_cachevar" = x"yes"; then
 fi
 undefine([Ac_cachevar])dnl
 ])# PGAC_SSE42_CRC32_INTRINSICS
+
+
+# PGAC_AVX512_TARGET_INTRINSICS
+# -----------------------
+# Check if the compiler can compile individual functions for AVX2, AVX-512
+# and VPCLMULQDQ using target attributes, and check for the instruction sets
+# at runtime with __builtin_cpu_supports.  That is used by the vectorized
+# variants of CRC-32C and of the page checksum, which need no special CFLAGS
+# and are only called on CPUs that support them.  Only 64-bit x86 is
+# supported.
+#
+# If the intrinsics are supported, sets pgac_avx512_target_intrinsics.
+AC_DEFUN([PGAC_AVX512_TARGET_INTRINSICS],
+[AC_CACHE_CHECK([for AVX-512 and VPCLMULQDQ intrinsics with target attributes], [pgac_cv_avx512_target_intrinsics],
+[AC_LINK_IFELSE([AC_LANG_PROGRAM([#include <immintrin.h>
+#ifndef __x86_64__
+#error not x86-64
+#endif
+__attribute__((target("avx512f,avx512vl,vpclmulqdq,pclmul,sse4.2")))
+static int clmul_test(void)
+{
+  __m512i x = _mm512_set1_epi32(1);
+  x = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, x, 0x00),
+                                _mm512_clmulepi64_epi128(x, x, 0x11),
+                                _mm512_mullo_epi32(x, x), 0x96);
+  return _mm_crc32_u8(0, _mm_cvtsi128_si32(_mm512_extracti32x4_epi32(x, 1))) == 0;
+}
+__attribute__((target("avx2")))
+static int avx2_test(void)
+{
+  __m256i x = _mm256_set1_epi32(1);
+  x = _mm256_mullo_epi32(x, x);
+  return _mm256_extract_epi32(x, 0) == 0;
+}],
+  [if (__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("vpclmulqdq"))
+     return clmul_test();
+   if (__builtin_cpu_supports("avx2"))
+     return avx2_test();
+   return 0;])],
+  [pgac_cv_avx512_target_intrinsics=yes],
+  [pgac_cv_avx512_target_intrinsics=no])])
+if test x"$pgac_cv_avx512_target_intrinsics" = x"yes"; then
+  pgac_avx512_target_intrinsics=yes
+fi])# PGAC_AVX512_TARGET_INTRINSICS
+
+
+# PGAC_ARMV8_CRC32C_INTRINSICS
+# -----------------------
+# Check if the compiler supports the CRC32C instructions using the __crc32cb,
+# __crc32ch, __crc32cw, and __crc32cd intrinsic functions. These instructions
+# were first introduced in ARMv8 in the optional CRC Extension, and became
+# mandatory in ARMv8.1.
+#
+# An optional compiler flag can be passed as argument (e.g.
+# -march=armv8-a+crc). If the intrinsics are supported, sets
+# pgac_armv8_crc32c_intrinsics, and CFLAGS_ARMV8_CRC32C.
+AC_DEFUN([PGAC_ARMV8_CRC32C_INTRINSICS],
+[define([Ac_cachevar], [AS_TR_SH([pgac_cv_armv8_crc32c_intrinsics_$1])])dnl
+AC_CACHE_CHECK([for __crc32cb, __crc32ch, __crc32cw, and __crc32cd with CFLAGS=$1], [Ac_cachevar],
+[pgac_save_CFLAGS=$CFLAGS
+CFLAGS="$pgac_save_CFLAGS $1"
+AC_LINK_IFELSE([AC_LANG_PROGRAM([#include <arm_acle.h>],
+  [unsigned int crc = 0;
+   crc = __crc32cb(crc, 0);
+   crc = __crc32ch(crc, 0);
+   crc = __crc32cw(crc, 0);
+   crc = __crc32cd(crc, 0);
+   /* return computed value, to prevent the above being optimized away */
+   return crc == 0;])],
+  [Ac_cachevar=yes],
+  [Ac_cachevar=no])
+CFLAGS="$pgac_save_CFLAGS"])
+if test x"$Ac_cachevar" = x"yes"; then
+  CFLAGS_ARMV8_CRC32C="$1"
+  pgac_armv8_crc32c_intrinsics=yes
+fi
+undefine([Ac_cachevar])dnl
+])# PGAC_ARMV8_CRC32C_INTRINSICS
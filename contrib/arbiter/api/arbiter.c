@@ -347,7 +347,6 @@ void ArbiterInitSnapshot(Snapshot snapshot)
 
 TransactionId ArbiterStartTransaction(Snapshot snapshot, TransactionId *gxmin, int nParticipants)
 {
-	int i;
 	xid_t xid;
 	int reslen;
 	xid_t results[RESULTS_SIZE];
@@ -377,10 +376,7 @@ TransactionId ArbiterStartTransaction(Snapshot snapshot, TransactionId *gxmin, i
 	snapshot->xmax = results[4];
 	snapshot->xcnt = reslen - 5;
 
-	for (i = 0; i < snapshot->xcnt; i++)
-	{
-		snapshot->xip[i] = results[5 + i];
-	}
+	memcpy(snapshot->xip, results + 5, snapshot->xcnt * sizeof(TransactionId));
 
 	return xid;
 failure:
@@ -391,7 +387,6 @@ failure:
 
 void ArbiterGetSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxmin)
 {
-	int i;
 	int reslen;
 	xid_t results[RESULTS_SIZE];
 	ArbiterConn arbiter = GetConnection();
@@ -414,10 +409,7 @@ void ArbiterGetSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxm
 	snapshot->xmax = results[3];
 	snapshot->xcnt = reslen - 4;
 
-	for (i = 0; i < snapshot->xcnt; i++)
-	{
-		snapshot->xip[i] = results[4 + i];
-	}
+	memcpy(snapshot->xip, results + 4, snapshot->xcnt * sizeof(TransactionId));
 
 	return;
 failure:
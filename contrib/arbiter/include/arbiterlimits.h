@@ -7,9 +7,14 @@
 /* start a new term when this number of xids is left */
 #define NEW_TERM_THRESHOLD 100000
 
-#define MAX_TRANSACTIONS 4096
+/* default limit of simultaneously active transactions, see the '-t' option */
+#define DEFAULT_MAX_TRANSACTIONS 4096
+#define MAX_STREAM_CLIENTS 4096 /* max number of sockhub channels per stream */
 #define MAX_SNAPSHOTS_PER_TRANS 8
 
+#define DEFAULT_GROUP_FLUSH_MS 2 /* see the '-g' option */
+#define CLOG_FLUSH_BATCH 1024 /* flush the clog when so many commit replies are waiting */
+
 #define BUFFER_SIZE (256 * 1024)
 #define LISTEN_QUEUE_SIZE 100
 #define MAX_STREAMS 4096
@@ -19,7 +24,9 @@
 #define HEARTBEAT_TIMEOUT_MS 20
 #define ELECTION_TIMEOUT_MS_MIN 150
 #define ELECTION_TIMEOUT_MS_MAX 300
-#define RAFT_LOGLEN 1024
-#define RAFT_KEEP_APPLIED 512 /* how many applied entries to keep during compaction */
+#define RAFT_LOGLEN 65536
+#define RAFT_KEEP_APPLIED 4096 /* how many applied entries to keep during compaction */
+#define RAFT_BATCH_SIZE 128 /* max number of entries in one update message */
+#define RAFT_PIPELINE_DEPTH 8 /* max number of unacknowledged batches per follower */
 
 #endif
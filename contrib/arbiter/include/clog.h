@@ -31,6 +31,13 @@ int clog_read(clog_t clog, xid_t xid);
 // 'false' otherwise.
 bool clog_write(clog_t clog, xid_t xid, int status);
 
+// Write the statuses set since the previous flush to disk and wait for them to
+// become durable. Return 'true' on success, 'false' otherwise.
+bool clog_flush(clog_t clog);
+
+// Return 'true' if there are statuses set but not flushed yet.
+bool clog_is_dirty(clog_t clog);
+
 // Forget about the commits before the given one ('until'), and free the
 // occupied space if possible. Return 'true' on success, 'false' otherwise.
 bool clog_forget(clog_t clog, xid_t until);
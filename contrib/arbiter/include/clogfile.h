@@ -3,6 +3,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "int.h"
 
 #ifndef CLOGFILE_H
@@ -22,6 +23,10 @@ typedef struct clogfile_t {
 	xid_t min;
 	xid_t max;
 	void *data; // ptr for mmap
+	int fd; // kept open for fdatasync
+	bool dirty; // true if there are changes not flushed yet
+	size_t dirty_from; // the range of bytes changed since the last flush
+	size_t dirty_to;
 } clogfile_t;
 
 // Open a clog file with the gived id. Create before opening if 'create' is
@@ -42,4 +47,8 @@ int clogfile_get_status(clogfile_t *clogfile, xid_t xid);
 // 'true' on success, 'false' otherwise.
 bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status);
 
+// Write the changes made since the previous flush to disk and wait for them
+// to become durable. Return 'true' on success, 'false' otherwise.
+bool clogfile_flush(clogfile_t *clogfile);
+
 #endif
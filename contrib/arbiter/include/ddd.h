@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include "transaction.h"
 
+#define DDD_HASH_SIZE 4096
+
 typedef struct Node {
     struct Node* collision;
     struct Edge* edges; /* local subgraph */    
@@ -28,7 +30,7 @@ typedef struct Vertex
 
 typedef struct Graph
 {
-    Vertex* hashtable[MAX_TRANSACTIONS];
+    Vertex* hashtable[DDD_HASH_SIZE];
     Edge* freeEdges;
     Vertex* freeVertexes;
     int marker;
@@ -3,6 +3,7 @@
 
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "arbiterlimits.h"
 
 #define NOBODY -1
@@ -20,6 +21,10 @@
 #error please ensure RAFT_KEEP_APPLIED < RAFT_LOGLEN
 #endif
 
+#if RAFT_BATCH_SIZE * RAFT_PIPELINE_DEPTH >= RAFT_LOGLEN - RAFT_KEEP_APPLIED
+#error please ensure RAFT_BATCH_SIZE * RAFT_PIPELINE_DEPTH < RAFT_LOGLEN - RAFT_KEEP_APPLIED
+#endif
+
 #if HEARTBEAT_TIMEOUT_MS >= ELECTION_TIMEOUT_MS_MIN
 #error please ensure HEARTBEAT_TIMEOUT_MS < ELECTION_TIMEOUT_MS_MIN (considerably)
 #endif
@@ -57,7 +62,9 @@ typedef struct raft_log_t {
 typedef struct raft_server_t {
 	int seqno;  // the rpc sequence number
 	int tosend; // index of the next entry to send
-	int acked;  // index of the highest entry known to be replicated
+	int acked;  // number of entries known to be replicated
+	int beatacked; // 'acked' at the previous heartbeat, to detect lost updates
+	bool behind; // the follower needs entries which are already compacted
 
 	char *host;
 	int port;
@@ -102,16 +109,20 @@ typedef struct raft_msg_update_t {
 	int previndex; // the index of the preceding log entry
 	int prevterm;  // the term of the preceding log entry
 
-	bool empty;    // the message is just a heartbeat if empty
-	raft_entry_t entry;
-
 	int acked;     // the leader's acked number
+
+	int nentries;  // the message is just a heartbeat if zero
+	raft_entry_t entries[RAFT_BATCH_SIZE]; // only 'nentries' are sent
 } raft_msg_update_t;
 
+#define RAFT_MSG_UPDATE_SIZE(NENTRIES) \
+	(offsetof(raft_msg_update_t, entries) + (NENTRIES) * sizeof(raft_entry_t))
+
 typedef struct raft_msg_done_t {
 	raft_msg_t msg;
-	int index; // the index of the appended entry
-	int term;  // the term of the appended entry
+	int index; // success: the index of the last entry matching the leader's log
+	           // failure: the index after which the leader should retry
+	int term;  // the term of the entry at 'index'
 	bool success;
 } raft_msg_done_t;
 
@@ -133,12 +144,14 @@ bool raft_set_myid(raft_t *r, int myid);
 
 // log actions
 bool raft_emit(raft_t *r, int action, int argument);
+void raft_flush(raft_t *r);
 int raft_apply(raft_t *r, raft_applier_t applier);
 
 // control
 void raft_tick(raft_t *r, int msec);
 void raft_handle_message(raft_t *r, raft_msg_t *m);
 raft_msg_t *raft_recv_message(raft_t *r);
+raft_msg_t *raft_try_recv_message(raft_t *r);
 int raft_create_udp_socket(raft_t *r);
 void raft_ensure_term(raft_t *r, int term);
 
@@ -57,6 +57,12 @@ bool server_start(server_t server);
  */
 bool server_tick(server_t server, int timeout_ms);
 
+/*
+ * Sends the finished messages of all the clients. The server does this at the
+ * end of every server_tick, use this to send the replies made outside of it.
+ */
+void server_flush(server_t server);
+
 /*
  * Closes all client connections on the server and refuses to accept new ones.
  */
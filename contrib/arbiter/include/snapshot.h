@@ -8,10 +8,14 @@ typedef struct Snapshot {
 	xid_t xmin;
 	xid_t xmax;
 	int nactive;
-	xid_t active[MAX_TRANSACTIONS];
+	int capacity; /* allocated size of 'active' */
+	xid_t *active;
 	int times_sent;
 } Snapshot;
 
 void snapshot_sort(Snapshot *s);
 
+/* Makes sure that 'active' can hold at least 'n' xids. */
+void snapshot_reserve(Snapshot *s, int n);
+
 #endif
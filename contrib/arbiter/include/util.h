@@ -37,6 +37,7 @@ typedef struct mstimer_t {
 } mstimer_t;
 
 int mstimer_reset(mstimer_t *t);
+int mstimer_elapsed(mstimer_t *t);
 struct timeval ms2tv(int ms);
 
 // ------ logging ------
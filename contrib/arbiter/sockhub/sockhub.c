@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <sys/utsname.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -16,12 +17,17 @@
 #include <signal.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "sockhub.h"
 
 #define SOCKHUB_BUFFER_SIZE (1024*1024)
 #define ERR_BUF_SIZE 1024
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 #define SHUB_TRACE(fmt, ...)
 /* #define SHUB_TRACE(fmt, ...) fprintf(stderr, fmt, ## __VA_ARGS__) */
 
@@ -192,6 +198,34 @@ int ShubWriteSocket(int sd, void const* buf, int size)
     return 1;
 }
 
+static int ShubWriteSocketV(int sd, struct iovec* iov, int iovcnt)
+{
+    while (iovcnt != 0) {
+        int n = writev(sd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (n <= 0) {
+            return 0;
+        }
+        /* skip what is sent */
+        while (iovcnt != 0 && n >= (int)iov->iov_len) {
+            n -= iov->iov_len;
+            iov += 1;
+            iovcnt -= 1;
+        }
+        if (n != 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 1;
+}
+
+static long get_time_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000L + tv.tv_usec/1000;
+}
+
 static void reconnect(Shub* shub)
 {
     struct sockaddr_in sock_inet;
@@ -281,6 +315,57 @@ static void notify_disconnect(Shub* shub, int chan)
     }
 }
 
+static void queue_reply(Shub* shub, ShubMessageHdr* first, int size)
+{
+    ShubReply* reply = &shub->replies[shub->n_replies++];
+    reply->chan = first->chan;
+    reply->data = (char*)first;
+    reply->size = size;
+}
+
+static int compare_replies(void const* p, void const* q)
+{
+    ShubReply const* r1 = (ShubReply const*)p;
+    ShubReply const* r2 = (ShubReply const*)q;
+    /* keep the order of the messages for each client */
+    return r1->chan != r2->chan ? (r1->chan < r2->chan ? -1 : 1) : r1->data < r2->data ? -1 : r1->data == r2->data ? 0 : 1;
+}
+
+/*
+ * Send the queued replies: all the replies to the same client are sent with one writev,
+ * so interleaved responses for different clients do not cost a system call per message.
+ */
+static void send_replies(Shub* shub)
+{
+    int i, j, k;
+    struct iovec iov[IOV_MAX];
+    int n = shub->n_replies;
+    ShubReply* replies = shub->replies;
+
+    if (n > 1) {
+        qsort(replies, n, sizeof(ShubReply), compare_replies);
+    }
+    for (i = 0; i < n; i = j) {
+        int chan = replies[i].chan;
+        int ok = 1;
+        for (j = i; j < n && replies[j].chan == chan; j += k) {
+            for (k = 0; k < IOV_MAX && j + k < n && replies[j + k].chan == chan; k++) {
+                iov[k].iov_base = replies[j + k].data;
+                iov[k].iov_len = replies[j + k].size;
+            }
+            if (ok && !ShubWriteSocketV(chan, iov, k)) {
+                ok = 0;
+            }
+        }
+        if (!ok) {
+            shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
+            close_socket(shub, chan);
+            notify_disconnect(shub, chan);
+        }
+    }
+    shub->n_replies = 0;
+}
+
 static void recovery(Shub* shub)
 {
 #ifndef USE_EPOLL
@@ -343,6 +428,13 @@ void ShubInitialize(Shub* shub, ShubParams* params)
     }
     shub->in_buffer_used = 0;
     shub->out_buffer_used = 0;
+
+    /* each run of replies takes at least one message header */
+    shub->replies = malloc((params->buffer_size / sizeof(ShubMessageHdr) + 1) * sizeof(ShubReply));
+    if (shub->replies == NULL) {
+        shub->params->error_handler("Failed to allocate buffer", SHUB_FATAL_ERROR);
+    }
+    shub->n_replies = 0;
 }
 
 static int stop = 0;
@@ -354,6 +446,7 @@ static void die(int sig)
 void ShubLoop(Shub* shub)
 {
     int buffer_size = shub->params->buffer_size;
+    long queued_since = 0; /* when requests have been added to the empty input buffer */
     sigset_t sset;
     signal(SIGINT, die);
     signal(SIGQUIT, die);
@@ -364,16 +457,24 @@ void ShubLoop(Shub* shub)
 
     while (!stop) { 
         int i, rc;
+        int delay = shub->params->delay;
+        if (shub->in_buffer_used != 0) {
+            /* wait for more requests only until the oldest queued one has waited for 'delay' */
+            delay -= get_time_ms() - queued_since;
+            if (delay < 0) {
+                delay = 0;
+            }
+        }
 #ifdef USE_EPOLL
         struct epoll_event events[MAX_EVENTS];
-        rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, shub->in_buffer_used == 0 ? -1 : shub->params->delay);
+        rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, shub->in_buffer_used == 0 ? -1 : delay);
 #else
         fd_set events;
         struct timeval tm;
         int max_fd = shub->max_fd;
 
-        tm.tv_sec = shub->params->delay/1000;
-        tm.tv_usec = shub->params->delay % 1000 * 1000;
+        tm.tv_sec = delay/1000;
+        tm.tv_usec = delay % 1000 * 1000;
         events = shub->inset;
         rc = select(max_fd+1, &events, NULL, NULL, shub->in_buffer_used == 0 ? NULL : &tm);
 #endif
@@ -431,11 +532,7 @@ void ShubLoop(Shub* shub)
                                 pos += sizeof(ShubMessageHdr) + hdr->size;
                                 if (firstHdr != NULL && (firstHdr->chan != chan || pos > available)) {
                                     assert(hdr > firstHdr);
-                                    if (!ShubWriteSocket(firstHdr->chan, firstHdr, (char*)hdr - (char*)firstHdr)) {
-                                        shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
-                                        close_socket(shub, firstHdr->chan);
-                                        notify_disconnect(shub, firstHdr->chan);
-                                    }
+                                    queue_reply(shub, firstHdr, (char*)hdr - (char*)firstHdr);
                                     firstHdr = NULL;
                                 }
                                 if (pos <= available) {
@@ -476,13 +573,10 @@ void ShubLoop(Shub* shub)
                                 }
                             }
                             if (firstHdr != NULL) {
-                               assert(&shub->out_buffer[pos] > (char*)firstHdr);
-                                if (!ShubWriteSocket(firstHdr->chan, firstHdr, &shub->out_buffer[pos] - (char*)firstHdr)) {
-                                    shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
-                                    close_socket(shub, firstHdr->chan);
-                                    notify_disconnect(shub, firstHdr->chan);
-                                }
+                                assert(&shub->out_buffer[pos] > (char*)firstHdr);
+                                queue_reply(shub, firstHdr, &shub->out_buffer[pos] - (char*)firstHdr);
                             }
+                            send_replies(shub);
                             /* Move partly fetched message header (if any) to the beginning of buffer */
                             memmove(shub->out_buffer, shub->out_buffer + pos, available - pos);
                             shub->out_buffer_used = available - pos;
@@ -587,8 +681,15 @@ void ShubLoop(Shub* shub)
                         }
                     }
                 }
-                if (shub->params->delay != 0) {
-                    continue;
+                if (shub->params->delay != 0 && shub->in_buffer_used != 0) {
+                    long now = get_time_ms();
+                    if (queued_since == 0) {
+                        queued_since = now;
+                    }
+                    if (now - queued_since < shub->params->delay) {
+                        /* collect more requests, but do not hold the queued ones longer than 'delay' */
+                        continue;
+                    }
                 }
             }
             if (shub->in_buffer_used != 0) { /* if buffer is not empty... */
@@ -607,6 +708,7 @@ void ShubLoop(Shub* shub)
                 }
                 shub->in_buffer_used = 0;
             }
+            queued_since = 0;
         }
     }
 }
@@ -54,6 +54,17 @@ typedef struct
     ShubErrorHandler error_handler;
 } ShubParams;
    
+/* 
+ * Run of consecutive messages for the same client received from the server.
+ * Runs are collected per read and then sent to each client with one writev.
+ */
+typedef struct
+{
+    int   chan;
+    char* data;
+    int   size;
+} ShubReply;
+
 typedef struct
 {
     int    output;
@@ -68,6 +79,8 @@ typedef struct
     char*  out_buffer;
     int    in_buffer_used;
     int    out_buffer_used;
+    ShubReply* replies;
+    int    n_replies;
     ShubParams* params;
 } Shub;
 
@@ -1,9 +1,22 @@
-n_clients=8
-n_iters=10000
-pkill -9 sockub
-pkill -9 test-async-client
-./sockhub -h $1 -p 5001 -f /tmp/p5002 &
+#!/bin/bash
+# Benchmark of sockhub: N_CLIENTS asynchronous clients send batches
+# of messages through sockhub to test-server and wait for the replies.
+n_clients=${N_CLIENTS:-8}
+n_iters=${N_ITERS:-10000}
+buffer_size=${BUFFER_SIZE:-65536}
+host=${1:-127.0.0.1}
+pkill -9 -x sockhub
+pkill -9 -x test-async-client
+pkill -9 -x test-server
+./test-server 5001 > /dev/null &
+server=$!
+./sockhub -h $host:5001 -f /tmp/p5002 -b $buffer_size $SOCKHUB_OPTIONS &
+hub=$!
+pids=()
 for ((i=0;i<n_clients;i++))
 do
-    ./test-async-client -h localhost -p 5002 -i $n_iters &
+    ./test-async-client -h localhost -p 5002 -i $n_iters -b $buffer_size $CLIENT_OPTIONS &
+    pids+=($!)
 done
+wait ${pids[@]}
+kill $hub $server
@@ -21,6 +21,7 @@
 #include "sockhub.h"
 
 #define MAX_CONNECT_ATTEMPTS 10
+#define N_HIST_BUCKETS 64 /* log2 buckets of round trip time in microseconds */
 
 typedef struct 
 { 
@@ -28,6 +29,51 @@ typedef struct
     int data;
 } Message;
 
+static long get_time_usec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000L + tv.tv_usec;
+}
+
+static int hist_bucket(long usec)
+{
+    int b = 0;
+    while (usec > 1 && b < N_HIST_BUCKETS-1) { 
+        usec >>= 1;
+        b += 1;
+    }
+    return b;
+}
+
+/* upper bound of the bucket containing the given percentile */
+static long hist_percentile(long* hist, long total, double percentile)
+{
+    long count = 0;
+    int b;
+    for (b = 0; b < N_HIST_BUCKETS; b++) { 
+        count += hist[b];
+        if (count >= total*percentile) { 
+            break;
+        }
+    }
+    return 1L << (b+1);
+}
+
+static void print_histogram(long* hist, long total)
+{
+    int b;
+    printf("Round trip time (usec)  count\n");
+    for (b = 0; b < N_HIST_BUCKETS; b++) { 
+        if (hist[b] != 0) { 
+            printf("  < %-18ld  %ld\n", 1L << (b+1), hist[b]);
+        }
+    }
+    printf("p50 < %ld usec, p90 < %ld usec, p99 < %ld usec, p99.9 < %ld usec\n",
+           hist_percentile(hist, total, 0.5), hist_percentile(hist, total, 0.9),
+           hist_percentile(hist, total, 0.99), hist_percentile(hist, total, 0.999));
+}
+
 static int resolve_host_by_name(const char *hostname, unsigned* addrs, unsigned* n_addrs)
 {
     struct sockaddr_in sin;
@@ -137,7 +183,9 @@ int main(int argc, char* argv[])
     int i, j;
     int n_iter = 10000;
     int n_msgs;
-    time_t start, elapsed;
+    long start, elapsed, sent, rtt, max_rtt = 0;
+    long hist[N_HIST_BUCKETS] = {0};
+    int verbose = 0;
     int buffer_size = 64*1024;
     int port = 5001;
     char const* host = NULL;
@@ -158,6 +206,9 @@ int main(int argc, char* argv[])
               case 'b':
                 buffer_size = atoi(argv[++i]);
                 break;
+              case 'v':
+                verbose = 1;
+                break;
               default:
                 goto Usage;
             }
@@ -171,7 +222,8 @@ int main(int argc, char* argv[])
                "\t-h HOST server address\n"
                "\t-p PORT server port\n"
                "\t-i N number of iterations\n"
-               "\t-b SIZE buffer size\n");
+               "\t-b SIZE buffer size\n"
+               "\t-v print histogram of round trip times\n");
         return 1;
     }
     n_msgs = buffer_size / sizeof(Message);
@@ -183,7 +235,7 @@ int main(int argc, char* argv[])
         perror("Failed to connect to socket");
         return 1;
     }
-    start = time(NULL);
+    start = get_time_usec();
 
     for (i = 0; i < n_iter; i++) {
         for (j = 0; j < n_msgs; j++) {
@@ -191,17 +243,28 @@ int main(int argc, char* argv[])
             msgs[j].hdr.size = sizeof(Message) - sizeof(ShubMessageHdr);
             msgs[j].hdr.code = MSG_FIRST_USER_CODE;
         }
+        sent = get_time_usec();
         rc = ShubWriteSocket(sd, msgs, buffer_size);
         assert(rc);
         rc = ShubReadSocket(sd, msgs, buffer_size);
         assert(rc);
+        rtt = get_time_usec() - sent;
+        hist[hist_bucket(rtt)] += 1;
+        if (rtt > max_rtt) { 
+            max_rtt = rtt;
+        }
         for (j = 0; j < n_msgs; j++) {
             assert(msgs[j].data == i+1);
         }
     }
     
-    elapsed = time(NULL) - start;
-    printf("Elapsed time for %d iterations=%ld sec, TPS=%ld\n", n_iter, elapsed, (long)n_iter*n_msgs/elapsed);
+    elapsed = get_time_usec() - start;
+    printf("Elapsed time for %d iterations=%.3f sec, TPS=%ld, p50 RTT < %ld usec, p99 RTT < %ld usec, max RTT=%ld usec\n",
+           n_iter, elapsed/1000000.0, (long)((double)n_iter*n_msgs*1000000/elapsed),
+           hist_percentile(hist, n_iter, 0.5), hist_percentile(hist, n_iter, 0.99), max_rtt);
+    if (verbose) { 
+        print_histogram(hist, n_iter);
+    }
     return 0;
 }
     
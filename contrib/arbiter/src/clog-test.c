@@ -24,6 +24,12 @@ bool test_clog(char *datadir) {
 	if (!clog_write(clog, 1000, POSITIVE)) return false;
 	if (!clog_write(clog, 1500, DOUBT)) return false;
 
+	printf("clog dirty %d (should be 1)\n", clog_is_dirty(clog));
+	if (!clog_is_dirty(clog)) return false;
+	if (!clog_flush(clog)) return false;
+	printf("clog dirty %d (should be 0)\n", clog_is_dirty(clog));
+	if (clog_is_dirty(clog)) return false;
+
 	if (!clog_close(clog)) return false;
 	if (!(clog = clog_open(datadir))) return false;
 
@@ -162,6 +162,29 @@ bool clog_write(clog_t clog, xid_t xid, int status) {
 	return clogfile_set_status(file, xid, status);
 }
 
+// Write the statuses set since the previous flush to disk and wait for them to
+// become durable. Return 'true' on success, 'false' otherwise.
+bool clog_flush(clog_t clog) {
+	clogfile_chain_t *cur;
+	for (cur = clog->lastfile; cur; cur = cur->prev) {
+		if (!clogfile_flush(&cur->file)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Return 'true' if there are statuses set but not flushed yet.
+bool clog_is_dirty(clog_t clog) {
+	clogfile_chain_t *cur;
+	for (cur = clog->lastfile; cur; cur = cur->prev) {
+		if (cur->file.dirty) {
+			return true;
+		}
+	}
+	return false;
+}
+
 // Forget about the commits before the given one ('until'), and free the
 // occupied space if possible. Return 'true' on success, 'false' otherwise.
 bool clog_forget(clog_t clog, xid_t until) {
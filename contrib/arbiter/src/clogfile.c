@@ -55,13 +55,13 @@ bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool c
 		PROT_READ | PROT_WRITE,
 		MAP_SHARED, fd, 0
 	);
-	// mmap will keep the file referenced, even after we close the fd
-	close(fd);
-
 	if (clogfile->data == MAP_FAILED) {
 		shout("cannot mmap clog file '%s': %s\n", clogfile->path, strerror(errno));
+		close(fd);
 		return false;
 	}
+	clogfile->fd = fd;
+	clogfile->dirty = false;
 	return true;
 }
 
@@ -82,6 +82,9 @@ bool clogfile_close(clogfile_t *clogfile) {
 	if (munmap(clogfile->data, BYTES_PER_FILE)) {
 		return false;
 	}
+	if (close(clogfile->fd)) {
+		return false;
+	}
 	return true;
 }
 
@@ -101,6 +104,14 @@ bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status) {
 	char *p = ((char*)clogfile->data + offset);
 	*p &= ~(COMMIT_MASK << (BITS_PER_COMMIT * suboffset));   // AND-out the old status
 	*p |= status << (BITS_PER_COMMIT * suboffset); // OR-in the new status
+	if (!clogfile->dirty) {
+		clogfile->dirty = true;
+		clogfile->dirty_from = clogfile->dirty_to = offset;
+	} else if (offset < clogfile->dirty_from) {
+		clogfile->dirty_from = offset;
+	} else if (offset > clogfile->dirty_to) {
+		clogfile->dirty_to = offset;
+	}
 	#ifdef SYNC
 	if (msync(clogfile->data, BYTES_PER_FILE, MS_SYNC)) {
 		shout("cannot msync clog file '%s': %s\n", clogfile->path, strerror(errno));
@@ -109,3 +120,28 @@ bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status) {
 	#endif
 	return true;
 }
+
+// Write the changes made since the previous flush to disk and wait for them
+// to become durable. Return 'true' on success, 'false' otherwise.
+bool clogfile_flush(clogfile_t *clogfile) {
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t from, to;
+
+	if (!clogfile->dirty) {
+		return true;
+	}
+	from = clogfile->dirty_from & ~(pagesize - 1);
+	to = clogfile->dirty_to + 1;
+	clogfile->dirty = false;
+
+	// start the writeback of the changed pages only, then wait for it
+	if (msync((char*)clogfile->data + from, to - from, MS_ASYNC)) {
+		shout("cannot msync clog file '%s': %s\n", clogfile->path, strerror(errno));
+		return false;
+	}
+	if (fdatasync(clogfile->fd)) {
+		shout("cannot fdatasync clog file '%s': %s\n", clogfile->path, strerror(errno));
+		return false;
+	}
+	return true;
+}
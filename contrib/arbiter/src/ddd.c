@@ -28,7 +28,7 @@ static inline Edge* newEdge(Graph* graph)
 
 static inline void freeVertex(Graph* graph, Vertex* vertex)
 {
-    int h = vertex->xid % MAX_TRANSACTIONS;
+    int h = vertex->xid % DDD_HASH_SIZE;
     Vertex** vpp = &graph->hashtable[h];
     while (*vpp != vertex) { 
         vpp = &(*vpp)->next;
@@ -58,7 +58,7 @@ static inline Vertex* newVertex(Graph* graph)
 
 static inline Vertex* findVertex(Graph* graph, xid_t xid)
 {
-    xid_t h = xid % MAX_TRANSACTIONS;
+    xid_t h = xid % DDD_HASH_SIZE;
     Vertex* v;
     for (v = graph->hashtable[h]; v != NULL; v = v->next) { 
         if (v->xid == xid) { 
@@ -143,7 +143,7 @@ static bool recursiveTraverseGraph(Vertex* root, Vertex* v, int marker)
 bool detectDeadLock(Graph* graph, xid_t root)
 {
     Vertex* v;
-    for (v = graph->hashtable[root % MAX_TRANSACTIONS]; v != NULL; v = v->next) { 
+    for (v = graph->hashtable[root % DDD_HASH_SIZE]; v != NULL; v = v->next) { 
         if (v->xid == root) { 
             if (recursiveTraverseGraph(v, v, ++graph->marker)) { 
                 return true;
@@ -81,6 +81,7 @@ static void main_loop() {
 			int action = rand() % 9 + 1;
 			shout("set state[%d] = %d\n", arg, action);
 			raft_emit(&raft, action, arg);
+			raft_flush(&raft);
 			arg++;
 		}
 	}
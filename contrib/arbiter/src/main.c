@@ -6,6 +6,8 @@
 #include <time.h>
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/wait.h>
 
 #include "clog.h"
@@ -20,12 +22,38 @@
 #define DEFAULT_LISTENHOST "0.0.0.0"
 #define DEFAULT_LISTENPORT 5431
 
-static xid_t get_global_xmin();
+/* a reply with the snapshot of all the active transactions should fit into a buffer */
+#define MAX_TRANSACTIONS_LIMIT (BUFFER_SIZE / sizeof(xid_t) - 16)
+
+void die(int signum);
 
-L2List active_transactions = {&active_transactions, &active_transactions};
 L2List* free_transactions;
 
-Transaction* transaction_hash[MAX_TRANSACTIONS];
+/*
+ * Active transactions by xid. The number of buckets is a power of two, at
+ * least twice the limit of active transactions.
+ */
+Transaction** transaction_hash;
+xid_t transaction_hash_mask;
+int max_transactions = DEFAULT_MAX_TRANSACTIONS;
+
+/*
+ * Xids of the active transactions in ascending order. Xids only grow, so
+ * BEGIN appends to the end and the first one is the oldest transaction.
+ */
+xid_t *active_xids;
+int n_active_transactions = 0;
+
+/*
+ * The snapshot of the active transactions is built once per 'snapshot_epoch',
+ * which changes whenever a transaction begins or finishes, and is copied to
+ * all the requests arriving in the meantime.
+ */
+static Snapshot current_snapshot;
+static unsigned long snapshot_epoch = 1;
+static unsigned long current_snapshot_epoch = 0;
+
+#define TRANSACTION_BUCKET(XID) (transaction_hash[(XID) & transaction_hash_mask])
 
 /*
  * We reserve the local xids if they fit between (prev, next) range, and
@@ -36,7 +64,7 @@ xid_t global_xmin = INVALID_XID;
 
 static Transaction *find_transaction(xid_t xid) {    
 	Transaction *t;    
-	for (t = transaction_hash[xid % MAX_TRANSACTIONS]; t != NULL && t->xid != xid; t = t->collision);
+	for (t = TRANSACTION_BUCKET(xid); t != NULL && t->xid != xid; t = t->collision);
 	return t;
 }
 
@@ -56,6 +84,42 @@ clog_t clg;
 raft_t raft;
 bool use_raft;
 
+/*
+ * With Raft enabled, the raft thread runs the timers, elections and log
+ * replication, so that they are not delayed by the client load. The state
+ * machine (clog, transactions and replies to the clients) belongs to the main
+ * thread: the raft thread only wakes it up through 'raft_wakeup' pipe when
+ * there are entries to apply, or the role or the term has changed. Both
+ * threads access 'raft' only while holding 'raft_lock'.
+ */
+static pthread_mutex_t raft_lock = PTHREAD_MUTEX_INITIALIZER;
+static int raft_wakeup[2];
+static bool raft_wakeup_pending; /* protected by raft_lock */
+
+/*
+ * Durability of the clog. With DURABILITY_GROUP the statuses are flushed to
+ * disk in groups: when 'group_flush_ms' passes since the clog got dirty or
+ * CLOG_FLUSH_BATCH replies are waiting, whichever comes first. The clients
+ * are not told that a transaction has committed until the flush completes.
+ * With DURABILITY_NONE writing back is left to the kernel.
+ */
+#define DURABILITY_NONE  0
+#define DURABILITY_GROUP 1
+
+int durability = DURABILITY_GROUP;
+int group_flush_ms = DEFAULT_GROUP_FLUSH_MS;
+
+typedef struct pending_reply_t {
+	client_t client;
+	xid_t result;
+} pending_reply_t;
+
+static pending_reply_t *pending_replies;
+static int pending_replies_num = 0;
+static int pending_replies_max = 0;
+static bool flush_scheduled = false;
+static mstimer_t flush_timer; /* reset when the clog gets dirty */
+
 #define CLIENT_USERDATA(CLIENT) ((client_userdata_t*)client_get_userdata(CLIENT))
 #define CLIENT_ID(CLIENT) (CLIENT_USERDATA(CLIENT)->id)
 #define CLIENT_SNAPSENT(CLIENT) (CLIENT_USERDATA(CLIENT)->snapshots_sent)
@@ -75,12 +139,37 @@ static void free_client_userdata(client_userdata_t *cd) {
 	free(cd);
 }
 
+static int compare_xids(void const* x, void const* y) {
+	xid_t xid1 = *(xid_t*)x;
+	xid_t xid2 = *(xid_t*)y;
+	return xid1 < xid2 ? -1 : xid1 == xid2 ? 0 : 1;
+}
+
+static void remove_active_xid(xid_t xid) {
+	xid_t *pos = bsearch(&xid, active_xids, n_active_transactions, sizeof(xid_t), compare_xids);
+	assert(pos != NULL);
+	memmove(pos, pos + 1, (active_xids + n_active_transactions - pos - 1) * sizeof(xid_t));
+	n_active_transactions -= 1;
+	snapshot_epoch += 1;
+}
+
+/*
+ * Each transaction's xmin is the oldest xid active at its BEGIN. It can only
+ * grow with time, so the oldest active transaction has the least xmin.
+ */
+static xid_t get_global_xmin() {
+	if (n_active_transactions == 0) {
+		return next_gxid;
+	}
+	return find_transaction(active_xids[0])->xmin;
+}
+
 inline static void free_transaction(Transaction* t) {
 	assert(transaction_pop_listener(t, 's') == NULL);
 	Transaction** tpp;
-	for (tpp = &transaction_hash[t->xid % MAX_TRANSACTIONS]; *tpp != t; tpp = &(*tpp)->collision);
+	for (tpp = &TRANSACTION_BUCKET(t->xid); *tpp != t; tpp = &(*tpp)->collision);
 	*tpp = t->collision;
-	l2_list_unlink(&t->elem);
+	remove_active_xid(t->xid);
 	t->elem.next = free_transactions;
 	free_transactions = &t->elem;
 	if (t->xmin == global_xmin) { 
@@ -88,6 +177,75 @@ inline static void free_transaction(Transaction* t) {
 	}
 }
 
+/*
+ * Sends the 'result' once the clog is flushed to disk, i.e. once the status
+ * the reply is based on can not be lost.
+ */
+static void reply_when_durable(client_t client, xid_t result) {
+	if ((durability == DURABILITY_NONE) || !clog_is_dirty(clg)) {
+		client_message_shortcut(client, result);
+		return;
+	}
+	if (pending_replies_num == pending_replies_max) {
+		pending_replies_max = max(pending_replies_max * 2, CLOG_FLUSH_BATCH);
+		pending_replies = realloc(pending_replies, pending_replies_max * sizeof(pending_reply_t));
+		assert(pending_replies);
+	}
+	pending_replies[pending_replies_num].client = client;
+	pending_replies[pending_replies_num].result = result;
+	pending_replies_num += 1;
+}
+
+/* Forgets the replies to the client which has disconnected. */
+static void drop_pending_replies(client_t client) {
+	int i, j = 0;
+	for (i = 0; i < pending_replies_num; i++) {
+		if (pending_replies[i].client != client) {
+			pending_replies[j++] = pending_replies[i];
+		}
+	}
+	pending_replies_num = j;
+}
+
+static void flush_clog() {
+	int i;
+	if (!clog_flush(clg)) {
+		shout("failed to flush the clog, cannot guarantee durability\n");
+		die(EXIT_FAILURE);
+	}
+	for (i = 0; i < pending_replies_num; i++) {
+		client_message_shortcut(pending_replies[i].client, pending_replies[i].result);
+	}
+	pending_replies_num = 0;
+	flush_scheduled = false;
+}
+
+/*
+ * Flushes the clog if it is time to. Returns the timeout (ms) to wait for the
+ * next events with.
+ */
+static int flush_clog_if_needed(server_t server) {
+	int elapsed;
+
+	if (durability == DURABILITY_NONE) {
+		return HEARTBEAT_TIMEOUT_MS;
+	}
+	if (!flush_scheduled) {
+		if (!clog_is_dirty(clg)) {
+			return HEARTBEAT_TIMEOUT_MS;
+		}
+		flush_scheduled = true;
+		mstimer_reset(&flush_timer);
+	}
+	elapsed = mstimer_elapsed(&flush_timer);
+	if ((elapsed >= group_flush_ms) || (pending_replies_num >= CLOG_FLUSH_BATCH)) {
+		flush_clog();
+		server_flush(server);
+		return HEARTBEAT_TIMEOUT_MS;
+	}
+	return min(HEARTBEAT_TIMEOUT_MS, group_flush_ms - elapsed);
+}
+
 static void notify_listeners(Transaction *t, int status) {
 	void *listener;
 	switch (status) {
@@ -116,7 +274,7 @@ static void notify_listeners(Transaction *t, int status) {
 			while ((listener = transaction_pop_listener(t, 's'))) {
 				debug("[%d] notifying the client about xid=%u (committed)\n", CLIENT_ID(listener), t->xid);
 				CLIENT_XWAIT(listener) = NULL;
-				client_message_shortcut(
+				reply_when_durable(
 					(client_t)listener,
 					RES_TRANSACTION_COMMITTED
 				);
@@ -167,7 +325,8 @@ static void onconnect(client_t client) {
 static void ondisconnect(client_t client) {
 	Transaction *t;
 	debug("[%d, %p] disconnected\n", CLIENT_ID(client), client);
-	
+
+	pthread_mutex_lock(&raft_lock);
 	if ((t = CLIENT_XPART(client))) {
 		transaction_remove_listener(t, 's', client);
 		if (use_raft) {
@@ -182,6 +341,9 @@ static void ondisconnect(client_t client) {
 	if ((t = CLIENT_XWAIT(client))) {
 		transaction_remove_listener(t, 's', client);
 	}
+	pthread_mutex_unlock(&raft_lock);
+
+	drop_pending_replies(client);
 
 	free_client_userdata(CLIENT_USERDATA(client));
 	client_set_userdata(client, NULL);
@@ -229,24 +391,39 @@ static xid_t max_of_xids(xid_t a, xid_t b) {
 	return a > b ? a : b;
 }
 
-static void gen_snapshot(Snapshot *s) {
-	Transaction* t;
-    int n = 0;
-	s->times_sent = 0;
-	for (t = (Transaction*)active_transactions.prev; t != (Transaction*)&active_transactions; t = (Transaction*)t->elem.prev) {
-		s->active[n++] = t->xid;
+/* Returns the snapshot of the active transactions, building it if the set has changed. */
+static Snapshot *get_current_snapshot() {
+	Snapshot *s = &current_snapshot;
+	int n = n_active_transactions;
+
+	if (current_snapshot_epoch == snapshot_epoch) {
+		return s;
 	}
+	snapshot_reserve(s, n);
+	memcpy(s->active, active_xids, n * sizeof(xid_t));
 	while (n > 1 && s->active[n-2]+1 == s->active[n-1]) { 
 		n -= 1;
 	}
 	if (n > 0) {
-        s->xmin = s->active[0];
-        s->xmax = s->active[--n];
+		s->xmin = s->active[0];
+		s->xmax = s->active[--n];
 		assert(s->xmin <= s->xmax);
 	} else {
 		s->xmin = s->xmax = 0;
 	} 
 	s->nactive = n;
+	current_snapshot_epoch = snapshot_epoch;
+	return s;
+}
+
+static void gen_snapshot(Snapshot *s) {
+	Snapshot *now = get_current_snapshot();
+	snapshot_reserve(s, now->nactive);
+	memcpy(s->active, now->active, now->nactive * sizeof(xid_t));
+	s->xmin = now->xmin;
+	s->xmax = now->xmax;
+	s->nactive = now->nactive;
+	s->times_sent = 0;
 }
 
 static void onhello(client_t client, int argc, xid_t *argv) {
@@ -374,17 +551,6 @@ static void onreserve(client_t client, int argc, xid_t *argv) {
 	client_message_finish(client);
 }
 
-static xid_t get_global_xmin() {
-	xid_t xmin = next_gxid;
-	Transaction *t;
-	for (t = (Transaction*)active_transactions.next; t != (Transaction*)&active_transactions; t = (Transaction*)t->elem.next) {
-		if (t->xmin < xmin) { 
-			xmin = t->xmin;
-		}
-	}
-	return xmin;
-}
-
 static void onbegin(client_t client, int argc, xid_t *argv) {
 	Transaction *t;
 	CHECK(
@@ -399,21 +565,32 @@ static void onbegin(client_t client, int argc, xid_t *argv) {
 		"BEGIN: already participating in another transaction"
 	);
 
+	CHECK(
+		n_active_transactions < max_transactions,
+		client,
+		"BEGIN: too many active transactions"
+	);
+
+	xid_t xid = next_gxid;
+	CHECK(
+		use_xid(xid),
+		client,
+		"not enought xids left in this term"
+	);
+
 	t = (Transaction*)free_transactions;
 	if (t == NULL) { 
-		t = (Transaction*)malloc(sizeof(Transaction));
+		/* zeroed, so that the snapshots have no buffers allocated yet */
+		t = (Transaction*)calloc(1, sizeof(Transaction));
 	} else { 
 		free_transactions = t->elem.next;
 	}
 	transaction_clear(t);
-	l2_list_link(&active_transactions, &t->elem);
 
-	t->xid = next_gxid;
-	CHECK(
-		use_xid(next_gxid),
-		client,
-		"not enought xids left in this term"
-	);
+	t->xid = xid;
+	assert(n_active_transactions == 0 || active_xids[n_active_transactions - 1] < xid);
+	active_xids[n_active_transactions++] = xid;
+	snapshot_epoch += 1;
 	prev_gxid = t->xid;
 	t->snapshots_count = 0;
 
@@ -425,8 +602,8 @@ static void onbegin(client_t client, int argc, xid_t *argv) {
 		t->fixed_size = false;
 	}
 
-	t->collision = transaction_hash[t->xid % MAX_TRANSACTIONS];
-	transaction_hash[t->xid % MAX_TRANSACTIONS] = t;
+	t->collision = TRANSACTION_BUCKET(t->xid);
+	TRANSACTION_BUCKET(t->xid) = t;
 
 	CLIENT_SNAPSENT(client) = 0;
 	CLIENT_XPART(client) = t;
@@ -534,7 +711,7 @@ static void onvote(client_t client, int argc, xid_t *argv, int vote) {
 			} else {
 				apply_clog_update(s, t->xid);
 				if (s == POSITIVE) {
-					client_message_shortcut(client, RES_TRANSACTION_COMMITTED);
+					reply_when_durable(client, RES_TRANSACTION_COMMITTED);
 				} else {
 					client_message_shortcut(client, RES_TRANSACTION_ABORTED);
 				}
@@ -558,8 +735,6 @@ static void onvote(client_t client, int argc, xid_t *argv, int vote) {
 }
 
 static void onsnapshot(client_t client, int argc, xid_t *argv) {
-	Snapshot snapshot_now;
-
 	CHECK(
 		argc == 2,
 		client,
@@ -574,8 +749,7 @@ static void onsnapshot(client_t client, int argc, xid_t *argv) {
 			"[%d] SNAPSHOT: xid=%u not found: use current snapshot\n",
 			CLIENT_ID(client), xid
 		);
-		gen_snapshot(&snapshot_now);
-		snap = &snapshot_now;
+		snap = get_current_snapshot();
 	} else {
 		if (CLIENT_XPART(client) == NULL) {
 			CLIENT_SNAPSENT(client) = 0;
@@ -630,7 +804,7 @@ static void onstatus(client_t client, int argc, xid_t *argv) {
 			client_message_shortcut(client, RES_TRANSACTION_UNKNOWN);
 			return;
 		case POSITIVE:
-			client_message_shortcut(client, RES_TRANSACTION_COMMITTED);
+			reply_when_durable(client, RES_TRANSACTION_COMMITTED);
 			return;
 		case NEGATIVE:
 			client_message_shortcut(client, RES_TRANSACTION_ABORTED);
@@ -737,19 +911,25 @@ static void onmessage(client_t client, size_t len, char *data) {
 	xid_t *argv = (xid_t*)data;
 	CHECK(argc > 0, client, "EMPTY: empty command?");
 
+	pthread_mutex_lock(&raft_lock);
 	oncmd(client, argc, argv);
+	pthread_mutex_unlock(&raft_lock);
 }
 
 static void usage(char *prog) {
 	printf(
-		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-d DATADIR] [-k] [-l LOGFILE]\n"
+		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-d DATADIR] [-t MAXTRANS] [-s none|group] [-g MS] [-k] [-l LOGFILE]\n"
 		"   arbiter will try to kill the other one running at\n"
 		"   the same DATADIR.\n"
 		"   -r : Listen on the HOST and PORT. Specify multiple times to enable Raft protocol.\n"
 		"   -i : A number to distinguish this instance among the Raft peers.\n"
+		"   -t : The maximal number of simultaneously active transactions (default %d).\n"
+		"   -s : Clog durability: 'group' flushes it in groups and delays the commit\n"
+		"        replies until the flush, 'none' leaves it to the kernel (default 'group').\n"
+		"   -g : Flush the clog at most MS milliseconds after a change (default %d).\n"
 		"   -l : Run as a daemon and write output to LOGFILE.\n"
 		"   -k : Just kill the other arbiter and exit.\n",
-		prog
+		prog, DEFAULT_MAX_TRANSACTIONS, DEFAULT_GROUP_FLUSH_MS
 	);
 }
 
@@ -849,7 +1029,7 @@ bool configure(int argc, char **argv) {
     initGraph(&graph);
 
 	int opt;
-	while ((opt = getopt(argc, argv, "hd:i:r:l:k")) != -1) {
+	while ((opt = getopt(argc, argv, "hd:i:r:t:s:g:l:k")) != -1) {
 		char *host;
 		char *portstr;
 		int port;
@@ -870,6 +1050,23 @@ bool configure(int argc, char **argv) {
 				}
 				raft_add_server(&raft, host, port);
 				break;
+			case 't':
+				max_transactions = atoi(optarg);
+				break;
+			case 's':
+				if (!strcmp(optarg, "none")) {
+					durability = DURABILITY_NONE;
+				} else if (!strcmp(optarg, "group")) {
+					durability = DURABILITY_GROUP;
+				} else {
+					shout("unknown durability mode '%s'\n", optarg);
+					usage(argv[0]);
+					return false;
+				}
+				break;
+			case 'g':
+				group_flush_ms = atoi(optarg);
+				break;
 			case 'l':
 				logfilename = optarg;
 				daemonize = true;
@@ -893,6 +1090,12 @@ bool configure(int argc, char **argv) {
 	}
 	use_raft = raft.servernum > 1;
 
+	if ((max_transactions < 1) || (max_transactions > MAX_TRANSACTIONS_LIMIT)) {
+		shout("the number of transactions should be in range 1-%d\n", (int)MAX_TRANSACTIONS_LIMIT);
+		usage(argv[0]);
+		return false;
+	}
+
 	if (!raft_set_myid(&raft, myid)) {
 		usage(argv[0]);
 		return false;
@@ -901,6 +1104,94 @@ bool configure(int argc, char **argv) {
 	return true;
 }
 
+static bool create_transaction_hash() {
+	xid_t buckets = 1;
+	while (buckets < 2 * max_transactions) {
+		buckets <<= 1;
+	}
+	transaction_hash = calloc(buckets, sizeof(Transaction*));
+	if (transaction_hash == NULL) {
+		shout("could not allocate the transaction hash of %u buckets\n", buckets);
+		return false;
+	}
+	transaction_hash_mask = buckets - 1;
+
+	active_xids = malloc(max_transactions * sizeof(xid_t));
+	if (active_xids == NULL) {
+		shout("could not allocate the list of %d active transactions\n", max_transactions);
+		return false;
+	}
+	return true;
+}
+
+static void wakeup_main_thread() {
+	char c = 0;
+	if (raft_wakeup_pending) {
+		return;
+	}
+	raft_wakeup_pending = true;
+	if ((write(raft_wakeup[1], &c, 1) == -1) && (errno != EAGAIN)) {
+		shout("failed to wake up the main thread: %s\n", strerror(errno));
+	}
+}
+
+static void drain_wakeups() {
+	char buf[64];
+	while (read(raft_wakeup[0], buf, sizeof(buf)) > 0);
+}
+
+static void *raft_thread(void *arg) {
+	mstimer_t t;
+	int role, term;
+
+	pthread_mutex_lock(&raft_lock);
+	role = raft.role;
+	term = raft.term;
+	pthread_mutex_unlock(&raft_lock);
+
+	mstimer_reset(&t);
+	while (true) {
+		/* Blocks for HEARTBEAT_TIMEOUT_MS at most, see the socket options. */
+		raft_msg_t *m = raft_recv_message(&raft);
+
+		pthread_mutex_lock(&raft_lock);
+		raft_tick(&raft, mstimer_reset(&t));
+		while (m) {
+			raft_handle_message(&raft, m);
+			/* Handle the rest of the arrived messages, e.g. acks of pipelined updates. */
+			m = raft_try_recv_message(&raft);
+		}
+		raft_flush(&raft);
+
+		if ((raft.log.acked > raft.log.applied) || (raft.role != role) || (raft.term != term)) {
+			role = raft.role;
+			term = raft.term;
+			wakeup_main_thread();
+		}
+		pthread_mutex_unlock(&raft_lock);
+	}
+	return NULL;
+}
+
+static bool start_raft_thread(server_t server) {
+	pthread_t thread;
+
+	if (pipe(raft_wakeup) == -1) {
+		shout("could not create the wakeup pipe: %s\n", strerror(errno));
+		return false;
+	}
+	fcntl(raft_wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(raft_wakeup[1], F_SETFL, O_NONBLOCK);
+	server_set_raft_socket(server, raft_wakeup[0]);
+
+	if (pthread_create(&thread, NULL, raft_thread, NULL) != 0) {
+		shout("could not start the raft thread\n");
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
 bool redirect_output() {
 	if (logfilename) {
 		if (!freopen(logfilename, "a", stdout)) {
@@ -923,6 +1214,8 @@ int main(int argc, char **argv) {
 
 	if (!redirect_output()) return EXIT_FAILURE;
 
+	if (!create_transaction_hash()) return EXIT_FAILURE;
+
 	next_gxid = MIN_XID;
 	clg = clog_open(datadir);
 
@@ -965,40 +1258,39 @@ int main(int argc, char **argv) {
 		onmessage, onconnect, ondisconnect
 	);
 
-	server_set_raft_socket(server, raftsock);
-
 	if (!server_start(server)) {
 		return EXIT_FAILURE;
 	}
 
-	mstimer_t t;
-	mstimer_reset(&t);
+	if (use_raft && !start_raft_thread(server)) {
+		return EXIT_FAILURE;
+	}
+
 	int old_term = 0;
+	int timeout = HEARTBEAT_TIMEOUT_MS;
 	while (true) {
-		int ms = mstimer_reset(&t);
-		raft_msg_t *m = NULL;
-
-		if (use_raft) {
-			raft_tick(&raft, ms);
-		}
+		bool leader = true;
 
 		/* The client interaction is done in server_tick. */
-		if (server_tick(server, HEARTBEAT_TIMEOUT_MS)) {
-			m = raft_recv_message(&raft);
-			assert(m); /* m should not be NULL, because the message should be ready to recv */
+		if (server_tick(server, timeout)) {
+			drain_wakeups();
 		}
 
 		if (use_raft) {
-			int applied = raft_apply(&raft, apply_clog_update);
+			int applied;
+
+			pthread_mutex_lock(&raft_lock);
+			raft_wakeup_pending = false;
+
+			applied = raft_apply(&raft, apply_clog_update);
 			if (applied) {
 				debug("applied %d updates\n", applied);
 			}
 
-			if (m) {
-				raft_handle_message(&raft, m);
-			}
+			/* Replicate all the entries emitted during this iteration in batches. */
+			raft_flush(&raft);
 
-			server_set_enabled(server, raft.role == ROLE_LEADER);
+			leader = raft.role == ROLE_LEADER;
 
 			/* Update the gxid limits based on current term and leadership. */
 			if (old_term < raft.term) {
@@ -1014,9 +1306,13 @@ int main(int argc, char **argv) {
 				}
 				old_term = raft.term;
 			}
-		} else {
-			server_set_enabled(server, true);
+			pthread_mutex_unlock(&raft_lock);
 		}
+
+		timeout = flush_clog_if_needed(server);
+
+		/* Not under the lock: disabling the server disconnects the clients. */
+		server_set_enabled(server, leader);
 	}
 
 	clog_close(clg);
@@ -10,6 +10,8 @@ static void raft_server_init(raft_server_t *s) {
 	s->seqno = 0;
 	s->tosend = 0;
 	s->acked = 0;
+	s->beatacked = 0;
+	s->behind = false;
 
 	s->host = DEFAULT_LISTENHOST;
 	s->port = DEFAULT_LISTENPORT;
@@ -155,7 +157,10 @@ int raft_create_udp_socket(raft_t *r) {
 static bool msg_size_is(raft_msg_t *m, int mlen) {
 	switch (m->msgtype) {
 		case RAFT_MSG_UPDATE:
-			return mlen == sizeof(raft_msg_update_t);
+			if (mlen < (int)RAFT_MSG_UPDATE_SIZE(0)) return false;
+			if (((raft_msg_update_t *)m)->nentries < 0) return false;
+			if (((raft_msg_update_t *)m)->nentries > RAFT_BATCH_SIZE) return false;
+			return mlen == RAFT_MSG_UPDATE_SIZE(((raft_msg_update_t *)m)->nentries);
 		case RAFT_MSG_DONE:
 			return mlen == sizeof(raft_msg_done_t);
 		case RAFT_MSG_CLAIM:
@@ -189,6 +194,82 @@ static void raft_send(raft_t *r, int dst, void *m, int mlen) {
 	}
 }
 
+// true if the entry at 'index' was compacted into a snapshot and cannot be sent
+static bool log_compacted(raft_log_t *l, int index) {
+	if (index < l->first) return true;
+	return (index == l->first) && (l->size > 0) && l->entries[index % RAFT_LOGLEN].snapshot;
+}
+
+static void raft_send_update(raft_t *r, int dst, int previndex, int nentries) {
+	raft_server_t *s = r->servers + dst;
+	raft_msg_update_t m;
+	int i;
+
+	assert(nentries <= RAFT_BATCH_SIZE);
+
+	m.msg.msgtype = RAFT_MSG_UPDATE;
+	m.msg.term = r->term;
+	m.msg.from = r->me;
+
+	m.previndex = previndex;
+	if ((m.previndex >= 0) && (m.previndex >= r->log.first)) {
+		m.prevterm = RAFT_LOG(r, m.previndex).term;
+	} else {
+		m.prevterm = -1;
+	}
+	for (i = 0; i < nentries; i++) {
+		m.entries[i] = RAFT_LOG(r, previndex + 1 + i);
+		assert(!m.entries[i].snapshot);
+	}
+	m.nentries = nentries;
+	m.acked = r->log.acked;
+
+	s->seqno++;
+	m.msg.seqno = s->seqno;
+	if (nentries) {
+		debug("[to %d] update with seqno = %d, previndex = %d, nentries = %d\n", dst, m.msg.seqno, previndex, nentries);
+	}
+
+	raft_send(r, dst, &m, RAFT_MSG_UPDATE_SIZE(nentries));
+}
+
+/*
+ * Send the entries the follower does not have yet in batches, without waiting
+ * for the previous batches to be acknowledged, as long as the number of
+ * unacknowledged entries fits into the pipeline. Returns the number of
+ * messages sent.
+ */
+static int raft_replicate(raft_t *r, int dst) {
+	raft_server_t *s = r->servers + dst;
+	int last = r->log.first + r->log.size;
+	int sent = 0;
+
+	assert(r->role == ROLE_LEADER);
+	assert(r->leader == r->me);
+
+	if (s->tosend < last && log_compacted(&r->log, s->tosend)) {
+		// TODO: implement snapshot sending
+		if (!s->behind) {
+			shout(
+				"[to %d] the follower needs entry %d, but the log is"
+				" compacted up to %d, it has to be reinitialized\n",
+				dst, s->tosend, r->log.first
+			);
+			s->behind = true;
+		}
+		return 0;
+	}
+	s->behind = false;
+
+	while ((s->tosend < last) && (s->tosend - s->acked < RAFT_BATCH_SIZE * RAFT_PIPELINE_DEPTH)) {
+		int n = min(last - s->tosend, RAFT_BATCH_SIZE);
+		raft_send_update(r, dst, s->tosend - 1, n);
+		s->tosend += n;
+		sent++;
+	}
+	return sent;
+}
+
 static void raft_beat(raft_t *r, int dst) {
 	if (dst == NOBODY) {
 		// send a beat/update to everybody
@@ -205,42 +286,31 @@ static void raft_beat(raft_t *r, int dst) {
 
 	raft_server_t *s = r->servers + dst;
 
-	raft_msg_update_t m;
-
-	m.msg.msgtype = RAFT_MSG_UPDATE;
-	m.msg.term = r->term;
-	m.msg.from = r->me;
-
-	if (s->tosend < r->log.first + r->log.size) {
-		raft_entry_t *e = &RAFT_LOG(r, s->tosend);
-		if (e->snapshot) {
-			// TODO: implement snapshot sending
-			shout("tosend = %d, first = %d, size = %d\n", s->tosend, r->log.first, r->log.size);
-			assert(false); // snapshot sending not implemented
-		}
+	if ((s->tosend > s->acked) && (s->acked == s->beatacked)) {
+		// no progress since the previous beat: some updates were lost, resend them
+		debug("[to %d] resending from %d (tosend = %d)\n", dst, s->acked, s->tosend);
+		s->tosend = s->acked;
+	}
+	s->beatacked = s->acked;
 
-		// the follower is a bit behind: send an update
-		m.previndex = s->tosend - 1;
-		if (m.previndex >= 0) {
-			m.prevterm = RAFT_LOG(r, m.previndex).term;
-		} else {
-			m.prevterm = -1;
+	if (raft_replicate(r, dst) == 0) {
+		// the follower is up to date (or cannot be updated): send a heartbeat
+		int previndex = s->acked - 1;
+		if (previndex < r->log.first) {
+			// the term of a compacted entry is unknown
+			previndex = -1;
 		}
-		m.entry = *e;
-		m.empty = false;
-	} else {
-		// the follower is up to date: send a heartbeat
-		m.empty = true;
+		raft_send_update(r, dst, previndex, 0);
 	}
-	m.acked = r->log.acked;
+}
 
-	s->seqno++;
-	m.msg.seqno = s->seqno;
-	if (!m.empty) {
-		debug("[to %d] update with seqno = %d, tosend = %d, previndex = %d\n", dst, m.msg.seqno, s->tosend, m.previndex);
+void raft_flush(raft_t *r) {
+	int i;
+	if (r->role != ROLE_LEADER) return;
+	for (i = 0; i < r->servernum; i++) {
+		if (i == r->me) continue;
+		raft_replicate(r, i);
 	}
-
-	raft_send(r, dst, &m, sizeof(m));
 }
 
 static void raft_claim(raft_t *r) {
@@ -303,15 +373,18 @@ void raft_tick(raft_t *r, int msec) {
 	}
 }
 
-static int raft_log_compact(raft_log_t *l, int keep_applied) {
+// compact the entries [first; upto) into a single snapshot entry
+static int raft_log_compact(raft_log_t *l, int upto) {
 	raft_entry_t snap;
 	snap.snapshot = true;
 	snap.minarg = INT_MAX;
 	snap.maxarg = INT_MIN;
 
+	assert(upto <= l->applied);
+
 	int compacted = 0;
 	int i;
-	for (i = l->first; i < l->applied - keep_applied; i++) {
+	for (i = l->first; i < upto; i++) {
 		raft_entry_t *e = l->entries + (i % RAFT_LOGLEN);
 		snap.term = e->term;
 		if (e->snapshot) {
@@ -323,11 +396,33 @@ static int raft_log_compact(raft_log_t *l, int keep_applied) {
 		}
 		compacted++;
 	}
-	if (compacted) {
+	if (compacted > 1) {
 		l->first += compacted - 1;
 		l->size -= compacted - 1;
 		assert(l->first < l->applied);
 		l->entries[l->first % RAFT_LOGLEN] = snap;
+		return compacted;
+	}
+	return 0;
+}
+
+/*
+ * Compact the leader's log. The entries still needed by followers are kept
+ * if possible, otherwise the lagging followers are left behind.
+ */
+static int raft_leader_compact(raft_t *r) {
+	int upto = r->log.applied - RAFT_KEEP_APPLIED;
+	int compacted;
+	int i;
+
+	for (i = 0; i < r->servernum; i++) {
+		if (i == r->me) continue;
+		if (r->servers[i].behind) continue;
+		upto = min(upto, r->servers[i].acked);
+	}
+	compacted = raft_log_compact(&r->log, upto);
+	if (!compacted) {
+		compacted = raft_log_compact(&r->log, r->log.applied - RAFT_KEEP_APPLIED);
 	}
 	return compacted;
 }
@@ -337,8 +432,8 @@ bool raft_emit(raft_t *r, int action, int argument) {
 	assert(r->role == ROLE_LEADER);
 
 	if (r->log.size == RAFT_LOGLEN) {
-		int compacted = raft_log_compact(&r->log, RAFT_KEEP_APPLIED);
-		if (compacted > 1) {
+		int compacted = raft_leader_compact(r);
+		if (compacted) {
 			debug("compacted %d entries\n", compacted);
 		} else {
 			shout(
@@ -356,47 +451,36 @@ bool raft_emit(raft_t *r, int action, int argument) {
 	e->argument = argument;
 	r->log.size++;
 
-	raft_beat(r, NOBODY);
-	raft_reset_timer(r);
+	// the entry is sent by raft_flush() together with the others emitted in the same loop
 	return true;
 }
 
-static bool log_append(raft_log_t *l, int previndex, int prevterm, raft_entry_t *e) {
-	if (e->snapshot) {
-		assert(false);
-	}
+/*
+ * Append the entries following 'previndex' to the log. On success '*matched'
+ * is set to the index of the last entry known to match the leader's log.
+ */
+static bool log_append(raft_log_t *l, int previndex, int prevterm, raft_entry_t *entries, int n, int *matched) {
+	int i;
+
 	debug(
-		"log_append(%p, previndex=%d, prevterm=%d,"
-		" term=%d, action=%d, argument=%d)\n",
-		l, previndex, prevterm,
-		e->term, e->action, e->argument
+		"log_append(%p, previndex=%d, prevterm=%d, n=%d)\n",
+		l, previndex, prevterm, n
 	);
-	if (previndex != -1) {
-		if (previndex < l->first) {
-			debug("previndex < first\n");
-			return false;
-		}
+
+	// the compacted entries are applied, so they match the leader's ones
+	while ((n > 0) && log_compacted(l, previndex + 1)) {
+		previndex++;
+		prevterm = entries->term;
+		entries++;
+		n--;
 	}
+
 	if (previndex >= l->first + l->size) {
 		debug("previndex > last\n");
 		return false;
 	}
-	if (previndex == l->first + l->size - 1) {
-		debug("previndex == last\n");
-		// appending to the end
-		// check if the log can accomodate
-		if (l->size == RAFT_LOGLEN) {
-			debug("log is full\n");
-			int compacted = raft_log_compact(l, RAFT_KEEP_APPLIED);
-			if (compacted) {
-				debug("compacted %d entries\n", compacted);
-			} else {
-				return false;
-			}
-		}
-	}
 
-	if (previndex != -1) {
+	if ((previndex >= 0) && !log_compacted(l, previndex)) {
 		raft_entry_t *pe = l->entries + (previndex % RAFT_LOGLEN);
 		if (pe->term != prevterm) {
 			debug("log term %d != prevterm %d\n", pe->term, prevterm);
@@ -404,27 +488,41 @@ static bool log_append(raft_log_t *l, int previndex, int prevterm, raft_entry_t
 		}
 	}
 
-	int index = previndex + 1;
-	raft_entry_t *slot = l->entries + (index % RAFT_LOGLEN);
+	for (i = 0; i < n; i++) {
+		int index = previndex + 1 + i;
+		raft_entry_t *e = entries + i;
+		assert(!e->snapshot);
 
-	if (index < l->first + l->size) {
-		// replacing an existing entry
-		if (slot->term != e->term) {
+		if (index < l->first + l->size) {
+			// replacing an existing entry
+			if (l->entries[index % RAFT_LOGLEN].term == e->term) {
+				continue;
+			}
 			// entry conflict, remove the entry and all that follow
 			l->size = index - l->first;
 		}
-	}
 
-	if (index == l->first + l->size) {
+		// appending to the end, check if the log can accomodate
+		if (l->size == RAFT_LOGLEN) {
+			debug("log is full\n");
+			int compacted = raft_log_compact(l, l->applied - RAFT_KEEP_APPLIED);
+			if (compacted) {
+				debug("compacted %d entries\n", compacted);
+			} else {
+				break;
+			}
+		}
+		l->entries[index % RAFT_LOGLEN] = *e;
 		l->size++;
 	}
-	*slot = *e;
 
+	*matched = previndex + i;
 	return true;
 }
 
 static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 	int sender = m->msg.from;
+	int matched;
 
 	raft_msg_done_t reply;
 	reply.msg.msgtype = RAFT_MSG_DONE;
@@ -433,11 +531,6 @@ static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 	reply.msg.seqno = m->msg.seqno;
 
 	reply.index = r->log.first + r->log.size - 1;
-	if (reply.index >= 0) {
-		reply.term = RAFT_LOG(r, reply.index).term;
-	} else {
-		reply.term = -1;
-	}
 	reply.success = false;
 
 	// the message is too old
@@ -453,59 +546,61 @@ static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 
 	raft_reset_timer(r);
 
-	if (m->acked > r->log.acked) {
-		r->log.acked = min(
-			r->log.first + r->log.size,
-			m->acked
-		);
-		raft_server_t *s = r->servers + sender;
-		s->acked = s->tosend = r->log.acked;
+	if (!log_append(&r->log, m->previndex, m->prevterm, m->entries, m->nentries, &matched)) {
+		debug("log_append failed\n");
+		// ask the leader to retry from an earlier entry
+		reply.index = min(reply.index, m->previndex - 1);
+		goto finish;
 	}
 
-	if (m->empty) {
-		// just a hearbeat
-		return;
+	if (min(m->acked, matched + 1) > r->log.acked) {
+		r->log.acked = min(m->acked, matched + 1);
 	}
 
-	if (!log_append(&r->log, m->previndex, m->prevterm, &m->entry)) {
-		debug("log_append failed\n");
-		goto finish;
+	if (m->nentries == 0) {
+		// just a hearbeat
+		return;
 	}
-	reply.index = r->log.first + r->log.size - 1;
-	reply.term = RAFT_LOG(r, reply.index).term;
 
+	reply.index = matched;
 	reply.success = true;
 finish:
+	if ((reply.index >= 0) && (reply.index >= r->log.first)) {
+		reply.term = RAFT_LOG(r, reply.index).term;
+	} else {
+		reply.term = -1;
+	}
 	raft_send(r, sender, &reply, sizeof(reply));
 }
 
 static void raft_refresh_acked(raft_t *r) {
-	// pick each server's acked and see if it is acked on the majority
-	// TODO: count 'acked' inside the entry itself to remove the nested loop here
+	// find the highest 'acked' reached by enough followers
+	int acked[MAX_SERVERS];
+	int n = 0;
 	int i, j;
 	for (i = 0; i < r->servernum; i++) {
 		if (i == r->me) continue;
-		int newacked = r->servers[i].acked;
-		if (newacked <= r->log.acked) continue;
-
-		int replication = 1; // count self as yes
-		for (j = 0; j < r->servernum; j++) {
-			if (j == r->me) continue;
-
-			raft_server_t *s = r->servers + j;
-			if (s->acked >= newacked) {
-				replication++;
-			}
+		int a = r->servers[i].acked;
+		// insertion sort in descending order
+		for (j = n; (j > 0) && (acked[j - 1] < a); j--) {
+			acked[j] = acked[j - 1];
 		}
+		acked[j] = a;
+		n++;
+	}
 
-		assert(replication <= r->servernum);
+	#ifdef MAJORITY_IS_NOT_ENOUGH
+	int needed = n; // every follower
+	#else
+	int needed = r->servernum / 2; // together with self makes the majority
+	#endif
 
-		if (replication * 2 > r->servernum) {
-			#ifdef MAJORITY_IS_NOT_ENOUGH
-			if (replication < r->servernum) continue;
-			#endif
-			r->log.acked = newacked;
-		}
+	int newacked = r->log.first + r->log.size;
+	if (needed > 0) {
+		newacked = min(newacked, acked[needed - 1]);
+	}
+	if (newacked > r->log.acked) {
+		r->log.acked = newacked;
 	}
 }
 
@@ -520,42 +615,34 @@ static void raft_handle_done(raft_t *r, raft_msg_done_t *m) {
 	}
 
 	raft_server_t *server = r->servers + sender;
-	if (m->msg.seqno != server->seqno) {
-		debug("[from %d] ============= mseqno(%d) != sseqno(%d)\n", sender, m->msg.seqno, server->seqno);
-		return;
-	}
-	server->seqno++;
 	if (m->msg.term < r->term) {
-		debug("[from %d] ============= msgterm(%d) != term(%d)\n", sender, m->term, r->term);
+		debug("[from %d] ============= msgterm(%d) != term(%d)\n", sender, m->msg.term, r->term);
 		return;
 	}
 
+	// several batches may be in flight, so the replies are matched by index, not by seqno
 	if (m->success) {
-		debug("[from %d] ============= done\n", sender);
-		server->tosend++;
-		server->acked = server->tosend;
-		raft_refresh_acked(r);
+		debug("[from %d] ============= done up to %d\n", sender, m->index);
+		if (m->index + 1 > server->acked) {
+			server->acked = m->index + 1;
+			raft_refresh_acked(r);
+		}
+		if (server->tosend < server->acked) {
+			server->tosend = server->acked;
+		}
 	} else {
-		debug("[from %d] ============= refused\n", sender);
-		if (server->tosend > 0) {
-			// the client should have specified the last index it had gotten
-			if (server->tosend == m->index + 1) {
-				shout(
-					"[from %d] the last index I have is %d, but"
-					" I still refuse, this should not happen\n",
-					sender, m->index
-				);
-				assert(false);
-			}
+		debug("[from %d] ============= refused, retry after %d\n", sender, m->index);
+		if (m->index + 1 < server->tosend) {
 			server->tosend = m->index + 1;
 		}
-		assert(server->tosend >= server->acked); // FIXME: remove this, because 'tosend' is actually allowed to be less than 'acked' if the follower has restarted
+		if (server->acked > server->tosend) {
+			// the follower has restarted and lost its log
+			server->acked = server->tosend;
+		}
 	}
 
-	if (server->tosend < r->log.first + r->log.size) {
-		// send the next entry
-		raft_beat(r, sender);
-	}
+	// send the next batches
+	raft_replicate(r, sender);
 }
 
 static void raft_set_term(raft_t *r, int term) {
@@ -627,8 +714,17 @@ static void raft_handle_vote(raft_t *r, raft_msg_vote_t *m) {
 
 	if (r->votes * 2 > r->servernum) {
 		// got the support of a majority
+		int i;
 		r->role = ROLE_LEADER;
 		r->leader = r->me;
+		for (i = 0; i < r->servernum; i++) {
+			raft_server_t *s = r->servers + i;
+			s->tosend = r->log.first + r->log.size;
+			s->acked = 0;
+			s->beatacked = 0;
+			s->behind = false;
+		}
+		raft_beat(r, NOBODY);
 		raft_reset_timer(r);
 	}
 }
@@ -662,16 +758,15 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 	}
 }
 
-static char buf[1024];
+static raft_msg_update_t buf; // the largest message
 
-raft_msg_t *raft_recv_message(raft_t *r) {
+static raft_msg_t *raft_recv(raft_t *r, int flags) {
 	struct sockaddr_in addr;
 	unsigned int addrlen = sizeof(addr);
 
-	//try to receive some data, this is a blocking call
-	raft_msg_t *m = (raft_msg_t *)buf;
+	raft_msg_t *m = (raft_msg_t *)&buf;
 	int recved = recvfrom(
-		r->sock, buf, sizeof(buf), 0,
+		r->sock, &buf, sizeof(buf), flags,
 		(struct sockaddr*)&addr, &addrlen
 	);
 
@@ -733,3 +828,13 @@ raft_msg_t *raft_recv_message(raft_t *r) {
 
 	return m;
 }
+
+raft_msg_t *raft_recv_message(raft_t *r) {
+	//try to receive some data, this is a blocking call
+	return raft_recv(r, 0);
+}
+
+raft_msg_t *raft_try_recv_message(raft_t *r) {
+	// receive the message if there is one, without blocking
+	return raft_recv(r, MSG_DONTWAIT);
+}
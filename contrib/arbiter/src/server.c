@@ -231,7 +231,7 @@ static bool stream_flush(stream_t stream) {
 	return true;
 }
 
-static void server_flush(server_t server) {
+void server_flush(server_t server) {
 	stream_t s;
 	debug("flushing the streams\n");
 	for (s = server->used_chain; s != NULL; s = s->next) { 
@@ -254,17 +254,17 @@ static void stream_init(stream_t stream, int fd) {
 	stream->fd = fd;
 	stream->good = true;
 
-	stream->clients = malloc(MAX_TRANSACTIONS * sizeof(client_data_t));
+	stream->clients = malloc(MAX_STREAM_CLIENTS * sizeof(client_data_t));
 	assert(stream->clients);
 	/* mark all clients as empty */
-	for (i = 0; i < MAX_TRANSACTIONS; i++) {
+	for (i = 0; i < MAX_STREAM_CLIENTS; i++) {
 		stream->clients[i].stream = NULL;
 	}
 }
 
 static void server_stream_destroy(server_t server, stream_t stream) {
 	int c;
-	for (c = 0; c < MAX_TRANSACTIONS; c++) {
+	for (c = 0; c < MAX_STREAM_CLIENTS; c++) {
 		client_t client = stream->clients + c;
 		if (client->stream) {
 			server->ondisconnect(client);
@@ -445,7 +445,7 @@ static bool server_accept(server_t server) {
 static client_t stream_get_client(stream_t stream, unsigned int chan, bool *isnew) {
 	client_t client;
 
-	assert(chan < MAX_TRANSACTIONS);
+	assert(chan < MAX_STREAM_CLIENTS);
 	client = stream->clients + chan;
 	if (client->stream == NULL) {
 		/* client is new */
@@ -14,3 +14,15 @@ static int compare_xid(void const* x, void const* y) {
 void snapshot_sort(Snapshot *s) {
 	qsort(s->active, s->nactive, sizeof(xid_t), compare_xid);
 }
+
+void snapshot_reserve(Snapshot *s, int n) {
+	if (s->capacity < n) {
+		int capacity = max(s->capacity * 2, 64);
+		while (capacity < n) {
+			capacity *= 2;
+		}
+		s->active = realloc(s->active, capacity * sizeof(xid_t));
+		assert(s->active);
+		s->capacity = capacity;
+	}
+}
@@ -92,6 +92,13 @@ int mstimer_reset(mstimer_t *t) {
 	return ms;
 }
 
+// Milliseconds since the last reset, without resetting the timer.
+int mstimer_elapsed(mstimer_t *t) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - t->tv.tv_sec) * 1000 + (now.tv_usec - t->tv.tv_usec) / 1000;
+}
+
 struct timeval ms2tv(int ms) {
 	struct timeval result;
 	result.tv_sec = ms / 1000;
@@ -167,6 +167,8 @@ typedef struct BloomTuple
 typedef struct BloomScanOpaqueData
 {
 	BloomSignatureWord *sign;	/* Scan signature */
+	int		   *signWords;		/* indexes of its nonzero words */
+	int			nSignWords;		/* number of entries in signWords */
 	BloomState	state;
 } BloomScanOpaqueData;
 
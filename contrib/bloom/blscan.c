@@ -36,6 +36,8 @@ blbeginscan(Relation r, int nkeys, int norderbys)
 	so = (BloomScanOpaque) palloc(sizeof(BloomScanOpaqueData));
 	initBloomState(&so->state, scan->indexRelation);
 	so->sign = NULL;
+	so->signWords = palloc(sizeof(int) * so->state.opts.bloomLength);
+	so->nSignWords = 0;
 
 	scan->opaque = so;
 
@@ -73,6 +75,8 @@ blendscan(IndexScanDesc scan)
 	if (so->sign)
 		pfree(so->sign);
 	so->sign = NULL;
+	pfree(so->signWords);
+	so->signWords = NULL;
 }
 
 /*
@@ -114,6 +118,18 @@ blgetbitmap(IndexScanDesc scan, TIDBitmap *tbm)
 
 			skey++;
 		}
+
+		/*
+		 * A scan key sets only bitSize bits per column, so most words of the
+		 * scan signature are usually zero and can't reject anything.  Note
+		 * which words aren't, and check only those against each tuple.
+		 */
+		so->nSignWords = 0;
+		for (i = 0; i < so->state.opts.bloomLength; i++)
+		{
+			if (so->sign[i] != 0)
+				so->signWords[so->nSignWords++] = i;
+		}
 	}
 
 	/*
@@ -139,16 +155,22 @@ blgetbitmap(IndexScanDesc scan, TIDBitmap *tbm)
 		{
 			OffsetNumber offset,
 						maxOffset = BloomPageGetMaxOffset(page);
+			char	   *ptr = (char *) BloomPageGetTuple(&so->state, page,
+														 FirstOffsetNumber);
 
 			for (offset = 1; offset <= maxOffset; offset++)
 			{
-				BloomTuple *itup = BloomPageGetTuple(&so->state, page, offset);
+				BloomTuple *itup = (BloomTuple *) ptr;
 				bool		res = true;
 
+				ptr += so->state.sizeOfBloomTuple;
+
 				/* Check index signature with scan signature */
-				for (i = 0; i < so->state.opts.bloomLength; i++)
+				for (i = 0; i < so->nSignWords; i++)
 				{
-					if ((itup->sign[i] & so->sign[i]) != so->sign[i])
+					int			w = so->signWords[i];
+
+					if ((itup->sign[w] & so->sign[w]) != so->sign[w])
 					{
 						res = false;
 						break;
@@ -0,0 +1,987 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_fdw.c
+ *		  foreign-data wrapper for append-only columnar tables.
+ *
+ * Tables are stored in server-side files written by INSERT in the format
+ * described in columnar_fdw.h.  A scan reads only the columns referenced by
+ * the query, and skips stripes whose minimum and maximum values refute the
+ * scan's quals, using the same predicate proofs as constraint exclusion.
+ * Rows carry no transaction information, so they are returned without any
+ * visibility checks.
+ *
+ * Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_fdw.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <sys/stat.h>
+
+#include "access/htup_details.h"
+#include "access/reloptions.h"
+#include "access/stratnum.h"
+#include "access/sysattr.h"
+#include "catalog/pg_foreign_table.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "commands/explain.h"
+#include "commands/vacuum.h"
+#include "foreign/fdwapi.h"
+#include "foreign/foreign.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/planmain.h"
+#include "optimizer/predtest.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/sampling.h"
+#include "utils/typcache.h"
+
+#include "columnar_fdw.h"
+
+PG_MODULE_MAGIC;
+
+/*
+ * Describes the valid options for objects that use this wrapper.
+ */
+struct ColumnarFdwOption
+{
+	const char *optname;
+	Oid			optcontext;		/* Oid of catalog in which option may appear */
+};
+
+static const struct ColumnarFdwOption valid_options[] = {
+	{"filename", ForeignTableRelationId},
+	{"compression", ForeignTableRelationId},
+	{"stripe_row_count", ForeignTableRelationId},
+
+	/* Sentinel */
+	{NULL, InvalidOid}
+};
+
+/*
+ * Options of a columnar_fdw foreign table.
+ */
+typedef struct ColumnarOptions
+{
+	char	   *filename;
+	bool		compress;		/* compress column chunks with pglz */
+	int			stripe_row_count;	/* rows per stripe written by INSERT */
+} ColumnarOptions;
+
+/*
+ * FDW-specific information for RelOptInfo.fdw_private.
+ */
+typedef struct ColumnarPlanState
+{
+	ColumnarOptions options;
+	BlockNumber pages;			/* physical size of the file */
+	double		ntuples;		/* number of rows in the file */
+} ColumnarPlanState;
+
+/*
+ * Information needed to refute the quals of a scan with the minimum and
+ * maximum values of a stripe.
+ */
+typedef struct ColumnarFilterState
+{
+	Index		scanrelid;
+	TupleDesc	tupdesc;
+	List	   *quals;			/* non-volatile quals of the scan */
+	List	   *columns;		/* indexes of the columns used by quals */
+	Oid		   *ge_oprs;		/* btree >= operator of each column */
+	Oid		   *le_oprs;		/* btree <= operator of each column */
+	Oid		   *opintypes;		/* input type of the operators */
+} ColumnarFilterState;
+
+/*
+ * FDW-specific information for ForeignScanState.fdw_state.
+ */
+typedef struct ColumnarScanState
+{
+	ColumnarReadState *rstate;
+	ColumnarFilterState *filter;	/* NULL if there are no usable quals */
+} ColumnarScanState;
+
+/*
+ * SQL functions
+ */
+PG_FUNCTION_INFO_V1(columnar_fdw_handler);
+PG_FUNCTION_INFO_V1(columnar_fdw_validator);
+
+/*
+ * FDW callback routines
+ */
+static void columnarGetForeignRelSize(PlannerInfo *root,
+						  RelOptInfo *baserel,
+						  Oid foreigntableid);
+static void columnarGetForeignPaths(PlannerInfo *root,
+						RelOptInfo *baserel,
+						Oid foreigntableid);
+static ForeignScan *columnarGetForeignPlan(PlannerInfo *root,
+					   RelOptInfo *baserel,
+					   Oid foreigntableid,
+					   ForeignPath *best_path,
+					   List *tlist,
+					   List *scan_clauses,
+					   Plan *outer_plan);
+static void columnarExplainForeignScan(ForeignScanState *node,
+						   ExplainState *es);
+static void columnarBeginForeignScan(ForeignScanState *node, int eflags);
+static TupleTableSlot *columnarIterateForeignScan(ForeignScanState *node);
+static void columnarReScanForeignScan(ForeignScanState *node);
+static void columnarEndForeignScan(ForeignScanState *node);
+static void columnarBeginForeignModify(ModifyTableState *mtstate,
+						   ResultRelInfo *rinfo,
+						   List *fdw_private,
+						   int subplan_index,
+						   int eflags);
+static TupleTableSlot *columnarExecForeignInsert(EState *estate,
+						  ResultRelInfo *rinfo,
+						  TupleTableSlot *slot,
+						  TupleTableSlot *planSlot);
+static void columnarEndForeignModify(EState *estate,
+						 ResultRelInfo *rinfo);
+static int	columnarIsForeignRelUpdatable(Relation rel);
+static bool columnarAnalyzeForeignTable(Relation relation,
+							AcquireSampleRowsFunc *func,
+							BlockNumber *totalpages);
+
+/*
+ * Helper functions
+ */
+static bool is_valid_option(const char *option, Oid context);
+static int	parse_stripe_row_count(DefElem *def);
+static bool parse_compression(DefElem *def);
+static void columnarGetOptions(Oid foreigntableid, ColumnarOptions *options);
+static List *needed_columns(RelOptInfo *baserel, Oid foreigntableid,
+			   double *fraction);
+static ColumnarFilterState *make_filter_state(ForeignScanState *node);
+static bool stripe_refuted(StripeHeader *header, void *arg);
+static int columnar_acquire_sample_rows(Relation onerel, int elevel,
+							 HeapTuple *rows, int targrows,
+							 double *totalrows, double *totaldeadrows);
+
+
+/*
+ * Foreign-data wrapper handler function: return a struct with pointers
+ * to my callback routines.
+ */
+Datum
+columnar_fdw_handler(PG_FUNCTION_ARGS)
+{
+	FdwRoutine *fdwroutine = makeNode(FdwRoutine);
+
+	fdwroutine->GetForeignRelSize = columnarGetForeignRelSize;
+	fdwroutine->GetForeignPaths = columnarGetForeignPaths;
+	fdwroutine->GetForeignPlan = columnarGetForeignPlan;
+	fdwroutine->ExplainForeignScan = columnarExplainForeignScan;
+	fdwroutine->BeginForeignScan = columnarBeginForeignScan;
+	fdwroutine->IterateForeignScan = columnarIterateForeignScan;
+	fdwroutine->ReScanForeignScan = columnarReScanForeignScan;
+	fdwroutine->EndForeignScan = columnarEndForeignScan;
+	fdwroutine->BeginForeignModify = columnarBeginForeignModify;
+	fdwroutine->ExecForeignInsert = columnarExecForeignInsert;
+	fdwroutine->EndForeignModify = columnarEndForeignModify;
+	fdwroutine->IsForeignRelUpdatable = columnarIsForeignRelUpdatable;
+	fdwroutine->AnalyzeForeignTable = columnarAnalyzeForeignTable;
+
+	PG_RETURN_POINTER(fdwroutine);
+}
+
+/*
+ * Validate the generic options given to a FOREIGN DATA WRAPPER, SERVER,
+ * USER MAPPING or FOREIGN TABLE that uses columnar_fdw.
+ *
+ * Raise an ERROR if the option or its value is considered invalid.
+ */
+Datum
+columnar_fdw_validator(PG_FUNCTION_ARGS)
+{
+	List	   *options_list = untransformRelOptions(PG_GETARG_DATUM(0));
+	Oid			catalog = PG_GETARG_OID(1);
+	char	   *filename = NULL;
+	ListCell   *cell;
+
+	/*
+	 * As with file_fdw, only superusers may choose which server-side file a
+	 * table reads and writes.
+	 */
+	if (catalog == ForeignTableRelationId && !superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("only superuser can change options of a columnar_fdw foreign table")));
+
+	foreach(cell, options_list)
+	{
+		DefElem    *def = (DefElem *) lfirst(cell);
+
+		if (!is_valid_option(def->defname, catalog))
+		{
+			const struct ColumnarFdwOption *opt;
+			StringInfoData buf;
+
+			/*
+			 * Unknown option specified, complain about it. Provide a hint
+			 * with list of valid options for the object.
+			 */
+			initStringInfo(&buf);
+			for (opt = valid_options; opt->optname; opt++)
+			{
+				if (catalog == opt->optcontext)
+					appendStringInfo(&buf, "%s%s", (buf.len > 0) ? ", " : "",
+									 opt->optname);
+			}
+
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
+					 errmsg("invalid option \"%s\"", def->defname),
+					 buf.len > 0
+					 ? errhint("Valid options in this context are: %s",
+							   buf.data)
+				  : errhint("There are no valid options in this context.")));
+		}
+
+		if (strcmp(def->defname, "filename") == 0)
+		{
+			if (filename)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			filename = defGetString(def);
+		}
+		else if (strcmp(def->defname, "compression") == 0)
+			(void) parse_compression(def);
+		else if (strcmp(def->defname, "stripe_row_count") == 0)
+			(void) parse_stripe_row_count(def);
+	}
+
+	if (catalog == ForeignTableRelationId && filename == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
+				 errmsg("filename is required for columnar_fdw foreign tables")));
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Check if the provided option is one of the valid options.
+ * context is the Oid of the catalog holding the object the option is for.
+ */
+static bool
+is_valid_option(const char *option, Oid context)
+{
+	const struct ColumnarFdwOption *opt;
+
+	for (opt = valid_options; opt->optname; opt++)
+	{
+		if (context == opt->optcontext && strcmp(opt->optname, option) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool
+parse_compression(DefElem *def)
+{
+	char	   *value = defGetString(def);
+
+	if (strcmp(value, "pglz") == 0)
+		return true;
+	if (strcmp(value, "none") == 0)
+		return false;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+			 errmsg("invalid value for option \"compression\": \"%s\"",
+					value),
+			 errhint("Valid values are \"pglz\" and \"none\".")));
+	return false;				/* keep compiler quiet */
+}
+
+static int
+parse_stripe_row_count(DefElem *def)
+{
+	char	   *value = defGetString(def);
+	char	   *end;
+	long		count;
+
+	errno = 0;
+	count = strtol(value, &end, 10);
+	if (errno != 0 || *end != '\0' || count < 1 || count > INT_MAX / 8)
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+				 errmsg("invalid value for option \"stripe_row_count\": \"%s\"",
+						value)));
+	return (int) count;
+}
+
+/*
+ * Fetch the options of a columnar_fdw foreign table.
+ */
+static void
+columnarGetOptions(Oid foreigntableid, ColumnarOptions *options)
+{
+	ForeignTable *table = GetForeignTable(foreigntableid);
+	ListCell   *lc;
+
+	options->filename = NULL;
+	options->compress = true;
+	options->stripe_row_count = DEFAULT_STRIPE_ROW_COUNT;
+
+	foreach(lc, table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "filename") == 0)
+			options->filename = defGetString(def);
+		else if (strcmp(def->defname, "compression") == 0)
+			options->compress = parse_compression(def);
+		else if (strcmp(def->defname, "stripe_row_count") == 0)
+			options->stripe_row_count = parse_stripe_row_count(def);
+	}
+
+	/*
+	 * The validator should have checked that a filename was included in the
+	 * options, but check again, just in case.
+	 */
+	if (options->filename == NULL)
+		elog(ERROR, "filename is required for columnar_fdw foreign tables");
+}
+
+/*
+ * columnarGetForeignRelSize
+ *		Obtain relation size estimates for a foreign table
+ *
+ * The stripe headers hold exact row counts, so they are simply added up.
+ */
+static void
+columnarGetForeignRelSize(PlannerInfo *root,
+						  RelOptInfo *baserel,
+						  Oid foreigntableid)
+{
+	ColumnarPlanState *fdw_private;
+	int			nstripes;
+	off_t		size;
+
+	fdw_private = (ColumnarPlanState *) palloc0(sizeof(ColumnarPlanState));
+	columnarGetOptions(foreigntableid, &fdw_private->options);
+	baserel->fdw_private = (void *) fdw_private;
+
+	(void) columnar_count_rows(fdw_private->options.filename,
+							   &fdw_private->ntuples, &nstripes, &size);
+
+	fdw_private->pages = (size + (BLCKSZ - 1)) / BLCKSZ;
+	if (fdw_private->pages < 1)
+		fdw_private->pages = 1;
+
+	baserel->rows = clamp_row_est(fdw_private->ntuples *
+								  clauselist_selectivity(root,
+													 baserel->baserestrictinfo,
+														 0,
+														 JOIN_INNER,
+														 NULL));
+}
+
+/*
+ * columnarGetForeignPaths
+ *		Create possible access paths for a scan on the foreign table
+ *
+ *		There is only one access path, which returns the rows in the order
+ *		they were inserted.  Its I/O cost is that of reading the chunks of
+ *		the needed columns only.  The columns are passed down to the plan in
+ *		the path's fdw_private.
+ */
+static void
+columnarGetForeignPaths(PlannerInfo *root,
+						RelOptInfo *baserel,
+						Oid foreigntableid)
+{
+	ColumnarPlanState *fdw_private = (ColumnarPlanState *) baserel->fdw_private;
+	List	   *columns;
+	double		fraction;
+	Cost		startup_cost;
+	Cost		run_cost;
+
+	columns = needed_columns(baserel, foreigntableid, &fraction);
+
+	startup_cost = baserel->baserestrictcost.startup;
+	run_cost = seq_page_cost * fdw_private->pages * fraction;
+	run_cost += (cpu_tuple_cost + baserel->baserestrictcost.per_tuple) *
+		fdw_private->ntuples;
+
+	add_path(baserel, (Path *)
+			 create_foreignscan_path(root, baserel,
+									 NULL,		/* default pathtarget */
+									 baserel->rows,
+									 startup_cost,
+									 startup_cost + run_cost,
+									 NIL,		/* no pathkeys */
+									 NULL,		/* no outer rel either */
+									 NULL,		/* no extra plan */
+									 columns));
+}
+
+/*
+ * columnarGetForeignPlan
+ *		Create a ForeignScan plan node for scanning the foreign table
+ */
+static ForeignScan *
+columnarGetForeignPlan(PlannerInfo *root,
+					   RelOptInfo *baserel,
+					   Oid foreigntableid,
+					   ForeignPath *best_path,
+					   List *tlist,
+					   List *scan_clauses,
+					   Plan *outer_plan)
+{
+	Index		scan_relid = baserel->relid;
+
+	/*
+	 * Stripe skipping only discards stripes which can't contain matching
+	 * rows, so all the quals are still checked by the executor.
+	 */
+	scan_clauses = extract_actual_clauses(scan_clauses, false);
+
+	return make_foreignscan(tlist,
+							scan_clauses,
+							scan_relid,
+							NIL,	/* no expressions to evaluate */
+							best_path->fdw_private,
+							NIL,	/* no custom tlist */
+							NIL,	/* no remote quals */
+							outer_plan);
+}
+
+/*
+ * Collect the attribute numbers of the columns needed for joins, final
+ * output and restriction clauses, and the fraction of the columns they make
+ * up.
+ */
+static List *
+needed_columns(RelOptInfo *baserel, Oid foreigntableid, double *fraction)
+{
+	Bitmapset  *attrs_used = NULL;
+	bool		has_wholerow = false;
+	List	   *columns = NIL;
+	Relation	rel;
+	TupleDesc	tupdesc;
+	int			numattrs = 0;
+	ListCell   *lc;
+	int			i;
+
+	pull_varattnos((Node *) baserel->reltarget->exprs, baserel->relid,
+				   &attrs_used);
+	foreach(lc, baserel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		pull_varattnos((Node *) rinfo->clause, baserel->relid,
+					   &attrs_used);
+	}
+	has_wholerow = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber,
+								 attrs_used);
+
+	rel = heap_open(foreigntableid, AccessShareLock);
+	tupdesc = RelationGetDescr(rel);
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+
+		if (attr->attisdropped)
+			continue;
+		numattrs++;
+
+		if (has_wholerow ||
+			bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber,
+						  attrs_used))
+			columns = lappend_int(columns, attr->attnum);
+	}
+
+	heap_close(rel, AccessShareLock);
+
+	/* Even reading no column at all costs the stripe headers */
+	*fraction = numattrs > 0 ?
+		(double) Max(list_length(columns), 1) / numattrs : 1.0;
+
+	return columns;
+}
+
+/*
+ * columnarExplainForeignScan
+ *		Produce extra output for EXPLAIN
+ */
+static void
+columnarExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+	ColumnarScanState *cstate = (ColumnarScanState *) node->fdw_state;
+	ColumnarOptions options;
+
+	columnarGetOptions(RelationGetRelid(node->ss.ss_currentRelation),
+					   &options);
+
+	ExplainPropertyText("Columnar File", options.filename, es);
+
+	if (es->analyze && cstate != NULL)
+	{
+		ExplainPropertyLong("Stripes Read", cstate->rstate->stripes_read, es);
+		ExplainPropertyLong("Stripes Skipped",
+							cstate->rstate->stripes_skipped, es);
+	}
+}
+
+/*
+ * columnarBeginForeignScan
+ *		Open the file and prepare to skip stripes by the scan's quals
+ */
+static void
+columnarBeginForeignScan(ForeignScanState *node, int eflags)
+{
+	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
+	TupleDesc	tupdesc = RelationGetDescr(node->ss.ss_currentRelation);
+	ColumnarScanState *cstate;
+	ColumnarOptions options;
+	bool	   *needed;
+	ListCell   *lc;
+
+	/*
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
+	 */
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	columnarGetOptions(RelationGetRelid(node->ss.ss_currentRelation),
+					   &options);
+
+	needed = (bool *) palloc0(tupdesc->natts * sizeof(bool));
+	foreach(lc, plan->fdw_private)
+		needed[lfirst_int(lc) - 1] = true;
+
+	cstate = (ColumnarScanState *) palloc0(sizeof(ColumnarScanState));
+	cstate->filter = make_filter_state(node);
+	cstate->rstate = columnar_begin_read(options.filename, tupdesc, needed,
+										 cstate->filter ? stripe_refuted : NULL,
+										 cstate->filter);
+
+	node->fdw_state = (void *) cstate;
+}
+
+/*
+ * Look up what's needed to build min/max constraints for the columns used by
+ * the scan's quals.  Returns NULL if no qual can be used for skipping.
+ */
+static ColumnarFilterState *
+make_filter_state(ForeignScanState *node)
+{
+	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
+	TupleDesc	tupdesc = RelationGetDescr(node->ss.ss_currentRelation);
+	ColumnarFilterState *filter;
+	Bitmapset  *attrs_used = NULL;
+	List	   *quals = NIL;
+	ListCell   *lc;
+	int			x;
+
+	/* As in constraint exclusion, volatile quals prove nothing */
+	foreach(lc, plan->scan.plan.qual)
+	{
+		Node	   *qual = (Node *) lfirst(lc);
+
+		if (!contain_volatile_functions(qual))
+			quals = lappend(quals, qual);
+	}
+	if (quals == NIL)
+		return NULL;
+
+	filter = (ColumnarFilterState *) palloc0(sizeof(ColumnarFilterState));
+	filter->scanrelid = plan->scan.scanrelid;
+	filter->tupdesc = tupdesc;
+	filter->quals = quals;
+	filter->ge_oprs = (Oid *) palloc0(tupdesc->natts * sizeof(Oid));
+	filter->le_oprs = (Oid *) palloc0(tupdesc->natts * sizeof(Oid));
+	filter->opintypes = (Oid *) palloc0(tupdesc->natts * sizeof(Oid));
+
+	pull_varattnos((Node *) quals, filter->scanrelid, &attrs_used);
+	while ((x = bms_first_member(attrs_used)) >= 0)
+	{
+		AttrNumber	attnum = x + FirstLowInvalidHeapAttributeNumber;
+		Form_pg_attribute attr;
+		TypeCacheEntry *typentry;
+
+		if (attnum <= 0)
+			continue;
+		attr = tupdesc->attrs[attnum - 1];
+		if (attr->attisdropped)
+			continue;
+
+		/*
+		 * Columns without a btree opclass can still be skipped over by
+		 * strict quals when they are all nulls.
+		 */
+		typentry = lookup_type_cache(attr->atttypid, TYPECACHE_BTREE_OPFAMILY);
+		if (OidIsValid(typentry->btree_opf))
+		{
+			Oid			opintype = typentry->btree_opintype;
+
+			filter->opintypes[attnum - 1] = opintype;
+			filter->ge_oprs[attnum - 1] =
+				get_opfamily_member(typentry->btree_opf, opintype, opintype,
+									BTGreaterEqualStrategyNumber);
+			filter->le_oprs[attnum - 1] =
+				get_opfamily_member(typentry->btree_opf, opintype, opintype,
+									BTLessEqualStrategyNumber);
+		}
+		filter->columns = lappend_int(filter->columns, attnum - 1);
+	}
+
+	return filter;
+}
+
+/*
+ * StripeFilter of the scans: does the stripe's contents, as described by its
+ * min/max values, refute the quals?
+ *
+ * Each column used by the quals contributes "col >= min AND col <= max", and
+ * "col IS NOT NULL" if it has no nulls in the stripe, or "col IS NULL" if it
+ * has nothing else.  Null values don't make the min/max constraints false, so
+ * the proof is sound in the presence of nulls, just like for CHECK
+ * constraints.
+ */
+static bool
+stripe_refuted(StripeHeader *header, void *arg)
+{
+	ColumnarFilterState *filter = (ColumnarFilterState *) arg;
+	ColumnChunkDesc *descs = StripeHeaderDescs(header);
+	List	   *constraints = NIL;
+	ListCell   *lc;
+
+	foreach(lc, filter->columns)
+	{
+		int			i = lfirst_int(lc);
+		Form_pg_attribute attr = filter->tupdesc->attrs[i];
+		Var		   *var;
+
+		var = makeVar(filter->scanrelid, i + 1, attr->atttypid,
+					  attr->atttypmod, attr->attcollation, 0);
+
+		if (i >= header->natts || (descs[i].flags & CHUNK_ALL_NULL))
+		{
+			NullTest   *ntest = makeNode(NullTest);
+
+			ntest->arg = (Expr *) var;
+			ntest->nulltesttype = IS_NULL;
+			ntest->argisrow = false;
+			ntest->location = -1;
+			constraints = lappend(constraints, ntest);
+			continue;
+		}
+
+		if (!(descs[i].flags & CHUNK_HAS_NULLS))
+		{
+			NullTest   *ntest = makeNode(NullTest);
+
+			ntest->arg = (Expr *) var;
+			ntest->nulltesttype = IS_NOT_NULL;
+			ntest->argisrow = false;
+			ntest->location = -1;
+			constraints = lappend(constraints, ntest);
+		}
+
+		if ((descs[i].flags & CHUNK_HAS_MINMAX) &&
+			descs[i].typid == attr->atttypid &&
+			OidIsValid(filter->ge_oprs[i]) &&
+			OidIsValid(filter->le_oprs[i]))
+		{
+			Oid			opintype = filter->opintypes[i];
+			Expr	   *arg = (Expr *) var;
+			Const	   *min;
+			Const	   *max;
+
+			/* Match the implicit coercion the parser puts in the quals */
+			if (opintype != attr->atttypid)
+				arg = (Expr *) makeRelabelType(arg, opintype, -1,
+											   attr->attcollation,
+											   COERCE_IMPLICIT_CAST);
+
+			min = makeConst(opintype, -1, attr->attcollation, attr->attlen,
+							columnar_stripe_min(header, i, attr),
+							false, attr->attbyval);
+			max = makeConst(opintype, -1, attr->attcollation, attr->attlen,
+							columnar_stripe_max(header, i, attr),
+							false, attr->attbyval);
+
+			constraints = lappend(constraints,
+								  make_opclause(filter->ge_oprs[i], BOOLOID,
+												false, arg, (Expr *) min,
+												InvalidOid,
+												attr->attcollation));
+			constraints = lappend(constraints,
+								  make_opclause(filter->le_oprs[i], BOOLOID,
+												false, arg, (Expr *) max,
+												InvalidOid,
+												attr->attcollation));
+		}
+	}
+
+	if (constraints == NIL)
+		return false;
+
+	return predicate_refuted_by(constraints, filter->quals);
+}
+
+/*
+ * columnarIterateForeignScan
+ *		Read next record from the file and store it into the
+ *		ScanTupleSlot as a virtual tuple
+ */
+static TupleTableSlot *
+columnarIterateForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *cstate = (ColumnarScanState *) node->fdw_state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+	ExecClearTuple(slot);
+
+	if (columnar_read_row(cstate->rstate, slot->tts_values, slot->tts_isnull))
+		ExecStoreVirtualTuple(slot);
+
+	return slot;
+}
+
+/*
+ * columnarReScanForeignScan
+ *		Rescan table, possibly with new parameters
+ */
+static void
+columnarReScanForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *cstate = (ColumnarScanState *) node->fdw_state;
+
+	columnar_rescan(cstate->rstate);
+}
+
+/*
+ * columnarEndForeignScan
+ *		Finish scanning foreign table and dispose objects used for this scan
+ */
+static void
+columnarEndForeignScan(ForeignScanState *node)
+{
+	ColumnarScanState *cstate = (ColumnarScanState *) node->fdw_state;
+
+	/* if cstate is NULL, we are in EXPLAIN; nothing to do */
+	if (cstate)
+		columnar_end_read(cstate->rstate);
+}
+
+/*
+ * columnarBeginForeignModify
+ *		Prepare to append the inserted rows to the file
+ */
+static void
+columnarBeginForeignModify(ModifyTableState *mtstate,
+						   ResultRelInfo *rinfo,
+						   List *fdw_private,
+						   int subplan_index,
+						   int eflags)
+{
+	Relation	rel = rinfo->ri_RelationDesc;
+	ColumnarOptions options;
+
+	/*
+	 * Do nothing in EXPLAIN (no ANALYZE) case.  ri_FdwState stays NULL.
+	 */
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	columnarGetOptions(RelationGetRelid(rel), &options);
+
+	rinfo->ri_FdwState = columnar_begin_write(rel, options.filename,
+											  options.compress,
+											  options.stripe_row_count);
+}
+
+/*
+ * columnarExecForeignInsert
+ *		Add one row to the stripe being built
+ */
+static TupleTableSlot *
+columnarExecForeignInsert(EState *estate,
+						  ResultRelInfo *rinfo,
+						  TupleTableSlot *slot,
+						  TupleTableSlot *planSlot)
+{
+	ColumnarWriteState *wstate = (ColumnarWriteState *) rinfo->ri_FdwState;
+
+	slot_getallattrs(slot);
+	columnar_write_row(wstate, slot->tts_values, slot->tts_isnull);
+
+	return slot;
+}
+
+/*
+ * columnarEndForeignModify
+ *		Write out the last stripe
+ */
+static void
+columnarEndForeignModify(EState *estate,
+						 ResultRelInfo *rinfo)
+{
+	ColumnarWriteState *wstate = (ColumnarWriteState *) rinfo->ri_FdwState;
+
+	/* if wstate is NULL, we are in EXPLAIN; nothing to do */
+	if (wstate)
+		columnar_end_write(wstate);
+}
+
+/*
+ * columnarIsForeignRelUpdatable
+ *		Tables are append-only
+ */
+static int
+columnarIsForeignRelUpdatable(Relation rel)
+{
+	return (1 << CMD_INSERT);
+}
+
+/*
+ * columnarAnalyzeForeignTable
+ *		Test whether analyzing this foreign table is supported
+ */
+static bool
+columnarAnalyzeForeignTable(Relation relation,
+							AcquireSampleRowsFunc *func,
+							BlockNumber *totalpages)
+{
+	ColumnarOptions options;
+	struct stat stat_buf;
+
+	columnarGetOptions(RelationGetRelid(relation), &options);
+
+	/*
+	 * Convert size to pages.  Must return at least 1 so that we can tell
+	 * later on that pg_class.relpages is not default.
+	 */
+	*totalpages = 1;
+	if (stat(options.filename, &stat_buf) == 0)
+		*totalpages = Max((stat_buf.st_size + (BLCKSZ - 1)) / BLCKSZ, 1);
+
+	*func = columnar_acquire_sample_rows;
+
+	return true;
+}
+
+/*
+ * columnar_acquire_sample_rows -- acquire a random sample of rows from the
+ * table
+ *
+ * Selected rows are returned in the caller-allocated array rows[],
+ * which must have at least targrows entries.
+ * The actual number of rows selected is returned as the function result.
+ * We also count the total number of rows in the file and return it into
+ * *totalrows.  Note that *totaldeadrows is always set to 0.
+ */
+static int
+columnar_acquire_sample_rows(Relation onerel, int elevel,
+							 HeapTuple *rows, int targrows,
+							 double *totalrows, double *totaldeadrows)
+{
+	int			numrows = 0;
+	double		rowstoskip = -1;	/* -1 means not set yet */
+	ReservoirStateData rstate;
+	TupleDesc	tupDesc = RelationGetDescr(onerel);
+	ColumnarOptions options;
+	ColumnarReadState *reader;
+	Datum	   *values;
+	bool	   *nulls;
+	bool	   *needed;
+
+	Assert(targrows > 0);
+
+	values = (Datum *) palloc(tupDesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupDesc->natts * sizeof(bool));
+	needed = (bool *) palloc(tupDesc->natts * sizeof(bool));
+	memset(needed, true, tupDesc->natts * sizeof(bool));
+
+	columnarGetOptions(RelationGetRelid(onerel), &options);
+	reader = columnar_begin_read(options.filename, tupDesc, needed,
+								 NULL, NULL);
+
+	/* Prepare for sampling rows */
+	reservoir_init_selection_state(&rstate, targrows);
+
+	*totalrows = 0;
+	*totaldeadrows = 0;
+	for (;;)
+	{
+		/* Check for user-requested abort or sleep */
+		vacuum_delay_point();
+
+		if (!columnar_read_row(reader, values, nulls))
+			break;
+
+		/*
+		 * The first targrows sample rows are simply copied into the
+		 * reservoir.  Then we start replacing tuples in the sample until we
+		 * reach the end of the relation. This algorithm is from Jeff Vitter's
+		 * paper (see more info in commands/analyze.c).
+		 */
+		if (numrows < targrows)
+		{
+			rows[numrows++] = heap_form_tuple(tupDesc, values, nulls);
+		}
+		else
+		{
+			/*
+			 * t in Vitter's paper is the number of records already processed.
+			 * If we need to compute a new S value, we must use the
+			 * not-yet-incremented value of totalrows as t.
+			 */
+			if (rowstoskip < 0)
+				rowstoskip = reservoir_get_next_S(&rstate, *totalrows, targrows);
+
+			if (rowstoskip <= 0)
+			{
+				/*
+				 * Found a suitable tuple, so save it, replacing one old tuple
+				 * at random
+				 */
+				int			k = (int) (targrows * sampler_random_fract(rstate.randstate));
+
+				Assert(k >= 0 && k < targrows);
+				heap_freetuple(rows[k]);
+				rows[k] = heap_form_tuple(tupDesc, values, nulls);
+			}
+
+			rowstoskip -= 1;
+		}
+
+		*totalrows += 1;
+	}
+
+	columnar_end_read(reader);
+
+	pfree(values);
+	pfree(nulls);
+	pfree(needed);
+
+	/*
+	 * Emit some interesting relation info
+	 */
+	ereport(elevel,
+			(errmsg("\"%s\": file contains %.0f rows; "
+					"%d rows in sample",
+					RelationGetRelationName(onerel),
+					*totalrows, numrows)));
+
+	return numrows;
+}
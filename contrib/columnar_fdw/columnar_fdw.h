@@ -0,0 +1,153 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_fdw.h
+ *		  on-disk format and stripe access routines of columnar_fdw.
+ *
+ * A columnar_fdw table is a single append-only file holding a sequence of
+ * self-contained stripes.  Each stripe starts with a header describing its
+ * rows, followed by one chunk per column:
+ *
+ *	StripeHeader
+ *	ColumnChunkDesc[natts]
+ *	minimum and maximum values of the columns, MAXALIGN'ed
+ *	column chunks (possibly pglz-compressed), in attribute number order
+ *
+ * A column chunk is a bitmap of non-null rows, laid out like the null bitmap
+ * of a heap tuple, followed by the non-null values aligned and stored as in a
+ * heap tuple.  Varlena values are always stored uncompressed with a 4-byte
+ * header, so that they can be used directly out of the chunk.
+ *
+ * The minimum and maximum values let a scan skip stripes that can't contain
+ * rows satisfying its quals, and the chunk offsets let it read only the
+ * columns it needs.
+ *
+ * Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_fdw.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef COLUMNAR_FDW_H
+#define COLUMNAR_FDW_H
+
+#include "access/tupdesc.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "utils/relcache.h"
+
+#define COLUMNAR_STRIPE_MAGIC		0x52434c43	/* "CLCR" */
+#define COLUMNAR_FORMAT_VERSION		1
+
+#define DEFAULT_STRIPE_ROW_COUNT	150000
+
+typedef struct StripeHeader
+{
+	uint32		magic;			/* COLUMNAR_STRIPE_MAGIC */
+	uint32		version;		/* COLUMNAR_FORMAT_VERSION */
+	uint32		nrows;			/* number of rows in the stripe */
+	uint32		natts;			/* number of column chunks */
+	uint32		header_size;	/* size of the header including min/max */
+	uint32		data_size;		/* total size of the column chunks */
+} StripeHeader;
+
+/* ColumnChunkDesc flags */
+#define CHUNK_COMPRESSED		0x0001	/* chunk is pglz-compressed */
+#define CHUNK_HAS_MINMAX		0x0002	/* min/max values are present */
+#define CHUNK_ALL_NULL			0x0004	/* no non-null values at all */
+#define CHUNK_HAS_NULLS			0x0008	/* some values are null */
+
+typedef struct ColumnChunkDesc
+{
+	Oid			typid;			/* type of the column when it was written */
+	uint32		offset;			/* from the start of the stripe's chunks */
+	uint32		stored_size;	/* size of the chunk in the file */
+	uint32		raw_size;		/* size of the chunk once decompressed */
+	uint32		flags;
+	uint32		min_offset;		/* from the start of the stripe header */
+	uint32		max_offset;
+} ColumnChunkDesc;
+
+#define StripeHeaderDescs(hdr) \
+	((ColumnChunkDesc *) ((char *) (hdr) + MAXALIGN(sizeof(StripeHeader))))
+
+/*
+ * Per-column state of a stripe being built by an INSERT.
+ */
+typedef struct ColumnBuffer
+{
+	StringInfoData values;		/* aligned non-null values */
+	bits8	   *nulls;			/* bitmap of non-null rows */
+	int			nvalues;		/* number of non-null values */
+	bool		has_minmax;		/* min and max below are valid */
+	Datum		min;
+	Datum		max;
+	FmgrInfo   *cmp;			/* btree comparison function, or NULL */
+} ColumnBuffer;
+
+typedef struct ColumnarWriteState
+{
+	Relation	rel;
+	char	   *filename;
+	bool		compress;
+	int			stripe_row_count;
+	TupleDesc	tupdesc;
+	MemoryContext stripe_cxt;	/* holds the buffered stripe */
+	int			nrows;			/* number of rows buffered */
+	bool		checked;		/* file's tail has been checked for debris */
+	ColumnBuffer *columns;
+} ColumnarWriteState;
+
+/*
+ * A stripe loaded by a scan.  Only the columns asked for are loaded.
+ */
+typedef struct ColumnarStripe
+{
+	StripeHeader *header;		/* whole header, including min/max values */
+	char	  **chunks;			/* decompressed chunks, NULL if not loaded */
+	uint32	   *offsets;		/* read position of each loaded column */
+	uint32		row;			/* next row to be returned */
+} ColumnarStripe;
+
+/* Decides whether a stripe can be skipped, given its header */
+typedef bool (*StripeFilter) (StripeHeader *header, void *arg);
+
+typedef struct ColumnarReadState
+{
+	char	   *filename;
+	int			fd;				/* -1 if the file doesn't exist */
+	off_t		position;		/* offset of the next stripe */
+	TupleDesc	tupdesc;
+	bool	   *needed;			/* columns to be read */
+	StripeFilter filter;
+	void	   *filter_arg;
+	MemoryContext stripe_cxt;	/* holds the current stripe */
+	ColumnarStripe *stripe;		/* current stripe, or NULL */
+	long		stripes_read;
+	long		stripes_skipped;
+} ColumnarReadState;
+
+/* columnar_writer.c */
+extern ColumnarWriteState *columnar_begin_write(Relation rel,
+					 const char *filename, bool compress, int stripe_row_count);
+extern void columnar_write_row(ColumnarWriteState *wstate,
+				   Datum *values, bool *isnull);
+extern void columnar_end_write(ColumnarWriteState *wstate);
+
+/* columnar_reader.c */
+extern ColumnarReadState *columnar_begin_read(const char *filename,
+					TupleDesc tupdesc, bool *needed,
+					StripeFilter filter, void *filter_arg);
+extern bool columnar_read_row(ColumnarReadState *rstate,
+				  Datum *values, bool *isnull);
+extern void columnar_rescan(ColumnarReadState *rstate);
+extern void columnar_end_read(ColumnarReadState *rstate);
+extern Datum columnar_stripe_min(StripeHeader *header, int attno,
+					Form_pg_attribute attr);
+extern Datum columnar_stripe_max(StripeHeader *header, int attno,
+					Form_pg_attribute attr);
+extern bool columnar_count_rows(const char *filename, double *nrows,
+					int *nstripes, off_t *size);
+
+#endif   /* COLUMNAR_FDW_H */
@@ -0,0 +1,405 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_reader.c
+ *		  reading the stripes of a columnar_fdw table.
+ *
+ * Only the chunks of the columns a scan asks for are read, and stripes the
+ * scan's filter rejects on the strength of their header are stepped over
+ * without reading any chunk at all.
+ *
+ * A stripe being appended concurrently may be seen only partially; the file
+ * is then treated as ending just before it.
+ *
+ * Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_reader.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "common/pg_lzcompress.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/memutils.h"
+
+#include "columnar_fdw.h"
+
+static int	open_data_file(const char *filename);
+static bool read_at(int fd, const char *filename, off_t offset, char *buf,
+		Size len);
+static StripeHeader *read_stripe_header(int fd, const char *filename,
+				   off_t offset);
+static bool next_stripe(ColumnarReadState *rstate);
+static bool load_stripe(ColumnarReadState *rstate, StripeHeader *header,
+			off_t data_start);
+
+
+/*
+ * Prepare to scan the file of a columnar_fdw table, reading the columns for
+ * which needed[] is set.  If filter isn't NULL, it's called with the header
+ * of each stripe and the stripe is skipped if it returns true.
+ *
+ * A file which doesn't exist yet reads as empty.
+ */
+ColumnarReadState *
+columnar_begin_read(const char *filename, TupleDesc tupdesc, bool *needed,
+					StripeFilter filter, void *filter_arg)
+{
+	ColumnarReadState *rstate;
+
+	rstate = (ColumnarReadState *) palloc0(sizeof(ColumnarReadState));
+	rstate->filename = pstrdup(filename);
+	rstate->tupdesc = tupdesc;
+	rstate->needed = needed;
+	rstate->filter = filter;
+	rstate->filter_arg = filter_arg;
+	rstate->stripe_cxt = AllocSetContextCreate(CurrentMemoryContext,
+											   "columnar_fdw stripe",
+											   ALLOCSET_DEFAULT_SIZES);
+	rstate->fd = open_data_file(filename);
+
+	return rstate;
+}
+
+/*
+ * Fetch the next row into values/isnull.  Columns which aren't needed are
+ * returned as nulls.  Values of pass-by-reference types point into the
+ * current stripe, so they are only valid until the next call.
+ *
+ * Returns false at the end of the file.
+ */
+bool
+columnar_read_row(ColumnarReadState *rstate, Datum *values, bool *isnull)
+{
+	TupleDesc	tupdesc = rstate->tupdesc;
+	ColumnarStripe *stripe;
+	uint32		row;
+	int			i;
+
+	while (rstate->stripe == NULL ||
+		   rstate->stripe->row >= rstate->stripe->header->nrows)
+	{
+		if (!next_stripe(rstate))
+			return false;
+	}
+
+	stripe = rstate->stripe;
+	row = stripe->row++;
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		char	   *chunk = stripe->chunks[i];
+		uint32		offset;
+
+		if (chunk == NULL || att_isnull(row, (bits8 *) chunk))
+		{
+			values[i] = (Datum) 0;
+			isnull[i] = true;
+			continue;
+		}
+
+		offset = att_align_nominal(stripe->offsets[i], attr->attalign);
+		values[i] = fetchatt(attr, chunk + offset);
+		isnull[i] = false;
+		stripe->offsets[i] = att_addlength_pointer(offset, attr->attlen,
+												   chunk + offset);
+	}
+
+	return true;
+}
+
+/*
+ * Start over from the first stripe.
+ */
+void
+columnar_rescan(ColumnarReadState *rstate)
+{
+	MemoryContextReset(rstate->stripe_cxt);
+	rstate->stripe = NULL;
+	rstate->position = 0;
+
+	/* The file may have been created by now */
+	if (rstate->fd < 0)
+		rstate->fd = open_data_file(rstate->filename);
+}
+
+void
+columnar_end_read(ColumnarReadState *rstate)
+{
+	if (rstate->fd >= 0)
+		CloseTransientFile(rstate->fd);
+	MemoryContextDelete(rstate->stripe_cxt);
+}
+
+/*
+ * Minimum and maximum values of a column of a stripe having
+ * CHUNK_HAS_MINMAX set.  The values point into the header.
+ */
+Datum
+columnar_stripe_min(StripeHeader *header, int attno, Form_pg_attribute attr)
+{
+	ColumnChunkDesc *desc = &StripeHeaderDescs(header)[attno];
+
+	Assert(desc->flags & CHUNK_HAS_MINMAX);
+	return fetchatt(attr, (char *) header + desc->min_offset);
+}
+
+Datum
+columnar_stripe_max(StripeHeader *header, int attno, Form_pg_attribute attr)
+{
+	ColumnChunkDesc *desc = &StripeHeaderDescs(header)[attno];
+
+	Assert(desc->flags & CHUNK_HAS_MINMAX);
+	return fetchatt(attr, (char *) header + desc->max_offset);
+}
+
+/*
+ * Count the rows of a columnar_fdw table by walking the stripe headers, for
+ * planning.  Returns false if the file doesn't exist.
+ */
+bool
+columnar_count_rows(const char *filename, double *nrows, int *nstripes,
+					off_t *size)
+{
+	int			fd = open_data_file(filename);
+	off_t		offset = 0;
+	struct stat st;
+
+	*nrows = 0;
+	*nstripes = 0;
+	*size = 0;
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", filename)));
+	*size = st.st_size;
+
+	for (;;)
+	{
+		StripeHeader hdr;
+
+		if (!read_at(fd, filename, offset, (char *) &hdr, sizeof(hdr)) ||
+			hdr.magic != COLUMNAR_STRIPE_MAGIC)
+			break;
+		*nrows += hdr.nrows;
+		*nstripes += 1;
+		offset += (off_t) hdr.header_size + (off_t) hdr.data_size;
+	}
+
+	CloseTransientFile(fd);
+
+	return true;
+}
+
+/*
+ * Open the file for reading, returning -1 if it doesn't exist.
+ */
+static int
+open_data_file(const char *filename)
+{
+	int			fd = OpenTransientFile((char *) filename, O_RDONLY | PG_BINARY,
+									   0);
+
+	if (fd < 0 && errno != ENOENT)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\" for reading: %m",
+						filename)));
+	return fd;
+}
+
+/*
+ * Read len bytes at offset.  Returns false if the file ends before that.
+ */
+static bool
+read_at(int fd, const char *filename, off_t offset, char *buf, Size len)
+{
+	if (lseek(fd, offset, SEEK_SET) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in file \"%s\": %m", filename)));
+
+	while (len > 0)
+	{
+		ssize_t		nread = read(fd, buf, len);
+
+		if (nread < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m", filename)));
+		if (nread == 0)
+			return false;
+		buf += nread;
+		len -= nread;
+	}
+	return true;
+}
+
+/*
+ * Read the header of the stripe at offset into the current memory context.
+ * Returns NULL at the end of the file.
+ */
+static StripeHeader *
+read_stripe_header(int fd, const char *filename, off_t offset)
+{
+	StripeHeader hdr;
+	StripeHeader *header;
+	Size		fixed_size;
+
+	if (!read_at(fd, filename, offset, (char *) &hdr, sizeof(hdr)))
+		return NULL;
+
+	fixed_size = MAXALIGN(sizeof(StripeHeader)) +
+		(Size) hdr.natts * sizeof(ColumnChunkDesc);
+	if (hdr.magic != COLUMNAR_STRIPE_MAGIC ||
+		hdr.version != COLUMNAR_FORMAT_VERSION ||
+		hdr.natts > MaxHeapAttributeNumber ||
+		hdr.header_size < fixed_size ||
+		!AllocSizeIsValid(hdr.header_size))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid stripe header at offset " INT64_FORMAT " of file \"%s\"",
+						(int64) offset, filename)));
+
+	header = (StripeHeader *) palloc(hdr.header_size);
+	if (!read_at(fd, filename, offset, (char *) header, hdr.header_size))
+		return NULL;
+
+	return header;
+}
+
+/*
+ * Move on to the next stripe which passes the filter.  Returns false at the
+ * end of the file.
+ */
+static bool
+next_stripe(ColumnarReadState *rstate)
+{
+	MemoryContext oldcontext;
+	bool		found = false;
+
+	rstate->stripe = NULL;
+	if (rstate->fd < 0)
+		return false;
+
+	oldcontext = MemoryContextSwitchTo(rstate->stripe_cxt);
+
+	for (;;)
+	{
+		StripeHeader *header;
+		off_t		data_start;
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContextReset(rstate->stripe_cxt);
+
+		header = read_stripe_header(rstate->fd, rstate->filename,
+									rstate->position);
+		if (header == NULL)
+			break;
+
+		data_start = rstate->position + header->header_size;
+
+		if (rstate->filter && rstate->filter(header, rstate->filter_arg))
+		{
+			rstate->stripes_skipped += 1;
+			rstate->position = data_start + header->data_size;
+			continue;
+		}
+
+		if (!load_stripe(rstate, header, data_start))
+			break;
+
+		rstate->stripes_read += 1;
+		rstate->position = data_start + header->data_size;
+		found = true;
+		break;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return found;
+}
+
+/*
+ * Read and decompress the chunks of the needed columns of a stripe.  Returns
+ * false if the stripe isn't completely written yet.
+ */
+static bool
+load_stripe(ColumnarReadState *rstate, StripeHeader *header, off_t data_start)
+{
+	TupleDesc	tupdesc = rstate->tupdesc;
+	ColumnChunkDesc *descs = StripeHeaderDescs(header);
+	ColumnarStripe *stripe;
+	int			i;
+
+	stripe = (ColumnarStripe *) palloc0(sizeof(ColumnarStripe));
+	stripe->header = header;
+	stripe->chunks = (char **) palloc0(tupdesc->natts * sizeof(char *));
+	stripe->offsets = (uint32 *) palloc0(tupdesc->natts * sizeof(uint32));
+
+	/* Columns added after the stripe was written read as nulls */
+	for (i = 0; i < tupdesc->natts && i < header->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		ColumnChunkDesc *desc = &descs[i];
+		char	   *stored;
+
+		if (!rstate->needed[i] || attr->attisdropped ||
+			(desc->flags & CHUNK_ALL_NULL))
+			continue;
+
+		if (desc->typid != attr->atttypid)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("column \"%s\" was written to file \"%s\" with a different type",
+							NameStr(attr->attname), rstate->filename)));
+
+		if (desc->raw_size < MAXALIGN(BITMAPLEN(header->nrows)) ||
+			!AllocSizeIsValid(desc->raw_size) ||
+			!AllocSizeIsValid(desc->stored_size))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("invalid chunk of column \"%s\" in file \"%s\"",
+							NameStr(attr->attname), rstate->filename)));
+
+		stored = (char *) palloc(desc->stored_size);
+		if (!read_at(rstate->fd, rstate->filename, data_start + desc->offset,
+					 stored, desc->stored_size))
+			return false;
+
+		if (desc->flags & CHUNK_COMPRESSED)
+		{
+			char	   *raw = (char *) palloc(desc->raw_size);
+
+			if (pglz_decompress(stored, desc->stored_size, raw,
+								desc->raw_size) != desc->raw_size)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATA_CORRUPTED),
+						 errmsg("compressed chunk of column \"%s\" in file \"%s\" is corrupt",
+								NameStr(attr->attname), rstate->filename)));
+			pfree(stored);
+			stored = raw;
+		}
+
+		stripe->chunks[i] = stored;
+		stripe->offsets[i] = MAXALIGN(BITMAPLEN(header->nrows));
+	}
+
+	rstate->stripe = stripe;
+
+	return true;
+}
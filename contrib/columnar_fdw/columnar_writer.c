@@ -0,0 +1,485 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_writer.c
+ *		  buffering of inserted rows into stripes and appending them to the
+ *		  file of a columnar_fdw table.
+ *
+ * Rows are accumulated column by column in memory until stripe_row_count of
+ * them have been collected or the INSERT ends, then the whole stripe is
+ * appended to the file at once.  Writers of the same table are serialized by
+ * the relation extension lock while they append a stripe, so stripes written
+ * concurrently never interleave.
+ *
+ * Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/columnar_fdw/columnar_writer.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "common/pg_lzcompress.h"
+#include "storage/fd.h"
+#include "storage/lmgr.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/typcache.h"
+
+#include "columnar_fdw.h"
+
+static void reset_stripe(ColumnarWriteState *wstate);
+static void flush_stripe(ColumnarWriteState *wstate);
+static int append_value(StringInfo buf, Datum value, Form_pg_attribute attr,
+			 char align);
+static void update_minmax(ColumnBuffer *col, Datum value,
+			  Form_pg_attribute attr);
+static off_t find_valid_end(int fd, const char *filename);
+static void write_all(int fd, const char *filename, off_t start,
+		  const char *data, Size len);
+
+
+/*
+ * Prepare to append rows to the file of a columnar_fdw table.
+ */
+ColumnarWriteState *
+columnar_begin_write(Relation rel, const char *filename, bool compress,
+					 int stripe_row_count)
+{
+	ColumnarWriteState *wstate;
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	int			i;
+
+	wstate = (ColumnarWriteState *) palloc0(sizeof(ColumnarWriteState));
+	wstate->rel = rel;
+	wstate->filename = pstrdup(filename);
+	wstate->compress = compress;
+	wstate->stripe_row_count = stripe_row_count;
+	wstate->tupdesc = tupdesc;
+	wstate->stripe_cxt = AllocSetContextCreate(CurrentMemoryContext,
+											   "columnar_fdw stripe",
+											   ALLOCSET_DEFAULT_SIZES);
+	wstate->columns = (ColumnBuffer *)
+		palloc0(tupdesc->natts * sizeof(ColumnBuffer));
+
+	/* Keep minimum and maximum of the columns having a btree opclass */
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		TypeCacheEntry *typentry;
+
+		if (attr->attisdropped)
+			continue;
+
+		typentry = lookup_type_cache(attr->atttypid,
+									 TYPECACHE_CMP_PROC_FINFO);
+		if (OidIsValid(typentry->cmp_proc_finfo.fn_oid))
+			wstate->columns[i].cmp = &typentry->cmp_proc_finfo;
+	}
+
+	reset_stripe(wstate);
+
+	return wstate;
+}
+
+/*
+ * Add a row to the stripe being built, appending the stripe to the file once
+ * it's full.
+ */
+void
+columnar_write_row(ColumnarWriteState *wstate, Datum *values, bool *isnull)
+{
+	TupleDesc	tupdesc = wstate->tupdesc;
+	MemoryContext oldcontext;
+	int			row = wstate->nrows;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(wstate->stripe_cxt);
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		ColumnBuffer *col = &wstate->columns[i];
+		Datum		value = values[i];
+
+		if (attr->attisdropped || isnull[i])
+			continue;
+
+		/* Varlenas are stored plain, so that they can be used in place */
+		if (attr->attlen == -1)
+			value = PointerGetDatum(PG_DETOAST_DATUM(value));
+
+		col->nulls[row >> 3] |= 1 << (row & 0x07);
+		col->nvalues += 1;
+		append_value(&col->values, value, attr, attr->attalign);
+
+		if (col->cmp)
+			update_minmax(col, value, attr);
+
+		if (DatumGetPointer(value) != DatumGetPointer(values[i]))
+			pfree(DatumGetPointer(value));
+	}
+	wstate->nrows += 1;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (wstate->nrows >= wstate->stripe_row_count)
+		flush_stripe(wstate);
+}
+
+/*
+ * Append the last, partially filled stripe and release the write state.
+ */
+void
+columnar_end_write(ColumnarWriteState *wstate)
+{
+	flush_stripe(wstate);
+	MemoryContextDelete(wstate->stripe_cxt);
+	pfree(wstate->columns);
+	pfree(wstate->filename);
+	pfree(wstate);
+}
+
+/*
+ * Start building a new stripe.
+ */
+static void
+reset_stripe(ColumnarWriteState *wstate)
+{
+	MemoryContext oldcontext;
+	int			i;
+
+	MemoryContextReset(wstate->stripe_cxt);
+	oldcontext = MemoryContextSwitchTo(wstate->stripe_cxt);
+
+	for (i = 0; i < wstate->tupdesc->natts; i++)
+	{
+		ColumnBuffer *col = &wstate->columns[i];
+
+		initStringInfo(&col->values);
+		col->nulls = (bits8 *) palloc0(BITMAPLEN(wstate->stripe_row_count));
+		col->nvalues = 0;
+		col->has_minmax = false;
+	}
+	wstate->nrows = 0;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Append a non-null value to buf, aligning it as in a heap tuple, and return
+ * its offset.
+ *
+ * The data of a StringInfo is MAXALIGN'ed, so aligning offsets relative to
+ * its start is enough for the values to be fetched in place later.
+ */
+static int
+append_value(StringInfo buf, Datum value, Form_pg_attribute attr, char align)
+{
+	int			offset = att_align_nominal(buf->len, align);
+	Size		size = datumGetSize(value, attr->attbyval, attr->attlen);
+
+	enlargeStringInfo(buf, offset - buf->len + size);
+	memset(buf->data + buf->len, 0, offset - buf->len);
+
+	if (attr->attbyval)
+		store_att_byval(buf->data + offset, value, attr->attlen);
+	else
+		memcpy(buf->data + offset, DatumGetPointer(value), size);
+
+	buf->len = offset + size;
+	buf->data[buf->len] = '\0';
+
+	return offset;
+}
+
+/*
+ * Track the smallest and largest value of a column in the stripe.
+ */
+static void
+update_minmax(ColumnBuffer *col, Datum value, Form_pg_attribute attr)
+{
+	if (!col->has_minmax)
+	{
+		col->min = datumCopy(value, attr->attbyval, attr->attlen);
+		col->max = datumCopy(value, attr->attbyval, attr->attlen);
+		col->has_minmax = true;
+		return;
+	}
+
+	if (DatumGetInt32(FunctionCall2Coll(col->cmp, attr->attcollation,
+										value, col->min)) < 0)
+	{
+		if (!attr->attbyval)
+			pfree(DatumGetPointer(col->min));
+		col->min = datumCopy(value, attr->attbyval, attr->attlen);
+	}
+	else if (DatumGetInt32(FunctionCall2Coll(col->cmp, attr->attcollation,
+											 value, col->max)) > 0)
+	{
+		if (!attr->attbyval)
+			pfree(DatumGetPointer(col->max));
+		col->max = datumCopy(value, attr->attbyval, attr->attlen);
+	}
+}
+
+/*
+ * Build the header and the column chunks of the buffered stripe and append
+ * them to the file.
+ */
+static void
+flush_stripe(ColumnarWriteState *wstate)
+{
+	TupleDesc	tupdesc = wstate->tupdesc;
+	int			natts = tupdesc->natts;
+	int			nrows = wstate->nrows;
+	Size		bitmaplen = MAXALIGN(BITMAPLEN(nrows));
+	MemoryContext oldcontext;
+	StringInfoData header;
+	StripeHeader *hdr;
+	ColumnChunkDesc *descs;
+	char	  **chunks;
+	uint32		data_size = 0;
+	int			fd;
+	off_t		start;
+	int			i;
+
+	if (nrows == 0)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(wstate->stripe_cxt);
+
+	/* Header is followed by the column descriptors and min/max values */
+	initStringInfo(&header);
+	enlargeStringInfo(&header, MAXALIGN(sizeof(StripeHeader)) +
+					  natts * sizeof(ColumnChunkDesc));
+	memset(header.data, 0,
+		   MAXALIGN(sizeof(StripeHeader)) + natts * sizeof(ColumnChunkDesc));
+	header.len = MAXALIGN(sizeof(StripeHeader)) +
+		natts * sizeof(ColumnChunkDesc);
+
+	chunks = (char **) palloc0(natts * sizeof(char *));
+
+	for (i = 0; i < natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		ColumnBuffer *col = &wstate->columns[i];
+		ColumnChunkDesc desc;
+		uint32		raw_size;
+		char	   *raw;
+
+		memset(&desc, 0, sizeof(desc));
+		desc.typid = attr->atttypid;
+		desc.offset = data_size;
+
+		if (attr->attisdropped || col->values.len == 0)
+		{
+			desc.flags = CHUNK_ALL_NULL;
+			memcpy(StripeHeaderDescs(header.data) + i, &desc, sizeof(desc));
+			continue;
+		}
+
+		if (col->nvalues < nrows)
+			desc.flags |= CHUNK_HAS_NULLS;
+
+		if (col->has_minmax)
+		{
+			desc.flags |= CHUNK_HAS_MINMAX;
+			desc.min_offset = append_value(&header, col->min, attr, 'd');
+			desc.max_offset = append_value(&header, col->max, attr, 'd');
+		}
+
+		/* Chunk is the bitmap of non-null rows followed by the values */
+		raw_size = bitmaplen + col->values.len;
+		raw = (char *) palloc0(raw_size);
+		memcpy(raw, col->nulls, BITMAPLEN(nrows));
+		memcpy(raw + bitmaplen, col->values.data, col->values.len);
+		pfree(col->values.data);
+		col->values.data = NULL;
+
+		desc.raw_size = raw_size;
+		desc.stored_size = raw_size;
+		chunks[i] = raw;
+
+		if (wstate->compress)
+		{
+			char	   *compressed = (char *) palloc(PGLZ_MAX_OUTPUT(raw_size));
+			int32		len;
+
+			len = pglz_compress(raw, raw_size, compressed,
+								PGLZ_strategy_default);
+			if (len >= 0)
+			{
+				desc.flags |= CHUNK_COMPRESSED;
+				desc.stored_size = len;
+				chunks[i] = compressed;
+				pfree(raw);
+			}
+			else
+				pfree(compressed);
+		}
+
+		if (desc.stored_size > PG_UINT32_MAX - data_size)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+					 errmsg("stripe of foreign table \"%s\" is too large",
+							RelationGetRelationName(wstate->rel)),
+					 errhint("Lower the table's stripe_row_count option.")));
+		data_size += desc.stored_size;
+		memcpy(StripeHeaderDescs(header.data) + i, &desc, sizeof(desc));
+	}
+
+	/* Pad the header, so that the min/max values stay aligned once read */
+	enlargeStringInfo(&header, MAXALIGN(header.len) - header.len);
+	memset(header.data + header.len, 0, MAXALIGN(header.len) - header.len);
+	header.len = MAXALIGN(header.len);
+
+	hdr = (StripeHeader *) header.data;
+	hdr->magic = COLUMNAR_STRIPE_MAGIC;
+	hdr->version = COLUMNAR_FORMAT_VERSION;
+	hdr->nrows = nrows;
+	hdr->natts = natts;
+	hdr->header_size = header.len;
+	hdr->data_size = data_size;
+	descs = StripeHeaderDescs(hdr);
+
+	/*
+	 * Append the stripe.  The extension lock keeps concurrent writers from
+	 * interleaving their stripes; readers only ever look at whole stripes.
+	 */
+	LockRelationForExtension(wstate->rel, ExclusiveLock);
+
+	fd = OpenTransientFile(wstate->filename, O_RDWR | O_CREAT | PG_BINARY,
+						   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", wstate->filename)));
+
+	/*
+	 * A stripe cut short by a crash would hide everything appended after it,
+	 * so the first time around make sure the file ends with a whole stripe.
+	 */
+	if (!wstate->checked)
+	{
+		start = find_valid_end(fd, wstate->filename);
+		wstate->checked = true;
+	}
+	else if ((start = lseek(fd, 0, SEEK_END)) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in file \"%s\": %m",
+						wstate->filename)));
+
+	write_all(fd, wstate->filename, start, header.data, header.len);
+	for (i = 0; i < natts; i++)
+	{
+		if (chunks[i] != NULL)
+			write_all(fd, wstate->filename, start, chunks[i],
+					  descs[i].stored_size);
+	}
+
+	if (pg_fsync(fd) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not fsync file \"%s\": %m", wstate->filename)));
+
+	CloseTransientFile(fd);
+
+	UnlockRelationForExtension(wstate->rel, ExclusiveLock);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	reset_stripe(wstate);
+}
+
+/*
+ * Find the end of the last whole stripe of the file, truncating whatever
+ * follows it, and leave the file positioned there.
+ */
+static off_t
+find_valid_end(int fd, const char *filename)
+{
+	struct stat st;
+	off_t		end = 0;
+
+	if (fstat(fd, &st) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat file \"%s\": %m", filename)));
+
+	for (;;)
+	{
+		StripeHeader hdr;
+		off_t		next;
+
+		if (lseek(fd, end, SEEK_SET) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in file \"%s\": %m", filename)));
+		if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+			hdr.magic != COLUMNAR_STRIPE_MAGIC)
+			break;
+		next = end + (off_t) hdr.header_size + (off_t) hdr.data_size;
+		if (next > st.st_size)
+			break;
+		end = next;
+	}
+
+	if (end < st.st_size)
+	{
+		ereport(LOG,
+				(errmsg("truncating incomplete stripe at offset " INT64_FORMAT " of file \"%s\"",
+						(int64) end, filename)));
+		if (ftruncate(fd, end) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not truncate file \"%s\": %m", filename)));
+	}
+
+	if (lseek(fd, end, SEEK_SET) < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in file \"%s\": %m", filename)));
+
+	return end;
+}
+
+/*
+ * Write len bytes at the current position.  On failure, the part of the
+ * stripe written so far is cut off again, so that it doesn't get in the way
+ * of the next writer.
+ */
+static void
+write_all(int fd, const char *filename, off_t start, const char *data,
+		  Size len)
+{
+	while (len > 0)
+	{
+		ssize_t		written = write(fd, data, len);
+
+		if (written <= 0)
+		{
+			int			save_errno = errno;
+
+			/* if write didn't set errno, assume problem is no disk space */
+			if (written == 0 || save_errno == 0)
+				save_errno = ENOSPC;
+			if (ftruncate(fd, start) < 0)
+				elog(LOG, "could not truncate file \"%s\": %m", filename);
+			errno = save_errno;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to file \"%s\": %m", filename)));
+		}
+		data += written;
+		len -= written;
+	}
+}
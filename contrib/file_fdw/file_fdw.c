@@ -16,6 +16,7 @@
 #include <unistd.h>
 
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/reloptions.h"
 #include "access/sysattr.h"
 #include "catalog/pg_foreign_table.h"
@@ -29,9 +30,12 @@
 #include "nodes/makefuncs.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
 #include "optimizer/var.h"
+#include "port/atomics.h"
+#include "storage/fd.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/sampling.h"
@@ -85,20 +89,38 @@ static const struct FileFdwOption valid_options[] = {
  */
 typedef struct FileFdwPlanState
 {
-	char	   *filename;		/* file to read */
+	char	   *filename;		/* file(s) to read, possibly a pattern */
 	List	   *options;		/* merged COPY options, excluding filename */
-	BlockNumber pages;			/* estimate of file's physical size */
-	double		ntuples;		/* estimate of number of rows in file */
+	int			nfiles;			/* number of files found at plan time */
+	BlockNumber pages;			/* estimate of files' physical size */
+	double		ntuples;		/* estimate of number of rows in files */
 } FileFdwPlanState;
 
+/*
+ * Shared state of a parallel scan, kept in dynamic shared memory.
+ *
+ * The leader expands the filename option and publishes the resulting file
+ * names here, so that all participants agree on what is to be read.  Each
+ * participant then claims whole files, one at a time, by advancing next_file.
+ */
+typedef struct FileFdwParallelState
+{
+	pg_atomic_uint32 next_file; /* index of the next file to be claimed */
+	int			nfiles;			/* number of file names that follow */
+	char		filenames[FLEXIBLE_ARRAY_MEMBER];	/* NUL-terminated names */
+} FileFdwParallelState;
+
 /*
  * FDW-specific information for ForeignScanState.fdw_state.
  */
 typedef struct FileFdwExecutionState
 {
-	char	   *filename;		/* file to read */
+	char	   *filename;		/* file(s) to read, possibly a pattern */
 	List	   *options;		/* merged COPY options, excluding filename */
-	CopyState	cstate;			/* state of reading file */
+	List	   *files;			/* expanded list of files to read */
+	int			next_file;		/* index of next file to read, if serial */
+	FileFdwParallelState *pstate;	/* shared state, if parallel */
+	CopyState	cstate;			/* state of reading current file, or NULL */
 } FileFdwExecutionState;
 
 /*
@@ -133,6 +155,17 @@ static bool fileAnalyzeForeignTable(Relation relation,
 						BlockNumber *totalpages);
 static bool fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
 							  RangeTblEntry *rte);
+static Size fileEstimateDSMForeignScan(ForeignScanState *node,
+						   ParallelContext *pcxt);
+static void fileInitializeDSMForeignScan(ForeignScanState *node,
+							 ParallelContext *pcxt,
+							 void *coordinate);
+static void fileReInitializeDSMForeignScan(ForeignScanState *node,
+							   ParallelContext *pcxt,
+							   void *coordinate);
+static void fileInitializeWorkerForeignScan(ForeignScanState *node,
+								shm_toc *toc,
+								void *coordinate);
 
 /*
  * Helper functions
@@ -141,14 +174,20 @@ static bool is_valid_option(const char *option, Oid context);
 static void fileGetOptions(Oid foreigntableid,
 			   char **filename, List **other_options);
 static List *get_file_fdw_attribute_options(Oid relid);
+static List *expand_filename(const char *filename, bool missing_ok);
+static bool filename_matches(const char *pattern, const char *name);
+static int	filename_cmp(const void *a, const void *b);
+static bool begin_next_file(ForeignScanState *node,
+				FileFdwExecutionState *festate);
 static bool check_selective_binary_conversion(RelOptInfo *baserel,
 								  Oid foreigntableid,
 								  List **columns);
 static void estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 			  FileFdwPlanState *fdw_private);
 static void estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   FileFdwPlanState *fdw_private,
+			   FileFdwPlanState *fdw_private, int parallel_workers,
 			   Cost *startup_cost, Cost *total_cost);
+static double parallel_divisor(int parallel_workers);
 static int file_acquire_sample_rows(Relation onerel, int elevel,
 						 HeapTuple *rows, int targrows,
 						 double *totalrows, double *totaldeadrows);
@@ -173,6 +212,10 @@ file_fdw_handler(PG_FUNCTION_ARGS)
 	fdwroutine->EndForeignScan = fileEndForeignScan;
 	fdwroutine->AnalyzeForeignTable = fileAnalyzeForeignTable;
 	fdwroutine->IsForeignScanParallelSafe = fileIsForeignScanParallelSafe;
+	fdwroutine->EstimateDSMForeignScan = fileEstimateDSMForeignScan;
+	fdwroutine->InitializeDSMForeignScan = fileInitializeDSMForeignScan;
+	fdwroutine->ReInitializeDSMForeignScan = fileReInitializeDSMForeignScan;
+	fdwroutine->InitializeWorkerForeignScan = fileInitializeWorkerForeignScan;
 
 	PG_RETURN_POINTER(fdwroutine);
 }
@@ -463,6 +506,117 @@ get_file_fdw_attribute_options(Oid relid)
 	return options;
 }
 
+/*
+ * Expand the filename option into the list of files to be read.
+ *
+ * If the last component of the path contains the wildcards '*' or '?', it is
+ * matched against the entries of the directory named by the rest of the
+ * path, and the regular files that match are returned in order of name.
+ * Names beginning with a dot only match a pattern that does too.  Otherwise
+ * the filename is returned unchanged, so that a missing file is reported by
+ * COPY just as it always has been.
+ *
+ * If missing_ok, return NIL rather than failing if the directory can't be
+ * read; that's wanted at plan time, when the files needn't exist yet.
+ */
+static List *
+expand_filename(const char *filename, bool missing_ok)
+{
+	char	   *sep = last_dir_separator(filename);
+	const char *pattern = sep ? sep + 1 : filename;
+	char	   *dirname;
+	DIR		   *dir;
+	struct dirent *de;
+	char	  **names;
+	int			nnames = 0;
+	int			maxnames = 16;
+	List	   *result = NIL;
+	int			i;
+
+	if (strpbrk(pattern, "*?") == NULL)
+		return list_make1(pstrdup(filename));
+
+	dirname = sep ? pnstrdup(filename, sep - filename + 1) : pstrdup(".");
+
+	dir = AllocateDir(dirname);
+	if (dir == NULL && missing_ok)
+		return NIL;
+
+	names = (char **) palloc(maxnames * sizeof(char *));
+	while ((de = ReadDir(dir, dirname)) != NULL)
+	{
+		char	   *path;
+		struct stat stat_buf;
+
+		if (de->d_name[0] == '.' && pattern[0] != '.')
+			continue;
+		if (!filename_matches(pattern, de->d_name))
+			continue;
+
+		path = sep ? psprintf("%s%s", dirname, de->d_name) :
+			pstrdup(de->d_name);
+		if (stat(path, &stat_buf) < 0 || !S_ISREG(stat_buf.st_mode))
+		{
+			pfree(path);
+			continue;
+		}
+
+		if (nnames >= maxnames)
+		{
+			maxnames *= 2;
+			names = (char **) repalloc(names, maxnames * sizeof(char *));
+		}
+		names[nnames++] = path;
+	}
+	FreeDir(dir);
+
+	qsort(names, nnames, sizeof(char *), filename_cmp);
+	for (i = 0; i < nnames; i++)
+		result = lappend(result, names[i]);
+	pfree(names);
+
+	return result;
+}
+
+/*
+ * Does name match the shell-style pattern, in which '*' stands for any
+ * sequence of characters and '?' for any single character?
+ */
+static bool
+filename_matches(const char *pattern, const char *name)
+{
+	while (*pattern)
+	{
+		if (*pattern == '*')
+		{
+			while (*pattern == '*')
+				pattern++;
+			if (*pattern == '\0')
+				return true;
+			for (; *name; name++)
+			{
+				if (filename_matches(pattern, name))
+					return true;
+			}
+			return false;
+		}
+		if (*name == '\0')
+			return false;
+		if (*pattern != '?' && *pattern != *name)
+			return false;
+		pattern++;
+		name++;
+	}
+	return *name == '\0';
+}
+
+/* qsort comparator for file names */
+static int
+filename_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
 /*
  * fileGetForeignRelSize
  *		Obtain relation size estimates for a foreign table
@@ -493,7 +647,8 @@ fileGetForeignRelSize(PlannerInfo *root,
  *
  *		Currently we don't support any push-down feature, so there is only one
  *		possible access path, which simply returns all records in the order in
- *		the data file.
+ *		the data files.  When there are several files, we also offer a partial
+ *		path, in which each participant of a parallel scan reads whole files.
  */
 static void
 fileGetForeignPaths(PlannerInfo *root,
@@ -514,7 +669,7 @@ fileGetForeignPaths(PlannerInfo *root,
 										  (Node *) columns));
 
 	/* Estimate costs */
-	estimate_costs(root, baserel, fdw_private,
+	estimate_costs(root, baserel, fdw_private, 0,
 				   &startup_cost, &total_cost);
 
 	/*
@@ -533,6 +688,44 @@ fileGetForeignPaths(PlannerInfo *root,
 									 NULL,		/* no extra plan */
 									 coptions));
 
+	/*
+	 * Consider a parallel scan as well.  Files aren't split between
+	 * participants, so there's no point in having more workers than files.
+	 */
+	if (baserel->consider_parallel && fdw_private->nfiles > 1)
+	{
+		int			parallel_workers;
+
+		parallel_workers = compute_parallel_worker(baserel,
+												   fdw_private->pages);
+		parallel_workers = Min(parallel_workers, fdw_private->nfiles);
+
+		if (parallel_workers > 0)
+		{
+			ForeignPath *path;
+			double		rows;
+
+			/* Each participant returns its share of the rows */
+			rows = clamp_row_est(baserel->rows /
+								 parallel_divisor(parallel_workers));
+
+			estimate_costs(root, baserel, fdw_private, parallel_workers,
+						   &startup_cost, &total_cost);
+			path = create_foreignscan_path(root, baserel,
+										   NULL,	/* default pathtarget */
+										   rows,
+										   startup_cost,
+										   total_cost,
+										   NIL, /* no pathkeys */
+										   NULL,	/* no outer rel either */
+										   NULL,	/* no extra plan */
+										   coptions);
+			path->path.parallel_aware = true;
+			path->path.parallel_workers = parallel_workers;
+			add_partial_path(baserel, (Path *) path);
+		}
+	}
+
 	/*
 	 * If data file was sorted, and we knew it somehow, we could insert
 	 * appropriate pathkeys into the ForeignPath node to tell the planner
@@ -594,11 +787,24 @@ fileExplainForeignScan(ForeignScanState *node, ExplainState *es)
 	/* Suppress file size if we're not showing cost details */
 	if (es->costs)
 	{
-		struct stat stat_buf;
+		List	   *files = expand_filename(filename, true);
+		bool		found = false;
+		off_t		total_size = 0;
+		ListCell   *lc;
 
-		if (stat(filename, &stat_buf) == 0)
-			ExplainPropertyLong("Foreign File Size", (long) stat_buf.st_size,
-								es);
+		foreach(lc, files)
+		{
+			struct stat stat_buf;
+
+			if (stat((char *) lfirst(lc), &stat_buf) == 0)
+			{
+				total_size += stat_buf.st_size;
+				found = true;
+			}
+		}
+
+		if (found)
+			ExplainPropertyLong("Foreign File Size", (long) total_size, es);
 	}
 }
 
@@ -612,7 +818,6 @@ fileBeginForeignScan(ForeignScanState *node, int eflags)
 	ForeignScan *plan = (ForeignScan *) node->ss.ps.plan;
 	char	   *filename;
 	List	   *options;
-	CopyState	cstate;
 	FileFdwExecutionState *festate;
 
 	/*
@@ -628,31 +833,73 @@ fileBeginForeignScan(ForeignScanState *node, int eflags)
 	/* Add any options from the plan (currently only convert_selectively) */
 	options = list_concat(options, plan->fdw_private);
 
-	/*
-	 * Create CopyState from FDW options.  We always acquire all columns, so
-	 * as to match the expected ScanTupleSlot signature.
-	 */
-	cstate = BeginCopyFrom(node->ss.ss_currentRelation,
-						   filename,
-						   false,
-						   NIL,
-						   options);
-
 	/*
 	 * Save state in node->fdw_state.  We must save enough information to call
-	 * BeginCopyFrom() again.
+	 * BeginCopyFrom() again for each file, and on rescan.
 	 */
-	festate = (FileFdwExecutionState *) palloc(sizeof(FileFdwExecutionState));
+	festate = (FileFdwExecutionState *) palloc0(sizeof(FileFdwExecutionState));
 	festate->filename = filename;
 	festate->options = options;
-	festate->cstate = cstate;
+
+	/*
+	 * The workers of a parallel scan get the list of files from the leader,
+	 * in fileInitializeWorkerForeignScan, so that all participants see the
+	 * same files even if the directory changes under us.
+	 */
+	if (!(plan->scan.plan.parallel_aware && IsParallelWorker()))
+		festate->files = expand_filename(filename, false);
 
 	node->fdw_state = (void *) festate;
+
+	/*
+	 * Open the first file right away, so that a missing file is reported
+	 * here as it always has been.  A parallel scan has to wait until it
+	 * knows which files are its to read.
+	 */
+	if (!plan->scan.plan.parallel_aware)
+		(void) begin_next_file(node, festate);
+}
+
+/*
+ * Create the CopyState for the next file this scan is to read, if any.
+ * Returns false once all the files have been handed out.
+ */
+static bool
+begin_next_file(ForeignScanState *node, FileFdwExecutionState *festate)
+{
+	MemoryContext oldcontext;
+	uint32		fileno;
+
+	Assert(festate->cstate == NULL);
+
+	if (festate->pstate)
+		fileno = pg_atomic_fetch_add_u32(&festate->pstate->next_file, 1);
+	else
+		fileno = festate->next_file++;
+
+	if (fileno >= (uint32) list_length(festate->files))
+		return false;
+
+	/*
+	 * We may be called from fileIterateForeignScan in a short-lived context,
+	 * but the CopyState must last until we're done with the file.  We always
+	 * acquire all columns, so as to match the expected ScanTupleSlot
+	 * signature.
+	 */
+	oldcontext = MemoryContextSwitchTo(node->ss.ps.state->es_query_cxt);
+	festate->cstate = BeginCopyFrom(node->ss.ss_currentRelation,
+									(char *) list_nth(festate->files, fileno),
+									false,
+									NIL,
+									festate->options);
+	MemoryContextSwitchTo(oldcontext);
+
+	return true;
 }
 
 /*
  * fileIterateForeignScan
- *		Read next record from the data file and store it into the
+ *		Read next record from the data files and store it into the
  *		ScanTupleSlot as a virtual tuple
  */
 static TupleTableSlot *
@@ -660,37 +907,50 @@ fileIterateForeignScan(ForeignScanState *node)
 {
 	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
 	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-	bool		found;
+	bool		found = false;
 	ErrorContextCallback errcallback;
 
-	/* Set up callback to identify error line number. */
-	errcallback.callback = CopyFromErrorCallback;
-	errcallback.arg = (void *) festate->cstate;
-	errcallback.previous = error_context_stack;
-	error_context_stack = &errcallback;
-
 	/*
 	 * The protocol for loading a virtual tuple into a slot is first
 	 * ExecClearTuple, then fill the values/isnull arrays, then
-	 * ExecStoreVirtualTuple.  If we don't find another row in the file, we
+	 * ExecStoreVirtualTuple.  If we don't find another row in any file, we
 	 * just skip the last step, leaving the slot empty as required.
-	 *
-	 * We can pass ExprContext = NULL because we read all columns from the
-	 * file, so no need to evaluate default expressions.
-	 *
-	 * We can also pass tupleOid = NULL because we don't allow oids for
-	 * foreign tables.
 	 */
 	ExecClearTuple(slot);
-	found = NextCopyFrom(festate->cstate, NULL,
-						 slot->tts_values, slot->tts_isnull,
-						 NULL);
+
+	/* Read from the current file, moving on to the next one at its end */
+	while (festate->cstate != NULL || begin_next_file(node, festate))
+	{
+		/* Set up callback to identify error line number. */
+		errcallback.callback = CopyFromErrorCallback;
+		errcallback.arg = (void *) festate->cstate;
+		errcallback.previous = error_context_stack;
+		error_context_stack = &errcallback;
+
+		/*
+		 * We can pass ExprContext = NULL because we read all columns from the
+		 * file, so no need to evaluate default expressions.
+		 *
+		 * We can also pass tupleOid = NULL because we don't allow oids for
+		 * foreign tables.
+		 */
+		found = NextCopyFrom(festate->cstate, NULL,
+							 slot->tts_values, slot->tts_isnull,
+							 NULL);
+
+		/* Remove error callback. */
+		error_context_stack = errcallback.previous;
+
+		if (found)
+			break;
+
+		EndCopyFrom(festate->cstate);
+		festate->cstate = NULL;
+	}
+
 	if (found)
 		ExecStoreVirtualTuple(slot);
 
-	/* Remove error callback. */
-	error_context_stack = errcallback.previous;
-
 	return slot;
 }
 
@@ -703,13 +963,17 @@ fileReScanForeignScan(ForeignScanState *node)
 {
 	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
 
-	EndCopyFrom(festate->cstate);
+	if (festate->cstate)
+		EndCopyFrom(festate->cstate);
+	festate->cstate = NULL;
 
-	festate->cstate = BeginCopyFrom(node->ss.ss_currentRelation,
-									festate->filename,
-									false,
-									NIL,
-									festate->options);
+	/*
+	 * Start over from the first file.  A parallel scan's shared state is
+	 * reset separately, by fileReInitializeDSMForeignScan.
+	 */
+	festate->next_file = 0;
+	if (festate->pstate == NULL)
+		(void) begin_next_file(node, festate);
 }
 
 /*
@@ -722,7 +986,7 @@ fileEndForeignScan(ForeignScanState *node)
 	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
 
 	/* if festate is NULL, we are in EXPLAIN; nothing to do */
-	if (festate)
+	if (festate && festate->cstate)
 		EndCopyFrom(festate->cstate);
 }
 
@@ -737,26 +1001,36 @@ fileAnalyzeForeignTable(Relation relation,
 {
 	char	   *filename;
 	List	   *options;
-	struct stat stat_buf;
+	List	   *files;
+	off_t		total_size = 0;
+	ListCell   *lc;
 
 	/* Fetch options of foreign table */
 	fileGetOptions(RelationGetRelid(relation), &filename, &options);
 
 	/*
-	 * Get size of the file.  (XXX if we fail here, would it be better to just
-	 * return false to skip analyzing the table?)
+	 * Get size of the files.  (XXX if we fail here, would it be better to
+	 * just return false to skip analyzing the table?)
 	 */
-	if (stat(filename, &stat_buf) < 0)
-		ereport(ERROR,
-				(errcode_for_file_access(),
-				 errmsg("could not stat file \"%s\": %m",
-						filename)));
+	files = expand_filename(filename, false);
+	foreach(lc, files)
+	{
+		char	   *file = (char *) lfirst(lc);
+		struct stat stat_buf;
+
+		if (stat(file, &stat_buf) < 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m",
+							file)));
+		total_size += stat_buf.st_size;
+	}
 
 	/*
 	 * Convert size to pages.  Must return at least 1 so that we can tell
 	 * later on that pg_class.relpages is not default.
 	 */
-	*totalpages = (stat_buf.st_size + (BLCKSZ - 1)) / BLCKSZ;
+	*totalpages = (total_size + (BLCKSZ - 1)) / BLCKSZ;
 	if (*totalpages < 1)
 		*totalpages = 1;
 
@@ -777,6 +1051,86 @@ fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
 	return true;
 }
 
+/*
+ * fileEstimateDSMForeignScan
+ *		Estimate space for the shared state of a parallel scan: the list of
+ *		files, as expanded by the leader.
+ */
+static Size
+fileEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
+	Size		size = offsetof(FileFdwParallelState, filenames);
+	ListCell   *lc;
+
+	foreach(lc, festate->files)
+		size = add_size(size, strlen((char *) lfirst(lc)) + 1);
+
+	return size;
+}
+
+/*
+ * fileInitializeDSMForeignScan
+ *		Publish the list of files, and start handing them out from the first.
+ */
+static void
+fileInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							 void *coordinate)
+{
+	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
+	FileFdwParallelState *pstate = (FileFdwParallelState *) coordinate;
+	char	   *ptr = pstate->filenames;
+	ListCell   *lc;
+
+	pg_atomic_init_u32(&pstate->next_file, 0);
+	pstate->nfiles = list_length(festate->files);
+	foreach(lc, festate->files)
+	{
+		Size		len = strlen((char *) lfirst(lc)) + 1;
+
+		memcpy(ptr, lfirst(lc), len);
+		ptr += len;
+	}
+
+	festate->pstate = pstate;
+}
+
+/*
+ * fileReInitializeDSMForeignScan
+ *		Reset the shared state so that a rescan reads all the files again.
+ */
+static void
+fileReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							   void *coordinate)
+{
+	FileFdwParallelState *pstate = (FileFdwParallelState *) coordinate;
+
+	pg_atomic_write_u32(&pstate->next_file, 0);
+}
+
+/*
+ * fileInitializeWorkerForeignScan
+ *		Pick up the list of files and the shared state from the leader.
+ */
+static void
+fileInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc,
+								void *coordinate)
+{
+	FileFdwExecutionState *festate = (FileFdwExecutionState *) node->fdw_state;
+	FileFdwParallelState *pstate = (FileFdwParallelState *) coordinate;
+	char	   *ptr = pstate->filenames;
+	int			i;
+
+	festate->files = NIL;
+	for (i = 0; i < pstate->nfiles; i++)
+	{
+		festate->files = lappend(festate->files, ptr);
+		ptr += strlen(ptr) + 1;
+	}
+
+	festate->pstate = pstate;
+}
+
 /*
  * check_selective_binary_conversion
  *
@@ -907,22 +1261,36 @@ static void
 estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 			  FileFdwPlanState *fdw_private)
 {
-	struct stat stat_buf;
+	List	   *files;
+	ListCell   *lc;
+	off_t		total_size = 0;
 	BlockNumber pages;
 	double		ntuples;
 	double		nrows;
 
 	/*
-	 * Get size of the file.  It might not be there at plan time, though, in
-	 * which case we have to use a default estimate.
+	 * Get size of the files.  They might not be there at plan time, though,
+	 * in which case we have to use a default estimate.
 	 */
-	if (stat(fdw_private->filename, &stat_buf) < 0)
-		stat_buf.st_size = 10 * BLCKSZ;
+	files = expand_filename(fdw_private->filename, true);
+	fdw_private->nfiles = 0;
+	foreach(lc, files)
+	{
+		struct stat stat_buf;
+
+		if (stat((char *) lfirst(lc), &stat_buf) == 0)
+		{
+			total_size += stat_buf.st_size;
+			fdw_private->nfiles++;
+		}
+	}
+	if (fdw_private->nfiles == 0)
+		total_size = 10 * BLCKSZ;
 
 	/*
 	 * Convert size to pages for use in I/O cost estimate later.
 	 */
-	pages = (stat_buf.st_size + (BLCKSZ - 1)) / BLCKSZ;
+	pages = (total_size + (BLCKSZ - 1)) / BLCKSZ;
 	if (pages < 1)
 		pages = 1;
 	fdw_private->pages = pages;
@@ -956,7 +1324,7 @@ estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 
 		tuple_width = MAXALIGN(baserel->reltarget->width) +
 			MAXALIGN(SizeofHeapTupleHeader);
-		ntuples = clamp_row_est((double) stat_buf.st_size /
+		ntuples = clamp_row_est((double) total_size /
 								(double) tuple_width);
 	}
 	fdw_private->ntuples = ntuples;
@@ -981,11 +1349,13 @@ estimate_size(PlannerInfo *root, RelOptInfo *baserel,
 /*
  * Estimate costs of scanning a foreign table.
  *
- * Results are returned in *startup_cost and *total_cost.
+ * If parallel_workers is not zero, estimate the cost of one participant's
+ * share of a parallel scan.  Results are returned in *startup_cost and
+ * *total_cost.
  */
 static void
 estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
-			   FileFdwPlanState *fdw_private,
+			   FileFdwPlanState *fdw_private, int parallel_workers,
 			   Cost *startup_cost, Cost *total_cost)
 {
 	BlockNumber pages = fdw_private->pages;
@@ -1004,16 +1374,43 @@ estimate_costs(PlannerInfo *root, RelOptInfo *baserel,
 	*startup_cost = baserel->baserestrictcost.startup;
 	cpu_per_tuple = cpu_tuple_cost * 10 + baserel->baserestrictcost.per_tuple;
 	run_cost += cpu_per_tuple * ntuples;
+
+	/*
+	 * Unlike a heap, the files of a parallel scan are read entirely by
+	 * whichever participant claims them, so the I/O is divided up along with
+	 * the parsing.
+	 */
+	if (parallel_workers > 0)
+		run_cost /= parallel_divisor(parallel_workers);
+
 	*total_cost = *startup_cost + run_cost;
 }
 
+/*
+ * Estimate the fraction of a parallel scan's work done by each participant,
+ * in the same way as the core planner does: the leader helps, but less so
+ * as it gets busier servicing the workers.
+ */
+static double
+parallel_divisor(int parallel_workers)
+{
+	double		divisor = parallel_workers;
+	double		leader_contribution;
+
+	leader_contribution = 1.0 - (0.3 * parallel_workers);
+	if (leader_contribution > 0)
+		divisor += leader_contribution;
+
+	return divisor;
+}
+
 /*
  * file_acquire_sample_rows -- acquire a random sample of rows from the table
  *
  * Selected rows are returned in the caller-allocated array rows[],
  * which must have at least targrows entries.
  * The actual number of rows selected is returned as the function result.
- * We also count the total number of rows in the file and return it into
+ * We also count the total number of rows in the files and return it into
  * *totalrows.  Note that *totaldeadrows is always set to 0.
  *
  * Note that the returned list of rows is not always in order by physical
@@ -1035,7 +1432,9 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	bool		found;
 	char	   *filename;
 	List	   *options;
-	CopyState	cstate;
+	List	   *files;
+	ListCell   *nextfile;
+	CopyState	cstate = NULL;
 	ErrorContextCallback errcallback;
 	MemoryContext oldcontext = CurrentMemoryContext;
 	MemoryContext tupcontext;
@@ -1050,10 +1449,9 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	/* Fetch options of foreign table */
 	fileGetOptions(RelationGetRelid(onerel), &filename, &options);
 
-	/*
-	 * Create CopyState from FDW options.
-	 */
-	cstate = BeginCopyFrom(onerel, filename, false, NIL, options);
+	/* We'll sample the files one after another */
+	files = expand_filename(filename, false);
+	nextfile = list_head(files);
 
 	/*
 	 * Use per-tuple memory context to prevent leak of memory used to read
@@ -1066,12 +1464,6 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 	/* Prepare for sampling rows */
 	reservoir_init_selection_state(&rstate, targrows);
 
-	/* Set up callback to identify error line number. */
-	errcallback.callback = CopyFromErrorCallback;
-	errcallback.arg = (void *) cstate;
-	errcallback.previous = error_context_stack;
-	error_context_stack = &errcallback;
-
 	*totalrows = 0;
 	*totaldeadrows = 0;
 	for (;;)
@@ -1079,6 +1471,22 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 		/* Check for user-requested abort or sleep */
 		vacuum_delay_point();
 
+		/* Create CopyState from FDW options for the next file, if needed */
+		if (cstate == NULL)
+		{
+			if (nextfile == NULL)
+				break;
+			cstate = BeginCopyFrom(onerel, (char *) lfirst(nextfile),
+								   false, NIL, options);
+			nextfile = lnext(nextfile);
+		}
+
+		/* Set up callback to identify error line number. */
+		errcallback.callback = CopyFromErrorCallback;
+		errcallback.arg = (void *) cstate;
+		errcallback.previous = error_context_stack;
+		error_context_stack = &errcallback;
+
 		/* Fetch next row */
 		MemoryContextReset(tupcontext);
 		MemoryContextSwitchTo(tupcontext);
@@ -1087,8 +1495,15 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 
 		MemoryContextSwitchTo(oldcontext);
 
+		/* Remove error callback. */
+		error_context_stack = errcallback.previous;
+
 		if (!found)
-			break;
+		{
+			EndCopyFrom(cstate);
+			cstate = NULL;
+			continue;
+		}
 
 		/*
 		 * The first targrows sample rows are simply copied into the
@@ -1129,14 +1544,9 @@ file_acquire_sample_rows(Relation onerel, int elevel,
 		*totalrows += 1;
 	}
 
-	/* Remove error callback. */
-	error_context_stack = errcallback.previous;
-
 	/* Clean up. */
 	MemoryContextDelete(tupcontext);
 
-	EndCopyFrom(cstate);
-
 	pfree(values);
 	pfree(nulls);
 
@@ -42,6 +42,8 @@
 #include "access/twophase.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
+#include "access/hash.h"
+#include "lib/stringinfo.h"
 #include "utils/tqual.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
@@ -62,7 +64,7 @@
 
 #ifndef USE_EPOLL
 #ifdef __linux__
-#define USE_EPOLL 0
+#define USE_EPOLL 1
 #else
 #define USE_EPOLL 0
 #endif
@@ -70,16 +72,18 @@
 
 #if USE_EPOLL
 #include <sys/epoll.h>
-#else
-#include <sys/select.h>
 #endif
+#include <sys/select.h>
 
 
 #include "multimaster.h"
+#include "perfstat.h"
+#include "trace.h"
 #include "state.h"
 
 #define MAX_ROUTES       16
 #define INIT_BUFFER_SIZE 1024
+#define MAX_RECV_BUFFER_SIZE (1024*1024) /* limit of data read from one node at a time */
 #define HANDSHAKE_MAGIC  0xCAFEDEED
 
 static int*        sockets;
@@ -88,13 +92,13 @@ static bool        send_heartbeat;
 static timestamp_t last_sent_heartbeat;
 static TimeoutId   heartbeat_timer;
 static nodemask_t  busy_mask;
-static timestamp_t last_heartbeat_to_node[MAX_NODES];
+static timestamp_t last_sent_to_node[MAX_NODES];
 
 static void MtmSender(Datum arg);
 static void MtmReceiver(Datum arg);
 static void MtmMonitor(Datum arg);
 static void MtmSendHeartbeat(void);
-static bool MtmSendToNode(int node, void const* buf, int size);
+static bool MtmSendToNode(int node, MtmArbiterMessage* msgs, int nMsgs);
 
 char const* const MtmMessageKindMnem[] = 
 {
@@ -107,7 +111,8 @@ char const* const MtmMessageKindMnem[] =
 	"STATUS",
 	"HEARTBEAT",
 	"POLL_REQUEST",
-	"POLL_STATUS"
+	"POLL_STATUS",
+	"LOCK_GRAPH_RESYNC"
 };
 
 static BackgroundWorker MtmSenderWorker = {
@@ -149,39 +154,47 @@ static void SetStop(int sig)
 	stop = 1;
 }
 
+/*
+ * Receiver uses epoll when it is available and select otherwise.
+ * RDMA sockets can not be added to epoll set, so select is used for them.
+ */
 #if USE_EPOLL
-static int    epollfd;
-#else
+static int    epollfd = -1;
+#endif
 static int    max_fd;
 static fd_set inset;
-#endif
 
 static void MtmRegisterSocket(int fd, int node)
 {
 #if USE_EPOLL
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.u32 = node;        
-    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
-		MTM_ELOG(LOG, "Arbiter failed to add socket to epoll set: %s", strerror(errno));
-    } 
-#else
+	if (epollfd >= 0) { 
+		struct epoll_event ev;
+		/* Connections are edge-triggered: receiver reads all available data. Listening socket accepts one connection at a time. */
+		ev.events = node+1 == MtmNodeId ? EPOLLIN : EPOLLIN|EPOLLET;
+		ev.data.u32 = node;        
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			MTM_ELOG(LOG, "Arbiter failed to add socket to epoll set: %s", strerror(errno));
+		} 
+		return;
+	}
+#endif
     FD_SET(fd, &inset);    
     if (fd > max_fd) {
         max_fd = fd;
     }
-#endif          
 }     
 
 static void MtmUnregisterSocket(int fd)
 {
 #if USE_EPOLL
-    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) { 
-		MTM_ELOG(LOG, "Arbiter failed to unregister socket from epoll set: %s", strerror(errno));
-    } 
-#else
-	FD_CLR(fd, &inset); 
+	if (epollfd >= 0) { 
+		if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) { 
+			MTM_ELOG(LOG, "Arbiter failed to unregister socket from epoll set: %s", strerror(errno));
+		} 
+		return;
+	}
 #endif
+	FD_CLR(fd, &inset); 
 }
 
 
@@ -215,9 +228,15 @@ static int MtmWaitSocket(int sd, bool forWrite, timestamp_t timeoutMsec)
 	return rc;
 }
 
+/*
+ * Write the whole buffer to the socket.
+ * Give up if the other side doesn't accept data for heartbeat_recv_timeout: after that it is considered dead anyway,
+ * and waiting longer would only delay messages to other nodes.
+ */
 static bool MtmWriteSocket(int sd, void const* buf, int size)
 {
     char* src = (char*)buf;
+	timestamp_t deadline = MtmGetSystemTime() + MSEC_TO_USEC(MtmHeartbeatRecvTimeout);
     while (size != 0) {
 		int rc = MtmWaitSocket(sd, true, MtmHeartbeatSendTimeout);
 		if (rc == 1) { 
@@ -232,6 +251,9 @@ static bool MtmWriteSocket(int sd, void const* buf, int size)
 			src += rc;
 		} else if (rc < 0) { 
 			return false;
+		} else if (MtmGetSystemTime() > deadline) {
+			errno = ETIMEDOUT;
+			return false;
 		}
     }
 	return true;
@@ -299,6 +321,289 @@ static void MtmSetSocketOptions(int sd)
 		}
 	}
 #endif
+#ifdef SO_BUSY_POLL
+	/* rsockets bypass the kernel network stack, so busy polling makes sense only for TCP */
+	if (MtmArbiterBusyPoll != 0 && !MtmUseRDMA) {
+		if (pg_setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL,
+						  (char *) &MtmArbiterBusyPoll, sizeof(MtmArbiterBusyPoll), MtmUseRDMA) < 0)
+		{
+			MTM_ELOG(WARNING, "Failed to set SO_BUSY_POLL: %m");
+		}
+	}
+#endif
+}
+
+/*
+ * Compact wire format of arbiter messages.
+ *
+ * Handshake is performed using fixed size messages. After it each message is sent as
+ * varint length followed by packed body: code, flags, varint encoded xids, delta of CSN
+ * from the previous message in this channel and only those fields which were changed
+ * since the previous message: oldest snapshot, disabled and connectivity masks.
+ * GID is interned in direct-mapped per-channel cache: when it is present in the cache,
+ * only index of the cache slot is sent.
+ * Channel state is reset on each (re)connect, so both sides always have the same view of it.
+ */
+#define MTM_GID_CACHE_SIZE          256
+#define MTM_MAX_PACKED_MESSAGE_SIZE 128
+
+#define MTM_PACK_LOCK_REQ     0x01
+#define MTM_PACK_LOCKED       0x02
+#define MTM_PACK_SNAPSHOT     0x04
+#define MTM_PACK_DISABLED     0x08
+#define MTM_PACK_CONNECTIVITY 0x10
+#define MTM_PACK_GID_LITERAL  0x20
+#define MTM_PACK_GID_REF      0x40
+
+typedef struct
+{
+	bool        valid;            /* state is synchronized with the other side */
+	csn_t       csn;
+	csn_t       oldestSnapshot;
+	nodemask_t  disabledNodeMask;
+	nodemask_t  connectivityMask;
+	StringInfoData buf;           /* packed messages: to be sent by sender or received but not yet processed by receiver */
+	pgid_t      gids[MTM_GID_CACHE_SIZE];
+} MtmChannel;
+
+static MtmChannel* channels; /* outgoing channels in sender, incoming channels in receiver */
+
+static MtmChannel* MtmGetChannel(int node)
+{
+	if (channels == NULL) {
+		MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+		int i;
+		channels = (MtmChannel*)palloc0(sizeof(MtmChannel)*MtmMaxNodes);
+		for (i = 0; i < MtmMaxNodes; i++) {
+			initStringInfo(&channels[i].buf);
+		}
+		MemoryContextSwitchTo(oldcontext);
+	}
+	return &channels[node];
+}
+
+static void MtmResetChannel(int node)
+{
+	MtmChannel* chan = MtmGetChannel(node);
+	chan->valid = false;
+	chan->csn = 0;
+	chan->oldestSnapshot = 0;
+	chan->disabledNodeMask = 0;
+	chan->connectivityMask = 0;
+	resetStringInfo(&chan->buf);
+	memset(chan->gids, 0, sizeof(chan->gids));
+}
+
+static void MtmPackVarint(StringInfo buf, uint64 val)
+{
+	while (val >= 0x80) {
+		appendStringInfoCharMacro(buf, (char)(val | 0x80));
+		val >>= 7;
+	}
+	appendStringInfoCharMacro(buf, (char)val);
+}
+
+static bool MtmUnpackVarint(char const** pp, char const* end, uint64* val)
+{
+	char const* p = *pp;
+	uint64 result = 0;
+	int shift;
+	for (shift = 0; shift < 64; shift += 7) {
+		uint8 b;
+		if (p == end) {
+			return false;
+		}
+		b = (uint8)*p++;
+		result |= (uint64)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*pp = p;
+			*val = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Zigzag encoding of signed delta, so that small negative values are also packed in few bytes */
+#define MTM_ZIGZAG(delta)   (((uint64)(delta) << 1) ^ (uint64)((int64)(delta) >> 63))
+#define MTM_UNZIGZAG(val)   ((int64)((val) >> 1) ^ -(int64)((val) & 1))
+
+static uint32 MtmGidSlot(char const* gid)
+{
+	return hash_any((unsigned char const*)gid, strlen(gid)) % MTM_GID_CACHE_SIZE;
+}
+
+/*
+ * Append packed message to the channel buffer
+ */
+static void MtmPackMessage(int node, MtmArbiterMessage* msg)
+{
+	MtmChannel* chan = MtmGetChannel(node);
+	char body[MTM_MAX_PACKED_MESSAGE_SIZE];
+	StringInfoData pack;
+	uint8 flags = 0;
+	int gidLen = 0;
+	uint32 slot = 0;
+
+	if (msg->lockReq) {
+		flags |= MTM_PACK_LOCK_REQ;
+	}
+	if (msg->locked) {
+		flags |= MTM_PACK_LOCKED;
+	}
+	if (!chan->valid || msg->oldestSnapshot != chan->oldestSnapshot) {
+		flags |= MTM_PACK_SNAPSHOT;
+	}
+	if (!chan->valid || msg->disabledNodeMask != chan->disabledNodeMask) {
+		flags |= MTM_PACK_DISABLED;
+	}
+	if (!chan->valid || msg->connectivityMask != chan->connectivityMask) {
+		flags |= MTM_PACK_CONNECTIVITY;
+	}
+	/* GID of heartbeat is not initialized */
+	if (msg->code != MSG_HEARTBEAT && *msg->gid != '\0') {
+		gidLen = strnlen(msg->gid, MULTIMASTER_MAX_GID_SIZE-1);
+		msg->gid[gidLen] = '\0';
+		slot = MtmGidSlot(msg->gid);
+		if (strcmp(chan->gids[slot], msg->gid) == 0) {
+			flags |= MTM_PACK_GID_REF;
+		} else {
+			memcpy(chan->gids[slot], msg->gid, gidLen+1);
+			flags |= MTM_PACK_GID_LITERAL;
+		}
+	}
+
+	/* Use stack buffer to avoid palloc for each message */
+	pack.data = body;
+	pack.len = 0;
+	pack.maxlen = sizeof(body);
+	pack.cursor = 0;
+
+	appendStringInfoCharMacro(&pack, (char)msg->code);
+	appendStringInfoCharMacro(&pack, (char)flags);
+	MtmPackVarint(&pack, msg->dxid);
+	MtmPackVarint(&pack, msg->sxid);
+	appendStringInfoCharMacro(&pack, (char)msg->status);
+	MtmPackVarint(&pack, MTM_ZIGZAG(msg->csn - chan->csn));
+	if (flags & MTM_PACK_SNAPSHOT) {
+		MtmPackVarint(&pack, MTM_ZIGZAG(msg->oldestSnapshot - chan->oldestSnapshot));
+	}
+	if (flags & MTM_PACK_DISABLED) {
+		MtmPackVarint(&pack, msg->disabledNodeMask);
+	}
+	if (flags & MTM_PACK_CONNECTIVITY) {
+		MtmPackVarint(&pack, msg->connectivityMask);
+	}
+	if (flags & (MTM_PACK_GID_REF|MTM_PACK_GID_LITERAL)) {
+		appendStringInfoCharMacro(&pack, (char)slot);
+		if (flags & MTM_PACK_GID_LITERAL) {
+			appendStringInfoCharMacro(&pack, (char)gidLen);
+			memcpy(pack.data + pack.len, msg->gid, gidLen);
+			pack.len += gidLen;
+		}
+	}
+	Assert(pack.data == body && pack.len <= sizeof(body));
+
+	chan->valid = true;
+	chan->csn = msg->csn;
+	chan->oldestSnapshot = msg->oldestSnapshot;
+	chan->disabledNodeMask = msg->disabledNodeMask;
+	chan->connectivityMask = msg->connectivityMask;
+
+	MtmPackVarint(&chan->buf, pack.len);
+	appendBinaryStringInfo(&chan->buf, body, pack.len);
+}
+
+/*
+ * Unpack message received from the node.
+ * Returns 1 if message is unpacked, 0 if more data is needed and -1 if message is corrupted.
+ */
+static int MtmUnpackMessage(int node, char const** pp, char const* end, MtmArbiterMessage* msg)
+{
+	MtmChannel* chan = MtmGetChannel(node);
+	char const* p = *pp;
+	char const* body_end;
+	uint64 len, val;
+	uint8 flags;
+
+	if (!MtmUnpackVarint(&p, end, &len)) {
+		return end - p >= 10 ? -1 : 0;
+	}
+	if (len > MTM_MAX_PACKED_MESSAGE_SIZE || len < 2) {
+		return -1;
+	}
+	if (end - p < len) {
+		return 0;
+	}
+	body_end = p + len;
+	*pp = body_end;
+
+	msg->node = node+1;
+	msg->code = (MtmMessageCode)(uint8)*p++;
+	flags = (uint8)*p++;
+	msg->lockReq = (flags & MTM_PACK_LOCK_REQ) != 0;
+	msg->locked = (flags & MTM_PACK_LOCKED) != 0;
+	if (!MtmUnpackVarint(&p, body_end, &val)) {
+		return -1;
+	}
+	msg->dxid = (TransactionId)val;
+	if (!MtmUnpackVarint(&p, body_end, &val)) {
+		return -1;
+	}
+	msg->sxid = (TransactionId)val;
+	if (p == body_end) {
+		return -1;
+	}
+	msg->status = (XidStatus)(uint8)*p++;
+	if (!MtmUnpackVarint(&p, body_end, &val)) {
+		return -1;
+	}
+	msg->csn = chan->csn + MTM_UNZIGZAG(val);
+	if (flags & MTM_PACK_SNAPSHOT) {
+		if (!MtmUnpackVarint(&p, body_end, &val)) {
+			return -1;
+		}
+		chan->oldestSnapshot += MTM_UNZIGZAG(val);
+	}
+	if (flags & MTM_PACK_DISABLED) {
+		if (!MtmUnpackVarint(&p, body_end, &val)) {
+			return -1;
+		}
+		chan->disabledNodeMask = val;
+	}
+	if (flags & MTM_PACK_CONNECTIVITY) {
+		if (!MtmUnpackVarint(&p, body_end, &val)) {
+			return -1;
+		}
+		chan->connectivityMask = val;
+	}
+	msg->gid[0] = '\0';
+	if (flags & (MTM_PACK_GID_REF|MTM_PACK_GID_LITERAL)) {
+		uint8 slot;
+		if (p == body_end) {
+			return -1;
+		}
+		slot = (uint8)*p++;
+		if (flags & MTM_PACK_GID_LITERAL) {
+			uint8 gidLen;
+			if (p == body_end) {
+				return -1;
+			}
+			gidLen = (uint8)*p++;
+			if (gidLen >= MULTIMASTER_MAX_GID_SIZE || body_end - p < gidLen) {
+				return -1;
+			}
+			memcpy(chan->gids[slot], p, gidLen);
+			chan->gids[slot][gidLen] = '\0';
+			p += gidLen;
+		}
+		memcpy(msg->gid, chan->gids[slot], MULTIMASTER_MAX_GID_SIZE);
+	}
+	chan->csn = msg->csn;
+	msg->oldestSnapshot = chan->oldestSnapshot;
+	msg->disabledNodeMask = chan->disabledNodeMask;
+	msg->connectivityMask = chan->connectivityMask;
+	return p == body_end ? 1 : -1;
 }
 
 /*
@@ -343,11 +648,17 @@ static void MtmScheduleHeartbeat()
 	PGSemaphoreUnlock(&Mtm->sendSemaphore);
 }
 	
+/*
+ * Send heartbeats to the nodes we have not sent anything to recently.
+ * Receiver treats any arbiter message as a sign of liveness and each message carries node state,
+ * so links busy with 2PC traffic need no explicit heartbeats.
+ */
 static void MtmSendHeartbeat()
 {
 	int i;
 	MtmArbiterMessage msg;
 	timestamp_t now = MtmGetSystemTime();
+	memset(&msg, 0, sizeof(msg));
 	MtmInitMessage(&msg, MSG_HEARTBEAT);
 	msg.node = MtmNodeId;
 	msg.csn = now;
@@ -358,41 +669,47 @@ static void MtmSendHeartbeat()
 
 	for (i = 0; i < Mtm->nAllNodes; i++)
 	{
-		if (i+1 != MtmNodeId) { 
-			if (!BIT_CHECK(busy_mask, i))
-				/*
-				 * Old behaviour here can cause subtle bugs, for example
-				 * it can happened that none of mentioned conditiotions is
-				 * true when disabled node connects to a major node which
-				 * is online. So just send it allways. --sk
-				 */
-				// && (Mtm->status != MTM_ONLINE
-				// 	|| sockets[i] >= 0
-				// 	|| !BIT_CHECK(Mtm->disabledNodeMask, i)
-				// 	|| BIT_CHECK(Mtm->reconnectMask, i)))
-			{ 
-				if (!MtmSendToNode(i, &msg, sizeof(msg))) {
-					MTM_ELOG(LOG, "Arbiter failed to send heartbeat to node %d", i+1);
-				} else {
-					if (last_heartbeat_to_node[i] + MSEC_TO_USEC(MtmHeartbeatSendTimeout)*2 < now) { 
-						MTM_LOG1("Last heartbeat to node %d was sent %lld microseconds ago", i+1, now - last_heartbeat_to_node[i]);
-					}
-					last_heartbeat_to_node[i] = now;
-					/* Connectivity mask can be cleared by MtmWatchdog: in this case sockets[i] >= 0 */
-					if (BIT_CHECK(SELF_CONNECTIVITY_MASK, i)) { 
-						MTM_LOG1("Force reconnect to node %d", i+1);    
-						pg_closesocket(sockets[i], MtmUseRDMA);
-						sockets[i] = -1;
-						MtmReconnectNode(i+1); /* set reconnect mask to force node reconnent */
-					}
-					MTM_LOG4("Send heartbeat to node %d with timestamp %lld", i+1, now);    
-				}
-			} else { 
-				MTM_LOG2("Do not send heartbeat to node %d, busy mask %lld, status %s", i+1, busy_mask, MtmNodeStatusMnem[Mtm->status]);
+		if (i+1 == MtmNodeId) {
+			continue;
+		}
+		/*
+		 * Old behaviour here can cause subtle bugs, for example
+		 * it can happened that none of mentioned conditiotions is
+		 * true when disabled node connects to a major node which
+		 * is online. So just send it allways. --sk
+		 */
+		// && (Mtm->status != MTM_ONLINE
+		// 	|| sockets[i] >= 0
+		// 	|| !BIT_CHECK(Mtm->disabledNodeMask, i)
+		// 	|| BIT_CHECK(Mtm->reconnectMask, i)))
+		if (BIT_CHECK(busy_mask, i)) {
+			MTM_LOG2("Do not send heartbeat to node %d, busy mask %lld, status %s", i+1, busy_mask, MtmNodeStatusMnem[Mtm->status]);
+			continue;
+		}
+		if (sockets[i] < 0) {
+			/* Connection is being reestablished by MtmMaintainConnections */
+			continue;
+		}
+		if (last_sent_to_node[i] + MSEC_TO_USEC(MtmHeartbeatSendTimeout)/2 > now) {
+			MTM_LOG4("Do not send heartbeat to node %d: link is busy", i+1);
+		} else {
+			if (last_sent_to_node[i] + MSEC_TO_USEC(MtmHeartbeatSendTimeout)*2 < now) { 
+				MTM_LOG1("Last message to node %d was sent %lld microseconds ago", i+1, now - last_sent_to_node[i]);
+			}
+			if (!MtmSendToNode(i, &msg, 1)) {
+				MTM_ELOG(LOG, "Arbiter failed to send heartbeat to node %d", i+1);
+				continue;
 			}
+			MTM_LOG4("Send heartbeat to node %d with timestamp %lld", i+1, now);    
+		}
+		/* Connectivity mask can be cleared by MtmWatchdog: in this case sockets[i] >= 0 */
+		if (BIT_CHECK(SELF_CONNECTIVITY_MASK, i)) { 
+			MTM_LOG1("Force reconnect to node %d", i+1);    
+			pg_closesocket(sockets[i], MtmUseRDMA);
+			sockets[i] = -1;
+			MtmReconnectNode(i+1); /* set reconnect mask to force node reconnent */
 		}
 	}
-	
 }
 
 /* This function should be called from all places where sender can be blocked.
@@ -408,18 +725,76 @@ void MtmCheckHeartbeat()
 }
 
 
-static int MtmConnectSocket(int node, int port)
+/*
+ * Outgoing connections are established without blocking the sender: an attempt is started by
+ * MtmStartConnect and advanced by MtmPollConnect each time the sender wakes up, which happens at least
+ * once per heartbeat period. So an unreachable node can not delay delivery of messages to other nodes.
+ */
+typedef enum
+{
+	MTM_CONN_IDLE,          /* no connection attempt is in progress */
+	MTM_CONN_CONNECTING,    /* waiting for completion of non-blocking connect */
+	MTM_CONN_HANDSHAKE      /* handshake is sent, waiting for response */
+} MtmConnState;
+
+typedef struct
 {
+	MtmConnState state;
+	int          sd;
+	timestamp_t  deadline;    /* when to give up current attempt */
+	timestamp_t  nextAttempt; /* do not start new attempt before this time unless reconnect is requested */
+} MtmConnAttempt;
+
+static MtmConnAttempt* connAttempts;
+
+/*
+ * Check whether socket is ready for read or write without waiting.
+ */
+static bool MtmPollSocket(int sd, bool forWrite)
+{
+	struct timeval tv;
+	fd_set set;
+	int rc;
+
+	do {
+		FD_ZERO(&set);
+		FD_SET(sd, &set);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+	} while ((rc = pg_select(sd+1, forWrite ? NULL : &set, forWrite ? &set : NULL, NULL, &tv, MtmUseRDMA)) < 0 && errno == EINTR);
+
+	return rc > 0;
+}
+
+static void MtmAbortConnect(int node)
+{
+	MtmConnAttempt* conn = &connAttempts[node];
+	if (conn->sd >= 0) {
+		pg_closesocket(conn->sd, MtmUseRDMA);
+		conn->sd = -1;
+	}
+	conn->state = MTM_CONN_IDLE;
+	conn->nextAttempt = MtmGetSystemTime() + MSEC_TO_USEC(MtmHeartbeatSendTimeout);
+}
+
+static void MtmStartConnect(int node)
+{
+	MtmConnAttempt* conn = &connAttempts[node];
  	struct addrinfo *addrs = NULL;
 	struct addrinfo *addr;
 	struct addrinfo hint;
 	char portstr[MAXPGPATH];
-	MtmHandshakeMessage req;
-	MtmArbiterMessage   resp;
-	int sd = -1;
-	int rc;
+	int port = Mtm->nodes[node].con.arbiterPort;
 	char const* host = Mtm->nodes[node].con.hostName;
-	nodemask_t save_mask = busy_mask;
+	int rc;
+
+	Assert(conn->state == MTM_CONN_IDLE && conn->sd < 0);
+
+	if (BIT_CHECK(Mtm->reconnectMask, node)) {
+		MtmLock(LW_EXCLUSIVE);
+		BIT_CLEAR(Mtm->reconnectMask, node);
+		MtmUnlock();
+	}
 
 	/* Initialize hint structure */
 	MemSet(&hint, 0, sizeof(hint));
@@ -432,18 +807,16 @@ static int MtmConnectSocket(int node, int port)
 	if (rc != 0) 
 	{
 		MTM_ELOG(LOG, "Arbiter failed to resolve host '%s' by name: %s", host, gai_strerror(rc));
-		return -1;
+		MtmAbortConnect(node);
+		return;
 	}
-	BIT_SET(busy_mask, node);
-	
-  Retry:
 
-	sd = pg_socket(AF_INET, SOCK_STREAM, 0, MtmUseRDMA);
-	if (sd < 0) {
+	conn->sd = pg_socket(AF_INET, SOCK_STREAM, 0, MtmUseRDMA);
+	if (conn->sd < 0) {
 		MTM_ELOG(LOG, "Arbiter failed to create socket: %s", strerror(errno));
 		goto Error;
 	}
-	rc = pg_fcntl(sd, F_SETFL, O_NONBLOCK, MtmUseRDMA);
+	rc = pg_fcntl(conn->sd, F_SETFL, O_NONBLOCK, MtmUseRDMA);
 	if (rc < 0) {
 		MTM_ELOG(LOG, "Arbiter failed to switch socket to non-blocking mode: %s", strerror(errno));
 		goto Error;
@@ -451,85 +824,142 @@ static int MtmConnectSocket(int node, int port)
 	for (addr = addrs; addr != NULL; addr = addr->ai_next)
 	{
 		do {
-			rc = pg_connect(sd, addr->ai_addr, addr->ai_addrlen, MtmUseRDMA);
+			rc = pg_connect(conn->sd, addr->ai_addr, addr->ai_addrlen, MtmUseRDMA);
 		} while (rc < 0 && errno == EINTR);
 
 		if (rc >= 0 || errno == EINPROGRESS) {
 			break;
 		}
 	}
+	if (rc != 0 && errno != EINPROGRESS) {
+		MTM_ELOG(WARNING, "Arbiter failed to connect to %s:%d: (%d) %s", host, port, rc, strerror(errno));
+		goto Error;
+	}
+	pg_freeaddrinfo_all(hint.ai_family, addrs);
 
-	if (rc != 0 && errno == EINPROGRESS) {
-		rc = MtmWaitSocket(sd, true, MtmHeartbeatSendTimeout);
-		if (rc == 1) {
-			socklen_t	optlen = sizeof(int);
-			int			errcode;
+	conn->state = MTM_CONN_CONNECTING;
+	conn->deadline = MtmGetSystemTime() + MSEC_TO_USEC(MtmHeartbeatRecvTimeout);
+	return;
 
-			if (pg_getsockopt(sd, SOL_SOCKET, SO_ERROR, (void*)&errcode, &optlen, MtmUseRDMA) < 0) {
-				MTM_ELOG(WARNING, "Arbiter failed to getsockopt for %s:%d: %s", host, port, strerror(errcode));
-				goto Error;
-			}
-			if (errcode != 0) {
-				MTM_ELOG(WARNING, "Arbiter trying to connect to %s:%d: %s", host, port, strerror(errcode));
-				goto Error;
-			}
-		} else if (rc == 0) {
-			MTM_ELOG(WARNING, "Arbiter failed to connect to socket to %s:%d within specified timeout", host, port);
+Error:
+	pg_freeaddrinfo_all(hint.ai_family, addrs);
+	MtmAbortConnect(node);
+}
+
+/*
+ * Advance connection attempt without blocking.
+ * Returns true when connection is established: in this case sockets[node] is assigned.
+ */
+static bool MtmPollConnect(int node)
+{
+	MtmConnAttempt* conn = &connAttempts[node];
+	int port = Mtm->nodes[node].con.arbiterPort;
+	char const* host = Mtm->nodes[node].con.hostName;
+
+	if (conn->state == MTM_CONN_CONNECTING) {
+		MtmHandshakeMessage req;
+		socklen_t	optlen = sizeof(int);
+		int			errcode;
+
+		if (!MtmPollSocket(conn->sd, true)) {
+			goto NotReady;
+		}
+		if (pg_getsockopt(conn->sd, SOL_SOCKET, SO_ERROR, (void*)&errcode, &optlen, MtmUseRDMA) < 0) {
+			MTM_ELOG(WARNING, "Arbiter failed to getsockopt for %s:%d: %s", host, port, strerror(errno));
 			goto Error;
-		} else { 
-			MTM_ELOG(WARNING, "Arbiter failed to wait socket to %s:%d: %s", host, port, strerror(errno));
+		}
+		if (errcode != 0) {
+			MTM_ELOG(WARNING, "Arbiter trying to connect to %s:%d: %s", host, port, strerror(errcode));
 			goto Error;
 		}
+
+		MtmSetSocketOptions(conn->sd);
+		MtmInitMessage(&req.hdr, MSG_HANDSHAKE);
+		req.hdr.node = MtmNodeId;
+		req.hdr.dxid = HANDSHAKE_MAGIC;
+		req.hdr.sxid = ShmemVariableCache->nextXid;
+		req.hdr.csn  = MtmGetCurrentTime();
+		strcpy(req.connStr, Mtm->nodes[MtmNodeId-1].con.connStr);
+		if (!MtmWriteSocket(conn->sd, &req, sizeof req)) { 
+			MTM_ELOG(WARNING, "Arbiter failed to send handshake message to %s:%d: %s", host, port, strerror(errno));
+			goto Error;
+		}
+		conn->state = MTM_CONN_HANDSHAKE;
 	}
-	else if (rc != 0) {
-		MTM_ELOG(WARNING, "Arbiter failed to connect to %s:%d: (%d) %s", host, port, rc, strerror(errno));
-		goto Error;
-	}
+	if (conn->state == MTM_CONN_HANDSHAKE) {
+		MtmArbiterMessage resp;
 
-	MtmSetSocketOptions(sd);
-	MtmInitMessage(&req.hdr, MSG_HANDSHAKE);
-	req.hdr.node = MtmNodeId;
-	req.hdr.dxid = HANDSHAKE_MAGIC;
-	req.hdr.sxid = ShmemVariableCache->nextXid;
-	req.hdr.csn  = MtmGetCurrentTime();
-	strcpy(req.connStr, Mtm->nodes[MtmNodeId-1].con.connStr);
-	if (!MtmWriteSocket(sd, &req, sizeof req)) { 
-		MTM_ELOG(WARNING, "Arbiter failed to send handshake message to %s:%d: %s", host, port, strerror(errno));
-		pg_closesocket(sd, MtmUseRDMA);
-		goto Retry;
-	}
-	if (MtmReadSocket(sd, &resp, sizeof resp) != sizeof(resp)) { 
-		MTM_ELOG(WARNING, "Arbiter failed to receive response for handshake message from %s:%d: %s", host, port, strerror(errno));
-		pg_closesocket(sd, MtmUseRDMA);
-		goto Retry;
-	}
-	if (resp.code != MSG_STATUS || resp.dxid != HANDSHAKE_MAGIC) {
-		MTM_ELOG(WARNING, "Arbiter get unexpected response %d for handshake message from %s:%d", resp.code, host, port);
-		pg_closesocket(sd, MtmUseRDMA);
-		goto Retry;
-	}
-	if (addrs)
-		pg_freeaddrinfo_all(hint.ai_family, addrs);
-
-	MtmLock(LW_EXCLUSIVE);
-	MtmCheckResponse(&resp);
-	MtmUnlock();
+		if (!MtmPollSocket(conn->sd, false)) {
+			goto NotReady;
+		}
+		if (MtmReadSocket(conn->sd, &resp, sizeof resp) != sizeof(resp)) { 
+			MTM_ELOG(WARNING, "Arbiter failed to receive response for handshake message from %s:%d: %s", host, port, strerror(errno));
+			goto Error;
+		}
+		if (resp.code != MSG_STATUS || resp.dxid != HANDSHAKE_MAGIC) {
+			MTM_ELOG(WARNING, "Arbiter get unexpected response %d for handshake message from %s:%d", resp.code, host, port);
+			goto Error;
+		}
 
-	MtmOnNodeConnect(node+1);
+		MtmLock(LW_EXCLUSIVE);
+		MtmCheckResponse(&resp);
+		MtmUnlock();
 
-	busy_mask = save_mask;
-	
-	return sd;
+		sockets[node] = conn->sd;
+		conn->sd = -1;
+		conn->state = MTM_CONN_IDLE;
 
-Error:
-	busy_mask = save_mask;
-	if (sd >= 0) { 
-		pg_closesocket(sd, MtmUseRDMA);
+		MtmOnNodeConnect(node+1);
+		MtmResetChannel(node);
+		return true;
+	}
+
+  NotReady:
+	if (MtmGetSystemTime() > conn->deadline) {
+		MTM_ELOG(WARNING, "Arbiter failed to connect to %s:%d within specified timeout", host, port);
+		MtmAbortConnect(node);
 	}
-	if (addrs) {
-		pg_freeaddrinfo_all(hint.ai_family, addrs);
+	return false;
+
+  Error:
+	MtmAbortConnect(node);
+	return false;
+}
+
+/*
+ * (Re)establish connections to the nodes we are not connected to.
+ * Messages for a node are kept in its transmit buffer while connection attempt is in progress
+ * and are sent once it succeeds. If the attempt fails, they are discarded, just like messages
+ * sent through a broken connection.
+ */
+static void MtmMaintainConnections(MtmBuffer* txBuffer)
+{
+	timestamp_t now = MtmGetSystemTime();
+	int i;
+
+	for (i = 0; i < Mtm->nAllNodes; i++) {
+		MtmConnAttempt* conn = &connAttempts[i];
+
+		if (i+1 == MtmNodeId || sockets[i] >= 0) {
+			continue;
+		}
+		if (conn->state == MTM_CONN_IDLE) {
+			if (conn->nextAttempt > now && !BIT_CHECK(Mtm->reconnectMask, i)) {
+				txBuffer[i].used = 0;
+				continue;
+			}
+			MtmStartConnect(i);
+		}
+		if (conn->state != MTM_CONN_IDLE && MtmPollConnect(i)) {
+			MTM_LOG1("Arbiter reestablish connection with node %d", i+1);
+			if (txBuffer[i].used != 0) {
+				MtmSendToNode(i, txBuffer[i].data, txBuffer[i].used);
+				txBuffer[i].used = 0;
+			}
+		} else if (conn->state == MTM_CONN_IDLE) {
+			txBuffer[i].used = 0;
+		}
 	}
-	return -1;
 }
 
 
@@ -539,69 +969,100 @@ static void MtmOpenConnections()
 	int i;
 
 	sockets = (int*)palloc(sizeof(int)*nNodes);
+	connAttempts = (MtmConnAttempt*)palloc0(sizeof(MtmConnAttempt)*nNodes);
 
 	for (i = 0; i < nNodes; i++) {
 		sockets[i] = -1;
+		connAttempts[i].sd = -1;
 	}
 	for (i = 0; i < nNodes; i++) {
 		if (i+1 != MtmNodeId && i < Mtm->nAllNodes) { 
-			sockets[i] = MtmConnectSocket(i, Mtm->nodes[i].con.arbiterPort);
+			MtmStartConnect(i);
 		}
 	}
 	MtmStateProcessEvent(MTM_ARBITER_RECEIVER_START);
 }
 
 
-static bool MtmSendToNode(int node, void const* buf, int size)
+/*
+ * Pack messages and send them to the node in one write.
+ * Messages are packed against state of the current connection, so them are repacked after reconnect.
+ * Connection is not reestablished here but by MtmMaintainConnections, so the caller should keep
+ * messages which were not sent.
+ * The last message is refreshed with the current node state, which makes it serve as heartbeat.
+ */
+static bool MtmSendToNode(int node, MtmArbiterMessage* msgs, int nMsgs)
 {	
-	bool result = true;
+	MtmChannel* chan = MtmGetChannel(node);
+	bool result = false;
+	int i;
 	nodemask_t save_mask = busy_mask;
+
+	if (BIT_CHECK(Mtm->reconnectMask, node)) {
+		MtmLock(LW_EXCLUSIVE);		
+		BIT_CLEAR(Mtm->reconnectMask, node);
+		MtmUnlock();
+	}
+	if (sockets[node] < 0) {
+		return false;
+	}
+
 	BIT_SET(busy_mask, node);
-	while (true) {
-#if 0
-		/* Original intention was to reestablish connection when reconnect mask is set to avoid hanged-up connection.
-		 * But reconnectMask is set not only when connection is broken, so breaking connection in all this cases cause avalanche of connection failures.
-		 */
-		if (sockets[node] >= 0 && BIT_CHECK(Mtm->reconnectMask, node)) {
-			MTM_ELOG(WARNING, "Arbiter is forced to reconnect to node %d", node+1); 
-			pg_closesocket(sockets[node], MtmUseRDMA);
-			sockets[node] = -1;
-		}
-#endif
-		if (BIT_CHECK(Mtm->reconnectMask, node)) {
-			MtmLock(LW_EXCLUSIVE);		
-			BIT_CLEAR(Mtm->reconnectMask, node);
-			MtmUnlock();
-		}
-		if (sockets[node] < 0 || !MtmWriteSocket(sockets[node], buf, size)) {
-			if (sockets[node] >= 0) { 
-				MTM_ELOG(WARNING, "Arbiter fail to write to node %d: %s", node+1, strerror(errno));
-				pg_closesocket(sockets[node], MtmUseRDMA);
-				sockets[node] = -1;
-			}
-			sockets[node] = MtmConnectSocket(node, Mtm->nodes[node].con.arbiterPort);
-			if (sockets[node] < 0) { 
-				result = false;
-				break;
-			}
-			MTM_LOG1("Arbiter reestablish connection with node %d", node+1);
-		} else { 
-			result = true;
-			break;
-		}
+	MtmInitMessage(&msgs[nMsgs-1], msgs[nMsgs-1].code);
+	resetStringInfo(&chan->buf);
+	for (i = 0; i < nMsgs; i++) {
+		MtmPackMessage(node, &msgs[i]);
+	}
+	if (MtmWriteSocket(sockets[node], chan->buf.data, chan->buf.len)) {
+		MtmPerfRecord(MTM_PERF_ARBITER_SEND_BYTES, node+1, chan->buf.len);
+		last_sent_to_node[node] = MtmGetSystemTime();
+		result = true;
+	} else {
+		MTM_ELOG(WARNING, "Arbiter fail to write to node %d: %s", node+1, strerror(errno));
+		pg_closesocket(sockets[node], MtmUseRDMA);
+		sockets[node] = -1;
 	}
 	busy_mask = save_mask;
 	return result;
 }
 
-static int MtmReadFromNode(int node, void* buf, int buf_size)
+/*
+ * Read all available data from the node to the buffer without blocking.
+ * Returns number of read bytes or -1 if connection is broken and no data was read.
+ * Reading is stopped when buffer size exceeds MAX_RECV_BUFFER_SIZE, in this case *more is set
+ * to let caller know that there can be more data in the socket.
+ */
+static int MtmReadFromNode(int node, StringInfo buf, bool* more)
 {
-	int rc = MtmReadSocket(sockets[node], buf, buf_size);
-	if (rc <= 0) { 
-		MTM_ELOG(WARNING, "Arbiter failed to read from node=%d: %s", node+1, strerror(errno));
-		MtmDisconnect(node);
+	int total = 0;
+	int rc;
+
+	*more = false;
+	while (true) { 
+		if (buf->len >= MAX_RECV_BUFFER_SIZE) { 
+			*more = true;
+			break;
+		}
+		enlargeStringInfo(buf, INIT_BUFFER_SIZE);
+		while ((rc = pg_recv(sockets[node], buf->data + buf->len, buf->maxlen - buf->len - 1, 0, MtmUseRDMA)) < 0 && errno == EINTR);
+		if (rc > 0) { 
+			buf->len += rc;
+			total += rc;
+		} else if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS)) {
+			break;
+		} else { 
+			MTM_ELOG(WARNING, "Arbiter failed to read from node=%d: %s", node+1, rc == 0 ? "connection closed" : strerror(errno));
+			MtmDisconnect(node);
+			if (total == 0) {
+				return -1;
+			}
+			break;
+		}
 	}
-	return rc;
+	if (total != 0) {
+		MtmPerfRecord(MTM_PERF_ARBITER_RECV_BYTES, node+1, total);
+	}
+	return total;
 }
 
 static void MtmAcceptOneConnection()
@@ -646,6 +1107,7 @@ static void MtmAcceptOneConnection()
 					MtmUnregisterSocket(sockets[node]);
 				}
 				sockets[node] = fd;
+				MtmResetChannel(node);
 				MtmRegisterSocket(fd, node);
 				MtmOnNodeConnect(node+1);
 			}
@@ -747,6 +1209,11 @@ static void MtmSender(Datum arg)
 		}
 
 		MtmCheckHeartbeat();
+
+		if (MtmArbiterCoalesceDelay != 0 && Mtm->sendQueue != NULL) {
+			/* Give other backends a chance to enqueue more messages which will be sent in the same batch */
+			pg_usleep(MtmArbiterCoalesceDelay);
+		}
 		/* 
 		 * Use shared lock to improve locality,
 		 * because all other process modifying this list are using exclusive lock 
@@ -763,12 +1230,16 @@ static void MtmSender(Datum arg)
 
 		SpinLockRelease(&Mtm->queueSpinlock);
 
+		/*
+		 * Serve connected nodes first. Messages to the node which connection is broken
+		 * are kept until it is reestablished by MtmMaintainConnections.
+		 */
 		for (i = 0; i < Mtm->nAllNodes; i++) { 
-			if (txBuffer[i].used != 0) { 
-				MtmSendToNode(i, txBuffer[i].data, txBuffer[i].used*sizeof(MtmArbiterMessage));
+			if (txBuffer[i].used != 0 && MtmSendToNode(i, txBuffer[i].data, txBuffer[i].used)) { 
 				txBuffer[i].used = 0;
 			}
 		}		
+		MtmMaintainConnections(txBuffer);
 		CHECK_FOR_INTERRUPTS();
 		MtmCheckHeartbeat();
 	}
@@ -777,7 +1248,6 @@ static void MtmSender(Datum arg)
 }
 
 
-#if !USE_EPOLL
 static bool MtmRecovery()
 {
 	int nNodes = Mtm->nAllNodes;
@@ -800,7 +1270,6 @@ static bool MtmRecovery()
     }
 	return recovered;
 }
-#endif
 
 static void MtmMonitor(Datum arg)
 {
@@ -818,7 +1287,10 @@ static void MtmMonitor(Datum arg)
 	BackgroundWorkerInitializeConnection(MtmDatabaseName, NULL);
 
 	while (!stop) {
-		int rc = WaitLatch(&MyProc->procLatch, WL_TIMEOUT | WL_POSTMASTER_DEATH, MtmHeartbeatRecvTimeout);
+		/* Response of referee is processed as soon as it is received */
+		int events = 0;
+		pgsocket sock = MtmRefereeSocket(&events);
+		int rc = WaitLatchOrSocket(&MyProc->procLatch, WL_TIMEOUT | WL_POSTMASTER_DEATH | events, sock, MtmHeartbeatRecvTimeout);
 		if (rc & WL_POSTMASTER_DEATH) { 
 			break;
 		}
@@ -830,26 +1302,295 @@ static void MtmMonitor(Datum arg)
 		}
 
 		MtmRefreshClusterStatus();
+		BgwPoolShrink(&Mtm->pool);
 	}
 }
 
+/*
+ * Read and process messages from the node.
+ * Returns true if not all data was read from the socket.
+ */
+static bool MtmReceiveFromNode(int i)
+{
+	int nNodes = MtmMaxNodes;
+	MtmArbiterMessage unpacked;
+	MtmMessageBatch responses;
+	MtmChannel* chan = MtmGetChannel(i);
+	char const* src;
+	bool more;
+	int rc;
+
+	rc = MtmReadFromNode(i, &chan->buf, &more);
+	if (rc <= 0) {
+		if (rc < 0) { 
+			MTM_LOG1("Failed to read response from node %d", i+1);
+		}
+		return false;
+	}
+
+	src = chan->buf.data;
+	responses.nMessages = 0;
+	
+	MtmLock(LW_EXCLUSIVE);						
+
+	while ((rc = MtmUnpackMessage(i, &src, chan->buf.data + chan->buf.len, &unpacked)) > 0) { 
+		MtmArbiterMessage* msg = &unpacked;
+		MtmTransState* ts;
+		MtmTransMap* tm;
+		int node = msg->node;
+
+		Assert(node > 0 && node <= nNodes && node != MtmNodeId);
+
+		if (Mtm->nodes[node-1].connectivityMask != msg->connectivityMask) { 
+			MTM_ELOG(LOG, "Node %d changes it connectivity mask from %llx to %llx", node, Mtm->nodes[node-1].connectivityMask, msg->connectivityMask);
+		}
+
+		Mtm->nodes[node-1].oldestSnapshot = msg->oldestSnapshot;
+		Mtm->nodes[node-1].disabledNodeMask = msg->disabledNodeMask;
+		Mtm->nodes[node-1].connectivityMask = msg->connectivityMask;
+		Mtm->nodes[node-1].lastHeartbeat = MtmGetSystemTime();
+
+		MtmCheckResponse(msg);
+		MTM_LOG2("Receive response %s for transaction %s from node %d", MtmMessageKindMnem[msg->code], msg->gid, node);
+
+		switch (msg->code) {
+		  case MSG_HEARTBEAT:
+			MTM_LOG4("Receive HEARTBEAT from node %d with timestamp %lld delay %lld", 
+					 node, msg->csn, USEC_TO_MSEC(MtmGetSystemTime() - msg->csn)); 
+			Mtm->nodes[node-1].nHeartbeats += 1;
+			continue;						
+		  case MSG_POLL_REQUEST:
+			Assert(*msg->gid);
+			tm = (MtmTransMap*)hash_search(MtmGid2State, msg->gid, HASH_FIND, NULL);
+			if (tm == NULL || tm->state == NULL) { 
+				MTM_ELOG(WARNING, "Request for unexisted transaction %s from node %d", msg->gid, node);
+				msg->status = TRANSACTION_STATUS_ABORTED;
+			} else {
+				msg->status = tm->state->status;
+				msg->csn = tm->state->csn;
+				MTM_LOG1("Send response %s for transaction %s to node %d", MtmTxnStatusMnem[msg->status], msg->gid, node);
+			}
+			MtmInitMessage(msg, MSG_POLL_STATUS);
+			MtmBatchMessage(&responses, msg);
+			continue;
+		  case MSG_LOCK_GRAPH_RESYNC:
+			MTM_LOG1("Node %d requests full lock graph", node);
+			Mtm->lockGraphResync = true;
+			continue;
+		  case MSG_POLL_STATUS:
+			Assert(*msg->gid);
+			tm = (MtmTransMap*)hash_search(MtmGid2State, msg->gid, HASH_FIND, NULL);
+			if (tm == NULL || tm->state == NULL) { 
+				MTM_ELOG(WARNING, "Response for non-existing transaction %s from node %d", msg->gid, node);
+			} else {
+				ts = tm->state;
+				BIT_SET(ts->votedMask, node-1);
+				if (ts->status == TRANSACTION_STATUS_UNKNOWN || ts->status == TRANSACTION_STATUS_IN_PROGRESS) { 
+					if (msg->status == TRANSACTION_STATUS_IN_PROGRESS || msg->status == TRANSACTION_STATUS_ABORTED) {
+						MTM_ELOG(LOG, "Abort prepared transaction %s because it is in state %s at node %d",
+							 msg->gid, MtmTxnStatusMnem[msg->status], node);
+
+						TXFINISH("%s ABORT, MSG_POLL_STATUS", msg->gid);
+						MtmResolvePreparedTransaction(ts, false, false);
+					} 
+					else if (msg->status == TRANSACTION_STATUS_COMMITTED || msg->status == TRANSACTION_STATUS_UNKNOWN)
+					{ 
+						if (msg->csn > ts->csn) {
+							ts->csn = msg->csn;
+							MtmSyncClock(ts->csn);
+						}
+						if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
+							MTM_ELOG(LOG, "Commit transaction %s because it is prepared at all live nodes", msg->gid);		
+
+							TXFINISH("%s COMMIT, MSG_POLL_STATUS", msg->gid);
+							MtmResolvePreparedTransaction(ts, true, false);
+						} else { 
+							MTM_LOG1("Receive response for transaction %s -> %s, participants=%llx, voted=%llx", 
+									 msg->gid, MtmTxnStatusMnem[msg->status], ts->participantsMask, ts->votedMask);		
+						}
+					} else {
+						MTM_ELOG(LOG, "Receive response %s for transaction %s for node %d, votedMask %llx, participantsMask %llx",
+							 MtmTxnStatusMnem[msg->status], msg->gid, node, ts->votedMask, ts->participantsMask & ~Mtm->disabledNodeMask);
+						continue;
+					}
+				} else if (ts->status == TRANSACTION_STATUS_ABORTED && msg->status == TRANSACTION_STATUS_COMMITTED) {
+					MTM_ELOG(WARNING, "Transaction %s is aborted at node %d but committed at node %d", msg->gid, MtmNodeId, node);
+				} else if (msg->status == TRANSACTION_STATUS_ABORTED && ts->status == TRANSACTION_STATUS_COMMITTED) {
+					MTM_ELOG(WARNING, "Transaction %s is committed at node %d but aborted at node %d", msg->gid, MtmNodeId, node);
+				} else { 
+					MTM_ELOG(LOG, "Receive response %s for transaction %s status %s for node %d, votedMask %llx, participantsMask %llx",
+						 MtmTxnStatusMnem[msg->status], msg->gid, MtmTxnStatusMnem[ts->status], node, ts->votedMask, ts->participantsMask & ~Mtm->disabledNodeMask);
+				}
+			}
+			continue;
+		  default:
+			break;
+		}
+		if (BIT_CHECK(msg->disabledNodeMask, node-1) || BIT_CHECK(Mtm->disabledNodeMask, node-1)) {
+			MTM_ELOG(WARNING, "Ignore message from dead node %d\n", node);
+			continue;
+		}
+		ts = MtmXidLookup(msg->dxid);
+		if (ts == NULL) { 
+			MTM_ELOG(WARNING, "Ignore response for non-existing transaction %llu from node %d", (long64)msg->dxid, node);
+			continue;
+		}
+		Assert(msg->code == MSG_ABORTED || strcmp(msg->gid, ts->gid) == 0);
+		if (BIT_CHECK(ts->votedMask, node-1)) {
+			MTM_ELOG(WARNING, "Receive deteriorated %s response for transaction %s (%llu) from node %d",
+				 MtmMessageKindMnem[msg->code], ts->gid, (long64)ts->xid, node);
+			continue;
+		}
+		if (MtmQuorumCommit && MtmIsCoordinator(ts) && ts->status != TRANSACTION_STATUS_ABORTED
+			&& (ts->votingCompleted || (msg->code == MSG_PREPARED && ts->isPrepared)))
+		{
+			/* Vote of node outside of the quorum arrived after the decision (or after the first round of it) */
+			if (msg->code == MSG_ABORTED) {
+				MTM_ELOG(WARNING, "Transaction %s (%llu) committed by quorum is aborted at node %d: the node has to be recovered",
+						 ts->gid, (long64)ts->xid, node);
+			}
+			continue;
+		}
+		BIT_SET(ts->votedMask, node-1);
+
+		if (MtmIsCoordinator(ts)) {
+			switch (msg->code) { 
+			  case MSG_PREPARED:
+				MTM_TXTRACE(ts, "MtmTransReceiver got MSG_PREPARED");
+				MtmTraceRecord(ts->gid, MTM_TRACE_VOTE, node, msg->csn);
+				if (ts->status == TRANSACTION_STATUS_COMMITTED) { 
+					MTM_ELOG(WARNING, "Receive PREPARED response for already committed transaction %llu from node %d",
+						 (long64)ts->xid, node);
+					continue;
+				}
+				Mtm->nodes[node-1].transDelay += MtmGetCurrentTime() - ts->csn;
+				MtmPerfRecord(MTM_PERF_VOTE, node, MtmGetCurrentTime() - ts->csn);
+				ts->xids[node-1] = msg->sxid;
+				
+#if 0
+				/* This code seems to be deteriorated because now checking that distributed transaction involves all live nodes is done at replica while applying PREPARE */
+				if ((~msg->disabledNodeMask & Mtm->disabledNodeMask) != 0) { 
+					/* Coordinator's disabled mask is wider than of this node: so reject such transaction to avoid 
+					   commit on smaller subset of nodes */
+					MTM_ELOG(WARNING, "Coordinator of distributed transaction %s (%llu) see less nodes than node %d: %llx instead of %llx",
+						 ts->gid, (long64)ts->xid, node, Mtm->disabledNodeMask, msg->disabledNodeMask);
+					MtmAbortTransaction(ts);
+				}
+#endif
+				if (MtmVotesCollected(ts)) {
+					/* All nodes (or quorum of them) are finished their transactions */
+					if (ts->status == TRANSACTION_STATUS_ABORTED) { 
+						MtmWakeUpBackend(ts);								
+					} else { 
+						Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
+						MTM_LOG2("Transaction %s is prepared (status=%s participants=%llx disabled=%llx, voted=%llx)", 
+								 ts->gid, MtmTxnStatusMnem[ts->status], ts->participantsMask, Mtm->disabledNodeMask, ts->votedMask);
+						ts->isPrepared = true;
+						if (ts->isTwoPhase) { 
+							MtmWakeUpBackend(ts);										
+						} else if (MtmUseDtm) { 
+							MTM_TXTRACE(ts, "MtmTransReceiver send MSG_PRECOMMIT");
+							Assert(replorigin_session_origin == InvalidRepOriginId);
+							ts->isPrepared = false;
+							SetLatch(&ProcGlobal->allProcs[ts->procno].procLatch);
+						} else { 
+							ts->status = TRANSACTION_STATUS_UNKNOWN;
+							MtmWakeUpBackend(ts);
+						}
+					}
+				}
+				break;						   
+			  case MSG_ABORTED:
+				MtmTraceRecord(ts->gid, MTM_TRACE_ABORT_VOTE, node, msg->csn);
+				if (ts->status == TRANSACTION_STATUS_COMMITTED) { 
+					MTM_ELOG(WARNING, "Receive ABORTED response for already committed transaction %s (%llu) from node %d",
+						 ts->gid, (long64)ts->xid, node);
+					continue;
+				}
+				if (ts->status != TRANSACTION_STATUS_ABORTED) { 
+					MTM_LOG1("Arbiter receive abort message for transaction %s (%llu) from node %d", ts->gid, (long64)ts->xid, node);
+					Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
+					ts->abortedByNode = node;
+					MtmAbortTransaction(ts);
+				}
+				if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
+					MtmWakeUpBackend(ts);
+				}
+				break;
+			  case MSG_PRECOMMITTED:
+				MTM_TXTRACE(ts, "MtmTransReceiver got MSG_PRECOMMITTED");
+                            if (ts->status == TRANSACTION_STATUS_COMMITTED) {
+                                MTM_ELOG(WARNING, "Receive PRECOMMITTED response for already committed transaction %s (%llu) from node %d",
+                                     ts->gid, (long64)ts->xid, node);
+                                continue;
+                            }
+				if (ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
+					if (msg->csn > ts->csn) {
+						ts->csn = msg->csn;
+						MtmSyncClock(ts->csn);
+					}
+					if (MtmVotesCollected(ts)) {
+						ts->csn = MtmAssignCSN();
+						ts->status = TRANSACTION_STATUS_UNKNOWN;
+						MtmWakeUpBackend(ts);
+					}
+				} else { 
+					Assert(ts->status == TRANSACTION_STATUS_ABORTED);
+					MTM_ELOG(WARNING, "Receive PRECOMMITTED response for aborted transaction %s (%llu) from node %d", 
+							 ts->gid, (long64)ts->xid, node); 
+					if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
+						MtmWakeUpBackend(ts);
+					}
+				}	
+				break;
+			  default:
+				Assert(false);
+			} 
+		} else { 
+			Assert(false); /* All broadcasts are now sent through pglogical */
+		}
+	}
+	MtmUnlock();
+
+	/* answer all poll requests of the buffer at once */
+	MtmSendMessageBatch(&responses);
+	
+	if (rc < 0) {
+		MTM_ELOG(WARNING, "Arbiter receive corrupted message from node %d", i+1);
+		if (sockets[i] >= 0) { 
+			MtmDisconnect(i);
+		}
+		resetStringInfo(&chan->buf);
+	} else { 
+		chan->buf.len -= src - chan->buf.data;
+		if (chan->buf.len != 0) { 
+			memmove(chan->buf.data, src, chan->buf.len);
+		}
+	}
+	return more;
+}
+
 static void MtmReceiver(Datum arg)
 {
 	int nNodes = MtmMaxNodes;
-	int nResponses;
-	int i, j, n, rc;
-	MtmBuffer* rxBuffer = (MtmBuffer*)palloc0(sizeof(MtmBuffer)*nNodes);
+	int i, n;
+	nodemask_t pending_mask = 0; /* nodes which sockets may contain unread data */
 	timestamp_t lastHeartbeatCheck = MtmGetSystemTime();
 	timestamp_t now;
 	timestamp_t selectTimeout = MtmHeartbeatRecvTimeout;
 
 #if USE_EPOLL
-	struct epoll_event* events = (struct epoll_event*)palloc(sizeof(struct epoll_event)*nNodes);
-    epollfd = epoll_create(nNodes);
-#else
+	int j;
+	struct epoll_event* epoll_events = (struct epoll_event*)palloc(sizeof(struct epoll_event)*nNodes);
+	if (!MtmUseRDMA) { 
+		epollfd = epoll_create(nNodes);
+		if (epollfd < 0) { 
+			MTM_ELOG(WARNING, "Arbiter failed to create epoll set, use select instead: %s", strerror(errno));
+		}
+	}
+#endif
     FD_ZERO(&inset);
     max_fd = 0;
-#endif
 
 	pqsignal(SIGINT, SetStop);
 	pqsignal(SIGQUIT, SetStop);
@@ -866,282 +1607,64 @@ static void MtmReceiver(Datum arg)
 
 	MtmAcceptIncomingConnections();
 
-	for (i = 0; i < nNodes; i++) { 
-		rxBuffer[i].size = INIT_BUFFER_SIZE;
-		rxBuffer[i].data = palloc(INIT_BUFFER_SIZE*sizeof(MtmArbiterMessage));
-	}
-
 	while (!stop) {
-#if USE_EPOLL
-        n = epoll_wait(epollfd, events, nNodes, selectTimeout);
-		if (n < 0) { 
-			if (errno == EINTR) { 
-				continue;
-			}
-			MTM_ELOG(ERROR, "Arbiter failed to poll sockets: %s", strerror(errno));
-		}
-		for (j = 0; j < n; j++) {
-			i = events[j].data.u32;
-			if (events[j].events & EPOLLERR) {
-				MTM_ELOG(WARNING, "Arbiter lost connection with node %d", i+1);
-				MtmDisconnect(i);
-			} 
-		}
-		for (j = 0; j < n; j++) {
-			if (events[j].events & EPOLLIN)  
-#else
-		fd_set events;
-
 		if (ConfigReloadPending)
 		{
 			ConfigReloadPending = false;
 			ProcessConfigFile(PGC_SIGHUP);
 		}
-
-		do { 
-			struct timeval tv;
-			events = inset;
-			tv.tv_sec = selectTimeout/1000;
-			tv.tv_usec = selectTimeout%1000*1000;
+#if USE_EPOLL
+		if (epollfd >= 0) { 
 			do { 
-				n = pg_select(max_fd+1, &events, NULL, NULL, &tv, MtmUseRDMA);
+				n = epoll_wait(epollfd, epoll_events, nNodes, pending_mask != 0 ? 0 : selectTimeout);
 			} while (n < 0 && errno == EINTR);
-		} while (n < 0 && MtmRecovery());
-		
-		if (n < 0) {
-			MTM_ELOG(ERROR, "Arbiter failed to select sockets: %s", strerror(errno));
-		}
-		for (i = 0; i < nNodes; i++) { 
-			if (sockets[i] >= 0 && FD_ISSET(sockets[i], &events)) 
-#endif
-			{
+			if (n < 0) { 
+				MTM_ELOG(ERROR, "Arbiter failed to poll sockets: %s", strerror(errno));
+			}
+			for (j = 0; j < n; j++) {
+				i = epoll_events[j].data.u32;
 				if (i+1 == MtmNodeId) { 
-					Assert(sockets[i] == gateway);
 					MtmAcceptOneConnection();
-					continue;
-				}  
-				
-				rc = MtmReadFromNode(i, (char*)rxBuffer[i].data + rxBuffer[i].used, rxBuffer[i].size-rxBuffer[i].used);
-				if (rc <= 0) {
-					MTM_LOG1("Failed to read response from node %d", i+1);
-					continue;
+				} else if (sockets[i] >= 0) { 
+					/* Errors are detected by read */
+					BIT_SET(pending_mask, i);
 				}
-
-				rxBuffer[i].used += rc;
-				nResponses = rxBuffer[i].used/sizeof(MtmArbiterMessage);
-
-				
-				MtmLock(LW_EXCLUSIVE);						
-
-				for (j = 0; j < nResponses; j++) { 
-					MtmArbiterMessage* msg = &rxBuffer[i].data[j];
-					MtmTransState* ts;
-					MtmTransMap* tm;
-					int node = msg->node;
-
-					Assert(node > 0 && node <= nNodes && node != MtmNodeId);
-
-					if (Mtm->nodes[node-1].connectivityMask != msg->connectivityMask) { 
-						MTM_ELOG(LOG, "Node %d changes it connectivity mask from %llx to %llx", node, Mtm->nodes[node-1].connectivityMask, msg->connectivityMask);
-					}
-
-					Mtm->nodes[node-1].oldestSnapshot = msg->oldestSnapshot;
-					Mtm->nodes[node-1].disabledNodeMask = msg->disabledNodeMask;
-					Mtm->nodes[node-1].connectivityMask = msg->connectivityMask;
-					Mtm->nodes[node-1].lastHeartbeat = MtmGetSystemTime();
-
-					MtmCheckResponse(msg);
-					MTM_LOG2("Receive response %s for transaction %s from node %d", MtmMessageKindMnem[msg->code], msg->gid, node);
-
-					switch (msg->code) {
-					  case MSG_HEARTBEAT:
-						MTM_LOG4("Receive HEARTBEAT from node %d with timestamp %lld delay %lld", 
-								 node, msg->csn, USEC_TO_MSEC(MtmGetSystemTime() - msg->csn)); 
-						Mtm->nodes[node-1].nHeartbeats += 1;
-						continue;						
-					  case MSG_POLL_REQUEST:
-						Assert(*msg->gid);
-						tm = (MtmTransMap*)hash_search(MtmGid2State, msg->gid, HASH_FIND, NULL);
-						if (tm == NULL || tm->state == NULL) { 
-							MTM_ELOG(WARNING, "Request for unexisted transaction %s from node %d", msg->gid, node);
-							msg->status = TRANSACTION_STATUS_ABORTED;
-						} else {
-							msg->status = tm->state->status;
-							msg->csn = tm->state->csn;
-							MTM_LOG1("Send response %s for transaction %s to node %d", MtmTxnStatusMnem[msg->status], msg->gid, node);
-						}
-						MtmInitMessage(msg, MSG_POLL_STATUS);
-						MtmSendMessage(msg);
-						continue;
-					  case MSG_POLL_STATUS:
-						Assert(*msg->gid);
-						tm = (MtmTransMap*)hash_search(MtmGid2State, msg->gid, HASH_FIND, NULL);
-						if (tm == NULL || tm->state == NULL) { 
-							MTM_ELOG(WARNING, "Response for non-existing transaction %s from node %d", msg->gid, node);
-						} else {
-							ts = tm->state;
-							BIT_SET(ts->votedMask, node-1);
-							if (ts->status == TRANSACTION_STATUS_UNKNOWN || ts->status == TRANSACTION_STATUS_IN_PROGRESS) { 
-								if (msg->status == TRANSACTION_STATUS_IN_PROGRESS || msg->status == TRANSACTION_STATUS_ABORTED) {
-									MTM_ELOG(LOG, "Abort prepared transaction %s because it is in state %s at node %d",
-										 msg->gid, MtmTxnStatusMnem[msg->status], node);
-
-									replorigin_session_origin = DoNotReplicateId;
-									TXFINISH("%s ABORT, MSG_POLL_STATUS", msg->gid);
-									MtmFinishPreparedTransaction(ts, false);
-									replorigin_session_origin = InvalidRepOriginId;
-								} 
-								else if (msg->status == TRANSACTION_STATUS_COMMITTED || msg->status == TRANSACTION_STATUS_UNKNOWN)
-								{ 
-									if (msg->csn > ts->csn) {
-										ts->csn = msg->csn;
-										MtmSyncClock(ts->csn);
-									}
-									if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
-										MTM_ELOG(LOG, "Commit transaction %s because it is prepared at all live nodes", msg->gid);		
-
-										replorigin_session_origin = DoNotReplicateId;
-										TXFINISH("%s COMMIT, MSG_POLL_STATUS", msg->gid);
-										MtmFinishPreparedTransaction(ts, true);
-										replorigin_session_origin = InvalidRepOriginId;
-									} else { 
-										MTM_LOG1("Receive response for transaction %s -> %s, participants=%llx, voted=%llx", 
-												 msg->gid, MtmTxnStatusMnem[msg->status], ts->participantsMask, ts->votedMask);		
-									}
-								} else {
-									MTM_ELOG(LOG, "Receive response %s for transaction %s for node %d, votedMask %llx, participantsMask %llx",
-										 MtmTxnStatusMnem[msg->status], msg->gid, node, ts->votedMask, ts->participantsMask & ~Mtm->disabledNodeMask);
-									continue;
-								}
-							} else if (ts->status == TRANSACTION_STATUS_ABORTED && msg->status == TRANSACTION_STATUS_COMMITTED) {
-								MTM_ELOG(WARNING, "Transaction %s is aborted at node %d but committed at node %d", msg->gid, MtmNodeId, node);
-							} else if (msg->status == TRANSACTION_STATUS_ABORTED && ts->status == TRANSACTION_STATUS_COMMITTED) {
-								MTM_ELOG(WARNING, "Transaction %s is committed at node %d but aborted at node %d", msg->gid, MtmNodeId, node);
-							} else { 
-								MTM_ELOG(LOG, "Receive response %s for transaction %s status %s for node %d, votedMask %llx, participantsMask %llx",
-									 MtmTxnStatusMnem[msg->status], msg->gid, MtmTxnStatusMnem[ts->status], node, ts->votedMask, ts->participantsMask & ~Mtm->disabledNodeMask);
-							}
-						}
-						continue;
-					  default:
-						break;
-					}
-					if (BIT_CHECK(msg->disabledNodeMask, node-1) || BIT_CHECK(Mtm->disabledNodeMask, node-1)) {
-						MTM_ELOG(WARNING, "Ignore message from dead node %d\n", node);
-						continue;
-					}
-					ts = (MtmTransState*)hash_search(MtmXid2State, &msg->dxid, HASH_FIND, NULL);
-					if (ts == NULL) { 
-						MTM_ELOG(WARNING, "Ignore response for non-existing transaction %llu from node %d", (long64)msg->dxid, node);
-						continue;
-					}
-					Assert(msg->code == MSG_ABORTED || strcmp(msg->gid, ts->gid) == 0);
-					if (BIT_CHECK(ts->votedMask, node-1)) {
-						MTM_ELOG(WARNING, "Receive deteriorated %s response for transaction %s (%llu) from node %d",
-							 MtmMessageKindMnem[msg->code], ts->gid, (long64)ts->xid, node);
-						continue;
-					}
-					BIT_SET(ts->votedMask, node-1);
-
-					if (MtmIsCoordinator(ts)) {
-						switch (msg->code) { 
-						  case MSG_PREPARED:
-							MTM_TXTRACE(ts, "MtmTransReceiver got MSG_PREPARED");
-							if (ts->status == TRANSACTION_STATUS_COMMITTED) { 
-								MTM_ELOG(WARNING, "Receive PREPARED response for already committed transaction %llu from node %d",
-									 (long64)ts->xid, node);
-								continue;
-							}
-							Mtm->nodes[node-1].transDelay += MtmGetCurrentTime() - ts->csn;
-							ts->xids[node-1] = msg->sxid;
-							
-#if 0
-							/* This code seems to be deteriorated because now checking that distributed transaction involves all live nodes is done at replica while applying PREPARE */
-							if ((~msg->disabledNodeMask & Mtm->disabledNodeMask) != 0) { 
-								/* Coordinator's disabled mask is wider than of this node: so reject such transaction to avoid 
-								   commit on smaller subset of nodes */
-								MTM_ELOG(WARNING, "Coordinator of distributed transaction %s (%llu) see less nodes than node %d: %llx instead of %llx",
-									 ts->gid, (long64)ts->xid, node, Mtm->disabledNodeMask, msg->disabledNodeMask);
-								MtmAbortTransaction(ts);
-							}
+			}
+		} else 
 #endif
-							if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
-								/* All nodes are finished their transactions */
-								if (ts->status == TRANSACTION_STATUS_ABORTED) { 
-									MtmWakeUpBackend(ts);								
-								} else { 
-									Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
-									MTM_LOG2("Transaction %s is prepared (status=%s participants=%llx disabled=%llx, voted=%llx)", 
-											 ts->gid, MtmTxnStatusMnem[ts->status], ts->participantsMask, Mtm->disabledNodeMask, ts->votedMask);
-									ts->isPrepared = true;
-									if (ts->isTwoPhase) { 
-										MtmWakeUpBackend(ts);										
-									} else if (MtmUseDtm) { 
-										MTM_TXTRACE(ts, "MtmTransReceiver send MSG_PRECOMMIT");
-										Assert(replorigin_session_origin == InvalidRepOriginId);
-										ts->isPrepared = false;
-										SetLatch(&ProcGlobal->allProcs[ts->procno].procLatch);
-									} else { 
-										ts->status = TRANSACTION_STATUS_UNKNOWN;
-										MtmWakeUpBackend(ts);
-									}
-								}
-							}
-							break;						   
-						  case MSG_ABORTED:
-							if (ts->status == TRANSACTION_STATUS_COMMITTED) { 
-								MTM_ELOG(WARNING, "Receive ABORTED response for already committed transaction %s (%llu) from node %d",
-									 ts->gid, (long64)ts->xid, node);
-								continue;
-							}
-							if (ts->status != TRANSACTION_STATUS_ABORTED) { 
-								MTM_LOG1("Arbiter receive abort message for transaction %s (%llu) from node %d", ts->gid, (long64)ts->xid, node);
-								Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
-								ts->abortedByNode = node;
-								MtmAbortTransaction(ts);
-							}
-							if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
-								MtmWakeUpBackend(ts);
-							}
-							break;
-						  case MSG_PRECOMMITTED:
-							MTM_TXTRACE(ts, "MtmTransReceiver got MSG_PRECOMMITTED");
-                            if (ts->status == TRANSACTION_STATUS_COMMITTED) {
-                                MTM_ELOG(WARNING, "Receive PRECOMMITTED response for already committed transaction %s (%llu) from node %d",
-                                     ts->gid, (long64)ts->xid, node);
-                                continue;
-                            }
-							if (ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
-								if (msg->csn > ts->csn) {
-									ts->csn = msg->csn;
-									MtmSyncClock(ts->csn);
-								}
-								if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
-									ts->csn = MtmAssignCSN();
-									ts->status = TRANSACTION_STATUS_UNKNOWN;
-									MtmWakeUpBackend(ts);
-								}
-							} else { 
-								Assert(ts->status == TRANSACTION_STATUS_ABORTED);
-								MTM_ELOG(WARNING, "Receive PRECOMMITTED response for aborted transaction %s (%llu) from node %d", 
-										 ts->gid, (long64)ts->xid, node); 
-								if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) {
-									MtmWakeUpBackend(ts);
-								}
-							}	
-							break;
-						  default:
-							Assert(false);
-						} 
+		{
+			fd_set events;
+
+			do { 
+				struct timeval tv;
+				timestamp_t timeout = pending_mask != 0 ? 0 : selectTimeout;
+				events = inset;
+				tv.tv_sec = timeout/1000;
+				tv.tv_usec = timeout%1000*1000;
+				do { 
+					n = pg_select(max_fd+1, &events, NULL, NULL, &tv, MtmUseRDMA);
+				} while (n < 0 && errno == EINTR);
+			} while (n < 0 && MtmRecovery());
+		
+			if (n < 0) {
+				MTM_ELOG(ERROR, "Arbiter failed to select sockets: %s", strerror(errno));
+			}
+			for (i = 0; i < nNodes; i++) { 
+				if (sockets[i] >= 0 && FD_ISSET(sockets[i], &events)) { 
+					if (i+1 == MtmNodeId) { 
+						Assert(sockets[i] == gateway);
+						MtmAcceptOneConnection();
 					} else { 
-						Assert(false); /* All broadcasts are now sent through pglogical */
+						BIT_SET(pending_mask, i);
 					}
 				}
-				MtmUnlock();
-				
-				rxBuffer[i].used -= nResponses*sizeof(MtmArbiterMessage);
-				if (rxBuffer[i].used != 0) { 
-					memmove(rxBuffer[i].data, (char*)rxBuffer[i].data + nResponses*sizeof(MtmArbiterMessage), rxBuffer[i].used);
+			}
+		}
+		for (i = 0; i < nNodes; i++) { 
+			if (BIT_CHECK(pending_mask, i)) { 
+				BIT_CLEAR(pending_mask, i);
+				if (sockets[i] >= 0 && MtmReceiveFromNode(i)) { 
+					BIT_SET(pending_mask, i);
 				}
 			}
 		}
@@ -1150,7 +1673,7 @@ static void MtmReceiver(Datum arg)
 			/* Check for heartbeats only in case of timeout expiration: it means that we do not have non-processed events.
 			 * It helps to avoid false node failure detection because of blocking receiver.
 			 */
-			if (n == 0) {
+			if (n == 0 && pending_mask == 0) {
 				selectTimeout = MtmHeartbeatRecvTimeout; /* restore select timeout */ 
 				if (now > lastHeartbeatCheck + MSEC_TO_USEC(MtmHeartbeatRecvTimeout)) { 
 					if (!MtmWatchdog(now)) { 
@@ -14,10 +14,14 @@
 
 #include "bgwpool.h"
 #include "multimaster.h"
+#include "perfstat.h"
 #include "utils/guc.h"
 
 bool MtmIsLogicalReceiver;
 int  MtmMaxWorkers;
+int  MtmWorkerGrowDelay;
+int  MtmWorkerIdleTimeout;
+BgwPoolStallHook BgwPoolProducerStallHook;
 
 static BgwPool* MtmPool;
 
@@ -29,9 +33,207 @@ static void BgwShutdownWorker(int sig)
 	}
 }
 
+typedef enum
+{
+	BGW_CELLS_FREE,   /* cells are free and can be claimed by producer */
+	BGW_CELLS_BUSY,   /* cells are not yet consumed by workers: queue is full */
+	BGW_CELLS_MOVED   /* cells were already claimed by some other producer */
+} BgwCellsStatus;
+
+typedef struct
+{
+	int         size;        /* size of work item (without header) */
+	timestamp_t enqueueTime; /* time when item was placed in the queue */
+} BgwPoolItemHeader;
+
+static inline size_t BgwPoolCellsRequired(size_t size)
+{
+	return (size + sizeof(BgwPoolItemHeader) + BGW_POOL_CELL_SIZE - 1) / BGW_POOL_CELL_SIZE;
+}
+
+static inline size_t BgwPoolCellOffset(BgwPoolQueue* q, uint64 pos)
+{
+	return (size_t)(pos % q->nCells) * BGW_POOL_CELL_SIZE;
+}
+
+/*
+ * Decrement counter of sleeping processes if it is not zero.
+ * Returns true if counter was decremented.
+ */
+static bool BgwPoolDecrementWaiters(pg_atomic_uint32* waiters)
+{
+	uint32 n = pg_atomic_read_u32(waiters);
+	while (n != 0) {
+		if (pg_atomic_compare_exchange_u32(waiters, &n, n - 1)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Sleep on the semaphore after registering in waiters counter.
+ * If condition becomes true after registration, try to cancel the wait.
+ * If somebody has already decremented the counter on our behalf, then it
+ * has posted (or is going to post) the semaphore, so we have to consume it.
+ */
+static void BgwPoolWait(BgwPool* pool, pg_atomic_uint32* waiters, PGSemaphore sema, bool (*ready)(BgwPool* pool, void* arg), void* arg)
+{
+	pg_atomic_fetch_add_u32(waiters, 1);
+	if (!ready(pool, arg) || !BgwPoolDecrementWaiters(waiters)) {
+		PGSemaphoreLock(sema);
+	}
+}
+
+static bool BgwPoolHasWork(BgwPool* pool, void* arg)
+{
+	int lane;
+	if (pool->shutdown) {
+		return true;
+	}
+	for (lane = 0; lane < BGW_N_LANES; lane++) {
+		BgwPoolQueue* q = &pool->lanes[lane];
+		uint64 pos = pg_atomic_read_u64(&q->head);
+		if (pg_atomic_read_u64(&q->seq[pos % q->nCells]) == pos + 1) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static BgwCellsStatus BgwPoolCheckCells(BgwPoolQueue* q, uint64 pos, size_t nCells)
+{
+	size_t i;
+	for (i = 0; i < nCells; i++) {
+		int64 diff = (int64)(pg_atomic_read_u64(&q->seq[(pos + i) % q->nCells]) - (pos + i));
+		if (diff < 0) {
+			return BGW_CELLS_BUSY;
+		} else if (diff > 0) {
+			return BGW_CELLS_MOVED;
+		}
+	}
+	return BGW_CELLS_FREE;
+}
+
+typedef struct
+{
+	BgwPoolQueue* queue;
+	uint64 pos;
+	size_t nCells;
+} BgwPoolSpaceRequest;
+
+static bool BgwPoolHasSpace(BgwPool* pool, void* arg)
+{
+	BgwPoolSpaceRequest* req = (BgwPoolSpaceRequest*)arg;
+	return pool->shutdown || BgwPoolCheckCells(req->queue, req->pos, req->nCells) != BGW_CELLS_BUSY;
+}
+
+static void BgwPoolUpdatePeakDepth(BgwPool* pool)
+{
+	uint64 depth = BgwPoolGetQueueSize(pool);
+	uint64 peak = pg_atomic_read_u64(&pool->stats.peakDepth);
+	while (depth > peak) {
+		if (pg_atomic_compare_exchange_u64(&pool->stats.peakDepth, &peak, depth)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Check whether this worker was woken up by BgwPoolShrink and should exit.
+ */
+static bool BgwPoolRetire(BgwPool* pool)
+{
+	uint32 n = pg_atomic_read_u32(&pool->nRetiring);
+	while (n != 0) {
+		if (pg_atomic_compare_exchange_u32(&pool->nRetiring, &n, n - 1)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Get next work from the priority lane or, if it is empty, from the bulk lane.
+ * Returns NULL in case of pool shutdown or if worker has to retire.
+ */
+static void* BgwPoolFetch(BgwPool* pool, size_t* size)
+{
+	BgwPoolQueue* q = NULL;
+	uint64 pos = 0;
+	size_t offs = 0;
+	size_t nCells;
+	size_t i;
+	int lane = 0;
+	int len = 0;
+	char* work;
+	BgwPoolItemHeader* hdr = NULL;
+	bool fetched = false;
+
+	while (!fetched) {
+		bool empty = true;
+		if (pool->shutdown || BgwPoolRetire(pool)) {
+			return NULL;
+		}
+		for (lane = 0; lane < BGW_N_LANES; lane++) {
+			int64 diff;
+			q = &pool->lanes[lane];
+			pos = pg_atomic_read_u64(&q->head);
+			offs = BgwPoolCellOffset(q, pos);
+			diff = (int64)(pg_atomic_read_u64(&q->seq[pos % q->nCells]) - (pos + 1));
+			if (diff == 0) {
+				pg_read_barrier();
+				hdr = (BgwPoolItemHeader*)&q->queue[offs];
+				len = hdr->size;
+				fetched = pg_atomic_compare_exchange_u64(&q->head, &pos, pos + BgwPoolCellsRequired(len));
+				empty = false;
+				break;
+			} else if (diff > 0) {
+				/* head was moved by some other worker: retry */
+				empty = false;
+				break;
+			}
+		}
+		if (empty) {
+			/* All lanes are empty or producers have not yet published the works */
+			timestamp_t start = MtmGetSystemTime();
+			pool->overloadStartTime = 0;
+			MtmPerfFlush(true);
+			BgwPoolWait(pool, &pool->nIdleWorkers, &pool->available, BgwPoolHasWork, NULL);
+			pg_atomic_fetch_add_u64(&pool->stats.idleTime, MtmGetSystemTime() - start);
+		}
+	}
+	Assert(len <= q->size);
+	MtmPerfRecord(lane == BGW_LANE_PRIORITY ? MTM_PERF_PRIORITY_QUEUE_WAIT : MTM_PERF_APPLY_QUEUE_WAIT, 0,
+				  MtmGetSystemTime() - hdr->enqueueTime);
+	work = palloc(len);
+	offs += sizeof(BgwPoolItemHeader);
+	if (offs + len <= q->size) {
+		memcpy(work, &q->queue[offs], len);
+	} else {
+		size_t part = q->size - offs;
+		memcpy(work, &q->queue[offs], part);
+		memcpy(work + part, q->queue, len - part);
+	}
+
+	/* Make cells available for the next lap */
+	pg_memory_barrier();
+	nCells = BgwPoolCellsRequired(len);
+	for (i = 0; i < nCells; i++) {
+		pg_atomic_write_u64(&q->seq[(pos + i) % q->nCells], pos + i + q->nCells);
+	}
+	pg_memory_barrier();
+	if (BgwPoolDecrementWaiters(&q->nBlockedProducers)) {
+		PGSemaphoreUnlock(&q->overflow);
+		pool->lastPeakTime = 0;
+	}
+	*size = len;
+	return work;
+}
+
 static void BgwPoolMainLoop(BgwPool* pool)
 {
-    int size;
+    size_t size;
     void* work;
 	static PortalData fakePortal;
 
@@ -58,71 +260,101 @@ static void BgwPoolMainLoop(BgwPool* pool)
 			ConfigReloadPending = false;
 			ProcessConfigFile(PGC_SIGHUP);
 		}
-
-        PGSemaphoreLock(&pool->available);
-        SpinLockAcquire(&pool->lock);
-		if (pool->shutdown) { 	
-			PGSemaphoreUnlock(&pool->available);
+		work = BgwPoolFetch(pool, &size);
+		if (work == NULL) {
+			if (pool->shutdown) {
+				/* Pass shutdown request to the next sleeping worker */
+				PGSemaphoreUnlock(&pool->available);
+			}
 			break;
 		}
-        size = *(int*)&pool->queue[pool->head];
-        Assert(size < pool->size);
-        work = palloc(size);
-        pool->pending -= 1;
-        pool->active += 1;
-		if (pool->lastPeakTime == 0 && pool->active == pool->nWorkers && pool->pending != 0) {
-			pool->lastPeakTime = MtmGetSystemTime();
-		}
-        if (pool->head + size + 4 > pool->size) { 
-            memcpy(work, pool->queue, size);
-            pool->head = INTALIGN(size);
-        } else { 
-            memcpy(work, &pool->queue[pool->head+4], size);
-            pool->head += 4 + INTALIGN(size);
-        }
-        if (pool->size == pool->head) { 
-            pool->head = 0;
-        }
-        if (pool->producerBlocked) {
-            pool->producerBlocked = false;
-            PGSemaphoreUnlock(&pool->overflow);
-			pool->lastPeakTime = 0;
-        }
-        SpinLockRelease(&pool->lock);
+		pg_atomic_fetch_sub_u32(&pool->pending, 1);
+		if (pg_atomic_add_fetch_u32(&pool->active, 1) >= pool->nWorkers) {
+			timestamp_t now = MtmGetSystemTime();
+			pool->lastBusyTime = now;
+			if (pool->lastPeakTime == 0 && pg_atomic_read_u32(&pool->pending) != 0) {
+				pool->lastPeakTime = now;
+			}
+		}
         pool->executor(work, size);
         pfree(work);
-        SpinLockAcquire(&pool->lock);
-        pool->active -= 1;
+		pg_atomic_fetch_sub_u32(&pool->active, 1);
 		pool->lastPeakTime = 0;
-        SpinLockRelease(&pool->lock);
     }
-	SpinLockRelease(&pool->lock);
-	MTM_ELOG(LOG, "Shutdown background worker %d", MyProcPid);
+	MTM_ELOG(LOG, "%s background worker %d", pool->shutdown ? "Shutdown" : "Retire idle", MyProcPid);
+}
+
+/*
+ * Priority lane gets 1/BGW_POOL_PRIORITY_FRACTION of queue size in addition to the bulk lane
+ */
+static size_t BgwPoolLaneCells(size_t queueSize, int lane)
+{
+	return (lane == BGW_LANE_PRIORITY ? queueSize / BGW_POOL_PRIORITY_FRACTION : queueSize) / BGW_POOL_CELL_SIZE;
+}
+
+Size BgwPoolShmemSize(size_t queueSize)
+{
+	Size size = 0;
+	int lane;
+	for (lane = 0; lane < BGW_N_LANES; lane++) {
+		size_t nCells = BgwPoolLaneCells(queueSize, lane);
+		size = add_size(size, add_size(mul_size(nCells, BGW_POOL_CELL_SIZE), mul_size(nCells, sizeof(pg_atomic_uint64))));
+	}
+	return size;
 }
 
 void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname,  char const* dbuser, size_t queueSize, size_t nWorkers)
 {
+	size_t i;
+	int lane;
+
 	MtmPool = pool;
-    pool->queue = (char*)ShmemAlloc(queueSize);
-	if (pool->queue == NULL) { 
-		elog(PANIC, "Failed to allocate memory for background workers pool: %lld bytes requested", (long64)queueSize);
+	pool->size = 0;
+	for (lane = 0; lane < BGW_N_LANES; lane++) {
+		BgwPoolQueue* q = &pool->lanes[lane];
+		q->nCells = BgwPoolLaneCells(queueSize, lane);
+		q->size = q->nCells * BGW_POOL_CELL_SIZE;
+		q->queue = (char*)ShmemAlloc(q->size);
+		q->seq = (pg_atomic_uint64*)ShmemAlloc(q->nCells * sizeof(pg_atomic_uint64));
+		if (q->queue == NULL || q->seq == NULL) {
+			elog(PANIC, "Failed to allocate memory for background workers pool: %lld bytes requested", (long64)BgwPoolShmemSize(queueSize));
+		}
+		for (i = 0; i < q->nCells; i++) {
+			pg_atomic_init_u64(&q->seq[i], i);
+		}
+		PGSemaphoreCreate(&q->overflow);
+		PGSemaphoreReset(&q->overflow);
+		pg_atomic_init_u64(&q->head, 0);
+		pg_atomic_init_u64(&q->tail, 0);
+		pg_atomic_init_u32(&q->nBlockedProducers, 0);
+		pg_atomic_init_u64(&q->nWorks, 0);
+		pg_atomic_init_u64(&q->nStalls, 0);
+		pool->size += q->size;
 	}
     pool->executor = executor;
     PGSemaphoreCreate(&pool->available);
-    PGSemaphoreCreate(&pool->overflow);
     PGSemaphoreReset(&pool->available);
-    PGSemaphoreReset(&pool->overflow);
     SpinLockInit(&pool->lock);
 	pool->shutdown = false;
-    pool->producerBlocked = false;
-    pool->head = 0;
-    pool->tail = 0;
-    pool->size = queueSize;
-    pool->active = 0;
-    pool->pending = 0;
+	pg_atomic_init_u32(&pool->nIdleWorkers, 0);
+	pg_atomic_init_u32(&pool->active, 0);
+	pg_atomic_init_u32(&pool->pending, 0);
+	pg_atomic_init_u32(&pool->nRetiring, 0);
+	pg_atomic_init_u64(&pool->stats.nWorks, 0);
+	pg_atomic_init_u64(&pool->stats.nStalls, 0);
+	pg_atomic_init_u64(&pool->stats.stallTime, 0);
+	pg_atomic_init_u64(&pool->stats.nWakeups, 0);
+	pg_atomic_init_u64(&pool->stats.idleTime, 0);
+	pg_atomic_init_u64(&pool->stats.peakDepth, 0);
+	pg_atomic_init_u64(&pool->stats.nGrows, 0);
+	pg_atomic_init_u64(&pool->stats.nShrinks, 0);
 	pool->nWorkers = nWorkers;
+	pool->nStaticWorkers = nWorkers;
 	pool->lastPeakTime = 0;
 	pool->lastDynamicWorkerStartTime = 0;
+	pool->lastRetireTime = 0;
+	pool->lastBusyTime = 0;
+	pool->overloadStartTime = 0;
 	strncpy(pool->dbname, dbname, MAX_DBNAME_LEN);
 	strncpy(pool->dbuser, dbuser, MAX_DBUSER_LEN);
 }
@@ -161,93 +393,239 @@ void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor)
     }
 }
 
+size_t BgwPoolGetLaneQueueSize(BgwPool* pool, BgwPoolLane lane)
+{
+	BgwPoolQueue* q = &pool->lanes[lane];
+	/* head should be read first: it can never pass tail */
+	uint64 head = pg_atomic_read_u64(&q->head);
+	pg_read_barrier();
+	return (size_t)(pg_atomic_read_u64(&q->tail) - head) * BGW_POOL_CELL_SIZE;
+}
+
 size_t BgwPoolGetQueueSize(BgwPool* pool)
 {
-	size_t used;
-    SpinLockAcquire(&pool->lock);
-	used = pool->head <= pool->tail ? pool->tail - pool->head : pool->size - pool->head + pool->tail;
-    SpinLockRelease(&pool->lock);            
-	return used;
+	size_t size = 0;
+	int lane;
+	for (lane = 0; lane < BGW_N_LANES; lane++) {
+		size += BgwPoolGetLaneQueueSize(pool, (BgwPoolLane)lane);
+	}
+	return size;
 }
 
 
 static void BgwStartExtraWorker(BgwPool* pool)
 {
-	if (pool->nWorkers < MtmMaxWorkers) { 
-		timestamp_t now = MtmGetSystemTime();
-		/*if (pool->lastDynamicWorkerStartTime + MULTIMASTER_BGW_RESTART_TIMEOUT*USECS_PER_SEC < now)*/
-		{ 
-			BackgroundWorker worker;
-			BackgroundWorkerHandle* handle;
-			MemSet(&worker, 0, sizeof(BackgroundWorker));
-			worker.bgw_flags = BGWORKER_SHMEM_ACCESS |  BGWORKER_BACKEND_DATABASE_CONNECTION;
-			worker.bgw_start_time = BgWorkerStart_ConsistentState;
-			worker.bgw_main = BgwPoolDynamicWorkerMainLoop;
-			worker.bgw_restart_time = MULTIMASTER_BGW_RESTART_TIMEOUT;
-			snprintf(worker.bgw_name, BGW_MAXLEN, "bgw_pool_dynworker_%d", (int)++pool->nWorkers);
-			worker.bgw_main_arg = PointerGetDatum(pool);
-			pool->lastDynamicWorkerStartTime = now;
-			if (!RegisterDynamicBackgroundWorker(&worker, &handle)) { 
-				elog(WARNING, "Failed to start dynamic background worker");
-			}
-		}
+	BackgroundWorker worker;
+	BackgroundWorkerHandle* handle;
+	timestamp_t now;
+	int workerId;
+
+	SpinLockAcquire(&pool->lock);
+	if (pool->nWorkers >= MtmMaxWorkers) {
+		SpinLockRelease(&pool->lock);
+		return;
 	}
+	workerId = (int)++pool->nWorkers;
+	SpinLockRelease(&pool->lock);
+
+	now = MtmGetSystemTime();
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |  BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_main = BgwPoolDynamicWorkerMainLoop;
+	worker.bgw_restart_time = MULTIMASTER_BGW_RESTART_TIMEOUT;
+	snprintf(worker.bgw_name, BGW_MAXLEN, "bgw_pool_dynworker_%d", workerId);
+	worker.bgw_main_arg = PointerGetDatum(pool);
+	pool->lastDynamicWorkerStartTime = now;
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle)) {
+		elog(WARNING, "Failed to start dynamic background worker");
+		SpinLockAcquire(&pool->lock);
+		pool->nWorkers -= 1;
+		SpinLockRelease(&pool->lock);
+		return;
+	}
+	pg_atomic_fetch_add_u64(&pool->stats.nGrows, 1);
+	MTM_LOG1("Start dynamic background worker %d: %d transactions are pending", workerId, (int)pg_atomic_read_u32(&pool->pending));
 }
 
-void BgwPoolExecute(BgwPool* pool, void* work, size_t size)
+/*
+ * Retire one of idle workers if not all workers were busy during multimaster.worker_idle_timeout.
+ * Pool is never shrunk below the number of static workers. Called periodically by the monitor,
+ * so at most one worker is retired per timeout.
+ */
+void BgwPoolShrink(BgwPool* pool)
 {
-    if (size+4 > pool->size) {
-		/* 
-		 * Size of work is larger than size of shared buffer: 
+	timestamp_t now = MtmGetSystemTime();
+	timestamp_t lastChange;
+	size_t nWorkers;
+
+	if (MtmWorkerIdleTimeout == 0 || pool->shutdown) {
+		return;
+	}
+	SpinLockAcquire(&pool->lock);
+	lastChange = Max(pool->lastBusyTime, Max(pool->lastDynamicWorkerStartTime, pool->lastRetireTime));
+	if (pool->nWorkers <= pool->nStaticWorkers
+		|| now - lastChange < (timestamp_t)MtmWorkerIdleTimeout*1000
+		|| pg_atomic_read_u32(&pool->nRetiring) != 0
+		|| !BgwPoolDecrementWaiters(&pool->nIdleWorkers))
+	{
+		SpinLockRelease(&pool->lock);
+		return;
+	}
+	/* One of sleeping workers is woken up and exits instead of fetching next work */
+	pg_atomic_fetch_add_u32(&pool->nRetiring, 1);
+	nWorkers = --pool->nWorkers;
+	pool->lastRetireTime = now;
+	SpinLockRelease(&pool->lock);
+
+	pg_atomic_fetch_add_u64(&pool->stats.nShrinks, 1);
+	PGSemaphoreUnlock(&pool->available);
+	MTM_LOG1("Retire idle background worker: pool size is %d", (int)nWorkers);
+}
+
+/*
+ * Enqueue work in the specified lane. If lane is full, wait for free space unless "wait" is false.
+ * Returns false if work was not enqueued.
+ */
+static bool BgwPoolEnqueue(BgwPool* pool, void* work, size_t size, BgwPoolLane lane, bool wait)
+{
+	BgwPoolSpaceRequest req;
+	timestamp_t stallStart = 0;
+	size_t offs;
+	BgwPoolItemHeader* hdr;
+	BgwPoolQueue* q;
+
+	req.nCells = BgwPoolCellsRequired(size);
+	if (lane == BGW_LANE_PRIORITY && req.nCells > pool->lanes[lane].nCells) {
+		lane = BGW_LANE_BULK;
+	}
+	q = &pool->lanes[lane];
+	req.queue = q;
+    if (req.nCells > q->nCells) {
+		/*
+		 * Size of work is larger than size of shared buffer:
 		 * run it immediately
 		 */
+		if (!wait) {
+			return false;
+		}
 		pool->executor(work, size);
-		return;
+		return true;
 	}
- 
-    SpinLockAcquire(&pool->lock);
-    while (!pool->shutdown) { 
-        if ((pool->head <= pool->tail && pool->size - pool->tail < size + 4 && pool->head < size) 
-            || (pool->head > pool->tail && pool->head - pool->tail < size + 4))
-        {
-            if (pool->lastPeakTime == 0) {
-				pool->lastPeakTime = MtmGetSystemTime();
+
+	while (true) {
+		if (pool->shutdown) {
+			/* Pass shutdown request to the next blocked producer */
+			PGSemaphoreUnlock(&q->overflow);
+			return true;
+		}
+		req.pos = pg_atomic_read_u64(&q->tail);
+		switch (BgwPoolCheckCells(q, req.pos, req.nCells)) {
+		  case BGW_CELLS_FREE:
+			if (!pg_atomic_compare_exchange_u64(&q->tail, &req.pos, req.pos + req.nCells)) {
+				continue;
 			}
-			pool->producerBlocked = true;
-            SpinLockRelease(&pool->lock);
-            PGSemaphoreLock(&pool->overflow);
-            SpinLockAcquire(&pool->lock);
-        } else {
-            pool->pending += 1;
-			if (pool->active + pool->pending > pool->nWorkers) { 
-				BgwStartExtraWorker(pool);				
+			break;
+		  case BGW_CELLS_BUSY:
+			if (!wait) {
+				return false;
 			}
-			if (pool->lastPeakTime == 0 && pool->active == pool->nWorkers && pool->pending != 0) {
-				pool->lastPeakTime = MtmGetSystemTime();
+			/* Queue is full: wait until workers release enough cells */
+			if (stallStart == 0) {
+				stallStart = MtmGetSystemTime();
+				pg_atomic_fetch_add_u64(&pool->stats.nStalls, 1);
+				pg_atomic_fetch_add_u64(&q->nStalls, 1);
+				if (pool->lastPeakTime == 0) {
+					pool->lastPeakTime = stallStart;
+				}
 			}
-            *(int*)&pool->queue[pool->tail] = size;
-            if (pool->size - pool->tail >= size + 4) { 
-                memcpy(&pool->queue[pool->tail+4], work, size);
-                pool->tail += 4 + INTALIGN(size);
-            } else { 
-                memcpy(pool->queue, work, size);
-                pool->tail = INTALIGN(size);
-            }
-            if (pool->tail == pool->size) {
-                pool->tail = 0;
-            }
-            PGSemaphoreUnlock(&pool->available);
-            break;
-        }
-    }
-    SpinLockRelease(&pool->lock);            
+			if (BgwPoolProducerStallHook != NULL) {
+				/* Let producer do its own work (e.g. keep reading the socket) while workers release cells */
+				BgwPoolProducerStallHook(BGW_POOL_STALL_POLL_INTERVAL);
+			} else {
+				BgwPoolWait(pool, &q->nBlockedProducers, &q->overflow, BgwPoolHasSpace, &req);
+			}
+			continue;
+		  case BGW_CELLS_MOVED:
+			continue;
+		}
+		break;
+	}
+	if (stallStart != 0) {
+		pg_atomic_fetch_add_u64(&pool->stats.stallTime, MtmGetSystemTime() - stallStart);
+	}
+
+	/* Cells [pos, pos+nCells) are now owned by this producer */
+	offs = BgwPoolCellOffset(q, req.pos);
+	hdr = (BgwPoolItemHeader*)&q->queue[offs];
+	hdr->size = (int)size;
+	hdr->enqueueTime = MtmGetSystemTime();
+	offs += sizeof(BgwPoolItemHeader);
+	if (offs + size <= q->size) {
+		memcpy(&q->queue[offs], work, size);
+	} else {
+		size_t part = q->size - offs;
+		memcpy(&q->queue[offs], work, part);
+		memcpy(q->queue, (char*)work + part, size - part);
+	}
+	/* Count work as pending before it becomes visible to workers */
+	pg_atomic_fetch_add_u32(&pool->pending, 1);
+	pg_atomic_fetch_add_u64(&pool->stats.nWorks, 1);
+	pg_atomic_fetch_add_u64(&q->nWorks, 1);
+	pg_write_barrier();
+	pg_atomic_write_u64(&q->seq[req.pos % q->nCells], req.pos + 1);
+
+	if (pg_atomic_read_u32(&pool->pending) + pg_atomic_read_u32(&pool->active) > pool->nWorkers) {
+		/* Start dynamic worker only if queue has more works than workers during multimaster.worker_grow_delay */
+		timestamp_t now = MtmGetSystemTime();
+		if (pool->overloadStartTime == 0) {
+			pool->overloadStartTime = now;
+		}
+		if (now - pool->overloadStartTime >= (timestamp_t)MtmWorkerGrowDelay*1000) {
+			BgwStartExtraWorker(pool);
+			pool->overloadStartTime = now;
+		}
+	}
+	if (pool->lastPeakTime == 0 && pg_atomic_read_u32(&pool->active) == pool->nWorkers) {
+		pool->lastPeakTime = MtmGetSystemTime();
+	}
+	BgwPoolUpdatePeakDepth(pool);
+
+	/* Wakeup idle worker only if queue was empty */
+	pg_memory_barrier();
+	if (BgwPoolDecrementWaiters(&pool->nIdleWorkers)) {
+		pg_atomic_fetch_add_u64(&pool->stats.nWakeups, 1);
+		PGSemaphoreUnlock(&pool->available);
+	}
+	return true;
+}
+
+/*
+ * Enqueue work in the specified lane. Workers are FIFO only within a lane, so works which have to be
+ * applied in order relative to each other should be placed in the same lane.
+ */
+void BgwPoolExecute(BgwPool* pool, void* work, size_t size, BgwPoolLane lane)
+{
+	BgwPoolEnqueue(pool, work, size, lane, true);
+}
+
+/*
+ * Enqueue work only if there is free space in the lane: never blocks, so it can be used
+ * by processes which workers may depend on (e.g. arbiter). Returns false if work was not enqueued.
+ */
+bool BgwPoolTryExecute(BgwPool* pool, void* work, size_t size, BgwPoolLane lane)
+{
+	return BgwPoolEnqueue(pool, work, size, lane, false);
 }
 
 void BgwPoolStop(BgwPool* pool)
 {
-    SpinLockAcquire(&pool->lock);
+	int lane;
+
 	pool->shutdown = true;
-    SpinLockRelease(&pool->lock);            
+	pg_memory_barrier();
 	PGSemaphoreUnlock(&pool->available);
-	PGSemaphoreUnlock(&pool->overflow);
+	for (lane = 0; lane < BGW_N_LANES; lane++) {
+		PGSemaphoreUnlock(&pool->lanes[lane].overflow);
+	}
 }
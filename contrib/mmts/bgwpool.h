@@ -1,6 +1,7 @@
 #ifndef __BGWPOOL_H__
 #define __BGWPOOL_H__
 
+#include "port/atomics.h"
 #include "storage/s_lock.h"
 #include "storage/spin.h"
 #include "storage/pg_sema.h"
@@ -10,36 +11,111 @@ typedef void(*BgwPoolExecutor)(void* work, size_t size);
 
 typedef ulong64 timestamp_t;
 
+/*
+ * Called by producer instead of sleeping on the overflow semaphore while queue is full.
+ * Hook should return in at most timeout microseconds, so that producer can recheck free space in queue.
+ */
+typedef void(*BgwPoolStallHook)(timestamp_t timeout);
+
 
 #define MAX_DBNAME_LEN 30
 #define MAX_DBUSER_LEN 30
 #define MULTIMASTER_BGW_RESTART_TIMEOUT BGW_NEVER_RESTART /* seconds */
 
+/*
+ * Queue is split into cells of this size. Work item occupies a sequence of adjacent cells:
+ * first cell starts with BgwPoolItemHeader (length of the item and time it was enqueued).
+ */
+#define BGW_POOL_CELL_SIZE 256
+
+/* How often (usec) producer with stall hook rechecks free space in queue */
+#define BGW_POOL_STALL_POLL_INTERVAL 1000
+
 extern timestamp_t MtmGetSystemTime(void);   /* non-adjusted current system time */
 extern timestamp_t MtmGetCurrentTime(void);  /* adjusted current system time */
 
 extern bool MtmIsLogicalReceiver;
+extern BgwPoolStallHook BgwPoolProducerStallHook; /* set by producer process, NULL to sleep on semaphore */
 extern int  MtmMaxWorkers;
+extern int  MtmWorkerGrowDelay;   /* msec */
+extern int  MtmWorkerIdleTimeout; /* msec */
 
+/*
+ * Queue statistics, updated without locks
+ */
+typedef struct
+{
+	pg_atomic_uint64 nWorks;          /* Number of enqueued work items */
+	pg_atomic_uint64 nStalls;         /* Number of times producer was blocked because queue was full */
+	pg_atomic_uint64 stallTime;       /* Total time (usec) producers spent waiting for free space in queue */
+	pg_atomic_uint64 nWakeups;        /* Number of times idle worker was woken up */
+	pg_atomic_uint64 idleTime;        /* Total time (usec) workers spent waiting for new work */
+	pg_atomic_uint64 peakDepth;       /* Maximal observed queue depth (bytes) */
+	pg_atomic_uint64 nGrows;          /* Number of started dynamic workers */
+	pg_atomic_uint64 nShrinks;        /* Number of workers retired because they were idle */
+} BgwPoolStats;
+
+/*
+ * Works are placed in one of the lanes of the pool. Workers always fetch works from the priority lane first,
+ * so short transactions and 2PC control messages are not queued behind bulk transactions.
+ * Works are fetched in FIFO order only within a lane.
+ */
+typedef enum
+{
+	BGW_LANE_PRIORITY,
+	BGW_LANE_BULK,
+	BGW_N_LANES
+} BgwPoolLane;
+
+/* Part of multimaster.queue_size given to the priority lane */
+#define BGW_POOL_PRIORITY_FRACTION 8
+
+/*
+ * Bounded multi-producer/multi-consumer queue of work items.
+ * Each cell has sequence number: cell at position pos is free when seq == pos and
+ * is ready for consumer when seq == pos + 1. After consumption sequence number is set
+ * to pos + nCells, so cell becomes free for the next lap.
+ */
+typedef struct
+{
+	PGSemaphoreData overflow;
+	pg_atomic_uint64 head;            /* position of next item to be fetched by worker */
+	pg_atomic_uint64 tail;            /* position of next free cell for producer */
+	pg_atomic_uint32 nBlockedProducers; /* number of producers sleeping on "overflow" semaphore */
+	size_t size;                      /* size of queue data area in bytes */
+	size_t nCells;
+	pg_atomic_uint64* seq;            /* [nCells] sequence numbers of cells */
+	char*  queue;                     /* [nCells*BGW_POOL_CELL_SIZE] data area */
+	pg_atomic_uint64 nWorks;          /* Number of works enqueued in this lane */
+	pg_atomic_uint64 nStalls;         /* Number of times producer was blocked because this lane was full */
+} BgwPoolQueue;
+
+/*
+ * Pool of workers fetching works from the lanes.
+ * Semaphores are used only to wake up idle workers (all lanes were empty) and blocked producers (lane was full).
+ */
 typedef struct
 {
     BgwPoolExecutor executor;
-    volatile slock_t lock;
+    volatile slock_t lock;            /* protects only nWorkers and dynamic workers start */
     PGSemaphoreData available;
-    PGSemaphoreData overflow;
-    size_t head;
-    size_t tail;
-    size_t size;
-    size_t active;
-    size_t pending;
+	pg_atomic_uint32 nIdleWorkers;    /* number of workers sleeping on "available" semaphore */
+	pg_atomic_uint32 active;          /* number of works being executed */
+	pg_atomic_uint32 pending;         /* number of works in all lanes */
+	pg_atomic_uint32 nRetiring;       /* number of idle workers requested to exit */
+    size_t size;                      /* total size of queue data area of all lanes in bytes */
 	size_t nWorkers;
+	size_t nStaticWorkers;            /* pool is never shrunk below this size */
 	time_t lastPeakTime;
 	timestamp_t lastDynamicWorkerStartTime;
-    bool   producerBlocked;
-	bool   shutdown;
+	timestamp_t lastRetireTime;
+	timestamp_t lastBusyTime;         /* last time when all workers were busy */
+	timestamp_t overloadStartTime;    /* start of the period when queue had more works than free workers, 0 if none */
+	volatile bool shutdown;
     char   dbname[MAX_DBNAME_LEN];
 	char   dbuser[MAX_DBUSER_LEN];
-    char*  queue;
+	BgwPoolQueue lanes[BGW_N_LANES];
+	BgwPoolStats stats;
 } BgwPool;
 
 typedef BgwPool*(*BgwPoolConstructor)(void);
@@ -48,11 +124,18 @@ extern void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor);
 
 extern void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname, char const* dbuser, size_t queueSize, size_t nWorkers);
 
-extern void BgwPoolExecute(BgwPool* pool, void* work, size_t size);
+extern Size BgwPoolShmemSize(size_t queueSize);
+
+extern void BgwPoolExecute(BgwPool* pool, void* work, size_t size, BgwPoolLane lane);
+extern bool BgwPoolTryExecute(BgwPool* pool, void* work, size_t size, BgwPoolLane lane);
 
 extern size_t BgwPoolGetQueueSize(BgwPool* pool);
 
+extern size_t BgwPoolGetLaneQueueSize(BgwPool* pool, BgwPoolLane lane);
+
 extern timestamp_t BgwGetLastPeekTime(BgwPool* pool);
 
+extern void BgwPoolShrink(BgwPool* pool);
+
 extern void BgwPoolStop(BgwPool* pool);
 #endif
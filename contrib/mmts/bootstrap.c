@@ -0,0 +1,488 @@
+/*
+ * bootstrap.c
+ *
+ * Logical bootstrap of a new node.
+ *
+ * Instead of physical copy of one donor, the new node started with multimaster.logical_bootstrap
+ * and empty schema copies data from all available donors in parallel. Each donor session is
+ * switched to the same global snapshot using mtm.set_snapshot(), so copied tables are consistent
+ * with each other. Until bootstrap is completed, transactions at the new node are local
+ * and its receivers do not start replication.
+ *
+ * Then the node performs usual recovery from the slot of one of the donors. This slot was created
+ * by mtm.add_node() before the bootstrap snapshot was taken, so it contains all transactions which
+ * are not in the copied data. The donor skips transactions committed in the bootstrap snapshot,
+ * which CSN is passed by the receiver in "mtm_bootstrap_csn" parameter.
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/xact.h"
+#include "commands/copy.h"
+#include "executor/spi.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "multimaster.h"
+#include "bootstrap.h"
+
+/* Parameters of bootstrap worker passed in bgw_extra */
+typedef struct
+{
+	csn_t snapshot; /* global snapshot of copied data */
+	int   donorId;  /* node from which data is copied */
+} MtmBootstrapWorkerArgs;
+
+typedef struct
+{
+	NameData nspname;
+	NameData relname;
+	char     relkind;
+} MtmBootstrapRel;
+
+/*
+ * Relations to be copied. Coordinator and all workers get the same list from the local catalog
+ * and take relations from it using shared counter Mtm->bootstrapNextRel.
+ */
+#define MTM_BOOTSTRAP_RELATIONS_QUERY \
+	"SELECT n.nspname, c.relname, c.relkind FROM pg_catalog.pg_class c" \
+	" JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace" \
+	" WHERE c.relkind IN ('r', 'S') AND c.relpersistence = 'p'" \
+	" AND n.nspname NOT IN ('pg_catalog', 'information_schema', 'mtm') AND n.nspname !~ '^pg_toast'" \
+	" AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_depend d WHERE d.classid = 'pg_catalog.pg_class'::regclass AND d.objid = c.oid AND d.deptype = 'e')" \
+	" AND NOT EXISTS (SELECT 1 FROM mtm.local_tables t WHERE t.rel_schema = n.nspname AND t.rel_name = c.relname)" \
+	" ORDER BY 1, 2"
+
+static void MtmBootstrapWorkerMain(Datum arg);
+
+/*
+ * Get list of relations to be copied. Should be called inside transaction.
+ * Returned array is allocated in the current memory context.
+ */
+static MtmBootstrapRel*
+MtmBootstrapListRelations(int* nRels)
+{
+	MtmBootstrapRel* rels;
+	int rc;
+	int i;
+
+	SPI_connect();
+	rc = SPI_execute(MTM_BOOTSTRAP_RELATIONS_QUERY, true, 0);
+	if (rc != SPI_OK_SELECT) {
+		MTM_ELOG(ERROR, "Failed to get list of relations: %d", rc);
+	}
+	*nRels = (int)SPI_processed;
+	rels = (MtmBootstrapRel*)SPI_palloc(sizeof(MtmBootstrapRel)*(*nRels + 1));
+	for (i = 0; i < *nRels; i++) {
+		HeapTuple tuple = SPI_tuptable->vals[i];
+		TupleDesc desc = SPI_tuptable->tupdesc;
+		namestrcpy(&rels[i].nspname, SPI_getvalue(tuple, desc, 1));
+		namestrcpy(&rels[i].relname, SPI_getvalue(tuple, desc, 2));
+		rels[i].relkind = *SPI_getvalue(tuple, desc, 3);
+	}
+	SPI_finish();
+	return rels;
+}
+
+/*
+ * Execute statement at the donor. Returns false and sets *error in case of failure.
+ */
+static bool
+MtmBootstrapExec(PGconn* conn, char const* sql, ExecStatusType expected, PGresult** result, char** error)
+{
+	PGresult* res = PQexec(conn, sql);
+	if (PQresultStatus(res) != expected) {
+		*error = pstrdup(PQresultErrorMessage(res));
+		PQclear(res);
+		return false;
+	}
+	if (result != NULL) {
+		*result = res;
+	} else {
+		PQclear(res);
+	}
+	return true;
+}
+
+/*
+ * Open donor session which sees data in the specified global snapshot.
+ * If snapshot is INVALID_CSN, then snapshot of the new transaction is used and returned in *snapshot.
+ */
+static PGconn*
+MtmBootstrapConnect(int donorId, csn_t* snapshot, char** error)
+{
+	PGconn* conn = PQconnectdb_safe(Mtm->nodes[donorId-1].con.connStr, 0);
+	PGresult* res;
+
+	if (PQstatus(conn) != CONNECTION_OK) {
+		*error = pstrdup(PQerrorMessage(conn));
+		PQfinish(conn);
+		return NULL;
+	}
+	if (!MtmBootstrapExec(conn, "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY", PGRES_COMMAND_OK, NULL, error)
+		|| !MtmBootstrapExec(conn, psprintf("SELECT mtm.set_snapshot(%lld)", (long64)*snapshot), PGRES_TUPLES_OK, &res, error))
+	{
+		PQfinish(conn);
+		return NULL;
+	}
+	*snapshot = (csn_t)strtoull(PQgetvalue(res, 0, 0), NULL, 10);
+	PQclear(res);
+	return conn;
+}
+
+/*
+ * Copy table from the donor. COPY data is buffered in temporary file by chunks of MTM_BOOTSTRAP_CHUNK_SIZE bytes
+ * and loaded using COPY FROM file, so that multi-insert and index maintenance of COPY are used.
+ */
+static void
+MtmBootstrapCopyTable(PGconn* conn, MtmBootstrapRel* rel)
+{
+	char* qualifiedName = quote_qualified_identifier(NameStr(rel->nspname), NameStr(rel->relname));
+	char* error;
+	uint64 nTuples = 0;
+	bool eof = false;
+	Relation heap;
+	HeapScanDesc scan;
+	bool isEmpty;
+	PGresult* res;
+
+	/* Bootstrap is performed only once: refuse to append data to non-empty table */
+	PushActiveSnapshot(GetTransactionSnapshot());
+	heap = heap_openrv(makeRangeVar(NameStr(rel->nspname), NameStr(rel->relname), -1), AccessShareLock);
+	scan = heap_beginscan(heap, GetActiveSnapshot(), 0, NULL);
+	isEmpty = heap_getnext(scan, ForwardScanDirection) == NULL;
+	heap_endscan(scan);
+	heap_close(heap, AccessShareLock);
+	PopActiveSnapshot();
+	if (!isEmpty) {
+		MTM_ELOG(ERROR, "Table %s is not empty", qualifiedName);
+	}
+
+	if (!MtmBootstrapExec(conn, psprintf("COPY %s TO STDOUT", qualifiedName), PGRES_COPY_OUT, NULL, &error)) {
+		MTM_ELOG(ERROR, "Failed to copy table %s: %s", qualifiedName, error);
+	}
+	while (!eof)
+	{
+		File file = OpenTemporaryFile(false);
+		off_t size = 0;
+
+		while (size < MTM_BOOTSTRAP_CHUNK_SIZE)
+		{
+			char* buf;
+			int len = PQgetCopyData(conn, &buf, false);
+			if (len < 0) {
+				if (len == -2) {
+					MTM_ELOG(ERROR, "Failed to copy table %s: %s", qualifiedName, PQerrorMessage(conn));
+				}
+				eof = true;
+				break;
+			}
+			if (FileWrite(file, buf, len) != len) {
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not write to temporary file: %m")));
+			}
+			PQfreemem(buf);
+			size += len;
+			CHECK_FOR_INTERRUPTS();
+		}
+		if (size != 0)
+		{
+			CopyStmt* stmt = makeNode(CopyStmt);
+			uint64 processed;
+
+			stmt->relation = makeRangeVar(NameStr(rel->nspname), NameStr(rel->relname), -1);
+			stmt->is_from = true;
+			stmt->filename = FilePathName(file);
+
+			PushActiveSnapshot(GetTransactionSnapshot());
+			DoCopy(stmt, psprintf("COPY %s FROM '%s'", qualifiedName, stmt->filename), &processed);
+			PopActiveSnapshot();
+			nTuples += processed;
+		}
+		FileClose(file);
+	}
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		MTM_ELOG(ERROR, "Failed to copy table %s: %s", qualifiedName, PQresultErrorMessage(res));
+	}
+	PQclear(res);
+
+	MTM_LOG1("%d: Bootstrap copied %llu tuples of table %s", MyProcPid, (long64)nTuples, qualifiedName);
+}
+
+/*
+ * Copy current position of the sequence from the donor
+ */
+static void
+MtmBootstrapCopySequence(PGconn* conn, MtmBootstrapRel* rel)
+{
+	char* qualifiedName = quote_qualified_identifier(NameStr(rel->nspname), NameStr(rel->relname));
+	char* error;
+	PGresult* res;
+	int rc;
+
+	if (!MtmBootstrapExec(conn, psprintf("SELECT last_value, is_called FROM %s", qualifiedName), PGRES_TUPLES_OK, &res, &error)) {
+		MTM_ELOG(ERROR, "Failed to get position of sequence %s: %s", qualifiedName, error);
+	}
+	SPI_connect();
+	rc = SPI_execute(psprintf("SELECT pg_catalog.setval(%s, %s, %s)",
+							  quote_literal_cstr(qualifiedName),
+							  PQgetvalue(res, 0, 0),
+							  *PQgetvalue(res, 0, 1) == 't' ? "true" : "false"),
+					 false, 0);
+	SPI_finish();
+	PQclear(res);
+	if (rc != SPI_OK_SELECT) {
+		MTM_ELOG(ERROR, "Failed to set position of sequence %s: %d", qualifiedName, rc);
+	}
+}
+
+/*
+ * Bootstrap worker: copy relations from one donor until all relations are taken.
+ * Any error terminates the worker, coordinator detects it by number of copied relations.
+ */
+static void
+MtmBootstrapWorkerMain(Datum arg)
+{
+	MtmBootstrapWorkerArgs args;
+	MtmBootstrapRel* rels;
+	MemoryContext oldContext;
+	PGconn* conn;
+	char* error;
+	int nRels;
+	uint32 i;
+
+	memcpy(&args, MyBgworkerEntry->bgw_extra, sizeof(args));
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Copied data should not be replicated to other nodes */
+	MtmBackgroundWorker = true;
+
+	BackgroundWorkerInitializeConnection(MtmDatabaseName, NULL);
+
+	/* Data is consistent at donor: do not fire triggers, including foreign key checks */
+	SetConfigOption("session_replication_role", "replica", PGC_SUSET, PGC_S_OVERRIDE);
+
+	conn = MtmBootstrapConnect(args.donorId, &args.snapshot, &error);
+	if (conn == NULL) {
+		MTM_ELOG(ERROR, "Bootstrap worker %d failed to connect to node %d: %s", DatumGetInt32(arg), args.donorId, error);
+	}
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	rels = MtmBootstrapListRelations(&nRels);
+	MemoryContextSwitchTo(oldContext);
+	CommitTransactionCommand();
+
+	while ((i = pg_atomic_fetch_add_u32(&Mtm->bootstrapNextRel, 1)) < (uint32)nRels)
+	{
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		pgstat_report_activity(STATE_RUNNING, NameStr(rels[i].relname));
+		if (rels[i].relkind == 'S') {
+			MtmBootstrapCopySequence(conn, &rels[i]);
+		} else {
+			MtmBootstrapCopyTable(conn, &rels[i]);
+		}
+		CommitTransactionCommand();
+		pgstat_report_activity(STATE_IDLE, NULL);
+		pg_atomic_fetch_add_u32(&Mtm->bootstrapCopiedRels, 1);
+	}
+	PQexec(conn, "COMMIT");
+	PQfinish(conn);
+}
+
+/*
+ * Remember that bootstrap is completed, so that receivers pass bootstrap CSN to donor after restart
+ */
+static void
+MtmSaveBootstrapCsn(csn_t snapshot)
+{
+	char path[MAXPGPATH];
+	FILE* f;
+
+	snprintf(path, MAXPGPATH, "%s/%s", DataDir, MTM_BOOTSTRAP_FILE);
+	f = AllocateFile(path, "w");
+	if (f == NULL) {
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", path)));
+	}
+	fprintf(f, "%llu\n", (ulong64)snapshot);
+	if (fflush(f) != 0 || pg_fsync(fileno(f)) != 0) {
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m", path)));
+	}
+	FreeFile(f);
+}
+
+/*
+ * Called at startup: returns CSN of completed bootstrap or INVALID_CSN
+ */
+csn_t
+MtmLoadBootstrapCsn(void)
+{
+	char path[MAXPGPATH];
+	ulong64 snapshot;
+	FILE* f;
+
+	snprintf(path, MAXPGPATH, "%s/%s", DataDir, MTM_BOOTSTRAP_FILE);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return INVALID_CSN;
+	}
+	if (fscanf(f, "%llu", &snapshot) != 1) {
+		MTM_ELOG(FATAL, "File %s doesn't contain bootstrap CSN", MTM_BOOTSTRAP_FILE);
+	}
+	fclose(f);
+	return (csn_t)snapshot;
+}
+
+/*
+ * Copy data of the new node from all available donors using nJobs parallel workers (one per donor by default).
+ * Returns global snapshot of copied data.
+ */
+csn_t
+MtmBootstrapNode(int nJobs)
+{
+	PGconn* conns[MAX_NODES];
+	int donors[MAX_NODES];
+	int nDonors = 0;
+	BackgroundWorkerHandle** workers = NULL;
+	int nWorkers = 0;
+	csn_t snapshot = INVALID_CSN;
+	int nRels;
+	int i;
+
+	if (!superuser()) {
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("must be superuser to bootstrap node")));
+	}
+	if (!MtmLogicalBootstrap) {
+		MTM_ELOG(ERROR, "Node should be started with multimaster.logical_bootstrap to be bootstrapped");
+	}
+	if (!MtmIsBootstrapPending()) {
+		MTM_ELOG(ERROR, "Node is already bootstrapped");
+	}
+	MtmLock(LW_EXCLUSIVE);
+	if (Mtm->bootstrapCoordinator != 0) {
+		MtmUnlock();
+		MTM_ELOG(ERROR, "Bootstrap is already performed by process %d", Mtm->bootstrapCoordinator);
+	}
+	Mtm->bootstrapCoordinator = MyProcPid;
+	MtmUnlock();
+
+	PG_TRY();
+	{
+		pfree(MtmBootstrapListRelations(&nRels));
+
+		/*
+		 * Donor sessions of coordinator pin the snapshot at donors until all workers are finished.
+		 * Snapshot of the first available donor is used.
+		 */
+		for (i = 0; i < Mtm->nAllNodes; i++)
+		{
+			char* error;
+			if (i+1 == MtmNodeId) {
+				continue;
+			}
+			conns[nDonors] = MtmBootstrapConnect(i+1, &snapshot, &error);
+			if (conns[nDonors] == NULL) {
+				MTM_ELOG(WARNING, "Node %d can not be used as bootstrap donor: %s", i+1, error);
+				continue;
+			}
+			donors[nDonors++] = i+1;
+		}
+		if (nDonors == 0) {
+			MTM_ELOG(ERROR, "No donors are available for bootstrap");
+		}
+		if (nJobs <= 0) {
+			nJobs = nDonors;
+		}
+		MTM_LOG1("Bootstrap %d relations from %d donors using %d workers in snapshot %lld", nRels, nDonors, nJobs, (long64)snapshot);
+
+		pg_atomic_write_u32(&Mtm->bootstrapNextRel, 0);
+		pg_atomic_write_u32(&Mtm->bootstrapCopiedRels, 0);
+
+		workers = (BackgroundWorkerHandle**)palloc(sizeof(BackgroundWorkerHandle*)*nJobs);
+		for (i = 0; i < nJobs; i++)
+		{
+			BackgroundWorker worker;
+			MtmBootstrapWorkerArgs args;
+
+			MemSet(&worker, 0, sizeof(BackgroundWorker));
+			worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+			worker.bgw_start_time = BgWorkerStart_ConsistentState;
+			worker.bgw_restart_time = BGW_NEVER_RESTART;
+			worker.bgw_main = MtmBootstrapWorkerMain;
+			worker.bgw_main_arg = Int32GetDatum(i);
+			worker.bgw_notify_pid = MyProcPid;
+			snprintf(worker.bgw_name, BGW_MAXLEN, "mtm-bootstrap-%d", i);
+			args.snapshot = snapshot;
+			args.donorId = donors[i % nDonors];
+			memcpy(worker.bgw_extra, &args, sizeof(args));
+
+			if (!RegisterDynamicBackgroundWorker(&worker, &workers[nWorkers])) {
+				MTM_ELOG(WARNING, "Failed to start bootstrap worker, please increase max_worker_processes configuration parameter (current value is %d)", max_worker_processes);
+				break;
+			}
+			nWorkers += 1;
+		}
+		if (nWorkers == 0) {
+			MTM_ELOG(ERROR, "Failed to start bootstrap workers");
+		}
+		for (i = 0; i < nWorkers; i++) {
+			if (WaitForBackgroundWorkerShutdown(workers[i]) == BGWH_POSTMASTER_DIED) {
+				ereport(FATAL,
+						(errcode(ERRCODE_ADMIN_SHUTDOWN),
+						 errmsg("postmaster exited during bootstrap")));
+			}
+		}
+		nWorkers = 0;
+
+		if (pg_atomic_read_u32(&Mtm->bootstrapCopiedRels) != (uint32)nRels) {
+			MTM_ELOG(ERROR, "Bootstrap failed: %u of %d relations are copied, see server log for errors of bootstrap workers. Database has to be recreated before next attempt.",
+					 pg_atomic_read_u32(&Mtm->bootstrapCopiedRels), nRels);
+		}
+		MtmSaveBootstrapCsn(snapshot);
+	}
+	PG_CATCH();
+	{
+		for (i = 0; i < nWorkers; i++) {
+			TerminateBackgroundWorker(workers[i]);
+		}
+		for (i = 0; i < nDonors; i++) {
+			PQfinish(conns[i]);
+		}
+		Mtm->bootstrapCoordinator = 0;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	for (i = 0; i < nDonors; i++) {
+		PQfinish(conns[i]);
+	}
+	MtmLock(LW_EXCLUSIVE);
+	Mtm->bootstrapCsn = snapshot;
+	Mtm->bootstrapCoordinator = 0;
+	MtmUnlock();
+
+	MTM_ELOG(LOG, "Bootstrap of node %d is completed in snapshot %lld", MtmNodeId, (long64)snapshot);
+	return snapshot;
+}
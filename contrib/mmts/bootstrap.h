@@ -0,0 +1,14 @@
+#ifndef __BOOTSTRAP_H__
+#define __BOOTSTRAP_H__
+
+/*
+ * Logical bootstrap of a new node: data is copied from several donors in parallel
+ * under the same global snapshot instead of pg_basebackup of one donor.
+ */
+#define MTM_BOOTSTRAP_FILE       "global/mmts_bootstrap"  /* contains CSN of completed bootstrap */
+#define MTM_BOOTSTRAP_CHUNK_SIZE (64*1024*1024)          /* size of COPY data buffered in temporary file */
+
+csn_t MtmBootstrapNode(int nJobs);
+csn_t MtmLoadBootstrapCsn(void);
+
+#endif
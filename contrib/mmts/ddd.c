@@ -2,73 +2,225 @@
 #include "access/clog.h"
 #include "storage/lwlock.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 #include "ddd.h"
 
+#define NOT_VISITED ((uint32)~0)
+
+static inline uint32 hashGtid(GlobalTransactionId* gtid)
+{
+	uint32 h = gtid->xid * 0x9E3779B1 ^ gtid->node;
+	return h ^ (h >> 16);
+}
 
 void MtmGraphInit(MtmGraph* graph)
 {
-    memset(graph->hashtable, 0, sizeof(graph->hashtable));
+	memset(graph, 0, sizeof(MtmGraph));
+	graph->ctx = AllocSetContextCreate(TopMemoryContext,
+									   "MtmDeadlockGraph",
+									   ALLOCSET_DEFAULT_MINSIZE,
+									   ALLOCSET_DEFAULT_INITSIZE,
+									   ALLOCSET_DEFAULT_MAXSIZE);
+	graph->maxVertices = MTM_GRAPH_INIT_SIZE;
+	graph->hashSize = MTM_GRAPH_INIT_SIZE*2;
+	graph->maxEdges = MTM_GRAPH_INIT_SIZE;
+	graph->vertices = (GlobalTransactionId*)MemoryContextAlloc(graph->ctx, graph->maxVertices*sizeof(GlobalTransactionId));
+	graph->hashtable = (uint32*)MemoryContextAllocZero(graph->ctx, graph->hashSize*sizeof(uint32));
+	graph->edges = (uint32*)MemoryContextAlloc(graph->ctx, graph->maxEdges*2*sizeof(uint32));
+	graph->offsets = (uint32*)MemoryContextAlloc(graph->ctx, (graph->maxVertices+1)*sizeof(uint32));
+	graph->targets = (uint32*)MemoryContextAlloc(graph->ctx, graph->maxEdges*sizeof(uint32));
+	graph->inLoop = (bool*)MemoryContextAlloc(graph->ctx, graph->maxVertices*sizeof(bool));
+	graph->scratch = (uint32*)MemoryContextAlloc(graph->ctx, graph->maxVertices*5*sizeof(uint32));
+}
+
+void MtmGraphReset(MtmGraph* graph)
+{
+	memset(graph->hashtable, 0, graph->hashSize*sizeof(uint32));
+	graph->nVertices = 0;
+	graph->nEdges = 0;
+	graph->searched = false;
+}
+
+static void growVertices(MtmGraph* graph)
+{
+	uint32 i;
+	graph->maxVertices *= 2;
+	graph->hashSize *= 2;
+	graph->vertices = (GlobalTransactionId*)repalloc(graph->vertices, graph->maxVertices*sizeof(GlobalTransactionId));
+	graph->offsets = (uint32*)repalloc(graph->offsets, (graph->maxVertices+1)*sizeof(uint32));
+	graph->inLoop = (bool*)repalloc(graph->inLoop, graph->maxVertices*sizeof(bool));
+	graph->scratch = (uint32*)repalloc(graph->scratch, graph->maxVertices*5*sizeof(uint32));
+	pfree(graph->hashtable);
+	graph->hashtable = (uint32*)MemoryContextAllocZero(graph->ctx, graph->hashSize*sizeof(uint32));
+	for (i = 0; i < graph->nVertices; i++) {
+		uint32 h = hashGtid(&graph->vertices[i]) & (graph->hashSize - 1);
+		while (graph->hashtable[h] != 0) {
+			h = (h + 1) & (graph->hashSize - 1);
+		}
+		graph->hashtable[h] = i + 1;
+	}
 }
 
-static inline MtmVertex* findVertex(MtmGraph* graph, GlobalTransactionId* gtid)
+static uint32 findVertex(MtmGraph* graph, GlobalTransactionId* gtid)
 {
-    uint32 h = gtid->xid % MAX_TRANSACTIONS;
-    MtmVertex* v;
-    for (v = graph->hashtable[h]; v != NULL; v = v->collision) { 
-        if (EQUAL_GTID(v->gtid, *gtid)) { 
-            return v;
-        }
-    }
-	v = (MtmVertex*)palloc(sizeof(MtmVertex));
-    v->gtid = *gtid;
-	v->outgoingEdges = NULL;
-    v->collision = graph->hashtable[h];
-    graph->hashtable[h] = v;
-    return v;
+	uint32 h = hashGtid(gtid) & (graph->hashSize - 1);
+	uint32 v;
+	while ((v = graph->hashtable[h]) != 0) {
+		if (EQUAL_GTID(graph->vertices[v-1], *gtid)) {
+			return v - 1;
+		}
+		h = (h + 1) & (graph->hashSize - 1);
+	}
+	if (graph->nVertices == graph->maxVertices) {
+		growVertices(graph);
+		return findVertex(graph, gtid);
+	}
+	v = graph->nVertices++;
+	graph->vertices[v] = *gtid;
+	graph->hashtable[h] = v + 1;
+	return v;
+}
+
+static uint32 lookupVertex(MtmGraph* graph, GlobalTransactionId* gtid)
+{
+	uint32 h = hashGtid(gtid) & (graph->hashSize - 1);
+	uint32 v;
+	while ((v = graph->hashtable[h]) != 0) {
+		if (EQUAL_GTID(graph->vertices[v-1], *gtid)) {
+			return v - 1;
+		}
+		h = (h + 1) & (graph->hashSize - 1);
+	}
+	return NOT_VISITED;
 }
 
 void MtmGraphAdd(MtmGraph* graph, GlobalTransactionId* gtid, int size)
 {
-    GlobalTransactionId* last = gtid + size;
-    while (gtid != last) { 
-        MtmVertex* src = findVertex(graph, gtid++);
-        while (gtid->node != 0) { 
-            MtmVertex* dst = findVertex(graph, gtid++);
-            MtmEdge* e = (MtmEdge*)palloc(sizeof(MtmEdge));
-            e->dst = dst;
-            e->src = src;
-            e->next = src->outgoingEdges;
-            src->outgoingEdges = e;
-        }
+	GlobalTransactionId* last = gtid + size;
+	graph->searched = false;
+	while (gtid != last) {
+		uint32 src = findVertex(graph, gtid++);
+		while (gtid->node != 0) {
+			uint32 dst = findVertex(graph, gtid++);
+			if (graph->nEdges == graph->maxEdges) {
+				graph->maxEdges *= 2;
+				graph->edges = (uint32*)repalloc(graph->edges, graph->maxEdges*2*sizeof(uint32));
+				graph->targets = (uint32*)repalloc(graph->targets, graph->maxEdges*sizeof(uint32));
+			}
+			graph->edges[graph->nEdges*2] = src;
+			graph->edges[graph->nEdges*2+1] = dst;
+			graph->nEdges += 1;
+		}
 		gtid += 1;
-    }
+	}
 }
 
-static bool recursiveTraverseGraph(MtmVertex* root, MtmVertex* v)
+/*
+ * Convert list of edges to compressed adjacency arrays using counting sort by source vertex
+ */
+static void buildAdjacency(MtmGraph* graph)
 {
-    MtmEdge* e;
-    v->gtid.node = VISITED_NODE_MARK;
-    for (e = v->outgoingEdges; e != NULL; e = e->next) {
-        if (e->dst == root) { 
-            return true;
-        } else if (e->dst->gtid.node != VISITED_NODE_MARK && recursiveTraverseGraph(root, e->dst)) { /* loop */
-            return true;
-        } 
-    }
-    return false;        
+	uint32* offsets = graph->offsets;
+	uint32 nVertices = graph->nVertices;
+	uint32 i;
+
+	memset(offsets, 0, (nVertices+1)*sizeof(uint32));
+	for (i = 0; i < graph->nEdges; i++) {
+		offsets[graph->edges[i*2] + 1] += 1;
+	}
+	for (i = 0; i < nVertices; i++) {
+		offsets[i+1] += offsets[i];
+	}
+	for (i = 0; i < graph->nEdges; i++) {
+		/* offsets[src] is temporarily used as insert position and is restored below */
+		graph->targets[offsets[graph->edges[i*2]]++] = graph->edges[i*2+1];
+	}
+	for (i = nVertices; i > 0; i--) {
+		offsets[i] = offsets[i-1];
+	}
+	offsets[0] = 0;
+}
+
+/*
+ * Iterative Tarjan algorithm: mark all vertices belonging to strongly connected components
+ * with more than one vertex or having self-loop edge.
+ */
+static void findLoops(MtmGraph* graph)
+{
+	uint32  nVertices = graph->nVertices;
+	uint32* offsets = graph->offsets;
+	uint32* targets = graph->targets;
+	bool*   inLoop = graph->inLoop;
+	uint32* index = graph->scratch;           /* DFS number of vertex or NOT_VISITED */
+	uint32* lowlink = index + nVertices;      /* minimal DFS number reachable from vertex or NOT_VISITED if vertex is not on stack */
+	uint32* stack = lowlink + nVertices;      /* vertices of components being constructed */
+	uint32* path = stack + nVertices;         /* current DFS path */
+	uint32* edgePos = path + nVertices;       /* next outgoing edge to be traversed */
+	uint32  counter = 0;
+	uint32  sp = 0;
+	uint32  root;
+
+	buildAdjacency(graph);
+	memset(inLoop, 0, nVertices*sizeof(bool));
+	for (root = 0; root < nVertices; root++) {
+		index[root] = NOT_VISITED;
+	}
+	for (root = 0; root < nVertices; root++) {
+		uint32 depth = 0;
+		if (index[root] != NOT_VISITED) {
+			continue;
+		}
+		index[root] = lowlink[root] = counter++;
+		edgePos[root] = offsets[root];
+		stack[sp++] = root;
+		path[depth++] = root;
+
+		while (depth != 0) {
+			uint32 v = path[depth-1];
+			if (edgePos[v] < offsets[v+1]) {
+				uint32 w = targets[edgePos[v]++];
+				if (w == v) {
+					inLoop[v] = true;
+				} else if (index[w] == NOT_VISITED) {
+					index[w] = lowlink[w] = counter++;
+					edgePos[w] = offsets[w];
+					stack[sp++] = w;
+					path[depth++] = w;
+				} else if (lowlink[w] != NOT_VISITED && index[w] < lowlink[v]) {
+					lowlink[v] = index[w];
+				}
+				continue;
+			}
+			/* all edges of v are traversed */
+			if (--depth != 0 && lowlink[v] < lowlink[path[depth-1]]) {
+				lowlink[path[depth-1]] = lowlink[v];
+			}
+			if (lowlink[v] == index[v]) {
+				/* v is root of strongly connected component */
+				uint32 w;
+				bool loop = stack[sp-1] != v;
+				do {
+					w = stack[--sp];
+					lowlink[w] = NOT_VISITED;
+					if (loop) {
+						inLoop[w] = true;
+					}
+				} while (w != v);
+			}
+		}
+	}
+	graph->searched = true;
 }
 
 bool MtmGraphFindLoop(MtmGraph* graph, GlobalTransactionId* root)
 {
-    MtmVertex* v;
-    for (v = graph->hashtable[root->xid % MAX_TRANSACTIONS]; v != NULL; v = v->collision) { 
-        if (EQUAL_GTID(v->gtid, *root)) { 
-            if (recursiveTraverseGraph(v, v)) { 
-                return true;
-            }
-            break;
-        }
-    }
-    return false;        
+	uint32 v = lookupVertex(graph, root);
+	if (v == NOT_VISITED) {
+		return false;
+	}
+	if (!graph->searched) {
+		findLoops(graph);
+	}
+	return graph->inLoop[v];
 }
@@ -3,28 +3,39 @@
 
 #include "multimaster.h"
 
-#define MAX_TRANSACTIONS  1024
-#define VISITED_NODE_MARK 0
+/*
+ * Global wait-for graph used by distributed deadlock detector.
+ *
+ * Graph is stored in arena (own memory context) and is reused by subsequent checks:
+ * MtmGraphReset() drops vertices and edges but keeps allocated arrays.
+ * Edges are accumulated in a plain list and are converted to compressed adjacency
+ * arrays (CSR) on first search. Single pass of iterative Tarjan algorithm finds
+ * all strongly connected components, so after it any number of transactions can be
+ * checked for participation in a loop without traversing the graph again.
+ */
 
-typedef struct MtmEdge {
-	struct MtmEdge*   next; /* list of outgoing edges */
-    struct MtmVertex* dst;
-    struct MtmVertex* src;
-} MtmEdge;
-
-typedef struct MtmVertex
-{    
-    struct MtmEdge* outgoingEdges;
-    struct MtmVertex* collision;
-	GlobalTransactionId gtid;
-} MtmVertex;
+#define MTM_GRAPH_INIT_SIZE 1024 /* initial number of vertices and edges */
 
 typedef struct MtmGraph
 {
-    MtmVertex* hashtable[MAX_TRANSACTIONS];
+	MemoryContext ctx;             /* arena containing all arrays of the graph */
+	GlobalTransactionId* vertices; /* [maxVertices] transactions */
+	uint32* hashtable;             /* [hashSize] open addressing hash of vertices: index+1 or 0 for empty slot */
+	uint32* edges;                 /* [maxEdges*2] added edges as (src,dst) pairs */
+	uint32* offsets;               /* [maxVertices+1] outgoing edges of vertex v are targets[offsets[v]..offsets[v+1]) */
+	uint32* targets;               /* [maxEdges] destinations of edges grouped by source */
+	bool*   inLoop;                /* [maxVertices] vertex belongs to some loop */
+	uint32* scratch;               /* [maxVertices*5] working storage of Tarjan algorithm */
+	uint32  nVertices;
+	uint32  maxVertices;
+	uint32  hashSize;              /* power of two, at least twice larger than maxVertices */
+	uint32  nEdges;
+	uint32  maxEdges;
+	bool    searched;              /* loops were located after last modification of graph */
 } MtmGraph;
 
 extern void MtmGraphInit(MtmGraph* graph);
+extern void MtmGraphReset(MtmGraph* graph);
 extern void MtmGraphAdd(MtmGraph* graph, GlobalTransactionId* subgraph, int size);
 extern bool MtmGraphFindLoop(MtmGraph* graph, GlobalTransactionId* root);
 
@@ -0,0 +1,328 @@
+/*
+ * fingerprint.c
+ *
+ * Early detection of conflicts between distributed transactions (see fingerprint.h).
+ *
+ * Two transactions updating the same record at different nodes are both prepared locally
+ * and then each of them blocks on the lock held by the other one at the remote node
+ * until deadlock detection or timeout aborts one of them. With fingerprints, the replica
+ * receiving PREPARE of the transaction conflicting with its own in-flight transaction
+ * votes abort for the transaction with larger (snapshot, node) pair without applying it.
+ * Decision is deterministic, so both nodes detecting the conflict abort the same transaction.
+ *
+ * Published fingerprints are kept in a ring of slots protected by version counters:
+ * version is odd while the slot is updated and reader discards the copy if version has changed.
+ * Slots are overwritten without checking that transaction is completed: fingerprint is relevant
+ * only while its transaction is waiting for votes, which is checked in MtmTransState.
+ */
+#include <arpa/inet.h>
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/tuptoaster.h"
+#include "catalog/pg_index.h"
+#include "fmgr.h"
+#include "port/atomics.h"
+#include "storage/shmem.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#include "multimaster.h"
+#include "fingerprint.h"
+
+typedef struct
+{
+	pg_atomic_uint32 version;  /* odd while slot is updated */
+	TransactionId xid;         /* local transaction */
+	csn_t  snapshot;
+	int    nKeys;
+	uint32 keys[MTM_FINGERPRINT_MAX_KEYS];
+} MtmFingerprintSlot;
+
+typedef struct
+{
+	pg_atomic_uint32 next;
+	MtmFingerprintSlot slots[MTM_FINGERPRINT_SLOTS];
+} MtmFingerprintRing;
+
+bool MtmConflictFingerprints;
+
+static MtmFingerprintRing* MtmFingerprints;
+
+/* WAL sender: replica identity of the last fingerprinted relation */
+static Oid        MtmFingerprintRelid;
+static Oid        MtmFingerprintIndexid;
+static uint32     MtmFingerprintRelHash;
+static int        MtmFingerprintNKeys;
+static AttrNumber MtmFingerprintKeys[INDEX_MAX_KEYS];
+
+Size MtmFingerprintShmemSize(void)
+{
+	return sizeof(MtmFingerprintRing);
+}
+
+void MtmFingerprintInitialize(void)
+{
+	bool found;
+	int  i;
+
+	MtmFingerprints = (MtmFingerprintRing*)ShmemInitStruct("mtm_fingerprints", MtmFingerprintShmemSize(), &found);
+	if (!found) {
+		pg_atomic_init_u32(&MtmFingerprints->next, 0);
+		for (i = 0; i < MTM_FINGERPRINT_SLOTS; i++) {
+			pg_atomic_init_u32(&MtmFingerprints->slots[i].version, 0);
+			MtmFingerprints->slots[i].xid = InvalidTransactionId;
+		}
+	}
+}
+
+void MtmFingerprintReset(MtmFingerprint* fp)
+{
+	fp->nKeys = 0;
+}
+
+/*
+ * Load replica identity key of the relation. Relation is identified by name,
+ * because OIDs of the same relation are different at different nodes.
+ */
+static void MtmFingerprintLoadRel(Relation rel)
+{
+	HeapTuple tuple;
+	char* nspname;
+	int i;
+
+	MtmFingerprintRelid = RelationGetRelid(rel);
+	MtmFingerprintIndexid = rel->rd_replidindex;
+	MtmFingerprintNKeys = -1;
+
+	nspname = get_namespace_name(RelationGetNamespace(rel));
+	MtmFingerprintRelHash = DatumGetUInt32(hash_any((unsigned char const*)nspname, strlen(nspname)))
+		^ DatumGetUInt32(hash_any((unsigned char const*)RelationGetRelationName(rel), strlen(RelationGetRelationName(rel))));
+	pfree(nspname);
+
+	if (!OidIsValid(rel->rd_replidindex)) {
+		return;
+	}
+	tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(rel->rd_replidindex));
+	if (HeapTupleIsValid(tuple)) {
+		Form_pg_index index = (Form_pg_index)GETSTRUCT(tuple);
+		MtmFingerprintNKeys = index->indnatts;
+		for (i = 0; i < index->indnatts; i++) {
+			MtmFingerprintKeys[i] = index->indkey.values[i];
+			if (MtmFingerprintKeys[i] <= 0) {
+				MtmFingerprintNKeys = -1;
+				break;
+			}
+		}
+		ReleaseSysCache(tuple);
+	}
+}
+
+/*
+ * Add key of the record modified by transaction to its fingerprint.
+ * Records which key can not be hashed without fetching toast are skipped: it can only cause missed conflict.
+ */
+void MtmFingerprintAddTuple(MtmFingerprint* fp, Relation rel, HeapTuple tuple)
+{
+	TupleDesc desc = RelationGetDescr(rel);
+	uint32 h;
+	int i;
+
+	if (fp->nKeys < 0) {
+		return;
+	}
+	if (fp->nKeys == MTM_FINGERPRINT_MAX_KEYS) {
+		fp->nKeys = -1;
+		return;
+	}
+	if (rel->rd_indexvalid == 0) {
+		RelationGetIndexList(rel);
+	}
+	if (RelationGetRelid(rel) != MtmFingerprintRelid || rel->rd_replidindex != MtmFingerprintIndexid) {
+		MtmFingerprintLoadRel(rel);
+	}
+	if (MtmFingerprintNKeys <= 0) {
+		return;
+	}
+	h = MtmFingerprintRelHash;
+	for (i = 0; i < MtmFingerprintNKeys; i++) {
+		Form_pg_attribute attr = desc->attrs[MtmFingerprintKeys[i]-1];
+		bool isnull;
+		Datum value = heap_getattr(tuple, MtmFingerprintKeys[i], desc, &isnull);
+
+		h = (h << 1) | (h >> 31);
+		if (isnull) {
+			continue;
+		}
+		if (attr->attbyval) {
+			h ^= hash_uint32((uint32)value ^ (uint32)((uint64)value >> 32));
+		} else if (attr->attlen == -1) {
+			struct varlena* v;
+			if (VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(value))) {
+				return;
+			}
+			v = PG_DETOAST_DATUM_PACKED(value);
+			h ^= DatumGetUInt32(hash_any((unsigned char const*)VARDATA_ANY(v), VARSIZE_ANY_EXHDR(v)));
+			if ((Pointer)v != DatumGetPointer(value)) {
+				pfree(v);
+			}
+		} else if (attr->attlen == -2) {
+			h ^= DatumGetUInt32(hash_any((unsigned char const*)DatumGetCString(value), strlen(DatumGetCString(value))));
+		} else {
+			h ^= DatumGetUInt32(hash_any((unsigned char const*)DatumGetPointer(value), attr->attlen));
+		}
+	}
+	fp->keys[fp->nKeys++] = h;
+}
+
+static int MtmFingerprintCompareKeys(void const* p, void const* q)
+{
+	uint32 a = *(uint32 const*)p;
+	uint32 b = *(uint32 const*)q;
+	return a < b ? -1 : a == b ? 0 : 1;
+}
+
+/*
+ * Sort and deduplicate keys of fingerprint. Returns false if transaction can not be fingerprinted.
+ */
+bool MtmFingerprintComplete(MtmFingerprint* fp)
+{
+	int i, j;
+
+	if (fp->nKeys <= 0) {
+		return false;
+	}
+	qsort(fp->keys, fp->nKeys, sizeof(uint32), MtmFingerprintCompareKeys);
+	for (i = 1, j = 0; i < fp->nKeys; i++) {
+		if (fp->keys[i] != fp->keys[j]) {
+			fp->keys[++j] = fp->keys[i];
+		}
+	}
+	fp->nKeys = j + 1;
+	return true;
+}
+
+/*
+ * Publish fingerprint of local transaction which is going to wait for 2PC votes.
+ * All WAL senders decode the same PREPARE, the first of them publishes its fingerprint.
+ */
+void MtmFingerprintPublish(TransactionId xid, csn_t snapshot, MtmFingerprint* fp)
+{
+	MtmFingerprintSlot* slot;
+	uint32 version;
+	int i;
+
+	for (i = 0; i < MTM_FINGERPRINT_SLOTS; i++) {
+		/* Unprotected read: duplicated slot is harmless */
+		if (MtmFingerprints->slots[i].xid == xid) {
+			return;
+		}
+	}
+	slot = &MtmFingerprints->slots[pg_atomic_fetch_add_u32(&MtmFingerprints->next, 1) % MTM_FINGERPRINT_SLOTS];
+	version = pg_atomic_read_u32(&slot->version);
+	if ((version & 1) || !pg_atomic_compare_exchange_u32(&slot->version, &version, version + 1)) {
+		/* Slot is concurrently updated by other WAL sender: fingerprint is not required for correctness */
+		return;
+	}
+	slot->xid = xid;
+	slot->snapshot = snapshot;
+	slot->nKeys = fp->nKeys;
+	memcpy(slot->keys, fp->keys, fp->nKeys*sizeof(uint32));
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->version, version + 2);
+}
+
+static bool MtmFingerprintIntersects(uint32 const* a, int na, uint32 const* b, int nb)
+{
+	int i = 0, j = 0;
+	while (i < na && j < nb) {
+		if (a[i] == b[j]) {
+			return true;
+		}
+		if (a[i] < b[j]) {
+			i += 1;
+		} else {
+			j += 1;
+		}
+	}
+	return false;
+}
+
+static uint32 MtmFingerprintGetInt(char const* p)
+{
+	uint32 n32;
+	memcpy(&n32, p, 4);
+	return ntohl(n32);
+}
+
+/*
+ * Check whether received transaction conflicts with in-flight local transaction which wins the conflict.
+ * begin and commit are 'B' and 'C' messages of the transaction, the latter contains fingerprint.
+ */
+bool MtmFingerprintIsDoomed(char const* begin, int beginSize, char const* commit, int commitSize)
+{
+	uint32 keys[MTM_FINGERPRINT_MAX_KEYS];
+	uint32 slotKeys[MTM_FINGERPRINT_MAX_KEYS];
+	char const* gidEnd;
+	int nodeId, nKeys, i;
+	csn_t snapshot;
+	int pos = 1 + 1 + 1 + 8 + 8 + 8 + 1 + 8; /* 'C', event, node, lsns, time, origin node, origin lsn */
+
+	if (beginSize < 1 + 4 + 8 + 8 || begin[0] != 'B'
+		|| commitSize <= pos || commit[0] != 'C' || commit[1] != PGLOGICAL_PREPARE)
+	{
+		return false;
+	}
+	gidEnd = memchr(&commit[pos], '\0', commitSize - pos);
+	if (gidEnd == NULL) {
+		return false;
+	}
+	pos = gidEnd - commit + 1;
+	if (pos + 3 > commitSize || commit[pos] != 'W') {
+		return false;
+	}
+	nKeys = ((uint8)commit[pos+1] << 8) | (uint8)commit[pos+2];
+	pos += 3;
+	if (nKeys > MTM_FINGERPRINT_MAX_KEYS || pos + nKeys*4 > commitSize) {
+		return false;
+	}
+	for (i = 0; i < nKeys; i++) {
+		keys[i] = MtmFingerprintGetInt(&commit[pos + i*4]);
+	}
+	nodeId = (int)MtmFingerprintGetInt(&begin[1]);
+	snapshot = ((uint64)MtmFingerprintGetInt(&begin[1+4+8]) << 32) | MtmFingerprintGetInt(&begin[1+4+8+4]);
+
+	for (i = 0; i < MTM_FINGERPRINT_SLOTS; i++) {
+		MtmFingerprintSlot* slot = &MtmFingerprints->slots[i];
+		uint32 version = pg_atomic_read_u32(&slot->version);
+		TransactionId xid;
+		csn_t slotSnapshot;
+		int slotNKeys;
+
+		if (version & 1) {
+			continue;
+		}
+		pg_read_barrier();
+		xid = slot->xid;
+		slotSnapshot = slot->snapshot;
+		slotNKeys = Min(slot->nKeys, MTM_FINGERPRINT_MAX_KEYS);
+		memcpy(slotKeys, slot->keys, slotNKeys*sizeof(uint32));
+		pg_read_barrier();
+		if (pg_atomic_read_u32(&slot->version) != version || !TransactionIdIsValid(xid)) {
+			continue;
+		}
+		/* Transaction with smaller (snapshot, node) wins */
+		if ((slotSnapshot < snapshot || (slotSnapshot == snapshot && MtmNodeId < nodeId))
+			&& MtmFingerprintIntersects(keys, nKeys, slotKeys, slotNKeys)
+			&& MtmIsVotingTransaction(xid))
+		{
+			MTM_LOG1("Transaction of node %d with snapshot %lld conflicts with local transaction %u with snapshot %lld",
+					 nodeId, (long64)snapshot, xid, (long64)slotSnapshot);
+			return true;
+		}
+	}
+	return false;
+}
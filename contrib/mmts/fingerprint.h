@@ -0,0 +1,39 @@
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+#include "access/htup.h"
+#include "utils/relcache.h"
+
+/*
+ * Write-set fingerprints of distributed transactions.
+ *
+ * WAL sender collects hashes of relation name and replica identity key of all records
+ * modified by local transaction and sends them sorted together with PREPARE ('W' field of 'C' message).
+ * The same fingerprint is published in shared memory while the transaction waits for 2PC votes.
+ * Receiver checks fingerprint of each PREPARE against fingerprints of local in-flight transactions:
+ * if they intersect, one of them (the one with larger snapshot) is doomed to be aborted,
+ * so replica votes abort immediately instead of applying it and waiting for the lock.
+ *
+ * Hash collisions can only cause false aborts, transactions with too large write sets are not fingerprinted.
+ */
+
+#define MTM_FINGERPRINT_MAX_KEYS 64   /* larger write sets are not fingerprinted */
+#define MTM_FINGERPRINT_SLOTS    256  /* ring of published fingerprints of local transactions */
+
+typedef struct
+{
+	int    nKeys;   /* number of keys or -1 if write set is too large */
+	uint32 keys[MTM_FINGERPRINT_MAX_KEYS];
+} MtmFingerprint;
+
+extern bool MtmConflictFingerprints;
+
+extern Size MtmFingerprintShmemSize(void);
+extern void MtmFingerprintInitialize(void);
+extern void MtmFingerprintReset(MtmFingerprint* fp);
+extern void MtmFingerprintAddTuple(MtmFingerprint* fp, Relation rel, HeapTuple tuple);
+extern bool MtmFingerprintComplete(MtmFingerprint* fp);
+extern void MtmFingerprintPublish(TransactionId xid, csn_t snapshot, MtmFingerprint* fp);
+extern bool MtmFingerprintIsDoomed(char const* begin, int beginSize, char const* commit, int commitSize);
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * hintbits.c
+ *
+ * Proactive hint bits for tuples written by apply workers (see hintbits.h).
+ *
+ * Without them, the first query reading a replicated tuple checks the commit status of its
+ * transaction and sets the hint bit, which dirties the page; with checksums enabled, the first
+ * hint bit set after a checkpoint also WAL-logs a full page image. So read-only queries over
+ * freshly replicated data cause write I/O. Apply worker does this work instead, once per page
+ * rather than once per tuple, right after COMMIT PREPARED is applied.
+ *
+ * Published page lists are kept in a ring of slots protected by version counters, like fingerprints:
+ * version is odd while the slot is updated and reader discards the copy if version has changed.
+ * Losing a slot only means that readers set hint bits themselves.
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "port/atomics.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "storage/shmem.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/tqual.h"
+
+#include "multimaster.h"
+#include "hintbits.h"
+
+typedef struct
+{
+	pg_atomic_uint32 version;  /* odd while slot is updated */
+	TransactionId xid;         /* prepared transaction */
+	char   gid[MULTIMASTER_MAX_GID_SIZE];
+	int    nPages;
+	MtmHintPage pages[MTM_HINT_MAX_PAGES];
+} MtmHintSlot;
+
+typedef struct
+{
+	pg_atomic_uint32 next;
+	MtmHintSlot slots[MTM_HINT_SLOTS];
+} MtmHintRing;
+
+bool MtmProactiveHintBits;
+
+static MtmHintRing* MtmHints;
+
+/* Apply worker: pages modified by the current remote transaction, -1 if there are too many */
+static int         MtmHintNPages;
+static MtmHintPage MtmHintPages[MTM_HINT_MAX_PAGES];
+
+Size MtmHintShmemSize(void)
+{
+	return sizeof(MtmHintRing);
+}
+
+void MtmHintInitialize(void)
+{
+	bool found;
+	int  i;
+
+	MtmHints = (MtmHintRing*)ShmemInitStruct("mtm_hint_bits", MtmHintShmemSize(), &found);
+	if (!found) {
+		pg_atomic_init_u32(&MtmHints->next, 0);
+		for (i = 0; i < MTM_HINT_SLOTS; i++) {
+			pg_atomic_init_u32(&MtmHints->slots[i].version, 0);
+			MtmHints->slots[i].xid = InvalidTransactionId;
+			memset(MtmHints->slots[i].gid, 0, sizeof(MtmHints->slots[i].gid));
+		}
+	}
+}
+
+/*
+ * Called at the beginning of each remote transaction
+ */
+void MtmHintReset(void)
+{
+	MtmHintNPages = MtmProactiveHintBits ? 0 : -1;
+}
+
+/*
+ * Remember page of the tuple inserted or modified by remote transaction.
+ * Tuples are mostly written in order, so only the last few pages are checked for duplicates.
+ */
+void MtmHintAddTuple(Relation rel, ItemPointer tid)
+{
+	Oid relid = RelationGetRelid(rel);
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+	int i;
+
+	if (MtmHintNPages < 0) {
+		return;
+	}
+	for (i = MtmHintNPages; --i >= 0 && i >= MtmHintNPages - 4;) {
+		if (MtmHintPages[i].relid == relid && MtmHintPages[i].blkno == blkno) {
+			return;
+		}
+	}
+	if (MtmHintNPages == MTM_HINT_MAX_PAGES) {
+		MtmHintNPages = -1;
+		return;
+	}
+	MtmHintPages[MtmHintNPages].relid = relid;
+	MtmHintPages[MtmHintNPages].blkno = blkno;
+	MtmHintNPages += 1;
+}
+
+/*
+ * Publish pages of remote transaction which is going to be prepared.
+ */
+void MtmHintPublish(char const* gid, TransactionId xid)
+{
+	MtmHintSlot* slot;
+	uint32 version;
+
+	if (MtmHintNPages <= 0 || !TransactionIdIsValid(xid)) {
+		return;
+	}
+	slot = &MtmHints->slots[pg_atomic_fetch_add_u32(&MtmHints->next, 1) % MTM_HINT_SLOTS];
+	version = pg_atomic_read_u32(&slot->version);
+	if ((version & 1) || !pg_atomic_compare_exchange_u32(&slot->version, &version, version + 1)) {
+		/* Slot is concurrently updated by other apply worker: hint bits are not required for correctness */
+		return;
+	}
+	slot->xid = xid;
+	strncpy(slot->gid, gid, sizeof(slot->gid));
+	slot->gid[sizeof(slot->gid) - 1] = '\0';
+	slot->nPages = MtmHintNPages;
+	memcpy(slot->pages, MtmHintPages, MtmHintNPages*sizeof(MtmHintPage));
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->version, version + 2);
+}
+
+static int MtmHintComparePages(void const* p, void const* q)
+{
+	MtmHintPage const* a = (MtmHintPage const*)p;
+	MtmHintPage const* b = (MtmHintPage const*)q;
+
+	if (a->relid != b->relid) {
+		return a->relid < b->relid ? -1 : 1;
+	}
+	return a->blkno < b->blkno ? -1 : a->blkno == b->blkno ? 0 : 1;
+}
+
+/*
+ * Set commit hint bits of all tuples of the committed transaction at the page.
+ */
+static void MtmHintSetPage(Relation rel, BlockNumber blkno, TransactionId xid)
+{
+	Buffer buffer;
+	Page page;
+	OffsetNumber off, maxoff;
+
+	buffer = ReadBuffer(rel, blkno);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buffer);
+	maxoff = PageGetMaxOffsetNumber(page);
+
+	for (off = FirstOffsetNumber; off <= maxoff; off = OffsetNumberNext(off)) {
+		ItemId itemid = PageGetItemId(page, off);
+		HeapTupleHeader htup;
+
+		if (!ItemIdIsNormal(itemid)) {
+			continue;
+		}
+		htup = (HeapTupleHeader)PageGetItem(page, itemid);
+
+		if (HeapTupleHeaderGetRawXmin(htup) == xid && !HeapTupleHeaderXminCommitted(htup)) {
+			HeapTupleSetHintBits(htup, buffer, HEAP_XMIN_COMMITTED, xid);
+		}
+		if (!(htup->t_infomask & (HEAP_XMAX_INVALID | HEAP_XMAX_COMMITTED | HEAP_XMAX_IS_MULTI))
+			&& !HEAP_XMAX_IS_LOCKED_ONLY(htup->t_infomask)
+			&& HeapTupleHeaderGetRawXmax(htup) == xid)
+		{
+			HeapTupleSetHintBits(htup, buffer, HEAP_XMAX_COMMITTED, xid);
+		}
+	}
+	UnlockReleaseBuffer(buffer);
+}
+
+/*
+ * Set hint bits for the transaction prepared by any apply worker, which has just been committed
+ * by FinishPreparedTransaction in the current transaction. Relations which are locked by somebody
+ * else or were dropped are skipped, nothing here is allowed to block or fail the commit.
+ */
+void MtmHintCommitPrepared(char const* gid)
+{
+	MtmHintPage pages[MTM_HINT_MAX_PAGES];
+	TransactionId xid = InvalidTransactionId;
+	int nPages = 0;
+	int i;
+
+	if (!MtmProactiveHintBits) {
+		return;
+	}
+	for (i = 0; i < MTM_HINT_SLOTS; i++) {
+		MtmHintSlot* slot = &MtmHints->slots[i];
+		uint32 version = pg_atomic_read_u32(&slot->version);
+
+		if ((version & 1) || strcmp(slot->gid, gid) != 0) {
+			continue;
+		}
+		pg_read_barrier();
+		xid = slot->xid;
+		nPages = Min(slot->nPages, MTM_HINT_MAX_PAGES);
+		memcpy(pages, slot->pages, nPages*sizeof(MtmHintPage));
+		pg_read_barrier();
+		if (pg_atomic_read_u32(&slot->version) == version && strcmp(slot->gid, gid) == 0) {
+			break;
+		}
+		nPages = 0;
+	}
+	if (nPages == 0 || !TransactionIdDidCommit(xid)) {
+		return;
+	}
+	qsort(pages, nPages, sizeof(MtmHintPage), MtmHintComparePages);
+
+	for (i = 0; i < nPages;) {
+		Oid relid = pages[i].relid;
+		Relation rel = NULL;
+		BlockNumber nblocks = 0;
+
+		if (ConditionalLockRelationOid(relid, AccessShareLock)) {
+			if (SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relid))) {
+				rel = relation_open(relid, NoLock);
+				nblocks = RelationGetNumberOfBlocks(rel);
+			} else {
+				UnlockRelationOid(relid, AccessShareLock);
+			}
+		}
+		for (; i < nPages && pages[i].relid == relid; i++) {
+			if (rel != NULL && pages[i].blkno < nblocks) {
+				MtmHintSetPage(rel, pages[i].blkno, xid);
+			}
+		}
+		if (rel != NULL) {
+			relation_close(rel, AccessShareLock);
+		}
+	}
+}
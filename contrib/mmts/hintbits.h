@@ -0,0 +1,38 @@
+#ifndef __HINTBITS_H__
+#define __HINTBITS_H__
+
+#include "storage/block.h"
+#include "storage/itemptr.h"
+#include "utils/relcache.h"
+
+/*
+ * Proactive hint bits for tuples written by apply workers.
+ *
+ * Apply worker remembers pages of the tuples inserted, updated and deleted by remote transaction.
+ * When the transaction is prepared, the list is published in shared memory, because COMMIT PREPARED
+ * can be applied by another worker. Once COMMIT PREPARED is applied, commit hint bits are set for all
+ * tuples of the transaction at these pages, one page at a time, so that the first queries reading them
+ * don't have to look up the commit status, dirty the pages and possibly WAL-log them.
+ *
+ * Transactions modifying too many pages are not tracked: readers set hint bits for them as usual.
+ */
+
+#define MTM_HINT_MAX_PAGES 128   /* larger transactions are not tracked */
+#define MTM_HINT_SLOTS     256   /* ring of published page lists of prepared transactions */
+
+typedef struct
+{
+	Oid         relid;
+	BlockNumber blkno;
+} MtmHintPage;
+
+extern bool MtmProactiveHintBits;
+
+extern Size MtmHintShmemSize(void);
+extern void MtmHintInitialize(void);
+extern void MtmHintReset(void);
+extern void MtmHintAddTuple(Relation rel, ItemPointer tid);
+extern void MtmHintPublish(char const* gid, TransactionId xid);
+extern void MtmHintCommitPrepared(char const* gid);
+
+#endif
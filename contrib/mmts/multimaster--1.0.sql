@@ -45,6 +45,14 @@ CREATE FUNCTION mtm.get_snapshot() RETURNS bigint
 AS 'MODULE_PATHNAME','mtm_get_snapshot'
 LANGUAGE C;
 
+CREATE FUNCTION mtm.set_snapshot(csn bigint) RETURNS bigint
+AS 'MODULE_PATHNAME','mtm_set_snapshot'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.bootstrap_node(jobs integer default 0) RETURNS bigint
+AS 'MODULE_PATHNAME','mtm_bootstrap_node'
+LANGUAGE C;
+
 CREATE FUNCTION mtm.get_csn(xid bigint) RETURNS bigint
 AS 'MODULE_PATHNAME','mtm_get_csn'
 LANGUAGE C;
@@ -53,14 +61,14 @@ CREATE FUNCTION mtm.get_last_csn() RETURNS bigint
 AS 'MODULE_PATHNAME','mtm_get_last_csn'
 LANGUAGE C;
 
-CREATE TYPE mtm.node_state AS ("id" integer, "enabled" bool, "connected" bool, "slot_active" bool, "stopped" bool, "catchUp" bool, "slotLag" bigint, "avgTransDelay" bigint, "lastStatusChange" timestamp, "oldestSnapshot" bigint, "SenderPid" integer, "SenderStartTime" timestamp, "ReceiverPid" integer, "ReceiverStartTime" timestamp, "connStr" text, "connectivityMask" bigint, "nHeartbeats" bigint);
+CREATE TYPE mtm.node_state AS ("id" integer, "enabled" bool, "connected" bool, "slot_active" bool, "stopped" bool, "catchUp" bool, "slotLag" bigint, "avgTransDelay" bigint, "lastStatusChange" timestamp, "oldestSnapshot" bigint, "SenderPid" integer, "SenderStartTime" timestamp, "ReceiverPid" integer, "ReceiverStartTime" timestamp, "connStr" text, "connectivityMask" bigint, "nHeartbeats" bigint, "receiverStalls" bigint, "receiverStallTime" bigint);
 
 CREATE FUNCTION mtm.get_nodes_state() RETURNS SETOF mtm.node_state
 AS 'MODULE_PATHNAME','mtm_get_nodes_state'
 LANGUAGE C;
 
 CREATE TYPE mtm.cluster_state AS ("id" integer, "status" text, "disabledNodeMask" bigint, "disconnectedNodeMask" bigint, "catchUpNodeMask" bigint, "liveNodes" integer, "allNodes" integer, "nActiveQueries" integer, "nPendingQueries" integer, "queueSize" bigint, "transCount" bigint, "timeShift" bigint, "recoverySlot" integer,
-"xidHashSize" bigint, "gidHashSize" bigint, "oldestXid" bigint, "configChanges" integer, "stalledNodeMask" bigint, "stoppedNodeMask" bigint, "deadNodeMask" bigint, "lastStatusChange" timestamp);
+"xidHashSize" bigint, "gidHashSize" bigint, "oldestXid" bigint, "configChanges" integer, "stalledNodeMask" bigint, "stoppedNodeMask" bigint, "deadNodeMask" bigint, "lastStatusChange" timestamp, "snapshotWaits" bigint, "snapshotWaitTime" bigint, "gcRuns" bigint, "gcRemoved" bigint, "gcTime" bigint, "gcMaxPause" bigint, "clockAhead" bigint, "maxClockDrift" bigint, "clockRejected" bigint, "readOnlyCommits" bigint, "emptyWriteCommits" bigint, "localOnlyCommits" bigint, "twoPhaseCommits" bigint, "visibilityCacheHits" bigint, "visibilityCacheMisses" bigint);
 
 CREATE TYPE mtm.trans_state AS ("status" text, "gid" text, "xid" bigint, "coordinator" integer, "gxid" bigint, "csn" timestamp, "snapshot" timestamp, "local" boolean, "prepared" boolean, "active" boolean, "twophase" boolean, "votingCompleted" boolean, "participants" bigint, "voted" bigint, "configChanges" integer);
 
@@ -76,6 +84,80 @@ CREATE FUNCTION mtm.get_cluster_state() RETURNS mtm.cluster_state
 AS 'MODULE_PATHNAME','mtm_get_cluster_state'
 LANGUAGE C;
 
+CREATE TYPE mtm.pool_stats AS ("workers" integer, "active" integer, "pending" integer, "queueDepth" bigint, "peakDepth" bigint, "queueSize" bigint, "works" bigint, "stalls" bigint, "stallTime" bigint, "wakeups" bigint, "idleTime" bigint, "grows" bigint, "shrinks" bigint, "priorityQueueDepth" bigint, "priorityQueueSize" bigint, "priorityWorks" bigint, "priorityStalls" bigint);
+
+CREATE FUNCTION mtm.get_pool_stats() RETURNS mtm.pool_stats
+AS 'MODULE_PATHNAME','mtm_get_pool_stats'
+LANGUAGE C;
+
+CREATE TYPE mtm.perf_stats AS ("metric" text, "node" integer, "count" bigint, "total" bigint, "max" bigint, "p50" bigint, "p99" bigint, "p999" bigint);
+
+CREATE FUNCTION mtm.get_perf_stats() RETURNS SETOF mtm.perf_stats
+AS 'MODULE_PATHNAME','mtm_get_perf_stats'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.reset_perf_stats() RETURNS void
+AS 'MODULE_PATHNAME','mtm_reset_perf_stats'
+LANGUAGE C;
+
+CREATE TYPE mtm.wait_sample AS ("sample_time" timestamptz, "pid" integer, "wait_event_type" text, "wait_event" text, "query_id" bigint, "mtm_state" text);
+
+CREATE FUNCTION mtm.get_wait_samples() RETURNS SETOF mtm.wait_sample
+AS 'MODULE_PATHNAME','mtm_get_wait_samples'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.reset_wait_samples() RETURNS void
+AS 'MODULE_PATHNAME','mtm_reset_wait_samples'
+LANGUAGE C;
+
+CREATE VIEW mtm.wait_samples AS SELECT * FROM mtm.get_wait_samples();
+
+-- Samples without wait event were taken on CPU
+CREATE VIEW mtm.wait_profile AS
+SELECT query_id, coalesce(wait_event_type, 'CPU') AS wait_event_type, wait_event, mtm_state,
+       count(*) AS samples,
+       round(100.0 * count(*) / sum(count(*)) OVER (PARTITION BY query_id), 1) AS percent
+FROM mtm.get_wait_samples()
+GROUP BY query_id, wait_event_type, wait_event, mtm_state;
+
+CREATE FUNCTION mtm.top_wait_events(n integer DEFAULT 5)
+RETURNS TABLE (query_id bigint, wait_event_type text, wait_event text, mtm_state text, samples bigint, percent numeric) AS
+$$
+SELECT p.query_id, p.wait_event_type, p.wait_event, p.mtm_state, p.samples, p.percent
+FROM (SELECT *, row_number() OVER (PARTITION BY query_id ORDER BY samples DESC) AS rank FROM mtm.wait_profile) p
+WHERE p.rank <= n
+ORDER BY sum(p.samples) OVER (PARTITION BY p.query_id) DESC, p.query_id, p.rank;
+$$
+LANGUAGE sql;
+
+CREATE TYPE mtm.trace_event AS ("gid" text, "node" integer, "event" text, "event_time" timestamptz, "peer_node" integer, "csn" bigint, "pid" integer);
+
+CREATE FUNCTION mtm.get_trace_events() RETURNS SETOF mtm.trace_event
+AS 'MODULE_PATHNAME','mtm_get_trace_events'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.reset_trace_events() RETURNS void
+AS 'MODULE_PATHNAME','mtm_reset_trace_events'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.collect_trace_events(gid text DEFAULT NULL) RETURNS SETOF mtm.trace_event
+AS 'MODULE_PATHNAME','mtm_collect_trace_events'
+LANGUAGE C;
+
+CREATE VIEW mtm.trace_events AS SELECT * FROM mtm.get_trace_events();
+
+-- Events of one transaction at all nodes. Intervals between events of different nodes include clock skew.
+CREATE FUNCTION mtm.trace_timeline(gid text)
+RETURNS TABLE (node integer, event text, peer_node integer, event_time timestamptz, since_begin interval, since_previous interval) AS
+$$
+SELECT e.node, e.event, e.peer_node, e.event_time,
+       e.event_time - min(e.event_time) OVER (),
+       e.event_time - lag(e.event_time) OVER (ORDER BY e.event_time, e.node)
+FROM mtm.collect_trace_events($1) e
+ORDER BY e.event_time, e.node;
+$$
+LANGUAGE sql;
+
 CREATE FUNCTION mtm.collect_cluster_info() RETURNS SETOF mtm.cluster_state
 AS 'MODULE_PATHNAME','mtm_collect_cluster_info'
 LANGUAGE C;
@@ -8,11 +8,13 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#include <poll.h>
 
 #include "postgres.h"
 #include "funcapi.h"
 #include "fmgr.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "pg_socket.h"
 
 #include "libpq-fe.h"
@@ -29,6 +31,8 @@
 #include "storage/shmem.h"
 #include "storage/ipc.h"
 #include "storage/procarray.h"
+#include "storage/bufmgr.h"
+#include "access/hash.h"
 #include "access/xlogdefs.h"
 #include "access/xact.h"
 #include "access/xtm.h"
@@ -79,6 +83,14 @@
 #include "multimaster.h"
 #include "ddd.h"
 #include "state.h"
+#include "bootstrap.h"
+#include "writeset.h"
+#include "fingerprint.h"
+#include "hintbits.h"
+#include "pglogical_relid_map.h"
+#include "perfstat.h"
+#include "sampler.h"
+#include "trace.h"
 
 typedef struct {
 	TransactionId xid;	  /* local transaction ID	*/
@@ -90,13 +102,28 @@ typedef struct {
 	bool  isSuspended;	  /* prepared transaction is suspended because coordinator node is switch to offline */
 	bool  isTransactionBlock; /* is transaction block */
 	bool  containsDML;	  /* transaction contains DML statements */
+	bool  containsLocalDML; /* transaction modified relations which are not replicated (local tables) */
+	bool  executedDML;	  /* transaction executed INSERT/UPDATE/DELETE statements, even if them changed nothing */
 	bool  isActive;		  /* transaction is active (nActiveTransaction counter is incremented) */
+	bool  isLocalRead;	  /* read-only transaction using local snapshot (multimaster.local_reads) */
 	XidStatus status;	  /* transaction status */
 	csn_t snapshot;		  /* transaction snapshot */
 	csn_t csn;			  /* CSN */
 	pgid_t gid;			  /* global transaction identifier (used by 2pc) */
 } MtmCurrentTrans;
 
+/*
+ * Range of values of monotonic sequence claimed by this node: other nodes are notified only
+ * about the end of the range, and move their sequences past it.
+ */
+typedef struct {
+	Oid           seqid;
+	int64         increment; /* increment of the sequence, 0 if not known yet */
+	int64         bound;     /* last value of the claimed range */
+	uint64        epoch;     /* epoch of the claimed range, 0 if none is claimed */
+	TransactionId xid;       /* transaction which announced the range, until it is known to be committed */
+} MtmSeqRange;
+
 typedef enum
 {
 	MTM_STATE_LOCK_ID
@@ -104,6 +131,11 @@ typedef enum
 
 #define MTM_SHMEM_SIZE (128*1024*1024)
 #define MTM_HASH_SIZE  100003
+#define MTM_XID_PARTITIONS 16 /* number of partitions of xid2state hash, should be power of 2 */
+#define MTM_XID_BUCKETS    (256*1024) /* number of chains of xid2state hash, should be power of 2 */
+#define MTM_TRANS_POOL_SIZE (256*1024) /* maximal number of transaction states */
+#define MTM_NO_SLOT        0xFFFFFFFF
+#define MTM_GC_BATCH_SIZE  1024 /* maximal number of transactions removed by one GC pass */
 #define MTM_MAP_SIZE   MTM_HASH_SIZE
 #define MIN_WAIT_TIMEOUT 1000
 #define MAX_WAIT_TIMEOUT 100000
@@ -123,12 +155,22 @@ PG_FUNCTION_INFO_V1(mtm_poll_node);
 PG_FUNCTION_INFO_V1(mtm_recover_node);
 PG_FUNCTION_INFO_V1(mtm_resume_node);
 PG_FUNCTION_INFO_V1(mtm_get_snapshot);
+PG_FUNCTION_INFO_V1(mtm_set_snapshot);
+PG_FUNCTION_INFO_V1(mtm_bootstrap_node);
 PG_FUNCTION_INFO_V1(mtm_get_csn);
 PG_FUNCTION_INFO_V1(mtm_get_trans_by_gid);
 PG_FUNCTION_INFO_V1(mtm_get_trans_by_xid);
 PG_FUNCTION_INFO_V1(mtm_get_last_csn);
 PG_FUNCTION_INFO_V1(mtm_get_nodes_state);
 PG_FUNCTION_INFO_V1(mtm_get_cluster_state);
+PG_FUNCTION_INFO_V1(mtm_get_pool_stats);
+PG_FUNCTION_INFO_V1(mtm_get_perf_stats);
+PG_FUNCTION_INFO_V1(mtm_reset_perf_stats);
+PG_FUNCTION_INFO_V1(mtm_get_wait_samples);
+PG_FUNCTION_INFO_V1(mtm_reset_wait_samples);
+PG_FUNCTION_INFO_V1(mtm_get_trace_events);
+PG_FUNCTION_INFO_V1(mtm_reset_trace_events);
+PG_FUNCTION_INFO_V1(mtm_collect_trace_events);
 PG_FUNCTION_INFO_V1(mtm_collect_cluster_info);
 PG_FUNCTION_INFO_V1(mtm_make_table_local);
 PG_FUNCTION_INFO_V1(mtm_dump_lock_graph);
@@ -148,8 +190,12 @@ static void MtmAbortPreparedTransaction(MtmCurrentTrans* x);
 static void MtmPreCommitPreparedTransaction(MtmCurrentTrans* x);
 static void MtmEndTransaction(MtmCurrentTrans* x, bool commit);
 static bool MtmTwoPhaseCommit(MtmCurrentTrans* x);
+static bool MtmIsLocalRelation(Oid relid);
+static void MtmCountCommit(MtmCurrentTrans* x);
+static void MtmLoadLocalTables(void);
 static TransactionId MtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
+static void MtmXidInMVCCSnapshotBatch(int nxids, TransactionId* xids, bool* inSnapshot, Snapshot snapshot);
 static TransactionId MtmAdjustOldestXid(TransactionId xid);
 static bool MtmDetectGlobalDeadLock(PGPROC* proc);
 static void MtmAddSubtransactions(MtmTransState* ts, TransactionId* subxids, int nSubxids);
@@ -166,11 +212,15 @@ static void   MtmSetRemoteFunction(char const* list, void* extra);
 static void MtmCheckClusterLock(void);
 static void MtmCheckSlots(void);
 static void MtmAddSubtransactions(MtmTransState* ts, TransactionId *subxids, int nSubxids);
+static MtmTransState* MtmXidLookupWithHash(TransactionId xid, uint32 hashcode);
+static MtmTransState* MtmXidEnter(TransactionId xid, bool* found);
+static void MtmXidRemove(TransactionId xid);
+static Size MtmXidMapShmemSize(void);
 
 static void MtmShmemStartup(void);
 
 static BgwPool* MtmPoolConstructor(void);
-static bool MtmRunUtilityStmt(PGconn* conn, char const* sql, char **errmsg);
+static int  MtmRunUtilityStmt(PGconn** conns, int nNodes, char const* sql, char **errmsg);
 static void MtmBroadcastUtilityStmt(char const* sql, bool ignoreError, int forceOnNode);
 static void MtmProcessDDLCommand(char const* queryString, bool transactional);
 
@@ -186,10 +236,29 @@ void*		MtmTablespaceStmt; /* CREATE/DELETE tablespace */
 MemoryContext MtmApplyContext;
 MtmConnectionInfo* MtmConnections;
 
-HTAB* MtmXid2State;
+/*
+ * Transaction states are allocated from preallocated shared pool of fixed-size slots
+ * (MtmTransState has variable-size tail xids[MtmMaxNodes]). Free slots form lock-free stack:
+ * its head contains index of the top slot and ABA counter incremented by each push and pop.
+ * Xid2state hash maps XID to slot number: heads of chains and links between slots are slot numbers.
+ * Chains are changed only under exclusive lock of XID partition (chain number modulo MTM_XID_PARTITIONS),
+ * link of removed slot is preserved, so concurrent reader continues the walk through the chain.
+ */
+typedef struct
+{
+	pg_atomic_uint64 freeHead;                 /* (ABA counter << 32) | top of stack of free slots */
+	pg_atomic_uint32 nUsed;                    /* number of allocated slots */
+	uint32 buckets[MTM_XID_BUCKETS];           /* first slot of the chain */
+	uint32 next[MTM_TRANS_POOL_SIZE];          /* next slot of the chain */
+	uint32 nextFree[MTM_TRANS_POOL_SIZE];      /* next slot of stack of free slots */
+	char   slots[FLEXIBLE_ARRAY_MEMBER];       /* [MTM_TRANS_POOL_SIZE] of MtmTransStateSize() */
+} MtmXidMap;
+
+static MtmXidMap* MtmXid2State;
 HTAB* MtmGid2State;
 static HTAB* MtmRemoteFunctions;
 static HTAB* MtmLocalTables;
+static HTAB* MtmSeqRanges;
 
 static bool MtmIsRecoverySession;
 
@@ -198,23 +267,24 @@ static dlist_head MtmLsnMapping = DLIST_STATIC_INIT(MtmLsnMapping);
 
 static TransactionManager MtmTM =
 {
-	PgTransactionIdGetStatus,
-	PgTransactionIdSetTreeStatus,
-	MtmGetSnapshot,
-	PgGetNewTransactionId,
-	MtmGetOldestXmin,
-	PgTransactionIdIsInProgress,
-	PgGetGlobalTransactionId,
-	MtmXidInMVCCSnapshot,
-	MtmDetectGlobalDeadLock,
-	MtmGetName,
-	MtmGetTransactionStateSize,
-	MtmSerializeTransactionState,
-	MtmDeserializeTransactionState,
-	MtmInitializeSequence,
-	MtmCreateSavepointContext,
-	MtmRestoreSavepointContext,
-	MtmReleaseSavepointContext
+	.GetTransactionStatus = PgTransactionIdGetStatus,
+	.SetTransactionStatus = PgTransactionIdSetTreeStatus,
+	.GetSnapshot = MtmGetSnapshot,
+	.GetNewTransactionId = PgGetNewTransactionId,
+	.GetOldestXmin = MtmGetOldestXmin,
+	.IsInProgress = PgTransactionIdIsInProgress,
+	.GetGlobalTransactionId = PgGetGlobalTransactionId,
+	.IsInSnapshot = MtmXidInMVCCSnapshot,
+	.DetectGlobalDeadLock = MtmDetectGlobalDeadLock,
+	.GetName = MtmGetName,
+	.GetTransactionStateSize = MtmGetTransactionStateSize,
+	.SerializeTransactionState = MtmSerializeTransactionState,
+	.DeserializeTransactionState = MtmDeserializeTransactionState,
+	.InitializeSequence = MtmInitializeSequence,
+	.CreateSavepointContext = MtmCreateSavepointContext,
+	.RestoreSavepointContext = MtmRestoreSavepointContext,
+	.ReleaseSavepointContext = MtmReleaseSavepointContext,
+	.IsInSnapshotBatch = MtmXidInMVCCSnapshotBatch
 };
 
 char const* const MtmNodeStatusMnem[] =
@@ -245,17 +315,34 @@ int	  MtmReplicationNodeId;
 int	  MtmArbiterPort;
 int	  MtmNodeDisableDelay;
 int	  MtmTransSpillThreshold;
+int	  MtmStreamThreshold;
+int	  MtmReceiveBufferSize;
+int	  MtmPriorityWorkSize;
 int	  MtmMaxNodes;
 int	  MtmHeartbeatSendTimeout;
+int   MtmArbiterCoalesceDelay;
+int   MtmArbiterBusyPoll;
 int	  MtmHeartbeatRecvTimeout;
+int	  MtmMaxClockSkew;
 int	  MtmMin2PCTimeout;
 int	  MtmMax2PCRatio;
+int   MtmGroupCommitDelay;
+int   MtmGroupCommitSiblings;
 bool  MtmUseDtm;
+bool  MtmQuorumCommit;
 bool  MtmUseRDMA;
 bool  MtmPreserveCommitOrder;
+bool  MtmTrackDependencies;
+bool  MtmParallelRecovery;
+bool  MtmOriginCommitOrder;
 bool  MtmVolksWagenMode; /* Pretend to be normal postgres. This means skip some NOTICE's and use local sequences */
 bool  MtmMajorNode;
 char* MtmRefereeConnStr;
+int   MtmRefereeLease;
+bool  MtmLogicalBootstrap;
+csn_t MtmReplicationBootstrapCsn; /* WAL sender: skip transactions visible in this snapshot of logical bootstrap */
+bool  MtmReplicationFingerprints; /* WAL sender: receiver accepts write-set fingerprints with PREPARE */
+bool  MtmReplicationCompression;
 
 static char* MtmConnStrs;
 static char* MtmRemoteFunctionsList;
@@ -270,10 +357,13 @@ static bool	 MtmIgnoreTablesWithoutPk;
 static int	 MtmLockCount;
 static bool	 MtmBreakConnection;
 static bool  MtmBypass;
+static bool  MtmLocalReads;
 static bool	 MtmClusterLocked;
 static bool	 MtmInsideTransaction;
 static bool  MtmReferee;
 static bool  MtmMonotonicSequences;
+static int   MtmMonotonicSequenceRange;
+static bool  MtmSnapshotPinned; /* current transaction has set its snapshot using mtm.set_snapshot() */
 static void const* MtmDDLStatement;
 
 static ExecutorStart_hook_type PreviousExecutorStartHook;
@@ -320,6 +410,8 @@ void MtmReleaseLocks(void)
  * locks[0] is used to synchronize access to multimaster state,
  * locks[1..N] are used to provide exclusive access to replication session for each node
  * locks[N+1..2*N] are used to synchronize access to distributed lock graph at each node
+ * locks[2*N+1..2*N+MTM_XID_PARTITIONS] are partition locks of xid2state hash
+ * locks[2*N+MTM_XID_PARTITIONS+1] protects sequence ranges hash
  * -------------------------------------------
  */
 
@@ -425,6 +517,36 @@ void MtmUnlockNode(int nodeId)
 	LWLockRelease((LWLockId)&Mtm->locks[nodeId]);
 }
 
+/*
+ * Xid2State hash is partitioned. Inserting or removing entries and initialization of new entries
+ * requires both exclusive MtmLock and exclusive lock of the xid partition.
+ * So entries can be found either under MtmLock, either under shared partition lock: the last one
+ * is used by hot read-only paths (visibility check and CSN lookup).
+ * Status and CSN of transaction are still updated only under MtmLock, so readers holding just partition lock
+ * should read status before CSN (with read barrier) and writers should assign CSN before status (with write barrier).
+ */
+static LWLockId MtmXidPartitionLock(uint32 hashcode)
+{
+	return (LWLockId)&Mtm->locks[1 + MtmMaxNodes*2 + hashcode % MTM_XID_PARTITIONS];
+}
+
+static LWLockId MtmSeqRangesLock(void)
+{
+	return (LWLockId)&Mtm->locks[1 + MtmMaxNodes*2 + MTM_XID_PARTITIONS];
+}
+
+static inline uint32 MtmXidHash(TransactionId xid)
+{
+	return hash_uint32(xid);
+}
+
+static LWLockId MtmLockXidPartition(TransactionId xid, LWLockMode mode)
+{
+	LWLockId lock = MtmXidPartitionLock(MtmXidHash(xid));
+	LWLockAcquire(lock, mode);
+	return lock;
+}
+
 /*
  * -------------------------------------------
  * System time manipulation functions
@@ -440,11 +562,11 @@ timestamp_t MtmGetSystemTime(void)
 }
 
 /*
- * Get adjusted system time: taking in account time shift
+ * Get current value of hybrid logical clock: system time, if no timestamps from the future were received
  */
 timestamp_t MtmGetCurrentTime(void)
 {
-	return MtmGetSystemTime() + Mtm->timeShift;
+	return HlcNow(&Mtm->clock);
 }
 
 void MtmSleep(timestamp_t interval)
@@ -466,25 +588,26 @@ void MtmSleep(timestamp_t interval)
  */
 csn_t MtmAssignCSN()
 {
-	csn_t csn = MtmGetCurrentTime();
-	if (csn <= Mtm->csn) {
-		csn = ++Mtm->csn;
-	} else {
-		Mtm->csn = csn;
-	}
-	return csn;
+	return HlcTick(&Mtm->clock);
 }
 
 /**
- * "Adjust" system clock if we receive message from future
+ * Merge timestamp received from other node into the local clock.
+ * It is not possible to refuse timestamp of already accepted transaction, so drift is not bounded here.
  */
 csn_t MtmSyncClock(csn_t global_csn)
 {
-	csn_t local_csn;
-	while ((local_csn = MtmAssignCSN()) < global_csn) {
-		Mtm->timeShift += global_csn - local_csn;
-	}
-	return local_csn;
+	return HlcUpdate(&Mtm->clock, global_csn, 0);
+}
+
+/**
+ * Merge snapshot of transaction started at other node into the local clock.
+ * Snapshot which is too far in the future is refused, so that the node with fast clock can not pull clocks
+ * of all other nodes forward. Returns false in this case.
+ */
+static bool MtmSyncClockBounded(csn_t global_csn)
+{
+	return HlcUpdate(&Mtm->clock, global_csn, MSEC_TO_USEC(MtmMaxClockSkew)) != 0;
 }
 
 /*
@@ -564,7 +687,7 @@ csn_t MtmDistributedTransactionSnapshot(TransactionId xid, int nodeId, nodemask_
 	*participantsMask = 0;
 	MtmLock(LW_SHARED);
 	if (Mtm->status == MTM_ONLINE) {
-		MtmTransState* ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+		MtmTransState* ts = MtmXidLookup(xid);
 		if (ts != NULL) {
 			*participantsMask = ts->participantsMask;
 			/* If node is disables, then we are in a process of recovery of this node */
@@ -581,10 +704,29 @@ csn_t MtmDistributedTransactionSnapshot(TransactionId xid, int nodeId, nodemask_
 	return snapshot;
 }
 
+/*
+ * Check if local transaction is still waiting for 2PC votes, i.e. its published write-set fingerprint is relevant
+ */
+bool MtmIsVotingTransaction(TransactionId xid)
+{
+	bool voting = false;
+	LWLockId lock = MtmLockXidPartition(xid, LW_SHARED);
+	MtmTransState* ts = MtmXidLookup(xid);
+	if (ts != NULL) {
+		voting = ts->gtid.node == MtmNodeId && !ts->votingCompleted && ts->status == TRANSACTION_STATUS_IN_PROGRESS;
+	}
+	LWLockRelease(lock);
+	return voting;
+}
+
 void MtmSetSnapshot(csn_t globalSnapshot)
 {
 	MtmLock(LW_EXCLUSIVE);
-	MtmSyncClock(globalSnapshot);
+	if (!MtmSyncClockBounded(globalSnapshot)) {
+		MtmUnlock();
+		MTM_ELOG(ERROR, "Snapshot %lld is ahead of local clock by more than multimaster.max_clock_skew=%d msec",
+				 (long64)globalSnapshot, MtmMaxClockSkew);
+	}
 	MtmTx.snapshot = globalSnapshot;
 	MtmUnlock();
 }
@@ -615,6 +757,82 @@ TransactionId MtmGetOldestXmin(Relation rel, bool ignoreVacuum)
 	return xmin;
 }
 
+/*
+ * Backend-local cache of MtmXidInMVCCSnapshot results for the current CSN snapshot.
+ * Once a transaction is committed or aborted its CSN and so its visibility in this snapshot can not change,
+ * so repeated checks of the same XID need not lock the MtmXid2State partition.
+ * The cache is an open-addressing table indexed by XID, which is cleared when MtmTx.snapshot changes or
+ * when it is three quarters full. Hit and miss counts are added to shared counters on every reset.
+ */
+#define MTM_VISIBILITY_CACHE_SIZE   1024
+#define MTM_VISIBILITY_CACHE_PROBES 8
+
+typedef struct
+{
+	TransactionId xid;  /* InvalidTransactionId for free slot */
+	bool invisible;     /* result of MtmXidInMVCCSnapshot */
+} MtmVisibilityCacheEntry;
+
+static MtmVisibilityCacheEntry MtmVisibilityCache[MTM_VISIBILITY_CACHE_SIZE];
+static csn_t  MtmVisibilityCacheSnapshot = INVALID_CSN;
+static int    MtmVisibilityCacheUsed;
+static uint64 MtmVisibilityCacheHits;
+static uint64 MtmVisibilityCacheMisses;
+
+static void MtmVisibilityCacheReset(csn_t snapshot)
+{
+	if (MtmVisibilityCacheHits + MtmVisibilityCacheMisses != 0) {
+		MtmPerfCount(&Mtm->nVisibilityCacheHits, MtmVisibilityCacheHits);
+		MtmPerfCount(&Mtm->nVisibilityCacheMisses, MtmVisibilityCacheMisses);
+		MtmVisibilityCacheHits = MtmVisibilityCacheMisses = 0;
+	}
+	if (MtmVisibilityCacheUsed != 0) {
+		memset(MtmVisibilityCache, 0, sizeof(MtmVisibilityCache));
+		MtmVisibilityCacheUsed = 0;
+	}
+	MtmVisibilityCacheSnapshot = snapshot;
+}
+
+static bool MtmVisibilityCacheLookup(TransactionId xid, bool* invisible)
+{
+	int i, slot;
+
+	if (MtmVisibilityCacheSnapshot != MtmTx.snapshot) {
+		MtmVisibilityCacheReset(MtmTx.snapshot);
+	}
+	for (i = 0, slot = xid % MTM_VISIBILITY_CACHE_SIZE;
+		 i < MTM_VISIBILITY_CACHE_PROBES && MtmVisibilityCache[slot].xid != InvalidTransactionId;
+		 i++, slot = (slot + 1) % MTM_VISIBILITY_CACHE_SIZE)
+	{
+		if (MtmVisibilityCache[slot].xid == xid) {
+			*invisible = MtmVisibilityCache[slot].invisible;
+			MtmVisibilityCacheHits += 1;
+			return true;
+		}
+	}
+	MtmVisibilityCacheMisses += 1;
+	return false;
+}
+
+static void MtmVisibilityCacheStore(TransactionId xid, bool invisible)
+{
+	int i, slot;
+
+	if (MtmVisibilityCacheUsed >= MTM_VISIBILITY_CACHE_SIZE*3/4) {
+		MtmVisibilityCacheReset(MtmVisibilityCacheSnapshot);
+	}
+	for (i = 0, slot = xid % MTM_VISIBILITY_CACHE_SIZE; i < MTM_VISIBILITY_CACHE_PROBES; i++, slot = (slot + 1) % MTM_VISIBILITY_CACHE_SIZE)
+	{
+		if (MtmVisibilityCache[slot].xid == InvalidTransactionId) {
+			MtmVisibilityCache[slot].xid = xid;
+			MtmVisibilityCache[slot].invisible = invisible;
+			MtmVisibilityCacheUsed += 1;
+			return;
+		}
+	}
+	/* probe sequence is full: the XID will be looked up in MtmXid2State next time */
+}
+
 bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
 #if TRACE_SLEEP_TIME
@@ -624,6 +842,9 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 	static timestamp_t maxSleepTime;
 #endif
 	timestamp_t delay = MIN_WAIT_TIMEOUT;
+	uint32 hashcode;
+	LWLockId lock;
+	bool invisible;
 	int i;
 #if DEBUG_LEVEL > 1
 	timestamp_t start = MtmGetSystemTime();
@@ -631,10 +852,19 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 
 	Assert(xid != InvalidTransactionId);
 
-	if (!MtmUseDtm || TransactionIdPrecedes(xid, Mtm->oldestXid)) {
+	/*
+	 * Local reads see transactions committed at this node before their snapshot was taken:
+	 * in-doubt transactions are still prepared here and so are just invisible.
+	 */
+	if (!MtmUseDtm || MtmTx.isLocalRead || TransactionIdPrecedes(xid, Mtm->oldestXid)) {
 		return PgXidInMVCCSnapshot(xid, snapshot);
 	}
-	MtmLock(LW_SHARED);
+	if (MtmVisibilityCacheLookup(xid, &invisible)) {
+		return invisible;
+	}
+	hashcode = MtmXidHash(xid);
+	lock = MtmXidPartitionLock(hashcode);
+	LWLockAcquire(lock, LW_SHARED);
 
 #if TRACE_SLEEP_TIME
 	if (firstReportTime == 0) {
@@ -644,31 +874,63 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 
 	for (i = 0; i < MAX_WAIT_LOOPS; i++)
 	{
-		MtmTransState* ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+		MtmTransState* ts = MtmXidLookupWithHash(xid, hashcode);
 		if (ts != NULL /*&& ts->status != TRANSACTION_STATUS_IN_PROGRESS*/)
 		{
-			if (ts->csn > MtmTx.snapshot) {
+			/* Status and CSN are updated without partition lock, so read status first */
+			XidStatus status = ts->status;
+			csn_t csn;
+			pg_read_barrier();
+			csn = ts->csn;
+			if (csn > MtmTx.snapshot) {
 				MTM_LOG4("%d: tuple with xid=%lld(csn=%lld) is invisible in snapshot %lld",
-						 MyProcPid, (long64)xid, ts->csn, MtmTx.snapshot);
+						 MyProcPid, (long64)xid, csn, MtmTx.snapshot);
 #if DEBUG_LEVEL > 1
 				if (MtmGetSystemTime() - start > USECS_PER_SEC) {
 					MTM_ELOG(WARNING, "Backend %d waits for transaction %s (%llu) status %lld usecs", MyProcPid, ts->gid, (long64)xid, MtmGetSystemTime() - start);
 				}
 #endif
-				MtmUnlock();
+				LWLockRelease(lock);
+				if (status == TRANSACTION_STATUS_COMMITTED || status == TRANSACTION_STATUS_ABORTED) {
+					/* CSN is assigned before final status, so it will not change any more */
+					MtmVisibilityCacheStore(xid, true);
+				}
 				return true;
 			}
-			if (ts->status == TRANSACTION_STATUS_UNKNOWN)
+			if (status == TRANSACTION_STATUS_UNKNOWN)
 			{
+				timestamp_t waitStart = MtmGetSystemTime();
+				MtmSampleState prevSampleState;
+				int rc;
 				MTM_LOG3("%d: wait for in-doubt transaction %u in snapshot %llu", MyProcPid, xid, MtmTx.snapshot);
-				MtmUnlock();
+				/*
+				 * Register in wait list and recheck status: MtmWakeUpSnapshotWaiters is called after status change,
+				 * so either we see new status, either it sees us. Timeout is used only as safety net.
+				 */
+				Mtm->snapshotWaitXids[MyProc->pgprocno] = xid;
+				pg_atomic_fetch_add_u32(&Mtm->nSnapshotWaiters, 1);
+				status = ts->status;
+				LWLockRelease(lock);
+				prevSampleState = MtmSamplerSetState(MTM_SAMPLE_VISIBILITY_WAIT);
+				rc = status == TRANSACTION_STATUS_UNKNOWN
+					? WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, USEC_TO_MSEC(delay))
+					: 0;
+				MtmSamplerSetState(prevSampleState);
+				pg_atomic_fetch_sub_u32(&Mtm->nSnapshotWaiters, 1);
+				Mtm->snapshotWaitXids[MyProc->pgprocno] = InvalidTransactionId;
+				if (rc & WL_POSTMASTER_DEATH) {
+					proc_exit(1);
+				}
+				if (rc & WL_LATCH_SET) {
+					ResetLatch(MyLatch);
+				}
+				pg_atomic_fetch_add_u64(&Mtm->nSnapshotWaits, 1);
+				pg_atomic_fetch_add_u64(&Mtm->snapshotWaitTime, MtmGetSystemTime() - waitStart);
+				MtmPerfRecord(MTM_PERF_VISIBILITY_WAIT, 0, MtmGetSystemTime() - waitStart);
 #if TRACE_SLEEP_TIME
 				{
-				timestamp_t delta, now = MtmGetCurrentTime();
-#endif
-				MtmSleep(delay);
-#if TRACE_SLEEP_TIME
-				delta = MtmGetCurrentTime() - now;
+				timestamp_t delta = MtmGetSystemTime() - waitStart;
+				timestamp_t now = MtmGetCurrentTime();
 				totalSleepTime += delta;
 				if (delta > maxSleepTime) {
 					maxSleepTime = delta;
@@ -683,34 +945,38 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 				}
 				}
 #endif
+				CHECK_FOR_INTERRUPTS();
 				if (delay*2 <= MAX_WAIT_TIMEOUT) {
 					delay *= 2;
 				}
-				MtmLock(LW_SHARED);
+				LWLockAcquire(lock, LW_SHARED);
 			}
 			else
 			{
-				bool invisible = ts->status != TRANSACTION_STATUS_COMMITTED;
+				invisible = status != TRANSACTION_STATUS_COMMITTED;
 				MTM_LOG4("%d: tuple with xid=%lld(csn= %lld) is %s in snapshot %lld",
-						 MyProcPid, (long64)xid, ts->csn, invisible ? "rollbacked" : "committed", MtmTx.snapshot);
-				MtmUnlock();
+						 MyProcPid, (long64)xid, csn, invisible ? "rollbacked" : "committed", MtmTx.snapshot);
+				LWLockRelease(lock);
 #if DEBUG_LEVEL > 1
 				if (MtmGetSystemTime() - start > USECS_PER_SEC) {
 					MTM_ELOG(WARNING, "Backend %d waits for %s transaction %s (%llu) %lld usecs", MyProcPid, invisible ? "rollbacked" : "committed",
 						 ts->gid, (long64)xid, MtmGetSystemTime() - start);
 				}
 #endif
+				if (status == TRANSACTION_STATUS_COMMITTED || status == TRANSACTION_STATUS_ABORTED) {
+					MtmVisibilityCacheStore(xid, invisible);
+				}
 				return invisible;
 			}
 		}
 		else
 		{
 			MTM_LOG4("%d: visibility check is skipped for transaction %llu in snapshot %llu", MyProcPid, (long64)xid, MtmTx.snapshot);
-			MtmUnlock();
+			LWLockRelease(lock);
 			return PgXidInMVCCSnapshot(xid, snapshot);
 		}
 	}
-	MtmUnlock();
+	LWLockRelease(lock);
 #if DEBUG_LEVEL > 1
 	MTM_ELOG(ERROR, "Failed to get status of XID %llu in %lld usec", (long64)xid, MtmGetSystemTime() - start);
 #else
@@ -719,6 +985,86 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 	return true;
 }
 
+/*
+ * Batch variant of MtmXidInMVCCSnapshot used by page-at-a-time heap scans.
+ * XIDs are grouped by partition of MtmXid2State, so that each partition lock is taken once per batch.
+ * In-doubt transactions are waited for one by one by MtmXidInMVCCSnapshot after the locks are released.
+ */
+static void MtmXidInMVCCSnapshotBatch(int nxids, TransactionId* xids, bool* inSnapshot, Snapshot snapshot)
+{
+	enum { XID_RESOLVED, XID_PENDING, XID_UNKNOWN, XID_IN_DOUBT };
+	uint32* hashcodes;
+	char* state;
+	int   i, partition;
+
+	if (!MtmUseDtm || MtmTx.isLocalRead) {
+		PgXidInMVCCSnapshotBatch(nxids, xids, inSnapshot, snapshot);
+		return;
+	}
+	hashcodes = (uint32*)palloc(nxids*sizeof(uint32));
+	state = (char*)palloc(nxids);
+
+	for (i = 0; i < nxids; i++) {
+		Assert(xids[i] != InvalidTransactionId);
+		state[i] = XID_RESOLVED;
+		if (TransactionIdPrecedes(xids[i], Mtm->oldestXid)) {
+			inSnapshot[i] = PgXidInMVCCSnapshot(xids[i], snapshot);
+		} else if (!MtmVisibilityCacheLookup(xids[i], &inSnapshot[i])) {
+			hashcodes[i] = MtmXidHash(xids[i]);
+			state[i] = XID_PENDING;
+		}
+	}
+	for (partition = 0; partition < MTM_XID_PARTITIONS; partition++) {
+		LWLockId lock = NULL;
+		for (i = 0; i < nxids; i++) {
+			MtmTransState* ts;
+			XidStatus status;
+			csn_t csn;
+
+			if (state[i] != XID_PENDING || hashcodes[i] % MTM_XID_PARTITIONS != partition) {
+				continue;
+			}
+			if (lock == NULL) {
+				lock = MtmXidPartitionLock(hashcodes[i]);
+				LWLockAcquire(lock, LW_SHARED);
+			}
+			ts = MtmXidLookupWithHash(xids[i], hashcodes[i]);
+			if (ts == NULL) {
+				state[i] = XID_UNKNOWN;
+				continue;
+			}
+			/* Same checks as in MtmXidInMVCCSnapshot: status is read before CSN */
+			status = ts->status;
+			pg_read_barrier();
+			csn = ts->csn;
+			if (csn > MtmTx.snapshot) {
+				inSnapshot[i] = true;
+			} else if (status != TRANSACTION_STATUS_UNKNOWN) {
+				inSnapshot[i] = status != TRANSACTION_STATUS_COMMITTED;
+			} else {
+				state[i] = XID_IN_DOUBT;
+				continue;
+			}
+			if (status == TRANSACTION_STATUS_COMMITTED || status == TRANSACTION_STATUS_ABORTED) {
+				MtmVisibilityCacheStore(xids[i], inSnapshot[i]);
+			}
+			state[i] = XID_RESOLVED;
+		}
+		if (lock != NULL) {
+			LWLockRelease(lock);
+		}
+	}
+	for (i = 0; i < nxids; i++) {
+		if (state[i] == XID_UNKNOWN) {
+			inSnapshot[i] = PgXidInMVCCSnapshot(xids[i], snapshot);
+		} else if (state[i] == XID_IN_DOUBT) {
+			inSnapshot[i] = MtmXidInMVCCSnapshot(xids[i], snapshot);
+		}
+	}
+	pfree(hashcodes);
+	pfree(state);
+}
+
 
 
 /*
@@ -732,7 +1078,9 @@ MtmAdjustOldestXid(TransactionId xid)
 	int i;
 	csn_t oldestSnapshot = INVALID_CSN;
 	MtmTransState *prev = NULL;
-	MtmTransState *ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+	MtmTransState *ts = MtmXidLookup(xid);
+	timestamp_t start = MtmGetSystemTime();
+	int nRemoved = 0;
 	MTM_LOG2("%d: MtmAdjustOldestXid(%d): snapshot=%lld, csn=%lld, status=%d", MyProcPid, xid, ts != NULL ? ts->snapshot : 0, ts != NULL ? ts->csn : 0, ts != NULL ? ts->status : -1);
 	Mtm->gcCount = 0;
 
@@ -751,6 +1099,10 @@ MtmAdjustOldestXid(TransactionId xid)
 				oldestSnapshot = Mtm->nodes[i].oldestSnapshot;
 			}
 		}
+		/* Keep transactions needed by snapshots set using mtm.set_snapshot() */
+		if (Mtm->nPinnedSnapshots != 0 && Mtm->pinnedSnapshot < oldestSnapshot) {
+			oldestSnapshot = Mtm->pinnedSnapshot;
+		}
 		if (oldestSnapshot > MtmVacuumDelay*USECS_PER_SEC) {
 			oldestSnapshot -= MtmVacuumDelay*USECS_PER_SEC;
 		} else {
@@ -762,16 +1114,24 @@ MtmAdjustOldestXid(TransactionId xid)
 				 && (ts->status == TRANSACTION_STATUS_ABORTED || ts->status == TRANSACTION_STATUS_COMMITTED)
 				 && ts->csn < oldestSnapshot
 				 && !ts->isPinned
-				 && TransactionIdPrecedes(ts->xid, xid);
+				 && TransactionIdPrecedes(ts->xid, xid)
+				 && nRemoved < MTM_GC_BATCH_SIZE;
 			 prev = ts, ts = ts->next)
 		{
 			Assert(!ts->isActive);
 			if (prev != NULL) {
 				/* Remove information about too old transactions */
-				hash_search(MtmXid2State, &prev->xid, HASH_REMOVE, NULL);
+				LWLockId lock = MtmLockXidPartition(prev->xid, LW_EXCLUSIVE);
+				MtmXidRemove(prev->xid);
+				LWLockRelease(lock);
 				hash_search(MtmGid2State, &prev->gid, HASH_REMOVE, NULL);
+				nRemoved += 1;
 			}
 		}
+		if (nRemoved == MTM_GC_BATCH_SIZE) {
+			/* Limit GC pause: continue cleanup at next transaction start */
+			Mtm->gcCount = MtmGcPeriod;
+		}
 		if (ts != NULL) {
 			MTM_LOG2("Adjust(%lld) stop at snashot %lld, xid %lld, pinned=%d, oldestSnaphsot=%lld\n",
 					 (long64)xid, ts->csn, (long64)ts->xid, ts->isPinned, oldestSnapshot);
@@ -800,6 +1160,16 @@ MtmAdjustOldestXid(TransactionId xid)
 		MtmCheckSlots();
 	}
 
+	if (nRemoved != 0) {
+		timestamp_t pause = MtmGetSystemTime() - start;
+		Mtm->gcRuns += 1;
+		Mtm->gcRemoved += nRemoved;
+		Mtm->gcTime += pause;
+		if (pause > Mtm->gcMaxPause) {
+			Mtm->gcMaxPause = pause;
+		}
+	}
+
 	return xid;
 }
 
@@ -843,28 +1213,52 @@ static void MtmAddSubtransactions(MtmTransState* ts, TransactionId* subxids, int
 	for (i = 0; i < nSubxids; i++) {
 		bool found;
 		MtmTransState* sts;
+		LWLockId lock;
 		Assert(TransactionIdIsValid(subxids[i]));
-		sts = (MtmTransState*)hash_search(MtmXid2State, &subxids[i], HASH_ENTER, &found);
+		lock = MtmLockXidPartition(subxids[i], LW_EXCLUSIVE);
+		sts = MtmXidEnter(subxids[i], &found);
 		Assert(!found);
 		sts->isActive = false;
 		sts->isPinned = false;
 		sts->status = ts->status;
 		sts->csn = ts->csn;
 		sts->votingCompleted = true;
+		LWLockRelease(lock);
 		MtmTransactionListInsertAfter(ts, sts);
 	}
 }
 
+/*
+ * Wakeup backends waiting in MtmXidInMVCCSnapshot for resolution of this transaction.
+ * Should be called after status of transaction is changed. Waiters register themselves and then recheck the status,
+ * so with full barriers at both sides either waiter sees new status, either we see the waiter.
+ */
+static void MtmWakeUpSnapshotWaiters(TransactionId xid)
+{
+	pg_memory_barrier();
+	if (pg_atomic_read_u32(&Mtm->nSnapshotWaiters) != 0) {
+		int i, n = ProcGlobal->allProcCount;
+		for (i = 0; i < n; i++) {
+			if (Mtm->snapshotWaitXids[i] == xid) {
+				SetLatch(&ProcGlobal->allProcs[i].procLatch);
+			}
+		}
+	}
+}
+
 void MtmAdjustSubtransactions(MtmTransState* ts)
 {
 	int i;
 	int nSubxids = ts->nSubxids;
 	MtmTransState* sts = ts;
 
+	MtmWakeUpSnapshotWaiters(ts->xid);
 	for (i = 0; i < nSubxids; i++) {
 		sts = sts->next;
-		sts->status = ts->status;
 		sts->csn = ts->csn;
+		pg_write_barrier();
+		sts->status = ts->status;
+		MtmWakeUpSnapshotWaiters(sts->xid);
 	}
 }
 
@@ -899,6 +1293,8 @@ MtmXactCallback(XactEvent event, void *arg)
 		MtmEndTransaction(&MtmTx, true);
 		break;
 	  case XACT_EVENT_ABORT:
+		/* Error could interrupt wait of the commit */
+		MtmSamplerSetState(MTM_SAMPLE_NONE);
 		MtmEndTransaction(&MtmTx, false);
 		break;
 	  case XACT_EVENT_COMMIT_COMMAND:
@@ -922,7 +1318,8 @@ MtmIsUserTransaction()
 		MtmDoReplication &&
 		!am_walsender &&
 		!MtmBackgroundWorker &&
-		!IsAutoVacuumWorkerProcess();
+		!IsAutoVacuumWorkerProcess() &&
+		!MtmIsBootstrapPending();
 }
 
 void
@@ -937,6 +1334,7 @@ MtmResetTransaction()
 	x->isSuspended = false;
 	x->isActive = false;
 	x->isTwoPhase = false;
+	x->isLocalRead = false;
 	x->csn = INVALID_CSN;
 	x->status = TRANSACTION_STATUS_UNKNOWN;
 	x->gid[0] = '\0';
@@ -959,10 +1357,54 @@ bool MtmTransIsActive(void)
 }
 
 
+/*
+ * Start read-only transaction with local snapshot (multimaster.local_reads).
+ * It gets no CSN and is not counted in Mtm->nRunningTransactions, so it doesn't take the multimaster lock at all,
+ * and visibility of tuples is decided by the ordinary PostgreSQL snapshot (see MtmXidInMVCCSnapshot).
+ * The transaction sees all transactions committed at this node, but not necessarily all transactions
+ * with smaller CSN committed at the other nodes, so it is not consistent with global snapshots.
+ */
+static void
+MtmBeginLocalRead(MtmCurrentTrans* x)
+{
+	if (Mtm->status != MTM_ONLINE && !MtmBypass) {
+		MTM_ELOG(MtmBreakConnection ? FATAL : ERROR, "Multimaster node is not online: current status %s", MtmNodeStatusMnem[Mtm->status]);
+	}
+	x->xid = InvalidTransactionId;
+	x->isReplicated = false;
+	x->isDistributed = false;
+	x->isPrepared = false;
+	x->isSuspended = false;
+	x->isTwoPhase = false;
+	x->isTransactionBlock = IsTransactionBlock();
+	x->isLocalRead = true;
+	x->containsDML = false;
+	x->containsLocalDML = false;
+	x->executedDML = false;
+	x->gtid.xid = InvalidTransactionId;
+	x->gid[0] = '\0';
+	x->status = TRANSACTION_STATUS_IN_PROGRESS;
+	MtmDDLStatement = NULL;
+	XactReadOnly = true;
+}
+
+/*
+ * Local read transaction can not write: its changes would be replicated without 2PC and global snapshot.
+ */
+static void
+MtmCheckLocalReadWrite(void)
+{
+	if (MtmTx.isLocalRead) {
+		MTM_ELOG(ERROR, "Cannot modify data in transaction started with multimaster.local_reads");
+	}
+}
+
 static void
 MtmBeginTransaction(MtmCurrentTrans* x)
 {
-	if (x->snapshot == INVALID_CSN) {
+	if (MtmLocalReads && !x->isLocalRead && x->snapshot == INVALID_CSN && MtmIsUserTransaction()) {
+		MtmBeginLocalRead(x);
+	} else if (x->snapshot == INVALID_CSN && !x->isLocalRead) {
 		TransactionId xmin = (Mtm->gcCount >= MtmGcPeriod) ? PgGetOldestXmin(NULL, false) : InvalidTransactionId; /* Get oldest xmin outside critical section */
 
 		Assert(!x->isActive);
@@ -989,6 +1431,8 @@ MtmBeginTransaction(MtmCurrentTrans* x)
 			MTM_ELOG(MtmBreakConnection ? FATAL : ERROR, "Multimaster node is not online: current status %s", MtmNodeStatusMnem[Mtm->status]);
 		}
 		x->containsDML = false;
+		x->containsLocalDML = false;
+		x->executedDML = false;
 		x->gtid.xid = InvalidTransactionId;
 		x->gid[0] = '\0';
 		x->status = TRANSACTION_STATUS_IN_PROGRESS;
@@ -1017,7 +1461,7 @@ MtmBeginTransaction(MtmCurrentTrans* x)
 		MTM_LOG3("%d: MtmLocalTransaction: %s transaction %u uses local snapshot %llu",
 				 MyProcPid, x->isDistributed ? "distributed" : "local", x->xid, x->snapshot);
 	} else {
-		Assert(MtmInsideTransaction);
+		Assert(MtmInsideTransaction || x->isLocalRead);
 	}
 }
 
@@ -1026,7 +1470,8 @@ static MtmTransState*
 MtmCreateTransState(MtmCurrentTrans* x)
 {
 	bool found;
-	MtmTransState* ts = (MtmTransState*)hash_search(MtmXid2State, &x->xid, HASH_ENTER, &found);
+	LWLockId lock = MtmLockXidPartition(x->xid, LW_EXCLUSIVE);
+	MtmTransState* ts = MtmXidEnter(x->xid, &found);
 	ts->status = TRANSACTION_STATUS_IN_PROGRESS;
 	ts->snapshot = x->snapshot;
 	ts->isLocal = true;
@@ -1048,6 +1493,7 @@ MtmCreateTransState(MtmCurrentTrans* x)
 		ts->gtid.node = MtmNodeId;
 	}
 	strcpy(ts->gid, x->gid);
+	LWLockRelease(lock);
 	x->isActive = true;
 	return ts;
 }
@@ -1230,6 +1676,26 @@ void MtmPrecommitTransaction(char const* gid)
 
 
 
+/*
+ * Check if coordinator of the transaction has collected enough votes to make the decision: votes of all live participants
+ * or, in quorum commit mode, PREPARED votes of the majority of nodes, counting the coordinator itself.
+ * Nodes outside of the quorum still apply the transaction, but their votes are not waited for.
+ */
+bool
+MtmVotesCollected(MtmTransState* ts)
+{
+	int nVoted;
+
+	if ((ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) { /* all live participants voted */
+		return true;
+	}
+	if (!MtmQuorumCommit || ts->status != TRANSACTION_STATUS_IN_PROGRESS) {
+		return false;
+	}
+	nVoted = Mtm->nAllNodes - countZeroBits(ts->votedMask & ts->participantsMask, Mtm->nAllNodes);
+	return nVoted + 1 > Mtm->nAllNodes/2;
+}
+
 static bool
 MtmVotingCompleted(MtmTransState* ts)
 {
@@ -1250,8 +1716,7 @@ MtmVotingCompleted(MtmTransState* ts)
 	if (ts->votingCompleted) {
 		return true;
 	}
-	if (ts->status == TRANSACTION_STATUS_IN_PROGRESS
-		&& (ts->participantsMask & ~Mtm->disabledNodeMask & ~ts->votedMask) == 0) /* all live participants voted */
+	if (ts->status == TRANSACTION_STATUS_IN_PROGRESS && MtmVotesCollected(ts))
 	{
 		if (ts->isPrepared) {
 			ts->csn = MtmAssignCSN();
@@ -1293,6 +1758,7 @@ Mtm2PCVoting(MtmCurrentTrans* x, MtmTransState* ts)
 	timestamp_t deadline = start + timeout;
 	timestamp_t now;
 	uint32 SaveCancelHoldoffCount = QueryCancelHoldoffCount;
+	MtmSampleState prevSampleState = MtmSamplerSetState(MTM_SAMPLE_CSN_WAIT);
 
 	Assert(ts->csn > ts->snapshot);
 
@@ -1327,6 +1793,8 @@ Mtm2PCVoting(MtmCurrentTrans* x, MtmTransState* ts)
 		}
 	}
 	QueryCancelHoldoffCount = SaveCancelHoldoffCount;
+	MtmPerfRecord(MTM_PERF_CSN_WAIT, 0, MtmGetSystemTime() - start);
+	MtmSamplerSetState(prevSampleState);
 
 	if (ts->status != TRANSACTION_STATUS_ABORTED && !ts->votingCompleted) {
 		if (ts->isPrepared) {
@@ -1372,7 +1840,7 @@ MtmPostPrepareTransaction(MtmCurrentTrans* x)
 		MTM_ELOG(ERROR, "ERROR INJECTION for transaction %s (%llu)", x->gid, (long64)x->xid);
 	}
 	MtmLock(LW_EXCLUSIVE);
-	ts = (MtmTransState*)hash_search(MtmXid2State, &x->xid, HASH_FIND, NULL);
+	ts = MtmXidLookup(x->xid);
 	Assert(ts != NULL);
 	if (!MtmIsCoordinator(ts) || Mtm->status == MTM_RECOVERY) {
 		MTM_LOG3("Preparing transaction %d (%s) at %lld", x->xid, x->gid, MtmGetCurrentTime());
@@ -1380,6 +1848,7 @@ MtmPostPrepareTransaction(MtmCurrentTrans* x)
 		ts->votingCompleted = true;
 		if (Mtm->status != MTM_RECOVERY/* || Mtm->recoverySlot != MtmReplicationNodeId*/) {
 			MtmSend2PCMessage(ts, MSG_PREPARED); /* send notification to coordinator */
+			MtmTraceRecord(x->gid, MTM_TRACE_REPLICA_PREPARED, 0, ts->csn);
 			if (!MtmUseDtm) {
 				ts->status = TRANSACTION_STATUS_UNKNOWN;
 			}
@@ -1389,8 +1858,12 @@ MtmPostPrepareTransaction(MtmCurrentTrans* x)
 		MtmUnlock();
 		MtmResetTransaction();
 	} else {
+		MtmTraceRecord(x->gid, MTM_TRACE_PREPARED, 0, ts->csn);
 		if (!ts->isLocal)  {
 			Mtm2PCVoting(x, ts);
+			if (x->status != TRANSACTION_STATUS_ABORTED) {
+				MtmTraceRecord(x->gid, MTM_TRACE_CSN, 0, ts->csn);
+			}
 		} else {
 			ts->status = TRANSACTION_STATUS_UNKNOWN;
 			ts->votingCompleted = true;
@@ -1501,6 +1974,27 @@ MtmLogAbortLogicalMessage(int nodeId, char const* gid)
 }
 
 
+/*
+ * Classify committed user transaction by the work needed to commit it.
+ * Only transactions which changed replicated relations are committed using 2PC,
+ * all other ones are committed locally without sending any messages to other nodes.
+ */
+static void
+MtmCountCommit(MtmCurrentTrans* x)
+{
+	pg_atomic_uint64* counter;
+	if (x->containsDML) {
+		counter = &Mtm->nTwoPhaseCommits;
+	} else if (x->containsLocalDML) {
+		counter = &Mtm->nLocalOnlyCommits;
+	} else if (x->executedDML) {
+		counter = &Mtm->nEmptyWriteCommits;
+	} else {
+		counter = &Mtm->nReadOnlyCommits;
+	}
+	MtmPerfCount(counter, 1);
+}
+
 static void
 MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 {
@@ -1510,14 +2004,32 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 
 	MTM_TXTRACE(x, "MtmEndTransaction Start (c=%d)", commit);
 
+	if (x->isLocalRead) {
+		/* Local read was not registered in the multimaster state */
+		Assert(!MtmInsideTransaction && !MtmClusterLocked);
+		MtmResetTransaction();
+		return;
+	}
+
+	if (commit && x->isDistributed && !x->isReplicated && !x->isTwoPhase) {
+		MtmCountCommit(x);
+	}
+
 	MtmLock(LW_EXCLUSIVE);
 
 	MtmStopTransaction();
 
+	if (MtmSnapshotPinned) {
+		if (--Mtm->nPinnedSnapshots == 0) {
+			Mtm->pinnedSnapshot = INVALID_CSN;
+		}
+		MtmSnapshotPinned = false;
+	}
+
 	if (x->isDistributed && (x->isPrepared || x->isReplicated) && !x->isTwoPhase) {
 		MtmTransState* ts = NULL;
 		if (x->isPrepared) {
-			ts = (MtmTransState*)hash_search(MtmXid2State, &x->xid, HASH_FIND, NULL);
+			ts = MtmXidLookup(x->xid);
 			Assert(ts != NULL);
 			Assert(strcmp(x->gid, ts->gid) == 0);
 		} else if (x->gid[0]) {
@@ -1550,6 +2062,7 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 					ts->csn = MtmAssignCSN();
 				}
 				Mtm->lastCsn = ts->csn;
+				pg_write_barrier(); /* CSN should be assigned before status: see MtmXidInMVCCSnapshot */
 				ts->status = TRANSACTION_STATUS_COMMITTED;
 				MtmAdjustSubtransactions(ts);
 			} else {
@@ -1570,8 +2083,10 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 					 MyProcPid, x->gid, (long64)x->gtid.xid, (long64)x->xid, x->gtid.node);
 			if (ts == NULL) {
 				bool found;
+				LWLockId lock;
 				Assert(TransactionIdIsValid(x->xid));
-				ts = (MtmTransState*)hash_search(MtmXid2State, &x->xid, HASH_ENTER, &found);
+				lock = MtmLockXidPartition(x->xid, LW_EXCLUSIVE);
+				ts = MtmXidEnter(x->xid, &found);
 				if (!found) {
 					ts->isEnqueued = false;
 					ts->isActive = false;
@@ -1587,6 +2102,7 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 				ts->nSubxids = 0;
 				ts->votingCompleted = true;
 				strcpy(ts->gid, x->gid);
+				LWLockRelease(lock);
 				MtmTransactionListAppend(ts);
 				if (*x->gid) {
 					replorigin_session_origin_lsn = INVALID_LSN;
@@ -1599,7 +2115,7 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 			MtmSend2PCMessage(ts, MSG_ABORTED); /* send notification to coordinator */
 #if 0
 		} else if (x->status == TRANSACTION_STATUS_ABORTED && x->isReplicated && !x->isPrepared) {
-			hash_search(MtmXid2State, &x->xid, HASH_REMOVE, NULL);
+			MtmXidRemove(x->xid);
 #endif
 		}
 		Assert(!x->isActive);
@@ -1629,26 +2145,30 @@ void MtmInitMessage(MtmArbiterMessage* msg, MtmMessageCode code)
 
 
 /*
- * Send arbiter's message
+ * Put arbiter's messages in the send queue
  */
-void MtmSendMessage(MtmArbiterMessage* msg)
+static void MtmSendMessages(MtmArbiterMessage* msgs, int nMessages)
 {
+	int i;
+
 	SpinLockAcquire(&Mtm->queueSpinlock);
 	{
-		MtmMessageQueue* mq = Mtm->freeQueue;
 		MtmMessageQueue* sendQueue = Mtm->sendQueue;
-		if (mq == NULL) {
-			mq = (MtmMessageQueue*)ShmemAlloc(sizeof(MtmMessageQueue));
+		for (i = 0; i < nMessages; i++) {
+			MtmMessageQueue* mq = Mtm->freeQueue;
 			if (mq == NULL) {
-				elog(PANIC, "Failed to allocate shared memory for message queue");
+				mq = (MtmMessageQueue*)ShmemAlloc(sizeof(MtmMessageQueue));
+				if (mq == NULL) {
+					elog(PANIC, "Failed to allocate shared memory for message queue");
+				}
+			} else {
+				Mtm->freeQueue = mq->next;
 			}
-		} else {
-			Mtm->freeQueue = mq->next;
+			mq->msg = msgs[i];
+			mq->next = Mtm->sendQueue;
+			Mtm->sendQueue = mq;
 		}
-		mq->msg = *msg;
-		mq->next = sendQueue;
-		Mtm->sendQueue = mq;
-		if (sendQueue == NULL) {
+		if (sendQueue == NULL && nMessages != 0) {
 			/* signal semaphore only once for the whole list */
 			PGSemaphoreUnlock(&Mtm->sendSemaphore);
 		}
@@ -1656,6 +2176,34 @@ void MtmSendMessage(MtmArbiterMessage* msg)
 	SpinLockRelease(&Mtm->queueSpinlock);
 }
 
+/*
+ * Send arbiter's message
+ */
+void MtmSendMessage(MtmArbiterMessage* msg)
+{
+	MtmSendMessages(msg, 1);
+}
+
+/*
+ * Add message to the batch, sending the batch if it is full
+ */
+void MtmBatchMessage(MtmMessageBatch* batch, MtmArbiterMessage* msg)
+{
+	if (batch->nMessages == MTM_MESSAGE_BATCH_SIZE) {
+		MtmSendMessageBatch(batch);
+	}
+	batch->messages[batch->nMessages++] = *msg;
+}
+
+/*
+ * Send all messages of the batch with single wakeup of arbiter sender
+ */
+void MtmSendMessageBatch(MtmMessageBatch* batch)
+{
+	MtmSendMessages(batch->messages, batch->nMessages);
+	batch->nMessages = 0;
+}
+
 /*
  * Send arbiter's 2PC message. Right now only responses to coordinates are
  * sent through arbiter. Broadcasts from coordinator to noes are done
@@ -1683,8 +2231,10 @@ void MtmSend2PCMessage(MtmTransState* ts, MtmMessageCode cmd)
  * Broadcast poll state message to all nodes.
  * This function is used to gather information about state of prepared transaction
  * at node startup or after crash of some node.
+ * Messages are added to the batch, so that requests for all in-doubt transactions are
+ * sent to each node together: caller should send the batch.
  */
-static void MtmBroadcastPollMessage(MtmTransState* ts)
+static void MtmBroadcastPollMessage(MtmTransState* ts, MtmMessageBatch* batch)
 {
 	int i;
 	int nparts;
@@ -1696,7 +2246,7 @@ static void MtmBroadcastPollMessage(MtmTransState* ts)
 	if (nparts == 1)
 	{
 		/* we were in major mode and there nobody to ask about status */
-		MtmFinishPreparedTransaction(ts, true);
+		MtmResolvePreparedTransaction(ts, true, true);
 		return;
 	}
 
@@ -1710,7 +2260,7 @@ static void MtmBroadcastPollMessage(MtmTransState* ts)
 		{
 			msg.node = i+1;
 			MTM_LOG3("Send request for transaction %s to node %d", msg.gid, msg.node);
-			MtmSendMessage(&msg);
+			MtmBatchMessage(batch, &msg);
 		}
 	}
 }
@@ -1725,6 +2275,9 @@ static void	MtmLoadPreparedTransactions(void)
 	PreparedTransaction pxacts;
 	int n = GetPreparedTransactions(&pxacts);
 	int i;
+	MtmMessageBatch batch;
+
+	batch.nMessages = 0;
 
 	for (i = 0; i < n; i++) {
 		bool found;
@@ -1732,7 +2285,8 @@ static void	MtmLoadPreparedTransactions(void)
 		MtmTransMap* tm = (MtmTransMap*)hash_search(MtmGid2State, gid, HASH_ENTER, &found);
 		if (!found || tm->state == NULL) {
 			TransactionId xid = GetNewTransactionId(false);
-			MtmTransState* ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_ENTER, &found);
+			LWLockId lock = MtmLockXidPartition(xid, LW_EXCLUSIVE);
+			MtmTransState* ts = MtmXidEnter(xid, &found);
 			MTM_LOG1("Recover prepared transaction %s (%llu) state=%s", gid, (long64)xid, pxacts[i].state_3pc);
 			MyPgXact->xid = InvalidTransactionId; /* dirty hack:((( */
 			Assert(!found);
@@ -1754,12 +2308,14 @@ static void	MtmLoadPreparedTransactions(void)
 			ts->nConfigChanges = Mtm->nConfigChanges;
 			ts->votedMask = 0;
 			strcpy(ts->gid, gid);
+			LWLockRelease(lock);
 			MtmTransactionListAppend(ts);
 			tm->status = ts->status;
 			tm->state = ts;
-			MtmBroadcastPollMessage(ts);
+			MtmBroadcastPollMessage(ts, &batch);
 		}
 	}
+	MtmSendMessageBatch(&batch);
 	MTM_LOG1("Recover %d prepared transactions", n);
 	if (pxacts) {
 		pfree(pxacts);
@@ -1807,7 +2363,11 @@ void MtmJoinTransaction(GlobalTransactionId* gtid, csn_t globalSnapshot, nodemas
 				 (long64)gtid->xid, gtid->node, liveMask, participantsMask);
 		}
 
-		MtmSyncClock(globalSnapshot);
+		if (!MtmSyncClockBounded(globalSnapshot)) {
+			MtmUnlock();
+			MTM_ELOG(ERROR, "Ignore transaction %llu from node %d because its snapshot is ahead of local clock by more than multimaster.max_clock_skew=%d msec",
+				 (long64)gtid->xid, gtid->node, MtmMaxClockSkew);
+		}
 		MtmTx.snapshot = globalSnapshot;
 		if (Mtm->status != MTM_RECOVERY) {
 			MtmTransState* ts = MtmCreateTransState(&MtmTx); /* we need local->remote xid mapping for deadlock detection */
@@ -1899,13 +2459,41 @@ csn_t MtmGetTransactionCSN(TransactionId xid)
 {
 	MtmTransState* ts;
 	csn_t csn;
-	MtmLock(LW_SHARED);
-	ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+	LWLockId lock = MtmLockXidPartition(xid, LW_SHARED);
+	ts = MtmXidLookup(xid);
 	csn = ts ? ts->csn : INVALID_CSN;
-	MtmUnlock();
+	LWLockRelease(lock);
 	return csn;
 }
 
+/*
+ * Check if distributed transaction is committed and its changes are visible in the specified snapshot.
+ * State of committed transaction can be missing only if it was removed by GC, which keeps transactions
+ * not visible in the snapshot pinned by mtm.set_snapshot() or younger than multimaster.vacuum_delay.
+ */
+bool MtmIsCommittedInSnapshot(TransactionId xid, csn_t snapshot)
+{
+	MtmTransState* ts;
+	bool visible;
+	LWLockId lock = MtmLockXidPartition(xid, LW_SHARED);
+	ts = MtmXidLookup(xid);
+	if (ts != NULL) {
+		visible = ts->status == TRANSACTION_STATUS_COMMITTED && ts->csn <= snapshot;
+	} else {
+		visible = TransactionIdDidCommit(xid);
+	}
+	LWLockRelease(lock);
+	return visible;
+}
+
+/*
+ * Node is started with multimaster.logical_bootstrap but mtm.bootstrap_node() is not yet completed
+ */
+bool MtmIsBootstrapPending(void)
+{
+	return MtmLogicalBootstrap && Mtm->bootstrapCsn == INVALID_CSN;
+}
+
 /*
  * Wakeup coordinator's backend when voting is completed
  */
@@ -1980,6 +2568,9 @@ void MtmHandleApplyError(void)
 void MtmPollStatusOfPreparedTransactionsForDisabledNode(int disabledNodeId, bool commitPrecommited)
 {
 	MtmTransState *ts;
+	MtmMessageBatch batch;
+
+	batch.nMessages = 0;
 	for (ts = Mtm->transListHead; ts != NULL; ts = ts->next) {
 		if (TransactionIdIsValid(ts->gtid.xid)
 			&& ts->gtid.node == disabledNodeId
@@ -1990,17 +2581,17 @@ void MtmPollStatusOfPreparedTransactionsForDisabledNode(int disabledNodeId, bool
 			if (ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
 				MTM_ELOG(LOG, "Abort transaction %s because its coordinator is disabled and it is not prepared at node %d", ts->gid, MtmNodeId);
 				TXFINISH("%s ABORT, PollStatusOfPrepared", ts->gid);
-				MtmFinishPreparedTransaction(ts, false);
+				MtmResolvePreparedTransaction(ts, false, true);
 			} else {
 				if (commitPrecommited)
 				{
 					TXFINISH("%s COMMIT, PollStatusOfPrepared", ts->gid);
-					MtmFinishPreparedTransaction(ts, true);
+					MtmResolvePreparedTransaction(ts, true, true);
 				}
 				else
 				{
 					MTM_LOG1("Poll state of transaction %s (%llu)", ts->gid, (long64)ts->xid);
-					MtmBroadcastPollMessage(ts);
+					MtmBroadcastPollMessage(ts, &batch);
 				}
 			}
 		} else {
@@ -2008,6 +2599,7 @@ void MtmPollStatusOfPreparedTransactionsForDisabledNode(int disabledNodeId, bool
 					 ts->gid, (long64)ts->xid, MtmTxnStatusMnem[ts->status], ts->gtid.node, (long64)ts->gtid.xid, ts->votedMask);
 		}
 	}
+	MtmSendMessageBatch(&batch);
 }
 
 /*
@@ -2018,6 +2610,9 @@ void MtmPollStatusOfPreparedTransactionsForDisabledNode(int disabledNodeId, bool
 static void MtmPollStatusOfPreparedTransactions()
 {
 	MtmTransState *ts;
+	MtmMessageBatch batch;
+
+	batch.nMessages = 0;
 	for (ts = Mtm->transListHead; ts != NULL; ts = ts->next) {
 		if (TransactionIdIsValid(ts->gtid.xid)
 			&& ts->votingCompleted /* If voting is not yet completed, then there is some backend coordinating this transaction */
@@ -2025,12 +2620,13 @@ static void MtmPollStatusOfPreparedTransactions()
 		{
 			Assert(ts->gid[0]);
 			MTM_LOG1("Poll state of transaction %s (%llu) from node %d", ts->gid, (long64)ts->xid, ts->gtid.node);
-			MtmBroadcastPollMessage(ts);
+			MtmBroadcastPollMessage(ts, &batch);
 		} else {
 			MTM_LOG2("Skip prepared transaction %s (%d) with status %s gtid.node=%d gtid.xid=%llu votedMask=%llx",
 					 ts->gid, (long64)ts->xid, MtmTxnStatusMnem[ts->status], ts->gtid.node, (long64)ts->gtid.xid, ts->votedMask);
 		}
 	}
+	MtmSendMessageBatch(&batch);
 }
 
 
@@ -2249,51 +2845,159 @@ int MtmGetNumberOfVotingNodes()
  * Size of this hash table should be limited by MtmAdjustOldestXid function which performs cleanup
  * of transaction list and from the list and from the hash table transactions which XIDs are not used in any snapshot at any node
  */
-static HTAB*
-MtmCreateXidMap(void)
+static Size
+MtmTransStateSize(void)
 {
-	HASHCTL info;
-	HTAB* htab;
 	Assert(MtmMaxNodes > 0);
-	memset(&info, 0, sizeof(info));
-	info.keysize = sizeof(TransactionId);
-	info.entrysize = sizeof(MtmTransState) + (MtmMaxNodes-1)*sizeof(TransactionId);
-	htab = ShmemInitHash(
-		"MtmXid2State",
-		MTM_HASH_SIZE, MTM_HASH_SIZE,
-		&info,
-		HASH_ELEM | HASH_BLOBS
-	);
-	return htab;
+	return MAXALIGN(sizeof(MtmTransState) + (MtmMaxNodes-1)*sizeof(TransactionId));
 }
 
-/*
- * Initialize Gid2State hash table to obtain status of transaction by GID.
- * Size of this hash table should be limited by MtmAdjustOldestXid function which performs cleanup
- * of transaction list and from the list and from the hash table transactions which XIDs are not used in any snapshot at any node
- */
-static HTAB*
-MtmCreateGidMap(void)
+static Size
+MtmXidMapShmemSize(void)
 {
-	HASHCTL info;
-	HTAB* htab;
-	memset(&info, 0, sizeof(info));
-	info.keysize = MULTIMASTER_MAX_GID_SIZE;
-	info.entrysize = sizeof(MtmTransMap);
-	htab = ShmemInitHash(
-		"MtmGid2State",
-		MTM_MAP_SIZE, MTM_MAP_SIZE,
-		&info,
-		HASH_ELEM
-	);
-	return htab;
+	return add_size(offsetof(MtmXidMap, slots), mul_size(MtmTransStateSize(), MTM_TRANS_POOL_SIZE));
 }
 
-/*
- * Initialize hash table used to mark local (not distributed) tables
- */
-static HTAB*
-MtmCreateLocalTableMap(void)
+static MtmXidMap*
+MtmCreateXidMap(void)
+{
+	bool found;
+	MtmXidMap* map = (MtmXidMap*)ShmemInitStruct("MtmXid2State", MtmXidMapShmemSize(), &found);
+	if (!found) {
+		int i;
+		for (i = 0; i < MTM_XID_BUCKETS; i++) {
+			map->buckets[i] = MTM_NO_SLOT;
+		}
+		for (i = 0; i < MTM_TRANS_POOL_SIZE; i++) {
+			map->next[i] = MTM_NO_SLOT;
+			map->nextFree[i] = i + 1 < MTM_TRANS_POOL_SIZE ? i + 1 : MTM_NO_SLOT;
+		}
+		pg_atomic_init_u64(&map->freeHead, 0);
+		pg_atomic_init_u32(&map->nUsed, 0);
+	}
+	return map;
+}
+
+static inline MtmTransState* MtmTransStateSlot(uint32 slot)
+{
+	return (MtmTransState*)(MtmXid2State->slots + (Size)slot*MtmTransStateSize());
+}
+
+static uint32 MtmAllocTransStateSlot(void)
+{
+	uint64 head = pg_atomic_read_u64(&MtmXid2State->freeHead);
+	uint32 slot;
+	do {
+		slot = (uint32)head;
+		if (slot == MTM_NO_SLOT) {
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 MTM_ERRMSG("too many multimaster transaction states: %u", MTM_TRANS_POOL_SIZE),
+					 errhint("Long running transactions or unavailable nodes may prevent cleanup of transaction states.")));
+		}
+	} while (!pg_atomic_compare_exchange_u64(&MtmXid2State->freeHead, &head,
+											 (((head >> 32) + 1) << 32) | MtmXid2State->nextFree[slot]));
+	pg_atomic_fetch_add_u32(&MtmXid2State->nUsed, 1);
+	return slot;
+}
+
+static void MtmFreeTransStateSlot(uint32 slot)
+{
+	uint64 head = pg_atomic_read_u64(&MtmXid2State->freeHead);
+	do {
+		MtmXid2State->nextFree[slot] = (uint32)head;
+	} while (!pg_atomic_compare_exchange_u64(&MtmXid2State->freeHead, &head, (((head >> 32) + 1) << 32) | slot));
+	pg_atomic_fetch_sub_u32(&MtmXid2State->nUsed, 1);
+}
+
+static MtmTransState* MtmXidLookupWithHash(TransactionId xid, uint32 hashcode)
+{
+	uint32 slot;
+	for (slot = MtmXid2State->buckets[hashcode & (MTM_XID_BUCKETS-1)]; slot != MTM_NO_SLOT; slot = MtmXid2State->next[slot]) {
+		MtmTransState* ts = MtmTransStateSlot(slot);
+		if (ts->xid == xid) {
+			return ts;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find state of transaction. Caller should hold lock of XID partition or MtmLock protecting state from GC.
+ */
+MtmTransState* MtmXidLookup(TransactionId xid)
+{
+	return MtmXidLookupWithHash(xid, MtmXidHash(xid));
+}
+
+/*
+ * Find or create state of transaction. Caller should hold exclusive lock of XID partition.
+ */
+static MtmTransState* MtmXidEnter(TransactionId xid, bool* found)
+{
+	uint32 hashcode = MtmXidHash(xid);
+	uint32* bucket = &MtmXid2State->buckets[hashcode & (MTM_XID_BUCKETS-1)];
+	MtmTransState* ts = MtmXidLookupWithHash(xid, hashcode);
+	uint32 slot;
+
+	*found = ts != NULL;
+	if (ts == NULL) {
+		slot = MtmAllocTransStateSlot();
+		ts = MtmTransStateSlot(slot);
+		ts->xid = xid;
+		ts->isResolving = false;
+		MtmXid2State->next[slot] = *bucket;
+		pg_write_barrier();
+		*bucket = slot;
+	}
+	return ts;
+}
+
+/*
+ * Remove state of transaction. Caller should hold exclusive lock of XID partition.
+ */
+static void MtmXidRemove(TransactionId xid)
+{
+	uint32* link = &MtmXid2State->buckets[MtmXidHash(xid) & (MTM_XID_BUCKETS-1)];
+	uint32 slot;
+	for (slot = *link; slot != MTM_NO_SLOT; link = &MtmXid2State->next[slot], slot = *link) {
+		MtmTransState* ts = MtmTransStateSlot(slot);
+		if (ts->xid == xid) {
+			*link = MtmXid2State->next[slot];
+			ts->xid = InvalidTransactionId;
+			MtmFreeTransStateSlot(slot);
+			return;
+		}
+	}
+}
+
+/*
+ * Initialize Gid2State hash table to obtain status of transaction by GID.
+ * Size of this hash table should be limited by MtmAdjustOldestXid function which performs cleanup
+ * of transaction list and from the list and from the hash table transactions which XIDs are not used in any snapshot at any node
+ */
+static HTAB*
+MtmCreateGidMap(void)
+{
+	HASHCTL info;
+	HTAB* htab;
+	memset(&info, 0, sizeof(info));
+	info.keysize = MULTIMASTER_MAX_GID_SIZE;
+	info.entrysize = sizeof(MtmTransMap);
+	htab = ShmemInitHash(
+		"MtmGid2State",
+		MTM_MAP_SIZE, MTM_MAP_SIZE,
+		&info,
+		HASH_ELEM
+	);
+	return htab;
+}
+
+/*
+ * Initialize hash table used to mark local (not distributed) tables
+ */
+static HTAB*
+MtmCreateLocalTableMap(void)
 {
 	HASHCTL info;
 	HTAB* htab;
@@ -2308,6 +3012,46 @@ MtmCreateLocalTableMap(void)
 	return htab;
 }
 
+/*
+ * Initialize hash table of sequence ranges claimed by this node
+ */
+static HTAB*
+MtmCreateSeqRangeMap(void)
+{
+	HASHCTL info;
+	HTAB* htab;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(MtmSeqRange);
+	htab = ShmemInitHash(
+		"MtmSeqRanges",
+		MULTIMASTER_MAX_SEQUENCES, MULTIMASTER_MAX_SEQUENCES,
+		&info,
+		HASH_ELEM | HASH_BLOBS
+	);
+	return htab;
+}
+
+/*
+ * Check if relation is excluded from replication
+ */
+static bool MtmIsLocalRelation(Oid relid)
+{
+	bool isLocal;
+	MtmLock(LW_SHARED);
+	if (!Mtm->localTablesHashLoaded) {
+		MtmUnlock();
+		MtmLock(LW_EXCLUSIVE);
+		if (!Mtm->localTablesHashLoaded) {
+			MtmLoadLocalTables();
+			Mtm->localTablesHashLoaded = true;
+		}
+	}
+	isLocal = hash_search(MtmLocalTables, &relid, HASH_FIND, NULL) != NULL;
+	MtmUnlock();
+	return isLocal;
+}
+
 static void MtmMakeRelationLocal(Oid relid)
 {
 	if (OidIsValid(relid)) {
@@ -2414,7 +3158,9 @@ static void MtmInitialize()
 		Mtm->status = MTM_DISABLED; //MTM_INITIALIZATION;
 		Mtm->recoverySlot = 0;
 		Mtm->locks = GetNamedLWLockTranche(MULTIMASTER_NAME);
-		Mtm->csn = MtmGetCurrentTime();
+		HlcInit(&Mtm->clock);
+		Mtm->lockGraphVersion = 0;
+		Mtm->lockGraphResync = false;
 		Mtm->lastCsn = INVALID_CSN;
 		Mtm->oldestXid = FirstNormalTransactionId;
 		Mtm->nLiveNodes = 0; //MtmNodes;
@@ -2436,13 +3182,29 @@ static void MtmInitialize()
 		Mtm->recoveredLSN = INVALID_LSN;
 		Mtm->nActiveTransactions = 0;
 		Mtm->nRunningTransactions = 0;
+		Mtm->bootstrapCoordinator = 0;
+		Mtm->pinnedSnapshot = INVALID_CSN;
+		Mtm->nPinnedSnapshots = 0;
+		Mtm->snapshotWaitXids = (TransactionId*)ShmemAlloc(sizeof(TransactionId)*ProcGlobal->allProcCount);
+		MemSet(Mtm->snapshotWaitXids, 0, sizeof(TransactionId)*ProcGlobal->allProcCount);
+		pg_atomic_init_u32(&Mtm->nSnapshotWaiters, 0);
+		pg_atomic_init_u64(&Mtm->nSnapshotWaits, 0);
+		pg_atomic_init_u64(&Mtm->snapshotWaitTime, 0);
+		pg_atomic_init_u64(&Mtm->nReadOnlyCommits, 0);
+		pg_atomic_init_u64(&Mtm->nEmptyWriteCommits, 0);
+		pg_atomic_init_u64(&Mtm->nLocalOnlyCommits, 0);
+		pg_atomic_init_u64(&Mtm->nTwoPhaseCommits, 0);
+		pg_atomic_init_u64(&Mtm->nVisibilityCacheHits, 0);
+		pg_atomic_init_u64(&Mtm->nVisibilityCacheMisses, 0);
+		pg_atomic_init_u32(&Mtm->bootstrapNextRel, 0);
+		pg_atomic_init_u32(&Mtm->bootstrapCopiedRels, 0);
+		pg_atomic_init_u64(&Mtm->groupCommitDeadline, 0);
 		Mtm->votingTransactions = NULL;
 		Mtm->transListHead = NULL;
 		Mtm->transListTail = &Mtm->transListHead;
 		Mtm->activeTransList.next = Mtm->activeTransList.prev = &Mtm->activeTransList;
 		Mtm->nReceivers = 0;
 		Mtm->nSenders = 0;
-		Mtm->timeShift = 0;
 		Mtm->transCount = 0;
 		Mtm->gcCount = 0;
 		Mtm->nConfigChanges = 0;
@@ -2457,6 +3219,7 @@ static void MtmInitialize()
 			Mtm->nodes[i].disabledNodeMask = 0;
 			Mtm->nodes[i].connectivityMask = (((nodemask_t)1 << MtmNodes) - 1);
 			Mtm->nodes[i].lockGraphUsed = 0;
+			Mtm->nodes[i].lockGraphVersion = 0;
 			Mtm->nodes[i].lockGraphAllocated = 0;
 			Mtm->nodes[i].lockGraphData = NULL;
 			Mtm->nodes[i].transDelay = 0;
@@ -2485,11 +3248,20 @@ static void MtmInitialize()
 	MtmXid2State = MtmCreateXidMap();
 	MtmGid2State = MtmCreateGidMap();
 	MtmLocalTables = MtmCreateLocalTableMap();
+	MtmSeqRanges = MtmCreateSeqRangeMap();
+	MtmWriteSetInitialize();
+	pglogical_shared_relid_map_init();
+	MtmFingerprintInitialize();
+	MtmHintInitialize();
+	MtmPerfInitialize();
+	MtmSamplerInitialize();
+	MtmTraceInitialize();
 	MtmDoReplication = true;
 	TM = &MtmTM;
 	LWLockRelease(AddinShmemInitLock);
 
 	MtmCheckControlFile();
+	Mtm->bootstrapCsn = MtmLoadBootstrapCsn();
 }
 
 static void
@@ -2829,6 +3601,51 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.arbiter_coalesce_delay",
+		"Delay in microseconds of sending arbiter messages",
+		"Arbiter sender waits this time after wakeup to accumulate more messages for the same destination and send them in one batch",
+		&MtmArbiterCoalesceDelay,
+		0,
+		0,
+		USECS_PER_SEC,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.arbiter_busy_poll",
+		"Time in microseconds the kernel busy polls device queue of arbiter sockets",
+		"Reduces latency of 2PC votes at the cost of CPU. Zero disables busy polling. Not supported with RDMA sockets",
+		&MtmArbiterBusyPoll,
+		0,
+		0,
+		USECS_PER_SEC,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.max_clock_skew",
+		"Maximal allowed advance (msec) of snapshot of remote transaction over local clock",
+		"Transactions started at node which clock runs ahead by more than this amount are refused. Zero disables the check",
+		&MtmMaxClockSkew,
+		0,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.heartbeat_recv_timeout",
 		"Timeout in milliseconds of receiving heartbeat messages",
@@ -2887,6 +3704,48 @@ _PG_init(void)
 		NULL,
 		NULL
 	);
+	DefineCustomIntVariable(
+		"multimaster.stream_threshold",
+		"Number of changes after which in-progress transaction is streamed to other nodes",
+		"Zero disables streaming: transactions are sent to other nodes only after they are prepared",
+		&MtmStreamThreshold,
+		0,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+	DefineCustomIntVariable(
+		"multimaster.receive_buffer_size",
+		"Maximal amount of data receiver reads from the socket ahead while the apply queue is full",
+		"Zero disables reading ahead: receiver stops reading the socket until there is free space in the queue",
+		&MtmReceiveBufferSize,
+		16 * 1024, /* 16Mb */
+		0,
+		MaxAllocSize/GUC_UNIT_KB,
+		PGC_SIGHUP,
+		GUC_UNIT_KB,
+		NULL,
+		NULL,
+		NULL
+	);
+	DefineCustomIntVariable(
+		"multimaster.priority_work_size",
+		"Maximal size of replicated transaction which is placed in the priority lane of apply workers queue",
+		"Small transactions and commits of prepared transactions do not wait behind large transactions in the bulk lane. Zero disables the priority lane",
+		&MtmPriorityWorkSize,
+		8, /* 8kb */
+		0,
+		MaxAllocSize/GUC_UNIT_KB,
+		PGC_SIGHUP,
+		GUC_UNIT_KB,
+		NULL,
+		NULL,
+		NULL
+	);
 
 	DefineCustomIntVariable(
 		"multimaster.node_disable_delay",
@@ -2961,6 +3820,20 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomBoolVariable(
+		"multimaster.local_reads",
+		"Run transactions as read-only with local snapshot",
+		"Such transactions see data committed at this node, never wait for in-doubt transactions "
+		"and do not get global snapshot, so they are not consistent with transactions at other nodes",
+		&MtmLocalReads,
+		false,
+		PGC_USERSET,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomBoolVariable(
 		"multimaster.major_node",
 		"Node which forms a majority in case of partitioning in cliques with equal number of nodes",
@@ -2987,6 +3860,22 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.monotonic_sequence_range",
+		"Number of sequence values claimed by one announcement of monotonic sequence",
+		"When multimaster.monotonic_sequences is on, node claims ranges of this many sequence values "
+		"and notifies other nodes only about the end of each range",
+		&MtmMonotonicSequenceRange,
+		100,
+		1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomBoolVariable(
 		"multimaster.ignore_tables_without_pk",
 		"Do not replicate tables without primary key",
@@ -3013,6 +3902,19 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomBoolVariable(
+		"multimaster.quorum_commit",
+		"Commit distributed transaction once it is prepared by the majority of nodes",
+		"Votes of the remaining nodes are not waited for, although they still have to apply the transaction",
+		&MtmQuorumCommit,
+		false,
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomBoolVariable(
 		"multimaster.referee",
 		"This instance of Postgres contains no data and peforms role of referee for other nodes",
@@ -3039,6 +3941,133 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.referee_lease",
+		"Time (msec) during which decision of referee is kept after all nodes are enabled",
+		"If only half of nodes becomes visible again within this time, the previous winner is used without request to referee.",
+		&MtmRefereeLease,
+		0,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.logical_bootstrap",
+		"Populate this node using mtm.bootstrap_node() instead of pg_basebackup",
+		"Until bootstrap is completed, transactions at this node are local and replication from other nodes is suspended.",
+		&MtmLogicalBootstrap,
+		false,
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.conflict_fingerprints",
+		"Send fingerprints of write sets of transactions with PREPARE and abort conflicting transactions without applying them",
+		"Transaction conflicting with in-flight transaction of the receiving node is aborted immediately if it has larger snapshot",
+		&MtmConflictFingerprints,
+		false,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.proactive_hint_bits",
+		"Set hint bits of tuples of replicated transactions when their COMMIT PREPARED is applied",
+		"Otherwise the first queries reading these tuples set hint bits and dirty the pages",
+		&MtmProactiveHintBits,
+		true,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.replication_compression",
+		"Compress replication traffic between nodes",
+		"WAL receivers ask WAL senders of other nodes to compress the replication stream",
+		&MtmReplicationCompression,
+		false,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.sampling_period",
+		"Period in milliseconds of sampling wait events of backends",
+		"Samples are kept in shared memory and can be seen in mtm.wait_samples view. 0 disables sampling",
+		&MtmSamplingPeriod,
+		10,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.sampling_history",
+		"Number of wait event samples kept in shared memory",
+		"Older samples are overwritten by new ones",
+		&MtmSamplingHistory,
+		100000,
+		100,
+		INT_MAX/sizeof(MtmSample),
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomRealVariable(
+		"multimaster.trace_sample_rate",
+		"Fraction of distributed transactions whose stages are traced at all nodes",
+		"Events of traced transactions can be seen in mtm.trace_events view",
+		&MtmTraceSampleRate,
+		0.0,
+		0.0,
+		1.0,
+		PGC_SUSET,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.trace_buffer_size",
+		"Number of events of traced transactions kept in shared memory",
+		"Older events are overwritten by new ones",
+		&MtmTraceBufferSize,
+		10000,
+		100,
+		INT_MAX/sizeof(MtmTraceEvent),
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomBoolVariable(
 		"multimaster.use_rdma",
 		"Use RDMA sockets",
@@ -3065,6 +4094,45 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomBoolVariable(
+		"multimaster.origin_commit_order",
+		"Commit prepared transactions of one node by the pool of background workers in the order they were received",
+		"Requires multimaster.preserve_commit_order. Otherwise such commits are performed by the receiver itself",
+		&MtmOriginCommitOrder,
+		false,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.track_dependencies",
+		"Track write sets of transactions received from one node and apply conflicting transactions in the same order",
+		"Non-conflicting transactions are still applied in parallel",
+		&MtmTrackDependencies,
+		false,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.parallel_recovery",
+		"Apply transactions received from donor during recovery by the pool of background workers",
+		"Requires multimaster.track_dependencies. Conflicting transactions are applied in the order they were received, all transactions are committed in this order",
+		&MtmParallelRecovery,
+		false,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomBoolVariable(
 		"multimaster.volkswagen_mode",
 		"Pretend to be normal postgres. This means skip some NOTICE's and use local sequences. Default false.",
@@ -3108,6 +4176,36 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.worker_grow_delay",
+		"Time during which the apply queue should have more transactions than free workers before dynamic worker is started (msec)",
+		NULL,
+		&MtmWorkerGrowDelay,
+		10,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.worker_idle_timeout",
+		"Time after which one of idle apply workers exits if not all workers were busy (msec)",
+		"Zero disables shrinking: dynamic workers are never stopped",
+		&MtmWorkerIdleTimeout,
+		60000,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.vacuum_delay",
 		"Minimal age of records which can be vacuumed (seconds)",
@@ -3123,6 +4221,36 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.group_commit_delay",
+		"Time in microseconds during which concurrently committing transactions are collected in one group",
+		"Transactions of the group start two-phase commit at the same time, so flushes of their PREPARE records are combined and votes are sent in one arbiter batch",
+		&MtmGroupCommitDelay,
+		0, /* disabled */
+		0,
+		100000,
+		PGC_BACKEND,
+		GUC_NO_SHOW_ALL,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.group_commit_siblings",
+		"Minimal number of concurrently running transactions required to perform group commit",
+		NULL,
+		&MtmGroupCommitSiblings,
+		5,
+		0,
+		1000,
+		PGC_BACKEND,
+		GUC_NO_SHOW_ALL,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.min_2pc_timeout",
 		"Minimal timeout between receiving PREPARED message from nodes participated in transaction to coordinator (milliseconds)",
@@ -3257,13 +4385,15 @@ _PG_init(void)
 	 * the postmaster process.)	 We'll allocate or attach to the shared
 	 * resources in mtm_shmem_startup().
 	 */
-	RequestAddinShmemSpace(MTM_SHMEM_SIZE + MtmQueueSize);
-	RequestNamedLWLockTranche(MULTIMASTER_NAME, 1 + MtmMaxNodes*2);
+	RequestAddinShmemSpace(MTM_SHMEM_SIZE + BgwPoolShmemSize(MtmQueueSize) + MtmWriteSetShmemSize() + MtmPerfShmemSize() + MtmSamplerShmemSize() + MtmTraceShmemSize() + pglogical_shared_relid_map_shmem_size() + MtmFingerprintShmemSize() + MtmHintShmemSize() + MtmXidMapShmemSize());
+	RequestNamedLWLockTranche(MULTIMASTER_NAME, 1 + MtmMaxNodes*2 + MTM_XID_PARTITIONS + 1);
 
 	BgwPoolStart(MtmWorkers, MtmPoolConstructor);
 
 	MtmArbiterInitialize();
 
+	MtmSamplerStart();
+
 	/*
 	 * Install hooks.
 	 */
@@ -3375,6 +4505,77 @@ void MtmFinishPreparedTransaction(MtmTransState* ts, bool commit)
 	ts->isPinned = false;
 }
 
+/*
+ * Finish in-doubt prepared transaction which outcome is determined by polling other nodes.
+ * This function is called with MTM mutex locked.
+ * Transaction is finished by apply worker from the priority lane of the pool, so that after node failure
+ * hundreds of prepared transactions are committed or aborted in parallel rather than one by one
+ * by arbiter. During recovery, or if the lane is full, transaction is finished immediately:
+ * arbiter can not wait for workers, because they may be waiting for arbiter.
+ * "replicate" is false when decision should not be sent to other nodes, because they make it themselves.
+ */
+void MtmResolvePreparedTransaction(MtmTransState* ts, bool commit, bool replicate)
+{
+	char work[1 + MULTIMASTER_MAX_GID_SIZE + 2];
+	int  len;
+
+	if (ts->isResolving) {
+		/* decision is already passed to apply worker */
+		return;
+	}
+	len = strlen(ts->gid) + 1;
+	work[0] = 'P';
+	memcpy(&work[1], ts->gid, len);
+	work[1 + len] = commit;
+	work[2 + len] = replicate;
+
+	if (Mtm->status != MTM_RECOVERY && BgwPoolTryExecute(&Mtm->pool, work, len + 3, BGW_LANE_PRIORITY)) {
+		ts->isResolving = true;
+	} else {
+		if (!replicate) {
+			replorigin_session_origin = DoNotReplicateId;
+		}
+		MtmFinishPreparedTransaction(ts, commit);
+		if (!replicate) {
+			replorigin_session_origin = InvalidRepOriginId;
+		}
+	}
+}
+
+/*
+ * Called by apply worker to finish transaction passed by MtmResolvePreparedTransaction.
+ * Transaction can be already finished in the meantime, e.g. by COMMIT PREPARED received from its coordinator.
+ */
+void MtmFinishResolvedTransaction(char const* gid, bool commit, bool replicate)
+{
+	MtmTransMap* tm;
+
+	MtmLock(LW_EXCLUSIVE);
+	tm = (MtmTransMap*)hash_search(MtmGid2State, gid, HASH_FIND, NULL);
+	if (tm != NULL && tm->state != NULL) {
+		MtmTransState* ts = tm->state;
+		ts->isResolving = false;
+		if (ts->status == TRANSACTION_STATUS_UNKNOWN || ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
+			if (!replicate) {
+				replorigin_session_origin = DoNotReplicateId;
+			}
+			PG_TRY();
+			{
+				MtmFinishPreparedTransaction(ts, commit);
+			}
+			PG_CATCH();
+			{
+				/* there is no replication session to be reset by error handler */
+				replorigin_session_origin = InvalidRepOriginId;
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			replorigin_session_origin = InvalidRepOriginId;
+		}
+	}
+	MtmUnlock();
+}
+
 /*
  * Determine when and how we should open replication slot.
  * During recovery we need to open only one replication slot from which node should receive all transactions.
@@ -3391,6 +4592,16 @@ MtmReplicationMode MtmGetReplicationMode(int nodeId, sig_atomic_t volatile* shut
 		Mtm->preparedTransactionsLoaded = true;
 	}
 
+	/* Node populated by logical bootstrap can start replication only when data is copied */
+	while (MtmIsBootstrapPending())
+	{
+		MtmUnlock();
+		if (*shutdown)
+			return REPLMODE_EXIT;
+		MtmSleep(STATUS_POLL_DELAY);
+		MtmLock(LW_EXCLUSIVE);
+	}
+
 	/* Await until node is connected and both receiver and sender are in clique */
 	while (BIT_CHECK(EFFECTIVE_CONNECTIVITY_MASK, nodeId - 1) ||
 			BIT_CHECK(EFFECTIVE_CONNECTIVITY_MASK, MtmNodeId - 1))
@@ -3542,6 +4753,7 @@ MtmReplicationStartupHook(struct PGLogicalStartupHookArgs* args)
 	ulong64 recoveryStartPos = INVALID_LSN;
 
 	MtmIsRecoverySession = false;
+	MtmReplicationFingerprints = false;
 	Mtm->nodes[MtmReplicationNodeId-1].senderPid = MyProcPid;
 	Mtm->nodes[MtmReplicationNodeId-1].senderStartTime = MtmGetSystemTime();
 	foreach(param, args->in_params)
@@ -3559,6 +4771,16 @@ MtmReplicationStartupHook(struct PGLogicalStartupHookArgs* args)
 			} else {
 				MTM_ELOG(ERROR, "Replication mode is not specified");
 			}
+		} else if (strcmp("mtm_conflict_fingerprints", elem->defname) == 0) {
+			if (elem->arg != NULL && strVal(elem->arg) != NULL) {
+				MtmReplicationFingerprints = strcmp(strVal(elem->arg), "1") == 0;
+			}
+		} else if (strcmp("mtm_bootstrap_csn", elem->defname) == 0) {
+			if (elem->arg != NULL && strVal(elem->arg) != NULL) {
+				sscanf(strVal(elem->arg), "%llu", &MtmReplicationBootstrapCsn);
+			} else {
+				MTM_ELOG(ERROR, "Bootstrap CSN is not specified");
+			}
 		} else if (strcmp("mtm_restart_pos", elem->defname) == 0) {
 			if (elem->arg != NULL && strVal(elem->arg) != NULL) {
 				sscanf(strVal(elem->arg), "%llx", &recoveryStartPos);
@@ -3717,19 +4939,7 @@ MtmReplicationTxnFilterHook(struct PGLogicalTxnFilterArgs* args)
 static bool
 MtmReplicationRowFilterHook(struct PGLogicalRowFilterArgs* args)
 {
-	bool isDistributed;
-	MtmLock(LW_SHARED);
-	if (!Mtm->localTablesHashLoaded) {
-		MtmUnlock();
-		MtmLock(LW_EXCLUSIVE);
-		if (!Mtm->localTablesHashLoaded) {
-			MtmLoadLocalTables();
-			Mtm->localTablesHashLoaded = true;
-		}
-	}
-	isDistributed = hash_search(MtmLocalTables, &RelationGetRelid(args->changed_rel), HASH_FIND, NULL) == NULL;
-	MtmUnlock();
-	return isDistributed;
+	return !MtmIsLocalRelation(RelationGetRelid(args->changed_rel));
 }
 
 /*
@@ -3977,6 +5187,54 @@ mtm_get_snapshot(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(MtmTx.snapshot);
 }
 
+/*
+ * Make current transaction use specified global snapshot, so that sessions at different nodes
+ * see the same set of distributed transactions. Zero means snapshot of the current transaction.
+ * Snapshot is pinned until end of transaction: GC doesn't remove state of transactions which are not visible in it.
+ */
+Datum
+mtm_set_snapshot(PG_FUNCTION_ARGS)
+{
+	csn_t snapshot = PG_GETARG_INT64(0);
+
+	if (!IsTransactionBlock() || !IsolationUsesXactSnapshot() || !XactReadOnly) {
+		MTM_ELOG(ERROR, "mtm.set_snapshot() can be used only in read-only REPEATABLE READ or SERIALIZABLE transaction block");
+	}
+	if (MtmTx.isLocalRead) {
+		MTM_ELOG(ERROR, "mtm.set_snapshot() can not be used in transaction started with multimaster.local_reads");
+	}
+	if (snapshot == INVALID_CSN) {
+		snapshot = MtmTx.snapshot;
+	} else if (snapshot > MtmTx.snapshot) {
+		MTM_ELOG(ERROR, "Snapshot %lld is newer than snapshot %lld of the current transaction", (long64)snapshot, (long64)MtmTx.snapshot);
+	}
+	MtmLock(LW_EXCLUSIVE);
+	/* State of transactions older than multimaster.vacuum_delay may be already removed unless they are kept by other pinned snapshot */
+	if (snapshot + MtmVacuumDelay*USECS_PER_SEC < MtmGetCurrentTime()
+		&& (Mtm->nPinnedSnapshots == 0 || snapshot < Mtm->pinnedSnapshot))
+	{
+		MtmUnlock();
+		MTM_ELOG(ERROR, "Snapshot %lld is too old", (long64)snapshot);
+	}
+	if (!MtmSnapshotPinned) {
+		Mtm->nPinnedSnapshots += 1;
+		MtmSnapshotPinned = true;
+	}
+	if (Mtm->pinnedSnapshot == INVALID_CSN || snapshot < Mtm->pinnedSnapshot) {
+		Mtm->pinnedSnapshot = snapshot;
+	}
+	MtmTx.snapshot = snapshot;
+	MtmUnlock();
+
+	PG_RETURN_INT64(snapshot);
+}
+
+Datum
+mtm_bootstrap_node(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT64(MtmBootstrapNode(PG_GETARG_INT32(0)));
+}
+
 
 Datum
 mtm_get_last_csn(PG_FUNCTION_ARGS)
@@ -3992,7 +5250,7 @@ mtm_get_csn(PG_FUNCTION_ARGS)
 	csn_t csn = INVALID_CSN;
 
 	MtmLock(LW_SHARED);
-	ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+	ts = MtmXidLookup(xid);
 	if (ts != NULL) {
 		csn = ts->csn;
 	}
@@ -4059,11 +5317,15 @@ mtm_get_nodes_state(PG_FUNCTION_ARGS)
 		usrfctx->nulls[11] = true;
 		usrfctx->nulls[12] = true;
 		usrfctx->nulls[13] = true;
+		usrfctx->nulls[17] = true;
+		usrfctx->nulls[18] = true;
 	}
 
 	usrfctx->values[14] = CStringGetTextDatum(Mtm->nodes[usrfctx->nodeId-1].con.connStr);
 	usrfctx->values[15] = Int64GetDatum(Mtm->nodes[usrfctx->nodeId-1].connectivityMask);
 	usrfctx->values[16] = Int64GetDatum(Mtm->nodes[usrfctx->nodeId-1].nHeartbeats);
+	usrfctx->values[17] = Int64GetDatum(Mtm->nodes[usrfctx->nodeId-1].receiverStalls);
+	usrfctx->values[18] = Int64GetDatum(Mtm->nodes[usrfctx->nodeId-1].receiverStallTime);
 	usrfctx->nodeId += 1;
 
 	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(usrfctx->desc, usrfctx->values, usrfctx->nulls)));
@@ -4127,7 +5389,7 @@ mtm_get_trans_by_xid(PG_FUNCTION_ARGS)
 	MtmTransState* ts;
 
 	MtmLock(LW_SHARED);
-	ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+	ts = MtmXidLookup(xid);
 	if (ts == NULL) {
 		MtmUnlock();
 		PG_RETURN_NULL();
@@ -4157,35 +5419,349 @@ Datum
 mtm_get_cluster_state(PG_FUNCTION_ARGS)
 {
 	TupleDesc desc;
-	Datum	  values[Natts_mtm_cluster_state];
-	bool	  nulls[Natts_mtm_cluster_state] = {false};
-	get_call_result_type(fcinfo, NULL, &desc);
+	Datum	  values[Natts_mtm_cluster_state];
+	bool	  nulls[Natts_mtm_cluster_state] = {false};
+	get_call_result_type(fcinfo, NULL, &desc);
+
+	values[0] = Int32GetDatum(MtmNodeId);
+	values[1] = CStringGetTextDatum(MtmNodeStatusMnem[Mtm->status]);
+	values[2] = Int64GetDatum(Mtm->disabledNodeMask);
+	values[3] = Int64GetDatum(SELF_CONNECTIVITY_MASK);
+	values[4] = Int64GetDatum(Mtm->originLockNodeMask);
+	values[5] = Int32GetDatum(Mtm->nLiveNodes);
+	values[6] = Int32GetDatum(Mtm->nAllNodes);
+	values[7] = Int32GetDatum((int)pg_atomic_read_u32(&Mtm->pool.active));
+	values[8] = Int32GetDatum((int)pg_atomic_read_u32(&Mtm->pool.pending));
+	values[9] = Int64GetDatum(BgwPoolGetQueueSize(&Mtm->pool));
+	values[10] = Int64GetDatum(Mtm->transCount);
+	values[11] = Int64GetDatum(HlcDrift(&Mtm->clock));
+	values[12] = Int32GetDatum(Mtm->recoverySlot);
+	values[13] = Int64GetDatum(pg_atomic_read_u32(&MtmXid2State->nUsed));
+	values[14] = Int64GetDatum(hash_get_num_entries(MtmGid2State));
+	values[15] = Int64GetDatum(Mtm->oldestXid);
+	values[16] = Int32GetDatum(Mtm->nConfigChanges);
+	values[17] = Int64GetDatum(Mtm->stalledNodeMask);
+	values[18] = Int64GetDatum(Mtm->stoppedNodeMask);
+	values[19] = Int64GetDatum(Mtm->deadNodeMask);
+	values[20] = TimestampTzGetDatum(time_t_to_timestamptz(Mtm->nodes[MtmNodeId-1].lastStatusChangeTime/USECS_PER_SEC));
+	values[21] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nSnapshotWaits));
+	values[22] = Int64GetDatum(pg_atomic_read_u64(&Mtm->snapshotWaitTime));
+	values[23] = Int64GetDatum(Mtm->gcRuns);
+	values[24] = Int64GetDatum(Mtm->gcRemoved);
+	values[25] = Int64GetDatum(Mtm->gcTime);
+	values[26] = Int64GetDatum(Mtm->gcMaxPause);
+	values[27] = Int64GetDatum(Mtm->clock.nAhead);
+	values[28] = Int64GetDatum(Mtm->clock.maxDrift);
+	values[29] = Int64GetDatum(Mtm->clock.nRejected);
+	values[30] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nReadOnlyCommits));
+	values[31] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nEmptyWriteCommits));
+	values[32] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nLocalOnlyCommits));
+	values[33] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nTwoPhaseCommits));
+	values[34] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nVisibilityCacheHits));
+	values[35] = Int64GetDatum(pg_atomic_read_u64(&Mtm->nVisibilityCacheMisses));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(desc, values, nulls)));
+}
+
+
+Datum
+mtm_get_pool_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum	  values[Natts_mtm_pool_stats];
+	bool	  nulls[Natts_mtm_pool_stats] = {false};
+	BgwPool*  pool = &Mtm->pool;
+	get_call_result_type(fcinfo, NULL, &desc);
+
+	values[0] = Int32GetDatum((int)pool->nWorkers);
+	values[1] = Int32GetDatum((int)pg_atomic_read_u32(&pool->active));
+	values[2] = Int32GetDatum((int)pg_atomic_read_u32(&pool->pending));
+	values[3] = Int64GetDatum(BgwPoolGetQueueSize(pool));
+	values[4] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.peakDepth));
+	values[5] = Int64GetDatum(pool->size);
+	values[6] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.nWorks));
+	values[7] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.nStalls));
+	values[8] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.stallTime));
+	values[9] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.nWakeups));
+	values[10] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.idleTime));
+	values[11] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.nGrows));
+	values[12] = Int64GetDatum(pg_atomic_read_u64(&pool->stats.nShrinks));
+	values[13] = Int64GetDatum(BgwPoolGetLaneQueueSize(pool, BGW_LANE_PRIORITY));
+	values[14] = Int64GetDatum(pool->lanes[BGW_LANE_PRIORITY].size);
+	values[15] = Int64GetDatum(pg_atomic_read_u64(&pool->lanes[BGW_LANE_PRIORITY].nWorks));
+	values[16] = Int64GetDatum(pg_atomic_read_u64(&pool->lanes[BGW_LANE_PRIORITY].nStalls));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(desc, values, nulls)));
+}
+
+typedef struct
+{
+	int		  metric;
+	int		  nodeId;
+	TupleDesc desc;
+	Datum	  values[Natts_mtm_perf_stats];
+	bool	  nulls[Natts_mtm_perf_stats];
+} MtmGetPerfStatsCtx;
+
+Datum
+mtm_get_perf_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmGetPerfStatsCtx* usrfctx;
+	MemoryContext oldcontext;
+	MtmPerfStat* stat;
+	uint64 count;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		usrfctx = (MtmGetPerfStatsCtx*)palloc(sizeof(MtmGetPerfStatsCtx));
+		get_call_result_type(fcinfo, NULL, &usrfctx->desc);
+		usrfctx->metric = 0;
+		usrfctx->nodeId = 0;
+		memset(usrfctx->nulls, false, sizeof(usrfctx->nulls));
+		funcctx->user_fctx = usrfctx;
+		MemoryContextSwitchTo(oldcontext);
+		/* Make values accumulated by this backend visible */
+		MtmPerfFlush(true);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	usrfctx = (MtmGetPerfStatsCtx*)funcctx->user_fctx;
+
+	/* Skip slots which have no recorded values */
+	while (true) {
+		if (usrfctx->nodeId > Mtm->nAllNodes) {
+			usrfctx->nodeId = 0;
+			usrfctx->metric += 1;
+		}
+		if (usrfctx->metric >= MTM_PERF_N_METRICS) {
+			SRF_RETURN_DONE(funcctx);
+		}
+		stat = MtmPerfGetStat((MtmPerfMetric)usrfctx->metric, usrfctx->nodeId);
+		count = pg_atomic_read_u64(&stat->count);
+		if (count != 0) {
+			break;
+		}
+		usrfctx->nodeId += 1;
+	}
+	usrfctx->values[0] = CStringGetTextDatum(MtmPerfMetricName[usrfctx->metric]);
+	usrfctx->values[1] = Int32GetDatum(usrfctx->nodeId);
+	usrfctx->nulls[1] = usrfctx->nodeId == 0;
+	usrfctx->values[2] = Int64GetDatum(count);
+	usrfctx->values[3] = Int64GetDatum(pg_atomic_read_u64(&stat->sum));
+	usrfctx->values[4] = Int64GetDatum(pg_atomic_read_u64(&stat->max));
+	usrfctx->values[5] = Int64GetDatum(MtmPerfPercentile(stat, 0.5));
+	usrfctx->values[6] = Int64GetDatum(MtmPerfPercentile(stat, 0.99));
+	usrfctx->values[7] = Int64GetDatum(MtmPerfPercentile(stat, 0.999));
+	/* Histograms are collected only for latencies */
+	usrfctx->nulls[5] = usrfctx->nulls[6] = usrfctx->nulls[7] = !MtmPerfMetricIsLatency[usrfctx->metric];
+	usrfctx->nodeId += 1;
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(usrfctx->desc, usrfctx->values, usrfctx->nulls)));
+}
+
+Datum
+mtm_reset_perf_stats(PG_FUNCTION_ARGS)
+{
+	MtmPerfReset();
+	PG_RETURN_VOID();
+}
+
+typedef struct
+{
+	MtmSample* samples;
+	int		  nSamples;
+	int		  sample;
+	TupleDesc desc;
+} MtmGetWaitSamplesCtx;
+
+Datum
+mtm_get_wait_samples(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmGetWaitSamplesCtx* usrfctx;
+	MemoryContext oldcontext;
+	MtmSample* sample;
+	Datum	  values[Natts_mtm_wait_samples];
+	bool	  nulls[Natts_mtm_wait_samples];
+	const char* eventType;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		usrfctx = (MtmGetWaitSamplesCtx*)palloc(sizeof(MtmGetWaitSamplesCtx));
+		get_call_result_type(fcinfo, NULL, &usrfctx->desc);
+		usrfctx->nSamples = MtmSamplerGetHistory(&usrfctx->samples);
+		usrfctx->sample = 0;
+		funcctx->user_fctx = usrfctx;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	usrfctx = (MtmGetWaitSamplesCtx*)funcctx->user_fctx;
+	if (usrfctx->sample >= usrfctx->nSamples) {
+		SRF_RETURN_DONE(funcctx);
+	}
+	sample = &usrfctx->samples[usrfctx->sample++];
+
+	memset(nulls, false, sizeof(nulls));
+	values[0] = TimestampTzGetDatum(sample->time);
+	values[1] = Int32GetDatum(sample->pid);
+	/* Sample without wait event was taken while the process was running on CPU */
+	eventType = sample->waitEventInfo != 0 ? pgstat_get_wait_event_type(sample->waitEventInfo) : NULL;
+	if (eventType != NULL) {
+		values[2] = CStringGetTextDatum(eventType);
+		values[3] = CStringGetTextDatum(pgstat_get_wait_event(sample->waitEventInfo));
+	} else {
+		nulls[2] = nulls[3] = true;
+	}
+	values[4] = Int64GetDatum(sample->queryId);
+	nulls[4] = sample->queryId == 0;
+	if (sample->state != MTM_SAMPLE_NONE && sample->state < MTM_SAMPLE_N_STATES) {
+		values[5] = CStringGetTextDatum(MtmSampleStateName[sample->state]);
+	} else {
+		nulls[5] = true;
+	}
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(usrfctx->desc, values, nulls)));
+}
+
+Datum
+mtm_reset_wait_samples(PG_FUNCTION_ARGS)
+{
+	MtmSamplerReset();
+	PG_RETURN_VOID();
+}
+
+typedef struct
+{
+	MtmTraceEvent* events;
+	int		  nEvents;
+	int		  event;
+	TupleDesc desc;
+} MtmGetTraceEventsCtx;
+
+Datum
+mtm_get_trace_events(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmGetTraceEventsCtx* usrfctx;
+	MemoryContext oldcontext;
+	MtmTraceEvent* ev;
+	Datum	  values[Natts_mtm_trace_events];
+	bool	  nulls[Natts_mtm_trace_events];
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		usrfctx = (MtmGetTraceEventsCtx*)palloc(sizeof(MtmGetTraceEventsCtx));
+		get_call_result_type(fcinfo, NULL, &usrfctx->desc);
+		usrfctx->nEvents = MtmTraceGetEvents(&usrfctx->events);
+		usrfctx->event = 0;
+		funcctx->user_fctx = usrfctx;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	usrfctx = (MtmGetTraceEventsCtx*)funcctx->user_fctx;
+	if (usrfctx->event >= usrfctx->nEvents) {
+		SRF_RETURN_DONE(funcctx);
+	}
+	ev = &usrfctx->events[usrfctx->event++];
+
+	memset(nulls, false, sizeof(nulls));
+	values[0] = CStringGetTextDatum(ev->gid);
+	values[1] = Int32GetDatum(MtmNodeId);
+	values[2] = CStringGetTextDatum(ev->event < MTM_TRACE_N_EVENTS ? MtmTraceEventName[ev->event] : "unknown");
+	values[3] = TimestampTzGetDatum(ev->time);
+	values[4] = Int32GetDatum(ev->peer);
+	nulls[4] = ev->peer == 0;
+	values[5] = Int64GetDatum(ev->csn);
+	nulls[5] = ev->csn == 0 || ev->csn == INVALID_CSN;
+	values[6] = Int32GetDatum(ev->pid);
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(usrfctx->desc, values, nulls)));
+}
+
+Datum
+mtm_reset_trace_events(PG_FUNCTION_ARGS)
+{
+	MtmTraceReset();
+	PG_RETURN_VOID();
+}
+
+typedef struct
+{
+	char***   rows;
+	int		  nRows;
+	int		  row;
+} MtmCollectTraceEventsCtx;
+
+/*
+ * Gather trace events of all enabled nodes, optionally only of one transaction.
+ */
+Datum
+mtm_collect_trace_events(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmCollectTraceEventsCtx* usrfctx;
+	MemoryContext oldcontext;
+	TupleDesc desc;
 
-	values[0] = Int32GetDatum(MtmNodeId);
-	values[1] = CStringGetTextDatum(MtmNodeStatusMnem[Mtm->status]);
-	values[2] = Int64GetDatum(Mtm->disabledNodeMask);
-	values[3] = Int64GetDatum(SELF_CONNECTIVITY_MASK);
-	values[4] = Int64GetDatum(Mtm->originLockNodeMask);
-	values[5] = Int32GetDatum(Mtm->nLiveNodes);
-	values[6] = Int32GetDatum(Mtm->nAllNodes);
-	values[7] = Int32GetDatum((int)Mtm->pool.active);
-	values[8] = Int32GetDatum((int)Mtm->pool.pending);
-	values[9] = Int64GetDatum(BgwPoolGetQueueSize(&Mtm->pool));
-	values[10] = Int64GetDatum(Mtm->transCount);
-	values[11] = Int64GetDatum(Mtm->timeShift);
-	values[12] = Int32GetDatum(Mtm->recoverySlot);
-	values[13] = Int64GetDatum(hash_get_num_entries(MtmXid2State));
-	values[14] = Int64GetDatum(hash_get_num_entries(MtmGid2State));
-	values[15] = Int64GetDatum(Mtm->oldestXid);
-	values[16] = Int32GetDatum(Mtm->nConfigChanges);
-	values[17] = Int64GetDatum(Mtm->stalledNodeMask);
-	values[18] = Int64GetDatum(Mtm->stoppedNodeMask);
-	values[19] = Int64GetDatum(Mtm->deadNodeMask);
-	values[20] = TimestampTzGetDatum(time_t_to_timestamptz(Mtm->nodes[MtmNodeId-1].lastStatusChangeTime/USECS_PER_SEC));
+	if (SRF_IS_FIRSTCALL()) {
+		char const* paramValues[1];
+		int nodeId;
+		int i, j;
 
-	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(desc, values, nulls)));
-}
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		usrfctx = (MtmCollectTraceEventsCtx*)palloc(sizeof(MtmCollectTraceEventsCtx));
+		get_call_result_type(fcinfo, NULL, &desc);
+		funcctx->attinmeta = TupleDescGetAttInMetadata(desc);
+		usrfctx->rows = (char***)palloc(sizeof(char**));
+		usrfctx->nRows = 0;
+		usrfctx->row = 0;
+		paramValues[0] = PG_ARGISNULL(0) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(0));
+
+		for (nodeId = 1; nodeId <= Mtm->nAllNodes; nodeId++) {
+			PGconn* conn;
+			PGresult* result;
 
+			if (BIT_CHECK(Mtm->disabledNodeMask, nodeId-1)) {
+				continue;
+			}
+			conn = PQconnectdb_safe(Mtm->nodes[nodeId-1].con.connStr, 0);
+			if (PQstatus(conn) != CONNECTION_OK) {
+				MTM_ELOG(WARNING, "Failed to establish connection '%s' to node %d: error = %s", Mtm->nodes[nodeId-1].con.connStr, nodeId, PQerrorMessage(conn));
+				PQfinish(conn);
+				continue;
+			}
+			result = PQexecParams(conn, "select * from mtm.get_trace_events() where $1::text is null or gid = $1::text",
+								  1, NULL, paramValues, NULL, NULL, 0);
+			if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+				MTM_ELOG(WARNING, "Failed to receive trace events from node %d: %s", nodeId, PQresultErrorMessage(result));
+			} else {
+				int nTuples = PQntuples(result);
+				usrfctx->rows = (char***)repalloc(usrfctx->rows, sizeof(char**)*(usrfctx->nRows + nTuples + 1));
+				for (i = 0; i < nTuples; i++) {
+					char** values = (char**)palloc(sizeof(char*)*Natts_mtm_trace_events);
+					for (j = 0; j < Natts_mtm_trace_events; j++) {
+						values[j] = PQgetisnull(result, i, j) ? NULL : pstrdup(PQgetvalue(result, i, j));
+					}
+					usrfctx->rows[usrfctx->nRows++] = values;
+				}
+			}
+			PQclear(result);
+			PQfinish(conn);
+		}
+		funcctx->user_fctx = usrfctx;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	usrfctx = (MtmCollectTraceEventsCtx*)funcctx->user_fctx;
+	if (usrfctx->row >= usrfctx->nRows) {
+		SRF_RETURN_DONE(funcctx);
+	}
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(BuildTupleFromCStrings(funcctx->attinmeta, usrfctx->rows[usrfctx->row++])));
+}
 
 typedef struct
 {
@@ -4416,28 +5992,108 @@ Datum mtm_inject_2pc_error(PG_FUNCTION_ARGS)
  */
 
 /*
- * Execute statement with specified parameters and check its result
+ * Per-backend pool of connections used to broadcast utility statements.
+ * Connections are kept open between broadcasts and are reestablished
+ * if they are broken, left in the middle of transaction or if connection string of node was changed.
  */
-static bool MtmRunUtilityStmt(PGconn* conn, char const* sql, char **errmsg)
-{
-	PGresult *result = PQexec(conn, sql);
-	int status = PQresultStatus(result);
+static PGconn* MtmBroadcastConns[MAX_NODES];
+static char*   MtmBroadcastConnStrs[MAX_NODES];
+static int     MtmBroadcastNodes[MAX_NODES]; /* argument of notice receiver */
 
-	bool ret = status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+/*
+ * Extract error message of failed utility statement
+ */
+static char* MtmGetUtilityErrorMessage(PGconn* conn, PGresult* result)
+{
+	char *errstr = result != NULL ? PQresultErrorMessage(result) : PQerrorMessage(conn);
+	int errlen = strlen(errstr);
+	char *errmsg;
+	if (errlen > 9 && strncmp(errstr, "ERROR:  ", 8) == 0) {
+		/* Strip "ERROR:  " from beginning and "\n" from end of error string */
+		errmsg = pnstrdup(errstr + 8, errlen - 1 - 8);
+	} else if (errlen > 0) {
+		errmsg = pnstrdup(errstr, errstr[errlen-1] == '\n' ? errlen - 1 : errlen);
+	} else {
+		errmsg = pstrdup("unknown error");
+	}
+	return errmsg;
+}
 
-	if (!ret) {
-		char *errstr = PQresultErrorMessage(result);
-		int errlen = strlen(errstr);
-		if (errlen > 9) {
-			*errmsg = palloc0(errlen);
+/*
+ * Send statement to all nodes concurrently and wait until all of them complete it,
+ * so that total latency is determined by the slowest node rather than sum of all nodes.
+ * Returns index of the first node at which statement has failed or -1 if it succeeds everywhere.
+ */
+static int MtmRunUtilityStmt(PGconn** conns, int nNodes, char const* sql, char **errmsg)
+{
+	struct pollfd fds[MAX_NODES];
+	int  nodes[MAX_NODES];
+	bool busy[MAX_NODES];
+	int  failedNode = -1;
+	int  nBusy = 0;
+	int  i;
 
-			/* Strip "ERROR:  " from beginning and "\n" from end of error string */
-			strncpy(*errmsg, errstr + 8, errlen - 1 - 8);
+	for (i = 0; i < nNodes; i++)
+	{
+		busy[i] = false;
+		if (conns[i] == NULL)
+			continue;
+		if (!PQsendQuery(conns[i], sql)) {
+			if (failedNode < 0 || i < failedNode) {
+				failedNode = i;
+				*errmsg = MtmGetUtilityErrorMessage(conns[i], NULL);
+			}
+			continue;
 		}
+		busy[i] = true;
+		nBusy += 1;
 	}
+	while (nBusy != 0)
+	{
+		int n = 0;
+		for (i = 0; i < nNodes; i++)
+		{
+			if (busy[i]) {
+				fds[n].fd = PQsocket(conns[i]);
+				fds[n].events = POLLIN;
+				fds[n].revents = 0;
+				nodes[n++] = i;
+			}
+		}
+		if (poll(fds, n, MtmHeartbeatRecvTimeout) < 0 && errno != EINTR) {
+			MTM_ELOG(ERROR, "Failed to wait for utility statement completion: %m");
+		}
+		CHECK_FOR_INTERRUPTS();
 
-	PQclear(result);
-	return ret;
+		for (n = n - 1; n >= 0; n--)
+		{
+			PGconn* conn;
+			i = nodes[n];
+			conn = conns[i];
+			if (fds[n].revents == 0)
+				continue;
+			if (PQconsumeInput(conn)) {
+				PGresult* result;
+				while (!PQisBusy(conn) && (result = PQgetResult(conn)) != NULL)
+				{
+					int status = PQresultStatus(result);
+					if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK && (failedNode < 0 || i < failedNode)) {
+						failedNode = i;
+						*errmsg = MtmGetUtilityErrorMessage(conn, result);
+					}
+					PQclear(result);
+				}
+				if (PQisBusy(conn))
+					continue;
+			} else if (failedNode < 0 || i < failedNode) {
+				failedNode = i;
+				*errmsg = MtmGetUtilityErrorMessage(conn, NULL);
+			}
+			busy[i] = false;
+			nBusy -= 1;
+		}
+	}
+	return failedNode;
 }
 
 static void
@@ -4475,94 +6131,90 @@ MtmNoticeReceiver(void *i, const PGresult *res)
 	pfree(stripped_notice);
 }
 
+/*
+ * Get connection to the specified node from the broadcast pool, establishing it if needed
+ */
+static PGconn* MtmGetBroadcastConnection(int node)
+{
+	PGconn* conn = MtmBroadcastConns[node];
+	char const* connStr = Mtm->nodes[node].con.connStr;
+	if (conn != NULL) {
+		if (PQstatus(conn) == CONNECTION_OK
+			&& PQtransactionStatus(conn) == PQTRANS_IDLE
+			&& strcmp(MtmBroadcastConnStrs[node], connStr) == 0)
+		{
+			return conn;
+		}
+		PQfinish(conn);
+		MtmBroadcastConns[node] = NULL;
+		pfree(MtmBroadcastConnStrs[node]);
+		MtmBroadcastConnStrs[node] = NULL;
+	}
+	conn = PQconnectdb_safe(psprintf("%s application_name=%s", connStr, MULTIMASTER_BROADCAST_SERVICE), 0);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		return conn;
+	}
+	MtmBroadcastNodes[node] = node;
+	PQsetNoticeReceiver(conn, MtmNoticeReceiver, &MtmBroadcastNodes[node]);
+	MtmBroadcastConns[node] = conn;
+	MtmBroadcastConnStrs[node] = MemoryContextStrdup(TopMemoryContext, connStr);
+	return conn;
+}
+
 static void MtmBroadcastUtilityStmt(char const* sql, bool ignoreError, int forceOnNode)
 {
 	int i = 0;
 	nodemask_t disabledNodeMask = Mtm->disabledNodeMask;
 	int failedNode = -1;
 	char const* errorMsg = NULL;
-	PGconn **conns = palloc0(sizeof(PGconn*)*Mtm->nAllNodes);
-	char* utility_errmsg;
+	PGconn* conns[MAX_NODES];
+	char* utility_errmsg = NULL;
 	int nNodes = Mtm->nAllNodes;
 
 	for (i = 0; i < nNodes; i++)
 	{
+		conns[i] = NULL;
 		if (!BIT_CHECK(disabledNodeMask, i) || (i + 1 == forceOnNode))
 		{
-			conns[i] = PQconnectdb_safe(psprintf("%s application_name=%s", Mtm->nodes[i].con.connStr, MULTIMASTER_BROADCAST_SERVICE), 0);
-			if (PQstatus(conns[i]) != CONNECTION_OK)
+			PGconn* conn = MtmGetBroadcastConnection(i);
+			if (PQstatus(conn) != CONNECTION_OK)
 			{
-				if (ignoreError)
+				char* connError = pstrdup(PQerrorMessage(conn));
+				PQfinish(conn);
+				if (!ignoreError)
 				{
-					PQfinish(conns[i]);
-					conns[i] = NULL;
-				} else {
-					failedNode = i;
-					do {
-						PQfinish(conns[i]);
-					} while (--i >= 0);
-					MTM_ELOG(ERROR, "Failed to establish connection '%s' to node %d, error = %s", Mtm->nodes[failedNode].con.connStr, failedNode+1, PQerrorMessage(conns[i]));
+					MTM_ELOG(ERROR, "Failed to establish connection '%s' to node %d, error = %s", Mtm->nodes[i].con.connStr, i+1, connError);
 				}
+			} else {
+				conns[i] = conn;
 			}
-			PQsetNoticeReceiver(conns[i], MtmNoticeReceiver, &i);
 		}
 	}
-	Assert(i == nNodes);
-
-	for (i = 0; i < nNodes; i++)
-	{
-		if (conns[i])
-		{
-			if (!MtmRunUtilityStmt(conns[i], "BEGIN TRANSACTION", &utility_errmsg) && !ignoreError)
-			{
-				errorMsg = MTM_TAG "Failed to start transaction at node %d";
-				failedNode = i;
-				break;
-			}
-			if (!MtmRunUtilityStmt(conns[i], sql, &utility_errmsg) && !ignoreError)
-			{
-				if (i + 1 == MtmNodeId)
-					errorMsg = psprintf(MTM_TAG "%s", utility_errmsg);
-				else
-				{
-					MTM_ELOG(ERROR, "%s", utility_errmsg);
-					errorMsg = MTM_TAG "Failed to run command at node %d";
-				}
 
-				failedNode = i;
-				break;
-			}
+	failedNode = MtmRunUtilityStmt(conns, nNodes, "BEGIN TRANSACTION", &utility_errmsg);
+	if (failedNode >= 0) {
+		errorMsg = psprintf(MTM_TAG "Failed to start transaction at node %d: %s", failedNode+1, utility_errmsg);
+	} else {
+		failedNode = MtmRunUtilityStmt(conns, nNodes, sql, &utility_errmsg);
+		if (failedNode >= 0) {
+			if (failedNode + 1 == MtmNodeId)
+				errorMsg = psprintf(MTM_TAG "%s", utility_errmsg);
+			else
+				errorMsg = psprintf(MTM_TAG "Failed to run command at node %d: %s", failedNode+1, utility_errmsg);
 		}
 	}
 	if (failedNode >= 0 && !ignoreError)
 	{
-		for (i = 0; i < nNodes; i++)
-		{
-			if (conns[i])
-			{
-				MtmRunUtilityStmt(conns[i], "ROLLBACK TRANSACTION", &utility_errmsg);
-			}
-		}
+		MtmRunUtilityStmt(conns, nNodes, "ROLLBACK TRANSACTION", &utility_errmsg);
 	} else {
-		for (i = 0; i < nNodes; i++)
-		{
-			if (conns[i] && !MtmRunUtilityStmt(conns[i], "COMMIT TRANSACTION", &utility_errmsg) && !ignoreError)
-			{
-				errorMsg = MTM_TAG "Commit failed at node %d";
-				failedNode = i;
-			}
-		}
-	}
-	for (i = 0; i < nNodes; i++)
-	{
-		if (conns[i])
-		{
-			PQfinish(conns[i]);
+		failedNode = MtmRunUtilityStmt(conns, nNodes, "COMMIT TRANSACTION", &utility_errmsg);
+		if (failedNode >= 0) {
+			errorMsg = psprintf(MTM_TAG "Commit failed at node %d: %s", failedNode+1, utility_errmsg);
 		}
 	}
 	if (!ignoreError && failedNode >= 0)
 	{
-		elog(ERROR, errorMsg, failedNode+1);
+		elog(ERROR, "%s", errorMsg);
 	}
 }
 
@@ -4574,7 +6226,36 @@ static void
 MtmGenerateGid(char* gid)
 {
 	static int localCount;
-	sprintf(gid, "MTM-%d-%d-%d", MtmNodeId, MyProcPid, ++localCount);
+	/* Prefix of the gid tells all nodes whether the transaction is traced */
+	sprintf(gid, "%s%d-%d-%d", MtmTraceSample() ? MTM_TRACE_GID_PREFIX : "MTM-", MtmNodeId, MyProcPid, ++localCount);
+}
+
+/*
+ * Group commit: transactions which are committed concurrently are collected during MtmGroupCommitDelay
+ * and then start two-phase commit together. So XLogFlush combines flushes of their PREPARE records,
+ * replicas vote for them in one arbiter batch and coordinator receives these votes (and assigns CSNs)
+ * under one lock. First transaction opens the group by setting its deadline, others join it until the deadline expires.
+ */
+static void MtmGroupCommitWait(void)
+{
+	timestamp_t now;
+	timestamp_t deadline;
+
+	if (MtmGroupCommitDelay == 0 || Mtm->nRunningTransactions <= MtmGroupCommitSiblings) {
+		return;
+	}
+	now = MtmGetSystemTime();
+	deadline = pg_atomic_read_u64(&Mtm->groupCommitDeadline);
+	while (deadline <= now) {
+		uint64 expected = deadline;
+		if (pg_atomic_compare_exchange_u64(&Mtm->groupCommitDeadline, &expected, now + MtmGroupCommitDelay)) {
+			deadline = now + MtmGroupCommitDelay;
+			MTM_LOG3("%d: open commit group till %lld", MyProcPid, deadline);
+			break;
+		}
+		deadline = expected;
+	}
+	pg_usleep(deadline - now);
 }
 
 /*
@@ -4583,21 +6264,30 @@ MtmGenerateGid(char* gid)
  */
 static bool MtmTwoPhaseCommit(MtmCurrentTrans* x)
 {
+	timestamp_t prepareStart;
 	MTM_TXTRACE(x, "MtmTwoPhaseCommit Start");
 
 	if (!x->isReplicated && x->isDistributed && x->containsDML) {
 		MtmGenerateGid(x->gid);
+		MtmTraceRecord(x->gid, MTM_TRACE_BEGIN, 0, 0);
 		if (!x->isTransactionBlock) {
 			BeginTransactionBlock(false);
 			x->isTransactionBlock = true;
 			CommitTransactionCommand();
 			StartTransactionCommand();
 		}
+		MtmGroupCommitWait();
+		prepareStart = MtmGetSystemTime();
+		MtmSamplerSetState(MTM_SAMPLE_PREPARE);
+		MtmTraceRecord(x->gid, MTM_TRACE_PREPARE_START, 0, 0);
 		if (!PrepareTransactionBlock(x->gid))
 		{
+			MtmSamplerSetState(MTM_SAMPLE_NONE);
 			MTM_ELOG(WARNING, "Failed to prepare transaction %s (%llu)", x->gid, (long64)x->xid);
 		} else {
 			CommitTransactionCommand();
+			MtmSamplerSetState(MTM_SAMPLE_NONE);
+			MtmPerfRecord(MTM_PERF_PREPARE, 0, MtmGetSystemTime() - prepareStart);
 			StartTransactionCommand();
 			if (x->isSuspended) {
 				MTM_ELOG(WARNING, "Transaction %s (%llu) is left in prepared state because coordinator node is not online", x->gid, (long64)x->xid);
@@ -4605,15 +6295,17 @@ static bool MtmTwoPhaseCommit(MtmCurrentTrans* x)
 				Assert(x->isActive);
 				if (x->status == TRANSACTION_STATUS_ABORTED) {
 					MtmTransState* ts;
-					ts = (MtmTransState*) hash_search(MtmXid2State, &(x->xid), HASH_FIND, NULL);
+					ts = MtmXidLookup(x->xid);
 					Assert(ts);
 
 					TXFINISH("%s ABORT, MtmTwoPhase", x->gid);
 					FinishPreparedTransaction(x->gid, false);
+					MtmTraceRecord(x->gid, MTM_TRACE_ABORT, 0, 0);
 					MTM_ELOG(ERROR, "Transaction %s (%llu) is aborted on node %d. Check its log to see error details.", x->gid, (long64)x->xid, ts->abortedByNode);
 				} else {
 					TXFINISH("%s COMMIT, MtmTwoPhase", x->gid);
 					FinishPreparedTransaction(x->gid, true);
+					MtmTraceRecord(x->gid, MTM_TRACE_COMMIT, 0, x->csn);
 					MTM_TXTRACE(x, "MtmTwoPhaseCommit Committed");
 					MTM_LOG2("Distributed transaction %s (%lld) is committed at %lld with LSN=%lld", x->gid, (long64)x->xid, MtmGetCurrentTime(), (long64)GetXLogInsertRecPtr());
 				}
@@ -4644,6 +6336,15 @@ typedef struct MtmGucEntry
 
 static HTAB *MtmGucHash = NULL;
 static dlist_head MtmGucList = DLIST_STATIC_INIT(MtmGucList);
+
+/*
+ * MtmGucSerialize result is cached until GUC list or search_path is changed:
+ * migrations can send thousands of DDL statements with the same GUC context.
+ */
+static uint64 MtmGucGeneration;          /* incremented on each change of MtmGucList */
+static uint64 MtmGucSerializedGeneration;
+static char  *MtmGucSerialized;          /* cached result of MtmGucSerialize, NULL if none */
+static char  *MtmGucSerializedSearchPath;
 static inline void MtmGucUpdate(const char *key, char *value);
 
 static void MtmGucInit(void)
@@ -4688,6 +6389,7 @@ static void MtmGucDiscard()
 
 	hash_destroy(MtmGucHash);
 	MtmGucHash = NULL;
+	MtmGucGeneration += 1;
 }
 
 static inline void MtmGucUpdate(const char *key, char *value)
@@ -4706,6 +6408,7 @@ static inline void MtmGucUpdate(const char *key, char *value)
 	}
 	hentry->value = value;
 	dlist_push_tail(&MtmGucList, &hentry->list_node);
+	MtmGucGeneration += 1;
 }
 
 static inline void MtmGucRemove(const char *key)
@@ -4722,6 +6425,7 @@ static inline void MtmGucRemove(const char *key)
 		pfree(hentry->value);
 		dlist_delete(&hentry->list_node);
 		hash_search(MtmGucHash, key, HASH_REMOVE, NULL);
+		MtmGucGeneration += 1;
 	}
 }
 
@@ -4763,16 +6467,40 @@ static void MtmGucSet(VariableSetStmt *stmt, const char *queryStr)
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/*
+ * Build "SET ... TO ...;" statements reproducing GUC context of the session.
+ * Returned string is cached and should not be modified or freed by the caller.
+ */
 char* MtmGucSerialize(void)
 {
-	StringInfo serialized_gucs;
+	StringInfoData serialized_gucs;
 	dlist_iter iter;
 	const char *search_path;
+	MemoryContext oldcontext;
 
 	if (!MtmGucHash)
 		MtmGucInit();
 
-	serialized_gucs = makeStringInfo();
+	/*
+	 * Crutch for scheduler. It sets search_path through SetConfigOption()
+	 * so our callback do not react on that, and we have to check it each time.
+	 */
+	search_path = GetConfigOption("search_path", false, true);
+
+	if (MtmGucSerialized != NULL
+		&& MtmGucSerializedGeneration == MtmGucGeneration
+		&& strcmp(MtmGucSerializedSearchPath, search_path) == 0)
+	{
+		return MtmGucSerialized;
+	}
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (MtmGucSerialized != NULL)
+	{
+		pfree(MtmGucSerialized);
+		pfree(MtmGucSerializedSearchPath);
+	}
+	initStringInfo(&serialized_gucs);
 
 	dlist_foreach(iter, &MtmGucList)
 	{
@@ -4781,32 +6509,32 @@ char* MtmGucSerialize(void)
 		if (strcmp(cur_entry->key, "search_path") == 0)
 			continue;
 
-		appendStringInfoString(serialized_gucs, "SET ");
-		appendStringInfoString(serialized_gucs, cur_entry->key);
-		appendStringInfoString(serialized_gucs, " TO ");
+		appendStringInfoString(&serialized_gucs, "SET ");
+		appendStringInfoString(&serialized_gucs, cur_entry->key);
+		appendStringInfoString(&serialized_gucs, " TO ");
 
 		/* quite a crutch */
 		if (strstr(cur_entry->key, "_mem") != NULL || *(cur_entry->value) == '\0')
 		{
-			appendStringInfoString(serialized_gucs, "'");
-			appendStringInfoString(serialized_gucs, cur_entry->value);
-			appendStringInfoString(serialized_gucs, "'");
+			appendStringInfoString(&serialized_gucs, "'");
+			appendStringInfoString(&serialized_gucs, cur_entry->value);
+			appendStringInfoString(&serialized_gucs, "'");
 		}
 		else
 		{
-			appendStringInfoString(serialized_gucs, cur_entry->value);
+			appendStringInfoString(&serialized_gucs, cur_entry->value);
 		}
-		appendStringInfoString(serialized_gucs, "; ");
+		appendStringInfoString(&serialized_gucs, "; ");
 	}
 
-	/*
-	 * Crutch for scheduler. It sets search_path through SetConfigOption()
-	 * so our callback do not react on that.
-	 */
-	search_path = GetConfigOption("search_path", false, true);
-	appendStringInfo(serialized_gucs, "SET search_path TO %s; ", search_path);
+	appendStringInfo(&serialized_gucs, "SET search_path TO %s; ", search_path);
+
+	MtmGucSerialized = serialized_gucs.data;
+	MtmGucSerializedSearchPath = pstrdup(search_path);
+	MtmGucSerializedGeneration = MtmGucGeneration;
+	MemoryContextSwitchTo(oldcontext);
 
-	return serialized_gucs->data;
+	return MtmGucSerialized;
 }
 
 /*
@@ -4820,14 +6548,26 @@ static void MtmProcessDDLCommand(char const* queryString, bool transactional)
 	if (MtmTx.isReplicated)
 		return;
 
+	MtmCheckLocalReadWrite();
+
 	if (transactional)
 	{
+		/*
+		 * Transactional DDL is sent as two null-terminated strings: GUC context of the session
+		 * and the statement itself. Receiver applies GUC context only if it differs from the one
+		 * it has applied before.
+		 */
 		char *gucCtx = MtmGucSerialize();
-		queryString = psprintf("RESET SESSION AUTHORIZATION; reset all; %s %s", gucCtx, queryString);
+		int gucCtxLen = strlen(gucCtx) + 1;
+		int queryLen = strlen(queryString) + 1;
+		char *message = palloc(gucCtxLen + queryLen);
 
-		/* Transactional DDL */
-		MTM_LOG3("Sending DDL: %s", queryString);
-		LogLogicalMessage("D", queryString, strlen(queryString) + 1, true);
+		memcpy(message, gucCtx, gucCtxLen);
+		memcpy(message + gucCtxLen, queryString, queryLen);
+
+		MTM_LOG3("Sending DDL: %s %s", gucCtx, queryString);
+		LogLogicalMessage("D", message, gucCtxLen + queryLen, true);
+		pfree(message);
 		MtmTx.containsDML = true;
 	}
 	else
@@ -4843,24 +6583,244 @@ static void MtmFinishDDLCommand()
 	LogLogicalMessage("E", "", 1, true);
 }
 
-void MtmUpdateLockGraph(int nodeId, void const* messageBody, int messageSize)
+/*
+ * Lock graph of the node is stored as sorted array of edges, each edge occupies
+ * MTM_LOCK_GRAPH_EDGE_SIZE elements: waiter, owner and end of owners list marker,
+ * so that it can be passed to MtmGraphAdd as is.
+ */
+#define MTM_LOCK_GRAPH_EDGE_SIZE 3
+
+static int
+MtmCompareLockGraphEdges(void const* p, void const* q)
 {
-	int allocated;
-	MtmLockNode(nodeId + MtmMaxNodes, LW_EXCLUSIVE);
-	allocated = Mtm->nodes[nodeId-1].lockGraphAllocated;
-	if (messageSize > allocated) {
-		allocated = Max(Max(MULTIMASTER_LOCK_BUF_INIT_SIZE, allocated*2), messageSize);
-		Mtm->nodes[nodeId-1].lockGraphData = ShmemAlloc(allocated);
-		if (Mtm->nodes[nodeId-1].lockGraphData == NULL) {
+	GlobalTransactionId const* e1 = (GlobalTransactionId const*)p;
+	GlobalTransactionId const* e2 = (GlobalTransactionId const*)q;
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (e1[i].node != e2[i].node) {
+			return e1[i].node < e2[i].node ? -1 : 1;
+		}
+		if (e1[i].xid != e2[i].xid) {
+			return e1[i].xid < e2[i].xid ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Get buffer in shared memory for lock graph of the node with specified number of edges.
+ * Caller should hold lock of the node's lock graph.
+ */
+static GlobalTransactionId*
+MtmReserveLockGraph(int nodeId, int nEdges)
+{
+	MtmNodeInfo* node = &Mtm->nodes[nodeId-1];
+	int size = nEdges*MTM_LOCK_GRAPH_EDGE_SIZE*sizeof(GlobalTransactionId);
+	if (size > node->lockGraphAllocated) {
+		int allocated = Max(Max(MULTIMASTER_LOCK_BUF_INIT_SIZE, node->lockGraphAllocated*2), size);
+		node->lockGraphData = ShmemAlloc(allocated);
+		if (node->lockGraphData == NULL) {
 			elog(PANIC, "Failed to allocate shared memory for lock graph: %d bytes requested",
 				 allocated);
 		}
-		Mtm->nodes[nodeId-1].lockGraphAllocated = allocated;
+		node->lockGraphAllocated = allocated;
+	}
+	node->lockGraphUsed = size;
+	return (GlobalTransactionId*)node->lockGraphData;
+}
+
+static void
+MtmStoreLockGraphEdges(GlobalTransactionId* dst, GlobalTransactionId const* edges, int nEdges)
+{
+	int i;
+	for (i = 0; i < nEdges; i++) {
+		dst[0] = edges[0];
+		dst[1] = edges[1];
+		dst[2].node = 0;
+		dst[2].xid = 0;
+		dst += MTM_LOCK_GRAPH_EDGE_SIZE;
+		edges += 2;
+	}
+}
+
+/*
+ * Send local lock graph, serialized by MtmSerializeLock, to other nodes.
+ * Only changes since the previously sent graph are sent unless the full graph is requested by some node
+ * or changes are not smaller than the graph itself.
+ * Returns position of logical message in WAL or InvalidXLogRecPtr if graph was not changed.
+ */
+static XLogRecPtr
+MtmSendLockGraph(GlobalTransactionId const* graph, int size)
+{
+	GlobalTransactionId const* end = graph + size;
+	GlobalTransactionId* edges = (GlobalTransactionId*)palloc(Max(size, 1)*2*sizeof(GlobalTransactionId));
+	GlobalTransactionId* sent;
+	GlobalTransactionId* added;
+	GlobalTransactionId* removed;
+	MtmNodeInfo* self = &Mtm->nodes[MtmNodeId-1];
+	MtmLockGraphHeader hdr;
+	ByteBuffer msg;
+	XLogRecPtr lsn;
+	int nEdges = 0, nSent, i, j;
+	bool full;
+
+	/* Convert lists of lock owners to sorted array of unique edges */
+	while (graph != end) {
+		GlobalTransactionId const* waiter = graph++;
+		while (graph->node != 0) {
+			edges[nEdges*2] = *waiter;
+			edges[nEdges*2+1] = *graph++;
+			nEdges += 1;
+		}
+		graph += 1;
+	}
+	qsort(edges, nEdges, 2*sizeof(GlobalTransactionId), MtmCompareLockGraphEdges);
+	for (i = j = 0; i < nEdges; i++) {
+		if (j == 0 || MtmCompareLockGraphEdges(&edges[i*2], &edges[(j-1)*2]) != 0) {
+			edges[j*2] = edges[i*2];
+			edges[j*2+1] = edges[i*2+1];
+			j += 1;
+		}
+	}
+	nEdges = j;
+
+	MtmLockNode(MtmNodeId + MtmMaxNodes, LW_EXCLUSIVE);
+
+	/* Merge with the previously sent graph to find added and removed edges */
+	sent = (GlobalTransactionId*)self->lockGraphData;
+	nSent = self->lockGraphUsed/(MTM_LOCK_GRAPH_EDGE_SIZE*sizeof(GlobalTransactionId));
+	added = (GlobalTransactionId*)palloc(Max(nEdges, 1)*2*sizeof(GlobalTransactionId));
+	removed = (GlobalTransactionId*)palloc(Max(nSent, 1)*2*sizeof(GlobalTransactionId));
+	hdr.nAdded = hdr.nRemoved = 0;
+	for (i = j = 0; i < nEdges || j < nSent;) {
+		int diff = i == nEdges ? 1 : j == nSent ? -1
+			: MtmCompareLockGraphEdges(&edges[i*2], &sent[j*MTM_LOCK_GRAPH_EDGE_SIZE]);
+		if (diff < 0) {
+			memcpy(&added[hdr.nAdded++*2], &edges[i++*2], 2*sizeof(GlobalTransactionId));
+		} else if (diff > 0) {
+			memcpy(&removed[hdr.nRemoved++*2], &sent[j++*MTM_LOCK_GRAPH_EDGE_SIZE], 2*sizeof(GlobalTransactionId));
+		} else {
+			i += 1;
+			j += 1;
+		}
+	}
+	full = Mtm->lockGraphVersion == 0 || Mtm->lockGraphResync;
+	if (!full && hdr.nAdded + hdr.nRemoved == 0) {
+		MtmUnlockNode(MtmNodeId + MtmMaxNodes);
+		pfree(edges);
+		pfree(added);
+		pfree(removed);
+		return InvalidXLogRecPtr;
+	}
+	full |= hdr.nAdded + hdr.nRemoved >= nEdges;
+	hdr.baseVersion = full ? 0 : Mtm->lockGraphVersion;
+	hdr.version = ++Mtm->lockGraphVersion;
+	Mtm->lockGraphResync = false;
+
+	ByteBufferAlloc(&msg);
+	if (full) {
+		hdr.nAdded = nEdges;
+		hdr.nRemoved = 0;
+		ByteBufferAppend(&msg, &hdr, sizeof(hdr));
+		ByteBufferAppend(&msg, edges, nEdges*2*sizeof(GlobalTransactionId));
+	} else {
+		ByteBufferAppend(&msg, &hdr, sizeof(hdr));
+		ByteBufferAppend(&msg, added, hdr.nAdded*2*sizeof(GlobalTransactionId));
+		ByteBufferAppend(&msg, removed, hdr.nRemoved*2*sizeof(GlobalTransactionId));
+	}
+	MtmStoreLockGraphEdges(MtmReserveLockGraph(MtmNodeId, nEdges), edges, nEdges);
+	self->lockGraphVersion = hdr.version;
+
+	Assert(replorigin_session_origin == InvalidRepOriginId);
+	lsn = LogLogicalMessage("L", msg.data, msg.used, false);
+
+	MtmUnlockNode(MtmNodeId + MtmMaxNodes);
+
+	MTM_LOG1("Send %s lock graph version %llu: %d edges added, %d removed",
+			 full ? "full" : "delta", (long64)hdr.version, hdr.nAdded, hdr.nRemoved);
+	ByteBufferFree(&msg);
+	pfree(edges);
+	pfree(added);
+	pfree(removed);
+	return lsn;
+}
+
+/*
+ * Apply lock graph message received from the node
+ */
+void MtmUpdateLockGraph(int nodeId, void const* messageBody, int messageSize)
+{
+	MtmNodeInfo* node = &Mtm->nodes[nodeId-1];
+	MtmLockGraphHeader hdr;
+	GlobalTransactionId* added;
+	GlobalTransactionId* removed;
+
+	if (messageSize < sizeof(hdr)) {
+		MTM_ELOG(WARNING, "Ignore corrupted lock graph message of size %d from node %d", messageSize, nodeId);
+		return;
+	}
+	memcpy(&hdr, messageBody, sizeof(hdr));
+	if (messageSize != sizeof(hdr) + (hdr.nAdded + hdr.nRemoved)*2*sizeof(GlobalTransactionId)) {
+		MTM_ELOG(WARNING, "Ignore corrupted lock graph message of size %d from node %d", messageSize, nodeId);
+		return;
+	}
+	/* Copy edges because message body is not aligned */
+	added = (GlobalTransactionId*)palloc(Max(hdr.nAdded + hdr.nRemoved, 1)*2*sizeof(GlobalTransactionId));
+	memcpy(added, (char const*)messageBody + sizeof(hdr), (hdr.nAdded + hdr.nRemoved)*2*sizeof(GlobalTransactionId));
+	removed = added + hdr.nAdded*2;
+
+	MtmLockNode(nodeId + MtmMaxNodes, LW_EXCLUSIVE);
+	if (hdr.baseVersion == 0) {
+		MtmStoreLockGraphEdges(MtmReserveLockGraph(nodeId, hdr.nAdded), added, hdr.nAdded);
+	} else if (hdr.baseVersion == node->lockGraphVersion) {
+		/* Both current graph and changes are sorted, so new graph can be constructed by merging them */
+		GlobalTransactionId* graph = (GlobalTransactionId*)node->lockGraphData;
+		int nEdges = node->lockGraphUsed/(MTM_LOCK_GRAPH_EDGE_SIZE*sizeof(GlobalTransactionId));
+		GlobalTransactionId* edges = (GlobalTransactionId*)palloc((nEdges + hdr.nAdded + 1)*2*sizeof(GlobalTransactionId));
+		int i = 0, j = 0, k = 0, n = 0;
+		while (i < nEdges || j < hdr.nAdded) {
+			GlobalTransactionId* edge;
+			if (j == hdr.nAdded || (i < nEdges && MtmCompareLockGraphEdges(&graph[i*MTM_LOCK_GRAPH_EDGE_SIZE], &added[j*2]) <= 0)) {
+				edge = &graph[i++*MTM_LOCK_GRAPH_EDGE_SIZE];
+			} else {
+				edge = &added[j++*2];
+			}
+			while (k < hdr.nRemoved && MtmCompareLockGraphEdges(&removed[k*2], edge) < 0) {
+				k += 1;
+			}
+			if (k < hdr.nRemoved && MtmCompareLockGraphEdges(&removed[k*2], edge) == 0) {
+				k += 1;
+				continue;
+			}
+			edges[n*2] = edge[0];
+			edges[n*2+1] = edge[1];
+			n += 1;
+		}
+		MtmStoreLockGraphEdges(MtmReserveLockGraph(nodeId, n), edges, n);
+		pfree(edges);
+	} else {
+		MtmArbiterMessage msg;
+		/* Some changes were missed: forget outdated graph and ask node to send the full one */
+		node->lockGraphUsed = 0;
+		node->lockGraphVersion = 0;
+		MtmUnlockNode(nodeId + MtmMaxNodes);
+		pfree(added);
+
+		MTM_LOG1("Lock graph version %llu from node %d doesn't match local version: request full graph", (long64)hdr.baseVersion, nodeId);
+		MtmInitMessage(&msg, MSG_LOCK_GRAPH_RESYNC);
+		msg.node = nodeId;
+		msg.dxid = InvalidTransactionId;
+		msg.sxid = InvalidTransactionId;
+		msg.status = TRANSACTION_STATUS_UNKNOWN;
+		msg.csn = MtmGetCurrentTime();
+		msg.gid[0] = '\0';
+		MtmSendMessage(&msg);
+		return;
 	}
-	memcpy(Mtm->nodes[nodeId-1].lockGraphData, messageBody, messageSize);
-	Mtm->nodes[nodeId-1].lockGraphUsed = messageSize;
+	node->lockGraphVersion = hdr.version;
 	MtmUnlockNode(nodeId + MtmMaxNodes);
-	MTM_LOG1("Update deadlock graph for node %d size %d", nodeId, messageSize);
+	pfree(added);
+	MTM_LOG1("Update deadlock graph for node %d version %llu: %d edges added, %d removed", nodeId, (long64)hdr.version, hdr.nAdded, hdr.nRemoved);
 }
 
 static bool MtmIsTempType(TypeName* typeName)
@@ -5208,7 +7168,7 @@ static void MtmProcessUtility(Node *parsetree, const char *queryString,
 			break;
 	}
 
-	if (!skipCommand && !MtmTx.isReplicated && !MtmDDLStatement)
+	if (!skipCommand && !MtmTx.isReplicated && !MtmDDLStatement && !MtmIsBootstrapPending())
 	{
 		MTM_LOG3("Process DDL statement '%s', MtmTx.isReplicated=%d, MtmIsLogicalReceiver=%d", queryString, MtmTx.isReplicated, MtmIsLogicalReceiver);
 		MtmProcessDDLCommand(queryString, true);
@@ -5281,6 +7241,12 @@ static void MtmProcessUtility(Node *parsetree, const char *queryString,
 static void
 MtmExecutorStart(QueryDesc *queryDesc, int eflags)
 {
+	MtmSamplerSetQueryId(queryDesc->plannedstmt->queryId);
+
+	if (queryDesc->operation != CMD_SELECT || queryDesc->plannedstmt->hasModifyingCTE) {
+		MtmCheckLocalReadWrite();
+	}
+
 	if (!MtmTx.isReplicated && !MtmDDLStatement)
 	{
 		ListCell   *tlist;
@@ -5338,6 +7304,9 @@ MtmExecutorFinish(QueryDesc *queryDesc)
 	if (MtmDoReplication) {
 		CmdType operation = queryDesc->operation;
 		EState *estate = queryDesc->estate;
+		if (operation == CMD_INSERT || operation == CMD_UPDATE || operation == CMD_DELETE) {
+			MtmTx.executedDML = true;
+		}
 		if (estate->es_processed != 0 && (operation == CMD_INSERT || operation == CMD_UPDATE || operation == CMD_DELETE)) {
 			int i;
 			for (i = 0; i < estate->es_num_result_relations; i++) {
@@ -5349,9 +7318,15 @@ MtmExecutorFinish(QueryDesc *queryDesc)
 						}
 						if (rel->rd_replidindex == InvalidOid) {
 							MtmMakeRelationLocal(RelationGetRelid(rel));
+							MtmTx.containsLocalDML = true;
 							continue;
 						}
 					}
+					/* changes of local tables are filtered by walsender, so them do not require 2PC */
+					if (MtmIsLocalRelation(RelationGetRelid(rel))) {
+						MtmTx.containsLocalDML = true;
+						continue;
+					}
 					MTM_LOG3("MtmTx.containsDML = true // WAL");
 					MtmTx.containsDML = true;
 					break;
@@ -5376,14 +7351,114 @@ MtmExecutorFinish(QueryDesc *queryDesc)
 	}
 }
 
+/*
+ * Get increment of the sequence directly from its data page.
+ */
+static int64 MtmGetSequenceIncrement(Oid seqid)
+{
+	Relation rel = relation_open(seqid, NoLock);
+	Buffer buf = ReadBuffer(rel, 0);
+	Page page;
+	ItemId lp;
+	HeapTupleData tuple;
+	int64 increment;
+
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+	lp = PageGetItemId(page, FirstOffsetNumber);
+	Assert(ItemIdIsNormal(lp));
+	tuple.t_data = (HeapTupleHeader) PageGetItem(page, lp);
+	increment = ((Form_pg_sequence) GETSTRUCT(&tuple))->increment_by;
+	UnlockReleaseBuffer(buf);
+	relation_close(rel, NoLock);
+
+	return increment;
+}
+
+/*
+ * Check if the value belongs to the range claimed by this node.
+ * Range announced by aborted transaction is considered to be not claimed.
+ */
+static bool MtmSeqInRange(MtmSeqRange* range, int64 next)
+{
+	if (range->epoch == 0) {
+		return false;
+	}
+	if (TransactionIdIsValid(range->xid)) {
+		if (TransactionIdDidCommit(range->xid)) {
+			range->xid = InvalidTransactionId;
+		} else if (TransactionIdDidAbort(range->xid)) {
+			return false;
+		}
+	}
+	return range->increment > 0 ? next <= range->bound : next >= range->bound;
+}
+
+/*
+ * Announce values of monotonic sequence to other nodes.
+ * Instead of sending message for each value, node claims range of multimaster.monotonic_sequence_range values
+ * and announces only its end. Other nodes adjust their sequences past it, so until value returned by nextval
+ * leaves the range, there is nothing to announce.
+ * Each claimed range gets new epoch, which allows receivers to skip stale announcements.
+ */
 static void MtmSeqNextvalHook(Oid seqid, int64 next)
 {
 	if (MtmMonotonicSequences)
 	{
 		MtmSeqPosition pos;
+		MtmSeqRange* range;
+		int64 span = MtmMonotonicSequenceRange - 1;
+		bool found;
+
+		LWLockAcquire(MtmSeqRangesLock(), LW_EXCLUSIVE);
+		range = (MtmSeqRange*)hash_search(MtmSeqRanges, &seqid, HASH_ENTER_NULL, &found);
+		if (range == NULL) {
+			/* Too many sequences: announce each value */
+			LWLockRelease(MtmSeqRangesLock());
+			pos.seqid = seqid;
+			pos.next = next;
+			pos.epoch = 0;
+			LogLogicalMessage("N", (char*)&pos, sizeof(pos), true);
+			return;
+		}
+		if (!found) {
+			range->increment = 0;
+			range->epoch = 0;
+			range->xid = InvalidTransactionId;
+		}
+		if (MtmSeqInRange(range, next)) {
+			LWLockRelease(MtmSeqRangesLock());
+			return;
+		}
+		if (range->increment == 0) {
+			range->increment = MtmGetSequenceIncrement(seqid);
+		}
+		if ((double)next + (double)span*range->increment >= (double)PG_INT64_MAX) {
+			range->bound = PG_INT64_MAX;
+		} else if ((double)next + (double)span*range->increment <= (double)PG_INT64_MIN) {
+			range->bound = PG_INT64_MIN;
+		} else {
+			range->bound = next + span*range->increment;
+		}
+		/*
+		 * Epochs should increase across restarts of this node, so start them from current time
+		 * rather than from one.
+		 */
+		range->epoch = range->epoch == 0 ? MtmGetSystemTime() : range->epoch + 1;
+		range->xid = InvalidTransactionId;
+
 		pos.seqid = seqid;
-		pos.next = next;
+		pos.next = range->bound;
+		pos.epoch = range->epoch;
+		LWLockRelease(MtmSeqRangesLock());
+
 		LogLogicalMessage("N", (char*)&pos, sizeof(pos), true);
+
+		LWLockAcquire(MtmSeqRangesLock(), LW_EXCLUSIVE);
+		if (range->epoch == pos.epoch) {
+			range->xid = GetCurrentTransactionId();
+		}
+		LWLockRelease(MtmSeqRangesLock());
 	}
 }
 
@@ -5393,13 +7468,13 @@ static void MtmSeqNextvalHook(Oid seqid, int64 next)
  * -------------------------------------------
  */
 
-void MtmExecute(void* work, int size)
+void MtmExecute(void* work, int size, BgwPoolLane lane)
 {
 	if (Mtm->status == MTM_RECOVERY) {
 		/* During recovery apply changes sequentially to preserve commit order */
 		MtmExecutor(work, size);
 	} else {
-		BgwPoolExecute(&Mtm->pool, work, size);
+		BgwPoolExecute(&Mtm->pool, work, size, lane);
 	}
 }
 
@@ -5421,7 +7496,7 @@ MtmGetGtid(TransactionId xid, GlobalTransactionId* gtid)
 	MtmTransState* ts;
 
 	MtmLock(LW_SHARED);
-	ts = (MtmTransState*)hash_search(MtmXid2State, &xid, HASH_FIND, NULL);
+	ts = MtmXidLookup(xid);
 	if (ts != NULL) {
 		*gtid = ts->gtid;
 	} else {
@@ -5486,20 +7561,28 @@ MtmSerializeLock(PROCLOCK* proclock, void* arg)
 static bool
 MtmDetectGlobalDeadLockForXid(TransactionId xid)
 {
+	static MtmGraph graph;  /* reused by subsequent checks to avoid allocation of vertices and edges */
+	static bool graphInitialized;
 	bool hasDeadlock = false;
 	if (TransactionIdIsValid(xid)) {
 		ByteBuffer buf;
-		MtmGraph graph;
 		GlobalTransactionId gtid;
+		XLogRecPtr lsn;
 		int i;
 
 		ByteBufferAlloc(&buf);
 		EnumerateLocks(MtmSerializeLock, &buf);
 
-		Assert(replorigin_session_origin == InvalidRepOriginId);
-		XLogFlush(LogLogicalMessage("L", buf.data, buf.used, false));
+		lsn = MtmSendLockGraph((GlobalTransactionId*)buf.data, buf.used/sizeof(GlobalTransactionId));
+		if (lsn != InvalidXLogRecPtr) {
+			XLogFlush(lsn);
+		}
 
-		MtmGraphInit(&graph);
+		if (!graphInitialized) {
+			MtmGraphInit(&graph);
+			graphInitialized = true;
+		}
+		MtmGraphReset(&graph);
 		MtmGraphAdd(&graph, (GlobalTransactionId*)buf.data, buf.used/sizeof(GlobalTransactionId));
 		ByteBufferFree(&buf);
 		for (i = 0; i < Mtm->nAllNodes; i++) {
@@ -5516,6 +7599,7 @@ MtmDetectGlobalDeadLockForXid(TransactionId xid)
 					return true;
 				} else {
 					MtmGraphAdd(&graph, (GlobalTransactionId*)lockGraphData, lockGraphSize/sizeof(GlobalTransactionId));
+					pfree(lockGraphData);
 				}
 			}
 		}
@@ -6,6 +6,7 @@
 #include "bkb.h"
 
 #include "access/clog.h"
+#include "access/hlc.h"
 #include "pglogical_output/hooks.h"
 #include "commands/vacuum.h"
 #include "libpq-fe.h"
@@ -69,6 +70,7 @@
 #define MULTIMASTER_MAX_CONN_STR_SIZE    128
 #define MULTIMASTER_MAX_HOST_NAME_SIZE   64
 #define MULTIMASTER_MAX_LOCAL_TABLES     256
+#define MULTIMASTER_MAX_SEQUENCES        1024
 #define MULTIMASTER_MAX_CTL_STR_SIZE     256
 #define MULTIMASTER_LOCK_BUF_INIT_SIZE   4096
 #define MULTIMASTER_BROADCAST_SERVICE    "mtm_broadcast"
@@ -82,6 +84,16 @@
 #define USEC_TO_MSEC(t) ((t)/1000)
 #define MSEC_TO_USEC(t) ((timestamp_t)(t)*1000)
 
+/*
+ * Align shared structure or field at the cache line boundary to avoid false sharing.
+ * Without compiler support structures are just not padded.
+ */
+#ifdef pg_attribute_aligned
+#define MTM_CACHE_ALIGNED pg_attribute_aligned(PG_CACHE_LINE_SIZE)
+#else
+#define MTM_CACHE_ALIGNED
+#endif
+
 #define Natts_mtm_ddl_log 2
 #define Anum_mtm_ddl_log_issued		1
 #define Anum_mtm_ddl_log_query		2
@@ -91,8 +103,12 @@
 #define Anum_mtm_local_tables_rel_name	 2
 
 #define Natts_mtm_trans_state   15
-#define Natts_mtm_nodes_state   17
-#define Natts_mtm_cluster_state 21
+#define Natts_mtm_nodes_state   19
+#define Natts_mtm_cluster_state 36
+#define Natts_mtm_pool_stats    17
+#define Natts_mtm_perf_stats    8
+#define Natts_mtm_wait_samples  6
+#define Natts_mtm_trace_events  7
 
 typedef ulong64 csn_t; /* commit serial number */
 #define INVALID_CSN  ((csn_t)-1)
@@ -134,7 +150,8 @@ typedef enum
 	MSG_STATUS,
 	MSG_HEARTBEAT,
 	MSG_POLL_REQUEST,
-	MSG_POLL_STATUS
+	MSG_POLL_STATUS,
+	MSG_LOCK_GRAPH_RESYNC
 } MtmMessageCode;
 
 typedef enum
@@ -172,6 +189,18 @@ typedef struct
 	pgid_t         gid;    /* Global transaction identifier */
 } MtmArbiterMessage;
 
+/*
+ * Messages accumulated to be put in the send queue at once, so that arbiter sender wakes up
+ * once and coalesces them in one write per node.
+ */
+#define MTM_MESSAGE_BATCH_SIZE 64
+
+typedef struct
+{
+	int               nMessages;
+	MtmArbiterMessage messages[MTM_MESSAGE_BATCH_SIZE];
+} MtmMessageBatch;
+
 /*
  * Abort logical message is send by replica when error is happen while applying prepared transaction.
  * In this case we do not have prepared transaction and can not do abort-prepared.
@@ -185,6 +214,20 @@ typedef struct MtmAbortLogicalMessage
 	lsn_t     origin_lsn;
 } MtmAbortLogicalMessage;
 
+/*
+ * Header of lock graph logical message 'L'. Message contains either the whole local wait-for graph
+ * (baseVersion == 0) or changes of the graph since version baseVersion: nAdded added edges followed
+ * by nRemoved removed edges. Each edge is a pair of GlobalTransactionId: waiting transaction and lock owner.
+ * Receiver which has missed some version requests the full graph by MSG_LOCK_GRAPH_RESYNC arbiter message.
+ */
+typedef struct MtmLockGraphHeader
+{
+	uint64    version;     /* version of the graph after applying this message */
+	uint64    baseVersion; /* version of the graph to which changes are applied, 0 for the full graph */
+	int32     nAdded;
+	int32     nRemoved;
+} MtmLockGraphHeader;
+
 typedef struct MtmMessageQueue
 {
 	MtmArbiterMessage msg;
@@ -237,15 +280,18 @@ typedef struct
 	lsn_t       restartLSN;
 	RepOriginId originId;
 	int         timeline;
-	void*       lockGraphData;
+	void*       lockGraphData;         /* Wait-for graph of the node: sorted (waiter,owner,{0,0}) triples. For local node: last sent graph */
 	int         lockGraphAllocated;
 	int         lockGraphUsed;
+	uint64      lockGraphVersion;      /* Version of lockGraphData, 0 if graph was not received yet or is outdated */
 	uint64      nHeartbeats;
+	uint64      receiverStalls;        /* Number of times receiver waited for free space in the apply queue */
+	timestamp_t receiverStallTime;     /* Total time (usec) receiver spent waiting for free space in the apply queue */
 	bool		manualRecovery;
 	bool		slotDeleted;			/* Signalizes that node is already deleted our slot and
 										 * recovery from that node isn't possible.
 										 */
-} MtmNodeInfo;
+} MTM_CACHE_ALIGNED MtmNodeInfo;      /* entries of Mtm->nodes are written by different processes */
 
 typedef struct MtmL2List
 {
@@ -273,6 +319,7 @@ typedef struct MtmTransState
 	bool           isActive;           /* Transaction is active */
 	bool           isTwoPhase;         /* User level 2PC */
 	bool           isPinned;           /* Transaction oid protected from GC */
+	bool           isResolving;        /* Decision about in-doubt transaction is passed to apply worker */
 	int            nConfigChanges;     /* Number of cluster configuration changes at moment of transaction start */
 	nodemask_t     participantsMask;   /* Mask of nodes involved in transaction */
 	nodemask_t     votedMask;          /* Mask of voted nodes */
@@ -287,14 +334,18 @@ typedef struct {
 	MtmTransState* state;
 } MtmTransMap;
 
+/*
+ * Fields of MtmState are grouped by access pattern, each group starts at its own cache line:
+ * mostly read cluster configuration and masks, transaction state updated by every commit under MtmLock,
+ * arbiter message queue, lock-free statistics and pool of apply workers.
+ * So commits do not invalidate cache lines read by all backends.
+ */
 typedef struct
 {
+	/* Cluster configuration and status: read by every transaction, changed rarely */
 	MtmNodeStatus status;              /* Status of this node */
 	int recoverySlot;                  /* NodeId of recovery slot or 0 if none */
-	volatile slock_t queueSpinlock;    /* spinlock used to protect sender queue */
-	PGSemaphoreData sendSemaphore;     /* semaphore used to notify mtm-sender about new responses to coordinator */
 	LWLockPadded *locks;               /* multimaster lock tranche */
-	TransactionId oldestXid;           /* XID of oldest transaction visible by any active transaction (local or global) */
 	nodemask_t disabledNodeMask;       /* Bitmask of disabled nodes */
 	nodemask_t clique;                 /* Bitmask of nodes that are connected and we allowed to connect/send wal/receive wal with them */
 	bool       refereeGrant;           /* Referee allowed us to work with half of the nodes */
@@ -310,7 +361,6 @@ typedef struct
 	nodemask_t originLockNodeMask;     /* Mask of node IDs which WAL-senders are locking the cluster.
 										* MtmNodeId bit is used by recovered node to complete recovery and by MtmLockCluster method */
 	nodemask_t reconnectMask; 	       /* Mask of nodes connection to which has to be reestablished by sender */
-	int        lastLockHolder;         /* PID of process last obtaining the node lock */
 	bool   localTablesHashLoaded;      /* Whether data from local_tables table is loaded in shared memory hash table */
 	bool   preparedTransactionsLoaded; /* GIDs of prepared transactions are loaded at startup */
 	int    inject2PCError;             /* Simulate error during 2PC commit at this node */
@@ -318,16 +368,21 @@ typedef struct
     int    nAllNodes;                  /* Total number of nodes */
     int    nReceivers;                 /* Number of initialized logical receivers (used to determine moment when initialization/recovery is completed) */
     int    nSenders;                   /* Number of started WAL senders (used to determine moment when recovery) */
-	int    nActiveTransactions;        /* Number of active 2PC transactions */
-	int    nRunningTransactions;       /* Number of all running transactions */
 	int    nConfigChanges;             /* Number of cluster configuration changes */
 	int    recoveryCount;              /* Number of completed recoveries */
 	int    donorNodeId;                /* Cluster node from which this node was populated */
-	int64  timeShift;                  /* Local time correction */
-	csn_t  csn;                        /* Last obtained timestamp: used to provide unique ascending CSNs based on system time */
+	csn_t  bootstrapCsn;               /* Global snapshot of data copied by logical bootstrap of this node, INVALID_CSN if none (see bootstrap.c) */
+	int    bootstrapCoordinator;       /* PID of backend executing mtm.bootstrap_node() or 0 */
+	lsn_t recoveredLSN;           /* LSN at the moment of recovery completion */
+	TransactionId* snapshotWaitXids;   /* [ProcGlobal->allProcCount]: in-doubt transaction for which backend waits in visibility check */
+
+	/* Transaction state: updated by every commit, protected by MtmLock */
+	int    lastLockHolder MTM_CACHE_ALIGNED; /* PID of process last obtaining the node lock */
+	TransactionId oldestXid;           /* XID of oldest transaction visible by any active transaction (local or global) */
+	int    nActiveTransactions;        /* Number of active 2PC transactions */
+	int    nRunningTransactions;       /* Number of all running transactions */
+	HybridLogicalClock clock;          /* Source of unique ascending CSNs: system time merged with timestamps received from other nodes */
 	csn_t  lastCsn;                    /* CSN of last committed transaction */
-	MtmTransState* votingTransactions; /* L1-list of replicated transactions notifications to coordinator.
-									 	 This list is used to pass information to mtm-sender BGW */
     MtmTransState* transListHead;      /* L1 list of all finished transactions present in xid2state hash.
 									 	  It is cleanup by MtmGetOldestXmin */
     MtmTransState** transListTail;     /* Tail of L1 list of all finished transactions, used to append new elements.
@@ -335,11 +390,39 @@ typedef struct
 	MtmL2List activeTransList;         /* List of active transactions */
 	ulong64 transCount;                /* Counter of transactions performed by this node */
 	ulong64 gcCount;                   /* Number of global transactions performed since last GC */
+	int64  gcRuns;                     /* Number of GC passes removed some transactions from xid2state */
+	int64  gcRemoved;                  /* Number of transactions removed by GC */
+	int64  gcTime;                     /* Total time (usec) spent in GC */
+	int64  gcMaxPause;                 /* Maximal duration (usec) of GC pass */
+	csn_t  pinnedSnapshot;             /* Oldest snapshot set by mtm.set_snapshot(): GC keeps state of transactions which are not visible in it */
+	int    nPinnedSnapshots;           /* Number of active transactions which have set their snapshot */
+	uint64 lockGraphVersion;           /* Version of the last lock graph sent by this node */
+	bool   lockGraphResync;            /* Some node has requested the full lock graph */
+	MtmTransState* votingTransactions; /* L1-list of replicated transactions notifications to coordinator.
+									 	 This list is used to pass information to mtm-sender BGW */
+
+	/* Queue of arbiter messages, protected by queueSpinlock */
+	volatile slock_t queueSpinlock MTM_CACHE_ALIGNED; /* spinlock used to protect sender queue */
+	PGSemaphoreData sendSemaphore;     /* semaphore used to notify mtm-sender about new responses to coordinator */
 	MtmMessageQueue* sendQueue;        /* Messages to be sent by arbiter sender */
 	MtmMessageQueue* freeQueue;        /* Free messages */
-	lsn_t recoveredLSN;           /* LSN at the moment of recovery completion */
-	BgwPool pool;                      /* Pool of background workers for applying logical replication patches */
-	MtmNodeInfo nodes[1];              /* [Mtm->nAllNodes]: per-node data */
+
+	/* Statistics updated without locks. Commit counters are accumulated by backends locally (see MtmPerfCount) */
+	pg_atomic_uint64 groupCommitDeadline MTM_CACHE_ALIGNED; /* Time when current group of committing transactions is released */
+	pg_atomic_uint32 nSnapshotWaiters; /* Number of backends waiting for in-doubt transactions */
+	pg_atomic_uint64 nSnapshotWaits;   /* Number of waits for in-doubt transactions in visibility checks */
+	pg_atomic_uint64 snapshotWaitTime; /* Total time (usec) spent in such waits */
+	pg_atomic_uint64 nReadOnlyCommits;   /* Number of committed user transactions which executed no DML */
+	pg_atomic_uint64 nEmptyWriteCommits; /* Number of committed user transactions which executed DML but changed no rows */
+	pg_atomic_uint64 nLocalOnlyCommits;  /* Number of committed user transactions which changed only local tables */
+	pg_atomic_uint64 nTwoPhaseCommits;   /* Number of user transactions committed using 2PC */
+	pg_atomic_uint64 nVisibilityCacheHits;   /* Number of visibility checks answered by backend-local cache */
+	pg_atomic_uint64 nVisibilityCacheMisses; /* Number of visibility checks which had to consult xid2state hash */
+	pg_atomic_uint32 bootstrapNextRel;   /* Index of the next relation to be copied by logical bootstrap workers */
+	pg_atomic_uint32 bootstrapCopiedRels;/* Number of relations copied by logical bootstrap workers */
+
+	BgwPool pool MTM_CACHE_ALIGNED;    /* Pool of background workers for applying logical replication patches */
+	MtmNodeInfo nodes[1];              /* [Mtm->nAllNodes]: per-node data, each entry starts at its own cache line */
 } MtmState;
 
 typedef struct MtmFlushPosition
@@ -353,8 +436,9 @@ typedef struct MtmFlushPosition
 
 typedef struct MtmSeqPosition
 {
-	Oid   seqid;
-	int64 next;
+	Oid    seqid;
+	int64  next;   /* last value of the range claimed by the origin node */
+	uint64 epoch;  /* increases with each range claimed for this sequence by the origin node */
 } MtmSeqPosition;
 
 #define MtmIsCoordinator(ts) (ts->gtid.node == MtmNodeId)
@@ -374,12 +458,19 @@ extern char* MtmDatabaseName;
 extern char* MtmDatabaseUser;
 extern int   MtmNodeDisableDelay;
 extern int   MtmTransSpillThreshold;
+extern int   MtmStreamThreshold;
+extern int   MtmReceiveBufferSize;
+extern int   MtmPriorityWorkSize;
 extern int   MtmHeartbeatSendTimeout;
 extern int   MtmHeartbeatRecvTimeout;
+extern int   MtmMaxClockSkew;
+extern int   MtmArbiterCoalesceDelay;
+extern int   MtmArbiterBusyPoll;
 extern bool  MtmUseRDMA;
 extern bool  MtmUseDtm;
+extern bool  MtmQuorumCommit;
 extern bool  MtmPreserveCommitOrder;
-extern HTAB* MtmXid2State;
+extern bool  MtmTrackDependencies;
 extern HTAB* MtmGid2State;
 extern VacuumStmt* MtmVacuumStmt;
 extern IndexStmt*  MtmIndexStmt;
@@ -392,6 +483,11 @@ extern MtmConnectionInfo* MtmConnections;
 extern bool MtmMajorNode;
 extern bool MtmBackgroundWorker;
 extern char* MtmRefereeConnStr;
+extern int   MtmRefereeLease;
+extern bool  MtmLogicalBootstrap;
+extern csn_t MtmReplicationBootstrapCsn;
+extern bool  MtmReplicationFingerprints;
+extern bool  MtmReplicationCompression;
 
 
 extern void  MtmArbiterInitialize(void);
@@ -402,10 +498,12 @@ extern csn_t MtmAssignCSN(void);
 extern csn_t MtmSyncClock(csn_t csn);
 extern void  MtmJoinTransaction(GlobalTransactionId* gtid, csn_t snapshot, nodemask_t participantsMask);
 extern MtmReplicationMode MtmGetReplicationMode(int nodeId, sig_atomic_t volatile* shutdown);
-extern void  MtmExecute(void* work, int size);
+extern void  MtmExecute(void* work, int size, BgwPoolLane lane);
 extern void  MtmExecutor(void* work, size_t size);
 extern void  MtmSend2PCMessage(MtmTransState* ts, MtmMessageCode cmd);
 extern void  MtmSendMessage(MtmArbiterMessage* msg);
+extern void  MtmBatchMessage(MtmMessageBatch* batch, MtmArbiterMessage* msg);
+extern void  MtmSendMessageBatch(MtmMessageBatch* batch);
 extern void  MtmAdjustSubtransactions(MtmTransState* ts);
 extern void  MtmLock(LWLockMode mode);
 extern void  MtmUnlock(void);
@@ -417,10 +515,15 @@ extern void  MtmStopNode(int nodeId, bool dropSlot);
 extern void  MtmRecoverNode(int nodeId);
 extern void  MtmResumeNode(int nodeId);
 extern void  MtmWakeUpBackend(MtmTransState* ts);
+extern bool  MtmVotesCollected(MtmTransState* ts);
 extern void  MtmSleep(timestamp_t interval);
 extern void  MtmAbortTransaction(MtmTransState* ts);
 extern void  MtmSetCurrentTransactionGID(char const* gid);
 extern csn_t MtmGetTransactionCSN(TransactionId xid);
+extern bool  MtmIsCommittedInSnapshot(TransactionId xid, csn_t snapshot);
+extern bool  MtmIsVotingTransaction(TransactionId xid);
+extern MtmTransState* MtmXidLookup(TransactionId xid);
+extern bool  MtmIsBootstrapPending(void);
 extern void  MtmSetCurrentTransactionCSN(csn_t csn);
 extern TransactionId MtmGetCurrentTransactionId(void);
 extern XidStatus MtmGetCurrentTransactionStatus(void);
@@ -443,6 +546,8 @@ extern PGconn *PQconnectdb_safe(const char *conninfo, int timeout);
 extern void MtmBeginSession(int nodeId);
 extern void MtmEndSession(int nodeId, bool unlock);
 extern void MtmFinishPreparedTransaction(MtmTransState* ts, bool commit);
+extern void MtmResolvePreparedTransaction(MtmTransState* ts, bool commit, bool replicate);
+extern void MtmFinishResolvedTransaction(char const* gid, bool commit, bool replicate);
 extern void MtmRollbackPreparedTransaction(int nodeId, char const* gid);
 extern bool MtmFilterTransaction(char* record, int size);
 extern void MtmPrecommitTransaction(char const* gid);
@@ -0,0 +1,259 @@
+/*
+ * perfstat.c
+ *
+ * Counters and latency histograms of multimaster hot paths (see perfstat.h).
+ */
+#include "postgres.h"
+
+#include "storage/shmem.h"
+#include "storage/ipc.h"
+
+#include "multimaster.h"
+#include "perfstat.h"
+
+char const* const MtmPerfMetricName[] =
+{
+	"prepare",
+	"vote",
+	"csn_wait",
+	"visibility_wait",
+	"apply_queue_wait",
+	"priority_queue_wait",
+	"spill_bytes",
+	"arbiter_send_bytes",
+	"arbiter_recv_bytes",
+	"status_refresh",
+	"clique_search",
+	"referee_rtt",
+	"conflict_abort"
+};
+
+bool const MtmPerfMetricIsLatency[] =
+{
+	true,
+	true,
+	true,
+	true,
+	true,
+	true,
+	false,
+	false,
+	false,
+	true,
+	true,
+	true,
+	false
+};
+
+typedef struct
+{
+	uint64 count;
+	uint64 sum;
+	uint64 max;
+	uint64 hist[MTM_PERF_HIST_BUCKETS];
+} MtmPerfLocalStat;
+
+#define MTM_PERF_N_SLOTS (MTM_PERF_N_METRICS*(MAX_NODES+1))
+
+static MtmPerfStat* MtmPerfStats; /* [MTM_PERF_N_METRICS][MAX_NODES+1] in shared memory */
+
+/* Per-process accumulated values which are not yet added to shared counters */
+static MtmPerfLocalStat MtmPerfLocal[MTM_PERF_N_SLOTS];
+static uint16 MtmPerfDirty[MTM_PERF_N_SLOTS]; /* list of slots with non-zero local values */
+static int    MtmPerfNDirty;
+
+/* Per-process deltas of shared counters passed to MtmPerfCount */
+typedef struct
+{
+	pg_atomic_uint64* counter;
+	uint64 delta;
+} MtmPerfLocalCounter;
+
+static MtmPerfLocalCounter MtmPerfCounters[MTM_PERF_MAX_COUNTERS];
+static int    MtmPerfNCounters;
+static timestamp_t MtmPerfLastFlush;
+static bool   MtmPerfExitCallbackRegistered;
+
+Size MtmPerfShmemSize(void)
+{
+	return MAXALIGN(sizeof(MtmPerfStat)*MTM_PERF_N_SLOTS);
+}
+
+void MtmPerfInitialize(void)
+{
+	bool found;
+	MtmPerfStats = (MtmPerfStat*)ShmemInitStruct("MtmPerfStats", MtmPerfShmemSize(), &found);
+	if (!found) {
+		int i, j;
+		for (i = 0; i < MTM_PERF_N_SLOTS; i++) {
+			MtmPerfStat* stat = &MtmPerfStats[i];
+			pg_atomic_init_u64(&stat->count, 0);
+			pg_atomic_init_u64(&stat->sum, 0);
+			pg_atomic_init_u64(&stat->max, 0);
+			for (j = 0; j < MTM_PERF_HIST_BUCKETS; j++) {
+				pg_atomic_init_u64(&stat->hist[j], 0);
+			}
+		}
+	}
+}
+
+static inline int MtmPerfBucket(uint64 value)
+{
+	int bucket = 0;
+	while (value != 0 && bucket < MTM_PERF_HIST_BUCKETS-1) {
+		value >>= 1;
+		bucket += 1;
+	}
+	return bucket;
+}
+
+static void MtmPerfOnExit(int code, Datum arg)
+{
+	MtmPerfFlush(true);
+}
+
+void MtmPerfRecord(MtmPerfMetric metric, int nodeId, uint64 value)
+{
+	int slot = metric*(MAX_NODES+1) + nodeId;
+	MtmPerfLocalStat* local = &MtmPerfLocal[slot];
+
+	Assert(nodeId >= 0 && nodeId <= MAX_NODES);
+	if (local->count == 0) {
+		MtmPerfDirty[MtmPerfNDirty++] = (uint16)slot;
+	}
+	local->count += 1;
+	local->sum += value;
+	if (value > local->max) {
+		local->max = value;
+	}
+	if (MtmPerfMetricIsLatency[metric]) {
+		local->hist[MtmPerfBucket(value)] += 1;
+	}
+	MtmPerfFlush(false);
+}
+
+/*
+ * Add delta to the shared counter lazily, together with other locally accumulated values.
+ * Used for counters incremented by every transaction, so that backends do not contend for their cache line.
+ */
+void MtmPerfCount(pg_atomic_uint64* counter, uint64 delta)
+{
+	int i;
+	for (i = 0; i < MtmPerfNCounters && MtmPerfCounters[i].counter != counter; i++);
+
+	if (i == MtmPerfNCounters) {
+		if (i == MTM_PERF_MAX_COUNTERS) {
+			pg_atomic_fetch_add_u64(counter, delta);
+			return;
+		}
+		MtmPerfCounters[i].counter = counter;
+		MtmPerfCounters[i].delta = 0;
+		MtmPerfNCounters += 1;
+	}
+	MtmPerfCounters[i].delta += delta;
+	MtmPerfFlush(false);
+}
+
+/*
+ * Add locally accumulated values to shared counters.
+ * Unless force is true, it is done only if MTM_PERF_FLUSH_INTERVAL has passed since the last flush.
+ */
+void MtmPerfFlush(bool force)
+{
+	timestamp_t now;
+	int i, j;
+
+	if ((MtmPerfNDirty == 0 && MtmPerfNCounters == 0) || MtmPerfStats == NULL) {
+		return;
+	}
+	now = MtmGetSystemTime();
+	if (!force && now - MtmPerfLastFlush < MTM_PERF_FLUSH_INTERVAL) {
+		return;
+	}
+	if (!MtmPerfExitCallbackRegistered) {
+		on_shmem_exit(MtmPerfOnExit, 0);
+		MtmPerfExitCallbackRegistered = true;
+	}
+	MtmPerfLastFlush = now;
+
+	for (i = 0; i < MtmPerfNDirty; i++) {
+		int slot = MtmPerfDirty[i];
+		MtmPerfLocalStat* local = &MtmPerfLocal[slot];
+		MtmPerfStat* stat = &MtmPerfStats[slot];
+		uint64 max = pg_atomic_read_u64(&stat->max);
+
+		pg_atomic_fetch_add_u64(&stat->count, local->count);
+		pg_atomic_fetch_add_u64(&stat->sum, local->sum);
+		while (local->max > max) {
+			if (pg_atomic_compare_exchange_u64(&stat->max, &max, local->max)) {
+				break;
+			}
+		}
+		for (j = 0; j < MTM_PERF_HIST_BUCKETS; j++) {
+			if (local->hist[j] != 0) {
+				pg_atomic_fetch_add_u64(&stat->hist[j], local->hist[j]);
+			}
+		}
+		memset(local, 0, sizeof(*local));
+	}
+	MtmPerfNDirty = 0;
+
+	for (i = 0; i < MtmPerfNCounters; i++) {
+		pg_atomic_fetch_add_u64(MtmPerfCounters[i].counter, MtmPerfCounters[i].delta);
+	}
+	MtmPerfNCounters = 0;
+}
+
+/*
+ * Reset shared counters. Values concurrently flushed by other processes may be partially preserved.
+ */
+void MtmPerfReset(void)
+{
+	int i, j;
+	for (i = 0; i < MTM_PERF_N_SLOTS; i++) {
+		MtmPerfStat* stat = &MtmPerfStats[i];
+		pg_atomic_write_u64(&stat->count, 0);
+		pg_atomic_write_u64(&stat->sum, 0);
+		pg_atomic_write_u64(&stat->max, 0);
+		for (j = 0; j < MTM_PERF_HIST_BUCKETS; j++) {
+			pg_atomic_write_u64(&stat->hist[j], 0);
+		}
+	}
+}
+
+MtmPerfStat* MtmPerfGetStat(MtmPerfMetric metric, int nodeId)
+{
+	return &MtmPerfStats[metric*(MAX_NODES+1) + nodeId];
+}
+
+/*
+ * Estimate percentile using histogram: upper bound of the bucket containing it is returned
+ * (but not larger than the maximal observed value).
+ */
+uint64 MtmPerfPercentile(MtmPerfStat* stat, double fraction)
+{
+	uint64 hist[MTM_PERF_HIST_BUCKETS];
+	uint64 total = 0, rank, sum = 0;
+	uint64 max = pg_atomic_read_u64(&stat->max);
+	int i;
+
+	for (i = 0; i < MTM_PERF_HIST_BUCKETS; i++) {
+		hist[i] = pg_atomic_read_u64(&stat->hist[i]);
+		total += hist[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	rank = (uint64)(total*fraction);
+	if (rank >= total) {
+		rank = total - 1;
+	}
+	for (i = 0; i < MTM_PERF_HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum > rank) {
+			uint64 bound = i == 0 ? 0 : ((uint64)1 << i) - 1;
+			return Min(bound, max);
+		}
+	}
+	return max;
+}
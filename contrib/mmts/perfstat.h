@@ -0,0 +1,57 @@
+#ifndef __PERFSTAT_H__
+#define __PERFSTAT_H__
+
+#include "port/atomics.h"
+
+/*
+ * Hot path statistics: counters and latency histograms.
+ *
+ * Each process accumulates values locally and adds them to shared memory counters
+ * not more often than once per MTM_PERF_FLUSH_INTERVAL, so recording a value costs
+ * only a few local increments. Metrics related to other nodes are kept per node,
+ * other ones are kept in the slot of node 0.
+ */
+
+#define MTM_PERF_HIST_BUCKETS  32     /* bucket i > 0 counts values in [2^(i-1), 2^i), bucket 0 counts zeros */
+#define MTM_PERF_FLUSH_INTERVAL 100000 /* usec */
+#define MTM_PERF_MAX_COUNTERS  16     /* shared counters which can be accumulated locally by MtmPerfCount */
+
+typedef enum
+{
+	MTM_PERF_PREPARE,            /* coordinator: prepare of distributed transaction including 2PC voting (usec) */
+	MTM_PERF_VOTE,               /* coordinator: round trip from start of prepare to PREPARED vote of the node (usec) */
+	MTM_PERF_CSN_WAIT,           /* coordinator: wait for votes and global CSN of the transaction (usec) */
+	MTM_PERF_VISIBILITY_WAIT,    /* sleep of visibility check until in-doubt transaction is resolved (usec) */
+	MTM_PERF_APPLY_QUEUE_WAIT,   /* time which work item spent in bulk lane of apply workers queue (usec) */
+	MTM_PERF_PRIORITY_QUEUE_WAIT,/* time which work item spent in priority lane of apply workers queue (usec) */
+	MTM_PERF_SPILL_BYTES,        /* bytes of replicated transactions written to spill files */
+	MTM_PERF_ARBITER_SEND_BYTES, /* bytes sent by arbiter to the node */
+	MTM_PERF_ARBITER_RECV_BYTES, /* bytes received by arbiter from the node */
+	MTM_PERF_STATUS_REFRESH,     /* monitor: refresh of cluster status, including wait for stable clique (usec) */
+	MTM_PERF_CLIQUE_SEARCH,      /* monitor: search of maximum clique when previous one can not be reused (usec) */
+	MTM_PERF_REFEREE_RTT,        /* monitor: round trip of request to referee (usec) */
+	MTM_PERF_CONFLICT_ABORT,     /* bytes of replicated transactions aborted by conflict of write-set fingerprints */
+	MTM_PERF_N_METRICS
+} MtmPerfMetric;
+
+typedef struct
+{
+	pg_atomic_uint64 count;
+	pg_atomic_uint64 sum;
+	pg_atomic_uint64 max;
+	pg_atomic_uint64 hist[MTM_PERF_HIST_BUCKETS];
+} MtmPerfStat;
+
+extern char const* const MtmPerfMetricName[];
+extern bool const MtmPerfMetricIsLatency[];
+
+extern Size MtmPerfShmemSize(void);
+extern void MtmPerfInitialize(void);
+extern void MtmPerfRecord(MtmPerfMetric metric, int nodeId, uint64 value);
+extern void MtmPerfCount(pg_atomic_uint64* counter, uint64 delta);
+extern void MtmPerfFlush(bool force);
+extern void MtmPerfReset(void);
+extern MtmPerfStat* MtmPerfGetStat(MtmPerfMetric metric, int nodeId);
+extern uint64 MtmPerfPercentile(MtmPerfStat* stat, double fraction);
+
+#endif
@@ -6,6 +6,7 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/relscan.h"
 #include "access/xact.h"
@@ -58,6 +59,11 @@
 #include "pglogical_relid_map.h"
 #include "spill.h"
 #include "state.h"
+#include "writeset.h"
+#include "perfstat.h"
+#include "sampler.h"
+#include "trace.h"
+#include "hintbits.h"
 
 typedef struct TupleData
 {
@@ -75,7 +81,7 @@ static bool find_pkey_tuple(ScanKey skey, Relation rel, Relation idxrel,
 static void build_index_scan_keys(EState *estate, ScanKey *scan_keys, TupleData *tup);
 static bool build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, TupleData *tup);
 static void UserTableUpdateOpenIndexes(EState *estate, TupleTableSlot *slot);
-static void UserTableUpdateIndexes(EState *estate, TupleTableSlot *slot);
+static bool fill_pkey_scan_key(ScanKey skey, PGLRelApplyInfo *info, TupleData *tup);
 
 static bool process_remote_begin(StringInfo s);
 static bool process_remote_message(StringInfo s);
@@ -85,6 +91,44 @@ static void process_remote_update(StringInfo s, Relation rel);
 static void process_remote_delete(StringInfo s, Relation rel);
 
 static bool          GucAltered; /* transaction is setting some GUC variables */
+static char*         MtmAppliedGucPrelude; /* GUC context of the last applied DDL statement */
+
+/*
+ * Consecutive inserts into the same relation are buffered and written by heap_multi_insert.
+ * Limits are the same as used by COPY.
+ */
+#define MTM_MULTI_INSERT_MAX_TUPLES 1000
+#define MTM_MULTI_INSERT_MAX_BYTES  65535
+
+/*
+ * Executor state of relation modified by remote transaction.
+ * It is created on the first change of the relation and kept until the end of transaction,
+ * so that executor state is created and indexes are opened only once per relation instead of once per row.
+ */
+typedef struct MtmApplyRelation
+{
+	Oid              relid;
+	Relation         rel;          /* own reference to the relation */
+	EState*          estate;       /* executor state with single result relation and open indexes */
+	TupleTableSlot*  newslot;
+	TupleTableSlot*  oldslot;
+	BulkInsertState  bistate;
+	PGLRelApplyInfo* info;         /* apply descriptor with replica identity index */
+	Relation         pkey;         /* replica identity index opened by executor or NULL */
+	MemoryContext    tuple_context; /* context of buffered tuples */
+	HeapTuple        pending[MTM_MULTI_INSERT_MAX_TUPLES]; /* buffered inserts */
+	int              n_pending;
+	Size             pending_size;
+	struct MtmApplyRelation* next;
+} MtmApplyRelation;
+
+static MemoryContext     MtmApplyTxnContext; /* lifetime of remote transaction */
+static MtmApplyRelation* MtmApplyRelations;
+
+static MtmApplyRelation* get_apply_relation(Relation rel);
+static void flush_apply_relation(MtmApplyRelation* ar);
+static void flush_apply_relations(void);
+static void release_apply_relations(bool commit);
 
 /*
  * Search the index 'idxrel' for a tuple identified by 'skey' in 'rel'.
@@ -279,16 +323,34 @@ build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, TupleData *tup
 	return hasnulls;
 }
 
-static void
-UserTableUpdateIndexes(EState *estate, TupleTableSlot *slot)
+/*
+ * Setup a ScanKey for a search of tuple 'tup' in replica identity index using prebuilt templates
+ * of relation apply descriptor.
+ *
+ * Returns whether any column contains NULLs.
+ */
+static bool
+fill_pkey_scan_key(ScanKey skey, PGLRelApplyInfo *info, TupleData *tup)
 {
-	/* HOT update does not require index inserts */
-	if (HeapTupleIsHeapOnly(slot->tts_tuple))
-		return;
+	int		attoff;
+	bool	hasnulls = false;
+
+	for (attoff = 0; attoff < info->nkeys; attoff++)
+	{
+		int mainattno = info->attnums[attoff];
 
-	ExecOpenIndices(estate->es_result_relation_info, false);
-	UserTableUpdateOpenIndexes(estate, slot);
-	ExecCloseIndices(estate->es_result_relation_info);
+		skey[attoff] = info->skey[attoff];
+		/* function cache of template should not be shared */
+		fmgr_info_copy(&skey[attoff].sk_func, &info->skey[attoff].sk_func, CurrentMemoryContext);
+		skey[attoff].sk_argument = tup->values[mainattno - 1];
+
+		if (tup->isnull[mainattno - 1])
+		{
+			hasnulls = true;
+			skey[attoff].sk_flags |= SK_ISNULL;
+		}
+	}
+	return hasnulls;
 }
 
 static void
@@ -336,13 +398,190 @@ create_rel_estate(Relation rel)
 	return estate;
 }
 
+static MtmApplyRelation*
+get_apply_relation(Relation rel)
+{
+	MtmApplyRelation* ar;
+	MemoryContext old_context;
+	ResultRelInfo* relinfo;
+	Oid relid = RelationGetRelid(rel);
+	int i;
+
+	for (ar = MtmApplyRelations; ar != NULL; ar = ar->next) {
+		if (ar->relid == relid) {
+			return ar;
+		}
+	}
+	if (MtmApplyTxnContext == NULL) {
+		MtmApplyTxnContext = AllocSetContextCreate(TopMemoryContext,
+												   "ApplyTransactionContext",
+												   ALLOCSET_DEFAULT_MINSIZE,
+												   ALLOCSET_DEFAULT_INITSIZE,
+												   ALLOCSET_DEFAULT_MAXSIZE);
+	}
+	old_context = MemoryContextSwitchTo(MtmApplyTxnContext);
+
+	ar = (MtmApplyRelation*)palloc(sizeof(MtmApplyRelation));
+	ar->relid = relid;
+	ar->rel = heap_open(relid, NoLock);
+	ar->estate = create_rel_estate(ar->rel);
+	ar->newslot = ExecInitExtraTupleSlot(ar->estate);
+	ar->oldslot = ExecInitExtraTupleSlot(ar->estate);
+	ExecSetSlotDescriptor(ar->newslot, RelationGetDescr(ar->rel));
+	ExecSetSlotDescriptor(ar->oldslot, RelationGetDescr(ar->rel));
+	ExecOpenIndices(ar->estate->es_result_relation_info, false);
+	ar->bistate = GetBulkInsertState();
+	ar->info = pglogical_apply_info_get(ar->rel);
+	ar->pkey = NULL;
+	relinfo = ar->estate->es_result_relation_info;
+	for (i = 0; i < relinfo->ri_NumIndices; i++) {
+		if (RelationGetRelid(relinfo->ri_IndexRelationDescs[i]) == ar->info->pkey_relid) {
+			ar->pkey = relinfo->ri_IndexRelationDescs[i];
+			break;
+		}
+	}
+	ar->tuple_context = AllocSetContextCreate(MtmApplyTxnContext,
+											  "ApplyInsertContext",
+											  ALLOCSET_DEFAULT_MINSIZE,
+											  ALLOCSET_DEFAULT_INITSIZE,
+											  ALLOCSET_DEFAULT_MAXSIZE);
+	ar->n_pending = 0;
+	ar->pending_size = 0;
+	ar->next = MtmApplyRelations;
+	MtmApplyRelations = ar;
+
+	MemoryContextSwitchTo(old_context);
+	return ar;
+}
+
+/*
+ * Write buffered inserts of the relation and insert index entries for them
+ */
+static void
+flush_apply_relation(MtmApplyRelation* ar)
+{
+	int i;
+
+	if (ar->n_pending == 0) {
+		return;
+	}
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	heap_multi_insert(ar->rel, ar->pending, ar->n_pending, GetCurrentCommandId(true), 0, ar->bistate);
+	for (i = 0; i < ar->n_pending; i++) {
+		MtmHintAddTuple(ar->rel, &ar->pending[i]->t_self);
+		ExecStoreTuple(ar->pending[i], ar->newslot, InvalidBuffer, false);
+		UserTableUpdateOpenIndexes(ar->estate, ar->newslot);
+		ResetPerTupleExprContext(ar->estate);
+	}
+	ExecClearTuple(ar->newslot);
+
+	PopActiveSnapshot();
+
+	ar->n_pending = 0;
+	ar->pending_size = 0;
+	MemoryContextReset(ar->tuple_context);
+
+	CommandCounterIncrement();
+}
+
+/*
+ * Buffered inserts should be written before any other change is applied
+ */
+static void
+flush_apply_relations(void)
+{
+	MtmApplyRelation* ar;
+	for (ar = MtmApplyRelations; ar != NULL; ar = ar->next) {
+		flush_apply_relation(ar);
+	}
+}
+
+/*
+ * Release executor state of all relations modified by the transaction.
+ * In case of abort indexes and relations are closed by resource owner, so we just forget about them.
+ */
+static void
+release_apply_relations(bool commit)
+{
+	MtmApplyRelation* ar;
+
+	if (commit) {
+		flush_apply_relations();
+		for (ar = MtmApplyRelations; ar != NULL; ar = ar->next) {
+			FreeBulkInsertState(ar->bistate);
+			ExecCloseIndices(ar->estate->es_result_relation_info);
+			ExecResetTupleTable(ar->estate->es_tupleTable, true);
+			FreeExecutorState(ar->estate);
+			heap_close(ar->rel, NoLock);
+		}
+	}
+	MtmApplyRelations = NULL;
+	if (MtmApplyTxnContext != NULL) {
+		MemoryContextReset(MtmApplyTxnContext);
+	}
+}
+
+/*
+ * Epochs of sequence ranges applied by this worker, see MtmSeqNextvalHook.
+ */
+typedef struct
+{
+	Oid    seqid;
+	int    node;
+} MtmSeqEpochKey;
+
+typedef struct
+{
+	MtmSeqEpochKey key;
+	uint64 epoch;
+} MtmSeqEpoch;
+
+static HTAB* MtmSeqEpochs;
+
+/*
+ * Check if sequence range announced by the node is newer than all ranges of this sequence
+ * announced by it which were already applied by this worker. Older announcements can arrive
+ * when transactions are applied in parallel or replayed during recovery; they are already
+ * covered by the newer range, so adjusting sequence for them is a waste of time.
+ */
+static bool
+MtmIsNewSequenceRange(Oid seqid, uint64 epoch)
+{
+	MtmSeqEpochKey key;
+	MtmSeqEpoch* entry;
+	bool found;
+
+	if (epoch == 0) {
+		/* origin didn't claim a range for this value */
+		return true;
+	}
+	if (MtmSeqEpochs == NULL) {
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(MtmSeqEpochKey);
+		info.entrysize = sizeof(MtmSeqEpoch);
+		info.hcxt = TopMemoryContext;
+		MtmSeqEpochs = hash_create("MtmSeqEpochs", MULTIMASTER_MAX_SEQUENCES, &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+	memset(&key, 0, sizeof(key));
+	key.seqid = seqid;
+	key.node = MtmReplicationNodeId;
+	entry = (MtmSeqEpoch*)hash_search(MtmSeqEpochs, &key, HASH_ENTER, &found);
+	if (found && entry->epoch >= epoch) {
+		return false;
+	}
+	entry->epoch = epoch;
+	return true;
+}
+
 static bool
 process_remote_begin(StringInfo s)
 {
 	GlobalTransactionId gtid;
 	csn_t snapshot;
 	nodemask_t participantsMask;
-	int rc;
 
 	gtid.node = pq_getmsgint(s, 4); 
 	gtid.xid = pq_getmsgint64(s); 
@@ -350,24 +589,70 @@ process_remote_begin(StringInfo s)
 	participantsMask = pq_getmsgint64(s);
 	Assert(gtid.node > 0);
 
+	/* BEGIN contains id of the sender node (also in recovery mode): remember it in apply worker */
+	MtmReplicationNodeId = gtid.node;
+
 	MTM_LOG2("REMOTE begin node=%d xid=%llu snapshot=%lld participantsMask=%llx", gtid.node, (long64)gtid.xid, snapshot, participantsMask);
 	MtmResetTransaction();		
+	MtmHintReset();
 
     SetCurrentStatementStartTimestamp();     
 	StartTransactionCommand();
     MtmJoinTransaction(&gtid, snapshot, participantsMask);
 
-	if (GucAltered) {
-		SPI_connect();
-		GucAltered = false;
-		rc = SPI_execute("RESET SESSION AUTHORIZATION; reset all;", false, 0);
-		SPI_finish();
-		if (rc < 0) { 
-			MTM_ELOG(ERROR, "Failed to set reset context: %d", rc);
-		}
+	return true;
+}
+
+/*
+ * Restore default GUC context altered by replicated DDL statements.
+ * It is done lazily: before applying data changes or non-transactional statement,
+ * so that sequence of DDL statements with the same GUC context doesn't need to reset and set it again.
+ */
+static void
+MtmResetRemoteGucs(void)
+{
+	int rc;
+
+	SPI_connect();
+	rc = SPI_execute("RESET SESSION AUTHORIZATION; reset all;", false, 0);
+	SPI_finish();
+	if (rc < 0) { 
+		MTM_ELOG(ERROR, "Failed to set reset context: %d", rc);
 	}
+	GucAltered = false;
+	if (MtmAppliedGucPrelude != NULL) {
+		pfree(MtmAppliedGucPrelude);
+		MtmAppliedGucPrelude = NULL;
+	}
+}
 
-	return true;
+/*
+ * Set GUC context of DDL statement unless it is the same as applied for the previous one.
+ */
+static void
+MtmApplyGucPrelude(char const* prelude)
+{
+	char* resetAndSet;
+	int rc;
+
+	if (GucAltered && MtmAppliedGucPrelude != NULL && strcmp(MtmAppliedGucPrelude, prelude) == 0) {
+		MTM_LOG3("%d: Skip already applied GUC context %s", MyProcPid, prelude);
+		return;
+	}
+	if (MtmAppliedGucPrelude != NULL) {
+		pfree(MtmAppliedGucPrelude);
+		MtmAppliedGucPrelude = NULL;
+	}
+	GucAltered = true;
+	resetAndSet = psprintf("RESET SESSION AUTHORIZATION; reset all; %s", prelude);
+	SPI_connect();
+	rc = SPI_execute(resetAndSet, false, 0);
+	SPI_finish();
+	if (rc < 0) { 
+		MTM_ELOG(ERROR, "Failed to set GUC context %s", prelude);
+	}
+	pfree(resetAndSet);
+	MtmAppliedGucPrelude = MemoryContextStrdup(TopMemoryContext, prelude);
 }
 
 static bool
@@ -386,13 +671,21 @@ process_remote_message(StringInfo s)
 			SetCurrentStatementStartTimestamp();
 			MtmResetTransaction();
 			StartTransactionCommand();
+			if (GucAltered) {
+				MtmResetRemoteGucs();
+			}
 			standalone = true;
 			/* intentional falldown to the next case */
 		}
 		case 'D':
 		{
 			int rc;
-			GucAltered = true;
+			if (!standalone) {
+				/* message contains GUC context followed by the statement itself */
+				MtmApplyGucPrelude(messageBody);
+				messageBody += strlen(messageBody) + 1;
+				Assert(messageBody < s->data + s->cursor);
+			}
 			MTM_LOG1("%d: Executing utility statement %s", MyProcPid, messageBody);
 			SPI_connect();
 			ActivePortal->sourceText = messageBody;
@@ -487,6 +780,28 @@ process_remote_message(StringInfo s)
 			standalone = true;
 			break;
 		}
+		case 'G':
+		{
+			/* batch of abort and lock graph messages, each of them is prefixed with its LSN at sender */
+			StringInfoData batch;
+			lsn_t walEnd = MtmSenderWalEnd;
+
+			batch.data = (char*)messageBody;
+			batch.len = messageSize;
+			batch.maxlen = -1;
+			batch.cursor = 0;
+			MTM_LOG3("%lld: Process batch of control messages with size %d from %d", MtmGetSystemTime(), messageSize, MtmReplicationNodeId);
+			while (batch.cursor < batch.len) {
+				MtmSenderWalEnd = pq_getmsgint64(&batch);
+				if (pq_getmsgbyte(&batch) != 'M') {
+					MTM_ELOG(ERROR, "Malformed batch of control messages from node %d", MtmReplicationNodeId);
+				}
+				process_remote_message(&batch);
+			}
+			MtmSenderWalEnd = walEnd;
+			standalone = true;
+			break;
+		}
 	    case 'S':
 		{
   		    Assert(messageSize == sizeof(csn_t));
@@ -618,36 +933,50 @@ close_rel(Relation rel)
 	} 		
 }
 
+/*
+ * Relation is identified by its Oid at the sender node. Its name is sent only once per transaction,
+ * so mapping to local relation is kept in the map shared by all apply workers.
+ */
 static Relation 
 read_rel(StringInfo s, LOCKMODE mode)
 {
 	int			relnamelen;
 	int			nspnamelen;
-	RangeVar*	rv;
+	RangeVar*	rv = NULL;
 	Oid			remote_relid = pq_getmsgint(s, 4);
 	Oid         local_relid;
-	MemoryContext old_context;
+	Relation    rel;
 
-	local_relid = pglogical_relid_map_get(remote_relid);
-	if (local_relid == InvalidOid) { 
+	nspnamelen = pq_getmsgbyte(s);
+	if (nspnamelen != 0) {
 		rv = makeNode(RangeVar);
-
-		nspnamelen = pq_getmsgbyte(s);
 		rv->schemaname = (char *) pq_getmsgbytes(s, nspnamelen);
-		
 		relnamelen = pq_getmsgbyte(s);
 		rv->relname = (char *) pq_getmsgbytes(s, relnamelen);
-		
-		local_relid = RangeVarGetRelidExtended(rv, mode, false, false, NULL, NULL);
-		old_context = MemoryContextSwitchTo(TopMemoryContext);
-		pglogical_relid_map_put(remote_relid, local_relid);
-		MemoryContextSwitchTo(old_context);
-	} else { 
-		nspnamelen = pq_getmsgbyte(s);
-		s->cursor += nspnamelen;
+	} else {
 		relnamelen = pq_getmsgbyte(s);
 		s->cursor += relnamelen;
 	}
+
+	local_relid = pglogical_shared_relid_map_get(MtmReplicationNodeId, remote_relid);
+	if (local_relid != InvalidOid) {
+		rel = try_relation_open(local_relid, mode);
+		if (rel != NULL) {
+			/* Relation may be dropped at sender and its Oid reused, so check name when it is known */
+			if (rv == NULL
+				|| (strcmp(RelationGetRelationName(rel), rv->relname) == 0
+					&& RelationGetNamespace(rel) == get_namespace_oid(rv->schemaname, true)))
+			{
+				return rel;
+			}
+			relation_close(rel, mode);
+		}
+	}
+	if (rv == NULL) {
+		MTM_ELOG(ERROR, "Relation %u of node %d is not known", remote_relid, MtmReplicationNodeId);
+	}
+	local_relid = RangeVarGetRelidExtended(rv, mode, false, false, NULL, NULL);
+	pglogical_shared_relid_map_put(MtmReplicationNodeId, remote_relid, local_relid);
 	return heap_open(local_relid, NoLock);
 }
 
@@ -706,6 +1035,11 @@ process_remote_commit(StringInfo in)
 		{
 			Assert(IsTransactionState() && TransactionIdIsValid(MtmGetCurrentTransactionId()));
 			strncpy(gid, pq_getmsgstring(in), sizeof gid);
+			if (in->cursor < in->len && in->data[in->cursor] == 'W') {
+				/* skip write-set fingerprint: it is checked by receiver */
+				in->cursor += 1;
+				in->cursor += pq_getmsgint(in, 2)*4;
+			}
 			MTM_LOG2("%d: PGLOGICAL_PREPARE %s, (%llx,%llx,%llx)", MyProcPid, gid, commit_lsn, end_lsn, origin_lsn);
 			if (MtmExchangeGlobalTransactionStatus(gid, TRANSACTION_STATUS_IN_PROGRESS) == TRANSACTION_STATUS_ABORTED) { 
 				MTM_LOG1("Avoid prepare of previously aborted global transaction %s", gid);	
@@ -718,7 +1052,9 @@ process_remote_commit(StringInfo in)
 				
 				MtmBeginSession(origin_node);
 				/* PREPARE itself */
+				MtmTraceRecord(gid, MTM_TRACE_REPLICA_PREPARE_START, 0, 0);
 				MtmSetCurrentTransactionGID(gid);
+				MtmHintPublish(gid, GetTopTransactionIdIfAny());
 				PrepareTransactionBlock(gid);
 				CommitTransactionCommand();
 
@@ -759,7 +1095,9 @@ process_remote_commit(StringInfo in)
 			TXFINISH("%s COMMIT, PGLOGICAL_COMMIT_PREPARED csn=%lld", gid, csn);
 			FinishPreparedTransaction(gid, true);
 			MTM_LOG2("Distributed transaction %s is committed", gid);
+			MtmHintCommitPrepared(gid);
 			CommitTransactionCommand();
+			MtmTraceRecord(gid, MTM_TRACE_REPLICA_COMMIT, 0, csn);
 			Assert(!MtmTransIsActive());
 			MtmEndSession(origin_node, true);
 			break;
@@ -771,6 +1109,7 @@ process_remote_commit(StringInfo in)
 			/* MtmRollbackPreparedTransaction will set origin session itself */
 			MTM_LOG1("Receive ABORT_PREPARED logical message for transaction %s from node %d", gid, origin_node);
 			MtmRollbackPreparedTransaction(origin_node, gid);
+			MtmTraceRecord(gid, MTM_TRACE_REPLICA_ABORT, 0, 0);
 			break;
 		}
 		default:
@@ -785,29 +1124,24 @@ process_remote_commit(StringInfo in)
 static void
 process_remote_insert(StringInfo s, Relation rel)
 {
-	EState *estate;
+	MtmApplyRelation* ar;
 	TupleData new_tuple;
-	TupleTableSlot *newslot;
-	TupleTableSlot *oldslot;
+	HeapTuple tup;
 	ResultRelInfo *relinfo;
 	ScanKey	*index_keys;
+	MemoryContext old_context;
 	int	i;
 
-	PushActiveSnapshot(GetTransactionSnapshot());
+	ar = get_apply_relation(rel);
 
-	estate = create_rel_estate(rel);
-	newslot = ExecInitExtraTupleSlot(estate);
-	oldslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(newslot, RelationGetDescr(rel));
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel));
+	PushActiveSnapshot(GetTransactionSnapshot());
 
 	read_tuple_parts(s, rel, &new_tuple);
-	{
-		HeapTuple tup;
-		tup = heap_form_tuple(RelationGetDescr(rel),
-							  new_tuple.values, new_tuple.isnull);
-		ExecStoreTuple(tup, newslot, InvalidBuffer, true);
-	}
+
+	old_context = MemoryContextSwitchTo(ar->tuple_context);
+	tup = heap_form_tuple(RelationGetDescr(rel),
+						  new_tuple.values, new_tuple.isnull);
+	MemoryContextSwitchTo(old_context);
 
 	// if (rel->rd_rel->relkind != RELKIND_RELATION) // RELKIND_MATVIEW
 	// 	MTM_ELOG(ERROR, "unexpected relkind '%c' rel \"%s\"",
@@ -815,17 +1149,18 @@ process_remote_insert(StringInfo s, Relation rel)
 
 	/* debug output */
 #ifdef VERBOSE_INSERT
-	log_tuple("INSERT:%s", RelationGetDescr(rel), newslot->tts_tuple);
+	log_tuple("INSERT:%s", RelationGetDescr(rel), tup);
 #endif
 
 	/*
 	 * Search for conflicting tuples.
+	 * Buffered tuples are not visible here, but them can not conflict with each other:
+	 * origin node has already checked unique constraints for them.
 	 */
-	ExecOpenIndices(estate->es_result_relation_info, false);
-	relinfo = estate->es_result_relation_info;
+	relinfo = ar->estate->es_result_relation_info;
 	index_keys = palloc0(relinfo->ri_NumIndices * sizeof(ScanKeyData*));
 
-	build_index_scan_keys(estate, index_keys, &new_tuple);
+	build_index_scan_keys(ar->estate, index_keys, &new_tuple);
 
 	/* do a SnapshotDirty search for conflicting tuples */
 	for (i = 0; i < relinfo->ri_NumIndices; i++)
@@ -851,7 +1186,7 @@ process_remote_insert(StringInfo s, Relation rel)
 		/* if conflict: wait */
 		found = find_pkey_tuple(index_keys[i],
 								rel, relinfo->ri_IndexRelationDescs[i],
-								oldslot, true, LockTupleExclusive);
+								ar->oldslot, true, LockTupleExclusive);
 
 		/* alert if there's more than one conflicting unique key */
 		if (found)
@@ -864,40 +1199,54 @@ process_remote_insert(StringInfo s, Relation rel)
 		}
 		CHECK_FOR_INTERRUPTS();
 	}
-
-	simple_heap_insert(rel, newslot->tts_tuple);
-    UserTableUpdateOpenIndexes(estate, newslot);
-
-	ExecCloseIndices(estate->es_result_relation_info);
+	ExecClearTuple(ar->oldslot);
 
 	if (ActiveSnapshotSet())
 		PopActiveSnapshot();
 
+	ar->pending[ar->n_pending++] = tup;
+	ar->pending_size += tup->t_len;
+	if (ar->n_pending == MTM_MULTI_INSERT_MAX_TUPLES || ar->pending_size >= MTM_MULTI_INSERT_MAX_BYTES) {
+		flush_apply_relation(ar);
+	}
+
 	if (strcmp(RelationGetRelationName(rel), MULTIMASTER_LOCAL_TABLES_TABLE) == 0 &&
 		strcmp(get_namespace_name(RelationGetNamespace(rel)), MULTIMASTER_SCHEMA_NAME) == 0)
 	{
 		MtmMakeTableLocal((char*)DatumGetPointer(new_tuple.values[0]), (char*)DatumGetPointer(new_tuple.values[1]));
 	}
-		
-    ExecResetTupleTable(estate->es_tupleTable, true);
-    FreeExecutorState(estate);
-	   
-	CommandCounterIncrement();
+}
+
+/*
+ * Locate replica identity index of the relation modified by remote UPDATE or DELETE
+ */
+static MtmApplyRelation*
+get_apply_relation_with_pkey(Relation rel)
+{
+	MtmApplyRelation* ar = get_apply_relation(rel);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		MTM_ELOG(ERROR, "unexpected relkind '%c' rel \"%s\"",
+			 rel->rd_rel->relkind, RelationGetRelationName(rel));
+
+	if (ar->pkey == NULL)
+		MTM_ELOG(ERROR, "could not find primary key for table with oid %u",
+			 RelationGetRelid(rel));
+
+	return ar;
 }
 
 static void
 process_remote_update(StringInfo s, Relation rel)
 {
 	char		action;
-	EState	   *estate;
+	MtmApplyRelation* ar;
 	TupleTableSlot *newslot;
 	TupleTableSlot *oldslot;
 	bool		pkey_sent;
 	bool		found_tuple;
 	TupleData   old_tuple;
 	TupleData   new_tuple;
-	Oid			idxoid;
-	Relation	idxrel;
 	ScanKeyData skey[INDEX_MAX_KEYS];
 	HeapTuple	remote_tuple = NULL;
 
@@ -908,12 +1257,6 @@ process_remote_update(StringInfo s, Relation rel)
 		MTM_ELOG(ERROR, "expected action 'N' or 'K', got %c",
 			 action);
 
-	estate = create_rel_estate(rel);
-	oldslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel));
-	newslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(newslot, RelationGetDescr(rel));
-
 	if (action == 'K')
 	{
 		pkey_sent = true;
@@ -928,37 +1271,20 @@ process_remote_update(StringInfo s, Relation rel)
 		MTM_ELOG(ERROR, "expected action 'N', got %c",
 			 action);
 
-	if (rel->rd_rel->relkind != RELKIND_RELATION)
-		MTM_ELOG(ERROR, "unexpected relkind '%c' rel \"%s\"",
-			 rel->rd_rel->relkind, RelationGetRelationName(rel));
+	ar = get_apply_relation_with_pkey(rel);
+	oldslot = ar->oldslot;
+	newslot = ar->newslot;
 
 	/* read new tuple */
 	read_tuple_parts(s, rel, &new_tuple);
 
-	/* lookup index to build scankey */
-	if (rel->rd_indexvalid == 0)
-		RelationGetIndexList(rel);
-	idxoid = rel->rd_replidindex;
-	if (!OidIsValid(idxoid))
-	{
-		MTM_ELOG(ERROR, "could not find primary key for table with oid %u",
-			 RelationGetRelid(rel));
-		return;
-	}
-
-	/* open index, so we can build scan key for row */
-	idxrel = index_open(idxoid, RowExclusiveLock);
-
-	Assert(idxrel->rd_index->indisunique);
-
 	/* Use columns from the new tuple if the key didn't change. */
-	build_index_scan_key(skey, rel, idxrel,
-						 pkey_sent ? &old_tuple : &new_tuple);
+	fill_pkey_scan_key(skey, ar->info, pkey_sent ? &old_tuple : &new_tuple);
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
 	/* look for tuple identified by the (old) primary key */
-	found_tuple = find_pkey_tuple(skey, rel, idxrel, oldslot, true,
+	found_tuple = find_pkey_tuple(skey, rel, ar->pkey, oldslot, true,
 						pkey_sent ? LockTupleExclusive : LockTupleNoKeyExclusive);
 
 	if (found_tuple)
@@ -984,7 +1310,9 @@ process_remote_update(StringInfo s, Relation rel)
 #endif
 
         simple_heap_update(rel, &oldslot->tts_tuple->t_self, newslot->tts_tuple);
-        UserTableUpdateIndexes(estate, newslot);
+        UserTableUpdateOpenIndexes(ar->estate, newslot);
+		MtmHintAddTuple(rel, &oldslot->tts_tuple->t_self);
+		MtmHintAddTuple(rel, &newslot->tts_tuple->t_self);
 	}
 	else
 	{
@@ -996,12 +1324,10 @@ process_remote_update(StringInfo s, Relation rel)
 	}
     
 	PopActiveSnapshot();
-    
-	/* release locks upon commit */
-	index_close(idxrel, NoLock);
-    
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
+
+	ExecClearTuple(newslot);
+	ExecClearTuple(oldslot);
+	ResetPerTupleExprContext(ar->estate);
 
 	CommandCounterIncrement();
 }
@@ -1009,38 +1335,17 @@ process_remote_update(StringInfo s, Relation rel)
 static void
 process_remote_delete(StringInfo s, Relation rel)
 {
-	EState	   *estate;
+	MtmApplyRelation* ar;
 	TupleData   oldtup;
 	TupleTableSlot *oldslot;
-	Oid			idxoid;
-	Relation	idxrel;
 	ScanKeyData skey[INDEX_MAX_KEYS];
 	bool		found_old;
 
-	estate = create_rel_estate(rel);
-	oldslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(oldslot, RelationGetDescr(rel));
+	ar = get_apply_relation_with_pkey(rel);
+	oldslot = ar->oldslot;
 
 	read_tuple_parts(s, rel, &oldtup);
 
-	/* lookup index to build scankey */
-	if (rel->rd_indexvalid == 0)
-		RelationGetIndexList(rel);
-	idxoid = rel->rd_replidindex;
-	if (!OidIsValid(idxoid))
-	{
-		MTM_ELOG(ERROR, "could not find primary key for table with oid %u",
-			 RelationGetRelid(rel));
-		return;
-	}
-
-	/* Now open the primary key index */
-	idxrel = index_open(idxoid, RowExclusiveLock);
-
-	if (rel->rd_rel->relkind != RELKIND_RELATION)
-		MTM_ELOG(ERROR, "unexpected relkind '%c' rel \"%s\"",
-			 rel->rd_rel->relkind, RelationGetRelationName(rel));
-
 #ifdef VERBOSE_DELETE
 	{
 		HeapTuple tup;
@@ -1053,14 +1358,15 @@ process_remote_delete(StringInfo s, Relation rel)
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	build_index_scan_key(skey, rel, idxrel, &oldtup);
+	fill_pkey_scan_key(skey, ar->info, &oldtup);
 
 	/* try to find tuple via a (candidate|primary) key */
-	found_old = find_pkey_tuple(skey, rel, idxrel, oldslot, true, LockTupleExclusive);
+	found_old = find_pkey_tuple(skey, rel, ar->pkey, oldslot, true, LockTupleExclusive);
 
 	if (found_old)
 	{
 		simple_heap_delete(rel, &oldslot->tts_tuple->t_self);
+		MtmHintAddTuple(rel, &oldslot->tts_tuple->t_self);
 	}
 	else
 	{
@@ -1072,10 +1378,7 @@ process_remote_delete(StringInfo s, Relation rel)
 
 	PopActiveSnapshot();
 
-	index_close(idxrel, NoLock);
-
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
+	ExecClearTuple(oldslot);
 
 	CommandCounterIncrement();
 }
@@ -1085,8 +1388,12 @@ void MtmExecutor(void* work, size_t size)
     StringInfoData s;
     Relation rel = NULL;
 	int spill_file = -1;
+	int spill_node = 0;
+	off_t spill_offset = 0;
+	MtmSpillSegment spill_segment = {NULL, 0};
 	int save_cursor = 0;
 	int save_len = 0;
+	bool doomed = false;
 	MemoryContext old_context;
 	MemoryContext top_context;
 
@@ -1104,12 +1411,22 @@ void MtmExecutor(void* work, size_t size)
     }
 	top_context = MemoryContextSwitchTo(MtmApplyContext);
 	replorigin_session_origin = InvalidRepOriginId;
+	MtmSamplerSetState(MTM_SAMPLE_APPLY);
     PG_TRY();
     {    
 		bool inside_transaction = true;
         do { 
             char action = pq_getmsgbyte(&s);
 			old_context = MemoryContextSwitchTo(MtmApplyContext);
+
+			/* buffered inserts should be written before applying any other change */
+			if (action != 'I' && action != 'R' && action != '(' && action != ')' && action != '~') {
+				flush_apply_relations();
+			}
+			/* data changes are applied with default GUC context */
+			if (GucAltered && (action == 'I' || action == 'U' || action == 'D')) {
+				MtmResetRemoteGucs();
+			}
 	
             MTM_LOG2("%d: REMOTE process action %c", MyProcPid, action);
 #if 0
@@ -1122,10 +1439,20 @@ void MtmExecutor(void* work, size_t size)
                 /* BEGIN */
             case 'B':
 			    inside_transaction = process_remote_begin(&s);
+				if (doomed) {
+					/* vote abort without applying the transaction: it conflicts with local transaction which wins */
+					MtmPerfRecord(MTM_PERF_CONFLICT_ABORT, MtmReplicationNodeId, size);
+					ereport(ERROR,
+							(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+							 MTM_ERRMSG("transaction of node %d conflicts with in-flight transaction of this node",
+										MtmReplicationNodeId)));
+				}
 				break;
                 /* COMMIT */
             case 'C':
   			    close_rel(rel);
+				release_apply_relations(true);
+				MtmWriteSetWaitCommitOrder();
                 process_remote_commit(&s);
 				inside_transaction = false;
                 break;
@@ -1151,22 +1478,43 @@ void MtmExecutor(void* work, size_t size)
 				int file_id = pq_getmsgint(&s, 4);
 				Assert(spill_file < 0);
 				spill_file = MtmOpenSpillFile(node_id, file_id);
+				spill_node = node_id;
+				break;
+			}
+			case '~':
+			{
+				/*
+				 * Streamed transaction: map next segment as soon as receiver appends it to the file.
+				 * Segment ends with ')' which returns us back to this action.
+				 */
+				uint32 size = MtmWaitSpillSegment(spill_file, spill_offset, spill_node);
+				if (size == 0) {
+					ereport(ERROR,
+							(errcode(ERRCODE_TRANSACTION_ROLLBACK),
+							 MTM_ERRMSG("%d: streamed transaction from node %d is aborted", MyProcPid, spill_node)));
+				}
+				save_cursor = s.cursor - 1;
+				save_len = s.len;
+				s.data = MtmMapSpillSegment(spill_file, spill_offset + sizeof(size), size, &spill_segment);
+				s.cursor = 0;
+				s.len = size;
+				spill_offset += sizeof(size) + size;
 				break;
 			}
  		    case '(':
 			{
 			    size_t size = pq_getmsgint(&s, 4);    
-				s.data = MemoryContextAlloc(TopMemoryContext, size);
 				save_cursor = s.cursor;
 				save_len = s.len;
+				s.data = MtmMapSpillSegment(spill_file, spill_offset, size, &spill_segment);
 				s.cursor = 0;
 				s.len = size;
-				MtmReadSpillFile(spill_file, s.data, size);
+				spill_offset += size;
 				break;
 			}
   		    case ')':
 			{
-  			    pfree(s.data);
+				MtmUnmapSpillSegment(&spill_segment);
 				s.data = work;
   			    s.cursor = save_cursor;
 				s.len = save_len;
@@ -1175,23 +1523,31 @@ void MtmExecutor(void* work, size_t size)
  		    case 'N':
 			{
 				int64 next;
+				uint64 epoch;
 				Oid relid;
 			    Assert(rel != NULL);
 				relid = RelationGetRelid(rel);
   			    close_rel(rel);
 				rel = NULL;
 				next = pq_getmsgint64(&s); 
-				AdjustSequence(relid, next);
+				epoch = pq_getmsgint64(&s);
+				if (MtmIsNewSequenceRange(relid, epoch)) {
+					AdjustSequence(relid, next);
+				}
 				break;
 			}			   
 		    case '0':
 			    Assert(rel != NULL);
+				/* bulk insert state keeps pinned buffer of truncated relation */
+				release_apply_relations(true);
 			    heap_truncate_one_rel(rel);
 				break;
 			case 'M':
 			{
   			    close_rel(rel);
 				rel = NULL;
+				/* DDL can change relations, so executor state has to be created once again */
+				release_apply_relations(true);
 				inside_transaction = !process_remote_message(&s);
 				break;
 			}
@@ -1201,6 +1557,34 @@ void MtmExecutor(void* work, size_t size)
 				inside_transaction = false;
 				break;
 			}
+			case 'S':
+			{
+				/* wait for completion of transactions we depend on */
+				MtmWriteSetWait(&s);
+				break;
+			}
+			case 'Q':
+			{
+				/* commit ticket of the origin node: commit waits for the previous commit of this node */
+				MtmWriteSetWaitCommit(&s);
+				break;
+			}
+			case 'V':
+			{
+				/* receiver has found conflict of write-set fingerprints (see fingerprint.c) */
+				doomed = true;
+				break;
+			}
+			case 'P':
+			{
+				/* in-doubt prepared transaction resolved by arbiter (see MtmResolvePreparedTransaction) */
+				char const* gid = pq_getmsgstring(&s);
+				bool commit = pq_getmsgbyte(&s);
+				bool replicate = pq_getmsgbyte(&s);
+				MtmFinishResolvedTransaction(gid, commit, replicate);
+				inside_transaction = false;
+				break;
+			}
             default:
                 MTM_ELOG(ERROR, "unknown action of type %c", action);
             }        
@@ -1213,18 +1597,25 @@ void MtmExecutor(void* work, size_t size)
 		old_context = MemoryContextSwitchTo(MtmApplyContext);
 		MtmHandleApplyError();
 		MemoryContextSwitchTo(old_context);
+		release_apply_relations(false);
 		EmitErrorReport();
         FlushErrorState();
 		MTM_LOG1("%d: REMOTE begin abort transaction %llu", MyProcPid, (long64)MtmGetCurrentTransactionId());
 		MtmEndSession(MtmReplicationNodeId, false);
         AbortCurrentTransaction();
+		/* GUC context applied by aborted transaction is rolled back, so it has to be set again */
+		if (MtmAppliedGucPrelude != NULL) {
+			pfree(MtmAppliedGucPrelude);
+			MtmAppliedGucPrelude = NULL;
+			GucAltered = true;
+		}
 		Assert(!MtmTransIsActive());
 		MTM_LOG2("%d: REMOTE end abort transaction %llu", MyProcPid, (long64)MtmGetCurrentTransactionId());
     }
     PG_END_TRY();
-	if (s.data != work) { 
-		pfree(s.data);
-	}
+	MtmWriteSetComplete();
+	/* last segment of spilled transaction ends with commit, so it is still mapped here */
+	MtmUnmapSpillSegment(&spill_segment);
 #if 0 /* spill file is expecrted to be closed by tranaction commit or rollback */
 	if (spill_file >= 0) { 
 		MtmCloseSpillFile(spill_file);
@@ -1233,5 +1624,6 @@ void MtmExecutor(void* work, size_t size)
 	MemoryContextSwitchTo(top_context);
     MemoryContextResetAndDeleteChildren(MtmApplyContext);
 	MtmReleaseLocks();
+	MtmSamplerSetState(MTM_SAMPLE_NONE);
 }
     
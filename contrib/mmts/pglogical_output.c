@@ -25,6 +25,8 @@
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 
+#include "libpq/pqformat.h"
+
 #include "mb/pg_wchar.h"
 
 #include "nodes/parsenodes.h"
@@ -73,6 +75,12 @@ static void pg_decode_message(LogicalDecodingContext *ctx,
 							  bool transactional, const char *prefix,
 							  Size sz, const char *message);
 static void pg_decode_caughtup(LogicalDecodingContext *ctx);
+static bool pg_decode_stream_start(LogicalDecodingContext *ctx,
+					   ReorderBufferTXN *txn, bool first);
+static void pg_decode_stream_stop(LogicalDecodingContext *ctx,
+					  ReorderBufferTXN *txn);
+static void pg_decode_stream_abort(LogicalDecodingContext *ctx,
+					   ReorderBufferTXN *txn, XLogRecPtr abort_lsn);
 
 static void send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message);
@@ -80,6 +88,16 @@ static void send_startup_message(LogicalDecodingContext *ctx,
 static bool startup_message_sent = false;
 
 #define OUTPUT_BUFFER_SIZE (16*1024*1024) 
+#define CONTROL_BATCH_SIZE (64*1024) /* send batch of control messages when it exceeds this size */
+
+/*
+ * Non-transactional control messages (aborts and lock graph) are not flushed one by one:
+ * they are collected in the batch, each prefixed with its LSN, and sent as single 'G' message
+ * before any other output or when WAL sender has caught up and is going to flush its output.
+ */
+static StringInfoData control_batch;
+static int control_batch_count;
+static XLogRecPtr control_batch_lsn;
 
 void MtmOutputPluginWrite(LogicalDecodingContext *ctx, bool last_write, bool flush)
 {
@@ -99,6 +117,64 @@ void MtmOutputPluginPrepareWrite(LogicalDecodingContext *ctx, bool last_write, b
 }
 
 
+static void
+flush_control_batch(LogicalDecodingContext *ctx)
+{
+	XLogRecPtr save_location;
+
+	if (control_batch_count == 0)
+		return;
+
+	if (ctx->prepared_write)
+		OutputPluginWrite(ctx, false);
+
+	/* LSN of the last batched message is reported as end of sent WAL */
+	save_location = ctx->write_location;
+	ctx->write_location = control_batch_lsn;
+	OutputPluginPrepareWrite(ctx, true);
+	if (control_batch_count == 1) {
+		/* single message is sent as is */
+		appendBinaryStringInfo(ctx->out, control_batch.data + 8, control_batch.len - 8);
+	} else {
+		pq_sendbyte(ctx->out, 'M');
+		pq_sendbyte(ctx->out, 'G');
+		pq_sendint(ctx->out, control_batch.len, 4);
+		appendBinaryStringInfo(ctx->out, control_batch.data, control_batch.len);
+	}
+	OutputPluginWrite(ctx, true);
+	ctx->write_location = save_location;
+
+	resetStringInfo(&control_batch);
+	control_batch_count = 0;
+}
+
+static void
+batch_control_message(LogicalDecodingContext *ctx, XLogRecPtr lsn,
+					  const char *prefix, Size sz, const char *message)
+{
+	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
+	int start;
+
+	if (control_batch.data == NULL) {
+		MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+		initStringInfo(&control_batch);
+		MemoryContextSwitchTo(old_context);
+	}
+	start = control_batch.len;
+	pq_sendint64(&control_batch, lsn);
+	data->api->write_message(&control_batch, ctx, prefix, sz, message);
+	if (control_batch.len == start + 8) {
+		/* message is filtered */
+		control_batch.len = start;
+		control_batch.data[start] = '\0';
+		return;
+	}
+	control_batch_count += 1;
+	control_batch_lsn = lsn;
+	if (control_batch.len >= CONTROL_BATCH_SIZE)
+		flush_control_batch(ctx);
+}
+
 /* specify output plugin callbacks */
 void
 _PG_output_plugin_init(OutputPluginCallbacks *cb)
@@ -113,6 +189,9 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->shutdown_cb = pg_decode_shutdown;
 	cb->message_cb = pg_decode_message;
 	cb->caughtup_cb = pg_decode_caughtup;
+	cb->stream_start_cb = pg_decode_stream_start;
+	cb->stream_stop_cb = pg_decode_stream_stop;
+	cb->stream_abort_cb = pg_decode_stream_abort;
 }
 
 static bool
@@ -173,6 +252,8 @@ check_binary_compatibility(PGLogicalOutputData *data)
 	return true;
 }
 
+extern int MtmStreamThreshold;
+
 /* initialize this plugin */
 static void
 pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
@@ -266,6 +347,7 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 		{
 			data->api = pglogical_init_api(PGLogicalProtoNative);
 			opt->output_type = OUTPUT_PLUGIN_BINARY_OUTPUT;
+			opt->stream_threshold = MtmStreamThreshold;
 
 			if (data->client_no_txinfo)
 			{
@@ -408,6 +490,7 @@ pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
 	send_replication_origin &= txn->origin_id != InvalidRepOriginId;
 
 	if (data->api) { 
+		flush_control_batch(ctx);
 		MtmOutputPluginPrepareWrite(ctx, !send_replication_origin, true);
 		data->api->write_begin(ctx->out, data, txn);
 
@@ -442,6 +525,7 @@ pg_decode_caughtup(LogicalDecodingContext *ctx)
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
 
 	if (data->api) { 
+		flush_control_batch(ctx);
 		MtmOutputPluginPrepareWrite(ctx, true, true);
 		data->api->write_caughtup(ctx->out, data, ctx->reader->EndRecPtr);
 		MtmOutputPluginWrite(ctx, true, true);
@@ -449,6 +533,57 @@ pg_decode_caughtup(LogicalDecodingContext *ctx)
 }
 
 
+/*
+ * STREAM START callback: first block of streamed transaction also contains BEGIN
+ */
+static bool
+pg_decode_stream_start(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, bool first)
+{
+	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
+
+	if (data->api == NULL || data->api->write_stream_start == NULL
+		|| (first && data->api->stream_filter(data, txn)))
+	{
+		return false;
+	}
+	if (!startup_message_sent)
+		send_startup_message(ctx, data, false /* can't be last message */);
+
+	flush_control_batch(ctx);
+	MtmOutputPluginPrepareWrite(ctx, true, true);
+	data->api->write_stream_start(ctx->out, data, txn, first);
+	MtmOutputPluginWrite(ctx, true, true);
+
+	if (first) {
+		MtmOutputPluginPrepareWrite(ctx, true, true);
+		data->api->write_begin(ctx->out, data, txn);
+		MtmOutputPluginWrite(ctx, true, false);
+	}
+	return true;
+}
+
+static void
+pg_decode_stream_stop(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
+
+	MtmOutputPluginPrepareWrite(ctx, true, true);
+	data->api->write_stream_stop(ctx->out, data, txn);
+	MtmOutputPluginWrite(ctx, true, true);
+}
+
+static void
+pg_decode_stream_abort(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					   XLogRecPtr abort_lsn)
+{
+	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
+
+	flush_control_batch(ctx);
+	MtmOutputPluginPrepareWrite(ctx, true, true);
+	data->api->write_stream_abort(ctx->out, data, txn);
+	MtmOutputPluginWrite(ctx, true, true);
+}
+
 /*
  * COMMIT callback
  */
@@ -459,6 +594,7 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
 
 	if (data->api) { 
+		flush_control_batch(ctx);
 		MtmOutputPluginPrepareWrite(ctx, true, true);
 		data->api->write_commit(ctx->out, data, txn, commit_lsn);
 		MtmOutputPluginWrite(ctx, true, true);
@@ -556,6 +692,11 @@ pg_decode_message(LogicalDecodingContext *ctx,
 {
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
 
+	if (!transactional && data->api->batch_message != NULL && data->api->batch_message(prefix)) {
+		batch_control_message(ctx, lsn, prefix, sz, message);
+		return;
+	}
+	flush_control_batch(ctx);
 	MtmOutputPluginPrepareWrite(ctx, true, !transactional);
 	data->api->write_message(ctx->out, ctx, prefix, sz, message);
 	MtmOutputPluginWrite(ctx, true, !transactional);
@@ -38,6 +38,7 @@
 
 #include "multimaster.h"
 #include "pglogical_relid_map.h"
+#include "fingerprint.h"
 
 static int MtmTransactionRecords;
 static bool MtmIsFilteredTxn;
@@ -45,11 +46,15 @@ static TransactionId MtmCurrentXid;
 static bool DDLInProgress = false;
 static Oid MtmSenderTID; /* transaction identifier for WAL sender */
 static Oid MtmLastRelId; /* last relation ID sent to the receiver in this transaction */
+static bool MtmFingerprintTxn; /* fingerprint of write set of this local transaction is collected */
+static csn_t MtmFingerprintSnapshot;
+static MtmFingerprint MtmTxnFingerprint;
 
 static void pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel);
 
 static void pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 							ReorderBufferTXN *txn);
+static bool pglogical_batch_message(const char *prefix);
 static void pglogical_write_commit(StringInfo out,PGLogicalOutputData *data,
 							ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
 
@@ -71,6 +76,14 @@ static char decide_datum_transfer(Form_pg_attribute att,
 static void pglogical_write_caughtup(StringInfo out, PGLogicalOutputData *data,
 									 XLogRecPtr wal_end_ptr);
 
+static bool pglogical_stream_filter(PGLogicalOutputData *data, ReorderBufferTXN *txn);
+static void pglogical_write_stream_start(StringInfo out, PGLogicalOutputData *data,
+										 ReorderBufferTXN *txn, bool first);
+static void pglogical_write_stream_stop(StringInfo out, PGLogicalOutputData *data,
+										ReorderBufferTXN *txn);
+static void pglogical_write_stream_abort(StringInfo out, PGLogicalOutputData *data,
+										 ReorderBufferTXN *txn);
+
 
 /*
  * Write relation description to the output stream.
@@ -129,6 +142,20 @@ pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel)
 	}
 }
 
+/*
+ * Receiver of the node populated by mtm.bootstrap_node() already has changes of transactions
+ * committed in the bootstrap snapshot. Prepared transactions are filtered both at PREPARE and
+ * COMMIT PREPARED: transaction which is not committed at the moment of decoding its PREPARE
+ * will be committed with CSN larger than bootstrap snapshot.
+ */
+static bool
+MtmIsBootstrappedTxn(ReorderBufferTXN *txn)
+{
+	return MtmReplicationBootstrapCsn != INVALID_CSN
+		&& MtmIsRecoveredNode(MtmReplicationNodeId)
+		&& MtmIsCommittedInSnapshot(txn->xid, MtmReplicationBootstrapCsn);
+}
+
 /*
  * Write BEGIN to the output stream.
  */
@@ -145,6 +172,9 @@ pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 	if (!isRecovery && csn == INVALID_CSN) { 
 		MtmIsFilteredTxn = true;
 		MTM_LOG2("%d: pglogical_write_begin XID=%lld filtered", MyProcPid, (long64)txn->xid);
+	} else if (MtmIsBootstrappedTxn(txn)) {
+		MtmIsFilteredTxn = true;
+		MTM_LOG2("%d: pglogical_write_begin XID=%lld is already copied by bootstrap", MyProcPid, (long64)txn->xid);
 	} else {
 		if (++MtmSenderTID == InvalidOid) { 
 			pglogical_relid_map_reset();
@@ -153,6 +183,9 @@ pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 		MtmLastRelId = InvalidOid;
 		MtmCurrentXid = txn->xid;
 		MtmIsFilteredTxn = false;
+		MtmFingerprintTxn = MtmConflictFingerprints && !isRecovery;
+		MtmFingerprintSnapshot = csn;
+		MtmFingerprintReset(&MtmTxnFingerprint);
 		MTM_LOG3("%d: pglogical_write_begin XID=%d node=%d CSN=%lld recovery=%d restart_decoding_lsn=%llx first_lsn=%llx end_lsn=%llx confirmed_flush=%llx", 
 				 MyProcPid, txn->xid, MtmReplicationNodeId, csn, isRecovery,
 				 (long64)txn->restart_decoding_lsn, (long64)txn->first_lsn, (long64)txn->end_lsn, (long64)MyReplicationSlot->data.confirmed_flush);
@@ -176,6 +209,7 @@ static void pglogical_seq_nextval(StringInfo out, LogicalDecodingContext *ctx, M
 	heap_close(rel, NoLock);
 	pq_sendbyte(out, 'N');
 	pq_sendint64(out, pos->next);
+	pq_sendint64(out, pos->epoch);
 }
 	
 
@@ -250,6 +284,16 @@ pglogical_write_message(StringInfo out, LogicalDecodingContext *ctx,
 	pq_sendbytes(out, message, sz);
 }
 
+/*
+ * Non-transactional abort and lock graph messages are batched by the output plugin
+ * and sent together as single 'G' message (see pglogical_output.c).
+ */
+static bool
+pglogical_batch_message(const char *prefix)
+{
+	return *prefix == 'A' || *prefix == 'L';
+}
+
 /*
  * Write COMMIT to the output stream.
  */
@@ -287,7 +331,7 @@ pglogical_write_commit(StringInfo out, PGLogicalOutputData *data,
 
 		Assert(isRecovery || txn->origin_id == InvalidRepOriginId);
 
-		if (!isRecovery && csn == INVALID_CSN)
+		if ((!isRecovery && csn == INVALID_CSN) || (event == PGLOGICAL_COMMIT_PREPARED && MtmIsBootstrappedTxn(txn)))
 		{
 			if (event == PGLOGICAL_ABORT_PREPARED) { 
 				MTM_LOG1("Skip ABORT_PREPARED for transaction %s to node %d origin %d", txn->gid, MtmReplicationNodeId, txn->origin_id);
@@ -346,6 +390,18 @@ pglogical_write_commit(StringInfo out, PGLogicalOutputData *data,
     if (txn->xact_action != XLOG_XACT_COMMIT) { 
     	pq_sendstring(out, txn->gid);
 	}
+	if (event == PGLOGICAL_PREPARE && MtmFingerprintTxn && MtmFingerprintComplete(&MtmTxnFingerprint)) {
+		MtmFingerprintPublish(txn->xid, MtmFingerprintSnapshot, &MtmTxnFingerprint);
+		if (MtmReplicationFingerprints) {
+			int i;
+			pq_sendbyte(out, 'W');
+			pq_sendint(out, MtmTxnFingerprint.nKeys, 2);
+			for (i = 0; i < MtmTxnFingerprint.nKeys; i++) {
+				pq_sendint(out, MtmTxnFingerprint.keys[i], 4);
+			}
+		}
+	}
+	MtmFingerprintTxn = false;
 
 	MtmTransactionRecords = 0;
 	MTM_TXTRACE(txn, "pglogical_write_commit Finish");
@@ -362,6 +418,63 @@ void pglogical_write_caughtup(StringInfo out, PGLogicalOutputData *data,
 	}
 }
 
+/*
+ * Streaming of large in-progress transactions.
+ *
+ * Blocks of changes of such transaction are enclosed in 'X' (stream start) and 'Y' (stream stop) messages,
+ * the first block also contains BEGIN. Other transactions can be sent between blocks.
+ * Last block is started by 'X' and terminated by COMMIT (PREPARE) as usual.
+ * If transaction is aborted at origin, 'A' (stream abort) is sent instead.
+ */
+static bool
+pglogical_stream_filter(PGLogicalOutputData *data, ReorderBufferTXN *txn)
+{
+	nodemask_t participantsMask;
+
+	/* Transactions sent to recovered node and local transactions are decoded at commit as usual */
+	return MtmIsRecoveredNode(MtmReplicationNodeId)
+		|| MtmDistributedTransactionSnapshot(txn->xid, MtmReplicationNodeId, &participantsMask) == INVALID_CSN;
+}
+
+static void
+pglogical_write_stream_start(StringInfo out, PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn, bool first)
+{
+	/* Relation names have to be sent again: other transactions may be sent between blocks */
+	if (++MtmSenderTID == InvalidOid) {
+		pglogical_relid_map_reset();
+		MtmSenderTID += 1; /* skip InvalidOid */
+	}
+	MtmLastRelId = InvalidOid;
+	MtmCurrentXid = txn->xid;
+	MtmIsFilteredTxn = false;
+	MtmFingerprintTxn = false; /* large transactions are not fingerprinted */
+	DDLInProgress = false;
+
+	MTM_LOG2("%d: pglogical_write_stream_start XID=%lld first=%d", MyProcPid, (long64)txn->xid, first);
+	pq_sendbyte(out, 'X');
+	pq_sendint64(out, txn->xid);
+	pq_sendbyte(out, first);
+}
+
+static void
+pglogical_write_stream_stop(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn)
+{
+	pq_sendbyte(out, 'Y');
+	pq_sendint64(out, txn->xid);
+	MtmTransactionRecords = 0;
+}
+
+static void
+pglogical_write_stream_abort(StringInfo out, PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn)
+{
+	MTM_LOG1("%d: abort streamed transaction %lld at node %d", MyProcPid, (long64)txn->xid, MtmReplicationNodeId);
+	pq_sendbyte(out, 'A');
+	pq_sendint64(out, txn->xid);
+}
+
 /*
  * Write INSERT to the output stream.
  */
@@ -382,6 +495,9 @@ pglogical_write_insert(StringInfo out, PGLogicalOutputData *data,
 	MtmTransactionRecords += 1;
 	pq_sendbyte(out, 'I');		/* action INSERT */
 	pglogical_write_tuple(out, data, rel, newtuple);
+	if (MtmFingerprintTxn) {
+		MtmFingerprintAddTuple(&MtmTxnFingerprint, rel, newtuple);
+	}
 
 }
 
@@ -416,6 +532,13 @@ pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 
 	pq_sendbyte(out, 'N');		/* new tuple follows */
 	pglogical_write_tuple(out, data, rel, newtuple);
+
+	if (MtmFingerprintTxn) {
+		if (oldtuple != NULL) {
+			MtmFingerprintAddTuple(&MtmTxnFingerprint, rel, oldtuple);
+		}
+		MtmFingerprintAddTuple(&MtmTxnFingerprint, rel, newtuple);
+	}
 }
 	
 /*
@@ -438,6 +561,9 @@ pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 	MtmTransactionRecords += 1;
 	pq_sendbyte(out, 'D');		/* action DELETE */
 	pglogical_write_tuple(out, data, rel, oldtuple);
+	if (MtmFingerprintTxn) {
+		MtmFingerprintAddTuple(&MtmTxnFingerprint, rel, oldtuple);
+	}
 }
 
 /*
@@ -565,6 +691,14 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					Assert(!VARATT_IS_EXTERNAL(data));
 
+					/*
+					 * The receiver may be built without LZ4, so only pglz
+					 * compressed values are sent as they are.
+					 */
+					if (VARATT_IS_COMPRESSED(data) &&
+						TOAST_COMPRESS_METHOD(data) != TOAST_PGLZ_COMPRESSION)
+						data = (char *) heap_tuple_untoast_attr((struct varlena *) data);
+
 					pq_sendint(out, VARSIZE_ANY(data), 4); /* length */
 
 					appendBinaryStringInfo(out, data, VARSIZE_ANY(data));
@@ -652,11 +786,16 @@ pglogical_init_api(PGLogicalProtoType typ)
     res->write_rel = pglogical_write_rel;
     res->write_begin = pglogical_write_begin;
 	res->write_message = pglogical_write_message;
+	res->batch_message = pglogical_batch_message;
     res->write_commit = pglogical_write_commit;
     res->write_insert = pglogical_write_insert;
     res->write_update = pglogical_write_update;
     res->write_delete = pglogical_write_delete;
     res->write_caughtup = pglogical_write_caughtup;
+	res->stream_filter = pglogical_stream_filter;
+	res->write_stream_start = pglogical_write_stream_start;
+	res->write_stream_stop = pglogical_write_stream_stop;
+	res->write_stream_abort = pglogical_write_stream_abort;
 	res->setup_hooks = MtmSetupReplicationHooks;
     res->write_startup_message = write_startup_message;
     return res;
@@ -23,6 +23,7 @@ typedef void (*pglogical_write_begin_fn)(StringInfo out, struct PGLogicalOutputD
 							 ReorderBufferTXN *txn);
 typedef void (*pglogical_write_message_fn)(StringInfo out, LogicalDecodingContext *ctx,
 					const char *prefix, Size sz, const char *message);
+typedef bool (*pglogical_batch_message_fn)(const char *prefix);
 typedef void (*pglogical_write_commit_fn)(StringInfo out, struct PGLogicalOutputData *data,
 							 ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
 
@@ -40,6 +41,13 @@ typedef void (*pglogical_write_delete_fn)(StringInfo out, struct PGLogicalOutput
 typedef void (*pglogical_write_caughtup_fn)(StringInfo out, struct PGLogicalOutputData *data,
 											XLogRecPtr wal_end_ptr);
 
+typedef bool (*pglogical_stream_filter_fn)(struct PGLogicalOutputData *data,
+										   ReorderBufferTXN *txn);
+typedef void (*pglogical_write_stream_start_fn)(StringInfo out, struct PGLogicalOutputData *data,
+												ReorderBufferTXN *txn, bool first);
+typedef void (*pglogical_write_stream_fn)(StringInfo out, struct PGLogicalOutputData *data,
+										  ReorderBufferTXN *txn);
+
 typedef void (*write_startup_message_fn)(StringInfo out, List *msg);
 
 typedef void (*pglogical_setup_hooks_fn)(struct PGLogicalHooks* hooks);
@@ -49,12 +57,17 @@ typedef struct PGLogicalProtoAPI
 	pglogical_write_rel_fn		write_rel;
 	pglogical_write_begin_fn	write_begin;
 	pglogical_write_message_fn	write_message;
+	pglogical_batch_message_fn	batch_message;
 	pglogical_write_commit_fn	write_commit;
 	pglogical_write_origin_fn	write_origin;
 	pglogical_write_insert_fn	write_insert;
 	pglogical_write_update_fn	write_update;
 	pglogical_write_delete_fn	write_delete;
 	pglogical_write_caughtup_fn	write_caughtup;
+	pglogical_stream_filter_fn  stream_filter;
+	pglogical_write_stream_start_fn write_stream_start;
+	pglogical_write_stream_fn   write_stream_stop;
+	pglogical_write_stream_fn   write_stream_abort;
 	pglogical_setup_hooks_fn    setup_hooks;
 	write_startup_message_fn	write_startup_message;
 } PGLogicalProtoAPI;
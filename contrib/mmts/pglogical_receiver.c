@@ -43,6 +43,8 @@
 #include "multimaster.h"
 #include "spill.h"
 #include "state.h"
+#include "writeset.h"
+#include "fingerprint.h"
 
 #define ERRCODE_DUPLICATE_OBJECT_STR  "42710"
 #define RECEIVER_SUSPEND_TIMEOUT (1*USECS_PER_SEC)
@@ -54,17 +56,24 @@ static volatile sig_atomic_t got_sighup = false;
 /* GUC variables */
 static int receiver_idle_time = 0;
 static bool receiver_sync_mode = true; /* We need sync mode to have up-to-date values of catalog_xmin in replication slots */
+static bool MtmParallelRecoverySession; /* recovered transactions are applied by the pool (multimaster.parallel_recovery) */
 
 /* Worker name */
 static char worker_proc[BGW_MAXLEN];
 
 /* Lastly written positions */
 static lsn_t output_written_lsn = INVALID_LSN;
+
+/* Replication connection read by MtmReceiverStall while the apply queue is full */
+static PGconn* MtmReceiverConn;
+static bool MtmReceiverStalled; /* stall of the current message is already counted */
+static int64 MtmReceiverLastFeedback;
 lsn_t MtmSenderWalEnd;
 
 /* Stream functions */
 static void fe_sendint64(int64 i, char *buf);
 static int64 fe_recvint64(char *buf);
+static int64 feGetCurrentTimestamp(void);
 
 static void
 receiver_raw_sigterm(SIGNAL_ARGS)
@@ -197,6 +206,250 @@ feTimestampDifference(int64 start_time, int64 stop_time,
 	}
 }
 
+/*
+ * Called by BgwPoolExecute while the apply queue is full.
+ * Instead of leaving the socket unread, so that the WAL sender at the other side blocks,
+ * read ahead up to multimaster.receive_buffer_size into the libpq input buffer: buffered messages
+ * are dispatched by the main loop once the queue has room. Feedback is still sent to the WAL sender
+ * to prevent wal_sender_timeout.
+ */
+static void
+MtmReceiverStall(timestamp_t timeout)
+{
+	PGconn* conn = MtmReceiverConn;
+	int nodeId = MtmReplicationNodeId;
+	timestamp_t start = MtmGetSystemTime();
+	int64 now;
+
+	if (!MtmReceiverStalled) {
+		MtmReceiverStalled = true;
+		Mtm->nodes[nodeId-1].receiverStalls += 1;
+	}
+	if (conn != NULL && (size_t)(conn->inEnd - conn->inStart) < (size_t)MtmReceiveBufferSize*1024) {
+		fd_set input_mask;
+		struct timeval tv;
+		int rc;
+
+		FD_ZERO(&input_mask);
+		FD_SET(PQsocket(conn), &input_mask);
+		tv.tv_sec = 0;
+		tv.tv_usec = timeout;
+		rc = pg_select(PQsocket(conn) + 1, &input_mask, NULL, NULL, &tv, conn->isRsocket);
+		if (rc > 0 && PQconsumeInput(conn) == 0) {
+			/* Connection is broken: error is reported by the main loop */
+			MtmReceiverConn = NULL;
+		}
+	} else {
+		pg_usleep(timeout);
+	}
+	now = feGetCurrentTimestamp();
+	if (MtmReceiverConn != NULL && now - MtmReceiverLastFeedback >= USECS_PER_SEC) {
+		MtmReceiverLastFeedback = now;
+		if (!sendFeedback(MtmReceiverConn, now, nodeId)) {
+			MtmReceiverConn = NULL;
+		}
+	}
+	Mtm->nodes[nodeId-1].receiverStallTime += MtmGetSystemTime() - start;
+}
+
+/*
+ * Start or stop reading ahead from the replication connection while the apply queue is full
+ */
+static void
+MtmSetReceiverConnection(PGconn* conn)
+{
+	MtmReceiverConn = conn;
+	BgwPoolProducerStallHook = conn != NULL && MtmReceiveBufferSize != 0 ? MtmReceiverStall : NULL;
+}
+
+/*
+ * During parallel recovery transactions are applied by the pool, so work executed by receiver itself
+ * has to wait until all previously received transactions are applied.
+ */
+static void
+MtmRecoveryBarrier(int nodeId)
+{
+	if (MtmParallelRecoverySession) {
+		MtmWriteSetDrain(nodeId);
+	}
+}
+
+/*
+ * Small works are placed in the priority lane of the pool, so that they are not applied after large transactions
+ * received before them. Only works which need not be applied in order relative to other works can use this lane.
+ */
+static BgwPoolLane
+MtmWorkLane(int size)
+{
+	return MtmPriorityWorkSize != 0 && size <= MtmPriorityWorkSize*1024 ? BGW_LANE_PRIORITY : BGW_LANE_BULK;
+}
+
+/*
+ * Pass transaction to the pool of apply workers.
+ * If dependency tracking is enabled, transaction is prefixed with 'S' record with its dependencies.
+ * Write set of spilled transaction is not known, so such transaction is scheduled as barrier.
+ * Transaction doomed by conflict of write-set fingerprints is prefixed with 'V' record:
+ * apply worker votes abort without applying it.
+ */
+static void
+MtmExecuteTransaction(int nodeId, char* data, int size, bool spilled, bool doomed, StringInfo work)
+{
+	if (MtmParallelRecoverySession) {
+		/* Recovered transactions are applied by the pool but committed in the order of receiving */
+		resetStringInfo(work);
+		MtmWriteSetSchedule(nodeId, data, size, spilled, true, work);
+		appendBinaryStringInfo(work, data, size);
+		BgwPoolExecute(&Mtm->pool, work->data, work->len, BGW_LANE_BULK);
+	} else if (MtmTrackDependencies) {
+		/* Works with tracked dependencies wait for each other, so they are kept in one lane */
+		resetStringInfo(work);
+		if (doomed) {
+			pq_sendbyte(work, 'V');
+		}
+		MtmWriteSetSchedule(nodeId, data, size, spilled, false, work);
+		appendBinaryStringInfo(work, data, size);
+		MtmExecute(work->data, work->len, BGW_LANE_BULK);
+	} else if (doomed) {
+		resetStringInfo(work);
+		pq_sendbyte(work, 'V');
+		appendBinaryStringInfo(work, data, size);
+		MtmExecute(work->data, work->len, MtmWorkLane(size));
+	} else {
+		MtmExecute(data, size, spilled ? BGW_LANE_BULK : MtmWorkLane(size));
+	}
+}
+
+/*
+ * In-progress transaction streamed by the sender (see pglogical_proto.c).
+ * Each block of its changes is appended to the stream file as separate segment,
+ * apply worker which has started applying this transaction follows the file.
+ */
+typedef struct
+{
+	int64 xid;         /* transaction id at origin node */
+	int   file;        /* stream file descriptor */
+	int   file_id;
+	bool  dispatched;  /* transaction is already passed to apply worker */
+} MtmStream;
+
+static MtmStream* MtmStreams;
+static int MtmNStreams;
+static int MtmMaxStreams;
+static int MtmNDispatchedStreams;
+
+/*
+ * Messages which are processed by receiver itself or passed to the parallel workers out of transaction context
+ */
+static bool
+MtmIsImmediateMessage(char const* stmt)
+{
+	return stmt[0] == 'Z' || (stmt[0] == 'M' && (stmt[1] == 'L' || stmt[1] == 'A' || stmt[1] == 'G' || stmt[1] == 'C'));
+}
+
+static int64
+MtmGetStreamXid(char const* stmt, int len)
+{
+	StringInfoData s;
+	s.data = (char*)stmt;
+	s.len = len;
+	s.cursor = 1;
+	return pq_getmsgint64(&s);
+}
+
+static MtmStream*
+MtmFindStream(int64 xid)
+{
+	int i;
+	for (i = 0; i < MtmNStreams; i++) {
+		if (MtmStreams[i].xid == xid) {
+			return &MtmStreams[i];
+		}
+	}
+	return NULL;
+}
+
+static MtmStream*
+MtmStartStream(int nodeId, int64 xid)
+{
+	MtmStream* stream;
+	if (MtmNStreams == MtmMaxStreams) {
+		MtmMaxStreams = MtmMaxStreams == 0 ? 8 : MtmMaxStreams*2;
+		MtmStreams = MtmStreams == NULL
+			? (MtmStream*)MemoryContextAlloc(TopMemoryContext, MtmMaxStreams*sizeof(MtmStream))
+			: (MtmStream*)repalloc(MtmStreams, MtmMaxStreams*sizeof(MtmStream));
+	}
+	stream = &MtmStreams[MtmNStreams++];
+	stream->xid = xid;
+	stream->file = MtmCreateStreamFile(nodeId, &stream->file_id);
+	stream->dispatched = false;
+	return stream;
+}
+
+/*
+ * Append block of changes collected in buf to the stream file
+ */
+static void
+MtmWriteStreamSegment(MtmStream* stream, ByteBuffer* buf)
+{
+	ByteBufferAppend(buf, ")", 1);
+	MtmStreamToFile(stream->file, buf->data, buf->used);
+	ByteBufferReset(buf);
+}
+
+/*
+ * Pass streamed transaction to apply worker. Worker applies segments of the stream file as soon as they are written.
+ * Only part of workers can be occupied by streamed transactions: other ones are dispatched when they are committed.
+ * Transaction can not be dispatched speculatively in recovery mode because it is applied synchronously.
+ */
+static void
+MtmDispatchStream(int nodeId, MtmStream* stream, bool committed)
+{
+	StringInfoData work;
+	if (stream->dispatched
+		|| (!committed && (Mtm->status == MTM_RECOVERY || MtmNDispatchedStreams >= Max(1, MtmMaxWorkers/2))))
+	{
+		return;
+	}
+	initStringInfo(&work);
+	pq_sendbyte(&work, 'F');
+	pq_sendint(&work, nodeId, 4);
+	pq_sendint(&work, stream->file_id, 4);
+	pq_sendbyte(&work, '~');
+	stream->dispatched = true;
+	MtmNDispatchedStreams += 1;
+	MTM_LOG2("Dispatch streamed transaction %lld from node %d, committed=%d", (long64)stream->xid, nodeId, committed);
+	MtmRecoveryBarrier(nodeId);
+	MtmExecute(work.data, work.len, BGW_LANE_BULK);
+	pfree(work.data);
+}
+
+static void
+MtmEndStream(int nodeId, MtmStream* stream, bool aborted)
+{
+	if (aborted) {
+		MTM_LOG1("Streamed transaction %lld from node %d is aborted", (long64)stream->xid, nodeId);
+		MtmStreamToFile(stream->file, NULL, 0);
+	}
+	MtmCloseStreamFile(stream->file);
+	if (stream->dispatched) {
+		MtmNDispatchedStreams -= 1;
+	} else {
+		MtmRemoveSpillFile(nodeId, stream->file_id);
+	}
+	*stream = MtmStreams[--MtmNStreams];
+}
+
+/*
+ * Streams can not be continued after reconnect: sender will decode these transactions once again
+ */
+static void
+MtmAbortStreams(int nodeId)
+{
+	while (MtmNStreams != 0) {
+		MtmEndStream(nodeId, &MtmStreams[MtmNStreams-1], true);
+	}
+}
+
 static char const* const MtmReplicationModeName[] =
 {
 	"exit",
@@ -217,24 +470,32 @@ pglogical_receiver_main(Datum main_arg)
 	MtmReplicationMode mode;
 
 	ByteBuffer buf;
+	ByteBuffer stream_buf;
+	MtmStream* stream = NULL;
 	/* Buffer for COPY data */
 	char	*copybuf = NULL;
 	int spill_file = -1;
+	int spill_file_id = 0;
 	StringInfoData spill_info;
+	StringInfoData work;
 	char *slotName;
-	char* connString = psprintf("replication=database %s", Mtm->nodes[nodeId-1].con.connStr);
+	char* connString = psprintf("replication=database %s%s",
+								MtmReplicationCompression ? "compression=1 " : "",
+								Mtm->nodes[nodeId-1].con.connStr);
 	static PortalData fakePortal;
 	int i;
 
 	MtmBackgroundWorker = true;
 
 	ByteBufferAlloc(&buf);
+	ByteBufferAlloc(&stream_buf);
 
 	slotName = psprintf(MULTIMASTER_SLOT_PATTERN, MtmNodeId);
 
 	MtmIsLogicalReceiver = true;
 
 	initStringInfo(&spill_info);
+	initStringInfo(&work);
 
 	/* Register functions for SIGTERM/SIGHUP management */
 	pqsignal(SIGHUP, receiver_raw_sighup);
@@ -310,6 +571,10 @@ pglogical_receiver_main(Datum main_arg)
 		timeline = Mtm->nodes[nodeId-1].timeline;
 		count = Mtm->recoveryCount;
 
+		/* Transactions received by previous parallel recovery session should be applied before we get restart position */
+		MtmRecoveryBarrier(nodeId);
+		MtmParallelRecoverySession = mode == REPLMODE_RECOVERY && MtmTrackDependencies && MtmParallelRecovery;
+
 		/* Establish connection to remote server */
 		conn = PQconnectdb_safe(connString, 0);
 		status = PQstatus(conn);
@@ -358,7 +623,7 @@ pglogical_receiver_main(Datum main_arg)
 		MTM_LOG1("Start replication on slot %s from node %d at position %llx, mode %s, recovered lsn %llx",
 				 slotName, nodeId, originStartPos, MtmReplicationModeName[mode], Mtm->recoveredLSN);
 
-		appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %x/%x (\"startup_params_format\" '1', \"max_proto_version\" '%d',  \"min_proto_version\" '%d', \"forward_changesets\" '1', \"mtm_replication_mode\" '%s', \"mtm_restart_pos\" '%llx', \"mtm_recovered_pos\" '%llx')",
+		appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %x/%x (\"startup_params_format\" '1', \"max_proto_version\" '%d',  \"min_proto_version\" '%d', \"forward_changesets\" '1', \"mtm_replication_mode\" '%s', \"mtm_restart_pos\" '%llx', \"mtm_recovered_pos\" '%llx', \"mtm_bootstrap_csn\" '%llu', \"mtm_conflict_fingerprints\" '%d')",
 						  slotName,
 						  (uint32) (originStartPos >> 32),
 						  (uint32) originStartPos,
@@ -366,7 +631,9 @@ pglogical_receiver_main(Datum main_arg)
 						  MULTIMASTER_MIN_PROTO_VERSION,
 						  MtmReplicationModeName[mode],
 						  originStartPos,
-						  Mtm->recoveredLSN
+						  Mtm->recoveredLSN,
+						  Mtm->bootstrapCsn,
+						  MtmConflictFingerprints
 			);
 		res = PQexec(conn, query->data);
 		if (PQresultStatus(res) != PGRES_COPY_BOTH)
@@ -389,8 +656,13 @@ pglogical_receiver_main(Datum main_arg)
 		}
 		PQclear(res);
 		resetPQExpBuffer(query);
+		MtmSetReceiverConnection(conn);
 
 		MtmStateProcessNeighborEvent(nodeId, MTM_NEIGHBOR_WAL_RECEIVER_START);
+		MtmWriteSetReceiverStart(nodeId);
+		MtmAbortStreams(nodeId);
+		ByteBufferReset(&stream_buf);
+		stream = NULL;
 
 		while (!got_sigterm)
 		{
@@ -406,6 +678,7 @@ pglogical_receiver_main(Datum main_arg)
 				/* Process config file */
 				ProcessConfigFile(PGC_SIGHUP);
 				got_sighup = false;
+				MtmSetReceiverConnection(conn);
 				ereport(LOG, (MTM_ERRMSG("%s: processed SIGHUP", worker_proc)));
 			}
 
@@ -450,6 +723,7 @@ pglogical_receiver_main(Datum main_arg)
 					copybuf = NULL;
 				}
 
+				MtmReceiverStalled = false;
 				rc = PQgetCopyData(conn, &copybuf, 1);
 				if (rc <= 0) {
 					break;
@@ -536,13 +810,62 @@ pglogical_receiver_main(Datum main_arg)
 					int msg_len = rc - hdr_len;
 					stmt = copybuf + hdr_len;
 					MTM_LOG3("Receive message %c from node %d", stmt[0], nodeId);
-					if (buf.used + msg_len + 1 >= MtmTransSpillThreshold*MB) {
+					if (stmt[0] == 'X') { /* start block of streamed transaction */
+						int64 xid = MtmGetStreamXid(stmt, msg_len);
+						bool first = stmt[9] != 0;
+						stream = MtmFindStream(xid);
+						if (first) {
+							if (stream != NULL) { /* transaction is streamed once again */
+								MtmEndStream(nodeId, stream, true);
+							}
+							stream = MtmStartStream(nodeId, xid);
+						} else if (stream == NULL) {
+							ereport(WARNING, (MTM_ERRMSG("%s: unknown streamed transaction %lld", worker_proc, (long64)xid)));
+							goto OnError;
+						}
+						Assert(stream_buf.used == 0);
+						output_written_lsn = Max(walEnd, output_written_lsn);
+						continue;
+					}
+					if (stream != NULL && !MtmIsImmediateMessage(stmt)) {
+						if (stmt[0] == 'Y') { /* end of block */
+							MtmWriteStreamSegment(stream, &stream_buf);
+							MtmDispatchStream(nodeId, stream, false);
+							stream = NULL;
+						} else if (stmt[0] == 'C') {
+							if (!MtmFilterTransaction(stmt, msg_len)) {
+								ByteBufferAppend(&stream_buf, stmt, msg_len);
+								MtmWriteStreamSegment(stream, &stream_buf);
+								MtmDispatchStream(nodeId, stream, true);
+								MtmEndStream(nodeId, stream, false);
+							} else {
+								ByteBufferReset(&stream_buf);
+								MtmEndStream(nodeId, stream, true);
+							}
+							stream = NULL;
+						} else {
+							if (stream_buf.used + msg_len + 1 >= (size_t)MtmTransSpillThreshold*1024) {
+								MtmWriteStreamSegment(stream, &stream_buf);
+							}
+							ByteBufferAppend(&stream_buf, stmt, msg_len);
+						}
+						output_written_lsn = Max(walEnd, output_written_lsn);
+						continue;
+					}
+					if (stmt[0] == 'A') { /* streamed transaction is aborted at origin */
+						MtmStream* aborted = MtmFindStream(MtmGetStreamXid(stmt, msg_len));
+						if (aborted != NULL) {
+							MtmEndStream(nodeId, aborted, true);
+						}
+						output_written_lsn = Max(walEnd, output_written_lsn);
+						continue;
+					}
+					if (buf.used + msg_len + 1 >= (size_t)MtmTransSpillThreshold*1024) { /* threshold is in kB */
 						if (spill_file < 0) {
-							int file_id;
-							spill_file = MtmCreateSpillFile(nodeId, &file_id);
+							spill_file = MtmCreateSpillFile(nodeId, &spill_file_id);
 							pq_sendbyte(&spill_info, 'F');
 							pq_sendint(&spill_info, nodeId, 4);
-							pq_sendint(&spill_info, file_id, 4);
+							pq_sendint(&spill_info, spill_file_id, 4);
 						}
 						ByteBufferAppend(&buf, ")", 1);
 						pq_sendbyte(&spill_info, '(');
@@ -550,10 +873,11 @@ pglogical_receiver_main(Datum main_arg)
 						MtmSpillToFile(spill_file, buf.data, buf.used);
 						ByteBufferReset(&buf);
 					}
-					if (stmt[0] == 'Z' || (stmt[0] == 'M' && (stmt[1] == 'L' || stmt[1] == 'A' || stmt[1] == 'C'))) {
+					if (MtmIsImmediateMessage(stmt)) {
 						MTM_LOG3("Process '%c' message from %d", stmt[1], nodeId);
+						MtmRecoveryBarrier(nodeId);
 						if (stmt[0] == 'M' && stmt[1] == 'C') { /* concurrent DDL should be executed by parallel workers */
-							MtmExecute(stmt, msg_len);
+							MtmExecute(stmt, msg_len, BGW_LANE_BULK);
 						} else {
 							MtmExecutor(stmt, msg_len); /* all other messages can be processed by receiver itself */
 						}
@@ -569,11 +893,23 @@ pglogical_receiver_main(Datum main_arg)
 									pq_sendint(&spill_info, buf.used, 4);
 									MtmSpillToFile(spill_file, buf.data, buf.used);
 									MtmCloseSpillFile(spill_file);
-									MtmExecute(spill_info.data, spill_info.len);
+									MtmExecuteTransaction(nodeId, spill_info.data, spill_info.len, true, false, &work);
 									spill_file = -1;
 									resetStringInfo(&spill_info);
+								} else if (MtmParallelRecoverySession) {
+									MtmExecuteTransaction(nodeId, buf.data, buf.used, false, false, &work);
 								} else {
-									if (MtmPreserveCommitOrder && buf.used == msg_len) {
+									if (MtmPreserveCommitOrder && MtmOriginCommitOrder && buf.used == msg_len) {
+										/*
+										 * Commit-prepared and rollback-prepared are finished by the pool in the order
+										 * of receiving. They are kept in the priority lane, where works are fetched
+										 * in FIFO order, so that predecessor of a commit is never queued after it.
+										 */
+										resetStringInfo(&work);
+										MtmWriteSetScheduleCommit(nodeId, &work);
+										appendBinaryStringInfo(&work, buf.data, buf.used);
+										MtmExecute(work.data, work.len, BGW_LANE_PRIORITY);
+									} else if (MtmPreserveCommitOrder && buf.used == msg_len) {
 										/* Perform commit-prepared and rollback-prepared requested directly in receiver */
 										timestamp_t stop, start = MtmGetSystemTime();
 										MtmExecutor(buf.data, buf.used);
@@ -581,14 +917,23 @@ pglogical_receiver_main(Datum main_arg)
 										if (stop - start > USECS_PER_SEC) {
 											elog(WARNING, "Commit of prepared transaction takes %lld usec, flags=%x", stop - start, stmt[1]);
 										}
+									} else if (buf.used == msg_len) {
+										/*
+										 * Commit-prepared and rollback-prepared should not wait for other transactions:
+										 * them may be waiting for locks held by this prepared transaction
+										 */
+										MtmExecute(buf.data, buf.used, MtmWorkLane(buf.used));
 									} else {
 										/* all other commits should be applied in place */
 										// Assert(stmt[1] == PGLOGICAL_PREPARE || stmt[1] == PGLOGICAL_COMMIT || stmt[1] == PGLOGICAL_PRECOMMIT_PREPARED);
-										MtmExecute(buf.data, buf.used);
+										bool doomed = MtmConflictFingerprints && stmt[1] == PGLOGICAL_PREPARE
+											&& MtmFingerprintIsDoomed(buf.data, buf.used, stmt, msg_len);
+										MtmExecuteTransaction(nodeId, buf.data, buf.used, false, doomed, &work);
 									}
 								}
 							} else if (spill_file >= 0) {
 								MtmCloseSpillFile(spill_file);
+								MtmRemoveSpillFile(nodeId, spill_file_id);
 								resetStringInfo(&spill_info);
 								spill_file = -1;
 							}
@@ -690,15 +1035,18 @@ pglogical_receiver_main(Datum main_arg)
 				goto OnError;
 			}
 		}
+		MtmSetReceiverConnection(NULL);
 		PQfinish(conn);
 		continue;
 
 	  OnError:
+		MtmSetReceiverConnection(NULL);
 		PQfinish(conn);
 		MtmReleaseRecoverySlot(nodeId);
 		MtmSleep(RECEIVER_SUSPEND_TIMEOUT);
 	}
 	ByteBufferFree(&buf);
+	ByteBufferFree(&stream_buf);
 	/* Restart this bgworker */
 	proc_exit(1);
 }
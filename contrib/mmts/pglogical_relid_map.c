@@ -11,10 +11,20 @@
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
+#include "access/genam.h"
+#include "access/stratnum.h"
+#include "catalog/pg_index.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "storage/shmem.h"
 #include "pglogical_relid_map.h"
 
 static HTAB *relid_map;
+static HTAB *apply_info_map;
+static PGLSharedRelidMapEntry *shared_relid_map;
 
 static void
 pglogical_relid_map_init(void)
@@ -62,3 +72,199 @@ void pglogical_relid_map_reset(void)
 		relid_map = NULL;
 	}
 }
+
+/*
+ * Map of remote relation Oids to local ones is shared by all apply workers, so each of them
+ * doesn't need to resolve relation names received from other nodes using catalog lookup.
+ * It is open addressing hash table with linear probing: entries are never removed and lookup
+ * doesn't take any locks. Mapping may become obsolete when local or remote relation is dropped,
+ * so it is validated by caller using relation cache and updated in place.
+ */
+Size pglogical_shared_relid_map_shmem_size(void)
+{
+	return sizeof(PGLSharedRelidMapEntry)*PGL_SHARED_RELID_MAP_SIZE;
+}
+
+void pglogical_shared_relid_map_init(void)
+{
+	bool found;
+	shared_relid_map = (PGLSharedRelidMapEntry*)ShmemInitStruct("pglogical_shared_relid_map",
+																pglogical_shared_relid_map_shmem_size(), &found);
+	if (!found) {
+		int i;
+		for (i = 0; i < PGL_SHARED_RELID_MAP_SIZE; i++) {
+			pg_atomic_init_u64(&shared_relid_map[i].key, 0);
+			pg_atomic_init_u32(&shared_relid_map[i].local_relid, InvalidOid);
+		}
+	}
+}
+
+static inline uint64
+pglogical_shared_relid_map_key(int node, Oid remote_relid)
+{
+	return ((uint64)node << 32) | remote_relid;
+}
+
+static inline uint32
+pglogical_shared_relid_map_hash(uint64 key)
+{
+	return (uint32)((key * UINT64CONST(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/*
+ * Returns InvalidOid if relation is not in the map or its entry is being filled
+ */
+Oid pglogical_shared_relid_map_get(int node, Oid remote_relid)
+{
+	uint64 key = pglogical_shared_relid_map_key(node, remote_relid);
+	uint32 h = pglogical_shared_relid_map_hash(key);
+	int i;
+
+	for (i = 0; i < PGL_SHARED_RELID_MAP_SIZE; i++) {
+		PGLSharedRelidMapEntry* entry = &shared_relid_map[(h + i) & (PGL_SHARED_RELID_MAP_SIZE-1)];
+		uint64 entry_key = pg_atomic_read_u64(&entry->key);
+		if (entry_key == key) {
+			return (Oid)pg_atomic_read_u32(&entry->local_relid);
+		}
+		if (entry_key == 0) {
+			break;
+		}
+	}
+	return InvalidOid;
+}
+
+/*
+ * Insert or update mapping. If the map is full, relation is just not cached.
+ */
+void pglogical_shared_relid_map_put(int node, Oid remote_relid, Oid local_relid)
+{
+	uint64 key = pglogical_shared_relid_map_key(node, remote_relid);
+	uint32 h = pglogical_shared_relid_map_hash(key);
+	int i;
+
+	for (i = 0; i < PGL_SHARED_RELID_MAP_SIZE; i++) {
+		PGLSharedRelidMapEntry* entry = &shared_relid_map[(h + i) & (PGL_SHARED_RELID_MAP_SIZE-1)];
+		uint64 entry_key = pg_atomic_read_u64(&entry->key);
+		if (entry_key == 0) {
+			/* Entry can be concurrently taken for the same or another key */
+			if (!pg_atomic_compare_exchange_u64(&entry->key, &entry_key, key) && entry_key != key) {
+				continue;
+			}
+			entry_key = key;
+		}
+		if (entry_key == key) {
+			pg_atomic_write_u32(&entry->local_relid, local_relid);
+			return;
+		}
+	}
+	elog(DEBUG1, "Shared relid map is full: relation %u of node %d is not cached", remote_relid, node);
+}
+
+static void
+pglogical_apply_info_invalidate(Datum arg, Oid relid)
+{
+	PGLRelApplyInfo* info;
+
+	if (apply_info_map == NULL) {
+		return;
+	}
+	if (relid == InvalidOid) {
+		HASH_SEQ_STATUS status;
+		hash_seq_init(&status, apply_info_map);
+		while ((info = (PGLRelApplyInfo*)hash_seq_search(&status)) != NULL) {
+			info->valid = false;
+		}
+	} else {
+		info = (PGLRelApplyInfo*)hash_search(apply_info_map, &relid, HASH_FIND, NULL);
+		if (info != NULL) {
+			info->valid = false;
+		}
+	}
+}
+
+static void
+pglogical_apply_info_build(PGLRelApplyInfo* info, Relation rel)
+{
+	Relation    idxrel;
+	Datum		indclassDatum;
+	Datum		indkeyDatum;
+	bool		isnull;
+	oidvector  *opclass;
+	int2vector *indkey;
+	int         attoff;
+	MemoryContext old_context;
+
+	if (rel->rd_indexvalid == 0)
+		RelationGetIndexList(rel);
+	info->pkey_relid = rel->rd_replidindex;
+	info->nkeys = 0;
+	if (!OidIsValid(info->pkey_relid)) {
+		info->valid = true;
+		return;
+	}
+	idxrel = index_open(info->pkey_relid, AccessShareLock);
+	Assert(idxrel->rd_index->indisunique);
+
+	indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
+									Anum_pg_index_indclass, &isnull);
+	Assert(!isnull);
+	opclass = (oidvector *) DatumGetPointer(indclassDatum);
+
+	indkeyDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
+								  Anum_pg_index_indkey, &isnull);
+	Assert(!isnull);
+	indkey = (int2vector *) DatumGetPointer(indkeyDatum);
+
+	/* operator info should survive the transaction */
+	old_context = MemoryContextSwitchTo(CacheMemoryContext);
+	for (attoff = 0; attoff < IndexRelationGetNumberOfKeyAttributes(idxrel); attoff++)
+	{
+		Oid	optype = get_opclass_input_type(opclass->values[attoff]);
+		Oid	opfamily = get_opclass_family(opclass->values[attoff]);
+		Oid	operator = get_opfamily_member(opfamily, optype, optype, BTEqualStrategyNumber);
+
+		if (!OidIsValid(operator)) {
+			MemoryContextSwitchTo(old_context);
+			elog(ERROR, "could not lookup equality operator for optype %u in opfamily %u",
+				 optype, opfamily);
+		}
+		info->attnums[attoff] = indkey->values[attoff];
+		ScanKeyInit(&info->skey[attoff],
+					attoff + 1,
+					BTEqualStrategyNumber,
+					get_opcode(operator),
+					(Datum)0);
+	}
+	MemoryContextSwitchTo(old_context);
+
+	info->nkeys = attoff;
+	info->valid = true;
+	index_close(idxrel, NoLock);
+}
+
+/*
+ * Get apply descriptor of the relation, building it if needed.
+ */
+PGLRelApplyInfo* pglogical_apply_info_get(Relation rel)
+{
+	Oid relid = RelationGetRelid(rel);
+	PGLRelApplyInfo* info;
+	bool found;
+
+	if (apply_info_map == NULL) {
+		HASHCTL	ctl;
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(PGLRelApplyInfo);
+		apply_info_map = hash_create("pglogical_apply_info_map", PGL_INIT_RELID_MAP_SIZE, &ctl, HASH_ELEM | HASH_BLOBS);
+		CacheRegisterRelcacheCallback(pglogical_apply_info_invalidate, (Datum)0);
+	}
+	info = (PGLRelApplyInfo*)hash_search(apply_info_map, &relid, HASH_ENTER, &found);
+	if (!found) {
+		info->valid = false;
+	}
+	if (!info->valid) {
+		pglogical_apply_info_build(info, rel);
+	}
+	return info;
+}
@@ -1,14 +1,47 @@
 #ifndef PGLOGICAL_RELID_MAP
 #define PGLOGICAL_RELID_MAP
 
+#include "access/skey.h"
+#include "port/atomics.h"
+#include "utils/rel.h"
+
 #define PGL_INIT_RELID_MAP_SIZE 256
+#define PGL_SHARED_RELID_MAP_SIZE (64*1024) /* should be power of 2 */
 
 typedef struct PGLRelidMapEntry { 
 	Oid remote_relid;
 	Oid local_relid;
 } PGLRelidMapEntry; 
 
+/*
+ * Entry of the map of relations of other nodes shared by all apply workers.
+ * Key combines id of the sender node and relation Oid at this node, zero key marks free entry.
+ */
+typedef struct PGLSharedRelidMapEntry {
+	pg_atomic_uint64 key;
+	pg_atomic_uint32 local_relid;
+} PGLSharedRelidMapEntry;
+
+/*
+ * Apply descriptor of local relation: replica identity index and scan key templates
+ * used to locate tuples updated or deleted by remote transactions.
+ * Entries are invalidated by relcache callback and rebuilt on next access.
+ */
+typedef struct PGLRelApplyInfo {
+	Oid         relid;
+	bool        valid;
+	Oid         pkey_relid;                  /* replica identity index */
+	int         nkeys;                       /* number of key columns */
+	AttrNumber  attnums[INDEX_MAX_KEYS];     /* heap attribute number of each key column */
+	ScanKeyData skey[INDEX_MAX_KEYS];        /* scan keys with resolved equality operators, arguments are not set */
+} PGLRelApplyInfo;
+
 extern Oid  pglogical_relid_map_get(Oid relid);
 extern bool pglogical_relid_map_put(Oid remote_relid, Oid local_relid);
 extern void pglogical_relid_map_reset(void);
+extern Size pglogical_shared_relid_map_shmem_size(void);
+extern void pglogical_shared_relid_map_init(void);
+extern Oid  pglogical_shared_relid_map_get(int node, Oid remote_relid);
+extern void pglogical_shared_relid_map_put(int node, Oid remote_relid, Oid local_relid);
+extern PGLRelApplyInfo* pglogical_apply_info_get(Relation rel);
 #endif
@@ -17,6 +17,7 @@
 #include <netdb.h>
 #include <time.h>
 #include <fcntl.h>
+#include <sys/select.h>
 
 #include "postgres.h"
 #include "fmgr.h"
@@ -26,6 +27,7 @@
 #include "storage/latch.h"
 #include "storage/proc.h"
 #include "storage/ipc.h"
+#include "storage/pmsignal.h"
 
 #include "multimaster.h"
 
@@ -38,6 +40,55 @@ static void MtmShutdownReferee(int sig)
 	MtmRefereeStop = true;
 }
 
+/*
+ * Queries are sent to all nodes at once: wait until all of them respond or deadline is reached.
+ */
+static void MtmRefereeWaitResponses(PGconn** conns, int nConns, timestamp_t deadline)
+{
+	nodemask_t brokenMask = 0;
+
+	while (!MtmRefereeStop) {
+		struct timeval tv;
+		fd_set inset;
+		int max_sd = -1;
+		timestamp_t now;
+		int i;
+
+		FD_ZERO(&inset);
+		for (i = 0; i < nConns; i++) {
+			if (conns[i] != NULL && !BIT_CHECK(brokenMask, i) && PQisBusy(conns[i])) {
+				int sd = PQsocket(conns[i]);
+				FD_SET(sd, &inset);
+				if (sd > max_sd) {
+					max_sd = sd;
+				}
+			}
+		}
+		now = MtmGetSystemTime();
+		if (max_sd < 0 || now >= deadline) {
+			break;
+		}
+		/* Check for postmaster death at least once per second */
+		tv.tv_sec = 0;
+		tv.tv_usec = Min(deadline - now, USECS_PER_SEC);
+		if (select(max_sd+1, &inset, NULL, NULL, &tv) < 0 && errno != EINTR) {
+			MTM_ELOG(WARNING, "Referee failed to select sockets: %s", strerror(errno));
+			break;
+		}
+		if (!PostmasterIsAlive()) {
+			proc_exit(1);
+		}
+		for (i = 0; i < nConns; i++) {
+			if (conns[i] != NULL && !BIT_CHECK(brokenMask, i) && FD_ISSET(PQsocket(conns[i]), &inset)) {
+				/* Errors are reported when result is retrieved */
+				if (!PQconsumeInput(conns[i])) {
+					BIT_SET(brokenMask, i);
+				}
+			}
+		}
+	}
+}
+
 static void MtmRefereeLoop(char const** connections, int nConns)
 {
 	PGconn* conns[MAX_NODES];
@@ -67,6 +118,8 @@ static void MtmRefereeLoop(char const** connections, int nConns)
 
 	while (!MtmRefereeStop) { 
 		char sql[128];
+		timestamp_t start = MtmGetSystemTime();
+		long64 delay;
 		sprintf(sql, "select mtm.referee_poll(%lld)", disabledMask);
 
 		/* Initiate queries to all live nodes */
@@ -95,10 +148,16 @@ static void MtmRefereeLoop(char const** connections, int nConns)
 				}
 			}
 		}
-		/* Wait some time */
-		result = WaitLatch(&MyProc->procLatch, WL_TIMEOUT | WL_POSTMASTER_DEATH, MtmHeartbeatRecvTimeout);
-		if (result & WL_POSTMASTER_DEATH) {
-			proc_exit(1);
+		/* Wait for responses from all nodes, but not longer than heartbeat receive timeout */
+		MtmRefereeWaitResponses(conns, nConns, start + MSEC_TO_USEC(MtmHeartbeatRecvTimeout));
+
+		/* Do not poll nodes more often than heartbeats are sent */
+		delay = start + MSEC_TO_USEC(MtmHeartbeatSendTimeout) - MtmGetSystemTime();
+		if (delay > 0) {
+			result = WaitLatch(&MyProc->procLatch, WL_TIMEOUT | WL_POSTMASTER_DEATH, USEC_TO_MSEC(delay) + 1);
+			if (result & WL_POSTMASTER_DEATH) {
+				proc_exit(1);
+			}
 		}
 
 		oldEnabledMask = newEnabledMask;
@@ -0,0 +1,261 @@
+/*
+ * sampler.c
+ *
+ * Sampling of wait events, query ids and multimaster state of backends (see sampler.h).
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+#include "multimaster.h"
+#include "sampler.h"
+
+char const* const MtmSampleStateName[] =
+{
+	NULL,
+	"prepare",
+	"csn_wait",
+	"visibility_wait",
+	"apply"
+};
+
+int MtmSamplingPeriod;
+int MtmSamplingHistory;
+
+MtmSamplerProc* MtmSamplerProcs;
+
+/*
+ * Ring of the last MtmSamplingHistory samples. It is written only by the sampler worker:
+ * sample number N is stored in samples[N % MtmSamplingHistory] before head is advanced past it.
+ */
+typedef struct
+{
+	pg_atomic_uint64 head;  /* number of samples ever recorded */
+	pg_atomic_uint64 reset; /* samples before this number were discarded by MtmSamplerReset */
+	MtmSample samples[FLEXIBLE_ARRAY_MEMBER];
+} MtmSamplerRing;
+
+static MtmSamplerRing* MtmSampleRing;
+
+typedef struct
+{
+	int pid;
+	int procno;
+} MtmSamplerPid;
+
+static MtmSamplerPid* MtmSamplerPids; /* sampler worker: map of pids of running processes to their PGPROCs */
+
+static volatile sig_atomic_t MtmSamplerStop;
+static volatile sig_atomic_t MtmSamplerReload;
+
+Size MtmSamplerShmemSize(void)
+{
+	/* Slots of processes are allocated from MTM_SHMEM_SIZE, as ProcGlobal->allProcCount is not known yet */
+	return MAXALIGN(offsetof(MtmSamplerRing, samples) + sizeof(MtmSample)*MtmSamplingHistory);
+}
+
+void MtmSamplerInitialize(void)
+{
+	bool found;
+	MtmSampleRing = (MtmSamplerRing*)ShmemInitStruct("MtmSampleRing", MtmSamplerShmemSize(), &found);
+	MtmSamplerProcs = (MtmSamplerProc*)ShmemInitStruct("MtmSamplerProcs", sizeof(MtmSamplerProc)*ProcGlobal->allProcCount, &found);
+	if (!found) {
+		pg_atomic_init_u64(&MtmSampleRing->head, 0);
+		pg_atomic_init_u64(&MtmSampleRing->reset, 0);
+		MemSet(MtmSamplerProcs, 0, sizeof(MtmSamplerProc)*ProcGlobal->allProcCount);
+	}
+}
+
+/*
+ * Remember query id of the statement started by the current backend.
+ * Statements executed by functions share the start time with the top-level statement, which keeps its id.
+ */
+void MtmSamplerSetQueryId(uint32 queryId)
+{
+	TimestampTz stmtStart = GetCurrentStatementStartTimestamp();
+
+	if (MtmSamplerProcs != NULL && MyProc != NULL) {
+		volatile MtmSamplerProc* slot = &MtmSamplerProcs[MyProc->pgprocno];
+		if (slot->stmtStart != stmtStart) {
+			slot->queryId = queryId;
+			pg_write_barrier();
+			slot->stmtStart = stmtStart;
+		}
+	}
+}
+
+static int MtmSamplerComparePids(const void* a, const void* b)
+{
+	int pa = ((MtmSamplerPid const*)a)->pid;
+	int pb = ((MtmSamplerPid const*)b)->pid;
+	return pa < pb ? -1 : pa == pb ? 0 : 1;
+}
+
+static void MtmSamplerAppend(MtmSample* sample)
+{
+	uint64 head = pg_atomic_read_u64(&MtmSampleRing->head);
+	MtmSampleRing->samples[head % MtmSamplingHistory] = *sample;
+	pg_write_barrier();
+	pg_atomic_write_u64(&MtmSampleRing->head, head + 1);
+}
+
+/*
+ * Take one sample of every backend which runs a statement and of every multimaster worker applying a transaction.
+ * Idle backends are not sampled. Wait events are taken from PGPROC, activity of backends from pgstat.
+ */
+static void MtmSamplerCollect(void)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	int nProcs = 0;
+	int nBackends;
+	int i;
+
+	for (i = 0; i < ProcGlobal->allProcCount; i++) {
+		int pid = ProcGlobal->allProcs[i].pid;
+		if (pid != 0) {
+			MtmSamplerPids[nProcs].pid = pid;
+			MtmSamplerPids[nProcs].procno = i;
+			nProcs += 1;
+		}
+	}
+	qsort(MtmSamplerPids, nProcs, sizeof(MtmSamplerPid), MtmSamplerComparePids);
+
+	pgstat_clear_snapshot();
+	nBackends = pgstat_fetch_stat_numbackends();
+	for (i = 1; i <= nBackends; i++) {
+		PgBackendStatus* be = &pgstat_fetch_stat_local_beentry(i)->backendStatus;
+		MtmSamplerPid key;
+		MtmSamplerPid* proc;
+		volatile MtmSamplerProc* slot;
+		MtmSample sample;
+		TimestampTz stmtStart;
+
+		key.pid = be->st_procpid;
+		proc = (MtmSamplerPid*)bsearch(&key, MtmSamplerPids, nProcs, sizeof(MtmSamplerPid), MtmSamplerComparePids);
+		if (proc == NULL) {
+			continue; /* process has exited */
+		}
+		slot = &MtmSamplerProcs[proc->procno];
+		sample.state = slot->state;
+		switch (be->st_state) {
+		  case STATE_RUNNING:
+		  case STATE_FASTPATH:
+			break;
+		  case STATE_UNDEFINED:
+			/* Background workers do not report activity: sample them only while they do multimaster work */
+			if (sample.state == MTM_SAMPLE_NONE) {
+				continue;
+			}
+			break;
+		  default:
+			continue;
+		}
+		stmtStart = slot->stmtStart;
+		pg_read_barrier();
+		/* Statements which did not pass the executor (utility commands) have no query id */
+		sample.queryId = stmtStart == be->st_activity_start_timestamp ? slot->queryId : 0;
+		sample.waitEventInfo = ((volatile PGPROC*)&ProcGlobal->allProcs[proc->procno])->wait_event_info;
+		sample.pid = key.pid;
+		sample.time = now;
+		MtmSamplerAppend(&sample);
+	}
+}
+
+/*
+ * Copy samples which are still in the ring, in the order they were taken.
+ */
+int MtmSamplerGetHistory(MtmSample** samples)
+{
+	uint64 size = (uint64)MtmSamplingHistory;
+	uint64 head = pg_atomic_read_u64(&MtmSampleRing->head);
+	uint64 from = Max(pg_atomic_read_u64(&MtmSampleRing->reset), head > size ? head - size : 0);
+	uint64 count = head - from;
+	uint64 skip = 0;
+	uint64 i;
+	MtmSample* copy = (MtmSample*)palloc(sizeof(MtmSample)*count);
+
+	pg_read_barrier();
+	for (i = from; i < head; i++) {
+		copy[i - from] = MtmSampleRing->samples[i % size];
+	}
+	pg_read_barrier();
+
+	/* Meanwhile the sampler may have advanced head to H and be writing sample H in place of sample H-size */
+	head = pg_atomic_read_u64(&MtmSampleRing->head);
+	if (head + 1 > from + size) {
+		skip = Min(head + 1 - size - from, count);
+		memmove(copy, copy + skip, sizeof(MtmSample)*(count - skip));
+	}
+	*samples = copy;
+	return (int)(count - skip);
+}
+
+void MtmSamplerReset(void)
+{
+	pg_atomic_write_u64(&MtmSampleRing->reset, pg_atomic_read_u64(&MtmSampleRing->head));
+}
+
+static void MtmSamplerSigterm(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+	MtmSamplerStop = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void MtmSamplerSighup(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+	MtmSamplerReload = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void MtmSamplerMain(Datum arg)
+{
+	pqsignal(SIGTERM, MtmSamplerSigterm);
+	pqsignal(SIGHUP, MtmSamplerSighup);
+
+	/* We're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+
+	MtmSamplerPids = (MtmSamplerPid*)MemoryContextAlloc(TopMemoryContext, sizeof(MtmSamplerPid)*ProcGlobal->allProcCount);
+
+	while (!MtmSamplerStop) {
+		int rc;
+
+		if (MtmSamplerReload) {
+			MtmSamplerReload = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+		if (MtmSamplingPeriod > 0) {
+			MtmSamplerCollect();
+		}
+		/* Sampling can be switched on by reload, which sets the latch */
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH | (MtmSamplingPeriod > 0 ? WL_TIMEOUT : 0), MtmSamplingPeriod);
+		if (rc & WL_POSTMASTER_DEATH) {
+			proc_exit(1);
+		}
+		ResetLatch(MyLatch);
+	}
+}
+
+static BackgroundWorker MtmSamplerWorker = {
+	"mtm-sampler",
+	BGWORKER_SHMEM_ACCESS,
+	BgWorkerStart_ConsistentState,
+	BGW_DEFAULT_RESTART_INTERVAL,
+	MtmSamplerMain
+};
+
+void MtmSamplerStart(void)
+{
+	RegisterBackgroundWorker(&MtmSamplerWorker);
+}
@@ -0,0 +1,73 @@
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include "port/atomics.h"
+#include "storage/proc.h"
+#include "utils/timestamp.h"
+
+/*
+ * Wait event sampler.
+ *
+ * Background worker "mtm-sampler" periodically looks at every backend running a statement and at every
+ * multimaster worker applying a remote transaction, and records its wait event, query id and multimaster
+ * state into a ring buffer in shared memory. A sample without wait event means that the process was on CPU.
+ *
+ * Backends publish the query id and multimaster state in their slot of MtmSamplerProcs with plain stores,
+ * so that instrumented paths pay only for one write.
+ */
+
+typedef enum
+{
+	MTM_SAMPLE_NONE,            /* no multimaster activity */
+	MTM_SAMPLE_PREPARE,         /* coordinator: local prepare of distributed transaction */
+	MTM_SAMPLE_CSN_WAIT,        /* coordinator: wait for votes and global CSN of the transaction */
+	MTM_SAMPLE_VISIBILITY_WAIT, /* visibility check waits until in-doubt transaction is resolved */
+	MTM_SAMPLE_APPLY,           /* apply worker or receiver applies remote transaction */
+	MTM_SAMPLE_N_STATES
+} MtmSampleState;
+
+typedef struct
+{
+	uint32      queryId;        /* query id of the current top-level statement, 0 if unknown */
+	uint8       state;          /* MtmSampleState */
+	TimestampTz stmtStart;      /* start of the top-level statement queryId belongs to */
+} MtmSamplerProc;
+
+typedef struct
+{
+	TimestampTz time;
+	int32       pid;
+	uint32      waitEventInfo;  /* 0 if the process was on CPU */
+	uint32      queryId;
+	uint8       state;          /* MtmSampleState */
+} MtmSample;
+
+extern char const* const MtmSampleStateName[];
+
+extern int MtmSamplingPeriod;
+extern int MtmSamplingHistory;
+
+extern MtmSamplerProc* MtmSamplerProcs; /* [ProcGlobal->allProcCount] in shared memory */
+
+extern Size MtmSamplerShmemSize(void);
+extern void MtmSamplerInitialize(void);
+extern void MtmSamplerStart(void);
+extern void MtmSamplerSetQueryId(uint32 queryId);
+extern int  MtmSamplerGetHistory(MtmSample** samples);
+extern void MtmSamplerReset(void);
+
+/*
+ * Publish multimaster state of the current process, returning the previous one so that nested waits can restore it.
+ */
+static inline MtmSampleState MtmSamplerSetState(MtmSampleState state)
+{
+	MtmSampleState prev = MTM_SAMPLE_NONE;
+	if (MtmSamplerProcs != NULL && MyProc != NULL) {
+		volatile MtmSamplerProc* slot = &MtmSamplerProcs[MyProc->pgprocno];
+		prev = (MtmSampleState)slot->state;
+		slot->state = (uint8)state;
+	}
+	return prev;
+}
+
+#endif
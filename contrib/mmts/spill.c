@@ -2,15 +2,22 @@
 
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/procarray.h"
+#include "miscadmin.h"
 #include "spill.h"
 #include "pgstat.h"
 
 #include "multimaster.h"
+#include "perfstat.h"
 
 void MtmSpillToFile(int fd, char const* data, size_t size)
 {
 	Assert(fd >= 0);
+	MtmPerfRecord(MTM_PERF_SPILL_BYTES, 0, size);
 	while (size != 0) { 
 		int written = write(fd, data, size);
 		if (written <= 0) { 
@@ -58,9 +65,10 @@ void MtmCreateSpillDirectory(int node_id)
 }
 
 
+static int spill_file_id;
+
 int MtmCreateSpillFile(int node_id, int* file_id)
 {
-	static int spill_file_id;
 	char path[MAXPGPATH];
 	int fd;
 
@@ -79,6 +87,68 @@ int MtmCreateSpillFile(int node_id, int* file_id)
 	return fd;
 }
 
+/*
+ * Spill file of streamed transaction lives longer than any local transaction of the receiver,
+ * so it is not registered as transient file (which are closed at the end of transaction).
+ */
+int MtmCreateStreamFile(int node_id, int* file_id)
+{
+	char path[MAXPGPATH];
+	int fd;
+
+	sprintf(path, "pg_mtm/%d/txn-%d.snap",
+			node_id, ++spill_file_id);
+	fd = BasicOpenFile(path,
+					   O_CREAT | O_TRUNC | O_WRONLY | O_APPEND | PG_BINARY,
+					   S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		ereport(PANIC,
+				(errcode_for_file_access(),
+				 MTM_ERRMSG("pglogical_receiver could not create stream file \"%s\": %m",
+						path)));
+	}
+	*file_id = spill_file_id;
+	return fd;
+}
+
+/*
+ * Append segment of streamed transaction prefixed with its length. Zero length segment marks aborted transaction.
+ */
+void MtmStreamToFile(int fd, char const* data, uint32 size)
+{
+	Assert(fd >= 0);
+	MtmPerfRecord(MTM_PERF_SPILL_BYTES, 0, size + sizeof(size));
+	while (true) {
+		int written = write(fd, &size, sizeof(size));
+		if (written == sizeof(size)) {
+			break;
+		}
+		if (written >= 0 || errno != EINTR) {
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 MTM_ERRMSG("pglogical_recevier failed to write stream file: %m")));
+		}
+	}
+	while (size != 0) {
+		int written = write(fd, data, size);
+		if (written <= 0) {
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 MTM_ERRMSG("pglogical_recevier failed to write stream file: %m")));
+		}
+		data += written;
+		size -= written;
+	}
+}
+
+void MtmCloseStreamFile(int fd)
+{
+	close(fd);
+}
+
 int MtmOpenSpillFile(int node_id, int file_id)
 {
 	static char path[MAXPGPATH];
@@ -103,23 +173,111 @@ int MtmOpenSpillFile(int node_id, int file_id)
 	return fd;
 }
 
-void MtmReadSpillFile(int fd, char* data, size_t size)
+void MtmCloseSpillFile(int fd)
 {
-	Assert(fd >= 0);
-	while (size != 0) { 
-		int rc = read(fd, data, size);
-		if (rc <= 0) { 
-			CloseTransientFile(fd);
-			ereport(ERROR,
+	CloseTransientFile(fd);
+}
+
+/*
+ * Remove spill file which will never be opened by apply worker (transaction was filtered out)
+ */
+void MtmRemoveSpillFile(int node_id, int file_id)
+{
+	char path[MAXPGPATH];
+
+	sprintf(path, "pg_mtm/%d/txn-%d.snap",
+			node_id, file_id);
+	if (unlink(path) < 0 && errno != ENOENT) {
+		ereport(LOG,
 				(errcode_for_file_access(),
-				 MTM_ERRMSG("pglogical_apply failed to read spill file: %m")));
+				 MTM_ERRMSG("pglogical_receiver failed to unlink spill file \"%s\": %m",
+						path)));
+	}
+}
+
+/*
+ * Map segment [offset, offset+size) of spill file into memory, so that apply worker can parse it in place
+ * instead of reading it into palloc'ed buffer. Mapping is private: pages touched by parser are copied on write,
+ * all other pages are shared with OS file cache. Only one segment is mapped at each moment, so memory consumption
+ * of the worker doesn't depend on the total size of spilled transaction.
+ */
+char* MtmMapSpillSegment(int fd, off_t offset, size_t size, MtmSpillSegment* seg)
+{
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	off_t  start = offset - offset % page_size;
+	char*  base;
+
+	Assert(fd >= 0 && seg->base == NULL);
+	seg->len = size + (offset - start);
+	base = mmap(NULL, seg->len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, start);
+	if (base == MAP_FAILED) {
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 MTM_ERRMSG("pglogical_apply failed to map spill file segment of size %lu: %m", (unsigned long)size)));
+	}
+#ifdef MADV_SEQUENTIAL
+	(void)madvise(base, seg->len, MADV_SEQUENTIAL);
+#endif
+	seg->base = base;
+	return base + (offset - start);
+}
+
+void MtmUnmapSpillSegment(MtmSpillSegment* seg)
+{
+	if (seg->base != NULL) {
+		if (munmap(seg->base, seg->len) < 0) {
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 MTM_ERRMSG("pglogical_apply failed to unmap spill file segment: %m")));
 		}
-		data += rc;
-		size -= rc;
+		seg->base = NULL;
+		seg->len = 0;
 	}
 }
 
-void MtmCloseSpillFile(int fd)
+/*
+ * Wait until receiver appends next segment of streamed transaction to the spill file.
+ * Each segment is prefixed with its 4-byte length, zero length means that transaction was aborted at origin.
+ * Receiver doesn't know which worker is waiting for the stream, so file is polled with MTM_STREAM_POLL_TIMEOUT interval.
+ * Returns length of the segment (without prefix) or 0 if transaction was aborted.
+ */
+uint32 MtmWaitSpillSegment(int fd, off_t offset, int node_id)
 {
-	CloseTransientFile(fd);
+	int    receiver_pid = Mtm->nodes[node_id-1].receiverPid;
+	uint32 size = 0;
+	bool   has_header = false;
+	struct stat st;
+	int    rc;
+
+	while (true) {
+		if (fstat(fd, &st) < 0) {
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 MTM_ERRMSG("pglogical_apply failed to stat spill file: %m")));
+		}
+		if (!has_header && st.st_size >= offset + (off_t)sizeof(size)) {
+			if (pread(fd, &size, sizeof(size), offset) != sizeof(size)) {
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 MTM_ERRMSG("pglogical_apply failed to read spill file segment header: %m")));
+			}
+			if (size == 0) {
+				return 0;
+			}
+			has_header = true;
+		}
+		if (has_header && st.st_size >= offset + (off_t)sizeof(size) + (off_t)size) {
+			return size;
+		}
+		if (Mtm->nodes[node_id-1].receiverPid != receiver_pid || BackendPidGetProc(receiver_pid) == NULL) {
+			/* Receiver was restarted and will never continue this stream */
+			return 0;
+		}
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, MTM_STREAM_POLL_TIMEOUT);
+		if (rc & WL_POSTMASTER_DEATH) {
+			proc_exit(1);
+		}
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
 }
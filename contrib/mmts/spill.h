@@ -1,11 +1,29 @@
 #ifndef __SPILL_H__
 #define __SPILL_H__
 
+/*
+ * Memory mapped segment of spill file. Receiver appends segments to the spill file,
+ * apply worker maps them one by one and parses the data in place.
+ */
+#define MTM_STREAM_POLL_TIMEOUT 10 /* msec, interval of checking spill file of streamed transaction for new segments */
+
+typedef struct
+{
+	char*  base; /* page aligned start of mapping or NULL if segment is not mapped */
+	size_t len;  /* length of mapping */
+} MtmSpillSegment;
+
 void MtmSpillToFile(int fd, char const* data, size_t size);
 void MtmCreateSpillDirectory(int node_id);
 int  MtmCreateSpillFile(int node_id, int* file_id);
+int  MtmCreateStreamFile(int node_id, int* file_id);
+void MtmStreamToFile(int fd, char const* data, uint32 size);
+void MtmCloseStreamFile(int fd);
 int  MtmOpenSpillFile(int node_id, int file_id);
-void MtmReadSpillFile(int fd, char* data, size_t size);
 void MtmCloseSpillFile(int fd);
+void MtmRemoveSpillFile(int node_id, int file_id);
+char* MtmMapSpillSegment(int fd, off_t offset, size_t size, MtmSpillSegment* seg);
+void MtmUnmapSpillSegment(MtmSpillSegment* seg);
+uint32 MtmWaitSpillSegment(int fd, off_t offset, int node_id);
 
 #endif
@@ -1,6 +1,9 @@
 #include "postgres.h"
 #include "miscadmin.h" /* PostmasterPid */
+#include "libpq-fe.h"
+#include "storage/latch.h"
 #include "multimaster.h"
+#include "perfstat.h"
 #include "state.h"
 
 char const* const MtmNeighborEventMnem[] =
@@ -25,8 +28,38 @@ char const* const MtmEventMnem[] =
 	"MTM_NONRECOVERABLE_ERROR"
 };
 
+typedef enum
+{
+	MTM_REFEREE_DONE,     /* result is received */
+	MTM_REFEREE_PENDING,  /* request is in progress */
+	MTM_REFEREE_FAILED    /* referee is not available */
+} MtmRefereeStatus;
+
+#define MTM_REFEREE_TIMEOUT (5*USECS_PER_SEC) /* timeout of connection and request to referee */
+
+/*
+ * Connection to referee used by the monitor process.
+ */
+static PGconn*     MtmRefereeConn;
+static bool        MtmRefereeConnecting;
+static PostgresPollingStatusType MtmRefereePolling;
+static char        MtmRefereeSql[64];       /* request in progress, empty string if there is no one */
+static timestamp_t MtmRefereeStart;         /* start of connection or request in progress */
+static timestamp_t MtmRefereeRetryTime;     /* do not connect to referee until this time after failure */
+static timestamp_t MtmRefereeReleaseTime;   /* all nodes are enabled since this time, 0 otherwise */
+
 static int  MtmRefereeGetWinner(void);
 static bool MtmRefereeClearWinner(void);
+static MtmRefereeStatus MtmRefereeFail(char const* msg, bool delayRetry);
+
+/*
+ * Connectivity matrix and clique found by the previous MtmFindClique call.
+ * Used only by the monitor process which refreshes cluster status.
+ */
+static nodemask_t MtmLastMatrix[MAX_NODES];
+static nodemask_t MtmLastClique;
+static int        MtmLastCliqueSize;
+static int        MtmLastMatrixNodes; /* 0 if there is no previous matrix */
 
 // XXXX: allocate in context and clean it
 static char *
@@ -359,14 +392,18 @@ void MtmReconnectNode(int nodeId) // XXXX evict that
 
 /**
  * Build internode connectivity mask. 1 - means that node is disconnected.
+ * Masks are copied under shared lock, the rest of work is done on the snapshot.
  */
 static void
 MtmBuildConnectivityMatrix(nodemask_t* matrix)
 {
-	int i, j, n = Mtm->nAllNodes;
+	int i, j, n;
 
+	MtmLock(LW_SHARED);
+	n = Mtm->nAllNodes;
 	for (i = 0; i < n; i++)
 		matrix[i] = Mtm->nodes[i].connectivityMask | Mtm->deadNodeMask;
+	MtmUnlock();
 
 	/* make matrix symmetric: required for Bron–Kerbosch algorithm */
 	for (i = 0; i < n; i++) {
@@ -378,14 +415,65 @@ MtmBuildConnectivityMatrix(nodemask_t* matrix)
 	}
 }
 
+/**
+ * Find maximum clique in the connectivity matrix, reusing the previous one when possible.
+ * Previous clique remains maximum if no connections were restored (that could produce larger clique)
+ * and no connections between members of the clique were lost. So with flapping links we run
+ * Bron–Kerbosch algorithm only when link is restored or broken inside the clique.
+ */
+static nodemask_t
+MtmFindClique(nodemask_t* matrix, int n_nodes, int* clique_size)
+{
+	timestamp_t start;
+	int i;
+
+	if (MtmLastMatrixNodes == n_nodes)
+	{
+		for (i = 0; i < n_nodes; i++)
+		{
+			nodemask_t restored = MtmLastMatrix[i] & ~matrix[i];
+			nodemask_t lost = matrix[i] & ~MtmLastMatrix[i];
+			if (restored != 0 || (BIT_CHECK(MtmLastClique, i) && (lost & MtmLastClique) != 0))
+				break;
+		}
+		if (i == n_nodes)
+		{
+			memcpy(MtmLastMatrix, matrix, n_nodes*sizeof(nodemask_t));
+			*clique_size = MtmLastCliqueSize;
+			return MtmLastClique;
+		}
+	}
+
+	start = MtmGetSystemTime();
+	MtmLastClique = MtmFindMaxClique(matrix, n_nodes, &MtmLastCliqueSize);
+	MtmPerfRecord(MTM_PERF_CLIQUE_SEARCH, 0, MtmGetSystemTime() - start);
+
+	memcpy(MtmLastMatrix, matrix, n_nodes*sizeof(nodemask_t));
+	MtmLastMatrixNodes = n_nodes;
+	*clique_size = MtmLastCliqueSize;
+	return MtmLastClique;
+}
+
+static void MtmDoRefreshClusterStatus(void);
+
+/**
+ * Refresh cluster status and account time spent in it.
+ */
+void
+MtmRefreshClusterStatus()
+{
+	timestamp_t start = MtmGetSystemTime();
+	MtmDoRefreshClusterStatus();
+	MtmPerfRecord(MTM_PERF_STATUS_REFRESH, 0, MtmGetSystemTime() - start);
+}
 
 
 /**
  * Build connectivity graph, find clique in it and extend disabledNodeMask by nodes not included in clique.
  * This function is called by arbiter monitor process with period MtmHeartbeatSendTimeout
  */
-void
-MtmRefreshClusterStatus()
+static void
+MtmDoRefreshClusterStatus(void)
 {
 	nodemask_t newClique, oldClique;
 	nodemask_t matrix[MAX_NODES];
@@ -405,10 +493,11 @@ MtmRefreshClusterStatus()
 	 * Check for referee decision when only half of nodes are visible.
 	 * Do not hold lock here, but recheck later wheter mask changed.
 	 */
-	if (MtmRefereeConnStr && *MtmRefereeConnStr && !Mtm->refereeWinnerId &&
+	if (MtmRefereeConnStr && *MtmRefereeConnStr && !Mtm->refereeGrant &&
 		countZeroBits(SELF_CONNECTIVITY_MASK, Mtm->nAllNodes) == Mtm->nAllNodes/2)
 	{
-		int winner_node_id = MtmRefereeGetWinner();
+		/* Decision of referee is kept until it is cleaned, so it can be reused without asking referee again */
+		int winner_node_id = Mtm->refereeWinnerId != 0 ? Mtm->refereeWinnerId : MtmRefereeGetWinner();
 
 		if (winner_node_id > 0)
 		{
@@ -447,22 +536,35 @@ MtmRefreshClusterStatus()
 	 * because we can clean old value before failed node starts it recovery and that node
 	 * can get refereeGrant before start of walsender, so it start in recovered mode.
 	 */
-	 if (MtmRefereeConnStr && *MtmRefereeConnStr && Mtm->refereeWinnerId &&
+	if (MtmRefereeConnStr && *MtmRefereeConnStr && Mtm->refereeWinnerId &&
 		countZeroBits(Mtm->disabledNodeMask, Mtm->nAllNodes) == Mtm->nAllNodes)
 	{
-		if (MtmRefereeClearWinner())
+		/*
+		 * Decision is leased for multimaster.referee_lease: if partition happens again
+		 * within this time, it is reused without round trip to referee.
+		 */
+		if (MtmRefereeReleaseTime == 0)
+			MtmRefereeReleaseTime = MtmGetSystemTime();
+
+		if (MtmGetSystemTime() >= MtmRefereeReleaseTime + MSEC_TO_USEC(MtmRefereeLease) &&
+			MtmRefereeClearWinner())
 		{
 			Mtm->refereeWinnerId = 0;
 			Mtm->refereeGrant = false;
+			MtmRefereeReleaseTime = 0;
 			MTM_LOG1("[STATE] Cleaning old referee decision");
 		}
 	}
+	else
+	{
+		MtmRefereeReleaseTime = 0;
+	}
 
 	/*
 	 * Check for clique.
 	 */
 	MtmBuildConnectivityMatrix(matrix);
-	newClique = MtmFindMaxClique(matrix, Mtm->nAllNodes, &cliqueSize);
+	newClique = MtmFindClique(matrix, Mtm->nAllNodes, &cliqueSize);
 
 	if (newClique == Mtm->clique)
 		return;
@@ -483,7 +585,7 @@ MtmRefreshClusterStatus()
 		 */
 		MtmSleep(MSEC_TO_USEC(MtmHeartbeatRecvTimeout)*2);
 		MtmBuildConnectivityMatrix(matrix);
-		newClique = MtmFindMaxClique(matrix, Mtm->nAllNodes, &cliqueSize);
+		newClique = MtmFindClique(matrix, Mtm->nAllNodes, &cliqueSize);
 	} while (newClique != oldClique);
 
 	MTM_LOG1("[STATE] New clique: %s", maskToString(oldClique, Mtm->nAllNodes));
@@ -531,24 +633,137 @@ MtmRefreshClusterStatus()
 	MtmUnlock();
 }
 
+/*
+ * Send request to referee or check whether its result is received.
+ * Connection to referee is kept open and established asynchronously, so refresh of cluster status
+ * is never blocked by referee: monitor is woken up by referee socket (see MtmRefereeSocket) and
+ * repeats the request until result is received or MTM_REFEREE_TIMEOUT expires.
+ */
+static MtmRefereeStatus
+MtmRefereeRequest(char const* sql, PGresult** result)
+{
+	timestamp_t now = MtmGetSystemTime();
+	PGresult* res;
+	PGresult* next;
+
+	if (MtmRefereeConn == NULL)
+	{
+		if (now < MtmRefereeRetryTime)
+			return MTM_REFEREE_FAILED;
+
+		MtmRefereeConn = PQconnectStart(MtmRefereeConnStr);
+		if (MtmRefereeConn == NULL || PQstatus(MtmRefereeConn) == CONNECTION_BAD)
+			return MtmRefereeFail("Could not connect to referee", true);
+
+		MtmRefereePolling = PGRES_POLLING_WRITING;
+		MtmRefereeConnecting = true;
+		MtmRefereeStart = now;
+	}
+
+	if (MtmRefereeConnecting)
+	{
+		MtmRefereePolling = PQconnectPoll(MtmRefereeConn);
+		if (MtmRefereePolling == PGRES_POLLING_FAILED)
+			return MtmRefereeFail("Could not connect to referee", true);
+		if (MtmRefereePolling != PGRES_POLLING_OK)
+		{
+			if (now - MtmRefereeStart > MTM_REFEREE_TIMEOUT)
+				return MtmRefereeFail("Timeout of connection to referee", true);
+			return MTM_REFEREE_PENDING;
+		}
+		MtmRefereeConnecting = false;
+		PQsetnonblocking(MtmRefereeConn, 1);
+		MTM_LOG1("Connected to referee in %lld usec", (long64)(now - MtmRefereeStart));
+	}
+
+	if (MtmRefereeSql[0] == '\0')
+	{
+		/* Idle connection may be broken: reconnect at once in this case */
+		if (!PQsendQuery(MtmRefereeConn, sql))
+			return MtmRefereeFail("Failed to send request to referee", false);
+		StrNCpy(MtmRefereeSql, sql, sizeof(MtmRefereeSql));
+		MtmRefereeStart = now;
+	}
+
+	if (PQflush(MtmRefereeConn) < 0 || !PQconsumeInput(MtmRefereeConn))
+		return MtmRefereeFail("Lost connection with referee", false);
+
+	if (PQisBusy(MtmRefereeConn))
+	{
+		if (now - MtmRefereeStart > MTM_REFEREE_TIMEOUT)
+			return MtmRefereeFail("Timeout of request to referee", true);
+		return MTM_REFEREE_PENDING;
+	}
+
+	res = PQgetResult(MtmRefereeConn);
+	while ((next = PQgetResult(MtmRefereeConn)) != NULL)
+		PQclear(next);
+	MtmPerfRecord(MTM_PERF_REFEREE_RTT, 0, MtmGetSystemTime() - MtmRefereeStart);
+
+	if (strcmp(MtmRefereeSql, sql) != 0)
+	{
+		/* Result of request which is not needed any more */
+		PQclear(res);
+		MtmRefereeSql[0] = '\0';
+		return MtmRefereeRequest(sql, result);
+	}
+	MtmRefereeSql[0] = '\0';
+	*result = res;
+	return MTM_REFEREE_DONE;
+}
+
+static MtmRefereeStatus
+MtmRefereeFail(char const* msg, bool delayRetry)
+{
+	MTM_ELOG(WARNING, "%s: %s", msg, MtmRefereeConn ? PQerrorMessage(MtmRefereeConn) : "out of memory");
+	PQfinish(MtmRefereeConn);
+	MtmRefereeConn = NULL;
+	MtmRefereeConnecting = false;
+	MtmRefereeSql[0] = '\0';
+	if (delayRetry)
+		MtmRefereeRetryTime = MtmGetSystemTime() + MSEC_TO_USEC(MtmHeartbeatRecvTimeout);
+	return MTM_REFEREE_FAILED;
+}
+
+/*
+ * Socket of referee connection the monitor should wait for, PGINVALID_SOCKET if there is no request in progress
+ */
+pgsocket
+MtmRefereeSocket(int* events)
+{
+	if (MtmRefereeConn == NULL)
+		return PGINVALID_SOCKET;
+
+	if (MtmRefereeConnecting)
+		*events = MtmRefereePolling == PGRES_POLLING_WRITING ? WL_SOCKET_WRITEABLE : WL_SOCKET_READABLE;
+	else if (MtmRefereeSql[0] != '\0')
+		*events = WL_SOCKET_READABLE;
+	else
+		return PGINVALID_SOCKET;
+
+	return PQsocket(MtmRefereeConn);
+}
+
+/*
+ * Returns winner node id, 0 if request is in progress or -1 if it has failed
+ */
 static int
 MtmRefereeGetWinner(void)
 {
-	PGconn* conn;
 	PGresult *res;
-	char sql[128];
+	char sql[64];
 	int  winner_node_id;
 
-	conn = PQconnectdb_safe(MtmRefereeConnStr, 5);
-	if (PQstatus(conn) != CONNECTION_OK)
+	sprintf(sql, "select referee.get_winner(%d)", MtmNodeId);
+	switch (MtmRefereeRequest(sql, &res))
 	{
-		MTM_ELOG(WARNING, "Could not connect to referee");
-		PQfinish(conn);
-		return -1;
+		case MTM_REFEREE_PENDING:
+			return 0;
+		case MTM_REFEREE_FAILED:
+			return -1;
+		case MTM_REFEREE_DONE:
+			break;
 	}
-
-	sprintf(sql, "select referee.get_winner(%d)", MtmNodeId);
-	res = PQexec(conn, sql);
 	if (PQresultStatus(res) != PGRES_TUPLES_OK ||
 		PQntuples(res) != 1 ||
 		PQnfields(res) != 1)
@@ -556,7 +771,6 @@ MtmRefereeGetWinner(void)
 		MTM_ELOG(WARNING, "Refusing unexpected result (r=%d, n=%d, w=%d, k=%s) from referee.get_winner()",
 			PQresultStatus(res), PQntuples(res), PQnfields(res), PQgetvalue(res, 0, 0));
 		PQclear(res);
-		PQfinish(conn);
 		return -1;
 	}
 
@@ -568,33 +782,27 @@ MtmRefereeGetWinner(void)
 			"Referee responded with node_id=%d, it's out of our node range",
 			winner_node_id);
 		PQclear(res);
-		PQfinish(conn);
 		return -1;
 	}
 
 	/* Ok, we finally got it! */
 	PQclear(res);
-	PQfinish(conn);
 	MTM_LOG1("Got referee response, winner node_id=%d.", winner_node_id);
 	return winner_node_id;
 }
 
+/*
+ * Returns true if decision of referee is cleaned, false if request is in progress or has failed
+ */
 static bool
 MtmRefereeClearWinner(void)
 {
-	PGconn* conn;
 	PGresult *res;
 	char *response;
 
-	conn = PQconnectdb_safe(MtmRefereeConnStr, 5);
-	if (PQstatus(conn) != CONNECTION_OK)
-	{
-		MTM_ELOG(WARNING, "Could not connect to referee");
-		PQfinish(conn);
+	if (MtmRefereeRequest("select referee.clean()", &res) != MTM_REFEREE_DONE)
 		return false;
-	}
 
-	res = PQexec(conn, "select referee.clean()");
 	if (PQresultStatus(res) != PGRES_TUPLES_OK ||
 		PQntuples(res) != 1 ||
 		PQnfields(res) != 1)
@@ -602,7 +810,6 @@ MtmRefereeClearWinner(void)
 		MTM_ELOG(WARNING, "Refusing unexpected result (r=%d, n=%d, w=%d, k=%s) from referee.clean().",
 			PQresultStatus(res), PQntuples(res), PQnfields(res), PQgetvalue(res, 0, 0));
 		PQclear(res);
-		PQfinish(conn);
 		return false;
 	}
 
@@ -612,13 +819,11 @@ MtmRefereeClearWinner(void)
 	{
 		MTM_ELOG(WARNING, "Wrong response from referee.clean(): '%s'", response);
 		PQclear(res);
-		PQfinish(conn);
 		return false;
 	}
 
 	/* Ok, we finally got it! */
 	MTM_LOG1("Got referee clear response '%s'", response);
 	PQclear(res);
-	PQfinish(conn);
 	return true;
 }
@@ -31,5 +31,6 @@ extern void MtmOnNodeConnect(int nodeId);
 extern void MtmReconnectNode(int nodeId);
 
 extern void MtmRefreshClusterStatus(void);
+extern pgsocket MtmRefereeSocket(int* events);
 
 extern int countZeroBits(nodemask_t mask, int nNodes);
@@ -0,0 +1,787 @@
+/*
+ * Benchmark of multimaster cluster.
+ *
+ * Runs one of the workloads (transfers, hot-row contention, bulk inserts), optionally
+ * together with readers checking consistency of the data, against a set of nodes and
+ * reports throughput, latency percentiles, per-second time series and breakdown
+ * of aborted transactions by the reason of abort.
+ *
+ * Uses plain libpq, so it can be built with pg_config of the installation being tested.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include <libpq-fe.h>
+
+using namespace std;
+
+typedef void* (*thread_proc_t)(void*);
+
+#define USEC 1000000
+
+static time_t getCurrentTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (time_t)tv.tv_sec*USEC + tv.tv_usec;
+}
+
+/*
+ * Latency histogram with bounded relative error (in the spirit of HdrHistogram).
+ * Values below 2^SUB_BITS are stored exactly, larger values are split into power-of-two
+ * ranges each divided into 2^(SUB_BITS-1) linear sub-buckets, so relative error is below 1/64.
+ */
+class histogram
+{
+    enum {
+        SUB_BITS = 7,
+        SUB_BUCKETS = 1 << SUB_BITS,
+        HALF_BUCKETS = SUB_BUCKETS/2,
+        MAX_BITS = 40, /* about 12 days in microseconds */
+        N_BUCKETS = (MAX_BITS - SUB_BITS + 2)*HALF_BUCKETS
+    };
+    uint64_t counts[N_BUCKETS];
+    uint64_t total;
+    uint64_t maxValue;
+    uint64_t sum;
+
+    static int msb(uint64_t v) {
+        int n = 0;
+        while (v >>= 1) {
+            n += 1;
+        }
+        return n;
+    }
+
+    static int index(uint64_t v) {
+        if (v < SUB_BUCKETS) {
+            return (int)v;
+        }
+        int bits = msb(v);
+        if (bits > MAX_BITS) {
+            bits = MAX_BITS;
+            v = ((uint64_t)1 << (MAX_BITS+1)) - 1;
+        }
+        int shift = bits - SUB_BITS + 1;
+        return shift*HALF_BUCKETS + (int)(v >> shift);
+    }
+
+    static uint64_t upperBound(int idx) {
+        if (idx < SUB_BUCKETS) {
+            return idx;
+        }
+        int shift = idx/HALF_BUCKETS - 1;
+        uint64_t sub = idx - shift*HALF_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+  public:
+    histogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(counts, 0, sizeof counts);
+        total = 0;
+        maxValue = 0;
+        sum = 0;
+    }
+
+    void record(uint64_t v) {
+        counts[index(v)] += 1;
+        total += 1;
+        sum += v;
+        if (v > maxValue) {
+            maxValue = v;
+        }
+    }
+
+    void merge(histogram const& other) {
+        for (int i = 0; i < N_BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        if (other.maxValue > maxValue) {
+            maxValue = other.maxValue;
+        }
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t max() const {
+        return maxValue;
+    }
+
+    double mean() const {
+        return total ? (double)sum/total : 0;
+    }
+
+    /* Returns upper bound of the bucket containing value with the given rank */
+    uint64_t percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(total*fraction);
+        uint64_t seen = 0;
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        for (int i = 0; i < N_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint64_t bound = upperBound(i);
+                return bound < maxValue ? bound : maxValue;
+            }
+        }
+        return maxValue;
+    }
+};
+
+/*
+ * Reasons of transaction abort, determined by SQLSTATE of the error
+ */
+enum abort_reason
+{
+    ABORT_SERIALIZATION,  /* 40001 */
+    ABORT_DEADLOCK,       /* 40P01: local or global deadlock */
+    ABORT_UNIQUE,         /* 23505 */
+    ABORT_TIMEOUT,        /* 57014: statement or transaction timeout */
+    ABORT_CLUSTER,        /* XX000: transaction rejected or aborted by multimaster */
+    ABORT_CONNECTION,     /* connection is broken or node is shutting down */
+    ABORT_OTHER,
+    N_ABORT_REASONS
+};
+
+static char const* const abortReasonName[] = {
+    "serialization",
+    "deadlock",
+    "unique",
+    "timeout",
+    "cluster",
+    "connection",
+    "other"
+};
+
+static abort_reason classifyError(PGconn* conn, PGresult* res)
+{
+    char const* state = res ? PQresultErrorField(res, PG_DIAG_SQLSTATE) : NULL;
+    if (PQstatus(conn) != CONNECTION_OK || state == NULL) {
+        return ABORT_CONNECTION;
+    }
+    if (strcmp(state, "40001") == 0) {
+        return ABORT_SERIALIZATION;
+    }
+    if (strcmp(state, "40P01") == 0) {
+        return ABORT_DEADLOCK;
+    }
+    if (strcmp(state, "23505") == 0) {
+        return ABORT_UNIQUE;
+    }
+    if (strcmp(state, "57014") == 0) {
+        return ABORT_TIMEOUT;
+    }
+    if (strcmp(state, "XX000") == 0) {
+        return ABORT_CLUSTER;
+    }
+    if (strncmp(state, "08", 2) == 0 || strncmp(state, "57P", 3) == 0) {
+        return ABORT_CONNECTION;
+    }
+    return ABORT_OTHER;
+}
+
+struct abort_error
+{
+    abort_reason reason;
+    string message;
+
+    abort_error(abort_reason r, char const* msg) : reason(r), message(msg) {}
+};
+
+enum workload_kind
+{
+    WORKLOAD_TRANSFER,  /* move money between two random accounts */
+    WORKLOAD_HOTROW,    /* transfers between a small set of hot accounts */
+    WORKLOAD_INSERT     /* bulk inserts into append-only table */
+};
+
+static char const* const workloadName[] = {
+    "transfer",
+    "hotrow",
+    "insert"
+};
+
+enum topology_kind
+{
+    TOPOLOGY_STICKY,  /* each client is bound to node (client id % number of nodes) */
+    TOPOLOGY_RANDOM,  /* each transaction is sent to random node */
+    TOPOLOGY_SINGLE   /* all transactions are sent to the same node */
+};
+
+struct config
+{
+    int nReaders;
+    int nWriters;
+    int nIterations;
+    int duration;
+    int nAccounts;
+    int nHotAccounts;
+    int batchSize;
+    int payloadSize;
+    workload_kind workload;
+    topology_kind topology;
+    int targetNode;
+    bool avoidDeadlocks;
+    bool series;
+    vector<string> connections;
+
+    config() {
+        nReaders = 0;
+        nWriters = 10;
+        nIterations = 1000;
+        duration = 0;
+        nAccounts = 100000;
+        nHotAccounts = 10;
+        batchSize = 100;
+        payloadSize = 100;
+        workload = WORKLOAD_TRANSFER;
+        topology = TOPOLOGY_STICKY;
+        targetNode = 0;
+        avoidDeadlocks = false;
+        series = true;
+    }
+};
+
+config cfg;
+volatile bool running;
+time_t runId;
+
+/*
+ * Statistic of client thread. Interval histogram is periodically harvested by monitor thread,
+ * so it is protected by mutex which is contended only once per second.
+ */
+struct thread
+{
+    pthread_t t;
+    int id;
+    bool reader;
+    vector<PGconn*> conns;
+    size_t transactions;
+    size_t aborts[N_ABORT_REASONS];
+    size_t inconsistencies;
+    string lastError[N_ABORT_REASONS];
+    histogram latency;
+    histogram interval;
+    size_t intervalAborts;
+    pthread_mutex_t mutex;
+
+    void start(int tid, bool isReader, thread_proc_t proc) {
+        id = tid;
+        reader = isReader;
+        transactions = 0;
+        inconsistencies = 0;
+        intervalAborts = 0;
+        memset(aborts, 0, sizeof aborts);
+        pthread_mutex_init(&mutex, NULL);
+        pthread_create(&t, NULL, proc, this);
+    }
+
+    void wait() {
+        pthread_join(t, NULL);
+    }
+
+    void committed(time_t elapsed) {
+        pthread_mutex_lock(&mutex);
+        transactions += 1;
+        latency.record(elapsed);
+        interval.record(elapsed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void aborted(abort_error const& x) {
+        pthread_mutex_lock(&mutex);
+        aborts[x.reason] += 1;
+        intervalAborts += 1;
+        lastError[x.reason] = x.message;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    /* Called by monitor: move interval statistic to the caller */
+    size_t harvest(histogram& h) {
+        size_t n;
+        pthread_mutex_lock(&mutex);
+        h.merge(interval);
+        interval.reset();
+        n = intervalAborts;
+        intervalAborts = 0;
+        pthread_mutex_unlock(&mutex);
+        return n;
+    }
+};
+
+static PGconn* connect(string const& connStr)
+{
+    PGconn* conn = PQconnectdb(connStr.c_str());
+    if (PQstatus(conn) != CONNECTION_OK) {
+        fprintf(stderr, "Failed to connect to '%s': %s", connStr.c_str(), PQerrorMessage(conn));
+        exit(1);
+    }
+    return conn;
+}
+
+/*
+ * Execute statement. Throws abort_error if statement failed.
+ * Returned result should be cleared by caller.
+ */
+static PGresult* exec(PGconn* conn, char const* sql, ...)
+{
+    va_list args;
+    char buf[1024];
+    va_start(args, sql);
+    vsnprintf(buf, sizeof buf, sql, args);
+    va_end(args);
+
+    PGresult* res = PQexec(conn, buf);
+    ExecStatusType status = PQresultStatus(res);
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        abort_error x(classifyError(conn, res), res ? PQresultErrorMessage(res) : PQerrorMessage(conn));
+        PQclear(res);
+        throw x;
+    }
+    return res;
+}
+
+static void execCommand(PGconn* conn, char const* sql, ...)
+{
+    va_list args;
+    char buf[1024];
+    va_start(args, sql);
+    vsnprintf(buf, sizeof buf, sql, args);
+    va_end(args);
+    PQclear(exec(conn, "%s", buf));
+}
+
+static int64_t execQuery(PGconn* conn, char const* sql)
+{
+    PGresult* res = exec(conn, "%s", sql);
+    int64_t val = PQgetisnull(res, 0, 0) ? 0 : strtoll(PQgetvalue(res, 0, 0), NULL, 10);
+    PQclear(res);
+    return val;
+}
+
+static PGconn* chooseConnection(thread& t)
+{
+    switch (cfg.topology) {
+      case TOPOLOGY_RANDOM:
+        return t.conns[random() % t.conns.size()];
+      case TOPOLOGY_SINGLE:
+        return t.conns[cfg.targetNode];
+      default:
+        return t.conns[t.id % t.conns.size()];
+    }
+}
+
+/*
+ * Finish aborted transaction: rollback it or reestablish broken connection.
+ */
+static void recover(PGconn* conn)
+{
+    if (PQstatus(conn) != CONNECTION_OK) {
+        PQreset(conn);
+    } else {
+        PQclear(PQexec(conn, "rollback"));
+    }
+}
+
+static void transfer(PGconn* conn, int nAccounts)
+{
+    int src = random() % nAccounts;
+    int dst = random() % nAccounts;
+    if (cfg.avoidDeadlocks && dst < src) {
+        int tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    execCommand(conn, "update t set v = v - 1 where u=%d", src);
+    execCommand(conn, "update t set v = v + 1 where u=%d", dst);
+}
+
+static void insert(PGconn* conn, thread& t, int64_t& seq)
+{
+    execCommand(conn, "insert into l select %ld, %d, g, repeat('x', %d) from generate_series(%ld, %ld) g",
+                (long)runId, t.id, cfg.payloadSize, (long)seq, (long)(seq + cfg.batchSize - 1));
+    seq += cfg.batchSize;
+}
+
+static void connectAll(thread& t)
+{
+    for (size_t i = 0; i < cfg.connections.size(); i++) {
+        t.conns.push_back(connect(cfg.connections[i]));
+    }
+}
+
+static void disconnectAll(thread& t)
+{
+    for (size_t i = 0; i < t.conns.size(); i++) {
+        PQfinish(t.conns[i]);
+    }
+}
+
+void* reader(void* arg)
+{
+    thread& t = *(thread*)arg;
+    connectAll(t);
+
+    while (running) {
+        PGconn* conn = chooseConnection(t);
+        time_t start = getCurrentTime();
+        try {
+            /* Transfers preserve total balance: any other value means isolation violation */
+            int64_t sum = execQuery(conn, "select sum(v) from t");
+            if (sum != 0 && cfg.workload != WORKLOAD_INSERT) {
+                printf("Reader %d: total=%ld\n", t.id, (long)sum);
+                t.inconsistencies += 1;
+            }
+            t.committed(getCurrentTime() - start);
+        } catch (abort_error const& x) {
+            t.aborted(x);
+            recover(conn);
+        }
+    }
+    disconnectAll(t);
+    return NULL;
+}
+
+void* writer(void* arg)
+{
+    thread& t = *(thread*)arg;
+    int64_t seq = 0;
+    connectAll(t);
+
+    for (int i = 0; cfg.duration ? running : i < cfg.nIterations; i++) {
+        PGconn* conn = chooseConnection(t);
+        time_t start = getCurrentTime();
+        try {
+            execCommand(conn, "begin");
+            switch (cfg.workload) {
+              case WORKLOAD_TRANSFER:
+                transfer(conn, cfg.nAccounts);
+                break;
+              case WORKLOAD_HOTROW:
+                transfer(conn, cfg.nHotAccounts);
+                break;
+              case WORKLOAD_INSERT:
+                insert(conn, t, seq);
+                break;
+            }
+            execCommand(conn, "commit");
+            t.committed(getCurrentTime() - start);
+        } catch (abort_error const& x) {
+            t.aborted(x);
+            recover(conn);
+            if (!cfg.duration) {
+                i -= 1; /* retry */
+            }
+        }
+    }
+    disconnectAll(t);
+    return NULL;
+}
+
+struct interval_stat
+{
+    int second;
+    size_t transactions;
+    size_t aborts;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+struct monitor_state
+{
+    vector<thread>* writers;
+    vector<interval_stat> series;
+    bool done;
+};
+
+void* monitor(void* arg)
+{
+    monitor_state& m = *(monitor_state*)arg;
+    vector<thread>& writers = *m.writers;
+    time_t start = getCurrentTime();
+    int second = 0;
+
+    while (!m.done) {
+        /* Sleep until the next second boundary, checking for completion frequently */
+        time_t next = start + (time_t)(second + 1)*USEC;
+        while (!m.done && getCurrentTime() < next) {
+            usleep(10000);
+        }
+        if (m.done) {
+            break;
+        }
+        second += 1;
+        histogram h;
+        interval_stat s;
+        s.aborts = 0;
+        for (size_t i = 0; i < writers.size(); i++) {
+            s.aborts += writers[i].harvest(h);
+        }
+        s.second = second;
+        s.transactions = h.count();
+        s.p50 = h.percentile(0.5);
+        s.p99 = h.percentile(0.99);
+        s.p999 = h.percentile(0.999);
+        m.series.push_back(s);
+        printf("%4d: %6ld TPS, %5ld aborts, latency p50=%ld p99=%ld p999=%ld usec\n",
+               s.second, (long)s.transactions, (long)s.aborts, (long)s.p50, (long)s.p99, (long)s.p999);
+        fflush(stdout);
+        if (cfg.duration && second >= cfg.duration) {
+            running = false;
+        }
+    }
+    return NULL;
+}
+
+void initializeDatabase()
+{
+    PGconn* conn = connect(cfg.connections[0]);
+    time_t start = getCurrentTime();
+    printf("Creating database schema...\n");
+    execCommand(conn, "drop table if exists t");
+    execCommand(conn, "drop table if exists l");
+    execCommand(conn, "create table t(u int primary key, v int)");
+    execCommand(conn, "create table l(run bigint, client int, seq bigint, payload text, primary key(run, client, seq))");
+    printf("Populating data...\n");
+    execCommand(conn, "insert into t (select generate_series(0,%d), 0)", cfg.nAccounts-1);
+    PQfinish(conn);
+    printf("Initialization completed in %f seconds\n", (double)(getCurrentTime() - start)/USEC);
+}
+
+static void printLatency(char const* name, histogram const& h)
+{
+    printf(" \"%s\":{\"count\":%ld, \"mean\":%.1f, \"p50\":%ld, \"p99\":%ld, \"p999\":%ld, \"max\":%ld},",
+           name, (long)h.count(), h.mean(), (long)h.percentile(0.5), (long)h.percentile(0.99),
+           (long)h.percentile(0.999), (long)h.max());
+}
+
+static void usage()
+{
+    printf("Options:\n"
+           "\t-c STR\tconnection string of cluster node (can be repeated)\n"
+           "\t-i\tinitialize database\n"
+           "\t-W NAME\tworkload: transfer, hotrow, insert (transfer)\n"
+           "\t-w N\tnumber of writers (10)\n"
+           "\t-r N\tnumber of readers checking consistency (0)\n"
+           "\t-n N\tnumber of transactions per writer (1000)\n"
+           "\t-T N\trun for N seconds instead of fixed number of transactions\n"
+           "\t-a N\tnumber of accounts (100000)\n"
+           "\t-H N\tnumber of hot accounts for hotrow workload (10)\n"
+           "\t-b N\trows per transaction for insert workload (100)\n"
+           "\t-P N\tpayload size for insert workload (100)\n"
+           "\t-t MODE\tnode topology: sticky, random or index of single node (sticky)\n"
+           "\t-d\tavoid deadlocks by ordering updates\n"
+           "\t-q\tdo not include per-second time series in the report\n");
+}
+
+int main (int argc, char* argv[])
+{
+    bool initialize = false;
+
+    if (argc == 1) {
+        printf("Use -h to show usage options\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            switch (argv[i][1]) {
+              case 'r':
+                cfg.nReaders = atoi(argv[++i]);
+                continue;
+              case 'w':
+                cfg.nWriters = atoi(argv[++i]);
+                continue;
+              case 'a':
+                cfg.nAccounts = atoi(argv[++i]);
+                continue;
+              case 'n':
+                cfg.nIterations = atoi(argv[++i]);
+                continue;
+              case 'T':
+                cfg.duration = atoi(argv[++i]);
+                continue;
+              case 'H':
+                cfg.nHotAccounts = atoi(argv[++i]);
+                continue;
+              case 'b':
+                cfg.batchSize = atoi(argv[++i]);
+                continue;
+              case 'P':
+                cfg.payloadSize = atoi(argv[++i]);
+                continue;
+              case 'W':
+                i += 1;
+                if (strcmp(argv[i], "transfer") == 0) {
+                    cfg.workload = WORKLOAD_TRANSFER;
+                } else if (strcmp(argv[i], "hotrow") == 0) {
+                    cfg.workload = WORKLOAD_HOTROW;
+                } else if (strcmp(argv[i], "insert") == 0) {
+                    cfg.workload = WORKLOAD_INSERT;
+                } else {
+                    break;
+                }
+                continue;
+              case 't':
+                i += 1;
+                if (strcmp(argv[i], "sticky") == 0) {
+                    cfg.topology = TOPOLOGY_STICKY;
+                } else if (strcmp(argv[i], "random") == 0) {
+                    cfg.topology = TOPOLOGY_RANDOM;
+                } else {
+                    cfg.topology = TOPOLOGY_SINGLE;
+                    cfg.targetNode = atoi(argv[i]);
+                }
+                continue;
+              case 'c':
+                cfg.connections.push_back(string(argv[++i]));
+                continue;
+              case 'i':
+                initialize = true;
+                continue;
+              case 'd':
+                cfg.avoidDeadlocks = true;
+                continue;
+              case 'q':
+                cfg.series = false;
+                continue;
+            }
+        }
+        usage();
+        return 1;
+    }
+    if (cfg.connections.empty() || cfg.nWriters <= 0 || cfg.nHotAccounts <= 0 || cfg.nAccounts <= 0
+        || (size_t)cfg.targetNode >= cfg.connections.size())
+    {
+        usage();
+        return 1;
+    }
+
+    if (initialize) {
+        initializeDatabase();
+        printf("%d accounts inserted\n", cfg.nAccounts);
+        return 0;
+    }
+
+    time_t start = getCurrentTime();
+    runId = start;
+    running = true;
+
+    vector<thread> readers(cfg.nReaders);
+    vector<thread> writers(cfg.nWriters);
+    monitor_state m;
+    pthread_t logger;
+
+    m.writers = &writers;
+    m.done = false;
+
+    for (int i = 0; i < cfg.nReaders; i++) {
+        readers[i].start(i, true, reader);
+    }
+    for (int i = 0; i < cfg.nWriters; i++) {
+        writers[i].start(i, false, writer);
+    }
+    pthread_create(&logger, NULL, monitor, &m);
+
+    for (int i = 0; i < cfg.nWriters; i++) {
+        writers[i].wait();
+    }
+    time_t elapsed = getCurrentTime() - start;
+
+    running = false;
+    for (int i = 0; i < cfg.nReaders; i++) {
+        readers[i].wait();
+    }
+    m.done = true;
+    pthread_join(logger, NULL);
+
+    histogram writeLatency;
+    histogram readLatency;
+    size_t aborts[N_ABORT_REASONS] = {0};
+    string lastError[N_ABORT_REASONS];
+    size_t nTransactions = 0;
+    size_t nAborts = 0;
+    size_t nReads = 0;
+    size_t nInconsistencies = 0;
+
+    for (int i = 0; i < cfg.nWriters; i++) {
+        writeLatency.merge(writers[i].latency);
+        nTransactions += writers[i].transactions;
+        for (int j = 0; j < N_ABORT_REASONS; j++) {
+            aborts[j] += writers[i].aborts[j];
+            nAborts += writers[i].aborts[j];
+            if (!writers[i].lastError[j].empty()) {
+                lastError[j] = writers[i].lastError[j];
+            }
+        }
+    }
+    for (int i = 0; i < cfg.nReaders; i++) {
+        readLatency.merge(readers[i].latency);
+        nReads += readers[i].transactions;
+        nInconsistencies += readers[i].inconsistencies;
+    }
+    for (int j = 0; j < N_ABORT_REASONS; j++) {
+        if (!lastError[j].empty()) {
+            fprintf(stderr, "Last %s abort: %s", abortReasonName[j], lastError[j].c_str());
+        }
+    }
+
+    printf("{\"workload\":\"%s\", \"tps\":%f, \"transactions\":%ld, \"aborts\":%ld, \"abort_percent\":%.2f,",
+           workloadName[cfg.workload],
+           (double)nTransactions*USEC/elapsed,
+           (long)nTransactions,
+           (long)nAborts,
+           nTransactions + nAborts ? (double)nAborts*100/(nTransactions + nAborts) : 0.0);
+    printf(" \"abort_reasons\":{");
+    for (int j = 0; j < N_ABORT_REASONS; j++) {
+        printf("%s\"%s\":%ld", j ? ", " : "", abortReasonName[j], (long)aborts[j]);
+    }
+    printf("},");
+    printLatency("latency", writeLatency);
+    if (cfg.nReaders != 0) {
+        printf(" \"reads\":%ld, \"inconsistencies\":%ld,", (long)nReads, (long)nInconsistencies);
+        printLatency("read_latency", readLatency);
+    }
+    if (cfg.series) {
+        printf(" \"series\":[");
+        for (size_t i = 0; i < m.series.size(); i++) {
+            interval_stat const& s = m.series[i];
+            printf("%s{\"second\":%d, \"tps\":%ld, \"aborts\":%ld, \"p50\":%ld, \"p99\":%ld, \"p999\":%ld}",
+                   i ? ", " : "", s.second, (long)s.transactions, (long)s.aborts, (long)s.p50, (long)s.p99, (long)s.p999);
+        }
+        printf("],");
+    }
+    printf(" \"readers\":%d, \"writers\":%d, \"accounts\":%d, \"hot_accounts\":%d, \"iterations\":%d, \"duration\":%d, \"hosts\":%ld}\n",
+           cfg.nReaders,
+           cfg.nWriters,
+           cfg.nAccounts,
+           cfg.nHotAccounts,
+           cfg.nIterations,
+           cfg.duration,
+           (long)cfg.connections.size());
+
+    return nInconsistencies != 0 ? 2 : 0;
+}
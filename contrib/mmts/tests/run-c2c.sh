@@ -0,0 +1,15 @@
+#!/bin/sh
+# Look for false sharing of multimaster shared memory under commit load.
+# Runs the pgbench workload of run-pgbench.sh while perf c2c samples all CPUs,
+# then reports cache lines with the most HITM (loads hitting lines modified by other cores).
+# Shared cache lines of MtmState and Mtm->nodes should not appear at the top of the report.
+# Requires perf with c2c support and permission to sample all CPUs.
+
+DURATION=${DURATION:-15}
+OUTPUT=${OUTPUT:-perf.c2c.data}
+
+pgbench -M prepared -f mm.pgb -T $DURATION -c 50 -j 16 postgres &
+perf c2c record -a -o $OUTPUT -- sleep $DURATION
+wait
+perf c2c report -i $OUTPUT --stdio --stats
+perf c2c report -i $OUTPUT --stdio -d tot --coalesce tid,pid,iaddr --full-symbols | grep -B2 -A20 multimaster | head -200
@@ -1 +1,3 @@
-pgbench -M prepared -f mm.pgb -T 15 -P 1 -c 50 -j 16 -r postgres
+# Set HOSTS (and PORTS) to comma-separated lists to spread the clients over
+# the nodes of the cluster, e.g. HOSTS=node1,node2,node3
+pgbench -M prepared -f mm.pgb -T 15 -P 1 -c 50 -j 16 -r --max-tries=10 ${HOSTS:+-h $HOSTS} ${PORTS:+-p $PORTS} postgres
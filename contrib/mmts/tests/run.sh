@@ -1,4 +1,4 @@
-./dtmbench  \
+./mtmbench  \
 -c "dbname=regression host=localhost port=5432 sslmode=disable" \
 -c "dbname=regression host=localhost port=5433 sslmode=disable" \
 -c "dbname=regression host=localhost port=5434 sslmode=disable" \
@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+#
+# Failover and recovery benchmark.
+#
+# Runs the bank load of lib.bank_client against a docker-compose cluster,
+# injects a failure into one node and samples throughput, latency and the
+# multimaster state of every node once a second until the node is back
+# online.  For each scenario it reports:
+#
+#   time_to_detect   - from the failure until a surviving node disables
+#                      the failed one;
+#   time_to_failover - from the failure until every surviving node commits
+#                      again (zero if their commits never stopped);
+#   time_to_recover  - from the end of the failure until the failed node is
+#                      online and commits again;
+#   catchup_rate     - MB/s of WAL consumed from the replication slot of the
+#                      failed node on the donor while it recovers;
+#
+# plus the per-second timeline, so that failover performance can be
+# compared across releases with --output.
+#
+# Usage: python3 bench_failover.py [--scenario NAME ...] [--output FILE]
+#
+
+import argparse
+import datetime
+import json
+import subprocess
+import time
+import warnings
+
+import psycopg2
+
+from lib.bank_client import MtmClient
+from lib.failure_injector import *
+
+THREE_NODES = {
+    'compose': [],
+    'dsns': [
+        "dbname=regression user=postgres host=127.0.0.1 port=15432",
+        "dbname=regression user=postgres host=127.0.0.1 port=15433",
+        "dbname=regression user=postgres host=127.0.0.1 port=15434"
+    ]
+}
+
+TWO_NODES_WITH_REFEREE = {
+    'compose': ['-f', 'support/two_nodes.yml'],
+    'dsns': [
+        "dbname=regression user=postgres host=127.0.0.1 port=15432",
+        "dbname=regression user=postgres host=127.0.0.1 port=15433"
+    ],
+    'referee': "dbname=regression user=postgres host=127.0.0.1 port=15435"
+}
+
+# name: (cluster, failure, number of the failed node)
+SCENARIOS = {
+    'node_crash': (THREE_NODES, lambda: CrashRecoverNode('node3'), 3),
+    'node_restart': (THREE_NODES, lambda: RestartNode('node3'), 3),
+    'node_partition': (THREE_NODES, lambda: SingleNodePartition('node3'), 3),
+    'slow_disk': (THREE_NODES, lambda: SlowDisk('node3'), 3),
+    'referee_crash': (TWO_NODES_WITH_REFEREE, lambda: CrashRecoverNode('node2'), 2),
+}
+
+SETUP_TIME = 20
+
+
+def node_execute(dsn, statements):
+    con = psycopg2.connect(dsn)
+    con.autocommit = True
+    cur = con.cursor()
+    for statement in statements:
+        cur.execute(statement)
+    cur.close()
+    con.close()
+
+
+def node_state(dsn, failed_node):
+    """
+    Multimaster status of the node, its mask of disabled nodes and the
+    position of the replication slot of the failed node on it, or Nones if
+    the node does not answer within a second.
+    """
+    state = {'status': None, 'disabled': None, 'slot': None}
+    try:
+        con = psycopg2.connect(dsn, connect_timeout=1,
+                               options='-c statement_timeout=1000')
+        con.autocommit = True
+        cur = con.cursor()
+        cur.execute('select status, "disabledNodeMask" from mtm.get_cluster_state()')
+        state['status'], state['disabled'] = cur.fetchone()
+        cur.execute("""
+            select pg_xlog_location_diff(confirmed_flush_lsn, '0/0')
+            from pg_replication_slots where slot_name = %s""",
+            ('mtm_slot_%d' % failed_node,))
+        row = cur.fetchone()
+        if row is not None and row[0] is not None:
+            state['slot'] = int(row[0])
+        cur.close()
+        con.close()
+    except psycopg2.Error:
+        pass
+    return state
+
+
+def take_sample(client, dsns, failed_node, start, prev_time):
+    aggs = client.get_aggregates(_print=False)
+    now = (datetime.datetime.now() - start).total_seconds()
+    # Commits are counted since the previous sample, which can be more than
+    # a second ago when nodes do not answer
+    sample = {'time': now, 'interval': now - prev_time, 'nodes': []}
+    for i, dsn in enumerate(dsns):
+        transfer = aggs[i]['transfer'] if i < len(aggs) else None
+        commits = transfer['finish'].get('commit', 0) if transfer else 0
+        node = node_state(dsn, failed_node)
+        node['commits'] = commits
+        node['errors'] = (sum(transfer['finish'].values()) - commits) if transfer else 0
+        node['avg_latency'] = transfer['commit_latency'] / commits if commits else None
+        node['max_latency'] = transfer['max_latency'] if transfer else None
+        sample['nodes'].append(node)
+    return sample
+
+
+def sample_for(client, dsns, failed_node, start, seconds, timeline, until=None):
+    deadline = time.time() + seconds
+    while time.time() < deadline:
+        time.sleep(1)
+        prev_time = timeline[-1]['time'] if timeline else 0.0
+        sample = take_sample(client, dsns, failed_node, start, prev_time)
+        timeline.append(sample)
+        if until is not None and until(sample):
+            break
+
+
+def analyze(timeline, failed_node, t_fail, t_stop):
+    failed = failed_node - 1
+    survivors = [i for i in range(len(timeline[0]['nodes'])) if i != failed]
+    during = [s for s in timeline if t_fail <= s['time'] <= t_stop]
+    after = [s for s in timeline if s['time'] > t_stop]
+    result = {}
+
+    result['time_to_detect'] = None
+    for s in timeline:
+        if s['time'] < t_fail:
+            continue
+        if any(s['nodes'][i]['disabled'] is not None and
+               s['nodes'][i]['disabled'] & (1 << failed) for i in survivors):
+            result['time_to_detect'] = s['time'] - t_fail
+            break
+
+    result['time_to_failover'] = 0.0
+    stalled = False
+    for s in during:
+        committed = all(s['nodes'][i]['commits'] > 0 for i in survivors)
+        if not committed:
+            stalled = True
+            result['time_to_failover'] = None
+        elif stalled:
+            result['time_to_failover'] = s['time'] - t_fail
+            break
+
+    result['time_to_recover'] = None
+    recovered_at = None
+    for s in after:
+        node = s['nodes'][failed]
+        if node['status'] == 'Online' and node['commits'] > 0:
+            recovered_at = s['time']
+            result['time_to_recover'] = recovered_at - t_stop
+            break
+
+    # The donor is whichever survivor's slot of the failed node moved most
+    result['catchup_rate'] = None
+    if recovered_at is not None and recovered_at > t_stop:
+        catchup = [s for s in after if s['time'] <= recovered_at]
+        advance = 0
+        for i in survivors:
+            slots = [s['nodes'][i]['slot'] for s in catchup
+                     if s['nodes'][i]['slot'] is not None]
+            if len(slots) >= 2:
+                advance = max(advance, slots[-1] - slots[0])
+        result['catchup_rate'] = advance / (recovered_at - t_stop) / (1024 * 1024)
+
+    def tps(samples, nodes):
+        if not samples:
+            return None
+        return (sum(s['nodes'][i]['commits'] for s in samples for i in nodes) /
+                sum(s['interval'] for s in samples))
+
+    nodes = range(len(timeline[0]['nodes']))
+    result['tps_before'] = tps([s for s in timeline if s['time'] < t_fail], nodes)
+    result['tps_during'] = tps(during, survivors)
+    result['tps_after'] = tps(after, nodes)
+    result['min_tps_during'] = min((sum(s['nodes'][i]['commits'] for i in survivors) / s['interval']
+                                    for s in during), default=None)
+    result['max_latency_during'] = max((s['nodes'][i]['max_latency'] or 0
+                                        for s in during for i in survivors), default=None)
+    return result
+
+
+def run_scenario(name, args):
+    cluster, make_failure, failed_node = SCENARIOS[name]
+    dsns = cluster['dsns']
+
+    print('### %s ###' % name)
+    subprocess.check_call(['docker-compose'] + cluster['compose'] +
+                          ['up', '--force-recreate', '--build', '-d'])
+    time.sleep(SETUP_TIME)
+
+    if 'referee' in cluster:
+        node_execute(cluster['referee'], ['create extension referee'])
+
+    client = MtmClient(dsns, n_accounts=args.accounts)
+    client.bgrun()
+
+    try:
+        timeline = []
+        start = datetime.datetime.now()
+        client.clean_aggregates()
+        sample_for(client, dsns, failed_node, start, args.warmup, timeline)
+
+        failure = make_failure()
+        t_fail = (datetime.datetime.now() - start).total_seconds()
+        print('Simulate failure at ', datetime.datetime.utcnow())
+        failure.start()
+        sample_for(client, dsns, failed_node, start, args.failure, timeline)
+
+        t_stop = (datetime.datetime.now() - start).total_seconds()
+        failure.stop()
+        print('Eliminate failure at ', datetime.datetime.utcnow())
+
+        def recovered(sample):
+            node = sample['nodes'][failed_node - 1]
+            return node['status'] == 'Online' and node['commits'] > 0
+        sample_for(client, dsns, failed_node, start, args.max_recovery,
+                   timeline, until=recovered)
+        # Keep sampling a bit to see throughput settle after recovery
+        sample_for(client, dsns, failed_node, start, args.warmup, timeline)
+    finally:
+        client.stop()
+        # Both clusters use the same container names
+        subprocess.check_call(['docker-compose'] + cluster['compose'] + ['down'])
+
+    result = analyze(timeline, failed_node, t_fail, t_stop)
+    result['scenario'] = name
+    result['failure_start'] = t_fail
+    result['failure_stop'] = t_stop
+    result['timeline'] = timeline
+    return result
+
+
+def fmt(value, unit=''):
+    if value is None:
+        return '-'
+    return '%.2f%s' % (value, unit)
+
+
+def print_timeline(result):
+    print('%8s' % 'time', end='')
+    for i in range(len(result['timeline'][0]['nodes'])):
+        print('%10s%10s%12s' % ('tps%d' % (i + 1), 'avg_ms', 'status'), end='')
+    print()
+    for s in result['timeline']:
+        print('%8.1f' % s['time'], end='')
+        for node in s['nodes']:
+            print('%10.1f%10s%12s' % (node['commits'] / s['interval'],
+                                   fmt(node['avg_latency'] and node['avg_latency'] * 1000),
+                                   node['status'] or 'n/a'), end='')
+        print()
+
+
+def print_summary(results):
+    columns = ['time_to_detect', 'time_to_failover', 'time_to_recover',
+               'catchup_rate', 'tps_before', 'tps_during', 'min_tps_during',
+               'tps_after', 'max_latency_during']
+    print('%-16s' % 'scenario', end='')
+    for col in columns:
+        print('%20s' % col, end='')
+    print()
+    for r in results:
+        print('%-16s' % r['scenario'], end='')
+        for col in columns:
+            print('%20s' % fmt(r[col]), end='')
+        print()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Multimaster failover and recovery benchmark')
+    parser.add_argument('--scenario', action='append', choices=sorted(SCENARIOS),
+                        help='scenario to run, may be repeated (default: all)')
+    parser.add_argument('--accounts', type=int, default=1000,
+                        help='number of accounts of the bank load')
+    parser.add_argument('--warmup', type=int, default=10,
+                        help='seconds of load before the failure and after recovery')
+    parser.add_argument('--failure', type=int, default=30,
+                        help='seconds the failure lasts')
+    parser.add_argument('--max-recovery', type=int, default=300,
+                        help='seconds to wait for the failed node to recover')
+    parser.add_argument('--output', help='write results with timelines to this JSON file')
+    args = parser.parse_args()
+
+    warnings.simplefilter("ignore", ResourceWarning)
+
+    results = []
+    for name in args.scenario or sorted(SCENARIOS):
+        result = run_scenario(name, args)
+        print_timeline(result)
+        results.append(result)
+
+    print_summary(results)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump({'date': datetime.datetime.utcnow().isoformat(),
+                       'results': results}, f, indent=1)
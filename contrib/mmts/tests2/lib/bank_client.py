@@ -22,6 +22,7 @@ class MtmTxAggregate(object):
 
     def clear_values(self):
         self.max_latency = 0.0
+        self.commit_latency = 0.0
         self.finish = {}
 
     def start_tx(self):
@@ -36,6 +37,9 @@ class MtmTxAggregate(object):
         if latency > self.max_latency:
             self.max_latency = latency
 
+        if status == 'commit':
+            self.commit_latency += latency
+
         if status not in self.finish:
             self.finish[status] = 1
         else:
@@ -45,6 +49,7 @@ class MtmTxAggregate(object):
         return {
             'running_latency': 'xxx', #(datetime.datetime.now() - self.start_time).total_seconds(),
             'max_latency': self.max_latency,
+            'commit_latency': self.commit_latency,
             'isolation': self.isolation,
             'finish': copy.deepcopy(self.finish)
         }
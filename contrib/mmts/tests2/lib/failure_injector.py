@@ -5,9 +5,9 @@ class FailureInjector(object):
     def __init__(self):
         self.docker_api = docker.from_env()
 
-    def container_exec(self, node, command):
+    def container_exec(self, node, command, detach=False):
         docker_node = self.docker_api.containers.get(node)
-        docker_node.exec_run(command, user='root')
+        docker_node.exec_run(command, user='root', detach=detach)
 
 class NoFailure(FailureInjector):
 
@@ -76,6 +76,29 @@ class CrashRecoverNode(FailureInjector):
         self.docker_api.containers.get(self.node).start()
 
 
+class SlowDisk(FailureInjector):
+    """
+    Saturates the disk under the data directory of the node with direct
+    synchronous writes, so that WAL flushes of the node have to queue
+    behind them.
+    """
+
+    def __init__(self, node):
+        self.node = node
+        super().__init__()
+
+    def start(self):
+        self.container_exec(self.node,
+            "sh -c 'while [ ! -e /tmp/slow_disk.stop ]; do "
+            "dd if=/dev/zero of=/pg/data/slow_disk bs=1M count=256 "
+            "oflag=direct conv=fsync 2>/dev/null; done; "
+            "rm -f /pg/data/slow_disk /tmp/slow_disk.stop'",
+            detach=True)
+
+    def stop(self):
+        self.container_exec(self.node, "touch /tmp/slow_disk.stop")
+
+
 class SkewTime(FailureInjector):
 
     def __init__(self, node):
@@ -0,0 +1,132 @@
+/*
+ * trace.c
+ *
+ * Ring of lifecycle events of traced distributed transactions (see trace.h).
+ */
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+
+#include "multimaster.h"
+#include "trace.h"
+
+char const* const MtmTraceEventName[] =
+{
+	"begin",
+	"prepare_start",
+	"prepared",
+	"vote",
+	"abort_vote",
+	"csn",
+	"commit",
+	"abort",
+	"replica_prepare_start",
+	"replica_prepared",
+	"replica_commit",
+	"replica_abort"
+};
+
+double MtmTraceSampleRate;
+int    MtmTraceBufferSize;
+
+/*
+ * Event number N is stored in events[N % MtmTraceBufferSize]. Any process can record events, so a slot is
+ * protected by its sequence number: readers take only events whose sequence number is the same before and
+ * after copying.
+ */
+typedef struct
+{
+	pg_atomic_uint64 head;  /* number of events ever recorded */
+	pg_atomic_uint64 reset; /* events before this number were discarded by MtmTraceReset */
+	MtmTraceEvent events[FLEXIBLE_ARRAY_MEMBER];
+} MtmTraceRing;
+
+static MtmTraceRing* MtmTraceEvents;
+
+Size MtmTraceShmemSize(void)
+{
+	return MAXALIGN(offsetof(MtmTraceRing, events) + sizeof(MtmTraceEvent)*MtmTraceBufferSize);
+}
+
+void MtmTraceInitialize(void)
+{
+	bool found;
+	MtmTraceEvents = (MtmTraceRing*)ShmemInitStruct("MtmTraceEvents", MtmTraceShmemSize(), &found);
+	if (!found) {
+		int i;
+		pg_atomic_init_u64(&MtmTraceEvents->head, 0);
+		pg_atomic_init_u64(&MtmTraceEvents->reset, 0);
+		for (i = 0; i < MtmTraceBufferSize; i++) {
+			pg_atomic_init_u64(&MtmTraceEvents->events[i].seq, 0);
+		}
+	}
+}
+
+/*
+ * Decide whether the transaction being committed by this backend should be traced.
+ */
+bool MtmTraceSample(void)
+{
+	return MtmTraceSampleRate > 0 && random() < MtmTraceSampleRate * MAX_RANDOM_VALUE;
+}
+
+void MtmTraceRecord(char const* gid, MtmTraceEventKind event, int peer, csn_t csn)
+{
+	uint64 pos;
+	MtmTraceEvent* ev;
+
+	if (!MtmTraceIsTraced(gid)) {
+		return;
+	}
+	pos = pg_atomic_fetch_add_u64(&MtmTraceEvents->head, 1);
+	ev = &MtmTraceEvents->events[pos % MtmTraceBufferSize];
+
+	pg_atomic_write_u64(&ev->seq, 0);
+	pg_write_barrier();
+	/* Begin is recorded at commit, when the transaction is chosen for tracing */
+	ev->time = event == MTM_TRACE_BEGIN ? GetCurrentTransactionStartTimestamp() : GetCurrentTimestamp();
+	ev->csn = csn;
+	ev->pid = MyProcPid;
+	ev->event = (uint8)event;
+	ev->peer = (uint8)peer;
+	strncpy(ev->gid, gid, sizeof(ev->gid));
+	pg_write_barrier();
+	pg_atomic_write_u64(&ev->seq, pos + 1);
+}
+
+/*
+ * Copy events which are still in the ring, in the order they were recorded.
+ */
+int MtmTraceGetEvents(MtmTraceEvent** events)
+{
+	uint64 size = (uint64)MtmTraceBufferSize;
+	uint64 head = pg_atomic_read_u64(&MtmTraceEvents->head);
+	uint64 from = Max(pg_atomic_read_u64(&MtmTraceEvents->reset), head > size ? head - size : 0);
+	MtmTraceEvent* copy = (MtmTraceEvent*)palloc(sizeof(MtmTraceEvent)*(head - from));
+	int n = 0;
+	uint64 pos;
+
+	for (pos = from; pos < head; pos++) {
+		MtmTraceEvent* ev = &MtmTraceEvents->events[pos % size];
+		uint64 seq = pg_atomic_read_u64(&ev->seq);
+		if (seq != pos + 1) {
+			continue; /* being written or already overwritten */
+		}
+		pg_read_barrier();
+		memcpy(&copy[n], ev, sizeof(MtmTraceEvent));
+		pg_read_barrier();
+		if (pg_atomic_read_u64(&ev->seq) == seq) {
+			n += 1;
+		}
+	}
+	*events = copy;
+	return n;
+}
+
+void MtmTraceReset(void)
+{
+	pg_atomic_write_u64(&MtmTraceEvents->reset, pg_atomic_read_u64(&MtmTraceEvents->head));
+}
@@ -0,0 +1,66 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "port/atomics.h"
+#include "utils/timestamp.h"
+
+#include "multimaster.h"
+
+/*
+ * Tracing of distributed transactions.
+ *
+ * Coordinator traces a sampled fraction (multimaster.trace_sample_rate) of its distributed transactions and
+ * marks them with MTM_TRACE_GID_PREFIX in the gid, so replicas know which transactions to trace without any
+ * change of the protocol. Each node records the stages it sees into a ring of the last
+ * multimaster.trace_buffer_size events in shared memory; events of one transaction at all nodes are
+ * matched by gid.
+ */
+
+#define MTM_TRACE_GID_PREFIX "MTMT-"
+
+typedef enum
+{
+	MTM_TRACE_BEGIN,                 /* coordinator: start of the transaction */
+	MTM_TRACE_PREPARE_START,         /* coordinator: start of local PREPARE */
+	MTM_TRACE_PREPARED,              /* coordinator: transaction is prepared locally */
+	MTM_TRACE_VOTE,                  /* coordinator: PREPARED vote of peer node arrived */
+	MTM_TRACE_ABORT_VOTE,            /* coordinator: ABORTED vote of peer node arrived */
+	MTM_TRACE_CSN,                   /* coordinator: voting is completed, global CSN is assigned */
+	MTM_TRACE_COMMIT,                /* coordinator: COMMIT PREPARED is done */
+	MTM_TRACE_ABORT,                 /* coordinator: ROLLBACK PREPARED is done */
+	MTM_TRACE_REPLICA_PREPARE_START, /* replica: start of PREPARE of applied transaction */
+	MTM_TRACE_REPLICA_PREPARED,      /* replica: applied transaction is prepared and vote is sent */
+	MTM_TRACE_REPLICA_COMMIT,        /* replica: COMMIT PREPARED is applied */
+	MTM_TRACE_REPLICA_ABORT,         /* replica: ABORT PREPARED is applied */
+	MTM_TRACE_N_EVENTS
+} MtmTraceEventKind;
+
+typedef struct
+{
+	pg_atomic_uint64 seq;  /* position of the event in the ring plus one, 0 while the event is written */
+	TimestampTz time;
+	csn_t       csn;       /* CSN for votes and CSN assignment, 0 otherwise */
+	int32       pid;
+	uint8       event;     /* MtmTraceEventKind */
+	uint8       peer;      /* voting node, 0 for other events */
+	pgid_t      gid;
+} MtmTraceEvent;
+
+extern char const* const MtmTraceEventName[];
+
+extern double MtmTraceSampleRate;
+extern int    MtmTraceBufferSize;
+
+extern Size MtmTraceShmemSize(void);
+extern void MtmTraceInitialize(void);
+extern bool MtmTraceSample(void);
+extern void MtmTraceRecord(char const* gid, MtmTraceEventKind event, int peer, csn_t csn);
+extern int  MtmTraceGetEvents(MtmTraceEvent** events);
+extern void MtmTraceReset(void);
+
+static inline bool MtmTraceIsTraced(char const* gid)
+{
+	return strncmp(gid, MTM_TRACE_GID_PREFIX, sizeof(MTM_TRACE_GID_PREFIX)-1) == 0;
+}
+
+#endif
@@ -0,0 +1,621 @@
+/*
+ * writeset.c
+ *
+ * Dependency-aware scheduling of replicated transactions.
+ *
+ * Logical receiver assigns sequence number to each transaction received from the node
+ * and extracts its write set: hashes of primary keys of inserted, updated and deleted records.
+ * Hashes are mapped to the buckets storing sequence number of the last transaction
+ * which has modified the key. Transaction depends on all such transactions which are still in progress.
+ * Transactions which write set can not be determined (DDL, truncate, spilled transactions,...)
+ * are treated as barriers: them wait completion of all previous transactions and all subsequent
+ * transactions wait for them.
+ *
+ * Completion of transactions is tracked in shared memory ring of MTM_WRITESET_WINDOW elements:
+ * receiver doesn't allow more than MTM_WRITESET_WINDOW transactions to be in progress,
+ * so done[seq % MTM_WRITESET_WINDOW] >= seq means that transaction seq is completed.
+ *
+ * Collisions of hashes can only cause false dependencies, but not lost ones.
+ *
+ * Independently of write sets, bare COMMIT PREPARED and ROLLBACK PREPARED records can be sequenced per origin
+ * (multimaster.origin_commit_order): receiver numbers them in the order of their origin LSN and apply workers
+ * finish prepared transactions of one node strictly in this order, while transactions of other nodes and
+ * all data changes are still applied in parallel.
+ */
+#include <arpa/inet.h>
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_index.h"
+#include "nodes/makefuncs.h"
+#include "port/atomics.h"
+#include "storage/lmgr.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/syscache.h"
+#include "libpq/pqformat.h"
+
+#include "multimaster.h"
+#include "writeset.h"
+
+typedef struct
+{
+	uint64 nextSeq;                               /* next sequence number: accessed only by receiver */
+	pg_atomic_uint64 done[MTM_WRITESET_WINDOW];   /* sequence numbers of completed transactions */
+	uint64 nextCommit;                            /* next commit ticket: accessed only by receiver */
+	pg_atomic_uint64 committed;                   /* all commits up to this ticket are completed */
+} MtmWriteSetQueue;
+
+/* Primary key of relation: positions of key columns among not-dropped columns */
+typedef struct
+{
+	Oid    relid;        /* relation OID at sender node */
+	int    nKeys;        /* number of key columns or -1 if key is unknown */
+	int16  keys[INDEX_MAX_KEYS];
+} MtmWriteSetRel;
+
+typedef struct
+{
+	char const* data;
+	int  len;
+	int  cursor;
+} MtmWriteSetReader;
+
+typedef struct
+{
+	char  kind;
+	int   len;
+	char const* data;
+} MtmWriteSetColumn;
+
+static MtmWriteSetQueue* MtmWriteSetQueues; /* [MtmMaxNodes] */
+
+/* Receiver state */
+static int     MtmWriteSetNodeId;
+static uint64* MtmWriteSetBuckets;
+static HTAB*   MtmWriteSetRels;
+static uint64  MtmLowWaterMark;  /* all transactions before it are completed */
+static uint64  MtmLastBarrier;
+static bool    MtmWriteSetRestarted;
+
+/* Apply worker state */
+static MtmWriteSetQueue* MtmCurrentQueue;
+static uint64  MtmCurrentSeq;
+static uint64  MtmCurrentCommitFrom; /* transactions before it are known to be completed before commit */
+static MtmWriteSetQueue* MtmCurrentCommitQueue;
+static uint64  MtmCurrentCommitTicket;
+
+Size MtmWriteSetShmemSize(void)
+{
+	return mul_size(sizeof(MtmWriteSetQueue), MtmMaxNodes);
+}
+
+void MtmWriteSetInitialize(void)
+{
+	bool found;
+	int  i, j;
+
+	MtmWriteSetQueues = (MtmWriteSetQueue*)ShmemInitStruct("mtm_writeset", MtmWriteSetShmemSize(), &found);
+	if (!found) {
+		for (i = 0; i < MtmMaxNodes; i++) {
+			MtmWriteSetQueues[i].nextSeq = 1;
+			MtmWriteSetQueues[i].nextCommit = 1;
+			pg_atomic_init_u64(&MtmWriteSetQueues[i].committed, 0);
+			for (j = 0; j < MTM_WRITESET_WINDOW; j++) {
+				pg_atomic_init_u64(&MtmWriteSetQueues[i].done[j], 0);
+			}
+		}
+	}
+}
+
+static inline bool MtmWriteSetIsDone(MtmWriteSetQueue* q, uint64 seq)
+{
+	return pg_atomic_read_u64(&q->done[seq % MTM_WRITESET_WINDOW]) >= seq;
+}
+
+/*
+ * Wait completion of the transaction. Returns false if wait was interrupted by timeout or shutdown.
+ * Timeout protects us against apply workers which exited without marking their transaction as completed:
+ * in this case we fallback to lock-based ordering.
+ */
+static bool MtmWriteSetWaitUntil(MtmWriteSetQueue* q, pg_atomic_uint64* done, uint64 seq, char const* what)
+{
+	timestamp_t start = 0;
+	timestamp_t delay = 10;
+
+	while (pg_atomic_read_u64(done) < seq) {
+		timestamp_t now = MtmGetSystemTime();
+		if (start == 0) {
+			start = now;
+		} else if (now - start > MTM_WRITESET_WAIT_TIMEOUT) {
+			MTM_ELOG(WARNING, "Stop waiting for completion of %s %lld from node %d",
+					 what, (long64)seq, (int)(q - MtmWriteSetQueues) + 1);
+			return false;
+		}
+		if (Mtm->pool.shutdown) {
+			return false;
+		}
+		MtmSleep(delay);
+		if (delay < 1000) {
+			delay *= 2;
+		}
+	}
+	return true;
+}
+
+static bool MtmWriteSetWaitFor(MtmWriteSetQueue* q, uint64 seq)
+{
+	return MtmWriteSetWaitUntil(q, &q->done[seq % MTM_WRITESET_WINDOW], seq, "transaction");
+}
+
+static void MtmWriteSetResetRels(void)
+{
+	HASHCTL info;
+
+	if (MtmWriteSetRels != NULL) {
+		hash_destroy(MtmWriteSetRels);
+	}
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(MtmWriteSetRel);
+	info.hcxt = TopMemoryContext;
+	MtmWriteSetRels = hash_create("MtmWriteSetRels", 256, &info, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+void MtmWriteSetReceiverStart(int nodeId)
+{
+	MtmWriteSetQueue* q = &MtmWriteSetQueues[nodeId-1];
+
+	MtmWriteSetNodeId = nodeId;
+	if (MtmWriteSetBuckets == NULL) {
+		MtmWriteSetBuckets = (uint64*)MemoryContextAlloc(TopMemoryContext, MTM_WRITESET_BUCKETS*sizeof(uint64));
+	}
+	memset(MtmWriteSetBuckets, 0, MTM_WRITESET_BUCKETS*sizeof(uint64));
+	MtmWriteSetResetRels();
+	/* Transactions scheduled by previous incarnation of receiver may be still in progress */
+	MtmLowWaterMark = q->nextSeq > MTM_WRITESET_WINDOW ? q->nextSeq - MTM_WRITESET_WINDOW : 1;
+	MtmLastBarrier = 0;
+	MtmWriteSetRestarted = true;
+}
+
+/*
+ * Locate primary key of the relation in local catalog.
+ * Receiver should never block here: prepared transaction holding lock on the relation
+ * may wait for commit which is delivered by this receiver.
+ */
+static void MtmWriteSetLoadKey(MtmWriteSetRel* entry, char const* nspname, char const* relname)
+{
+	Oid relid;
+
+	entry->nKeys = -1;
+	StartTransactionCommand();
+	relid = RangeVarGetRelid(makeRangeVar((char*)nspname, (char*)relname, -1), NoLock, true);
+	if (OidIsValid(relid) && ConditionalLockRelationOid(relid, AccessShareLock)) {
+		Relation rel = heap_open(relid, NoLock);
+		if (rel->rd_indexvalid == 0) {
+			RelationGetIndexList(rel);
+		}
+		if (OidIsValid(rel->rd_replidindex)) {
+			HeapTuple tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(rel->rd_replidindex));
+			if (HeapTupleIsValid(tuple)) {
+				Form_pg_index index = (Form_pg_index)GETSTRUCT(tuple);
+				TupleDesc desc = RelationGetDescr(rel);
+				int i, j;
+				entry->nKeys = index->indnatts;
+				for (i = 0; i < index->indnatts; i++) {
+					AttrNumber attno = index->indkey.values[i];
+					int pos = 0;
+					if (attno <= 0) {
+						entry->nKeys = -1;
+						break;
+					}
+					for (j = 0; j < attno-1; j++) {
+						if (!desc->attrs[j]->attisdropped) {
+							pos += 1;
+						}
+					}
+					entry->keys[i] = pos;
+				}
+				ReleaseSysCache(tuple);
+			}
+		}
+		heap_close(rel, AccessShareLock);
+	}
+	CommitTransactionCommand();
+}
+
+static bool MtmReadByte(MtmWriteSetReader* r, char* c)
+{
+	if (r->cursor >= r->len) {
+		return false;
+	}
+	*c = r->data[r->cursor++];
+	return true;
+}
+
+static bool MtmReadInt(MtmWriteSetReader* r, int size, uint32* val)
+{
+	uint32 n32;
+	uint16 n16;
+
+	if (r->cursor + size > r->len) {
+		return false;
+	}
+	if (size == 4) {
+		memcpy(&n32, &r->data[r->cursor], 4);
+		*val = ntohl(n32);
+	} else {
+		Assert(size == 2);
+		memcpy(&n16, &r->data[r->cursor], 2);
+		*val = ntohs(n16);
+	}
+	r->cursor += size;
+	return true;
+}
+
+static bool MtmReadBytes(MtmWriteSetReader* r, int size, char const** data)
+{
+	if (size < 0 || r->cursor + size > r->len) {
+		return false;
+	}
+	*data = &r->data[r->cursor];
+	r->cursor += size;
+	return true;
+}
+
+/*
+ * Parse tuple and calculate hash of its primary key.
+ * Returns false if tuple can not be parsed or key is not available.
+ */
+static bool MtmReadTupleKey(MtmWriteSetReader* r, MtmWriteSetRel* rel, uint32* hash)
+{
+	static MtmWriteSetColumn cols[MaxTupleAttributeNumber];
+	uint32 natts;
+	uint32 len;
+	uint32 h;
+	char kind;
+	int i;
+
+	if (!MtmReadByte(r, &kind) || kind != 'T' || !MtmReadInt(r, 2, &natts) || natts > MaxTupleAttributeNumber) {
+		return false;
+	}
+	for (i = 0; i < natts; i++) {
+		if (!MtmReadByte(r, &cols[i].kind)) {
+			return false;
+		}
+		switch (cols[i].kind) {
+		  case 'n':
+		  case 'u':
+			cols[i].len = 0;
+			break;
+		  case 'b':
+		  case 's':
+		  case 't':
+			if (!MtmReadInt(r, 4, &len) || !MtmReadBytes(r, (int)len, &cols[i].data)) {
+				return false;
+			}
+			cols[i].len = len;
+			break;
+		  default:
+			return false;
+		}
+	}
+	if (rel == NULL || rel->nKeys <= 0) {
+		return false;
+	}
+	h = hash_uint32(rel->relid);
+	for (i = 0; i < rel->nKeys; i++) {
+		MtmWriteSetColumn* col;
+		if (rel->keys[i] >= natts) {
+			return false;
+		}
+		col = &cols[rel->keys[i]];
+		if (col->kind == 'u') {
+			/* toasted key: can not calculate hash */
+			return false;
+		}
+		h = (h << 1) | (h >> 31);
+		h ^= col->kind == 'n' ? 0 : DatumGetUInt32(hash_any((unsigned char const*)col->data, col->len));
+	}
+	*hash = h;
+	return true;
+}
+
+static void MtmWriteSetAddDep(MtmWriteSetQueue* q, uint64 seq, uint64 dep, uint64* deps, int* nDeps, bool* waitAll)
+{
+	int i;
+	if (dep < MtmLowWaterMark || dep >= seq || MtmWriteSetIsDone(q, dep)) {
+		return;
+	}
+	for (i = 0; i < *nDeps; i++) {
+		if (deps[i] == dep) {
+			return;
+		}
+	}
+	if (*nDeps == MTM_WRITESET_MAX_DEPS) {
+		*waitAll = true;
+	} else {
+		deps[(*nDeps)++] = dep;
+	}
+}
+
+static void MtmWriteSetAddKey(MtmWriteSetQueue* q, uint64 seq, uint32 hash, uint64* deps, int* nDeps, bool* waitAll)
+{
+	uint64* bucket = &MtmWriteSetBuckets[hash % MTM_WRITESET_BUCKETS];
+	MtmWriteSetAddDep(q, seq, *bucket, deps, nDeps, waitAll);
+	*bucket = seq;
+}
+
+/*
+ * Walk through records of the transaction and collect its dependencies.
+ * Returns false if transaction should be executed as barrier.
+ */
+static bool MtmWriteSetExtract(MtmWriteSetQueue* q, uint64 seq, char const* data, int size, uint64* deps, int* nDeps, bool* waitAll)
+{
+	MtmWriteSetReader r;
+	MtmWriteSetRel* rel = NULL;
+	uint32 hash;
+	uint32 len;
+	char const* body;
+	char action;
+
+	r.data = data;
+	r.len = size;
+	r.cursor = 0;
+
+	while (MtmReadByte(&r, &action)) {
+		switch (action) {
+		  case 'B':
+			if (!MtmReadBytes(&r, 4 + 8 + 8 + 8, &body)) {
+				return false;
+			}
+			break;
+		  case 'R':
+		  {
+			  uint32 relid;
+			  char nsplen, rellen;
+			  char const* nspname;
+			  char const* relname;
+			  bool found;
+
+			  if (!MtmReadInt(&r, 4, &relid)
+				  || !MtmReadByte(&r, &nsplen) || !MtmReadBytes(&r, (uint8)nsplen, &nspname)
+				  || !MtmReadByte(&r, &rellen) || !MtmReadBytes(&r, (uint8)rellen, &relname))
+			  {
+				  return false;
+			  }
+			  rel = (MtmWriteSetRel*)hash_search(MtmWriteSetRels, &relid, nsplen != 0 ? HASH_ENTER : HASH_FIND, &found);
+			  if (rel != NULL && !found) {
+				  MtmWriteSetLoadKey(rel, nspname, relname);
+				  if (rel->nKeys < 0) {
+					  /* do not cache failures: relation can be locked or not yet created */
+					  hash_search(MtmWriteSetRels, &relid, HASH_REMOVE, NULL);
+					  return false;
+				  }
+			  }
+			  if (rel == NULL) {
+				  return false;
+			  }
+			  break;
+		  }
+		  case 'I':
+		  case 'D':
+			if (!MtmReadTupleKey(&r, rel, &hash)) {
+				return false;
+			}
+			MtmWriteSetAddKey(q, seq, hash, deps, nDeps, waitAll);
+			break;
+		  case 'U':
+			if (!MtmReadByte(&r, &action)) {
+				return false;
+			}
+			if (action == 'K') {
+				/* old key */
+				if (!MtmReadTupleKey(&r, rel, &hash) || !MtmReadByte(&r, &action)) {
+					return false;
+				}
+				MtmWriteSetAddKey(q, seq, hash, deps, nDeps, waitAll);
+			}
+			if (action != 'N' || !MtmReadTupleKey(&r, rel, &hash)) {
+				return false;
+			}
+			MtmWriteSetAddKey(q, seq, hash, deps, nDeps, waitAll);
+			break;
+		  case 'N':
+			/* sequence adjustment is commutative */
+			if (!MtmReadBytes(&r, 8, &body)) {
+				return false;
+			}
+			break;
+		  case 'M':
+			if (!MtmReadByte(&r, &action) || !MtmReadInt(&r, 4, &len) || !MtmReadBytes(&r, (int)len, &body)) {
+				return false;
+			}
+			if (action != 'S') {
+				if (action == 'D') {
+					/* DDL can change primary keys */
+					MtmWriteSetResetRels();
+				}
+				return false;
+			}
+			break;
+		  case 'C':
+			return true;
+		  default:
+			/* truncate and other records are not tracked */
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Called by receiver before passing transaction to the pool.
+ * Appends 'S' record with dependencies of the transaction to hdr.
+ */
+void MtmWriteSetSchedule(int nodeId, char const* data, int size, bool barrier, bool ordered, StringInfo hdr)
+{
+	MtmWriteSetQueue* q = &MtmWriteSetQueues[nodeId-1];
+	uint64 deps[MTM_WRITESET_MAX_DEPS];
+	int    nDeps = 0;
+	bool   waitAll = false;
+	uint64 seq;
+	int    i;
+
+	Assert(nodeId == MtmWriteSetNodeId);
+	seq = q->nextSeq++;
+
+	/* Do not allow more than MTM_WRITESET_WINDOW transactions to be in progress */
+	if (seq > MTM_WRITESET_WINDOW) {
+		MtmWriteSetWaitFor(q, seq - MTM_WRITESET_WINDOW);
+		if (MtmLowWaterMark <= seq - MTM_WRITESET_WINDOW) {
+			MtmLowWaterMark = seq - MTM_WRITESET_WINDOW + 1;
+		}
+	}
+	while (MtmLowWaterMark < seq && MtmWriteSetIsDone(q, MtmLowWaterMark)) {
+		MtmLowWaterMark += 1;
+	}
+
+	if (barrier || MtmWriteSetRestarted || !MtmWriteSetExtract(q, seq, data, size, deps, &nDeps, &waitAll)) {
+		MtmWriteSetRestarted = false;
+		MtmLastBarrier = seq;
+		waitAll = true;
+	} else {
+		MtmWriteSetAddDep(q, seq, MtmLastBarrier, deps, &nDeps, &waitAll);
+	}
+	if (waitAll) {
+		nDeps = 0;
+	}
+	pq_sendbyte(hdr, 'S');
+	pq_sendbyte(hdr, nodeId);
+	pq_sendint64(hdr, seq);
+	pq_sendint64(hdr, waitAll ? MtmLowWaterMark : seq);
+	pq_sendint64(hdr, ordered ? MtmLowWaterMark : seq);
+	pq_sendbyte(hdr, nDeps);
+	for (i = 0; i < nDeps; i++) {
+		pq_sendint64(hdr, deps[i]);
+	}
+}
+
+/*
+ * Called by apply worker when 'S' record is processed: wait until all transactions
+ * this transaction depends on are completed.
+ */
+void MtmWriteSetWait(StringInfo s)
+{
+	int    nodeId = pq_getmsgbyte(s);
+	uint64 seq = pq_getmsgint64(s);
+	uint64 from = pq_getmsgint64(s);
+	uint64 commitFrom = pq_getmsgint64(s);
+	int    nDeps = pq_getmsgbyte(s);
+	bool   wait = true;
+	MtmWriteSetQueue* q = &MtmWriteSetQueues[nodeId-1];
+	uint64 dep;
+	int    i;
+
+	MtmCurrentQueue = q;
+	MtmCurrentSeq = seq;
+	MtmCurrentCommitFrom = commitFrom;
+
+	for (i = 0; i < nDeps; i++) {
+		dep = pq_getmsgint64(s);
+		if (wait) {
+			wait = MtmWriteSetWaitFor(q, dep);
+		}
+	}
+	for (dep = from; wait && dep < seq; dep++) {
+		wait = MtmWriteSetWaitFor(q, dep);
+	}
+}
+
+/*
+ * Called by receiver before passing bare COMMIT PREPARED or ROLLBACK PREPARED to the pool.
+ * Appends 'Q' record with the commit ticket of the origin node to hdr.
+ * Commits are received in the order of their origin LSN, so tickets follow it as well.
+ */
+void MtmWriteSetScheduleCommit(int nodeId, StringInfo hdr)
+{
+	MtmWriteSetQueue* q = &MtmWriteSetQueues[nodeId-1];
+
+	Assert(nodeId == MtmWriteSetNodeId);
+	pq_sendbyte(hdr, 'Q');
+	pq_sendbyte(hdr, nodeId);
+	pq_sendint64(hdr, q->nextCommit++);
+}
+
+/*
+ * Called by apply worker when 'Q' record is processed: remember commit ticket of the work.
+ */
+void MtmWriteSetWaitCommit(StringInfo s)
+{
+	int nodeId = pq_getmsgbyte(s);
+	MtmCurrentCommitQueue = &MtmWriteSetQueues[nodeId-1];
+	MtmCurrentCommitTicket = pq_getmsgint64(s);
+}
+
+/*
+ * Called by apply worker before commit of ordered transaction: wait until all previously received
+ * transactions are completed, so that transactions are committed in the same order as at the sender
+ * and replication origin progress never skips not yet committed transaction.
+ * Commit with a ticket waits only for the previous commit of the same origin.
+ */
+void MtmWriteSetWaitCommitOrder(void)
+{
+	uint64 seq;
+	for (seq = MtmCurrentCommitFrom; seq < MtmCurrentSeq; seq++) {
+		if (!MtmWriteSetWaitFor(MtmCurrentQueue, seq)) {
+			break;
+		}
+	}
+	MtmCurrentCommitFrom = MtmCurrentSeq;
+
+	if (MtmCurrentCommitTicket > 1) {
+		MtmWriteSetWaitUntil(MtmCurrentCommitQueue, &MtmCurrentCommitQueue->committed, MtmCurrentCommitTicket - 1, "commit");
+	}
+}
+
+/*
+ * Wait until all transactions scheduled by receiver of the node are completed
+ */
+void MtmWriteSetDrain(int nodeId)
+{
+	MtmWriteSetQueue* q = &MtmWriteSetQueues[nodeId-1];
+	uint64 seq = q->nextSeq > MTM_WRITESET_WINDOW ? q->nextSeq - MTM_WRITESET_WINDOW : 1;
+	if (nodeId == MtmWriteSetNodeId && seq < MtmLowWaterMark) {
+		seq = MtmLowWaterMark;
+	}
+	for (; seq < q->nextSeq; seq++) {
+		if (!MtmWriteSetWaitFor(q, seq)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Mark transaction applied by this worker as completed.
+ * Should be called both in case of successful apply and in case of error.
+ */
+void MtmWriteSetComplete(void)
+{
+	if (MtmCurrentSeq != 0) {
+		pg_write_barrier();
+		pg_atomic_write_u64(&MtmCurrentQueue->done[MtmCurrentSeq % MTM_WRITESET_WINDOW], MtmCurrentSeq);
+		MtmCurrentSeq = 0;
+	}
+	if (MtmCurrentCommitTicket != 0) {
+		/* Commit may complete before its predecessor if the wait was timed out: never move back */
+		uint64 committed = pg_atomic_read_u64(&MtmCurrentCommitQueue->committed);
+		pg_write_barrier();
+		while (committed < MtmCurrentCommitTicket
+			   && !pg_atomic_compare_exchange_u64(&MtmCurrentCommitQueue->committed, &committed, MtmCurrentCommitTicket));
+		MtmCurrentCommitTicket = 0;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef __WRITESET_H__
+#define __WRITESET_H__
+
+#include "lib/stringinfo.h"
+
+/*
+ * Dependency tracking of replicated transactions.
+ *
+ * Receiver extracts write set (relation + primary key) of each transaction
+ * and prepends to the work passed to the pool 'S' record with sequence number
+ * of the transaction and list of in-flight transactions it conflicts with.
+ * Apply worker waits until these transactions are applied before starting its own.
+ * Ordered transactions (used by parallel recovery) additionally wait before commit
+ * until all previously received transactions are completed.
+ *
+ * Bare commits of prepared transactions can also be prefixed with 'Q' record with per-origin ticket:
+ * apply worker finishes the prepared transaction only after the commit with the previous ticket.
+ */
+
+#define MTM_WRITESET_WINDOW     4096      /* maximal number of in-flight transactions from one node */
+#define MTM_WRITESET_BUCKETS    (64*1024) /* size of write set hash used by receiver */
+#define MTM_WRITESET_MAX_DEPS   8         /* maximal number of dependencies stored in 'S' record */
+#define MTM_WRITESET_WAIT_TIMEOUT (10*USECS_PER_SEC) /* give up waiting for dependency after this time */
+
+extern bool MtmTrackDependencies;
+extern bool MtmParallelRecovery;
+extern bool MtmOriginCommitOrder;
+
+extern Size MtmWriteSetShmemSize(void);
+extern void MtmWriteSetInitialize(void);
+extern void MtmWriteSetReceiverStart(int nodeId);
+extern void MtmWriteSetSchedule(int nodeId, char const* data, int size, bool barrier, bool ordered, StringInfo hdr);
+extern void MtmWriteSetWait(StringInfo s);
+extern void MtmWriteSetScheduleCommit(int nodeId, StringInfo hdr);
+extern void MtmWriteSetWaitCommit(StringInfo s);
+extern void MtmWriteSetWaitCommitOrder(void);
+extern void MtmWriteSetComplete(void);
+extern void MtmWriteSetDrain(int nodeId);
+
+#endif
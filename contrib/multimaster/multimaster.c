@@ -126,16 +126,16 @@ static int DtmLocalXidReserve;
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
-	DtmGetTransactionStatus,
-	DtmSetTransactionStatus,
-	DtmGetSnapshot,
-	DtmGetNewTransactionId,
-	DtmGetOldestXmin,
-	PgTransactionIdIsInProgress,
-	DtmGetGlobalTransactionId,
-	PgXidInMVCCSnapshot,
-    DtmDetectGlobalDeadLock,
-	DtmGetName
+	.GetTransactionStatus = DtmGetTransactionStatus,
+	.SetTransactionStatus = DtmSetTransactionStatus,
+	.GetSnapshot = DtmGetSnapshot,
+	.GetNewTransactionId = DtmGetNewTransactionId,
+	.GetOldestXmin = DtmGetOldestXmin,
+	.IsInProgress = PgTransactionIdIsInProgress,
+	.GetGlobalTransactionId = DtmGetGlobalTransactionId,
+	.IsInSnapshot = PgXidInMVCCSnapshot,
+	.DetectGlobalDeadLock = DtmDetectGlobalDeadLock,
+	.GetName = DtmGetName
 };
 
 bool  MMDoReplication;
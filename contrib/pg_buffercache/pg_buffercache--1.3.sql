@@ -0,0 +1,39 @@
+/* contrib/pg_buffercache/pg_buffercache--1.3.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_buffercache" to load this file. \quit
+
+-- Register the function.
+CREATE FUNCTION pg_buffercache_pages()
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_pages'
+LANGUAGE C PARALLEL SAFE;
+
+-- Create a view for convenient access.
+CREATE VIEW pg_buffercache AS
+	SELECT P.* FROM pg_buffercache_pages() AS P
+	(bufferid integer, relfilenode oid, reltablespace oid, reldatabase oid,
+	 relforknumber int2, relblocknumber int8, isdirty bool, usagecount int2,
+	 pinning_backends int4);
+
+CREATE FUNCTION pg_buffercache_pages(consistent boolean,
+	OUT bufferid integer, OUT relfilenode oid, OUT reltablespace oid,
+	OUT reldatabase oid, OUT relforknumber int2, OUT relblocknumber int8,
+	OUT isdirty bool, OUT usagecount int2, OUT pinning_backends int4)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_pages'
+LANGUAGE C STRICT PARALLEL SAFE;
+
+CREATE FUNCTION pg_buffercache_summary(
+	OUT relfilenode oid, OUT reltablespace oid, OUT reldatabase oid,
+	OUT buffers int4, OUT buffers_dirty int4, OUT buffers_pinned int4,
+	OUT usagecount_counts int4[])
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_summary'
+LANGUAGE C PARALLEL SAFE;
+
+-- Don't want these to be available to public.
+REVOKE ALL ON FUNCTION pg_buffercache_pages() FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_pages(boolean) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_summary() FROM PUBLIC;
+REVOKE ALL ON pg_buffercache FROM PUBLIC;
@@ -11,12 +11,16 @@
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
+#include "utils/array.h"
+#include "utils/hsearch.h"
 
 
 #define NUM_BUFFERCACHE_PAGES_MIN_ELEM	8
 #define NUM_BUFFERCACHE_PAGES_ELEM	9
+#define NUM_BUFFERCACHE_SUMMARY_ELEM	7
 
 PG_MODULE_MAGIC;
 
@@ -54,11 +58,31 @@ typedef struct
 } BufferCachePagesContext;
 
 
+/*
+ * Per-relation counters of pg_buffercache_summary().
+ */
+typedef struct
+{
+	RelFileNode rnode;			/* hash key; all zeroes for unused buffers */
+	int32		buffers;
+	int32		dirty;
+	int32		pinned;
+	int32		usagecounts[BM_MAX_USAGE_COUNT + 1];
+} BufferCacheSummaryEntry;
+
+
 /*
  * Function returning data from the shared buffer cache - buffer number,
  * relation node/tablespace/database/blocknum and dirty indicator.
+ *
+ * Called without arguments, or with consistent = true, this locks the whole
+ * buffer mapping table while it copies the buffer headers, so that the
+ * result is a consistent snapshot.  With consistent = false, each header is
+ * only read under its own spinlock: buffers may be replaced while we scan,
+ * but no other backend is held up.
  */
 PG_FUNCTION_INFO_V1(pg_buffercache_pages);
+PG_FUNCTION_INFO_V1(pg_buffercache_summary);
 
 Datum
 pg_buffercache_pages(PG_FUNCTION_ARGS)
@@ -73,6 +97,7 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 
 	if (SRF_IS_FIRSTCALL())
 	{
+		bool		consistent = PG_NARGS() > 0 ? PG_GETARG_BOOL(0) : true;
 		int			i;
 
 		funcctx = SRF_FIRSTCALL_INIT();
@@ -141,8 +166,11 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 		 * for concurrency.  Must grab locks in increasing order to avoid
 		 * possible deadlocks.
 		 */
-		for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
-			LWLockAcquire(BufMappingPartitionLockByIndex(i), LW_SHARED);
+		if (consistent)
+		{
+			for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
+				LWLockAcquire(BufMappingPartitionLockByIndex(i), LW_SHARED);
+		}
 
 		/*
 		 * Scan through all the buffers, saving the relevant fields in the
@@ -187,8 +215,11 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 		 * other process until it can get all the locks it needs. (2) This
 		 * avoids O(N^2) behavior inside LWLockRelease.
 		 */
-		for (i = NUM_BUFFER_PARTITIONS; --i >= 0;)
-			LWLockRelease(BufMappingPartitionLockByIndex(i));
+		if (consistent)
+		{
+			for (i = NUM_BUFFER_PARTITIONS; --i >= 0;)
+				LWLockRelease(BufMappingPartitionLockByIndex(i));
+		}
 	}
 
 	funcctx = SRF_PERCALL_SETUP();
@@ -252,3 +283,136 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 	else
 		SRF_RETURN_DONE(funcctx);
 }
+
+/*
+ * Function returning one row per relation with buffers in the shared buffer
+ * cache: how many, how many of those are dirty or pinned, and how many have
+ * each usage count.  One more row, with null relation columns, covers the
+ * unused buffers.
+ *
+ * Like pg_buffercache_pages(false), this reads each buffer header under its
+ * spinlock only, and it never holds more than one row per relation in
+ * memory.
+ */
+Datum
+pg_buffercache_summary(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	HASHCTL		ctl;
+	HTAB	   *htab;
+	HASH_SEQ_STATUS hash_seq;
+	BufferCacheSummaryEntry *entry;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	if (tupdesc->natts != NUM_BUFFERCACHE_SUMMARY_ELEM)
+		elog(ERROR, "incorrect number of output arguments");
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(RelFileNode);
+	ctl.entrysize = sizeof(BufferCacheSummaryEntry);
+	ctl.hcxt = CurrentMemoryContext;
+	htab = hash_create("pg_buffercache_summary", 1024, &ctl,
+					   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc *bufHdr;
+		uint32		buf_state;
+		RelFileNode rnode;
+		bool		found;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+		buf_state = LockBufHdr(bufHdr);
+		if ((buf_state & BM_VALID) && (buf_state & BM_TAG_VALID))
+			rnode = bufHdr->tag.rnode;
+		else
+			MemSet(&rnode, 0, sizeof(rnode));
+		UnlockBufHdr(bufHdr, buf_state);
+
+		entry = (BufferCacheSummaryEntry *) hash_search(htab, &rnode,
+														HASH_ENTER, &found);
+		if (!found)
+			MemSet(((char *) entry) + sizeof(RelFileNode), 0,
+				   sizeof(BufferCacheSummaryEntry) - sizeof(RelFileNode));
+
+		entry->buffers++;
+		if (buf_state & BM_DIRTY)
+			entry->dirty++;
+		if (BUF_STATE_GET_REFCOUNT(buf_state) > 0)
+			entry->pinned++;
+		entry->usagecounts[BUF_STATE_GET_USAGECOUNT(buf_state)]++;
+	}
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	hash_seq_init(&hash_seq, htab);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum		values[NUM_BUFFERCACHE_SUMMARY_ELEM];
+		bool		nulls[NUM_BUFFERCACHE_SUMMARY_ELEM];
+		Datum		counts[BM_MAX_USAGE_COUNT + 1];
+		int			j;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		if (entry->rnode.relNode == InvalidOid)
+		{
+			nulls[0] = true;
+			nulls[1] = true;
+			nulls[2] = true;
+		}
+		else
+		{
+			values[0] = ObjectIdGetDatum(entry->rnode.relNode);
+			values[1] = ObjectIdGetDatum(entry->rnode.spcNode);
+			values[2] = ObjectIdGetDatum(entry->rnode.dbNode);
+		}
+		values[3] = Int32GetDatum(entry->buffers);
+		values[4] = Int32GetDatum(entry->dirty);
+		values[5] = Int32GetDatum(entry->pinned);
+
+		for (j = 0; j <= BM_MAX_USAGE_COUNT; j++)
+			counts[j] = Int32GetDatum(entry->usagecounts[j]);
+		values[6] = PointerGetDatum(construct_array(counts,
+													BM_MAX_USAGE_COUNT + 1,
+													INT4OID, sizeof(int32),
+													true, 'i'));
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	hash_destroy(htab);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -20,3 +20,7 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_current_snapshot_xcnt() RETURNS integer
 AS 'MODULE_PATHNAME','dtm_get_current_snapshot_xcnt'
 LANGUAGE C;
+
+CREATE FUNCTION dtm_get_xid_lease_stats(OUT leases bigint, OUT stalls bigint, OUT stall_time bigint, OUT avg_lease_time bigint, OUT max_lease_time bigint, OUT last_lease_size bigint, OUT reserved_xids bigint, OUT xid_rate float8) RETURNS record
+AS 'MODULE_PATHNAME','dtm_get_xid_lease_stats'
+LANGUAGE C;
@@ -35,6 +35,9 @@
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
 #include "commands/dbcommands.h"
 #include "miscadmin.h"
 #include "postmaster/autovacuum.h"
@@ -45,6 +48,23 @@
 #include "sockhub.h"
 #include "arbiter.h"
 
+#define DTM_MAX_XID_LEASE      100000 /* maximal size of range of local XIDs reserved at once */
+#define DTM_LEASER_INTERVAL_MS 100    /* period of XID consumption rate estimation */
+
+/*
+ * Statistic of reservation of local XID ranges
+ */
+typedef struct
+{
+	uint64 nLeases;        /* number of ranges reserved in advance by XID leaser */
+	uint64 nStalls;        /* number of times backend had to reserve range itself */
+	uint64 stallTime;      /* total time backends were blocked reserving range (usec) */
+	uint64 totalLeaseTime; /* total duration of reservation requests of XID leaser (usec) */
+	uint64 maxLeaseTime;   /* maximal duration of reservation request of XID leaser (usec) */
+	uint64 lastLeaseSize;  /* size of the last reserved range */
+	double xidRate;        /* estimated rate of local XID consumption (XIDs/sec) */
+} DtmLeaseStats;
+
 typedef struct
 {
 	LWLockId hashLock;
@@ -52,6 +72,13 @@ typedef struct
 	TransactionId minXid;  /* XID of oldest transaction visible by any active transaction (local or global) */
 	TransactionId nextXid; /* next XID for local transaction */
 	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+	/* Fields below are protected by xidLock */
+	TransactionId prefetchedXid; /* first XID of the range reserved in advance by XID leaser */
+	size_t nPrefetchedXids;      /* size of prefetched range, 0 if there is no such range */
+	size_t lowWatermark;         /* XID leaser is woken up when fewer reserved XIDs are left */
+	Latch* leaserLatch;          /* latch of XID leaser worker */
+	uint64 nConsumedXids;        /* number of local XIDs assigned */
+	DtmLeaseStats leaseStats;
 } DtmState;
 
 typedef struct
@@ -90,6 +117,7 @@ static bool TransactionIdIsInDoubt(TransactionId xid);
 
 static void DtmShmemStartup(void);
 static void DtmBackgroundWorker(Datum arg);
+static void DtmXidLeaser(Datum arg);
 
 static void ByteBufferAlloc(ByteBuffer* buf);
 static void ByteBufferAppend(ByteBuffer* buf, void* data, int len);
@@ -107,23 +135,24 @@ static SnapshotData DtmSnapshot = { HeapTupleSatisfiesMVCC };
 static bool DtmHasGlobalSnapshot;
 static bool DtmGlobalXidAssigned;
 static int DtmLocalXidReserve;
+static int DtmXidLeaseHorizon;
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
-	DtmGetTransactionStatus,
-	DtmSetTransactionStatus,
-	DtmGetSnapshot,
-	DtmGetNewTransactionId,
-	DtmGetOldestXmin,
-	PgTransactionIdIsInProgress,
-	DtmGetGlobalTransactionId,
-	PgXidInMVCCSnapshot,
-    DtmDetectGlobalDeadLock,
-	DtmGetName,
-	PgGetTransactionStateSize,
-	PgSerializeTransactionState,
-	PgDeserializeTransactionState,
-	PgInitializeSequence
+	.GetTransactionStatus = DtmGetTransactionStatus,
+	.SetTransactionStatus = DtmSetTransactionStatus,
+	.GetSnapshot = DtmGetSnapshot,
+	.GetNewTransactionId = DtmGetNewTransactionId,
+	.GetOldestXmin = DtmGetOldestXmin,
+	.IsInProgress = PgTransactionIdIsInProgress,
+	.GetGlobalTransactionId = DtmGetGlobalTransactionId,
+	.IsInSnapshot = PgXidInMVCCSnapshot,
+	.DetectGlobalDeadLock = DtmDetectGlobalDeadLock,
+	.GetName = DtmGetName,
+	.GetTransactionStateSize = PgGetTransactionStateSize,
+	.SerializeTransactionState = PgSerializeTransactionState,
+	.DeserializeTransactionState = PgDeserializeTransactionState,
+	.InitializeSequence = PgInitializeSequence
 };
 
 static char *Arbiters;
@@ -138,6 +167,16 @@ static BackgroundWorker DtmWorker = {
 	DtmBackgroundWorker
 };
 
+static BackgroundWorker DtmLeaserWorker = {
+	"DtmXidLeaser",
+	BGWORKER_SHMEM_ACCESS,
+	BgWorkerStart_RecoveryFinished,
+	1,
+	DtmXidLeaser
+};
+
+static volatile sig_atomic_t DtmLeaserTerminate;
+
 #define XTM_TRACE(fmt, ...)
 //#define XTM_INFO(fmt, ...) fprintf(stderr, fmt, ## __VA_ARGS__)
 #define XTM_INFO(fmt, ...)
@@ -238,6 +277,8 @@ GetLocalSnapshot:
 		// Global snapshot is invalid
 		return;
 	}
+	/* Merged snapshot can not be reused by PgGetSnapshotData */
+	dst->snapXactCompletionCount = 0;
 
 	for (i = 0; i < dst->xcnt; i++)
 		if (TransactionIdIsInDoubt(dst->xip[i]))
@@ -363,11 +404,30 @@ static TransactionId DtmGetNextXid()
 	{
 		if (dtm->nReservedXids == 0)
 		{
-			dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, DtmLocalXidReserve, &dtm->nextXid);
-			if (dtm->nReservedXids < 1)
+			if (dtm->nPrefetchedXids != 0 && TransactionIdFollowsOrEquals(dtm->prefetchedXid, ShmemVariableCache->nextXid))
 			{
-				elog(WARNING, "failed to reserve a local range of xids on arbiter");
-				goto end;
+				/* Switch to the range reserved in advance by XID leaser */
+				dtm->nextXid = dtm->prefetchedXid;
+				dtm->nReservedXids = dtm->nPrefetchedXids;
+				dtm->nPrefetchedXids = 0;
+			}
+			else
+			{
+				/* XID leaser didn't manage to reserve next range in time (or it was overtaken by global XIDs) */
+				TimestampTz start = GetCurrentTimestamp();
+				long secs;
+				int usecs;
+
+				dtm->nPrefetchedXids = 0;
+				dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, DtmLocalXidReserve, &dtm->nextXid);
+				TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+				dtm->leaseStats.nStalls += 1;
+				dtm->leaseStats.stallTime += secs*USECS_PER_SEC + usecs;
+				if (dtm->nReservedXids < 1)
+				{
+					elog(WARNING, "failed to reserve a local range of xids on arbiter");
+					goto end;
+				}
 			}
 
 			Assert(TransactionIdFollowsOrEquals(dtm->nextXid, ShmemVariableCache->nextXid));
@@ -385,8 +445,14 @@ static TransactionId DtmGetNextXid()
 		Assert(ShmemVariableCache->nextXid == dtm->nextXid);
 		xid = dtm->nextXid++;
 		dtm->nReservedXids -= 1;
+		dtm->nConsumedXids += 1;
 		XTM_INFO("Obtain new local XID %d\n", xid);
 	}
+	if (dtm->nPrefetchedXids == 0 && dtm->nReservedXids <= dtm->lowWatermark && dtm->leaserLatch != NULL)
+	{
+		/* Ask XID leaser to reserve next range before this one is exhausted */
+		SetLatch(dtm->leaserLatch);
+	}
 end:
 	LWLockRelease(dtm->xidLock);
 	return xid;
@@ -736,6 +802,11 @@ static void DtmInitialize()
 		dtm->xidLock = LWLockAssign();
 		dtm->nReservedXids = 0;
 		dtm->minXid = InvalidTransactionId;
+		dtm->nPrefetchedXids = 0;
+		dtm->lowWatermark = DtmLocalXidReserve / 2;
+		dtm->leaserLatch = NULL;
+		dtm->nConsumedXids = 0;
+		memset(&dtm->leaseStats, 0, sizeof(dtm->leaseStats));
 		RegisterXactCallback(DtmXactCallback, NULL);
 		RegisterSubXactCallback(DtmSubXactCallback, NULL);
 	}
@@ -849,6 +920,21 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"dtm.xid_lease_horizon",
+		"Time (msec) for which range of local XIDs reserved in advance should be enough at current XID consumption rate",
+		"Size of the range is not less than dtm.local_xid_reserve. Next range is reserved when half of the current one is used.",
+		&DtmXidLeaseHorizon,
+		1000,
+		0,
+		INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"dtm.buffer_size",
 		"Size of sockhub buffer for connection to arbiters, if 0, then direct connection will be used",
@@ -885,6 +971,7 @@ _PG_init(void)
 	}
 	else
 		ArbiterConfig(Arbiters, NULL);
+	RegisterBackgroundWorker(&DtmLeaserWorker);
 
 	/*
 	 * Install hooks.
@@ -921,6 +1008,7 @@ PG_FUNCTION_INFO_V1(dtm_join_transaction);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmax);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmin);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xcnt);
+PG_FUNCTION_INFO_V1(dtm_get_xid_lease_stats);
 
 Datum
 dtm_get_current_snapshot_xmin(PG_FUNCTION_ARGS)
@@ -940,6 +1028,37 @@ dtm_get_current_snapshot_xcnt(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(CurrentTransactionSnapshot->xcnt);
 }
 
+Datum
+dtm_get_xid_lease_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum values[8];
+	bool nulls[8] = {false};
+	DtmLeaseStats stats;
+	size_t nReserved, nPrefetched;
+
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
+	get_call_result_type(fcinfo, NULL, &desc);
+
+	LWLockAcquire(dtm->xidLock, LW_SHARED);
+	stats = dtm->leaseStats;
+	nReserved = dtm->nReservedXids;
+	nPrefetched = dtm->nPrefetchedXids;
+	LWLockRelease(dtm->xidLock);
+
+	values[0] = Int64GetDatum(stats.nLeases);
+	values[1] = Int64GetDatum(stats.nStalls);
+	values[2] = Int64GetDatum(stats.stallTime);
+	values[3] = Int64GetDatum(stats.nLeases ? stats.totalLeaseTime/stats.nLeases : 0);
+	values[4] = Int64GetDatum(stats.maxLeaseTime);
+	values[5] = Int64GetDatum(stats.lastLeaseSize);
+	values[6] = Int64GetDatum(nReserved + nPrefetched);
+	values[7] = Float8GetDatum(stats.xidRate);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(desc, values, nulls)));
+}
+
 Datum
 dtm_begin_transaction(PG_FUNCTION_ARGS)
 {
@@ -977,6 +1096,104 @@ Datum dtm_join_transaction(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
+static void DtmLeaserSigterm(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+	DtmLeaserTerminate = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void DtmLeaserDetach(int code, Datum arg)
+{
+	LWLockAcquire(dtm->xidLock, LW_EXCLUSIVE);
+	dtm->leaserLatch = NULL;
+	LWLockRelease(dtm->xidLock);
+}
+
+/*
+ * XID leaser reserves next range of local XIDs on arbiter while the current range is not yet exhausted,
+ * so backends do not have to wait for arbiter in GetNewTransactionId.
+ * Size of the range is chosen to last for dtm.xid_lease_horizon at the observed XID consumption rate.
+ */
+static void DtmXidLeaser(Datum arg)
+{
+	TimestampTz lastRateCheck;
+	uint64 lastConsumed;
+
+	pqsignal(SIGTERM, DtmLeaserSigterm);
+	BackgroundWorkerUnblockSignals();
+
+	LWLockAcquire(dtm->xidLock, LW_EXCLUSIVE);
+	dtm->leaserLatch = MyLatch;
+	lastConsumed = dtm->nConsumedXids;
+	LWLockRelease(dtm->xidLock);
+	before_shmem_exit(DtmLeaserDetach, 0);
+	lastRateCheck = GetCurrentTimestamp();
+
+	while (!DtmLeaserTerminate)
+	{
+		TimestampTz now = GetCurrentTimestamp();
+		TransactionId from = InvalidTransactionId;
+		TransactionId first;
+		size_t size = 0;
+		long secs;
+		int usecs;
+		int rc;
+
+		ResetLatch(MyLatch);
+
+		LWLockAcquire(dtm->xidLock, LW_EXCLUSIVE);
+		TimestampDifference(lastRateCheck, now, &secs, &usecs);
+		if (secs*1000 + usecs/1000 >= DTM_LEASER_INTERVAL_MS)
+		{
+			double rate = (double)(dtm->nConsumedXids - lastConsumed)*USECS_PER_SEC/(secs*USECS_PER_SEC + usecs);
+			DtmLeaseStats* stats = &dtm->leaseStats;
+			stats->xidRate = stats->xidRate == 0 ? rate : stats->xidRate*0.75 + rate*0.25;
+			lastConsumed = dtm->nConsumedXids;
+			lastRateCheck = now;
+		}
+		size = (size_t)(dtm->leaseStats.xidRate*DtmXidLeaseHorizon/1000);
+		size = Min(Max(size, (size_t)DtmLocalXidReserve), DTM_MAX_XID_LEASE);
+		dtm->lowWatermark = size/2;
+		if (dtm->nPrefetchedXids == 0 && dtm->nReservedXids <= dtm->lowWatermark)
+		{
+			from = dtm->nReservedXids != 0 ? dtm->nextXid + dtm->nReservedXids : ShmemVariableCache->nextXid;
+		}
+		LWLockRelease(dtm->xidLock);
+
+		if (TransactionIdIsValid(from))
+		{
+			TimestampTz start = GetCurrentTimestamp();
+			int n = ArbiterReserve(from, size, &first);
+			uint64 elapsed;
+
+			TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+			elapsed = secs*USECS_PER_SEC + usecs;
+			if (n > 0)
+			{
+				LWLockAcquire(dtm->xidLock, LW_EXCLUSIVE);
+				dtm->leaseStats.nLeases += 1;
+				dtm->leaseStats.totalLeaseTime += elapsed;
+				dtm->leaseStats.maxLeaseTime = Max(dtm->leaseStats.maxLeaseTime, elapsed);
+				dtm->leaseStats.lastLeaseSize = n;
+				if (dtm->nPrefetchedXids == 0)
+				{
+					dtm->prefetchedXid = first;
+					dtm->nPrefetchedXids = n;
+				}
+				LWLockRelease(dtm->xidLock);
+				continue;
+			}
+			elog(WARNING, "XID leaser failed to reserve a local range of xids on arbiter");
+		}
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, DTM_LEASER_INTERVAL_MS);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
+	proc_exit(0);
+}
+
 void DtmBackgroundWorker(Datum arg)
 {
 	Shub shub;
@@ -0,0 +1,1105 @@
+/*-------------------------------------------------------------------------
+ *
+ * autoprewarm.c
+ *		Periodically dump information about the blocks present in
+ *		shared_buffers, and reload them on server restart.
+ *
+ *		Due to locking considerations, we can't actually begin prewarming
+ *		until the server reaches a consistent state.  We need the catalogs
+ *		to be consistent so that we can figure out which relation to lock,
+ *		and we need to lock the relations so that we don't try to prewarm
+ *		pages from a relation that is in the process of being dropped.
+ *
+ *		While prewarming, autoprewarm will use background workers to
+ *		prewarm each database, up to pg_prewarm.autoprewarm_workers of them
+ *		at a time.  A database with many blocks to load is split into
+ *		several ranges so that they can be loaded in parallel, and each
+ *		worker can be made to pause now and then so that it doesn't starve
+ *		foreground I/O.  Blocks are loaded in (tablespace, relfilenode,
+ *		fork, block) order, which keeps the reads as sequential as the
+ *		storage allows.
+ *
+ *		The autoprewarm master worker stays around afterwards to dump the
+ *		list of blocks in shared_buffers every pg_prewarm.autoprewarm_interval
+ *		seconds and at shutdown.
+ *
+ *	Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ *	IDENTIFICATION
+ *		contrib/pg_prewarm/autoprewarm.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "postmaster/bgworker.h"
+#include "storage/buf_internals.h"
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/rel.h"
+#include "utils/relfilenodemap.h"
+#include "utils/resowner.h"
+
+#define AUTOPREWARM_FILE "autoprewarm.blocks"
+
+/* Upper limit for pg_prewarm.autoprewarm_workers */
+#define AUTOPREWARM_MAX_WORKERS		16
+
+/* Don't split a database into ranges of fewer blocks than this (64MB) */
+#define AUTOPREWARM_MIN_RANGE_BLOCKS	8192
+
+/* Number of blocks read between pauses when throttling (1MB) */
+#define AUTOPREWARM_THROTTLE_BLOCKS		128
+
+/* Metadata for each block we dump. */
+typedef struct BlockInfoRecord
+{
+	Oid			database;
+	Oid			tablespace;
+	Oid			filenode;
+	ForkNumber	forknum;
+	BlockNumber blocknum;
+} BlockInfoRecord;
+
+/* A range of BlockInfoRecords for one database, loaded by one worker. */
+typedef struct AutoPrewarmTask
+{
+	Oid			database;		/* database to connect to */
+	int			start_idx;		/* first BlockInfoRecord to load */
+	int			stop_idx;		/* one past the last one */
+	int			prewarmed_blocks;	/* set by the worker */
+} AutoPrewarmTask;
+
+/* Shared state information for autoprewarm bgworker. */
+typedef struct AutoPrewarmSharedState
+{
+	LWLock		lock;			/* mutual exclusion */
+	int			tranche_id;		/* tranche of lock */
+	pid_t		bgworker_pid;	/* for main bgworker */
+	pid_t		pid_using_dumpfile;		/* for autoprewarm or block dump */
+
+	/* Following items are for communication with per-database workers */
+	dsm_handle	block_info_handle;
+	AutoPrewarmTask tasks[AUTOPREWARM_MAX_WORKERS];	/* indexed by slot */
+} AutoPrewarmSharedState;
+
+void		_PG_init(void);
+void		autoprewarm_main(Datum main_arg);
+void		autoprewarm_database_main(Datum main_arg);
+
+PG_FUNCTION_INFO_V1(autoprewarm_start_worker);
+PG_FUNCTION_INFO_V1(autoprewarm_dump_now);
+
+static void apw_load_buffers(void);
+static int	apw_dump_now(bool is_bgworker, bool dump_unlogged);
+static void apw_start_master_worker(void);
+static BackgroundWorkerHandle *apw_start_database_worker(int slot);
+static int	apw_add_tasks(AutoPrewarmTask **tasks, int ntasks, int *maxtasks,
+			  Oid database, int start_idx, int stop_idx);
+static bool apw_init_shmem(void);
+static void apw_detach_shmem(int code, Datum arg);
+static int	apw_compare_blockinfo(const void *p, const void *q);
+static void apw_sigterm_handler(SIGNAL_ARGS);
+static void apw_sighup_handler(SIGNAL_ARGS);
+static void apw_sigusr1_handler(SIGNAL_ARGS);
+
+/* Flags set by signal handlers */
+static volatile sig_atomic_t got_sigterm = false;
+static volatile sig_atomic_t got_sighup = false;
+
+/* Pointer to shared-memory state. */
+static AutoPrewarmSharedState *apw_state = NULL;
+static LWLockTranche apw_tranche;
+
+/* GUC variables. */
+static bool autoprewarm = true; /* start worker? */
+static int	autoprewarm_interval;	/* dump interval */
+static int	autoprewarm_workers;	/* concurrent loading workers */
+static int	autoprewarm_delay;	/* pause per AUTOPREWARM_THROTTLE_BLOCKS */
+
+/*
+ * Module load callback.
+ */
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_interval",
+							"Sets the interval between dumps of shared buffers",
+							"If set to zero, time-based dumping is disabled.",
+							&autoprewarm_interval,
+							300,
+							0, INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_workers",
+							"Sets the number of workers loading blocks at the same time.",
+							NULL,
+							&autoprewarm_workers,
+							1,
+							1, AUTOPREWARM_MAX_WORKERS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_delay",
+							"Sets the pause taken by a loading worker after each megabyte read.",
+							"If set to zero, blocks are loaded as fast as possible.",
+							&autoprewarm_delay,
+							0,
+							0, 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	/* can't define PGC_POSTMASTER variable after startup */
+	DefineCustomBoolVariable("pg_prewarm.autoprewarm",
+							 "Starts the autoprewarm worker.",
+							 NULL,
+							 &autoprewarm,
+							 true,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	EmitWarningsOnPlaceholders("pg_prewarm");
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(AutoPrewarmSharedState)));
+
+	/* Register autoprewarm worker, if enabled. */
+	if (autoprewarm)
+		apw_start_master_worker();
+}
+
+/*
+ * Main entry point for the master autoprewarm process.  Per-database workers
+ * have a separate entry point.
+ */
+void
+autoprewarm_main(Datum main_arg)
+{
+	bool		first_time = true;
+	TimestampTz last_dump_time;
+
+	/* Establish signal handlers; once that's done, unblock signals. */
+	pqsignal(SIGTERM, apw_sigterm_handler);
+	pqsignal(SIGHUP, apw_sighup_handler);
+	pqsignal(SIGUSR1, apw_sigusr1_handler);
+	BackgroundWorkerUnblockSignals();
+
+	/* dsm_create() needs a resource owner */
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "autoprewarm");
+
+	/* Create (if necessary) and attach to our shared memory area. */
+	if (apw_init_shmem())
+		first_time = false;
+
+	/* Set on-detach hook so that our PID will be cleared on exit. */
+	on_shmem_exit(apw_detach_shmem, 0);
+
+	/*
+	 * Store our PID in the shared memory area --- unless there's already
+	 * another worker running, in which case just exit.
+	 */
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->bgworker_pid != InvalidPid)
+	{
+		LWLockRelease(&apw_state->lock);
+		ereport(LOG,
+				(errmsg("autoprewarm worker is already running under PID %d",
+						(int) apw_state->bgworker_pid)));
+		return;
+	}
+	apw_state->bgworker_pid = MyProcPid;
+	LWLockRelease(&apw_state->lock);
+
+	/*
+	 * Preload buffers from the dump file only if we just started, not if the
+	 * worker was started again by autoprewarm_start_worker().
+	 */
+	if (first_time)
+		apw_load_buffers();
+
+	/*
+	 * Don't dump right away: if loading was skipped or cut short, the dump
+	 * file we started from is a better picture of the working set than what
+	 * is in shared_buffers now.
+	 */
+	last_dump_time = GetCurrentTimestamp();
+
+	/* Periodically dump buffers until terminated. */
+	while (!got_sigterm)
+	{
+		int			rc;
+
+		/* In case of a SIGHUP, just reload the configuration. */
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if (autoprewarm_interval <= 0)
+		{
+			/* We're only dumping at shutdown, so just wait forever. */
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_POSTMASTER_DEATH,
+						   -1L);
+		}
+		else
+		{
+			TimestampTz next_dump_time;
+			long		secs;
+			int			usecs;
+
+			/* Compute the next dump time. */
+			next_dump_time =
+				TimestampTzPlusMilliseconds(last_dump_time,
+											autoprewarm_interval * 1000);
+			TimestampDifference(GetCurrentTimestamp(), next_dump_time,
+								&secs, &usecs);
+
+			/* Perform a dump if it's time. */
+			if (secs <= 0 && usecs <= 0)
+			{
+				last_dump_time = GetCurrentTimestamp();
+				apw_dump_now(true, false);
+				continue;
+			}
+
+			/* Sleep until the next dump time. */
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   secs * 1000L + usecs / 1000);
+		}
+
+		/* Reset the latch, bail out if postmaster died, otherwise loop. */
+		ResetLatch(MyLatch);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
+
+	/*
+	 * Dump one last time.  We assume this is probably the result of an
+	 * instance shutdown.
+	 */
+	apw_dump_now(true, true);
+}
+
+/*
+ * Read the dump file and launch per-database workers to load the blocks
+ * listed in it.
+ *
+ * The block list is sorted and copied into a dynamic shared memory segment,
+ * then carved into tasks: one range of blocks per database, split further
+ * so that up to pg_prewarm.autoprewarm_workers workers can share a large
+ * database.  Workers are launched as task slots free up, until every task
+ * has run or shared_buffers has no free buffers left.
+ */
+static void
+apw_load_buffers(void)
+{
+	FILE	   *file = NULL;
+	int			num_elements,
+				i;
+	BlockInfoRecord *blkinfo;
+	dsm_segment *seg;
+	AutoPrewarmTask *tasks;
+	int			ntasks = 0;
+	int			maxtasks = 16;
+	int			next_task = 0;
+	int			nrunning = 0;
+	int			start_idx;
+	int64		prewarmed_blocks = 0;
+	BackgroundWorkerHandle *handles[AUTOPREWARM_MAX_WORKERS];
+
+	/*
+	 * Skip the prewarm if the dump file is in use; otherwise, prevent any
+	 * other process from writing it while we're using it.
+	 */
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->pid_using_dumpfile == InvalidPid)
+		apw_state->pid_using_dumpfile = MyProcPid;
+	else
+	{
+		LWLockRelease(&apw_state->lock);
+		ereport(LOG,
+				(errmsg("skipping prewarm because block dump file is being written by PID %d",
+						(int) apw_state->pid_using_dumpfile)));
+		return;
+	}
+	LWLockRelease(&apw_state->lock);
+
+	/*
+	 * Open the block dump file.  Exit quietly if it doesn't exist, but report
+	 * any other error.
+	 */
+	file = AllocateFile(AUTOPREWARM_FILE, "r");
+	if (!file)
+	{
+		if (errno == ENOENT)
+		{
+			LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+			apw_state->pid_using_dumpfile = InvalidPid;
+			LWLockRelease(&apw_state->lock);
+			return;				/* No file to load. */
+		}
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m",
+						AUTOPREWARM_FILE)));
+	}
+
+	/* First line of the file is a record count. */
+	if (fscanf(file, "<<%d>>\n", &num_elements) != 1 || num_elements < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from file \"%s\": %m",
+						AUTOPREWARM_FILE)));
+
+	if (num_elements == 0)
+	{
+		FreeFile(file);
+		LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+		apw_state->pid_using_dumpfile = InvalidPid;
+		LWLockRelease(&apw_state->lock);
+		return;
+	}
+
+	/* Allocate a dynamic shared memory segment to store the record data. */
+	seg = dsm_create(sizeof(BlockInfoRecord) * num_elements, 0);
+	blkinfo = (BlockInfoRecord *) dsm_segment_address(seg);
+
+	/* Read records, one per line. */
+	for (i = 0; i < num_elements; i++)
+	{
+		unsigned	forknum;
+
+		if (fscanf(file, "%u,%u,%u,%u,%u\n", &blkinfo[i].database,
+				   &blkinfo[i].tablespace, &blkinfo[i].filenode,
+				   &forknum, &blkinfo[i].blocknum) != 5)
+			ereport(ERROR,
+					(errmsg("autoprewarm block dump file is corrupted at line %d",
+							i + 1)));
+		blkinfo[i].forknum = forknum;
+	}
+
+	FreeFile(file);
+
+	/* Sort the blocks to be loaded. */
+	qsort(blkinfo, num_elements, sizeof(BlockInfoRecord),
+		  apw_compare_blockinfo);
+
+	/*
+	 * Carve the block list into tasks.  Blocks of shared relations sort
+	 * first, with database InvalidOid; they're loaded along with the first
+	 * real database, since any database can open them.
+	 */
+	tasks = (AutoPrewarmTask *) palloc(maxtasks * sizeof(AutoPrewarmTask));
+	start_idx = 0;
+	for (i = 0; i < num_elements; i++)
+	{
+		if (blkinfo[i].database == InvalidOid)
+			continue;
+		if (i + 1 < num_elements &&
+			blkinfo[i + 1].database == blkinfo[i].database)
+			continue;
+
+		ntasks = apw_add_tasks(&tasks, ntasks, &maxtasks,
+							   blkinfo[i].database, start_idx, i + 1);
+		start_idx = i + 1;
+	}
+
+	apw_state->block_info_handle = dsm_segment_handle(seg);
+	memset(handles, 0, sizeof(handles));
+
+	/* Run the tasks, at most autoprewarm_workers at a time. */
+	while (next_task < ntasks || nrunning > 0)
+	{
+		int			slot;
+		int			rc;
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		/*
+		 * Stop handing out tasks if we're asked to quit, or if there's no
+		 * room left in shared_buffers, perhaps because it has been made
+		 * smaller since the dump.
+		 */
+		if (got_sigterm || !have_free_buffer())
+		{
+			next_task = ntasks;
+			for (slot = 0; slot < AUTOPREWARM_MAX_WORKERS; slot++)
+			{
+				if (handles[slot] != NULL && got_sigterm)
+					TerminateBackgroundWorker(handles[slot]);
+			}
+		}
+
+		for (slot = 0; slot < autoprewarm_workers && next_task < ntasks;
+			 slot++)
+		{
+			if (handles[slot] != NULL)
+				continue;
+
+			apw_state->tasks[slot] = tasks[next_task];
+			handles[slot] = apw_start_database_worker(slot);
+			if (handles[slot] == NULL)
+			{
+				/* Out of worker slots; try again once one of ours exits */
+				if (nrunning == 0)
+				{
+					ereport(LOG,
+							(errmsg("could not start autoprewarm worker"),
+							 errhint("You may need to increase max_worker_processes.")));
+					next_task = ntasks;
+				}
+				break;
+			}
+			next_task++;
+			nrunning++;
+		}
+
+		if (nrunning == 0)
+			break;
+
+		/* Wait for a worker to start or exit; the postmaster tells us. */
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   1000L);
+		ResetLatch(MyLatch);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		for (slot = 0; slot < AUTOPREWARM_MAX_WORKERS; slot++)
+		{
+			pid_t		pid;
+
+			if (handles[slot] == NULL ||
+				GetBackgroundWorkerPid(handles[slot], &pid) != BGWH_STOPPED)
+				continue;
+
+			prewarmed_blocks += apw_state->tasks[slot].prewarmed_blocks;
+			pfree(handles[slot]);
+			handles[slot] = NULL;
+			nrunning--;
+		}
+	}
+
+	/* Clean up. */
+	dsm_detach(seg);
+	pfree(tasks);
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	apw_state->pid_using_dumpfile = InvalidPid;
+	LWLockRelease(&apw_state->lock);
+
+	/* Report our success, if we were able to finish. */
+	if (!got_sigterm)
+		ereport(LOG,
+				(errmsg("autoprewarm successfully prewarmed " INT64_FORMAT
+						" of %d previously-loaded blocks",
+						prewarmed_blocks, num_elements)));
+}
+
+/*
+ * Append tasks covering blocks start_idx up to stop_idx of one database,
+ * split into up to autoprewarm_workers ranges of similar size.  Returns the
+ * new number of tasks.
+ */
+static int
+apw_add_tasks(AutoPrewarmTask **tasks, int ntasks, int *maxtasks,
+			  Oid database, int start_idx, int stop_idx)
+{
+	int			nblocks = stop_idx - start_idx;
+	int			nranges;
+	int			i;
+
+	nranges = Min(autoprewarm_workers,
+				  Max(nblocks / AUTOPREWARM_MIN_RANGE_BLOCKS, 1));
+
+	if (ntasks + nranges > *maxtasks)
+	{
+		*maxtasks = Max(*maxtasks * 2, ntasks + nranges);
+		*tasks = (AutoPrewarmTask *)
+			repalloc(*tasks, *maxtasks * sizeof(AutoPrewarmTask));
+	}
+
+	for (i = 0; i < nranges; i++)
+	{
+		AutoPrewarmTask *task = &(*tasks)[ntasks++];
+
+		task->database = database;
+		task->start_idx = start_idx + (int) ((int64) nblocks * i / nranges);
+		task->stop_idx = start_idx + (int) ((int64) nblocks * (i + 1) / nranges);
+		task->prewarmed_blocks = 0;
+	}
+
+	return ntasks;
+}
+
+/*
+ * Prewarm one range of blocks of one database.
+ */
+void
+autoprewarm_database_main(Datum main_arg)
+{
+	int			slot = DatumGetInt32(main_arg);
+	AutoPrewarmTask *task;
+	dsm_segment *seg;
+	BlockInfoRecord *block_info;
+	BlockInfoRecord *old_blk = NULL;
+	Relation	rel = NULL;
+	BlockNumber nblocks = 0;
+	int			prewarmed_blocks = 0;
+	int			since_pause = 0;
+	int			i;
+
+	/* Establish signal handlers; once that's done, unblock signals. */
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Connect to correct database and get block information. */
+	apw_init_shmem();
+	task = &apw_state->tasks[slot];
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "autoprewarm");
+	seg = dsm_attach(apw_state->block_info_handle);
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	BackgroundWorkerInitializeConnectionByOid(task->database, InvalidOid);
+	block_info = (BlockInfoRecord *) dsm_segment_address(seg);
+
+	/*
+	 * Loop until we run out of blocks to prewarm or until we run out of free
+	 * buffers.
+	 */
+	for (i = task->start_idx; i < task->stop_idx && have_free_buffer(); i++)
+	{
+		BlockInfoRecord *blk = &block_info[i];
+		Buffer		buf;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * As soon as we encounter a block of a new relation, close the old
+		 * relation.  Note that rel will be NULL if try_relation_open failed
+		 * previously; in that case, there is nothing to close.
+		 */
+		if (old_blk != NULL &&
+			(old_blk->tablespace != blk->tablespace ||
+			 old_blk->filenode != blk->filenode) &&
+			rel != NULL)
+		{
+			relation_close(rel, AccessShareLock);
+			rel = NULL;
+			CommitTransactionCommand();
+		}
+
+		/*
+		 * Try to open each new relation, but only once, when we first
+		 * encounter it.  If it's been dropped, skip the associated blocks.
+		 */
+		if (old_blk == NULL ||
+			old_blk->tablespace != blk->tablespace ||
+			old_blk->filenode != blk->filenode)
+		{
+			Oid			reloid;
+
+			Assert(rel == NULL);
+			StartTransactionCommand();
+			reloid = RelidByRelfilenode(blk->tablespace, blk->filenode);
+			if (OidIsValid(reloid))
+				rel = try_relation_open(reloid, AccessShareLock);
+
+			if (!rel)
+				CommitTransactionCommand();
+		}
+		if (!rel)
+		{
+			old_blk = blk;
+			continue;
+		}
+
+		/* Once per fork, check for fork existence and size. */
+		if (old_blk == NULL ||
+			old_blk->tablespace != blk->tablespace ||
+			old_blk->filenode != blk->filenode ||
+			old_blk->forknum != blk->forknum)
+		{
+			RelationOpenSmgr(rel);
+
+			/*
+			 * smgrexists is not safe for illegal forknum, hence check whether
+			 * the passed forknum is valid before using it in smgrexists.
+			 */
+			if (blk->forknum > InvalidForkNumber &&
+				blk->forknum <= MAX_FORKNUM &&
+				smgrexists(rel->rd_smgr, blk->forknum))
+				nblocks = RelationGetNumberOfBlocksInFork(rel, blk->forknum);
+			else
+				nblocks = 0;
+		}
+
+		/* Check whether blocknum is valid and within fork file size. */
+		if (blk->blocknum >= nblocks)
+		{
+			/* Move to next forknum. */
+			old_blk = blk;
+			continue;
+		}
+
+		/* Prewarm buffer. */
+		buf = ReadBufferExtended(rel, blk->forknum, blk->blocknum, RBM_NORMAL,
+								 NULL);
+		if (BufferIsValid(buf))
+		{
+			prewarmed_blocks++;
+			ReleaseBuffer(buf);
+		}
+
+		old_blk = blk;
+
+		/* Leave some I/O bandwidth to everyone else, if so configured. */
+		if (autoprewarm_delay > 0 &&
+			++since_pause >= AUTOPREWARM_THROTTLE_BLOCKS)
+		{
+			int			rc;
+
+			since_pause = 0;
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   autoprewarm_delay);
+			ResetLatch(MyLatch);
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+		}
+	}
+
+	dsm_detach(seg);
+
+	/* Release lock on previous relation. */
+	if (rel)
+	{
+		relation_close(rel, AccessShareLock);
+		CommitTransactionCommand();
+	}
+
+	task->prewarmed_blocks = prewarmed_blocks;
+}
+
+/*
+ * Dump information on blocks in shared buffers.  We use a text format here
+ * so that it's easy to understand and even change the file contents if
+ * necessary.
+ * Returns the number of blocks dumped.
+ */
+static int
+apw_dump_now(bool is_bgworker, bool dump_unlogged)
+{
+	int			num_blocks;
+	int			i;
+	int			ret;
+	BlockInfoRecord *block_info_array;
+	BufferDesc *bufHdr;
+	FILE	   *file;
+	char		transient_dump_file_path[MAXPGPATH];
+	pid_t		pid;
+
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	pid = apw_state->pid_using_dumpfile;
+	if (apw_state->pid_using_dumpfile == InvalidPid)
+		apw_state->pid_using_dumpfile = MyProcPid;
+	LWLockRelease(&apw_state->lock);
+
+	if (pid != InvalidPid)
+	{
+		if (!is_bgworker)
+			ereport(ERROR,
+					(errmsg("could not perform block dump because dump file is being used by PID %d",
+							(int) apw_state->pid_using_dumpfile)));
+
+		ereport(LOG,
+				(errmsg("skipping block dump because it is already being performed by PID %d",
+						(int) apw_state->pid_using_dumpfile)));
+		return 0;
+	}
+
+	/* 20 bytes per buffer can exceed MaxAllocSize for huge shared_buffers */
+	block_info_array = (BlockInfoRecord *)
+		MemoryContextAllocHuge(CurrentMemoryContext,
+							   sizeof(BlockInfoRecord) * NBuffers);
+
+	for (num_blocks = 0, i = 0; i < NBuffers; i++)
+	{
+		uint32		buf_state;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Lock each buffer header before inspecting. */
+		buf_state = LockBufHdr(bufHdr);
+
+		/*
+		 * Unlogged tables will be automatically truncated after a crash or
+		 * unclean shutdown. In such cases we need not prewarm them. Dump them
+		 * only if requested by caller.
+		 */
+		if (buf_state & BM_TAG_VALID &&
+			((buf_state & BM_PERMANENT) || dump_unlogged))
+		{
+			block_info_array[num_blocks].database = bufHdr->tag.rnode.dbNode;
+			block_info_array[num_blocks].tablespace = bufHdr->tag.rnode.spcNode;
+			block_info_array[num_blocks].filenode = bufHdr->tag.rnode.relNode;
+			block_info_array[num_blocks].forknum = bufHdr->tag.forkNum;
+			block_info_array[num_blocks].blocknum = bufHdr->tag.blockNum;
+			++num_blocks;
+		}
+
+		UnlockBufHdr(bufHdr, buf_state);
+	}
+
+	snprintf(transient_dump_file_path, MAXPGPATH, "%s.tmp", AUTOPREWARM_FILE);
+	file = AllocateFile(transient_dump_file_path, "w");
+	if (!file)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m",
+						transient_dump_file_path)));
+
+	ret = fprintf(file, "<<%d>>\n", num_blocks);
+	if (ret < 0)
+	{
+		int			save_errno = errno;
+
+		FreeFile(file);
+		unlink(transient_dump_file_path);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m",
+						transient_dump_file_path)));
+	}
+
+	for (i = 0; i < num_blocks; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ret = fprintf(file, "%u,%u,%u,%u,%u\n",
+					  block_info_array[i].database,
+					  block_info_array[i].tablespace,
+					  block_info_array[i].filenode,
+					  (uint32) block_info_array[i].forknum,
+					  block_info_array[i].blocknum);
+		if (ret < 0)
+		{
+			int			save_errno = errno;
+
+			FreeFile(file);
+			unlink(transient_dump_file_path);
+			errno = save_errno;
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to file \"%s\": %m",
+							transient_dump_file_path)));
+		}
+	}
+
+	pfree(block_info_array);
+
+	/*
+	 * Rename transient_dump_file_path to AUTOPREWARM_FILE to make things
+	 * permanent.
+	 */
+	ret = FreeFile(file);
+	if (ret != 0)
+	{
+		int			save_errno = errno;
+
+		unlink(transient_dump_file_path);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not close file \"%s\": %m",
+						transient_dump_file_path)));
+	}
+
+	(void) durable_rename(transient_dump_file_path, AUTOPREWARM_FILE, ERROR);
+	apw_state->pid_using_dumpfile = InvalidPid;
+
+	ereport(DEBUG1,
+			(errmsg("wrote block details for %d blocks", num_blocks)));
+	return num_blocks;
+}
+
+/*
+ * SQL-callable function to launch autoprewarm.
+ */
+Datum
+autoprewarm_start_worker(PG_FUNCTION_ARGS)
+{
+	pid_t		pid;
+
+	if (!autoprewarm)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("autoprewarm is disabled")));
+
+	apw_init_shmem();
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	pid = apw_state->bgworker_pid;
+	LWLockRelease(&apw_state->lock);
+
+	if (pid != InvalidPid)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("autoprewarm worker is already running under PID %d",
+						(int) pid)));
+
+	apw_start_master_worker();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SQL-callable function to perform an immediate block dump.
+ *
+ * Note: this is declared to return int8, as insurance against some
+ * very distant day when we might make NBuffers wider than int.
+ */
+Datum
+autoprewarm_dump_now(PG_FUNCTION_ARGS)
+{
+	int			num_blocks;
+
+	apw_init_shmem();
+
+	PG_ENSURE_ERROR_CLEANUP(apw_detach_shmem, 0);
+	{
+		num_blocks = apw_dump_now(false, true);
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(apw_detach_shmem, 0);
+
+	PG_RETURN_INT64((int64) num_blocks);
+}
+
+/*
+ * Allocate and initialize autoprewarm related shared memory, if not already
+ * done, and set up backend-local pointer to that state.  Returns true if an
+ * existing shared memory segment was found.
+ */
+static bool
+apw_init_shmem(void)
+{
+	bool		found;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	apw_state = ShmemInitStruct("autoprewarm",
+								sizeof(AutoPrewarmSharedState),
+								&found);
+	if (!found)
+	{
+		/* First time through ... */
+		apw_state->tranche_id = LWLockNewTrancheId();
+		LWLockInitialize(&apw_state->lock, apw_state->tranche_id);
+		apw_state->bgworker_pid = InvalidPid;
+		apw_state->pid_using_dumpfile = InvalidPid;
+	}
+	LWLockRelease(AddinShmemInitLock);
+
+	apw_tranche.name = "autoprewarm";
+	apw_tranche.array_base = &apw_state->lock;
+	apw_tranche.array_stride = sizeof(LWLock);
+	LWLockRegisterTranche(apw_state->tranche_id, &apw_tranche);
+
+	return found;
+}
+
+/*
+ * Clear our PID from autoprewarm shared state.
+ */
+static void
+apw_detach_shmem(int code, Datum arg)
+{
+	LWLockAcquire(&apw_state->lock, LW_EXCLUSIVE);
+	if (apw_state->pid_using_dumpfile == MyProcPid)
+		apw_state->pid_using_dumpfile = InvalidPid;
+	if (apw_state->bgworker_pid == MyProcPid)
+		apw_state->bgworker_pid = InvalidPid;
+	LWLockRelease(&apw_state->lock);
+}
+
+/*
+ * Start autoprewarm master worker process.
+ */
+static void
+apw_start_master_worker(void)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+	BgwHandleStatus status;
+	pid_t		pid;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "pg_prewarm");
+	strcpy(worker.bgw_function_name, "autoprewarm_main");
+	strcpy(worker.bgw_name, "autoprewarm master");
+
+	if (process_shared_preload_libraries_in_progress)
+	{
+		RegisterBackgroundWorker(&worker);
+		return;
+	}
+
+	/* must set notify PID to wait for startup */
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not register background process"),
+			   errhint("You may need to increase max_worker_processes.")));
+
+	status = WaitForBackgroundWorkerStartup(handle, &pid);
+	if (status != BGWH_STARTED)
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not start background process"),
+			   errhint("More details may be available in the server log.")));
+}
+
+/*
+ * Start a worker for the task in the given slot of the shared state.
+ * Returns NULL if no background worker slot is free.
+ */
+static BackgroundWorkerHandle *
+apw_start_database_worker(int slot)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags =
+		BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "pg_prewarm");
+	strcpy(worker.bgw_function_name, "autoprewarm_database_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "autoprewarm worker %d", slot);
+	worker.bgw_main_arg = Int32GetDatum(slot);
+
+	/* get a SIGUSR1 when the worker starts and exits */
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		return NULL;
+
+	return handle;
+}
+
+/*
+ * Compare function for sorting BlockInfoRecords.  Blocks of shared
+ * relations, with database InvalidOid, sort first.
+ */
+static int
+apw_compare_blockinfo(const void *p, const void *q)
+{
+	const BlockInfoRecord *a = (const BlockInfoRecord *) p;
+	const BlockInfoRecord *b = (const BlockInfoRecord *) q;
+
+#define cmp_member_elem(fld)	\
+do { \
+	if (a->fld < b->fld)		\
+		return -1;				\
+	else if (a->fld > b->fld)	\
+		return 1;				\
+} while(0)
+
+	cmp_member_elem(database);
+	cmp_member_elem(tablespace);
+	cmp_member_elem(filenode);
+	cmp_member_elem(forknum);
+	cmp_member_elem(blocknum);
+
+#undef cmp_member_elem
+
+	return 0;
+}
+
+/*
+ * Signal handler for SIGTERM
+ */
+static void
+apw_sigterm_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Signal handler for SIGHUP
+ */
+static void
+apw_sighup_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Signal handler for SIGUSR1, which the postmaster sends when one of our
+ * per-database workers starts or exits
+ */
+static void
+apw_sigusr1_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
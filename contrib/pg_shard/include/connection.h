@@ -16,6 +16,8 @@
 #include "c.h"
 #include "libpq-fe.h"
 
+#include "nodes/pg_list.h"
+
 
 /* maximum duration to wait for connection */
 #define CLIENT_CONNECT_TIMEOUT_SECONDS "5"
@@ -27,6 +29,16 @@
 /* times to attempt connection (or reconnection) */
 #define MAX_CONNECT_ATTEMPTS 2
 
+/* maximum duration to wait for a node's connection count to drop */
+#define MAX_CONNECTION_WAIT_MILLIS 5000
+#define CONNECTION_WAIT_INTERVAL_MILLIS 10
+
+/* maximum number of nodes whose connections are counted in shared memory */
+#define MAX_COUNTED_NODES 256
+
+/* name of the lock tranche protecting the shared connection counts */
+#define CONNECTION_COUNT_TRANCHE_NAME "pg_shard connection counts"
+
 /* SQL statement for testing */
 #define TEST_SQL "DO $$ BEGIN RAISE EXCEPTION 'Raised remotely!'; END $$"
 
@@ -47,13 +59,35 @@ typedef struct NodeConnectionEntry
 {
 	NodeConnectionKey cacheKey; /* hash entry key */
 	PGconn *connection;         /* connection to remote server, if any */
+	List *preparedStatementList; /* names of statements prepared on connection */
 } NodeConnectionEntry;
 
 
+/*
+ * NodeConnectionCountEntry counts the connections all backends hold to a node.
+ * These entries live in shared memory.
+ */
+typedef struct NodeConnectionCountEntry
+{
+	NodeConnectionKey nodeKey;  /* hash entry key */
+	int connectionCount;        /* number of open connections to the node */
+} NodeConnectionCountEntry;
+
+
+/* configuration for bounding connections to each node */
+extern int MaxConnectionsPerNode;
+
+
 /* function declarations for obtaining and using a connection */
+extern void RequestConnectionSharedMemory(void);
 extern PGconn * GetConnection(char *nodeName, int32 nodePort, bool openNew);
+extern PGconn * OpenDedicatedConnection(char *nodeName, int32 nodePort);
+extern void CloseDedicatedConnection(PGconn *connection, char *nodeName, int32 nodePort);
+extern void ReleaseFailedConnection(PGconn *connection);
 extern void PurgeConnection(PGconn *connection);
 extern void ReportRemoteError(PGconn *connection, PGresult *result);
+extern bool ConnectionHasPreparedStatement(PGconn *connection, char *statementName);
+extern void RecordPreparedStatement(PGconn *connection, char *statementName);
 
 
 #endif /* PG_SHARD_CONNECTION_H */
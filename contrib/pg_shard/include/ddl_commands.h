@@ -27,6 +27,8 @@
 
 /* function declarations to extend DDL commands with shard IDs */
 extern List * TableDDLCommandList(Oid relationId);
+extern List * TableCreationDDLCommandList(Oid relationId);
+extern List * TableIndexDDLCommandList(Oid relationId);
 extern void AppendOptionListToString(StringInfo stringBuffer, List *optionList);
 extern List * ExtendedDDLCommandList(Oid masterRelationId, int64 shardId,
 									 List *sqlCommandList);
@@ -0,0 +1,45 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/metadata_cache.h
+ *
+ * Declarations for public functions and types related to the shared metadata
+ * cache and its version counter.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_METADATA_CACHE_H
+#define PG_SHARD_METADATA_CACHE_H
+
+#include "postgres.h"
+#include "c.h"
+
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+
+
+/* name of the schema holding the distribution metadata tables */
+#define METADATA_SCHEMA_NAME "pgs_distribution_metadata"
+
+/* name of the lock tranche protecting the shared shard interval hash */
+#define METADATA_CACHE_TRANCHE_NAME "pg_shard metadata cache"
+
+/* maximum number of tables and of shards per table kept in shared memory */
+#define METADATA_CACHE_MAX_TABLES 128
+#define METADATA_CACHE_MAX_SHARDS 512
+
+
+/* function declarations to access and invalidate the metadata cache */
+extern void RequestMetadataCacheSharedMemory(void);
+extern uint64 CurrentMetadataVersion(void);
+extern void InvalidateMetadataCache(void);
+extern bool PlanModifiesDistributionMetadata(PlannedStmt *plannedStatement);
+extern List * LookupSharedShardIntervalList(Oid distributedTableId,
+											uint64 metadataVersion);
+extern void StoreSharedShardIntervalList(Oid distributedTableId, uint64 metadataVersion,
+										 List *shardIntervalList);
+
+
+#endif /* PG_SHARD_METADATA_CACHE_H */
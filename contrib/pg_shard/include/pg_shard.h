@@ -16,6 +16,10 @@
 
 #include "access/tupdesc.h"
 #include "catalog/indexing.h"
+#include "nodes/params.h"
+#if (PG_VERSION_NUM >= 90600)
+#include "nodes/extensible.h"
+#endif
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
@@ -47,6 +51,9 @@ typedef enum DistributedNodeTag
 	T_DistributedPlan = 2100,       /* plan to be built and passed to executor */
 } DistributedNodeTag;
 
+/* name of the extensible node holding a DistributedPlan */
+#define DISTRIBUTED_PLAN_NODE_NAME "PgShardDistributedPlan"
+
 
 /*
  * PlannerType identifies the type of planner which should be used for a given
@@ -67,13 +74,22 @@ typedef enum PlannerType
  */
 typedef struct DistributedPlan
 {
+#if (PG_VERSION_NUM >= 90600)
+	ExtensibleNode node; /* lets the plan cache copy prepared plans */
+#else
 	Plan plan;          /* this is a "subclass" of Plan */
+#endif
 	Plan *originalPlan; /* we save a copy of standard_planner's output */
 	List *taskList;     /* list of tasks to run as part of this plan */
 	List *targetList;   /* copy of the target list for remote SELECT queries only */
 
 	bool selectFromMultipleShards; /* does the select run across multiple shards? */
-	CreateStmt *createTemporaryTableStmt; /* valid for multiple shard selects */
+	CreateStmt *createTemporaryTableStmt; /* multiple shard selects before 9.5 only */
+	char *combineQueryString; /* query combining partial aggregates, if pushed down */
+
+	Query *routerQuery;         /* single-shard query whose shard depends on a parameter */
+	char *routerQueryTemplate;  /* routerQuery deparsed without shard names */
+	int partitionParameterId;   /* parameter holding routerQuery's partition value */
 } DistributedPlan;
 
 
@@ -89,6 +105,8 @@ typedef struct Task
 	StringInfo queryString;     /* SQL string suitable for immediate remote execution */
 	List *taskPlacementList;    /* ShardPlacements on which the task can be executed */
 	int64 shardId;              /* Denormalized shardId of tasks for convenience */
+	char *preparedStatementName; /* name of the query prepared on workers, if any */
+	ParamListInfo parameterList; /* values of parameters in the query, if any */
 } Task;
 
 
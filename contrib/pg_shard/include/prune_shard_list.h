@@ -14,6 +14,9 @@
 #define PG_SHARD_PRUNE_SHARD_LIST_H
 
 #include "c.h"
+#include "fmgr.h"
+
+#include "distribution_metadata.h"
 
 #include "access/attnum.h"
 #include "nodes/pg_list.h"
@@ -38,6 +41,34 @@ typedef struct OperatorIdCacheEntry
 } OperatorIdCacheEntry;
 
 
+/*
+ * ShardIntervalCompareContext holds the function and collation used to compare
+ * the min and max values of a table's shard intervals.
+ */
+typedef struct ShardIntervalCompareContext
+{
+	FmgrInfo *compareFunction;
+	Oid collation;
+} ShardIntervalCompareContext;
+
+
+/*
+ * SortedShardIntervalCacheEntry contains a table's shard intervals sorted by
+ * their min values. If the intervals are disjoint, pruning for a single
+ * partition value binary searches this array.
+ */
+typedef struct SortedShardIntervalCacheEntry
+{
+	Oid relationId;                         /* cache key */
+	List *shardIntervalList;                /* list the array was built from */
+	uint64 metadataVersion;                 /* metadata version at build time */
+	int shardCount;
+	ShardInterval **sortedIntervalArray;
+	bool intervalsDisjoint;
+	ShardIntervalCompareContext compareContext;
+} SortedShardIntervalCacheEntry;
+
+
 /* function declarations for shard pruning */
 extern List * PruneShardList(Oid relationId, List *whereClauseList,
 							 List *shardIntervalList);
@@ -19,13 +19,21 @@
 
 /* templates for SQL commands used during shard placement repair */
 #define DROP_REGULAR_TABLE_COMMAND "DROP TABLE IF EXISTS %s"
-#define DROP_FOREIGN_TABLE_COMMAND "DROP FOREIGN TABLE IF EXISTS %s"
-#define COPY_SHARD_PLACEMENT_COMMAND "SELECT worker_copy_shard_placement(%s, %s, %d)"
+#define COPY_OUT_SHARD_COMMAND "COPY %s TO STDOUT WITH (FORMAT %s)"
+#define COPY_IN_SHARD_COMMAND "COPY %s FROM STDIN WITH (FORMAT %s)"
 #define SELECT_ALL_QUERY "SELECT * FROM %s"
 
+/* maximum duration to wait for progress of any running repair */
+#define REPAIR_POLL_TIMEOUT 100
+
+
+/* configuration for the number of shards repaired at once */
+extern int MaxParallelShardRepairs;
+
 
 /* function declarations for shard repair functionality */
 extern Datum master_copy_shard_placement(PG_FUNCTION_ARGS);
+extern Datum master_copy_shard_placements(PG_FUNCTION_ARGS);
 extern Datum worker_copy_shard_placement(PG_FUNCTION_ARGS);
 
 
@@ -0,0 +1,62 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/router_statement_cache.h
+ *
+ * Declarations for public functions and types related to caching the shard
+ * statements of parameterized single-shard queries.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_ROUTER_STATEMENT_CACHE_H
+#define PG_SHARD_ROUTER_STATEMENT_CACHE_H
+
+#include "c.h"
+#include "libpq-fe.h"
+
+#include "pg_shard.h"
+
+#include "nodes/parsenodes.h"
+
+
+/* maximum number of shard statements cached by a backend */
+#define MAX_ROUTER_STATEMENTS 4096
+
+/* prefix of names of statements prepared on worker nodes */
+#define ROUTER_STATEMENT_PREFIX "pg_shard_router_"
+
+
+/*
+ * RouterStatementKey identifies a parameterized query on a given shard. The
+ * query is represented by the hash of its template, i.e. the query deparsed
+ * without shard names.
+ */
+typedef struct RouterStatementKey
+{
+	uint32 queryTemplateHash; /* hash of the query template */
+	int64 shardId;            /* shard the statement runs on */
+} RouterStatementKey;
+
+
+/*
+ * RouterStatementEntry keeps the query string of a parameterized query on a
+ * shard, and the name under which the statement is prepared on workers.
+ */
+typedef struct RouterStatementEntry
+{
+	RouterStatementKey cacheKey;        /* hash entry key */
+	char *queryTemplate;                /* template, to tell hash collisions apart */
+	char *queryString;                  /* query deparsed for the shard */
+	char statementName[NAMEDATALEN];    /* name of statement on worker nodes */
+} RouterStatementEntry;
+
+
+/* function declarations for caching and sending router statements */
+extern RouterStatementEntry * LookupRouterStatement(Query *query, char *queryTemplate,
+													int64 shardId);
+extern int SendTaskQuery(PGconn *connection, Task *task);
+
+
+#endif /* PG_SHARD_ROUTER_STATEMENT_CACHE_H */
@@ -209,6 +209,15 @@ RETURNS void
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT;
 
+CREATE FUNCTION master_copy_shard_placements(shard_ids bigint[],
+											 source_node_name text,
+											 source_node_port integer,
+											 target_node_name text,
+											 target_node_port integer)
+RETURNS integer
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
 CREATE FUNCTION worker_copy_shard_placement(table_name text, source_node_name text,
 											source_node_port integer)
 RETURNS void
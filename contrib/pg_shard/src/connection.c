@@ -16,12 +16,16 @@
 
 #include "connection.h"
 
+#include <poll.h>
 #include <stddef.h>
 #include <string.h>
 
 #include "commands/dbcommands.h"
 #include "lib/stringinfo.h"
 #include "mb/pg_wchar.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
@@ -36,11 +40,31 @@
  */
 static HTAB *NodeConnectionHash = NULL;
 
+/* maximum number of connections all backends may open to any single node */
+int MaxConnectionsPerNode = 0;
+
+/*
+ * NodeConnectionCountHash counts the connections all backends hold to each node
+ * and NodeConnectionCountLock protects it. Both remain NULL unless pg_shard is
+ * loaded through shared_preload_libraries.
+ */
+static HTAB *NodeConnectionCountHash = NULL;
+static LWLock *NodeConnectionCountLock = NULL;
+static bool ExitCallbackRegistered = false;
+
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
 
 /* local function forward declarations */
 static HTAB * CreateNodeConnectionHash(void);
+static void ConnectionShmemStartup(void);
+static bool ConnectionIsHealthy(PGconn *connection);
+static bool ReserveNodeConnection(NodeConnectionKey *nodeConnectionKey);
+static void ReleaseNodeConnection(NodeConnectionKey *nodeConnectionKey);
+static void ReleaseAllNodeConnections(int code, Datum arg);
 static PGconn * ConnectToNode(char *nodeName, char *nodePort);
 static char * ConnectionGetOptionValue(PGconn *connection, char *optionKeyword);
+static NodeConnectionEntry * LookupConnectionEntry(PGconn *connection);
 
 
 /*
@@ -87,13 +111,14 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 	if (entryFound)
 	{
 		connection = nodeConnectionEntry->connection;
-		if (PQstatus(connection) == CONNECTION_OK)
+		if (ConnectionIsHealthy(connection))
 		{
 			needNewConnection = false;
 		}
 		else
 		{
 			PurgeConnection(connection);
+			connection = NULL;
 		}
 	}
 
@@ -102,12 +127,22 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 		StringInfo nodePortString = makeStringInfo();
 		appendStringInfo(nodePortString, "%d", nodePort);
 
+		if (!ReserveNodeConnection(&nodeConnectionKey))
+		{
+			return NULL;
+		}
+
 		connection = ConnectToNode(nodeName, nodePortString->data);
 		if (connection != NULL)
 		{
 			nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
 											  HASH_ENTER, &entryFound);
 			nodeConnectionEntry->connection = connection;
+			nodeConnectionEntry->preparedStatementList = NIL;
+		}
+		else
+		{
+			ReleaseNodeConnection(&nodeConnectionKey);
 		}
 	}
 
@@ -115,6 +150,108 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 }
 
 
+/*
+ * OpenDedicatedConnection opens a connection to the given node which is not
+ * cached in the connection hash, for callers needing several connections to a
+ * node at once. The connection counts against pg_shard.max_connections_per_node
+ * like cached ones and must be closed using CloseDedicatedConnection. The
+ * function returns NULL if the connection cannot be established.
+ */
+PGconn *
+OpenDedicatedConnection(char *nodeName, int32 nodePort)
+{
+	PGconn *connection = NULL;
+	NodeConnectionKey nodeConnectionKey;
+	StringInfo nodePortString = makeStringInfo();
+
+	if (strnlen(nodeName, MAX_NODE_LENGTH + 1) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	memset(&nodeConnectionKey, 0, sizeof(nodeConnectionKey));
+	strncpy(nodeConnectionKey.nodeName, nodeName, MAX_NODE_LENGTH);
+	nodeConnectionKey.nodePort = nodePort;
+
+	if (!ReserveNodeConnection(&nodeConnectionKey))
+	{
+		return NULL;
+	}
+
+	appendStringInfo(nodePortString, "%d", nodePort);
+
+	connection = ConnectToNode(nodeName, nodePortString->data);
+	if (connection == NULL)
+	{
+		ReleaseNodeConnection(&nodeConnectionKey);
+	}
+
+	return connection;
+}
+
+
+/*
+ * CloseDedicatedConnection closes a connection opened by OpenDedicatedConnection
+ * to the given node and uncounts it.
+ */
+void
+CloseDedicatedConnection(PGconn *connection, char *nodeName, int32 nodePort)
+{
+	NodeConnectionKey nodeConnectionKey;
+
+	memset(&nodeConnectionKey, 0, sizeof(nodeConnectionKey));
+	strncpy(nodeConnectionKey.nodeName, nodeName, MAX_NODE_LENGTH);
+	nodeConnectionKey.nodePort = nodePort;
+
+	PQfinish(connection);
+	ReleaseNodeConnection(&nodeConnectionKey);
+}
+
+
+/*
+ * ReleaseFailedConnection is called with a connection on which a query failed.
+ * If the connection is idle outside of a transaction block, it remains cached
+ * so that later queries do not pay for a new connection. Otherwise, or if the
+ * failed query is still running remotely, the connection is purged.
+ */
+void
+ReleaseFailedConnection(PGconn *connection)
+{
+	if (PQstatus(connection) != CONNECTION_OK)
+	{
+		PurgeConnection(connection);
+		return;
+	}
+
+	/* discard whatever is left of the failed query's results without blocking */
+	for (;;)
+	{
+		PGresult *result = NULL;
+
+		if (PQconsumeInput(connection) == 0 || PQisBusy(connection))
+		{
+			PurgeConnection(connection);
+			return;
+		}
+
+		result = PQgetResult(connection);
+		if (result == NULL)
+		{
+			break;
+		}
+
+		PQclear(result);
+	}
+
+	if (PQtransactionStatus(connection) != PQTRANS_IDLE)
+	{
+		PurgeConnection(connection);
+	}
+}
+
+
 /*
  * PurgeConnection removes the given connection from the connection hash and
  * closes it using PQfinish. If our hash does not contain the given connection,
@@ -154,6 +291,12 @@ PurgeConnection(PGconn *connection)
 									  HASH_REMOVE, &entryFound);
 	if (entryFound)
 	{
+		/* prepared statements vanish with the connection */
+		list_free_deep(nodeConnectionEntry->preparedStatementList);
+
+		/* the hash owns one connection to the node, whichever one it is */
+		ReleaseNodeConnection(&nodeConnectionKey);
+
 		/*
 		 * It's possible the provided connection matches the host and port for
 		 * an entry in the hash without being precisely the same connection. In
@@ -181,6 +324,57 @@ PurgeConnection(PGconn *connection)
 }
 
 
+/*
+ * ConnectionHasPreparedStatement returns true if a statement with the given name
+ * was recorded as prepared on the connection by RecordPreparedStatement.
+ */
+bool
+ConnectionHasPreparedStatement(PGconn *connection, char *statementName)
+{
+	NodeConnectionEntry *nodeConnectionEntry = LookupConnectionEntry(connection);
+	ListCell *statementNameCell = NULL;
+
+	if (nodeConnectionEntry == NULL)
+	{
+		return false;
+	}
+
+	foreach(statementNameCell, nodeConnectionEntry->preparedStatementList)
+	{
+		char *preparedStatementName = (char *) lfirst(statementNameCell);
+		if (strncmp(preparedStatementName, statementName, NAMEDATALEN) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RecordPreparedStatement remembers that a statement with the given name has
+ * been prepared on the connection. The record is dropped along with the
+ * connection. Connections not in the connection hash are ignored.
+ */
+void
+RecordPreparedStatement(PGconn *connection, char *statementName)
+{
+	NodeConnectionEntry *nodeConnectionEntry = LookupConnectionEntry(connection);
+	MemoryContext oldContext = NULL;
+
+	if (nodeConnectionEntry == NULL)
+	{
+		return;
+	}
+
+	oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+	nodeConnectionEntry->preparedStatementList =
+		lappend(nodeConnectionEntry->preparedStatementList, pstrdup(statementName));
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * ReportRemoteError retrieves various error fields from the a remote result and
  * produces an error report at the WARNING level.
@@ -231,6 +425,242 @@ ReportRemoteError(PGconn *connection, PGresult *result)
 }
 
 
+/*
+ * RequestConnectionSharedMemory reserves shared memory and a lock for counting
+ * the connections all backends hold to each node. The function has to be
+ * called from _PG_init, and does nothing unless pg_shard is being loaded
+ * through shared_preload_libraries; pg_shard.max_connections_per_node is not
+ * enforced otherwise.
+ */
+void
+RequestConnectionSharedMemory(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+	{
+		return;
+	}
+
+	RequestAddinShmemSpace(hash_estimate_size(MAX_COUNTED_NODES,
+											  sizeof(NodeConnectionCountEntry)));
+#if (PG_VERSION_NUM >= 90600)
+	RequestNamedLWLockTranche(CONNECTION_COUNT_TRANCHE_NAME, 1);
+#else
+	RequestAddinLWLocks(1);
+#endif
+
+	PreviousShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = ConnectionShmemStartup;
+}
+
+
+/*
+ * ConnectionShmemStartup creates or attaches to the shared connection count
+ * hash.
+ */
+static void
+ConnectionShmemStartup(void)
+{
+	HASHCTL info;
+
+	if (PreviousShmemStartupHook != NULL)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(NodeConnectionKey);
+	info.entrysize = sizeof(NodeConnectionCountEntry);
+	info.hash = tag_hash;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	NodeConnectionCountHash = ShmemInitHash("pg_shard connection counts",
+											MAX_COUNTED_NODES, MAX_COUNTED_NODES,
+											&info, HASH_ELEM | HASH_FUNCTION);
+#if (PG_VERSION_NUM >= 90600)
+	NodeConnectionCountLock =
+		&(GetNamedLWLockTranche(CONNECTION_COUNT_TRANCHE_NAME))->lock;
+#else
+	{
+		bool lockFound = false;
+		LWLock **sharedLock = ShmemInitStruct("pg_shard connection count lock",
+											  sizeof(LWLock *), &lockFound);
+		if (!lockFound)
+		{
+			*sharedLock = LWLockAssign();
+		}
+
+		NodeConnectionCountLock = *sharedLock;
+	}
+#endif
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * ConnectionIsHealthy checks whether a cached connection can still be used.
+ * Idle connections should not receive any data, so if the connection's socket
+ * is readable, the function reads from it to find out whether the server has
+ * closed the connection in the meantime.
+ */
+static bool
+ConnectionIsHealthy(PGconn *connection)
+{
+	struct pollfd pollDescriptor;
+	int pollResult = 0;
+
+	if (PQstatus(connection) != CONNECTION_OK)
+	{
+		return false;
+	}
+
+	pollDescriptor.fd = PQsocket(connection);
+	pollDescriptor.events = POLLIN;
+	pollDescriptor.revents = 0;
+
+	pollResult = poll(&pollDescriptor, 1, 0);
+	if (pollResult > 0)
+	{
+		if ((pollDescriptor.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0 ||
+			PQconsumeInput(connection) == 0)
+		{
+			return false;
+		}
+	}
+
+	return (PQstatus(connection) == CONNECTION_OK);
+}
+
+
+/*
+ * ReserveNodeConnection counts a new connection to the given node against
+ * pg_shard.max_connections_per_node. If all backends together already hold
+ * that many connections to the node, the function waits for one of them to be
+ * closed. It gives up with a warning and returns false after waiting for
+ * MAX_CONNECTION_WAIT_MILLIS.
+ */
+static bool
+ReserveNodeConnection(NodeConnectionKey *nodeConnectionKey)
+{
+	long waitedMillis = 0;
+
+	if (NodeConnectionCountHash == NULL)
+	{
+		return true;
+	}
+
+	if (!ExitCallbackRegistered)
+	{
+		before_shmem_exit(ReleaseAllNodeConnections, 0);
+		ExitCallbackRegistered = true;
+	}
+
+	for (;;)
+	{
+		NodeConnectionCountEntry *countEntry = NULL;
+		bool entryFound = false;
+		bool connectionReserved = false;
+
+		LWLockAcquire(NodeConnectionCountLock, LW_EXCLUSIVE);
+
+		countEntry = hash_search(NodeConnectionCountHash, nodeConnectionKey,
+								 HASH_ENTER_NULL, &entryFound);
+		if (countEntry == NULL)
+		{
+			/* too many distinct nodes to count, so do not limit this one */
+			LWLockRelease(NodeConnectionCountLock);
+			return true;
+		}
+
+		if (!entryFound)
+		{
+			countEntry->connectionCount = 0;
+		}
+
+		if (MaxConnectionsPerNode <= 0 ||
+			countEntry->connectionCount < MaxConnectionsPerNode)
+		{
+			countEntry->connectionCount++;
+			connectionReserved = true;
+		}
+
+		LWLockRelease(NodeConnectionCountLock);
+
+		if (connectionReserved)
+		{
+			return true;
+		}
+
+		if (waitedMillis >= MAX_CONNECTION_WAIT_MILLIS)
+		{
+			ereport(WARNING, (errcode(ERRCODE_TOO_MANY_CONNECTIONS),
+							  errmsg("could not open connection to %s:%d",
+									 nodeConnectionKey->nodeName,
+									 nodeConnectionKey->nodePort),
+							  errdetail("All %d connections allowed to the node "
+										"are in use.", MaxConnectionsPerNode),
+							  errhint("Consider increasing "
+									  "pg_shard.max_connections_per_node.")));
+			return false;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		pg_usleep(CONNECTION_WAIT_INTERVAL_MILLIS * 1000L);
+		waitedMillis += CONNECTION_WAIT_INTERVAL_MILLIS;
+	}
+}
+
+
+/* ReleaseNodeConnection uncounts a connection reserved for the given node. */
+static void
+ReleaseNodeConnection(NodeConnectionKey *nodeConnectionKey)
+{
+	NodeConnectionCountEntry *countEntry = NULL;
+	bool entryFound = false;
+
+	if (NodeConnectionCountHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(NodeConnectionCountLock, LW_EXCLUSIVE);
+
+	countEntry = hash_search(NodeConnectionCountHash, nodeConnectionKey, HASH_FIND,
+							 &entryFound);
+	if (entryFound && countEntry->connectionCount > 0)
+	{
+		countEntry->connectionCount--;
+	}
+
+	LWLockRelease(NodeConnectionCountLock);
+}
+
+
+/*
+ * ReleaseAllNodeConnections runs at backend exit and uncounts the connections
+ * still held in the connection hash.
+ */
+static void
+ReleaseAllNodeConnections(int code, Datum arg)
+{
+	NodeConnectionEntry *nodeConnectionEntry = NULL;
+	HASH_SEQ_STATUS status;
+
+	if (NodeConnectionHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, NodeConnectionHash);
+	while ((nodeConnectionEntry = hash_seq_search(&status)) != NULL)
+	{
+		ReleaseNodeConnection(&nodeConnectionEntry->cacheKey);
+	}
+}
+
+
 /*
  * CreateNodeConnectionHash returns a newly created hash table suitable for
  * storing unlimited connections indexed by node name and port.
@@ -330,3 +760,32 @@ ConnectionGetOptionValue(PGconn *connection, char *optionKeyword)
 
 	return optionValue;
 }
+
+
+/*
+ * LookupConnectionEntry finds the connection hash entry holding the given
+ * connection. The function returns NULL if no entry holds the connection.
+ */
+static NodeConnectionEntry *
+LookupConnectionEntry(PGconn *connection)
+{
+	NodeConnectionEntry *nodeConnectionEntry = NULL;
+	HASH_SEQ_STATUS status;
+
+	if (NodeConnectionHash == NULL)
+	{
+		return NULL;
+	}
+
+	hash_seq_init(&status, NodeConnectionHash);
+	while ((nodeConnectionEntry = hash_seq_search(&status)) != NULL)
+	{
+		if (nodeConnectionEntry->connection == connection)
+		{
+			hash_seq_term(&status);
+			break;
+		}
+	}
+
+	return nodeConnectionEntry;
+}
@@ -16,6 +16,7 @@
 #include "miscadmin.h"
 
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 
 #include <stddef.h>
 #include <string.h>
@@ -39,16 +40,22 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/snapmgr.h"
 
 
 /*
  * ShardIntervalListCache is used for caching shard interval lists. It begins
- * initialized to empty list as there are no items in the cache.
+ * initialized to empty list as there are no items in the cache. The entries
+ * are allocated in ShardIntervalListCacheContext and are valid for as long as
+ * the metadata version stays at ShardIntervalListCacheVersion.
  */
 static List *ShardIntervalListCache = NIL;
+static MemoryContext ShardIntervalListCacheContext = NULL;
+static uint64 ShardIntervalListCacheVersion = 0;
 
 
 /* local function forward declarations */
+static void ResetShardIntervalListCache(uint64 metadataVersion);
 static ShardInterval * TupleToShardInterval(HeapTuple heapTuple,
 											TupleDesc tupleDescriptor);
 static ShardPlacement * TupleToShardPlacement(HeapTuple heapTuple,
@@ -59,8 +66,10 @@ static void AcquireShardLock(int64 shardId, ShardLockType shardLockType,
 
 /*
  * LookupShardIntervalList is wrapper around LoadShardIntervalList that uses a
- * cache to avoid multiple lookups of a distributed table's shards within a
- * single session.
+ * cache to avoid multiple lookups of a distributed table's shards. The session
+ * cache is dropped whenever the metadata version changes. On a miss, the
+ * function first tries the shard intervals other backends left in shared
+ * memory, and only queries the metadata tables if these are missing or stale.
  */
 List *
 LookupShardIntervalList(Oid distributedTableId)
@@ -68,6 +77,13 @@ LookupShardIntervalList(Oid distributedTableId)
 	ShardIntervalListCacheEntry *matchingCacheEntry = NULL;
 	ListCell *cacheEntryCell = NULL;
 
+	/* read the version before loading, so later changes invalidate our copy */
+	uint64 metadataVersion = CurrentMetadataVersion();
+	if (metadataVersion != ShardIntervalListCacheVersion)
+	{
+		ResetShardIntervalListCache(metadataVersion);
+	}
+
 	/* search the cache */
 	foreach(cacheEntryCell, ShardIntervalListCache)
 	{
@@ -82,9 +98,17 @@ LookupShardIntervalList(Oid distributedTableId)
 	/* if not found in the cache, load the shard interval and put it in cache */
 	if (matchingCacheEntry == NULL)
 	{
-		MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+		MemoryContext oldContext = MemoryContextSwitchTo(ShardIntervalListCacheContext);
+
+		List *loadedIntervalList = LookupSharedShardIntervalList(distributedTableId,
+																 metadataVersion);
+		if (loadedIntervalList == NIL)
+		{
+			loadedIntervalList = LoadShardIntervalList(distributedTableId);
+			StoreSharedShardIntervalList(distributedTableId, metadataVersion,
+										 loadedIntervalList);
+		}
 
-		List *loadedIntervalList = LoadShardIntervalList(distributedTableId);
 		if (loadedIntervalList != NIL)
 		{
 			matchingCacheEntry = palloc0(sizeof(ShardIntervalListCacheEntry));
@@ -110,6 +134,30 @@ LookupShardIntervalList(Oid distributedTableId)
 }
 
 
+/*
+ * ResetShardIntervalListCache empties the shard interval list cache and tags
+ * it with the given metadata version. Callers within the current transaction
+ * may still hold shard intervals from the previous cache, so its memory is
+ * handed over to the transaction and only freed when the transaction ends.
+ */
+static void
+ResetShardIntervalListCache(uint64 metadataVersion)
+{
+	if (ShardIntervalListCacheContext != NULL)
+	{
+		MemoryContextSetParent(ShardIntervalListCacheContext, TopTransactionContext);
+	}
+
+	ShardIntervalListCacheContext = AllocSetContextCreate(CacheMemoryContext,
+														  "pg_shard shard intervals",
+														  ALLOCSET_SMALL_MINSIZE,
+														  ALLOCSET_SMALL_INITSIZE,
+														  ALLOCSET_SMALL_MAXSIZE);
+	ShardIntervalListCache = NIL;
+	ShardIntervalListCacheVersion = metadataVersion;
+}
+
+
 /*
  * LoadShardIntervalList returns a list of shard intervals related for a given
  * distributed table. The function returns an empty list if no shards can be
@@ -145,7 +193,13 @@ LoadShardIntervalList(Oid distributedTableId)
 		Assert(spiStatus == 0);
 	}
 
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 0);
+	/*
+	 * Cached intervals are tagged with the metadata version read before this
+	 * call, so they have to reflect the latest committed metadata rather than
+	 * an older transaction snapshot.
+	 */
+	spiStatus = SPI_execute_snapshot(spiPlan, argValues, NULL, GetLatestSnapshot(),
+									 InvalidSnapshot, false, false, 0);
 	Assert(spiStatus == SPI_OK_SELECT);
 
 	oldContext = MemoryContextSwitchTo(upperContext);
@@ -72,17 +72,26 @@ static char * pg_shard_get_indexclusterdef_string(Oid indexRelationId);
  */
 List *
 TableDDLCommandList(Oid relationId)
+{
+	List *tableDDLCommandList = TableCreationDDLCommandList(relationId);
+	List *indexDDLCommandList = TableIndexDDLCommandList(relationId);
+
+	return list_concat(tableDDLCommandList, indexDDLCommandList);
+}
+
+
+/*
+ * TableCreationDDLCommandList returns the DDL commands which create the given
+ * relation without any of its indexes: the table's schema definition and its
+ * optional column storage and statistics definitions.
+ */
+List *
+TableCreationDDLCommandList(Oid relationId)
 {
 	List *tableDDLCommandList = NIL;
 	char *tableSchemaDef = NULL;
 	char *tableColumnOptionsDef = NULL;
 
-	Relation pgIndex = NULL;
-	SysScanDesc scanDescriptor = NULL;
-	ScanKeyData scanKey[1];
-	int scanKeyCount = 1;
-	HeapTuple heapTuple = NULL;
-
 	/* fetch table schema and column option definitions */
 	tableSchemaDef = pg_shard_get_tableschemadef_string(relationId);
 	tableColumnOptionsDef = pg_shard_get_tablecolumnoptionsdef_string(relationId);
@@ -93,6 +102,27 @@ TableDDLCommandList(Oid relationId)
 		tableDDLCommandList = lappend(tableDDLCommandList, tableColumnOptionsDef);
 	}
 
+	return tableDDLCommandList;
+}
+
+
+/*
+ * TableIndexDDLCommandList returns the DDL commands which create the indexes
+ * and index-backed constraints of the given relation, as well as the command
+ * marking the index the table is clustered on. Running them after the table is
+ * loaded builds each index once instead of maintaining it row by row.
+ */
+List *
+TableIndexDDLCommandList(Oid relationId)
+{
+	List *indexDDLCommandList = NIL;
+
+	Relation pgIndex = NULL;
+	SysScanDesc scanDescriptor = NULL;
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	HeapTuple heapTuple = NULL;
+
 	/* open system catalog and scan all indexes that belong to this table */
 	pgIndex = heap_open(IndexRelationId, AccessShareLock);
 
@@ -145,7 +175,7 @@ TableDDLCommandList(Oid relationId)
 		}
 
 		/* append found constraint or index definition to the list */
-		tableDDLCommandList = lappend(tableDDLCommandList, statementDef);
+		indexDDLCommandList = lappend(indexDDLCommandList, statementDef);
 
 		/* if table is clustered on this index, append definition to the list */
 		if (indexForm->indisclustered)
@@ -153,7 +183,7 @@ TableDDLCommandList(Oid relationId)
 			char *clusteredDef = pg_shard_get_indexclusterdef_string(indexId);
 			Assert(clusteredDef != NULL);
 
-			tableDDLCommandList = lappend(tableDDLCommandList, clusteredDef);
+			indexDDLCommandList = lappend(indexDDLCommandList, clusteredDef);
 		}
 
 		heapTuple = systable_getnext(scanDescriptor);
@@ -163,7 +193,7 @@ TableDDLCommandList(Oid relationId)
 	systable_endscan(scanDescriptor);
 	heap_close(pgIndex, AccessShareLock);
 
-	return tableDDLCommandList;
+	return indexDDLCommandList;
 }
 
 
@@ -0,0 +1,458 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/metadata_cache.c
+ *
+ * This file contains functions to keep the shard intervals of distributed
+ * tables in shared memory, and to maintain the metadata version counter that
+ * tells backends when their cached metadata became stale.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "miscadmin.h"
+
+#include "distribution_metadata.h"
+#include "metadata_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "nodes/parsenodes.h"
+#include "parser/parsetree.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/palloc.h"
+
+
+/*
+ * MetadataCacheControl is the shared state of the metadata cache. The version
+ * counter advances whenever shards or placements change; cached metadata is
+ * only valid for the version it was loaded under.
+ */
+typedef struct MetadataCacheControl
+{
+	LWLock *lock;                       /* protects the shard interval hash */
+	pg_atomic_uint64 metadataVersion;   /* current metadata version */
+} MetadataCacheControl;
+
+
+/* SharedShardInterval is the shared memory representation of a shard interval */
+typedef struct SharedShardInterval
+{
+	int64 id;
+	Datum minValue;
+	Datum maxValue;
+} SharedShardInterval;
+
+
+/*
+ * SharedShardIntervalEntry holds all shard intervals of a distributed table.
+ * Only tables whose interval values are passed by value are kept, which covers
+ * all hash-partitioned tables.
+ */
+typedef struct SharedShardIntervalEntry
+{
+	Oid distributedTableId;     /* hash key */
+	uint64 metadataVersion;     /* version the intervals were loaded under */
+	Oid valueTypeId;
+	int shardCount;
+	SharedShardInterval shardIntervalArray[METADATA_CACHE_MAX_SHARDS];
+} SharedShardIntervalEntry;
+
+
+/* shared state; both remain NULL if pg_shard is not in shared_preload_libraries */
+static MetadataCacheControl *MetadataCache = NULL;
+static HTAB *SharedShardIntervalHash = NULL;
+
+/* version counter used when shared memory is unavailable */
+static uint64 LocalMetadataVersion = 1;
+
+/* whether the current transaction changed the metadata */
+static bool MetadataChangePending = false;
+static bool TransactionCallbacksRegistered = false;
+
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+
+/* local function forward declarations */
+static Size MetadataCacheShmemSize(void);
+static void MetadataCacheShmemStartup(void);
+static void AdvanceMetadataVersion(void);
+static void MetadataCacheXactCallback(XactEvent event, void *arg);
+static void MetadataCacheSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
+										 SubTransactionId parentSubid, void *arg);
+static void RemoveStaleSharedEntries(uint64 metadataVersion);
+
+
+/*
+ * RequestMetadataCacheSharedMemory reserves shared memory and a lock for the
+ * metadata cache. The function has to be called from _PG_init, and does
+ * nothing unless pg_shard is being loaded through shared_preload_libraries;
+ * otherwise, backends only cache metadata locally.
+ */
+void
+RequestMetadataCacheSharedMemory(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+	{
+		return;
+	}
+
+	RequestAddinShmemSpace(MetadataCacheShmemSize());
+#if (PG_VERSION_NUM >= 90600)
+	RequestNamedLWLockTranche(METADATA_CACHE_TRANCHE_NAME, 1);
+#else
+	RequestAddinLWLocks(1);
+#endif
+
+	PreviousShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = MetadataCacheShmemStartup;
+}
+
+
+/* MetadataCacheShmemSize returns the shared memory size the cache requires. */
+static Size
+MetadataCacheShmemSize(void)
+{
+	Size size = MAXALIGN(sizeof(MetadataCacheControl));
+	size = add_size(size, hash_estimate_size(METADATA_CACHE_MAX_TABLES,
+											 sizeof(SharedShardIntervalEntry)));
+
+	return size;
+}
+
+
+/*
+ * MetadataCacheShmemStartup creates or attaches to the shared state of the
+ * metadata cache.
+ */
+static void
+MetadataCacheShmemStartup(void)
+{
+	HASHCTL info;
+	bool cacheFound = false;
+
+	if (PreviousShmemStartupHook != NULL)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(SharedShardIntervalEntry);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MetadataCache = ShmemInitStruct("pg_shard metadata cache",
+									sizeof(MetadataCacheControl), &cacheFound);
+	if (!cacheFound)
+	{
+#if (PG_VERSION_NUM >= 90600)
+		MetadataCache->lock = &(GetNamedLWLockTranche(METADATA_CACHE_TRANCHE_NAME))->lock;
+#else
+		MetadataCache->lock = LWLockAssign();
+#endif
+		pg_atomic_init_u64(&MetadataCache->metadataVersion, 1);
+	}
+
+	SharedShardIntervalHash = ShmemInitHash("pg_shard shard intervals",
+											METADATA_CACHE_MAX_TABLES,
+											METADATA_CACHE_MAX_TABLES, &info,
+											HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * CurrentMetadataVersion returns the current metadata version. Metadata loaded
+ * after reading a version remains valid for as long as the version does not
+ * change.
+ */
+uint64
+CurrentMetadataVersion(void)
+{
+	if (MetadataCache == NULL)
+	{
+		return LocalMetadataVersion;
+	}
+
+	return pg_atomic_read_u64(&MetadataCache->metadataVersion);
+}
+
+
+/*
+ * InvalidateMetadataCache marks all cached metadata stale after the current
+ * transaction changed shards or placements. The version advances right away,
+ * so that the transaction itself sees its changes, and again when the
+ * transaction ends, so that other backends drop metadata they loaded before
+ * the change became visible to them.
+ */
+void
+InvalidateMetadataCache(void)
+{
+	AdvanceMetadataVersion();
+	MetadataChangePending = true;
+
+	if (!TransactionCallbacksRegistered)
+	{
+		RegisterXactCallback(MetadataCacheXactCallback, NULL);
+		RegisterSubXactCallback(MetadataCacheSubXactCallback, NULL);
+		TransactionCallbacksRegistered = true;
+	}
+}
+
+
+/* AdvanceMetadataVersion increments the shared or local version counter. */
+static void
+AdvanceMetadataVersion(void)
+{
+	if (MetadataCache == NULL)
+	{
+		LocalMetadataVersion++;
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&MetadataCache->metadataVersion, 1);
+}
+
+
+/*
+ * MetadataCacheXactCallback advances the metadata version at the end of any
+ * transaction that changed the metadata. Prepared transactions advance it when
+ * prepared; the COMMIT PREPARED command advances it once more.
+ */
+static void
+MetadataCacheXactCallback(XactEvent event, void *arg)
+{
+	if (!MetadataChangePending)
+	{
+		return;
+	}
+
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+		{
+			AdvanceMetadataVersion();
+			MetadataChangePending = false;
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+}
+
+
+/*
+ * MetadataCacheSubXactCallback advances the metadata version when a
+ * subtransaction aborts, as the aborted subtransaction may have changed the
+ * metadata this backend cached.
+ */
+static void
+MetadataCacheSubXactCallback(SubXactEvent event, SubTransactionId mySubid,
+							 SubTransactionId parentSubid, void *arg)
+{
+	if (MetadataChangePending && event == SUBXACT_EVENT_ABORT_SUB)
+	{
+		AdvanceMetadataVersion();
+	}
+}
+
+
+/*
+ * PlanModifiesDistributionMetadata returns whether the plan inserts, updates
+ * or deletes rows of a distribution metadata table. Metadata functions change
+ * these tables using SPI, so checking plans catches them as well as direct
+ * changes to the tables.
+ */
+bool
+PlanModifiesDistributionMetadata(PlannedStmt *plannedStatement)
+{
+	Oid metadataNamespaceId = InvalidOid;
+	ListCell *resultRelationCell = NULL;
+
+	if (plannedStatement->resultRelations == NIL)
+	{
+		return false;
+	}
+
+	metadataNamespaceId = get_namespace_oid(METADATA_SCHEMA_NAME, true);
+	if (!OidIsValid(metadataNamespaceId))
+	{
+		return false;
+	}
+
+	foreach(resultRelationCell, plannedStatement->resultRelations)
+	{
+		Index resultRelationIndex = (Index) lfirst_int(resultRelationCell);
+		RangeTblEntry *resultEntry = rt_fetch(resultRelationIndex,
+											  plannedStatement->rtable);
+
+		if (get_rel_namespace(resultEntry->relid) == metadataNamespaceId)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * LookupSharedShardIntervalList returns a list of the table's shard intervals
+ * allocated in the current memory context, if shared memory holds them for the
+ * given metadata version. Otherwise, the function returns NIL.
+ */
+List *
+LookupSharedShardIntervalList(Oid distributedTableId, uint64 metadataVersion)
+{
+	SharedShardIntervalEntry *sharedEntry = NULL;
+	List *shardIntervalList = NIL;
+	bool entryFound = false;
+
+	if (SharedShardIntervalHash == NULL)
+	{
+		return NIL;
+	}
+
+	LWLockAcquire(MetadataCache->lock, LW_SHARED);
+
+	sharedEntry = hash_search(SharedShardIntervalHash, &distributedTableId, HASH_FIND,
+							  &entryFound);
+	if (entryFound && sharedEntry->metadataVersion == metadataVersion)
+	{
+		int shardIndex = 0;
+
+		for (shardIndex = 0; shardIndex < sharedEntry->shardCount; shardIndex++)
+		{
+			SharedShardInterval *sharedInterval =
+				&sharedEntry->shardIntervalArray[shardIndex];
+			ShardInterval *shardInterval = palloc0(sizeof(ShardInterval));
+
+			shardInterval->id = sharedInterval->id;
+			shardInterval->relationId = distributedTableId;
+			shardInterval->minValue = sharedInterval->minValue;
+			shardInterval->maxValue = sharedInterval->maxValue;
+			shardInterval->valueTypeId = sharedEntry->valueTypeId;
+
+			shardIntervalList = lappend(shardIntervalList, shardInterval);
+		}
+	}
+
+	LWLockRelease(MetadataCache->lock);
+
+	return shardIntervalList;
+}
+
+
+/*
+ * StoreSharedShardIntervalList copies the table's shard intervals, loaded under
+ * the given metadata version, into shared memory. The function skips tables
+ * with too many shards or with interval values not passed by value, and does
+ * nothing while the current transaction has uncommitted metadata changes.
+ */
+void
+StoreSharedShardIntervalList(Oid distributedTableId, uint64 metadataVersion,
+							 List *shardIntervalList)
+{
+	SharedShardIntervalEntry *sharedEntry = NULL;
+	ShardInterval *firstInterval = NULL;
+	ListCell *shardIntervalCell = NULL;
+	int shardIndex = 0;
+	bool entryFound = false;
+
+	if (SharedShardIntervalHash == NULL || MetadataChangePending)
+	{
+		return;
+	}
+
+	if (shardIntervalList == NIL ||
+		list_length(shardIntervalList) > METADATA_CACHE_MAX_SHARDS)
+	{
+		return;
+	}
+
+	firstInterval = (ShardInterval *) linitial(shardIntervalList);
+	if (!get_typbyval(firstInterval->valueTypeId))
+	{
+		return;
+	}
+
+	LWLockAcquire(MetadataCache->lock, LW_EXCLUSIVE);
+
+	sharedEntry = hash_search(SharedShardIntervalHash, &distributedTableId,
+							  HASH_ENTER_NULL, &entryFound);
+	if (sharedEntry == NULL)
+	{
+		RemoveStaleSharedEntries(metadataVersion);
+
+		sharedEntry = hash_search(SharedShardIntervalHash, &distributedTableId,
+								  HASH_ENTER_NULL, &entryFound);
+	}
+
+	/* keep entries from other backends that loaded a newer version */
+	if (sharedEntry == NULL ||
+		(entryFound && sharedEntry->metadataVersion >= metadataVersion))
+	{
+		LWLockRelease(MetadataCache->lock);
+		return;
+	}
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		SharedShardInterval *sharedInterval =
+			&sharedEntry->shardIntervalArray[shardIndex];
+
+		sharedInterval->id = shardInterval->id;
+		sharedInterval->minValue = shardInterval->minValue;
+		sharedInterval->maxValue = shardInterval->maxValue;
+
+		shardIndex++;
+	}
+
+	sharedEntry->metadataVersion = metadataVersion;
+	sharedEntry->valueTypeId = firstInterval->valueTypeId;
+	sharedEntry->shardCount = shardIndex;
+
+	LWLockRelease(MetadataCache->lock);
+}
+
+
+/*
+ * RemoveStaleSharedEntries frees the shared entries loaded under versions older
+ * than the given one. The caller must hold the cache lock exclusively.
+ */
+static void
+RemoveStaleSharedEntries(uint64 metadataVersion)
+{
+	HASH_SEQ_STATUS status;
+	SharedShardIntervalEntry *sharedEntry = NULL;
+
+	hash_seq_init(&status, SharedShardIntervalHash);
+
+	while ((sharedEntry = hash_seq_search(&status)) != NULL)
+	{
+		if (sharedEntry->metadataVersion < metadataVersion)
+		{
+			hash_search(SharedShardIntervalHash, &sharedEntry->distributedTableId,
+						HASH_REMOVE, NULL);
+		}
+	}
+}
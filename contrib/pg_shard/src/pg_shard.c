@@ -21,13 +21,18 @@
 #include "pg_shard.h"
 #include "connection.h"
 #include "create_shards.h"
+#include "ddl_commands.h"
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 #include "prune_shard_list.h"
+#include "repair_shards.h"
+#include "router_statement_cache.h"
 #include "ruleutils.h"
 
 #include <stddef.h>
 #include <string.h>
 #include <inttypes.h>
+#include <poll.h>
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
@@ -41,8 +46,11 @@
 #include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_type.h"
+#include "commands/copy.h"
 #include "commands/extension.h"
 #include "executor/execdesc.h"
 #include "executor/executor.h"
@@ -50,6 +58,9 @@
 #include "executor/tuptable.h"
 #include "lib/stringinfo.h"
 #include "nodes/execnodes.h"
+#if (PG_VERSION_NUM >= 90600)
+#include "nodes/extensible.h"
+#endif
 #include "nodes/makefuncs.h"
 #include "nodes/memnodes.h" /* IWYU pragma: keep */
 #include "nodes/nodeFuncs.h"
@@ -62,11 +73,15 @@
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/planner.h"
+#include "optimizer/tlist.h"
 #include "optimizer/var.h"
 #include "parser/analyze.h"
+#include "parser/parse_func.h"
 #include "parser/parse_node.h"
+#include "parser/parser.h"
 #include "parser/parsetree.h"
 #include "parser/parse_type.h"
+#include "rewrite/rewriteManip.h"
 #include "storage/lock.h"
 #include "tcop/dest.h"
 #include "tcop/tcopprot.h"
@@ -75,16 +90,84 @@
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/palloc.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
+#if (PG_VERSION_NUM >= 90500)
+#include "utils/ruleutils.h"
+#endif
 #include "utils/snapmgr.h"
 #include "utils/tuplestore.h"
+#include "utils/typcache.h"
 #include "utils/memutils.h"
 
 typedef long long csn_t;
 
+/* maximum time to wait (in milliseconds) for shard results before checking for interrupts */
+#define REMOTE_RESULT_POLL_TIMEOUT 100
+
+/* size of rows buffered for one shard (in bytes) before they are sent by COPY */
+#define SHARD_COPY_BUFFER_SIZE (1024 * 1024)
+
+
+/*
+ * ShardSelectExecution tracks the progress of one task of a multi-shard SELECT
+ * while the queries are concurrently executed on all shards.
+ */
+typedef struct ShardSelectExecution
+{
+	Task *task;                  /* task being executed */
+	ListCell *placementCell;     /* placement currently tried, NULL if none left */
+	PGconn *connection;          /* connection running the query, if any */
+	Tuplestorestate *tupleStore; /* rows received from current placement */
+	bool resultsReceived;        /* have all results of the task been received? */
+} ShardSelectExecution;
+
+
+/*
+ * ShardCopyDestination buffers the rows of a distributed COPY destined for one
+ * shard. The task's query is the COPY command run on each of shard placements.
+ */
+typedef struct ShardCopyDestination
+{
+	int64 shardId;        /* hash key, must be first */
+	Task *task;           /* COPY command and placements of the shard */
+	StringInfo copyData;  /* rows not yet sent, in COPY text format */
+} ShardCopyDestination;
+
+
+/* ShardSelectStatus is the outcome of consuming input of running shard query */
+typedef enum ShardSelectStatus
+{
+	SHARD_SELECT_BUSY = 0,
+	SHARD_SELECT_DONE = 1,
+	SHARD_SELECT_FAILED = 2
+} ShardSelectStatus;
+
+#if (PG_VERSION_NUM >= 90500)
+
+/*
+ * IntermediateResultScanState is the execution state of the custom scan which
+ * feeds rows fetched by a multi-shard SELECT into the local plan. Rows are
+ * fetched from the shards when the scan is first read, and then returned from
+ * the tuplestores of the tasks in task order.
+ */
+typedef struct IntermediateResultScanState
+{
+	CustomScanState customScanState;  /* must be first */
+	DistributedPlan *distributedPlan; /* plan whose tasks fetch the rows */
+	List *storeToScanColumnList;      /* remote target list, NIL if in order */
+	TupleTableSlot *storeSlot;        /* slot for rows as fetched from shards */
+	List *tupleStoreList;             /* rows of each task, in task order */
+	ListCell *tupleStoreCell;         /* tuplestore currently read */
+	bool resultsFetched;              /* have the shard queries been run? */
+} IntermediateResultScanState;
+
+#endif
+
+
 /* controls use of locks to enforce safe commutativity */
 bool AllModificationsCommutative = false;
 
@@ -108,39 +191,111 @@ static PlannerType DeterminePlannerType(Query *query);
 static void ErrorIfQueryNotSupported(Query *queryTree);
 static Oid ExtractFirstDistributedTableId(Query *query);
 static bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
+static bool IsMultiRowInsert(Query *query);
+static Param * PartitionColumnParameter(Query *query);
+static List * DistributedTableShardList(Oid distributedTableId);
 static List * DistributedQueryShardList(Query *query);
 static bool SelectFromMultipleShards(Query *query, List *queryShardList);
 static void ClassifyRestrictions(List *queryRestrictList, List **remoteRestrictList,
 								 List **localRestrictList);
 static Query * RowAndColumnFilterQuery(Query *query, List *remoteRestrictList,
 									   List *localRestrictList);
+static void PushDownSortAndLimit(Query *query, Query *filterQuery,
+								 List *localRestrictList);
+static bool PartialAggregationSafe(Query *query, List *localRestrictList);
+static bool PartialAggregateSupported(Aggref *aggregate);
+static Oid AggregateFunctionOid(char *aggregateName, Oid argumentType);
+static char * SortClauseDirection(SortGroupClause *sortClause, Node *sortExpression);
+static Query * PartialAggregateQuery(Query *query, List *remoteRestrictList,
+									 List **combineExpressionList);
+static char * CombineAggregateQueryString(Query *query, List *combineExpressionList,
+										  char *intermediateResultClause);
 static Query * BuildLocalQuery(Query *query, List *localRestrictList);
 static PlannedStmt * PlanSequentialScan(Query *query, int cursorOptions,
 										ParamListInfo boundParams);
 static List * QueryRestrictList(Query *query);
 static Const * ExtractPartitionValue(Query *query, Var *partitionColumn);
+static OpExpr * PartitionValueRestriction(Var *partitionColumn,
+										  Const *partitionValue);
+static ShardInterval * DestinationShardInterval(Oid distributedTableId,
+												OpExpr *partitionRestriction,
+												List *shardIntervalList);
 static bool ExtractFromExpressionWalker(Node *node, List **qualifierList);
 static List * QueryFromList(List *rangeTableList);
 static List * TargetEntryList(List *expressionList);
+#if (PG_VERSION_NUM >= 90500)
+static char * IntermediateResultFunctionClause(List *partialTargetList);
+#else
+static RangeVar * TemporaryTableRangeVar(void);
 static CreateStmt * CreateTemporaryTableLikeStmt(Oid sourceRelationId);
+static CreateStmt * CreateTemporaryTableStmt(List *targetList);
+#endif
+static PlannedStmt * PlanCombineQuery(char *combineQueryString);
+static DistributedPlan * MakeDistributedPlan(void);
 static DistributedPlan * BuildDistributedPlan(Query *query, List *shardIntervalList);
+static DistributedPlan * BuildMultiRowInsertPlan(Query *query);
+static DistributedPlan * BuildRouterPlan(Query *query, Param *partitionParameter);
+static Task * BuildShardTask(Query *query, int64 shardId);
+#if (PG_VERSION_NUM >= 90600)
+static void CopyDistributedPlan(ExtensibleNode *newNode, const ExtensibleNode *oldNode);
+static Task * CopyTask(Task *task);
+static bool EqualDistributedPlans(const ExtensibleNode *leftNode,
+								  const ExtensibleNode *rightNode);
+static bool EqualTaskLists(List *leftTaskList, List *rightTaskList);
+static bool EqualStrings(const char *leftString, const char *rightString);
+static void OutDistributedPlan(StringInfo str, const ExtensibleNode *node);
+static void ReadDistributedPlan(ExtensibleNode *node);
+#endif
 
 /* executor functions forward declarations */
 static void PgShardExecutorStart(QueryDesc *queryDesc, int eflags);
 static bool IsPgShardPlan(PlannedStmt *plannedStmt);
+static PlannedStmt * RouterExecutionStatement(PlannedStmt *plannedStatement,
+											  ParamListInfo parameterList);
 static void NextExecutorStartHook(QueryDesc *queryDesc, int eflags);
 static LOCKMODE CommutativityRuleToLockMode(CmdType commandType);
 static void AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
-static void ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
-									   RangeVar *intermediateTable);
-static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query);
+static List * ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
+										TupleDesc tupleStoreDescriptor);
+static bool StartShardSelect(ShardSelectExecution *executionArray, int executionCount,
+							 ShardSelectExecution *execution);
+static bool PlacementConnectionInUse(ShardSelectExecution *executionArray,
+									 int executionCount, ShardPlacement *placement);
+static ShardSelectStatus ReceiveShardSelectResults(ShardSelectExecution *execution,
+												   AttInMetadata *attributeInputMetadata,
+												   MemoryContext ioContext);
+static bool SendQueryInSingleRowMode(PGconn *connection, Task *task);
+static void StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+							  MemoryContext ioContext, Tuplestorestate *tupleStore);
 static bool StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 							 Tuplestorestate *tupleStore);
+#if (PG_VERSION_NUM >= 90500)
+static Plan * ReplaceScanWithIntermediateResult(Plan *plan,
+												DistributedPlan *distributedPlan);
+static CustomScan * IntermediateResultScan(Scan *scan, DistributedPlan *distributedPlan);
+static Node * CreateIntermediateResultScanState(CustomScan *customScan);
+static void BeginIntermediateResultScan(CustomScanState *node, EState *estate,
+										int eflags);
+static TupleTableSlot * ExecIntermediateResultScan(CustomScanState *node);
+static TupleTableSlot * IntermediateResultNext(CustomScanState *node);
+static bool IntermediateResultRecheck(CustomScanState *node, TupleTableSlot *slot);
+static void StoreToScanSlot(TupleTableSlot *storeSlot, TupleTableSlot *scanSlot,
+							List *storeToScanColumnList);
+static void EndIntermediateResultScan(CustomScanState *node);
+static void ReScanIntermediateResultScan(CustomScanState *node);
+#else
+static void StoreResultsInTable(DistributedPlan *distributedPlan,
+								RangeVar *intermediateTable);
 static void TupleStoreToTable(RangeVar *tableRangeVar, List *remoteTargetList,
 							  TupleDesc storeTupleDescriptor, Tuplestorestate *store);
+#endif
 static void PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count);
-static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan);
+static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan,
+									  CmdType operation);
+static int32 ExecuteTaskModify(Task *task, StringInfo copyData);
+static void GatherRemoteResults(PGconn **connectionArray, PGresult **resultArray,
+								int connectionCount);
 static void PrepareDtmTransaction(Task *task);
 static csn_t SendDtmBeginTransaction(PGconn *connection);
 static bool SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId);
@@ -154,6 +309,11 @@ static void PgShardExecutorEnd(QueryDesc *queryDesc);
 static void PgShardProcessUtility(Node *parsetree, const char *queryString,
 								  ProcessUtilityContext context, ParamListInfo params,
 								  DestReceiver *dest, char *completionTag);
+static uint64 CopyIntoDistributedTable(CopyStmt *copyStatement);
+static ShardCopyDestination * LookupShardCopyDestination(HTAB *destinationHash,
+														 ShardInterval *shardInterval,
+														 char *columnNames);
+static void AppendCopyTextValue(StringInfo copyData, char *value);
 static void ErrorOnDropIfDistributedTablesExist(DropStmt *dropStatement);
 
 /* PL/pgSQL plugin declarations */
@@ -166,6 +326,37 @@ static PLpgSQL_plugin PluginFuncs = {
 	.func_end = TeardownPLErrorTransformation
 };
 
+#if (PG_VERSION_NUM >= 90500)
+
+/* custom scan reading the rows fetched by multi-shard SELECTs */
+static CustomScanMethods IntermediateResultScanMethods = {
+	.CustomName = "PgShardIntermediateResultScan",
+	.CreateCustomScanState = CreateIntermediateResultScanState
+};
+static CustomExecMethods IntermediateResultExecMethods = {
+	.CustomName = "PgShardIntermediateResultScan",
+	.BeginCustomScan = BeginIntermediateResultScan,
+	.ExecCustomScan = ExecIntermediateResultScan,
+	.EndCustomScan = EndIntermediateResultScan,
+	.ReScanCustomScan = ReScanIntermediateResultScan
+};
+
+#endif
+
+#if (PG_VERSION_NUM >= 90600)
+
+/* distributed plans are copied when prepared statements cache them */
+static ExtensibleNodeMethods DistributedPlanMethods = {
+	.extnodename = DISTRIBUTED_PLAN_NODE_NAME,
+	.node_size = sizeof(DistributedPlan),
+	.nodeCopy = CopyDistributedPlan,
+	.nodeEqual = EqualDistributedPlans,
+	.nodeOut = OutDistributedPlan,
+	.nodeRead = ReadDistributedPlan
+};
+
+#endif
+
 /* declarations for dynamic loading */
 PG_MODULE_MAGIC;
 
@@ -217,6 +408,13 @@ _PG_init(void)
 	PreviousProcessUtilityHook = ProcessUtility_hook;
 	ProcessUtility_hook = PgShardProcessUtility;
 
+	RequestMetadataCacheSharedMemory();
+	RequestConnectionSharedMemory();
+
+#if (PG_VERSION_NUM >= 90600)
+	RegisterExtensibleNodeMethods(&DistributedPlanMethods);
+#endif
+
 	DefineCustomBoolVariable("pg_shard.all_modifications_commutative",
 							 "Bypasses commutativity checks when enabled", NULL,
 							 &AllModificationsCommutative, false, PGC_USERSET, 0, NULL,
@@ -232,6 +430,19 @@ _PG_init(void)
 							 &UseDtmTransactions, false, PGC_USERSET, 0, NULL,
 							 NULL, NULL);
 
+	DefineCustomIntVariable("pg_shard.max_connections_per_node",
+							"Sets the maximum number of connections to each worker node",
+							"The limit applies to the connections of all sessions "
+							"together. Zero means no limit.",
+							&MaxConnectionsPerNode, 0, 0, INT_MAX, PGC_SIGHUP, 0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_shard.max_parallel_repairs",
+							"Sets the number of shards master_copy_shard_placements "
+							"repairs at once", NULL,
+							&MaxParallelShardRepairs, 4, 1, 64, PGC_USERSET, 0,
+							NULL, NULL, NULL);
+
 	DefineCustomBoolVariable("pg_shard.log_distributed_statements",
 							 "Logs each statement used in a distributed plan", NULL,
 							 &LogDistributedStatements, false, PGC_USERSET, 0, NULL,
@@ -283,7 +494,8 @@ TeardownPLErrorTransformation(PLpgSQL_execstate *estate, PLpgSQL_function *func)
  * PgShardErrorTransform detects an uninformative error message produced when
  * a pg_shard-distributed relation is referenced in bare SQL within a PL/pgSQL
  * function and replaces it with a more specific message to help the user work
- * around the underlying issue.
+ * around the underlying issue. As of PostgreSQL 9.6 distributed plans can be
+ * copied, so PL/pgSQL caches them and the error does not occur.
  */
 static void
 PgShardErrorTransform(void *arg)
@@ -347,9 +559,11 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 	{
 		DistributedPlan *distributedPlan = NULL;
 		Query *distributedQuery = copyObject(query);
+		Param *partitionParameter = NULL;
 		List *queryShardList = NIL;
 		bool selectFromMultipleShards = false;
 		CreateStmt *createTemporaryTableStmt = NULL;
+		char *combineQueryString = NULL;
 
 		/* call standard planner first to have Query transformations performed */
 		plannedStatement = standard_planner(distributedQuery, cursorOptions,
@@ -357,57 +571,118 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 
 		ErrorIfQueryNotSupported(distributedQuery);
 
-		/*
-		 * Compute the list of shards this query needs to access.
-		 * Error out if there are no existing shards for the table.
-		 */
-		queryShardList = DistributedQueryShardList(distributedQuery);
-
-		/*
-		 * If a select query touches multiple shards, we don't push down the
-		 * query as-is, and instead only push down the filter clauses and select
-		 * needed columns. We then copy those results to a local temporary table
-		 * and then modify the original PostgreSQL plan to perform a sequential
-		 * scan on that temporary table.
-		 * XXX: This approach is limited as we cannot handle index or foreign
-		 * scans. We will revisit this by potentially using another type of scan
-		 * node instead of a sequential scan.
-		 */
-		selectFromMultipleShards = SelectFromMultipleShards(query, queryShardList);
-		if (selectFromMultipleShards)
+		if (IsMultiRowInsert(distributedQuery))
 		{
-			Oid distributedTableId = InvalidOid;
-			Query *localQuery = NULL;
-			List *queryRestrictList = QueryRestrictList(distributedQuery);
-			List *remoteRestrictList = NIL;
-			List *localRestrictList = NIL;
-
-			/* partition restrictions into remote and local lists */
-			ClassifyRestrictions(queryRestrictList, &remoteRestrictList,
-								 &localRestrictList);
-
-			/* build local and distributed query */
-			distributedQuery = RowAndColumnFilterQuery(distributedQuery,
-													   remoteRestrictList,
-													   localRestrictList);
-			localQuery = BuildLocalQuery(query, localRestrictList);
+			/* rows are grouped by shard, each shard receives a single INSERT */
+			distributedPlan = BuildMultiRowInsertPlan(distributedQuery);
+		}
+		else if ((partitionParameter = PartitionColumnParameter(distributedQuery)) != NULL)
+		{
+			/*
+			 * Generic plans of prepared statements don't know the partition
+			 * value yet, so the executor picks the shard.
+			 */
+			distributedPlan = BuildRouterPlan(distributedQuery, partitionParameter);
+		}
+		else
+		{
+			/*
+			 * Compute the list of shards this query needs to access.
+			 * Error out if there are no existing shards for the table.
+			 */
+			queryShardList = DistributedQueryShardList(distributedQuery);
 
 			/*
-			 * Force a sequential scan as we change the underlying table to
-			 * point to our intermediate temporary table which contains the
-			 * fetched data.
+			 * If a select query touches multiple shards, we don't push down the
+			 * query as-is, and instead only push down the filter clauses and
+			 * select needed columns. At execution, the sequential scan of the
+			 * local plan is replaced by a custom scan returning the fetched
+			 * rows (before PostgreSQL 9.5, by a sequential scan of a temporary
+			 * table the rows are copied into).
 			 */
-			plannedStatement = PlanSequentialScan(localQuery, cursorOptions, boundParams);
+			selectFromMultipleShards = SelectFromMultipleShards(query, queryShardList);
+			if (selectFromMultipleShards)
+			{
+				Query *localQuery = NULL;
+				List *queryRestrictList = QueryRestrictList(distributedQuery);
+				List *remoteRestrictList = NIL;
+				List *localRestrictList = NIL;
+
+				/* partition restrictions into remote and local lists */
+				ClassifyRestrictions(queryRestrictList, &remoteRestrictList,
+									 &localRestrictList);
+
+				/*
+				 * The parser wraps LIMIT and OFFSET values in a cast to bigint;
+				 * fold them so constant values can be pushed down.
+				 */
+				query->limitOffset = eval_const_expressions(NULL, query->limitOffset);
+				query->limitCount = eval_const_expressions(NULL, query->limitCount);
+
+				/* build local query */
+				localQuery = BuildLocalQuery(query, localRestrictList);
+
+				/*
+				 * Force a sequential scan as we replace it with the scan of the
+				 * fetched data.
+				 */
+				plannedStatement = PlanSequentialScan(localQuery, cursorOptions,
+													  boundParams);
+
+				if (PartialAggregationSafe(query, localRestrictList))
+				{
+					/*
+					 * Shards compute partial aggregates which are then combined
+					 * by a query over the intermediate table, so that only one
+					 * row per group is fetched from each shard.
+					 */
+					List *combineExpressionList = NIL;
+					char *intermediateResultClause = NULL;
+
+					distributedQuery = PartialAggregateQuery(query,
+															 remoteRestrictList,
+															 &combineExpressionList);
+#if (PG_VERSION_NUM >= 90500)
+					intermediateResultClause =
+						IntermediateResultFunctionClause(distributedQuery->targetList);
+#else
+					createTemporaryTableStmt =
+						CreateTemporaryTableStmt(distributedQuery->targetList);
+					intermediateResultClause =
+						psprintf("pg_temp.%s", quote_identifier(
+									 createTemporaryTableStmt->relation->relname));
+#endif
+					combineQueryString =
+						CombineAggregateQueryString(query, combineExpressionList,
+													intermediateResultClause);
+				}
+				else
+				{
+					/* build distributed query */
+					distributedQuery = RowAndColumnFilterQuery(distributedQuery,
+															   remoteRestrictList,
+															   localRestrictList);
+					PushDownSortAndLimit(query, distributedQuery, localRestrictList);
+
+#if (PG_VERSION_NUM < 90500)
+					{
+						/* construct a CreateStmt to clone the existing table */
+						Oid distributedTableId =
+							ExtractFirstDistributedTableId(distributedQuery);
+						createTemporaryTableStmt =
+							CreateTemporaryTableLikeStmt(distributedTableId);
+					}
+#endif
+				}
+			}
 
-			/* construct a CreateStmt to clone the existing table */
-			distributedTableId = ExtractFirstDistributedTableId(distributedQuery);
-			createTemporaryTableStmt = CreateTemporaryTableLikeStmt(distributedTableId);
+			distributedPlan = BuildDistributedPlan(distributedQuery, queryShardList);
 		}
 
-		distributedPlan = BuildDistributedPlan(distributedQuery, queryShardList);
 		distributedPlan->originalPlan = plannedStatement->planTree;
 		distributedPlan->selectFromMultipleShards = selectFromMultipleShards;
 		distributedPlan->createTemporaryTableStmt = createTemporaryTableStmt;
+		distributedPlan->combineQueryString = combineQueryString;
 
 		plannedStatement->planTree = (Plan *) distributedPlan;
 	}
@@ -609,14 +884,14 @@ ErrorIfQueryNotSupported(Query *queryTree)
 						errdetail("Joins are not supported in distributed queries.")));
 	}
 
-	/* reject queries which involve multi-row inserts */
-	if (hasValuesScan)
+	/* multi-row inserts are supported, but VALUES lists elsewhere are not */
+	if (hasValuesScan && commandType != CMD_INSERT)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("cannot perform distributed planning for the given"
 							   " query"),
-						errdetail("Multi-row INSERTs to distributed tables are not "
-								  "supported.")));
+						errdetail("VALUES lists must not appear in the FROM clause "
+								  "of a distributed query.")));
 	}
 
 	/* reject queries with a returning list */
@@ -769,10 +1044,25 @@ DistributedQueryShardList(Query *query)
 	List *prunedShardList = NIL;
 
 	Oid distributedTableId = ExtractFirstDistributedTableId(query);
-	List *shardIntervalList = NIL;
+	List *shardIntervalList = DistributedTableShardList(distributedTableId);
+
+	restrictClauseList = QueryRestrictList(query);
+	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
+									 shardIntervalList);
+
+	return prunedShardList;
+}
 
-	/* error out if no shards exist for the table */
-	shardIntervalList = LookupShardIntervalList(distributedTableId);
+
+/*
+ * DistributedTableShardList returns the list of all shard intervals of the given
+ * distributed table. If the table has no shards whatsoever, the function errors
+ * out.
+ */
+static List *
+DistributedTableShardList(Oid distributedTableId)
+{
+	List *shardIntervalList = LookupShardIntervalList(distributedTableId);
 	if (shardIntervalList == NIL)
 	{
 		char *relationName = get_rel_name(distributedTableId);
@@ -785,11 +1075,118 @@ DistributedQueryShardList(Query *query)
 								"and try again.")));
 	}
 
-	restrictClauseList = QueryRestrictList(query);
-	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
-									 shardIntervalList);
+	return shardIntervalList;
+}
 
-	return prunedShardList;
+
+/*
+ * IsMultiRowInsert returns true if the query is an INSERT whose rows come from
+ * a VALUES list, i.e. an INSERT of more than one row.
+ */
+static bool
+IsMultiRowInsert(Query *query)
+{
+	ListCell *rangeTableCell = NULL;
+
+	if (query->commandType != CMD_INSERT)
+	{
+		return false;
+	}
+
+	foreach(rangeTableCell, query->rtable)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+		if (rangeTableEntry->rtekind == RTE_VALUES)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * PartitionColumnParameter returns the external parameter which provides the
+ * partition value of the given query, i.e. the parameter inserted into the
+ * partition column or compared to it for equality by a top-level qualifier.
+ * The function returns NULL if the query has no such parameter, or if its type
+ * differs from the partition column's type, which prevents shard pruning.
+ */
+static Param *
+PartitionColumnParameter(Query *query)
+{
+	Oid distributedTableId = ExtractFirstDistributedTableId(query);
+	Var *partitionColumn = PartitionColumn(distributedTableId);
+	Node *partitionValue = NULL;
+	Param *partitionParameter = NULL;
+
+	if (query->commandType == CMD_INSERT)
+	{
+		TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+													partitionColumn->varattno);
+		if (targetEntry != NULL)
+		{
+			partitionValue = (Node *) targetEntry->expr;
+		}
+	}
+	else
+	{
+		List *restrictClauseList = QueryRestrictList(query);
+		OpExpr *equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+		ListCell *restrictClauseCell = NULL;
+
+		foreach(restrictClauseCell, restrictClauseList)
+		{
+			Node *restrictClause = (Node *) lfirst(restrictClauseCell);
+			OpExpr *operatorExpression = NULL;
+			Node *leftOperand = NULL;
+			Node *rightOperand = NULL;
+
+			if (!IsA(restrictClause, OpExpr))
+			{
+				continue;
+			}
+
+			operatorExpression = (OpExpr *) restrictClause;
+			if (operatorExpression->opno != equalityExpr->opno ||
+				list_length(operatorExpression->args) != 2)
+			{
+				continue;
+			}
+
+			leftOperand = get_leftop((Expr *) operatorExpression);
+			rightOperand = get_rightop((Expr *) operatorExpression);
+
+			if (IsA(leftOperand, Var) &&
+				((Var *) leftOperand)->varattno == partitionColumn->varattno &&
+				IsA(rightOperand, Param))
+			{
+				partitionValue = rightOperand;
+				break;
+			}
+			else if (IsA(rightOperand, Var) &&
+					 ((Var *) rightOperand)->varattno == partitionColumn->varattno &&
+					 IsA(leftOperand, Param))
+			{
+				partitionValue = leftOperand;
+				break;
+			}
+		}
+	}
+
+	if (partitionValue != NULL && IsA(partitionValue, Param))
+	{
+		Param *parameter = (Param *) partitionValue;
+
+		if (parameter->paramkind == PARAM_EXTERN &&
+			parameter->paramtype == partitionColumn->vartype)
+		{
+			partitionParameter = parameter;
+		}
+	}
+
+	return partitionParameter;
 }
 
 
@@ -924,117 +1321,595 @@ RowAndColumnFilterQuery(Query *query, List *remoteRestrictList, List *localRestr
 
 
 /*
- * BuildLocalQuery returns a copy of query with its quals replaced by those
- * in localRestrictList. Expects queries with a single entry in their FROM
- * list.
+ * PushDownSortAndLimit adds the ORDER BY and LIMIT clauses of the original
+ * query to the given filter query when it is safe to do so: each shard then
+ * returns at most LIMIT + OFFSET rows, and the final ORDER BY, OFFSET and
+ * LIMIT are still applied by the local query. Only plain column sort keys are
+ * pushed down, and queries which could change the number of rows after the
+ * scan (aggregates, DISTINCT, set-returning functions, local filters) are
+ * left untouched.
  */
-static Query *
-BuildLocalQuery(Query *query, List *localRestrictList)
+static void
+PushDownSortAndLimit(Query *query, Query *filterQuery, List *localRestrictList)
 {
-	Query *localQuery = copyObject(query);
-	FromExpr *joinTree = localQuery->jointree;
-
-	Assert(joinTree != NULL);
-	Assert(list_length(joinTree->fromlist) == 1);
-	joinTree->quals = (Node *) make_ands_explicit((List *) localRestrictList);
+	Const *limitCount = (Const *) query->limitCount;
+	Const *limitOffset = (Const *) query->limitOffset;
+	int64 remoteLimit = 0;
+	List *sortClauseList = NIL;
+	Index nextSortGroupRef = 1;
+	ListCell *sortClauseCell = NULL;
+
+	if (limitCount == NULL || !IsA(limitCount, Const) || limitCount->constisnull)
+	{
+		return;
+	}
 
-	return localQuery;
-}
+	if (limitOffset != NULL && (!IsA(limitOffset, Const) || limitOffset->constisnull))
+	{
+		return;
+	}
 
+	if (query->hasAggs || query->hasWindowFuncs || query->groupClause != NIL ||
+		query->distinctClause != NIL || query->havingQual != NULL ||
+		query->rowMarks != NIL || localRestrictList != NIL ||
+		expression_returns_set((Node *) query->targetList))
+	{
+		return;
+	}
 
-/*
- * PlanSequentialScan attempts to plan the given query using only a sequential
- * scan of the underlying table. The function disables index scan types and
- * plans the query. If the plan still contains a non-sequential scan plan node,
- * the function errors out. Note this function modifies the query parameter, so
- * make a copy before calling PlanSequentialScan if that is unacceptable.
- */
-static PlannedStmt *
-PlanSequentialScan(Query *query, int cursorOptions, ParamListInfo boundParams)
-{
-	PlannedStmt *sequentialScanPlan = NULL;
-	bool indexScanEnabledOldValue = false;
-	bool bitmapScanEnabledOldValue = false;
-	List *rangeTableList = NIL;
-	ListCell *rangeTableCell = NULL;
+	remoteLimit = DatumGetInt64(limitCount->constvalue);
+	if (limitOffset != NULL)
+	{
+		int64 offset = DatumGetInt64(limitOffset->constvalue);
+		if (offset > 0 && remoteLimit > PG_INT64_MAX - offset)
+		{
+			return;
+		}
 
-	/* error out if the table is a foreign table */
-	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
+		remoteLimit += Max(offset, 0);
+	}
 
-	foreach(rangeTableCell, rangeTableList)
+	foreach(sortClauseCell, query->sortClause)
 	{
-		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
-		if (rangeTableEntry->rtekind == RTE_RELATION)
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		TargetEntry *sortTargetEntry = get_sortgroupclause_tle(sortClause,
+															   query->targetList);
+		TargetEntry *filterTargetEntry = NULL;
+		SortGroupClause *filterSortClause = NULL;
+		ListCell *targetEntryCell = NULL;
+
+		if (!IsA(sortTargetEntry->expr, Var))
 		{
-			if (rangeTableEntry->relkind == RELKIND_FOREIGN_TABLE)
+			return;
+		}
+
+		foreach(targetEntryCell, filterQuery->targetList)
+		{
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+			if (equal(targetEntry->expr, sortTargetEntry->expr))
 			{
-				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-								errmsg("multi-shard SELECTs from foreign tables are "
-									   "unsupported")));
+				filterTargetEntry = targetEntry;
+				break;
 			}
 		}
-	}
-
-	/* disable index scan types */
-	indexScanEnabledOldValue = enable_indexscan;
-	bitmapScanEnabledOldValue = enable_bitmapscan;
 
-	enable_indexscan = false;
-	enable_bitmapscan = false;
+		if (filterTargetEntry == NULL)
+		{
+			return;
+		}
 
-	sequentialScanPlan = standard_planner(query, cursorOptions, boundParams);
+		if (filterTargetEntry->ressortgroupref == 0)
+		{
+			filterTargetEntry->ressortgroupref = nextSortGroupRef++;
+		}
 
-	enable_indexscan = indexScanEnabledOldValue;
-	enable_bitmapscan = bitmapScanEnabledOldValue;
+		filterSortClause = copyObject(sortClause);
+		filterSortClause->tleSortGroupRef = filterTargetEntry->ressortgroupref;
+		sortClauseList = lappend(sortClauseList, filterSortClause);
+	}
 
-	return sequentialScanPlan;
+	filterQuery->sortClause = sortClauseList;
+	filterQuery->limitCount = (Node *) makeConst(INT8OID, -1, InvalidOid, sizeof(int64),
+												 Int64GetDatum(remoteLimit), false,
+												 FLOAT8PASSBYVAL);
 }
 
 
 /*
- * QueryRestrictList returns the restriction clauses for the query. For a SELECT
- * statement these are the where-clause expressions. For INSERT statements we
- * build an equality clause based on the partition-column and its supplied
- * insert value.
+ * PartialAggregationSafe determines whether the aggregates of the given query
+ * can be computed by the shards and then combined on the master. This is the
+ * case if every target entry is either a grouping expression or one of the
+ * supported aggregates, and the query doesn't have clauses (HAVING, DISTINCT,
+ * window functions, etc.) which would have to be evaluated over the combined
+ * aggregate values.
  */
-static List *
-QueryRestrictList(Query *query)
+static bool
+PartialAggregationSafe(Query *query, List *localRestrictList)
 {
-	List *queryRestrictList = NIL;
-	CmdType commandType = query->commandType;
+	ListCell *targetEntryCell = NULL;
+	ListCell *sortClauseCell = NULL;
 
-	if (commandType == CMD_INSERT)
+	if (!query->hasAggs || query->hasWindowFuncs || query->havingQual != NULL ||
+		query->distinctClause != NIL || query->groupingSets != NIL ||
+		query->rowMarks != NIL || localRestrictList != NIL)
 	{
-		/* build equality expression based on partition column value for row */
-		Oid distributedTableId = ExtractFirstDistributedTableId(query);
-		Var *partitionColumn = PartitionColumn(distributedTableId);
-		Const *partitionValue = ExtractPartitionValue(query, partitionColumn);
-
-		OpExpr *equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
-
-		Node *rightOp = get_rightop((Expr *) equalityExpr);
-		Const *rightConst = (Const *) rightOp;
-		Assert(IsA(rightOp, Const));
-
-		rightConst->constvalue = partitionValue->constvalue;
-		rightConst->constisnull = partitionValue->constisnull;
-		rightConst->constbyval = partitionValue->constbyval;
-
-		queryRestrictList = list_make1(equalityExpr);
+		return false;
 	}
-	else if (commandType == CMD_SELECT || commandType == CMD_UPDATE ||
-			 commandType == CMD_DELETE)
+
+	if ((query->limitCount != NULL && !IsA(query->limitCount, Const)) ||
+		(query->limitOffset != NULL && !IsA(query->limitOffset, Const)))
 	{
-		query_tree_walker(query, ExtractFromExpressionWalker, &queryRestrictList, 0);
+		return false;
 	}
 
-	return queryRestrictList;
-}
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpression = (Node *) targetEntry->expr;
 
+		if (IsA(targetExpression, Aggref))
+		{
+			if (!PartialAggregateSupported((Aggref *) targetExpression))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			bool groupingExpression = false;
+			ListCell *groupClauseCell = NULL;
 
-/*
- * ExtractPartitionValue extracts the partition column value from a the target
- * of a modification command. If a partition value is missing altogether or is
+			foreach(groupClauseCell, query->groupClause)
+			{
+				SortGroupClause *groupClause = (SortGroupClause *) lfirst(groupClauseCell);
+				if (targetEntry->ressortgroupref != 0 &&
+					groupClause->tleSortGroupRef == targetEntry->ressortgroupref)
+				{
+					groupingExpression = true;
+					break;
+				}
+			}
+
+			if (!groupingExpression || expression_returns_set(targetExpression))
+			{
+				return false;
+			}
+		}
+	}
+
+	/* the combining query can only sort using default ordering operators */
+	foreach(sortClauseCell, query->sortClause)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		TargetEntry *sortTargetEntry = get_sortgroupclause_tle(sortClause,
+															   query->targetList);
+
+		if (SortClauseDirection(sortClause, (Node *) sortTargetEntry->expr) == NULL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * PartialAggregateSupported checks whether the given aggregate is one of the
+ * built-in count, sum, min, max or avg aggregates which can be combined from
+ * per-shard values. Aggregates with DISTINCT, ORDER BY or FILTER clauses are
+ * not supported.
+ */
+static bool
+PartialAggregateSupported(Aggref *aggregate)
+{
+	char *aggregateName = NULL;
+
+	if (aggregate->aggdistinct != NIL || aggregate->aggorder != NIL ||
+		aggregate->aggfilter != NULL || aggregate->aggkind != AGGKIND_NORMAL ||
+		aggregate->agglevelsup != 0 || aggregate->aggvariadic)
+	{
+		return false;
+	}
+
+	if (get_func_namespace(aggregate->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	aggregateName = get_func_name(aggregate->aggfnoid);
+	if (strcmp(aggregateName, "count") == 0 || strcmp(aggregateName, "sum") == 0 ||
+		strcmp(aggregateName, "min") == 0 || strcmp(aggregateName, "max") == 0)
+	{
+		return true;
+	}
+	else if (strcmp(aggregateName, "avg") == 0)
+	{
+		Oid *argumentTypes = NULL;
+		int argumentCount = 0;
+
+		get_func_signature(aggregate->aggfnoid, &argumentTypes, &argumentCount);
+		Assert(argumentCount == 1);
+
+		/* avg is computed from sum and count, which we can only do for numbers */
+		switch (argumentTypes[0])
+		{
+			case INT2OID:
+			case INT4OID:
+			case INT8OID:
+			case NUMERICOID:
+			case FLOAT4OID:
+			case FLOAT8OID:
+			{
+				return OidIsValid(AggregateFunctionOid("sum", argumentTypes[0]));
+			}
+
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * AggregateFunctionOid looks up the built-in aggregate with the given name and
+ * argument type. The function returns InvalidOid if no such aggregate exists.
+ */
+static Oid
+AggregateFunctionOid(char *aggregateName, Oid argumentType)
+{
+	List *qualifiedName = list_make2(makeString("pg_catalog"), makeString(aggregateName));
+	bool missingOK = true;
+
+	return LookupFuncName(qualifiedName, 1, &argumentType, missingOK);
+}
+
+
+/*
+ * SortClauseDirection returns the ASC or DESC keyword equivalent to the sort
+ * operator of the given sort clause, or NULL if the clause uses some other
+ * ordering operator.
+ */
+static char *
+SortClauseDirection(SortGroupClause *sortClause, Node *sortExpression)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(exprType(sortExpression),
+												  TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
+
+	if (sortClause->sortop == typeEntry->lt_opr)
+	{
+		return "ASC";
+	}
+	else if (sortClause->sortop == typeEntry->gt_opr)
+	{
+		return "DESC";
+	}
+
+	return NULL;
+}
+
+
+/*
+ * PartialAggregateQuery builds the query sent to the shards for a query which
+ * passed PartialAggregationSafe. The query computes grouping expressions and
+ * per-shard aggregates over the rows matching the remote restrictions; avg is
+ * replaced by a sum and count pair. For each target entry of the original query,
+ * the function also returns the SQL expression combining the partial values,
+ * which refers to the columns of the intermediate table as p1, p2, etc.
+ */
+static Query *
+PartialAggregateQuery(Query *query, List *remoteRestrictList,
+					  List **combineExpressionList)
+{
+	Query *partialQuery = NULL;
+	List *rangeTableList = NIL;
+	List *partialTargetList = NIL;
+	FromExpr *fromExpr = NULL;
+	ListCell *targetEntryCell = NULL;
+
+	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
+	Assert(list_length(rangeTableList) == 1);
+
+	/* build the expression to supply FROM/WHERE for the remote query */
+	fromExpr = makeNode(FromExpr);
+	fromExpr->quals = (Node *) make_ands_explicit((List *) remoteRestrictList);
+	fromExpr->fromlist = QueryFromList(rangeTableList);
+
+	*combineExpressionList = NIL;
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Expr *targetExpression = targetEntry->expr;
+		char *resultType = format_type_with_typemod(exprType((Node *) targetExpression),
+													exprTypmod((Node *) targetExpression));
+		AttrNumber partialColumnId = list_length(partialTargetList) + 1;
+		StringInfo combineExpression = makeStringInfo();
+
+		if (IsA(targetExpression, Aggref))
+		{
+			Aggref *aggregate = (Aggref *) targetExpression;
+			char *aggregateName = get_func_name(aggregate->aggfnoid);
+			Expr *partialExpression = copyObject(aggregate);
+
+			if (strcmp(aggregateName, "count") == 0)
+			{
+				appendStringInfo(combineExpression, "COALESCE(sum(p%d), 0)::%s",
+								 partialColumnId, resultType);
+			}
+			else if (strcmp(aggregateName, "avg") == 0)
+			{
+				Oid *argumentTypes = NULL;
+				int argumentCount = 0;
+				Aggref *partialSum = (Aggref *) partialExpression;
+				Aggref *partialCount = copyObject(aggregate);
+				char *divisionType = NULL;
+
+				get_func_signature(aggregate->aggfnoid, &argumentTypes, &argumentCount);
+
+				partialSum->aggfnoid = AggregateFunctionOid("sum", argumentTypes[0]);
+				partialSum->aggtype = get_func_rettype(partialSum->aggfnoid);
+
+				partialCount->aggfnoid = AggregateFunctionOid("count", ANYOID);
+				partialCount->aggtype = INT8OID;
+
+				/* avg of floating point values is computed in double precision */
+				divisionType = (argumentTypes[0] == FLOAT4OID ||
+								argumentTypes[0] == FLOAT8OID) ? "float8" : "numeric";
+
+				appendStringInfo(combineExpression,
+								 "(sum(p%d)::%s / NULLIF(sum(p%d), 0)::%s)::%s",
+								 partialColumnId, divisionType, partialColumnId + 1,
+								 divisionType, resultType);
+
+				partialTargetList = lappend(partialTargetList,
+											makeTargetEntry(partialExpression,
+															partialColumnId, NULL,
+															false));
+				partialExpression = (Expr *) partialCount;
+				partialColumnId++;
+			}
+			else
+			{
+				/* sum, min and max of partial values give the final value */
+				appendStringInfo(combineExpression, "%s(p%d)::%s", aggregateName,
+								 partialColumnId, resultType);
+			}
+
+			partialTargetList = lappend(partialTargetList,
+										makeTargetEntry(partialExpression,
+														partialColumnId, NULL, false));
+		}
+		else
+		{
+			TargetEntry *partialTargetEntry =
+				makeTargetEntry(copyObject(targetExpression), partialColumnId, NULL,
+								false);
+
+			/* grouping expressions are grouped again on the master */
+			partialTargetEntry->ressortgroupref = targetEntry->ressortgroupref;
+			partialTargetList = lappend(partialTargetList, partialTargetEntry);
+
+			appendStringInfo(combineExpression, "p%d", partialColumnId);
+		}
+
+		*combineExpressionList = lappend(*combineExpressionList, combineExpression->data);
+	}
+
+	partialQuery = makeNode(Query);
+	partialQuery->commandType = CMD_SELECT;
+	partialQuery->rtable = rangeTableList;
+	partialQuery->jointree = fromExpr;
+	partialQuery->targetList = partialTargetList;
+	partialQuery->groupClause = copyObject(query->groupClause);
+	partialQuery->hasAggs = true;
+
+	return partialQuery;
+}
+
+
+/*
+ * CombineAggregateQueryString builds the query which computes the result of
+ * the original query from the partial aggregates, read from the given FROM
+ * clause item. Output columns keep the names and types of the original query,
+ * and its GROUP BY, ORDER BY, OFFSET and LIMIT clauses are applied to combined
+ * values.
+ */
+static char *
+CombineAggregateQueryString(Query *query, List *combineExpressionList,
+							char *intermediateResultClause)
+{
+	StringInfo combineQuery = makeStringInfo();
+	ListCell *targetEntryCell = NULL;
+	ListCell *combineExpressionCell = NULL;
+	ListCell *groupClauseCell = NULL;
+	ListCell *sortClauseCell = NULL;
+	bool firstColumn = true;
+
+	appendStringInfoString(combineQuery, "SELECT ");
+
+	forboth(targetEntryCell, query->targetList,
+			combineExpressionCell, combineExpressionList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		char *combineExpression = (char *) lfirst(combineExpressionCell);
+
+		if (targetEntry->resjunk)
+		{
+			continue;
+		}
+
+		appendStringInfo(combineQuery, "%s%s", firstColumn ? "" : ", ",
+						 combineExpression);
+		if (targetEntry->resname != NULL)
+		{
+			appendStringInfo(combineQuery, " AS %s",
+							 quote_identifier(targetEntry->resname));
+		}
+
+		firstColumn = false;
+	}
+
+	appendStringInfo(combineQuery, " FROM %s", intermediateResultClause);
+
+	foreach(groupClauseCell, query->groupClause)
+	{
+		SortGroupClause *groupClause = (SortGroupClause *) lfirst(groupClauseCell);
+		TargetEntry *groupTargetEntry = get_sortgroupclause_tle(groupClause,
+																query->targetList);
+
+		appendStringInfo(combineQuery, "%s%s",
+						 (groupClauseCell == list_head(query->groupClause)) ?
+						 " GROUP BY " : ", ",
+						 (char *) list_nth(combineExpressionList,
+										   groupTargetEntry->resno - 1));
+	}
+
+	foreach(sortClauseCell, query->sortClause)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		TargetEntry *sortTargetEntry = get_sortgroupclause_tle(sortClause,
+															   query->targetList);
+
+		appendStringInfo(combineQuery, "%s%s %s NULLS %s",
+						 (sortClauseCell == list_head(query->sortClause)) ?
+						 " ORDER BY " : ", ",
+						 (char *) list_nth(combineExpressionList,
+										   sortTargetEntry->resno - 1),
+						 SortClauseDirection(sortClause, (Node *) sortTargetEntry->expr),
+						 sortClause->nulls_first ? "FIRST" : "LAST");
+	}
+
+	if (query->limitOffset != NULL && !((Const *) query->limitOffset)->constisnull)
+	{
+		appendStringInfo(combineQuery, " OFFSET " INT64_FORMAT,
+						 DatumGetInt64(((Const *) query->limitOffset)->constvalue));
+	}
+
+	if (query->limitCount != NULL && !((Const *) query->limitCount)->constisnull)
+	{
+		appendStringInfo(combineQuery, " LIMIT " INT64_FORMAT,
+						 DatumGetInt64(((Const *) query->limitCount)->constvalue));
+	}
+
+	return combineQuery->data;
+}
+
+
+/*
+ * BuildLocalQuery returns a copy of query with its quals replaced by those
+ * in localRestrictList. Expects queries with a single entry in their FROM
+ * list.
+ */
+static Query *
+BuildLocalQuery(Query *query, List *localRestrictList)
+{
+	Query *localQuery = copyObject(query);
+	FromExpr *joinTree = localQuery->jointree;
+
+	Assert(joinTree != NULL);
+	Assert(list_length(joinTree->fromlist) == 1);
+	joinTree->quals = (Node *) make_ands_explicit((List *) localRestrictList);
+
+	return localQuery;
+}
+
+
+/*
+ * PlanSequentialScan attempts to plan the given query using only a sequential
+ * scan of the underlying table. The function disables index scan types and
+ * parallel scans, and plans the query. If the plan still contains a
+ * non-sequential scan plan node, the function errors out. Note this function
+ * modifies the query parameter, so make a copy before calling
+ * PlanSequentialScan if that is unacceptable.
+ */
+static PlannedStmt *
+PlanSequentialScan(Query *query, int cursorOptions, ParamListInfo boundParams)
+{
+	PlannedStmt *sequentialScanPlan = NULL;
+	bool indexScanEnabledOldValue = false;
+	bool bitmapScanEnabledOldValue = false;
+	List *rangeTableList = NIL;
+	ListCell *rangeTableCell = NULL;
+
+	/* error out if the table is a foreign table */
+	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
+
+	foreach(rangeTableCell, rangeTableList)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+		if (rangeTableEntry->rtekind == RTE_RELATION)
+		{
+			if (rangeTableEntry->relkind == RELKIND_FOREIGN_TABLE)
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("multi-shard SELECTs from foreign tables are "
+									   "unsupported")));
+			}
+		}
+	}
+
+	/* disable index scan types */
+	indexScanEnabledOldValue = enable_indexscan;
+	bitmapScanEnabledOldValue = enable_bitmapscan;
+
+	enable_indexscan = false;
+	enable_bitmapscan = false;
+
+#if (PG_VERSION_NUM >= 90600)
+	/* the scan is replaced by one returning the fetched rows in this backend */
+	cursorOptions &= ~CURSOR_OPT_PARALLEL_OK;
+#endif
+
+	sequentialScanPlan = standard_planner(query, cursorOptions, boundParams);
+
+	enable_indexscan = indexScanEnabledOldValue;
+	enable_bitmapscan = bitmapScanEnabledOldValue;
+
+	return sequentialScanPlan;
+}
+
+
+/*
+ * QueryRestrictList returns the restriction clauses for the query. For a SELECT
+ * statement these are the where-clause expressions. For INSERT statements we
+ * build an equality clause based on the partition-column and its supplied
+ * insert value.
+ */
+static List *
+QueryRestrictList(Query *query)
+{
+	List *queryRestrictList = NIL;
+	CmdType commandType = query->commandType;
+
+	if (commandType == CMD_INSERT)
+	{
+		/* build equality expression based on partition column value for row */
+		Oid distributedTableId = ExtractFirstDistributedTableId(query);
+		Var *partitionColumn = PartitionColumn(distributedTableId);
+		Const *partitionValue = ExtractPartitionValue(query, partitionColumn);
+		OpExpr *equalityExpr = PartitionValueRestriction(partitionColumn,
+														 partitionValue);
+
+		queryRestrictList = list_make1(equalityExpr);
+	}
+	else if (commandType == CMD_SELECT || commandType == CMD_UPDATE ||
+			 commandType == CMD_DELETE)
+	{
+		query_tree_walker(query, ExtractFromExpressionWalker, &queryRestrictList, 0);
+	}
+
+	return queryRestrictList;
+}
+
+
+/*
+ * ExtractPartitionValue extracts the partition column value from a the target
+ * of a modification command. If a partition value is missing altogether or is
  * NULL, this function throws an error.
  */
 static Const *
@@ -1061,6 +1936,59 @@ ExtractPartitionValue(Query *query, Var *partitionColumn)
 }
 
 
+/*
+ * PartitionValueRestriction builds an equality expression between the partition
+ * column and the given partition value. Callers looking up the shards of many
+ * rows may directly overwrite the value of the expression's right operand.
+ */
+static OpExpr *
+PartitionValueRestriction(Var *partitionColumn, Const *partitionValue)
+{
+	OpExpr *equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+
+	Node *rightOp = get_rightop((Expr *) equalityExpr);
+	Const *rightConst = (Const *) rightOp;
+	Assert(IsA(rightOp, Const));
+
+	rightConst->constvalue = partitionValue->constvalue;
+	rightConst->constisnull = partitionValue->constisnull;
+	rightConst->constbyval = partitionValue->constbyval;
+
+	return equalityExpr;
+}
+
+
+/*
+ * DestinationShardInterval returns the shard interval that stores rows whose
+ * partition value is given by the partition restriction. The function errors
+ * out if no shard or more than one shard could store such a row.
+ */
+static ShardInterval *
+DestinationShardInterval(Oid distributedTableId, OpExpr *partitionRestriction,
+						 List *shardIntervalList)
+{
+	List *restrictClauseList = list_make1(partitionRestriction);
+	List *prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
+										   shardIntervalList);
+	int prunedShardCount = list_length(prunedShardList);
+
+	if (prunedShardCount == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find destination shard for new row"),
+						errdetail("Target relation does not contain any shards "
+								  "capable of storing the new row.")));
+	}
+	else if (prunedShardCount > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify multiple shards during a single query")));
+	}
+
+	return (ShardInterval *) linitial(prunedShardList);
+}
+
+
 /*
  * ExtractFromExpressionWalker walks over a FROM expression, and finds all
  * explicit qualifiers in the expression.
@@ -1134,6 +2062,53 @@ TargetEntryList(List *expressionList)
 }
 
 
+#if (PG_VERSION_NUM >= 90500)
+
+/*
+ * IntermediateResultFunctionClause returns the FROM clause item through which
+ * the query combining partial aggregates reads them: a call of a function
+ * returning no rows, with one column for each entry of the given target list.
+ * Columns are named p1, p2, etc. and have types of the target expressions. The
+ * scan of the function is replaced by the scan of the fetched partial
+ * aggregates once the query is planned.
+ */
+static char *
+IntermediateResultFunctionClause(List *partialTargetList)
+{
+	StringInfo fromClause = makeStringInfo();
+	ListCell *targetEntryCell = NULL;
+
+	appendStringInfoString(fromClause,
+						   "pg_catalog.json_to_recordset('[]') AS intermediate_result(");
+
+	foreach(targetEntryCell, partialTargetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpression = (Node *) targetEntry->expr;
+		Oid columnType = exprType(targetExpression);
+		Oid columnCollation = exprCollation(targetExpression);
+
+		appendStringInfo(fromClause, "%sp%d %s",
+						 (targetEntryCell == list_head(partialTargetList)) ? "" : ", ",
+						 targetEntry->resno,
+						 format_type_with_typemod(columnType,
+												  exprTypmod(targetExpression)));
+
+		if (OidIsValid(columnCollation) &&
+			columnCollation != get_typcollation(columnType))
+		{
+			appendStringInfo(fromClause, " COLLATE %s",
+							 generate_collation_name(columnCollation));
+		}
+	}
+
+	appendStringInfoChar(fromClause, ')');
+
+	return fromClause->data;
+}
+
+#else
+
 /*
  * CreateTemporaryTableLikeStmt returns a CreateStmt node which will create a
  * clone of the given relation using the CREATE TEMPORARY TABLE LIKE option.
@@ -1143,9 +2118,7 @@ TargetEntryList(List *expressionList)
 static CreateStmt *
 CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 {
-	static unsigned long temporaryTableId = 0;
 	CreateStmt *createStmt = NULL;
-	StringInfo clonedTableName = NULL;
 	RangeVar *clonedRelation = NULL;
 
 	char *sourceTableName = get_rel_name(sourceRelationId);
@@ -1157,14 +2130,7 @@ CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 	tableLikeClause->relation = sourceRelation;
 	tableLikeClause->options = 0; /* don't copy over indexes/constraints etc */
 
-	/* create a unique name for the cloned table */
-	clonedTableName = makeStringInfo();
-	appendStringInfo(clonedTableName, "%s_%d_%lu", TEMPORARY_TABLE_PREFIX, MyProcPid,
-					 temporaryTableId);
-	temporaryTableId++;
-
-	clonedRelation = makeRangeVar(NULL, clonedTableName->data, -1);
-	clonedRelation->relpersistence = RELPERSISTENCE_TEMP;
+	clonedRelation = TemporaryTableRangeVar();
 
 	createStmt = makeNode(CreateStmt);
 	createStmt->relation = clonedRelation;
@@ -1175,6 +2141,89 @@ CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 }
 
 
+/*
+ * CreateTemporaryTableStmt returns a CreateStmt node which will create a
+ * temporary table with one column for each entry of the given target list.
+ * Columns are named p1, p2, etc. and have types of the target expressions.
+ */
+static CreateStmt *
+CreateTemporaryTableStmt(List *targetList)
+{
+	CreateStmt *createStmt = NULL;
+	List *columnDefinitionList = NIL;
+	ListCell *targetEntryCell = NULL;
+
+	foreach(targetEntryCell, targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpression = (Node *) targetEntry->expr;
+		ColumnDef *columnDefinition = makeNode(ColumnDef);
+		StringInfo columnName = makeStringInfo();
+
+		appendStringInfo(columnName, "p%d", targetEntry->resno);
+
+		columnDefinition->colname = columnName->data;
+		columnDefinition->typeName = makeTypeNameFromOid(exprType(targetExpression),
+														 exprTypmod(targetExpression));
+		columnDefinition->collOid = exprCollation(targetExpression);
+		columnDefinition->is_local = true;
+
+		columnDefinitionList = lappend(columnDefinitionList, columnDefinition);
+	}
+
+	createStmt = makeNode(CreateStmt);
+	createStmt->relation = TemporaryTableRangeVar();
+	createStmt->tableElts = columnDefinitionList;
+	createStmt->oncommit = ONCOMMIT_DROP;
+
+	return createStmt;
+}
+
+
+/*
+ * TemporaryTableRangeVar returns a RangeVar with a unique name for a temporary
+ * table holding intermediate results of a multi-shard query.
+ */
+static RangeVar *
+TemporaryTableRangeVar(void)
+{
+	static unsigned long temporaryTableId = 0;
+	StringInfo temporaryTableName = makeStringInfo();
+	RangeVar *temporaryTable = NULL;
+
+	appendStringInfo(temporaryTableName, "%s_%d_%lu", TEMPORARY_TABLE_PREFIX,
+					 MyProcPid, temporaryTableId);
+	temporaryTableId++;
+
+	temporaryTable = makeRangeVar(NULL, temporaryTableName->data, -1);
+	temporaryTable->relpersistence = RELPERSISTENCE_TEMP;
+
+	return temporaryTable;
+}
+
+#endif
+
+
+/*
+ * MakeDistributedPlan creates an empty DistributedPlan. As of PostgreSQL 9.6 the
+ * plan is an extensible node, which the plan cache can copy.
+ */
+static DistributedPlan *
+MakeDistributedPlan(void)
+{
+	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
+
+#if (PG_VERSION_NUM >= 90600)
+	distributedPlan->node.type = T_ExtensibleNode;
+	distributedPlan->node.extnodename = DISTRIBUTED_PLAN_NODE_NAME;
+#else
+	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+#endif
+
+	return distributedPlan;
+}
+
+
 /*
  * BuildDistributedPlan simply creates the DistributedPlan instance from the
  * provided query and shard interval list.
@@ -1184,24 +2233,15 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 {
 	ListCell *shardIntervalCell = NULL;
 	List *taskList = NIL;
-	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
-	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+	DistributedPlan *distributedPlan = MakeDistributedPlan();
 	distributedPlan->targetList = query->targetList;
 
 	foreach(shardIntervalCell, shardIntervalList)
 	{
 		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
 		int64 shardId = shardInterval->id;
-		List *finalizedPlacementList = NIL;
 		FromExpr *joinTree = NULL;
 		Task *task = NULL;
-		StringInfo queryString = makeStringInfo();
-
-		/* grab shared metadata lock to stop concurrent placement additions */
-		LockShardDistributionMetadata(shardId, ShareLock);
-
-		/* now safe to populate placement list */
-		finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
 
 		/*
 		 * Convert the qualifiers to an explicitly and'd clause, which is needed
@@ -1218,26 +2258,408 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 			}
 		}
 
-		deparse_shard_query(query, shardId, queryString);
+		task = BuildShardTask(query, shardId);
+		taskList = lappend(taskList, task);
+	}
+
+	distributedPlan->taskList = taskList;
+
+	return distributedPlan;
+}
+
+
+/*
+ * BuildMultiRowInsertPlan builds the distributed plan of an INSERT with a VALUES
+ * list. The function assigns each row to the shard storing its partition value,
+ * and creates one task per destination shard which inserts all of its rows.
+ */
+static DistributedPlan *
+BuildMultiRowInsertPlan(Query *query)
+{
+	Oid distributedTableId = ExtractFirstDistributedTableId(query);
+	Var *partitionColumn = PartitionColumn(distributedTableId);
+	List *shardIntervalList = DistributedTableShardList(distributedTableId);
+	RangeTblEntry *valuesRangeTableEntry = NULL;
+	List *originalValuesLists = NIL;
+	TargetEntry *partitionTargetEntry = NULL;
+	Var *valuesColumn = NULL;
+	Const *nullPartitionValue = NULL;
+	OpExpr *partitionRestriction = NULL;
+	Const *restrictionValue = NULL;
+	List *shardList = NIL;
+	List *shardRowListList = NIL;
+	ListCell *valuesListCell = NULL;
+	ListCell *shardCell = NULL;
+	ListCell *shardRowListCell = NULL;
+	List *taskList = NIL;
+
+	DistributedPlan *distributedPlan = MakeDistributedPlan();
+	distributedPlan->targetList = query->targetList;
+
+	/* the target list references the columns of the VALUES list */
+	partitionTargetEntry = get_tle_by_resno(query->targetList,
+											partitionColumn->varattno);
+	if (partitionTargetEntry == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg("cannot plan INSERT using row with NULL value "
+							   "in partition column")));
+	}
+
+	valuesColumn = (Var *) partitionTargetEntry->expr;
+	Assert(IsA(valuesColumn, Var));
+
+	valuesRangeTableEntry = rt_fetch(valuesColumn->varno, query->rtable);
+	Assert(valuesRangeTableEntry->rtekind == RTE_VALUES);
+	originalValuesLists = valuesRangeTableEntry->values_lists;
+
+	nullPartitionValue = makeNullConst(partitionColumn->vartype,
+									   partitionColumn->vartypmod,
+									   partitionColumn->varcollid);
+	partitionRestriction = PartitionValueRestriction(partitionColumn,
+													 nullPartitionValue);
+	restrictionValue = (Const *) get_rightop((Expr *) partitionRestriction);
+
+	/* group the rows by destination shard */
+	foreach(valuesListCell, originalValuesLists)
+	{
+		List *valuesList = (List *) lfirst(valuesListCell);
+		Node *partitionValueNode = list_nth(valuesList, valuesColumn->varattno - 1);
+		Const *partitionValue = NULL;
+		ShardInterval *shardInterval = NULL;
+		List **shardRowList = NULL;
+
+		if (!IsA(partitionValueNode, Const))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot plan sharded modification containing "
+								   "values which are not constants or constant "
+								   "expressions")));
+		}
+
+		partitionValue = (Const *) partitionValueNode;
+		if (partitionValue->constisnull)
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("cannot plan INSERT using row with NULL value "
+								   "in partition column")));
+		}
+
+		restrictionValue->constvalue = partitionValue->constvalue;
+		restrictionValue->constisnull = false;
+
+		shardInterval = DestinationShardInterval(distributedTableId,
+												 partitionRestriction,
+												 shardIntervalList);
+
+		forboth(shardCell, shardList, shardRowListCell, shardRowListList)
+		{
+			ShardInterval *listedShardInterval = (ShardInterval *) lfirst(shardCell);
+			if (listedShardInterval->id == shardInterval->id)
+			{
+				shardRowList = (List **) &lfirst(shardRowListCell);
+				break;
+			}
+		}
+
+		if (shardRowList == NULL)
+		{
+			shardList = lappend(shardList, shardInterval);
+			shardRowListList = lappend(shardRowListList, NIL);
+			shardRowList = (List **) &llast(shardRowListList);
+		}
+
+		*shardRowList = lappend(*shardRowList, valuesList);
+	}
+
+	/* deparse one INSERT per shard, with only the rows that shard stores */
+	forboth(shardCell, shardList, shardRowListCell, shardRowListList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardCell);
+		List *shardRowList = (List *) lfirst(shardRowListCell);
+		Task *task = NULL;
+
+		valuesRangeTableEntry->values_lists = shardRowList;
+
+		task = BuildShardTask(query, shardInterval->id);
+		taskList = lappend(taskList, task);
+	}
+
+	valuesRangeTableEntry->values_lists = originalValuesLists;
+
+	distributedPlan->taskList = taskList;
+
+	return distributedPlan;
+}
+
+
+/*
+ * BuildRouterPlan builds the distributed plan of a single-shard query whose
+ * partition value is given by a parameter. The plan keeps the query and its
+ * template, i.e. the query deparsed without shard names. Its tasks are only
+ * created by the executor, once the parameter's value is known.
+ */
+static DistributedPlan *
+BuildRouterPlan(Query *query, Param *partitionParameter)
+{
+	FromExpr *joinTree = query->jointree;
+	StringInfo queryTemplate = makeStringInfo();
+
+	DistributedPlan *distributedPlan = MakeDistributedPlan();
+	distributedPlan->targetList = query->targetList;
+
+	/* deparsing needs explicitly and'd qualifiers, see BuildDistributedPlan */
+	if ((joinTree != NULL) && (joinTree->quals != NULL))
+	{
+		Node *whereClause = joinTree->quals;
+		if (IsA(whereClause, List))
+		{
+			joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
+		}
+	}
+
+	/* a non-positive shard identifier omits shard names */
+	deparse_shard_query(query, 0, queryTemplate);
+
+	distributedPlan->routerQuery = query;
+	distributedPlan->routerQueryTemplate = queryTemplate->data;
+	distributedPlan->partitionParameterId = partitionParameter->paramid;
+
+	return distributedPlan;
+}
+
+
+/*
+ * BuildShardTask creates the task which runs the given query on the specified
+ * shard. The task is executed on the shard's finalized placements.
+ */
+static Task *
+BuildShardTask(Query *query, int64 shardId)
+{
+	List *finalizedPlacementList = NIL;
+	Task *task = NULL;
+	StringInfo queryString = makeStringInfo();
+
+	/* grab shared metadata lock to stop concurrent placement additions */
+	LockShardDistributionMetadata(shardId, ShareLock);
+
+	/* now safe to populate placement list */
+	finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
+
+	deparse_shard_query(query, shardId, queryString);
+
+	if (LogDistributedStatements)
+	{
+		ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+	}
+
+	task = (Task *) palloc0(sizeof(Task));
+	task->queryString = queryString;
+	task->taskPlacementList = finalizedPlacementList;
+	task->shardId = shardId;
+
+	return task;
+}
+
+
+#if (PG_VERSION_NUM >= 90600)
+
+/*
+ * CopyDistributedPlan deep copies the fields of a distributed plan. The plan
+ * cache calls this function when it saves the plan of a prepared statement.
+ */
+static void
+CopyDistributedPlan(ExtensibleNode *newNode, const ExtensibleNode *oldNode)
+{
+	DistributedPlan *newPlan = (DistributedPlan *) newNode;
+	const DistributedPlan *oldPlan = (const DistributedPlan *) oldNode;
+	ListCell *taskCell = NULL;
+
+	newPlan->originalPlan = copyObject(oldPlan->originalPlan);
+
+	newPlan->taskList = NIL;
+	foreach(taskCell, oldPlan->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		newPlan->taskList = lappend(newPlan->taskList, CopyTask(task));
+	}
+
+	newPlan->targetList = copyObject(oldPlan->targetList);
+	newPlan->selectFromMultipleShards = oldPlan->selectFromMultipleShards;
+	newPlan->createTemporaryTableStmt = copyObject(oldPlan->createTemporaryTableStmt);
+	if (oldPlan->combineQueryString != NULL)
+	{
+		newPlan->combineQueryString = pstrdup(oldPlan->combineQueryString);
+	}
+
+	newPlan->routerQuery = copyObject(oldPlan->routerQuery);
+	if (oldPlan->routerQueryTemplate != NULL)
+	{
+		newPlan->routerQueryTemplate = pstrdup(oldPlan->routerQueryTemplate);
+	}
+	newPlan->partitionParameterId = oldPlan->partitionParameterId;
+}
+
+
+/*
+ * CopyTask returns a deep copy of the given task, including its placements.
+ */
+static Task *
+CopyTask(Task *task)
+{
+	Task *taskCopy = (Task *) palloc0(sizeof(Task));
+	ListCell *placementCell = NULL;
+
+	taskCopy->queryString = makeStringInfo();
+	appendStringInfoString(taskCopy->queryString, task->queryString->data);
+
+	foreach(placementCell, task->taskPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		ShardPlacement *placementCopy = (ShardPlacement *) palloc(sizeof(ShardPlacement));
+
+		memcpy(placementCopy, placement, sizeof(ShardPlacement));
+		placementCopy->nodeName = pstrdup(placement->nodeName);
+
+		taskCopy->taskPlacementList = lappend(taskCopy->taskPlacementList,
+											  placementCopy);
+	}
+
+	taskCopy->shardId = task->shardId;
+	if (task->preparedStatementName != NULL)
+	{
+		taskCopy->preparedStatementName = pstrdup(task->preparedStatementName);
+	}
+	taskCopy->parameterList = copyParamList(task->parameterList);
+
+	return taskCopy;
+}
+
+
+/*
+ * EqualDistributedPlans compares two distributed plans. Tasks are compared by
+ * their shard and query string; their placements are metadata looked up while
+ * planning, and are left out of the comparison.
+ */
+static bool
+EqualDistributedPlans(const ExtensibleNode *leftNode, const ExtensibleNode *rightNode)
+{
+	const DistributedPlan *leftPlan = (const DistributedPlan *) leftNode;
+	const DistributedPlan *rightPlan = (const DistributedPlan *) rightNode;
+
+	return equal(leftPlan->originalPlan, rightPlan->originalPlan) &&
+		   EqualTaskLists(leftPlan->taskList, rightPlan->taskList) &&
+		   equal(leftPlan->targetList, rightPlan->targetList) &&
+		   leftPlan->selectFromMultipleShards == rightPlan->selectFromMultipleShards &&
+		   equal(leftPlan->createTemporaryTableStmt,
+				 rightPlan->createTemporaryTableStmt) &&
+		   EqualStrings(leftPlan->combineQueryString, rightPlan->combineQueryString) &&
+		   equal(leftPlan->routerQuery, rightPlan->routerQuery) &&
+		   EqualStrings(leftPlan->routerQueryTemplate, rightPlan->routerQueryTemplate) &&
+		   leftPlan->partitionParameterId == rightPlan->partitionParameterId;
+}
+
+
+/*
+ * EqualTaskLists checks whether the given task lists run the same queries on
+ * the same shards, in the same order.
+ */
+static bool
+EqualTaskLists(List *leftTaskList, List *rightTaskList)
+{
+	ListCell *leftTaskCell = NULL;
+	ListCell *rightTaskCell = NULL;
+
+	if (list_length(leftTaskList) != list_length(rightTaskList))
+	{
+		return false;
+	}
+
+	forboth(leftTaskCell, leftTaskList, rightTaskCell, rightTaskList)
+	{
+		Task *leftTask = (Task *) lfirst(leftTaskCell);
+		Task *rightTask = (Task *) lfirst(rightTaskCell);
 
-		if (LogDistributedStatements)
+		if (leftTask->shardId != rightTask->shardId ||
+			strcmp(leftTask->queryString->data, rightTask->queryString->data) != 0)
 		{
-			ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+			return false;
 		}
+	}
 
-		task = (Task *) palloc0(sizeof(Task));
-		task->queryString = queryString;
-		task->taskPlacementList = finalizedPlacementList;
-		task->shardId = shardId;
+	return true;
+}
 
-		taskList = lappend(taskList, task);
+
+/*
+ * EqualStrings compares two strings, either of which may be NULL.
+ */
+static bool
+EqualStrings(const char *leftString, const char *rightString)
+{
+	if (leftString == NULL || rightString == NULL)
+	{
+		return (leftString == rightString);
 	}
 
-	distributedPlan->taskList = taskList;
+	return (strcmp(leftString, rightString) == 0);
+}
 
-	return distributedPlan;
+
+/*
+ * OutDistributedPlan writes a text representation of a distributed plan, such
+ * as the one logged by debug_print_plan. Tasks are written as their shard IDs
+ * and query strings.
+ */
+static void
+OutDistributedPlan(StringInfo str, const ExtensibleNode *node)
+{
+	const DistributedPlan *distributedPlan = (const DistributedPlan *) node;
+	ListCell *taskCell = NULL;
+
+	appendStringInfoString(str, " :originalPlan ");
+	outNode(str, distributedPlan->originalPlan);
+
+	appendStringInfoString(str, " :taskList (");
+	foreach(taskCell, distributedPlan->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		appendStringInfo(str, "{TASK :shardId " INT64_FORMAT " :queryString ",
+						 task->shardId);
+		outToken(str, task->queryString->data);
+		appendStringInfoChar(str, '}');
+	}
+	appendStringInfoChar(str, ')');
+
+	appendStringInfoString(str, " :targetList ");
+	outNode(str, distributedPlan->targetList);
+	appendStringInfo(str, " :selectFromMultipleShards %s",
+					 distributedPlan->selectFromMultipleShards ? "true" : "false");
+	appendStringInfoString(str, " :combineQueryString ");
+	outToken(str, distributedPlan->combineQueryString);
+	appendStringInfoString(str, " :routerQuery ");
+	outNode(str, distributedPlan->routerQuery);
+	appendStringInfoString(str, " :routerQueryTemplate ");
+	outToken(str, distributedPlan->routerQueryTemplate);
+	appendStringInfo(str, " :partitionParameterId %d",
+					 distributedPlan->partitionParameterId);
+}
+
+
+/*
+ * ReadDistributedPlan errors out: distributed plans are only used by the
+ * backend which planned them, so they are never read back.
+ */
+static void
+ReadDistributedPlan(ExtensibleNode *node)
+{
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("cannot read pg_shard distributed plans")));
 }
 
+#endif
+
 
 /*
  * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
@@ -1255,8 +2677,29 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 	{
 		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
 		bool selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
-		bool zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+		bool zeroShardQuery = false;
+
+		/* router plans pick their shard using the parameter values */
+		if (distributedPlan->routerQuery != NULL)
+		{
+			plannedStatement = RouterExecutionStatement(plannedStatement,
+														queryDesc->params);
+			distributedPlan = (DistributedPlan *) plannedStatement->planTree;
+		}
+		else
+		{
+			/*
+			 * The plan of a prepared statement stays in the plan cache, so we
+			 * swap plan trees in a copy of the statement.
+			 */
+			PlannedStmt *statementCopy = (PlannedStmt *) palloc(sizeof(PlannedStmt));
+			memcpy(statementCopy, plannedStatement, sizeof(PlannedStmt));
+			plannedStatement = statementCopy;
+		}
 
+		queryDesc->plannedstmt = plannedStatement;
+
+		zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
 		if (zeroShardQuery)
 		{
 			/* if zero shards are involved, let non-INSERTs hit local table */
@@ -1305,8 +2748,64 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 				AcquireExecutorShardLocks(distributedPlan->taskList, lockMode);
 			}
 		}
+		else if (distributedPlan->combineQueryString != NULL)
+		{
+#if (PG_VERSION_NUM >= 90500)
+			/*
+			 * If aggregates of a multi-shard SELECT are pushed down, we run the
+			 * query combining the partial aggregates instead of the original
+			 * plan. The partial aggregates are fetched from the remote nodes by
+			 * the custom scan taking the place of the query's function scan.
+			 */
+			PlannedStmt *combineStatement =
+				PlanCombineQuery(distributedPlan->combineQueryString);
+
+			combineStatement->planTree =
+				ReplaceScanWithIntermediateResult(combineStatement->planTree,
+												  distributedPlan);
+			queryDesc->plannedstmt = combineStatement;
+#else
+
+			/*
+			 * If aggregates of a multi-shard SELECT are pushed down, we fetch
+			 * partial aggregates from the remote nodes into a temp table. Now
+			 * that the table exists, we plan the query combining them and run
+			 * it instead of the original plan.
+			 */
+			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
+			const char *queryDescription = "create temp table";
+			RangeVar *intermediateResultTable = createStmt->relation;
+
+			ProcessUtility((Node *) createStmt, queryDescription,
+						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+
+			StoreResultsInTable(distributedPlan, intermediateResultTable);
+
+			/* update the query descriptor snapshot so results are visible */
+			UnregisterSnapshot(queryDesc->snapshot);
+			UpdateActiveSnapshotCommandId();
+			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+
+			queryDesc->plannedstmt = PlanCombineQuery(distributedPlan->combineQueryString);
+#endif
+
+			NextExecutorStartHook(queryDesc, eflags);
+		}
 		else
 		{
+#if (PG_VERSION_NUM >= 90500)
+			/*
+			 * If its a SELECT query over multiple shards, we replace the
+			 * sequential scan of the local plan with a custom scan, which
+			 * fetches the relevant data from the remote nodes when it is first
+			 * read.
+			 */
+			Plan *localPlan = copyObject(distributedPlan->originalPlan);
+
+			plannedStatement->planTree =
+				ReplaceScanWithIntermediateResult(localPlan, distributedPlan);
+#else
+
 			/*
 			 * If its a SELECT query over multiple shards, we fetch the relevant
 			 * data from the remote nodes and insert it into a temp table. We then
@@ -1327,7 +2826,7 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
 
 			/* execute select queries and fetch results into the temp table */
-			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable);
+			StoreResultsInTable(distributedPlan, intermediateResultTable);
 
 			/* update the query descriptor snapshot so results are visible */
 			UnregisterSnapshot(queryDesc->snapshot);
@@ -1346,17 +2845,159 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 			/* swap in modified (local) plan for compatibility with standard start hook */
 			originalPlan = distributedPlan->originalPlan;
 			plannedStatement->planTree = originalPlan;
+#endif
 
 			NextExecutorStartHook(queryDesc, eflags);
 		}
 	}
 	else
 	{
+		/* shard and placement changes invalidate all cached metadata */
+		if (PlanModifiesDistributionMetadata(plannedStatement))
+		{
+			InvalidateMetadataCache();
+		}
+
 		NextExecutorStartHook(queryDesc, eflags);
 	}
 }
 
 
+/*
+ * PlanCombineQuery parses, analyzes and plans the query combining partial
+ * aggregates of a multi-shard SELECT.
+ */
+static PlannedStmt *
+PlanCombineQuery(char *combineQueryString)
+{
+	List *parseTreeList = raw_parser(combineQueryString);
+	List *queryList = NIL;
+
+	Assert(list_length(parseTreeList) == 1);
+	queryList = pg_analyze_and_rewrite((Node *) linitial(parseTreeList),
+									   combineQueryString, NULL, 0);
+	Assert(list_length(queryList) == 1);
+
+	return pg_plan_query((Query *) linitial(queryList), 0, NULL);
+}
+
+
+/*
+ * RouterExecutionStatement prepares a router plan for execution with the given
+ * parameter values. The function prunes the shards using the value of the
+ * partition parameter, and returns a copy of the planned statement whose plan
+ * has the task running the query on the remaining shard, or no task if no
+ * shard remains. The task runs the shard's statement from the router statement
+ * cache, which prepares it on each worker connection once.
+ */
+static PlannedStmt *
+RouterExecutionStatement(PlannedStmt *plannedStatement, ParamListInfo parameterList)
+{
+	DistributedPlan *routerPlan = (DistributedPlan *) plannedStatement->planTree;
+	Query *routerQuery = routerPlan->routerQuery;
+	int partitionParameterId = routerPlan->partitionParameterId;
+	Oid distributedTableId = ExtractFirstDistributedTableId(routerQuery);
+	Var *partitionColumn = PartitionColumn(distributedTableId);
+	List *shardIntervalList = DistributedTableShardList(distributedTableId);
+	ParamExternData *partitionParameter = NULL;
+	List *prunedShardList = NIL;
+	PlannedStmt *executionStatement = NULL;
+	DistributedPlan *executionPlan = NULL;
+	List *taskList = NIL;
+
+	if (parameterList == NULL || partitionParameterId <= 0 ||
+		partitionParameterId > parameterList->numParams)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+						errmsg("no value found for parameter %d",
+							   partitionParameterId)));
+	}
+
+	partitionParameter = &parameterList->params[partitionParameterId - 1];
+	if (!OidIsValid(partitionParameter->ptype) && parameterList->paramFetch != NULL)
+	{
+		(*parameterList->paramFetch)(parameterList, partitionParameterId);
+	}
+
+	if (partitionParameter->isnull && routerQuery->commandType == CMD_INSERT)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg("cannot plan INSERT using row with NULL value "
+							   "in partition column")));
+	}
+
+	/* a NULL partition value equals nothing, so no shard has matching rows */
+	if (!partitionParameter->isnull)
+	{
+		Const *partitionValue = makeConst(partitionColumn->vartype,
+										  partitionColumn->vartypmod,
+										  partitionColumn->varcollid,
+										  get_typlen(partitionColumn->vartype),
+										  partitionParameter->value, false,
+										  get_typbyval(partitionColumn->vartype));
+		OpExpr *partitionRestriction = PartitionValueRestriction(partitionColumn,
+																 partitionValue);
+
+		prunedShardList = PruneShardList(distributedTableId,
+										 list_make1(partitionRestriction),
+										 shardIntervalList);
+	}
+
+	if (list_length(prunedShardList) > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot execute prepared query on multiple shards")));
+	}
+	else if (list_length(prunedShardList) == 1)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) linitial(prunedShardList);
+		int64 shardId = shardInterval->id;
+		RouterStatementEntry *statementEntry = NULL;
+		Task *task = (Task *) palloc0(sizeof(Task));
+
+		/* grab shared metadata lock to stop concurrent placement additions */
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		task->queryString = makeStringInfo();
+		task->taskPlacementList = LoadFinalizedShardPlacementList(shardId);
+		task->shardId = shardId;
+		task->parameterList = parameterList;
+
+		statementEntry = LookupRouterStatement(routerQuery,
+											   routerPlan->routerQueryTemplate,
+											   shardId);
+		if (statementEntry != NULL)
+		{
+			appendStringInfoString(task->queryString, statementEntry->queryString);
+			task->preparedStatementName = statementEntry->statementName;
+		}
+		else
+		{
+			deparse_shard_query(routerQuery, shardId, task->queryString);
+		}
+
+		if (LogDistributedStatements)
+		{
+			ereport(LOG, (errmsg("distributed statement: %s",
+								 task->queryString->data)));
+		}
+
+		taskList = list_make1(task);
+	}
+
+	executionPlan = (DistributedPlan *) palloc(sizeof(DistributedPlan));
+	memcpy(executionPlan, routerPlan, sizeof(DistributedPlan));
+	executionPlan->taskList = taskList;
+	executionPlan->routerQuery = NULL;
+
+	executionStatement = (PlannedStmt *) palloc(sizeof(PlannedStmt));
+	memcpy(executionStatement, plannedStatement, sizeof(PlannedStmt));
+	executionStatement->planTree = (Plan *) executionPlan;
+
+	return executionStatement;
+}
+
+
 /*
  * IsPgShardPlan determines whether the provided plannedStmt contains a plan
  * suitable for execution by PgShard.
@@ -1365,8 +3006,20 @@ static bool
 IsPgShardPlan(PlannedStmt *plannedStmt)
 {
 	Plan *plan = plannedStmt->planTree;
+#if (PG_VERSION_NUM >= 90600)
+	bool isPgShardPlan = false;
+
+	if (IsA(plan, ExtensibleNode))
+	{
+		ExtensibleNode *extensibleNode = (ExtensibleNode *) plan;
+
+		isPgShardPlan = (strcmp(extensibleNode->extnodename,
+								DISTRIBUTED_PLAN_NODE_NAME) == 0);
+	}
+#else
 	NodeTag nodeTag = nodeTag(plan);
 	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+#endif
 
 	return isPgShardPlan;
 }
@@ -1484,17 +3137,33 @@ CompareTasksByShardId(const void *leftElement, const void *rightElement)
 
 /*
  * ExecuteMultipleShardSelect executes the SELECT queries in the distributed
- * plan and inserts the returned rows into the given tableId.
+ * plan and returns the list of tuplestores holding the rows returned for each
+ * task, in task order. Queries are sent to all shards at once and their results
+ * are consumed as they arrive, so the latency of the statement is that of the
+ * slowest shard rather than the sum of all of them. Rows of a task are buffered
+ * until the task completes, so that the task can be retried on the next
+ * placement if the current one fails.
  */
-static void
+static List *
 ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
-						   RangeVar *intermediateTable)
+						   TupleDesc tupleStoreDescriptor)
 {
 	List *taskList = distributedPlan->taskList;
-	List *targetList = distributedPlan->targetList;
+	List *tupleStoreList = NIL;
+	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleStoreDescriptor);
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"ExecuteMultipleShardSelect",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
 
-	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
-	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
+	int executionCount = list_length(taskList);
+	ShardSelectExecution *executionArray =
+		(ShardSelectExecution *) palloc0(executionCount * sizeof(ShardSelectExecution));
+	struct pollfd *pollDescriptorArray =
+		(struct pollfd *) palloc0(executionCount * sizeof(struct pollfd));
+	int receivedCount = 0;
+	int executionIndex = 0;
 
 	ListCell *taskCell = NULL;
 
@@ -1503,31 +3172,211 @@ ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
 	foreach(taskCell, taskList)
 	{
 		Task *task = (Task *) lfirst(taskCell);
-		Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
-		bool resultsOK = false;
+		ShardSelectExecution *execution = &executionArray[executionIndex++];
+
+		if (UseDtmTransactions)
+		{
+			PrepareDtmTransaction(task);
+		}
+
+		execution->task = task;
+		execution->placementCell = list_head(task->taskPlacementList);
+		execution->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	}
+
+	while (receivedCount < executionCount)
+	{
+		int pollCount = 0;
+
+		for (executionIndex = 0; executionIndex < executionCount; executionIndex++)
+		{
+			ShardSelectExecution *execution = &executionArray[executionIndex];
+			ShardSelectStatus status = SHARD_SELECT_BUSY;
+
+			if (execution->resultsReceived)
+			{
+				continue;
+			}
+
+			/* connection to the node may be used by the query of another shard */
+			if (execution->connection == NULL &&
+				!StartShardSelect(executionArray, executionCount, execution))
+			{
+				continue;
+			}
+
+			status = ReceiveShardSelectResults(execution, attributeInputMetadata,
+											   ioContext);
+			if (status == SHARD_SELECT_DONE)
+			{
+				execution->connection = NULL;
+				execution->resultsReceived = true;
+				receivedCount++;
+			}
+			else if (status == SHARD_SELECT_FAILED)
+			{
+				/* retry the task on the next placement */
+				tuplestore_clear(execution->tupleStore);
+				ReleaseFailedConnection(execution->connection);
+				execution->connection = NULL;
+				execution->placementCell = lnext(execution->placementCell);
+			}
+			else
+			{
+				pollDescriptorArray[pollCount].fd = PQsocket(execution->connection);
+				pollDescriptorArray[pollCount].events = POLLIN;
+				pollDescriptorArray[pollCount].revents = 0;
+				pollCount++;
+			}
+		}
+
+		if (pollCount > 0)
+		{
+			/* errors (including EINTR) are handled by rechecking all connections */
+			(void) poll(pollDescriptorArray, pollCount, REMOTE_RESULT_POLL_TIMEOUT);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	for (executionIndex = 0; executionIndex < executionCount; executionIndex++)
+	{
+		ShardSelectExecution *execution = &executionArray[executionIndex];
+
+		tupleStoreList = lappend(tupleStoreList, execution->tupleStore);
+	}
+
+	MemoryContextDelete(ioContext);
+	pfree(pollDescriptorArray);
+	pfree(executionArray);
+
+	return tupleStoreList;
+}
+
+
+/*
+ * StartShardSelect sends the query of the given execution to its current
+ * placement, moving on to the next placement if the query can't be sent. The
+ * function returns false if the connection to the placement's node is in use
+ * by another execution; in that case, the caller should retry later. If there
+ * are no more placements to try, the function errors out.
+ */
+static bool
+StartShardSelect(ShardSelectExecution *executionArray, int executionCount,
+				 ShardSelectExecution *execution)
+{
+	while (execution->placementCell != NULL)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(execution->placementCell);
+		PGconn *connection = NULL;
+		bool queryOK = false;
+
+		if (PlacementConnectionInUse(executionArray, executionCount, placement))
+		{
+			return false;
+		}
+
+		connection = GetConnection(placement->nodeName, placement->nodePort,
+								   !UseDtmTransactions);
+		if (connection == NULL)
+		{
+			execution->placementCell = lnext(execution->placementCell);
+			continue;
+		}
+
+		queryOK = SendQueryInSingleRowMode(connection, execution->task);
+		if (!queryOK)
+		{
+			PurgeConnection(connection);
+			execution->placementCell = lnext(execution->placementCell);
+			continue;
+		}
+
+		execution->connection = connection;
+		return true;
+	}
+
+	ereport(ERROR, (errmsg("could not receive query results")));
+	return false;
+}
+
+
+/*
+ * PlacementConnectionInUse checks whether a running execution uses the
+ * connection to the node of the given placement. Connections are cached per
+ * node, so only one query at a time can be in progress on each node.
+ */
+static bool
+PlacementConnectionInUse(ShardSelectExecution *executionArray, int executionCount,
+						 ShardPlacement *placement)
+{
+	int executionIndex = 0;
+
+	for (executionIndex = 0; executionIndex < executionCount; executionIndex++)
+	{
+		ShardSelectExecution *execution = &executionArray[executionIndex];
+		ShardPlacement *runningPlacement = NULL;
+
+		if (execution->connection == NULL)
+		{
+			continue;
+		}
+
+		runningPlacement = (ShardPlacement *) lfirst(execution->placementCell);
+		if (runningPlacement->nodePort == placement->nodePort &&
+			strcmp(runningPlacement->nodeName, placement->nodeName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ReceiveShardSelectResults consumes the input available on the connection of
+ * the given execution without blocking and stores the received rows in the
+ * execution's tuplestore. The function reports whether the query is still
+ * running, has completed or has failed.
+ */
+static ShardSelectStatus
+ReceiveShardSelectResults(ShardSelectExecution *execution,
+						  AttInMetadata *attributeInputMetadata, MemoryContext ioContext)
+{
+	PGconn *connection = execution->connection;
+
+	if (PQconsumeInput(connection) == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		return SHARD_SELECT_FAILED;
+	}
+
+	while (PQisBusy(connection) == 0)
+	{
+		ExecStatusType resultStatus = 0;
 
-		if (UseDtmTransactions)
+		PGresult *result = PQgetResult(connection);
+		if (result == NULL)
 		{
-			PrepareDtmTransaction(task);
+			return SHARD_SELECT_DONE;
 		}
 
-		resultsOK = ExecuteTaskAndStoreResults(task, tupleStoreDescriptor, tupleStore);
-		if (!resultsOK)
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
 		{
-			ereport(ERROR, (errmsg("could not receive query results")));
-		}
+			ReportRemoteError(connection, result);
+			PQclear(result);
 
-		/*
-		 * We successfully fetched data into local tuplestore. Now move results from
-		 * the tupleStore into the table.
-		 */
-		Assert(tupleStore != NULL);
-		TupleStoreToTable(intermediateTable, targetList, tupleStoreDescriptor,
-						  tupleStore);
+			return SHARD_SELECT_FAILED;
+		}
 
-		tuplestore_end(tupleStore);
+		StoreResultTuples(result, attributeInputMetadata, ioContext,
+						  execution->tupleStore);
+		PQclear(result);
 	}
-	
+
+	return SHARD_SELECT_BUSY;
 }
 
 
@@ -1562,7 +3411,7 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 			continue;
 		}
 
-		queryOK = SendQueryInSingleRowMode(connection, task->queryString);
+		queryOK = SendQueryInSingleRowMode(connection, task);
 		if (!queryOK)
 		{
 			PurgeConnection(connection);
@@ -1578,7 +3427,7 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 		else
 		{
 			tuplestore_clear(tupleStore);
-			PurgeConnection(connection);
+			ReleaseFailedConnection(connection);
 		}
 	}
 
@@ -1587,17 +3436,17 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 
 
 /*
- * SendQueryInSingleRowMode sends the given query on the connection in an
- * asynchronous way. The function also sets the single-row mode on the
+ * SendQueryInSingleRowMode sends the query of the given task on the connection
+ * in an asynchronous way. The function also sets the single-row mode on the
  * connection so that we receive results a row at a time.
  */
 static bool
-SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
+SendQueryInSingleRowMode(PGconn *connection, Task *task)
 {
 	int querySent = 0;
 	int singleRowMode = 0;
 
-	querySent = PQsendQuery(connection, query->data);
+	querySent = SendTaskQuery(connection, task);
 	if (querySent == 0)
 	{
 		ReportRemoteError(connection, NULL);
@@ -1615,6 +3464,70 @@ SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
 }
 
 
+/*
+ * StoreResultTuples builds tuples from the rows of the given result and stores
+ * them in the given tuple-store. Tuples are built in the given memory context,
+ * which is reset after each tuple.
+ */
+static void
+StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+				  MemoryContext ioContext, Tuplestorestate *tupleStore)
+{
+	uint32 expectedColumnCount PG_USED_FOR_ASSERTS_ONLY =
+		attributeInputMetadata->tupdesc->natts;
+	uint32 rowIndex = 0;
+	uint32 columnIndex = 0;
+	uint32 rowCount = PQntuples(result);
+	uint32 columnCount = PQnfields(result);
+	char **columnArray = NULL;
+
+	Assert(tupleStore != NULL);
+	Assert(columnCount == expectedColumnCount);
+
+	if (rowCount == 0)
+	{
+		return;
+	}
+
+	columnArray = (char **) palloc0(columnCount * sizeof(char *));
+
+	for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		HeapTuple heapTuple = NULL;
+		MemoryContext oldContext = NULL;
+		memset(columnArray, 0, columnCount * sizeof(char *));
+
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (PQgetisnull(result, rowIndex, columnIndex))
+			{
+				columnArray[columnIndex] = NULL;
+			}
+			else
+			{
+				columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+			}
+		}
+
+		/*
+		 * Switch to a temporary memory context that we reset after each tuple. This
+		 * protects us from any memory leaks that might be present in I/O functions
+		 * called by BuildTupleFromCStrings.
+		 */
+		oldContext = MemoryContextSwitchTo(ioContext);
+
+		heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+
+		MemoryContextSwitchTo(oldContext);
+
+		tuplestore_puttuple(tupleStore, heapTuple);
+		MemoryContextReset(ioContext);
+	}
+
+	pfree(columnArray);
+}
+
+
 /*
  * StoreQueryResult gets the query results from the given connection, builds
  * tuples from the results and stores them in the given tuple-store. If the
@@ -1627,8 +3540,6 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 				 Tuplestorestate *tupleStore)
 {
 	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-	uint32 expectedColumnCount = tupleDescriptor->natts;
-	char **columnArray = (char **) palloc0(expectedColumnCount * sizeof(char *));
 	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
 													"StoreQueryResult",
 													ALLOCSET_DEFAULT_MINSIZE,
@@ -1639,10 +3550,6 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 
 	for (;;)
 	{
-		uint32 rowIndex = 0;
-		uint32 columnIndex = 0;
-		uint32 rowCount = 0;
-		uint32 columnCount = 0;
 		ExecStatusType resultStatus = 0;
 
 		PGresult *result = PQgetResult(connection);
@@ -1660,57 +3567,337 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 			return false;
 		}
 
-		rowCount = PQntuples(result);
-		columnCount = PQnfields(result);
-		Assert(columnCount == expectedColumnCount);
+		StoreResultTuples(result, attributeInputMetadata, ioContext, tupleStore);
+		PQclear(result);
+	}
+
+	return true;
+}
+
+
+#if (PG_VERSION_NUM >= 90500)
+
+/*
+ * ReplaceScanWithIntermediateResult replaces the scan in the given local plan of
+ * a multi-shard SELECT with the custom scan returning the rows fetched by the
+ * distributed plan. The scan is the sequential scan of the distributed table,
+ * or the function scan the query combining partial aggregates reads them from.
+ */
+static Plan *
+ReplaceScanWithIntermediateResult(Plan *plan, DistributedPlan *distributedPlan)
+{
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(plan, SeqScan) || IsA(plan, FunctionScan))
+	{
+		return (Plan *) IntermediateResultScan((Scan *) plan, distributedPlan);
+	}
+
+	plan->lefttree = ReplaceScanWithIntermediateResult(plan->lefttree,
+													   distributedPlan);
+	plan->righttree = ReplaceScanWithIntermediateResult(plan->righttree,
+														distributedPlan);
+
+	return plan;
+}
+
+
+/*
+ * IntermediateResultScan returns a custom scan which takes the place of the
+ * given scan, and returns the rows fetched by the distributed plan. Fetched rows
+ * replace those of the distributed table, so its scan keeps the range table
+ * entry, target list and quals. The function scan of the query combining
+ * partial aggregates has no relation, so the custom scan describes the partial
+ * aggregates itself, and its expressions refer to them as INDEX_VAR columns.
+ */
+static CustomScan *
+IntermediateResultScan(Scan *scan, DistributedPlan *distributedPlan)
+{
+	CustomScan *customScan = makeNode(CustomScan);
+	Plan *customPlan = &customScan->scan.plan;
+
+	customPlan->startup_cost = scan->plan.startup_cost;
+	customPlan->total_cost = scan->plan.total_cost;
+	customPlan->plan_rows = scan->plan.plan_rows;
+	customPlan->plan_width = scan->plan.plan_width;
+	customPlan->targetlist = scan->plan.targetlist;
+	customPlan->qual = scan->plan.qual;
+
+	/* the plan is built at executor start and is never copied */
+	customScan->methods = &IntermediateResultScanMethods;
+	customScan->custom_private = list_make1(distributedPlan);
+
+	if (IsA(scan, SeqScan))
+	{
+		customScan->scan.scanrelid = scan->scanrelid;
+	}
+	else
+	{
+		List *scanTargetList = NIL;
+		ListCell *targetEntryCell = NULL;
 
-		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		foreach(targetEntryCell, distributedPlan->targetList)
 		{
-			HeapTuple heapTuple = NULL;
-			MemoryContext oldContext = NULL;
-			memset(columnArray, 0, columnCount * sizeof(char *));
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+			Var *column = makeVarFromTargetEntry(scan->scanrelid, targetEntry);
 
-			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-			{
-				if (PQgetisnull(result, rowIndex, columnIndex))
-				{
-					columnArray[columnIndex] = NULL;
-				}
-				else
-				{
-					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
-				}
-			}
+			scanTargetList = lappend(scanTargetList,
+									 makeTargetEntry((Expr *) column,
+													 targetEntry->resno, NULL,
+													 false));
+		}
 
-			/*
-			 * Switch to a temporary memory context that we reset after each tuple. This
-			 * protects us from any memory leaks that might be present in I/O functions
-			 * called by BuildTupleFromCStrings.
-			 */
-			oldContext = MemoryContextSwitchTo(ioContext);
+		customScan->scan.scanrelid = 0;
+		customScan->custom_scan_tlist = scanTargetList;
+		customScan->custom_relids = bms_make_singleton(scan->scanrelid);
 
-			heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+		ChangeVarNodes((Node *) customPlan->targetlist, scan->scanrelid, INDEX_VAR, 0);
+		ChangeVarNodes((Node *) customPlan->qual, scan->scanrelid, INDEX_VAR, 0);
+	}
 
-			MemoryContextSwitchTo(oldContext);
+	return customScan;
+}
+
+
+/*
+ * CreateIntermediateResultScanState creates the execution state of a custom
+ * scan created by IntermediateResultScan.
+ */
+static Node *
+CreateIntermediateResultScanState(CustomScan *customScan)
+{
+	IntermediateResultScanState *scanState = palloc0(sizeof(IntermediateResultScanState));
+	DistributedPlan *distributedPlan =
+		(DistributedPlan *) linitial(customScan->custom_private);
+
+	NodeSetTag(scanState, T_CustomScanState);
+	scanState->customScanState.methods = &IntermediateResultExecMethods;
+	scanState->distributedPlan = distributedPlan;
+
+	/* partial aggregates are stored in the columns of the scan in order */
+	scanState->storeToScanColumnList =
+		(distributedPlan->combineQueryString != NULL) ? NIL : distributedPlan->targetList;
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * BeginIntermediateResultScan sets up the slot holding the rows as they are
+ * fetched from the shards. Shard queries are run only once the scan is read.
+ */
+static void
+BeginIntermediateResultScan(CustomScanState *node, EState *estate, int eflags)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	List *targetList = scanState->distributedPlan->targetList;
+
+	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
+	TupleDesc storeTupleDescriptor = ExecTypeFromTL(targetList, false);
+
+	scanState->storeSlot = ExecInitExtraTupleSlot(estate);
+	ExecSetSlotDescriptor(scanState->storeSlot, storeTupleDescriptor);
+}
+
+
+/*
+ * ExecIntermediateResultScan returns the next fetched row which passes the
+ * scan's quals, projected to its target list.
+ */
+static TupleTableSlot *
+ExecIntermediateResultScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, (ExecScanAccessMtd) IntermediateResultNext,
+					(ExecScanRecheckMtd) IntermediateResultRecheck);
+}
+
+
+/*
+ * IntermediateResultNext returns the next fetched row in the scan tuple slot,
+ * or an empty slot if all rows have been returned. The first call executes the
+ * SELECT queries on the shards.
+ */
+static TupleTableSlot *
+IntermediateResultNext(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	TupleTableSlot *storeSlot = scanState->storeSlot;
+	TupleTableSlot *scanSlot = node->ss.ss_ScanTupleSlot;
+
+	if (!scanState->resultsFetched)
+	{
+		scanState->tupleStoreList =
+			ExecuteMultipleShardSelect(scanState->distributedPlan,
+									   storeSlot->tts_tupleDescriptor);
+		scanState->tupleStoreCell = list_head(scanState->tupleStoreList);
+		scanState->resultsFetched = true;
+	}
+
+	while (scanState->tupleStoreCell != NULL)
+	{
+		Tuplestorestate *tupleStore =
+			(Tuplestorestate *) lfirst(scanState->tupleStoreCell);
 
-			tuplestore_puttuple(tupleStore, heapTuple);
-			MemoryContextReset(ioContext);
+		if (tuplestore_gettupleslot(tupleStore, true, false, storeSlot))
+		{
+			StoreToScanSlot(storeSlot, scanSlot, scanState->storeToScanColumnList);
+			return scanSlot;
 		}
 
-		PQclear(result);
+		scanState->tupleStoreCell = lnext(scanState->tupleStoreCell);
 	}
 
-	pfree(columnArray);
+	return ExecClearTuple(scanSlot);
+}
 
+
+/*
+ * IntermediateResultRecheck is never called, as fetched rows can't be rechecked
+ * by EvalPlanQual.
+ */
+static bool
+IntermediateResultRecheck(CustomScanState *node, TupleTableSlot *slot)
+{
 	return true;
 }
 
 
+/*
+ * StoreToScanSlot stores the values of the row in storeSlot as a virtual tuple
+ * in scanSlot. The attribute location of each value is determined by the
+ * attribute number of the column in the remote query's target list; if the
+ * column list is empty, values are stored in order.
+ */
+static void
+StoreToScanSlot(TupleTableSlot *storeSlot, TupleTableSlot *scanSlot,
+				List *storeToScanColumnList)
+{
+	int storeColumnCount = storeSlot->tts_tupleDescriptor->natts;
+	int scanColumnCount = scanSlot->tts_tupleDescriptor->natts;
+	int storeColumnIndex = 0;
+
+	ExecClearTuple(scanSlot);
+	slot_getallattrs(storeSlot);
+
+	/* set all values to null for the scan tuple */
+	memset(scanSlot->tts_isnull, true, scanColumnCount * sizeof(bool));
+
+	if (storeToScanColumnList == NIL)
+	{
+		Assert(storeColumnCount == scanColumnCount);
+
+		memcpy(scanSlot->tts_values, storeSlot->tts_values,
+			   storeColumnCount * sizeof(Datum));
+		memcpy(scanSlot->tts_isnull, storeSlot->tts_isnull,
+			   storeColumnCount * sizeof(bool));
+	}
+
+	for (storeColumnIndex = 0;
+		 storeToScanColumnList != NIL && storeColumnIndex < storeColumnCount;
+		 storeColumnIndex++)
+	{
+		TargetEntry *scanEntry = (TargetEntry *) list_nth(storeToScanColumnList,
+														  storeColumnIndex);
+		Expr *scanExpression = scanEntry->expr;
+		int scanColumnId = 0;
+
+		/* skip over the null consts of count(*) */
+		if (IsA(scanExpression, Const))
+		{
+			continue;
+		}
+
+		Assert(IsA(scanExpression, Var));
+		scanColumnId = ((Var *) scanExpression)->varattno;
+
+		scanSlot->tts_values[scanColumnId - 1] = storeSlot->tts_values[storeColumnIndex];
+		scanSlot->tts_isnull[scanColumnId - 1] = storeSlot->tts_isnull[storeColumnIndex];
+	}
+
+	ExecStoreVirtualTuple(scanSlot);
+}
+
+
+/*
+ * EndIntermediateResultScan releases the fetched rows.
+ */
+static void
+EndIntermediateResultScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	ListCell *tupleStoreCell = NULL;
+
+	foreach(tupleStoreCell, scanState->tupleStoreList)
+	{
+		tuplestore_end((Tuplestorestate *) lfirst(tupleStoreCell));
+	}
+
+	scanState->tupleStoreList = NIL;
+	scanState->tupleStoreCell = NULL;
+}
+
+
+/*
+ * ReScanIntermediateResultScan rewinds the scan to the first fetched row. Shard
+ * queries are not run again.
+ */
+static void
+ReScanIntermediateResultScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	ListCell *tupleStoreCell = NULL;
+
+	foreach(tupleStoreCell, scanState->tupleStoreList)
+	{
+		tuplestore_rescan((Tuplestorestate *) lfirst(tupleStoreCell));
+	}
+
+	scanState->tupleStoreCell = list_head(scanState->tupleStoreList);
+
+	ExecScanReScan(&node->ss);
+}
+
+#else
+
+/*
+ * StoreResultsInTable executes the SELECT queries in the distributed plan and
+ * inserts the returned rows into the given table, in task order.
+ */
+static void
+StoreResultsInTable(DistributedPlan *distributedPlan, RangeVar *intermediateTable)
+{
+	List *targetList = distributedPlan->targetList;
+
+	/* partial aggregates are stored in the columns of the table in order */
+	List *storeToTableColumnList =
+		(distributedPlan->combineQueryString != NULL) ? NIL : targetList;
+
+	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
+	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
+	List *tupleStoreList = ExecuteMultipleShardSelect(distributedPlan,
+													  tupleStoreDescriptor);
+	ListCell *tupleStoreCell = NULL;
+
+	foreach(tupleStoreCell, tupleStoreList)
+	{
+		Tuplestorestate *tupleStore = (Tuplestorestate *) lfirst(tupleStoreCell);
+
+		TupleStoreToTable(intermediateTable, storeToTableColumnList,
+						  tupleStoreDescriptor, tupleStore);
+		tuplestore_end(tupleStore);
+	}
+}
+
+
 /*
  * TupleStoreToTable inserts the tuples from the given tupleStore into the given
  * table. Before doing so, the function extracts the values from the tuple and
  * sets the right attributes for the given table based on the column attribute
- * numbers.
+ * numbers. If the column list is empty, values are stored in the table columns
+ * in order.
  */
 static void
 TupleStoreToTable(RangeVar *tableRangeVar, List *storeToTableColumnList,
@@ -1747,13 +3934,22 @@ TupleStoreToTable(RangeVar *tableRangeVar, List *storeToTableColumnList,
 		/* set all values to null for the table tuple */
 		memset(tableTupleNulls, true, tableColumnCount * sizeof(bool));
 
+		if (storeToTableColumnList == NIL)
+		{
+			Assert(storeColumnCount == tableColumnCount);
+
+			memcpy(tableTupleValues, storeTupleValues, storeColumnCount * sizeof(Datum));
+			memcpy(tableTupleNulls, storeTupleNulls, storeColumnCount * sizeof(bool));
+		}
+
 		/*
 		 * Extract values from the returned tuple and set them in the right
 		 * attribute location for the new table. We determine this attribute
 		 * location based on the attribute number in the column from the remote
 		 * query's target list.
 		 */
-		for (storeColumnIndex = 0; storeColumnIndex < storeColumnCount;
+		for (storeColumnIndex = 0;
+			 storeToTableColumnList != NIL && storeColumnIndex < storeColumnCount;
 			 storeColumnIndex++)
 		{
 			TargetEntry *tableEntry = (TargetEntry *) list_nth(storeToTableColumnList,
@@ -1794,6 +3990,8 @@ TupleStoreToTable(RangeVar *tableRangeVar, List *storeToTableColumnList,
 	heap_close(table, RowExclusiveLock);
 }
 
+#endif
+
 
 /*
  * PgShardExecutorRun actually runs a distributed plan, if any.
@@ -1838,7 +4036,7 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 		if (operation == CMD_INSERT || operation == CMD_UPDATE ||
 			operation == CMD_DELETE)
 		{
-			int32 affectedRowCount = ExecuteDistributedModify(plan);
+			int32 affectedRowCount = ExecuteDistributedModify(plan, operation);
 			estate->es_processed = affectedRowCount;
 		}
 		else if (operation == CMD_SELECT)
@@ -1879,54 +4077,149 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 
 /*
  * ExecuteDistributedModify is the main entry point for modifying distributed
- * tables. A distributed modification is successful if any placement of the
- * distributed table is successful. ExecuteDistributedModify returns the number
- * of modified rows in that case and errors in all others. This function will
- * also generate warnings for individual placement failures.
+ * tables. A distributed modification is successful if any placement of each
+ * modified shard is successful. ExecuteDistributedModify returns the number of
+ * modified rows in that case and errors in all others. This function will also
+ * generate warnings for individual placement failures.
+ */
+static int32
+ExecuteDistributedModify(DistributedPlan *plan, CmdType operation)
+{
+	int32 affectedTupleCount = 0;
+	ListCell *taskCell = NULL;
+
+	/* only multi-row INSERTs may modify more than a single shard */
+	if (list_length(plan->taskList) != 1 && operation != CMD_INSERT)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify multiple shards during a single query")));
+	}
+
+	foreach(taskCell, plan->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		affectedTupleCount += ExecuteTaskModify(task, NULL);
+	}
+
+	return affectedTupleCount;
+}
+
+
+/*
+ * ExecuteTaskModify runs the modification of the given task on all placements
+ * of its shard concurrently. If copyData is not NULL, the task's query is a COPY
+ * FROM STDIN command and copyData holds the rows sent to each placement. Failed
+ * placements are marked inactive, unless all of them fail, in which case the
+ * function errors out. Otherwise it returns the number of modified rows.
  */
 static int32
-ExecuteDistributedModify(DistributedPlan *plan)
+ExecuteTaskModify(Task *task, StringInfo copyData)
 {
 	int32 affectedTupleCount = -1;
-	Task *task = (Task *) linitial(plan->taskList);
 	ListCell *taskPlacementCell = NULL;
 	List *failedPlacementList = NIL;
 	ListCell *failedPlacementCell = NULL;
+	PGconn **connectionArray = NULL;
+	PGresult **resultArray = NULL;
+	int placementCount = 0;
+	int placementIndex = 0;
 
-	/* we only support a single modification to a single shard */
-	if (list_length(plan->taskList) != 1)
+	if (UseDtmTransactions)
 	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("cannot modify multiple shards during a single query")));
+		DtmTwoPhaseCommit = true;
+		PrepareDtmTransaction(task);
+	}
+
+	placementCount = list_length(task->taskPlacementList);
+	connectionArray = (PGconn **) palloc0(placementCount * sizeof(PGconn *));
+	resultArray = (PGresult **) palloc0(placementCount * sizeof(PGresult *));
+
+	/* send the modification to all placements before waiting for any of them */
+	foreach(taskPlacementCell, task->taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		char *nodeName = taskPlacement->nodeName;
+		int32 nodePort = taskPlacement->nodePort;
+		PGconn *connection = NULL;
+		int querySent = 0;
+
+		Assert(taskPlacement->shardState == STATE_FINALIZED);
+
+		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+		if (connection != NULL)
+		{
+			querySent = SendTaskQuery(connection, task);
+			if (querySent == 0)
+			{
+				ReportRemoteError(connection, NULL);
+			}
+			else
+			{
+				connectionArray[placementIndex] = connection;
+			}
+		}
+
+		placementIndex++;
 	}
 
-	if (UseDtmTransactions)
+	GatherRemoteResults(connectionArray, resultArray, placementCount);
+
+	/* placements ready to receive data get all rows, then finish the COPY */
+	if (copyData != NULL)
 	{
-		DtmTwoPhaseCommit = true;
-		PrepareDtmTransaction(task);
+		for (placementIndex = 0; placementIndex < placementCount; placementIndex++)
+		{
+			PGconn *connection = connectionArray[placementIndex];
+			PGresult *result = resultArray[placementIndex];
+			int copySent = 0;
+
+			if (connection == NULL || PQresultStatus(result) != PGRES_COPY_IN)
+			{
+				continue;
+			}
+
+			PQclear(result);
+			resultArray[placementIndex] = NULL;
+
+			copySent = PQputCopyData(connection, copyData->data, copyData->len);
+			if (copySent == 1)
+			{
+				copySent = PQputCopyEnd(connection, NULL);
+			}
+
+			if (copySent != 1)
+			{
+				ReportRemoteError(connection, NULL);
+				connectionArray[placementIndex] = NULL;
+			}
+		}
+
+		GatherRemoteResults(connectionArray, resultArray, placementCount);
 	}
 
+	placementIndex = 0;
 	foreach(taskPlacementCell, task->taskPlacementList)
 	{
 		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
 		char *nodeName = taskPlacement->nodeName;
 		int32 nodePort = taskPlacement->nodePort;
 
-		PGconn *connection = NULL;
-		PGresult *result = NULL;
+		PGconn *connection = connectionArray[placementIndex];
+		PGresult *result = resultArray[placementIndex];
 		char *currentAffectedTupleString = NULL;
 		int32 currentAffectedTupleCount = -1;
 
-		Assert(taskPlacement->shardState == STATE_FINALIZED);
+		placementIndex++;
 
-		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
 		if (connection == NULL)
 		{
+			PQclear(result);
+
 			failedPlacementList = lappend(failedPlacementList, taskPlacement);
 			continue;
 		}
 
-		result = PQexec(connection, task->queryString->data);
 		if (PQresultStatus(result) != PGRES_COMMAND_OK)
 		{
 			ReportRemoteError(connection, result);
@@ -1957,6 +4250,9 @@ ExecuteDistributedModify(DistributedPlan *plan)
 		PQclear(result);
 	}
 
+	pfree(connectionArray);
+	pfree(resultArray);
+
 	/* if all placements failed, error out */
 	if (list_length(failedPlacementList) == list_length(task->taskPlacementList))
 	{
@@ -1975,6 +4271,89 @@ ExecuteDistributedModify(DistributedPlan *plan)
 }
 
 
+/*
+ * GatherRemoteResults waits until the commands previously sent on all given
+ * connections complete, consuming their input as it arrives. Like PQexec, the
+ * function keeps the last result of each command. If a connection breaks, its
+ * result is the one libpq reports for the failure. A COPY FROM STDIN command
+ * counts as complete once the remote node is ready to receive the data. NULL
+ * connections are skipped.
+ */
+static void
+GatherRemoteResults(PGconn **connectionArray, PGresult **resultArray,
+					int connectionCount)
+{
+	struct pollfd *pollDescriptorArray =
+		(struct pollfd *) palloc0(connectionCount * sizeof(struct pollfd));
+	bool *completedArray = (bool *) palloc0(connectionCount * sizeof(bool));
+	int completedCount = 0;
+	int connectionIndex = 0;
+
+	for (connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+	{
+		if (connectionArray[connectionIndex] == NULL)
+		{
+			completedArray[connectionIndex] = true;
+			completedCount++;
+		}
+	}
+
+	while (completedCount < connectionCount)
+	{
+		int pollCount = 0;
+
+		for (connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+		{
+			PGconn *connection = connectionArray[connectionIndex];
+
+			if (completedArray[connectionIndex])
+			{
+				continue;
+			}
+
+			/* on failure, PQgetResult below returns a result describing it */
+			(void) PQconsumeInput(connection);
+
+			while (PQisBusy(connection) == 0)
+			{
+				PGresult *result = PQgetResult(connection);
+				if (result != NULL)
+				{
+					PQclear(resultArray[connectionIndex]);
+					resultArray[connectionIndex] = result;
+				}
+
+				if (result == NULL || PQresultStatus(result) == PGRES_COPY_IN)
+				{
+					completedArray[connectionIndex] = true;
+					completedCount++;
+					break;
+				}
+			}
+
+			if (!completedArray[connectionIndex])
+			{
+				pollDescriptorArray[pollCount].fd = PQsocket(connection);
+				pollDescriptorArray[pollCount].events = POLLIN;
+				pollDescriptorArray[pollCount].revents = 0;
+				pollCount++;
+			}
+		}
+
+		if (pollCount > 0)
+		{
+			/* errors (including EINTR) are handled by rechecking all connections */
+			(void) poll(pollDescriptorArray, pollCount, REMOTE_RESULT_POLL_TIMEOUT);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	pfree(completedArray);
+	pfree(pollDescriptorArray);
+}
+
+
 /*
  * PrepareDtmTransaction sends the necessary commands to the nodes to perform
  * a global transaction.
@@ -2196,14 +4575,73 @@ static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommand
 	return allOk;
 }
 
-static bool RunDtmCommand(char const* sql)
+/*
+ * Send a sequence of statements to all shards in libpq pipeline mode, so that
+ * it costs a single round trip instead of one per statement.  There is no sync
+ * point between the statements, so once one of them fails at a shard the rest
+ * are skipped there.  The handler is applied to the result of the last statement.
+ */
+static bool RunDtmPipeline(int nStmts, char const* const* sql, ExecStatusType const* expectedStatus, DtmCommandResultHandler handler, void* arg)
 {
-	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
+	PGresult *result = NULL;
+	PGconn *connection = NULL;
+	bool allOk = true;
+	bool querySent;
+	int i;
+	ListCell *connectionCell = NULL;
+	ListCell *nextCell = list_head(connectionsWithDtmTransactions);
+	ListCell *prevCell = NULL;
+
+	while ((connectionCell = nextCell) != NULL)
+	{
+		nextCell = lnext(connectionCell);
+		connection = (PGconn *) lfirst(connectionCell);
+		querySent = PQenterPipelineMode(connection);
+		for (i = 0; i < nStmts && querySent; i++)
+		{
+			querySent = PQsendQueryParams(connection, sql[i], 0, NULL, NULL, NULL, NULL, 0);
+		}
+		if (!querySent || !PQpipelineSync(connection))
+		{
+			ReportRemoteError(connection, NULL);
+			list_delete_cell(connectionsWithDtmTransactions, connectionCell, prevCell);
+			PurgeConnection(connection);
+			allOk = false;
+			continue;
+		}
+		prevCell = connectionCell;
+		TRACE("shard_xtm: conn#%p: Pipelined %d statements starting with %s to %s:%s\n", connection, nStmts, sql[0], PQhost(connection), PQport(connection));
+	}
+	foreach(connectionCell, connectionsWithDtmTransactions)
+	{
+		connection = (PGconn *) lfirst(connectionCell);
+		for (i = 0; i < nStmts; i++)
+		{
+			result = PQgetResult(connection);
+			if (PQresultStatus(result) != expectedStatus[i] || (handler && i == nStmts-1 && !handler(result, arg)))
+			{
+				/* statements following the failed one are just skipped */
+				if (PQresultStatus(result) != PGRES_PIPELINE_ABORTED)
+				{
+					ReportRemoteError(connection, result);
+				}
+				allOk = false;
+			}
+			PQclear(result);
+			if (result != NULL)
+			{
+				PQgetResult(connection); /* consume NULL result */
+			}
+		}
+		PQclear(PQgetResult(connection)); /* consume sync point */
+		PQexitPipelineMode(connection);
+	}
+	return allOk;
 }
 
-static bool RunDtmFunction(char const* sql)
+static bool RunDtmCommand(char const* sql)
 {
-	return RunDtmStatement(sql, PGRES_TUPLES_OK, NULL, NULL);
+	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
 }
 
 
@@ -2235,17 +4673,26 @@ FinishDtmTransaction(XactEvent event, void * arg)
 			if (event == XACT_EVENT_COMMIT)
 			{
 				csn_t maxCSN = 0;
-				
-				if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'", 
-											MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmFunction(psprintf("SELECT dtm_begin_prepare('%d.%d')", 
-											 MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmStatement(psprintf("SELECT dtm_prepare('%d.%d',0)", 
-											  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
-					!RunDtmFunction(psprintf("SELECT dtm_end_prepare('%d.%d',%lld)", 
-											 MyProcPid, currentLocalTransactionId, maxCSN)) ||
-					!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'", 
-											MyProcPid, currentLocalTransactionId)))
+				bool committed = false;
+				char const* prepareStmts[3];
+				char const* commitStmts[2];
+				static ExecStatusType const prepareStatus[3] = {PGRES_COMMAND_OK, PGRES_TUPLES_OK, PGRES_TUPLES_OK};
+				static ExecStatusType const commitStatus[2] = {PGRES_TUPLES_OK, PGRES_COMMAND_OK};
+
+				/*
+				 * Only dtm_end_prepare has to wait for the maximal CSN, so
+				 * the commit protocol takes two round trips.
+				 */
+				prepareStmts[0] = psprintf("PREPARE TRANSACTION '%d.%d'", MyProcPid, currentLocalTransactionId);
+				prepareStmts[1] = psprintf("SELECT dtm_begin_prepare('%d.%d')", MyProcPid, currentLocalTransactionId);
+				prepareStmts[2] = psprintf("SELECT dtm_prepare('%d.%d',0)", MyProcPid, currentLocalTransactionId);
+				if (RunDtmPipeline(3, prepareStmts, prepareStatus, DtmMaxCSN, &maxCSN))
+				{
+					commitStmts[0] = psprintf("SELECT dtm_end_prepare('%d.%d',%lld)", MyProcPid, currentLocalTransactionId, maxCSN);
+					commitStmts[1] = psprintf("COMMIT PREPARED '%d.%d'", MyProcPid, currentLocalTransactionId);
+					committed = RunDtmPipeline(2, commitStmts, commitStatus, NULL, NULL);
+				}
+				if (!committed)
 				{
 					RunDtmCommand(psprintf("ROLLBACK PREPARED '%d.%d'", 
 										   MyProcPid, currentLocalTransactionId));
@@ -2418,50 +4865,6 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 			}
 		}
 	}
-	else if (statementType == T_PrepareStmt)
-	{
-		PrepareStmt *prepareStatement = (PrepareStmt *) parsetree;
-		Query *parsedQuery = NULL;
-		Node *rawQuery = copyObject(prepareStatement->query);
-		int argumentCount = list_length(prepareStatement->argtypes);
-		Oid *argumentTypeArray = NULL;
-		PlannerType plannerType = PLANNER_INVALID_FIRST;
-
-		/* transform list of TypeNames to array of type OID's if they exist */
-		if (argumentCount > 0)
-		{
-			List *argumentTypeList = prepareStatement->argtypes;
-			ListCell *argumentTypeCell = NULL;
-			uint32 argumentTypeIndex = 0;
-
-			ParseState *parseState = make_parsestate(NULL);
-			parseState->p_sourcetext = queryString;
-
-			argumentTypeArray = (Oid *) palloc0(argumentCount * sizeof(Oid));
-
-			foreach(argumentTypeCell, argumentTypeList)
-			{
-				TypeName *typeName = lfirst(argumentTypeCell);
-				Oid typeId = typenameTypeId(parseState, typeName);
-
-				argumentTypeArray[argumentTypeIndex] = typeId;
-				argumentTypeIndex++;
-			}
-		}
-
-		/* analyze the statement using these parameter types */
-		parsedQuery = parse_analyze_varparams(rawQuery, queryString,
-											  &argumentTypeArray, &argumentCount);
-
-		/* determine if the query runs on a distributed table */
-		plannerType = DeterminePlannerType(parsedQuery);
-		if (plannerType == PLANNER_TYPE_PG_SHARD)
-		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("PREPARE commands on distributed tables "
-								   "are unsupported")));
-		}
-	}
 	else if (statementType == T_CopyStmt)
 	{
 		CopyStmt *copyStatement = (CopyStmt *) parsetree;
@@ -2477,7 +4880,20 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 			Assert(rawQuery == NULL);
 
 			isDistributedTable = IsDistributedTable(tableId);
-			if (isDistributedTable)
+			if (isDistributedTable && copyStatement->is_from)
+			{
+				uint64 processedCount = CopyIntoDistributedTable(copyStatement);
+
+				if (completionTag != NULL)
+				{
+					snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+							 "COPY " UINT64_FORMAT, processedCount);
+				}
+
+				/* the rows went to the shards, the local table stays empty */
+				return;
+			}
+			else if (isDistributedTable)
 			{
 				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 								errmsg("COPY commands on distributed tables "
@@ -2526,6 +4942,324 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 		standard_ProcessUtility(parsetree, queryString, context,
 								params, dest, completionTag);
 	}
+
+	/*
+	 * Metadata changes of a prepared transaction only become visible now, so
+	 * drop any metadata cached since the transaction was prepared.
+	 */
+	if (statementType == T_TransactionStmt &&
+		((TransactionStmt *) parsetree)->kind == TRANS_STMT_COMMIT_PREPARED)
+	{
+		InvalidateMetadataCache();
+	}
+}
+
+
+/*
+ * CopyIntoDistributedTable implements COPY FROM for distributed tables. The rows
+ * are parsed locally, which also computes defaults of columns missing from the
+ * input, and are assigned to shards by their partition value. Each shard's rows
+ * are buffered in COPY text format and sent to all of its placements at once,
+ * whenever the buffer fills up and at the end of the input. The function
+ * returns the number of copied rows.
+ */
+static uint64
+CopyIntoDistributedTable(CopyStmt *copyStatement)
+{
+	Relation distributedRelation = NULL;
+	Oid distributedTableId = InvalidOid;
+	Var *partitionColumn = NULL;
+	List *shardIntervalList = NIL;
+	TupleDesc tupleDescriptor = NULL;
+	int columnCount = 0;
+	int columnIndex = 0;
+	int partitionColumnIndex = 0;
+	Datum *columnValues = NULL;
+	bool *columnNulls = NULL;
+	FmgrInfo *columnOutputFunctions = NULL;
+	StringInfo columnNames = makeStringInfo();
+	Const *nullPartitionValue = NULL;
+	OpExpr *partitionRestriction = NULL;
+	Const *restrictionValue = NULL;
+	HTAB *destinationHash = NULL;
+	HASHCTL hashInfo;
+	HASH_SEQ_STATUS destinationStatus;
+	ShardCopyDestination *destination = NULL;
+	EState *executorState = NULL;
+	ExprContext *executorExpressionContext = NULL;
+	CopyState copyState = NULL;
+	ErrorContextCallback errorCallback;
+	uint64 processedCount = 0;
+
+	/* same permission requirements as for COPY on local tables */
+	if (copyStatement->filename != NULL && !superuser())
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be superuser to COPY to or from a file"),
+						errhint("Anyone can COPY to stdout or from stdin. "
+								"psql's \\copy command also works for anyone.")));
+	}
+
+	PreventCommandIfReadOnly("COPY FROM");
+
+	distributedRelation = heap_openrv(copyStatement->relation, RowExclusiveLock);
+	distributedTableId = RelationGetRelid(distributedRelation);
+	partitionColumn = PartitionColumn(distributedTableId);
+	partitionColumnIndex = partitionColumn->varattno - 1;
+
+	/* error out before reading any input if no shards exist */
+	shardIntervalList = DistributedTableShardList(distributedTableId);
+
+	/* the shards receive all columns, in text format with default options */
+	tupleDescriptor = RelationGetDescr(distributedRelation);
+	columnCount = tupleDescriptor->natts;
+	columnValues = (Datum *) palloc0(columnCount * sizeof(Datum));
+	columnNulls = (bool *) palloc0(columnCount * sizeof(bool));
+	columnOutputFunctions = (FmgrInfo *) palloc0(columnCount * sizeof(FmgrInfo));
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = tupleDescriptor->attrs[columnIndex];
+		Oid outputFunctionId = InvalidOid;
+		bool typeVariableLength = false;
+
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		getTypeOutputInfo(attribute->atttypid, &outputFunctionId, &typeVariableLength);
+		fmgr_info(outputFunctionId, &columnOutputFunctions[columnIndex]);
+
+		if (columnNames->len > 0)
+		{
+			appendStringInfoString(columnNames, ", ");
+		}
+		appendStringInfoString(columnNames,
+							   quote_identifier(NameStr(attribute->attname)));
+	}
+
+	nullPartitionValue = makeNullConst(partitionColumn->vartype,
+									   partitionColumn->vartypmod,
+									   partitionColumn->varcollid);
+	partitionRestriction = PartitionValueRestriction(partitionColumn,
+													 nullPartitionValue);
+	restrictionValue = (Const *) get_rightop((Expr *) partitionRestriction);
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(int64);
+	hashInfo.entrysize = sizeof(ShardCopyDestination);
+	hashInfo.hcxt = CurrentMemoryContext;
+	destinationHash = hash_create("pg_shard copy destinations", 32, &hashInfo,
+								  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	executorState = CreateExecutorState();
+	executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	copyState = BeginCopyFrom(distributedRelation, copyStatement->filename,
+							  copyStatement->is_program, copyStatement->attlist,
+							  copyStatement->options);
+
+	/* report the input line of errors like COPY into local tables does */
+	errorCallback.callback = CopyFromErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	while (true)
+	{
+		bool nextRowFound = false;
+		ShardInterval *shardInterval = NULL;
+		StringInfo copyData = NULL;
+		bool firstColumn = true;
+		MemoryContext oldContext = NULL;
+
+		ResetPerTupleExprContext(executorState);
+		oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(executorState));
+
+		nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+									columnValues, columnNulls, NULL);
+		if (!nextRowFound)
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		if (columnNulls[partitionColumnIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("cannot copy row with NULL value "
+								   "in partition column")));
+		}
+
+		restrictionValue->constvalue = columnValues[partitionColumnIndex];
+		restrictionValue->constisnull = false;
+
+		shardInterval = DestinationShardInterval(distributedTableId,
+												 partitionRestriction,
+												 shardIntervalList);
+
+		MemoryContextSwitchTo(oldContext);
+		destination = LookupShardCopyDestination(destinationHash, shardInterval,
+												 columnNames->data);
+		MemoryContextSwitchTo(GetPerTupleMemoryContext(executorState));
+
+		/* append the row in COPY text format */
+		copyData = destination->copyData;
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			Form_pg_attribute attribute = tupleDescriptor->attrs[columnIndex];
+
+			if (attribute->attisdropped)
+			{
+				continue;
+			}
+
+			if (!firstColumn)
+			{
+				appendStringInfoCharMacro(copyData, '\t');
+			}
+			firstColumn = false;
+
+			if (columnNulls[columnIndex])
+			{
+				appendStringInfoString(copyData, "\\N");
+			}
+			else
+			{
+				char *columnText = OutputFunctionCall(&columnOutputFunctions[columnIndex],
+													  columnValues[columnIndex]);
+				AppendCopyTextValue(copyData, columnText);
+			}
+		}
+		appendStringInfoCharMacro(copyData, '\n');
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (copyData->len >= SHARD_COPY_BUFFER_SIZE)
+		{
+			ExecuteTaskModify(destination->task, copyData);
+			resetStringInfo(copyData);
+		}
+
+		processedCount++;
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	/* rows are fully read, errors now stem from the shards */
+	error_context_stack = errorCallback.previous;
+
+	hash_seq_init(&destinationStatus, destinationHash);
+	while ((destination = hash_seq_search(&destinationStatus)) != NULL)
+	{
+		if (destination->copyData->len > 0)
+		{
+			ExecuteTaskModify(destination->task, destination->copyData);
+		}
+	}
+
+	EndCopyFrom(copyState);
+	FreeExecutorState(executorState);
+	hash_destroy(destinationHash);
+
+	heap_close(distributedRelation, NoLock);
+
+	return processedCount;
+}
+
+
+/*
+ * LookupShardCopyDestination returns the buffer collecting the rows copied into
+ * the given shard. Upon the first lookup of a shard, the function locks the
+ * shard as an INSERT would and creates the task copying rows into the shard.
+ */
+static ShardCopyDestination *
+LookupShardCopyDestination(HTAB *destinationHash, ShardInterval *shardInterval,
+						   char *columnNames)
+{
+	int64 shardId = shardInterval->id;
+	bool destinationFound = false;
+	ShardCopyDestination *destination = NULL;
+
+	destination = (ShardCopyDestination *) hash_search(destinationHash, &shardId,
+													   HASH_ENTER, &destinationFound);
+	if (!destinationFound)
+	{
+		char *shardName = get_rel_name(shardInterval->relationId);
+		LOCKMODE lockMode = CommutativityRuleToLockMode(CMD_INSERT);
+		Task *task = (Task *) palloc0(sizeof(Task));
+
+		AppendShardIdToName(&shardName, shardId);
+
+		/* grab shared metadata lock to stop concurrent placement additions */
+		LockShardDistributionMetadata(shardId, ShareLock);
+		LockShardData(shardId, lockMode);
+
+		task->queryString = makeStringInfo();
+		appendStringInfo(task->queryString, "COPY %s (%s) FROM STDIN",
+						 quote_identifier(shardName), columnNames);
+		task->taskPlacementList = LoadFinalizedShardPlacementList(shardId);
+		task->shardId = shardId;
+
+		if (LogDistributedStatements)
+		{
+			ereport(LOG, (errmsg("distributed statement: %s",
+								 task->queryString->data)));
+		}
+
+		destination->task = task;
+		destination->copyData = makeStringInfo();
+	}
+
+	return destination;
+}
+
+
+/*
+ * AppendCopyTextValue appends the given column value to the buffer, escaping the
+ * characters COPY's text format treats specially.
+ */
+static void
+AppendCopyTextValue(StringInfo copyData, char *value)
+{
+	char *character = NULL;
+
+	for (character = value; *character != '\0'; character++)
+	{
+		switch (*character)
+		{
+			case '\\':
+			{
+				appendStringInfoString(copyData, "\\\\");
+				break;
+			}
+
+			case '\n':
+			{
+				appendStringInfoString(copyData, "\\n");
+				break;
+			}
+
+			case '\r':
+			{
+				appendStringInfoString(copyData, "\\r");
+				break;
+			}
+
+			case '\t':
+			{
+				appendStringInfoString(copyData, "\\t");
+				break;
+			}
+
+			default:
+			{
+				appendStringInfoCharMacro(copyData, *character);
+				break;
+			}
+		}
+	}
 }
 
 
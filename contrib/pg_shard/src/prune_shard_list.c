@@ -16,8 +16,8 @@
 #include "fmgr.h"
 
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 #include "prune_shard_list.h"
-#include "create_shards.h"
 
 #include <stddef.h>
 
@@ -70,54 +70,32 @@ static List * BuildRestrictInfoList(List *qualList);
 static Node * BuildBaseConstraint(Var *column);
 static void UpdateConstraint(Node *baseConstraint, ShardInterval *shardInterval);
 
-static HTAB* shardPlacementCache;
+static SortedShardIntervalCacheEntry * LookupSortedShardIntervals(Oid relationId,
+																List *shardIntervalList);
+static void BuildSortedShardIntervals(Oid relationId, List *shardIntervalList,
+									  SortedShardIntervalCacheEntry *cacheEntry);
+static int CompareShardIntervals(const void *leftElement, const void *rightElement,
+								 void *arg);
+static bool PartitionValueSearchable(Oid relationId, List *whereClauseList,
+									 Var *partitionColumn, char partitionMethod,
+									 Datum *searchValue);
+static ShardInterval * SearchShardInterval(SortedShardIntervalCacheEntry *cacheEntry,
+										   Datum searchValue);
 
-typedef struct ShardPlacementEntryCacheEntry
-{
-	Oid tableId;
-	List** placements;
-} ShardPlacementCacheEntry;
-
-#define MAX_DISTRIBUTED_TABLES 101
-
-static List* 
-LookupShardPlacementCache(Oid relationId, int shardHashCode)
-{
-	ShardPlacementCacheEntry* entry = NULL;
 
-	if (shardPlacementCache == NULL)
-	{
-		HASHCTL info;
-		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-		memset(&info, 0, sizeof(info));
-		info.keysize = sizeof(Oid);
-		info.entrysize = sizeof(ShardPlacementCacheEntry);
-		info.hcxt = CacheMemoryContext;
-
-		shardPlacementCache = hash_create("pg_shard placement cache", MAX_DISTRIBUTED_TABLES, &info, hashFlags);
-	}
-	entry = hash_search(shardPlacementCache, &relationId, HASH_FIND, NULL);
-	return (entry != NULL) ? entry->placements[shardHashCode] : NULL;
-}
+/*
+ * SortedShardIntervalCache maps distributed tables to their shard intervals
+ * sorted by min value. It begins uninitialized; the first lookup creates it.
+ */
+static HTAB *SortedShardIntervalCache = NULL;
 
-static void 
-AddToShardPlacementCache(Oid relationId, int shardHashCode, int shardCount, List* shardPlacements)
-{
-	MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
-	bool found = false;
-	ShardPlacementCacheEntry* entry = (ShardPlacementCacheEntry*)hash_search(shardPlacementCache, &relationId, HASH_ENTER, &found);
-	if (!found)
-	{
-		entry->placements = palloc0(shardCount*sizeof(List*));
-	}
-	entry->placements[shardHashCode] = list_copy(shardPlacements);
-	MemoryContextSwitchTo(oldContext);
-}
 
 /*
  * PruneShardList prunes shards from given list based on the selection criteria,
- * and returns remaining shards in another list.
+ * and returns remaining shards in another list. If the only selection criterion
+ * is an equality restriction on the partition column and the table's shards do
+ * not overlap, the function binary searches the sorted shard intervals instead
+ * of checking each shard.
  */
 List *
 PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
@@ -126,12 +104,28 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 	ListCell *shardIntervalCell = NULL;
 	List *restrictInfoList = NIL;
 	Node *baseConstraint = NULL;
-	int shardHashCode = -1;
-	int shardCount = shardIntervalList->length;
-	uint32 hashTokenIncrement = (uint32)(HASH_TOKEN_COUNT / shardCount);
+	Datum searchValue = 0;
 	Var *partitionColumn = PartitionColumn(relationId);
 	char partitionMethod = PartitionType(relationId);
 
+	if (PartitionValueSearchable(relationId, whereClauseList, partitionColumn,
+								 partitionMethod, &searchValue))
+	{
+		SortedShardIntervalCacheEntry *cacheEntry =
+			LookupSortedShardIntervals(relationId, shardIntervalList);
+
+		if (cacheEntry->intervalsDisjoint)
+		{
+			ShardInterval *shardInterval = SearchShardInterval(cacheEntry, searchValue);
+			if (shardInterval != NULL)
+			{
+				remainingShardList = list_make1(shardInterval);
+			}
+
+			return remainingShardList;
+		}
+	}
+
 	/* build the filter clause list for the partition method */
 	switch (partitionMethod)
 	{
@@ -144,49 +138,10 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 
 		case HASH_PARTITION_TYPE:
 		{
-			Node *hashedNode = NULL;
-			List *hashedClauseList = NULL;
-			if (whereClauseList && whereClauseList->length == 1)
-			{
-				Expr* predicate = (Expr *)lfirst(list_head(whereClauseList));
-
-				if (IsA(predicate, OpExpr))
-				{
-					OpExpr *operatorExpression = (OpExpr *) predicate;
-					Oid leftHashFunction = InvalidOid;
-					Oid rightHashFunction = InvalidOid;
-					if (get_op_hash_functions(operatorExpression->opno,
-											  &leftHashFunction,
-											  &rightHashFunction)				
-						&& SimpleOpExpression(predicate)
-						&& OpExpressionContainsColumn(operatorExpression,
-													  partitionColumn))
-					{
-						Node *leftOperand = get_leftop(predicate);
-						Node *rightOperand = get_rightop(predicate);
-						Const *constant = (Const*)(IsA(rightOperand, Const) ? rightOperand : leftOperand);
-						TypeCacheEntry *typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
-						FmgrInfo *hashFunction = &(typeEntry->hash_proc_finfo);
-						if (OidIsValid(hashFunction->fn_oid))
-						{
-							int hashedValue = DatumGetInt32(FunctionCall1(hashFunction, constant->constvalue));
-							shardHashCode = (int)((uint32)(hashedValue - INT32_MIN) / hashTokenIncrement);
-							remainingShardList = LookupShardPlacementCache(relationId, shardHashCode);
-							if (remainingShardList != NULL)
-							{
-								return remainingShardList;
-							}
-						}
-					}
-				}
-			}
-			hashedNode = HashableClauseMutator((Node *) whereClauseList,
-											   partitionColumn);
-			hashedClauseList = (List *) hashedNode;
-			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
+			Node *hashedNode = HashableClauseMutator((Node *) whereClauseList,
+													 partitionColumn);
+			List *hashedClauseList = (List *) hashedNode;
 
-			/* override the partition column for hash partitioning */
-			partitionColumn = MakeInt4Column();
 			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
 
 			/* override the partition column for hash partitioning */
@@ -227,23 +182,301 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 			remainingShardList = lappend(remainingShardList, &(shardInterval->id));
 		}
 	}
-	if (shardHashCode >= 0)
+
+	return remainingShardList;
+}
+
+
+/*
+ * PartitionValueSearchable checks whether the where clause list consists of a
+ * single equality restriction between the partition column and a non-null
+ * constant. If so, the function sets searchValue to the value to look for in
+ * the shard intervals: the hashed constant for hash-partitioned tables, and
+ * the constant itself otherwise.
+ */
+static bool
+PartitionValueSearchable(Oid relationId, List *whereClauseList, Var *partitionColumn,
+						 char partitionMethod, Datum *searchValue)
+{
+	OpExpr *operatorExpression = NULL;
+	Node *leftOperand = NULL;
+	Node *rightOperand = NULL;
+	Const *constant = NULL;
+
+	if (list_length(whereClauseList) != 1 ||
+		!SimpleOpExpression((Expr *) linitial(whereClauseList)))
 	{
-		ShardInterval* shardInterval = (ShardInterval *) linitial(remainingShardList);
-		int64 shardId = shardInterval->id;
-		int32 shardMinHashToken = INT32_MIN + (shardId * hashTokenIncrement);
-		int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
-		if (shardId == (shardCount - 1))
+		return false;
+	}
+
+	operatorExpression = (OpExpr *) linitial(whereClauseList);
+	if (!OpExpressionContainsColumn(operatorExpression, partitionColumn))
+	{
+		return false;
+	}
+
+	leftOperand = get_leftop((Expr *) operatorExpression);
+	rightOperand = get_rightop((Expr *) operatorExpression);
+	constant = (Const *) (IsA(rightOperand, Const) ? rightOperand : leftOperand);
+
+	if (partitionMethod == HASH_PARTITION_TYPE)
+	{
+		Oid leftHashFunction = InvalidOid;
+		Oid rightHashFunction = InvalidOid;
+		TypeCacheEntry *typeEntry = NULL;
+		FmgrInfo *hashFunction = NULL;
+
+		if (!get_op_hash_functions(operatorExpression->opno, &leftHashFunction,
+								   &rightHashFunction))
 		{
-			shardMaxHashToken = INT32_MAX;
+			return false;
 		}
-		if (DatumGetInt32(shardInterval->minValue) == shardMinHashToken &&
-			DatumGetInt32(shardInterval->maxValue) == shardMaxHashToken)
-		{		
-			AddToShardPlacementCache(relationId, shardHashCode, shardIntervalList->length, remainingShardList);
+
+		typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
+		hashFunction = &(typeEntry->hash_proc_finfo);
+		if (!OidIsValid(hashFunction->fn_oid))
+		{
+			return false;
 		}
+
+		/* hash the constant the same way MakeHashedOperatorExpression does */
+		(*searchValue) = FunctionCall1(hashFunction, constant->constvalue);
 	}
-	return remainingShardList;
+	else
+	{
+		TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+													  TYPECACHE_EQ_OPR);
+
+		if (constant->consttype != partitionColumn->vartype ||
+			operatorExpression->opno != typeEntry->eq_opr)
+		{
+			return false;
+		}
+
+		(*searchValue) = constant->constvalue;
+	}
+
+	return true;
+}
+
+
+/*
+ * LookupSortedShardIntervals returns an entry holding the given shard interval
+ * list sorted by min value. If the list is the one the metadata cache holds for
+ * the table, the entry is cached until the metadata version changes. Other
+ * lists may not outlive the caller, so their entry is built in the current
+ * memory context instead.
+ */
+static SortedShardIntervalCacheEntry *
+LookupSortedShardIntervals(Oid relationId, List *shardIntervalList)
+{
+	SortedShardIntervalCacheEntry *cacheEntry = NULL;
+	MemoryContext oldContext = NULL;
+	uint64 metadataVersion = CurrentMetadataVersion();
+	bool entryFound = false;
+
+	if (shardIntervalList != LookupShardIntervalList(relationId))
+	{
+		cacheEntry = palloc0(sizeof(SortedShardIntervalCacheEntry));
+		BuildSortedShardIntervals(relationId, shardIntervalList, cacheEntry);
+
+		return cacheEntry;
+	}
+
+	/* if first call, initialize the cache */
+	if (SortedShardIntervalCache == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(Oid);
+		info.entrysize = sizeof(SortedShardIntervalCacheEntry);
+		info.hcxt = CacheMemoryContext;
+
+		SortedShardIntervalCache = hash_create("pg_shard sorted shard intervals", 32,
+											   &info, hashFlags);
+	}
+
+	cacheEntry = hash_search(SortedShardIntervalCache, &relationId, HASH_ENTER,
+							 &entryFound);
+	if (entryFound && cacheEntry->shardIntervalList == shardIntervalList &&
+		cacheEntry->metadataVersion == metadataVersion)
+	{
+		return cacheEntry;
+	}
+
+	if (entryFound && cacheEntry->sortedIntervalArray != NULL)
+	{
+		pfree(cacheEntry->sortedIntervalArray);
+	}
+
+	/* keep the entry invalid until it is completely built */
+	cacheEntry->shardIntervalList = NIL;
+	cacheEntry->sortedIntervalArray = NULL;
+
+	oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+	BuildSortedShardIntervals(relationId, shardIntervalList, cacheEntry);
+	MemoryContextSwitchTo(oldContext);
+
+	cacheEntry->metadataVersion = metadataVersion;
+
+	return cacheEntry;
+}
+
+
+/*
+ * BuildSortedShardIntervals fills the entry with the shard intervals of the
+ * list, sorted by min value, and determines whether the intervals are disjoint.
+ * The sorted array is allocated in the current memory context.
+ */
+static void
+BuildSortedShardIntervals(Oid relationId, List *shardIntervalList,
+						  SortedShardIntervalCacheEntry *cacheEntry)
+{
+	ShardIntervalCompareContext *compareContext = &cacheEntry->compareContext;
+	ListCell *shardIntervalCell = NULL;
+	int shardIndex = 0;
+
+	cacheEntry->shardCount = list_length(shardIntervalList);
+	cacheEntry->sortedIntervalArray = palloc0(cacheEntry->shardCount *
+											  sizeof(ShardInterval *));
+	cacheEntry->intervalsDisjoint = false;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		cacheEntry->sortedIntervalArray[shardIndex] = lfirst(shardIntervalCell);
+		shardIndex++;
+	}
+
+	/* the type cache entry, and so the comparison function, is never freed */
+	compareContext->compareFunction = NULL;
+	compareContext->collation = InvalidOid;
+
+	if (cacheEntry->shardCount > 0)
+	{
+		Oid valueTypeId = cacheEntry->sortedIntervalArray[0]->valueTypeId;
+		Var *partitionColumn = PartitionColumn(relationId);
+		TypeCacheEntry *typeEntry = lookup_type_cache(valueTypeId,
+													  TYPECACHE_CMP_PROC_FINFO);
+
+		/* without an ordering we cannot search, so check each shard instead */
+		if (!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			cacheEntry->shardIntervalList = shardIntervalList;
+			return;
+		}
+
+		/* hashed values are plain integers, range values use the column's collation */
+		if (valueTypeId == partitionColumn->vartype)
+		{
+			compareContext->collation = partitionColumn->varcollid;
+		}
+
+		compareContext->compareFunction = &(typeEntry->cmp_proc_finfo);
+	}
+
+	qsort_arg(cacheEntry->sortedIntervalArray, cacheEntry->shardCount,
+			  sizeof(ShardInterval *), CompareShardIntervals, compareContext);
+
+	/* binary search requires each interval to end before the next one starts */
+	cacheEntry->intervalsDisjoint = true;
+	for (shardIndex = 0; shardIndex < cacheEntry->shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedIntervalArray[shardIndex];
+		Datum compareResult = FunctionCall2Coll(compareContext->compareFunction,
+												compareContext->collation,
+												shardInterval->minValue,
+												shardInterval->maxValue);
+		if (DatumGetInt32(compareResult) > 0)
+		{
+			cacheEntry->intervalsDisjoint = false;
+			break;
+		}
+
+		if (shardIndex + 1 < cacheEntry->shardCount)
+		{
+			ShardInterval *nextInterval = cacheEntry->sortedIntervalArray[shardIndex + 1];
+
+			compareResult = FunctionCall2Coll(compareContext->compareFunction,
+											  compareContext->collation,
+											  shardInterval->maxValue,
+											  nextInterval->minValue);
+			if (DatumGetInt32(compareResult) >= 0)
+			{
+				cacheEntry->intervalsDisjoint = false;
+				break;
+			}
+		}
+	}
+
+	cacheEntry->shardIntervalList = shardIntervalList;
+}
+
+
+/*
+ * CompareShardIntervals is a comparison function for sorting shard intervals by
+ * their min values, using the comparison function given in the context.
+ */
+static int
+CompareShardIntervals(const void *leftElement, const void *rightElement, void *arg)
+{
+	ShardInterval *leftInterval = *((ShardInterval **) leftElement);
+	ShardInterval *rightInterval = *((ShardInterval **) rightElement);
+	ShardIntervalCompareContext *compareContext = (ShardIntervalCompareContext *) arg;
+
+	Datum compareResult = FunctionCall2Coll(compareContext->compareFunction,
+											compareContext->collation,
+											leftInterval->minValue,
+											rightInterval->minValue);
+
+	return DatumGetInt32(compareResult);
+}
+
+
+/*
+ * SearchShardInterval binary searches the disjoint, sorted shard intervals of
+ * the cache entry for the one containing the given value. The function returns
+ * NULL if no shard interval contains the value.
+ */
+static ShardInterval *
+SearchShardInterval(SortedShardIntervalCacheEntry *cacheEntry, Datum searchValue)
+{
+	ShardIntervalCompareContext *compareContext = &cacheEntry->compareContext;
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = cacheEntry->shardCount;
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = lowerBoundIndex + (upperBoundIndex - lowerBoundIndex) / 2;
+		ShardInterval *shardInterval = cacheEntry->sortedIntervalArray[middleIndex];
+		int minValueComparison = 0;
+		int maxValueComparison = 0;
+
+		minValueComparison = DatumGetInt32(FunctionCall2Coll(
+											   compareContext->compareFunction,
+											   compareContext->collation,
+											   searchValue, shardInterval->minValue));
+		if (minValueComparison < 0)
+		{
+			upperBoundIndex = middleIndex;
+			continue;
+		}
+
+		maxValueComparison = DatumGetInt32(FunctionCall2Coll(
+											   compareContext->compareFunction,
+											   compareContext->collation,
+											   searchValue, shardInterval->maxValue));
+		if (maxValueComparison > 0)
+		{
+			lowerBoundIndex = middleIndex + 1;
+			continue;
+		}
+
+		return shardInterval;
+	}
+
+	return NULL;
 }
 
 
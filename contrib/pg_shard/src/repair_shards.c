@@ -13,6 +13,8 @@
 #include "postgres.h"
 #include "c.h"
 #include "fmgr.h"
+#include "funcapi.h"
+#include "libpq-fe.h"
 #include "miscadmin.h"
 
 #include "connection.h"
@@ -22,51 +24,119 @@
 #include "distribution_metadata.h"
 #include "pg_shard.h"
 
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "access/heapam.h"
 #include "access/htup.h"
+#include "access/htup_details.h"
 #include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/pg_class.h"
-#include "executor/tuptable.h"
+#include "catalog/pg_type.h"
 #include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "storage/lock.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/palloc.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
-#include "utils/tuplestore.h"
+#include "utils/syscache.h"
+
+
+/*
+ * ShardRepairState tracks the progress of a shard placement repair. Rows are
+ * streamed from the source to the target placement with COPY, after which the
+ * target builds the indexes and commits.
+ */
+typedef enum ShardRepairState
+{
+	REPAIR_PENDING = 0,
+	REPAIR_COPYING = 1,           /* relaying rows from source to target */
+	REPAIR_ENDING_COPY = 2,       /* flushing last rows before ending the COPY */
+	REPAIR_LOADING = 3,           /* waiting for the target to finish the COPY */
+	REPAIR_BUILDING_INDEXES = 4,  /* waiting for index builds and commit */
+	REPAIR_DONE = 5,
+	REPAIR_FAILED = 6
+} ShardRepairState;
+
+
+/*
+ * ShardRepair holds everything needed to repair one shard placement, along with
+ * the state of the repair while it runs concurrently with others.
+ */
+typedef struct ShardRepair
+{
+	int64 shardId;
+	ShardPlacement *sourcePlacement;
+	ShardPlacement *targetPlacement;
+	List *recreateCommandList;  /* drops and recreates the table without indexes */
+	char *copyOutCommand;       /* COPY ... TO STDOUT run on the source */
+	char *copyInCommand;        /* COPY ... FROM STDIN run on the target */
+	char *finishCommand;        /* builds indexes and commits on the target */
+
+	ShardRepairState state;
+	PGconn *sourceConnection;
+	PGconn *targetConnection;
+	char *copyBuffer;           /* row received from source, not yet queued */
+	int copyBufferLength;
+	bool flushPending;          /* target has queued data it couldn't send yet */
+} ShardRepair;
+
+
+/* configuration for the number of shards repaired at once */
+int MaxParallelShardRepairs = 4;
 
 
 /* local function forward declarations */
+static ShardRepair * PrepareShardRepair(int64 shardId, text *sourceNodeName,
+										int32 sourceNodePort, text *targetNodeName,
+										int32 targetNodePort);
 static ShardPlacement * SearchShardPlacementInList(List *shardPlacementList,
 												   text *nodeName, int32 nodePort);
 static List * RecreateTableDDLCommandList(Oid relationId, int64 shardId);
-static bool CopyDataFromFinalizedPlacement(Oid distributedTableId, int64 shardId,
-										   ShardPlacement *healthyPlacement,
-										   ShardPlacement *placementToRepair);
-static void CopyDataFromTupleStoreToRelation(Tuplestorestate *tupleStore,
-											 Relation relation);
+static char * FinishRepairCommand(Oid relationId, int64 shardId);
+static bool BinaryCopySupported(Oid relationId);
+static bool TypeSupportsBinaryCopy(Oid typeId);
+static int CompareShardIds(const void *leftElement, const void *rightElement);
+static void ExecuteShardRepairs(List *shardRepairList);
+static bool StartShardRepair(ShardRepair *repair);
+static bool ExecuteRepairCommand(PGconn *connection, const char *command,
+								 ExecStatusType expectedStatus);
+static void AdvanceShardRepair(ShardRepair *repair);
+static void RelayCopyData(ShardRepair *repair);
+static void EndTargetCopy(ShardRepair *repair);
+static ShardRepairState ReceiveRepairResults(PGconn *connection,
+											 ShardRepairState currentState,
+											 ShardRepairState nextState);
+static void SetRepairPollDescriptor(ShardRepair *repair, struct pollfd *pollDescriptor);
+static void FailShardRepair(ShardRepair *repair, PGconn *connection);
+static void CloseShardRepairConnections(ShardRepair *repair);
+static bool CopyQueryResultsToRelation(PGconn *connection, char *queryString,
+									   Relation relation);
 
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_copy_shard_placement);
+PG_FUNCTION_INFO_V1(master_copy_shard_placements);
 PG_FUNCTION_INFO_V1(worker_copy_shard_placement);
 
 
 /*
  * master_copy_shard_placement implements a user-facing UDF to copy data from
  * a healthy (source) node to an inactive (target) node. To accomplish this it
- * entirely recreates the table structure before copying all data. During this
- * time all modifications are paused to the shard. After successful repair, the
- * inactive placement is marked healthy and modifications may continue. If the
- * repair fails at any point, this function throws an error, leaving the node
- * in an unhealthy state.
+ * entirely recreates the table structure before streaming all data from the
+ * source to the target and building the table's indexes. During this time all
+ * modifications are paused to the shard. After successful repair, the inactive
+ * placement is marked healthy and modifications may continue. If the repair
+ * fails at any point, this function throws an error, leaving the node in an
+ * unhealthy state.
  */
 Datum
 master_copy_shard_placement(PG_FUNCTION_ARGS)
@@ -76,84 +146,107 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 	int32 sourceNodePort = PG_GETARG_INT32(2);
 	text *targetNodeName = PG_GETARG_TEXT_P(3);
 	int32 targetNodePort = PG_GETARG_INT32(4);
-	ShardInterval *shardInterval = LoadShardInterval(shardId);
-	Oid distributedTableId = shardInterval->relationId;
 
-	List *shardPlacementList = NIL;
-	ShardPlacement *sourcePlacement = NULL;
-	ShardPlacement *targetPlacement = NULL;
-	List *ddlCommandList = NIL;
-	bool recreated = false;
-	bool dataCopied = false;
+	ShardRepair *repair = PrepareShardRepair(shardId, sourceNodeName, sourceNodePort,
+											 targetNodeName, targetNodePort);
 
-	/*
-	 * By taking an exclusive lock on the shard, we both stop all modifications
-	 * (INSERT, UPDATE, or DELETE) and prevent concurrent repair operations from
-	 * being able to operate on this shard.
-	 */
-	LockShardData(shardId, ExclusiveLock);
+	ExecuteShardRepairs(list_make1(repair));
 
-	/*
-	 * We've stopped data modifications of this shard, but we plan to move
-	 * a placement to the healthy state, so we need to grab a shard metadata
-	 * lock (in exclusive mode) as well.
-	 */
-	LockShardDistributionMetadata(shardId, ExclusiveLock);
-
-	shardPlacementList = LoadShardPlacementList(shardId);
-	sourcePlacement = SearchShardPlacementInList(shardPlacementList, sourceNodeName,
-												 sourceNodePort);
-	if (sourcePlacement->shardState != STATE_FINALIZED)
+	if (repair->state != REPAIR_DONE)
 	{
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						errmsg("source placement must be in finalized state")));
+		ereport(ERROR, (errmsg("could not copy shard data"),
+						errhint("Consult recent messages in the server logs for "
+								"details.")));
 	}
 
-	targetPlacement = SearchShardPlacementInList(shardPlacementList, targetNodeName,
-												 targetNodePort);
-	if (targetPlacement->shardState != STATE_INACTIVE)
-	{
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						errmsg("target placement must be in inactive state")));
-	}
+	PG_RETURN_VOID();
+}
 
-	/* retrieve the DDL commands for the table and run them */
-	ddlCommandList = RecreateTableDDLCommandList(distributedTableId, shardId);
 
-	recreated = ExecuteRemoteCommandList(targetPlacement->nodeName,
-										 targetPlacement->nodePort,
-										 ddlCommandList);
-	if (!recreated)
+/*
+ * master_copy_shard_placements repairs the placements of all given shards on
+ * the target node using data from their placements on the source node. Up to
+ * pg_shard.max_parallel_repairs shards are copied at once. A shard whose repair
+ * fails is reported with a warning and its placement stays inactive; the
+ * function returns the number of repaired placements.
+ */
+Datum
+master_copy_shard_placements(PG_FUNCTION_ARGS)
+{
+	ArrayType *shardIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	text *sourceNodeName = PG_GETARG_TEXT_P(1);
+	int32 sourceNodePort = PG_GETARG_INT32(2);
+	text *targetNodeName = PG_GETARG_TEXT_P(3);
+	int32 targetNodePort = PG_GETARG_INT32(4);
+
+	Datum *shardIdDatumArray = NULL;
+	bool *shardIdNullArray = NULL;
+	int shardIdCount = 0;
+	int64 *shardIdArray = NULL;
+	int shardIndex = 0;
+	int32 repairedCount = 0;
+	List *shardRepairList = NIL;
+	ListCell *shardRepairCell = NULL;
+
+	deconstruct_array(shardIdArrayObject, INT8OID, sizeof(int64), FLOAT8PASSBYVAL,
+					  'd', &shardIdDatumArray, &shardIdNullArray, &shardIdCount);
+
+	shardIdArray = (int64 *) palloc0(shardIdCount * sizeof(int64));
+	for (shardIndex = 0; shardIndex < shardIdCount; shardIndex++)
 	{
-		ereport(ERROR, (errmsg("could not recreate shard table"),
-						errhint("Consult recent messages in the server logs for "
-								"details.")));
+		if (shardIdNullArray[shardIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("shard identifiers must not be null")));
+		}
+
+		shardIdArray[shardIndex] = DatumGetInt64(shardIdDatumArray[shardIndex]);
 	}
 
-	HOLD_INTERRUPTS();
+	/* lock shards in a consistent order to avoid deadlocks with other repairs */
+	qsort(shardIdArray, shardIdCount, sizeof(int64), CompareShardIds);
 
-	dataCopied = CopyDataFromFinalizedPlacement(distributedTableId, shardId,
-												sourcePlacement, targetPlacement);
-	if (!dataCopied)
+	for (shardIndex = 0; shardIndex < shardIdCount; shardIndex++)
 	{
-		ereport(ERROR, (errmsg("could not copy shard data"),
-						errhint("Consult recent messages in the server logs for "
-								"details.")));
+		ShardRepair *repair = NULL;
+
+		if (shardIndex > 0 && shardIdArray[shardIndex] == shardIdArray[shardIndex - 1])
+		{
+			continue;
+		}
+
+		repair = PrepareShardRepair(shardIdArray[shardIndex], sourceNodeName,
+									sourceNodePort, targetNodeName, targetNodePort);
+		shardRepairList = lappend(shardRepairList, repair);
 	}
 
-	/* the placement is repaired, so return to finalized state */
-	UpdateShardPlacementRowState(targetPlacement->id, STATE_FINALIZED);
+	ExecuteShardRepairs(shardRepairList);
+
+	foreach(shardRepairCell, shardRepairList)
+	{
+		ShardRepair *repair = (ShardRepair *) lfirst(shardRepairCell);
 
-	RESUME_INTERRUPTS();
+		if (repair->state == REPAIR_DONE)
+		{
+			repairedCount++;
+		}
+		else
+		{
+			ereport(WARNING, (errmsg("could not repair placement of shard " INT64_FORMAT
+									 " on \"%s:%d\"", repair->shardId,
+									 repair->targetPlacement->nodeName,
+									 repair->targetPlacement->nodePort)));
+		}
+	}
 
-	PG_RETURN_VOID();
+	PG_RETURN_INT32(repairedCount);
 }
 
 
 /*
  * worker_copy_shard_placement implements a internal UDF to copy a table's data from
- * a healthy placement into a receiving table on an unhealthy placement. This
- * function returns a boolean reflecting success or failure.
+ * a healthy placement into a receiving table on an unhealthy placement. Rows are
+ * inserted as they arrive rather than collected first.
  */
 Datum
 worker_copy_shard_placement(PG_FUNCTION_ARGS)
@@ -167,26 +260,19 @@ worker_copy_shard_placement(PG_FUNCTION_ARGS)
 
 	Oid shardRelationId = ResolveRelationId(shardRelationNameText);
 	Relation shardTable = heap_open(shardRelationId, RowExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(shardTable);
-	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	StringInfo selectAllQuery = makeStringInfo();
+	PGconn *connection = NULL;
 
-	StringInfo selectAllQuery = NULL;
-	ShardPlacement *placement = NULL;
-	Task *task = NULL;
-
-	selectAllQuery = makeStringInfo();
 	appendStringInfo(selectAllQuery, SELECT_ALL_QUERY,
 					 quote_identifier(shardRelationName));
 
-	placement = (ShardPlacement *) palloc0(sizeof(ShardPlacement));
-	placement->nodeName = nodeName;
-	placement->nodePort = nodePort;
-
-	task = (Task *) palloc0(sizeof(Task));
-	task->queryString = selectAllQuery;
-	task->taskPlacementList = list_make1(placement);
+	connection = GetConnection(nodeName, nodePort, true);
+	if (connection != NULL)
+	{
+		fetchSuccessful = CopyQueryResultsToRelation(connection, selectAllQuery->data,
+													 shardTable);
+	}
 
-	fetchSuccessful = ExecuteTaskAndStoreResults(task, tupleDescriptor, tupleStore);
 	if (!fetchSuccessful)
 	{
 		ereport(ERROR, (errmsg("could not store shard rows from healthy placement"),
@@ -194,16 +280,100 @@ worker_copy_shard_placement(PG_FUNCTION_ARGS)
 								"details.")));
 	}
 
-	CopyDataFromTupleStoreToRelation(tupleStore, shardTable);
-
-	tuplestore_end(tupleStore);
-
 	heap_close(shardTable, RowExclusiveLock);
 
 	PG_RETURN_VOID();
 }
 
 
+/*
+ * PrepareShardRepair locks the given shard, checks that its placements can be
+ * used as the source and target of a repair, and builds the commands needed to
+ * repair the target placement.
+ */
+static ShardRepair *
+PrepareShardRepair(int64 shardId, text *sourceNodeName, int32 sourceNodePort,
+				   text *targetNodeName, int32 targetNodePort)
+{
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+	char relationKind = get_rel_relkind(distributedTableId);
+	char *relationName = get_rel_name(distributedTableId);
+	const char *shardName = NULL;
+	const char *copyFormat = NULL;
+	StringInfo copyOutCommand = makeStringInfo();
+	StringInfo copyInCommand = makeStringInfo();
+
+	List *shardPlacementList = NIL;
+	ShardRepair *repair = (ShardRepair *) palloc0(sizeof(ShardRepair));
+
+	/*
+	 * By taking an exclusive lock on the shard, we both stop all modifications
+	 * (INSERT, UPDATE, or DELETE) and prevent concurrent repair operations from
+	 * being able to operate on this shard.
+	 */
+	LockShardData(shardId, ExclusiveLock);
+
+	/*
+	 * We've stopped data modifications of this shard, but we plan to move
+	 * a placement to the healthy state, so we need to grab a shard metadata
+	 * lock (in exclusive mode) as well.
+	 */
+	LockShardDistributionMetadata(shardId, ExclusiveLock);
+
+	shardPlacementList = LoadShardPlacementList(shardId);
+	repair->sourcePlacement = SearchShardPlacementInList(shardPlacementList,
+														 sourceNodeName,
+														 sourceNodePort);
+	if (repair->sourcePlacement->shardState != STATE_FINALIZED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("source placement must be in finalized state")));
+	}
+
+	repair->targetPlacement = SearchShardPlacementInList(shardPlacementList,
+														 targetNodeName,
+														 targetNodePort);
+	if (repair->targetPlacement->shardState != STATE_INACTIVE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("target placement must be in inactive state")));
+	}
+
+	if (relationKind == RELKIND_FOREIGN_TABLE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot repair shard"),
+						errdetail("Repairing shards backed by foreign tables is "
+								  "not supported.")));
+	}
+	else if (relationKind != RELKIND_RELATION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						errmsg("repair target is not a regular or foreign table")));
+	}
+
+	AppendShardIdToName(&relationName, shardId);
+	shardName = quote_identifier(relationName);
+
+	/* both placements get the same definition, so binary data is portable */
+	copyFormat = BinaryCopySupported(distributedTableId) ? "binary" : "text";
+
+	appendStringInfo(copyOutCommand, COPY_OUT_SHARD_COMMAND, shardName, copyFormat);
+	appendStringInfo(copyInCommand, COPY_IN_SHARD_COMMAND, shardName, copyFormat);
+
+	repair->shardId = shardId;
+	repair->recreateCommandList = RecreateTableDDLCommandList(distributedTableId,
+															  shardId);
+	repair->copyOutCommand = copyOutCommand->data;
+	repair->copyInCommand = copyInCommand->data;
+	repair->finishCommand = FinishRepairCommand(distributedTableId, shardId);
+	repair->state = REPAIR_PENDING;
+
+	return repair;
+}
+
+
 /*
  * SearchShardPlacementInList searches a provided list for a shard placement
  * with the specified node name and port. This function throws an error if no
@@ -241,10 +411,9 @@ SearchShardPlacementInList(List *shardPlacementList, text *nodeNameText, int32 n
 
 
 /*
- * RecreateTableDDLCommandList returns a list of DDL statements similar to that
- * returned by ExtendedDDLCommandList except that the list begins with a "DROP
- * TABLE" or "DROP FOREIGN TABLE" statement to facilitate total recreation of a
- * placement.
+ * RecreateTableDDLCommandList returns a list of DDL statements which drop the
+ * shard's table and create it again, leaving out its indexes so that they can
+ * be built after the data is loaded.
  */
 static List *
 RecreateTableDDLCommandList(Oid relationId, int64 shardId)
@@ -256,109 +425,726 @@ RecreateTableDDLCommandList(Oid relationId, int64 shardId)
 	List *extendedCreateCommandList = NIL;
 	List *extendedDropCommandList = NIL;
 	List *extendedRecreateCommandList = NIL;
-	char relationKind = get_rel_relkind(relationId);
 
 	AppendShardIdToName(&relationName, shardId);
 	shardName = quote_identifier(relationName);
 
-	/* build appropriate DROP command based on relation kind */
-	if (relationKind == RELKIND_RELATION)
+	appendStringInfo(extendedDropCommand, DROP_REGULAR_TABLE_COMMAND, shardName);
+	extendedDropCommandList = list_make1(extendedDropCommand->data);
+
+	createCommandList = TableCreationDDLCommandList(relationId);
+	extendedCreateCommandList = ExtendedDDLCommandList(relationId, shardId,
+													   createCommandList);
+
+	extendedRecreateCommandList = list_concat(extendedDropCommandList,
+											  extendedCreateCommandList);
+
+	return extendedRecreateCommandList;
+}
+
+
+/*
+ * FinishRepairCommand returns the command string run on the target placement
+ * once all rows are loaded: it creates the shard's indexes and constraints and
+ * commits the load.
+ */
+static char *
+FinishRepairCommand(Oid relationId, int64 shardId)
+{
+	List *indexCommandList = TableIndexDDLCommandList(relationId);
+	List *extendedIndexCommandList = ExtendedDDLCommandList(relationId, shardId,
+															indexCommandList);
+	StringInfo finishCommand = makeStringInfo();
+	ListCell *indexCommandCell = NULL;
+
+	foreach(indexCommandCell, extendedIndexCommandList)
 	{
-		appendStringInfo(extendedDropCommand, DROP_REGULAR_TABLE_COMMAND, shardName);
+		char *indexCommand = (char *) lfirst(indexCommandCell);
+
+		appendStringInfo(finishCommand, "%s;\n", indexCommand);
 	}
-	else if (relationKind == RELKIND_FOREIGN_TABLE)
+
+	appendStringInfoString(finishCommand, COMMIT_COMMAND);
+
+	return finishCommand->data;
+}
+
+
+/*
+ * BinaryCopySupported returns whether all columns of the given relation have
+ * types with binary send and receive functions, so that shard data can be
+ * copied in binary format.
+ */
+static bool
+BinaryCopySupported(Oid relationId)
+{
+	Relation relation = relation_open(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	bool binarySupported = true;
+	int columnIndex = 0;
+
+	for (columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = tupleDescriptor->attrs[columnIndex];
+
+		if (column->attisdropped)
+		{
+			continue;
+		}
+
+		if (!TypeSupportsBinaryCopy(column->atttypid))
+		{
+			binarySupported = false;
+			break;
+		}
+	}
+
+	relation_close(relation, AccessShareLock);
+
+	return binarySupported;
+}
+
+
+/*
+ * TypeSupportsBinaryCopy checks whether values of the given type can be sent
+ * and received in binary format. Arrays and ranges depend on their element
+ * types; composite types are conservatively reported as unsupported.
+ */
+static bool
+TypeSupportsBinaryCopy(Oid typeId)
+{
+	Oid baseTypeId = getBaseType(typeId);
+	Oid elementTypeId = get_element_type(baseTypeId);
+	HeapTuple typeTuple = NULL;
+	Form_pg_type typeForm = NULL;
+	bool binarySupported = false;
+
+	if (OidIsValid(elementTypeId))
+	{
+		return TypeSupportsBinaryCopy(elementTypeId);
+	}
+
+	typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(baseTypeId));
+	if (!HeapTupleIsValid(typeTuple))
+	{
+		return false;
+	}
+
+	typeForm = (Form_pg_type) GETSTRUCT(typeTuple);
+	binarySupported = (typeForm->typtype != TYPTYPE_COMPOSITE &&
+					   OidIsValid(typeForm->typsend) &&
+					   OidIsValid(typeForm->typreceive));
+
+	ReleaseSysCache(typeTuple);
+
+	if (binarySupported && type_is_range(baseTypeId))
+	{
+		binarySupported = TypeSupportsBinaryCopy(get_range_subtype(baseTypeId));
+	}
+
+	return binarySupported;
+}
+
+
+/* Helper function to sort shard identifiers in ascending order with qsort */
+static int
+CompareShardIds(const void *leftElement, const void *rightElement)
+{
+	int64 leftShardId = *((const int64 *) leftElement);
+	int64 rightShardId = *((const int64 *) rightElement);
+
+	if (leftShardId > rightShardId)
 	{
-		appendStringInfo(extendedDropCommand, DROP_FOREIGN_TABLE_COMMAND, shardName);
+		return 1;
+	}
+	else if (leftShardId < rightShardId)
+	{
+		return -1;
 	}
 	else
 	{
-		ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
-						errmsg("repair target is not a regular or foreign table")));
+		return 0;
 	}
+}
 
-	extendedDropCommandList = list_make1(extendedDropCommand->data);
 
-	createCommandList = TableDDLCommandList(relationId);
-	extendedCreateCommandList = ExtendedDDLCommandList(relationId, shardId,
-													   createCommandList);
+/*
+ * ExecuteShardRepairs runs the given repairs, at most MaxParallelShardRepairs
+ * of them at a time. Each repair uses its own pair of connections, rows are
+ * relayed from the source to the target as they arrive and never stored
+ * locally. Placements repaired successfully are marked as finalized; failed
+ * repairs are left in the REPAIR_FAILED state for the caller to report. On
+ * error, all connections are closed, which rolls back the loads in progress.
+ */
+static void
+ExecuteShardRepairs(List *shardRepairList)
+{
+	int repairCount = list_length(shardRepairList);
+	ShardRepair **repairArray =
+		(ShardRepair **) palloc0(repairCount * sizeof(ShardRepair *));
+	struct pollfd *pollDescriptorArray =
+		(struct pollfd *) palloc0(repairCount * sizeof(struct pollfd));
+	int repairIndex = 0;
+	ListCell *shardRepairCell = NULL;
 
-	extendedRecreateCommandList = list_concat(extendedDropCommandList,
-											  extendedCreateCommandList);
+	foreach(shardRepairCell, shardRepairList)
+	{
+		repairArray[repairIndex++] = (ShardRepair *) lfirst(shardRepairCell);
+	}
 
-	return extendedRecreateCommandList;
+	PG_TRY();
+	{
+		int startedCount = 0;
+		int runningCount = 0;
+		int finishedCount = 0;
+
+		while (finishedCount < repairCount)
+		{
+			int pollCount = 0;
+
+			while (runningCount < MaxParallelShardRepairs && startedCount < repairCount)
+			{
+				ShardRepair *repair = repairArray[startedCount++];
+
+				if (StartShardRepair(repair))
+				{
+					runningCount++;
+				}
+				else
+				{
+					finishedCount++;
+				}
+			}
+
+			for (repairIndex = 0; repairIndex < startedCount; repairIndex++)
+			{
+				ShardRepair *repair = repairArray[repairIndex];
+
+				if (repair->state == REPAIR_DONE || repair->state == REPAIR_FAILED)
+				{
+					continue;
+				}
+
+				AdvanceShardRepair(repair);
+
+				if (repair->state == REPAIR_DONE)
+				{
+					CloseShardRepairConnections(repair);
+
+					/* the placement is repaired, so return to finalized state */
+					UpdateShardPlacementRowState(repair->targetPlacement->id,
+												 STATE_FINALIZED);
+				}
+
+				if (repair->state == REPAIR_DONE || repair->state == REPAIR_FAILED)
+				{
+					runningCount--;
+					finishedCount++;
+					continue;
+				}
+
+				SetRepairPollDescriptor(repair, &pollDescriptorArray[pollCount++]);
+			}
+
+			if (pollCount > 0)
+			{
+				/* errors (including EINTR) are handled by rechecking all repairs */
+				(void) poll(pollDescriptorArray, pollCount, REPAIR_POLL_TIMEOUT);
+			}
+
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	PG_CATCH();
+	{
+		for (repairIndex = 0; repairIndex < repairCount; repairIndex++)
+		{
+			CloseShardRepairConnections(repairArray[repairIndex]);
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pfree(pollDescriptorArray);
+	pfree(repairArray);
 }
 
 
 /*
- * CopyDataFromFinalizedPlacement copies a the data for a shard (identified by
- * a relation and shard identifier) from a healthy placement to one needing
- * repair. The unhealthy placement must already have an empty relation in place
- * to receive rows from the healthy placement. This function returns a boolean
- * indicating success or failure.
+ * StartShardRepair recreates the table of the target placement and starts the
+ * COPY commands on both placements. The target's COPY runs in a transaction
+ * which also builds the indexes once the rows are loaded. The function returns
+ * false if the repair could not be started.
  */
 static bool
-CopyDataFromFinalizedPlacement(Oid distributedTableId, int64 shardId,
-							   ShardPlacement *healthyPlacement,
-							   ShardPlacement *placementToRepair)
+StartShardRepair(ShardRepair *repair)
 {
-	char *relationName = get_rel_name(distributedTableId);
-	const char *shardName = NULL;
-	StringInfo copyRelationQuery = makeStringInfo();
-	bool copySuccessful = false;
+	ShardPlacement *sourcePlacement = repair->sourcePlacement;
+	ShardPlacement *targetPlacement = repair->targetPlacement;
+	bool recreated = false;
 
-	char relationKind = get_rel_relkind(distributedTableId);
-	if (relationKind == RELKIND_FOREIGN_TABLE)
+	recreated = ExecuteRemoteCommandList(targetPlacement->nodeName,
+										 targetPlacement->nodePort,
+										 repair->recreateCommandList);
+	if (!recreated)
 	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("cannot repair shard"),
-						errdetail("Repairing shards backed by foreign tables is "
-								  "not supported.")));
+		FailShardRepair(repair, NULL);
+		return false;
 	}
 
-	AppendShardIdToName(&relationName, shardId);
-	shardName = quote_identifier(relationName);
+	repair->targetConnection = OpenDedicatedConnection(targetPlacement->nodeName,
+													   targetPlacement->nodePort);
+	if (repair->targetConnection == NULL)
+	{
+		FailShardRepair(repair, NULL);
+		return false;
+	}
+
+	repair->sourceConnection = OpenDedicatedConnection(sourcePlacement->nodeName,
+													   sourcePlacement->nodePort);
+	if (repair->sourceConnection == NULL)
+	{
+		FailShardRepair(repair, NULL);
+		return false;
+	}
+
+	if (!ExecuteRepairCommand(repair->targetConnection, BEGIN_COMMAND,
+							  PGRES_COMMAND_OK) ||
+		!ExecuteRepairCommand(repair->targetConnection, repair->copyInCommand,
+							  PGRES_COPY_IN) ||
+		!ExecuteRepairCommand(repair->sourceConnection, repair->copyOutCommand,
+							  PGRES_COPY_OUT))
+	{
+		FailShardRepair(repair, NULL);
+		return false;
+	}
+
+	/* a slow target must not keep us from serving other repairs */
+	if (PQsetnonblocking(repair->targetConnection, 1) != 0)
+	{
+		FailShardRepair(repair, repair->targetConnection);
+		return false;
+	}
+
+	repair->state = REPAIR_COPYING;
+
+	return true;
+}
+
+
+/*
+ * ExecuteRepairCommand runs the given command on the connection and returns
+ * whether it resulted in the expected status.
+ */
+static bool
+ExecuteRepairCommand(PGconn *connection, const char *command,
+					 ExecStatusType expectedStatus)
+{
+	PGresult *result = PQexec(connection, command);
+	bool commandSuccessful = true;
+
+	if (PQresultStatus(result) != expectedStatus)
+	{
+		ReportRemoteError(connection, result);
+		commandSuccessful = false;
+	}
+
+	PQclear(result);
+	return commandSuccessful;
+}
+
+
+/*
+ * AdvanceShardRepair makes as much progress on the given repair as possible
+ * without blocking.
+ */
+static void
+AdvanceShardRepair(ShardRepair *repair)
+{
+	switch (repair->state)
+	{
+		case REPAIR_COPYING:
+		{
+			RelayCopyData(repair);
+			break;
+		}
+
+		case REPAIR_ENDING_COPY:
+		{
+			EndTargetCopy(repair);
+			break;
+		}
+
+		case REPAIR_LOADING:
+		{
+			repair->state = ReceiveRepairResults(repair->targetConnection,
+												 REPAIR_LOADING,
+												 REPAIR_BUILDING_INDEXES);
+			if (repair->state == REPAIR_BUILDING_INDEXES &&
+				PQsendQuery(repair->targetConnection, repair->finishCommand) == 0)
+			{
+				FailShardRepair(repair, repair->targetConnection);
+			}
 
-	appendStringInfo(copyRelationQuery, COPY_SHARD_PLACEMENT_COMMAND,
-					 quote_literal_cstr(shardName),
-					 quote_literal_cstr(healthyPlacement->nodeName),
-					 healthyPlacement->nodePort);
+			break;
+		}
 
-	copySuccessful = ExecuteRemoteCommandList(placementToRepair->nodeName,
-											  placementToRepair->nodePort,
-											  list_make1(copyRelationQuery->data));
+		case REPAIR_BUILDING_INDEXES:
+		{
+			repair->state = ReceiveRepairResults(repair->targetConnection,
+												 REPAIR_BUILDING_INDEXES,
+												 REPAIR_DONE);
+			break;
+		}
 
-	return copySuccessful;
+		default:
+		{
+			break;
+		}
+	}
+
+	if (repair->state == REPAIR_FAILED)
+	{
+		CloseShardRepairConnections(repair);
+	}
 }
 
 
 /*
- * CopyDataFromTupleStoreToRelation loads a specified relation with all tuples
- * stored in the provided tuplestore. This function assumes the relation's
- * layout (TupleDesc) exactly matches that of the provided tuplestore. This
- * function raises an error if the copy cannot be completed.
+ * RelayCopyData passes the COPY data available from the source placement on
+ * to the target placement. The function stops when the source has no more data
+ * at hand or the target can't take any more; in the latter case the received
+ * row is kept until the next call. Once the source has sent all rows, the
+ * repair moves on to ending the target's COPY.
  */
 static void
-CopyDataFromTupleStoreToRelation(Tuplestorestate *tupleStore, Relation relation)
+RelayCopyData(ShardRepair *repair)
+{
+	PGconn *sourceConnection = repair->sourceConnection;
+	PGconn *targetConnection = repair->targetConnection;
+	PGresult *result = NULL;
+	int flushStatus = 0;
+
+	if (PQconsumeInput(sourceConnection) == 0)
+	{
+		FailShardRepair(repair, sourceConnection);
+		return;
+	}
+
+	for (;;)
+	{
+		int copyStatus = 0;
+
+		if (repair->copyBuffer != NULL)
+		{
+			int putStatus = PQputCopyData(targetConnection, repair->copyBuffer,
+										  repair->copyBufferLength);
+			if (putStatus == -1)
+			{
+				FailShardRepair(repair, targetConnection);
+				return;
+			}
+			else if (putStatus == 0)
+			{
+				/* target's output buffer is full, wait until it can be flushed */
+				break;
+			}
+
+			PQfreemem(repair->copyBuffer);
+			repair->copyBuffer = NULL;
+		}
+
+		copyStatus = PQgetCopyData(sourceConnection, &repair->copyBuffer, true);
+		if (copyStatus > 0)
+		{
+			repair->copyBufferLength = copyStatus;
+			continue;
+		}
+
+		repair->copyBuffer = NULL;
+
+		if (copyStatus == 0)
+		{
+			/* wait for more data from the source */
+			break;
+		}
+		else if (copyStatus == -2)
+		{
+			FailShardRepair(repair, sourceConnection);
+			return;
+		}
+
+		/* the source has sent all rows, check that its COPY succeeded */
+		while ((result = PQgetResult(sourceConnection)) != NULL)
+		{
+			if (PQresultStatus(result) != PGRES_COMMAND_OK)
+			{
+				ReportRemoteError(sourceConnection, result);
+				PQclear(result);
+				FailShardRepair(repair, NULL);
+				return;
+			}
+
+			PQclear(result);
+		}
+
+		repair->state = REPAIR_ENDING_COPY;
+		EndTargetCopy(repair);
+		return;
+	}
+
+	flushStatus = PQflush(targetConnection);
+	if (flushStatus == -1)
+	{
+		FailShardRepair(repair, targetConnection);
+		return;
+	}
+
+	repair->flushPending = (flushStatus == 1);
+}
+
+
+/*
+ * EndTargetCopy sends the rows still queued on the target's connection and then
+ * ends its COPY. The connection is switched back to blocking mode, so the end
+ * of the COPY and the command building the indexes are sent in full.
+ */
+static void
+EndTargetCopy(ShardRepair *repair)
+{
+	PGconn *targetConnection = repair->targetConnection;
+	int flushStatus = PQflush(targetConnection);
+
+	if (flushStatus == -1)
+	{
+		FailShardRepair(repair, targetConnection);
+		return;
+	}
+
+	repair->flushPending = (flushStatus == 1);
+	if (repair->flushPending)
+	{
+		return;
+	}
+
+	if (PQsetnonblocking(targetConnection, 0) != 0 ||
+		PQputCopyEnd(targetConnection, NULL) != 1)
+	{
+		FailShardRepair(repair, targetConnection);
+		return;
+	}
+
+	repair->state = REPAIR_LOADING;
+}
+
+
+/*
+ * ReceiveRepairResults consumes the results available on the connection
+ * without blocking. The function returns nextState if all results were
+ * received and succeeded, REPAIR_FAILED if one of them failed, and
+ * currentState if results are still pending.
+ */
+static ShardRepairState
+ReceiveRepairResults(PGconn *connection, ShardRepairState currentState,
+					 ShardRepairState nextState)
+{
+	if (PQconsumeInput(connection) == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		return REPAIR_FAILED;
+	}
+
+	while (PQisBusy(connection) == 0)
+	{
+		PGresult *result = PQgetResult(connection);
+		if (result == NULL)
+		{
+			return nextState;
+		}
+
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+
+			return REPAIR_FAILED;
+		}
+
+		PQclear(result);
+	}
+
+	return currentState;
+}
+
+
+/*
+ * SetRepairPollDescriptor sets up the poll descriptor for the connection the
+ * given repair waits on: the target if it has data to send, the source while
+ * rows are copied, and the target afterwards.
+ */
+static void
+SetRepairPollDescriptor(ShardRepair *repair, struct pollfd *pollDescriptor)
+{
+	if (repair->copyBuffer != NULL || repair->flushPending)
+	{
+		pollDescriptor->fd = PQsocket(repair->targetConnection);
+		pollDescriptor->events = POLLOUT;
+	}
+	else if (repair->state == REPAIR_COPYING)
+	{
+		pollDescriptor->fd = PQsocket(repair->sourceConnection);
+		pollDescriptor->events = POLLIN;
+	}
+	else
+	{
+		pollDescriptor->fd = PQsocket(repair->targetConnection);
+		pollDescriptor->events = POLLIN;
+	}
+
+	pollDescriptor->revents = 0;
+}
+
+
+/*
+ * FailShardRepair marks the repair as failed and closes its connections. If a
+ * connection is given, its error message is reported first.
+ */
+static void
+FailShardRepair(ShardRepair *repair, PGconn *connection)
+{
+	if (connection != NULL)
+	{
+		ReportRemoteError(connection, NULL);
+	}
+
+	repair->state = REPAIR_FAILED;
+	CloseShardRepairConnections(repair);
+}
+
+
+/*
+ * CloseShardRepairConnections closes the connections of the given repair, if
+ * any. A load which wasn't committed is rolled back by the target.
+ */
+static void
+CloseShardRepairConnections(ShardRepair *repair)
+{
+	if (repair->copyBuffer != NULL)
+	{
+		PQfreemem(repair->copyBuffer);
+		repair->copyBuffer = NULL;
+	}
+
+	if (repair->sourceConnection != NULL)
+	{
+		CloseDedicatedConnection(repair->sourceConnection,
+								 repair->sourcePlacement->nodeName,
+								 repair->sourcePlacement->nodePort);
+		repair->sourceConnection = NULL;
+	}
+
+	if (repair->targetConnection != NULL)
+	{
+		CloseDedicatedConnection(repair->targetConnection,
+								 repair->targetPlacement->nodeName,
+								 repair->targetPlacement->nodePort);
+		repair->targetConnection = NULL;
+	}
+
+	repair->flushPending = false;
+}
+
+
+/*
+ * CopyQueryResultsToRelation runs the query on the given connection and inserts
+ * the resulting rows into the relation one at a time, as they are received.
+ * This function assumes the relation's layout (TupleDesc) exactly matches that
+ * of the query results. The function returns false if the query fails.
+ */
+static bool
+CopyQueryResultsToRelation(PGconn *connection, char *queryString, Relation relation)
 {
 	TupleDesc tupleDescriptor = RelationGetDescr(relation);
-	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+	uint32 columnCount = tupleDescriptor->natts;
+	char **columnArray = (char **) palloc0(columnCount * sizeof(char *));
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "CopyQueryResultsToRelation",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+	CommandId commandId = GetCurrentCommandId(true);
+	BulkInsertState bulkInsertState = NULL;
+	bool resultsOK = true;
+
+	if (PQsendQuery(connection, queryString) == 0 ||
+		PQsetSingleRowMode(connection) == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		PurgeConnection(connection);
+		return false;
+	}
+
+	bulkInsertState = GetBulkInsertState();
 
 	for (;;)
 	{
-		HeapTuple tupleToInsert = NULL;
-		bool nextTuple = tuplestore_gettupleslot(tupleStore, true, false, tupleTableSlot);
-		if (!nextTuple)
+		ExecStatusType resultStatus = 0;
+		uint32 columnIndex = 0;
+
+		PGresult *result = PQgetResult(connection);
+		if (result == NULL)
 		{
 			break;
 		}
 
-		tupleToInsert = ExecMaterializeSlot(tupleTableSlot);
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			/* keep reading, so the connection is left idle */
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			resultsOK = false;
+			continue;
+		}
+
+		if (PQntuples(result) > 0)
+		{
+			HeapTuple heapTuple = NULL;
+			MemoryContext oldContext = NULL;
+
+			Assert(PQnfields(result) == columnCount);
 
-		simple_heap_insert(relation, tupleToInsert);
-		CommandCounterIncrement();
+			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				if (PQgetisnull(result, 0, columnIndex))
+				{
+					columnArray[columnIndex] = NULL;
+				}
+				else
+				{
+					columnArray[columnIndex] = PQgetvalue(result, 0, columnIndex);
+				}
+			}
 
-		ExecClearTuple(tupleTableSlot);
+			oldContext = MemoryContextSwitchTo(rowContext);
+
+			heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+			heap_insert(relation, heapTuple, commandId, 0, bulkInsertState);
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(rowContext);
+		}
+
+		PQclear(result);
 	}
 
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	FreeBulkInsertState(bulkInsertState);
+	MemoryContextDelete(rowContext);
+	pfree(columnArray);
+
+	CommandCounterIncrement();
+
+	return resultsOK;
 }
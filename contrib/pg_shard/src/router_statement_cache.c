@@ -0,0 +1,222 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/router_statement_cache.c
+ *
+ * This file contains functions to cache the shard statements of parameterized
+ * single-shard queries, and to run these statements as prepared statements on
+ * the worker nodes.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h" /* IWYU pragma: keep */
+#include "c.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+
+#include "connection.h"
+#include "pg_shard.h"
+#include "router_statement_cache.h"
+#include "ruleutils.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "access/hash.h"
+#include "access/transam.h"
+#include "lib/stringinfo.h"
+#include "nodes/params.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+
+
+/*
+ * RouterStatementHash maps parameterized queries on shards to their shard
+ * statements. It begins uninitialized; the first lookup creates the hash.
+ */
+static HTAB *RouterStatementHash = NULL;
+
+/* number of statements created so far, used to name new statements */
+static uint64 RouterStatementCount = 0;
+
+
+/* local function forward declarations */
+static HTAB * CreateRouterStatementHash(void);
+
+
+/*
+ * LookupRouterStatement returns the cached shard statement of the given query
+ * template on the given shard. On the first lookup, the function deparses the
+ * query for the shard and assigns the statement its worker-side name.
+ *
+ * The function returns NULL if the statement cannot be cached, either because
+ * the cache is full or because another template has the same hash. Callers
+ * then have to deparse the query themselves.
+ */
+RouterStatementEntry *
+LookupRouterStatement(Query *query, char *queryTemplate, int64 shardId)
+{
+	RouterStatementKey statementKey;
+	RouterStatementEntry *statementEntry = NULL;
+	StringInfo queryString = NULL;
+	MemoryContext oldContext = NULL;
+	bool entryFound = false;
+
+	/* if first call, initialize the statement hash */
+	if (RouterStatementHash == NULL)
+	{
+		RouterStatementHash = CreateRouterStatementHash();
+	}
+
+	memset(&statementKey, 0, sizeof(statementKey));
+	statementKey.queryTemplateHash =
+		DatumGetUInt32(hash_any((unsigned char *) queryTemplate, strlen(queryTemplate)));
+	statementKey.shardId = shardId;
+
+	statementEntry = hash_search(RouterStatementHash, &statementKey, HASH_FIND,
+								 &entryFound);
+	if (entryFound)
+	{
+		if (strcmp(statementEntry->queryTemplate, queryTemplate) != 0)
+		{
+			return NULL;
+		}
+
+		return statementEntry;
+	}
+
+	if (hash_get_num_entries(RouterStatementHash) >= MAX_ROUTER_STATEMENTS)
+	{
+		return NULL;
+	}
+
+	/* deparse before entering the key, so errors leave no partial entry */
+	queryString = makeStringInfo();
+	deparse_shard_query(query, shardId, queryString);
+
+	statementEntry = hash_search(RouterStatementHash, &statementKey, HASH_ENTER,
+								 &entryFound);
+
+	oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+	statementEntry->queryTemplate = pstrdup(queryTemplate);
+	statementEntry->queryString = pstrdup(queryString->data);
+	MemoryContextSwitchTo(oldContext);
+
+	RouterStatementCount++;
+	snprintf(statementEntry->statementName, NAMEDATALEN,
+			 ROUTER_STATEMENT_PREFIX UINT64_FORMAT, RouterStatementCount);
+
+	return statementEntry;
+}
+
+
+/*
+ * SendTaskQuery asynchronously sends the task's query on the connection, with
+ * the task's parameter values if it has any. If the task names a prepared
+ * statement, the function prepares it on the connection the first time, and
+ * only binds and executes it afterwards.
+ *
+ * Like PQsendQuery, the function returns 1 if the query was dispatched and 0
+ * otherwise, in which case the connection's error message tells why.
+ */
+int
+SendTaskQuery(PGconn *connection, Task *task)
+{
+	ParamListInfo parameterList = task->parameterList;
+	char *statementName = task->preparedStatementName;
+	char *queryString = task->queryString->data;
+	int parameterCount = 0;
+	int parameterIndex = 0;
+	Oid *parameterTypes = NULL;
+	const char **parameterValues = NULL;
+
+	if (parameterList == NULL)
+	{
+		return PQsendQuery(connection, queryString);
+	}
+
+	parameterCount = parameterList->numParams;
+	parameterTypes = (Oid *) palloc0(parameterCount * sizeof(Oid));
+	parameterValues = (const char **) palloc0(parameterCount * sizeof(char *));
+
+	for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		ParamExternData *parameter = &parameterList->params[parameterIndex];
+		Oid parameterType = InvalidOid;
+
+		/* give hook a chance in case parameter is dynamic */
+		if (!OidIsValid(parameter->ptype) && parameterList->paramFetch != NULL)
+		{
+			(*parameterList->paramFetch)(parameterList, parameterIndex + 1);
+		}
+
+		parameterType = parameter->ptype;
+
+		/* user-defined types may have other OIDs on workers, let them infer it */
+		if (parameterType < FirstNormalObjectId)
+		{
+			parameterTypes[parameterIndex] = parameterType;
+		}
+
+		if (OidIsValid(parameterType) && !parameter->isnull)
+		{
+			Oid outputFunctionId = InvalidOid;
+			bool typeVariableLength = false;
+
+			getTypeOutputInfo(parameterType, &outputFunctionId, &typeVariableLength);
+			parameterValues[parameterIndex] = OidOutputFunctionCall(outputFunctionId,
+																	parameter->value);
+		}
+	}
+
+	if (statementName == NULL)
+	{
+		return PQsendQueryParams(connection, queryString, parameterCount,
+								 parameterTypes, parameterValues, NULL, NULL, 0);
+	}
+
+	if (!ConnectionHasPreparedStatement(connection, statementName))
+	{
+		PGresult *result = PQprepare(connection, statementName, queryString,
+									 parameterCount, parameterTypes);
+		bool statementPrepared = (PQresultStatus(result) == PGRES_COMMAND_OK);
+
+		PQclear(result);
+		if (!statementPrepared)
+		{
+			return 0;
+		}
+
+		RecordPreparedStatement(connection, statementName);
+	}
+
+	return PQsendQueryPrepared(connection, statementName, parameterCount,
+							   parameterValues, NULL, NULL, 0);
+}
+
+
+/* CreateRouterStatementHash creates the backend-local router statement hash. */
+static HTAB *
+CreateRouterStatementHash(void)
+{
+	HTAB *routerStatementHash = NULL;
+	HASHCTL info;
+	int hashFlags = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(RouterStatementKey);
+	info.entrysize = sizeof(RouterStatementEntry);
+	info.hash = tag_hash;
+	info.hcxt = CacheMemoryContext;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	routerStatementHash = hash_create("pg_shard router statements", 256, &info,
+									  hashFlags);
+
+	return routerStatementHash;
+}
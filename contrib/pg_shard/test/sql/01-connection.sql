@@ -55,7 +55,7 @@ SELECT pg_terminate_backend(pid)
 	FROM pg_stat_activity
 	WHERE application_name = 'pg_shard';
 
--- should get connection failure (cached connection bad)
+-- should fail: the cached connection is either bad or replaced by a new one
 SELECT count_remote_temp_table_rows('localhost', :worker_port);
 
 -- should get result failure (reconnected, so no temp table)
@@ -66,3 +66,34 @@ SELECT prune_using_both_values('pruning', 'tomato', 'rose');
 
 -- unit test of the equality expression generation code
 SELECT debug_equality_expression('pruning');
+
+-- create range distributed table metadata to observe shard interval search
+CREATE TABLE pruning_range ( species text, last_pruned date, plant_id integer );
+
+INSERT INTO pgs_distribution_metadata.partition (relation_id, partition_method, key)
+VALUES
+	('pruning_range'::regclass, 'r', 'species');
+
+INSERT INTO pgs_distribution_metadata.shard
+	(id, relation_id, storage, min_value, max_value)
+VALUES
+	(20, 'pruning_range'::regclass, 't', 'oak', 'rose'),
+	(21, 'pruning_range'::regclass, 't', 'apple', 'maple'),
+	(22, 'pruning_range'::regclass, 't', 'sage', 'yew');
+
+-- a value within a shard's interval finds that shard
+SELECT prune_using_single_value('pruning_range', 'petunia');
+SELECT prune_using_single_value('pruning_range', 'apple');
+SELECT prune_using_single_value('pruning_range', 'yew');
+
+-- a value between or outside all intervals finds no shard
+SELECT prune_using_single_value('pruning_range', 'nettle');
+SELECT prune_using_single_value('pruning_range', 'zinnia');
+
+-- adding an overlapping shard is noticed, and all matching shards are returned
+INSERT INTO pgs_distribution_metadata.shard
+	(id, relation_id, storage, min_value, max_value)
+VALUES
+	(23, 'pruning_range'::regclass, 't', 'lily', 'pine');
+
+SELECT prune_using_single_value('pruning_range', 'petunia');
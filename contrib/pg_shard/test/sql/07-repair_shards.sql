@@ -100,3 +100,10 @@ SELECT worker_copy_shard_placement('customer_engagements_20', 'localhost', :work
 
 -- should expect twice as many rows as we put in
 SELECT COUNT(*) FROM customer_engagements_20;
+
+-- repair several shards at once; duplicate shard identifiers are ignored
+UPDATE pgs_distribution_metadata.shard_placement SET shard_state = 3 WHERE id = 201;
+SELECT master_copy_shard_placements(ARRAY[20, 20], 'localhost', :worker_port, '127.0.0.1', :worker_port);
+
+-- the repaired placement should be healthy again
+SELECT shard_state FROM pgs_distribution_metadata.shard_placement WHERE id = 201;
@@ -46,6 +46,27 @@ INSERT INTO limit_orders VALUES (430, upper('ibm'), 214, timestamp '2003-01-28 1
 								 interval '5 hours', 'buy', sqrt(2));
 SELECT COUNT(*) FROM limit_orders WHERE id = 430;
 
+-- multi-row INSERT with rows for both shards
+INSERT INTO limit_orders VALUES (1001, 'ORCL', 3014, '2011-01-15 09:30:00', 'buy', 30.15),
+								(1002, 'INTC', 3015, '2011-01-15 09:31:00', 'sell', 22.40),
+								(1003, 'CSCO', 3016, '2011-01-15 09:32:00', 'buy', 19.85),
+								(1004, 'QCOM', 3017, '2011-01-15 09:33:00', 'sell', 54.12);
+SELECT COUNT(*) FROM limit_orders WHERE id >= 1001 AND id <= 1004;
+
+-- COPY distributes rows among the shards
+COPY limit_orders FROM STDIN;
+2001	HPQ	4101	2012-02-20 10:00:00	buy	28.50
+2002	DELL	4102	2012-02-20 10:01:00	sell	13.95
+2003	EMC	4103	2012-02-20 10:02:00	buy	24.10
+\.
+SELECT COUNT(*) FROM limit_orders WHERE id >= 2001 AND id <= 2003;
+
+-- COPY fills in defaults of omitted columns
+COPY limit_orders (id, symbol, bidder_id, placed_at, kind) FROM STDIN;
+2004	SAP	4104	2012-02-20 10:03:00	buy
+\.
+SELECT limit_price FROM limit_orders WHERE id = 2004;
+
 -- INSERT without partition key
 INSERT INTO limit_orders DEFAULT VALUES;
 
@@ -77,7 +98,7 @@ DELETE FROM limit_orders WHERE id = 246 AND bidder_id = (random() * 1000);
 -- commands with mutable but non-volatilte functions(ie: stable func.) in their quals
 DELETE FROM limit_orders WHERE id = 246 AND placed_at = current_timestamp;
 
--- commands with multiple rows are unsupported
+-- multi-row INSERTs need a partition value in each row
 INSERT INTO limit_orders VALUES (DEFAULT), (DEFAULT);
 
 -- INSERT ... SELECT ... FROM commands are unsupported
@@ -154,10 +154,10 @@ DO $sharded_execute$
 	END
 $sharded_execute$;
 
--- test use of bare SQL within plpgsql
+-- test use of bare SQL within plpgsql, whose plans are cached
 DO $sharded_sql$
 	BEGIN
-		SELECT COUNT(*) FROM articles WHERE author_id = 1 AND author_id = 2;
+		PERFORM COUNT(*) FROM articles WHERE author_id = 1 AND author_id = 2;
 	END
 $sharded_sql$;
 
@@ -196,6 +196,18 @@ SET client_min_messages = log;
 
 SELECT count(*) FROM articles WHERE word_count > 10000;
 
+-- aggregates are computed on the shards and combined on the master
+SELECT author_id, count(*), sum(word_count), min(word_count), max(word_count), avg(word_count)
+	FROM articles
+	GROUP BY author_id
+	ORDER BY author_id
+	LIMIT 3;
+
+-- sort and limit are pushed down to the shards
+SELECT id, word_count FROM articles
+	ORDER BY word_count DESC
+	LIMIT 3;
+
 SET client_min_messages = DEFAULT;
 SET pg_shard.log_distributed_statements = DEFAULT;
 
@@ -205,6 +217,30 @@ SELECT author_id FROM articles
 	HAVING sum(word_count) > 50000
 	ORDER BY author_id;
 
+-- prepared single-shard queries keep working once a generic plan is used
+PREPARE author_word_count (bigint) AS
+	SELECT count(*), sum(word_count) FROM articles WHERE author_id = $1;
+EXECUTE author_word_count(1);
+EXECUTE author_word_count(2);
+EXECUTE author_word_count(3);
+EXECUTE author_word_count(4);
+EXECUTE author_word_count(5);
+EXECUTE author_word_count(6);
+EXECUTE author_word_count(7);
+
+PREPARE touch_article (bigint, bigint) AS
+	UPDATE articles SET word_count = word_count WHERE author_id = $1 AND id = $2;
+EXECUTE touch_article(1, 1);
+EXECUTE touch_article(2, 2);
+EXECUTE touch_article(3, 3);
+EXECUTE touch_article(4, 4);
+EXECUTE touch_article(5, 5);
+EXECUTE touch_article(6, 6);
+EXECUTE touch_article(7, 7);
+
+DEALLOCATE author_word_count;
+DEALLOCATE touch_article;
+
 -- verify temp tables used by cross-shard queries do not persist
 SELECT COUNT(*) FROM pg_class WHERE relname LIKE 'pg_shard_temp_table%' AND
 									relkind = 'r';
@@ -8,6 +8,8 @@ SELECT master_create_distributed_table('sharded_table', 'id');
 -- COPY is not supported with distributed tables
 COPY sharded_table TO STDOUT;
 COPY (SELECT COUNT(*) FROM sharded_table) TO STDOUT;
+
+-- COPY FROM needs shards to distribute the rows to
 COPY sharded_table FROM STDIN;
 
 -- cursors may not involve distributed tables
@@ -16,5 +18,5 @@ DECLARE all_sharded_rows CURSOR FOR SELECT * FROM sharded_table;
 -- EXPLAIN support isn't implemented
 EXPLAIN SELECT * FROM sharded_table;
 
--- PREPARE support isn't implemented
+-- PREPARE is supported, the shard is chosen when executing the statement
 PREPARE sharded_query (bigint) AS SELECT * FROM sharded_table WHERE id = $1;
@@ -0,0 +1,9 @@
+-- repairs the placements of several shards at once
+CREATE FUNCTION master_copy_shard_placements(shard_ids bigint[],
+											 source_node_name text,
+											 source_node_port integer,
+											 target_node_name text,
+											 target_node_port integer)
+RETURNS integer
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
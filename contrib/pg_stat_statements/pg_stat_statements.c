@@ -28,24 +28,24 @@
  *
  * To facilitate presenting entries to users, we create "representative" query
  * strings in which constants are replaced with '?' characters, to make it
- * clearer what a normalized entry can represent.  To save on shared memory,
- * and to avoid having to truncate oversized query strings, we store these
- * strings in a temporary external query-texts file.  Offsets into this
- * file are kept in shared memory.
+ * clearer what a normalized entry can represent.  These strings are kept in
+ * the hashtable entry itself, truncated to track_activity_query_size bytes,
+ * so a query text lives and dies with its entry and never has to be written
+ * to or read back from disk while the server is running.
  *
- * Note about locking issues: to create or delete an entry in the shared
- * hashtable, one must hold pgss->lock exclusively.  Modifying any field
- * in an entry except the counters requires the same.  To look up an entry,
- * one must hold the lock shared.  To read or update the counters within
- * an entry, one must hold the lock shared or exclusive (so the entry doesn't
- * disappear!) and also take the entry's mutex spinlock.
- * The shared state variable pgss->extent (the next free spot in the external
- * query-text file) should be accessed only while holding either the
- * pgss->mutex spinlock, or exclusive lock on pgss->lock.  We use the mutex to
- * allow reserving file space while holding only shared lock on pgss->lock.
- * Rewriting the entire external query-text file, eg for garbage collection,
- * requires holding pgss->lock exclusively; this allows individual entries
- * in the file to be read or written while holding only shared lock.
+ * Note about locking issues: the shared hashtable is partitioned, and each
+ * partition is protected by its own LWLock.  To look up an entry, one must
+ * hold pgss->lock shared and the entry's partition lock shared.  To create
+ * an entry, one must hold pgss->lock shared and the partition lock
+ * exclusively, so that backends adding entries in different partitions
+ * don't block each other.  Deleting entries (to make room, or on reset)
+ * requires holding pgss->lock exclusively, which also allows entries to be
+ * created without taking any partition lock.  To read or update the
+ * counters within an entry, one must hold pgss->lock shared or exclusive
+ * (so the entry doesn't disappear!) and also take the entry's mutex
+ * spinlock.  The query text of an entry is never changed once it is made.
+ * Scanning the whole hashtable requires pgss->lock and every partition lock
+ * in shared mode.
  *
  *
  * Copyright (c) 2008-2016, PostgreSQL Global Development Group
@@ -62,6 +62,7 @@
 #include <unistd.h>
 
 #include "access/hash.h"
+#include "catalog/pg_type.h"
 #include "executor/instrument.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
@@ -74,6 +75,7 @@
 #include "storage/ipc.h"
 #include "storage/spin.h"
 #include "tcop/utility.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
 
@@ -83,17 +85,13 @@ PG_MODULE_MAGIC;
 #define PGSS_DUMP_FILE	PGSTAT_STAT_PERMANENT_DIRECTORY "/pg_stat_statements.stat"
 
 /*
- * Location of external query text file.  We don't keep it in the core
- * system's stats_temp_directory.  The core system can safely use that GUC
- * setting, because the statistics collector temp file paths are set only once
- * as part of changing the GUC, but pg_stat_statements has no way of avoiding
- * race conditions.  Besides, we only expect modest, infrequent I/O for query
- * strings, so placing the file on a faster filesystem is not compelling.
+ * Location of the external query text file used by older versions of this
+ * module.  We only remove it if it is left over.
  */
 #define PGSS_TEXT_FILE	PG_STAT_TMP_DIR "/pgss_query_texts.stat"
 
 /* Magic number identifying the stats file format */
-static const uint32 PGSS_FILE_HEADER = 0x20140125;
+static const uint32 PGSS_FILE_HEADER = 0x20161015;
 
 /* PostgreSQL major version number, changes in which invalidate all entries */
 static const uint32 PGSS_PG_MAJOR_VERSION = PG_VERSION_NUM / 100;
@@ -102,13 +100,15 @@ static const uint32 PGSS_PG_MAJOR_VERSION = PG_VERSION_NUM / 100;
 #define USAGE_EXEC(duration)	(1.0)
 #define USAGE_INIT				(1.0)	/* including initial planning */
 #define ASSUMED_MEDIAN_INIT		(10.0)	/* initial assumed median usage */
-#define ASSUMED_LENGTH_INIT		1024	/* initial assumed mean query length */
 #define USAGE_DECREASE_FACTOR	(0.99)	/* decreased every entry_dealloc */
 #define STICKY_DECREASE_FACTOR	(0.50)	/* factor for sticky entries */
 #define USAGE_DEALLOC_PERCENT	5		/* free this % of entries at once */
 
 #define JUMBLE_SIZE				1024	/* query serialization buffer size */
 
+#define PGSS_NUM_PARTITIONS		16		/* # of hashtable partitions */
+#define PGSS_HIST_BUCKETS		32		/* # of latency histogram buckets */
+
 /*
  * Extension version number, for supporting older extension versions' objects
  */
@@ -117,7 +117,8 @@ typedef enum pgssVersion
 	PGSS_V1_0 = 0,
 	PGSS_V1_1,
 	PGSS_V1_2,
-	PGSS_V1_3
+	PGSS_V1_3,
+	PGSS_V1_5
 } pgssVersion;
 
 /*
@@ -156,23 +157,29 @@ typedef struct Counters
 	double		blk_read_time;	/* time spent reading, in msec */
 	double		blk_write_time; /* time spent writing, in msec */
 	double		usage;			/* usage factor */
+
+	/*
+	 * Execution time histogram.  Bucket 0 counts executions that took less
+	 * than a microsecond, bucket i executions that took at least 2^(i-1)
+	 * but less than 2^i microseconds; the last bucket has no upper bound.
+	 */
+	int64		latency_hist[PGSS_HIST_BUCKETS];
 } Counters;
 
 /*
  * Statistics per statement
  *
- * Note: in event of a failure in garbage collection of the query text file,
- * we reset query_offset to zero and query_len to -1.  This will be seen as
- * an invalid state by qtext_fetch().
+ * Note: the hashtable entries are actually allocated as
+ * offsetof(pgssEntry, query) + pgss->query_size bytes.
  */
 typedef struct pgssEntry
 {
 	pgssHashKey key;			/* hash key of entry - MUST BE FIRST */
 	Counters	counters;		/* the statistics for this query */
-	Size		query_offset;	/* query text offset in external file */
-	int			query_len;		/* # of valid bytes in query string, or -1 */
+	int			query_len;		/* # of valid bytes in query string */
 	int			encoding;		/* query text encoding */
 	slock_t		mutex;			/* protects the counters only */
+	char		query[FLEXIBLE_ARRAY_MEMBER];	/* null-terminated query text */
 } pgssEntry;
 
 /*
@@ -180,13 +187,10 @@ typedef struct pgssEntry
  */
 typedef struct pgssSharedState
 {
-	LWLock	   *lock;			/* protects hashtable search/modification */
+	LWLock	   *lock;			/* protects hashtable entry deletion */
+	LWLockPadded *partition_locks;		/* protect hashtable partitions */
+	int			query_size;		/* max query length including null */
 	double		cur_median_usage;		/* current median usage in hashtable */
-	Size		mean_query_len; /* current mean entry text length */
-	slock_t		mutex;			/* protects following fields only: */
-	Size		extent;			/* current extent of query file */
-	int			n_writers;		/* number of active writers to query file */
-	int			gc_count;		/* query file garbage collection cycle count */
 } pgssSharedState;
 
 /*
@@ -265,13 +269,8 @@ static bool pgss_save;			/* whether to save stats across shutdown */
 	(pgss_track == PGSS_TRACK_ALL || \
 	(pgss_track == PGSS_TRACK_TOP && nested_level == 0))
 
-#define record_gc_qtexts() \
-	do { \
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss; \
-		SpinLockAcquire(&s->mutex); \
-		s->gc_count++; \
-		SpinLockRelease(&s->mutex); \
-	} while(0)
+#define pgss_partition_lock(hashcode) \
+	(&pgss->partition_locks[(hashcode) % PGSS_NUM_PARTITIONS].lock)
 
 /*---- Function declarations ----*/
 
@@ -281,6 +280,7 @@ void		_PG_fini(void);
 PG_FUNCTION_INFO_V1(pg_stat_statements_reset);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_2);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_3);
+PG_FUNCTION_INFO_V1(pg_stat_statements_1_5);
 PG_FUNCTION_INFO_V1(pg_stat_statements);
 
 static void pgss_shmem_startup(void);
@@ -306,17 +306,11 @@ static void pg_stat_statements_internal(FunctionCallInfo fcinfo,
 							pgssVersion api_version,
 							bool showtext);
 static Size pgss_memsize(void);
-static pgssEntry *entry_alloc(pgssHashKey *key, Size query_offset, int query_len,
-			int encoding, bool sticky);
+static pgssEntry *entry_alloc(pgssHashKey *key, uint32 hashcode,
+			const char *query, int query_len, int encoding, bool sticky);
 static void entry_dealloc(void);
-static bool qtext_store(const char *query, int query_len,
-			Size *query_offset, int *gc_count);
-static char *qtext_load_file(Size *buffer_size);
-static char *qtext_fetch(Size query_offset, int query_len,
-			char *buffer, Size buffer_size);
-static bool need_gc_qtexts(void);
-static void gc_qtexts(void);
 static void entry_reset(void);
+static int	pgss_hist_bucket(double total_time);
 static void AppendJumble(pgssJumbleState *jstate,
 			 const unsigned char *item, Size size);
 static void JumbleQuery(pgssJumbleState *jstate, Query *query);
@@ -404,7 +398,7 @@ _PG_init(void)
 	 * resources in pgss_shmem_startup().
 	 */
 	RequestAddinShmemSpace(pgss_memsize());
-	RequestNamedLWLockTranche("pg_stat_statements", 1);
+	RequestNamedLWLockTranche("pg_stat_statements", 1 + PGSS_NUM_PARTITIONS);
 
 	/*
 	 * Install hooks.
@@ -444,8 +438,6 @@ _PG_fini(void)
 /*
  * shmem_startup hook: allocate or attach to shared memory,
  * then load any pre-existing statistics from file.
- * Also create and load the query-texts file, which is expected to exist
- * (even if empty) while the module is enabled.
  */
 static void
 pgss_shmem_startup(void)
@@ -453,11 +445,11 @@ pgss_shmem_startup(void)
 	bool		found;
 	HASHCTL		info;
 	FILE	   *file = NULL;
-	FILE	   *qfile = NULL;
 	uint32		header;
 	int32		num;
 	int32		pgver;
 	int32		i;
+	int			query_size;
 	int			buffer_size;
 	char	   *buffer = NULL;
 
@@ -480,24 +472,28 @@ pgss_shmem_startup(void)
 	if (!found)
 	{
 		/* First time through ... */
-		pgss->lock = &(GetNamedLWLockTranche("pg_stat_statements"))->lock;
+		LWLockPadded *locks = GetNamedLWLockTranche("pg_stat_statements");
+
+		pgss->lock = &locks[0].lock;
+		pgss->partition_locks = &locks[1];
+		pgss->query_size = pgstat_track_activity_query_size;
 		pgss->cur_median_usage = ASSUMED_MEDIAN_INIT;
-		pgss->mean_query_len = ASSUMED_LENGTH_INIT;
-		SpinLockInit(&pgss->mutex);
-		pgss->extent = 0;
-		pgss->n_writers = 0;
-		pgss->gc_count = 0;
 	}
 
+	/* Be sure everyone agrees on the hash table entry size */
+	query_size = pgss->query_size;
+
 	memset(&info, 0, sizeof(info));
 	info.keysize = sizeof(pgssHashKey);
-	info.entrysize = sizeof(pgssEntry);
+	info.entrysize = offsetof(pgssEntry, query) + query_size;
 	info.hash = pgss_hash_fn;
 	info.match = pgss_match_fn;
+	info.num_partitions = PGSS_NUM_PARTITIONS;
 	pgss_hash = ShmemInitHash("pg_stat_statements hash",
 							  pgss_max, pgss_max,
 							  &info,
-							  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+							  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE |
+							  HASH_PARTITION);
 
 	LWLockRelease(AddinShmemInitLock);
 
@@ -519,24 +515,16 @@ pgss_shmem_startup(void)
 	 * processes running when this code is reached.
 	 */
 
-	/* Unlink query text file possibly left over from crash */
+	/* Unlink query text file possibly left over by an older version */
 	unlink(PGSS_TEXT_FILE);
 
-	/* Allocate new query text temp file */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-		goto write_error;
-
 	/*
 	 * If we were told not to load old statistics, we're done.  (Note we do
 	 * not try to unlink any old dump file in this case.  This seems a bit
 	 * questionable but it's the historical behavior.)
 	 */
 	if (!pgss_save)
-	{
-		FreeFile(qfile);
 		return;
-	}
 
 	/*
 	 * Attempt to load old statistics from the dump file.
@@ -547,7 +535,6 @@ pgss_shmem_startup(void)
 		if (errno != ENOENT)
 			goto read_error;
 		/* No existing persisted stats file, so we're done */
-		FreeFile(qfile);
 		return;
 	}
 
@@ -567,13 +554,13 @@ pgss_shmem_startup(void)
 	{
 		pgssEntry	temp;
 		pgssEntry  *entry;
-		Size		query_offset;
+		uint32		hashcode;
 
-		if (fread(&temp, sizeof(pgssEntry), 1, file) != 1)
+		if (fread(&temp, offsetof(pgssEntry, query), 1, file) != 1)
 			goto read_error;
 
 		/* Encoding is the only field we can easily sanity-check */
-		if (!PG_VALID_BE_ENCODING(temp.encoding))
+		if (!PG_VALID_BE_ENCODING(temp.encoding) || temp.query_len < 0)
 			goto data_error;
 
 		/* Resize buffer as needed */
@@ -593,16 +580,12 @@ pgss_shmem_startup(void)
 		if (temp.counters.calls == 0)
 			continue;
 
-		/* Store the query text */
-		query_offset = pgss->extent;
-		if (fwrite(buffer, 1, temp.query_len + 1, qfile) != temp.query_len + 1)
-			goto write_error;
-		pgss->extent += temp.query_len + 1;
-
 		/* make the hashtable entry (discards old entries if too many) */
-		entry = entry_alloc(&temp.key, query_offset, temp.query_len,
-							temp.encoding,
-							false);
+		hashcode = get_hash_value(pgss_hash, &temp.key);
+		while ((entry = entry_alloc(&temp.key, hashcode, buffer,
+									temp.query_len, temp.encoding,
+									false)) == NULL)
+			entry_dealloc();
 
 		/* copy in the actual stats */
 		entry->counters = temp.counters;
@@ -610,20 +593,11 @@ pgss_shmem_startup(void)
 
 	pfree(buffer);
 	FreeFile(file);
-	FreeFile(qfile);
 
 	/*
 	 * Remove the persisted stats file so it's not included in
 	 * backups/replication slaves, etc.  A new file will be written on next
 	 * shutdown.
-	 *
-	 * Note: it's okay if the PGSS_TEXT_FILE is included in a basebackup,
-	 * because we remove that file on startup; it acts inversely to
-	 * PGSS_DUMP_FILE, in that it is only supposed to be around when the
-	 * server is running, whereas PGSS_DUMP_FILE is only supposed to be around
-	 * when the server is not running.  Leaving the file creates no danger of
-	 * a newly restored database having a spurious record of execution costs,
-	 * which is what we're really concerned about here.
 	 */
 	unlink(PGSS_DUMP_FILE);
 
@@ -640,26 +614,13 @@ data_error:
 			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 			 errmsg("ignoring invalid data in pg_stat_statement file \"%s\"",
 					PGSS_DUMP_FILE)));
-	goto fail;
-write_error:
-	ereport(LOG,
-			(errcode_for_file_access(),
-			 errmsg("could not write pg_stat_statement file \"%s\": %m",
-					PGSS_TEXT_FILE)));
 fail:
 	if (buffer)
 		pfree(buffer);
 	if (file)
 		FreeFile(file);
-	if (qfile)
-		FreeFile(qfile);
 	/* If possible, throw away the bogus file; ignore any error */
 	unlink(PGSS_DUMP_FILE);
-
-	/*
-	 * Don't unlink PGSS_TEXT_FILE here; it should always be around while the
-	 * server is running with pg_stat_statements enabled
-	 */
 }
 
 /*
@@ -672,8 +633,6 @@ static void
 pgss_shmem_shutdown(int code, Datum arg)
 {
 	FILE	   *file;
-	char	   *qbuffer = NULL;
-	Size		qbuffer_size = 0;
 	HASH_SEQ_STATUS hash_seq;
 	int32		num_entries;
 	pgssEntry  *entry;
@@ -702,26 +661,18 @@ pgss_shmem_shutdown(int code, Datum arg)
 	if (fwrite(&num_entries, sizeof(int32), 1, file) != 1)
 		goto error;
 
-	qbuffer = qtext_load_file(&qbuffer_size);
-	if (qbuffer == NULL)
-		goto error;
-
 	/*
-	 * When serializing to disk, we store query texts immediately after their
-	 * entry data.  Any orphaned query texts are thereby excluded.
+	 * When serializing to disk, we store each query text immediately after
+	 * the fixed part of its entry, so that it can be reloaded with a
+	 * different track_activity_query_size.
 	 */
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
 	{
 		int			len = entry->query_len;
-		char	   *qstr = qtext_fetch(entry->query_offset, len,
-									   qbuffer, qbuffer_size);
-
-		if (qstr == NULL)
-			continue;			/* Ignore any entries with bogus texts */
 
-		if (fwrite(entry, sizeof(pgssEntry), 1, file) != 1 ||
-			fwrite(qstr, 1, len + 1, file) != len + 1)
+		if (fwrite(entry, offsetof(pgssEntry, query), 1, file) != 1 ||
+			fwrite(entry->query, 1, len + 1, file) != len + 1)
 		{
 			/* note: we assume hash_seq_term won't change errno */
 			hash_seq_term(&hash_seq);
@@ -729,9 +680,6 @@ pgss_shmem_shutdown(int code, Datum arg)
 		}
 	}
 
-	free(qbuffer);
-	qbuffer = NULL;
-
 	if (FreeFile(file))
 	{
 		file = NULL;
@@ -743,9 +691,6 @@ pgss_shmem_shutdown(int code, Datum arg)
 	 */
 	(void) durable_rename(PGSS_DUMP_FILE ".tmp", PGSS_DUMP_FILE, LOG);
 
-	/* Unlink query-texts file; it's not needed while shutdown */
-	unlink(PGSS_TEXT_FILE);
-
 	return;
 
 error:
@@ -753,12 +698,9 @@ error:
 			(errcode_for_file_access(),
 			 errmsg("could not write pg_stat_statement file \"%s\": %m",
 					PGSS_DUMP_FILE ".tmp")));
-	if (qbuffer)
-		free(qbuffer);
 	if (file)
 		FreeFile(file);
 	unlink(PGSS_DUMP_FILE ".tmp");
-	unlink(PGSS_TEXT_FILE);
 }
 
 /*
@@ -1109,6 +1051,9 @@ pgss_store(const char *query, uint32 queryId,
 		   pgssJumbleState *jstate)
 {
 	pgssHashKey key;
+	uint32		hashcode;
+	LWLock	   *partitionLock;
+	bool		exclusive = false;
 	pgssEntry  *entry;
 	char	   *norm_query = NULL;
 	int			encoding = GetDatabaseEncoding();
@@ -1127,25 +1072,28 @@ pgss_store(const char *query, uint32 queryId,
 	key.dbid = MyDatabaseId;
 	key.queryid = queryId;
 
-	/* Lookup the hash table entry with shared lock. */
+	hashcode = get_hash_value(pgss_hash, &key);
+	partitionLock = pgss_partition_lock(hashcode);
+
+	/* Lookup the hash table entry with shared locks. */
 	LWLockAcquire(pgss->lock, LW_SHARED);
+	LWLockAcquire(partitionLock, LW_SHARED);
 
-	entry = (pgssEntry *) hash_search(pgss_hash, &key, HASH_FIND, NULL);
+	entry = (pgssEntry *) hash_search_with_hash_value(pgss_hash, &key,
+													  hashcode,
+													  HASH_FIND, NULL);
 
 	/* Create new entry, if not present */
 	if (!entry)
 	{
-		Size		query_offset;
-		int			gc_count;
-		bool		stored;
-		bool		do_gc;
+		LWLockRelease(partitionLock);
 
 		/*
 		 * Create a new, normalized query string if caller asked.  We don't
 		 * need to hold the lock while doing this work.  (Note: in any case,
 		 * it's possible that someone else creates a duplicate hashtable entry
-		 * in the interval where we don't hold the lock below.  That case is
-		 * handled by entry_alloc.)
+		 * in the interval where we don't hold the partition lock below.  That
+		 * case is handled by entry_alloc.)
 		 */
 		if (jstate)
 		{
@@ -1156,43 +1104,36 @@ pgss_store(const char *query, uint32 queryId,
 			LWLockAcquire(pgss->lock, LW_SHARED);
 		}
 
-		/* Append new query text to file with only shared lock held */
-		stored = qtext_store(norm_query ? norm_query : query, query_len,
-							 &query_offset, &gc_count);
-
-		/*
-		 * Determine whether we need to garbage collect external query texts
-		 * while the shared lock is still held.  This micro-optimization
-		 * avoids taking the time to decide this while holding exclusive lock.
-		 */
-		do_gc = need_gc_qtexts();
+		/* Need exclusive partition lock to make a new hashtable entry */
+		LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
-		/* Need exclusive lock to make a new hashtable entry - promote */
-		LWLockRelease(pgss->lock);
-		LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+		entry = entry_alloc(&key, hashcode,
+							norm_query ? norm_query : query, query_len,
+							encoding, jstate != NULL);
 
-		/*
-		 * A garbage collection may have occurred while we weren't holding the
-		 * lock.  In the unlikely event that this happens, the query text we
-		 * stored above will have been garbage collected, so write it again.
-		 * This should be infrequent enough that doing it while holding
-		 * exclusive lock isn't a performance problem.
-		 */
-		if (!stored || pgss->gc_count != gc_count)
-			stored = qtext_store(norm_query ? norm_query : query, query_len,
-								 &query_offset, NULL);
+		if (!entry)
+		{
+			/*
+			 * The hashtable is full.  Evicting entries can touch any
+			 * partition, so it needs pgss->lock exclusively; holding that,
+			 * we don't need the partition lock to insert.
+			 */
+			LWLockRelease(partitionLock);
+			LWLockRelease(pgss->lock);
+			LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+			exclusive = true;
 
-		/* If we failed to write to the text file, give up */
-		if (!stored)
-			goto done;
+			while (hash_get_num_entries(pgss_hash) >= pgss_max)
+				entry_dealloc();
 
-		/* OK to create a new hashtable entry */
-		entry = entry_alloc(&key, query_offset, query_len, encoding,
-							jstate != NULL);
+			entry = entry_alloc(&key, hashcode,
+								norm_query ? norm_query : query, query_len,
+								encoding, jstate != NULL);
 
-		/* If needed, perform garbage collection while exclusive lock held */
-		if (do_gc)
-			gc_qtexts();
+			/* If we're out of shared memory after all, give up */
+			if (!entry)
+				goto done;
+		}
 	}
 
 	/* Increment the counts, except when jstate is not NULL */
@@ -1251,11 +1192,14 @@ pgss_store(const char *query, uint32 queryId,
 		e->counters.blk_read_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_read_time);
 		e->counters.blk_write_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_write_time);
 		e->counters.usage += USAGE_EXEC(total_time);
+		e->counters.latency_hist[pgss_hist_bucket(total_time)] += 1;
 
 		SpinLockRelease(&e->mutex);
 	}
 
 done:
+	if (!exclusive)
+		LWLockRelease(partitionLock);
 	LWLockRelease(pgss->lock);
 
 	/* We postpone this clean-up until we're out of the lock */
@@ -1282,7 +1226,8 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
 #define PG_STAT_STATEMENTS_COLS_V1_1	18
 #define PG_STAT_STATEMENTS_COLS_V1_2	19
 #define PG_STAT_STATEMENTS_COLS_V1_3	23
-#define PG_STAT_STATEMENTS_COLS			23		/* maximum of above */
+#define PG_STAT_STATEMENTS_COLS_V1_5	24
+#define PG_STAT_STATEMENTS_COLS			24		/* maximum of above */
 
 /*
  * Retrieve statement statistics.
@@ -1294,6 +1239,16 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
  * expected API version is identified by embedding it in the C name of the
  * function.  Unfortunately we weren't bright enough to do that for 1.1.
  */
+Datum
+pg_stat_statements_1_5(PG_FUNCTION_ARGS)
+{
+	bool		showtext = PG_GETARG_BOOL(0);
+
+	pg_stat_statements_internal(fcinfo, PGSS_V1_5, showtext);
+
+	return (Datum) 0;
+}
+
 Datum
 pg_stat_statements_1_3(PG_FUNCTION_ARGS)
 {
@@ -1340,12 +1295,9 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 	MemoryContext oldcontext;
 	Oid			userid = GetUserId();
 	bool		is_superuser = superuser();
-	char	   *qbuffer = NULL;
-	Size		qbuffer_size = 0;
-	Size		extent = 0;
-	int			gc_count = 0;
 	HASH_SEQ_STATUS hash_seq;
 	pgssEntry  *entry;
+	int			i;
 
 	/* hash table must exist already */
 	if (!pgss || !pgss_hash)
@@ -1397,6 +1349,10 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			if (api_version != PGSS_V1_3)
 				elog(ERROR, "incorrect number of output arguments");
 			break;
+		case PG_STAT_STATEMENTS_COLS_V1_5:
+			if (api_version != PGSS_V1_5)
+				elog(ERROR, "incorrect number of output arguments");
+			break;
 		default:
 			elog(ERROR, "incorrect number of output arguments");
 	}
@@ -1409,69 +1365,17 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 	MemoryContextSwitchTo(oldcontext);
 
 	/*
-	 * We'd like to load the query text file (if needed) while not holding any
-	 * lock on pgss->lock.  In the worst case we'll have to do this again
-	 * after we have the lock, but it's unlikely enough to make this a win
-	 * despite occasional duplicated work.  We need to reload if anybody
-	 * writes to the file (either a retail qtext_store(), or a garbage
-	 * collection) between this point and where we've gotten shared lock.  If
-	 * a qtext_store is actually in progress when we look, we might as well
-	 * skip the speculative load entirely.
-	 */
-	if (showtext)
-	{
-		int			n_writers;
-
-		/* Take the mutex so we can examine variables */
-		{
-			volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-			SpinLockAcquire(&s->mutex);
-			extent = s->extent;
-			n_writers = s->n_writers;
-			gc_count = s->gc_count;
-			SpinLockRelease(&s->mutex);
-		}
-
-		/* No point in loading file now if there are active writers */
-		if (n_writers == 0)
-			qbuffer = qtext_load_file(&qbuffer_size);
-	}
-
-	/*
-	 * Get shared lock, load or reload the query text file if we must, and
-	 * iterate over the hashtable entries.
+	 * Get shared lock on the table and on all of its partitions, and iterate
+	 * over the hashtable entries.
 	 *
-	 * With a large hash table, we might be holding the lock rather longer
+	 * With a large hash table, we might be holding the locks rather longer
 	 * than one could wish.  However, this only blocks creation of new hash
 	 * table entries, and the larger the hash table the less likely that is to
-	 * be needed.  So we can hope this is okay.  Perhaps someday we'll decide
-	 * we need to partition the hash table to limit the time spent holding any
-	 * one lock.
+	 * be needed.  So we can hope this is okay.
 	 */
 	LWLockAcquire(pgss->lock, LW_SHARED);
-
-	if (showtext)
-	{
-		/*
-		 * Here it is safe to examine extent and gc_count without taking the
-		 * mutex.  Note that although other processes might change
-		 * pgss->extent just after we look at it, the strings they then write
-		 * into the file cannot yet be referenced in the hashtable, so we
-		 * don't care whether we see them or not.
-		 *
-		 * If qtext_load_file fails, we just press on; we'll return NULL for
-		 * every query text.
-		 */
-		if (qbuffer == NULL ||
-			pgss->extent != extent ||
-			pgss->gc_count != gc_count)
-		{
-			if (qbuffer)
-				free(qbuffer);
-			qbuffer = qtext_load_file(&qbuffer_size);
-		}
-	}
+	for (i = 0; i < PGSS_NUM_PARTITIONS; i++)
+		LWLockAcquire(&pgss->partition_locks[i].lock, LW_SHARED);
 
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
@@ -1496,29 +1400,16 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 
 			if (showtext)
 			{
-				char	   *qstr = qtext_fetch(entry->query_offset,
-											   entry->query_len,
-											   qbuffer,
-											   qbuffer_size);
-
-				if (qstr)
-				{
-					char	   *enc;
+				char	   *enc;
 
-					enc = pg_any_to_server(qstr,
-										   entry->query_len,
-										   entry->encoding);
+				enc = pg_any_to_server(entry->query,
+									   entry->query_len,
+									   entry->encoding);
 
-					values[i++] = CStringGetTextDatum(enc);
+				values[i++] = CStringGetTextDatum(enc);
 
-					if (enc != qstr)
-						pfree(enc);
-				}
-				else
-				{
-					/* Just return a null if we fail to find the text */
-					nulls[i++] = true;
-				}
+				if (enc != entry->query)
+					pfree(enc);
 			}
 			else
 			{
@@ -1593,22 +1484,36 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			values[i++] = Float8GetDatumFast(tmp.blk_read_time);
 			values[i++] = Float8GetDatumFast(tmp.blk_write_time);
 		}
+		if (api_version >= PGSS_V1_5)
+		{
+			Datum		hist[PGSS_HIST_BUCKETS];
+			int			j;
+
+			for (j = 0; j < PGSS_HIST_BUCKETS; j++)
+				hist[j] = Int64GetDatumFast(tmp.latency_hist[j]);
+			values[i++] = PointerGetDatum(construct_array(hist,
+														  PGSS_HIST_BUCKETS,
+														  INT8OID,
+														  sizeof(int64),
+														  FLOAT8PASSBYVAL,
+														  'd'));
+		}
 
 		Assert(i == (api_version == PGSS_V1_0 ? PG_STAT_STATEMENTS_COLS_V1_0 :
 					 api_version == PGSS_V1_1 ? PG_STAT_STATEMENTS_COLS_V1_1 :
 					 api_version == PGSS_V1_2 ? PG_STAT_STATEMENTS_COLS_V1_2 :
 					 api_version == PGSS_V1_3 ? PG_STAT_STATEMENTS_COLS_V1_3 :
+					 api_version == PGSS_V1_5 ? PG_STAT_STATEMENTS_COLS_V1_5 :
 					 -1 /* fail if you forget to update this assert */ ));
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
 
 	/* clean up and return the tuplestore */
+	for (i = PGSS_NUM_PARTITIONS; --i >= 0;)
+		LWLockRelease(&pgss->partition_locks[i].lock);
 	LWLockRelease(pgss->lock);
 
-	if (qbuffer)
-		free(qbuffer);
-
 	tuplestore_donestoring(tupstore);
 }
 
@@ -1619,18 +1524,22 @@ static Size
 pgss_memsize(void)
 {
 	Size		size;
+	Size		entrysize;
 
 	size = MAXALIGN(sizeof(pgssSharedState));
-	size = add_size(size, hash_estimate_size(pgss_max, sizeof(pgssEntry)));
+	entrysize = offsetof(pgssEntry, query) + pgstat_track_activity_query_size;
+	size = add_size(size, hash_estimate_size(pgss_max, entrysize));
 
 	return size;
 }
 
 /*
  * Allocate a new hashtable entry.
- * caller must hold an exclusive lock on pgss->lock
+ * caller must hold pgss->lock and the partition lock for hashcode
+ * exclusively, or pgss->lock shared and the partition lock exclusively
  *
- * "query" need not be null-terminated; we rely on query_len instead
+ * "query" need not be null-terminated; we rely on query_len instead.  The
+ * text is truncated to fit into the entry if necessary.
  *
  * If "sticky" is true, make the new entry artificially sticky so that it will
  * probably still be there when the query finishes execution.  We do this by
@@ -1638,24 +1547,35 @@ pgss_memsize(void)
  * speaking, query strings are normalized on a best effort basis, though it
  * would be difficult to demonstrate this even under artificial conditions.)
  *
- * Note: despite needing exclusive lock, it's not an error for the target
- * entry to already exist.  This is because pgss_store releases and
- * reacquires lock after failing to find a match; so someone else could
- * have made the entry while we waited to get exclusive lock.
+ * Returns NULL if the hashtable is full; it's up to the caller to make room
+ * with entry_dealloc(), which requires pgss->lock exclusively.  The number
+ * of entries is checked without any lock, so concurrent callers may
+ * overshoot pgss_max by a few entries.
+ *
+ * Note: it's not an error for the target entry to already exist.  This is
+ * because pgss_store releases and reacquires locks after failing to find a
+ * match; so someone else could have made the entry in the meantime.
  */
 static pgssEntry *
-entry_alloc(pgssHashKey *key, Size query_offset, int query_len, int encoding,
-			bool sticky)
+entry_alloc(pgssHashKey *key, uint32 hashcode, const char *query,
+			int query_len, int encoding, bool sticky)
 {
 	pgssEntry  *entry;
 	bool		found;
 
-	/* Make space if needed */
-	while (hash_get_num_entries(pgss_hash) >= pgss_max)
-		entry_dealloc();
+	if (hash_get_num_entries(pgss_hash) >= pgss_max)
+	{
+		/* Still OK if the entry is already there */
+		return (pgssEntry *) hash_search_with_hash_value(pgss_hash, key,
+														 hashcode,
+														 HASH_FIND, NULL);
+	}
 
 	/* Find or create an entry with desired hash code */
-	entry = (pgssEntry *) hash_search(pgss_hash, key, HASH_ENTER, &found);
+	entry = (pgssEntry *) hash_search_with_hash_value(pgss_hash, key, hashcode,
+													  HASH_ENTER_NULL, &found);
+	if (!entry)
+		return NULL;
 
 	if (!found)
 	{
@@ -1667,9 +1587,12 @@ entry_alloc(pgssHashKey *key, Size query_offset, int query_len, int encoding,
 		entry->counters.usage = sticky ? pgss->cur_median_usage : USAGE_INIT;
 		/* re-initialize the mutex each time ... we assume no one using it */
 		SpinLockInit(&entry->mutex);
-		/* ... and don't forget the query text metadata */
+		/* ... and don't forget the query text */
 		Assert(query_len >= 0);
-		entry->query_offset = query_offset;
+		query_len = pg_encoding_mbcliplen(encoding, query, query_len,
+										  pgss->query_size - 1);
+		memcpy(entry->query, query, query_len);
+		entry->query[query_len] = '\0';
 		entry->query_len = query_len;
 		entry->encoding = encoding;
 	}
@@ -1707,26 +1630,19 @@ entry_dealloc(void)
 	pgssEntry  *entry;
 	int			nvictims;
 	int			i;
-	Size		tottextlen;
-	int			nvalidtexts;
 
 	/*
 	 * Sort entries by usage and deallocate USAGE_DEALLOC_PERCENT of them.
 	 * While we're scanning the table, apply the decay factor to the usage
-	 * values, and update the mean query length.
+	 * values.
 	 *
-	 * Note that the mean query length is almost immediately obsolete, since
-	 * we compute it before not after discarding the least-used entries.
-	 * Hopefully, that doesn't affect the mean too much; it doesn't seem worth
-	 * making two passes to get a more current result.  Likewise, the new
-	 * cur_median_usage includes the entries we're about to zap.
+	 * Note that the new cur_median_usage includes the entries we're about to
+	 * zap.
 	 */
 
 	entries = palloc(hash_get_num_entries(pgss_hash) * sizeof(pgssEntry *));
 
 	i = 0;
-	tottextlen = 0;
-	nvalidtexts = 0;
 
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
@@ -1737,12 +1653,6 @@ entry_dealloc(void)
 			entry->counters.usage *= STICKY_DECREASE_FACTOR;
 		else
 			entry->counters.usage *= USAGE_DECREASE_FACTOR;
-		/* In the mean length computation, ignore dropped texts. */
-		if (entry->query_len >= 0)
-		{
-			tottextlen += entry->query_len + 1;
-			nvalidtexts++;
-		}
 	}
 
 	/* Sort into increasing order by usage */
@@ -1751,11 +1661,6 @@ entry_dealloc(void)
 	/* Record the (approximate) median usage */
 	if (i > 0)
 		pgss->cur_median_usage = entries[i / 2]->counters.usage;
-	/* Record the mean query length */
-	if (nvalidtexts > 0)
-		pgss->mean_query_len = tottextlen / nvalidtexts;
-	else
-		pgss->mean_query_len = ASSUMED_LENGTH_INIT;
 
 	/* Now zap an appropriate fraction of lowest-usage entries */
 	nvictims = Max(10, i * USAGE_DEALLOC_PERCENT / 100);
@@ -1770,481 +1675,45 @@ entry_dealloc(void)
 }
 
 /*
- * Given a null-terminated string, allocate a new entry in the external query
- * text file and store the string there.
- *
- * Although we could compute the string length via strlen(), callers already
- * have it handy, so we require them to pass it too.
- *
- * If successful, returns true, and stores the new entry's offset in the file
- * into *query_offset.  Also, if gc_count isn't NULL, *gc_count is set to the
- * number of garbage collections that have occurred so far.
- *
- * On failure, returns false.
- *
- * At least a shared lock on pgss->lock must be held by the caller, so as
- * to prevent a concurrent garbage collection.  Share-lock-holding callers
- * should pass a gc_count pointer to obtain the number of garbage collections,
- * so that they can recheck the count after obtaining exclusive lock to
- * detect whether a garbage collection occurred (and removed this entry).
- */
-static bool
-qtext_store(const char *query, int query_len,
-			Size *query_offset, int *gc_count)
-{
-	Size		off;
-	int			fd;
-
-	/*
-	 * We use a spinlock to protect extent/n_writers/gc_count, so that
-	 * multiple processes may execute this function concurrently.
-	 */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-		SpinLockAcquire(&s->mutex);
-		off = s->extent;
-		s->extent += query_len + 1;
-		s->n_writers++;
-		if (gc_count)
-			*gc_count = s->gc_count;
-		SpinLockRelease(&s->mutex);
-	}
-
-	*query_offset = off;
-
-	/* Now write the data into the successfully-reserved part of the file */
-	fd = OpenTransientFile(PGSS_TEXT_FILE, O_RDWR | O_CREAT | PG_BINARY,
-						   S_IRUSR | S_IWUSR);
-	if (fd < 0)
-		goto error;
-
-	if (lseek(fd, off, SEEK_SET) != off)
-		goto error;
-
-	if (write(fd, query, query_len + 1) != query_len + 1)
-		goto error;
-
-	CloseTransientFile(fd);
-
-	/* Mark our write complete */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-		SpinLockAcquire(&s->mutex);
-		s->n_writers--;
-		SpinLockRelease(&s->mutex);
-	}
-
-	return true;
-
-error:
-	ereport(LOG,
-			(errcode_for_file_access(),
-			 errmsg("could not write pg_stat_statement file \"%s\": %m",
-					PGSS_TEXT_FILE)));
-
-	if (fd >= 0)
-		CloseTransientFile(fd);
-
-	/* Mark our write complete */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-		SpinLockAcquire(&s->mutex);
-		s->n_writers--;
-		SpinLockRelease(&s->mutex);
-	}
-
-	return false;
-}
-
-/*
- * Read the external query text file into a malloc'd buffer.
- *
- * Returns NULL (without throwing an error) if unable to read, eg
- * file not there or insufficient memory.
- *
- * On success, the buffer size is also returned into *buffer_size.
- *
- * This can be called without any lock on pgss->lock, but in that case
- * the caller is responsible for verifying that the result is sane.
- */
-static char *
-qtext_load_file(Size *buffer_size)
-{
-	char	   *buf;
-	int			fd;
-	struct stat stat;
-
-	fd = OpenTransientFile(PGSS_TEXT_FILE, O_RDONLY | PG_BINARY, 0);
-	if (fd < 0)
-	{
-		if (errno != ENOENT)
-			ereport(LOG,
-					(errcode_for_file_access(),
-				   errmsg("could not read pg_stat_statement file \"%s\": %m",
-						  PGSS_TEXT_FILE)));
-		return NULL;
-	}
-
-	/* Get file length */
-	if (fstat(fd, &stat))
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not stat pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		CloseTransientFile(fd);
-		return NULL;
-	}
-
-	/* Allocate buffer; beware that off_t might be wider than size_t */
-	if (stat.st_size <= MaxAllocHugeSize)
-		buf = (char *) malloc(stat.st_size);
-	else
-		buf = NULL;
-	if (buf == NULL)
-	{
-		ereport(LOG,
-				(errcode(ERRCODE_OUT_OF_MEMORY),
-				 errmsg("out of memory"),
-				 errdetail("Could not allocate enough memory to read pg_stat_statement file \"%s\".",
-						   PGSS_TEXT_FILE)));
-		CloseTransientFile(fd);
-		return NULL;
-	}
-
-	/*
-	 * OK, slurp in the file.  If we get a short read and errno doesn't get
-	 * set, the reason is probably that garbage collection truncated the file
-	 * since we did the fstat(), so we don't log a complaint --- but we don't
-	 * return the data, either, since it's most likely corrupt due to
-	 * concurrent writes from garbage collection.
-	 */
-	errno = 0;
-	if (read(fd, buf, stat.st_size) != stat.st_size)
-	{
-		if (errno)
-			ereport(LOG,
-					(errcode_for_file_access(),
-				   errmsg("could not read pg_stat_statement file \"%s\": %m",
-						  PGSS_TEXT_FILE)));
-		free(buf);
-		CloseTransientFile(fd);
-		return NULL;
-	}
-
-	CloseTransientFile(fd);
-
-	*buffer_size = stat.st_size;
-	return buf;
-}
-
-/*
- * Locate a query text in the file image previously read by qtext_load_file().
- *
- * We validate the given offset/length, and return NULL if bogus.  Otherwise,
- * the result points to a null-terminated string within the buffer.
- */
-static char *
-qtext_fetch(Size query_offset, int query_len,
-			char *buffer, Size buffer_size)
-{
-	/* File read failed? */
-	if (buffer == NULL)
-		return NULL;
-	/* Bogus offset/length? */
-	if (query_len < 0 ||
-		query_offset + query_len >= buffer_size)
-		return NULL;
-	/* As a further sanity check, make sure there's a trailing null */
-	if (buffer[query_offset + query_len] != '\0')
-		return NULL;
-	/* Looks OK */
-	return buffer + query_offset;
-}
-
-/*
- * Do we need to garbage-collect the external query text file?
- *
- * Caller should hold at least a shared lock on pgss->lock.
- */
-static bool
-need_gc_qtexts(void)
-{
-	Size		extent;
-
-	/* Read shared extent pointer */
-	{
-		volatile pgssSharedState *s = (volatile pgssSharedState *) pgss;
-
-		SpinLockAcquire(&s->mutex);
-		extent = s->extent;
-		SpinLockRelease(&s->mutex);
-	}
-
-	/* Don't proceed if file does not exceed 512 bytes per possible entry */
-	if (extent < 512 * pgss_max)
-		return false;
-
-	/*
-	 * Don't proceed if file is less than about 50% bloat.  Nothing can or
-	 * should be done in the event of unusually large query texts accounting
-	 * for file's large size.  We go to the trouble of maintaining the mean
-	 * query length in order to prevent garbage collection from thrashing
-	 * uselessly.
-	 */
-	if (extent < pgss->mean_query_len * pgss_max * 2)
-		return false;
-
-	return true;
-}
-
-/*
- * Garbage-collect orphaned query texts in external file.
- *
- * This won't be called often in the typical case, since it's likely that
- * there won't be too much churn, and besides, a similar compaction process
- * occurs when serializing to disk at shutdown or as part of resetting.
- * Despite this, it seems prudent to plan for the edge case where the file
- * becomes unreasonably large, with no other method of compaction likely to
- * occur in the foreseeable future.
- *
- * The caller must hold an exclusive lock on pgss->lock.
- *
- * At the first sign of trouble we unlink the query text file to get a clean
- * slate (although existing statistics are retained), rather than risk
- * thrashing by allowing the same problem case to recur indefinitely.
+ * Release all entries.
  */
 static void
-gc_qtexts(void)
+entry_reset(void)
 {
-	char	   *qbuffer;
-	Size		qbuffer_size;
-	FILE	   *qfile = NULL;
 	HASH_SEQ_STATUS hash_seq;
 	pgssEntry  *entry;
-	Size		extent;
-	int			nentries;
 
-	/*
-	 * When called from pgss_store, some other session might have proceeded
-	 * with garbage collection in the no-lock-held interim of lock strength
-	 * escalation.  Check once more that this is actually necessary.
-	 */
-	if (!need_gc_qtexts())
-		return;
-
-	/*
-	 * Load the old texts file.  If we fail (out of memory, for instance),
-	 * invalidate query texts.  Hopefully this is rare.  It might seem better
-	 * to leave things alone on an OOM failure, but the problem is that the
-	 * file is only going to get bigger; hoping for a future non-OOM result is
-	 * risky and can easily lead to complete denial of service.
-	 */
-	qbuffer = qtext_load_file(&qbuffer_size);
-	if (qbuffer == NULL)
-		goto gc_fail;
-
-	/*
-	 * We overwrite the query texts file in place, so as to reduce the risk of
-	 * an out-of-disk-space failure.  Since the file is guaranteed not to get
-	 * larger, this should always work on traditional filesystems; though we
-	 * could still lose on copy-on-write filesystems.
-	 */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not write pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		goto gc_fail;
-	}
-
-	extent = 0;
-	nentries = 0;
-
-	hash_seq_init(&hash_seq, pgss_hash);
-	while ((entry = hash_seq_search(&hash_seq)) != NULL)
-	{
-		int			query_len = entry->query_len;
-		char	   *qry = qtext_fetch(entry->query_offset,
-									  query_len,
-									  qbuffer,
-									  qbuffer_size);
-
-		if (qry == NULL)
-		{
-			/* Trouble ... drop the text */
-			entry->query_offset = 0;
-			entry->query_len = -1;
-			/* entry will not be counted in mean query length computation */
-			continue;
-		}
-
-		if (fwrite(qry, 1, query_len + 1, qfile) != query_len + 1)
-		{
-			ereport(LOG,
-					(errcode_for_file_access(),
-				  errmsg("could not write pg_stat_statement file \"%s\": %m",
-						 PGSS_TEXT_FILE)));
-			hash_seq_term(&hash_seq);
-			goto gc_fail;
-		}
-
-		entry->query_offset = extent;
-		extent += query_len + 1;
-		nentries++;
-	}
-
-	/*
-	 * Truncate away any now-unused space.  If this fails for some odd reason,
-	 * we log it, but there's no need to fail.
-	 */
-	if (ftruncate(fileno(qfile), extent) != 0)
-		ereport(LOG,
-				(errcode_for_file_access(),
-			   errmsg("could not truncate pg_stat_statement file \"%s\": %m",
-					  PGSS_TEXT_FILE)));
-
-	if (FreeFile(qfile))
-	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not write pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		qfile = NULL;
-		goto gc_fail;
-	}
-
-	elog(DEBUG1, "pgss gc of queries file shrunk size from %zu to %zu",
-		 pgss->extent, extent);
-
-	/* Reset the shared extent pointer */
-	pgss->extent = extent;
-
-	/*
-	 * Also update the mean query length, to be sure that need_gc_qtexts()
-	 * won't still think we have a problem.
-	 */
-	if (nentries > 0)
-		pgss->mean_query_len = extent / nentries;
-	else
-		pgss->mean_query_len = ASSUMED_LENGTH_INIT;
-
-	free(qbuffer);
-
-	/*
-	 * OK, count a garbage collection cycle.  (Note: even though we have
-	 * exclusive lock on pgss->lock, we must take pgss->mutex for this, since
-	 * other processes may examine gc_count while holding only the mutex.
-	 * Also, we have to advance the count *after* we've rewritten the file,
-	 * else other processes might not realize they read a stale file.)
-	 */
-	record_gc_qtexts();
-
-	return;
-
-gc_fail:
-	/* clean up resources */
-	if (qfile)
-		FreeFile(qfile);
-	if (qbuffer)
-		free(qbuffer);
+	LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
 
-	/*
-	 * Since the contents of the external file are now uncertain, mark all
-	 * hashtable entries as having invalid texts.
-	 */
 	hash_seq_init(&hash_seq, pgss_hash);
 	while ((entry = hash_seq_search(&hash_seq)) != NULL)
 	{
-		entry->query_offset = 0;
-		entry->query_len = -1;
+		hash_search(pgss_hash, &entry->key, HASH_REMOVE, NULL);
 	}
 
-	/*
-	 * Destroy the query text file and create a new, empty one
-	 */
-	(void) unlink(PGSS_TEXT_FILE);
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
-		ereport(LOG,
-				(errcode_for_file_access(),
-			  errmsg("could not write new pg_stat_statement file \"%s\": %m",
-					 PGSS_TEXT_FILE)));
-	else
-		FreeFile(qfile);
-
-	/* Reset the shared extent pointer */
-	pgss->extent = 0;
-
-	/* Reset mean_query_len to match the new state */
-	pgss->mean_query_len = ASSUMED_LENGTH_INIT;
-
-	/*
-	 * Bump the GC count even though we failed.
-	 *
-	 * This is needed to make concurrent readers of file without any lock on
-	 * pgss->lock notice existence of new version of file.  Once readers
-	 * subsequently observe a change in GC count with pgss->lock held, that
-	 * forces a safe reopen of file.  Writers also require that we bump here,
-	 * of course.  (As required by locking protocol, readers and writers don't
-	 * trust earlier file contents until gc_count is found unchanged after
-	 * pgss->lock acquired in shared or exclusive mode respectively.)
-	 */
-	record_gc_qtexts();
+	LWLockRelease(pgss->lock);
 }
 
 /*
- * Release all entries.
+ * Map an execution time in msec to its latency histogram bucket.
  */
-static void
-entry_reset(void)
+static int
+pgss_hist_bucket(double total_time)
 {
-	HASH_SEQ_STATUS hash_seq;
-	pgssEntry  *entry;
-	FILE	   *qfile;
-
-	LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+	uint64		usec;
+	int			bucket = 0;
 
-	hash_seq_init(&hash_seq, pgss_hash);
-	while ((entry = hash_seq_search(&hash_seq)) != NULL)
-	{
-		hash_search(pgss_hash, &entry->key, HASH_REMOVE, NULL);
-	}
+	if (total_time < 0.001)
+		return 0;
 
-	/*
-	 * Write new empty query file, perhaps even creating a new one to recover
-	 * if the file was missing.
-	 */
-	qfile = AllocateFile(PGSS_TEXT_FILE, PG_BINARY_W);
-	if (qfile == NULL)
+	usec = (uint64) (total_time * 1000.0);
+	while (usec > 0 && bucket < PGSS_HIST_BUCKETS - 1)
 	{
-		ereport(LOG,
-				(errcode_for_file_access(),
-				 errmsg("could not create pg_stat_statement file \"%s\": %m",
-						PGSS_TEXT_FILE)));
-		goto done;
+		usec >>= 1;
+		bucket++;
 	}
 
-	/* If ftruncate fails, log it, but it's not a fatal problem */
-	if (ftruncate(fileno(qfile), 0) != 0)
-		ereport(LOG,
-				(errcode_for_file_access(),
-			   errmsg("could not truncate pg_stat_statement file \"%s\": %m",
-					  PGSS_TEXT_FILE)));
-
-	FreeFile(qfile);
-
-done:
-	pgss->extent = 0;
-	/* This counts as a query text garbage collection for our purposes */
-	record_gc_qtexts();
-
-	LWLockRelease(pgss->lock);
+	return bucket;
 }
 
 /*
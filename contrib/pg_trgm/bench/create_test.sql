@@ -0,0 +1,23 @@
+-- contrib/pg_trgm/bench/create_test.sql
+--
+-- Test data for the pgbench scripts in this directory: 100000 short strings
+-- of one to three pseudo-random mixed-case words, with a copy indexed by
+-- GiST and a copy indexed by GIN.
+
+DROP TABLE IF EXISTS trgm_bench_gist, trgm_bench_gin;
+
+CREATE TABLE trgm_bench_gist AS
+	SELECT i AS id,
+		   (SELECT string_agg(initcap(translate(substr(md5((i * 3 + j)::text), 1, 4 + (i + j) % 6),
+												'0123456789', 'ghijklmnop')), ' ')
+			FROM generate_series(1, 1 + i % 3) j) AS t
+	FROM generate_series(1, 100000) i;
+CREATE TABLE trgm_bench_gin AS SELECT * FROM trgm_bench_gist;
+
+ALTER TABLE trgm_bench_gist ADD PRIMARY KEY (id);
+ALTER TABLE trgm_bench_gin ADD PRIMARY KEY (id);
+CREATE INDEX trgm_bench_gist_idx ON trgm_bench_gist USING gist (t gist_trgm_ops);
+CREATE INDEX trgm_bench_gin_idx ON trgm_bench_gin USING gin (t gin_trgm_ops);
+
+VACUUM ANALYZE trgm_bench_gist;
+VACUUM ANALYZE trgm_bench_gin;
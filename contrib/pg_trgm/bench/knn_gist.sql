@@ -0,0 +1,4 @@
+-- contrib/pg_trgm/bench/knn_gist.sql
+\set id random(1, 100000)
+SELECT t FROM trgm_bench_gist
+	ORDER BY t <-> (SELECT t FROM trgm_bench_gist WHERE id = :id) LIMIT 10;
@@ -0,0 +1,4 @@
+-- contrib/pg_trgm/bench/similarity_gist.sql
+\set id random(1, 100000)
+SELECT count(*) FROM trgm_bench_gist
+	WHERE t % (SELECT t FROM trgm_bench_gist WHERE id = :id);
@@ -40,6 +40,39 @@ typedef struct
 	int			index;
 } pos_trgm;
 
+/*
+ * Per-byte lookup tables for characters that are a single byte.
+ *
+ * For each byte value that is a whole character in the database encoding
+ * (every value in a single-byte encoding, just ASCII otherwise) and whose
+ * case-folded form is a single byte too, char_flags marks it as simple and
+ * says whether ISWORDCHR holds for it, and char_lower gives its case-folded
+ * form, exactly as lowerstr_with_len would produce it.  Words made only of
+ * simple characters can then be found and folded without the per-character
+ * function calls and the allocations of the general path.  The answers
+ * depend only on the database's encoding and locale, which can't change
+ * within a session, so the tables are filled in once, on first use.
+ */
+#define TRGM_CHAR_SIMPLE	0x01
+#define TRGM_CHAR_WORD		0x02
+
+static bool char_tables_ready = false;
+static uint8 char_flags[256];
+static char char_lower[256];
+
+/*
+ * Cache of the trigrams of the right-hand argument of similarity() and the
+ * operators built on it, kept in fn_extra.  An index scan rechecks every
+ * candidate row against the same query string, so this saves extracting
+ * the query's trigrams over and over.
+ */
+typedef struct
+{
+	TRGM	   *trg;			/* trigrams of str */
+	int			len;			/* length of str */
+	char		str[FLEXIBLE_ARRAY_MEMBER];
+} TrgmQueryCache;
+
 /*
  * Module load callback
  */
@@ -131,26 +164,94 @@ unique_array(trgm *a, int len)
 	return curend + 1 - a;
 }
 
+/*
+ * Fill in char_flags and char_lower.
+ */
+static void
+init_char_tables(void)
+{
+	int			maxbyte = (pg_database_encoding_max_length() == 1) ? 255 : 127;
+	int			c;
+
+	memset(char_flags, 0, sizeof(char_flags));
+	for (c = 1; c <= maxbyte; c++)
+	{
+		char		ch = (char) c;
+
+#ifdef IGNORECASE
+		char	   *lower = lowerstr_with_len(&ch, 1);
+
+		if (strlen(lower) != 1)
+		{
+			pfree(lower);
+			continue;
+		}
+		char_lower[c] = lower[0];
+		pfree(lower);
+#else
+		char_lower[c] = ch;
+#endif
+
+		char_flags[c] = TRGM_CHAR_SIMPLE;
+		if (ISWORDCHR(&ch))
+			char_flags[c] |= TRGM_CHAR_WORD;
+	}
+
+	char_tables_ready = true;
+}
+
 /*
  * Finds first word in string, returns pointer to the word,
- * endword points to the character after word
+ * endword points to the character after word.  *simple is set to
+ * whether the word consists of simple single-byte characters only.
  */
 static char *
-find_word(char *str, int lenstr, char **endword, int *charlen)
+find_word(char *str, int lenstr, char **endword, int *charlen, bool *simple)
 {
 	char	   *beginword = str;
+	char	   *end = str + lenstr;
 
-	while (beginword - str < lenstr && !ISWORDCHR(beginword))
-		beginword += pg_mblen(beginword);
+	while (beginword < end)
+	{
+		uint8		flags = char_flags[(unsigned char) *beginword];
 
-	if (beginword - str >= lenstr)
+		if (flags & TRGM_CHAR_SIMPLE)
+		{
+			if (flags & TRGM_CHAR_WORD)
+				break;
+			beginword++;
+		}
+		else
+		{
+			if (ISWORDCHR(beginword))
+				break;
+			beginword += pg_mblen(beginword);
+		}
+	}
+
+	if (beginword >= end)
 		return NULL;
 
 	*endword = beginword;
 	*charlen = 0;
-	while (*endword - str < lenstr && ISWORDCHR(*endword))
+	*simple = true;
+	while (*endword < end)
 	{
-		*endword += pg_mblen(*endword);
+		uint8		flags = char_flags[(unsigned char) **endword];
+
+		if (flags & TRGM_CHAR_SIMPLE)
+		{
+			if (!(flags & TRGM_CHAR_WORD))
+				break;
+			(*endword)++;
+		}
+		else
+		{
+			if (!ISWORDCHR(*endword))
+				break;
+			*endword += pg_mblen(*endword);
+			*simple = false;
+		}
 		(*charlen)++;
 	}
 
@@ -247,10 +348,14 @@ generate_trgm_only(trgm *trg, char *str, int slen)
 				bytelen;
 	char	   *bword,
 			   *eword;
+	bool		simple;
 
 	if (slen + LPADDING + RPADDING < 3 || slen == 0)
 		return 0;
 
+	if (!char_tables_ready)
+		init_char_tables();
+
 	tptr = trg;
 
 	/* Allocate a buffer for case-folded, blank-padded words */
@@ -264,20 +369,34 @@ generate_trgm_only(trgm *trg, char *str, int slen)
 	}
 
 	eword = str;
-	while ((bword = find_word(eword, slen - (eword - str), &eword, &charlen)) != NULL)
+	while ((bword = find_word(eword, slen - (eword - str), &eword, &charlen,
+							  &simple)) != NULL)
 	{
+		if (simple)
+		{
+			/* Case-fold by table lookup, straight into the buffer */
+			char	   *src;
+			char	   *dst = buf + LPADDING;
+
+			for (src = bword; src < eword; src++)
+				*dst++ = char_lower[(unsigned char) *src];
+			bytelen = eword - bword;
+		}
+		else
+		{
 #ifdef IGNORECASE
-		bword = lowerstr_with_len(bword, eword - bword);
-		bytelen = strlen(bword);
+			bword = lowerstr_with_len(bword, eword - bword);
+			bytelen = strlen(bword);
 #else
-		bytelen = eword - bword;
+			bytelen = eword - bword;
 #endif
 
-		memcpy(buf + LPADDING, bword, bytelen);
+			memcpy(buf + LPADDING, bword, bytelen);
 
 #ifdef IGNORECASE
-		pfree(bword);
+			pfree(bword);
 #endif
+		}
 
 		buf[LPADDING + bytelen] = ' ';
 		buf[LPADDING + bytelen + 1] = ' ';
@@ -1050,26 +1169,79 @@ trgm_presence_map(TRGM *query, TRGM *key)
 	return result;
 }
 
-Datum
-similarity(PG_FUNCTION_ARGS)
+/*
+ * Return the trigrams of the query string, from the cache in fn_extra if
+ * it was the same last time.  If there's no FmgrInfo to keep the cache in,
+ * the result is freshly palloc'd, and *fresh is set to tell the caller to
+ * free it.
+ */
+static TRGM *
+get_query_trgm(FunctionCallInfo fcinfo, text *query, bool *fresh)
 {
-	text	   *in1 = PG_GETARG_TEXT_P(0);
-	text	   *in2 = PG_GETARG_TEXT_P(1);
+	TrgmQueryCache *cache;
+	char	   *str = VARDATA_ANY(query);
+	int			len = VARSIZE_ANY_EXHDR(query);
+	MemoryContext oldcontext;
+
+	if (fcinfo->flinfo == NULL)
+	{
+		*fresh = true;
+		return generate_trgm(str, len);
+	}
+
+	*fresh = false;
+	cache = (TrgmQueryCache *) fcinfo->flinfo->fn_extra;
+	if (cache != NULL && cache->len == len && memcmp(cache->str, str, len) == 0)
+		return cache->trg;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	if (cache != NULL)
+	{
+		fcinfo->flinfo->fn_extra = NULL;
+		pfree(cache->trg);
+		pfree(cache);
+	}
+	cache = (TrgmQueryCache *) palloc(offsetof(TrgmQueryCache, str) + len);
+	cache->trg = generate_trgm(str, len);
+	cache->len = len;
+	memcpy(cache->str, str, len);
+	fcinfo->flinfo->fn_extra = (void *) cache;
+	MemoryContextSwitchTo(oldcontext);
+
+	return cache->trg;
+}
+
+/*
+ * Common code for similarity() and the operators based on it.
+ */
+static float4
+calc_similarity(FunctionCallInfo fcinfo)
+{
+	text	   *in1 = PG_GETARG_TEXT_PP(0);
+	text	   *in2 = PG_GETARG_TEXT_PP(1);
 	TRGM	   *trg1,
 			   *trg2;
+	bool		fresh;
 	float4		res;
 
-	trg1 = generate_trgm(VARDATA(in1), VARSIZE(in1) - VARHDRSZ);
-	trg2 = generate_trgm(VARDATA(in2), VARSIZE(in2) - VARHDRSZ);
+	trg1 = generate_trgm(VARDATA_ANY(in1), VARSIZE_ANY_EXHDR(in1));
+	trg2 = get_query_trgm(fcinfo, in2, &fresh);
 
 	res = cnt_sml(trg1, trg2, false);
 
 	pfree(trg1);
-	pfree(trg2);
+	if (fresh)
+		pfree(trg2);
 	PG_FREE_IF_COPY(in1, 0);
 	PG_FREE_IF_COPY(in2, 1);
 
-	PG_RETURN_FLOAT4(res);
+	return res;
+}
+
+Datum
+similarity(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT4(calc_similarity(fcinfo));
 }
 
 Datum
@@ -1091,9 +1263,7 @@ word_similarity(PG_FUNCTION_ARGS)
 Datum
 similarity_dist(PG_FUNCTION_ARGS)
 {
-	float4		res = DatumGetFloat4(DirectFunctionCall2(similarity,
-														 PG_GETARG_DATUM(0),
-														 PG_GETARG_DATUM(1)));
+	float4		res = calc_similarity(fcinfo);
 
 	PG_RETURN_FLOAT4(1.0 - res);
 }
@@ -1101,9 +1271,7 @@ similarity_dist(PG_FUNCTION_ARGS)
 Datum
 similarity_op(PG_FUNCTION_ARGS)
 {
-	float4		res = DatumGetFloat4(DirectFunctionCall2(similarity,
-														 PG_GETARG_DATUM(0),
-														 PG_GETARG_DATUM(1)));
+	float4		res = calc_similarity(fcinfo);
 
 	PG_RETURN_BOOL(res >= similarity_threshold);
 }
@@ -3,12 +3,224 @@
 #include <vector>
 #include <set>
 
-#include <pqxx/connection>
-#include <pqxx/transaction>
-#include <pqxx/nontransaction>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <libpq-fe.h>
 
 using namespace std;
-using namespace pqxx;
+
+/*
+ * Maximal number of COMMIT/ROLLBACK PREPARED statements sent to a node before waiting for their results
+ */
+#define MAX_PIPELINE_DEPTH 1024
+
+struct Resolution
+{
+    string gid;
+    bool   commit;
+};
+
+struct Node
+{
+    string             connstr;
+    PGconn*            conn;
+    set<string>        prepared;    /* transactions prepared at the node */
+    set<string>        committed;   /* transactions recorded in pg_committed_xacts of the node */
+    vector<Resolution> resolutions; /* prepared transactions to be committed or rolled back */
+    size_t             sent;        /* number of resolutions sent to the node */
+    size_t             done;        /* number of resolutions completed by the node */
+    bool               busy;        /* query is in progress */
+};
+
+typedef void (*ResultHandler)(Node& node, PGresult* res);
+
+static bool verbose = false;
+
+static double getCurrentTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static void fatal(Node const& node, char const* what)
+{
+    cerr << what << " at " << node.connstr << ": " << PQerrorMessage(node.conn);
+    exit(1);
+}
+
+/*
+ * Establish connections to all nodes at once
+ */
+static void connectAll(vector<Node>& nodes)
+{
+    vector<PostgresPollingStatusType> status(nodes.size(), PGRES_POLLING_WRITING);
+    vector<struct pollfd> fds;
+    size_t i, nConnecting = nodes.size();
+
+    for (i = 0; i < nodes.size(); i++) {
+        if (verbose) {
+            cout << "Connecting to " << nodes[i].connstr << "...\n";
+        }
+        nodes[i].conn = PQconnectStart(nodes[i].connstr.c_str());
+        if (nodes[i].conn == NULL) {
+            cerr << "Failed to allocate connection to " << nodes[i].connstr << "\n";
+            exit(1);
+        }
+        if (PQstatus(nodes[i].conn) == CONNECTION_BAD) {
+            fatal(nodes[i], "Failed to connect");
+        }
+    }
+    while (nConnecting != 0) {
+        fds.clear();
+        for (i = 0; i < nodes.size(); i++) {
+            if (status[i] == PGRES_POLLING_READING || status[i] == PGRES_POLLING_WRITING) {
+                struct pollfd fd;
+                fd.fd = PQsocket(nodes[i].conn);
+                fd.events = status[i] == PGRES_POLLING_READING ? POLLIN : POLLOUT;
+                fd.revents = 0;
+                fds.push_back(fd);
+            }
+        }
+        poll(&fds[0], fds.size(), 1000);
+        for (i = 0; i < nodes.size(); i++) {
+            if (status[i] == PGRES_POLLING_READING || status[i] == PGRES_POLLING_WRITING) {
+                status[i] = PQconnectPoll(nodes[i].conn);
+                if (status[i] == PGRES_POLLING_FAILED) {
+                    fatal(nodes[i], "Failed to connect");
+                } else if (status[i] == PGRES_POLLING_OK) {
+                    nConnecting -= 1;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Wait for input at the nodes with query in progress
+ */
+static void waitForInput(vector<Node>& nodes)
+{
+    vector<struct pollfd> fds;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].busy) {
+            struct pollfd fd;
+            fd.fd = PQsocket(nodes[i].conn);
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+        }
+    }
+    if (!fds.empty()) {
+        poll(&fds[0], fds.size(), 1000);
+    }
+}
+
+/*
+ * Execute the same query with one optional parameter at all nodes concurrently, passing results to the handler
+ */
+static void execAll(vector<Node>& nodes, char const* sql, char const* param, ResultHandler handler)
+{
+    size_t i, nBusy = nodes.size();
+
+    for (i = 0; i < nodes.size(); i++) {
+        if (!PQsendQueryParams(nodes[i].conn, sql, param ? 1 : 0, NULL, param ? &param : NULL, NULL, NULL, 0)) {
+            fatal(nodes[i], "Failed to send query");
+        }
+        nodes[i].busy = true;
+    }
+    while (nBusy != 0) {
+        waitForInput(nodes);
+        for (i = 0; i < nodes.size(); i++) {
+            Node& node = nodes[i];
+            if (!node.busy) {
+                continue;
+            }
+            if (!PQconsumeInput(node.conn)) {
+                fatal(node, "Failed to receive results");
+            }
+            while (node.busy && !PQisBusy(node.conn)) {
+                PGresult* res = PQgetResult(node.conn);
+                if (res == NULL) {
+                    node.busy = false;
+                    nBusy -= 1;
+                } else if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+                    fatal(node, "Query failed");
+                } else {
+                    handler(node, res);
+                    PQclear(res);
+                }
+            }
+        }
+    }
+}
+
+static void collectPrepared(Node& node, PGresult* res)
+{
+    for (int i = 0, n = PQntuples(res); i < n; i++) {
+        node.prepared.insert(PQgetvalue(res, i, 0));
+    }
+}
+
+static void collectCommitted(Node& node, PGresult* res)
+{
+    for (int i = 0, n = PQntuples(res); i < n; i++) {
+        node.committed.insert(PQgetvalue(res, i, 0));
+    }
+}
+
+/*
+ * Build text array literal for the list of GIDs
+ */
+static string makeArrayLiteral(set<string> const& gids)
+{
+    string array = "{";
+    for (set<string>::const_iterator it = gids.begin(); it != gids.end(); ++it) {
+        if (it != gids.begin()) {
+            array += ',';
+        }
+        array += '"';
+        for (size_t i = 0; i < it->size(); i++) {
+            char ch = (*it)[i];
+            if (ch == '"' || ch == '\\') {
+                array += '\\';
+            }
+            array += ch;
+        }
+        array += '"';
+    }
+    return array + "}";
+}
+
+/*
+ * Send next batch of COMMIT/ROLLBACK PREPARED statements to the node.
+ * Each statement is followed by sync point, so failure of one of them doesn't affect the others.
+ */
+static void sendResolutions(Node& node)
+{
+    while (node.sent < node.resolutions.size() && node.sent - node.done < MAX_PIPELINE_DEPTH) {
+        Resolution const& r = node.resolutions[node.sent];
+        char* gid = PQescapeLiteral(node.conn, r.gid.c_str(), r.gid.size());
+        string sql;
+        if (gid == NULL) {
+            fatal(node, "Failed to escape GID");
+        }
+        sql = string(r.commit ? "commit prepared " : "rollback prepared ") + gid;
+        PQfreemem(gid);
+        if (!PQsendQueryParams(node.conn, sql.c_str(), 0, NULL, NULL, NULL, NULL, 0) || !PQpipelineSync(node.conn)) {
+            fatal(node, "Failed to send statement");
+        }
+        node.sent += 1;
+    }
+    if (PQflush(node.conn) < 0) {
+        fatal(node, "Failed to send statements");
+    }
+    node.busy = node.done < node.sent;
+}
 
 int main (int argc, char* argv[])
 {
@@ -16,17 +228,23 @@ int main (int argc, char* argv[])
         printf("Use -h to show usage options\n");
         return 1;
     }
-    vector<string> connections;
+    vector<Node> nodes;
     set<string> prepared_xacts;
     set<string> committed_xacts;
-    bool verbose = false;
-    for (int i = 1; i < argc; i++) { 
-        if (argv[i][0] == '-') { 
-            switch (argv[i][1]) { 
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            switch (argv[i][1]) {
               case 'C':
               case 'c':
-                connections.push_back(string(argv[++i]));
+              {
+                Node node;
+                node.connstr = argv[++i];
+                node.conn = NULL;
+                node.sent = node.done = 0;
+                node.busy = false;
+                nodes.push_back(node);
                 continue;
+              }
               case 'v':
                 verbose = true;
                 continue;
@@ -39,91 +257,117 @@ int main (int argc, char* argv[])
                "\t-v\tverbose mode: print extra information while processing\n");
         return 1;
     }
-    if (verbose) { 
+    connectAll(nodes);
+
+    if (verbose) {
         cout << "Collecting information about prepared transactions...\n";
     }
-    for (vector<string>::iterator ic = connections.begin(); ic != connections.end(); ++ic)
-    {
-        if (verbose) { 
-            cout << "Connecting to " << *ic << "...\n";
-        }
-        connection con(*ic);
-        work txn(con);
-        result r = txn.exec("select gid from pg_prepared_xacts");
-        for (result::const_iterator it = r.begin(); it != r.end(); ++it)
-        {
-            string gid = it.at("gid").as(string());
-            prepared_xacts.insert(gid);
-        }
-        txn.commit();
+    execAll(nodes, "select gid from pg_prepared_xacts", NULL, collectPrepared);
+    for (vector<Node>::iterator in = nodes.begin(); in != nodes.end(); ++in) {
+        prepared_xacts.insert(in->prepared.begin(), in->prepared.end());
     }
-    if (verbose) { 
+    if (verbose) {
         cout << "Prepared transactions: ";
         for (set<string>::iterator it = prepared_xacts.begin(); it != prepared_xacts.end(); ++it)
         {
             cout << *it << ", ";
         }
         cout << "\nChecking which of them are committed...\n";
-    }        
-    for (vector<string>::iterator ic = connections.begin(); ic != connections.end(); ++ic)
-    {
-        if (verbose) { 
-            cout << "Connecting to " << *ic << "...\n";
-        }
-        connection con(*ic);
-        work txn(con);
-        con.prepare("commit-check", "select * from pg_committed_xacts where gid=$1");
-        for (set<string>::iterator it = prepared_xacts.begin(); it != prepared_xacts.end(); ++it)
-        {
-            string gid = *it;
-            result r = txn.prepared("commit-check")(gid).exec();
-            if (!r.empty()) {
-                committed_xacts.insert(gid);
-            }
-        }
-        txn.commit();
     }
-    if (verbose) { 
+    if (prepared_xacts.empty()) {
+        cout << "No in-doubt transactions\n";
+        return 0;
+    }
+
+    /* check all GIDs with a single query per node */
+    string gids = makeArrayLiteral(prepared_xacts);
+    execAll(nodes, "select gid from pg_committed_xacts where gid = any($1::text[])", gids.c_str(), collectCommitted);
+    for (vector<Node>::iterator in = nodes.begin(); in != nodes.end(); ++in) {
+        committed_xacts.insert(in->committed.begin(), in->committed.end());
+    }
+    if (verbose) {
         cout << "Committed transactions: ";
         for (set<string>::iterator it = committed_xacts.begin(); it != committed_xacts.end(); ++it)
         {
             cout << *it << ", ";
         }
         cout << "\nCommitting them at all nodes...\n";
-    }      
-    for (vector<string>::iterator ic = connections.begin(); ic != connections.end(); ++ic)
-    {
-        if (verbose) { 
-            cout << "Connecting to " << *ic << "...\n";
-        }
-        connection con(*ic);
-        work txn(con);
-        con.prepare("commit-check", "select * from pg_committed_xacts where gid=$1");
-        con.prepare("commit-prepared", "commit prepared $1");
-        con.prepare("rollback-prepared", "rollback prepared $1");
-        result r = txn.exec("select gid from pg_prepared_xacts");
-        for (result::const_iterator it = r.begin(); it != r.end(); ++it)
-        {
-            string gid = it.at("gid").as(string());
-            result rc = txn.prepared("commit-check")(gid).exec();
-            if (rc.empty()) {
-                if (committed_xacts.find(gid) != committed_xacts.end()) {
-                    if (verbose) { 
-                        cout << "Commit transaction " << gid << "\n";
-                    }
-                    txn.prepared("commit-prepared")(gid);
-                } else { 
-                    if (verbose) { 
-                        cout << "Rollback transaction " << gid << "\n";
+    }
+
+    size_t nResolutions = 0, nCommitted = 0, nAborted = 0, nFailed = 0;
+    for (vector<Node>::iterator in = nodes.begin(); in != nodes.end(); ++in) {
+        for (set<string>::iterator it = in->prepared.begin(); it != in->prepared.end(); ++it) {
+            if (in->committed.find(*it) == in->committed.end()) {
+                Resolution r;
+                r.gid = *it;
+                r.commit = committed_xacts.find(*it) != committed_xacts.end();
+                if (verbose) {
+                    cout << (r.commit ? "Commit" : "Rollback") << " transaction " << r.gid << " at " << in->connstr << "\n";
+                }
+                in->resolutions.push_back(r);
+            }
+        }
+        nResolutions += in->resolutions.size();
+        if (!PQenterPipelineMode(in->conn)) {
+            fatal(*in, "Failed to enter pipeline mode");
+        }
+    }
+
+    /* resolve transactions at all nodes concurrently, pipelining the statements sent to each node */
+    double start = getCurrentTime();
+    size_t nDone = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        sendResolutions(nodes[i]);
+    }
+    while (nDone < nResolutions) {
+        waitForInput(nodes);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            Node& node = nodes[i];
+            if (!node.busy) {
+                continue;
+            }
+            if (!PQconsumeInput(node.conn)) {
+                fatal(node, "Failed to receive results");
+            }
+            while (node.done < node.sent && !PQisBusy(node.conn)) {
+                PGresult* res = PQgetResult(node.conn);
+                if (res == NULL) {
+                    continue; /* end of results of the statement */
+                }
+                switch (PQresultStatus(res)) {
+                  case PGRES_PIPELINE_SYNC:
+                    node.done += 1;
+                    nDone += 1;
+                    break;
+                  case PGRES_COMMAND_OK:
+                    if (node.resolutions[node.done].commit) {
+                        nCommitted += 1;
+                    } else {
+                        nAborted += 1;
                     }
-                    txn.prepared("rollback-prepared")(gid);
+                    break;
+                  default:
+                    cerr << "Failed to " << (node.resolutions[node.done].commit ? "commit" : "rollback")
+                         << " transaction " << node.resolutions[node.done].gid << " at " << node.connstr
+                         << ": " << PQresultErrorMessage(res);
+                    nFailed += 1;
                 }
+                PQclear(res);
             }
+            sendResolutions(node);
         }
-        txn.commit();
     }
-    if (verbose) { 
+    double elapsed = getCurrentTime() - start;
+
+    printf("Resolved %ld of %ld prepared transactions (%ld committed, %ld rolled back) of %ld global transactions in %.3f seconds: %.0f transactions/sec\n",
+           (long)(nCommitted + nAborted), (long)nResolutions, (long)nCommitted, (long)nAborted, (long)prepared_xacts.size(),
+           elapsed, elapsed > 0 ? (nCommitted + nAborted)/elapsed : 0.0);
+
+    for (vector<Node>::iterator in = nodes.begin(); in != nodes.end(); ++in) {
+        PQfinish(in->conn);
+    }
+    if (verbose) {
         cout << "Recovery completed\n";
     }
-    return 0;
-}               
+    return nFailed == 0 ? 0 : 1;
+}
@@ -24,3 +24,7 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_csn(xid integer) RETURNS bigint
 AS 'MODULE_PATHNAME','dtm_get_csn'
 LANGUAGE C;
+
+CREATE FUNCTION dtm_get_clock_stats(OUT drift bigint, OUT ahead bigint, OUT max_drift bigint, OUT rejected bigint) RETURNS record
+AS 'MODULE_PATHNAME','dtm_get_clock_stats'
+LANGUAGE C;
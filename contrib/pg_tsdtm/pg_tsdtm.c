@@ -11,15 +11,19 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "storage/s_lock.h"
 #include "storage/spin.h"
 #include "storage/lmgr.h"
 #include "storage/shmem.h"
 #include "storage/ipc.h"
+#include "port/atomics.h"
 #include "access/xlogdefs.h"
 #include "access/xact.h"
 #include "access/xtm.h"
+#include "access/hlc.h"
+#include "access/htup_details.h"
 #include "access/transam.h"
 #include "access/subtrans.h"
 #include "access/xlog.h"
@@ -38,6 +42,8 @@
 #define MAX_WAIT_TIMEOUT 100000
 #define MAX_GTID_SIZE  16
 #define HASH_PER_ELEM_OVERHEAD 64
+#define DTM_CSN_LOG_SIZE  (1024*1024)	/* must be power of two */
+#define DTM_CSN_ABORTED   ((cid_t)1 << 63)	/* flag of aborted transaction in CSN log */
 
 #define USEC 1000000
 
@@ -56,14 +62,25 @@ typedef struct DtmTransStatus
 								 * transaction list */
 }	DtmTransStatus;
 
+/*
+ * Slot of CSN log: lock-free map of XID to CSN of finished (committed or aborted) transaction.
+ * Slot is addressed by XID modulo DTM_CSN_LOG_SIZE, so XID is stored in the slot to detect collisions.
+ * Slots are updated under local->lock, readers use seqlock-like protocol: XID is invalidated before
+ * CSN is changed and restored after it, so reader rechecks XID after fetching CSN.
+ */
+typedef struct
+{
+	pg_atomic_uint32 xid;
+	pg_atomic_uint64 csn;
+}	DtmCsnLogSlot;
+
 /* State of DTM node */
 typedef struct
 {
-	cid_t		cid;			/* last assigned CSN; used to provide unique
-								 * ascending CSNs */
+	HybridLogicalClock clock;	/* source of unique ascending CSNs: system
+								 * time merged with received timestamps */
 	TransactionId oldest_xid;	/* XID of oldest transaction visible by any
 								 * active transaction (local or global) */
-	long		time_shift;		/* correction to system time */
 	volatile slock_t lock;		/* spinlock to protect access to hash table  */
 	DtmTransStatus *trans_list_head;	/* L1 list of finished transactions
 										 * present in xid2status hash table.
@@ -89,9 +106,11 @@ static shmem_startup_hook_type prev_shmem_startup_hook;
 static HTAB *xid2status;
 static HTAB *gtid2xid;
 static DtmNodeState *local;
+static DtmCsnLogSlot *csnlog;
 static DtmCurrentTrans dtm_tx;
 static uint64 totalSleepInterrupts;
 static int	DtmVacuumDelay;
+static int	DtmMaxClockSkew;
 static bool DtmRecordCommits;
 
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
@@ -108,20 +127,20 @@ static void DtmDeserializeTransactionState(void* ctx);
 
 
 static TransactionManager DtmTM = {
-	PgTransactionIdGetStatus,
-	PgTransactionIdSetTreeStatus,
-	DtmGetSnapshot,
-	PgGetNewTransactionId,
-	DtmGetOldestXmin,
-	PgTransactionIdIsInProgress,
-	PgGetGlobalTransactionId,
-	DtmXidInMVCCSnapshot,
-	DtmDetectGlobalDeadLock,
-	DtmGetName,
-	DtmGetTransactionStateSize,
-	DtmSerializeTransactionState,
-	DtmDeserializeTransactionState,
-	PgInitializeSequence
+	.GetTransactionStatus = PgTransactionIdGetStatus,
+	.SetTransactionStatus = PgTransactionIdSetTreeStatus,
+	.GetSnapshot = DtmGetSnapshot,
+	.GetNewTransactionId = PgGetNewTransactionId,
+	.GetOldestXmin = DtmGetOldestXmin,
+	.IsInProgress = PgTransactionIdIsInProgress,
+	.GetGlobalTransactionId = PgGetGlobalTransactionId,
+	.IsInSnapshot = DtmXidInMVCCSnapshot,
+	.DetectGlobalDeadLock = DtmDetectGlobalDeadLock,
+	.GetName = DtmGetName,
+	.GetTransactionStateSize = DtmGetTransactionStateSize,
+	.SerializeTransactionState = DtmSerializeTransactionState,
+	.DeserializeTransactionState = DtmDeserializeTransactionState,
+	.InitializeSequence = PgInitializeSequence
 };
 
 void		_PG_init(void);
@@ -140,14 +159,11 @@ static cid_t dtm_sync(cid_t cid);
  *	Time manipulation functions
  */
 
-/* Get current time with microscond resolution */
+/* Get current value of hybrid logical clock with microscond resolution */
 static timestamp_t
 dtm_get_current_time()
 {
-	struct timeval tv;
-
-	gettimeofday(&tv, NULL);
-	return (timestamp_t) tv.tv_sec * USEC + tv.tv_usec + local->time_shift;
+	return HlcNow(&local->clock);
 }
 
 /* Sleep for specified amount of time */
@@ -174,32 +190,16 @@ dtm_sleep(timestamp_t interval)
 static cid_t
 dtm_get_cid()
 {
-	cid_t		cid = dtm_get_current_time();
-
-	if (cid <= local->cid)
-	{
-		cid = ++local->cid;
-	}
-	else
-	{
-		local->cid = cid;
-	}
-	return cid;
+	return HlcTick(&local->clock);
 }
 
 /*
- * Adjust system time
+ * Merge received CSN into the local clock
  */
 static cid_t
 dtm_sync(cid_t global_cid)
 {
-	cid_t		local_cid;
-
-	while ((local_cid = dtm_get_cid()) < global_cid)
-	{
-		local->time_shift += global_cid - local_cid;
-	}
-	return local_cid;
+	return HlcUpdate(&local->clock, global_cid, 0);
 }
 
 void
@@ -235,6 +235,21 @@ _PG_init(void)
 							NULL
 		);
 
+	DefineCustomIntVariable(
+							"dtm.max_clock_skew",
+							"Maximal allowed advance (msec) of snapshot of global transaction over local clock",
+							"Zero disables the check",
+							&DtmMaxClockSkew,
+							0,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL
+		);
+
 	DefineCustomBoolVariable(
 							 "dtm.record_commits",
 							 "Store information about committed global transactions in pg_committed_xacts table",
@@ -275,6 +290,7 @@ dtm_memsize(void)
 	Size		size;
 
 	size = MAXALIGN(sizeof(DtmNodeState));
+	size = add_size(size, MAXALIGN(sizeof(DtmCsnLogSlot) * DTM_CSN_LOG_SIZE));
 	size = add_size(size, (sizeof(DtmTransId) + sizeof(DtmTransStatus) + HASH_PER_ELEM_OVERHEAD * 2) * DTM_HASH_INIT_SIZE);
 
 	return size;
@@ -353,6 +369,7 @@ PG_FUNCTION_INFO_V1(dtm_begin_prepare);
 PG_FUNCTION_INFO_V1(dtm_prepare);
 PG_FUNCTION_INFO_V1(dtm_end_prepare);
 PG_FUNCTION_INFO_V1(dtm_get_csn);
+PG_FUNCTION_INFO_V1(dtm_get_clock_stats);
 
 Datum
 dtm_extend(PG_FUNCTION_ARGS)
@@ -416,6 +433,26 @@ dtm_get_csn(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(csn);
 }
 
+Datum
+dtm_get_clock_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	desc;
+	Datum		values[4];
+	bool		nulls[4] = {false};
+
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	SpinLockAcquire(&local->lock);
+	values[0] = Int64GetDatum(HlcDrift(&local->clock));
+	values[1] = Int64GetDatum(local->clock.nAhead);
+	values[2] = Int64GetDatum(local->clock.maxDrift);
+	values[3] = Int64GetDatum(local->clock.nRejected);
+	SpinLockRelease(&local->lock);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(desc, values, nulls)));
+}
+
 /*
  *	***************************************************************************
  */
@@ -482,6 +519,53 @@ DtmTransactionListInsertAfter(DtmTransStatus * after, DtmTransStatus * ts)
 	}
 }
 
+/*
+ * Publish CSN of finished transaction in CSN log. Called under local->lock.
+ */
+static void
+DtmCsnLogSet(TransactionId xid, cid_t csn)
+{
+	DtmCsnLogSlot *slot = &csnlog[xid & (DTM_CSN_LOG_SIZE - 1)];
+
+	pg_atomic_write_u32(&slot->xid, InvalidTransactionId);
+	pg_write_barrier();
+	pg_atomic_write_u64(&slot->csn, csn);
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->xid, xid);
+}
+
+/*
+ * Remove transaction from CSN log. Called under local->lock.
+ */
+static void
+DtmCsnLogReset(TransactionId xid)
+{
+	DtmCsnLogSlot *slot = &csnlog[xid & (DTM_CSN_LOG_SIZE - 1)];
+
+	if (pg_atomic_read_u32(&slot->xid) == xid)
+		pg_atomic_write_u32(&slot->xid, InvalidTransactionId);
+}
+
+/*
+ * Lock-free lookup of CSN of finished transaction.
+ * Returns INVALID_CID if transaction is not present in CSN log.
+ */
+static cid_t
+DtmCsnLogGet(TransactionId xid)
+{
+	DtmCsnLogSlot *slot = &csnlog[xid & (DTM_CSN_LOG_SIZE - 1)];
+	cid_t		csn;
+
+	if (pg_atomic_read_u32(&slot->xid) != xid)
+		return INVALID_CID;
+	pg_read_barrier();
+	csn = pg_atomic_read_u64(&slot->csn);
+	pg_read_barrier();
+	if (pg_atomic_read_u32(&slot->xid) != xid)
+		return INVALID_CID;
+	return csn;
+}
+
 /*
  * There can be different oldest XIDs at different cluster node.
  * Seince we do not have centralized aribiter, we have to rely in DtmVacuumDelay.
@@ -508,7 +592,10 @@ DtmAdjustOldestXid(TransactionId xid)
 			for (ts = local->trans_list_head; ts != NULL && ts->cid < cutoff_time; prev = ts, ts = ts->next)
 			{
 				if (prev != NULL)
+				{
+					DtmCsnLogReset(prev->xid);
 					hash_search(xid2status, &prev->xid, HASH_REMOVE, NULL);
+				}
 			}
 		}
 		if (prev != NULL)
@@ -545,14 +632,23 @@ DtmGetOldestXmin(Relation rel, bool ignoreVacuum)
 /*
  * Check tuple bisibility based on CSN of current transaction.
  * If there is no niformation about transaction with this XID, then use standard PostgreSQL visibility rules.
+ * Finished transactions are looked up in CSN log without locking, hash is accessed only for in-doubt
+ * transactions and transactions evicted from CSN log by collision.
  */
 bool
 DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
 	timestamp_t delay = MIN_WAIT_TIMEOUT;
+	cid_t		csn;
 
 	Assert(xid != InvalidTransactionId);
 
+	csn = DtmCsnLogGet(xid);
+	if (csn != INVALID_CID)
+	{
+		return (csn & DTM_CSN_ABORTED) || csn > dtm_tx.snapshot;
+	}
+
 	SpinLockAcquire(&local->lock);
 
 	while (true)
@@ -627,12 +723,22 @@ DtmInitialize()
 	TM = &DtmTM;
 
 	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	csnlog = (DtmCsnLogSlot *) ShmemInitStruct("dtm_csn_log", sizeof(DtmCsnLogSlot) * DTM_CSN_LOG_SIZE, &found);
+	if (!found)
+	{
+		int			i;
+
+		for (i = 0; i < DTM_CSN_LOG_SIZE; i++)
+		{
+			pg_atomic_init_u32(&csnlog[i].xid, InvalidTransactionId);
+			pg_atomic_init_u64(&csnlog[i].csn, INVALID_CID);
+		}
+	}
 	local = (DtmNodeState *) ShmemInitStruct("dtm", sizeof(DtmNodeState), &found);
 	if (!found)
 	{
-		local->time_shift = 0;
 		local->oldest_xid = FirstNormalTransactionId;
-		local->cid = dtm_get_current_time();
+		HlcInit(&local->clock);
 		local->trans_list_head = NULL;
 		local->trans_list_tail = &local->trans_list_head;
 		SpinLockInit(&local->lock);
@@ -695,6 +801,13 @@ DtmLocalAccess(DtmCurrentTrans * x, GlobalTransactionId gtid, cid_t global_cid)
 	cid_t		local_cid;
 
 	SpinLockAcquire(&local->lock);
+	/* node with fast clock should not push clocks of all other nodes forward */
+	local_cid = HlcUpdate(&local->clock, global_cid, (uint64) DtmMaxClockSkew * 1000);
+	if (local_cid == INVALID_CID)
+	{
+		SpinLockRelease(&local->lock);
+		elog(ERROR, "Snapshot %ld is ahead of local clock by more than dtm.max_clock_skew=%d msec", global_cid, DtmMaxClockSkew);
+	}
 	{
 		if (gtid != NULL)
 		{
@@ -704,7 +817,6 @@ DtmLocalAccess(DtmCurrentTrans * x, GlobalTransactionId gtid, cid_t global_cid)
 			id->nSubxids = 0;
 			id->subxids = 0;
 		}
-		local_cid = dtm_sync(global_cid);
 		x->snapshot = global_cid;
 		x->is_global = true;
 	}
@@ -859,18 +971,27 @@ DtmLocalCommit(DtmCurrentTrans * x)
 				sts = sts->next;
 				Assert(sts->cid == ts->cid);
 				sts->status = TRANSACTION_STATUS_COMMITTED;
+				DtmCsnLogSet(sts->xid, sts->cid);
 			}
 		}
 		else
 		{
 			TransactionId *subxids;
+			int			i;
+			DtmTransStatus *sts = ts;
 
 			Assert(!found);
 			ts->cid = dtm_get_cid();
 			DtmTransactionListAppend(ts);
 			ts->nSubxids = xactGetCommittedChildren(&subxids);
 			DtmAddSubtransactions(ts, subxids, ts->nSubxids);
+			for (i = 0; i < ts->nSubxids; i++)
+			{
+				sts = sts->next;
+				DtmCsnLogSet(sts->xid, sts->cid);
+			}
 		}
+		DtmCsnLogSet(ts->xid, ts->cid);
 		x->cid = ts->cid;
 		DTM_TRACE((stderr, "Local transaction %u is committed at %lu\n", x->xid, x->cid));
 	}
@@ -928,6 +1049,7 @@ DtmLocalAbort(DtmCurrentTrans * x)
 		}
 		x->cid = ts->cid;
 		ts->status = TRANSACTION_STATUS_ABORTED;
+		DtmCsnLogSet(ts->xid, ts->cid | DTM_CSN_ABORTED);
 		DTM_TRACE((stderr, "Local transaction %u is aborted at %lu\n", x->xid, x->cid));
 	}
 	SpinLockRelease(&local->lock);
@@ -979,7 +1101,10 @@ DtmDeserializeTransactionState(void* ctx)
 static cid_t
 DtmGetCsn(TransactionId xid)
 {
-	cid_t		csn = 0;
+	cid_t		csn = DtmCsnLogGet(xid);
+
+	if (csn != INVALID_CID)
+		return csn & ~DTM_CSN_ABORTED;
 
 	SpinLockAcquire(&local->lock);
 	{
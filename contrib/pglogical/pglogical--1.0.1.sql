@@ -41,6 +41,7 @@ CREATE TABLE pglogical.local_sync_status (
     sync_nspname name,
     sync_relname name,
     sync_status "char" NOT NULL,
+    sync_fast_copy boolean NOT NULL DEFAULT false,
     UNIQUE (sync_subid, sync_nspname, sync_relname)
 );
 
@@ -52,7 +53,8 @@ RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_drop
 
 CREATE FUNCTION pglogical.create_subscription(subscription_name name, provider_dsn text,
     replication_sets text[] = '{default,default_insert_only,ddl_sql}', synchronize_structure boolean = true,
-    synchronize_data boolean = true, forward_origins text[] = '{all}')
+    synchronize_data boolean = true, forward_origins text[] = '{all}',
+    fast_copy boolean = false)
 RETURNS oid STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_create_subscription';
 CREATE FUNCTION pglogical.drop_subscription(subscription_name name, ifexists boolean DEFAULT false)
 RETURNS oid STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_drop_subscription';
@@ -143,20 +145,13 @@ RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_repl
 CREATE FUNCTION pglogical.alter_subscription_synchronize(subscription_name name, truncate boolean DEFAULT false)
 RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_alter_subscription_synchronize';
 
-CREATE FUNCTION pglogical.alter_subscription_resynchronize_table(subscription_name name, relation regclass)
+CREATE FUNCTION pglogical.alter_subscription_resynchronize_table(subscription_name name, relation regclass,
+    fast_copy boolean DEFAULT false)
 RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_alter_subscription_resynchronize_table';
 
 CREATE FUNCTION pglogical.show_subscription_table(subscription_name name, relation regclass, OUT nspname text, OUT relname text, OUT status text)
 RETURNS record STRICT STABLE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_show_subscription_table';
 
-CREATE TABLE pglogical.queue (
-    queued_at timestamp with time zone NOT NULL,
-    role name NOT NULL,
-    replication_sets text[],
-    message_type "char" NOT NULL,
-    message json NOT NULL
-);
-
 CREATE FUNCTION pglogical.replicate_ddl_command(command text)
 RETURNS boolean STRICT VOLATILE LANGUAGE c AS 'MODULE_PATHNAME', 'pglogical_replicate_ddl_command';
 
@@ -49,6 +49,8 @@ static const struct config_enum_entry PGLogicalConflictResolvers[] = {
 
 bool	pglogical_synchronous_commit = false;
 char   *pglogical_temp_directory;
+int		pglogical_sync_jobs = 1;
+bool	pglogical_batch_inserts = false;
 
 void _PG_init(void);
 void pglogical_supervisor_main(Datum main_arg);
@@ -108,7 +110,7 @@ textarray_to_list(ArrayType *textarray)
 }
 
 /*
- * Get oid of our queue table.
+ * Get oid of a table in the pglogical schema.
  */
 inline Oid
 get_pglogical_table_oid(const char *table)
@@ -279,6 +281,7 @@ pglogical_start_replication(PGconn *streamConn, const char *slot_name,
 
 	/* Tell the upstream that we want unbounded metadata cache size */
 	appendStringInfoString(&command, ", \"relmeta_cache_size\" '-1'");
+	appendStringInfoString(&command, ", \"compact_tuples\" '1'");
 
 	/* general info about the downstream */
 	appendStringInfo(&command, ", pg_version '%u'", PG_VERSION_NUM);
@@ -442,6 +445,23 @@ _PG_init(void)
 							   "/tmp", PGC_SIGHUP,
 							   0,
 							   NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.sync_jobs",
+							"Number of tables copied in parallel during initial synchronization",
+							NULL,
+							&pglogical_sync_jobs,
+							1, 1, 64, PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pglogical.batch_inserts",
+							 "Apply consecutive inserts into the same table in batches",
+							 NULL,
+							 &pglogical_batch_inserts,
+							 false, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
 	if (IsBinaryUpgrade)
 		return;
 
@@ -38,6 +38,8 @@
 
 extern bool pglogical_synchronous_commit;
 extern char *pglogical_temp_directory;
+extern int pglogical_sync_jobs;
+extern bool pglogical_batch_inserts;
 
 extern char *shorten_hash(const char *str, int maxlen);
 
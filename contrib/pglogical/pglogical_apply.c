@@ -16,6 +16,7 @@
 #include "libpq-fe.h"
 #include "pgstat.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 
@@ -47,7 +48,6 @@
 #include "tcop/utility.h"
 
 #include "utils/builtins.h"
-#include "utils/jsonb.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
 
@@ -69,8 +69,6 @@ static bool			in_remote_transaction = false;
 static XLogRecPtr	remote_origin_lsn = InvalidXLogRecPtr;
 static RepOriginId	remote_origin_id = InvalidRepOriginId;
 
-static Oid			QueueRelid = InvalidOid;
-
 static List		   *SyncingTables = NIL;
 
 PGLogicalApplyWorker	   *MyApplyWorker = NULL;
@@ -87,7 +85,33 @@ typedef struct PGLFlushPosition
 
 dlist_head lsn_mapping = DLIST_STATIC_INIT(lsn_mapping);
 
-static void handle_queued_message(HeapTuple msgtup, bool tx_just_started);
+/*
+ * Limits of the insert buffer, same as the ones COPY FROM uses for its
+ * multi-inserts.
+ */
+#define MAX_BUFFERED_TUPLES		1000
+#define MAX_BUFFERED_BYTES		65535
+
+/*
+ * Consecutive inserts into the same table waiting to be written by
+ * heap_multi_insert, see pglogical.batch_inserts.
+ */
+typedef struct ApplyInsertBuffer
+{
+	MemoryContext	context;		/* holds the buffer and its tuples */
+	Relation		rel;			/* open target relation */
+	EState		   *estate;
+	TupleTableSlot *localslot;		/* conflicting local tuple */
+	TupleTableSlot *applyslot;		/* tuple being checked or indexed */
+	HeapTuple		tuples[MAX_BUFFERED_TUPLES];
+	int				ntuples;
+	Size			nbytes;
+} ApplyInsertBuffer;
+
+static ApplyInsertBuffer *InsertBuffer = NULL;
+
+static void handle_queued_message(QueuedMessage *queued_message,
+								  bool tx_just_started);
 static void handle_startup_param(const char *key, const char *value);
 static bool parse_bool_param(const char *key, const char *value);
 static void process_syncing_tables(XLogRecPtr end_lsn);
@@ -391,6 +415,49 @@ physatt_in_attmap(PGLogicalRelation *rel, int attid)
 	return false;
 }
 
+/*
+ * Write out the buffered inserts and release the buffer.
+ *
+ * Must be called before anything else touches the database in the remote
+ * transaction, so that it sees the buffered rows.
+ */
+static void
+flush_insert_buffer(void)
+{
+	ApplyInsertBuffer  *buffer = InsertBuffer;
+	EState			   *estate;
+	int					i;
+
+	if (buffer == NULL)
+		return;
+
+	estate = buffer->estate;
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	heap_multi_insert(buffer->rel, buffer->tuples, buffer->ntuples,
+					  GetCurrentCommandId(true), 0, NULL);
+
+	for (i = 0; i < buffer->ntuples; i++)
+	{
+		ExecStoreTuple(buffer->tuples[i], buffer->applyslot, InvalidBuffer,
+					   false);
+		UserTableUpdateOpenIndexes(estate, buffer->applyslot);
+	}
+
+	PopActiveSnapshot();
+
+	ExecCloseIndices(estate->es_result_relation_info);
+	ExecResetTupleTable(estate->es_tupleTable, true);
+	FreeExecutorState(estate);
+	heap_close(buffer->rel, NoLock);
+
+	InsertBuffer = NULL;
+	MemoryContextDelete(buffer->context);
+
+	CommandCounterIncrement();
+}
+
 /*
  * Executes default values for columns for which we didn't get any data.
  *
@@ -447,6 +514,96 @@ fill_tuple_defaults(PGLogicalRelation *rel, ExprContext *econtext,
 												NULL);
 }
 
+/*
+ * Add the remote tuple to the insert buffer, starting a new buffer if the
+ * current one is for a different table.
+ *
+ * Conflicts are still looked up row by row against the existing data. If the
+ * new tuple conflicts with a local one, the buffer is flushed and false is
+ * returned so that the caller applies the tuple through the normal path which
+ * resolves the conflict.
+ */
+static bool
+buffer_insert(PGLogicalRelation *rel, PGLogicalTupleData *newtup)
+{
+	ApplyInsertBuffer  *buffer;
+	EState			   *estate;
+	HeapTuple			remotetuple;
+	MemoryContext		oldcontext;
+	Oid					conflicts;
+
+	if (InsertBuffer != NULL &&
+		RelationGetRelid(InsertBuffer->rel) != RelationGetRelid(rel->rel))
+		flush_insert_buffer();
+
+	if (InsertBuffer == NULL)
+	{
+		MemoryContext	context;
+
+		context = AllocSetContextCreate(TopTransactionContext,
+										"pglogical insert buffer",
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE);
+		oldcontext = MemoryContextSwitchTo(context);
+
+		buffer = palloc0(sizeof(ApplyInsertBuffer));
+		buffer->context = context;
+		buffer->rel = heap_open(RelationGetRelid(rel->rel), NoLock);
+		buffer->estate = create_estate_for_relation(buffer->rel);
+		buffer->localslot = ExecInitExtraTupleSlot(buffer->estate);
+		buffer->applyslot = ExecInitExtraTupleSlot(buffer->estate);
+		ExecSetSlotDescriptor(buffer->localslot, RelationGetDescr(buffer->rel));
+		ExecSetSlotDescriptor(buffer->applyslot, RelationGetDescr(buffer->rel));
+		ExecOpenIndices(buffer->estate->es_result_relation_info, false);
+
+		MemoryContextSwitchTo(oldcontext);
+		InsertBuffer = buffer;
+	}
+
+	buffer = InsertBuffer;
+	estate = buffer->estate;
+
+	ResetPerTupleExprContext(estate);
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	fill_tuple_defaults(rel, GetPerTupleExprContext(estate), newtup);
+
+	conflicts = pglogical_tuple_find_conflict(estate, newtup,
+											  buffer->localslot);
+	if (OidIsValid(conflicts))
+	{
+		MemoryContextSwitchTo(oldcontext);
+		PopActiveSnapshot();
+		flush_insert_buffer();
+		return false;
+	}
+
+	MemoryContextSwitchTo(buffer->context);
+	remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
+								  newtup->values, newtup->nulls);
+	MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+	/* Check the constraints of the tuple */
+	ExecStoreTuple(remotetuple, buffer->applyslot, InvalidBuffer, false);
+	if (rel->rel->rd_att->constr)
+		ExecConstraints(estate->es_result_relation_info, buffer->applyslot,
+						estate);
+
+	MemoryContextSwitchTo(oldcontext);
+	PopActiveSnapshot();
+
+	buffer->tuples[buffer->ntuples++] = remotetuple;
+	buffer->nbytes += remotetuple->t_len;
+
+	if (buffer->ntuples >= MAX_BUFFERED_TUPLES ||
+		buffer->nbytes >= MAX_BUFFERED_BYTES)
+		flush_insert_buffer();
+
+	return true;
+}
+
 static void
 handle_insert(StringInfo s)
 {
@@ -461,7 +618,8 @@ handle_insert(StringInfo s)
 	HeapTuple			applytuple;
 	MemoryContext		oldcontext = CurrentMemoryContext;
 	PGLogicalConflictResolution resolution;
-	bool				started_tx = ensure_transaction();
+
+	ensure_transaction();
 
 	rel = pglogical_read_insert(s, RowExclusiveLock, &newtup);
 
@@ -472,6 +630,18 @@ handle_insert(StringInfo s)
 		return;
 	}
 
+	/* Buffer the tuple if we can. */
+	if (pglogical_batch_inserts)
+	{
+		if (buffer_insert(rel, &newtup))
+		{
+			pglogical_relation_close(rel, NoLock);
+			return;
+		}
+	}
+	else
+		flush_insert_buffer();
+
 	/* Initialize the executor state. */
 	estate = create_estate_for_relation(rel->rel);
 	econtext = GetPerTupleExprContext(estate);
@@ -536,44 +706,9 @@ handle_insert(StringInfo s)
 
 	PopActiveSnapshot();
 
-	/* if INSERT was into our queue, process the message. */
-	if (RelationGetRelid(rel->rel) == QueueRelid)
-	{
-		HeapTuple		ht;
-		LockRelId		lockid = rel->rel->rd_lockInfo.lockRelId;
-		TransactionId	oldxid = GetTopTransactionId();
-		Relation		qrel;
-
-		/*
-		 * Release transaction bound resources for CONCURRENTLY support.
-		 */
-		MemoryContextSwitchTo(MessageContext);
-		ht = heap_copytuple(applyslot->tts_tuple);
-
-		LockRelationIdForSession(&lockid, RowExclusiveLock);
-		pglogical_relation_close(rel, NoLock);
-
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
-
-		handle_queued_message(ht, started_tx);
-
-		qrel = heap_open(QueueRelid, RowExclusiveLock);
-
-		UnlockRelationIdForSession(&lockid, RowExclusiveLock);
-
-		heap_close(qrel, NoLock);
-
-		if (oldxid != GetTopTransactionId())
-			CommitTransactionCommand();
-	}
-	else
-	{
-		/* Otherwise do normal cleanup. */
-		pglogical_relation_close(rel, NoLock);
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
-	}
+	pglogical_relation_close(rel, NoLock);
+	ExecResetTupleTable(estate->es_tupleTable, true);
+	FreeExecutorState(estate);
 
 	CommandCounterIncrement();
 }
@@ -875,92 +1010,18 @@ handle_startup_param(const char *key, const char *value)
 	 */
 }
 
-static RangeVar *
-parse_relation_message(Jsonb *message)
-{
-	JsonbIterator  *it;
-	JsonbValue		v;
-	int				r;
-	int				level = 0;
-	char		   *key = NULL;
-	char		  **parse_res = NULL;
-	char		   *nspname = NULL;
-	char		   *relname = NULL;
-
-	/* Parse and validate the json message. */
-	if (!JB_ROOT_IS_OBJECT(message))
-		elog(ERROR, "malformed message in queued message tuple: root is not object");
-
-	it = JsonbIteratorInit(&message->root);
-	while ((r = JsonbIteratorNext(&it, &v, false)) != WJB_DONE)
-	{
-		if (level == 0 && r != WJB_BEGIN_OBJECT)
-			elog(ERROR, "root element needs to be an object");
-		else if (level == 0 && r == WJB_BEGIN_OBJECT)
-		{
-			level++;
-		}
-		else if (level == 1 && r == WJB_KEY)
-		{
-			if (strncmp(v.val.string.val, "schema_name", v.val.string.len) == 0)
-				parse_res = &nspname;
-			else if (strncmp(v.val.string.val, "table_name", v.val.string.len) == 0)
-				parse_res = &relname;
-			else
-				elog(ERROR, "unexpected key: %s",
-					 pnstrdup(v.val.string.val, v.val.string.len));
-
-			key = v.val.string.val;
-		}
-		else if (level == 1 && r == WJB_VALUE)
-		{
-			if (!key)
-				elog(ERROR, "in wrong state when parsing key");
-
-			if (v.type != jbvString)
-				elog(ERROR, "unexpected type for key '%s': %u", key, v.type);
-
-			*parse_res = pnstrdup(v.val.string.val, v.val.string.len);
-		}
-		else if (level == 1 && r != WJB_END_OBJECT)
-		{
-			elog(ERROR, "unexpected content: %u at level %d", r, level);
-		}
-		else if (r == WJB_END_OBJECT)
-		{
-			level--;
-			parse_res = NULL;
-			key = NULL;
-		}
-		else
-			elog(ERROR, "unexpected content: %u at level %d", r, level);
-
-	}
-
-	/* Check if we got both schema and table names. */
-	if (!nspname)
-		elog(ERROR, "missing schema_name in relation message");
-
-	if (!relname)
-		elog(ERROR, "missing table_name in relation message");
-
-	return makeRangeVar(nspname, relname, -1);
-}
-
 /*
- * Handle TRUNCATE message comming via queue table.
+ * Handle queued TRUNCATE message.
  */
 static void
 handle_truncate(QueuedMessage *queued_message)
 {
-	RangeVar	   *rv;
-
 	/*
 	 * If table doesn't exist locally, it can't be subscribed.
 	 *
 	 * TODO: should we error here?
 	 */
-	rv = parse_relation_message(queued_message->message);
+	RangeVar	   *rv = queued_message->relation;
 
 	/* If in list of relations which are being synchronized, skip. */
 	if (check_syncing_relation(rv->schemaname, rv->relname))
@@ -970,18 +1031,16 @@ handle_truncate(QueuedMessage *queued_message)
 }
 
 /*
- * Handle TABLESYNC message comming via queue table.
+ * Handle queued TABLESYNC message.
  */
 static void
 handle_table_sync(QueuedMessage *queued_message)
 {
-	RangeVar	   *rv;
+	RangeVar	   *rv = queued_message->relation;
 	MemoryContext			oldcontext;
 	PGLogicalSyncStatus		*oldsync;
 	PGLogicalSyncStatus		newsync;
 
-	rv = parse_relation_message(queued_message->message);
-
 	oldsync = get_table_sync_status(MyApplyWorker->subid, rv->schemaname,
 									rv->relname, true);
 
@@ -1003,6 +1062,7 @@ handle_table_sync(QueuedMessage *queued_message)
 	newsync.nspname = rv->schemaname;
 	newsync.relname = rv->relname;
 	newsync.status = SYNC_STATUS_INIT;
+	newsync.fast_copy = false;
 	create_local_sync_status(&newsync);
 
 	/* Keep the lists persistent. */
@@ -1014,54 +1074,21 @@ handle_table_sync(QueuedMessage *queued_message)
 }
 
 /*
- * Handle SQL message comming via queue table.
+ * Handle queued SQL message.
  */
 static void
 handle_sql(QueuedMessage *queued_message, bool tx_just_started)
 {
-	JsonbIterator *it;
-	JsonbValue	v;
-	int			r;
-	char	   *sql;
-
-	/* Validate the json and extract the SQL string from it. */
-	if (!JB_ROOT_IS_SCALAR(queued_message->message))
-		elog(ERROR, "malformed message in queued message tuple: root is not scalar");
-
-	it = JsonbIteratorInit(&queued_message->message->root);
-	r = JsonbIteratorNext(&it, &v, false);
-	if (r != WJB_BEGIN_ARRAY)
-		elog(ERROR, "malformed message in queued message tuple, item type %d expected %d", r, WJB_BEGIN_ARRAY);
-
-	r = JsonbIteratorNext(&it, &v, false);
-	if (r != WJB_ELEM)
-		elog(ERROR, "malformed message in queued message tuple, item type %d expected %d", r, WJB_ELEM);
-
-	if (v.type != jbvString)
-		elog(ERROR, "malformed message in queued message tuple, expected value type %d got %d", jbvString, v.type);
-
-	sql = pnstrdup(v.val.string.val, v.val.string.len);
-
-	r = JsonbIteratorNext(&it, &v, false);
-	if (r != WJB_END_ARRAY)
-		elog(ERROR, "malformed message in queued message tuple, item type %d expected %d", r, WJB_END_ARRAY);
-
-	r = JsonbIteratorNext(&it, &v, false);
-	if (r != WJB_DONE)
-		elog(ERROR, "malformed message in queued message tuple, item type %d expected %d", r, WJB_DONE);
-
-	/* Run the extracted SQL. */
-	pglogical_execute_sql_command(sql, queued_message->role, tx_just_started);
+	pglogical_execute_sql_command(queued_message->sql, queued_message->role,
+								  tx_just_started);
 }
 
 /*
- * Handles messages comming from the queue.
+ * Handles commands queued by the upstream.
  */
 static void
-handle_queued_message(HeapTuple msgtup, bool tx_just_started)
+handle_queued_message(QueuedMessage *queued_message, bool tx_just_started)
 {
-	QueuedMessage  *queued_message = queued_message_from_tuple(msgtup);
-
 	switch (queued_message->message_type)
 	{
 		case QUEUE_COMMAND_TYPE_SQL:
@@ -1079,11 +1106,51 @@ handle_queued_message(HeapTuple msgtup, bool tx_just_started)
 	}
 }
 
+/*
+ * Handle generic logical decoding message, only commands queued by
+ * pglogical on the upstream are expected.
+ */
+static void
+handle_message(StringInfo s)
+{
+	XLogRecPtr		message_lsn;
+	bool			transactional;
+	const char	   *prefix;
+	Size			message_size;
+	const char	   *message;
+	bool			started_tx;
+	TransactionId	oldxid;
+	QueuedMessage  *queued_message;
+
+	message = pglogical_read_message(s, &message_lsn, &transactional,
+									 &prefix, &message_size);
+
+	if (!transactional || strcmp(prefix, PGLOGICAL_MESSAGE_PREFIX) != 0)
+		return;
+
+	started_tx = ensure_transaction();
+	oldxid = GetTopTransactionId();
+
+	queued_message = queued_message_from_logical_message(message,
+														 message_size);
+	handle_queued_message(queued_message, started_tx);
+
+	/* CONCURRENTLY commands commit the transaction and start a new one. */
+	if (oldxid != GetTopTransactionId())
+		CommitTransactionCommand();
+	else
+		CommandCounterIncrement();
+}
+
 static void
 replication_handler(StringInfo s)
 {
 	char action = pq_getmsgbyte(s);
 
+	/* Only consecutive inserts can be buffered. */
+	if (action != 'I')
+		flush_insert_buffer();
+
 	switch (action)
 	{
 		/* BEGIN */
@@ -1118,6 +1185,10 @@ replication_handler(StringInfo s)
 		case 'S':
 			handle_startup(s);
 			break;
+		/* GENERIC MESSAGE */
+		case 'M':
+			handle_message(s);
+			break;
 		default:
 			elog(ERROR, "unknown action of type %c", action);
 	}
@@ -1732,12 +1803,7 @@ pglogical_apply_main(Datum main_arg)
 	elog(DEBUG1, "conneting to provider %s, dsn %s",
 		 MySubscription->origin->name, MySubscription->origin_if->dsn);
 
-	/*
-	 * Cache the queue relation id.
-	 * TODO: invalidation
-	 */
 	StartTransactionCommand();
-	QueueRelid = get_queue_table_oid();
 
 	originid = replorigin_by_name(MySubscription->slot_name, false);
 	replorigin_session_setup(originid);
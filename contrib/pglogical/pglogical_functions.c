@@ -48,7 +48,6 @@
 #include "utils/catcache.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
-#include "utils/json.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
@@ -266,6 +265,7 @@ pglogical_create_subscription(PG_FUNCTION_ARGS)
 	bool					sync_structure = PG_GETARG_BOOL(3);
 	bool					sync_data = PG_GETARG_BOOL(4);
 	ArrayType			   *forward_origin_names = PG_GETARG_ARRAYTYPE_P(5);
+	bool					fast_copy = PG_GETARG_BOOL(6);
 	PGconn				   *conn;
 	PGLogicalSubscription	sub;
 	PGLogicalSyncStatus		sync;
@@ -335,6 +335,7 @@ pglogical_create_subscription(PG_FUNCTION_ARGS)
 	sync.nspname = NULL;
 	sync.relname = NULL;
 	sync.status = SYNC_STATUS_INIT;
+	sync.fast_copy = fast_copy;
 	create_local_sync_status(&sync);
 
 	pglogical_connections_changed();
@@ -619,6 +620,7 @@ pglogical_alter_subscription_synchronize(PG_FUNCTION_ARGS)
 			newsync.nspname = rv->schemaname;
 			newsync.relname = rv->relname;
 			newsync.status = SYNC_STATUS_INIT;
+			newsync.fast_copy = false;
 			create_local_sync_status(&newsync);
 
 			if (truncate)
@@ -646,6 +648,7 @@ pglogical_alter_subscription_resynchronize_table(PG_FUNCTION_ARGS)
 {
 	char				   *sub_name = NameStr(*PG_GETARG_NAME(0));
 	Oid						reloid = PG_GETARG_OID(1);
+	bool					fast_copy = PG_GETARG_BOOL(2);
 	PGLogicalSubscription  *sub = get_subscription_by_name(sub_name, false);
 	PGLogicalSyncStatus	   *oldsync;
 	PGLogicalWorker		   *apply;
@@ -668,6 +671,7 @@ pglogical_alter_subscription_resynchronize_table(PG_FUNCTION_ARGS)
 				 nspname, relname);
 
 		set_table_sync_status(sub->id, nspname, relname, SYNC_STATUS_INIT);
+		set_table_sync_fast_copy(sub->id, nspname, relname, fast_copy);
 	}
 	else
 	{
@@ -678,6 +682,7 @@ pglogical_alter_subscription_resynchronize_table(PG_FUNCTION_ARGS)
 		newsync.nspname = nspname;
 		newsync.relname = relname;
 		newsync.status = SYNC_STATUS_INIT;
+		newsync.fast_copy = fast_copy;
 		create_local_sync_status(&newsync);
 	}
 
@@ -1012,7 +1017,6 @@ pglogical_replication_set_add_table(PG_FUNCTION_ARGS)
 	PGLogicalLocalNode *node;
 	char			   *nspname;
 	char			   *relname;
-	StringInfoData		json;
 
 	node = get_local_node(true);
 	if (!node)
@@ -1035,17 +1039,9 @@ pglogical_replication_set_add_table(PG_FUNCTION_ARGS)
 		nspname = get_namespace_name(RelationGetNamespace(rel));
 		relname = RelationGetRelationName(rel);
 
-		/* It's easier to construct json manually than via Jsonb API... */
-		initStringInfo(&json);
-		appendStringInfo(&json, "{\"schema_name\": ");
-		escape_json(&json, nspname);
-		appendStringInfo(&json, ",\"table_name\": ");
-		escape_json(&json, relname);
-		appendStringInfo(&json, "}");
-
-		/* Queue the truncate for replication. */
-		queue_message(list_make1(repset->name), GetUserId(),
-					  QUEUE_COMMAND_TYPE_TABLESYNC, json.data);
+		/* Queue the synchronization for replication. */
+		queue_relation_message(list_make1(repset->name), GetUserId(),
+							   QUEUE_COMMAND_TYPE_TABLESYNC, nspname, relname);
 	}
 
 	/* Cleanup. */
@@ -1066,7 +1062,6 @@ pglogical_replication_set_add_all_tables(PG_FUNCTION_ARGS)
 	PGLogicalRepSet    *repset;
 	Relation			rel;
 	PGLogicalLocalNode *node;
-	StringInfoData		json;
 	ListCell		   *lc;
 
 	node = get_local_node(true);
@@ -1117,17 +1112,10 @@ pglogical_replication_set_add_all_tables(PG_FUNCTION_ARGS)
 
 			if (synchronize)
 			{
-				/* It's easier to construct json manually than via Jsonb API... */
-				initStringInfo(&json);
-				appendStringInfo(&json, "{\"schema_name\": ");
-				escape_json(&json, nspname);
-				appendStringInfo(&json, ",\"table_name\": ");
-				escape_json(&json, NameStr(reltup->relname));
-				appendStringInfo(&json, "}");
-
-				/* Queue the truncate for replication. */
-				queue_message(list_make1(repset->name), GetUserId(),
-							  QUEUE_COMMAND_TYPE_TABLESYNC, json.data);
+				/* Queue the synchronization for replication. */
+				queue_relation_message(list_make1(repset->name), GetUserId(),
+									   QUEUE_COMMAND_TYPE_TABLESYNC, nspname,
+									   NameStr(reltup->relname));
 			}
 		}
 
@@ -1179,7 +1167,6 @@ pglogical_replicate_ddl_command(PG_FUNCTION_ARGS)
 	text   *command = PG_GETARG_TEXT_PP(0);
 	char   *query = text_to_cstring(command);
 	int		save_nestlevel;
-	StringInfoData	cmd;
 
 	save_nestlevel = NewGUCNestLevel();
 
@@ -1188,18 +1175,13 @@ pglogical_replicate_ddl_command(PG_FUNCTION_ARGS)
 							 PGC_USERSET, PGC_S_SESSION,
 							 GUC_ACTION_SAVE, true, 0, false);
 
-	/* Convert the query to json string. */
-	initStringInfo(&cmd);
-	escape_json(&cmd, query);
-
 	/*
 	 * Queue the query for replication.
 	 *
 	 * Note, we keep "DDL" message type for the future when we have deparsing
 	 * support.
 	 */
-	queue_message(list_make1(DDL_SQL_REPSET_NAME), GetUserId(),
-				  QUEUE_COMMAND_TYPE_SQL, cmd.data);
+	queue_sql_message(list_make1(DDL_SQL_REPSET_NAME), GetUserId(), query);
 
 	/* Execute the query locally. */
 	pglogical_execute_sql_command(query, GetUserNameFromId(GetUserId(), false), false);
@@ -1230,7 +1212,6 @@ pglogical_queue_truncate(PG_FUNCTION_ARGS)
 	List		   *repsets;
 	List		   *repset_names;
 	ListCell	   *lc;
-	StringInfoData	json;
 	PGLogicalLocalNode *local_node;
 
 	/* Return if this function was called from apply process. */
@@ -1260,14 +1241,6 @@ pglogical_queue_truncate(PG_FUNCTION_ARGS)
 	nspname = get_namespace_name(RelationGetNamespace(trigdata->tg_relation));
 	relname = RelationGetRelationName(trigdata->tg_relation);
 
-	/* It's easier to construct json manually than via Jsonb API... */
-	initStringInfo(&json);
-	appendStringInfo(&json, "{\"schema_name\": ");
-	escape_json(&json, nspname);
-	appendStringInfo(&json, ",\"table_name\": ");
-	escape_json(&json, relname);
-	appendStringInfo(&json, "}");
-
 	repsets = get_relation_replication_sets(local_node->node->id,
 											RelationGetRelid(trigdata->tg_relation));
 
@@ -1279,8 +1252,8 @@ pglogical_queue_truncate(PG_FUNCTION_ARGS)
 	}
 
 	/* Queue the truncate for replication. */
-	queue_message(repset_names, GetUserId(), QUEUE_COMMAND_TYPE_TRUNCATE,
-				  json.data);
+	queue_relation_message(repset_names, GetUserId(),
+						   QUEUE_COMMAND_TYPE_TRUNCATE, nspname, relname);
 
 	PG_RETURN_VOID();
 }
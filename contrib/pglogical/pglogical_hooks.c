@@ -50,6 +50,7 @@ void pglogical_startup_hook(struct PGLogicalStartupHookArgs *startup_args);
 void pglogical_shutdown_hook(struct PGLogicalShutdownHookArgs *shutdown_args);
 bool pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args);
 bool pglogical_txn_filter_hook(struct PGLogicalTxnFilterArgs *txnfilter_args);
+bool pglogical_message_filter_hook(struct PGLogicalMessageFilterArgs *messagefilter_args);
 
 typedef struct PGLogicalHooksPrivate
 {
@@ -165,42 +166,6 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 			RelationGetNamespace(rowfilter_args->changed_rel) ==
 			get_namespace_oid(private->replicate_only_table->schemaname, true);
 	}
-	else if (RelationGetRelid(rowfilter_args->changed_rel) == get_queue_table_oid())
-	{
-		/* Special case - queue table */
-		if (rowfilter_args->change_type == REORDER_BUFFER_CHANGE_INSERT)
-		{
-			HeapTuple		tup = &rowfilter_args->change->data.tp.newtuple->tuple;
-			QueuedMessage  *q = queued_message_from_tuple(tup);
-			ListCell	   *qlc;
-
-			/*
-			 * No replication set means global message, those are always
-			 * replicated.
-			 */
-			if (q->replication_sets == NULL)
-				return true;
-
-			foreach (qlc, q->replication_sets)
-			{
-				char	   *queue_set = (char *) lfirst(qlc);
-				ListCell   *plc;
-
-				foreach (plc, private->replication_sets)
-				{
-					PGLogicalRepSet	   *rs = lfirst(plc);
-
-					/* TODO: this is somewhat ugly. */
-					if (strcmp(queue_set, rs->name) == 0 &&
-						(q->message_type != QUEUE_COMMAND_TYPE_TRUNCATE ||
-						 rs->replicate_truncate))
-						return true;
-				}
-			}
-		}
-
-		return false;
-	}
 	else if (RelationGetRelid(rowfilter_args->changed_rel) == get_replication_set_table_oid())
 	{
 		/*
@@ -259,6 +224,59 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 	return ret;
 }
 
+/*
+ * Decide if the command queued by queue_sql_message/queue_relation_message
+ * should be sent to this subscriber.
+ */
+bool
+pglogical_message_filter_hook(struct PGLogicalMessageFilterArgs *messagefilter_args)
+{
+	PGLogicalHooksPrivate *private = (PGLogicalHooksPrivate*)messagefilter_args->private_data;
+	QueuedMessage  *q;
+	ListCell	   *qlc;
+	bool			ret = false;
+
+	/* Catching up just one table, queued commands are not needed. */
+	if (private->replicate_only_table)
+		return false;
+
+	if (!messagefilter_args->transactional ||
+		strcmp(messagefilter_args->prefix, PGLOGICAL_MESSAGE_PREFIX) != 0)
+		return false;
+
+	q = queued_message_from_logical_message(messagefilter_args->message,
+											messagefilter_args->message_size);
+
+	/*
+	 * No replication set means global message, those are always
+	 * replicated.
+	 */
+	if (q->replication_sets == NULL)
+		ret = true;
+
+	foreach (qlc, q->replication_sets)
+	{
+		char	   *queue_set = (char *) lfirst(qlc);
+		ListCell   *plc;
+
+		foreach (plc, private->replication_sets)
+		{
+			PGLogicalRepSet	   *rs = lfirst(plc);
+
+			/* TODO: this is somewhat ugly. */
+			if (strcmp(queue_set, rs->name) == 0 &&
+				(q->message_type != QUEUE_COMMAND_TYPE_TRUNCATE ||
+				 rs->replicate_truncate))
+				ret = true;
+		}
+	}
+
+	/* Hook memory context lives as long as the decoding session. */
+	free_queued_message(q);
+
+	return ret;
+}
+
 bool
 pglogical_txn_filter_hook(struct PGLogicalTxnFilterArgs *txnfilter_args)
 {
@@ -296,6 +314,7 @@ pglogical_hooks_setup(PG_FUNCTION_ARGS)
 	hooks->shutdown_hook = NULL;
 	hooks->row_filter_hook = pglogical_row_filter_hook;
 	hooks->txn_filter_hook = pglogical_txn_filter_hook;
+	hooks->message_filter_hook = pglogical_message_filter_hook;
 
 	PG_RETURN_VOID();
 }
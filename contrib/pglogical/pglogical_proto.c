@@ -53,6 +53,8 @@
 
 static void pglogical_read_attrs(StringInfo in, char ***attrnames,
 								  int *nattrnames);
+static uint64 pglogical_read_varint(StringInfo in);
+static int	pglogical_read_length(StringInfo in, bool compact);
 static void pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 					  PGLogicalTupleData *tuple);
 
@@ -119,6 +121,38 @@ pglogical_read_origin(StringInfo in, XLogRecPtr *origin_lsn)
 	return pnstrdup(pq_getmsgbytes(in, len), len);
 }
 
+/*
+ * Read generic logical decoding MESSAGE from the output stream.
+ *
+ * Returns the content, which points into the input buffer.
+ */
+const char *
+pglogical_read_message(StringInfo in, XLogRecPtr *message_lsn,
+					   bool *transactional, const char **prefix,
+					   Size *message_size)
+{
+	uint8	flags;
+	uint8	len;
+
+	/* read the flags */
+	flags = pq_getmsgbyte(in);
+	Assert((flags & ~PGLOGICAL_MESSAGE_TRANSACTIONAL) == 0);
+	*transactional = (flags & PGLOGICAL_MESSAGE_TRANSACTIONAL) != 0;
+
+	/* fixed fields */
+	*message_lsn = pq_getmsgint64(in);
+
+	/* prefix, sent with its terminating zero */
+	len = pq_getmsgbyte(in);
+	*prefix = pq_getmsgbytes(in, len);
+	if (len == 0 || (*prefix)[len - 1] != '\0')
+		elog(ERROR, "invalid prefix of logical decoding message");
+
+	/* content */
+	*message_size = pq_getmsgint(in, 4);
+	return pq_getmsgbytes(in, *message_size);
+}
+
 
 /*
  * Read INSERT from stream.
@@ -246,19 +280,28 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 	int			i;
 	int			natts;
 	char		action;
+	bool		compact;
+	const char *nullbits = NULL;
 	TupleDesc	desc;
 
 	action = pq_getmsgbyte(in);
-	if (action != 'T')
+	if (action != 'T' && action != 'C')
 		elog(ERROR, "expected TUPLE, got %c", action);
+	compact = (action == 'C');
 
 	memset(tuple->nulls, 1, sizeof(tuple->nulls));
 	memset(tuple->changed, 0, sizeof(tuple->changed));
 
-	natts = pq_getmsgint(in, 2);
+	if (compact)
+		natts = (int) pglogical_read_varint(in);
+	else
+		natts = pq_getmsgint(in, 2);
 	if (rel->natts != natts)
 		elog(ERROR, "tuple natts mismatch, %u vs %u", rel->natts, natts);
 
+	if (compact)
+		nullbits = pq_getmsgbytes(in, (natts + 7) / 8);
+
 	desc = RelationGetDescr(rel->rel);
 
 	/* Read the data */
@@ -266,10 +309,16 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 	{
 		int			attid = rel->attmap[i];
 		Form_pg_attribute att = desc->attrs[attid];
-		char		kind = pq_getmsgbyte(in);
+		char		kind;
 		const char *data;
 		int			len;
 
+		/* nulls of compact tuples come from the bitmap */
+		if (compact && (nullbits[i / 8] & (1 << (i % 8))))
+			kind = 'n';
+		else
+			kind = pq_getmsgbyte(in);
+
 		switch (kind)
 		{
 			case 'n': /* null */
@@ -284,7 +333,7 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 				tuple->nulls[attid] = false;
 				tuple->changed[attid] = true;
 
-				len = pq_getmsgint(in, 4); /* read length */
+				len = pglogical_read_length(in, compact);
 				data = pq_getmsgbytes(in, len);
 
 				/* and data */
@@ -292,6 +341,57 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 					tuple->values[attid] = fetch_att(data, true, len);
 				else
 					tuple->values[attid] = PointerGetDatum(data);
+
+				/* remember integer values, the next ones may be deltas */
+				if (compact && (len == 2 || len == 4 || len == 8))
+				{
+					int16		v16;
+					int32		v32;
+					int64		v64;
+
+					if (len == 2)
+					{
+						memcpy(&v16, data, len);
+						rel->prevvalues[i] = v16;
+					}
+					else if (len == 4)
+					{
+						memcpy(&v32, data, len);
+						rel->prevvalues[i] = v32;
+					}
+					else
+					{
+						memcpy(&v64, data, len);
+						rel->prevvalues[i] = v64;
+					}
+					rel->prevlens[i] = len;
+				}
+				break;
+			case 'd': /* delta from the previous value of the column */
+				{
+					uint64		zigzag;
+					uint64		delta;
+					int64		value;
+
+					if (!compact || rel->prevlens[i] == 0)
+						elog(ERROR, "delta for column \"%s\" without previous value",
+							 rel->attnames[i]);
+
+					tuple->nulls[attid] = false;
+					tuple->changed[attid] = true;
+
+					zigzag = pglogical_read_varint(in);
+					delta = (zigzag >> 1) ^ (uint64) -((int64) (zigzag & 1));
+					value = (int64) ((uint64) rel->prevvalues[i] + delta);
+					rel->prevvalues[i] = value;
+
+					if (rel->prevlens[i] == 2)
+						tuple->values[attid] = Int16GetDatum((int16) value);
+					else if (rel->prevlens[i] == 4)
+						tuple->values[attid] = Int32GetDatum((int32) value);
+					else
+						tuple->values[attid] = Int64GetDatum(value);
+				}
 				break;
 			case 'b': /* binary send/recv format */
 				{
@@ -302,7 +402,7 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 					tuple->nulls[attid] = false;
 					tuple->changed[attid] = true;
 
-					len = pq_getmsgint(in, 4); /* read length */
+					len = pglogical_read_length(in, compact);
 
 					getTypeBinaryInputInfo(att->atttypid,
 										   &typreceive, &typioparam);
@@ -329,7 +429,7 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 					tuple->nulls[attid] = false;
 					tuple->changed[attid] = true;
 
-					len = pq_getmsgint(in, 4); /* read length */
+					len = pglogical_read_length(in, compact);
 
 					getTypeInputInfo(att->atttypid, &typinput, &typioparam);
 					/* and data */
@@ -344,6 +444,47 @@ pglogical_read_tuple(StringInfo in, PGLogicalRelation *rel,
 	}
 }
 
+/*
+ * Read an unsigned integer in the variable length format of compact tuples.
+ */
+static uint64
+pglogical_read_varint(StringInfo in)
+{
+	uint64		val = 0;
+	int			shift = 0;
+	int			b;
+
+	do
+	{
+		if (shift > 63)
+			elog(ERROR, "invalid variable length integer in tuple");
+
+		b = pq_getmsgbyte(in);
+		val |= (uint64) (b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return val;
+}
+
+/*
+ * Read the length of a column value.
+ */
+static int
+pglogical_read_length(StringInfo in, bool compact)
+{
+	uint64		len;
+
+	if (!compact)
+		return pq_getmsgint(in, 4);
+
+	len = pglogical_read_varint(in);
+	if (len > (uint64) (in->len - in->cursor))
+		elog(ERROR, "invalid column length " UINT64_FORMAT " in tuple", len);
+
+	return (int) len;
+}
+
 /*
  * Read schema.relation from stream and return as PGLogicalRelation opened in
  * lockmode.
@@ -31,12 +31,17 @@ typedef struct PGLogicalTupleData
 
 #define PGLOGICAL_XACT_EVENT(flags)	(flags & 0x03)
 
+#define PGLOGICAL_MESSAGE_TRANSACTIONAL	0x01
+
 extern void pglogical_read_begin(StringInfo in, XLogRecPtr *remote_lsn,
 					  TimestampTz *committime, TransactionId *remote_xid);
 extern void pglogical_read_commit(StringInfo in, XLogRecPtr *commit_lsn,
 					   XLogRecPtr *end_lsn, TimestampTz *committime,
 					   uint8 *flags, const char **gid);
 extern char *pglogical_read_origin(StringInfo in, XLogRecPtr *origin_lsn);
+extern const char *pglogical_read_message(StringInfo in, XLogRecPtr *message_lsn,
+					   bool *transactional, const char **prefix,
+					   Size *message_size);
 
 extern uint32 pglogical_read_rel(StringInfo in);
 
@@ -13,169 +13,201 @@
 
 #include "postgres.h"
 
-#include "access/genam.h"
-#include "access/hash.h"
-#include "access/heapam.h"
-#include "access/htup_details.h"
 #include "access/xact.h"
 
-#include "catalog/indexing.h"
-#include "catalog/namespace.h"
 #include "catalog/objectaddress.h"
 #include "catalog/pg_trigger.h"
-#include "catalog/pg_type.h"
 
 #include "commands/trigger.h"
 
+#include "libpq/pqformat.h"
+
 #include "miscadmin.h"
 
 #include "nodes/makefuncs.h"
 
-#include "utils/array.h"
-#include "utils/builtins.h"
-#include "utils/fmgroids.h"
-#include "utils/json.h"
-#include "utils/jsonb.h"
-#include "utils/lsyscache.h"
-#include "utils/rel.h"
+#include "replication/message.h"
+
 #include "utils/timestamp.h"
 
 #include "pglogical_queue.h"
 #include "pglogical.h"
 
-#define CATALOG_QUEUE	"queue"
+/*
+ * Commands are carried as transactional logical decoding messages with
+ * PGLOGICAL_MESSAGE_PREFIX, so they are decoded at the same point of the
+ * transaction as they were queued, without a table that would have to be
+ * vacuumed. The content is:
+ *
+ *   message type (char)
+ *   queued at (timestamp)
+ *   role (string)
+ *   number of replication sets (int32, -1 for global message)
+ *   replication set names (strings)
+ *   SQL command (string) or schema and table name (strings)
+ *
+ * Strings are sent as int32 length followed by the bytes, in the server
+ * encoding.
+ */
+
+static void
+queue_send_string(StringInfo out, const char *str)
+{
+	int		len = strlen(str);
 
-#define Natts_queue					5
-#define Anum_queue_queued_at		1
-#define Anum_queue_role				2
-#define Anum_queue_replication_sets	3
-#define Anum_queue_message_type		4
-#define Anum_queue_message			5
+	pq_sendint(out, len, 4);
+	pq_sendbytes(out, str, len);
+}
 
-typedef struct QueueTuple
+static char *
+queue_get_string(StringInfo in)
 {
-	TimestampTz	queued_at;
-	NameData	replication_set;
-	NameData	role;
-	char		message_type;
-/*	json		message;*/
-} QueueTuple;
+	int		len = pq_getmsgint(in, 4);
+
+	if (len < 0 || len > in->len - in->cursor)
+		elog(ERROR, "malformed queued message: invalid string length %d", len);
+
+	return pnstrdup(pq_getmsgbytes(in, len), len);
+}
 
 /*
- * Add tuple to the queue table.
+ * Serialize the common part of the message.
  */
-void
-queue_message(List *replication_sets, Oid roleoid, char message_type,
-			  char *message)
+static void
+queue_message_header(StringInfo out, List *replication_sets, Oid roleoid,
+					 char message_type)
 {
-	RangeVar   *rv;
-	Relation	rel;
-	TupleDesc	tupDesc;
-	HeapTuple	tup;
-	Datum		values[Natts_queue];
-	bool		nulls[Natts_queue];
-	const char *role;
-	TimestampTz ts = GetCurrentTimestamp();
-
-	role =  GetUserNameFromId(roleoid, false);
-
-	rv = makeRangeVar(EXTENSION_NAME, CATALOG_QUEUE, -1);
-	rel = heap_openrv(rv, RowExclusiveLock);
-	tupDesc = RelationGetDescr(rel);
-
-	/* Form a tuple. */
-	memset(nulls, false, sizeof(nulls));
-
-	values[Anum_queue_queued_at - 1] = TimestampTzGetDatum(ts);
-	values[Anum_queue_role - 1] =
-		DirectFunctionCall1(namein, CStringGetDatum(role));
+	TimestampTz	ts = GetCurrentTimestamp();
+	ListCell   *lc;
+
+	pq_sendbyte(out, message_type);
+#ifdef HAVE_INT64_TIMESTAMP
+	pq_sendint64(out, ts);
+#else
+	pq_sendfloat8(out, ts);
+#endif
+	queue_send_string(out, GetUserNameFromId(roleoid, false));
+
 	if (replication_sets)
-		values[Anum_queue_replication_sets - 1] =
-			PointerGetDatum(strlist_to_textarray(replication_sets));
+	{
+		pq_sendint(out, list_length(replication_sets), 4);
+		foreach (lc, replication_sets)
+			queue_send_string(out, (char *) lfirst(lc));
+	}
 	else
-		nulls[Anum_queue_replication_sets - 1] = true;
-	values[Anum_queue_message_type - 1] = CharGetDatum(message_type);
-	values[Anum_queue_message - 1] =
-		DirectFunctionCall1(json_in, CStringGetDatum(message));
+		pq_sendint(out, -1, 4);
+}
 
-	tup = heap_form_tuple(tupDesc, values, nulls);
+/*
+ * Queue SQL command for replication.
+ */
+void
+queue_sql_message(List *replication_sets, Oid roleoid, const char *sql)
+{
+	StringInfoData	msg;
 
-	/* Insert the tuple to the catalog. */
-	simple_heap_insert(rel, tup);
+	initStringInfo(&msg);
+	queue_message_header(&msg, replication_sets, roleoid,
+						 QUEUE_COMMAND_TYPE_SQL);
+	queue_send_string(&msg, sql);
 
-	/* Update the indexes. */
-	CatalogUpdateIndexes(rel, tup);
+	LogLogicalMessage(PGLOGICAL_MESSAGE_PREFIX, msg.data, msg.len, true);
 
-	/* Cleanup. */
-	heap_freetuple(tup);
-	heap_close(rel, RowExclusiveLock);
+	pfree(msg.data);
 }
 
-
 /*
- * Parse the tuple from the queue table into palloc'd QueuedMessage struct.
- *
- * The caller must have the queue table locked in at least AccessShare mode.
+ * Queue command affecting one relation (TRUNCATE or TABLESYNC) for
+ * replication.
  */
-QueuedMessage *
-queued_message_from_tuple(HeapTuple queue_tup)
+void
+queue_relation_message(List *replication_sets, Oid roleoid, char message_type,
+					   const char *nspname, const char *relname)
 {
-	RangeVar   *rv;
-	Relation	rel;
-	TupleDesc	tupDesc;
-	bool		isnull;
-	Datum		d;
-	QueuedMessage *res;
-
-	/* Open relation to get the tuple descriptor. */
-	rv = makeRangeVar(EXTENSION_NAME, CATALOG_QUEUE, -1);
-	rel = heap_openrv(rv, NoLock);
-	tupDesc = RelationGetDescr(rel);
-
-	res = (QueuedMessage *) palloc(sizeof(QueuedMessage));
-
-	d = fastgetattr(queue_tup, Anum_queue_queued_at, tupDesc, &isnull);
-	Assert(!isnull);
-	res->queued_at = DatumGetTimestampTz(d);
-
-	d = fastgetattr(queue_tup, Anum_queue_role, tupDesc, &isnull);
-	Assert(!isnull);
-	res->role = pstrdup(NameStr(*DatumGetName(d)));
-
-	d = fastgetattr(queue_tup, Anum_queue_replication_sets, tupDesc, &isnull);
-	if (!isnull)
-		res->replication_sets = textarray_to_list(DatumGetArrayTypeP(d));
-	else
-		res->replication_sets = NULL;
-
-	d = fastgetattr(queue_tup, Anum_queue_message_type, tupDesc, &isnull);
-	Assert(!isnull);
-	res->message_type = DatumGetChar(d);
+	StringInfoData	msg;
 
-	d = fastgetattr(queue_tup, Anum_queue_message, tupDesc, &isnull);
-	Assert(!isnull);
-	/* Parse the json inside the message into Jsonb object. */
-	res->message = DatumGetJsonb(
-		DirectFunctionCall1(jsonb_in, DirectFunctionCall1(json_out, d)));
+	initStringInfo(&msg);
+	queue_message_header(&msg, replication_sets, roleoid, message_type);
+	queue_send_string(&msg, nspname);
+	queue_send_string(&msg, relname);
 
-	/* Close the relation. */
-	heap_close(rel, NoLock);
+	LogLogicalMessage(PGLOGICAL_MESSAGE_PREFIX, msg.data, msg.len, true);
 
-	return res;
+	pfree(msg.data);
 }
 
 /*
- * Get (cached) oid of the queue table.
+ * Parse the content of the logical decoding message into palloc'd
+ * QueuedMessage struct.
  */
-Oid
-get_queue_table_oid(void)
+QueuedMessage *
+queued_message_from_logical_message(const char *message, Size size)
 {
-	static Oid	queuetableoid = InvalidOid;
+	StringInfoData	in;
+	QueuedMessage  *res;
+	int				nsets;
+	int				i;
+
+	in.data = (char *) message;
+	in.len = size;
+	in.maxlen = size;
+	in.cursor = 0;
+
+	res = (QueuedMessage *) palloc0(sizeof(QueuedMessage));
+
+	res->message_type = pq_getmsgbyte(&in);
+#ifdef HAVE_INT64_TIMESTAMP
+	res->queued_at = pq_getmsgint64(&in);
+#else
+	res->queued_at = pq_getmsgfloat8(&in);
+#endif
+	res->role = queue_get_string(&in);
+
+	nsets = pq_getmsgint(&in, 4);
+	for (i = 0; i < nsets; i++)
+		res->replication_sets = lappend(res->replication_sets,
+										queue_get_string(&in));
+
+	switch (res->message_type)
+	{
+		case QUEUE_COMMAND_TYPE_SQL:
+			res->sql = queue_get_string(&in);
+			break;
+		case QUEUE_COMMAND_TYPE_TRUNCATE:
+		case QUEUE_COMMAND_TYPE_TABLESYNC:
+			{
+				char   *nspname = queue_get_string(&in);
+				char   *relname = queue_get_string(&in);
+
+				res->relation = makeRangeVar(nspname, relname, -1);
+				break;
+			}
+		default:
+			elog(ERROR, "unknown message type '%c'", res->message_type);
+	}
+
+	pq_getmsgend(&in);
 
-	if (queuetableoid == InvalidOid)
-		queuetableoid = get_pglogical_table_oid(CATALOG_QUEUE);
+	return res;
+}
 
-	return queuetableoid;
+/*
+ * Free QueuedMessage returned by queued_message_from_logical_message.
+ */
+void
+free_queued_message(QueuedMessage *queued_message)
+{
+	list_free_deep(queued_message->replication_sets);
+	pfree(queued_message->role);
+	if (queued_message->sql)
+		pfree(queued_message->sql);
+	if (queued_message->relation)
+	{
+		pfree(queued_message->relation->schemaname);
+		pfree(queued_message->relation->relname);
+		pfree(queued_message->relation);
+	}
+	pfree(queued_message);
 }
 
 
@@ -13,7 +13,11 @@
 #ifndef PGLOGICAL_QUEUE_H
 #define PGLOGICAL_QUEUE_H
 
-#include "utils/jsonb.h"
+#include "nodes/primnodes.h"
+#include "utils/timestamp.h"
+
+/* Prefix of the logical decoding messages carrying queued commands */
+#define PGLOGICAL_MESSAGE_PREFIX		"pglogical"
 
 #define QUEUE_COMMAND_TYPE_SQL			'Q'
 #define QUEUE_COMMAND_TYPE_TRUNCATE		'T'
@@ -25,15 +29,19 @@ typedef struct QueuedMessage
 	List	   *replication_sets;
 	char	   *role;
 	char		message_type;
-	Jsonb	   *message;
+	char	   *sql;			/* QUEUE_COMMAND_TYPE_SQL */
+	RangeVar   *relation;		/* QUEUE_COMMAND_TYPE_TRUNCATE and TABLESYNC */
 } QueuedMessage;
 
-extern void queue_message(List *replication_sets, Oid roleoid,
-						  char message_type, char *message);
-
-extern QueuedMessage *queued_message_from_tuple(HeapTuple queue_tup);
+extern void queue_sql_message(List *replication_sets, Oid roleoid,
+							  const char *sql);
+extern void queue_relation_message(List *replication_sets, Oid roleoid,
+								   char message_type, const char *nspname,
+								   const char *relname);
 
-extern Oid get_queue_table_oid(void);
+extern QueuedMessage *queued_message_from_logical_message(const char *message,
+														  Size size);
+extern void free_queued_message(QueuedMessage *queued_message);
 
 extern void create_truncate_trigger(char *schemaname, char *relname);
 
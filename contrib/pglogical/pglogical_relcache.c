@@ -47,6 +47,10 @@ relcache_free_entry(PGLogicalRelation *entry)
 
 	if (entry->attmap)
 		pfree(entry->attmap);
+	if (entry->prevvalues)
+		pfree(entry->prevvalues);
+	if (entry->prevlens)
+		pfree(entry->prevlens);
 
 	entry->natts = 0;
 	entry->reloid = InvalidOid;
@@ -123,6 +127,8 @@ pglogical_relation_cache_update(uint32 remoteid, char *schemaname,
 	for (i = 0; i < natts; i++)
 		entry->attnames[i] = pstrdup(attnames[i]);
 	entry->attmap = palloc(natts * sizeof(int));
+	entry->prevvalues = palloc0(natts * sizeof(int64));
+	entry->prevlens = palloc0(natts * sizeof(uint8));
 	MemoryContextSwitchTo(oldcontext);
 
 	/* XXX Should we validate the relation against local schema here? */
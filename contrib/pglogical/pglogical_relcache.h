@@ -22,6 +22,10 @@ typedef struct PGLogicalRelation
 	int			natts;
 	char	  **attnames;
 
+	/* Last integer values of the columns, for delta decoding. */
+	int64	   *prevvalues;
+	uint8	   *prevlens;		/* 0 if no previous value */
+
 	/* Mapping to local relation, filled as needed. */
 	Oid			reloid;
 	Relation	rel;
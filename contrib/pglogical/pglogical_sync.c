@@ -13,6 +13,7 @@
 
 #include "postgres.h"
 
+#include <poll.h>
 #include <unistd.h>
 
 #include "libpq-fe.h"
@@ -28,6 +29,7 @@
 
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_type.h"
 
 #include "commands/dbcommands.h"
 #include "commands/tablecmds.h"
@@ -62,12 +64,13 @@
 #define PGDUMP_BINARY "pg_dump"
 #define PGRESTORE_BINARY "pg_restore"
 
-#define Natts_local_sync_state	5
+#define Natts_local_sync_state	6
 #define Anum_sync_kind			1
 #define Anum_sync_subid			2
 #define Anum_sync_nspname		3
 #define Anum_sync_relname		4
 #define Anum_sync_status		5
+#define Anum_sync_fast_copy		6
 
 
 void pglogical_sync_main(Datum main_arg);
@@ -268,85 +271,361 @@ finish_copy_target_tx(PGconn *conn)
 
 
 /*
- * COPY single table over wire.
+ * State of one of the table copies running in parallel: a pair of origin and
+ * target connections, each inside its own copy transaction, and the table
+ * currently being copied over them.
+ */
+typedef struct CopyJob
+{
+	PGconn	   *origin_conn;
+	PGconn	   *target_conn;
+	RangeVar   *table;			/* table being copied, NULL if idle */
+	bool		fast_copy;		/* use binary COPY and defer indexes */
+	List	   *index_defs;		/* commands recreating the dropped indexes */
+} CopyJob;
+
+/*
+ * Drop the indexes of the target table which can be rebuilt after the copy
+ * and return the commands recreating them.
+ *
+ * Building an index in one go is much cheaper than inserting every copied
+ * row into it. Indexes backing constraints, the replica identity index and
+ * the clustered index stay in place as they can't be recreated by plain
+ * CREATE INDEX. Indexes outside of the default tablespace are kept as well.
+ *
+ * All of this happens in the copy transaction, so the indexes are never
+ * missing for other sessions.
+ */
+static List *
+defer_table_indexes(PGconn *conn, const char *tablename)
+{
+	PGresult   *res;
+	List	   *index_defs = NIL;
+	int			i;
+	const char *values[1];
+	Oid			types[1] = { TEXTOID };
+	const char *query =
+		"SELECT pg_catalog.pg_get_indexdef(i.indexrelid),"
+		"       pg_catalog.quote_ident(n.nspname) || '.' ||"
+		"       pg_catalog.quote_ident(c.relname),"
+		"       pg_catalog.obj_description(i.indexrelid, 'pg_class')"
+		"  FROM pg_catalog.pg_index i"
+		"  JOIN pg_catalog.pg_class c ON c.oid = i.indexrelid"
+		"  JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace"
+		" WHERE i.indrelid = $1::pg_catalog.regclass"
+		"   AND i.indisvalid"
+		"   AND NOT i.indisreplident"
+		"   AND NOT i.indisclustered"
+		"   AND c.reltablespace = 0"
+		"   AND NOT EXISTS (SELECT 1 FROM pg_catalog.pg_constraint con"
+		"                    WHERE con.conindid = i.indexrelid)";
+
+	values[0] = tablename;
+	res = PQexecParams(conn, query, 1, types, values, NULL, NULL, 0);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		elog(ERROR, "could not fetch indexes of table %s: %s",
+			 tablename, PQresultErrorMessage(res));
+
+	for (i = 0; i < PQntuples(res); i++)
+	{
+		char	   *indexname = PQgetvalue(res, i, 1);
+		PGresult   *dropres;
+		StringInfoData	cmd;
+
+		index_defs = lappend(index_defs, pstrdup(PQgetvalue(res, i, 0)));
+
+		if (!PQgetisnull(res, i, 2))
+		{
+			char	   *comment = PQgetvalue(res, i, 2);
+			char	   *quoted = PQescapeLiteral(conn, comment,
+												  strlen(comment));
+
+			initStringInfo(&cmd);
+			appendStringInfo(&cmd, "COMMENT ON INDEX %s IS %s",
+							 indexname, quoted);
+			index_defs = lappend(index_defs, cmd.data);
+			PQfreemem(quoted);
+		}
+
+		initStringInfo(&cmd);
+		appendStringInfo(&cmd, "DROP INDEX %s", indexname);
+		dropres = PQexec(conn, cmd.data);
+		if (PQresultStatus(dropres) != PGRES_COMMAND_OK)
+			elog(ERROR, "could not drop index %s: %s",
+				 indexname, PQresultErrorMessage(dropres));
+		PQclear(dropres);
+		pfree(cmd.data);
+	}
+
+	PQclear(res);
+
+	return index_defs;
+}
+
+/*
+ * Recreate the indexes dropped by defer_table_indexes.
  */
 static void
-copy_table_data(PGconn *origin_conn, PGconn *target_conn,
-				const char *nspname, const char *relname)
+restore_table_indexes(PGconn *conn, List *index_defs)
+{
+	ListCell   *lc;
+
+	foreach (lc, index_defs)
+	{
+		const char *cmd = lfirst(lc);
+		PGresult   *res;
+
+		res = PQexec(conn, cmd);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			elog(ERROR, "could not recreate index using '%s': %s",
+				 cmd, PQresultErrorMessage(res));
+		PQclear(res);
+	}
+}
+
+/*
+ * Start COPY of single table over wire.
+ */
+static void
+start_table_copy(CopyJob *job)
 {
 	PGresult   *res;
-	int			bytes;
-	char	   *copybuf;
+	const char *nspname = job->table->schemaname;
+	const char *relname = job->table->relname;
+	const char *options = job->fast_copy ? " (FORMAT binary)" : "";
 	StringInfoData	query;
 
 	/* Build COPY TO query. */
 	initStringInfo(&query);
-	appendStringInfo(&query, "COPY %s.%s TO stdout",
-					 PQescapeIdentifier(origin_conn, nspname,
+	appendStringInfo(&query, "COPY %s.%s TO stdout%s",
+					 PQescapeIdentifier(job->origin_conn, nspname,
 										strlen(nspname)),
-					 PQescapeIdentifier(origin_conn, relname,
-										strlen(relname)));
+					 PQescapeIdentifier(job->origin_conn, relname,
+										strlen(relname)),
+					 options);
 
 	/* Execute COPY TO. */
-	res = PQexec(origin_conn, query.data);
+	res = PQexec(job->origin_conn, query.data);
 	if (PQresultStatus(res) != PGRES_COPY_OUT)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
 				 errdetail("Query '%s': %s", query.data,
-					 PQerrorMessage(origin_conn))));
+					 PQerrorMessage(job->origin_conn))));
 	}
+	PQclear(res);
 
 	/* Build COPY FROM query. */
 	resetStringInfo(&query);
-	appendStringInfo(&query, "COPY %s.%s FROM stdin",
-					 PQescapeIdentifier(origin_conn, nspname,
+	appendStringInfo(&query, "%s.%s",
+					 PQescapeIdentifier(job->origin_conn, nspname,
 										strlen(nspname)),
-					 PQescapeIdentifier(origin_conn, relname,
+					 PQescapeIdentifier(job->origin_conn, relname,
 										strlen(relname)));
 
+	/* Get rid of the indexes we can build faster once the data is in. */
+	if (job->fast_copy)
+		job->index_defs = defer_table_indexes(job->target_conn, query.data);
+
+	resetStringInfo(&query);
+	appendStringInfo(&query, "COPY %s.%s FROM stdin%s",
+					 PQescapeIdentifier(job->origin_conn, nspname,
+										strlen(nspname)),
+					 PQescapeIdentifier(job->origin_conn, relname,
+										strlen(relname)),
+					 options);
+
 	/* Execute COPY FROM. */
-	res = PQexec(target_conn, query.data);
+	res = PQexec(job->target_conn, query.data);
 	if (PQresultStatus(res) != PGRES_COPY_IN)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
 				 errdetail("Query '%s': %s", query.data,
-					 PQerrorMessage(origin_conn))));
+					 PQerrorMessage(job->target_conn))));
+	}
+	PQclear(res);
+}
+
+/*
+ * Forward the COPY data already received from origin to target without
+ * waiting for more.
+ *
+ * Returns true when the whole table was copied.
+ */
+static bool
+pump_table_copy(CopyJob *job)
+{
+	PGresult   *res;
+	int			bytes;
+	char	   *copybuf;
+
+	if (PQconsumeInput(job->origin_conn) != 1)
+	{
+		ereport(ERROR,
+				(errmsg("reading from origin table failed"),
+				 errdetail("source connection reported: %s",
+					PQerrorMessage(job->origin_conn))));
 	}
 
-	while ((bytes = PQgetCopyData(origin_conn, &copybuf, false)) > 0)
+	while ((bytes = PQgetCopyData(job->origin_conn, &copybuf, true)) > 0)
 	{
-		if (PQputCopyData(target_conn, copybuf, bytes) != 1)
+		if (PQputCopyData(job->target_conn, copybuf, bytes) != 1)
 		{
 			ereport(ERROR,
 					(errmsg("writing to target table failed"),
 					 errdetail("destination connection reported: %s",
-						 PQerrorMessage(target_conn))));
+						 PQerrorMessage(job->target_conn))));
 		}
 		PQfreemem(copybuf);
-
-		CHECK_FOR_INTERRUPTS();
 	}
 
+	/* Wait for more data. */
+	if (bytes == 0)
+		return false;
+
 	if (bytes != -1)
 	{
 		ereport(ERROR,
 				(errmsg("reading from origin table failed"),
 				 errdetail("source connection returned %d: %s",
-					bytes, PQerrorMessage(origin_conn))));
+					bytes, PQerrorMessage(job->origin_conn))));
+	}
+
+	/* Check that COPY TO finished fine on origin. */
+	while ((res = PQgetResult(job->origin_conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			ereport(ERROR,
+					(errmsg("reading from origin table failed"),
+					 errdetail("source connection reported: %s",
+						PQresultErrorMessage(res))));
+		}
+		PQclear(res);
 	}
 
 	/* Send local finish */
-	if (PQputCopyEnd(target_conn, NULL) != 1)
+	if (PQputCopyEnd(job->target_conn, NULL) != 1)
 	{
 		ereport(ERROR,
 				(errmsg("sending copy-completion to destination connection failed"),
 				 errdetail("destination connection reported: %s",
-					 PQerrorMessage(target_conn))));
+					 PQerrorMessage(job->target_conn))));
 	}
 
-	PQclear(res);
+	/* And check that the rows made it into the target table. */
+	while ((res = PQgetResult(job->target_conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			ereport(ERROR,
+					(errmsg("writing to target table failed"),
+					 errdetail("destination connection reported: %s",
+						 PQresultErrorMessage(res))));
+		}
+		PQclear(res);
+	}
+
+	restore_table_indexes(job->target_conn, job->index_defs);
+	list_free_deep(job->index_defs);
+	job->index_defs = NIL;
+
+	return true;
+}
+
+/*
+ * Copy the tables using up to pglogical.sync_jobs connection pairs at once.
+ *
+ * The first pair is provided by the caller, who also finishes its
+ * transactions. The other pairs are opened here and import the same origin
+ * snapshot, so all tables are copied as of the same point in time.
+ */
+static void
+copy_tables_parallel(const char *origin_dsn, const char *target_dsn,
+					 const char *origin_snapshot, PGconn *origin_conn,
+					 PGconn *target_conn, List *tables, bool fast_copy)
+{
+	int			njobs = Max(1, Min(pglogical_sync_jobs, list_length(tables)));
+	CopyJob	   *jobs = palloc0(sizeof(CopyJob) * njobs);
+	struct pollfd *fds = palloc0(sizeof(struct pollfd) * njobs);
+	ListCell   *next_table = list_head(tables);
+	int			i;
+
+	jobs[0].origin_conn = origin_conn;
+	jobs[0].target_conn = target_conn;
+
+	for (i = 0; i < njobs; i++)
+		jobs[i].fast_copy = fast_copy;
+
+	for (i = 1; i < njobs; i++)
+	{
+		jobs[i].origin_conn = pglogical_connect(origin_dsn,
+												EXTENSION_NAME "_copy");
+		start_copy_origin_tx(jobs[i].origin_conn, origin_snapshot);
+
+		jobs[i].target_conn = pglogical_connect(target_dsn,
+												EXTENSION_NAME "_copy");
+		start_copy_target_tx(jobs[i].target_conn);
+	}
+
+	for (;;)
+	{
+		int		nfds = 0;
+		bool	finished_any = false;
+
+		/* Hand out the remaining tables to idle jobs. */
+		for (i = 0; i < njobs && next_table != NULL; i++)
+		{
+			if (jobs[i].table != NULL)
+				continue;
+
+			jobs[i].table = lfirst(next_table);
+			next_table = lnext(next_table);
+			start_table_copy(&jobs[i]);
+		}
+
+		/* Move data of all running copies. */
+		for (i = 0; i < njobs; i++)
+		{
+			if (jobs[i].table == NULL)
+				continue;
+
+			if (pump_table_copy(&jobs[i]))
+			{
+				jobs[i].table = NULL;
+				finished_any = true;
+				continue;
+			}
+
+			fds[nfds].fd = PQsocket(jobs[i].origin_conn);
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			nfds++;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (nfds == 0 && next_table == NULL)
+			break;
+
+		/* Don't wait while there are idle jobs and tables left to copy. */
+		if (finished_any)
+			continue;
+
+		if (poll(fds, nfds, 1000L) < 0 && errno != EINTR)
+			elog(ERROR, "poll() failed: %m");
+	}
+
+	/* Finish the transactions and disconnect the additional jobs. */
+	for (i = 1; i < njobs; i++)
+	{
+		finish_copy_origin_tx(jobs[i].origin_conn);
+		finish_copy_target_tx(jobs[i].target_conn);
+	}
+
+	pfree(fds);
+	pfree(jobs);
 }
 
 /*
@@ -356,11 +635,10 @@ copy_table_data(PGconn *origin_conn, PGconn *target_conn,
  */
 static void
 copy_tables_data(const char *origin_dsn, const char *target_dsn,
-				 const char *origin_snapshot, List *tables)
+				 const char *origin_snapshot, List *tables, bool fast_copy)
 {
 	PGconn	   *origin_conn;
 	PGconn	   *target_conn;
-	ListCell   *lc;
 
 	/* Connect to origin node. */
 	origin_conn = pglogical_connect(origin_dsn, EXTENSION_NAME "_copy");
@@ -371,15 +649,8 @@ copy_tables_data(const char *origin_dsn, const char *target_dsn,
 	start_copy_target_tx(target_conn);
 
 	/* Copy every table. */
-	foreach (lc, tables)
-	{
-		RangeVar	*rv = lfirst(lc);
-
-		copy_table_data(origin_conn, target_conn,
-						rv->schemaname, rv->relname);
-
-		CHECK_FOR_INTERRUPTS();
-	}
+	copy_tables_parallel(origin_dsn, target_dsn, origin_snapshot,
+						 origin_conn, target_conn, tables, fast_copy);
 
 	/* Finish the transactions and disconnect. */
 	finish_copy_origin_tx(origin_conn);
@@ -397,12 +668,12 @@ copy_tables_data(const char *origin_dsn, const char *target_dsn,
  */
 static List *
 copy_replication_sets_data(const char *origin_dsn, const char *target_dsn,
-						   const char *origin_snapshot, List *replication_sets)
+						   const char *origin_snapshot, List *replication_sets,
+						   bool fast_copy)
 {
 	PGconn	   *origin_conn;
 	PGconn	   *target_conn;
 	List	   *tables;
-	ListCell   *lc;
 
 	/* Connect to origin node. */
 	origin_conn = pglogical_connect(origin_dsn, EXTENSION_NAME "_copy");
@@ -417,15 +688,8 @@ copy_replication_sets_data(const char *origin_dsn, const char *target_dsn,
 	start_copy_target_tx(target_conn);
 
 	/* Copy every table. */
-	foreach (lc, tables)
-	{
-		RangeVar	*rv = lfirst(lc);
-
-		copy_table_data(origin_conn, target_conn,
-						rv->schemaname, rv->relname);
-
-		CHECK_FOR_INTERRUPTS();
-	}
+	copy_tables_parallel(origin_dsn, target_dsn, origin_snapshot,
+						 origin_conn, target_conn, tables, fast_copy);
 
 	/* Finish the transactions and disconnect. */
 	finish_copy_origin_tx(origin_conn);
@@ -580,7 +844,8 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 					tables = copy_replication_sets_data(sub->origin_if->dsn,
 														sub->target_if->dsn,
 														snapshot,
-														sub->replication_sets);
+														sub->replication_sets,
+														sync->fast_copy);
 
 					/* Store info about all the synchronized tables. */
 					StartTransactionCommand();
@@ -607,6 +872,7 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 							newsync.nspname = rv->schemaname;
 							newsync.relname = rv->relname;
 							newsync.status = SYNC_STATUS_READY;
+							newsync.fast_copy = sync->fast_copy;
 							create_local_sync_status(&newsync);
 						}
 					}
@@ -664,6 +930,7 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 	RepOriginId	originid;
 	char	   *snapshot;
 	PGLogicalSyncStatus	   *sync;
+	bool		fast_copy;
 
 	StartTransactionCommand();
 
@@ -686,6 +953,8 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 	if (sync->status != SYNC_STATUS_INIT)
 		set_table_sync_status(sub->id, table->schemaname, table->relname, SYNC_STATUS_INIT);
 
+	fast_copy = sync->fast_copy;
+
 	CommitTransactionCommand();
 
 	origin_conn_repl = pglogical_connect_replica(sub->origin_if->dsn,
@@ -708,7 +977,7 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 
 		/* Copy data. */
 		copy_tables_data(sub->origin_if->dsn,sub->target_if->dsn, snapshot,
-						 list_make1(table));
+						 list_make1(table), fast_copy);
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(pglogical_sync_worker_cleanup_cb,
 								PointerGetDatum(sub));
@@ -881,6 +1150,7 @@ create_local_sync_status(PGLogicalSyncStatus *sync)
 	else
 		nulls[Anum_sync_relname - 1] = true;
 	values[Anum_sync_status - 1] = CharGetDatum(sync->status);
+	values[Anum_sync_fast_copy - 1] = BoolGetDatum(sync->fast_copy);
 
 	tup = heap_form_tuple(tupDesc, values, nulls);
 
@@ -958,6 +1228,10 @@ syncstatus_fromtuple(HeapTuple tuple, TupleDesc desc)
 	Assert(!isnull);
 	sync->status = DatumGetChar(d);
 
+	d = fastgetattr(tuple, Anum_sync_fast_copy, desc, &isnull);
+	Assert(!isnull);
+	sync->fast_copy = DatumGetBool(d);
+
 	return sync;
 }
 
@@ -1194,10 +1468,10 @@ get_unsynced_tables(Oid subid)
 	return res;
 }
 
-/* Set the sync status for a table. */
-void
-set_table_sync_status(Oid subid, const char *nspname, const char *relname,
-					  char status)
+/* Replace single attribute of the sync status record of a table. */
+static void
+update_table_sync_status(Oid subid, const char *nspname, const char *relname,
+						 AttrNumber attnum, Datum value)
 {
 	RangeVar	   *rv;
 	Relation		rel;
@@ -1237,8 +1511,8 @@ set_table_sync_status(Oid subid, const char *nspname, const char *relname,
 	memset(nulls, false, sizeof(nulls));
 	memset(replaces, false, sizeof(replaces));
 
-	values[Anum_sync_status - 1] = CharGetDatum(status);
-	replaces[Anum_sync_status - 1] = true;
+	values[attnum - 1] = value;
+	replaces[attnum - 1] = true;
 
 	newtup = heap_modify_tuple(oldtup, tupDesc, values, nulls, replaces);
 
@@ -1254,6 +1528,24 @@ set_table_sync_status(Oid subid, const char *nspname, const char *relname,
 	heap_close(rel, RowExclusiveLock);
 }
 
+/* Set the sync status for a table. */
+void
+set_table_sync_status(Oid subid, const char *nspname, const char *relname,
+					  char status)
+{
+	update_table_sync_status(subid, nspname, relname, Anum_sync_status,
+							 CharGetDatum(status));
+}
+
+/* Set whether the table is copied in fast copy mode. */
+void
+set_table_sync_fast_copy(Oid subid, const char *nspname, const char *relname,
+						 bool fast_copy)
+{
+	update_table_sync_status(subid, nspname, relname, Anum_sync_fast_copy,
+							 BoolGetDatum(fast_copy));
+}
+
 /*
  * Wait until the table sync status has changed desired one.
  *
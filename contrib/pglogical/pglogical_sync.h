@@ -25,6 +25,7 @@ typedef struct PGLogicalSyncStatus
 	char   *nspname;
 	char   *relname;
 	char	status;
+	bool	fast_copy;		/* binary COPY, indexes built after the copy */
 } PGLogicalSyncStatus;
 
 #define SYNC_KIND_INIT		'i'
@@ -66,6 +67,8 @@ extern PGLogicalSyncStatus *get_table_sync_status(Oid subid,
 												  bool missing_ok);
 extern void set_table_sync_status(Oid subid, const char *schemaname,
 								  const char *relname, char status);
+extern void set_table_sync_fast_copy(Oid subid, const char *schemaname,
+									 const char *relname, bool fast_copy);
 extern List *get_unsynced_tables(Oid subid);
 
 extern bool wait_for_sync_status_change(Oid subid, char *nspname,
@@ -75,7 +75,8 @@ enum {
 	PARAM_PG_VERSION,
 	PARAM_HOOKS_SETUP_FUNCTION,
 	PARAM_NO_TXINFO,
-	PARAM_RELMETA_CACHE_SIZE
+	PARAM_RELMETA_CACHE_SIZE,
+	PARAM_COMPACT_TUPLES
 } OutputPluginParamKey;
 
 typedef struct {
@@ -103,6 +104,7 @@ static OutputPluginParam param_lookup[] = {
 	{"hooks.setup_function", PARAM_HOOKS_SETUP_FUNCTION},
 	{"no_txinfo", PARAM_NO_TXINFO},
 	{"relmeta_cache_size", PARAM_RELMETA_CACHE_SIZE},
+	{"compact_tuples", PARAM_COMPACT_TUPLES},
 	{NULL, PARAM_UNRECOGNISED}
 };
 
@@ -244,6 +246,11 @@ process_parameters_v1(List *options, PGLogicalOutputData *data)
 				data->client_relmeta_cache_size = DatumGetInt32(val);
 				break;
 
+			case PARAM_COMPACT_TUPLES:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_BOOL);
+				data->client_want_compact_tuples = DatumGetBool(val);
+				break;
+
 			case PARAM_UNRECOGNISED:
 				ereport(DEBUG1,
 						(errmsg("Unrecognised pglogical parameter %s ignored", elem->defname)));
@@ -456,6 +463,9 @@ prepare_startup_message(PGLogicalOutputData *data)
 	/* We don't support understand column types yet */
 	l = add_startup_msg_b(l, "coltypes", false);
 
+	/* Tuples are sent in compact format, see protocol docs */
+	l = add_startup_msg_b(l, "compact_tuples", data->compact_tuples);
+
 	/* Info about our Pg host */
 	l = add_startup_msg_i(l, "pg_version_num", PG_VERSION_NUM);
 	l = add_startup_msg_s(l, "pg_version", PG_VERSION);
@@ -508,6 +518,8 @@ prepare_startup_message(PGLogicalOutputData *data)
 			data->hooks.row_filter_hook != NULL);
 	l = add_startup_msg_b(l, "hooks.transaction_filter_enabled",
 			data->hooks.txn_filter_hook != NULL);
+	l = add_startup_msg_b(l, "hooks.message_filter_enabled",
+			data->hooks.message_filter_hook != NULL);
 
 	/* Cache control and other misc options */
 	l = add_startup_msg_i(l, "relmeta_cache_size",
@@ -101,12 +101,14 @@ load_hooks(PGLogicalOutputData *data)
 				"\tshutdown_hook: %p\n"
 				"\trow_filter_hook: %p\n"
 				"\ttxn_filter_hook: %p\n"
+				"\tmessage_filter_hook: %p\n"
 				"\thooks_private_data: %p\n",
 				hooks_func,
 				data->hooks.startup_hook,
 				data->hooks.shutdown_hook,
 				data->hooks.row_filter_hook,
 				data->hooks.txn_filter_hook,
+				data->hooks.message_filter_hook,
 				data->hooks.hooks_private_data);
 	}
 
@@ -233,3 +235,39 @@ call_txn_filter_hook(PGLogicalOutputData *data, RepOriginId txn_origin)
 
 	return ret;
 }
+
+/*
+ * Decide if the generic logical decoding message should be sent. Messages
+ * are application-defined, so unlike rows they are only sent when a hook
+ * asks for them: clients which don't install one never see them.
+ */
+bool
+call_message_filter_hook(PGLogicalOutputData *data, bool transactional,
+		const char *prefix, Size message_size, const char *message)
+{
+	struct PGLogicalMessageFilterArgs hook_args;
+	bool ret = false;
+	MemoryContext old_ctxt;
+
+	if (data->hooks.message_filter_hook != NULL)
+	{
+		hook_args.private_data = data->hooks.hooks_private_data;
+		hook_args.transactional = transactional;
+		hook_args.prefix = prefix;
+		hook_args.message_size = message_size;
+		hook_args.message = message;
+
+		elog(DEBUG3, "calling pglogical message filter hook");
+
+		old_ctxt = MemoryContextSwitchTo(data->hooks_mctxt);
+		ret = (*data->hooks.message_filter_hook)(&hook_args);
+		MemoryContextSwitchTo(old_ctxt);
+
+		/* Filter hooks shouldn't change the private data ptr */
+		Assert(data->hooks.hooks_private_data == hook_args.private_data);
+
+		elog(DEBUG3, "called pglogical message filter hook, returned %d", (int)ret);
+	}
+
+	return ret;
+}
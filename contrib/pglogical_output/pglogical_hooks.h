@@ -19,5 +19,9 @@ extern bool call_row_filter_hook(PGLogicalOutputData *data,
 extern bool call_txn_filter_hook(PGLogicalOutputData *data,
 		RepOriginId txn_origin);
 
+extern bool call_message_filter_hook(PGLogicalOutputData *data,
+		bool transactional, const char *prefix, Size message_size,
+		const char *message);
+
 
 #endif
@@ -66,6 +66,10 @@ static void pg_decode_commit_txn(LogicalDecodingContext *ctx,
 static void pg_decode_change(LogicalDecodingContext *ctx,
 				 ReorderBufferTXN *txn, Relation rel,
 				 ReorderBufferChange *change);
+static void pg_decode_message(LogicalDecodingContext *ctx,
+				  ReorderBufferTXN *txn, XLogRecPtr message_lsn,
+				  bool transactional, const char *prefix,
+				  Size message_size, const char *message);
 
 #ifdef HAVE_REPLICATION_ORIGINS
 static bool pg_decode_origin_filter(LogicalDecodingContext *ctx,
@@ -87,6 +91,7 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->begin_cb = pg_decode_begin_txn;
 	cb->change_cb = pg_decode_change;
 	cb->commit_cb = pg_decode_commit_txn;
+	cb->message_cb = pg_decode_message;
 #ifdef HAVE_REPLICATION_ORIGINS
 	cb->filter_by_origin_cb = pg_decode_origin_filter;
 #endif
@@ -242,6 +247,7 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 		{
 			data->api = pglogical_init_api(PGLogicalProtoNative);
 			opt->output_type = OUTPUT_PLUGIN_BINARY_OUTPUT;
+			data->compact_tuples = data->client_want_compact_tuples;
 
 			if (data->client_no_txinfo)
 			{
@@ -374,9 +380,11 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 			data->relmeta_cache_size = data->client_relmeta_cache_size;
 		}
 
-		/* if cache enabled, init it */
-		if (data->relmeta_cache_size != 0)
-			pglogical_init_relmetacache(ctx->context);
+		/*
+		 * The cache also keeps the protocol's per-relation send plans, so
+		 * it's needed even when the client doesn't cache relation metadata.
+		 */
+		pglogical_init_relmetacache(ctx->context);
 	}
 }
 
@@ -512,6 +520,32 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	MemoryContextReset(data->context);
 }
 
+/*
+ * Generic logical decoding MESSAGE callback
+ */
+static void
+pg_decode_message(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				  XLogRecPtr message_lsn, bool transactional,
+				  const char *prefix, Size message_size,
+				  const char *message)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	if (data->api->write_message == NULL ||
+		!call_message_filter_hook(data, transactional, prefix,
+								  message_size, message))
+		return;
+
+	/* Non-transactional message can come before any BEGIN */
+	if (!startup_message_sent)
+		send_startup_message(ctx, data, false /* can't be last message */);
+
+	OutputPluginPrepareWrite(ctx, true);
+	data->api->write_message(ctx->out, data, message_lsn, transactional,
+							 prefix, message_size, message);
+	OutputPluginWrite(ctx, true);
+}
+
 #ifdef HAVE_REPLICATION_ORIGINS
 /*
  * Decide if the whole transaction with specific origin should be filtered out.
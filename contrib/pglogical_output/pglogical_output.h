@@ -64,6 +64,7 @@ typedef struct PGLogicalOutputData
 	bool	forward_changeset_origins;
 	int		field_datum_encoding;
 	int		relmeta_cache_size;
+	bool	compact_tuples;
 
 	/*
 	 * client info
@@ -95,6 +96,7 @@ typedef struct PGLogicalOutputData
 	bool	client_binary_intdatetimes;
 	bool	client_no_txinfo;
 	int   client_relmeta_cache_size;
+	bool	client_want_compact_tuples;
 
 	/* hooks */
 	List *hooks_setup_funcname;
@@ -49,6 +49,19 @@ struct PGLogicalRowFilterArgs
 typedef bool (*pglogical_row_filter_hook_fn)(struct PGLogicalRowFilterArgs *args);
 
 
+struct PGLogicalMessageFilterArgs
+{
+	void 	   *private_data;
+	/* generic logical decoding message, see LogLogicalMessage */
+	bool		transactional;
+	const char *prefix;
+	Size		message_size;
+	const char *message;
+};
+
+typedef bool (*pglogical_message_filter_hook_fn)(struct PGLogicalMessageFilterArgs *args);
+
+
 struct PGLogicalShutdownHookArgs
 {
 	void	   *private_data;
@@ -66,6 +79,7 @@ struct PGLogicalHooks
 	pglogical_shutdown_hook_fn shutdown_hook;
 	pglogical_txn_filter_hook_fn txn_filter_hook;
 	pglogical_row_filter_hook_fn row_filter_hook;
+	pglogical_message_filter_hook_fn message_filter_hook;
 	void *hooks_private_data;
 };
 
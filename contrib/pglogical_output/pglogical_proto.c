@@ -31,6 +31,7 @@ pglogical_init_api(PGLogicalProtoType typ)
 		res->write_insert = pglogical_json_write_insert;
 		res->write_update = pglogical_json_write_update;
 		res->write_delete = pglogical_json_write_delete;
+		res->write_message = pglogical_json_write_message;
 		res->write_startup_message = json_write_startup_message;
 	}
 	else
@@ -42,6 +43,7 @@ pglogical_init_api(PGLogicalProtoType typ)
 		res->write_insert = pglogical_write_insert;
 		res->write_update = pglogical_write_update;
 		res->write_delete = pglogical_write_delete;
+		res->write_message = pglogical_write_message;
 		res->write_startup_message = write_startup_message;
 	}
 
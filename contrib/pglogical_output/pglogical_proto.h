@@ -35,6 +35,11 @@ typedef void (*pglogical_write_update_fn)(StringInfo out, struct PGLogicalOutput
 typedef void (*pglogical_write_delete_fn)(StringInfo out, struct PGLogicalOutputData *data,
 							 Relation rel, HeapTuple oldtuple);
 
+typedef void (*pglogical_write_message_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 XLogRecPtr message_lsn, bool transactional,
+							 const char *prefix, Size message_size,
+							 const char *message);
+
 typedef void (*write_startup_message_fn)(StringInfo out, List *msg);
 
 typedef struct PGLogicalProtoAPI
@@ -46,6 +51,7 @@ typedef struct PGLogicalProtoAPI
 	pglogical_write_insert_fn	write_insert;
 	pglogical_write_update_fn	write_update;
 	pglogical_write_delete_fn	write_delete;
+	pglogical_write_message_fn	write_message;
 	write_startup_message_fn	write_startup_message;
 } PGLogicalProtoAPI;
 
@@ -16,7 +16,9 @@
 
 #include "pglogical_output.h"
 #include "pglogical_proto_json.h"
+#include "pglogical_relmetacache.h"
 
+#include "access/htup_details.h"
 #include "access/sysattr.h"
 #include "access/tuptoaster.h"
 #include "access/xact.h"
@@ -44,6 +46,7 @@
 
 #include "utils/builtins.h"
 #include "utils/json.h"
+#include "utils/jsonapi.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -51,6 +54,31 @@
 #include "utils/timestamp.h"
 #include "utils/typcache.h"
 
+/*
+ * How to write one attribute of the relation's tuples as JSON.
+ */
+typedef struct PGLJsonPlanAttr
+{
+	bool		attisdropped;
+	JsonTypeCategory tcategory;	/* see json_categorize_type */
+	Oid			outfuncoid;		/* output or cast function, for datum_to_json */
+	FmgrInfo	outfunc;		/* output function for numeric, json and
+								 * other types */
+	char	   *key;			/* escaped attribute name followed by ':' */
+} PGLJsonPlanAttr;
+
+/*
+ * Cached per-relation plan for json_write_tuple, kept in the relation
+ * metadata cache like the native protocol's send plan.
+ */
+typedef struct PGLJsonPlan
+{
+	int			natts;
+	PGLJsonPlanAttr attrs[FLEXIBLE_ARRAY_MEMBER];
+} PGLJsonPlan;
+
+static PGLJsonPlan *get_json_plan(Relation rel);
+
 
 /*
  * Write BEGIN to the output stream.
@@ -126,20 +154,138 @@ pglogical_json_write_commit(StringInfo out, PGLogicalOutputData *data, ReorderBu
 }
 
 /*
- * Write a tuple to the outputstream, in the most efficient format possible.
+ * Get the JSON plan of the relation, building it if needed.
+ */
+static PGLJsonPlan *
+get_json_plan(Relation rel)
+{
+	struct PGLRelMetaCacheEntry *cache_entry;
+	TupleDesc	desc;
+	PGLJsonPlan *plan;
+	MemoryContext old;
+	StringInfoData key;
+	int			i;
+
+	cache_entry = pglogical_lookup_relmeta(rel);
+	if (cache_entry->send_plan != NULL)
+		return (PGLJsonPlan *) cache_entry->send_plan;
+
+	desc = RelationGetDescr(rel);
+
+	old = MemoryContextSwitchTo(cache_entry->send_plan_context);
+
+	plan = palloc0(offsetof(PGLJsonPlan, attrs) +
+				   desc->natts * sizeof(PGLJsonPlanAttr));
+	plan->natts = desc->natts;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute att = desc->attrs[i];
+		PGLJsonPlanAttr *attplan = &plan->attrs[i];
+
+		attplan->attisdropped = att->attisdropped;
+		if (att->attisdropped)
+			continue;
+
+		json_categorize_type(att->atttypid, &attplan->tcategory,
+							 &attplan->outfuncoid);
+		if (attplan->tcategory == JSONTYPE_NUMERIC ||
+			attplan->tcategory == JSONTYPE_JSON ||
+			attplan->tcategory == JSONTYPE_OTHER)
+			fmgr_info_cxt(attplan->outfuncoid, &attplan->outfunc,
+						  cache_entry->send_plan_context);
+
+		initStringInfo(&key);
+		escape_json(&key, NameStr(att->attname));
+		appendStringInfoChar(&key, ':');
+		attplan->key = key.data;
+	}
+
+	MemoryContextSwitchTo(old);
+
+	cache_entry->send_plan = plan;
+
+	return plan;
+}
+
+/*
+ * Write a tuple to the output stream as a JSON object, the same as
+ * row_to_json() would, but straight from the deformed tuple using the
+ * relation's cached JSON plan.
  */
 static void
 json_write_tuple(StringInfo out, Relation rel, HeapTuple tuple)
 {
 	TupleDesc	desc;
-	Datum		tupdatum,
-				json;
+	Datum		values[MaxTupleAttributeNumber];
+	bool		isnull[MaxTupleAttributeNumber];
+	PGLJsonPlan *plan;
+	bool		needsep = false;
+	int			i;
 
 	desc = RelationGetDescr(rel);
-	tupdatum = heap_copy_tuple_as_datum(tuple, desc);
-	json = DirectFunctionCall1(row_to_json, tupdatum);
+	plan = get_json_plan(rel);
+	Assert(plan->natts == desc->natts);
+
+	heap_deform_tuple(tuple, desc, values, isnull);
+
+	appendStringInfoChar(out, '{');
+
+	for (i = 0; i < plan->natts; i++)
+	{
+		PGLJsonPlanAttr *att = &plan->attrs[i];
+		char	   *outputstr;
+
+		if (att->attisdropped)
+			continue;
+
+		if (needsep)
+			appendStringInfoChar(out, ',');
+		needsep = true;
+
+		appendStringInfoString(out, att->key);
+
+		if (isnull[i])
+		{
+			appendStringInfoString(out, "null");
+			continue;
+		}
 
-	appendStringInfoString(out, TextDatumGetCString(json));
+		switch (att->tcategory)
+		{
+			case JSONTYPE_BOOL:
+				appendStringInfoString(out,
+									   DatumGetBool(values[i]) ? "true" : "false");
+				break;
+			case JSONTYPE_NUMERIC:
+				outputstr = OutputFunctionCall(&att->outfunc, values[i]);
+				/* NaN and infinities aren't valid JSON numbers */
+				if (IsValidJsonNumber(outputstr, strlen(outputstr)))
+					appendStringInfoString(out, outputstr);
+				else
+					escape_json(out, outputstr);
+				pfree(outputstr);
+				break;
+			case JSONTYPE_JSON:
+				/* JSON and JSONB output will already be escaped */
+				outputstr = OutputFunctionCall(&att->outfunc, values[i]);
+				appendStringInfoString(out, outputstr);
+				pfree(outputstr);
+				break;
+			case JSONTYPE_OTHER:
+				outputstr = OutputFunctionCall(&att->outfunc, values[i]);
+				escape_json(out, outputstr);
+				pfree(outputstr);
+				break;
+			default:
+				/* datetimes, arrays, composites and casts to json */
+				datum_to_json(values[i], false, out, att->tcategory,
+							  att->outfuncoid, false);
+				break;
+		}
+	}
+
+	appendStringInfoChar(out, '}');
 }
 
 /*
@@ -201,6 +347,27 @@ pglogical_json_write_delete(StringInfo out, PGLogicalOutputData *data,
 	pglogical_json_write_change(out, "D", rel, oldtuple, NULL);
 }
 
+/*
+ * Write generic logical decoding message, content is arbitrary binary
+ * data so it's sent as hex like bytea.
+ */
+void
+pglogical_json_write_message(StringInfo out, PGLogicalOutputData *data,
+							 XLogRecPtr message_lsn, bool transactional,
+							 const char *prefix, Size message_size,
+							 const char *message)
+{
+	appendStringInfoString(out, "{\"action\":\"M\"");
+	appendStringInfo(out, ", \"transactional\":\"%c\"", transactional ? 't' : 'f');
+	appendStringInfoString(out, ", \"prefix\":");
+	escape_json(out, prefix);
+	appendStringInfoString(out, ", \"content\":\"\\\\x");
+	enlargeStringInfo(out, message_size * 2);
+	out->len += hex_encode(message, message_size, out->data + out->len);
+	out->data[out->len] = '\0';
+	appendStringInfoString(out, "\"}");
+}
+
 /*
  * The startup message should be constructed as a json object, one
  * key/value per DefElem list member.
@@ -26,6 +26,10 @@ extern void pglogical_json_write_update(StringInfo out, PGLogicalOutputData *dat
 								 HeapTuple newtuple);
 extern void pglogical_json_write_delete(StringInfo out, PGLogicalOutputData *data,
 								 Relation rel, HeapTuple oldtuple);
+extern void pglogical_json_write_message(StringInfo out, PGLogicalOutputData *data,
+								 XLogRecPtr message_lsn, bool transactional,
+								 const char *prefix, Size message_size,
+								 const char *message);
 
 extern void json_write_startup_message(StringInfo out, List *msg);
 
@@ -50,6 +50,34 @@
 
 #define IS_REPLICA_IDENTITY 1
 
+/*
+ * How to send one attribute of the relation's tuples.
+ */
+typedef struct PGLSendPlanAttr
+{
+	bool		attisdropped;
+	char		transfer_type;	/* 'i', 'b' or 't', see decide_datum_transfer */
+	int16		attlen;
+	bool		attbyval;
+	FmgrInfo	sendfunc;		/* send or output function of the type */
+
+	/* delta encoding state, only used with compact_tuples */
+	bool		delta_encodable;
+	bool		has_prev;
+	int64		prev;			/* last value sent for this column */
+} PGLSendPlanAttr;
+
+/*
+ * Cached per-relation plan for pglogical_write_tuple, so that the hot path
+ * doesn't have to look up the type of every column of every row.
+ */
+typedef struct PGLSendPlan
+{
+	int			natts;
+	uint16		nliveatts;
+	PGLSendPlanAttr attrs[FLEXIBLE_ARRAY_MEMBER];
+} PGLSendPlan;
+
 static void pglogical_write_attrs(StringInfo out, Relation rel);
 static void pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 								   Relation rel, HeapTuple tuple);
@@ -57,6 +85,12 @@ static char decide_datum_transfer(Form_pg_attribute att,
 								  Form_pg_type typclass,
 								  bool allow_internal_basetypes,
 								  bool allow_binary_basetypes);
+static PGLSendPlan *get_send_plan(PGLogicalOutputData *data, Relation rel);
+static void reset_send_plan_deltas(Relation rel);
+static bool type_is_delta_encodable(Oid typid);
+static void send_varint(StringInfo out, uint64 val);
+static int	varint_size(uint64 val);
+static void send_field_length(StringInfo out, int len, bool compact);
 
 /*
  * Write relation description to the output stream.
@@ -102,6 +136,10 @@ pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel,
 	/* send the attribute info */
 	pglogical_write_attrs(out, rel);
 
+	/* the client starts delta decoding of the relation from scratch */
+	if (data->compact_tuples)
+		reset_send_plan_deltas(rel);
+
 	/*
 	 * Since we've sent the whole relation metadata not just the columns for
 	 * the coming row(s), we can omit sending it again. The client will cache
@@ -334,6 +372,41 @@ pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 	pglogical_write_tuple(out, data, rel, oldtuple);
 }
 
+/*
+ * Write generic logical decoding MESSAGE to the output stream.
+ */
+void
+pglogical_write_message(StringInfo out, PGLogicalOutputData *data,
+						XLogRecPtr message_lsn, bool transactional,
+						const char *prefix, Size message_size,
+						const char *message)
+{
+	uint8	flags = 0;
+	uint8	len;
+
+	Assert(strlen(prefix) < 255);
+
+	if (transactional)
+		flags |= PGLOGICAL_MESSAGE_TRANSACTIONAL;
+
+	pq_sendbyte(out, 'M');		/* MESSAGE */
+
+	/* send the flags field its self */
+	pq_sendbyte(out, flags);
+
+	/* fixed fields */
+	pq_sendint64(out, message_lsn);
+
+	/* prefix */
+	len = strlen(prefix) + 1;
+	pq_sendbyte(out, len);
+	pq_sendbytes(out, prefix, len);
+
+	/* content */
+	pq_sendint(out, message_size, 4);
+	pq_sendbytes(out, message, message_size);
+}
+
 /*
  * Most of the brains for startup message creation lives in
  * pglogical_config.c, so this presently just sends the set of key/value pairs.
@@ -356,33 +429,180 @@ write_startup_message(StringInfo out, List *msg)
 }
 
 /*
- * Write a tuple to the outputstream, in the most efficient format possible.
+ * Get the send plan of the relation, building it if needed.
  */
-static void
-pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
-					   Relation rel, HeapTuple tuple)
+static PGLSendPlan *
+get_send_plan(PGLogicalOutputData *data, Relation rel)
 {
+	struct PGLRelMetaCacheEntry *cache_entry;
 	TupleDesc	desc;
-	Datum		values[MaxTupleAttributeNumber];
-	bool		isnull[MaxTupleAttributeNumber];
+	PGLSendPlan *plan;
+	MemoryContext old;
 	int			i;
-	uint16		nliveatts = 0;
+
+	cache_entry = pglogical_lookup_relmeta(rel);
+	if (cache_entry->send_plan != NULL)
+		return (PGLSendPlan *) cache_entry->send_plan;
 
 	desc = RelationGetDescr(rel);
 
-	pq_sendbyte(out, 'T');			/* sending TUPLE */
+	old = MemoryContextSwitchTo(cache_entry->send_plan_context);
+
+	plan = palloc0(offsetof(PGLSendPlan, attrs) +
+				   desc->natts * sizeof(PGLSendPlanAttr));
+	plan->natts = desc->natts;
 
 	for (i = 0; i < desc->natts; i++)
 	{
-		if (desc->attrs[i]->attisdropped)
+		Form_pg_attribute att = desc->attrs[i];
+		PGLSendPlanAttr *attplan = &plan->attrs[i];
+		HeapTuple	typtup;
+		Form_pg_type typclass;
+
+		attplan->attisdropped = att->attisdropped;
+		if (att->attisdropped)
 			continue;
-		nliveatts++;
+
+		plan->nliveatts++;
+		attplan->attlen = att->attlen;
+		attplan->attbyval = att->attbyval;
+
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
+		if (!HeapTupleIsValid(typtup))
+			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
+		typclass = (Form_pg_type) GETSTRUCT(typtup);
+
+		attplan->transfer_type =
+			decide_datum_transfer(att, typclass,
+								  data->allow_internal_basetypes,
+								  data->allow_binary_basetypes);
+
+		attplan->delta_encodable = attplan->transfer_type == 'i' &&
+			att->attbyval && type_is_delta_encodable(att->atttypid);
+
+		if (attplan->transfer_type == 'b')
+			fmgr_info_cxt(typclass->typsend, &attplan->sendfunc,
+						  cache_entry->send_plan_context);
+		else if (attplan->transfer_type == 't')
+			fmgr_info_cxt(typclass->typoutput, &attplan->sendfunc,
+						  cache_entry->send_plan_context);
+
+		ReleaseSysCache(typtup);
 	}
-	pq_sendint(out, nliveatts, 2);
 
-	/* try to allocate enough memory from the get go */
-	enlargeStringInfo(out, tuple->t_len +
-					  nliveatts * (1 + 4));
+	MemoryContextSwitchTo(old);
+
+	cache_entry->send_plan = plan;
+
+	return plan;
+}
+
+/*
+ * Forget the previous values of the delta encoded columns of the relation.
+ */
+static void
+reset_send_plan_deltas(Relation rel)
+{
+	struct PGLRelMetaCacheEntry *cache_entry;
+	PGLSendPlan *plan;
+	int			i;
+
+	cache_entry = pglogical_lookup_relmeta(rel);
+	plan = (PGLSendPlan *) cache_entry->send_plan;
+	if (plan == NULL)
+		return;
+
+	for (i = 0; i < plan->natts; i++)
+		plan->attrs[i].has_prev = false;
+}
+
+/*
+ * Can the values of the type be sent as a difference from the previous
+ * value of the column? Only integer-like types qualify, and only when their
+ * internal representation is an integer of the same width.
+ */
+static bool
+type_is_delta_encodable(Oid typid)
+{
+	switch (typid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case DATEOID:
+			return true;
+#ifdef HAVE_INT64_TIMESTAMP
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+/*
+ * Write an unsigned integer in the variable length format used by compact
+ * tuples: 7 bits per byte, least significant group first, with the high bit
+ * set on all bytes but the last.
+ */
+static void
+send_varint(StringInfo out, uint64 val)
+{
+	while (val >= 0x80)
+	{
+		pq_sendbyte(out, (val & 0x7F) | 0x80);
+		val >>= 7;
+	}
+	pq_sendbyte(out, (int) val);
+}
+
+/*
+ * Number of bytes send_varint needs for the value.
+ */
+static int
+varint_size(uint64 val)
+{
+	int			size = 1;
+
+	while (val >= 0x80)
+	{
+		size++;
+		val >>= 7;
+	}
+
+	return size;
+}
+
+/*
+ * Write the length of a column value.
+ */
+static void
+send_field_length(StringInfo out, int len, bool compact)
+{
+	if (compact)
+		send_varint(out, (uint64) len);
+	else
+		pq_sendint(out, len, 4);
+}
+
+/*
+ * Write a tuple to the outputstream, in the most efficient format possible.
+ */
+static void
+pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
+					   Relation rel, HeapTuple tuple)
+{
+	TupleDesc	desc;
+	Datum		values[MaxTupleAttributeNumber];
+	bool		isnull[MaxTupleAttributeNumber];
+	int			i;
+	PGLSendPlan *plan;
+	bool		compact = data->compact_tuples;
+
+	desc = RelationGetDescr(rel);
+	plan = get_send_plan(data, rel);
+	Assert(plan->natts == desc->natts);
 
 	/*
 	 * XXX: should this prove to be a relevant bottleneck, it might be
@@ -391,12 +611,42 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 	 */
 	heap_deform_tuple(tuple, desc, values, isnull);
 
-	for (i = 0; i < desc->natts; i++)
+	if (compact)
 	{
-		HeapTuple	typtup;
-		Form_pg_type typclass;
-		Form_pg_attribute att = desc->attrs[i];
-		char		transfer_type;
+		uint8		nullbits[(MaxTupleAttributeNumber + 7) / 8];
+		int			nlive = 0;
+
+		pq_sendbyte(out, 'C');		/* sending COMPACT TUPLE */
+
+		send_varint(out, plan->nliveatts);
+
+		/* null bitmap, one bit per live column */
+		memset(nullbits, 0, sizeof(nullbits));
+		for (i = 0; i < plan->natts; i++)
+		{
+			if (plan->attrs[i].attisdropped)
+				continue;
+
+			if (isnull[i])
+				nullbits[nlive / 8] |= 1 << (nlive % 8);
+			nlive++;
+		}
+		pq_sendbytes(out, (char *) nullbits, (nlive + 7) / 8);
+	}
+	else
+	{
+		pq_sendbyte(out, 'T');		/* sending TUPLE */
+
+		pq_sendint(out, plan->nliveatts, 2);
+	}
+
+	/* try to allocate enough memory from the get go */
+	enlargeStringInfo(out, tuple->t_len +
+					  plan->nliveatts * (1 + 4));
+
+	for (i = 0; i < plan->natts; i++)
+	{
+		PGLSendPlanAttr *att = &plan->attrs[i];
 
 		/* skip dropped columns */
 		if (att->attisdropped)
@@ -404,7 +654,9 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 		if (isnull[i])
 		{
-			pq_sendbyte(out, 'n');	/* null column */
+			/* nulls of compact tuples are in the bitmap */
+			if (!compact)
+				pq_sendbyte(out, 'n');	/* null column */
 			continue;
 		}
 		else if (att->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(values[i]))
@@ -413,16 +665,40 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 			continue;
 		}
 
-		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
-		if (!HeapTupleIsValid(typtup))
-			elog(ERROR, "cache lookup failed for type %u", att->atttypid);
-		typclass = (Form_pg_type) GETSTRUCT(typtup);
-
-		transfer_type = decide_datum_transfer(att, typclass,
-											  data->allow_internal_basetypes,
-											  data->allow_binary_basetypes);
+		if (compact && att->delta_encodable)
+		{
+			int64		value;
+			bool		use_delta = false;
+			uint64		zigzag = 0;
+
+			if (att->attlen == 2)
+				value = DatumGetInt16(values[i]);
+			else if (att->attlen == 4)
+				value = DatumGetInt32(values[i]);
+			else
+				value = DatumGetInt64(values[i]);
+
+			if (att->has_prev)
+			{
+				/* wrapping difference, zigzag encoded to keep it small */
+				uint64		delta = (uint64) value - (uint64) att->prev;
+
+				zigzag = (delta << 1) ^ (uint64) ((int64) delta >> 63);
+				use_delta = varint_size(zigzag) < att->attlen + 1;
+			}
+
+			att->prev = value;
+			att->has_prev = true;
+
+			if (use_delta)
+			{
+				pq_sendbyte(out, 'd');	/* delta from previous value */
+				send_varint(out, zigzag);
+				continue;
+			}
+		}
 
-		switch (transfer_type)
+		switch (att->transfer_type)
 		{
 			case 'i':
 				pq_sendbyte(out, 'i');	/* internal-format binary data follows */
@@ -430,7 +706,7 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 				/* pass by value */
 				if (att->attbyval)
 				{
-					pq_sendint(out, att->attlen, 4); /* length */
+					send_field_length(out, att->attlen, compact);
 
 					enlargeStringInfo(out, att->attlen);
 					store_att_byval(out->data + out->len, values[i],
@@ -441,7 +717,7 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 				/* fixed length non-varlena pass-by-reference type */
 				else if (att->attlen > 0)
 				{
-					pq_sendint(out, att->attlen, 4); /* length */
+					send_field_length(out, att->attlen, compact);
 
 					appendBinaryStringInfo(out, DatumGetPointer(values[i]),
 										   att->attlen);
@@ -461,7 +737,15 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					Assert(!VARATT_IS_EXTERNAL(data));
 
-					pq_sendint(out, VARSIZE_ANY(data), 4); /* length */
+					/*
+					 * The receiver may be built without LZ4, so only pglz
+					 * compressed values are sent as they are.
+					 */
+					if (VARATT_IS_COMPRESSED(data) &&
+						TOAST_COMPRESS_METHOD(data) != TOAST_PGLZ_COMPRESSION)
+						data = (char *) heap_tuple_untoast_attr((struct varlena *) data);
+
+					send_field_length(out, VARSIZE_ANY(data), compact);
 
 					appendBinaryStringInfo(out, data, VARSIZE_ANY(data));
 				}
@@ -477,11 +761,10 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					pq_sendbyte(out, 'b');	/* binary send/recv data follows */
 
-					outputbytes = OidSendFunctionCall(typclass->typsend,
-													  values[i]);
+					outputbytes = SendFunctionCall(&att->sendfunc, values[i]);
 
 					len = VARSIZE(outputbytes) - VARHDRSZ;
-					pq_sendint(out, len, 4); /* length */
+					send_field_length(out, len, compact);
 					pq_sendbytes(out, VARDATA(outputbytes), len); /* data */
 					pfree(outputbytes);
 				}
@@ -494,16 +777,13 @@ pglogical_write_tuple(StringInfo out, PGLogicalOutputData *data,
 
 					pq_sendbyte(out, 't');	/* 'text' data follows */
 
-					outputstr =	OidOutputFunctionCall(typclass->typoutput,
-													  values[i]);
+					outputstr =	OutputFunctionCall(&att->sendfunc, values[i]);
 					len = strlen(outputstr) + 1;
-					pq_sendint(out, len, 4); /* length */
+					send_field_length(out, len, compact);
 					appendBinaryStringInfo(out, outputstr, len); /* data */
 					pfree(outputstr);
 				}
 		}
-
-		ReleaseSysCache(typtup);
 	}
 }
 
@@ -30,6 +30,9 @@
 
 #define PGLOGICAL_XACT_EVENT(flags)	(flags & 0x03)
 
+/* Flags of MESSAGE */
+#define PGLOGICAL_MESSAGE_TRANSACTIONAL	0x01
+
 extern void pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel,
 							struct PGLRelMetaCacheEntry *cache_entry);
 
@@ -48,6 +51,10 @@ extern void pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 							HeapTuple newtuple);
 extern void pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 							Relation rel, HeapTuple oldtuple);
+extern void pglogical_write_message(StringInfo out, PGLogicalOutputData *data,
+							XLogRecPtr message_lsn, bool transactional,
+							const char *prefix, Size message_size,
+							const char *message);
 
 extern void write_startup_message(StringInfo out, List *msg);
 
@@ -32,6 +32,9 @@ static void relmeta_cache_callback(Datum arg, Oid relid);
  */
 static HTAB *RelMetaCache = NULL;
 
+/* Decoding context the hash table and the send plans live in */
+static MemoryContext RelMetaCacheContext = NULL;
+
 /*
  * The callback persists across decoding sessions so we should only
  * register it once.
@@ -70,6 +73,7 @@ pglogical_init_relmetacache(MemoryContext decoding_context)
 
 	RelMetaCache = hash_create("pglogical relation metadata cache", 128,
 								&ctl, hash_flags);
+	RelMetaCacheContext = decoding_context;
 
 	Assert(RelMetaCache != NULL);
 
@@ -98,6 +102,8 @@ pglogical_init_relmetacache(MemoryContext decoding_context)
 static void
 relmeta_cache_callback(Datum arg, Oid relid)
  {
+	struct PGLRelMetaCacheEntry *hentry;
+
 	/*
 	 * We can be called after decoding session teardown becaues the
 	 * relcache callback isn't cleared. In that case there's no action
@@ -107,20 +113,67 @@ relmeta_cache_callback(Datum arg, Oid relid)
 		return;
 
 	/*
-	 * Nobody keeps pointers to entries in this hash table around so
-	 * it's safe to directly HASH_REMOVE the entries as soon as they are
-	 * invalidated. Finding them and flagging them invalid then removing
-	 * them lazily might save some memory churn for tables that get
-	 * repeatedly invalidated and re-sent, but it dodesn't seem worth
-	 * doing.
+	 * The protocol may be in the middle of sending a tuple with the
+	 * entry's send plan when catalog access processes the invalidation,
+	 * so we only flag the entry here. The plan is thrown away on the next
+	 * lookup of the relation, when it's no longer in use.
 	 *
 	 * Getting invalidations for relations that aren't in the table is
 	 * entirely normal, since there's no way to unregister for an
 	 * invalidation event. So we don't care if it's found or not.
 	 */
-	(void) hash_search(RelMetaCache, &relid, HASH_REMOVE, NULL);
+	hentry = (struct PGLRelMetaCacheEntry *) hash_search(RelMetaCache,
+														 &relid, HASH_FIND,
+														 NULL);
+	if (hentry != NULL)
+	{
+		hentry->is_cached = false;
+		hentry->api_private = NULL;
+		hentry->send_plan_valid = false;
+	}
  }
 
+/*
+ * Look up the entry of a relation, creating it if not found.
+ *
+ * If the relation was invalidated since its send plan was built, the plan
+ * is discarded and the caller has to build a new one in send_plan_context.
+ */
+struct PGLRelMetaCacheEntry *
+pglogical_lookup_relmeta(Relation rel)
+{
+	struct PGLRelMetaCacheEntry *hentry;
+	bool found;
+
+	Assert(RelMetaCache != NULL);
+
+	hentry = (struct PGLRelMetaCacheEntry*) hash_search(RelMetaCache,
+										 (void *)(&RelationGetRelid(rel)),
+										 HASH_ENTER, &found);
+
+	if (!found)
+	{
+		Assert(hentry->relid == RelationGetRelid(rel));
+		hentry->is_cached = false;
+		hentry->api_private = NULL;
+		hentry->send_plan = NULL;
+		hentry->send_plan_context = AllocSetContextCreate(RelMetaCacheContext,
+										"pglogical send plan",
+										ALLOCSET_SMALL_MINSIZE,
+										ALLOCSET_SMALL_INITSIZE,
+										ALLOCSET_SMALL_MAXSIZE);
+		hentry->send_plan_valid = true;
+	}
+	else if (!hentry->send_plan_valid)
+	{
+		MemoryContextReset(hentry->send_plan_context);
+		hentry->send_plan = NULL;
+		hentry->send_plan_valid = true;
+	}
+
+	return hentry;
+}
+
 /*
  * Look up an entry, creating it not found.
  *
@@ -135,7 +188,6 @@ pglogical_cache_relmeta(struct PGLogicalOutputData *data,
 		Relation rel, struct PGLRelMetaCacheEntry **entry)
 {
 	struct PGLRelMetaCacheEntry *hentry;
-	bool found;
 
 	if (data->relmeta_cache_size == 0)
 	{
@@ -148,18 +200,7 @@ pglogical_cache_relmeta(struct PGLogicalOutputData *data,
 	}
 
 	/* Find cached function info, creating if not found */
-	hentry = (struct PGLRelMetaCacheEntry*) hash_search(RelMetaCache,
-										 (void *)(&RelationGetRelid(rel)),
-										 HASH_ENTER, &found);
-
-	if (!found)
-	{
-		Assert(hentry->relid = RelationGetRelid(rel));
-		hentry->is_cached = false;
-		hentry->api_private = NULL;
-	}
-
-	Assert(hentry != NULL);
+	hentry = pglogical_lookup_relmeta(rel);
 
 	*entry = hentry;
 	return hentry->is_cached;
@@ -182,5 +223,6 @@ pglogical_destroy_relmetacache(void)
 	{
 		hash_destroy(RelMetaCache);
 		RelMetaCache = NULL;
+		RelMetaCacheContext = NULL;
 	}
 }
@@ -10,11 +10,20 @@ struct PGLRelMetaCacheEntry
 	bool is_cached;
 	/* Field for API plugin use, must be alloc'd in decoding context */
 	void *api_private;
+	/*
+	 * Protocol specific data about how to send the relation's tuples,
+	 * alloc'd in send_plan_context. It's reset by pglogical_lookup_relmeta
+	 * once the relation gets invalidated.
+	 */
+	void *send_plan;
+	MemoryContext send_plan_context;
+	bool send_plan_valid;
 };
 
 struct PGLogicalOutputData;
 
 extern void pglogical_init_relmetacache(MemoryContext decoding_context);
+extern struct PGLRelMetaCacheEntry *pglogical_lookup_relmeta(Relation rel);
 extern bool pglogical_cache_relmeta(struct PGLogicalOutputData *data, Relation rel, struct PGLRelMetaCacheEntry **entry);
 extern void pglogical_destroy_relmetacache(void);
 
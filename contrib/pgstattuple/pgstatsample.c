@@ -0,0 +1,637 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgstatsample.c
+ *		  Bloat estimation by random block sampling
+ *
+ * pgstattuple() and pgstatindex() read every block of the relation, and
+ * pgstattuple_approx() still reads every block that is not all-visible.
+ * The functions in this file instead read a fixed-size random sample of
+ * blocks, so their cost does not grow with the size of the relation.  The
+ * per-block figures are scaled up to the whole relation, and the spread
+ * between sampled blocks is used to report a 95% margin of error for each
+ * estimated percentage.
+ *
+ * Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/pgstattuple/pgstatsample.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/gin_private.h"
+#include "access/htup_details.h"
+#include "access/nbtree.h"
+#include "catalog/pg_am.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
+#include "storage/procarray.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+#include "utils/sampling.h"
+#include "utils/spccache.h"
+#include "utils/tqual.h"
+
+PG_FUNCTION_INFO_V1(pgstattuple_sample);
+PG_FUNCTION_INFO_V1(pgstatindex_sample);
+
+/* two-sided 95% quantile of the standard normal distribution */
+#define SAMPLE_Z_95		1.959964
+
+/*
+ * State of a sampling scan.  Blocks are chosen with the same algorithm as
+ * ANALYZE uses, which returns them in increasing block number order.  A
+ * second sampler seeded identically runs ahead of the first one, so we know
+ * which blocks are going to be read next and can prefetch them.
+ */
+typedef struct BlockSampleScan
+{
+	Relation	rel;
+	BlockNumber firstblock;		/* blocks before this one are never sampled */
+	BlockSamplerData bs;		/* blocks to read */
+	BlockSamplerData prefetch_bs;	/* same sequence, ahead of bs */
+	int			prefetch_maximum;	/* how far ahead to prefetch */
+	int			prefetch_pages; /* blocks prefetched but not yet read */
+	BufferAccessStrategy bstrategy;
+} BlockSampleScan;
+
+/*
+ * Running sums from which the mean of a per-block quantity and its margin
+ * of error are computed.
+ */
+typedef struct SampleMean
+{
+	double		n;
+	double		sum;
+	double		sumsq;
+} SampleMean;
+
+typedef struct heap_output_type
+{
+	uint64		table_len;
+	uint64		sampled_pages;
+	uint64		tuple_count;
+	uint64		tuple_len;
+	double		tuple_percent;
+	uint64		dead_tuple_count;
+	uint64		dead_tuple_len;
+	double		dead_tuple_percent;
+	uint64		free_space;
+	double		free_percent;
+} heap_output_type;
+
+#define NUM_HEAP_OUTPUT_COLUMNS 13
+#define NUM_INDEX_OUTPUT_COLUMNS 10
+
+/*
+ * Set up a sampling scan of up to sample_pages blocks, chosen among blocks
+ * firstblock .. nblocks - 1 of the relation.
+ */
+static void
+sample_scan_init(BlockSampleScan *scan, Relation rel, BlockNumber firstblock,
+				 BlockNumber nblocks, int sample_pages)
+{
+	long		randseed = random();
+	BlockNumber ncandidates;
+	int			io_concurrency;
+
+	ncandidates = (nblocks > firstblock) ? nblocks - firstblock : 0;
+
+	scan->rel = rel;
+	scan->firstblock = firstblock;
+	BlockSampler_Init(&scan->bs, ncandidates, sample_pages, randseed);
+	BlockSampler_Init(&scan->prefetch_bs, ncandidates, sample_pages, randseed);
+	scan->prefetch_pages = 0;
+	scan->bstrategy = GetAccessStrategy(BAS_BULKREAD);
+
+	/*
+	 * Prefetch as far ahead as a bitmap heap scan on this tablespace would.
+	 */
+	scan->prefetch_maximum = target_prefetch_pages;
+	io_concurrency = get_tablespace_io_concurrency(rel->rd_rel->reltablespace);
+	if (io_concurrency != effective_io_concurrency)
+	{
+		double		maximum;
+
+		if (ComputeIoConcurrency(io_concurrency, &maximum))
+			scan->prefetch_maximum = rint(maximum);
+	}
+}
+
+/*
+ * Return the next sampled block, share-locked, or InvalidBuffer when the
+ * sample is exhausted.
+ */
+static Buffer
+sample_scan_next(BlockSampleScan *scan)
+{
+	BlockNumber blkno;
+	Buffer		buf;
+
+#ifdef USE_PREFETCH
+	while (scan->prefetch_pages < scan->prefetch_maximum &&
+		   BlockSampler_HasMore(&scan->prefetch_bs))
+	{
+		PrefetchBuffer(scan->rel, MAIN_FORKNUM,
+					   scan->firstblock + BlockSampler_Next(&scan->prefetch_bs));
+		scan->prefetch_pages++;
+	}
+#endif
+
+	if (!BlockSampler_HasMore(&scan->bs))
+		return InvalidBuffer;
+
+	blkno = scan->firstblock + BlockSampler_Next(&scan->bs);
+	if (scan->prefetch_pages > 0)
+		scan->prefetch_pages--;
+
+	buf = ReadBufferExtended(scan->rel, MAIN_FORKNUM, blkno,
+							 RBM_NORMAL, scan->bstrategy);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+
+	return buf;
+}
+
+static void
+sample_mean_add(SampleMean *m, double x)
+{
+	m->n += 1;
+	m->sum += x;
+	m->sumsq += x * x;
+}
+
+static double
+sample_mean(SampleMean *m)
+{
+	return (m->n > 0) ? m->sum / m->n : 0;
+}
+
+/*
+ * Compute the half-width of the 95% confidence interval of the mean, for a
+ * sample drawn without replacement from a population of the given size.
+ * Returns false if that cannot be computed, because we have too few values
+ * to know anything about their spread.
+ */
+static bool
+sample_margin(SampleMean *m, double population, double *margin)
+{
+	double		variance;
+	double		fpc;
+
+	if (m->n == 0)
+		return false;
+
+	/* we've seen the whole population, so there is no sampling error */
+	if (m->n >= population)
+	{
+		*margin = 0;
+		return true;
+	}
+
+	if (m->n < 2)
+		return false;
+
+	variance = (m->sumsq - m->sum * m->sum / m->n) / (m->n - 1);
+	if (variance < 0)
+		variance = 0;			/* guard against roundoff */
+
+	/* finite population correction */
+	fpc = 1.0 - m->n / population;
+
+	*margin = SAMPLE_Z_95 * sqrt(variance / m->n * fpc);
+	return true;
+}
+
+static void
+check_sample_args(Relation rel, int sample_pages)
+{
+	if (sample_pages <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("sample_pages must be greater than zero")));
+
+	/*
+	 * Reject attempts to read non-local temporary relations; we would be
+	 * likely to get wrong data since we have no visibility into the owning
+	 * session's local buffers.
+	 */
+	if (RELATION_IS_OTHER_TEMP(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot access temporary tables of other sessions")));
+}
+
+/*
+ * Sample the blocks of a heap relation.  Each sampled block contributes the
+ * bytes taken by its live tuples, its dead tuples and its free space; the
+ * mean over the sample, multiplied by the number of blocks, estimates the
+ * totals.  Since every block has the same size, the mean of the per-block
+ * percentages is also an unbiased estimate of the overall percentages.
+ */
+static void
+statsample_heap(Relation rel, int sample_pages, heap_output_type *stat,
+				SampleMean *live, SampleMean *dead, SampleMean *freesp)
+{
+	BlockNumber nblocks;
+	BlockSampleScan scan;
+	Buffer		buf;
+	TransactionId OldestXmin;
+	uint64		tuple_count = 0;
+	uint64		dead_tuple_count = 0;
+
+	OldestXmin = GetOldestXmin(rel, true);
+
+	nblocks = RelationGetNumberOfBlocks(rel);
+	sample_scan_init(&scan, rel, 0, nblocks, sample_pages);
+
+	while ((buf = sample_scan_next(&scan)) != InvalidBuffer)
+	{
+		Page		page = BufferGetPage(buf);
+		OffsetNumber offnum,
+					maxoff;
+		Size		freespace;
+		uint64		live_len = 0;
+		uint64		dead_len = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * It's not safe to call PageGetHeapFreeSpace() on new pages, so we
+		 * treat them as being free space for our purposes.
+		 */
+		if (PageIsNew(page))
+			freespace = BLCKSZ - SizeOfPageHeaderData;
+		else
+		{
+			freespace = PageGetHeapFreeSpace(page);
+
+			maxoff = PageGetMaxOffsetNumber(page);
+			for (offnum = FirstOffsetNumber;
+				 offnum <= maxoff;
+				 offnum = OffsetNumberNext(offnum))
+			{
+				ItemId		itemid;
+				HeapTupleData tuple;
+
+				itemid = PageGetItemId(page, offnum);
+
+				if (!ItemIdIsNormal(itemid))
+					continue;
+
+				ItemPointerSet(&(tuple.t_self), BufferGetBlockNumber(buf),
+							   offnum);
+				tuple.t_data = (HeapTupleHeader) PageGetItem(page, itemid);
+				tuple.t_len = ItemIdGetLength(itemid);
+				tuple.t_tableOid = RelationGetRelid(rel);
+
+				switch (HeapTupleSatisfiesVacuum(&tuple, OldestXmin, buf))
+				{
+					case HEAPTUPLE_DEAD:
+					case HEAPTUPLE_RECENTLY_DEAD:
+						dead_len += tuple.t_len;
+						dead_tuple_count++;
+						break;
+					case HEAPTUPLE_LIVE:
+					case HEAPTUPLE_INSERT_IN_PROGRESS:
+					case HEAPTUPLE_DELETE_IN_PROGRESS:
+						live_len += tuple.t_len;
+						tuple_count++;
+						break;
+					default:
+						elog(ERROR, "unexpected HeapTupleSatisfiesVacuum result");
+						break;
+				}
+			}
+		}
+
+		UnlockReleaseBuffer(buf);
+
+		stat->sampled_pages++;
+		stat->tuple_len += live_len;
+		stat->dead_tuple_len += dead_len;
+		stat->free_space += freespace;
+
+		sample_mean_add(live, 100.0 * live_len / BLCKSZ);
+		sample_mean_add(dead, 100.0 * dead_len / BLCKSZ);
+		sample_mean_add(freesp, 100.0 * freespace / BLCKSZ);
+	}
+
+	stat->table_len = (uint64) nblocks * BLCKSZ;
+
+	/* Scale the sampled totals up to the whole relation */
+	if (stat->sampled_pages > 0)
+	{
+		double		scale = (double) nblocks / stat->sampled_pages;
+
+		stat->tuple_count = (uint64) rint(tuple_count * scale);
+		stat->tuple_len = (uint64) rint(stat->tuple_len * scale);
+		stat->dead_tuple_count = (uint64) rint(dead_tuple_count * scale);
+		stat->dead_tuple_len = (uint64) rint(stat->dead_tuple_len * scale);
+		stat->free_space = (uint64) rint(stat->free_space * scale);
+	}
+
+	stat->tuple_percent = sample_mean(live);
+	stat->dead_tuple_percent = sample_mean(dead);
+	stat->free_percent = sample_mean(freesp);
+}
+
+/*
+ * Returns live/dead tuple statistics for the given relid, estimated from a
+ * random sample of its blocks.
+ */
+Datum
+pgstattuple_sample(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		sample_pages = PG_GETARG_INT32(1);
+	Relation	rel;
+	heap_output_type stat = {0};
+	SampleMean	live = {0},
+				dead = {0},
+				freesp = {0};
+	double		nblocks;
+	TupleDesc	tupdesc;
+	bool		nulls[NUM_HEAP_OUTPUT_COLUMNS];
+	Datum		values[NUM_HEAP_OUTPUT_COLUMNS];
+	double		margin;
+	HeapTuple	ret;
+	int			i = 0;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to use pgstattuple functions"))));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (tupdesc->natts != NUM_HEAP_OUTPUT_COLUMNS)
+		elog(ERROR, "incorrect number of output arguments");
+
+	rel = relation_open(relid, AccessShareLock);
+
+	check_sample_args(rel, sample_pages);
+
+	if (!(rel->rd_rel->relkind == RELKIND_RELATION ||
+		  rel->rd_rel->relkind == RELKIND_MATVIEW ||
+		  rel->rd_rel->relkind == RELKIND_TOASTVALUE))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"%s\" is not a table, materialized view, or TOAST table",
+						RelationGetRelationName(rel))));
+
+	statsample_heap(rel, sample_pages, &stat, &live, &dead, &freesp);
+
+	relation_close(rel, AccessShareLock);
+
+	nblocks = (double) stat.table_len / BLCKSZ;
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[i++] = Int64GetDatum(stat.table_len);
+	values[i++] = Int64GetDatum(stat.sampled_pages);
+	values[i++] = Int64GetDatum(stat.tuple_count);
+	values[i++] = Int64GetDatum(stat.tuple_len);
+	values[i++] = Float8GetDatum(stat.tuple_percent);
+	nulls[i] = !sample_margin(&live, nblocks, &margin);
+	values[i++] = Float8GetDatum(margin);
+	values[i++] = Int64GetDatum(stat.dead_tuple_count);
+	values[i++] = Int64GetDatum(stat.dead_tuple_len);
+	values[i++] = Float8GetDatum(stat.dead_tuple_percent);
+	nulls[i] = !sample_margin(&dead, nblocks, &margin);
+	values[i++] = Float8GetDatum(margin);
+	values[i++] = Int64GetDatum(stat.free_space);
+	values[i++] = Float8GetDatum(stat.free_percent);
+	nulls[i] = !sample_margin(&freesp, nblocks, &margin);
+	values[i++] = Float8GetDatum(margin);
+
+	ret = heap_form_tuple(tupdesc, values, nulls);
+	return HeapTupleGetDatum(ret);
+}
+
+/*
+ * Classification of a sampled index page.
+ */
+typedef enum
+{
+	SAMPLE_PAGE_INTERNAL,
+	SAMPLE_PAGE_LEAF,
+	SAMPLE_PAGE_DELETED,
+	SAMPLE_PAGE_OTHER
+} SamplePageType;
+
+/*
+ * Classify a btree page, and report its free space and, for leaf pages, the
+ * space available for tuples on an empty page and whether the next leaf is
+ * on an earlier block.
+ */
+static SamplePageType
+sample_btree_page(Page page, BlockNumber blkno, Size *freespace,
+				  Size *max_avail, bool *fragment)
+{
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	*max_avail = ((PageHeader) page)->pd_special - SizeOfPageHeaderData;
+
+	/* a deleted or half-dead page holds nothing we care about */
+	if (P_IGNORE(opaque))
+	{
+		*freespace = *max_avail;
+		return SAMPLE_PAGE_DELETED;
+	}
+
+	*freespace = PageGetFreeSpace(page);
+
+	if (P_ISLEAF(opaque))
+	{
+		*fragment = (opaque->btpo_next != P_NONE && opaque->btpo_next < blkno);
+		return SAMPLE_PAGE_LEAF;
+	}
+
+	return SAMPLE_PAGE_INTERNAL;
+}
+
+/*
+ * Same for a GIN page.  Leaf pages of both the entry tree and of posting
+ * trees count as leaf pages; pending list pages are neither leaf nor
+ * internal pages.
+ */
+static SamplePageType
+sample_gin_page(Page page, Size *freespace, Size *max_avail)
+{
+	if (GinPageIsDeleted(page))
+	{
+		*max_avail = ((PageHeader) page)->pd_special - SizeOfPageHeaderData;
+		*freespace = *max_avail;
+		return SAMPLE_PAGE_DELETED;
+	}
+
+	if (GinPageIsData(page))
+	{
+		*max_avail = GinDataPageMaxDataSize;
+
+		if (!GinPageIsLeaf(page))
+		{
+			*freespace = GinNonLeafDataPageGetFreeSpace(page);
+			return SAMPLE_PAGE_INTERNAL;
+		}
+
+		if (GinPageIsCompressed(page))
+			*freespace = GinDataPageMaxDataSize -
+				GinDataLeafPageGetPostingListSize(page);
+		else
+			*freespace = GinDataPageMaxDataSize -
+				GinPageGetOpaque(page)->maxoff * sizeof(ItemPointerData);
+		return SAMPLE_PAGE_LEAF;
+	}
+
+	*max_avail = ((PageHeader) page)->pd_special - SizeOfPageHeaderData;
+	*freespace = PageGetExactFreeSpace(page);
+
+	if (GinPageIsList(page))
+		return SAMPLE_PAGE_OTHER;
+
+	return GinPageIsLeaf(page) ? SAMPLE_PAGE_LEAF : SAMPLE_PAGE_INTERNAL;
+}
+
+/*
+ * Returns btree or GIN index statistics estimated from a random sample of
+ * its pages.
+ */
+Datum
+pgstatindex_sample(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		sample_pages = PG_GETARG_INT32(1);
+	Relation	rel;
+	bool		is_btree;
+	BlockNumber nblocks;
+	BlockSampleScan scan;
+	Buffer		buf;
+	uint64		sampled = 0;
+	uint64		internal_pages = 0;
+	uint64		leaf_pages = 0;
+	uint64		deleted_pages = 0;
+	uint64		fragments = 0;
+	SampleMean	density = {0},
+				freesp = {0};
+	double		npages;
+	double		scale = 0;
+	double		margin;
+	TupleDesc	tupdesc;
+	bool		nulls[NUM_INDEX_OUTPUT_COLUMNS];
+	Datum		values[NUM_INDEX_OUTPUT_COLUMNS];
+	HeapTuple	ret;
+	int			i = 0;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to use pgstattuple functions"))));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (tupdesc->natts != NUM_INDEX_OUTPUT_COLUMNS)
+		elog(ERROR, "incorrect number of output arguments");
+
+	rel = relation_open(relid, AccessShareLock);
+
+	if (rel->rd_rel->relkind != RELKIND_INDEX ||
+		(rel->rd_rel->relam != BTREE_AM_OID &&
+		 rel->rd_rel->relam != GIN_AM_OID))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("\"%s\" is not a btree or GIN index",
+						RelationGetRelationName(rel))));
+
+	check_sample_args(rel, sample_pages);
+
+	is_btree = (rel->rd_rel->relam == BTREE_AM_OID);
+
+	/* Both access methods keep their metapage in block 0; skip it */
+	nblocks = RelationGetNumberOfBlocks(rel);
+	sample_scan_init(&scan, rel, 1, nblocks, sample_pages);
+
+	while ((buf = sample_scan_next(&scan)) != InvalidBuffer)
+	{
+		Page		page = BufferGetPage(buf);
+		Size		freespace = 0;
+		Size		max_avail = 0;
+		bool		fragment = false;
+		SamplePageType type;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (PageIsNew(page))
+		{
+			/* an unused page left behind by a relation extension */
+			freespace = BLCKSZ - SizeOfPageHeaderData;
+			type = SAMPLE_PAGE_OTHER;
+		}
+		else if (is_btree)
+			type = sample_btree_page(page, BufferGetBlockNumber(buf),
+									 &freespace, &max_avail, &fragment);
+		else
+			type = sample_gin_page(page, &freespace, &max_avail);
+
+		UnlockReleaseBuffer(buf);
+
+		sampled++;
+		switch (type)
+		{
+			case SAMPLE_PAGE_INTERNAL:
+				internal_pages++;
+				break;
+			case SAMPLE_PAGE_LEAF:
+				leaf_pages++;
+				if (fragment)
+					fragments++;
+				if (max_avail > 0)
+					sample_mean_add(&density,
+									100.0 - 100.0 * freespace / max_avail);
+				break;
+			case SAMPLE_PAGE_DELETED:
+				deleted_pages++;
+				break;
+			case SAMPLE_PAGE_OTHER:
+				break;
+		}
+		sample_mean_add(&freesp, 100.0 * freespace / BLCKSZ);
+	}
+
+	relation_close(rel, AccessShareLock);
+
+	/* number of pages we could have sampled */
+	npages = (nblocks > 1) ? nblocks - 1 : 0;
+	if (sampled > 0)
+		scale = npages / sampled;
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[i++] = Int64GetDatum((int64) nblocks * BLCKSZ);
+	values[i++] = Int64GetDatum(sampled);
+	values[i++] = Int64GetDatum((int64) rint(internal_pages * scale));
+	values[i++] = Int64GetDatum((int64) rint(leaf_pages * scale));
+	values[i++] = Int64GetDatum((int64) rint(deleted_pages * scale));
+	if (density.n > 0)
+		values[i++] = Float8GetDatum(sample_mean(&density));
+	else
+		values[i++] = Float8GetDatum(get_float8_nan());
+	nulls[i] = !sample_margin(&density, leaf_pages * scale, &margin);
+	values[i++] = Float8GetDatum(margin);
+	values[i++] = Float8GetDatum(sample_mean(&freesp));
+	nulls[i] = !sample_margin(&freesp, npages, &margin);
+	values[i++] = Float8GetDatum(margin);
+	if (is_btree && leaf_pages > 0)
+		values[i++] = Float8GetDatum(100.0 * fragments / leaf_pages);
+	else
+		nulls[i++] = true;
+
+	ret = heap_form_tuple(tupdesc, values, nulls);
+	return HeapTupleGetDatum(ret);
+}
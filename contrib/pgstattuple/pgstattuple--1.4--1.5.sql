@@ -0,0 +1,37 @@
+/* contrib/pgstattuple/pgstattuple--1.4--1.5.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pgstattuple UPDATE TO '1.5'" to load this file. \quit
+
+CREATE FUNCTION pgstattuple_sample(IN reloid regclass,
+    IN sample_pages integer DEFAULT 1000,
+    OUT table_len BIGINT,               -- physical table length in bytes
+    OUT sampled_pages BIGINT,           -- number of pages read
+    OUT approx_tuple_count BIGINT,      -- estimated number of live tuples
+    OUT approx_tuple_len BIGINT,        -- estimated total length in bytes of live tuples
+    OUT approx_tuple_percent FLOAT8,    -- estimated live tuples in %
+    OUT tuple_percent_margin FLOAT8,    -- 95% margin of error of approx_tuple_percent
+    OUT approx_dead_tuple_count BIGINT, -- estimated number of dead tuples
+    OUT approx_dead_tuple_len BIGINT,   -- estimated total length in bytes of dead tuples
+    OUT approx_dead_tuple_percent FLOAT8, -- estimated dead tuples in %
+    OUT dead_tuple_percent_margin FLOAT8, -- 95% margin of error of approx_dead_tuple_percent
+    OUT approx_free_space BIGINT,       -- estimated free space in bytes
+    OUT approx_free_percent FLOAT8,     -- estimated free space in %
+    OUT free_percent_margin FLOAT8)     -- 95% margin of error of approx_free_percent
+AS 'MODULE_PATHNAME', 'pgstattuple_sample'
+LANGUAGE C STRICT PARALLEL SAFE;
+
+CREATE FUNCTION pgstatindex_sample(IN relname regclass,
+    IN sample_pages integer DEFAULT 1000,
+    OUT index_size BIGINT,              -- physical index size in bytes
+    OUT sampled_pages BIGINT,           -- number of pages read
+    OUT approx_internal_pages BIGINT,   -- estimated number of internal pages
+    OUT approx_leaf_pages BIGINT,       -- estimated number of leaf pages
+    OUT approx_deleted_pages BIGINT,    -- estimated number of deleted pages
+    OUT avg_leaf_density FLOAT8,        -- estimated leaf page fill factor in %
+    OUT avg_leaf_density_margin FLOAT8, -- 95% margin of error of avg_leaf_density
+    OUT approx_free_percent FLOAT8,     -- estimated free space in %
+    OUT free_percent_margin FLOAT8,     -- 95% margin of error of approx_free_percent
+    OUT leaf_fragmentation FLOAT8)      -- estimated leaf fragmentation in % (btree only)
+AS 'MODULE_PATHNAME', 'pgstatindex_sample'
+LANGUAGE C STRICT PARALLEL SAFE;
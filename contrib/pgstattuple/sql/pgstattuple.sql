@@ -47,3 +47,19 @@ select pg_relpages(relname) from pg_class where relname = 'test_pkey';
 create index test_ginidx on test using gin (b);
 
 select * from pgstatginindex('test_ginidx');
+
+select * from pgstattuple_sample('test');
+select * from pgstattuple_sample('test', 10);
+select pgstattuple_sample('test', 0);
+
+select index_size / current_setting('block_size')::int as index_size,
+    sampled_pages, approx_internal_pages, approx_leaf_pages,
+    approx_deleted_pages, avg_leaf_density, avg_leaf_density_margin,
+    free_percent_margin, leaf_fragmentation
+    from pgstatindex_sample('test_pkey');
+select index_size / current_setting('block_size')::int as index_size,
+    sampled_pages, approx_internal_pages, approx_leaf_pages,
+    approx_deleted_pages, avg_leaf_density, avg_leaf_density_margin,
+    free_percent_margin, leaf_fragmentation
+    from pgstatindex_sample('test_ginidx');
+select * from pgstatindex_sample('test');
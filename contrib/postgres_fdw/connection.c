@@ -59,6 +59,7 @@ typedef struct ConnCacheEntry
 	bool		invalidated;	/* true if reconnect is pending */
 	uint32		server_hashvalue;	/* hash value of foreign server OID */
 	uint32		mapping_hashvalue;	/* hash value of user mapping OID */
+	PgFdwConnState state;		/* extra per-connection state */
 } ConnCacheEntry;
 
 /*
@@ -111,9 +112,12 @@ static bool pgfdw_get_cleanup_result(PGconn *conn, TimestampTz endtime,
  * will_prep_stmt must be true if caller intends to create any prepared
  * statements.  Since those don't go away automatically at transaction end
  * (not even on error), we need this flag to cue manual cleanup.
+ *
+ * If state is not NULL, *state receives the per-connection state associated
+ * with the PGconn.
  */
 PGconn *
-GetConnection(UserMapping *user, bool will_prep_stmt)
+GetConnection(UserMapping *user, bool will_prep_stmt, PgFdwConnState **state)
 {
 	bool		found;
 	ConnCacheEntry *entry;
@@ -199,6 +203,7 @@ GetConnection(UserMapping *user, bool will_prep_stmt)
 		entry->have_error = false;
 		entry->changing_xact_state = false;
 		entry->invalidated = false;
+		memset(&entry->state, 0, sizeof(entry->state));
 		entry->server_hashvalue =
 			GetSysCacheHashValue1(FOREIGNSERVEROID,
 								  ObjectIdGetDatum(server->serverid));
@@ -213,6 +218,13 @@ GetConnection(UserMapping *user, bool will_prep_stmt)
 			 entry->conn, server->servername, user->umid, user->userid);
 	}
 
+	/*
+	 * If an asynchronous fetch is still in flight on this connection, collect
+	 * its result before we send anything else.
+	 */
+	if (entry->state.pending_scan)
+		process_pending_request(&entry->state);
+
 	/*
 	 * Start a new transaction or subtransaction if needed.
 	 */
@@ -221,6 +233,9 @@ GetConnection(UserMapping *user, bool will_prep_stmt)
 	/* Remember if caller will prepare statements */
 	entry->have_prep_stmt |= will_prep_stmt;
 
+	if (state)
+		*state = &entry->state;
+
 	return entry->conn;
 }
 
@@ -486,45 +501,52 @@ begin_remote_xact(ConnCacheEntry *entry)
 			sql = "START TRANSACTION ISOLATION LEVEL SERIALIZABLE";
 		else
 			sql = "START TRANSACTION ISOLATION LEVEL REPEATABLE READ";
-		entry->changing_xact_state = true;
-		do_sql_command(entry->conn, sql);
-		entry->xact_depth = 1;
-		entry->changing_xact_state = false;
 
-		if (UseTsDtmTransactions)
+		if (UseTsDtmTransactions && currentConnection != NULL && entry->conn != currentConnection)
 		{
-			if (currentConnection == NULL) 
-			{
-				currentConnection = entry->conn;
-			} 
-			else if (entry->conn != currentConnection)
+			/*
+			 * Join global transaction: dtm_access is sent in the same query
+			 * string as START TRANSACTION to save a round trip to the shard.
+			 */
+			if (!currentGlobalTransactionId)
 			{
-				if (!currentGlobalTransactionId)
-				{	
-					char	   *resp;
-					res = PQexec(currentConnection, psprintf("SELECT public.dtm_extend('%d.%d')",
-															 MyProcPid, ++currentLocalTransactionId));
-					
-					if (PQresultStatus(res) != PGRES_TUPLES_OK)
-					{
-						pgfdw_report_error(ERROR, res, currentConnection, true, sql);
-					}
-					resp = PQgetvalue(res, 0, 0);
-					if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &currentGlobalTransactionId) != 1)
-					{
-						pgfdw_report_error(ERROR, res, currentConnection, true, sql);
-					}
-					PQclear(res);
-				}
-				res = PQexec(entry->conn, psprintf("SELECT public.dtm_access(%llu, '%d.%d')", currentGlobalTransactionId, MyProcPid, currentLocalTransactionId));
+				char	   *resp;
+				char	   *extend = psprintf("SELECT public.dtm_extend('%d.%d')",
+											  MyProcPid, ++currentLocalTransactionId);
 
+				res = pgfdw_exec_query(currentConnection, extend);
 				if (PQresultStatus(res) != PGRES_TUPLES_OK)
 				{
-					pgfdw_report_error(ERROR, res, entry->conn, true, sql);
+					pgfdw_report_error(ERROR, res, currentConnection, true, extend);
+				}
+				resp = PQgetvalue(res, 0, 0);
+				if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &currentGlobalTransactionId) != 1)
+				{
+					pgfdw_report_error(ERROR, res, currentConnection, true, extend);
 				}
 				PQclear(res);
 			}
+			sql = psprintf("%s; SELECT public.dtm_access(%llu, '%d.%d')",
+						   sql, currentGlobalTransactionId, MyProcPid, currentLocalTransactionId);
+			entry->changing_xact_state = true;
+			res = pgfdw_exec_query(entry->conn, sql);
+			if (PQresultStatus(res) != PGRES_TUPLES_OK)
+			{
+				pgfdw_report_error(ERROR, res, entry->conn, true, sql);
+			}
+			PQclear(res);
+		}
+		else
+		{
+			entry->changing_xact_state = true;
+			do_sql_command(entry->conn, sql);
+			if (UseTsDtmTransactions && currentConnection == NULL)
+			{
+				currentConnection = entry->conn;
+			}
 		}
+		entry->xact_depth = 1;
+		entry->changing_xact_state = false;
 	}
 
 	/*
@@ -736,6 +758,12 @@ pgfdw_report_error(int elevel, PGresult *res, PGconn *conn,
 
 typedef bool (*DtmCommandResultHandler) (PGresult *result, void *arg);
 
+/*
+ * Broadcast statement to all participants of the global transaction and then
+ * collect the replies, so the shards execute it concurrently.
+ * The statement may consist of several commands: the result of the last one
+ * is checked and passed to the handler.
+ */
 static bool
 RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandler handler, void *arg)
 {
@@ -757,7 +785,7 @@ RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandl
 	{
 		if (entry->xact_depth > 0)
 		{
-			PGresult   *result = PQgetResult(entry->conn);
+			PGresult   *result = pgfdw_get_result(entry->conn, sql);
 
 			if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
 			{
@@ -766,22 +794,81 @@ RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandl
 				allOk = false;
 			}
 			PQclear(result);
-			PQgetResult(entry->conn);	/* consume NULL result */
 		}
 	}
 	return allOk;
 }
 
+/*
+ * Send a sequence of statements to all participants of the global transaction
+ * in pipeline mode, so that each shard executes them one after another without
+ * waiting for us and the whole sequence costs a single round trip.
+ * There is no sync point between the statements: if one of them fails at a
+ * shard, the following ones are not executed there.
+ * Results are collected from all shards before reporting failure, so that
+ * connections leave pipeline mode and can be used for the cleanup.
+ */
 static bool
-RunDtmCommand(char const * sql)
+RunDtmPipeline(int nStmts, char const * const * sql, ExecStatusType const * expectedStatus)
 {
-	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
+	HASH_SEQ_STATUS scan;
+	ConnCacheEntry *entry;
+	bool		allOk = true;
+	int			i;
+
+	hash_seq_init(&scan, ConnectionHash);
+	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (entry->xact_depth > 0)
+		{
+			if (!PQenterPipelineMode(entry->conn))
+				pgfdw_report_error(ERROR, NULL, entry->conn, false, sql[0]);
+			for (i = 0; i < nStmts; i++)
+			{
+				if (!PQsendQueryParams(entry->conn, sql[i], 0, NULL, NULL, NULL, NULL, 0))
+					pgfdw_report_error(ERROR, NULL, entry->conn, false, sql[i]);
+			}
+			if (!PQpipelineSync(entry->conn))
+				pgfdw_report_error(ERROR, NULL, entry->conn, false, sql[nStmts-1]);
+		}
+	}
+
+	hash_seq_init(&scan, ConnectionHash);
+	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (entry->xact_depth > 0)
+		{
+			PGresult   *result;
+
+			for (i = 0; i < nStmts; i++)
+			{
+				result = pgfdw_get_result(entry->conn, sql[i]);
+				if (PQresultStatus(result) != expectedStatus[i])
+				{
+					if (PQresultStatus(result) != PGRES_PIPELINE_ABORTED)
+						elog(WARNING, "Failed command %s: status=%d, expected status=%d, error=%s",
+							 sql[i], PQresultStatus(result), expectedStatus[i],
+							 result ? PQresultErrorMessage(result) : PQerrorMessage(entry->conn));
+					allOk = false;
+				}
+				PQclear(result);
+			}
+			/* sync point result is not followed by NULL, so fetch it directly */
+			result = PQgetResult(entry->conn);
+			if (PQresultStatus(result) != PGRES_PIPELINE_SYNC)
+				allOk = false;
+			PQclear(result);
+			if (!PQexitPipelineMode(entry->conn))
+				allOk = false;
+		}
+	}
+	return allOk;
 }
 
 static bool
-RunDtmFunction(char const * sql)
+RunDtmCommand(char const * sql)
 {
-	return RunDtmStatement(sql, PGRES_TUPLES_OK, NULL, NULL);
+	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
 }
 
 
@@ -841,17 +928,36 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 			case XACT_EVENT_PRE_COMMIT:
 				{
 					csn_t		maxCSN = 0;
+					char const *commitStmts[2];
+					static ExecStatusType const commitStatus[2] = {PGRES_TUPLES_OK, PGRES_COMMAND_OK};
 
-					if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'",
-									MyProcPid, currentLocalTransactionId)) ||
-						!RunDtmFunction(psprintf("SELECT public.dtm_begin_prepare('%d.%d')",
-									MyProcPid, currentLocalTransactionId)) ||
-						!RunDtmStatement(psprintf("SELECT public.dtm_prepare('%d.%d',0)",
-												  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
-						!RunDtmFunction(psprintf("SELECT public.dtm_end_prepare('%d.%d',%lld)",
-							MyProcPid, currentLocalTransactionId, maxCSN)) ||
-						!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'",
-									  MyProcPid, currentLocalTransactionId)))
+					/*
+					 * PREPARE TRANSACTION, dtm_begin_prepare and dtm_prepare
+					 * are sent to all shards as one query string, so that
+					 * maximal CSN is collected in a single round trip.
+					 * COMMIT PREPARED can not be part of multi-command string,
+					 * so it is pipelined after dtm_end_prepare instead: it is
+					 * skipped at the shard if dtm_end_prepare fails there.
+					 */
+					if (!RunDtmStatement(psprintf("PREPARE TRANSACTION '%d.%d'; "
+												  "SELECT public.dtm_begin_prepare('%d.%d'); "
+												  "SELECT public.dtm_prepare('%d.%d',0)",
+												  MyProcPid, currentLocalTransactionId,
+												  MyProcPid, currentLocalTransactionId,
+												  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN))
+					{
+						RunDtmCommand(psprintf("ROLLBACK PREPARED '%d.%d'",
+									  MyProcPid, currentLocalTransactionId));
+						ereport(ERROR,
+								(errcode(ERRCODE_TRANSACTION_ROLLBACK),
+								 errmsg("transaction was aborted at one of the shards")));
+						break;
+					}
+					commitStmts[0] = psprintf("SELECT public.dtm_end_prepare('%d.%d',%lld)",
+											  MyProcPid, currentLocalTransactionId, maxCSN);
+					commitStmts[1] = psprintf("COMMIT PREPARED '%d.%d'",
+											  MyProcPid, currentLocalTransactionId);
+					if (!RunDtmPipeline(2, commitStmts, commitStatus))
 					{
 						RunDtmCommand(psprintf("ROLLBACK PREPARED '%d.%d'",
 									  MyProcPid, currentLocalTransactionId));
@@ -899,7 +1005,12 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 					 */
 					pgfdw_reject_incomplete_xact_state_change(entry);
 
-					/* Commit all remote transactions during pre-commit */
+					/*
+					 * Commit all remote transactions during pre-commit.  The
+					 * COMMITs are sent to all servers first, and their
+					 * results collected below, so that they run concurrently.
+					 */
+					entry->changing_xact_state = true;
 					do_sql_send_command(entry->conn, "COMMIT TRANSACTION");
 					continue;
 
@@ -922,12 +1033,6 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 				case XACT_EVENT_PARALLEL_COMMIT:
 				case XACT_EVENT_COMMIT:
 				case XACT_EVENT_PREPARE:
-					if (!currentGlobalTransactionId)
-					{
-						entry->changing_xact_state = true;
-						do_sql_command(entry->conn, "COMMIT TRANSACTION");
-						entry->changing_xact_state = false;
-					}
 					/*
 					 * If there were any errors in subtransactions, and we
 					 * made prepared statements, do a DEALLOCATE ALL to make
@@ -985,7 +1090,12 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 					 * command is still being processed by the remote server,
 					 * and if so, request cancellation of the command.
 					 */
-					if (PQtransactionStatus(entry->conn) == PQTRANS_ACTIVE &&
+					if (PQpipelineStatus(entry->conn) != PQ_PIPELINE_OFF)
+					{
+						/* Left in the middle of pipelined commit protocol */
+						abort_cleanup_failure = true;
+					}
+					else if (PQtransactionStatus(entry->conn) == PQTRANS_ACTIVE &&
 						!pgfdw_cancel_query(entry->conn))
 					{
 						/* Unable to cancel running query. */
@@ -1029,6 +1139,9 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 		/* Reset state to show we're out of a transaction */
 		entry->xact_depth = 0;
 
+		/* Any in-flight asynchronous fetch is gone along with the xact */
+		entry->state.pending_scan = NULL;
+
 		/*
 		 * If the connection isn't in a good idle state, discard it to
 		 * recover. Next GetConnection will open a new connection.
@@ -1041,7 +1154,23 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 			disconnect_pg_server(entry);
 		}
 	}
-	if (event != XACT_EVENT_PARALLEL_PRE_COMMIT && event != XACT_EVENT_PRE_COMMIT)
+	if (event == XACT_EVENT_PARALLEL_PRE_COMMIT || event == XACT_EVENT_PRE_COMMIT)
+	{
+		/*
+		 * Wait for the COMMITs sent above.  This must happen before we commit
+		 * locally, so that a failure at any server aborts our transaction.
+		 */
+		hash_seq_init(&scan, ConnectionHash);
+		while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+		{
+			if (entry->conn == NULL || entry->xact_depth == 0)
+				continue;
+
+			do_sql_wait_command(entry->conn, "COMMIT TRANSACTION");
+			entry->changing_xact_state = false;
+		}
+	}
+	else
 	{
 		/*
 		 * Regardless of the event type, we can now mark ourselves as out of
@@ -1152,6 +1281,9 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
 					abort_cleanup_failure = true;
 			}
 
+			/* Any in-flight asynchronous fetch was cancelled or consumed */
+			entry->state.pending_scan = NULL;
+
 			/* Disarm changing_xact_state if it all worked. */
 			entry->changing_xact_state = abort_cleanup_failure;
 		}
@@ -20,6 +20,15 @@
 
 #include "libpq-fe.h"
 
+/*
+ * Extra control information relating to a connection.
+ */
+typedef struct PgFdwConnState
+{
+	/* scan whose asynchronous FETCH is in flight on this connection, if any */
+	struct ForeignScanState *pending_scan;
+} PgFdwConnState;
+
 /*
  * FDW-specific planner information kept in RelOptInfo.fdw_private for a
  * foreign table.  This information is collected by postgresGetForeignRelSize.
@@ -44,6 +53,8 @@ typedef struct PgFdwRelationInfo
 	 * For a join relation, however, they are part of otherclause list
 	 * obtained from extract_actual_join_clauses, which strips RestrictInfo
 	 * construct. So, for a join relation they are list of bare clauses.
+	 * Likewise, for an upper (grouping) relation they are the bare HAVING
+	 * clauses.
 	 */
 	List	   *remote_conds;
 	List	   *local_conds;
@@ -72,6 +83,7 @@ typedef struct PgFdwRelationInfo
 	Cost		fdw_startup_cost;
 	Cost		fdw_tuple_cost;
 	List	   *shippable_extensions;	/* OIDs of whitelisted extensions */
+	bool		async_capable;	/* may be scanned asynchronously by Append */
 
 	/* Cached catalog information. */
 	ForeignTable *table;
@@ -82,24 +94,30 @@ typedef struct PgFdwRelationInfo
 
 	/*
 	 * Name of the relation while EXPLAINing ForeignScan. It is used for join
-	 * relations but is set for all relations. For join relation, the name
-	 * indicates which foreign tables are being joined and the join type used.
+	 * and upper relations but is set for all relations. For join relation,
+	 * the name indicates which foreign tables are being joined and the join
+	 * type used; for an upper relation, what is being aggregated.
 	 */
 	StringInfo	relation_name;
 
-	/* Join information */
+	/* Join information; outerrel is also the input rel of an upper rel */
 	RelOptInfo *outerrel;
 	RelOptInfo *innerrel;
 	JoinType	jointype;
 	List	   *joinclauses;
+
+	/* Grouping information */
+	List	   *grouped_tlist;
 } PgFdwRelationInfo;
 
 /* in postgres_fdw.c */
 extern int	set_transmission_modes(void);
 extern void reset_transmission_modes(int nestlevel);
+extern void process_pending_request(PgFdwConnState *conn_state);
 
 /* in connection.c */
-extern PGconn *GetConnection(UserMapping *user, bool will_prep_stmt);
+extern PGconn *GetConnection(UserMapping *user, bool will_prep_stmt,
+			  PgFdwConnState **state);
 extern void ReleaseConnection(PGconn *conn);
 extern unsigned int GetCursorNumber(PGconn *conn);
 extern unsigned int GetPrepStmtNumber(PGconn *conn);
@@ -127,7 +145,9 @@ extern bool is_foreign_expr(PlannerInfo *root,
 extern void deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, bool doNothing, List *returningList,
-				 List **retrieved_attrs);
+				 List **retrieved_attrs, int *values_end_len);
+extern void rebuildInsertSql(StringInfo buf, char *orig_query,
+				 int values_end_len, int num_params, int num_rows);
 extern void deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, List *returningList,
@@ -1423,3 +1423,95 @@ WHERE ftrelid = 'table30000'::regclass
 AND ftoptions @> array['fetch_size=60000'];
 
 ROLLBACK;
+
+-- ===================================================================
+-- test asynchronous execution
+-- ===================================================================
+ALTER SERVER loopback OPTIONS (ADD async_capable 'true');
+ALTER SERVER loopback2 OPTIONS (ADD async_capable 'true');
+CREATE TABLE async_t1 (a int, b text);
+CREATE TABLE async_t2 (a int, b text);
+CREATE TABLE async_t3 (a int, b text);
+INSERT INTO async_t1 SELECT i, 'one' FROM generate_series(1, 300) i;
+INSERT INTO async_t2 SELECT i, 'two' FROM generate_series(1, 200) i;
+INSERT INTO async_t3 SELECT i, 'three' FROM generate_series(1, 100) i;
+CREATE FOREIGN TABLE async_f1 (a int, b text)
+  SERVER loopback OPTIONS (table_name 'async_t1', fetch_size '50');
+CREATE FOREIGN TABLE async_f2 (a int, b text)
+  SERVER loopback2 OPTIONS (table_name 'async_t2', fetch_size '50');
+-- two scans sharing the loopback connection
+CREATE FOREIGN TABLE async_f3 (a int, b text)
+  SERVER loopback OPTIONS (table_name 'async_t3', fetch_size '50');
+
+SELECT b, count(*), sum(a) FROM (
+  SELECT * FROM async_f1 UNION ALL
+  SELECT * FROM async_f2 UNION ALL
+  SELECT * FROM async_f3) ss
+GROUP BY b ORDER BY b;
+-- mixed with a local scan
+SELECT b, count(*), sum(a) FROM (
+  SELECT * FROM async_f1 UNION ALL
+  SELECT * FROM async_t2 UNION ALL
+  SELECT * FROM async_f3) ss
+GROUP BY b ORDER BY b;
+SELECT * FROM (
+  SELECT * FROM async_f1 UNION ALL
+  SELECT * FROM async_f2) ss
+ORDER BY a, b LIMIT 3;
+SET enable_async_append TO off;
+SELECT b, count(*), sum(a) FROM (
+  SELECT * FROM async_f1 UNION ALL
+  SELECT * FROM async_f2 UNION ALL
+  SELECT * FROM async_f3) ss
+GROUP BY b ORDER BY b;
+RESET enable_async_append;
+
+DROP FOREIGN TABLE async_f1, async_f2, async_f3;
+DROP TABLE async_t1, async_t2, async_t3;
+ALTER SERVER loopback OPTIONS (DROP async_capable);
+ALTER SERVER loopback2 OPTIONS (DROP async_capable);
+
+-- ===================================================================
+-- test batch insert
+-- ===================================================================
+CREATE TABLE batch_table (x int, y text);
+CREATE FOREIGN TABLE ftable (x int, y text)
+  SERVER loopback OPTIONS (table_name 'batch_table', batch_size '10');
+-- two full batches and a short one
+INSERT INTO ftable SELECT i, 'row ' || i FROM generate_series(1, 25) i;
+SELECT count(*), sum(x), min(y), max(y) FROM ftable;
+INSERT INTO ftable VALUES (26, NULL), (27, 'row 27');
+SELECT count(*), count(y) FROM ftable;
+-- RETURNING makes rows go one at a time
+INSERT INTO ftable VALUES (28, 'row 28') RETURNING *;
+SELECT * FROM ftable WHERE x > 25 ORDER BY x;
+ALTER FOREIGN TABLE ftable OPTIONS (SET batch_size '0');
+DROP FOREIGN TABLE ftable;
+DROP TABLE batch_table;
+
+-- ===================================================================
+-- test aggregate pushdown
+-- ===================================================================
+CREATE TABLE agg_table (a int, b int, c text);
+CREATE FOREIGN TABLE agg_ftable (a int, b int, c text)
+  SERVER loopback OPTIONS (table_name 'agg_table');
+INSERT INTO agg_table SELECT i, i % 3, 'grp ' || (i % 3) FROM generate_series(1, 30) i;
+-- grouping and aggregates are computed on the remote side
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT b, count(*), sum(a) FROM agg_ftable GROUP BY b ORDER BY b;
+SELECT b, count(*), sum(a) FROM agg_ftable GROUP BY b ORDER BY b;
+-- so are WHERE and HAVING clauses
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT b, max(a) FROM agg_ftable WHERE a > 5 GROUP BY b HAVING avg(a) > 18 ORDER BY b;
+SELECT b, max(a) FROM agg_ftable WHERE a > 5 GROUP BY b HAVING avg(a) > 18 ORDER BY b;
+-- DISTINCT, ORDER BY and FILTER within aggregates, grouping by an expression
+SELECT a % 2, count(DISTINCT b), string_agg(c, ',' ORDER BY c DESC) FILTER (WHERE a < 10)
+  FROM agg_ftable GROUP BY a % 2 ORDER BY 1;
+-- aggregate over a foreign join
+SELECT count(*) FROM agg_ftable t1 JOIN agg_ftable t2 ON (t1.a = t2.b);
+-- HAVING clauses that can't be shipped are checked locally
+ALTER SERVER loopback OPTIONS (DROP extensions);
+SELECT b, sum(a) FROM agg_ftable GROUP BY b HAVING max(a) === 30 ORDER BY b;
+ALTER SERVER loopback OPTIONS (ADD extensions 'postgres_fdw');
+DROP FOREIGN TABLE agg_ftable;
+DROP TABLE agg_table;
@@ -980,6 +980,13 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
 	bool		slow;			/* can we use/set attcacheoff? */
 
+	/* use code generated for the slot's tuple descriptor, if any */
+	if (slot->tts_deform != NULL)
+	{
+		slot->tts_deform(slot, natts);
+		return;
+	}
+
 	/*
 	 * Check whether the first call for this tuple, and initialize or restore
 	 * loop state.
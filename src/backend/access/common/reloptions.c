@@ -21,6 +21,7 @@
 #include "access/nbtree.h"
 #include "access/reloptions.h"
 #include "access/spgist.h"
+#include "access/tuptoaster.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "commands/tablespace.h"
@@ -81,6 +82,25 @@ static relopt_bool boolRelOpts[] =
 		},
 		true
 	},
+	{
+		{
+			"deduplicate_items",
+			"Enables \"deduplicate items\" feature for this btree index",
+			RELOPT_KIND_BTREE,
+			ShareUpdateExclusiveLock	/* since it applies only to later
+										 * inserts */
+		},
+		true
+	},
+	{
+		{
+			"autosummarize",
+			"Enables automatic summarization on this BRIN index",
+			RELOPT_KIND_BRIN,
+			AccessExclusiveLock
+		},
+		false
+	},
 	{
 		{
 			"security_barrier",
@@ -273,6 +293,24 @@ static relopt_int intRelOpts[] =
 		0, 0, 0
 #endif
 	},
+	{
+		{
+			"max_write_rate",
+			"Maximum rate of background writes to the tablespace, in kilobytes per second.",
+			RELOPT_KIND_TABLESPACE,
+			AccessExclusiveLock
+		},
+		-1, 0, INT_MAX
+	},
+	{
+		{
+			"max_write_iops",
+			"Maximum number of background writes to the tablespace per second.",
+			RELOPT_KIND_TABLESPACE,
+			AccessExclusiveLock
+		},
+		-1, 0, INT_MAX
+	},
 	{
 		{
 			"parallel_workers",
@@ -373,6 +411,18 @@ static relopt_string stringRelOpts[] =
 		validateWithCheckOption,
 		NULL
 	},
+	{
+		{
+			"compression",
+			"Sets the compression method for values of this column.",
+			RELOPT_KIND_ATTRIBUTE,
+			AccessExclusiveLock
+		},
+		0,
+		true,
+		validateToastCompressionOption,
+		NULL
+	},
 	/* list terminator */
 	{{NULL}}
 };
@@ -1419,7 +1469,8 @@ attribute_reloptions(Datum reloptions, bool validate)
 	int			numoptions;
 	static const relopt_parse_elt tab[] = {
 		{"n_distinct", RELOPT_TYPE_REAL, offsetof(AttributeOpts, n_distinct)},
-		{"n_distinct_inherited", RELOPT_TYPE_REAL, offsetof(AttributeOpts, n_distinct_inherited)}
+		{"n_distinct_inherited", RELOPT_TYPE_REAL, offsetof(AttributeOpts, n_distinct_inherited)},
+		{"compression", RELOPT_TYPE_STRING, offsetof(AttributeOpts, compression_offset)}
 	};
 
 	options = parseRelOptions(reloptions, validate, RELOPT_KIND_ATTRIBUTE,
@@ -1451,7 +1502,9 @@ tablespace_reloptions(Datum reloptions, bool validate)
 	static const relopt_parse_elt tab[] = {
 		{"random_page_cost", RELOPT_TYPE_REAL, offsetof(TableSpaceOpts, random_page_cost)},
 		{"seq_page_cost", RELOPT_TYPE_REAL, offsetof(TableSpaceOpts, seq_page_cost)},
-		{"effective_io_concurrency", RELOPT_TYPE_INT, offsetof(TableSpaceOpts, effective_io_concurrency)}
+		{"effective_io_concurrency", RELOPT_TYPE_INT, offsetof(TableSpaceOpts, effective_io_concurrency)},
+		{"max_write_rate", RELOPT_TYPE_INT, offsetof(TableSpaceOpts, max_write_rate)},
+		{"max_write_iops", RELOPT_TYPE_INT, offsetof(TableSpaceOpts, max_write_iops)}
 	};
 
 	options = parseRelOptions(reloptions, validate, RELOPT_KIND_TABLESPACE,
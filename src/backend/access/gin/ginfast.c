@@ -45,6 +45,8 @@ typedef struct KeyArray
 	int32		maxvalues;		/* allocated size of arrays */
 } KeyArray;
 
+static bool ginAutovacuumCleansUp(Relation index);
+
 
 /*
  * Build a pending-list page from the given array of tuples, and write it out.
@@ -229,6 +231,7 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	bool		separateList = false;
 	bool		needCleanup = false;
 	int			cleanupSize;
+	int64		pendingSize;
 	bool		needWal;
 
 	if (collector->ntuples == 0)
@@ -431,17 +434,62 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	 * ginInsertCleanup() should not be called inside our CRIT_SECTION.
 	 */
 	cleanupSize = GinGetPendingListCleanupSize(index);
-	if (metadata->nPendingPages * GIN_PAGE_FREESIZE > cleanupSize * 1024L)
+	pendingSize = (int64) metadata->nPendingPages * GIN_PAGE_FREESIZE;
+	if (pendingSize > cleanupSize * 1024L)
 		needCleanup = true;
 
 	UnlockReleaseBuffer(metabuffer);
 
 	END_CRIT_SECTION();
 
-	if (needCleanup)
+	if (!needCleanup)
+		return;
+
+	/*
+	 * The cleanup can take long, and we'd rather not make the inserting
+	 * transaction wait for it, so ask autovacuum to do it instead.  Pages are
+	 * only added to the list when we've made a sublist, so asking each time
+	 * that happens keeps the requests infrequent.  We clean up ourselves only
+	 * if the list has grown far past the limit anyway, which means autovacuum
+	 * isn't keeping up, or if autovacuum won't help: when it's disabled for
+	 * the table, the index is temporary, or its work queue is full.
+	 */
+	if (!ginAutovacuumCleansUp(index) ||
+		pendingSize > (int64) cleanupSize * 1024L *
+		GIN_PENDING_LIST_EMERGENCY_FACTOR)
+		ginInsertCleanup(ginstate, false, true, NULL);
+	else if (separateList &&
+			 !AutoVacuumRequestWork(AVW_GINCleanPendingList,
+									RelationGetRelid(index),
+									InvalidBlockNumber))
 		ginInsertCleanup(ginstate, false, true, NULL);
 }
 
+/*
+ * Can we leave pending list cleanup of this index to autovacuum?
+ */
+static bool
+ginAutovacuumCleansUp(Relation index)
+{
+	Relation	heapRel;
+	bool		result = true;
+
+	if (!AutoVacuumingActive() || RelationUsesLocalBuffers(index))
+		return false;
+
+	/* the inserter has the table locked, so this is just a cache lookup */
+	heapRel = RelationIdGetRelation(index->rd_index->indrelid);
+	if (RelationIsValid(heapRel))
+	{
+		if (heapRel->rd_options &&
+			!((StdRdOptions *) heapRel->rd_options)->autovacuum.enabled)
+			result = false;
+		RelationClose(heapRel);
+	}
+
+	return result;
+}
+
 /*
  * Create temporary index tuples for a single indexable item (one index column
  * for the heap tuple specified by ht_ctid), and append them to the array
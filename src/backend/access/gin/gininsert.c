@@ -9,21 +9,119 @@
  *
  * IDENTIFICATION
  *			src/backend/access/gin/gininsert.c
+ *
+ * NOTES
+ *	  An index build can scan the heap in parallel.  The leader and the
+ *	  workers each take chunks of the heap, collect entries in their own
+ *	  BuildAccumulator, and write it out as a sorted run to a shared temporary
+ *	  file whenever it fills up, instead of inserting into the index.  The
+ *	  leader then merges all the runs by key and inserts each key once, with
+ *	  the TIDs from every run, so that the tree is written in a single pass.
  *-------------------------------------------------------------------------
  */
 
 #include "postgres.h"
 
 #include "access/gin_private.h"
+#include "access/parallel.h"
+#include "access/xact.h"
 #include "access/xloginsert.h"
+#include "catalog/catalog.h"
 #include "catalog/index.h"
+#include "commands/tablespace.h"
+#include "lib/binaryheap.h"
 #include "miscadmin.h"
+#include "optimizer/paths.h"
+#include "storage/buffile.h"
 #include "storage/bufmgr.h"
 #include "storage/smgr.h"
 #include "storage/indexfsm.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"		/* pgrminclude ignore */
+#include "utils/datum.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+
+/* DSM key for parallel GIN builds */
+#define PARALLEL_KEY_GIN_SHARED			UINT64CONST(0xA000000000000011)
+
+/*
+ * The participants of a parallel build take the heap in chunks of this many
+ * blocks, as in a parallel btree build.
+ */
+#define PARALLEL_GIN_CHUNK_BLOCKS	((BlockNumber) (8 * 1024 * 1024 / BLCKSZ))
+
+/*
+ * A parallel build must leave each participant this much of
+ * maintenance_work_mem (in kB) to accumulate entries in, or it uses fewer
+ * workers.
+ */
+#define PARALLEL_GIN_MIN_ACCUM_MEM		32768
+
+/*
+ * The sorted runs of a parallel build.  Run i is a shared BufFile named
+ * after the leader's PID, a per-backend counter and i.
+ */
+typedef struct GinRunSet
+{
+	Oid			tablespace;		/* where the run files go */
+	int			leader_pid;
+	uint32		fileset;
+	int			nruns;			/* # of runs written so far */
+} GinRunSet;
+
+/*
+ * State shared between the leader and the workers of a parallel build
+ */
+typedef struct GinShared
+{
+	Oid			heaprelid;
+	Oid			indexrelid;
+	int			accummem;		/* accumulator memory of each participant,
+								 * in kB */
+	BlockNumber nblocks;		/* # of heap blocks to scan */
+
+	slock_t		mutex;			/* protects everything below */
+	BlockNumber nextblock;		/* first block of the next chunk */
+	GinRunSet	runs;
+	double		reltuples;		/* totals over all participants */
+	double		indtuples;
+	bool		brokenhotchain;
+} GinShared;
+
+/*
+ * Each entry of a run is this header, followed by keylen bytes of key data
+ * and nitems heap TIDs in increasing order.  A header with nitems == 0 ends
+ * the run.  Pass-by-value keys are stored as a whole Datum.
+ */
+typedef struct GinRunEntry
+{
+	OffsetNumber attnum;
+	GinNullCategory category;
+	uint32		keylen;
+	uint32		nitems;
+} GinRunEntry;
 
+/* The leader's read position in one run */
+typedef struct GinRunReader
+{
+	BufFile    *file;
+	OffsetNumber attnum;
+	Datum		key;
+	GinNullCategory category;
+	char	   *keybuf;			/* palloc'd key data, if pass-by-reference */
+	ItemPointerData *items;
+	uint32		nitems;
+} GinRunReader;
+
+/* State of the leader's merge of the runs */
+typedef struct GinMergeState
+{
+	GinState   *ginstate;
+	GinRunReader *readers;
+} GinMergeState;
 
 typedef struct
 {
@@ -33,8 +131,24 @@ typedef struct
 	MemoryContext tmpCtx;
 	MemoryContext funcCtx;
 	BuildAccumulator accum;
+	Size		accumMem;		/* dump the accumulator when it gets this big */
+	GinShared  *ginshared;		/* set if dumping to runs of a parallel build */
 } GinBuildState;
 
+static void ginDumpAccum(GinBuildState *buildstate);
+static int	ginParallelWorkers(Relation heap, IndexInfo *indexInfo);
+static ParallelContext *ginBeginParallel(Relation heap, Relation index,
+				 int nworkers, GinShared **ginsharedp);
+static double ginParallelHeapScan(GinBuildState *buildstate,
+					Relation heap, Relation index, IndexInfo *indexInfo);
+static void ginParallelScanAndAccum(GinShared *ginshared, Relation heap,
+						Relation index, IndexInfo *indexInfo);
+static void ginDumpRun(GinBuildState *buildstate);
+static void ginMergeRuns(GinBuildState *buildstate, GinRunSet *runs);
+static bool ginRunReadEntry(GinState *ginstate, GinRunReader *reader);
+static int	ginRunReaderCompare(Datum a, Datum b, void *arg);
+static void ginRunName(char *name, GinRunSet *runs, int runno);
+
 
 /*
  * Adds array of item pointers to tuple's posting list, or
@@ -280,24 +394,16 @@ ginBuildCallback(Relation index, HeapTuple htup, Datum *values,
 							   values[i], isnull[i],
 							   &htup->t_self);
 
-	/* If we've maxed out our available memory, dump everything to the index */
-	if (buildstate->accum.allocatedMemory >= (Size) maintenance_work_mem * 1024L)
+	/*
+	 * If we've maxed out our available memory, dump everything to the index,
+	 * or to a new run of a parallel build
+	 */
+	if (buildstate->accum.allocatedMemory >= buildstate->accumMem)
 	{
-		ItemPointerData *list;
-		Datum		key;
-		GinNullCategory category;
-		uint32		nlist;
-		OffsetNumber attnum;
-
-		ginBeginBAScan(&buildstate->accum);
-		while ((list = ginGetBAEntry(&buildstate->accum,
-								  &attnum, &key, &category, &nlist)) != NULL)
-		{
-			/* there could be many entries, so be willing to abort here */
-			CHECK_FOR_INTERRUPTS();
-			ginEntryInsert(&buildstate->ginstate, attnum, key, category,
-						   list, nlist, &buildstate->buildStats);
-		}
+		if (buildstate->ginshared)
+			ginDumpRun(buildstate);
+		else
+			ginDumpAccum(buildstate);
 
 		MemoryContextReset(buildstate->tmpCtx);
 		ginInitBA(&buildstate->accum);
@@ -306,6 +412,29 @@ ginBuildCallback(Relation index, HeapTuple htup, Datum *values,
 	MemoryContextSwitchTo(oldCtx);
 }
 
+/*
+ * Insert all entries collected in the BuildAccumulator into the index.
+ */
+static void
+ginDumpAccum(GinBuildState *buildstate)
+{
+	ItemPointerData *list;
+	Datum		key;
+	GinNullCategory category;
+	uint32		nlist;
+	OffsetNumber attnum;
+
+	ginBeginBAScan(&buildstate->accum);
+	while ((list = ginGetBAEntry(&buildstate->accum,
+								 &attnum, &key, &category, &nlist)) != NULL)
+	{
+		/* there could be many entries, so be willing to abort here */
+		CHECK_FOR_INTERRUPTS();
+		ginEntryInsert(&buildstate->ginstate, attnum, key, category,
+					   list, nlist, &buildstate->buildStats);
+	}
+}
+
 IndexBuildResult *
 ginbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 {
@@ -314,12 +443,7 @@ ginbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	GinBuildState buildstate;
 	Buffer		RootBuffer,
 				MetaBuffer;
-	ItemPointerData *list;
-	Datum		key;
-	GinNullCategory category;
-	uint32		nlist;
 	MemoryContext oldCtx;
-	OffsetNumber attnum;
 
 	if (RelationGetNumberOfBlocks(index) != 0)
 		elog(ERROR, "index \"%s\" already contains data",
@@ -384,26 +508,24 @@ ginbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 
 	buildstate.accum.ginstate = &buildstate.ginstate;
 	ginInitBA(&buildstate.accum);
+	buildstate.accumMem = (Size) maintenance_work_mem * 1024L;
+	buildstate.ginshared = NULL;
 
-	/*
-	 * Do the heap scan.  We disallow sync scan here because dataPlaceToPage
-	 * prefers to receive tuples in TID order.
-	 */
-	reltuples = IndexBuildHeapScan(heap, index, indexInfo, false,
-								   ginBuildCallback, (void *) &buildstate);
-
-	/* dump remaining entries to the index */
-	oldCtx = MemoryContextSwitchTo(buildstate.tmpCtx);
-	ginBeginBAScan(&buildstate.accum);
-	while ((list = ginGetBAEntry(&buildstate.accum,
-								 &attnum, &key, &category, &nlist)) != NULL)
+	reltuples = ginParallelHeapScan(&buildstate, heap, index, indexInfo);
+	if (reltuples < 0)
 	{
-		/* there could be many entries, so be willing to abort here */
-		CHECK_FOR_INTERRUPTS();
-		ginEntryInsert(&buildstate.ginstate, attnum, key, category,
-					   list, nlist, &buildstate.buildStats);
+		/*
+		 * Do the heap scan.  We disallow sync scan here because
+		 * dataPlaceToPage prefers to receive tuples in TID order.
+		 */
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, false,
+									 ginBuildCallback, (void *) &buildstate);
+
+		/* dump remaining entries to the index */
+		oldCtx = MemoryContextSwitchTo(buildstate.tmpCtx);
+		ginDumpAccum(&buildstate);
+		MemoryContextSwitchTo(oldCtx);
 	}
-	MemoryContextSwitchTo(oldCtx);
 
 	MemoryContextDelete(buildstate.funcCtx);
 	MemoryContextDelete(buildstate.tmpCtx);
@@ -524,3 +646,568 @@ gininsert(Relation index, Datum *values, bool *isnull,
 
 	return false;
 }
+
+
+/*
+ * Parallel build support
+ */
+
+
+/*
+ * ginParallelWorkers - how many workers to use for building an index
+ *
+ * Returns 0 to build the index serially.  This follows the same rules as a
+ * parallel btree build; see _bt_parallel_workers.
+ */
+static int
+ginParallelWorkers(Relation heap, IndexInfo *indexInfo)
+{
+	BlockNumber nblocks;
+	int			threshold;
+	int			nworkers;
+
+	if (max_parallel_index_build_workers <= 0 || !IsUnderPostmaster ||
+		!ActiveSnapshotSet() ||
+		indexInfo->ii_Concurrent ||
+		indexInfo->ii_Expressions != NIL ||
+		indexInfo->ii_Predicate != NIL ||
+		RelationUsesLocalBuffers(heap) ||
+		IsCatalogRelation(heap))
+		return 0;
+
+	nblocks = RelationGetNumberOfBlocks(heap);
+	if (nblocks < (BlockNumber) min_parallel_relation_size)
+		return 0;
+
+	nworkers = 1;
+	threshold = Max(min_parallel_relation_size, 1);
+	while (nblocks >= (BlockNumber) (threshold * 3))
+	{
+		nworkers++;
+		threshold *= 3;
+		if (threshold > INT_MAX / 3)
+			break;				/* avoid overflow */
+	}
+	nworkers = Min(nworkers, max_parallel_index_build_workers);
+
+	/* Each participant, the leader included, accumulates with its share */
+	while (nworkers > 0 &&
+		   maintenance_work_mem / (nworkers + 1) < PARALLEL_GIN_MIN_ACCUM_MEM)
+		nworkers--;
+
+	return nworkers;
+}
+
+/*
+ * ginBeginParallel - launch the workers of a parallel build
+ *
+ * Returns NULL if no worker could be launched.
+ */
+static ParallelContext *
+ginBeginParallel(Relation heap, Relation index, int nworkers,
+				 GinShared **ginsharedp)
+{
+	static uint32 fileset_counter = 0;
+	ParallelContext *pcxt;
+	GinShared  *ginshared;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContextForExternalFunction("postgres",
+													"ginParallelBuildMain",
+													nworkers);
+
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(GinShared));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+
+	InitializeParallelDSM(pcxt);
+
+	ginshared = (GinShared *) shm_toc_allocate(pcxt->toc, sizeof(GinShared));
+	ginshared->heaprelid = RelationGetRelid(heap);
+	ginshared->indexrelid = RelationGetRelid(index);
+	ginshared->accummem = maintenance_work_mem / (nworkers + 1);
+	ginshared->nblocks = RelationGetNumberOfBlocks(heap);
+	SpinLockInit(&ginshared->mutex);
+	ginshared->nextblock = 0;
+	ginshared->reltuples = 0;
+	ginshared->indtuples = 0;
+	ginshared->brokenhotchain = false;
+
+	/* All the runs go to the same temp tablespace */
+	PrepareTempTablespaces();
+	ginshared->runs.tablespace = GetNextTempTableSpace();
+	if (!OidIsValid(ginshared->runs.tablespace))
+		ginshared->runs.tablespace = MyDatabaseTableSpace;
+	ginshared->runs.leader_pid = MyProcPid;
+	ginshared->runs.fileset = ++fileset_counter;
+	ginshared->runs.nruns = 0;
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_GIN_SHARED, ginshared);
+
+	LaunchParallelWorkers(pcxt);
+
+	ereport(DEBUG1,
+			(errmsg("launched %d parallel workers to build index \"%s\" (planned: %d)",
+					pcxt->nworkers_launched, RelationGetRelationName(index),
+					nworkers)));
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
+	}
+
+	*ginsharedp = ginshared;
+	return pcxt;
+}
+
+/*
+ * ginParallelHeapScan - build the index from a parallel heap scan
+ *
+ * The leader scans its share of the heap like a worker, waits for the
+ * workers, and then merges everyone's runs into the index.  Returns the
+ * number of heap tuples seen by all participants, or -1 if the build should
+ * be done serially after all.
+ */
+static double
+ginParallelHeapScan(GinBuildState *buildstate, Relation heap, Relation index,
+					IndexInfo *indexInfo)
+{
+	ParallelContext *pcxt;
+	GinShared  *ginshared;
+	GinRunSet	runs;
+	double		reltuples;
+	int			nworkers;
+	int			i;
+
+	nworkers = ginParallelWorkers(heap, indexInfo);
+	if (nworkers <= 0)
+		return -1;
+	pcxt = ginBeginParallel(heap, index, nworkers, &ginshared);
+	if (pcxt == NULL)
+		return -1;
+
+	ginParallelScanAndAccum(ginshared, heap, index, indexInfo);
+
+	WaitForParallelWorkersToFinish(pcxt);
+
+	/*
+	 * The run files outlive the DSM segment, so we can leave parallel mode
+	 * before writing the index.
+	 */
+	runs = ginshared->runs;
+	reltuples = ginshared->reltuples;
+	buildstate->indtuples = ginshared->indtuples;
+	if (ginshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+
+	ginMergeRuns(buildstate, &runs);
+
+	for (i = 0; i < runs.nruns; i++)
+	{
+		char		name[MAXPGPATH];
+
+		ginRunName(name, &runs, i);
+		BufFileDeleteShared(runs.tablespace, name);
+	}
+
+	return reltuples;
+}
+
+/*
+ * ginParallelScanAndAccum - scan chunks of the heap into sorted runs
+ *
+ * Run by the leader and by each worker of a parallel build.  Our counts are
+ * added to the shared totals.
+ */
+static void
+ginParallelScanAndAccum(GinShared *ginshared, Relation heap, Relation index,
+						IndexInfo *indexInfo)
+{
+	GinBuildState buildstate;
+	MemoryContext oldCtx;
+	double		reltuples = 0;
+
+	initGinState(&buildstate.ginstate, index);
+	buildstate.indtuples = 0;
+	memset(&buildstate.buildStats, 0, sizeof(GinStatsData));
+	buildstate.tmpCtx = AllocSetContextCreate(CurrentMemoryContext,
+											  "Gin build temporary context",
+											  ALLOCSET_DEFAULT_SIZES);
+	buildstate.funcCtx = AllocSetContextCreate(CurrentMemoryContext,
+					 "Gin build temporary context for user-defined function",
+											   ALLOCSET_DEFAULT_SIZES);
+	buildstate.accum.ginstate = &buildstate.ginstate;
+	ginInitBA(&buildstate.accum);
+	buildstate.accumMem = (Size) ginshared->accummem * 1024L;
+	buildstate.ginshared = ginshared;
+
+	for (;;)
+	{
+		BlockNumber startblock;
+		BlockNumber numblocks;
+
+		SpinLockAcquire(&ginshared->mutex);
+		startblock = ginshared->nextblock;
+		numblocks = Min(PARALLEL_GIN_CHUNK_BLOCKS,
+						ginshared->nblocks - startblock);
+		ginshared->nextblock += numblocks;
+		SpinLockRelease(&ginshared->mutex);
+
+		if (numblocks == 0)
+			break;
+
+		reltuples += IndexBuildHeapRangeScan(heap, index, indexInfo,
+											 false, false,
+											 startblock, numblocks,
+											 ginBuildCallback,
+											 (void *) &buildstate);
+	}
+
+	/* write out whatever is left */
+	if (buildstate.accum.allocatedMemory > 0)
+	{
+		oldCtx = MemoryContextSwitchTo(buildstate.tmpCtx);
+		ginDumpRun(&buildstate);
+		MemoryContextSwitchTo(oldCtx);
+	}
+
+	MemoryContextDelete(buildstate.funcCtx);
+	MemoryContextDelete(buildstate.tmpCtx);
+
+	SpinLockAcquire(&ginshared->mutex);
+	ginshared->reltuples += reltuples;
+	ginshared->indtuples += buildstate.indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		ginshared->brokenhotchain = true;
+	SpinLockRelease(&ginshared->mutex);
+}
+
+/*
+ * ginDumpRun - write the BuildAccumulator out as a new sorted run
+ */
+static void
+ginDumpRun(GinBuildState *buildstate)
+{
+	GinShared  *ginshared = buildstate->ginshared;
+	TupleDesc	tupdesc = buildstate->ginstate.origTupdesc;
+	char		name[MAXPGPATH];
+	BufFile    *file;
+	int			runno;
+	GinRunEntry hdr;
+	ItemPointerData *list;
+	Datum		key;
+	GinNullCategory category;
+	uint32		nlist;
+	OffsetNumber attnum;
+
+	SpinLockAcquire(&ginshared->mutex);
+	runno = ginshared->runs.nruns++;
+	SpinLockRelease(&ginshared->mutex);
+
+	ginRunName(name, &ginshared->runs, runno);
+	file = BufFileCreateShared(ginshared->runs.tablespace, name);
+
+	ginBeginBAScan(&buildstate->accum);
+	while ((list = ginGetBAEntry(&buildstate->accum,
+								 &attnum, &key, &category, &nlist)) != NULL)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[attnum - 1];
+		char	   *keydata = NULL;
+
+		CHECK_FOR_INTERRUPTS();
+
+		hdr.attnum = attnum;
+		hdr.category = category;
+		hdr.nitems = nlist;
+		if (category != GIN_CAT_NORM_KEY)
+			hdr.keylen = 0;
+		else if (attr->attbyval)
+		{
+			hdr.keylen = sizeof(Datum);
+			keydata = (char *) &key;
+		}
+		else
+		{
+			hdr.keylen = datumGetSize(key, false, attr->attlen);
+			keydata = DatumGetPointer(key);
+		}
+
+		if (BufFileWrite(file, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+			(hdr.keylen > 0 &&
+			 BufFileWrite(file, keydata, hdr.keylen) != hdr.keylen) ||
+			BufFileWrite(file, list, nlist * sizeof(ItemPointerData)) !=
+			nlist * sizeof(ItemPointerData))
+			elog(ERROR, "could not write to GIN build temporary file");
+	}
+
+	/* end-of-run marker */
+	memset(&hdr, 0, sizeof(hdr));
+	if (BufFileWrite(file, &hdr, sizeof(hdr)) != sizeof(hdr))
+		elog(ERROR, "could not write to GIN build temporary file");
+
+	BufFileClose(file);
+}
+
+/* qsort comparator for heap TIDs */
+static int
+ginCmpItemPointers(const void *a, const void *b)
+{
+	return ginCompareItemPointers((ItemPointer) a, (ItemPointer) b);
+}
+
+/*
+ * ginMergeRuns - insert the entries of all runs into the index
+ *
+ * The runs are merged by key, and the TIDs of equal keys from different runs
+ * are inserted together.  Since every heap tuple was seen by one participant
+ * only, the TID lists of a key don't overlap; they just need to be put in
+ * order if the runs came from interleaved chunks of the heap.  If a key has
+ * more TIDs than fit in maintenance_work_mem, they are inserted in batches.
+ */
+static void
+ginMergeRuns(GinBuildState *buildstate, GinRunSet *runs)
+{
+	GinState   *ginstate = &buildstate->ginstate;
+	GinMergeState mergestate;
+	GinRunReader *readers;
+	binaryheap *heap;
+	ItemPointerData *items;
+	uint32		nitems;
+	uint32		maxitems;
+	uint32		flushitems;
+	int			i;
+
+	if (runs->nruns == 0)
+		return;
+
+	readers = (GinRunReader *) palloc0(runs->nruns * sizeof(GinRunReader));
+	mergestate.ginstate = ginstate;
+	mergestate.readers = readers;
+	heap = binaryheap_allocate(runs->nruns, ginRunReaderCompare,
+							   (void *) &mergestate);
+
+	for (i = 0; i < runs->nruns; i++)
+	{
+		char		name[MAXPGPATH];
+
+		ginRunName(name, runs, i);
+		readers[i].file = BufFileOpenShared(runs->tablespace, name);
+		if (readers[i].file == NULL)
+			elog(ERROR, "could not open GIN build run file \"%s\"", name);
+		if (ginRunReadEntry(ginstate, &readers[i]))
+			binaryheap_add_unordered(heap, Int32GetDatum(i));
+	}
+	binaryheap_build(heap);
+
+	flushitems = Max((Size) maintenance_work_mem * 1024L /
+					 sizeof(ItemPointerData), 1024);
+	maxitems = 1024;
+	items = (ItemPointerData *) palloc(maxitems * sizeof(ItemPointerData));
+
+	while (!binaryheap_empty(heap))
+	{
+		GinRunReader *first;
+		OffsetNumber attnum;
+		Datum		key;
+		GinNullCategory category;
+		bool		sorted = true;
+		MemoryContext oldCtx;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * Remember the key, since its reader will move past it.  The runs'
+		 * own data is kept out of tmpCtx, which is reset for each key.
+		 */
+		first = &readers[DatumGetInt32(binaryheap_first(heap))];
+		oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
+		attnum = first->attnum;
+		category = first->category;
+		if (category == GIN_CAT_NORM_KEY)
+		{
+			Form_pg_attribute attr = ginstate->origTupdesc->attrs[attnum - 1];
+
+			key = datumCopy(first->key, attr->attbyval, attr->attlen);
+		}
+		else
+			key = (Datum) 0;
+		MemoryContextSwitchTo(oldCtx);
+
+		/* collect the TIDs of this key from every run that has it */
+		nitems = 0;
+		while (!binaryheap_empty(heap))
+		{
+			int			runno = DatumGetInt32(binaryheap_first(heap));
+			GinRunReader *reader = &readers[runno];
+
+			if (ginCompareAttEntries(ginstate, attnum, key, category,
+									 reader->attnum, reader->key,
+									 reader->category) != 0)
+				break;
+
+			if (nitems + reader->nitems > maxitems)
+			{
+				while (nitems + reader->nitems > maxitems)
+					maxitems *= 2;
+				items = (ItemPointerData *)
+					repalloc_huge(items, maxitems * sizeof(ItemPointerData));
+			}
+			if (nitems > 0 &&
+				ginCompareItemPointers(&items[nitems - 1],
+									   &reader->items[0]) > 0)
+				sorted = false;
+			memcpy(items + nitems, reader->items,
+				   reader->nitems * sizeof(ItemPointerData));
+			nitems += reader->nitems;
+
+			if (ginRunReadEntry(ginstate, reader))
+				binaryheap_replace_first(heap, Int32GetDatum(runno));
+			else
+				(void) binaryheap_remove_first(heap);
+
+			if (nitems >= flushitems)
+			{
+				if (!sorted)
+					qsort(items, nitems, sizeof(ItemPointerData),
+						  ginCmpItemPointers);
+				oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
+				ginEntryInsert(ginstate, attnum, key, category,
+							   items, nitems, &buildstate->buildStats);
+				MemoryContextSwitchTo(oldCtx);
+				nitems = 0;
+				sorted = true;
+			}
+		}
+
+		if (nitems > 0)
+		{
+			if (!sorted)
+				qsort(items, nitems, sizeof(ItemPointerData),
+					  ginCmpItemPointers);
+			oldCtx = MemoryContextSwitchTo(buildstate->tmpCtx);
+			ginEntryInsert(ginstate, attnum, key, category,
+						   items, nitems, &buildstate->buildStats);
+			MemoryContextSwitchTo(oldCtx);
+		}
+
+		/* this also frees our copy of the key */
+		MemoryContextReset(buildstate->tmpCtx);
+	}
+
+	for (i = 0; i < runs->nruns; i++)
+		BufFileClose(readers[i].file);
+	binaryheap_free(heap);
+	pfree(items);
+	pfree(readers);
+}
+
+/*
+ * ginRunReadEntry - advance a reader to the next entry of its run
+ *
+ * Returns false at the end of the run.
+ */
+static bool
+ginRunReadEntry(GinState *ginstate, GinRunReader *reader)
+{
+	GinRunEntry hdr;
+	Size		itemsz;
+
+	if (reader->keybuf)
+		pfree(reader->keybuf);
+	reader->keybuf = NULL;
+	if (reader->items)
+		pfree(reader->items);
+	reader->items = NULL;
+
+	if (BufFileRead(reader->file, &hdr, sizeof(hdr)) != sizeof(hdr))
+		elog(ERROR, "could not read from GIN build temporary file");
+	if (hdr.nitems == 0)
+		return false;
+
+	reader->attnum = hdr.attnum;
+	reader->category = hdr.category;
+	reader->nitems = hdr.nitems;
+
+	if (hdr.keylen == 0)
+		reader->key = (Datum) 0;
+	else if (ginstate->origTupdesc->attrs[hdr.attnum - 1]->attbyval)
+	{
+		Assert(hdr.keylen == sizeof(Datum));
+		if (BufFileRead(reader->file, &reader->key, sizeof(Datum)) !=
+			sizeof(Datum))
+			elog(ERROR, "could not read from GIN build temporary file");
+	}
+	else
+	{
+		reader->keybuf = palloc(hdr.keylen);
+		if (BufFileRead(reader->file, reader->keybuf, hdr.keylen) !=
+			hdr.keylen)
+			elog(ERROR, "could not read from GIN build temporary file");
+		reader->key = PointerGetDatum(reader->keybuf);
+	}
+
+	itemsz = hdr.nitems * sizeof(ItemPointerData);
+	reader->items = (ItemPointerData *)
+		MemoryContextAllocHuge(CurrentMemoryContext, itemsz);
+	if (BufFileRead(reader->file, reader->items, itemsz) != itemsz)
+		elog(ERROR, "could not read from GIN build temporary file");
+
+	return true;
+}
+
+/*
+ * binaryheap comparator for the merge.  binaryheap is a max-heap, so this
+ * sorts the run with the smallest current key first.
+ */
+static int
+ginRunReaderCompare(Datum a, Datum b, void *arg)
+{
+	GinMergeState *mergestate = (GinMergeState *) arg;
+	GinRunReader *ra = &mergestate->readers[DatumGetInt32(a)];
+	GinRunReader *rb = &mergestate->readers[DatumGetInt32(b)];
+
+	return -ginCompareAttEntries(mergestate->ginstate,
+								 ra->attnum, ra->key, ra->category,
+								 rb->attnum, rb->key, rb->category);
+}
+
+/*
+ * ginRunName - name of the shared BufFile holding a run
+ */
+static void
+ginRunName(char *name, GinRunSet *runs, int runno)
+{
+	snprintf(name, MAXPGPATH, "%d.gin%u.%d",
+			 runs->leader_pid, runs->fileset, runno);
+}
+
+/*
+ * ginParallelBuildMain - entry point of a parallel GIN build worker
+ */
+void
+ginParallelBuildMain(dsm_segment *seg, shm_toc *toc)
+{
+	GinShared  *ginshared;
+	Relation	heapRel;
+	Relation	indexRel;
+	IndexInfo  *indexInfo;
+
+	ginshared = (GinShared *) shm_toc_lookup(toc, PARALLEL_KEY_GIN_SHARED);
+	Assert(ginshared != NULL);
+
+	/*
+	 * The leader holds ShareLock on the heap and AccessExclusiveLock on the
+	 * new index, but as members of one lock group we don't conflict with it.
+	 */
+	heapRel = heap_open(ginshared->heaprelid, ShareLock);
+	indexRel = index_open(ginshared->indexrelid, RowExclusiveLock);
+	indexInfo = BuildIndexInfo(indexRel);
+
+	ginParallelScanAndAccum(ginshared, heapRel, indexRel, indexInfo);
+
+	index_close(indexRel, RowExclusiveLock);
+	heap_close(heapRel, ShareLock);
+}
@@ -26,6 +26,7 @@
 #include "storage/smgr.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/tuplesort.h"
 
 /* Step of index tuples for check whether to switch to buffering build mode */
 #define BUFFERING_MODE_SWITCH_CHECK_STEP 256
@@ -71,9 +72,46 @@ typedef struct
 	HTAB	   *parentMap;
 
 	GistBufferingMode bufferingMode;
+
+	/*
+	 * Extra data used during a sorted build: the sort of the index tuples and
+	 * the number of blocks allocated and written out so far.
+	 */
+	Tuplesortstate *sortstate;
+	BlockNumber pages_allocated;
+	BlockNumber pages_written;
 } GISTBuildState;
 
+/*
+ * In sorted build, we use a stack of these structs, one for each level,
+ * to hold an in-memory buffer of the rightmost page at that level.  When the
+ * page fills up, it is written out and a new page is allocated.
+ */
+typedef struct GistSortedBuildPageState
+{
+	Page		page;
+	struct GistSortedBuildPageState *parent;	/* upper level, if any */
+} GistSortedBuildPageState;
+
 /* prototypes for private functions */
+static double gistbuildinsert(Relation heap, Relation index,
+				IndexInfo *indexInfo, GISTBuildState *buildstate);
+static bool gistCanSortedBuild(Relation index);
+static void gistSortedBuildCallback(Relation index,
+						HeapTuple htup,
+						Datum *values,
+						bool *isnull,
+						bool tupleIsAlive,
+						void *state);
+static void gist_indexsortbuild(GISTBuildState *state);
+static void gist_indexsortbuild_pagestate_add(GISTBuildState *state,
+								  GistSortedBuildPageState *pagestate,
+								  IndexTuple itup);
+static void gist_indexsortbuild_pagestate_flush(GISTBuildState *state,
+									GistSortedBuildPageState *pagestate);
+static void gist_indexsortbuild_writepage(GISTBuildState *state, Page page,
+							  BlockNumber blkno);
+
 static void gistInitBuffering(GISTBuildState *buildstate);
 static int	calculatePagesPerBuffer(GISTBuildState *buildstate, int levelStep);
 static void gistBuildCallback(Relation index,
@@ -105,9 +143,15 @@ static void gistMemorizeAllDownlinks(GISTBuildState *buildstate, Buffer parent);
 static BlockNumber gistGetParent(GISTBuildState *buildstate, BlockNumber child);
 
 /*
- * Main entry point to GiST index build. Initially calls insert over and over,
- * but switches to more efficient buffering build algorithm after a certain
- * number of tuples (unless buffering mode is disabled).
+ * Main entry point to GiST index build.
+ *
+ * If the opclasses of all key columns provide a sortsupport function, and
+ * buffering wasn't explicitly requested, the index tuples are sorted (along a
+ * space-filling curve, typically) and packed into pages bottom-up.
+ *
+ * Otherwise, initially calls insert over and over, but switches to more
+ * efficient buffering build algorithm after a certain number of tuples
+ * (unless buffering mode is disabled).
  */
 IndexBuildResult *
 gistbuild(Relation heap, Relation index, IndexInfo *indexInfo)
@@ -115,12 +159,11 @@ gistbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	IndexBuildResult *result;
 	double		reltuples;
 	GISTBuildState buildstate;
-	Buffer		buffer;
-	Page		page;
 	MemoryContext oldcxt = CurrentMemoryContext;
 	int			fillfactor;
 
 	buildstate.indexrel = index;
+	buildstate.sortstate = NULL;
 	if (index->rd_options)
 	{
 		/* Get buffering mode from the options string */
@@ -166,6 +209,61 @@ gistbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 	 */
 	buildstate.giststate->tempCxt = createTempGistContext();
 
+	buildstate.indtuples = 0;
+	buildstate.indtuplesSize = 0;
+
+	if (buildstate.bufferingMode != GIST_BUFFERING_STATS &&
+		gistCanSortedBuild(index))
+	{
+		/*
+		 * Sort all the index tuples, then build the tree from them bottom-up.
+		 */
+		buildstate.sortstate = tuplesort_begin_index_gist(heap, index,
+														  maintenance_work_mem,
+														  false);
+
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   gistSortedBuildCallback,
+									   (void *) &buildstate);
+
+		tuplesort_performsort(buildstate.sortstate);
+
+		gist_indexsortbuild(&buildstate);
+
+		tuplesort_end(buildstate.sortstate);
+	}
+	else
+		reltuples = gistbuildinsert(heap, index, indexInfo, &buildstate);
+
+	/* okay, all heap tuples are indexed */
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(buildstate.giststate->tempCxt);
+
+	freeGISTstate(buildstate.giststate);
+
+	/*
+	 * Return statistics
+	 */
+	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+
+	result->heap_tuples = reltuples;
+	result->index_tuples = (double) buildstate.indtuples;
+
+	return result;
+}
+
+/*
+ * Build the index by inserting the tuples one by one, switching to buffering
+ * build as configured.
+ */
+static double
+gistbuildinsert(Relation heap, Relation index, IndexInfo *indexInfo,
+				GISTBuildState *buildstate)
+{
+	double		reltuples;
+	Buffer		buffer;
+	Page		page;
+
 	/* initialize the root page */
 	buffer = gistNewBuffer(index);
 	Assert(BufferGetBlockNumber(buffer) == GIST_ROOT_BLKNO);
@@ -194,42 +292,260 @@ gistbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 
 	END_CRIT_SECTION();
 
-	/* build the index */
-	buildstate.indtuples = 0;
-	buildstate.indtuplesSize = 0;
-
 	/*
 	 * Do the heap scan.
 	 */
 	reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
-								   gistBuildCallback, (void *) &buildstate);
+								   gistBuildCallback, (void *) buildstate);
 
 	/*
 	 * If buffering was used, flush out all the tuples that are still in the
 	 * buffers.
 	 */
-	if (buildstate.bufferingMode == GIST_BUFFERING_ACTIVE)
+	if (buildstate->bufferingMode == GIST_BUFFERING_ACTIVE)
 	{
 		elog(DEBUG1, "all tuples processed, emptying buffers");
-		gistEmptyAllBuffers(&buildstate);
-		gistFreeBuildBuffers(buildstate.gfbb);
+		gistEmptyAllBuffers(buildstate);
+		gistFreeBuildBuffers(buildstate->gfbb);
 	}
 
-	/* okay, all heap tuples are indexed */
-	MemoryContextSwitchTo(oldcxt);
-	MemoryContextDelete(buildstate.giststate->tempCxt);
+	return reltuples;
+}
 
-	freeGISTstate(buildstate.giststate);
+/*
+ * Can the index be built by sorting?  All key columns need a sortsupport
+ * function in their opclass.
+ */
+static bool
+gistCanSortedBuild(Relation index)
+{
+	int			i;
+
+	for (i = 0; i < RelationGetNumberOfAttributes(index); i++)
+	{
+		if (!OidIsValid(index_getprocid(index, i + 1, GIST_SORTSUPPORT_PROC)))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapScan, in sorted build.
+ */
+static void
+gistSortedBuildCallback(Relation index,
+						HeapTuple htup,
+						Datum *values,
+						bool *isnull,
+						bool tupleIsAlive,
+						void *state)
+{
+	GISTBuildState *buildstate = (GISTBuildState *) state;
+	MemoryContext oldCtx;
+	Datum		compressed_values[INDEX_MAX_KEYS];
+
+	oldCtx = MemoryContextSwitchTo(buildstate->giststate->tempCxt);
+
+	/* sort the compressed keys, as they will be stored in the index */
+	gistCompressValues(buildstate->giststate, index,
+					   values, isnull,
+					   true, compressed_values);
+
+	tuplesort_putindextuplevalues(buildstate->sortstate,
+								  buildstate->indexrel,
+								  &htup->t_self,
+								  compressed_values, isnull);
+
+	MemoryContextSwitchTo(oldCtx);
+	MemoryContextReset(buildstate->giststate->tempCxt);
+
+	buildstate->indtuples += 1;
+}
+
+/*
+ * Build the GiST index bottom-up from the sorted index tuples.
+ *
+ * Leaf pages are filled in the sort order, up to the fillfactor, and a
+ * downlink with the union of the keys of each finished page is added to the
+ * page of the level above, the same way.  Pages are written out directly with
+ * smgr as they are finished, bypassing shared buffers, like B-tree build
+ * does.  The root is written last, to block 0, which is reserved for it.
+ */
+static void
+gist_indexsortbuild(GISTBuildState *state)
+{
+	IndexTuple	itup;
+	bool		should_free;
+	GistSortedBuildPageState *leafstate;
+	GistSortedBuildPageState *pagestate;
+
+	state->pages_allocated = 0;
+	state->pages_written = 0;
 
 	/*
-	 * Return statistics
+	 * Write an empty page as a placeholder for the root page.  It will be
+	 * replaced with the real root page at the end.
 	 */
-	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+	leafstate = palloc(sizeof(GistSortedBuildPageState));
+	leafstate->page = (Page) palloc0(BLCKSZ);
+	leafstate->parent = NULL;
 
-	result->heap_tuples = reltuples;
-	result->index_tuples = (double) buildstate.indtuples;
+	RelationOpenSmgr(state->indexrel);
+	smgrextend(state->indexrel->rd_smgr, MAIN_FORKNUM, GIST_ROOT_BLKNO,
+			   (char *) leafstate->page, true);
+	state->pages_allocated++;
+	state->pages_written++;
 
-	return result;
+	gistinitpage(leafstate->page, F_LEAF);
+
+	/*
+	 * Fill index pages with tuples in the sorted order.
+	 */
+	while ((itup = tuplesort_getindextuple(state->sortstate,
+										   true, &should_free)) != NULL)
+	{
+		gist_indexsortbuild_pagestate_add(state, leafstate, itup);
+		MemoryContextReset(state->giststate->tempCxt);
+		if (should_free)
+			pfree(itup);
+	}
+
+	/*
+	 * Write out the partially full non-root pages.  Keep in mind that a flush
+	 * can add a new root above the current one.
+	 */
+	pagestate = leafstate;
+	while (pagestate->parent != NULL)
+	{
+		GistSortedBuildPageState *parent;
+
+		gist_indexsortbuild_pagestate_flush(state, pagestate);
+		parent = pagestate->parent;
+		pfree(pagestate->page);
+		pfree(pagestate);
+		pagestate = parent;
+	}
+
+	/* Write out the root */
+	gist_indexsortbuild_writepage(state, pagestate->page, GIST_ROOT_BLKNO);
+	pfree(pagestate->page);
+	pfree(pagestate);
+
+	/*
+	 * We wrote the index outside shared buffers, so a checkpoint during the
+	 * build couldn't have flushed it.  Sync it now if it's WAL-logged, see
+	 * the comments at the end of _bt_load().
+	 */
+	if (RelationNeedsWAL(state->indexrel))
+	{
+		RelationOpenSmgr(state->indexrel);
+		smgrimmedsync(state->indexrel->rd_smgr, MAIN_FORKNUM);
+	}
+}
+
+/*
+ * Add a tuple to the page of a level, writing the page out first if it's full.
+ */
+static void
+gist_indexsortbuild_pagestate_add(GISTBuildState *state,
+								  GistSortedBuildPageState *pagestate,
+								  IndexTuple itup)
+{
+	Size		sizeNeeded;
+
+	/* Does the tuple fit? If not, flush */
+	sizeNeeded = IndexTupleSize(itup) + sizeof(ItemIdData) + state->freespace;
+	if (PageGetFreeSpace(pagestate->page) < sizeNeeded &&
+		!PageIsEmpty(pagestate->page))
+		gist_indexsortbuild_pagestate_flush(state, pagestate);
+
+	gistfillbuffer(pagestate->page, &itup, 1, InvalidOffsetNumber);
+}
+
+/*
+ * Write out the current page of a level, add its downlink to the level above,
+ * and start a new page on this level.
+ */
+static void
+gist_indexsortbuild_pagestate_flush(GISTBuildState *state,
+									GistSortedBuildPageState *pagestate)
+{
+	GistSortedBuildPageState *parent;
+	IndexTuple *itvec;
+	IndexTuple	union_tuple;
+	int			vect_len;
+	bool		isleaf;
+	BlockNumber blkno;
+	MemoryContext oldCtx;
+
+	/* check once per page */
+	CHECK_FOR_INTERRUPTS();
+
+	/* The page is now complete.  Assign a block number to it. */
+	blkno = state->pages_allocated++;
+	isleaf = GistPageIsLeaf(pagestate->page);
+
+	/*
+	 * Form a downlink tuple to represent all the tuples on the page.
+	 */
+	oldCtx = MemoryContextSwitchTo(state->giststate->tempCxt);
+	itvec = gistextractpage(pagestate->page, &vect_len);
+	union_tuple = gistunion(state->indexrel, itvec, vect_len,
+							state->giststate);
+	ItemPointerSetBlockNumber(&(union_tuple->t_tid), blkno);
+	MemoryContextSwitchTo(oldCtx);
+
+	gist_indexsortbuild_writepage(state, pagestate->page, blkno);
+
+	/*
+	 * Insert the downlink to the parent page.  If this was the root, create a
+	 * new page as the parent, which becomes the new root.
+	 */
+	parent = pagestate->parent;
+	if (parent == NULL)
+	{
+		parent = palloc(sizeof(GistSortedBuildPageState));
+		parent->page = (Page) palloc(BLCKSZ);
+		parent->parent = NULL;
+		gistinitpage(parent->page, 0);
+
+		pagestate->parent = parent;
+	}
+	gist_indexsortbuild_pagestate_add(state, parent, union_tuple);
+
+	/* Re-initialize the page buffer for the next page on this level */
+	gistinitpage(pagestate->page, isleaf ? F_LEAF : 0);
+}
+
+/*
+ * Write out a finished page.  All pages but the root are written in block
+ * number order, extending the relation.
+ */
+static void
+gist_indexsortbuild_writepage(GISTBuildState *state, Page page,
+							  BlockNumber blkno)
+{
+	Relation	index = state->indexrel;
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(index))
+		log_newpage(&index->rd_node, MAIN_FORKNUM, blkno, page, true);
+	else
+		PageSetLSN(page, gistGetFakeLSN(index));
+
+	PageSetChecksumInplace(page, blkno);
+
+	RelationOpenSmgr(index);
+	if (blkno == state->pages_written)
+	{
+		smgrextend(index->rd_smgr, MAIN_FORKNUM, blkno, (char *) page, true);
+		state->pages_written++;
+	}
+	else
+	{
+		Assert(blkno < state->pages_written);
+		smgrwrite(index->rd_smgr, MAIN_FORKNUM, blkno, (char *) page, true);
+	}
 }
 
 /*
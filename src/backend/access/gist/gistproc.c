@@ -23,6 +23,7 @@
 #include "access/stratnum.h"
 #include "utils/builtins.h"
 #include "utils/geo_decls.h"
+#include "utils/sortsupport.h"
 
 
 static bool gist_box_leaf_consistent(BOX *key, BOX *query,
@@ -1247,6 +1248,142 @@ gist_point_fetch(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(retval);
 }
 
+/*
+ * Map a float to uint32 so that the order of the values is preserved.
+ *
+ * The bit patterns of non-negative IEEE floats, interpreted as integers, are
+ * ordered like the floats themselves, and so are those of negative floats,
+ * in reverse.  Negative values are flipped into 0-7FFFFFFF and non-negative
+ * ones moved to 80000000-FFFFFFFF (both zeroes end up next to each other).
+ * NaNs all go to FFFFFFFF, above infinity.
+ */
+static uint32
+float_to_ordered_uint32(float4 f)
+{
+	union
+	{
+		float4		f;
+		uint32		i;
+	}			u;
+
+	if (isnan(f))
+		return 0xFFFFFFFF;
+
+	u.f = f;
+	if (u.i & 0x80000000)
+		u.i = ~u.i;
+	else
+		u.i |= 0x80000000;
+	return u.i;
+}
+
+/* Spread the bits of a uint32 over the even bits of a uint64 */
+static uint64
+spread_bits(uint32 x)
+{
+	uint64		n = x;
+
+	n = (n | (n << 16)) & UINT64CONST(0x0000FFFF0000FFFF);
+	n = (n | (n << 8)) & UINT64CONST(0x00FF00FF00FF00FF);
+	n = (n | (n << 4)) & UINT64CONST(0x0F0F0F0F0F0F0F0F);
+	n = (n | (n << 2)) & UINT64CONST(0x3333333333333333);
+	n = (n | (n << 1)) & UINT64CONST(0x5555555555555555);
+	return n;
+}
+
+/*
+ * Z-order (Morton code) of a point: the interleaved bits of its coordinates.
+ * Points close to each other mostly get close Z-values, so sorting by them
+ * groups nearby points on the same leaf pages.  The coordinates are rounded
+ * to float4, which is plenty for that.
+ */
+static uint64
+point_zorder(Point *p)
+{
+	return spread_bits(float_to_ordered_uint32((float4) p->x)) |
+		(spread_bits(float_to_ordered_uint32((float4) p->y)) << 1);
+}
+
+/*
+ * Compare the Z-order of the points stored in leaf keys (the keys are
+ * boxes with equal corners, see gist_point_compress).
+ */
+static int
+gist_point_zorder_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	Point	   *p1 = &(DatumGetBoxP(a)->low);
+	Point	   *p2 = &(DatumGetBoxP(b)->low);
+	uint64		z1;
+	uint64		z2;
+
+	/* cheap check first, it's common as a tie-breaker of abbreviated keys */
+	if (p1->x == p2->x && p1->y == p2->y)
+		return 0;
+
+	z1 = point_zorder(p1);
+	z2 = point_zorder(p2);
+	if (z1 == z2)
+		return 0;
+	return (z1 > z2) ? 1 : -1;
+}
+
+/*
+ * Abbreviated key is the Z-value itself, or its upper half if Datum is only
+ * 32 bits wide.
+ */
+static Datum
+gist_point_zorder_abbrev_convert(Datum original, SortSupport ssup)
+{
+	uint64		z = point_zorder(&(DatumGetBoxP(original)->low));
+
+#if SIZEOF_DATUM == 8
+	return (Datum) z;
+#else
+	return (Datum) (z >> 32);
+#endif
+}
+
+static int
+gist_point_zorder_cmp_abbrev(Datum z1, Datum z2, SortSupport ssup)
+{
+	/* Datum is unsigned, so the Z-values compare as they are */
+	if (z1 == z2)
+		return 0;
+	return (z1 > z2) ? 1 : -1;
+}
+
+/*
+ * Abbreviation is never aborted: computing the Z-value is the expensive part
+ * of a full comparison anyway.
+ */
+static bool
+gist_point_zorder_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	return false;
+}
+
+/*
+ * GiST sortsupport method for point, used to build the index by sorting the
+ * points in Z-order.
+ */
+Datum
+gist_point_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	if (ssup->abbreviate)
+	{
+		ssup->comparator = gist_point_zorder_cmp_abbrev;
+		ssup->abbrev_converter = gist_point_zorder_abbrev_convert;
+		ssup->abbrev_abort = gist_point_zorder_abbrev_abort;
+		ssup->abbrev_full_comparator = gist_point_zorder_cmp;
+	}
+	else
+		ssup->comparator = gist_point_zorder_cmp;
+
+	PG_RETURN_VOID();
+}
+
 
 #define point_point_distance(p1,p2) \
 	DatumGetFloat8(DirectFunctionCall2(point_distance, \
@@ -567,12 +567,30 @@ gistFormTuple(GISTSTATE *giststate, Relation r,
 			  Datum attdata[], bool isnull[], bool isleaf)
 {
 	Datum		compatt[INDEX_MAX_KEYS];
-	int			i;
 	IndexTuple	res;
 
+	gistCompressValues(giststate, r, attdata, isnull, isleaf, compatt);
+
+	res = index_form_tuple(giststate->tupdesc, compatt, isnull);
+
 	/*
-	 * Call the compress method on each attribute.
+	 * The offset number on tuples on internal pages is unused. For historical
+	 * reasons, it is set to 0xffff.
 	 */
+	ItemPointerSetOffsetNumber(&(res->t_tid), 0xffff);
+	return res;
+}
+
+/*
+ * Call the compress method on each attribute.
+ */
+void
+gistCompressValues(GISTSTATE *giststate, Relation r,
+				   Datum *attdata, bool *isnull, bool isleaf,
+				   Datum *compatt)
+{
+	int			i;
+
 	for (i = 0; i < r->rd_att->natts; i++)
 	{
 		if (isnull[i])
@@ -591,15 +609,6 @@ gistFormTuple(GISTSTATE *giststate, Relation r,
 			compatt[i] = cep->key;
 		}
 	}
-
-	res = index_form_tuple(giststate->tupdesc, compatt, isnull);
-
-	/*
-	 * The offset number on tuples on internal pages is unused. For historical
-	 * reasons, it is set to 0xffff.
-	 */
-	ItemPointerSetOffsetNumber(&(res->t_tid), 0xffff);
-	return res;
 }
 
 /*
@@ -698,14 +707,19 @@ gistpenalty(GISTSTATE *giststate, int attno,
  */
 void
 GISTInitBuffer(Buffer b, uint32 f)
+{
+	gistinitpage(BufferGetPage(b), f);
+}
+
+/*
+ * Initialize a new index page in a private buffer, as the sorted build does
+ */
+void
+gistinitpage(Page page, uint32 f)
 {
 	GISTPageOpaque opaque;
-	Page		page;
-	Size		pageSize;
 
-	pageSize = BufferGetPageSize(b);
-	page = BufferGetPage(b);
-	PageInit(page, pageSize, sizeof(GISTPageOpaqueData));
+	PageInit(page, BLCKSZ, sizeof(GISTPageOpaqueData));
 
 	opaque = GistPageGetOpaque(page);
 	/* page was already zeroed by PageInit, so this is not needed: */
@@ -89,6 +89,7 @@ static HeapScanDesc heap_beginscan_internal(Relation relation,
 						bool is_samplescan,
 						bool temp_snap);
 static BlockNumber heap_parallelscan_nextpage(HeapScanDesc scan);
+static void heap_begin_read_stream(HeapScanDesc scan);
 static HeapTuple heap_prepare_insert(Relation relation, HeapTuple tup,
 					TransactionId xid, CommandId cid, int options);
 static XLogRecPtr log_heap_update(Relation reln, Buffer oldbuf,
@@ -299,6 +300,7 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 	ItemPointerSetInvalid(&scan->rs_ctup.t_self);
 	scan->rs_cbuf = InvalidBuffer;
 	scan->rs_cblock = InvalidBlockNumber;
+	scan->rs_stream.length = 0;	/* no read-ahead until scanning forward */
 
 	/* page-at-a-time fields are always invalid when not rs_inited */
 
@@ -371,6 +373,9 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+	/* initiate reads of the pages after it, if scanning forward */
+	ReadStreamPrefetch(&scan->rs_stream, scan->rs_rd, page);
+
 	/* read page using selected strategy */
 	scan->rs_cbuf = ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
 									   RBM_NORMAL, scan->rs_strategy);
@@ -396,6 +401,38 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 
 	dp = BufferGetPage(buffer);
 	TestForOldSnapshot(snapshot, scan->rs_rd, dp);
+
+	/*
+	 * With an external transaction manager, collect the XIDs of the page and
+	 * resolve them against the snapshot in one batch.  The buffer lock is
+	 * released meanwhile, since the manager may have to wait for in-doubt
+	 * distributed transactions.  Tuples added to the page in the meantime
+	 * are simply checked one by one below.
+	 */
+	if (scan->rs_xidmemo != NULL &&
+		!(PageIsAllVisible(dp) && !snapshot->takenDuringRecovery))
+	{
+		if (scan->rs_xidmemo->snapshot != snapshot)
+			ResetXidVisibilityMemo(scan->rs_xidmemo, snapshot);
+
+		lines = PageGetMaxOffsetNumber(dp);
+		for (lineoff = FirstOffsetNumber, lpp = PageGetItemId(dp, lineoff);
+			 lineoff <= lines;
+			 lineoff++, lpp++)
+		{
+			if (ItemIdIsNormal(lpp))
+				XidVisibilityMemoQueueTuple(scan->rs_xidmemo,
+								  (HeapTupleHeader) PageGetItem((Page) dp, lpp));
+		}
+
+		if (scan->rs_xidmemo->nbatch != 0)
+		{
+			LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+			XidVisibilityMemoFlush(scan->rs_xidmemo);
+			LockBuffer(buffer, BUFFER_LOCK_SHARE);
+		}
+	}
+
 	lines = PageGetMaxOffsetNumber(dp);
 	ntup = 0;
 
@@ -437,6 +474,9 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 
 			if (all_visible)
 				valid = true;
+			else if (scan->rs_xidmemo != NULL)
+				valid = HeapTupleSatisfiesMVCCMemo(&loctup, snapshot, buffer,
+												   scan->rs_xidmemo);
 			else
 				valid = HeapTupleSatisfiesVisibility(&loctup, snapshot, buffer);
 
@@ -524,6 +564,7 @@ heapgettup(HeapScanDesc scan,
 			}
 			else
 				page = scan->rs_startblock;		/* first page */
+			heap_begin_read_stream(scan);
 			heapgetpage(scan, page);
 			lineoff = FirstOffsetNumber;		/* first offnum */
 			scan->rs_inited = true;
@@ -550,6 +591,9 @@ heapgettup(HeapScanDesc scan,
 		/* backward parallel scan not supported */
 		Assert(scan->rs_parallel == NULL);
 
+		/* nor read-ahead */
+		scan->rs_stream.length = 0;
+
 		if (!scan->rs_inited)
 		{
 			/*
@@ -826,6 +870,7 @@ heapgettup_pagemode(HeapScanDesc scan,
 			}
 			else
 				page = scan->rs_startblock;		/* first page */
+			heap_begin_read_stream(scan);
 			heapgetpage(scan, page);
 			lineindex = 0;
 			scan->rs_inited = true;
@@ -849,6 +894,9 @@ heapgettup_pagemode(HeapScanDesc scan,
 		/* backward parallel scan not supported */
 		Assert(scan->rs_parallel == NULL);
 
+		/* nor read-ahead */
+		scan->rs_stream.length = 0;
+
 		if (!scan->rs_inited)
 		{
 			/*
@@ -1478,6 +1526,12 @@ heap_beginscan_internal(Relation relation, Snapshot snapshot,
 	 */
 	scan->rs_pageatatime = allow_pagemode && IsMVCCSnapshot(snapshot);
 
+	/*
+	 * in page-at-a-time mode an external transaction manager is asked about
+	 * the XIDs of a page in one batch, see heapgetpage
+	 */
+	scan->rs_xidmemo = CreateXidVisibilityMemo(snapshot);
+
 	/*
 	 * For a seqscan in a serializable transaction, acquire a predicate lock
 	 * on the entire relation. This is required not only to lock all the
@@ -1598,6 +1652,9 @@ heap_endscan(HeapScanDesc scan)
 	if (scan->rs_strategy != NULL)
 		FreeAccessStrategy(scan->rs_strategy);
 
+	if (scan->rs_xidmemo != NULL)
+		pfree(scan->rs_xidmemo);
+
 	if (scan->rs_temp_snap)
 		UnregisterSnapshot(scan->rs_snapshot);
 
@@ -1661,6 +1718,25 @@ heap_beginscan_parallel(Relation relation, ParallelHeapScanDesc parallel_scan)
 								   true, true, true, false, false, true);
 }
 
+/* ----------------
+ *		heap_begin_read_stream - set up read-ahead for a forward scan
+ *
+ *		For a parallel scan, the read stream covers the whole scan rather
+ *		than the pages this backend gets, so that each page is prefetched
+ *		by whichever backend reads the page "distance" pages before it.
+ * ----------------
+ */
+static void
+heap_begin_read_stream(HeapScanDesc scan)
+{
+	if (scan->rs_parallel != NULL)
+		ReadStreamBegin(&scan->rs_stream, scan->rs_parallel->phs_startblock,
+						scan->rs_nblocks, scan->rs_nblocks);
+	else
+		ReadStreamBegin(&scan->rs_stream, scan->rs_startblock,
+						scan->rs_numblocks, scan->rs_nblocks);
+}
+
 /* ----------------
  *		heap_parallelscan_nextpage - get the next page to scan
  *
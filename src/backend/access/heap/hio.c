@@ -15,16 +15,33 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/heapam.h"
 #include "access/hio.h"
 #include "access/htup_details.h"
 #include "access/visibilitymap.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
+#include "storage/shmem.h"
 #include "storage/smgr.h"
 
 
+/*
+ * Upper limit on the number of blocks added by one bulk extension, and the
+ * number of shared slots remembering the size of each relation's previous
+ * bulk extension.  Relations are mapped to slots by hashing their
+ * relfilenode; two relations sharing a slot just get a less accurate
+ * estimate.
+ */
+#define MAX_EXTRA_BLOCKS		512
+#define EXTENSION_SIZE_SLOTS	1024
+
+static pg_atomic_uint32 *ExtensionSizes = NULL;
+
+
 /*
  * RelationPutHeapTuple - place tuple at specified page
  *
@@ -173,70 +190,125 @@ GetVisibilityMapPins(Relation relation, Buffer buffer1, Buffer buffer2,
  * relation extension lock.  Our goal is to pre-extend the relation by an
  * amount which ramps up as the degree of contention ramps up, but limiting
  * the result to some sane overall value.
+ *
+ * Caller must hold the relation extension lock.
  */
 static void
 RelationAddExtraBlocks(Relation relation, BulkInsertState bistate)
 {
 	Page		page;
-	BlockNumber blockNum = InvalidBlockNumber,
-				firstBlock = InvalidBlockNumber;
+	BlockNumber blockNum,
+				firstBlock;
+	uint32		slot;
+	pg_atomic_uint32 *lastExtension;
 	int			extraBlocks = 0;
 	int			lockWaiters = 0;
 	Size		freespace = 0;
 	Buffer		buffer;
+	int			i;
+
+	slot = DatumGetUInt32(hash_any((unsigned char *) &relation->rd_node,
+								   sizeof(RelFileNode)));
+	lastExtension = &ExtensionSizes[slot % EXTENSION_SIZE_SLOTS];
 
-	/* Use the length of the lock wait queue to judge how much to extend. */
+	/*
+	 * Use the length of the lock wait queue to judge how much to extend.  It
+	 * might seem like multiplying the number of lock waiters by as much as 20
+	 * is too aggressive, but benchmarking revealed that smaller numbers were
+	 * insufficient.
+	 *
+	 * Under sustained contention the queue length alone understates the
+	 * need, since every bulk extension empties the queue again, so we also
+	 * double the size of the relation's previous bulk extension.  Once there
+	 * are no more waiters, the size decays by half each time instead.
+	 * MAX_EXTRA_BLOCKS is just an arbitrary cap to prevent pathological
+	 * results.
+	 */
 	lockWaiters = RelationExtensionLockWaiterCount(relation);
-	if (lockWaiters <= 0)
+	if (lockWaiters > 0)
+		extraBlocks = Max(lockWaiters * 20,
+						  (int) pg_atomic_read_u32(lastExtension) * 2);
+	else
+		extraBlocks = pg_atomic_read_u32(lastExtension) / 2;
+	extraBlocks = Min(MAX_EXTRA_BLOCKS, extraBlocks);
+
+	pg_atomic_write_u32(lastExtension, extraBlocks);
+	if (extraBlocks <= 0)
 		return;
 
 	/*
-	 * It might seem like multiplying the number of lock waiters by as much as
-	 * 20 is too aggressive, but benchmarking revealed that smaller numbers
-	 * were insufficient.  512 is just an arbitrary cap to prevent
-	 * pathological results.
+	 * Extend the file by all the blocks at once.  Since we hold the extension
+	 * lock, nobody else can extend the relation meanwhile; concurrent readers
+	 * may see the new pages, but they are all-zeroes, so they treat them as
+	 * empty.
 	 */
-	extraBlocks = Min(512, lockWaiters * 20);
+	RelationOpenSmgr(relation);
+	firstBlock = smgrnblocks(relation->rd_smgr, MAIN_FORKNUM);
+	smgrzeroextend(relation->rd_smgr, MAIN_FORKNUM, firstBlock, extraBlocks,
+				   false);
 
-	while (extraBlocks-- >= 0)
+	/* Now initialize each page through shared buffers */
+	for (i = 0; i < extraBlocks; i++)
 	{
-		/* Ouch - an unnecessary lseek() each time through the loop! */
-		buffer = ReadBufferBI(relation, P_NEW, bistate);
-
-		/* Extend by one page. */
-		LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+		blockNum = firstBlock + i;
+		buffer = ReadBufferExtended(relation, MAIN_FORKNUM, blockNum,
+									RBM_ZERO_AND_LOCK,
+									bistate ? bistate->strategy : NULL);
 		page = BufferGetPage(buffer);
 		PageInit(page, BufferGetPageSize(buffer), 0);
 		MarkBufferDirty(buffer);
-		blockNum = BufferGetBlockNumber(buffer);
 		freespace = PageGetHeapFreeSpace(page);
 		UnlockReleaseBuffer(buffer);
-
-		/* Remember first block number thus added. */
-		if (firstBlock == InvalidBlockNumber)
-			firstBlock = blockNum;
-
-		/*
-		 * Immediately update the bottom level of the FSM.  This has a good
-		 * chance of making this page visible to other concurrently inserting
-		 * backends, and we want that to happen without delay.
-		 */
-		RecordPageWithFreeSpace(relation, blockNum, freespace);
 	}
 
 	/*
-	 * Updating the upper levels of the free space map is too expensive to do
-	 * for every block, but it's worth doing once at the end to make sure that
-	 * subsequent insertion activity sees all of those nifty free pages we
-	 * just inserted.
+	 * Record all the new pages in the bottom level of the FSM, touching each
+	 * FSM page just once.  Updating the upper levels is more expensive, but
+	 * it's worth doing once at the end to make sure that subsequent insertion
+	 * activity sees all of those nifty free pages we just inserted.
 	 *
 	 * Note that we're using the freespace value that was reported for the
 	 * last block we added as if it were the freespace value for every block
 	 * we added.  That's actually true, because they're all equally empty.
 	 */
+	blockNum = firstBlock + extraBlocks - 1;
+	RecordPagesWithFreeSpace(relation, firstBlock, blockNum, freespace);
 	UpdateFreeSpaceMap(relation, firstBlock, blockNum, freespace);
 }
 
+/*
+ * HeapExtensionShmemSize --- report amount of shared memory space needed
+ */
+Size
+HeapExtensionShmemSize(void)
+{
+	return mul_size(EXTENSION_SIZE_SLOTS, sizeof(pg_atomic_uint32));
+}
+
+/*
+ * HeapExtensionShmemInit --- initialize the shared bulk extension sizes
+ */
+void
+HeapExtensionShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	ExtensionSizes = (pg_atomic_uint32 *)
+		ShmemInitStruct("Heap Extension Sizes",
+						HeapExtensionShmemSize(),
+						&found);
+
+	if (!IsUnderPostmaster)
+	{
+		Assert(!found);
+		for (i = 0; i < EXTENSION_SIZE_SLOTS; i++)
+			pg_atomic_init_u32(&ExtensionSizes[i], 0);
+	}
+	else
+		Assert(found);
+}
+
 /*
  * RelationGetBufferForTuple
  *
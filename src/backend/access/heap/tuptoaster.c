@@ -29,6 +29,9 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
 
 #include "access/genam.h"
 #include "access/heapam.h"
@@ -37,6 +40,7 @@
 #include "catalog/catalog.h"
 #include "common/pg_lzcompress.h"
 #include "miscadmin.h"
+#include "utils/attoptcache.h"
 #include "utils/expandeddatum.h"
 #include "utils/fmgroids.h"
 #include "utils/rel.h"
@@ -53,7 +57,7 @@
 typedef struct toast_compress_header
 {
 	int32		vl_len_;		/* varlena header (do not touch directly!) */
-	int32		rawsize;
+	uint32		rawsize;		/* raw size and compression method */
 } toast_compress_header;
 
 /*
@@ -61,11 +65,16 @@ typedef struct toast_compress_header
  * toast entries.
  */
 #define TOAST_COMPRESS_HDRSZ		((int32) sizeof(toast_compress_header))
-#define TOAST_COMPRESS_RAWSIZE(ptr) (((toast_compress_header *) (ptr))->rawsize)
+#define TOAST_COMPRESS_RAWSIZE(ptr) \
+	((int32) (((toast_compress_header *) (ptr))->rawsize & VARLENA_RAWSIZE_MASK))
 #define TOAST_COMPRESS_RAWDATA(ptr) \
 	(((char *) (ptr)) + TOAST_COMPRESS_HDRSZ)
-#define TOAST_COMPRESS_SET_RAWSIZE(ptr, len) \
-	(((toast_compress_header *) (ptr))->rawsize = (len))
+#define TOAST_COMPRESS_SET_RAWSIZE(ptr, len, method) \
+	(((toast_compress_header *) (ptr))->rawsize = \
+	 (uint32) (len) | ((uint32) (method) << VARLENA_RAWSIZE_BITS))
+
+/* GUC */
+int			default_toast_compression = TOAST_PGLZ_COMPRESSION;
 
 static void toast_delete_datum(Relation rel, Datum value, bool is_speculative);
 static Datum toast_save_datum(Relation rel, Datum value,
@@ -774,7 +783,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		if (att[i]->attstorage == 'x')
 		{
 			old_value = toast_values[i];
-			new_value = toast_compress_datum(old_value);
+			new_value = toast_compress_datum(old_value,
+										toast_get_compression(rel, i + 1));
 
 			if (DatumGetPointer(new_value) != NULL)
 			{
@@ -913,7 +923,8 @@ toast_insert_or_update(Relation rel, HeapTuple newtup, HeapTuple oldtup,
 		 */
 		i = biggest_attno;
 		old_value = toast_values[i];
-		new_value = toast_compress_datum(old_value);
+		new_value = toast_compress_datum(old_value,
+									toast_get_compression(rel, i + 1));
 
 		if (DatumGetPointer(new_value) != NULL)
 		{
@@ -1291,7 +1302,7 @@ toast_flatten_tuple_to_datum(HeapTupleHeader tup,
 /* ----------
  * toast_compress_datum -
  *
- *	Create a compressed version of a varlena datum
+ *	Create a compressed version of a varlena datum, using the given method
  *
  *	If we fail (ie, compressed result is actually bigger than original)
  *	then return NULL.  We must not use compressed data if it'd expand
@@ -1302,7 +1313,7 @@ toast_flatten_tuple_to_datum(HeapTupleHeader tup,
  * ----------
  */
 Datum
-toast_compress_datum(Datum value)
+toast_compress_datum(Datum value, int method)
 {
 	struct varlena *tmp;
 	int32		valsize = VARSIZE_ANY_EXHDR(DatumGetPointer(value));
@@ -1313,17 +1324,42 @@ toast_compress_datum(Datum value)
 
 	/*
 	 * No point in wasting a palloc cycle if value size is out of the allowed
-	 * range for compression
+	 * range for compression.  pglz's limits are used for all methods, so
+	 * that switching the method doesn't change which values get compressed.
 	 */
 	if (valsize < PGLZ_strategy_default->min_input_size ||
 		valsize > PGLZ_strategy_default->max_input_size)
 		return PointerGetDatum(NULL);
 
-	tmp = (struct varlena *) palloc(PGLZ_MAX_OUTPUT(valsize) +
-									TOAST_COMPRESS_HDRSZ);
+	switch (method)
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			tmp = (struct varlena *) palloc(PGLZ_MAX_OUTPUT(valsize) +
+											TOAST_COMPRESS_HDRSZ);
+			len = pglz_compress(VARDATA_ANY(DatumGetPointer(value)),
+								valsize,
+								TOAST_COMPRESS_RAWDATA(tmp),
+								PGLZ_strategy_default);
+			break;
+#ifdef USE_LZ4
+		case TOAST_LZ4_COMPRESSION:
+			tmp = (struct varlena *) palloc(LZ4_compressBound(valsize) +
+											TOAST_COMPRESS_HDRSZ);
+			len = LZ4_compress_default(VARDATA_ANY(DatumGetPointer(value)),
+									   TOAST_COMPRESS_RAWDATA(tmp),
+									   valsize,
+									   LZ4_compressBound(valsize));
+			if (len <= 0)
+				len = -1;
+			break;
+#endif
+		default:
+			elog(ERROR, "unsupported compression method %d", method);
+			return PointerGetDatum(NULL);		/* keep compiler quiet */
+	}
 
 	/*
-	 * We recheck the actual size even if pglz_compress() reports success,
+	 * We recheck the actual size even if the compressor reports success,
 	 * because it might be satisfied with having saved as little as one byte
 	 * in the compressed data --- which could turn into a net loss once you
 	 * consider header and alignment padding.  Worst case, the compressed
@@ -1332,14 +1368,10 @@ toast_compress_datum(Datum value)
 	 * only one header byte and no padding if the value is short enough.  So
 	 * we insist on a savings of more than 2 bytes to ensure we have a gain.
 	 */
-	len = pglz_compress(VARDATA_ANY(DatumGetPointer(value)),
-						valsize,
-						TOAST_COMPRESS_RAWDATA(tmp),
-						PGLZ_strategy_default);
 	if (len >= 0 &&
 		len + TOAST_COMPRESS_HDRSZ < valsize - 2)
 	{
-		TOAST_COMPRESS_SET_RAWSIZE(tmp, valsize);
+		TOAST_COMPRESS_SET_RAWSIZE(tmp, valsize, method);
 		SET_VARSIZE_COMPRESSED(tmp, len + TOAST_COMPRESS_HDRSZ);
 		/* successful compression */
 		return PointerGetDatum(tmp);
@@ -1352,6 +1384,85 @@ toast_compress_datum(Datum value)
 	}
 }
 
+/* ----------
+ * toast_get_compression -
+ *
+ *	Return the compression method for the given column of a relation: the
+ *	column's "compression" option if set, else default_toast_compression.
+ * ----------
+ */
+int
+toast_get_compression(Relation rel, int attnum)
+{
+	AttributeOpts *aopts;
+	int			method = default_toast_compression;
+
+	/* System catalogs can't have attribute options */
+	if (IsCatalogRelation(rel))
+		return method;
+
+	aopts = get_attribute_options(RelationGetRelid(rel), attnum);
+	if (aopts != NULL)
+	{
+		if (aopts->compression_offset != 0)
+		{
+			method = toast_compression_method((char *) aopts +
+											  aopts->compression_offset);
+			/* the option was validated, but this build may differ */
+			if (method < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("compression method \"%s\" of column \"%s\" is not supported by this build",
+								(char *) aopts + aopts->compression_offset,
+								NameStr(rel->rd_att->attrs[attnum - 1]->attname))));
+		}
+		pfree(aopts);
+	}
+
+	return method;
+}
+
+/* ----------
+ * toast_compression_method -
+ *
+ *	Look up a compression method by name.  Returns -1 if the method is
+ *	unknown or not supported by this build.
+ * ----------
+ */
+int
+toast_compression_method(const char *name)
+{
+	if (pg_strcasecmp(name, "pglz") == 0)
+		return TOAST_PGLZ_COMPRESSION;
+#ifdef USE_LZ4
+	if (pg_strcasecmp(name, "lz4") == 0)
+		return TOAST_LZ4_COMPRESSION;
+#endif
+	return -1;
+}
+
+/*
+ * Validator for the "compression" attribute option
+ */
+void
+validateToastCompressionOption(char *value)
+{
+	if (value == NULL || toast_compression_method(value) < 0)
+	{
+#ifndef USE_LZ4
+		if (value != NULL && pg_strcasecmp(value, "lz4") == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("LZ4 compression is not supported by this build"),
+					 errhint("Rebuild with --with-lz4 to use it.")));
+#endif
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid value for \"compression\" option"),
+				 errdetail("Valid values are \"pglz\" and \"lz4\".")));
+	}
+}
+
 
 /* ----------
  * toast_get_valid_index
@@ -2208,6 +2319,7 @@ static struct varlena *
 toast_decompress_datum(struct varlena * attr)
 {
 	struct varlena *result;
+	int32		rawsize;
 
 	Assert(VARATT_IS_COMPRESSED(attr));
 
@@ -2215,10 +2327,35 @@ toast_decompress_datum(struct varlena * attr)
 		palloc(TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
 	SET_VARSIZE(result, TOAST_COMPRESS_RAWSIZE(attr) + VARHDRSZ);
 
-	if (pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
-						VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
-						VARDATA(result),
-						TOAST_COMPRESS_RAWSIZE(attr)) < 0)
+	switch (TOAST_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION:
+			rawsize = pglz_decompress(TOAST_COMPRESS_RAWDATA(attr),
+									  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+									  VARDATA(result),
+									  TOAST_COMPRESS_RAWSIZE(attr));
+			break;
+		case TOAST_LZ4_COMPRESSION:
+#ifdef USE_LZ4
+			rawsize = LZ4_decompress_safe(TOAST_COMPRESS_RAWDATA(attr),
+										  VARDATA(result),
+										  VARSIZE(attr) - TOAST_COMPRESS_HDRSZ,
+										  TOAST_COMPRESS_RAWSIZE(attr));
+			if (rawsize != TOAST_COMPRESS_RAWSIZE(attr))
+				rawsize = -1;
+			break;
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("LZ4 compression is not supported by this build")));
+#endif
+		default:
+			elog(ERROR, "compressed data uses unknown compression method %d",
+				 (int) TOAST_COMPRESS_METHOD(attr));
+			rawsize = -1;		/* keep compiler quiet */
+	}
+
+	if (rawsize < 0)
 		elog(ERROR, "compressed data is corrupted");
 
 	return result;
@@ -125,6 +125,9 @@ RelationGetIndexScan(Relation indexRelation, int nkeys, int norderbys)
 	scan->xs_cbuf = InvalidBuffer;
 	scan->xs_continue_hot = false;
 
+	scan->xs_temp_snap = false;
+	scan->parallel_scan = NULL;
+
 	return scan;
 }
 
@@ -0,0 +1,308 @@
+/*-------------------------------------------------------------------------
+ *
+ * nbtdedup.c
+ *	  Merge duplicate leaf items of a Postgres btree into posting lists.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/nbtree/nbtdedup.c
+ *
+ *	NOTES
+ *	   Deduplication is done lazily: _bt_findinsertloc() calls
+ *	   _bt_dedup_one_page() only when an insertion would otherwise have to
+ *	   split a leaf page.  See the comments in nbtree.h for the layout of a
+ *	   posting list tuple.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/nbtree.h"
+#include "access/xloginsert.h"
+#include "miscadmin.h"
+#include "utils/rel.h"
+
+static bool _bt_keys_identical(IndexTuple a, IndexTuple b);
+
+
+/*
+ *	_bt_dedup_one_page() -- Merge runs of duplicates on a leaf page.
+ *
+ *		Each run of adjacent items with bitwise identical keys is replaced
+ *		by one posting list tuple holding all of their heap TIDs, as long as
+ *		the result stays under half of BTMaxItemSize; longer runs are broken
+ *		into several posting lists.  Items marked LP_DEAD are left alone.
+ *
+ *		Only non-unique indexes are deduplicated, and only if the
+ *		deduplicate_items reloption hasn't been turned off.  The caller must
+ *		hold an exclusive lock on the buffer.  Returns true if the page was
+ *		changed, in which case any offsets the caller remembered are stale.
+ */
+bool
+_bt_dedup_one_page(Relation rel, Buffer buf)
+{
+	Page		page = BufferGetPage(buf);
+	BTPageOpaque opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+	BTDedupInterval intervals[MaxIndexTuplesPerPage];
+	int			nintervals = 0;
+	IndexTuple	base = NULL;
+	OffsetNumber baseoff = InvalidOffsetNumber;
+	Size		keysize = 0;
+	int			nitems = 0;
+	int			nhtids = 0;
+	Size		maxpostingsize;
+	OffsetNumber offnum,
+				minoff,
+				maxoff;
+	Page		newpage;
+
+	Assert(P_ISLEAF(opaque));
+
+	if (rel->rd_index->indisunique || !BTGetDeduplicateItems(rel))
+		return false;
+
+	maxpostingsize = BTMaxItemSize(page) / 2;
+	minoff = P_FIRSTDATAKEY(opaque);
+	maxoff = PageGetMaxOffsetNumber(page);
+
+	for (offnum = minoff; offnum <= maxoff; offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		itemid = PageGetItemId(page, offnum);
+		IndexTuple	itup = (IndexTuple) PageGetItem(page, itemid);
+		int			ntids;
+
+		ntids = BTreeTupleIsPosting(itup) ? BTreeTupleGetNPosting(itup) : 1;
+
+		/* extend the pending run if we can */
+		if (base != NULL && !ItemIdIsDead(itemid) &&
+			_bt_keys_identical(base, itup) &&
+			MAXALIGN(keysize + (nhtids + ntids) * sizeof(ItemPointerData)) <=
+			maxpostingsize)
+		{
+			nitems++;
+			nhtids += ntids;
+			continue;
+		}
+
+		/* otherwise finish it, and start a new one with this item */
+		if (nitems > 1)
+		{
+			intervals[nintervals].baseoff = baseoff;
+			intervals[nintervals].nitems = nitems;
+			nintervals++;
+		}
+
+		if (ItemIdIsDead(itemid))
+		{
+			base = NULL;
+			nitems = 0;
+			continue;
+		}
+
+		base = itup;
+		baseoff = offnum;
+		keysize = BTreeTupleGetKeySize(itup);
+		nitems = 1;
+		nhtids = ntids;
+	}
+
+	if (nitems > 1)
+	{
+		intervals[nintervals].baseoff = baseoff;
+		intervals[nintervals].nitems = nitems;
+		nintervals++;
+	}
+
+	if (nintervals == 0)
+		return false;
+
+	/* build the new page outside the critical section, since it pallocs */
+	newpage = _bt_dedup_build_page(page, intervals, nintervals);
+
+	/* No ereport(ERROR) until changes are logged */
+	START_CRIT_SECTION();
+
+	PageRestoreTempPage(newpage, page);
+
+	/* LP_DEAD hints didn't survive the rewrite */
+	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+	opaque->btpo_flags &= ~BTP_HAS_GARBAGE;
+
+	MarkBufferDirty(buf);
+
+	/* XLOG stuff */
+	if (RelationNeedsWAL(rel))
+	{
+		XLogRecPtr	recptr;
+		xl_btree_dedup xlrec;
+
+		xlrec.nintervals = nintervals;
+
+		XLogBeginInsert();
+		XLogRegisterBuffer(0, buf, REGBUF_STANDARD);
+		XLogRegisterData((char *) &xlrec, SizeOfBtreeDedup);
+		XLogRegisterBufData(0, (char *) intervals,
+							nintervals * sizeof(BTDedupInterval));
+
+		recptr = XLogInsert(RM_BTREE_ID, XLOG_BTREE_DEDUP);
+
+		PageSetLSN(page, recptr);
+	}
+
+	END_CRIT_SECTION();
+
+	return true;
+}
+
+/*
+ *	_bt_dedup_build_page() -- Apply a set of merge intervals to a page.
+ *
+ *		Returns a palloc'd temporary copy of the page in which the items
+ *		named by each interval have been replaced by a single posting list
+ *		tuple.  Intervals must be in increasing order of baseoff.  This is
+ *		shared with WAL replay, so that the page comes out the same on the
+ *		standby.
+ *
+ *		The heap TIDs are kept in page order rather than sorted, so that a
+ *		scan returns equal keys in the same order as it did before the
+ *		merge (newest first, since new items go in front of equal keys).
+ */
+Page
+_bt_dedup_build_page(Page page, BTDedupInterval *intervals, int nintervals)
+{
+	Page		newpage = PageGetTempPageCopySpecial(page);
+	ItemPointer htids;
+	OffsetNumber offnum,
+				maxoff,
+				newoff;
+	int			i = 0;
+
+	htids = (ItemPointer) palloc(MaxBTreeTIDsPerPage * sizeof(ItemPointerData));
+
+	maxoff = PageGetMaxOffsetNumber(page);
+	newoff = FirstOffsetNumber;
+	for (offnum = FirstOffsetNumber; offnum <= maxoff; offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		itemid = PageGetItemId(page, offnum);
+		IndexTuple	itup = (IndexTuple) PageGetItem(page, itemid);
+
+		if (i < nintervals && intervals[i].baseoff == offnum)
+		{
+			IndexTuple	posting;
+			int			nhtids = 0;
+			int			j;
+
+			for (j = 0; j < intervals[i].nitems; j++)
+			{
+				IndexTuple	cur;
+
+				cur = (IndexTuple) PageGetItem(page,
+											   PageGetItemId(page, offnum + j));
+				if (BTreeTupleIsPosting(cur))
+				{
+					memcpy(htids + nhtids, BTreeTupleGetPosting(cur),
+						   BTreeTupleGetNPosting(cur) * sizeof(ItemPointerData));
+					nhtids += BTreeTupleGetNPosting(cur);
+				}
+				else
+					htids[nhtids++] = cur->t_tid;
+			}
+
+			posting = _bt_form_posting(itup, htids, nhtids);
+			if (PageAddItem(newpage, (Item) posting, IndexTupleSize(posting),
+							newoff, false, false) == InvalidOffsetNumber)
+				elog(ERROR, "failed to add posting list item to btree page");
+			pfree(posting);
+
+			offnum += intervals[i].nitems - 1;
+			i++;
+		}
+		else if (PageAddItem(newpage, (Item) itup, ItemIdGetLength(itemid),
+							 newoff, false, false) == InvalidOffsetNumber)
+			elog(ERROR, "failed to add item to btree page");
+
+		newoff = OffsetNumberNext(newoff);
+	}
+	Assert(i == nintervals);
+
+	pfree(htids);
+
+	return newpage;
+}
+
+/*
+ *	_bt_form_posting() -- Build a leaf tuple with base's key and given TIDs.
+ *
+ *		base may itself be a posting list; only its key is used.  With a
+ *		single TID the result is an ordinary tuple.
+ */
+IndexTuple
+_bt_form_posting(IndexTuple base, ItemPointer htids, int nhtids)
+{
+	Size		keysize = BTreeTupleGetKeySize(base);
+	Size		newsize;
+	IndexTuple	itup;
+
+	Assert(nhtids > 0);
+	Assert(keysize == MAXALIGN(keysize));
+
+	if (nhtids > 1)
+		newsize = MAXALIGN(keysize + nhtids * sizeof(ItemPointerData));
+	else
+		newsize = keysize;
+
+	itup = (IndexTuple) palloc0(newsize);
+	memcpy(itup, base, keysize);
+	itup->t_info &= ~(INDEX_SIZE_MASK | BT_IS_POSTING);
+	itup->t_info |= newsize;
+
+	if (nhtids > 1)
+	{
+		BTreeTupleSetPosting(itup, nhtids, keysize);
+		memcpy(BTreeTupleGetPosting(itup), htids,
+			   nhtids * sizeof(ItemPointerData));
+	}
+	else
+		itup->t_tid = htids[0];
+
+	return itup;
+}
+
+/*
+ *	_bt_update_posting() -- Replace the item at offnum with itup.
+ *
+ *		Used by VACUUM (and its replay) to shrink a posting list whose TIDs
+ *		are only partly dead.  The new tuple must not be larger than the old
+ *		one, so this can't fail for lack of space; we're in a critical
+ *		section anyway.
+ */
+void
+_bt_update_posting(Page page, OffsetNumber offnum, IndexTuple itup)
+{
+	PageIndexTupleDelete(page, offnum);
+	if (PageAddItem(page, (Item) itup, IndexTupleSize(itup), offnum,
+					false, false) == InvalidOffsetNumber)
+		elog(PANIC, "failed to update posting list item in btree page");
+}
+
+/*
+ * Are the keys of a and b bitwise identical?  Any TIDs are ignored.
+ */
+static bool
+_bt_keys_identical(IndexTuple a, IndexTuple b)
+{
+	Size		keysize = BTreeTupleGetKeySize(a);
+
+	if (BTreeTupleGetKeySize(b) != keysize)
+		return false;
+	if ((a->t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)) !=
+		(b->t_info & (INDEX_NULL_MASK | INDEX_VAR_MASK)))
+		return false;
+
+	return memcmp((char *) a + sizeof(IndexTupleData),
+				  (char *) b + sizeof(IndexTupleData),
+				  keysize - sizeof(IndexTupleData)) == 0;
+}
@@ -22,6 +22,7 @@
 #include "miscadmin.h"
 #include "storage/lmgr.h"
 #include "storage/predicate.h"
+#include "storage/smgr.h"
 #include "utils/tqual.h"
 
 
@@ -110,32 +111,87 @@ _bt_doinsert(Relation rel, IndexTuple itup,
 	bool		is_unique = false;
 	int			natts = rel->rd_rel->relnatts;
 	ScanKey		itup_scankey;
-	BTStack		stack;
+	BTStack		stack = NULL;
 	Buffer		buf;
 	OffsetNumber offset;
+	bool		fastpath;
 
 	/* we need an insertion scan key to do our search, so build one */
 	itup_scankey = _bt_mkscankey(rel, itup);
 
+	/*
+	 * Indexes on serial or timestamp columns get every new key at the right
+	 * end of the tree.  To save the descent from the root in that case, we
+	 * remember the rightmost leaf we last inserted into (see
+	 * _bt_insertonpg) and try it first.  If it is still the rightmost leaf,
+	 * has room for the new tuple, and the new key is strictly greater than
+	 * its first data key, then the key can only belong on that page, so we
+	 * insert there directly.  That last test also means no equal key can
+	 * be on an earlier page, so uniqueness checks are unaffected.
+	 *
+	 * We only try for the lock conditionally: if some other backend holds
+	 * it, the page is likely to have changed anyway, so forget it and take
+	 * the normal path.
+	 */
 top:
-	/* find the first page containing this key */
-	stack = _bt_search(rel, natts, itup_scankey, false, &buf, BT_WRITE, NULL);
-
+	fastpath = false;
 	offset = InvalidOffsetNumber;
+	if (RelationGetTargetBlock(rel) != InvalidBlockNumber)
+	{
+		Size		itemsz;
+		Page		page;
+		BTPageOpaque lpageop;
 
-	/* trade in our read lock for a write lock */
-	LockBuffer(buf, BUFFER_LOCK_UNLOCK);
-	LockBuffer(buf, BT_WRITE);
+		buf = ReadBuffer(rel, RelationGetTargetBlock(rel));
 
-	/*
-	 * If the page was split between the time that we surrendered our read
-	 * lock and acquired our write lock, then this page may no longer be the
-	 * right place for the key we want to insert.  In this case, we need to
-	 * move right in the tree.  See Lehman and Yao for an excruciatingly
-	 * precise description.
-	 */
-	buf = _bt_moveright(rel, buf, natts, itup_scankey, false,
-						true, stack, BT_WRITE, NULL);
+		if (ConditionalLockBuffer(buf))
+		{
+			_bt_checkpage(rel, buf);
+
+			page = BufferGetPage(buf);
+			lpageop = (BTPageOpaque) PageGetSpecialPointer(page);
+			itemsz = MAXALIGN(IndexTupleDSize(*itup));
+
+			if (P_ISLEAF(lpageop) && P_RIGHTMOST(lpageop) &&
+				!P_IGNORE(lpageop) && !P_INCOMPLETE_SPLIT(lpageop) &&
+				PageGetFreeSpace(page) > itemsz &&
+				PageGetMaxOffsetNumber(page) >= P_FIRSTDATAKEY(lpageop) &&
+				_bt_compare(rel, natts, itup_scankey, page,
+							P_FIRSTDATAKEY(lpageop)) > 0)
+				fastpath = true;
+			else
+			{
+				_bt_relbuf(rel, buf);
+				RelationSetTargetBlock(rel, InvalidBlockNumber);
+			}
+		}
+		else
+		{
+			ReleaseBuffer(buf);
+			RelationSetTargetBlock(rel, InvalidBlockNumber);
+		}
+	}
+
+	if (!fastpath)
+	{
+		/* find the first page containing this key */
+		stack = _bt_search(rel, natts, itup_scankey, false, &buf, BT_WRITE,
+						   NULL);
+
+		/* trade in our read lock for a write lock */
+		LockBuffer(buf, BUFFER_LOCK_UNLOCK);
+		LockBuffer(buf, BT_WRITE);
+
+		/*
+		 * If the page was split between the time that we surrendered our
+		 * read lock and acquired our write lock, then this page may no
+		 * longer be the right place for the key we want to insert.  In this
+		 * case, we need to move right in the tree.  See Lehman and Yao for
+		 * an excruciatingly precise description.
+		 */
+		buf = _bt_moveright(rel, buf, natts, itup_scankey, false,
+							true, stack, BT_WRITE, NULL);
+	}
 
 	/*
 	 * If we're not allowing duplicates, make sure the key isn't already in
@@ -184,6 +240,7 @@ top:
 
 			/* start over... */
 			_bt_freestack(stack);
+			stack = NULL;
 			goto top;
 		}
 	}
@@ -522,7 +579,8 @@ _bt_check_unique(Relation rel, IndexTuple itup, Relation heapRel,
  *		any existing equal keys because of the way _bt_binsrch() works.
  *
  *		If there's not enough room in the space, we try to make room by
- *		removing any LP_DEAD tuples.
+ *		removing any LP_DEAD tuples, and failing that, by merging duplicates
+ *		into posting lists on the page we'd otherwise split.
  *
  *		On entry, *bufptr and *offsetptr point to the first legal position
  *		where the new tuple could be inserted.  The caller should hold an
@@ -631,7 +689,16 @@ _bt_findinsertloc(Relation rel,
 		if (P_RIGHTMOST(lpageop) ||
 			_bt_compare(rel, keysz, scankey, page, P_HIKEY) != 0 ||
 			random() <= (MAX_RANDOM_VALUE / 100))
+		{
+			/*
+			 * We're going to split this page, unless deduplication can
+			 * still make enough room.  That rewrites the page, so the hint
+			 * is invalid afterwards, just as if we'd vacuumed it.
+			 */
+			if (P_ISLEAF(lpageop) && _bt_dedup_one_page(rel, buf))
+				vacuumed = true;
 			break;
+		}
 
 		/*
 		 * step right to next non-dead page
@@ -809,6 +876,7 @@ _bt_insertonpg(Relation rel,
 		BTMetaPageData *metad = NULL;
 		OffsetNumber itup_off;
 		BlockNumber itup_blkno;
+		BlockNumber cachedBlock = InvalidBlockNumber;
 
 		itup_off = newitemoff;
 		itup_blkno = BufferGetBlockNumber(buf);
@@ -931,12 +999,28 @@ _bt_insertonpg(Relation rel,
 
 		END_CRIT_SECTION();
 
+		/*
+		 * Remember the rightmost leaf for _bt_doinsert's fastpath.  Don't
+		 * bother when it is also the root: the descent costs nothing then.
+		 */
+		if (P_ISLEAF(lpageop) && P_RIGHTMOST(lpageop) && !P_ISROOT(lpageop))
+			cachedBlock = itup_blkno;
+
 		/* release buffers */
 		if (BufferIsValid(metabuf))
 			_bt_relbuf(rel, metabuf);
 		if (BufferIsValid(cbuf))
 			_bt_relbuf(rel, cbuf);
 		_bt_relbuf(rel, buf);
+
+		/*
+		 * Only cache it for trees of some height, where skipping the upper
+		 * levels is worth the extra lock attempt.  _bt_getrootheight() may
+		 * read the metapage, so do this after releasing our locks.
+		 */
+		if (BlockNumberIsValid(cachedBlock) &&
+			_bt_getrootheight(rel) >= BTREE_FASTPATH_MIN_LEVEL)
+			RelationSetTargetBlock(rel, cachedBlock);
 	}
 }
 
@@ -975,6 +1059,7 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 	Size		itemsz;
 	ItemId		itemid;
 	IndexTuple	item;
+	IndexTuple	lhikey;
 	OffsetNumber leftoff,
 				rightoff;
 	OffsetNumber maxoff;
@@ -1081,6 +1166,18 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 		itemsz = ItemIdGetLength(itemid);
 		item = (IndexTuple) PageGetItem(origpage, itemid);
 	}
+
+	/*
+	 * The high key is copied into the parent as a downlink, so it must not
+	 * be a posting list.  Keep just its key and first heap TID.
+	 */
+	lhikey = NULL;
+	if (BTreeTupleIsPosting(item))
+	{
+		lhikey = _bt_form_posting(item, BTreeTupleGetPosting(item), 1);
+		item = lhikey;
+		itemsz = IndexTupleSize(lhikey);
+	}
 	if (PageAddItem(leftpage, (Item) item, itemsz, leftoff,
 					false, false) == InvalidOffsetNumber)
 	{
@@ -1089,6 +1186,8 @@ _bt_split(Relation rel, Buffer buf, Buffer cbuf, OffsetNumber firstright,
 			 " while splitting block %u of index \"%s\"",
 			 origpagenumber, RelationGetRelationName(rel));
 	}
+	if (lhikey)
+		pfree(lhikey);
 	leftoff = OffsetNumberNext(leftoff);
 
 	/*
@@ -774,6 +774,10 @@ _bt_page_recyclable(Page page)
  * This routine assumes that the caller has pinned and locked the buffer.
  * Also, the given itemnos *must* appear in increasing order in the array.
  *
+ * updatenos/updated name posting list items that lose only some of their
+ * TIDs, and the smaller tuples that replace them.  Those offsets must not
+ * also appear in itemnos.
+ *
  * We record VACUUMs and b-tree deletes differently in WAL. InHotStandby
  * we need to be able to pin all of the blocks in the btree in physical
  * order when replaying the effects of a VACUUM, just as we do for the
@@ -787,15 +791,43 @@ _bt_page_recyclable(Page page)
 void
 _bt_delitems_vacuum(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems,
-					BlockNumber lastBlockVacuumed)
+					OffsetNumber *updatenos, IndexTuple *updated,
+					int nupdated, BlockNumber lastBlockVacuumed)
 {
 	Page		page = BufferGetPage(buf);
 	BTPageOpaque opaque;
+	char	   *updatedbuf = NULL;
+	Size		updatedbuflen = 0;
+	int			i;
+
+	/*
+	 * Flatten the replacement tuples for WAL before entering the critical
+	 * section, so that the record needs a bounded number of rdatas.
+	 */
+	if (nupdated > 0 && RelationNeedsWAL(rel))
+	{
+		for (i = 0; i < nupdated; i++)
+			updatedbuflen += IndexTupleSize(updated[i]);
+		updatedbuf = palloc(updatedbuflen);
+		updatedbuflen = 0;
+		for (i = 0; i < nupdated; i++)
+		{
+			memcpy(updatedbuf + updatedbuflen, updated[i],
+				   IndexTupleSize(updated[i]));
+			updatedbuflen += IndexTupleSize(updated[i]);
+		}
+	}
 
 	/* No ereport(ERROR) until changes are logged */
 	START_CRIT_SECTION();
 
-	/* Fix the page */
+	/*
+	 * Fix the page.  Updates go first, since they don't move any other items
+	 * around; replay does the same.
+	 */
+	for (i = 0; i < nupdated; i++)
+		_bt_update_posting(page, updatenos[i], updated[i]);
+
 	if (nitems > 0)
 		PageIndexMultiDelete(page, itemnos, nitems);
 
@@ -824,6 +856,8 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 		xl_btree_vacuum xlrec_vacuum;
 
 		xlrec_vacuum.lastBlockVacuumed = lastBlockVacuumed;
+		xlrec_vacuum.ndeleted = nitems;
+		xlrec_vacuum.nupdated = nupdated;
 
 		XLogBeginInsert();
 		XLogRegisterBuffer(0, buf, REGBUF_STANDARD);
@@ -836,6 +870,12 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 		 */
 		if (nitems > 0)
 			XLogRegisterBufData(0, (char *) itemnos, nitems * sizeof(OffsetNumber));
+		if (nupdated > 0)
+		{
+			XLogRegisterBufData(0, (char *) updatenos,
+								nupdated * sizeof(OffsetNumber));
+			XLogRegisterBufData(0, updatedbuf, updatedbuflen);
+		}
 
 		recptr = XLogInsert(RM_BTREE_ID, XLOG_BTREE_VACUUM);
 
@@ -843,6 +883,9 @@ _bt_delitems_vacuum(Relation rel, Buffer buf,
 	}
 
 	END_CRIT_SECTION();
+
+	if (updatedbuf)
+		pfree(updatedbuf);
 }
 
 /*
@@ -29,7 +29,13 @@ static bool _bt_readpage(IndexScanDesc scan, ScanDirection dir,
 			 OffsetNumber offnum);
 static void _bt_saveitem(BTScanOpaque so, int itemIndex,
 			 OffsetNumber offnum, IndexTuple itup);
+static void _bt_savepostingitems(BTScanOpaque so, int itemIndex,
+					 OffsetNumber offnum, IndexTuple itup);
 static bool _bt_steppage(IndexScanDesc scan, ScanDirection dir);
+static bool _bt_readnextpage(IndexScanDesc scan, BlockNumber blkno,
+				 ScanDirection dir);
+static bool _bt_parallel_readpage(IndexScanDesc scan, BlockNumber blkno,
+					  ScanDirection dir);
 static Buffer _bt_walk_left(Relation rel, Buffer buf, Snapshot snapshot);
 static bool _bt_endpoint(IndexScanDesc scan, ScanDirection dir);
 static void _bt_drop_lock_and_maybe_pin(IndexScanDesc scan, BTScanPos sp);
@@ -562,7 +568,39 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 	 * never be satisfied (eg, x == 1 AND x > 2).
 	 */
 	if (!so->qual_ok)
+	{
+		_bt_parallel_done(scan);
 		return false;
+	}
+
+	/*
+	 * For parallel scans, get the starting page from shared state.  If the
+	 * scan has not started, proceed to find out the first leaf page in the
+	 * usual way while keeping other participating processes waiting.  If the
+	 * scan has already begun, use the page number from the shared structure.
+	 */
+	if (scan->parallel_scan != NULL)
+	{
+		BlockNumber blkno;
+
+		/* the planner only builds parallel scans in forward direction */
+		if (!ScanDirectionIsForward(dir))
+			elog(ERROR, "parallel btree scans must be forward scans");
+
+		if (!_bt_parallel_seize(scan, &blkno))
+			return false;
+		else if (blkno == P_NONE)
+		{
+			_bt_parallel_done(scan);
+			return false;
+		}
+		else if (blkno != InvalidBlockNumber)
+		{
+			if (!_bt_parallel_readpage(scan, blkno, dir))
+				return false;
+			goto readcomplete;
+		}
+	}
 
 	/*----------
 	 * Examine the scan keys to discover where we need to start the scan.
@@ -993,6 +1031,12 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		 * because nothing finer to lock exists.
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
+
+		/*
+		 * Mark parallel scan as done, so that all the workers can finish
+		 * their scan.
+		 */
+		_bt_parallel_done(scan);
 		return false;
 	}
 	else
@@ -1060,6 +1104,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
 	}
 
+readcomplete:
 	/* OK, itemIndex says what to return */
 	currItem = &so->currPos.items[so->currPos.itemIndex];
 	scan->xs_ctup.t_self = currItem->heapTid;
@@ -1154,6 +1199,14 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 
 	page = BufferGetPage(so->currPos.buf);
 	opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+	/*
+	 * In a parallel scan, let the other participants move on to the next page
+	 * as soon as we know which one that is.
+	 */
+	if (scan->parallel_scan != NULL)
+		_bt_parallel_release(scan, opaque->btpo_next);
+
 	minoff = P_FIRSTDATAKEY(opaque);
 	maxoff = PageGetMaxOffsetNumber(page);
 
@@ -1199,8 +1252,16 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 			if (itup != NULL)
 			{
 				/* tuple passes all scan key conditions, so remember it */
-				_bt_saveitem(so, itemIndex, offnum, itup);
-				itemIndex++;
+				if (BTreeTupleIsPosting(itup))
+				{
+					_bt_savepostingitems(so, itemIndex, offnum, itup);
+					itemIndex += BTreeTupleGetNPosting(itup);
+				}
+				else
+				{
+					_bt_saveitem(so, itemIndex, offnum, itup);
+					itemIndex++;
+				}
 			}
 			if (!continuescan)
 			{
@@ -1212,7 +1273,7 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 			offnum = OffsetNumberNext(offnum);
 		}
 
-		Assert(itemIndex <= MaxIndexTuplesPerPage);
+		Assert(itemIndex <= MaxBTreeTIDsPerPage);
 		so->currPos.firstItem = 0;
 		so->currPos.lastItem = itemIndex - 1;
 		so->currPos.itemIndex = 0;
@@ -1220,7 +1281,7 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	else
 	{
 		/* load items[] in descending order */
-		itemIndex = MaxIndexTuplesPerPage;
+		itemIndex = MaxBTreeTIDsPerPage;
 
 		offnum = Min(offnum, maxoff);
 
@@ -1230,8 +1291,16 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 			if (itup != NULL)
 			{
 				/* tuple passes all scan key conditions, so remember it */
-				itemIndex--;
-				_bt_saveitem(so, itemIndex, offnum, itup);
+				if (BTreeTupleIsPosting(itup))
+				{
+					itemIndex -= BTreeTupleGetNPosting(itup);
+					_bt_savepostingitems(so, itemIndex, offnum, itup);
+				}
+				else
+				{
+					itemIndex--;
+					_bt_saveitem(so, itemIndex, offnum, itup);
+				}
 			}
 			if (!continuescan)
 			{
@@ -1245,8 +1314,8 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 
 		Assert(itemIndex >= 0);
 		so->currPos.firstItem = itemIndex;
-		so->currPos.lastItem = MaxIndexTuplesPerPage - 1;
-		so->currPos.itemIndex = MaxIndexTuplesPerPage - 1;
+		so->currPos.lastItem = MaxBTreeTIDsPerPage - 1;
+		so->currPos.itemIndex = MaxBTreeTIDsPerPage - 1;
 	}
 
 	return (so->currPos.firstItem <= so->currPos.lastItem);
@@ -1271,6 +1340,43 @@ _bt_saveitem(BTScanOpaque so, int itemIndex,
 	}
 }
 
+/*
+ * Save the heap TIDs of a posting list tuple into so->currPos.items[],
+ * starting at itemIndex and in TID order.  For an index-only scan, all of
+ * the items share one copy of the tuple with its posting list stripped off.
+ */
+static void
+_bt_savepostingitems(BTScanOpaque so, int itemIndex,
+					 OffsetNumber offnum, IndexTuple itup)
+{
+	int			nposting = BTreeTupleGetNPosting(itup);
+	LocationIndex tupleOffset = 0;
+	int			i;
+
+	if (so->currTuples)
+	{
+		Size		keysize = BTreeTupleGetPostingOffset(itup);
+		IndexTuple	base;
+
+		tupleOffset = so->currPos.nextTupleOffset;
+		base = (IndexTuple) (so->currTuples + tupleOffset);
+		memcpy(base, itup, keysize);
+		base->t_info &= ~(INDEX_SIZE_MASK | BT_IS_POSTING);
+		base->t_info |= keysize;
+		base->t_tid = *BTreeTupleGetPosting(itup);
+		so->currPos.nextTupleOffset += MAXALIGN(keysize);
+	}
+
+	for (i = 0; i < nposting; i++)
+	{
+		BTScanPosItem *currItem = &so->currPos.items[itemIndex + i];
+
+		currItem->heapTid = *BTreeTupleGetPostingN(itup, i);
+		currItem->indexOffset = offnum;
+		currItem->tupleOffset = tupleOffset;
+	}
+}
+
 /*
  *	_bt_steppage() -- Step to next page containing valid data for scan
  *
@@ -1323,9 +1429,7 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 
 	if (ScanDirectionIsForward(dir))
 	{
-		/* Walk right to the next page with data */
-		/* We must rely on the previously saved nextPage link! */
-		BlockNumber blkno = so->currPos.nextPage;
+		BlockNumber blkno;
 
 		/* Remember we left a page with data */
 		so->currPos.moreLeft = true;
@@ -1333,35 +1437,27 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 		/* release the previous buffer, if pinned */
 		BTScanPosUnpinIfPinned(so->currPos);
 
-		for (;;)
+		/* Walk right to the next page with data */
+		if (scan->parallel_scan != NULL)
 		{
-			/* if we're at end of scan, give up */
-			if (blkno == P_NONE || !so->currPos.moreRight)
+			/*
+			 * Seize the scan to get the next block number; if the scan has
+			 * ended already, bail out.
+			 */
+			if (!_bt_parallel_seize(scan, &blkno))
 			{
 				BTScanPosInvalidate(so->currPos);
 				return false;
 			}
-			/* check for interrupts while we're not holding any buffer lock */
-			CHECK_FOR_INTERRUPTS();
-			/* step right one page */
-			so->currPos.buf = _bt_getbuf(rel, blkno, BT_READ);
-			/* check for deleted page */
-			page = BufferGetPage(so->currPos.buf);
-			TestForOldSnapshot(scan->xs_snapshot, rel, page);
-			opaque = (BTPageOpaque) PageGetSpecialPointer(page);
-			if (!P_IGNORE(opaque))
-			{
-				PredicateLockPage(rel, blkno, scan->xs_snapshot);
-				/* see if there are any matches on this page */
-				/* note that this will clear moreRight if we can stop */
-				if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
-					break;
-			}
-
-			/* nope, keep going */
-			blkno = opaque->btpo_next;
-			_bt_relbuf(rel, so->currPos.buf);
 		}
+		else
+		{
+			/* We must rely on the previously saved nextPage link! */
+			blkno = so->currPos.nextPage;
+		}
+
+		if (!_bt_readnextpage(scan, blkno, dir))
+			return false;
 	}
 	else
 	{
@@ -1441,6 +1537,107 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 	return true;
 }
 
+/*
+ *	_bt_readnextpage() -- Read the next page with data in a forward scan
+ *
+ * blkno is the page to start at: the right-link saved from the previous page,
+ * or in a parallel scan the page handed out by _bt_parallel_seize(), which
+ * the caller must have called.
+ *
+ * On success exit, so->currPos is updated to contain data from the next
+ * interesting page, and we hold a pin and read lock on that page.  If there
+ * are no more matching records, we drop all locks and pins, set
+ * so->currPos.buf to InvalidBuffer, and return FALSE.
+ */
+static bool
+_bt_readnextpage(IndexScanDesc scan, BlockNumber blkno, ScanDirection dir)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Relation	rel = scan->indexRelation;
+	Page		page;
+	BTPageOpaque opaque;
+
+	Assert(ScanDirectionIsForward(dir));
+
+	for (;;)
+	{
+		/* if we're at end of scan, give up and mark parallel scan as done */
+		if (blkno == P_NONE || !so->currPos.moreRight)
+		{
+			_bt_parallel_done(scan);
+			BTScanPosInvalidate(so->currPos);
+			return false;
+		}
+		/* check for interrupts while we're not holding any buffer lock */
+		CHECK_FOR_INTERRUPTS();
+		/* step right one page */
+		so->currPos.buf = _bt_getbuf(rel, blkno, BT_READ);
+		/* check for deleted page */
+		page = BufferGetPage(so->currPos.buf);
+		TestForOldSnapshot(scan->xs_snapshot, rel, page);
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		if (!P_IGNORE(opaque))
+		{
+			PredicateLockPage(rel, blkno, scan->xs_snapshot);
+			/* see if there are any matches on this page */
+			/* note that this will clear moreRight if we can stop */
+			if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
+				break;
+		}
+		else if (scan->parallel_scan != NULL)
+		{
+			/* allow the next page to be processed by another participant */
+			_bt_parallel_release(scan, opaque->btpo_next);
+		}
+
+		/* nope, keep going */
+		if (scan->parallel_scan != NULL)
+		{
+			_bt_relbuf(rel, so->currPos.buf);
+			if (!_bt_parallel_seize(scan, &blkno))
+			{
+				BTScanPosInvalidate(so->currPos);
+				return false;
+			}
+		}
+		else
+		{
+			blkno = opaque->btpo_next;
+			_bt_relbuf(rel, so->currPos.buf);
+		}
+	}
+
+	return true;
+}
+
+/*
+ *	_bt_parallel_readpage() -- Read the page handed out by the shared state
+ *		of a parallel scan that another participant has already started.
+ *
+ * On success, release lock and maybe pin on buffer.  We return TRUE to
+ * indicate success.
+ */
+static bool
+_bt_parallel_readpage(IndexScanDesc scan, BlockNumber blkno,
+					  ScanDirection dir)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+
+	/* initialize moreLeft/moreRight for a forward scan */
+	so->currPos.moreLeft = false;
+	so->currPos.moreRight = true;
+	so->numKilled = 0;			/* just paranoia */
+	Assert(so->markItemIndex == -1);
+
+	if (!_bt_readnextpage(scan, blkno, dir))
+		return false;
+
+	/* Drop the lock, and maybe the pin, on the current page */
+	_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
+
+	return true;
+}
+
 /*
  * _bt_walk_left() -- step left one page, if possible
  *
@@ -1682,6 +1879,7 @@ _bt_endpoint(IndexScanDesc scan, ScanDirection dir)
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
 		BTScanPosInvalidate(so->currPos);
+		_bt_parallel_done(scan);
 		return false;
 	}
 
@@ -55,6 +55,14 @@
  * This code isn't concerned about the FSM at all. The caller is responsible
  * for initializing that.
  *
+ * The heap scan and the sort can be done in parallel, with up to
+ * max_parallel_index_build_workers workers.  The heap is handed out to the
+ * leader and the workers in chunks of consecutive blocks; each of them
+ * spools what it finds into a worker tuplesort of its own, and sorts that
+ * into a run in a shared temporary file.  The leader then merges the runs
+ * while loading the leaf pages, as tuplesort.c explains.  Nothing else about
+ * loading the index changes: only the leader writes pages.
+ *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -67,16 +75,41 @@
 #include "postgres.h"
 
 #include "access/nbtree.h"
+#include "access/parallel.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "access/xloginsert.h"
+#include "catalog/catalog.h"
+#include "catalog/index.h"
 #include "miscadmin.h"
+#include "optimizer/paths.h"
 #include "storage/smgr.h"
-#include "tcop/tcopprot.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"		/* pgrminclude ignore */
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
 #include "utils/sortsupport.h"
 #include "utils/tuplesort.h"
 
 
+/* DSM keys for parallel btree builds */
+#define PARALLEL_KEY_BTREE_SHARED		UINT64CONST(0xA000000000000001)
+#define PARALLEL_KEY_TUPLESORT			UINT64CONST(0xA000000000000002)
+#define PARALLEL_KEY_TUPLESORT_SPOOL2	UINT64CONST(0xA000000000000003)
+
+/*
+ * The participants of a parallel build take the heap in chunks of this many
+ * blocks, so that each of them still reads long sequential stretches.
+ */
+#define PARALLEL_BTREE_CHUNK_BLOCKS ((BlockNumber) (8 * 1024 * 1024 / BLCKSZ))
+
+/*
+ * A parallel build must leave each participant this much of
+ * maintenance_work_mem (in kB) to sort with, or it uses fewer workers.
+ */
+#define PARALLEL_BTREE_MIN_SORT_MEM		32768
+
+
 /*
  * Status record for spooling/sorting phase.  (Note we may have two of
  * these due to the special requirements for uniqueness-checking with
@@ -90,6 +123,55 @@ struct BTSpool
 	bool		isunique;
 };
 
+/*
+ * State shared between the leader and the workers of a parallel build
+ */
+typedef struct BTShared
+{
+	Oid			heaprelid;
+	Oid			indexrelid;
+	bool		isunique;
+	int			sortmem;		/* sort memory of each participant, in kB */
+	BlockNumber nblocks;		/* # of heap blocks to scan */
+
+	slock_t		mutex;			/* protects everything below */
+	BlockNumber nextblock;		/* first block of the next chunk */
+	double		reltuples;		/* totals over all participants */
+	double		indtuples;
+	bool		havedead;
+	bool		brokenhotchain;
+} BTShared;
+
+/*
+ * Leader's state of a parallel build
+ */
+typedef struct BTLeader
+{
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	Sharedsort *sharedsort;
+	Sharedsort *sharedsort2;	/* for spool2; NULL if not unique */
+} BTLeader;
+
+/* Working state for btbuild and its callback */
+typedef struct
+{
+	bool		isUnique;
+	bool		haveDead;
+	Relation	heapRel;
+	BTSpool    *spool;
+
+	/*
+	 * spool2 is needed only when the index is a unique index. Dead tuples are
+	 * put into spool2 instead of spool in order to avoid uniqueness check.
+	 */
+	BTSpool    *spool2;
+	double		indtuples;
+
+	/* set if the heap scan and sort are done in parallel */
+	BTLeader   *btleader;
+} BTBuildState;
+
 /*
  * Status record for a btree page being built.  We have one of these
  * for each active tree level.
@@ -128,6 +210,27 @@ typedef struct BTWriteState
 } BTWriteState;
 
 
+static double _bt_spools_heapscan(Relation heap, Relation index,
+					BTBuildState *buildstate, IndexInfo *indexInfo);
+static void btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state);
+static BTSpool *_bt_spoolinit_common(Relation heap, Relation index,
+					 bool isunique, int sortmem,
+					 SortCoordinate coordinate);
+static int	_bt_parallel_workers(Relation heap, IndexInfo *indexInfo);
+static void _bt_begin_parallel(BTBuildState *buildstate, Relation heap,
+				   Relation index, bool isunique, int nworkers);
+static double _bt_parallel_heapscan(BTBuildState *buildstate, Relation heap,
+					  Relation index, IndexInfo *indexInfo);
+static void _bt_parallel_scan_and_sort(BTShared *btshared,
+						   Sharedsort *sharedsort, Sharedsort *sharedsort2,
+						   Relation heap, Relation index,
+						   IndexInfo *indexInfo);
+static void _bt_end_parallel(BTLeader *btleader);
 static Page _bt_blnewpage(uint32 level);
 static BTPageState *_bt_pagestate(BTWriteState *wstate, uint32 level);
 static void _bt_slideleft(Page page);
@@ -145,19 +248,145 @@ static void _bt_load(BTWriteState *wstate,
  */
 
 
+/*
+ *	btbuild() -- build a new btree index.
+ */
+IndexBuildResult *
+btbuild(Relation heap, Relation index, IndexInfo *indexInfo)
+{
+	IndexBuildResult *result;
+	double		reltuples;
+	BTBuildState buildstate;
+
+	buildstate.isUnique = indexInfo->ii_Unique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heap;
+	buildstate.spool = NULL;
+	buildstate.spool2 = NULL;
+	buildstate.indtuples = 0;
+	buildstate.btleader = NULL;
+
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+		ResetUsage();
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * We expect to be called exactly once for any index relation. If that's
+	 * not the case, big trouble's what we have.
+	 */
+	if (RelationGetNumberOfBlocks(index) != 0)
+		elog(ERROR, "index \"%s\" already contains data",
+			 RelationGetRelationName(index));
+
+	/* do the heap scan, filling the spools */
+	reltuples = _bt_spools_heapscan(heap, index, &buildstate, indexInfo);
+
+	/* okay, all heap tuples are indexed */
+	if (buildstate.spool2 && !buildstate.haveDead)
+	{
+		/* spool2 turns out to be unnecessary */
+		_bt_spooldestroy(buildstate.spool2);
+		buildstate.spool2 = NULL;
+	}
+
+	/*
+	 * Finish the build by (1) completing the sort of the spool file, (2)
+	 * inserting the sorted tuples into btree pages and (3) building the upper
+	 * levels.
+	 */
+	_bt_leafbuild(buildstate.spool, buildstate.spool2);
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+	if (buildstate.btleader)
+		_bt_end_parallel(buildstate.btleader);
+
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+	{
+		ShowUsage("BTREE BUILD STATS");
+		ResetUsage();
+	}
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * Return statistics
+	 */
+	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+
+	result->heap_tuples = reltuples;
+	result->index_tuples = buildstate.indtuples;
+
+	return result;
+}
+
+/*
+ * Create the spools and scan the heap into them, in parallel if that's
+ * worthwhile.  Returns the number of heap tuples seen.
+ */
+static double
+_bt_spools_heapscan(Relation heap, Relation index, BTBuildState *buildstate,
+					IndexInfo *indexInfo)
+{
+	int			nworkers;
+
+	nworkers = _bt_parallel_workers(heap, indexInfo);
+	if (nworkers > 0)
+		_bt_begin_parallel(buildstate, heap, index, indexInfo->ii_Unique,
+						   nworkers);
+	if (buildstate->btleader)
+		return _bt_parallel_heapscan(buildstate, heap, index, indexInfo);
+
+	buildstate->spool = _bt_spoolinit(heap, index, indexInfo->ii_Unique,
+									  false);
+
+	/*
+	 * If building a unique index, put dead tuples in a second spool to keep
+	 * them out of the uniqueness check.
+	 */
+	if (indexInfo->ii_Unique)
+		buildstate->spool2 = _bt_spoolinit(heap, index, false, true);
+
+	return IndexBuildHeapScan(heap, index, indexInfo, true,
+							  btbuildCallback, (void *) buildstate);
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapScan
+ */
+static void
+btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state)
+{
+	BTBuildState *buildstate = (BTBuildState *) state;
+
+	/*
+	 * insert the index tuple into the appropriate spool file for subsequent
+	 * processing
+	 */
+	if (tupleIsAlive || buildstate->spool2 == NULL)
+		_bt_spool(buildstate->spool, &htup->t_self, values, isnull);
+	else
+	{
+		/* dead tuples are put into spool2 */
+		buildstate->haveDead = true;
+		_bt_spool(buildstate->spool2, &htup->t_self, values, isnull);
+	}
+
+	buildstate->indtuples += 1;
+}
+
 /*
  * create and initialize a spool structure
  */
 BTSpool *
 _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 {
-	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
-	int			btKbytes;
-
-	btspool->heap = heap;
-	btspool->index = index;
-	btspool->isunique = isunique;
-
 	/*
 	 * We size the sort area as maintenance_work_mem rather than work_mem to
 	 * speed index creation.  This should be OK since a single backend can't
@@ -166,9 +395,26 @@ _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 	 * second one (for dead tuples) won't get very full, so we give it only
 	 * work_mem.
 	 */
-	btKbytes = isdead ? work_mem : maintenance_work_mem;
+	return _bt_spoolinit_common(heap, index, isunique,
+								isdead ? work_mem : maintenance_work_mem,
+								NULL);
+}
+
+/*
+ * create a spool structure, possibly as part of a parallel sort
+ */
+static BTSpool *
+_bt_spoolinit_common(Relation heap, Relation index, bool isunique,
+					 int sortmem, SortCoordinate coordinate)
+{
+	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
+
+	btspool->heap = heap;
+	btspool->index = index;
+	btspool->isunique = isunique;
 	btspool->sortstate = tuplesort_begin_index_btree(heap, index, isunique,
-													 btKbytes, false);
+													 sortmem, coordinate,
+													 false);
 
 	return btspool;
 }
@@ -831,3 +1077,316 @@ _bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
 		smgrimmedsync(wstate->index->rd_smgr, MAIN_FORKNUM);
 	}
 }
+
+
+/*
+ * Parallel build support
+ */
+
+
+/*
+ * _bt_parallel_workers - how many workers to use for building an index
+ *
+ * Returns 0 to build the index serially.  The number of workers grows with
+ * the log of the heap size, as for a parallel sequential scan.
+ */
+static int
+_bt_parallel_workers(Relation heap, IndexInfo *indexInfo)
+{
+	BlockNumber nblocks;
+	int			threshold;
+	int			nworkers;
+
+	/*
+	 * The workers evaluate neither index expressions nor predicates, which
+	 * needn't be parallel safe.  A concurrent build waits for other
+	 * transactions between its phases, which is more than we want workers to
+	 * be part of, and a temporary table's pages are in local buffers.  System
+	 * catalogs are always built serially.  Workers also need an active
+	 * snapshot to start from, which not every caller has set.
+	 */
+	if (max_parallel_index_build_workers <= 0 || !IsUnderPostmaster ||
+		!ActiveSnapshotSet() ||
+		indexInfo->ii_Concurrent ||
+		indexInfo->ii_Expressions != NIL ||
+		indexInfo->ii_Predicate != NIL ||
+		RelationUsesLocalBuffers(heap) ||
+		IsCatalogRelation(heap))
+		return 0;
+
+	nblocks = RelationGetNumberOfBlocks(heap);
+	if (nblocks < (BlockNumber) min_parallel_relation_size)
+		return 0;
+
+	nworkers = 1;
+	threshold = Max(min_parallel_relation_size, 1);
+	while (nblocks >= (BlockNumber) (threshold * 3))
+	{
+		nworkers++;
+		threshold *= 3;
+		if (threshold > INT_MAX / 3)
+			break;				/* avoid overflow */
+	}
+	nworkers = Min(nworkers, max_parallel_index_build_workers);
+
+	/* Each participant, the leader included, sorts with its share */
+	while (nworkers > 0 &&
+		   maintenance_work_mem / (nworkers + 1) < PARALLEL_BTREE_MIN_SORT_MEM)
+		nworkers--;
+
+	return nworkers;
+}
+
+/*
+ * _bt_begin_parallel - launch the workers of a parallel build
+ *
+ * On success, buildstate->btleader is set.  If no worker could be launched,
+ * it's left NULL and the caller builds the index serially.
+ */
+static void
+_bt_begin_parallel(BTBuildState *buildstate, Relation heap, Relation index,
+				   bool isunique, int nworkers)
+{
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	Sharedsort *sharedsort;
+	Sharedsort *sharedsort2 = NULL;
+	Size		estsort;
+	BTLeader   *btleader;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContextForExternalFunction("postgres",
+													"_bt_parallel_build_main",
+													nworkers);
+
+	estsort = tuplesort_estimate_shared();
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(BTShared));
+	shm_toc_estimate_chunk(&pcxt->estimator, estsort);
+	if (isunique)
+	{
+		shm_toc_estimate_chunk(&pcxt->estimator, estsort);
+		shm_toc_estimate_keys(&pcxt->estimator, 3);
+	}
+	else
+		shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	btshared = (BTShared *) shm_toc_allocate(pcxt->toc, sizeof(BTShared));
+	btshared->heaprelid = RelationGetRelid(heap);
+	btshared->indexrelid = RelationGetRelid(index);
+	btshared->isunique = isunique;
+	btshared->sortmem = maintenance_work_mem / (nworkers + 1);
+	btshared->nblocks = RelationGetNumberOfBlocks(heap);
+	SpinLockInit(&btshared->mutex);
+	btshared->nextblock = 0;
+	btshared->reltuples = 0;
+	btshared->indtuples = 0;
+	btshared->havedead = false;
+	btshared->brokenhotchain = false;
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_BTREE_SHARED, btshared);
+
+	sharedsort = (Sharedsort *) shm_toc_allocate(pcxt->toc, estsort);
+	tuplesort_initialize_shared(sharedsort);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_TUPLESORT, sharedsort);
+
+	if (isunique)
+	{
+		sharedsort2 = (Sharedsort *) shm_toc_allocate(pcxt->toc, estsort);
+		tuplesort_initialize_shared(sharedsort2);
+		shm_toc_insert(pcxt->toc, PARALLEL_KEY_TUPLESORT_SPOOL2, sharedsort2);
+	}
+
+	LaunchParallelWorkers(pcxt);
+
+	ereport(DEBUG1,
+			(errmsg("launched %d parallel workers to build index \"%s\" (planned: %d)",
+					pcxt->nworkers_launched, RelationGetRelationName(index),
+					nworkers)));
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return;
+	}
+
+	btleader = (BTLeader *) palloc(sizeof(BTLeader));
+	btleader->pcxt = pcxt;
+	btleader->btshared = btshared;
+	btleader->sharedsort = sharedsort;
+	btleader->sharedsort2 = sharedsort2;
+	buildstate->btleader = btleader;
+}
+
+/*
+ * _bt_parallel_heapscan - the leader's part of a parallel heap scan
+ *
+ * The leader scans and sorts its share of the heap like a worker, waits for
+ * the workers, and is left with spools that merge everyone's runs.  Returns
+ * the number of heap tuples seen by all participants.
+ */
+static double
+_bt_parallel_heapscan(BTBuildState *buildstate, Relation heap,
+					  Relation index, IndexInfo *indexInfo)
+{
+	BTLeader   *btleader = buildstate->btleader;
+	BTShared   *btshared = btleader->btshared;
+	SortCoordinateData coordinate;
+	SortCoordinateData coordinate2;
+
+	coordinate.isWorker = false;
+	coordinate.sharedsort = btleader->sharedsort;
+	buildstate->spool = _bt_spoolinit_common(heap, index, btshared->isunique,
+											 maintenance_work_mem,
+											 &coordinate);
+	if (btleader->sharedsort2)
+	{
+		coordinate2.isWorker = false;
+		coordinate2.sharedsort = btleader->sharedsort2;
+		buildstate->spool2 = _bt_spoolinit_common(heap, index, false,
+												  work_mem, &coordinate2);
+	}
+
+	_bt_parallel_scan_and_sort(btshared, btleader->sharedsort,
+							   btleader->sharedsort2, heap, index, indexInfo);
+
+	WaitForParallelWorkersToFinish(btleader->pcxt);
+
+	buildstate->haveDead = btshared->havedead;
+	buildstate->indtuples = btshared->indtuples;
+	if (btshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+
+	return btshared->reltuples;
+}
+
+/*
+ * _bt_parallel_scan_and_sort - scan and sort chunks of the heap
+ *
+ * Run by the leader and by each worker of a parallel build.  The tuples go
+ * into worker tuplesorts of our own, whose runs the leader merges; our
+ * counts are added to the shared totals.
+ */
+static void
+_bt_parallel_scan_and_sort(BTShared *btshared, Sharedsort *sharedsort,
+						   Sharedsort *sharedsort2, Relation heap,
+						   Relation index, IndexInfo *indexInfo)
+{
+	BTBuildState buildstate;
+	SortCoordinateData coordinate;
+	SortCoordinateData coordinate2;
+	double		reltuples = 0;
+
+	buildstate.isUnique = btshared->isunique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heap;
+	buildstate.spool2 = NULL;
+	buildstate.indtuples = 0;
+	buildstate.btleader = NULL;
+
+	coordinate.isWorker = true;
+	coordinate.sharedsort = sharedsort;
+	buildstate.spool = _bt_spoolinit_common(heap, index, btshared->isunique,
+											btshared->sortmem, &coordinate);
+	if (sharedsort2)
+	{
+		coordinate2.isWorker = true;
+		coordinate2.sharedsort = sharedsort2;
+		buildstate.spool2 = _bt_spoolinit_common(heap, index, false,
+												 work_mem, &coordinate2);
+	}
+
+	for (;;)
+	{
+		BlockNumber startblock;
+		BlockNumber numblocks;
+
+		SpinLockAcquire(&btshared->mutex);
+		startblock = btshared->nextblock;
+		numblocks = Min(PARALLEL_BTREE_CHUNK_BLOCKS,
+						btshared->nblocks - startblock);
+		btshared->nextblock += numblocks;
+		SpinLockRelease(&btshared->mutex);
+
+		if (numblocks == 0)
+			break;
+
+		reltuples += IndexBuildHeapRangeScan(heap, index, indexInfo,
+											 false, false,
+											 startblock, numblocks,
+											 btbuildCallback,
+											 (void *) &buildstate);
+	}
+
+	/* Write out our runs for the leader */
+	tuplesort_performsort(buildstate.spool->sortstate);
+	if (buildstate.spool2)
+		tuplesort_performsort(buildstate.spool2->sortstate);
+
+	SpinLockAcquire(&btshared->mutex);
+	btshared->reltuples += reltuples;
+	btshared->indtuples += buildstate.indtuples;
+	if (buildstate.haveDead)
+		btshared->havedead = true;
+	if (indexInfo->ii_BrokenHotChain)
+		btshared->brokenhotchain = true;
+	SpinLockRelease(&btshared->mutex);
+
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+}
+
+/*
+ * _bt_end_parallel - shut down a parallel build
+ *
+ * The workers are long finished; this must wait until the leader has merged
+ * their runs, since the shared sort state is in the DSM segment.
+ */
+static void
+_bt_end_parallel(BTLeader *btleader)
+{
+	DestroyParallelContext(btleader->pcxt);
+	ExitParallelMode();
+	pfree(btleader);
+}
+
+/*
+ * _bt_parallel_build_main - entry point of a parallel btree build worker
+ */
+void
+_bt_parallel_build_main(dsm_segment *seg, shm_toc *toc)
+{
+	BTShared   *btshared;
+	Sharedsort *sharedsort;
+	Sharedsort *sharedsort2 = NULL;
+	Relation	heapRel;
+	Relation	indexRel;
+	IndexInfo  *indexInfo;
+
+	btshared = (BTShared *) shm_toc_lookup(toc, PARALLEL_KEY_BTREE_SHARED);
+	Assert(btshared != NULL);
+	sharedsort = (Sharedsort *) shm_toc_lookup(toc, PARALLEL_KEY_TUPLESORT);
+	Assert(sharedsort != NULL);
+	if (btshared->isunique)
+	{
+		sharedsort2 = (Sharedsort *)
+			shm_toc_lookup(toc, PARALLEL_KEY_TUPLESORT_SPOOL2);
+		Assert(sharedsort2 != NULL);
+	}
+
+	/*
+	 * The leader holds ShareLock on the heap and AccessExclusiveLock on the
+	 * new index, but as members of one lock group we don't conflict with it.
+	 */
+	heapRel = heap_open(btshared->heaprelid, ShareLock);
+	indexRel = index_open(btshared->indexrelid, RowExclusiveLock);
+	indexInfo = BuildIndexInfo(indexRel);
+
+	_bt_parallel_scan_and_sort(btshared, sharedsort, sharedsort2,
+							   heapRel, indexRel, indexInfo);
+
+	index_close(indexRel, RowExclusiveLock);
+	heap_close(heapRel, ShareLock);
+}
@@ -49,6 +49,7 @@ static void _bt_mark_scankey_required(ScanKey skey);
 static bool _bt_check_rowcompare(ScanKey skey,
 					 IndexTuple tuple, TupleDesc tupdesc,
 					 ScanDirection dir, bool *continuescan);
+static int	_bt_int_cmp(const void *a, const void *b);
 
 
 /*
@@ -1782,6 +1783,13 @@ _bt_killitems(IndexScanDesc scan)
 	minoff = P_FIRSTDATAKEY(opaque);
 	maxoff = PageGetMaxOffsetNumber(page);
 
+	/*
+	 * Visit the killed items in items[] order, which is also heap TID order
+	 * within any posting list, whichever direction the scan went.
+	 */
+	if (numKilled > 1)
+		qsort(so->killedItems, numKilled, sizeof(int), _bt_int_cmp);
+
 	for (i = 0; i < numKilled; i++)
 	{
 		int			itemIndex = so->killedItems[i];
@@ -1797,7 +1805,38 @@ _bt_killitems(IndexScanDesc scan)
 			ItemId		iid = PageGetItemId(page, offnum);
 			IndexTuple	ituple = (IndexTuple) PageGetItem(page, iid);
 
-			if (ItemPointerEquals(&ituple->t_tid, &kitem->heapTid))
+			if (BTreeTupleIsPosting(ituple))
+			{
+				if (ItemPointerEquals(BTreeTupleGetPosting(ituple),
+									  &kitem->heapTid))
+				{
+					/*
+					 * found the posting list; it can only be marked dead if
+					 * all of its TIDs were killed, and those must then be
+					 * the next killed items, in the same order
+					 */
+					int			nposting = BTreeTupleGetNPosting(ituple);
+					int			j;
+
+					for (j = 1; j < nposting && i + j < numKilled; j++)
+					{
+						BTScanPosItem *jitem;
+
+						jitem = &so->currPos.items[so->killedItems[i + j]];
+						if (!ItemPointerEquals(BTreeTupleGetPostingN(ituple, j),
+											   &jitem->heapTid))
+							break;
+					}
+					if (j == nposting)
+					{
+						ItemIdMarkDead(iid);
+						killedsomething = true;
+						i += nposting - 1;
+					}
+					break;		/* out of inner search loop */
+				}
+			}
+			else if (ItemPointerEquals(&ituple->t_tid, &kitem->heapTid))
 			{
 				/* found the item */
 				ItemIdMarkDead(iid);
@@ -1823,6 +1862,20 @@ _bt_killitems(IndexScanDesc scan)
 	LockBuffer(so->currPos.buf, BUFFER_LOCK_UNLOCK);
 }
 
+/* qsort comparator for killedItems */
+static int
+_bt_int_cmp(const void *a, const void *b)
+{
+	int			ia = *(const int *) a;
+	int			ib = *(const int *) b;
+
+	if (ia < ib)
+		return -1;
+	if (ia > ib)
+		return 1;
+	return 0;
+}
+
 
 /*
  * The following routines manage a shared-memory area in which we track
@@ -2037,7 +2090,30 @@ BTreeShmemInit(void)
 bytea *
 btoptions(Datum reloptions, bool validate)
 {
-	return default_reloptions(reloptions, validate, RELOPT_KIND_BTREE);
+	relopt_value *options;
+	BTOptions  *rdopts;
+	int			numoptions;
+	static const relopt_parse_elt tab[] = {
+		{"fillfactor", RELOPT_TYPE_INT, offsetof(BTOptions, fillfactor)},
+		{"deduplicate_items", RELOPT_TYPE_BOOL,
+		offsetof(BTOptions, deduplicate_items)}
+	};
+
+	options = parseRelOptions(reloptions, validate, RELOPT_KIND_BTREE,
+							  &numoptions);
+
+	/* if none set, we're done */
+	if (numoptions == 0)
+		return NULL;
+
+	rdopts = allocateReloptStruct(sizeof(BTOptions), options, numoptions);
+
+	fillRelOptions((void *) rdopts, sizeof(BTOptions), options, numoptions,
+				   validate, tab, lengthof(tab));
+
+	pfree(options);
+
+	return (bytea *) rdopts;
 }
 
 /*
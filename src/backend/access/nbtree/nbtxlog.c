@@ -204,6 +204,7 @@ btree_xlog_split(bool onleft, bool isroot, XLogReaderState *record)
 	Size		datalen;
 	Item		left_hikey = NULL;
 	Size		left_hikeysz = 0;
+	IndexTuple	stripped_hikey = NULL;
 	BlockNumber leftsib;
 	BlockNumber rightsib;
 	BlockNumber rnext;
@@ -239,14 +240,26 @@ btree_xlog_split(bool onleft, bool isroot, XLogReaderState *record)
 
 	/*
 	 * On leaf level, the high key of the left page is equal to the first key
-	 * on the right page.
+	 * on the right page, minus any posting list (see _bt_split()).
 	 */
 	if (isleaf)
 	{
 		ItemId		hiItemId = PageGetItemId(rpage, P_FIRSTDATAKEY(ropaque));
+		IndexTuple	firstright = (IndexTuple) PageGetItem(rpage, hiItemId);
 
-		left_hikey = PageGetItem(rpage, hiItemId);
-		left_hikeysz = ItemIdGetLength(hiItemId);
+		if (BTreeTupleIsPosting(firstright))
+		{
+			stripped_hikey = _bt_form_posting(firstright,
+											  BTreeTupleGetPosting(firstright),
+											  1);
+			left_hikey = (Item) stripped_hikey;
+			left_hikeysz = IndexTupleSize(stripped_hikey);
+		}
+		else
+		{
+			left_hikey = (Item) firstright;
+			left_hikeysz = ItemIdGetLength(hiItemId);
+		}
 	}
 
 	PageSetLSN(rpage, lsn);
@@ -354,6 +367,9 @@ btree_xlog_split(bool onleft, bool isroot, XLogReaderState *record)
 		UnlockReleaseBuffer(lbuf);
 	UnlockReleaseBuffer(rbuf);
 
+	if (stripped_hikey)
+		pfree(stripped_hikey);
+
 	/*
 	 * Fix left-link of the page to the right of the new right sibling.
 	 *
@@ -388,8 +404,8 @@ btree_xlog_vacuum(XLogReaderState *record)
 	Buffer		buffer;
 	Page		page;
 	BTPageOpaque opaque;
-#ifdef UNUSED
 	xl_btree_vacuum *xlrec = (xl_btree_vacuum *) XLogRecGetData(record);
+#ifdef UNUSED
 
 	/*
 	 * This section of code is thought to be no longer needed, after analysis
@@ -480,14 +496,26 @@ btree_xlog_vacuum(XLogReaderState *record)
 
 		if (len > 0)
 		{
-			OffsetNumber *unused;
-			OffsetNumber *unend;
+			OffsetNumber *deleted;
+			OffsetNumber *updated;
+			char	   *updatedtuples;
+			int			i;
 
-			unused = (OffsetNumber *) ptr;
-			unend = (OffsetNumber *) ((char *) ptr + len);
+			deleted = (OffsetNumber *) ptr;
+			updated = deleted + xlrec->ndeleted;
+			updatedtuples = (char *) (updated + xlrec->nupdated);
 
-			if ((unend - unused) > 0)
-				PageIndexMultiDelete(page, unused, unend - unused);
+			/* shrink partly-dead posting lists first, as the primary did */
+			for (i = 0; i < xlrec->nupdated; i++)
+			{
+				IndexTuple	itup = (IndexTuple) updatedtuples;
+
+				_bt_update_posting(page, updated[i], itup);
+				updatedtuples += IndexTupleSize(itup);
+			}
+
+			if (xlrec->ndeleted > 0)
+				PageIndexMultiDelete(page, deleted, xlrec->ndeleted);
 		}
 
 		/*
@@ -504,6 +532,39 @@ btree_xlog_vacuum(XLogReaderState *record)
 		UnlockReleaseBuffer(buffer);
 }
 
+static void
+btree_xlog_dedup(XLogReaderState *record)
+{
+	XLogRecPtr	lsn = record->EndRecPtr;
+	xl_btree_dedup *xlrec = (xl_btree_dedup *) XLogRecGetData(record);
+	Buffer		buffer;
+
+	if (XLogReadBufferForRedo(record, 0, &buffer) == BLK_NEEDS_REDO)
+	{
+		Page		page = (Page) BufferGetPage(buffer);
+		BTPageOpaque opaque;
+		Page		newpage;
+		char	   *ptr;
+		Size		len;
+
+		ptr = XLogRecGetBlockData(record, 0, &len);
+		Assert(len == xlrec->nintervals * sizeof(BTDedupInterval));
+
+		newpage = _bt_dedup_build_page(page, (BTDedupInterval *) ptr,
+									   xlrec->nintervals);
+		PageRestoreTempPage(newpage, page);
+
+		/* see _bt_dedup_one_page() */
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		opaque->btpo_flags &= ~BTP_HAS_GARBAGE;
+
+		PageSetLSN(page, lsn);
+		MarkBufferDirty(buffer);
+	}
+	if (BufferIsValid(buffer))
+		UnlockReleaseBuffer(buffer);
+}
+
 /*
  * Get the latestRemovedXid from the heap pages pointed at by the index
  * tuples being deleted. This puts the work for calculating latestRemovedXid
@@ -529,11 +590,14 @@ btree_xlog_delete_get_latestRemovedXid(XLogReaderState *record)
 	ItemId		iitemid,
 				hitemid;
 	IndexTuple	itup;
+	ItemPointer htids;
+	int			nhtids;
 	HeapTupleHeader htuphdr;
 	BlockNumber hblkno;
 	OffsetNumber hoffnum;
 	TransactionId latestRemovedXid = InvalidTransactionId;
-	int			i;
+	int			i,
+				j;
 
 	/*
 	 * If there's nothing running on the standby we don't need to derive a
@@ -587,62 +651,81 @@ btree_xlog_delete_get_latestRemovedXid(XLogReaderState *record)
 		itup = (IndexTuple) PageGetItem(ipage, iitemid);
 
 		/*
-		 * Locate the heap page that the index tuple points at
+		 * A posting list points at several heap tuples; visit each of them
 		 */
-		hblkno = ItemPointerGetBlockNumber(&(itup->t_tid));
-		hbuffer = XLogReadBufferExtended(xlrec->hnode, MAIN_FORKNUM, hblkno, RBM_NORMAL);
-		if (!BufferIsValid(hbuffer))
+		if (BTreeTupleIsPosting(itup))
 		{
-			UnlockReleaseBuffer(ibuffer);
-			return InvalidTransactionId;
+			htids = BTreeTupleGetPosting(itup);
+			nhtids = BTreeTupleGetNPosting(itup);
 		}
-		LockBuffer(hbuffer, BUFFER_LOCK_SHARE);
-		hpage = (Page) BufferGetPage(hbuffer);
-
-		/*
-		 * Look up the heap tuple header that the index tuple points at by
-		 * using the heap node supplied with the xlrec. We can't use
-		 * heap_fetch, since it uses ReadBuffer rather than XLogReadBuffer.
-		 * Note that we are not looking at tuple data here, just headers.
-		 */
-		hoffnum = ItemPointerGetOffsetNumber(&(itup->t_tid));
-		hitemid = PageGetItemId(hpage, hoffnum);
-
-		/*
-		 * Follow any redirections until we find something useful.
-		 */
-		while (ItemIdIsRedirected(hitemid))
+		else
 		{
-			hoffnum = ItemIdGetRedirect(hitemid);
-			hitemid = PageGetItemId(hpage, hoffnum);
-			CHECK_FOR_INTERRUPTS();
+			htids = &itup->t_tid;
+			nhtids = 1;
 		}
 
-		/*
-		 * If the heap item has storage, then read the header and use that to
-		 * set latestRemovedXid.
-		 *
-		 * Some LP_DEAD items may not be accessible, so we ignore them.
-		 */
-		if (ItemIdHasStorage(hitemid))
+		for (j = 0; j < nhtids; j++)
 		{
-			htuphdr = (HeapTupleHeader) PageGetItem(hpage, hitemid);
+			/*
+			 * Locate the heap page that the index tuple points at
+			 */
+			hblkno = ItemPointerGetBlockNumber(&htids[j]);
+			hbuffer = XLogReadBufferExtended(xlrec->hnode, MAIN_FORKNUM, hblkno,
+											 RBM_NORMAL);
+			if (!BufferIsValid(hbuffer))
+			{
+				UnlockReleaseBuffer(ibuffer);
+				return InvalidTransactionId;
+			}
+			LockBuffer(hbuffer, BUFFER_LOCK_SHARE);
+			hpage = (Page) BufferGetPage(hbuffer);
 
-			HeapTupleHeaderAdvanceLatestRemovedXid(htuphdr, &latestRemovedXid);
-		}
-		else if (ItemIdIsDead(hitemid))
-		{
 			/*
-			 * Conjecture: if hitemid is dead then it had xids before the xids
-			 * marked on LP_NORMAL items. So we just ignore this item and move
-			 * onto the next, for the purposes of calculating
-			 * latestRemovedxids.
+			 * Look up the heap tuple header that the index tuple points at by
+			 * using the heap node supplied with the xlrec. We can't use
+			 * heap_fetch, since it uses ReadBuffer rather than
+			 * XLogReadBuffer. Note that we are not looking at tuple data
+			 * here, just headers.
 			 */
-		}
-		else
-			Assert(!ItemIdIsUsed(hitemid));
+			hoffnum = ItemPointerGetOffsetNumber(&htids[j]);
+			hitemid = PageGetItemId(hpage, hoffnum);
+
+			/*
+			 * Follow any redirections until we find something useful.
+			 */
+			while (ItemIdIsRedirected(hitemid))
+			{
+				hoffnum = ItemIdGetRedirect(hitemid);
+				hitemid = PageGetItemId(hpage, hoffnum);
+				CHECK_FOR_INTERRUPTS();
+			}
+
+			/*
+			 * If the heap item has storage, then read the header and use that
+			 * to set latestRemovedXid.
+			 *
+			 * Some LP_DEAD items may not be accessible, so we ignore them.
+			 */
+			if (ItemIdHasStorage(hitemid))
+			{
+				htuphdr = (HeapTupleHeader) PageGetItem(hpage, hitemid);
 
-		UnlockReleaseBuffer(hbuffer);
+				HeapTupleHeaderAdvanceLatestRemovedXid(htuphdr, &latestRemovedXid);
+			}
+			else if (ItemIdIsDead(hitemid))
+			{
+				/*
+				 * Conjecture: if hitemid is dead then it had xids before the
+				 * xids marked on LP_NORMAL items. So we just ignore this item
+				 * and move onto the next, for the purposes of calculating
+				 * latestRemovedxids.
+				 */
+			}
+			else
+				Assert(!ItemIdIsUsed(hitemid));
+
+			UnlockReleaseBuffer(hbuffer);
+		}
 	}
 
 	UnlockReleaseBuffer(ibuffer);
@@ -1008,6 +1091,9 @@ btree_redo(XLogReaderState *record)
 		case XLOG_BTREE_VACUUM:
 			btree_xlog_vacuum(record);
 			break;
+		case XLOG_BTREE_DEDUP:
+			btree_xlog_dedup(record);
+			break;
 		case XLOG_BTREE_DELETE:
 			btree_xlog_delete(record);
 			break;
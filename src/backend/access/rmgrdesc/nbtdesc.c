@@ -48,8 +48,16 @@ btree_desc(StringInfo buf, XLogReaderState *record)
 			{
 				xl_btree_vacuum *xlrec = (xl_btree_vacuum *) rec;
 
-				appendStringInfo(buf, "lastBlockVacuumed %u",
-								 xlrec->lastBlockVacuumed);
+				appendStringInfo(buf, "lastBlockVacuumed %u; ndeleted %u; nupdated %u",
+								 xlrec->lastBlockVacuumed,
+								 xlrec->ndeleted, xlrec->nupdated);
+				break;
+			}
+		case XLOG_BTREE_DEDUP:
+			{
+				xl_btree_dedup *xlrec = (xl_btree_dedup *) rec;
+
+				appendStringInfo(buf, "nintervals %u", xlrec->nintervals);
 				break;
 			}
 		case XLOG_BTREE_DELETE:
@@ -130,6 +138,9 @@ btree_identify(uint8 info)
 		case XLOG_BTREE_VACUUM:
 			id = "VACUUM";
 			break;
+		case XLOG_BTREE_DEDUP:
+			id = "DEDUP";
+			break;
 		case XLOG_BTREE_DELETE:
 			id = "DELETE";
 			break;
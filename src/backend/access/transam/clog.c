@@ -80,6 +80,15 @@ static SlruCtlData ClogCtlData;
 
 #define ClogCtl (&ClogCtlData)
 
+/* GUC: number of CLOG buffers, or 0 to size them based on shared_buffers */
+int			clog_buffers = 0;
+
+/*
+ * Slot in which this backend last found a CLOG page; PgTransactionIdGetStatus
+ * tries it without the control lock first.
+ */
+static int	ClogLastSlot = -1;
+
 
 static int	ZeroCLOGPage(int pageno, bool writeXlog);
 static bool CLOGPagePrecedes(int page1, int page2);
@@ -357,12 +366,6 @@ TransactionIdSetStatusBit(TransactionId xid, XidStatus status, XLogRecPtr lsn, i
 /*			status != TRANSACTION_STATUS_IN_PROGRESS) || */
 /*		   curval == status); */
 
-	/* note this assumes exclusive access to the clog page */
-	byteval = *byteptr;
-	byteval &= ~(((1 << CLOG_BITS_PER_XACT) - 1) << bshift);
-	byteval |= (status << bshift);
-	*byteptr = byteval;
-
 	/*
 	 * Update the group LSN if the transaction completion LSN is higher.
 	 *
@@ -370,6 +373,10 @@ TransactionIdSetStatusBit(TransactionId xid, XidStatus status, XLogRecPtr lsn, i
 	 * so we don't need to do anything special to avoid LSN updates during
 	 * recovery. After recovery completes the next clog change will set the
 	 * LSN correctly.
+	 *
+	 * This is done before setting the status, so that a lock-free reader
+	 * that sees the new status also sees an LSN covering its commit record
+	 * (see PgTransactionIdGetStatus).
 	 */
 	if (!XLogRecPtrIsInvalid(lsn))
 	{
@@ -377,7 +384,14 @@ TransactionIdSetStatusBit(TransactionId xid, XidStatus status, XLogRecPtr lsn, i
 
 		if (ClogCtl->shared->group_lsn[lsnindex] < lsn)
 			ClogCtl->shared->group_lsn[lsnindex] = lsn;
+		pg_write_barrier();
 	}
+
+	/* note this assumes exclusive access to the clog page */
+	byteval = *byteptr;
+	byteval &= ~(((1 << CLOG_BITS_PER_XACT) - 1) << bshift);
+	byteval |= (status << bshift);
+	*byteptr = byteval;
 }
 
 /*
@@ -411,6 +425,29 @@ PgTransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 	int			lsnindex;
 	char	   *byteptr;
 	XidStatus	status;
+#if SIZEOF_VOID_P >= 8
+	uint32		changecount;
+
+
+	/*
+	 * Most lookups hit the page we found last time, so first try to read the
+	 * status from it without taking the control lock.  This needs atomic
+	 * reads of the group LSN, hence is done only on 64-bit platforms.  The
+	 * LSN is read after the status, pairing with the write barrier in
+	 * TransactionIdSetStatusBit.
+	 */
+	slotno = ClogLastSlot;
+	if (SimpleLruPeekSlot(ClogCtl, slotno, pageno, &changecount))
+	{
+		byteptr = ClogCtl->shared->page_buffer[slotno] + byteno;
+		status = (*byteptr >> bshift) & CLOG_XACT_BITMASK;
+		pg_read_barrier();
+		*lsn = ClogCtl->shared->group_lsn[GetLSNIndex(slotno, xid)];
+
+		if (SimpleLruSlotUnchanged(ClogCtl, slotno, changecount))
+			return status;
+	}
+#endif
 
 	/* lock is acquired by SimpleLruReadPage_ReadOnly */
 
@@ -424,6 +461,8 @@ PgTransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 
 	LWLockRelease(CLogControlLock);
 
+	ClogLastSlot = slotno;
+
 	return status;
 }
 
@@ -446,6 +485,8 @@ PgTransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 Size
 CLOGShmemBuffers(void)
 {
+	if (clog_buffers > 0)
+		return clog_buffers;
 	return Min(128, Max(4, NBuffers / 512));
 }
 
@@ -14,11 +14,15 @@
 
 #include "postgres.h"
 
+#include "access/gin_private.h"
+#include "access/nbtree.h"
 #include "access/parallel.h"
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/namespace.h"
 #include "commands/async.h"
+#include "commands/copy.h"
+#include "commands/vacuum.h"
 #include "executor/execParallel.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
@@ -120,6 +124,18 @@ static const struct
 {
 	{
 		"ParallelQueryMain", ParallelQueryMain
+	},
+	{
+		"parallel_vacuum_main", parallel_vacuum_main
+	},
+	{
+		"_bt_parallel_build_main", _bt_parallel_build_main
+	},
+	{
+		"ginParallelBuildMain", ginParallelBuildMain
+	},
+	{
+		"ParallelCopyMain", ParallelCopyMain
 	}
 };
 
@@ -698,11 +714,27 @@ DestroyParallelContext(ParallelContext *pcxt)
 
 /*
  * Are there any parallel contexts currently active?
+ *
+ * Contexts marked leader_writes don't count.  Their workers depend on
+ * nothing that the leader changes once they're launched, so the leader is
+ * allowed to exit parallel mode and write while they're still running (see
+ * parallel COPY FROM).
  */
 bool
 ParallelContextActive(void)
 {
-	return !dlist_is_empty(&pcxt_list);
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &pcxt_list)
+	{
+		ParallelContext *pcxt;
+
+		pcxt = dlist_container(ParallelContext, node, iter.cur);
+		if (!pcxt->leader_writes)
+			return true;
+	}
+
+	return false;
 }
 
 /*
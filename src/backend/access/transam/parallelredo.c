@@ -0,0 +1,678 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallelredo.c
+ *	  Replay of WAL records by parallel redo worker processes
+ *
+ * During crash recovery, the startup process can hand WAL records that only
+ * modify data pages to a set of background workers, which replay them
+ * concurrently.  Each such record is sent to the worker chosen by hashing
+ * the pages it references, so all changes to one page are replayed by one
+ * worker, in WAL order.  A record whose pages hash to different workers, or
+ * that does anything beyond modifying its pages, is replayed by the startup
+ * process itself, after waiting for the workers to catch up with everything
+ * dispatched before it.  Transaction commit and abort records that don't
+ * drop relations are replayed by the startup process without waiting, since
+ * during crash recovery nothing looks at data pages and commit status
+ * together until replay is done.
+ *
+ * Only record types known to touch nothing but their block references (and
+ * the free space map and visibility map bits of those pages) are dispatched;
+ * see ParallelRedoChooseWorker.  Parallel redo is never used in archive
+ * recovery or on a standby, where queries or recovery targets could observe
+ * the records being replayed out of order.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/transam/parallelredo.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/heapam_xlog.h"
+#include "access/nbtree.h"
+#include "access/parallelredo.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "access/xlog_internal.h"
+#include "access/xlogutils.h"
+#include "catalog/pg_control.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/startup.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/smgr.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+#include "utils/timeout.h"
+
+
+/* Size of the queue of records to each worker */
+#define PARALLEL_REDO_QUEUE_SIZE	(256 * 1024)
+
+/* GUC variable */
+int			parallel_redo_workers = 0;
+
+/* Is this process a parallel redo worker? */
+bool		AmParallelRedoWorker = false;
+
+/*
+ * Shared state, at the start of the parallel redo DSM segment.  The queues
+ * of the workers follow it.  applied[i] counts the messages worker i has
+ * processed; the startup process sets 'waiting' while it waits for those
+ * counters to reach the number of messages it has sent, so that the workers
+ * know to wake it up.
+ */
+typedef struct ParallelRedoShared
+{
+	PGPROC	   *startup;
+	int			nworkers;
+	bool		finished;		/* set before detaching at the end of redo */
+	pg_atomic_uint32 waiting;
+	pg_atomic_uint64 applied[MAX_PARALLEL_REDO_WORKERS];
+} ParallelRedoShared;
+
+#define PARALLEL_REDO_QUEUE(shared, i) \
+	((shm_mq *) ((char *) (shared) + MAXALIGN(sizeof(ParallelRedoShared)) + \
+				 (Size) (i) * PARALLEL_REDO_QUEUE_SIZE))
+
+typedef enum
+{
+	PARALLEL_REDO_RECORD,		/* replay the record that follows */
+	PARALLEL_REDO_FORGET_RELATION,		/* relation dropped or truncated */
+	PARALLEL_REDO_FORGET_DATABASE		/* database dropped */
+} ParallelRedoMessageType;
+
+/*
+ * Header of the messages to the workers.  A PARALLEL_REDO_RECORD message is
+ * followed by the raw WAL record.  The other messages tell the workers what
+ * the startup process has dropped or truncated, so that they close their
+ * files and forget about the invalid pages they have seen in it, like
+ * XLogDropRelation and friends do in the startup process.
+ */
+typedef struct ParallelRedoMessage
+{
+	ParallelRedoMessageType type;
+	XLogRecPtr	ReadRecPtr;		/* start of the record */
+	XLogRecPtr	EndRecPtr;		/* end+1 of the record */
+	RelFileNode rnode;			/* relation to forget */
+	ForkNumber	forknum;
+	BlockNumber nblocks;		/* new size, 0 if dropped */
+	Oid			dbid;			/* database to forget */
+} ParallelRedoMessage;
+
+/* Startup process state, only valid while the workers are running */
+static dsm_segment *redoSegment = NULL;
+static ParallelRedoShared *redoShared = NULL;
+static shm_mq_handle **redoQueues = NULL;
+static BackgroundWorkerHandle **redoHandles = NULL;
+static uint64 *redoSent = NULL;
+
+static int	ParallelRedoChooseWorker(XLogReaderState *record);
+static bool ParallelRedoNeedsBarrier(XLogReaderState *record);
+static void ParallelRedoSend(int worker, ParallelRedoMessage *msg,
+				 const char *data, Size len);
+static void ParallelRedoWaitAll(void);
+static void ParallelRedoErrorCallback(void *arg);
+
+
+/*
+ * Launch the parallel redo workers, if parallel_redo_workers is set and we
+ * are in crash recovery.  If no worker can be registered, redo simply stays
+ * in the startup process.
+ */
+void
+ParallelRedoStart(void)
+{
+	BackgroundWorker worker;
+	ResourceOwner owner;
+	Size		segsize;
+	int			nworkers;
+	int			i;
+
+	Assert(AmStartupProcess());
+
+	if (parallel_redo_workers == 0 || ArchiveRecoveryRequested)
+		return;
+
+	nworkers = parallel_redo_workers;
+	segsize = MAXALIGN(sizeof(ParallelRedoShared)) +
+		(Size) nworkers * PARALLEL_REDO_QUEUE_SIZE;
+
+	/*
+	 * The startup process has no resource owner.  Make one just long enough
+	 * to create the segment, which we keep mapped until ParallelRedoEnd.
+	 */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "parallel redo");
+	redoSegment = dsm_create(segsize, 0);
+	dsm_pin_mapping(redoSegment);
+	owner = CurrentResourceOwner;
+	CurrentResourceOwner = NULL;
+	ResourceOwnerDelete(owner);
+
+	redoShared = dsm_segment_address(redoSegment);
+
+	redoShared->startup = MyProc;
+	redoShared->finished = false;
+	pg_atomic_init_u32(&redoShared->waiting, 0);
+	for (i = 0; i < nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		pg_atomic_init_u64(&redoShared->applied[i], 0);
+		mq = shm_mq_create(PARALLEL_REDO_QUEUE(redoShared, i),
+						   PARALLEL_REDO_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+	}
+
+	redoQueues = palloc(nworkers * sizeof(shm_mq_handle *));
+	redoHandles = palloc(nworkers * sizeof(BackgroundWorkerHandle *));
+	redoSent = palloc0(nworkers * sizeof(uint64));
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	sprintf(worker.bgw_library_name, "postgres");
+	sprintf(worker.bgw_function_name, "ParallelRedoWorkerMain");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(redoSegment));
+	worker.bgw_notify_pid = MyProcPid;
+
+	for (i = 0; i < nworkers; i++)
+	{
+		snprintf(worker.bgw_name, BGW_MAXLEN, "parallel redo worker %d", i);
+		memcpy(worker.bgw_extra, &i, sizeof(int));
+		if (!RegisterDynamicBackgroundWorker(&worker, &redoHandles[i]))
+			break;
+
+		redoQueues[i] = shm_mq_attach(PARALLEL_REDO_QUEUE(redoShared, i),
+									  redoSegment, redoHandles[i]);
+	}
+
+	/* Workers we could not register just leave their queue unused */
+	redoShared->nworkers = i;
+
+	if (redoShared->nworkers == 0)
+	{
+		ereport(LOG,
+				(errmsg("could not start parallel redo workers, redo continues in the startup process"),
+				 errhint("You might need to increase max_worker_processes.")));
+		dsm_detach(redoSegment);
+		redoSegment = NULL;
+		redoShared = NULL;
+		return;
+	}
+
+	ereport(LOG,
+			(errmsg("parallel redo starts with %d workers",
+					redoShared->nworkers)));
+}
+
+/*
+ * Hand 'record' to a parallel redo worker if it can be replayed by one, and
+ * return true.  Otherwise return false, after waiting for the workers to
+ * replay everything dispatched before it if that is necessary; the caller
+ * then replays it itself.
+ */
+bool
+ParallelRedoDispatch(XLogReaderState *record)
+{
+	ParallelRedoMessage msg;
+	int			worker;
+
+	if (redoShared == NULL)
+		return false;
+
+	worker = ParallelRedoChooseWorker(record);
+	if (worker < 0)
+	{
+		if (ParallelRedoNeedsBarrier(record))
+			ParallelRedoWaitAll();
+		return false;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PARALLEL_REDO_RECORD;
+	msg.ReadRecPtr = record->ReadRecPtr;
+	msg.EndRecPtr = record->EndRecPtr;
+	ParallelRedoSend(worker, &msg, (char *) record->decoded_record,
+					 XLogRecGetTotalLen(record));
+
+	return true;
+}
+
+/*
+ * Wait for the workers to replay everything, and stop them.  Called at the
+ * end of redo; after this, the startup process has all of the work again.
+ */
+void
+ParallelRedoEnd(void)
+{
+	int			i;
+
+	if (redoShared == NULL)
+		return;
+
+	ParallelRedoWaitAll();
+
+	/* Tell the workers this is a clean end, and let them go */
+	redoShared->finished = true;
+	for (i = 0; i < redoShared->nworkers; i++)
+		shm_mq_detach(shm_mq_get_queue(redoQueues[i]));
+
+	for (i = 0; i < redoShared->nworkers; i++)
+	{
+		if (WaitForBackgroundWorkerShutdown(redoHandles[i]) ==
+			BGWH_POSTMASTER_DIED)
+			proc_exit(1);
+	}
+
+	dsm_detach(redoSegment);
+	redoSegment = NULL;
+	redoShared = NULL;
+	pfree(redoQueues);
+	pfree(redoHandles);
+	pfree(redoSent);
+}
+
+/*
+ * Tell the workers that a relation fork has been dropped (nblocks is 0) or
+ * truncated to nblocks.  No-op unless parallel redo is in progress.
+ */
+void
+ParallelRedoForgetRelation(RelFileNode rnode, ForkNumber forknum,
+						   BlockNumber nblocks)
+{
+	ParallelRedoMessage msg;
+	int			i;
+
+	if (redoShared == NULL)
+		return;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PARALLEL_REDO_FORGET_RELATION;
+	msg.rnode = rnode;
+	msg.forknum = forknum;
+	msg.nblocks = nblocks;
+	for (i = 0; i < redoShared->nworkers; i++)
+		ParallelRedoSend(i, &msg, NULL, 0);
+}
+
+/*
+ * As above, for a dropped database.
+ */
+void
+ParallelRedoForgetDatabase(Oid dbid)
+{
+	ParallelRedoMessage msg;
+	int			i;
+
+	if (redoShared == NULL)
+		return;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.type = PARALLEL_REDO_FORGET_DATABASE;
+	msg.dbid = dbid;
+	for (i = 0; i < redoShared->nworkers; i++)
+		ParallelRedoSend(i, &msg, NULL, 0);
+}
+
+/*
+ * Decide which worker replays 'record', or return -1 if the startup process
+ * has to replay it.
+ *
+ * The record types accepted here modify only the main fork pages they
+ * reference, apart from updating the free space map and clearing visibility
+ * map bits of those pages, which is done under buffer locks and commutes
+ * with the same done by other workers.  Setting visibility map bits is not
+ * accepted, because its redo compares the LSN of the map page, which is
+ * shared by many heap pages.  All the referenced pages must map to the same
+ * worker, so that each page keeps seeing its changes in WAL order.
+ */
+static int
+ParallelRedoChooseWorker(XLogReaderState *record)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+	int			worker = -1;
+	int			block_id;
+
+	switch (XLogRecGetRmid(record))
+	{
+		case RM_HEAP_ID:
+			switch (info & XLOG_HEAP_OPMASK)
+			{
+				case XLOG_HEAP_INSERT:
+				case XLOG_HEAP_DELETE:
+				case XLOG_HEAP_UPDATE:
+				case XLOG_HEAP_HOT_UPDATE:
+				case XLOG_HEAP_CONFIRM:
+				case XLOG_HEAP_LOCK:
+				case XLOG_HEAP_INPLACE:
+					break;
+				default:
+					return -1;
+			}
+			break;
+		case RM_HEAP2_ID:
+			switch (info & XLOG_HEAP_OPMASK)
+			{
+				case XLOG_HEAP2_CLEAN:
+				case XLOG_HEAP2_FREEZE_PAGE:
+				case XLOG_HEAP2_MULTI_INSERT:
+				case XLOG_HEAP2_LOCK_UPDATED:
+					break;
+				default:
+					return -1;
+			}
+			break;
+		case RM_BTREE_ID:
+			if (info != XLOG_BTREE_INSERT_LEAF &&
+				info != XLOG_BTREE_INSERT_UPPER &&
+				info != XLOG_BTREE_DEDUP)
+				return -1;
+			break;
+		case RM_XLOG_ID:
+			if (info != XLOG_FPI && info != XLOG_FPI_FOR_HINT)
+				return -1;
+			break;
+		default:
+			return -1;
+	}
+
+	for (block_id = 0; block_id <= record->max_block_id; block_id++)
+	{
+		struct
+		{
+			RelFileNode rnode;
+			BlockNumber blkno;
+		}			key;
+		ForkNumber	forknum;
+		int			w;
+
+		if (!XLogRecGetBlockTag(record, block_id,
+								&key.rnode, &forknum, &key.blkno))
+			continue;
+		if (forknum != MAIN_FORKNUM)
+			return -1;
+
+		w = DatumGetUInt32(hash_any((unsigned char *) &key, sizeof(key))) %
+			redoShared->nworkers;
+		if (worker >= 0 && w != worker)
+			return -1;
+		worker = w;
+	}
+
+	return worker;
+}
+
+/*
+ * Does the startup process have to wait for the workers before replaying
+ * 'record' itself?  Only records that don't touch data pages in any way can
+ * skip the wait.
+ */
+static bool
+ParallelRedoNeedsBarrier(XLogReaderState *record)
+{
+	uint8		info = XLogRecGetInfo(record) & ~XLR_INFO_MASK;
+
+	switch (XLogRecGetRmid(record))
+	{
+		case RM_XACT_ID:
+			switch (info & XLOG_XACT_OPMASK)
+			{
+				case XLOG_XACT_COMMIT:
+				case XLOG_XACT_COMMIT_PREPARED:
+					{
+						xl_xact_parsed_commit parsed;
+
+						ParseCommitRecord(XLogRecGetInfo(record),
+									(xl_xact_commit *) XLogRecGetData(record),
+										  &parsed);
+						return parsed.nrels > 0;
+					}
+				case XLOG_XACT_ABORT:
+				case XLOG_XACT_ABORT_PREPARED:
+					{
+						xl_xact_parsed_abort parsed;
+
+						ParseAbortRecord(XLogRecGetInfo(record),
+									 (xl_xact_abort *) XLogRecGetData(record),
+										 &parsed);
+						return parsed.nrels > 0;
+					}
+				case XLOG_XACT_ASSIGNMENT:
+					return false;
+				default:
+					return true;
+			}
+		case RM_STANDBY_ID:
+			return false;
+		default:
+			return true;
+	}
+}
+
+/*
+ * Send a message to a worker, waiting for room in its queue.
+ */
+static void
+ParallelRedoSend(int worker, ParallelRedoMessage *msg,
+				 const char *data, Size len)
+{
+	shm_mq_iovec iov[2];
+	shm_mq_result res;
+
+	iov[0].data = (const char *) msg;
+	iov[0].len = sizeof(ParallelRedoMessage);
+	iov[1].data = data;
+	iov[1].len = len;
+
+	res = shm_mq_sendv(redoQueues[worker], iov, len > 0 ? 2 : 1, false);
+	if (res != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errmsg("parallel redo worker %d exited unexpectedly",
+						worker)));
+
+	redoSent[worker]++;
+}
+
+/*
+ * Wait until every worker has processed all the messages sent to it.
+ */
+static void
+ParallelRedoWaitAll(void)
+{
+	int			i;
+
+	pg_atomic_write_u32(&redoShared->waiting, 1);
+
+	for (i = 0; i < redoShared->nworkers; i++)
+	{
+		while (pg_atomic_read_u64(&redoShared->applied[i]) < redoSent[i])
+		{
+			pid_t		pid;
+			int			rc;
+
+			if (GetBackgroundWorkerPid(redoHandles[i], &pid) == BGWH_STOPPED)
+				ereport(ERROR,
+						(errmsg("parallel redo worker %d exited unexpectedly",
+								i)));
+
+			rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1L);
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+			ResetLatch(MyLatch);
+
+			HandleStartupProcInterrupts();
+		}
+	}
+
+	pg_atomic_write_u32(&redoShared->waiting, 0);
+}
+
+/*
+ * Main entry point of a parallel redo worker.
+ */
+void
+ParallelRedoWorkerMain(Datum main_arg)
+{
+	dsm_segment *seg;
+	ParallelRedoShared *shared;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	XLogReaderState *reader;
+	MemoryContext redoContext;
+	ErrorContextCallback errcallback;
+	char	   *recordbuf = NULL;
+	Size		recordbufsize = 0;
+	int			worker;
+
+	memcpy(&worker, MyBgworkerEntry->bgw_extra, sizeof(int));
+
+	/* Replay like the startup process does */
+	AmParallelRedoWorker = true;
+	InRecovery = true;
+
+	/* We may need to wait for relation extension locks */
+	RegisterTimeout(DEADLOCK_TIMEOUT, CheckDeadLockAlert);
+
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "parallel redo worker");
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	shared = dsm_segment_address(seg);
+
+	mq = PARALLEL_REDO_QUEUE(shared, worker);
+	shm_mq_set_receiver(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	reader = XLogReaderAllocate(NULL, NULL);
+	if (!reader)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+			errdetail("Failed while allocating an XLog reading processor.")));
+
+	redoContext = AllocSetContextCreate(TopMemoryContext,
+										"parallel redo",
+										ALLOCSET_DEFAULT_SIZES);
+
+	for (;;)
+	{
+		ParallelRedoMessage msg;
+		shm_mq_result res;
+		Size		nbytes;
+		void	   *data;
+
+		res = shm_mq_receive(mqh, &nbytes, &data, false);
+		if (res != SHM_MQ_SUCCESS)
+			break;
+
+		Assert(nbytes >= sizeof(ParallelRedoMessage));
+		memcpy(&msg, data, sizeof(ParallelRedoMessage));
+
+		switch (msg.type)
+		{
+			case PARALLEL_REDO_RECORD:
+				{
+					Size		len = nbytes - sizeof(ParallelRedoMessage);
+					char	   *errormsg;
+					MemoryContext oldcontext;
+
+					/* copy the record, the redo routines expect it aligned */
+					if (len > recordbufsize)
+					{
+						if (recordbuf)
+							pfree(recordbuf);
+						recordbufsize = Max(len, BLCKSZ);
+						recordbuf = MemoryContextAlloc(TopMemoryContext,
+													   recordbufsize);
+					}
+					memcpy(recordbuf,
+						   (char *) data + sizeof(ParallelRedoMessage), len);
+
+					reader->ReadRecPtr = msg.ReadRecPtr;
+					reader->EndRecPtr = msg.EndRecPtr;
+					if (!DecodeXLogRecord(reader, (XLogRecord *) recordbuf,
+										  &errormsg))
+						elog(ERROR, "could not decode WAL record at %X/%X: %s",
+							 (uint32) (msg.ReadRecPtr >> 32),
+							 (uint32) msg.ReadRecPtr, errormsg);
+
+					errcallback.callback = ParallelRedoErrorCallback;
+					errcallback.arg = (void *) reader;
+					errcallback.previous = error_context_stack;
+					error_context_stack = &errcallback;
+
+					oldcontext = MemoryContextSwitchTo(redoContext);
+					RmgrTable[XLogRecGetRmid(reader)].rm_redo(reader);
+					MemoryContextSwitchTo(oldcontext);
+					MemoryContextReset(redoContext);
+
+					error_context_stack = errcallback.previous;
+					break;
+				}
+			case PARALLEL_REDO_FORGET_RELATION:
+				{
+					RelFileNodeBackend rnode;
+
+					rnode.node = msg.rnode;
+					rnode.backend = InvalidBackendId;
+					smgrclosenode(rnode);
+					XLogTruncateRelation(msg.rnode, msg.forknum, msg.nblocks);
+					break;
+				}
+			case PARALLEL_REDO_FORGET_DATABASE:
+				XLogDropDatabase(msg.dbid);
+				break;
+		}
+
+		pg_atomic_fetch_add_u64(&shared->applied[worker], 1);
+		if (pg_atomic_read_u32(&shared->waiting) != 0)
+			SetLatch(&shared->startup->procLatch);
+	}
+
+	/*
+	 * If the startup process finished redo, complain about pages we were
+	 * told to change but that were never dropped, like the startup process
+	 * does for its own.  Otherwise it failed, and will report that.
+	 */
+	if (shared->finished)
+		XLogCheckInvalidPages();
+
+	proc_exit(0);
+}
+
+/*
+ * Error context callback for errors occurring while a worker replays a
+ * record.
+ */
+static void
+ParallelRedoErrorCallback(void *arg)
+{
+	XLogReaderState *record = (XLogReaderState *) arg;
+	const char *id;
+
+	id = RmgrTable[XLogRecGetRmid(record)].rm_identify(XLogRecGetInfo(record));
+	errcontext("parallel redo of WAL record at %X/%X for %s/%s",
+			   (uint32) (record->ReadRecPtr >> 32),
+			   (uint32) record->ReadRecPtr,
+			   RmgrTable[XLogRecGetRmid(record)].rm_name,
+			   id ? id : "UNKNOWN");
+}
@@ -108,6 +108,32 @@ typedef struct SlruFlushData *SlruFlush;
 		} \
 	} while (0)
 
+/*
+ * Change a slot's status to one that lock-free readers reject, before
+ * replacing or discarding its page, and mark it valid again once it holds a
+ * page.  page_change_count is odd in between, so that a reader can tell the
+ * slot was changed under it (see SimpleLruPeekSlot).  Control lock must be
+ * held exclusively.
+ */
+#define SlruInvalidateSlot(shared, slotno, newstatus)	\
+	do { \
+		if (((shared)->page_change_count[slotno] & 1) == 0) \
+		{ \
+			(shared)->page_change_count[slotno]++; \
+			pg_write_barrier(); \
+		} \
+		(shared)->page_status[slotno] = (newstatus); \
+	} while (0)
+
+#define SlruValidateSlot(shared, slotno)	\
+	do { \
+		pg_write_barrier(); \
+		(shared)->page_status[slotno] = SLRU_PAGE_VALID; \
+		pg_write_barrier(); \
+		if ((shared)->page_change_count[slotno] & 1) \
+			(shared)->page_change_count[slotno]++; \
+	} while (0)
+
 /* Saved info for SlruReportIOError */
 typedef enum
 {
@@ -152,6 +178,7 @@ SimpleLruShmemSize(int nslots, int nlsns)
 	sz += MAXALIGN(nslots * sizeof(bool));		/* page_dirty[] */
 	sz += MAXALIGN(nslots * sizeof(int));		/* page_number[] */
 	sz += MAXALIGN(nslots * sizeof(int));		/* page_lru_count[] */
+	sz += MAXALIGN(nslots * sizeof(uint32));	/* page_change_count[] */
 	sz += MAXALIGN(nslots * sizeof(LWLockPadded));		/* buffer_locks[] */
 
 	if (nlsns > 0)
@@ -203,6 +230,8 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		offset += MAXALIGN(nslots * sizeof(int));
 		shared->page_lru_count = (int *) (ptr + offset);
 		offset += MAXALIGN(nslots * sizeof(int));
+		shared->page_change_count = (uint32 *) (ptr + offset);
+		offset += MAXALIGN(nslots * sizeof(uint32));
 
 		/* Initialize LWLocks */
 		shared->buffer_locks = (LWLockPadded *) (ptr + offset);
@@ -231,6 +260,7 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
 			shared->page_dirty[slotno] = false;
 			shared->page_lru_count[slotno] = 0;
+			shared->page_change_count[slotno] = 0;
 			ptr += BLCKSZ;
 		}
 
@@ -273,9 +303,13 @@ SimpleLruZeroPage(SlruCtl ctl, int pageno)
 			!shared->page_dirty[slotno]) ||
 		   shared->page_number[slotno] == pageno);
 
-	/* Mark the slot as containing this page */
+	/*
+	 * Mark the slot as containing this page.  The slot is invalidated before
+	 * its page number changes and becomes valid only after its contents are
+	 * set, for the benefit of lock-free readers (see SimpleLruPeekSlot).
+	 */
+	SlruInvalidateSlot(shared, slotno, SLRU_PAGE_EMPTY);
 	shared->page_number[slotno] = pageno;
-	shared->page_status[slotno] = SLRU_PAGE_VALID;
 	shared->page_dirty[slotno] = true;
 	SlruRecentlyUsed(shared, slotno);
 
@@ -285,6 +319,8 @@ SimpleLruZeroPage(SlruCtl ctl, int pageno)
 	/* Set the LSNs for this new page to zero */
 	SimpleLruZeroLSNs(ctl, slotno);
 
+	SlruValidateSlot(shared, slotno);
+
 	/* Assume this page is now the latest active page */
 	shared->latest_page_number = pageno;
 
@@ -414,8 +450,8 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 				!shared->page_dirty[slotno]));
 
 		/* Mark the slot read-busy */
+		SlruInvalidateSlot(shared, slotno, SLRU_PAGE_READ_IN_PROGRESS);
 		shared->page_number[slotno] = pageno;
-		shared->page_status[slotno] = SLRU_PAGE_READ_IN_PROGRESS;
 		shared->page_dirty[slotno] = false;
 
 		/* Acquire per-buffer lock (cannot deadlock, see notes at top) */
@@ -437,7 +473,10 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 			   shared->page_status[slotno] == SLRU_PAGE_READ_IN_PROGRESS &&
 			   !shared->page_dirty[slotno]);
 
-		shared->page_status[slotno] = ok ? SLRU_PAGE_VALID : SLRU_PAGE_EMPTY;
+		if (ok)
+			SlruValidateSlot(shared, slotno);
+		else
+			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
 
 		LWLockRelease(&shared->buffer_locks[slotno].lock);
 
@@ -493,6 +532,60 @@ SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
 	return SimpleLruReadPage(ctl, pageno, true, xid);
 }
 
+/*
+ * Check without taking the control lock whether the given slot holds a valid
+ * copy of the given page.
+ *
+ * Lock-free readers call this before reading from the slot's buffer, and
+ * SimpleLruSlotUnchanged with the returned *changecount afterwards; if both
+ * return true, the data read in between belongs to the page.  Comparing the
+ * page number alone would not do, since the slot could have been reused for
+ * another page and then for this one again in the meantime.  Data
+ * concurrently modified under the control lock may be seen in either state,
+ * as by a locked reader that finished just before or after the update, so
+ * only individually atomic items should be read this way.
+ *
+ * The page is marked recently used, with the same caveats about concurrent
+ * updates of the LRU counts as in SimpleLruReadPage_ReadOnly.
+ */
+bool
+SimpleLruPeekSlot(SlruCtl ctl, int slotno, int pageno, uint32 *changecount)
+{
+	SlruShared	shared = ctl->shared;
+	SlruPageStatus status;
+	uint32		count;
+
+	if (slotno < 0 || slotno >= shared->num_slots)
+		return false;
+
+	count = shared->page_change_count[slotno];
+	if (count & 1)
+		return false;			/* page is being replaced */
+	pg_read_barrier();
+
+	if (shared->page_number[slotno] != pageno)
+		return false;
+	status = shared->page_status[slotno];
+	if (status != SLRU_PAGE_VALID && status != SLRU_PAGE_WRITE_IN_PROGRESS)
+		return false;
+	pg_read_barrier();
+
+	SlruRecentlyUsed(shared, slotno);
+	*changecount = count;
+	return true;
+}
+
+/*
+ * Check whether a slot approved by SimpleLruPeekSlot still holds the same
+ * copy of its page.
+ */
+bool
+SimpleLruSlotUnchanged(SlruCtl ctl, int slotno, uint32 changecount)
+{
+	pg_read_barrier();
+	return ctl->shared->page_change_count[slotno] == changecount;
+}
+
 /*
  * Write a page from a shared buffer, if necessary.
  * Does nothing if the specified slot is not dirty.
@@ -1204,7 +1297,7 @@ restart:;
 		if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
 			!shared->page_dirty[slotno])
 		{
-			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
+			SlruInvalidateSlot(shared, slotno, SLRU_PAGE_EMPTY);
 			continue;
 		}
 
@@ -1275,7 +1368,7 @@ restart:
 		if (shared->page_status[slotno] == SLRU_PAGE_VALID &&
 			!shared->page_dirty[slotno])
 		{
-			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
+			SlruInvalidateSlot(shared, slotno, SLRU_PAGE_EMPTY);
 			continue;
 		}
 
@@ -62,6 +62,14 @@ static SlruCtlData SubTransCtlData;
 
 #define SubTransCtl  (&SubTransCtlData)
 
+int			subtrans_buffers = 32;
+
+/*
+ * Slot in which this backend last found a SUBTRANS page; SubTransGetParent
+ * tries it without the control lock first.
+ */
+static int	SubTransLastSlot = -1;
+
 
 static int	ZeroSUBTRANSPage(int pageno);
 static bool SubTransPagePrecedes(int page1, int page2);
@@ -108,6 +116,7 @@ SubTransGetParent(TransactionId xid)
 	int			pageno = TransactionIdToPage(xid);
 	int			entryno = TransactionIdToEntry(xid);
 	int			slotno;
+	uint32		changecount;
 	TransactionId *ptr;
 	TransactionId parent;
 
@@ -118,6 +127,21 @@ SubTransGetParent(TransactionId xid)
 	if (!TransactionIdIsNormal(xid))
 		return InvalidTransactionId;
 
+	/*
+	 * Walking up a deep subtransaction tree looks up the same page over and
+	 * over, so first try to read the parent from the page we found last time
+	 * without taking the control lock.
+	 */
+	slotno = SubTransLastSlot;
+	if (SimpleLruPeekSlot(SubTransCtl, slotno, pageno, &changecount))
+	{
+		ptr = (TransactionId *) SubTransCtl->shared->page_buffer[slotno];
+		parent = ptr[entryno];
+
+		if (SimpleLruSlotUnchanged(SubTransCtl, slotno, changecount))
+			return parent;
+	}
+
 	/* lock is acquired by SimpleLruReadPage_ReadOnly */
 
 	slotno = SimpleLruReadPage_ReadOnly(SubTransCtl, pageno, xid);
@@ -128,6 +152,8 @@ SubTransGetParent(TransactionId xid)
 
 	LWLockRelease(SubtransControlLock);
 
+	SubTransLastSlot = slotno;
+
 	return parent;
 }
 
@@ -175,14 +201,14 @@ SubTransGetTopmostTransaction(TransactionId xid)
 Size
 SUBTRANSShmemSize(void)
 {
-	return SimpleLruShmemSize(NUM_SUBTRANS_BUFFERS, 0);
+	return SimpleLruShmemSize(subtrans_buffers, 0);
 }
 
 void
 SUBTRANSShmemInit(void)
 {
 	SubTransCtl->PagePrecedes = SubTransPagePrecedes;
-	SimpleLruInit(SubTransCtl, "subtrans", NUM_SUBTRANS_BUFFERS, 0,
+	SimpleLruInit(SubTransCtl, "subtrans", subtrans_buffers, 0,
 				  SubtransControlLock, "pg_subtrans",
 				  LWTRANCHE_SUBTRANS_BUFFERS);
 	/* Override default assumption that writes should be fsync'd */
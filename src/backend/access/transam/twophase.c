@@ -38,9 +38,12 @@
  *
  *		* On PREPARE TRANSACTION backend writes state data only to the WAL and
  *		  stores pointer to the start of the WAL record in
- *		  gxact->prepare_start_lsn.
- *		* If COMMIT occurs before checkpoint then backend reads data from WAL
- *		  using prepare_start_lsn.
+ *		  gxact->prepare_start_lsn.  If the state data is not larger than
+ *		  twophase_state_cache_size, it is also copied to shared memory.
+ *		* If the state data is in shared memory, COMMIT takes it from there,
+ *		  no matter whether a checkpoint happened meanwhile.
+ *		* Otherwise, if COMMIT occurs before checkpoint then backend reads
+ *		  data from WAL using prepare_start_lsn.
  *		* On checkpoint state data copied to files in pg_twophase directory and
  *		  fsynced
  *		* If COMMIT happens after checkpoint then backend reads state data from
@@ -96,8 +99,9 @@
  */
 #define TWOPHASE_DIR "pg_twophase"
 
-/* GUC variable, can't be changed after startup */
+/* GUC variables, can't be changed after startup */
 int			max_prepared_xacts = 0;
+int			twophase_state_cache_size = 2;	/* kB */
 
 /*
  * This struct describes one global transaction that is in prepared state
@@ -106,7 +110,7 @@ int			max_prepared_xacts = 0;
  * The lifecycle of a global transaction is:
  *
  * 1. After checking that the requested GID is not in use, set up an entry in
- * the TwoPhaseState->prepXacts array with the correct GID and valid = false,
+ * the TwoPhaseState->hashTable with the correct GID and valid = false,
  * and mark it as locked by my backend.
  *
  * 2. After successfully completing prepare, set valid = true and enter the
@@ -118,7 +122,7 @@ int			max_prepared_xacts = 0;
  * commit or rollback the same prepared xact.
  *
  * 4. On completion of COMMIT PREPARED or ROLLBACK PREPARED, remove the entry
- * from the ProcArray and the TwoPhaseState->prepXacts array and return it to
+ * from the ProcArray and the TwoPhaseState->hashTable and return it to
  * the freelist.
  *
  * Note that if the preparing transaction fails between steps 1 and 2, the
@@ -134,7 +138,7 @@ int			max_prepared_xacts = 0;
 
 typedef struct GlobalTransactionData
 {
-	GlobalTransaction next;		/* list link for free list */
+	GlobalTransaction next;		/* list link for free list or hash chain */
 	int			pgprocno;		/* ID of associated dummy PGPROC */
 	BackendId	dummyBackendId; /* similar to backend id for backends */
 	TimestampTz prepared_at;	/* time of preparation */
@@ -153,30 +157,56 @@ typedef struct GlobalTransactionData
 	int 	    locking_pid;	/* backend currently working on the xact */
 	bool		valid;			/* TRUE if PGPROC entry is in proc array */
 	bool		ondisk;			/* TRUE if prepare state file is on disk */
-	int         prep_index;     /* Index of prepXacts array */
+	bool		inuse;			/* TRUE if entry is in the hash table */
+	int			bucket;			/* hash chain of the GID, determines partition */
 	char		gid[GIDSIZE];	/* The GID assigned to the prepared xact */
 	char        state_3pc[MAX_3PC_STATE_SIZE]; /* 3PC transaction state  */
+
+	/*
+	 * Copy of the state data written to WAL (without CRC), if it fits in
+	 * twophase_state_cache_size.  state_len is zero if the state data is
+	 * not cached.  Like gid, it is changed only by the backend that has the
+	 * entry locked.
+	 */
+	char	   *state_data;		/* [twophase_state_cache_size] kB in shmem */
+	uint32		state_len;
 }	GlobalTransactionData;
 
 /*
- * Two Phase Commit shared state.  Access to this struct is protected
- * by TwoPhaseStateLock.
+ * Two Phase Commit shared state.
+ *
+ * The table is divided into NUM_TWOPHASE_PARTITIONS partitions by hash of
+ * the GID.  Each partition's LWLock protects the hash chains and the free
+ * list of the partition, so that preparing and finishing transactions with
+ * different GIDs do not contend for a single lock.  Operations that need all
+ * prepared transactions lock all partitions, in partition number order.
+ *
+ * Hash chains are also searched without any lock, see TwoPhaseLookupGid.
+ * This is possible because GlobalTransactionData structs are never freed:
+ * the worst that can happen to a reader is to follow a struct that has just
+ * been moved to a free list or to another chain.
  */
 typedef struct TwoPhaseStateData
 {
-	/* Head of linked list of free GlobalTransactionData structs */
-	GlobalTransaction freeGXacts;
-
-	/* Number of valid prepXacts entries. */
-	int			numPrepXacts;
+	/* Heads of linked lists of free GlobalTransactionData structs */
+	GlobalTransaction freeGXacts[NUM_TWOPHASE_PARTITIONS];
 
-	/* Hash table for gxacts */
-	GlobalTransaction* hashTable;
+	/* Array of all max_prepared_xacts GlobalTransactionData structs */
+	GlobalTransaction allGXacts;
 
-	/* There are max_prepared_xacts items in this array */
-	GlobalTransaction prepXacts[FLEXIBLE_ARRAY_MEMBER];
+	/* There are max_prepared_xacts hash chains in this array */
+	GlobalTransaction hashTable[FLEXIBLE_ARRAY_MEMBER];
 } TwoPhaseStateData;
 
+#define TwoPhaseGidBucket(gid) \
+	(string_hash(gid, 0) % max_prepared_xacts)
+#define TwoPhaseBucketPartition(bucket) \
+	((bucket) % NUM_TWOPHASE_PARTITIONS)
+#define TwoPhasePartitionLockByIndex(i) \
+	(&MainLWLockArray[TWOPHASE_STATE_LWLOCK_OFFSET + (i)].lock)
+#define TwoPhasePartitionLock(bucket) \
+	TwoPhasePartitionLockByIndex(TwoPhaseBucketPartition(bucket))
+
 /*
  * 2PC state file format:
  *
@@ -284,8 +314,15 @@ static void RecordTransactionAbortPrepared(TransactionId xid,
 static void ProcessRecords(char *bufptr, TransactionId xid,
 			   const TwoPhaseCallback callbacks[]);
 static void RemoveGXact(GlobalTransaction gxact);
+static GlobalTransaction TwoPhaseLookupGid(const char *gid, int bucket);
+static GlobalTransaction TwoPhaseGetFreeGXact(int partition);
+static void TwoPhaseLockAllPartitions(LWLockMode mode);
+static void TwoPhaseUnlockAllPartitions(void);
 
 static void XlogReadTwoPhaseData(XLogRecPtr lsn, char **buf, int *len);
+static char *ReadTwoPhaseState(GlobalTransaction gxact, int *len);
+
+#define TwoPhaseStateCacheSize() ((Size) twophase_state_cache_size * 1024)
 
 /*
  * Initialization of shared memory
@@ -295,13 +332,16 @@ TwoPhaseShmemSize(void)
 {
 	Size		size;
 
-	/* Need the fixed struct, the array of pointers, and the GTD structs */
-	size = offsetof(TwoPhaseStateData, prepXacts);
-	size = add_size(size, mul_size(max_prepared_xacts*2,
+	/* Need the fixed struct, the hash chains, and the GTD structs */
+	size = offsetof(TwoPhaseStateData, hashTable);
+	size = add_size(size, mul_size(max_prepared_xacts,
 								   sizeof(GlobalTransaction)));
 	size = MAXALIGN(size);
 	size = add_size(size, mul_size(max_prepared_xacts,
 								   sizeof(GlobalTransactionData)));
+	size = MAXALIGN(size);
+	size = add_size(size, mul_size(max_prepared_xacts,
+								   TwoPhaseStateCacheSize()));
 
 	return size;
 }
@@ -317,27 +357,32 @@ TwoPhaseShmemInit(void)
 	if (!IsUnderPostmaster)
 	{
 		GlobalTransaction gxacts;
+		char	   *state_cache;
 		int			i;
 
 		Assert(!found);
-		TwoPhaseState->freeGXacts = NULL;
-		TwoPhaseState->numPrepXacts = 0;
+		for (i = 0; i < NUM_TWOPHASE_PARTITIONS; i++)
+			TwoPhaseState->freeGXacts[i] = NULL;
 
 		/*
-		 * Initialize the linked list of free GlobalTransactionData structs
+		 * Initialize the linked lists of free GlobalTransactionData structs,
+		 * spreading the structs evenly over the partitions
 		 */
 		gxacts = (GlobalTransaction)
 			((char *) TwoPhaseState +
-			 MAXALIGN(offsetof(TwoPhaseStateData, prepXacts) +
-					  sizeof(GlobalTransaction) * 2 * max_prepared_xacts));
-		
-		TwoPhaseState->hashTable = &TwoPhaseState->prepXacts[max_prepared_xacts];
+			 MAXALIGN(offsetof(TwoPhaseStateData, hashTable) +
+					  sizeof(GlobalTransaction) * max_prepared_xacts));
+		TwoPhaseState->allGXacts = gxacts;
+		state_cache = (char *) gxacts +
+			MAXALIGN(sizeof(GlobalTransactionData) * max_prepared_xacts);
 
 		for (i = 0; i < max_prepared_xacts; i++)
 		{
+			int			partition = i % NUM_TWOPHASE_PARTITIONS;
+
 			/* insert into linked list */
-			gxacts[i].next = TwoPhaseState->freeGXacts;
-			TwoPhaseState->freeGXacts = &gxacts[i];
+			gxacts[i].next = TwoPhaseState->freeGXacts[partition];
+			TwoPhaseState->freeGXacts[partition] = &gxacts[i];
 
 			TwoPhaseState->hashTable[i] = NULL;
 
@@ -359,12 +404,99 @@ TwoPhaseShmemInit(void)
 			gxacts[i].dummyBackendId = MaxBackends + 1 + i;
 			SpinLockInit(&gxacts[i].spinlock);
 			gxacts[i].locking_pid = -1;
+			gxacts[i].inuse = false;
+			gxacts[i].gid[0] = '\0';
+			gxacts[i].state_data = state_cache + i * TwoPhaseStateCacheSize();
+			gxacts[i].state_len = 0;
 		}
 	}
 	else
 		Assert(found);
 }
 
+/*
+ * TwoPhaseLockAllPartitions
+ *		Lock all partitions of the prepared transaction table.
+ *
+ * Partitions are locked in partition number order, which is safe because
+ * everybody else holds at most one partition lock at a time.
+ */
+static void
+TwoPhaseLockAllPartitions(LWLockMode mode)
+{
+	int			i;
+
+	for (i = 0; i < NUM_TWOPHASE_PARTITIONS; i++)
+		LWLockAcquire(TwoPhasePartitionLockByIndex(i), mode);
+}
+
+static void
+TwoPhaseUnlockAllPartitions(void)
+{
+	int			i;
+
+	for (i = NUM_TWOPHASE_PARTITIONS; --i >= 0;)
+		LWLockRelease(TwoPhasePartitionLockByIndex(i));
+}
+
+/*
+ * TwoPhaseLookupGid
+ *		Search the hash chain for an entry with the given GID.
+ *
+ * If the caller holds the partition lock, the result is exact.  Otherwise the
+ * chain can change under us: an entry removed concurrently may lead the scan
+ * to a free list or to another chain, and the GID of an entry can be replaced
+ * right after we compared it.  Without the lock the caller therefore has to
+ * revalidate the returned entry, and has to search again under the lock
+ * before concluding that the GID does not exist.
+ */
+static GlobalTransaction
+TwoPhaseLookupGid(const char *gid, int bucket)
+{
+	volatile TwoPhaseStateData *twophaseState = TwoPhaseState;
+	GlobalTransaction gxact;
+	int			steps = 0;
+
+	for (gxact = twophaseState->hashTable[bucket];
+		 gxact != NULL && steps++ < max_prepared_xacts;
+		 gxact = ((volatile GlobalTransactionData *) gxact)->next)
+	{
+		pg_read_barrier();
+		if (gxact->inuse && strncmp(gxact->gid, gid, GIDSIZE) == 0)
+			return gxact;
+	}
+	return NULL;
+}
+
+/*
+ * TwoPhaseGetFreeGXact
+ *		Take a GlobalTransactionData struct from a free list.
+ *
+ * The free list of the given partition is tried first.  If it is empty, the
+ * struct is taken from another partition; it is returned to the free list of
+ * its new GID's partition when it is released.  Partition locks are taken one
+ * at a time, so the caller must not hold any.  Returns NULL if all structs are
+ * in use.
+ */
+static GlobalTransaction
+TwoPhaseGetFreeGXact(int partition)
+{
+	GlobalTransaction gxact = NULL;
+	int			i;
+
+	for (i = 0; i < NUM_TWOPHASE_PARTITIONS && gxact == NULL; i++)
+	{
+		int			p = (partition + i) % NUM_TWOPHASE_PARTITIONS;
+
+		LWLockAcquire(TwoPhasePartitionLockByIndex(p), LW_EXCLUSIVE);
+		gxact = TwoPhaseState->freeGXacts[p];
+		if (gxact != NULL)
+			TwoPhaseState->freeGXacts[p] = gxact->next;
+		LWLockRelease(TwoPhasePartitionLockByIndex(p));
+	}
+	return gxact;
+}
+
 /*
  * Exit hook to unlock the global transaction entry we're working on.
  */
@@ -445,6 +577,10 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	GlobalTransaction gxact;
 	PGPROC	   *proc;
 	PGXACT	   *pgxact;
+	uint64	   *fpLockBits;
+	Oid		   *fpRelId;
+	LWLock	   *partitionLock;
+	int			bucket;
 	int			i;
 
 	if (strlen(gid) >= GIDSIZE)
@@ -467,51 +603,46 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 		twophaseExitRegistered = true;
 	}
 
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
-
-	/* Check for conflicting GID */
-	i = string_hash(gid, 0)  % max_prepared_xacts;
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
-	{
-		if (strcmp(gxact->gid, gid) == 0)
-		{
-			LWLockRelease(TwoPhaseStateLock);
-			ereport(ERROR,
-					(errcode(ERRCODE_DUPLICATE_OBJECT),
-					 errmsg("transaction identifier \"%s\" is already in use",
-							gid)));
-		}
-	}
+	bucket = TwoPhaseGidBucket(gid);
+	partitionLock = TwoPhasePartitionLock(bucket);
 
 	/* Get a free gxact from the freelist */
-	if (TwoPhaseState->freeGXacts == NULL)
-	{
-		LWLockRelease(TwoPhaseStateLock);
+	gxact = TwoPhaseGetFreeGXact(TwoPhaseBucketPartition(bucket));
+	if (gxact == NULL)
 		ereport(ERROR,
 				(errcode(ERRCODE_OUT_OF_MEMORY),
 				 errmsg("maximum number of prepared transactions reached"),
 				 errhint("Increase max_prepared_transactions (currently %d).",
 						 max_prepared_xacts)));
-	}
-	gxact = TwoPhaseState->freeGXacts;
-	TwoPhaseState->freeGXacts = gxact->next;
 
-	/* Lock gxact usnig spinlock. We have to release TwoPhaseStateLock LWLock to avoid deadlock and reobtain it after holding spinlock */
-	LWLockRelease(TwoPhaseStateLock);
+	/* Lock gxact using spinlock before obtaining the partition lock to avoid deadlock */
 	SpinLockAcquire(&gxact->spinlock);
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 	Assert(gxact->locking_pid < 0);
 
-	/* Include in collision chain */
-	gxact->next = TwoPhaseState->hashTable[i];
-	TwoPhaseState->hashTable[i] = gxact;
+	/* Check for conflicting GID */
+	if (TwoPhaseLookupGid(gid, bucket) != NULL)
+	{
+		gxact->next = TwoPhaseState->freeGXacts[TwoPhaseBucketPartition(bucket)];
+		TwoPhaseState->freeGXacts[TwoPhaseBucketPartition(bucket)] = gxact;
+		LWLockRelease(partitionLock);
+		SpinLockRelease(&gxact->spinlock);
+		ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_OBJECT),
+				 errmsg("transaction identifier \"%s\" is already in use",
+						gid)));
+	}
 
 	proc = &ProcGlobal->allProcs[gxact->pgprocno];
 	pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
 
-	/* Initialize the PGPROC entry */
+	/* Initialize the PGPROC entry, keeping its fast-path lock arrays */
+	fpLockBits = proc->fpLockBits;
+	fpRelId = proc->fpRelId;
 	MemSet(proc, 0, sizeof(PGPROC));
+	proc->fpLockBits = fpLockBits;
+	proc->fpRelId = fpRelId;
 	proc->pgprocno = gxact->pgprocno;
 	SHMQueueElemInit(&(proc->links));
 	proc->waitStatus = STATUS_OK;
@@ -547,22 +678,28 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	gxact->owner = owner;
 	gxact->locking_pid = MyProcPid;
 	gxact->valid = false;
-	gxact->ondisk = false;	
-	gxact->prep_index = TwoPhaseState->numPrepXacts;
+	gxact->ondisk = false;
+	gxact->bucket = bucket;
 	strcpy(gxact->gid, gid);
 	*gxact->state_3pc = '\0';
+	gxact->state_len = 0;
+	gxact->inuse = true;
+
+	/*
+	 * And include it in the collision chain.  The entry must be fully
+	 * initialized before lock-free readers can see it.
+	 */
+	pg_write_barrier();
+	gxact->next = TwoPhaseState->hashTable[bucket];
+	TwoPhaseState->hashTable[bucket] = gxact;
 
-	/* And insert it into the active array */
-	Assert(TwoPhaseState->numPrepXacts < max_prepared_xacts);
-	TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts++] = gxact;
-	
 	/*
 	 * Remember that we have this GlobalTransaction entry locked for us. If we
 	 * abort after this, we must release it.
 	 */
 	MyLockedGxact = gxact;
 
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	return gxact;
 }
@@ -602,11 +739,13 @@ GXactLoadSubxactData(GlobalTransaction gxact, int nsubxacts,
 static void
 MarkAsPrepared(GlobalTransaction gxact)
 {
+	LWLock	   *partitionLock = TwoPhasePartitionLock(gxact->bucket);
+
 	/* Lock here may be overkill, but I'm not convinced of that ... */
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 	Assert(!gxact->valid);
 	gxact->valid = true;
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	/*
 	 * Put it into the global ProcArray so TransactionIdIsInProgress considers
@@ -623,8 +762,9 @@ MarkAsPrepared(GlobalTransaction gxact)
 static GlobalTransaction
 LockGXact(const char *gid, Oid user)
 {
-	int			i;
+	int			bucket;
 	GlobalTransaction gxact;
+	PGPROC	   *proc;
 
 	/* on first call, register the exit hook */
 	if (!twophaseExitRegistered)
@@ -633,78 +773,73 @@ LockGXact(const char *gid, Oid user)
 		twophaseExitRegistered = true;
 	}
 	MyLockedGxact = NULL;
-	i = string_hash(gid, 0) % max_prepared_xacts;
-  Retry:
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
+	bucket = TwoPhaseGidBucket(gid);
+
+	for (;;)
 	{
-		if (strcmp(gxact->gid, gid) == 0)
+		gxact = TwoPhaseLookupGid(gid, bucket);
+		if (gxact == NULL)
 		{
-			PGPROC	   *proc = &ProcGlobal->allProcs[gxact->pgprocno];
+			/* Concurrent changes of the chain might have hidden the entry */
+			LWLock	   *partitionLock = TwoPhasePartitionLock(bucket);
 
-			/* Lock gxact. We have to release TwoPhaseStateLock LW-Lock to avoid deadlock */
+			LWLockAcquire(partitionLock, LW_SHARED);
+			gxact = TwoPhaseLookupGid(gid, bucket);
+			LWLockRelease(partitionLock);
 
-			LWLockRelease(TwoPhaseStateLock);
-
-			if (MyLockedGxact != gxact) {
-				if (MyLockedGxact != NULL) { 
-					SpinLockRelease(&MyLockedGxact->spinlock);
-				}
-				MyLockedGxact = gxact;
-				SpinLockAcquire(&gxact->spinlock);
-				goto Retry;
-			}
-
-			/* Ignore not-yet-valid GIDs */
-			if (!gxact->valid) {
+			if (gxact == NULL)
 				ereport(ERROR,
-						(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-						 errmsg("prepared transaction with identifier \"%s\" is not valid",
+						(errcode(ERRCODE_UNDEFINED_OBJECT),
+						 errmsg("prepared transaction with identifier \"%s\" does not exist",
 								gid)));
-			}
-			
-			if (user != gxact->owner && !superuser_arg(user)) {
-				ereport(ERROR,
-						(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
-						 errmsg("permission denied to finish prepared transaction"),
-						 errhint("Must be superuser or the user that prepared the transaction.")));
-			}	
-
-			/*
-			 * Note: it probably would be possible to allow committing from
-			 * another database; but at the moment NOTIFY is known not to work and
-			 * there may be some other issues as well.  Hence disallow until
-			 * someone gets motivated to make it work.
-			 */
-			if (MyDatabaseId != proc->databaseId) {
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("prepared transaction belongs to another database"),
-						 errhint("Connect to the database where the transaction was prepared to finish it.")));
-			}
+		}
 
+		/*
+		 * Lock gxact.  The entry can be finished and reused while we are
+		 * waiting for the spinlock, so check its GID again once we hold it:
+		 * nobody can remove the entry or change its GID while it is locked.
+		 */
+		SpinLockAcquire(&gxact->spinlock);
+		if (gxact->inuse && strcmp(gxact->gid, gid) == 0)
+			break;
+		SpinLockRelease(&gxact->spinlock);
+	}
+	MyLockedGxact = gxact;
+	proc = &ProcGlobal->allProcs[gxact->pgprocno];
 
-			/* OK for me to lock it */
-			Assert(gxact->locking_pid < 0);
-			gxact->locking_pid = MyProcPid;
+	/* Ignore not-yet-valid GIDs */
+	if (!gxact->valid) {
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("prepared transaction with identifier \"%s\" is not valid",
+						gid)));
+	}
 
-			return gxact;
-		}		
+	if (user != gxact->owner && !superuser_arg(user)) {
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("permission denied to finish prepared transaction"),
+				 errhint("Must be superuser or the user that prepared the transaction.")));
 	}
 
-	LWLockRelease(TwoPhaseStateLock);
-	if (MyLockedGxact != NULL) { 
-		SpinLockRelease(&MyLockedGxact->spinlock);
-		MyLockedGxact = NULL;
+	/*
+	 * Note: it probably would be possible to allow committing from
+	 * another database; but at the moment NOTIFY is known not to work and
+	 * there may be some other issues as well.  Hence disallow until
+	 * someone gets motivated to make it work.
+	 */
+	if (MyDatabaseId != proc->databaseId) {
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("prepared transaction belongs to another database"),
+				 errhint("Connect to the database where the transaction was prepared to finish it.")));
 	}
 
-	ereport(ERROR,
-			(errcode(ERRCODE_UNDEFINED_OBJECT),
-		 errmsg("prepared transaction with identifier \"%s\" does not exist",
-				gid)));
+	/* OK for me to lock it */
+	Assert(gxact->locking_pid < 0);
+	gxact->locking_pid = MyProcPid;
 
-	/* NOTREACHED */
-	return NULL;
+	return gxact;
 }
 
 /*
@@ -716,39 +851,35 @@ LockGXact(const char *gid, Oid user)
 static void
 RemoveGXact(GlobalTransaction gxact)
 {
-	int			i;
+	int			partition = TwoPhaseBucketPartition(gxact->bucket);
+	LWLock	   *partitionLock = TwoPhasePartitionLock(gxact->bucket);
 	GlobalTransaction* prev;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
-	i = string_hash(gxact->gid, 0) % max_prepared_xacts;
-
-	for (prev = &TwoPhaseState->hashTable[i]; *prev != NULL; prev = &(*prev)->next)
+	for (prev = &TwoPhaseState->hashTable[gxact->bucket]; *prev != NULL; prev = &(*prev)->next)
 	{
 		if (gxact == *prev)
 		{
-			/* remove from the active array */
-			TwoPhaseState->numPrepXacts--;
-			TwoPhaseState->prepXacts[gxact->prep_index] = TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts];
-			TwoPhaseState->prepXacts[gxact->prep_index]->prep_index = gxact->prep_index;
-
 			/* remove from collision list */
 			*prev = gxact->next;
+			gxact->inuse = false;
 
 			/* and put it back in the freelist */
-			gxact->next = TwoPhaseState->freeGXacts;
-			TwoPhaseState->freeGXacts = gxact;
+			pg_write_barrier();
+			gxact->next = TwoPhaseState->freeGXacts[partition];
+			TwoPhaseState->freeGXacts[partition] = gxact;
 
 			gxact->locking_pid = -1;
 
-			LWLockRelease(TwoPhaseStateLock);
+			LWLockRelease(partitionLock);
 			SpinLockRelease(&gxact->spinlock);
 
 			return;
 		}
 	}
 
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	elog(ERROR, "failed to find %p in GlobalTransaction array", gxact);
 }
@@ -758,7 +889,7 @@ RemoveGXact(GlobalTransaction gxact)
  * function pg_prepared_xact.
  *
  * The returned array and all its elements are copies of internal data
- * structures, to minimize the time we need to hold the TwoPhaseStateLock.
+ * structures, to minimize the time we need to hold the partition locks.
  *
  * WARNING -- we return even those transactions that are not fully prepared
  * yet.  The caller should filter them out if he doesn't want them.
@@ -769,49 +900,70 @@ static int
 GetPreparedTransactionList(GlobalTransaction *gxacts)
 {
 	GlobalTransaction array;
-	int			num;
+	int			num = 0;
 	int			i;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
+	TwoPhaseLockAllPartitions(LW_SHARED);
+
+	for (i = 0; i < max_prepared_xacts; i++)
+		if (TwoPhaseState->allGXacts[i].inuse)
+			num++;
 
-	if (TwoPhaseState->numPrepXacts == 0)
+	if (num == 0)
 	{
-		LWLockRelease(TwoPhaseStateLock);
+		TwoPhaseUnlockAllPartitions();
 
 		*gxacts = NULL;
 		return 0;
 	}
 
-	num = TwoPhaseState->numPrepXacts;
 	array = (GlobalTransaction) palloc(sizeof(GlobalTransactionData) * num);
 	*gxacts = array;
-	for (i = 0; i < num; i++)
-		memcpy(array + i, TwoPhaseState->prepXacts[i],
-			   sizeof(GlobalTransactionData));
+	for (i = 0; i < max_prepared_xacts; i++)
+		if (TwoPhaseState->allGXacts[i].inuse)
+			memcpy(array++, &TwoPhaseState->allGXacts[i],
+				   sizeof(GlobalTransactionData));
 
-	LWLockRelease(TwoPhaseStateLock);
+	TwoPhaseUnlockAllPartitions();
 
 	return num;
 }
 
+/*
+ * GetPreparedTransactionState
+ *		Get 3PC state of prepared transaction, returns false if there is no
+ *		such transaction.
+ *
+ * The state is usually found without taking the partition lock: it is enough
+ * to check that the entry still has the same GID after the state was copied.
+ */
 bool GetPreparedTransactionState(char const* gid, char* state)
 {
-	int i;
+	int			bucket = TwoPhaseGidBucket(gid);
+	LWLock	   *partitionLock;
 	GlobalTransaction gxact;
-	bool result = false;
+	bool		result = false;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
-	i = string_hash(gid, 0)  % max_prepared_xacts;
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
+	gxact = TwoPhaseLookupGid(gid, bucket);
+	if (gxact != NULL)
 	{
-		if (strcmp(gxact->gid, gid) == 0)
-		{
-			strcpy(state, gxact->state_3pc);
-			result = true;
-			break;
-		}
+		memcpy(state, gxact->state_3pc, MAX_3PC_STATE_SIZE);
+		state[MAX_3PC_STATE_SIZE - 1] = '\0';
+		pg_read_barrier();
+		if (gxact->inuse && strncmp(gxact->gid, gid, GIDSIZE) == 0)
+			return true;
+	}
+
+	partitionLock = TwoPhasePartitionLock(bucket);
+	LWLockAcquire(partitionLock, LW_SHARED);
+	gxact = TwoPhaseLookupGid(gid, bucket);
+	if (gxact != NULL)
+	{
+		memcpy(state, gxact->state_3pc, MAX_3PC_STATE_SIZE);
+		state[MAX_3PC_STATE_SIZE - 1] = '\0';
+		result = true;
 	}
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 	return result;
 }
 
@@ -823,7 +975,6 @@ bool GetPreparedTransactionState(char const* gid, char* state)
 void SetPreparedTransactionState(char const* gid, char const* state)
 {	
 	GlobalTransaction gxact;
-	PGXACT	   *pgxact;
 	TwoPhaseFileHeader *hdr;
 	char* buf;
     bool replorigin;
@@ -839,13 +990,9 @@ void SetPreparedTransactionState(char const* gid, char const* state)
 				  replorigin_session_origin != DoNotReplicateId);
 
 	gxact = LockGXact(gid, GetUserId());	
-	pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
 	strcpy(gxact->state_3pc, state);
 
-	if (gxact->ondisk)
-		buf = ReadTwoPhaseFile(pgxact->xid, true);
-	else
-		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, NULL);
+	buf = ReadTwoPhaseState(gxact, NULL);
 	hdr = (TwoPhaseFileHeader *)buf;
 	strcpy(hdr->state_3pc, state);
 
@@ -870,6 +1017,10 @@ void SetPreparedTransactionState(char const* gid, char const* state)
 	gxact->prepare_start_lsn = ProcLastRecPtr;
 	MyPgXact->delayChkpt = false;
 
+	/* Cached copy must match the new record */
+	if (gxact->state_len != 0)
+		memcpy(gxact->state_data, buf, gxact->state_len);
+
 	END_CRIT_SECTION();
 
 	PostPrepare_Twophase();
@@ -1010,21 +1161,30 @@ TwoPhaseGetGXact(TransactionId xid)
 	if (xid == cached_xid)
 		return cached_gxact;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
-
-	for (i = 0; i < TwoPhaseState->numPrepXacts; i++)
+	/* Usually it is the transaction we are preparing or finishing */
+	if (MyLockedGxact != NULL &&
+		ProcGlobal->allPgXact[MyLockedGxact->pgprocno].xid == xid)
 	{
-		GlobalTransaction gxact = TwoPhaseState->prepXacts[i];
-		PGXACT	   *pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
+		result = MyLockedGxact;
+	}
+	else
+	{
+		TwoPhaseLockAllPartitions(LW_SHARED);
 
-		if (pgxact->xid == xid)
+		for (i = 0; i < max_prepared_xacts; i++)
 		{
-			result = gxact;
-			break;
+			GlobalTransaction gxact = &TwoPhaseState->allGXacts[i];
+			PGXACT	   *pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
+
+			if (gxact->inuse && pgxact->xid == xid)
+			{
+				result = gxact;
+				break;
+			}
 		}
-	}
 
-	LWLockRelease(TwoPhaseStateLock);
+		TwoPhaseUnlockAllPartitions();
+	}
 
 	if (result == NULL)			/* should not happen */
 		elog(ERROR, "failed to find GlobalTransaction for xid %u", xid);
@@ -1235,6 +1395,23 @@ EndPrepare(GlobalTransaction gxact)
 	 */
 	XLogEnsureRecordSpace(0, records.num_chunks);
 
+	/*
+	 * Keep a copy of the state data in shared memory, so that COMMIT PREPARED
+	 * need not read it back from WAL.  We hold the entry locked, and it is
+	 * not valid yet, so nobody else can look at the copy.
+	 */
+	if (records.total_len <= TwoPhaseStateCacheSize())
+	{
+		char	   *dst = gxact->state_data;
+
+		for (record = records.head; record != NULL; record = record->next)
+		{
+			memcpy(dst, record->data, record->len);
+			dst += record->len;
+		}
+		gxact->state_len = records.total_len;
+	}
+
 	START_CRIT_SECTION();
 	MyPgXact->delayChkpt = true;
 
@@ -1514,6 +1691,48 @@ XlogReadTwoPhaseData(XLogRecPtr lsn, char **buf, int *len)
 	XLogReaderFree(xlogreader);
 }
 
+/*
+ * ReadTwoPhaseState
+ *		Read 2PC state data of a prepared transaction into a palloc'd buffer.
+ *
+ * The state data is copied from shared memory if EndPrepare could cache it
+ * there.  Otherwise it is stored in WAL files if the LSN is after the last
+ * checkpoint record, or moved to disk if for some reason it has lived for a
+ * long time.  Transactions recovered after a restart are never cached.
+ *
+ * If len is not NULL, *len is set to the length of the data without CRC.
+ */
+static char *
+ReadTwoPhaseState(GlobalTransaction gxact, int *len)
+{
+	char	   *buf;
+
+	if (gxact->state_len != 0)
+	{
+		buf = palloc(gxact->state_len);
+		memcpy(buf, gxact->state_data, gxact->state_len);
+		if (len)
+			*len = gxact->state_len;
+	}
+	else if (gxact->ondisk)
+	{
+		PGXACT	   *pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
+
+		buf = ReadTwoPhaseFile(pgxact->xid, true);
+		if (buf == NULL)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read two-phase state file for transaction %u",
+							pgxact->xid)));
+		if (len)
+			*len = ((TwoPhaseFileHeader *) buf)->total_len - sizeof(pg_crc32c);
+	}
+	else
+		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, len);
+
+	return buf;
+}
+
 
 /*
  * Confirms an xid is prepared, during recovery
@@ -1581,15 +1800,10 @@ FinishPreparedTransaction(const char *gid, bool isCommit)
 	xid = pgxact->xid;
 
 	/*
-	 * Read and validate 2PC state data. State data will typically be stored
-	 * in WAL files if the LSN is after the last checkpoint record, or moved
-	 * to disk if for some reason they have lived for a long time.
+	 * Read and validate 2PC state data. State data will typically be cached
+	 * in shared memory, see ReadTwoPhaseState.
 	 */
-	if (gxact->ondisk)
-		buf = ReadTwoPhaseFile(xid, true);
-	else
-		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, NULL);
-
+	buf = ReadTwoPhaseState(gxact, NULL);
 
 	/*
 	 * Disassemble the header area
@@ -1645,7 +1859,7 @@ FinishPreparedTransaction(const char *gid, bool isCommit)
 	 * we fail after this point.  It is still locked by our backend so it
 	 * won't go away yet.
 	 *
-	 * (We assume it's safe to do this without taking TwoPhaseStateLock.)
+	 * (We assume it's safe to do this without taking the partition lock.)
 	 */
 	gxact->valid = false;
 
@@ -1851,7 +2065,7 @@ CheckPointTwoPhase(XLogRecPtr redo_horizon)
 
 	/*
 	 * We are expecting there to be zero GXACTs that need to be copied to
-	 * disk, so we perform all I/O while holding TwoPhaseStateLock for
+	 * disk, so we perform all I/O while holding the partition locks for
 	 * simplicity. This prevents any new xacts from preparing while this
 	 * occurs, which shouldn't be a problem since the presence of long-lived
 	 * prepared xacts indicates the transaction manager isn't active.
@@ -1865,27 +2079,28 @@ CheckPointTwoPhase(XLogRecPtr redo_horizon)
 	 * prepare_end_lsn set prior to the last checkpoint yet is marked invalid,
 	 * because of the efforts with delayChkpt.
 	 */
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
-	for (i = 0; i < TwoPhaseState->numPrepXacts; i++)
+	TwoPhaseLockAllPartitions(LW_SHARED);
+	for (i = 0; i < max_prepared_xacts; i++)
 	{
-		GlobalTransaction gxact = TwoPhaseState->prepXacts[i];
+		GlobalTransaction gxact = &TwoPhaseState->allGXacts[i];
 		PGXACT	   *pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
 
-		if (gxact->valid &&
+		if (gxact->inuse &&
+			gxact->valid &&
 			!gxact->ondisk &&
 			gxact->prepare_end_lsn <= redo_horizon)
 		{
 			char	   *buf;
 			int			len;
 
-			XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, &len);
+			buf = ReadTwoPhaseState(gxact, &len);
 			RecreateTwoPhaseFile(pgxact->xid, buf, len);
 			gxact->ondisk = true;
 			pfree(buf);
 			serialized_xacts++;
 		}
 	}
-	LWLockRelease(TwoPhaseStateLock);
+	TwoPhaseUnlockAllPartitions();
 
 	TRACE_POSTGRESQL_TWOPHASE_CHECKPOINT_DONE();
 
@@ -2425,15 +2640,17 @@ int
 FinishAllPreparedTransactions(bool isCommit)
 {
 	int i, count = 0;
+	char gid[GIDSIZE];
 
-	for (i = TwoPhaseState->numPrepXacts; --i >= 0;)
+	for (i = 0; i < max_prepared_xacts; i++)
 	{
-		GlobalTransaction gxact = TwoPhaseState->prepXacts[i];
+		GlobalTransaction gxact = &TwoPhaseState->allGXacts[i];
 
-		if (gxact->valid)
+		if (gxact->inuse && gxact->valid)
 		{
-			elog(LOG, "Finish prepared transaction %s", gxact->gid);
-			FinishPreparedTransaction(gxact->gid, isCommit);
+			strlcpy(gid, gxact->gid, GIDSIZE);
+			elog(LOG, "Finish prepared transaction %s", gid);
+			FinishPreparedTransaction(gid, isCommit);
 			count++;
 		}
 	}
@@ -2453,26 +2670,34 @@ pg_rollback_prepared_xacts(PG_FUNCTION_ARGS)
 int
 GetPreparedTransactions(PreparedTransaction* pxacts)
 {
-	int			num;
+	int			num = 0;
 	int			i;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
+	TwoPhaseLockAllPartitions(LW_SHARED);
+
+	for (i = 0; i < max_prepared_xacts; i++)
+		if (TwoPhaseState->allGXacts[i].inuse)
+			num++;
 
-	num = TwoPhaseState->numPrepXacts;
 	if (num == 0)
 	{
-		LWLockRelease(TwoPhaseStateLock);
+		TwoPhaseUnlockAllPartitions();
 		*pxacts = NULL;
 		return 0;
 	}
 
 	*pxacts = (PreparedTransaction)palloc(sizeof(PreparedTransactionData) * num);
-	for (i = 0; i < num; i++) {
-		(*pxacts)[i].owner = TwoPhaseState->prepXacts[i]->owner;
-		strcpy((*pxacts)[i].gid, TwoPhaseState->prepXacts[i]->gid);
-		strcpy((*pxacts)[i].state_3pc, TwoPhaseState->prepXacts[i]->state_3pc);
+	num = 0;
+	for (i = 0; i < max_prepared_xacts; i++) {
+		GlobalTransaction gxact = &TwoPhaseState->allGXacts[i];
+		if (!gxact->inuse)
+			continue;
+		(*pxacts)[num].owner = gxact->owner;
+		strcpy((*pxacts)[num].gid, gxact->gid);
+		strcpy((*pxacts)[num].state_3pc, gxact->state_3pc);
+		num++;
 	}
-	LWLockRelease(TwoPhaseStateLock);
+	TwoPhaseUnlockAllPartitions();
 
 	return num;
 }
@@ -186,6 +186,7 @@ typedef struct TransactionStateData
 	bool		startedInRecovery;		/* did we start in recovery? */
 	bool		didLogXid;		/* has xid been included in WAL record? */
 	int			parallelModeLevel;		/* Enter/ExitParallelMode counter */
+	void	   *savepointContext;	/* transaction manager's state at start */
 	struct TransactionStateData *parent;		/* back link to parent */
 } TransactionStateData;
 
@@ -217,6 +218,7 @@ static TransactionStateData TopTransactionStateData = {
 	false,						/* startedInRecovery */
 	false,						/* didLogXid */
 	0,							/* parallelMode */
+	NULL,						/* savepoint context */
 	NULL						/* link to parent state block */
 };
 
@@ -4545,6 +4547,9 @@ CommitSubTransaction(void)
 
 	AtSubCommit_Memory();
 
+	if (TM->ReleaseSavepointContext)
+		TM->ReleaseSavepointContext(s->savepointContext);
+
 	s->state = TRANS_DEFAULT;
 
 	PopTransaction();
@@ -4719,6 +4724,9 @@ CleanupSubTransaction(void)
 
 	AtSubCleanup_Memory();
 
+	if (TM->RestoreSavepointContext)
+		TM->RestoreSavepointContext(s->savepointContext);
+
 	s->state = TRANS_DEFAULT;
 
 	PopTransaction();
@@ -4772,6 +4780,8 @@ PushTransaction(void)
 	GetUserIdAndSecContext(&s->prevUser, &s->prevSecContext);
 	s->prevXactReadOnly = XactReadOnly;
 	s->parallelModeLevel = 0;
+	if (TM->CreateSavepointContext)
+		s->savepointContext = TM->CreateSavepointContext();
 
 	CurrentTransactionState = s;
 
@@ -24,6 +24,7 @@
 #include "access/clog.h"
 #include "access/commit_ts.h"
 #include "access/multixact.h"
+#include "access/parallelredo.h"
 #include "access/rewriteheap.h"
 #include "access/subtrans.h"
 #include "access/timeline.h"
@@ -100,17 +101,19 @@ int			wal_level = WAL_LEVEL_MINIMAL;
 int			CommitDelay = 0;	/* precommit delay in microseconds */
 int			CommitSiblings = 5; /* # concurrent xacts needed to sleep */
 int			wal_retrieve_retry_interval = 5000;
+int			recovery_prefetch_distance = 0;
 
 #ifdef WAL_DEBUG
 bool		XLOG_DEBUG = false;
 #endif
 
 /*
- * Number of WAL insertion locks to use. A higher value allows more insertions
- * to happen concurrently, but adds some CPU overhead to flushing the WAL,
- * which needs to iterate all the locks.
+ * Number of WAL insertion locks to use (wal_insert_locks). A higher value
+ * allows more insertions to happen concurrently, but adds some CPU overhead
+ * to flushing the WAL, which needs to iterate all the locks.  -1 means size
+ * it by the number of CPUs, see XLOGChooseNumInsertLocks.
  */
-#define NUM_XLOGINSERT_LOCKS  8
+int			XLOGinsertLocks = -1;
 
 /*
  * Max distance from last checkpoint, before triggering a new xlog-based
@@ -772,6 +775,23 @@ static XLogSource readSource = 0;		/* XLOG_FROM_* code */
 static XLogSource currentSource = 0;	/* XLOG_FROM_* code */
 static bool lastSourceFailed = false;
 
+/*
+ * State of the recovery prefetcher, which reads the WAL ahead of replay with
+ * a reader of its own (see XLogPrefetchAhead).  prefetchEndPtr is the end of
+ * the last record it has scanned; prefetchStalled is set when it could not
+ * read any further, and makes it wait until replay has caught up with it.
+ * prefetchFile is the segment it has open, like readFile for the replay
+ * reader.
+ */
+#ifdef USE_PREFETCH
+static XLogReaderState *prefetchReader = NULL;
+static XLogRecPtr prefetchEndPtr = InvalidXLogRecPtr;
+static bool prefetchStalled = false;
+static int	prefetchFile = -1;
+static XLogSegNo prefetchSegNo = 0;
+static TimeLineID prefetchTLI = 0;
+#endif
+
 typedef struct XLogPageReadPrivate
 {
 	int			emode;
@@ -851,6 +871,14 @@ static int XLogPageRead(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
 			 TimeLineID *readTLI);
 static bool WaitForWALToBecomeAvailable(XLogRecPtr RecPtr, bool randAccess,
 							bool fetching_ckpt, XLogRecPtr tliRecPtr);
+#ifdef USE_PREFETCH
+static void XLogPrefetchAhead(XLogReaderState *replay);
+static void XLogPrefetchEnd(void);
+static int XLogPrefetchPageRead(XLogReaderState *state,
+					 XLogRecPtr targetPagePtr, int reqLen,
+					 XLogRecPtr targetRecPtr, char *readBuf,
+					 TimeLineID *readTLI);
+#endif
 static int	emode_for_corrupt_record(int emode, XLogRecPtr RecPtr);
 static void XLogFileClose(void);
 static void PreallocXlogFiles(XLogRecPtr endptr);
@@ -962,7 +990,7 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 	 * inserter acquires an insertion lock. In addition to just indicating that
 	 * an insertion is in progress, the lock tells others how far the inserter
 	 * has progressed. There is a small fixed number of insertion locks,
-	 * determined by NUM_XLOGINSERT_LOCKS. When an inserter crosses a page
+	 * determined by XLOGinsertLocks. When an inserter crosses a page
 	 * boundary, it updates the value stored in the lock to the how far it has
 	 * inserted, to allow the previous buffer to be flushed.
 	 *
@@ -1436,7 +1464,7 @@ WALInsertLockAcquire(void)
 	static int	lockToTry = -1;
 
 	if (lockToTry == -1)
-		lockToTry = MyProc->pgprocno % NUM_XLOGINSERT_LOCKS;
+		lockToTry = MyProc->pgprocno % XLOGinsertLocks;
 	MyLockNo = lockToTry;
 
 	/*
@@ -1454,7 +1482,7 @@ WALInsertLockAcquire(void)
 		 * than locks, it still helps to distribute the inserters evenly
 		 * across the locks.
 		 */
-		lockToTry = (lockToTry + 1) % NUM_XLOGINSERT_LOCKS;
+		lockToTry = (lockToTry + 1) % XLOGinsertLocks;
 	}
 }
 
@@ -1472,7 +1500,7 @@ WALInsertLockAcquireExclusive(void)
 	 * indicator is set to 0xFFFFFFFFFFFFFFFF, which is higher than any real
 	 * XLogRecPtr value, to make sure that no-one blocks waiting on those.
 	 */
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS - 1; i++)
+	for (i = 0; i < XLOGinsertLocks - 1; i++)
 	{
 		LWLockAcquire(&WALInsertLocks[i].l.lock, LW_EXCLUSIVE);
 		LWLockUpdateVar(&WALInsertLocks[i].l.lock,
@@ -1498,7 +1526,7 @@ WALInsertLockRelease(void)
 	{
 		int			i;
 
-		for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+		for (i = 0; i < XLOGinsertLocks; i++)
 			LWLockReleaseClearVar(&WALInsertLocks[i].l.lock,
 								  &WALInsertLocks[i].l.insertingAt,
 								  0);
@@ -1526,8 +1554,8 @@ WALInsertLockUpdateInsertingAt(XLogRecPtr insertingAt)
 		 * We use the last lock to mark our actual position, see comments in
 		 * WALInsertLockAcquireExclusive.
 		 */
-		LWLockUpdateVar(&WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.lock,
-					 &WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.insertingAt,
+		LWLockUpdateVar(&WALInsertLocks[XLOGinsertLocks - 1].l.lock,
+					 &WALInsertLocks[XLOGinsertLocks - 1].l.insertingAt,
 						insertingAt);
 	}
 	else
@@ -1594,7 +1622,7 @@ WaitXLogInsertionsToFinish(XLogRecPtr upto)
 	 * out for any insertion that's still in progress.
 	 */
 	finishedUpto = reservedUpto;
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < XLOGinsertLocks; i++)
 	{
 		XLogRecPtr	insertingat = InvalidXLogRecPtr;
 
@@ -2705,21 +2733,24 @@ XLogFlush(XLogRecPtr record)
 		 */
 		if (CommitDelay > 0 && enableFsync &&
 			MinimumActiveBackends(CommitSiblings))
-		{
 			pg_usleep(CommitDelay);
 
-			/*
-			 * Re-check how far we can now flush the WAL. It's generally not
-			 * safe to call WaitXLogInsertionsToFinish while holding
-			 * WALWriteLock, because an in-progress insertion might need to
-			 * also grab WALWriteLock to make progress. But we know that all
-			 * the insertions up to insertpos have already finished, because
-			 * that's what the earlier WaitXLogInsertionsToFinish() returned.
-			 * We're only calling it again to allow insertpos to be moved
-			 * further forward, not to actually wait for anyone.
-			 */
-			insertpos = WaitXLogInsertionsToFinish(insertpos);
-		}
+		/*
+		 * Re-check how far we can now flush the WAL.  If we had to wait for
+		 * the lock, other backends have likely finished inserting their
+		 * commit records while the previous flush was in progress, and are
+		 * now queued behind us; flushing their records too saves them
+		 * another fsync each.
+		 *
+		 * It's generally not safe to call WaitXLogInsertionsToFinish while
+		 * holding WALWriteLock, because an in-progress insertion might need
+		 * to also grab WALWriteLock to make progress. But we know that all
+		 * the insertions up to insertpos have already finished, because
+		 * that's what the earlier WaitXLogInsertionsToFinish() returned.
+		 * We're only calling it again to allow insertpos to be moved further
+		 * forward, not to actually wait for anyone.
+		 */
+		insertpos = WaitXLogInsertionsToFinish(insertpos);
 
 		/* try to write/flush later additions to XLOG as well */
 		WriteRqst.Write = insertpos;
@@ -4635,6 +4666,42 @@ check_wal_buffers(int *newval, void **extra, GucSource source)
 	return true;
 }
 
+/*
+ * Auto-tune the number of WAL insertion locks: one per CPU, within the range
+ * where the cost of WaitXLogInsertionsToFinish scanning all the locks stays
+ * modest.
+ */
+static int
+XLOGChooseNumInsertLocks(void)
+{
+	int			nlocks = 8;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	long		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus > nlocks)
+		nlocks = (int) Min(ncpus, 64);
+#endif
+
+	return nlocks;
+}
+
+/*
+ * GUC check_hook for wal_insert_locks
+ */
+bool
+check_wal_insert_locks(int *newval, void **extra, GucSource source)
+{
+	/*
+	 * -1 indicates a request for auto-tune.  As for wal_buffers, the boot_val
+	 * is fixed up when XLOGShmemSize is called.
+	 */
+	if (*newval == -1 && XLOGinsertLocks != -1)
+		*newval = XLOGChooseNumInsertLocks();
+
+	return true;
+}
+
 /*
  * Initialization of shared memory for XLOG
  */
@@ -4658,11 +4725,22 @@ XLOGShmemSize(void)
 	}
 	Assert(XLOGbuffers > 0);
 
+	/* Likewise resolve an auto-tuned wal_insert_locks */
+	if (XLOGinsertLocks == -1)
+	{
+		char		buf[32];
+
+		snprintf(buf, sizeof(buf), "%d", XLOGChooseNumInsertLocks());
+		SetConfigOption("wal_insert_locks", buf, PGC_POSTMASTER,
+						PGC_S_OVERRIDE);
+	}
+	Assert(XLOGinsertLocks > 0);
+
 	/* XLogCtl */
 	size = sizeof(XLogCtlData);
 
 	/* WAL insertion locks, plus alignment */
-	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), NUM_XLOGINSERT_LOCKS + 1));
+	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), XLOGinsertLocks + 1));
 	/* xlblocks array */
 	size = add_size(size, mul_size(sizeof(XLogRecPtr), XLOGbuffers));
 	/* extra alignment padding for XLOG I/O buffers */
@@ -4737,14 +4815,14 @@ XLOGShmemInit(void)
 		((uintptr_t) allocptr) %sizeof(WALInsertLockPadded);
 	WALInsertLocks = XLogCtl->Insert.WALInsertLocks =
 		(WALInsertLockPadded *) allocptr;
-	allocptr += sizeof(WALInsertLockPadded) * NUM_XLOGINSERT_LOCKS;
+	allocptr += sizeof(WALInsertLockPadded) * XLOGinsertLocks;
 
 	XLogCtl->Insert.WALInsertLockTranche.name = "wal_insert";
 	XLogCtl->Insert.WALInsertLockTranche.array_base = WALInsertLocks;
 	XLogCtl->Insert.WALInsertLockTranche.array_stride = sizeof(WALInsertLockPadded);
 
 	LWLockRegisterTranche(LWTRANCHE_WAL_INSERT, &XLogCtl->Insert.WALInsertLockTranche);
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < XLOGinsertLocks; i++)
 	{
 		LWLockInitialize(&WALInsertLocks[i].l.lock, LWTRANCHE_WAL_INSERT);
 		WALInsertLocks[i].l.insertingAt = InvalidXLogRecPtr;
@@ -6484,6 +6562,14 @@ StartupXLOG(void)
 		InRecovery = true;
 	}
 
+	/*
+	 * After a clean shutdown, reload the table statistics the checkpointer
+	 * saved.  If we have to recover, they are thrown away along with the
+	 * rest of the statistics below.
+	 */
+	if (!InRecovery)
+		pgstat_read_table_stats();
+
 	/* REDO */
 	if (InRecovery)
 	{
@@ -6759,6 +6845,9 @@ StartupXLOG(void)
 					(errmsg("redo starts at %X/%X",
 						 (uint32) (ReadRecPtr >> 32), (uint32) ReadRecPtr)));
 
+			/* In crash recovery, maybe let workers replay some records */
+			ParallelRedoStart();
+
 			/*
 			 * main redo apply loop
 			 */
@@ -6912,8 +7001,15 @@ StartupXLOG(void)
 					TransactionIdIsValid(record->xl_xid))
 					RecordKnownAssignedTransactionIds(record->xl_xid);
 
-				/* Now apply the WAL record itself */
-				RmgrTable[record->xl_rmid].rm_redo(xlogreader);
+#ifdef USE_PREFETCH
+				/* Get the blocks of upcoming records on their way */
+				if (recovery_prefetch_distance > 0)
+					XLogPrefetchAhead(xlogreader);
+#endif
+
+				/* Now apply the WAL record itself, or have a worker do it */
+				if (!ParallelRedoDispatch(xlogreader))
+					RmgrTable[record->xl_rmid].rm_redo(xlogreader);
 
 				/* Pop the error context stack */
 				error_context_stack = errcallback.previous;
@@ -6977,6 +7073,9 @@ StartupXLOG(void)
 			 * end of main redo apply loop
 			 */
 
+			/* Wait for parallel redo workers to replay everything */
+			ParallelRedoEnd();
+
 			if (reachedStopPoint)
 			{
 				if (!reachedConsistency)
@@ -7409,6 +7508,7 @@ StartupXLOG(void)
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	ShmemVariableCache->latestCompletedXid = ShmemVariableCache->nextXid;
 	TransactionIdRetreat(ShmemVariableCache->latestCompletedXid);
+	ShmemVariableCache->xactCompletionCount++;
 	LWLockRelease(ProcArrayLock);
 
 	/*
@@ -7444,6 +7544,9 @@ StartupXLOG(void)
 		readFile = -1;
 	}
 	XLogReaderFree(xlogreader);
+#ifdef USE_PREFETCH
+	XLogPrefetchEnd();
+#endif
 
 	/*
 	 * If any of the critical GUCs have changed, log them before we allow
@@ -8036,6 +8139,9 @@ ShutdownXLOG(int code, Datum arg)
 	ShutdownCommitTs();
 	ShutdownSUBTRANS();
 	ShutdownMultiXact();
+
+	/* Save the shared table statistics for the next startup */
+	pgstat_write_table_stats();
 }
 
 /*
@@ -11246,6 +11352,162 @@ next_record_is_invalid:
 		return -1;
 }
 
+#ifdef USE_PREFETCH
+/*
+ * Scan the WAL up to recovery_prefetch_distance past the record 'replay' is
+ * about to replay, and prefetch the data blocks the scanned records will
+ * read.  Called before each record is replayed.
+ *
+ * The prefetcher only borrows WAL that is already in pg_xlog, and never
+ * waits for more: whenever it cannot read the next record, whether because
+ * that WAL has not arrived yet, was restored from the archive, or is simply
+ * the end of WAL, it stalls until replay has caught up and then starts over
+ * from the replay position.  Errors in what it reads are ignored for the same
+ * reason; the replay reader will deal with them.
+ */
+static void
+XLogPrefetchAhead(XLogReaderState *replay)
+{
+	XLogRecPtr	replayEndPtr = replay->EndRecPtr;
+	XLogRecPtr	limit;
+
+	limit = replayEndPtr + (XLogRecPtr) recovery_prefetch_distance * 1024;
+
+	if (prefetchReader == NULL)
+	{
+		prefetchReader = XLogReaderAllocate(&XLogPrefetchPageRead, NULL);
+		if (!prefetchReader)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory"),
+			errdetail("Failed while allocating an XLog reading processor.")));
+	}
+
+	if (prefetchEndPtr <= replayEndPtr)
+	{
+		/*
+		 * Replay has caught up with us, or we haven't started yet. Continue
+		 * from the record after the one being replayed, which is a valid
+		 * place to start reading even if it is at a page boundary.  Forget
+		 * whatever page we had read, since it may have been incomplete.
+		 */
+		prefetchReader->ReadRecPtr = replay->ReadRecPtr;
+		prefetchReader->EndRecPtr = replayEndPtr;
+		prefetchReader->readLen = 0;
+		prefetchEndPtr = replayEndPtr;
+		prefetchStalled = false;
+	}
+	else if (prefetchStalled)
+		return;
+
+	while (prefetchEndPtr < limit)
+	{
+		XLogRecord *record;
+		char	   *errormsg;
+		int			block_id;
+
+		record = XLogReadRecord(prefetchReader, InvalidXLogRecPtr, &errormsg);
+		if (record == NULL)
+		{
+			prefetchStalled = true;
+			break;
+		}
+		prefetchEndPtr = prefetchReader->EndRecPtr;
+
+		for (block_id = 0; block_id <= prefetchReader->max_block_id; block_id++)
+		{
+			RelFileNode rnode;
+			ForkNumber	forknum;
+			BlockNumber blkno;
+
+			if (!XLogRecGetBlockTag(prefetchReader, block_id,
+									&rnode, &forknum, &blkno))
+				continue;
+
+			/* Pages restored from an image or zeroed out are never read */
+			if (XLogRecHasBlockImage(prefetchReader, block_id) ||
+				(prefetchReader->blocks[block_id].flags & BKPBLOCK_WILL_INIT))
+				continue;
+
+			PrefetchSharedBuffer(smgropen(rnode, InvalidBackendId),
+								 forknum, blkno);
+		}
+	}
+}
+
+/*
+ * Release the resources of the recovery prefetcher at the end of recovery.
+ */
+static void
+XLogPrefetchEnd(void)
+{
+	if (prefetchFile >= 0)
+		close(prefetchFile);
+	prefetchFile = -1;
+
+	if (prefetchReader != NULL)
+		XLogReaderFree(prefetchReader);
+	prefetchReader = NULL;
+}
+
+/*
+ * Read callback of the prefetcher's WAL reader.  Reads whole pages straight
+ * from the segment files in pg_xlog, and fails rather than waiting when the
+ * page is not there yet.
+ */
+static int
+XLogPrefetchPageRead(XLogReaderState *state, XLogRecPtr targetPagePtr,
+					 int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
+					 TimeLineID *readTLI)
+{
+	XLogSegNo	targetSegNo;
+	uint32		targetPageOff;
+	XLogRecPtr	segEndPtr;
+	TimeLineID	tli;
+
+	/* When streaming, don't read past what the walreceiver has flushed */
+	if (currentSource == XLOG_FROM_STREAM &&
+		targetPagePtr + reqLen > receivedUpto)
+		return -1;
+
+	XLByteToSeg(targetPagePtr, targetSegNo);
+	targetPageOff = targetPagePtr % XLogSegSize;
+
+	/*
+	 * Like XLogFileReadAnyTLI, read the segment from the newest timeline that
+	 * it belongs to, which is the one its last byte is on.
+	 */
+	XLogSegNoOffsetToRecPtr(targetSegNo + 1, 0, segEndPtr);
+	tli = tliOfPointInHistory(segEndPtr - 1, expectedTLEs);
+
+	if (prefetchFile >= 0 &&
+		(prefetchSegNo != targetSegNo || prefetchTLI != tli))
+	{
+		close(prefetchFile);
+		prefetchFile = -1;
+	}
+
+	if (prefetchFile < 0)
+	{
+		char		path[MAXPGPATH];
+
+		XLogFilePath(path, tli, targetSegNo);
+		prefetchFile = BasicOpenFile(path, O_RDONLY | PG_BINARY, 0);
+		if (prefetchFile < 0)
+			return -1;
+		prefetchSegNo = targetSegNo;
+		prefetchTLI = tli;
+	}
+
+	if (lseek(prefetchFile, (off_t) targetPageOff, SEEK_SET) < 0 ||
+		read(prefetchFile, readBuf, XLOG_BLCKSZ) != XLOG_BLCKSZ)
+		return -1;
+
+	*readTLI = tli;
+	return XLOG_BLCKSZ;
+}
+#endif   /* USE_PREFETCH */
+
 /*
  * Open the WAL segment containing WAL position 'RecPtr'.
  *
@@ -19,11 +19,13 @@
 
 #include <unistd.h>
 
+#include "access/parallelredo.h"
 #include "access/xlog.h"
 #include "access/xlog_internal.h"
 #include "access/xlogutils.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
+#include "storage/lock.h"
 #include "storage/smgr.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
@@ -438,6 +440,7 @@ XLogReadBufferExtended(RelFileNode rnode, ForkNumber forknum,
 	BlockNumber lastblock;
 	Buffer		buffer;
 	SMgrRelation smgr;
+	LOCKTAG		tag;
 
 	Assert(blkno != P_NEW);
 
@@ -473,30 +476,51 @@ XLogReadBufferExtended(RelFileNode rnode, ForkNumber forknum,
 		if (mode == RBM_NORMAL_NO_LOG)
 			return InvalidBuffer;
 		/* OK to extend the file */
-		/* we do this in recovery only - no rel-extension lock needed */
 		Assert(InRecovery);
-		buffer = InvalidBuffer;
-		do
+
+		/*
+		 * The startup process needs no rel-extension lock, but parallel redo
+		 * workers may be extending the same relation at once.  Once we have
+		 * the lock, somebody else may have extended it past our page.
+		 */
+		if (AmParallelRedoWorker)
+		{
+			SET_LOCKTAG_RELATION_EXTEND(tag, rnode.dbNode, rnode.relNode);
+			(void) LockAcquire(&tag, ExclusiveLock, false, false);
+			lastblock = smgrnblocks(smgr, forknum);
+		}
+
+		if (blkno < lastblock)
+			buffer = ReadBufferWithoutRelcache(rnode, forknum, blkno,
+											   mode, NULL);
+		else
 		{
-			if (buffer != InvalidBuffer)
+			buffer = InvalidBuffer;
+			do
+			{
+				if (buffer != InvalidBuffer)
+				{
+					if (mode == RBM_ZERO_AND_LOCK || mode == RBM_ZERO_AND_CLEANUP_LOCK)
+						LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+					ReleaseBuffer(buffer);
+				}
+				buffer = ReadBufferWithoutRelcache(rnode, forknum,
+												   P_NEW, mode, NULL);
+			}
+			while (BufferGetBlockNumber(buffer) < blkno);
+			/* Handle the corner case that P_NEW returns non-consecutive pages */
+			if (BufferGetBlockNumber(buffer) != blkno)
 			{
 				if (mode == RBM_ZERO_AND_LOCK || mode == RBM_ZERO_AND_CLEANUP_LOCK)
 					LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
 				ReleaseBuffer(buffer);
+				buffer = ReadBufferWithoutRelcache(rnode, forknum, blkno,
+												   mode, NULL);
 			}
-			buffer = ReadBufferWithoutRelcache(rnode, forknum,
-											   P_NEW, mode, NULL);
-		}
-		while (BufferGetBlockNumber(buffer) < blkno);
-		/* Handle the corner case that P_NEW returns non-consecutive pages */
-		if (BufferGetBlockNumber(buffer) != blkno)
-		{
-			if (mode == RBM_ZERO_AND_LOCK || mode == RBM_ZERO_AND_CLEANUP_LOCK)
-				LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
-			ReleaseBuffer(buffer);
-			buffer = ReadBufferWithoutRelcache(rnode, forknum, blkno,
-											   mode, NULL);
 		}
+
+		if (AmParallelRedoWorker)
+			LockRelease(&tag, ExclusiveLock, false);
 	}
 
 	if (mode == RBM_NORMAL)
@@ -507,7 +531,8 @@ XLogReadBufferExtended(RelFileNode rnode, ForkNumber forknum,
 		/*
 		 * We assume that PageIsNew is safe without a lock. During recovery,
 		 * there should be no other backends that could modify the buffer at
-		 * the same time.
+		 * the same time; even parallel redo replays all changes to one page
+		 * in one process.
 		 */
 		if (PageIsNew(page))
 		{
@@ -604,6 +629,7 @@ void
 XLogDropRelation(RelFileNode rnode, ForkNumber forknum)
 {
 	forget_invalid_pages(rnode, forknum, 0);
+	ParallelRedoForgetRelation(rnode, forknum, 0);
 }
 
 /*
@@ -623,6 +649,7 @@ XLogDropDatabase(Oid dbid)
 	smgrcloseall();
 
 	forget_invalid_pages_db(dbid);
+	ParallelRedoForgetDatabase(dbid);
 }
 
 /*
@@ -635,6 +662,7 @@ XLogTruncateRelation(RelFileNode rnode, ForkNumber forkNum,
 					 BlockNumber nblocks)
 {
 	forget_invalid_pages(rnode, forkNum, nblocks);
+	ParallelRedoForgetRelation(rnode, forkNum, nblocks);
 }
 
 /*
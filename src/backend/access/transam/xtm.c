@@ -58,22 +58,42 @@ void PgInitializeSequence(int64* init, int64* step)
 	*step = 1;
 }
 
+void *
+PgCreateSavepointContext(void)
+{
+	return NULL;
+}
+
+void
+PgRestoreSavepointContext(void *ctx)
+{
+}
+
+void
+PgReleaseSavepointContext(void *ctx)
+{
+}
+
 
 TransactionManager PgTM = {
-	PgTransactionIdGetStatus,
-	PgTransactionIdSetTreeStatus,
-	PgGetSnapshotData,
-	PgGetNewTransactionId,
-	PgGetOldestXmin,
-	PgTransactionIdIsInProgress,
-	PgGetGlobalTransactionId,
-	PgXidInMVCCSnapshot,
-	PgDetectGlobalDeadLock,
-	PgGetTransactionManagerName,
-	PgGetTransactionStateSize,
-	PgSerializeTransactionState,
-	PgDeserializeTransactionState,
-	PgInitializeSequence
+	.GetTransactionStatus = PgTransactionIdGetStatus,
+	.SetTransactionStatus = PgTransactionIdSetTreeStatus,
+	.GetSnapshot = PgGetSnapshotData,
+	.GetNewTransactionId = PgGetNewTransactionId,
+	.GetOldestXmin = PgGetOldestXmin,
+	.IsInProgress = PgTransactionIdIsInProgress,
+	.GetGlobalTransactionId = PgGetGlobalTransactionId,
+	.IsInSnapshot = PgXidInMVCCSnapshot,
+	.DetectGlobalDeadLock = PgDetectGlobalDeadLock,
+	.GetName = PgGetTransactionManagerName,
+	.GetTransactionStateSize = PgGetTransactionStateSize,
+	.SerializeTransactionState = PgSerializeTransactionState,
+	.DeserializeTransactionState = PgDeserializeTransactionState,
+	.InitializeSequence = PgInitializeSequence,
+	.IsInSnapshotBatch = PgXidInMVCCSnapshotBatch,
+	.CreateSavepointContext = PgCreateSavepointContext,
+	.RestoreSavepointContext = PgRestoreSavepointContext,
+	.ReleaseSavepointContext = PgReleaseSavepointContext
 };
 
 TransactionManager *TM = &PgTM;
@@ -76,6 +76,9 @@
 /* Potentially set by pg_upgrade_support functions */
 Oid			binary_upgrade_next_index_pg_class_oid = InvalidOid;
 
+/* GUC parameter, for access methods that can build indexes in parallel */
+int			max_parallel_index_build_workers = 2;
+
 /* state info for validate_index bulkdelete callback */
 typedef struct
 {
@@ -1246,6 +1249,7 @@ index_constraint_create(Relation heapRelation,
 		trigger->events = TRIGGER_TYPE_INSERT | TRIGGER_TYPE_UPDATE;
 		trigger->columns = NIL;
 		trigger->whenClause = NULL;
+		trigger->transitionRels = NIL;
 		trigger->isconstraint = true;
 		trigger->deferrable = true;
 		trigger->initdeferred = initdeferred;
@@ -439,6 +439,9 @@ CREATE VIEW pg_config AS
 REVOKE ALL on pg_config FROM PUBLIC;
 REVOKE EXECUTE ON FUNCTION pg_config() FROM PUBLIC;
 
+CREATE VIEW pg_backend_memory_contexts AS
+    SELECT * FROM pg_get_memory_contexts(pg_backend_pid());
+
 -- Statistics views
 
 CREATE VIEW pg_stat_all_tables AS
@@ -662,8 +665,17 @@ CREATE VIEW pg_stat_replication AS
             W.write_location,
             W.flush_location,
             W.replay_location,
+            W.write_lag,
+            W.flush_lag,
+            W.replay_lag,
             W.sync_priority,
-            W.sync_state
+            W.sync_state,
+            W.spill_txns,
+            W.spill_count,
+            W.spill_bytes,
+            W.sent_messages,
+            W.sent_bytes,
+            W.flushes
     FROM pg_stat_get_activity(NULL) AS S, pg_authid U,
             pg_stat_get_wal_senders() AS W
     WHERE S.usesysid = U.oid AND
@@ -677,6 +689,7 @@ CREATE VIEW pg_stat_wal_receiver AS
             s.receive_start_tli,
             s.received_lsn,
             s.received_tli,
+            s.written_lsn,
             s.last_msg_send_time,
             s.last_msg_receipt_time,
             s.latest_end_lsn,
@@ -734,6 +747,7 @@ CREATE VIEW pg_stat_database AS
             pg_stat_get_db_deadlocks(D.oid) AS deadlocks,
             pg_stat_get_db_blk_read_time(D.oid) AS blk_read_time,
             pg_stat_get_db_blk_write_time(D.oid) AS blk_write_time,
+            pg_stat_get_db_fastpath_overflows(D.oid) AS fastpath_overflows,
             pg_stat_get_db_stat_reset_time(D.oid) AS stats_reset
     FROM pg_database D;
 
@@ -797,6 +811,62 @@ CREATE VIEW pg_stat_bgwriter AS
         pg_stat_get_buf_alloc() AS buffers_alloc,
         pg_stat_get_bgwriter_stat_reset_time() AS stats_reset;
 
+CREATE VIEW pg_stat_lwlocks AS
+    SELECT
+        s.name,
+        s.acquires,
+        s.contended,
+        s.wait_time,
+        s.max_wait_time,
+        s.wait_histogram
+    FROM pg_stat_get_lwlocks() s;
+
+CREATE VIEW pg_stat_tablespace_io AS
+    SELECT
+        S.spcid,
+        T.spcname,
+        S.writes,
+        S.write_bytes,
+        S.write_rate,
+        S.write_iops,
+        S.delayed_writes,
+        S.delay_time,
+        S.max_write_rate,
+        S.max_write_iops
+    FROM pg_stat_get_tablespace_io() S
+        LEFT JOIN pg_tablespace T ON (T.oid = S.spcid);
+
+CREATE VIEW pg_stat_session_pool AS
+    SELECT
+        S.idle_backends,
+        S.hits,
+        S.misses,
+        S.returns,
+        S.evictions
+    FROM pg_stat_get_session_pool() S;
+
+CREATE VIEW pg_stat_serializable AS
+    SELECT
+        S.page_promotions,
+        S.relation_promotions,
+        S.doomed_failures,
+        S.pivot_write_failures,
+        S.pivot_read_failures,
+        S.summarized_failures,
+        S.prepared_pivot_failures
+    FROM pg_stat_get_serializable() S;
+
+CREATE VIEW pg_stat_autovacuum_queue AS
+    SELECT
+        S.datid,
+        D.datname,
+        S.relid,
+        S.priority,
+        S.wraparound,
+        S.pid
+    FROM pg_stat_get_autovacuum_queue() S
+        LEFT JOIN pg_database D ON (D.oid = S.datid);
+
 CREATE VIEW pg_stat_progress_vacuum AS
 	SELECT
 		S.pid AS pid, S.datid AS datid, D.datname AS datname,
@@ -815,6 +885,15 @@ CREATE VIEW pg_stat_progress_vacuum AS
     FROM pg_stat_get_progress_info('VACUUM') AS S
 		 JOIN pg_database D ON S.datid = D.oid;
 
+CREATE VIEW pg_stat_progress_copy AS
+	SELECT
+		S.pid AS pid, S.datid AS datid, D.datname AS datname,
+		S.relid AS relid,
+		S.param1 AS lines_processed, S.param2 AS tuples_inserted,
+		S.param3 AS buffer_flushes
+    FROM pg_stat_get_progress_info('COPY') AS S
+		 JOIN pg_database D ON S.datid = D.oid;
+
 CREATE VIEW pg_user_mappings AS
     SELECT
         U.oid       AS umid,
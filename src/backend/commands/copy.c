@@ -22,12 +22,15 @@
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/sysattr.h"
 #include "access/xact.h"
 #include "access/xlog.h"
+#include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
+#include "commands/progress.h"
 #include "commands/trigger.h"
 #include "executor/executor.h"
 #include "libpq/libpq.h"
@@ -37,8 +40,10 @@
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
 #include "nodes/makefuncs.h"
+#include "pgstat.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/fd.h"
+#include "storage/shm_mq.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -161,6 +166,9 @@ typedef struct CopyStateData
 	ExprState **defexprs;		/* array of default att expressions */
 	bool		volatile_defexprs;		/* is any of defexprs volatile? */
 	List	   *range_table;
+	int			nworkers;		/* PARALLEL option, 0 for a serial COPY */
+	List	   *attnamelist;	/* BeginCopyFrom arguments, passed on to */
+	List	   *options;		/* parallel workers */
 
 	/*
 	 * These variables are used to reduce overhead in textual COPY FROM.
@@ -209,6 +217,55 @@ typedef struct
 	uint64		processed;		/* # of tuples processed */
 } DR_copy;
 
+/*
+ * Parallel COPY FROM
+ *
+ * With the PARALLEL option, the leader still reads the input and splits it
+ * into lines, but hands the lines out in batches to parallel workers, which
+ * split them into fields, run the datatype input functions and send back
+ * formed heap tuples.  The leader does everything else -- defaults,
+ * constraints, index entries, triggers and the insertion itself -- since
+ * parallel workers cannot write.
+ *
+ * Batch i goes to worker i % nworkers, and the leader collects the results
+ * in the same order, so rows are still inserted in input order.  Each worker
+ * has at most one batch outstanding: its next batch is read and sent only
+ * once all tuples of the previous one have been received.  Thus a worker is
+ * always waiting for input when the leader sends to it, and neither side can
+ * block on a full queue while the other is waiting for it.
+ */
+#define PARALLEL_KEY_COPY_SHARED		UINT64CONST(0xA000000000000021)
+#define PARALLEL_KEY_COPY_QUEUES		UINT64CONST(0xA000000000000022)
+
+/* size of each leader-to-worker and worker-to-leader queue */
+#define PARALLEL_COPY_QUEUE_SIZE		65536
+
+/* a batch is closed once it holds this many lines or bytes */
+#define PARALLEL_COPY_BATCH_LINES		1000
+#define PARALLEL_COPY_BATCH_SIZE		32768
+
+/* Shared state of a parallel COPY FROM */
+typedef struct ParallelCopyShared
+{
+	Oid			relid;			/* table being loaded */
+	/* nodeToString() of BeginCopyFrom's attnamelist and options */
+	char		state[FLEXIBLE_ARRAY_MEMBER];
+} ParallelCopyShared;
+
+/* Leader's working state for a parallel COPY FROM */
+typedef struct ParallelCopyState
+{
+	ParallelContext *pcxt;
+	int			nworkers;		/* number of workers launched */
+	shm_mq_handle **inqh;		/* batches of lines, leader to worker */
+	shm_mq_handle **outqh;		/* formed tuples, worker to leader */
+	int		   *pending;		/* tuples still to come from each worker */
+	int			curworker;		/* worker we're receiving tuples from */
+	int			read_lineno;	/* cur_lineno of the reading side */
+	bool		eof;			/* seen the end of the input? */
+	StringInfoData batch;		/* workspace for assembling a batch */
+} ParallelCopyState;
+
 
 /*
  * These macros centralize code used to process line_buf and raw_buf buffers.
@@ -251,6 +308,17 @@ if (1) \
 	} \
 } else ((void) 0)
 
+/*
+ * Word-at-a-time helpers for CopyReadLineText: a word with the given byte in
+ * all positions, and a test whether any byte of a word is zero.  The test
+ * is exact, since we only ask whether there is such a byte, not where.
+ */
+#define COPY_BROADCAST_BYTE(b) \
+	(UINT64CONST(0x0101010101010101) * (uint8) (b))
+#define COPY_HAS_ZERO_BYTE(w) \
+	(((w) - UINT64CONST(0x0101010101010101)) & ~(w) & \
+	 UINT64CONST(0x8080808080808080))
+
 /*
  * Transfer any approved data to line_buf; must do this to be sure
  * there is some room in raw_buf.
@@ -299,6 +367,25 @@ static void CopyFromInsertBatch(CopyState cstate, EState *estate,
 					BulkInsertState bistate,
 					int nBufferedTuples, HeapTuple *bufferedTuples,
 					int firstBufferedLineNo);
+static void CopyFromReportProgress(CopyState cstate, uint64 inserted,
+					   int64 flushes);
+static ParallelCopyState *BeginParallelCopy(CopyState cstate,
+				  ResultRelInfo *resultRelInfo);
+static void ParallelCopySendBatch(CopyState cstate, ParallelCopyState *pcopy,
+					  int worker);
+static HeapTuple ParallelCopyNextTuple(CopyState cstate,
+					  ParallelCopyState *pcopy);
+static void ParallelCopyWorkerFailed(ParallelCopyState *pcopy);
+static void EndParallelCopy(ParallelCopyState *pcopy);
+static bool ParallelCopyProcessBatch(CopyState cstate, shm_mq_handle *outqh,
+						 char *batch, Size len, MemoryContext rowcontext,
+						 Datum *values, bool *nulls);
+static CopyState BeginCopyFromCommon(Relation rel, List *attnamelist,
+					List *options);
+static void CopyFieldsToValues(CopyState cstate, char **field_strings,
+				   int fldct, Datum *values, bool *nulls, Oid *tupleOid);
+static void CopyEvalDefaults(CopyState cstate, ExprContext *econtext,
+				 Datum *values, bool *nulls);
 static bool CopyReadLine(CopyState cstate);
 static bool CopyReadLineText(CopyState cstate);
 static int	CopyReadAttributesText(CopyState cstate);
@@ -1025,6 +1112,7 @@ ProcessCopyOptions(CopyState cstate,
 				   List *options)
 {
 	bool		format_specified = false;
+	bool		parallel_specified = false;
 	ListCell   *option;
 
 	/* Support external use for option sanity checking */
@@ -1074,6 +1162,20 @@ ProcessCopyOptions(CopyState cstate,
 						 errmsg("conflicting or redundant options")));
 			cstate->freeze = defGetBoolean(defel);
 		}
+		else if (strcmp(defel->defname, "parallel") == 0)
+		{
+			if (parallel_specified)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			parallel_specified = true;
+			cstate->nworkers = defGetInt32(defel);
+			if (cstate->nworkers < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("argument to option \"%s\" must not be negative",
+								defel->defname)));
+		}
 		else if (strcmp(defel->defname, "delimiter") == 0)
 		{
 			if (cstate->delim)
@@ -1328,6 +1430,12 @@ ProcessCopyOptions(CopyState cstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY force null only available using COPY FROM")));
 
+	/* Check parallel */
+	if (parallel_specified && !is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY parallel only available using COPY FROM")));
+
 	/* Don't allow the delimiter to appear in the null string. */
 	if (strchr(cstate->null_print, cstate->delim[0]) != NULL)
 		ereport(ERROR,
@@ -2268,10 +2376,20 @@ CopyFrom(CopyState cstate)
 	bool		useHeapMultiInsert;
 	int			nBufferedTuples = 0;
 
-#define MAX_BUFFERED_TUPLES 1000
+	/*
+	 * Tuples are buffered for heap_multi_insert() until they would fill about
+	 * COPY_BUFFER_PAGES heap pages at the table's fillfactor, so that each
+	 * call writes a good number of full pages however wide the tuples are,
+	 * or until MAX_BUFFERED_TUPLES narrow ones have piled up.
+	 */
+#define COPY_BUFFER_PAGES 16
+#define MAX_BUFFERED_TUPLES 10000
 	HeapTuple  *bufferedTuples = NULL;	/* initialize to silence warning */
 	Size		bufferedTuplesSize = 0;
+	Size		maxBufferedTuplesSize;
 	int			firstBufferedLineNo = 0;
+	int64		nFlushes = 0;
+	ParallelCopyState *pcopy;
 
 	Assert(cstate->rel);
 
@@ -2306,6 +2424,9 @@ CopyFrom(CopyState cstate)
 
 	tupDesc = RelationGetDescr(cstate->rel);
 
+	pgstat_progress_start_command(PROGRESS_COMMAND_COPY,
+								  RelationGetRelid(cstate->rel));
+
 	/*----------
 	 * Check to see if we can avoid writing WAL
 	 *
@@ -2419,6 +2540,8 @@ CopyFrom(CopyState cstate)
 		useHeapMultiInsert = true;
 		bufferedTuples = palloc(MAX_BUFFERED_TUPLES * sizeof(HeapTuple));
 	}
+	maxBufferedTuplesSize = COPY_BUFFER_PAGES *
+		RelationGetTargetPageUsage(cstate->rel, HEAP_DEFAULT_FILLFACTOR);
 
 	/* Prepare to catch AFTER triggers. */
 	AfterTriggerBeginQuery();
@@ -2437,6 +2560,13 @@ CopyFrom(CopyState cstate)
 	bistate = GetBulkInsertState();
 	econtext = GetPerTupleExprContext(estate);
 
+	/*
+	 * Hand the parsing off to parallel workers if asked to.  This must be
+	 * done before installing our error context callback, which the
+	 * context of errors rethrown from the workers would otherwise repeat.
+	 */
+	pcopy = BeginParallelCopy(cstate, resultRelInfo);
+
 	/* Set up callback to identify error line number */
 	errcallback.callback = CopyFromErrorCallback;
 	errcallback.arg = (void *) cstate;
@@ -2464,11 +2594,29 @@ CopyFrom(CopyState cstate)
 		/* Switch into its memory context */
 		MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
 
-		if (!NextCopyFrom(cstate, econtext, values, nulls, &loaded_oid))
-			break;
+		if (pcopy)
+		{
+			tuple = ParallelCopyNextTuple(cstate, pcopy);
+			if (tuple == NULL)
+				break;
 
-		/* And now we can form the input tuple. */
-		tuple = heap_form_tuple(tupDesc, values, nulls);
+			/* The workers leave the defaults to us */
+			if (cstate->num_defaults > 0)
+			{
+				loaded_oid = HeapTupleGetOid(tuple);
+				heap_deform_tuple(tuple, tupDesc, values, nulls);
+				CopyEvalDefaults(cstate, econtext, values, nulls);
+				tuple = heap_form_tuple(tupDesc, values, nulls);
+			}
+		}
+		else
+		{
+			if (!NextCopyFrom(cstate, econtext, values, nulls, &loaded_oid))
+				break;
+
+			/* And now we can form the input tuple. */
+			tuple = heap_form_tuple(tupDesc, values, nulls);
+		}
 
 		if (loaded_oid != InvalidOid)
 			HeapTupleSetOid(tuple, loaded_oid);
@@ -2512,21 +2660,22 @@ CopyFrom(CopyState cstate)
 				if (nBufferedTuples == 0)
 					firstBufferedLineNo = cstate->cur_lineno;
 				bufferedTuples[nBufferedTuples++] = tuple;
-				bufferedTuplesSize += tuple->t_len;
+				bufferedTuplesSize += MAXALIGN(tuple->t_len) + sizeof(ItemIdData);
 
 				/*
-				 * If the buffer filled up, flush it. Also flush if the total
-				 * size of all the tuples in the buffer becomes large, to
-				 * avoid using large amounts of memory for the buffers when
+				 * If the buffer filled up, flush it.  Counting its size in
+				 * page space also bounds the memory used for the buffer when
 				 * the tuples are exceptionally wide.
 				 */
 				if (nBufferedTuples == MAX_BUFFERED_TUPLES ||
-					bufferedTuplesSize > 65535)
+					bufferedTuplesSize >= maxBufferedTuplesSize)
 				{
 					CopyFromInsertBatch(cstate, estate, mycid, hi_options,
 										resultRelInfo, myslot, bistate,
 										nBufferedTuples, bufferedTuples,
 										firstBufferedLineNo);
+					CopyFromReportProgress(cstate, processed + 1,
+										   ++nFlushes);
 					nBufferedTuples = 0;
 					bufferedTuplesSize = 0;
 				}
@@ -2548,6 +2697,8 @@ CopyFrom(CopyState cstate)
 									 recheckIndexes);
 
 				list_free(recheckIndexes);
+
+				CopyFromReportProgress(cstate, processed + 1, nFlushes);
 			}
 
 			/*
@@ -2559,12 +2710,18 @@ CopyFrom(CopyState cstate)
 		}
 	}
 
+	if (pcopy)
+		EndParallelCopy(pcopy);
+
 	/* Flush any remaining buffered tuples */
 	if (nBufferedTuples > 0)
+	{
 		CopyFromInsertBatch(cstate, estate, mycid, hi_options,
 							resultRelInfo, myslot, bistate,
 							nBufferedTuples, bufferedTuples,
 							firstBufferedLineNo);
+		CopyFromReportProgress(cstate, processed, ++nFlushes);
+	}
 
 	/* Done, clean up */
 	error_context_stack = errcallback.previous;
@@ -2602,9 +2759,30 @@ CopyFrom(CopyState cstate)
 	if (hi_options & HEAP_INSERT_SKIP_WAL)
 		heap_sync(cstate->rel);
 
+	pgstat_progress_end_command();
+
 	return processed;
 }
 
+/*
+ * Advertise the progress of a COPY FROM in pg_stat_progress_copy.
+ */
+static void
+CopyFromReportProgress(CopyState cstate, uint64 inserted, int64 flushes)
+{
+	const int	index[] = {
+		PROGRESS_COPY_LINES_PROCESSED,
+		PROGRESS_COPY_TUPLES_INSERTED,
+		PROGRESS_COPY_BUFFER_FLUSHES
+	};
+	int64		val[3];
+
+	val[0] = cstate->cur_lineno;
+	val[1] = (int64) inserted;
+	val[2] = flushes;
+	pgstat_progress_update_multi_param(3, index, val);
+}
+
 /*
  * A subroutine of CopyFrom, to write the current batch of buffered heap
  * tuples to the heap. Also updates indexes and runs AFTER ROW INSERT
@@ -2684,195 +2862,517 @@ CopyFromInsertBatch(CopyState cstate, EState *estate, CommandId mycid,
 }
 
 /*
- * Setup to read tuples from a file for COPY FROM.
- *
- * 'rel': Used as a template for the tuples
- * 'filename': Name of server-local file to read
- * 'attnamelist': List of char *, columns to include. NIL selects all cols.
- * 'options': List of DefElem. See copy_opt_item in gram.y for selections.
+ * Try to start a parallel COPY FROM.
  *
- * Returns a CopyState, to be passed to NextCopyFrom and related functions.
+ * Returns NULL if the COPY has to run serially, because PARALLEL wasn't
+ * given, the COPY doesn't qualify, or no worker could be launched.
  */
-CopyState
-BeginCopyFrom(Relation rel,
-			  const char *filename,
-			  bool is_program,
-			  List *attnamelist,
-			  List *options)
+static ParallelCopyState *
+BeginParallelCopy(CopyState cstate, ResultRelInfo *resultRelInfo)
 {
-	CopyState	cstate;
-	bool		pipe = (filename == NULL);
-	TupleDesc	tupDesc;
-	Form_pg_attribute *attr;
-	AttrNumber	num_phys_attrs,
-				num_defaults;
-	FmgrInfo   *in_functions;
-	Oid		   *typioparams;
-	int			attnum;
-	Oid			in_func_oid;
-	int		   *defmap;
-	ExprState **defexprs;
-	MemoryContext oldcontext;
-	bool		volatile_defexprs;
-
-	cstate = BeginCopy(true, rel, NULL, NULL, InvalidOid, attnamelist, options);
-	oldcontext = MemoryContextSwitchTo(cstate->copycontext);
-
-	/* Initialize state variables */
-	cstate->fe_eof = false;
-	cstate->eol_type = EOL_UNKNOWN;
-	cstate->cur_relname = RelationGetRelationName(cstate->rel);
-	cstate->cur_lineno = 0;
-	cstate->cur_attname = NULL;
-	cstate->cur_attval = NULL;
-
-	/* Set up variables to avoid per-attribute overhead. */
-	initStringInfo(&cstate->attribute_buf);
-	initStringInfo(&cstate->line_buf);
-	cstate->line_buf_converted = false;
-	cstate->raw_buf = (char *) palloc(RAW_BUF_SIZE + 1);
-	cstate->raw_buf_index = cstate->raw_buf_len = 0;
+	int			nworkers = Min(cstate->nworkers, max_worker_processes);
+	ParallelCopyState *pcopy;
+	ParallelContext *pcxt;
+	ParallelCopyShared *shared;
+	char	   *state;
+	Size		statelen;
+	char	   *queuespace;
+	ListCell   *cur;
+	int			i;
 
-	tupDesc = RelationGetDescr(cstate->rel);
-	attr = tupDesc->attrs;
-	num_phys_attrs = tupDesc->natts;
-	num_defaults = 0;
-	volatile_defexprs = false;
+	if (nworkers <= 0 || cstate->binary || !IsUnderPostmaster ||
+		IsInParallelMode())
+		return NULL;
 
 	/*
-	 * Pick up the required catalog information for each attribute in the
-	 * relation, including the input function, the element type (to pass to
-	 * the input function), and info about defaults and constraints. (Which
-	 * input function we use depends on text/binary format choice.)
+	 * The workers parse ahead of the insertions, so give up on anything
+	 * that might make the parsing depend on the rows loaded so far: these
+	 * are the same cases in which CopyFrom doesn't buffer tuples for
+	 * heap_multi_insert().
 	 */
-	in_functions = (FmgrInfo *) palloc(num_phys_attrs * sizeof(FmgrInfo));
-	typioparams = (Oid *) palloc(num_phys_attrs * sizeof(Oid));
-	defmap = (int *) palloc(num_phys_attrs * sizeof(int));
-	defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
+	if ((resultRelInfo->ri_TrigDesc != NULL &&
+		 (resultRelInfo->ri_TrigDesc->trig_insert_before_row ||
+		  resultRelInfo->ri_TrigDesc->trig_insert_instead_row)) ||
+		cstate->volatile_defexprs)
+		return NULL;
 
-	for (attnum = 1; attnum <= num_phys_attrs; attnum++)
+	/* The input functions run in the workers, so they must be safe there */
+	foreach(cur, cstate->attnumlist)
 	{
-		/* We don't need info for dropped attributes */
-		if (attr[attnum - 1]->attisdropped)
-			continue;
-
-		/* Fetch the input function and typioparam info */
-		if (cstate->binary)
-			getTypeBinaryInputInfo(attr[attnum - 1]->atttypid,
-								   &in_func_oid, &typioparams[attnum - 1]);
-		else
-			getTypeInputInfo(attr[attnum - 1]->atttypid,
-							 &in_func_oid, &typioparams[attnum - 1]);
-		fmgr_info(in_func_oid, &in_functions[attnum - 1]);
+		int			m = lfirst_int(cur) - 1;
 
-		/* Get default info if needed */
-		if (!list_member_int(cstate->attnumlist, attnum))
-		{
-			/* attribute is NOT to be copied from input */
-			/* use default value if one exists */
-			Expr	   *defexpr = (Expr *) build_column_default(cstate->rel,
-																attnum);
+		if (func_parallel(cstate->in_functions[m].fn_oid) != PROPARALLEL_SAFE)
+			return NULL;
+	}
 
-			if (defexpr != NULL)
-			{
-				/* Run the expression through planner */
-				defexpr = expression_planner(defexpr);
+	EnterParallelMode();
+	pcxt = CreateParallelContextForExternalFunction("postgres",
+													"ParallelCopyMain",
+													nworkers);
+
+	state = nodeToString(list_make2(cstate->attnamelist, cstate->options));
+	statelen = strlen(state) + 1;
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   offsetof(ParallelCopyShared, state) + statelen);
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(PARALLEL_COPY_QUEUE_SIZE, 2 * nworkers));
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	shared = (ParallelCopyShared *)
+		shm_toc_allocate(pcxt->toc,
+						 offsetof(ParallelCopyShared, state) + statelen);
+	shared->relid = RelationGetRelid(cstate->rel);
+	memcpy(shared->state, state, statelen);
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_COPY_SHARED, shared);
+
+	/* Queue 2 * i feeds worker i, queue 2 * i + 1 carries back its tuples */
+	pcopy = (ParallelCopyState *) palloc0(sizeof(ParallelCopyState));
+	pcopy->inqh = (shm_mq_handle **) palloc(nworkers * sizeof(shm_mq_handle *));
+	pcopy->outqh = (shm_mq_handle **) palloc(nworkers * sizeof(shm_mq_handle *));
+	queuespace = shm_toc_allocate(pcxt->toc,
+							mul_size(PARALLEL_COPY_QUEUE_SIZE, 2 * nworkers));
+	for (i = 0; i < nworkers; i++)
+	{
+		shm_mq	   *mq;
 
-				/* Initialize executable expression in copycontext */
-				defexprs[num_defaults] = ExecInitExpr(defexpr, NULL);
-				defmap[num_defaults] = attnum - 1;
-				num_defaults++;
+		mq = shm_mq_create(queuespace + ((Size) 2 * i) * PARALLEL_COPY_QUEUE_SIZE,
+						   (Size) PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+		pcopy->inqh[i] = shm_mq_attach(mq, pcxt->seg, NULL);
 
-				/*
-				 * If a default expression looks at the table being loaded,
-				 * then it could give the wrong answer when using
-				 * multi-insert. Since database access can be dynamic this is
-				 * hard to test for exactly, so we use the much wider test of
-				 * whether the default expression is volatile. We allow for
-				 * the special case of when the default expression is the
-				 * nextval() of a sequence which in this specific case is
-				 * known to be safe for use with the multi-insert
-				 * optimisation. Hence we use this special case function
-				 * checker rather than the standard check for
-				 * contain_volatile_functions().
-				 */
-				if (!volatile_defexprs)
-					volatile_defexprs = contain_volatile_functions_not_nextval((Node *) defexpr);
-			}
-		}
+		mq = shm_mq_create(queuespace + ((Size) 2 * i + 1) * PARALLEL_COPY_QUEUE_SIZE,
+						   (Size) PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(mq, MyProc);
+		pcopy->outqh[i] = shm_mq_attach(mq, pcxt->seg, NULL);
 	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_COPY_QUEUES, queuespace);
 
-	/* We keep those variables in cstate. */
-	cstate->in_functions = in_functions;
-	cstate->typioparams = typioparams;
-	cstate->defmap = defmap;
-	cstate->defexprs = defexprs;
-	cstate->volatile_defexprs = volatile_defexprs;
-	cstate->num_defaults = num_defaults;
-	cstate->is_program = is_program;
+	LaunchParallelWorkers(pcxt);
 
-	if (pipe)
+	ereport(DEBUG1,
+			(errmsg("launched %d parallel workers to load table \"%s\" (planned: %d)",
+					pcxt->nworkers_launched,
+					RelationGetRelationName(cstate->rel), nworkers)));
+
+	if (pcxt->nworkers_launched == 0)
 	{
-		Assert(!is_program);	/* the grammar does not allow this */
-		if (whereToSendOutput == DestRemote)
-			ReceiveCopyBegin(cstate);
-		else
-			cstate->copy_file = stdin;
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
 	}
-	else
+
+	pcopy->pcxt = pcxt;
+	pcopy->nworkers = pcxt->nworkers_launched;
+	for (i = 0; i < pcopy->nworkers; i++)
 	{
-		cstate->filename = pstrdup(filename);
+		shm_mq_set_handle(pcopy->inqh[i], pcxt->worker[i].bgwhandle);
+		shm_mq_set_handle(pcopy->outqh[i], pcxt->worker[i].bgwhandle);
+	}
+	pcopy->pending = (int *) palloc0(pcopy->nworkers * sizeof(int));
+	pcopy->curworker = 0;
+	pcopy->read_lineno = cstate->cur_lineno;
+	pcopy->eof = false;
+	initStringInfo(&pcopy->batch);
 
-		if (cstate->is_program)
+	/*
+	 * The workers only ever look at the lines we send them, not at the
+	 * table or at anything else we change from here on, so we can leave
+	 * parallel mode and insert while they run.
+	 */
+	pcxt->leader_writes = true;
+	ExitParallelMode();
+
+	return pcopy;
+}
+
+/*
+ * Read the next batch of lines and send it to the given worker, which must
+ * have returned all tuples of its previous batch.
+ */
+static void
+ParallelCopySendBatch(CopyState cstate, ParallelCopyState *pcopy, int worker)
+{
+	StringInfo	batch = &pcopy->batch;
+	int			nlines = 0;
+
+	Assert(pcopy->pending[worker] == 0);
+
+	resetStringInfo(batch);
+	cstate->cur_lineno = pcopy->read_lineno;
+
+	while (!pcopy->eof &&
+		   nlines < PARALLEL_COPY_BATCH_LINES &&
+		   batch->len < PARALLEL_COPY_BATCH_SIZE)
+	{
+		bool		done;
+		int32		lineno;
+		int32		len;
+
+		/* on input just throw the header line away */
+		if (cstate->cur_lineno == 0 && cstate->header_line)
 		{
-			cstate->copy_file = OpenPipeStream(cstate->filename, PG_BINARY_R);
-			if (cstate->copy_file == NULL)
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not execute command \"%s\": %m",
-								cstate->filename)));
+			cstate->cur_lineno++;
+			if (CopyReadLine(cstate))
+			{
+				pcopy->eof = true;
+				break;
+			}
 		}
-		else
-		{
-			struct stat st;
 
-			cstate->copy_file = AllocateFile(cstate->filename, PG_BINARY_R);
-			if (cstate->copy_file == NULL)
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not open file \"%s\" for reading: %m",
-								cstate->filename)));
+		cstate->cur_lineno++;
 
-			if (fstat(fileno(cstate->copy_file), &st))
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not stat file \"%s\": %m",
-								cstate->filename)));
+		/* see NextCopyFromRawFields */
+		done = CopyReadLine(cstate);
+		if (done)
+			pcopy->eof = true;
+		if (done && cstate->line_buf.len == 0)
+			break;
 
-			if (S_ISDIR(st.st_mode))
-				ereport(ERROR,
-						(errcode(ERRCODE_WRONG_OBJECT_TYPE),
-						 errmsg("\"%s\" is a directory", cstate->filename)));
-		}
+		lineno = cstate->cur_lineno;
+		len = cstate->line_buf.len;
+		appendBinaryStringInfo(batch, (char *) &lineno, sizeof(int32));
+		appendBinaryStringInfo(batch, (char *) &len, sizeof(int32));
+		appendBinaryStringInfo(batch, cstate->line_buf.data, len);
+		nlines++;
 	}
 
-	if (!cstate->binary)
-	{
-		/* must rely on user to tell us... */
-		cstate->file_has_oids = cstate->oids;
-	}
-	else
+	pcopy->read_lineno = cstate->cur_lineno;
+	pcopy->pending[worker] = nlines;
+
+	if (nlines > 0 &&
+		shm_mq_send(pcopy->inqh[worker], batch->len, batch->data,
+					false) != SHM_MQ_SUCCESS)
+		ParallelCopyWorkerFailed(pcopy);
+}
+
+/*
+ * Get the next tuple of a parallel COPY FROM, in input order, or NULL at
+ * the end of the input.  cur_lineno is set to the tuple's input line.
+ *
+ * The tuple is palloc'd in the current memory context.
+ */
+static HeapTuple
+ParallelCopyNextTuple(CopyState cstate, ParallelCopyState *pcopy)
+{
+	int			worker;
+	Size		nbytes;
+	void	   *data;
+	int32		lineno;
+	uint32		len;
+	HeapTuple	tuple;
+
+	for (;;)
 	{
-		/* Read and verify binary header */
-		char		readSig[11];
-		int32		tmp;
+		worker = pcopy->curworker;
+		if (pcopy->pending[worker] > 0)
+			break;
 
-		/* Signature */
-		if (CopyGetData(cstate, readSig, 11, 11) != 11 ||
-			memcmp(readSig, BinarySignature, 11) != 0)
-			ereport(ERROR,
-					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-					 errmsg("COPY file signature not recognized")));
+		/*
+		 * That worker's batch is used up.  Give it the next one and move on
+		 * to the worker holding the batch after that.
+		 */
+		if (!pcopy->eof)
+			ParallelCopySendBatch(cstate, pcopy, worker);
+		else
+		{
+			int			i;
+
+			for (i = 0; i < pcopy->nworkers; i++)
+			{
+				if (pcopy->pending[i] > 0)
+					break;
+			}
+			if (i == pcopy->nworkers)
+				return NULL;
+		}
+		pcopy->curworker = (worker + 1) % pcopy->nworkers;
+	}
+
+	if (shm_mq_receive(pcopy->outqh[worker], &nbytes, &data,
+					   false) != SHM_MQ_SUCCESS)
+		ParallelCopyWorkerFailed(pcopy);
+	pcopy->pending[worker]--;
+
+	/* Each message is the line number followed by the tuple */
+	Assert(nbytes > sizeof(int32));
+	memcpy(&lineno, data, sizeof(int32));
+	len = nbytes - sizeof(int32);
+
+	tuple = (HeapTuple) palloc(HEAPTUPLESIZE + len);
+	tuple->t_len = len;
+	ItemPointerSetInvalid(&tuple->t_self);
+	tuple->t_tableOid = InvalidOid;
+	tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+	memcpy(tuple->t_data, (char *) data + sizeof(int32), len);
+
+	/* line_buf holds whatever line was read last, not this one */
+	cstate->cur_lineno = lineno;
+	cstate->line_buf_valid = false;
+
+	return tuple;
+}
+
+/*
+ * A worker detached from its queue before it was done.  Normally that's
+ * because it failed, in which case waiting for the workers to exit rethrows
+ * its error.
+ */
+static void
+ParallelCopyWorkerFailed(ParallelCopyState *pcopy)
+{
+	EndParallelCopy(pcopy);
+	elog(ERROR, "parallel COPY worker exited unexpectedly");
+}
+
+/*
+ * Shut down the workers of a parallel COPY FROM.
+ */
+static void
+EndParallelCopy(ParallelCopyState *pcopy)
+{
+	int			i;
+
+	/* Detaching tells the workers there's no more input */
+	for (i = 0; i < pcopy->nworkers; i++)
+	{
+		shm_mq_detach(shm_mq_get_queue(pcopy->inqh[i]));
+		shm_mq_detach(shm_mq_get_queue(pcopy->outqh[i]));
+	}
+
+	WaitForParallelWorkersToFinish(pcopy->pcxt);
+	DestroyParallelContext(pcopy->pcxt);
+}
+
+/*
+ * Main entry point of a parallel COPY FROM worker.
+ */
+void
+ParallelCopyMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelCopyShared *shared;
+	List	   *state;
+	char	   *queuespace;
+	shm_mq	   *mq;
+	shm_mq_handle *inqh;
+	shm_mq_handle *outqh;
+	Relation	rel;
+	CopyState	cstate;
+	TupleDesc	tupDesc;
+	Datum	   *values;
+	bool	   *nulls;
+	MemoryContext rowcontext;
+	ErrorContextCallback errcallback;
+
+	shared = (ParallelCopyShared *) shm_toc_lookup(toc,
+												PARALLEL_KEY_COPY_SHARED);
+	queuespace = shm_toc_lookup(toc, PARALLEL_KEY_COPY_QUEUES);
+	Assert(shared != NULL && queuespace != NULL);
+
+	mq = (shm_mq *) (queuespace +
+				((Size) 2 * ParallelWorkerNumber) * PARALLEL_COPY_QUEUE_SIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	inqh = shm_mq_attach(mq, seg, NULL);
+
+	mq = (shm_mq *) (queuespace +
+			((Size) 2 * ParallelWorkerNumber + 1) * PARALLEL_COPY_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+	outqh = shm_mq_attach(mq, seg, NULL);
+
+	/* The leader holds RowExclusiveLock; we're in its lock group anyway */
+	rel = heap_open(shared->relid, AccessShareLock);
+	state = (List *) stringToNode(shared->state);
+	cstate = BeginCopyFromCommon(rel, (List *) linitial(state),
+								 (List *) lsecond(state));
+
+	tupDesc = RelationGetDescr(rel);
+	values = (Datum *) palloc(tupDesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupDesc->natts * sizeof(bool));
+	rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+									   "COPY worker row",
+									   ALLOCSET_DEFAULT_SIZES);
+
+	/* Errors are reported with the line they occurred in, as usual */
+	errcallback.callback = CopyFromErrorCallback;
+	errcallback.arg = (void *) cstate;
+	errcallback.previous = error_context_stack;
+	error_context_stack = &errcallback;
+
+	/* Until the leader detaches, meaning it has no more input for us */
+	for (;;)
+	{
+		Size		nbytes;
+		void	   *data;
+
+		if (shm_mq_receive(inqh, &nbytes, &data, false) != SHM_MQ_SUCCESS)
+			break;
+		if (!ParallelCopyProcessBatch(cstate, outqh, (char *) data, nbytes,
+									  rowcontext, values, nulls))
+			break;
+	}
+
+	error_context_stack = errcallback.previous;
+
+	EndCopyFrom(cstate);
+	heap_close(rel, AccessShareLock);
+}
+
+/*
+ * Turn one batch of lines into tuples and send them to the leader.
+ *
+ * Returns false if the leader has gone away.
+ */
+static bool
+ParallelCopyProcessBatch(CopyState cstate, shm_mq_handle *outqh,
+						 char *batch, Size len, MemoryContext rowcontext,
+						 Datum *values, bool *nulls)
+{
+	TupleDesc	tupDesc = RelationGetDescr(cstate->rel);
+	char	   *ptr = batch;
+	char	   *end = batch + len;
+
+	while (ptr < end)
+	{
+		int32		lineno;
+		int32		linelen;
+		int			fldct;
+		Oid			loaded_oid = InvalidOid;
+		HeapTuple	tuple;
+		shm_mq_iovec iov[2];
+		MemoryContext oldcontext;
+		shm_mq_result res;
+
+		CHECK_FOR_INTERRUPTS();
+
+		memcpy(&lineno, ptr, sizeof(int32));
+		ptr += sizeof(int32);
+		memcpy(&linelen, ptr, sizeof(int32));
+		ptr += sizeof(int32);
+
+		/* The line is already in server encoding */
+		resetStringInfo(&cstate->line_buf);
+		appendBinaryStringInfo(&cstate->line_buf, ptr, linelen);
+		ptr += linelen;
+		cstate->line_buf_converted = true;
+		cstate->line_buf_valid = true;
+		cstate->cur_lineno = lineno;
+
+		MemoryContextReset(rowcontext);
+		oldcontext = MemoryContextSwitchTo(rowcontext);
+
+		if (cstate->csv_mode)
+			fldct = CopyReadAttributesCSV(cstate);
+		else
+			fldct = CopyReadAttributesText(cstate);
+
+		MemSet(values, 0, tupDesc->natts * sizeof(Datum));
+		MemSet(nulls, true, tupDesc->natts * sizeof(bool));
+		CopyFieldsToValues(cstate, cstate->raw_fields, fldct,
+						   values, nulls, &loaded_oid);
+
+		tuple = heap_form_tuple(tupDesc, values, nulls);
+		if (loaded_oid != InvalidOid)
+			HeapTupleSetOid(tuple, loaded_oid);
+
+		MemoryContextSwitchTo(oldcontext);
+
+		iov[0].data = (char *) &lineno;
+		iov[0].len = sizeof(int32);
+		iov[1].data = (char *) tuple->t_data;
+		iov[1].len = tuple->t_len;
+		res = shm_mq_sendv(outqh, iov, 2, false);
+		if (res != SHM_MQ_SUCCESS)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Setup to read tuples from a file for COPY FROM.
+ *
+ * 'rel': Used as a template for the tuples
+ * 'filename': Name of server-local file to read
+ * 'attnamelist': List of char *, columns to include. NIL selects all cols.
+ * 'options': List of DefElem. See copy_opt_item in gram.y for selections.
+ *
+ * Returns a CopyState, to be passed to NextCopyFrom and related functions.
+ */
+CopyState
+BeginCopyFrom(Relation rel,
+			  const char *filename,
+			  bool is_program,
+			  List *attnamelist,
+			  List *options)
+{
+	CopyState	cstate;
+	bool		pipe = (filename == NULL);
+	Oid			in_func_oid;
+	MemoryContext oldcontext;
+
+	cstate = BeginCopyFromCommon(rel, attnamelist, options);
+	oldcontext = MemoryContextSwitchTo(cstate->copycontext);
+
+	cstate->is_program = is_program;
+
+	if (pipe)
+	{
+		Assert(!is_program);	/* the grammar does not allow this */
+		if (whereToSendOutput == DestRemote)
+			ReceiveCopyBegin(cstate);
+		else
+			cstate->copy_file = stdin;
+	}
+	else
+	{
+		cstate->filename = pstrdup(filename);
+
+		if (cstate->is_program)
+		{
+			cstate->copy_file = OpenPipeStream(cstate->filename, PG_BINARY_R);
+			if (cstate->copy_file == NULL)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not execute command \"%s\": %m",
+								cstate->filename)));
+		}
+		else
+		{
+			struct stat st;
+
+			cstate->copy_file = AllocateFile(cstate->filename, PG_BINARY_R);
+			if (cstate->copy_file == NULL)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not open file \"%s\" for reading: %m",
+								cstate->filename)));
+
+			if (fstat(fileno(cstate->copy_file), &st))
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not stat file \"%s\": %m",
+								cstate->filename)));
+
+			if (S_ISDIR(st.st_mode))
+				ereport(ERROR,
+						(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						 errmsg("\"%s\" is a directory", cstate->filename)));
+		}
+	}
+
+	if (cstate->binary)
+	{
+		/* Read and verify binary header */
+		char		readSig[11];
+		int32		tmp;
+
+		/* Signature */
+		if (CopyGetData(cstate, readSig, 11, 11) != 11 ||
+			memcmp(readSig, BinarySignature, 11) != 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("COPY file signature not recognized")));
 		/* Flags field */
 		if (!CopyGetInt32(cstate, &tmp))
 			ereport(ERROR,
@@ -2907,12 +3407,140 @@ BeginCopyFrom(Relation rel,
 		fmgr_info(in_func_oid, &cstate->oid_in_function);
 	}
 
+	MemoryContextSwitchTo(oldcontext);
+
+	return cstate;
+}
+
+/*
+ * Set up the part of the COPY FROM state that doesn't depend on where the
+ * data comes from.  That is all a parallel COPY worker needs, since it gets
+ * its input lines from the leader.
+ */
+static CopyState
+BeginCopyFromCommon(Relation rel, List *attnamelist, List *options)
+{
+	CopyState	cstate;
+	TupleDesc	tupDesc;
+	Form_pg_attribute *attr;
+	AttrNumber	num_phys_attrs,
+				num_defaults;
+	FmgrInfo   *in_functions;
+	Oid		   *typioparams;
+	int			attnum;
+	Oid			in_func_oid;
+	int		   *defmap;
+	ExprState **defexprs;
+	MemoryContext oldcontext;
+	bool		volatile_defexprs;
+
+	cstate = BeginCopy(true, rel, NULL, NULL, InvalidOid, attnamelist, options);
+	oldcontext = MemoryContextSwitchTo(cstate->copycontext);
+
+	/* Initialize state variables */
+	cstate->fe_eof = false;
+	cstate->eol_type = EOL_UNKNOWN;
+	cstate->cur_relname = RelationGetRelationName(cstate->rel);
+	cstate->cur_lineno = 0;
+	cstate->cur_attname = NULL;
+	cstate->cur_attval = NULL;
+
+	/* Set up variables to avoid per-attribute overhead. */
+	initStringInfo(&cstate->attribute_buf);
+	initStringInfo(&cstate->line_buf);
+	cstate->line_buf_converted = false;
+	cstate->raw_buf = (char *) palloc(RAW_BUF_SIZE + 1);
+	cstate->raw_buf_index = cstate->raw_buf_len = 0;
+
+	tupDesc = RelationGetDescr(cstate->rel);
+	attr = tupDesc->attrs;
+	num_phys_attrs = tupDesc->natts;
+	num_defaults = 0;
+	volatile_defexprs = false;
+
+	/*
+	 * Pick up the required catalog information for each attribute in the
+	 * relation, including the input function, the element type (to pass to
+	 * the input function), and info about defaults and constraints. (Which
+	 * input function we use depends on text/binary format choice.)
+	 */
+	in_functions = (FmgrInfo *) palloc(num_phys_attrs * sizeof(FmgrInfo));
+	typioparams = (Oid *) palloc(num_phys_attrs * sizeof(Oid));
+	defmap = (int *) palloc(num_phys_attrs * sizeof(int));
+	defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
+
+	for (attnum = 1; attnum <= num_phys_attrs; attnum++)
+	{
+		/* We don't need info for dropped attributes */
+		if (attr[attnum - 1]->attisdropped)
+			continue;
+
+		/* Fetch the input function and typioparam info */
+		if (cstate->binary)
+			getTypeBinaryInputInfo(attr[attnum - 1]->atttypid,
+								   &in_func_oid, &typioparams[attnum - 1]);
+		else
+			getTypeInputInfo(attr[attnum - 1]->atttypid,
+							 &in_func_oid, &typioparams[attnum - 1]);
+		fmgr_info(in_func_oid, &in_functions[attnum - 1]);
+
+		/* Get default info if needed */
+		if (!list_member_int(cstate->attnumlist, attnum))
+		{
+			/* attribute is NOT to be copied from input */
+			/* use default value if one exists */
+			Expr	   *defexpr = (Expr *) build_column_default(cstate->rel,
+																attnum);
+
+			if (defexpr != NULL)
+			{
+				/* Run the expression through planner */
+				defexpr = expression_planner(defexpr);
+
+				/* Initialize executable expression in copycontext */
+				defexprs[num_defaults] = ExecInitExpr(defexpr, NULL);
+				defmap[num_defaults] = attnum - 1;
+				num_defaults++;
+
+				/*
+				 * If a default expression looks at the table being loaded,
+				 * then it could give the wrong answer when using
+				 * multi-insert. Since database access can be dynamic this is
+				 * hard to test for exactly, so we use the much wider test of
+				 * whether the default expression is volatile. We allow for
+				 * the special case of when the default expression is the
+				 * nextval() of a sequence which in this specific case is
+				 * known to be safe for use with the multi-insert
+				 * optimisation. Hence we use this special case function
+				 * checker rather than the standard check for
+				 * contain_volatile_functions().
+				 */
+				if (!volatile_defexprs)
+					volatile_defexprs = contain_volatile_functions_not_nextval((Node *) defexpr);
+			}
+		}
+	}
+
+	/* We keep those variables in cstate. */
+	cstate->in_functions = in_functions;
+	cstate->typioparams = typioparams;
+	cstate->defmap = defmap;
+	cstate->defexprs = defexprs;
+	cstate->volatile_defexprs = volatile_defexprs;
+	cstate->num_defaults = num_defaults;
+	cstate->attnamelist = attnamelist;
+	cstate->options = options;
+
 	/* create workspace for CopyReadAttributes results */
 	if (!cstate->binary)
 	{
 		AttrNumber	attr_count = list_length(cstate->attnumlist);
-		int			nfields = cstate->file_has_oids ? (attr_count + 1) : attr_count;
+		int			nfields;
+
+		/* must rely on user to tell us... */
+		cstate->file_has_oids = cstate->oids;
 
+		nfields = cstate->file_has_oids ? (attr_count + 1) : attr_count;
 		cstate->max_fields = nfields;
 		cstate->raw_fields = (char **) palloc(nfields * sizeof(char *));
 	}
@@ -2992,22 +3620,17 @@ NextCopyFrom(CopyState cstate, ExprContext *econtext,
 	TupleDesc	tupDesc;
 	Form_pg_attribute *attr;
 	AttrNumber	num_phys_attrs,
-				attr_count,
-				num_defaults = cstate->num_defaults;
+				attr_count;
 	FmgrInfo   *in_functions = cstate->in_functions;
 	Oid		   *typioparams = cstate->typioparams;
 	int			i;
-	int			nfields;
 	bool		isnull;
 	bool		file_has_oids = cstate->file_has_oids;
-	int		   *defmap = cstate->defmap;
-	ExprState **defexprs = cstate->defexprs;
 
 	tupDesc = RelationGetDescr(cstate->rel);
 	attr = tupDesc->attrs;
 	num_phys_attrs = tupDesc->natts;
 	attr_count = list_length(cstate->attnumlist);
-	nfields = file_has_oids ? (attr_count + 1) : attr_count;
 
 	/* Initialize all values for row to NULL */
 	MemSet(values, 0, num_phys_attrs * sizeof(Datum));
@@ -3016,108 +3639,14 @@ NextCopyFrom(CopyState cstate, ExprContext *econtext,
 	if (!cstate->binary)
 	{
 		char	  **field_strings;
-		ListCell   *cur;
 		int			fldct;
-		int			fieldno;
-		char	   *string;
 
 		/* read raw fields in the next line */
 		if (!NextCopyFromRawFields(cstate, &field_strings, &fldct))
 			return false;
 
-		/* check for overflowing fields */
-		if (nfields > 0 && fldct > nfields)
-			ereport(ERROR,
-					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-					 errmsg("extra data after last expected column")));
-
-		fieldno = 0;
-
-		/* Read the OID field if present */
-		if (file_has_oids)
-		{
-			if (fieldno >= fldct)
-				ereport(ERROR,
-						(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-						 errmsg("missing data for OID column")));
-			string = field_strings[fieldno++];
-
-			if (string == NULL)
-				ereport(ERROR,
-						(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-						 errmsg("null OID in COPY data")));
-			else if (cstate->oids && tupleOid != NULL)
-			{
-				cstate->cur_attname = "oid";
-				cstate->cur_attval = string;
-				*tupleOid = DatumGetObjectId(DirectFunctionCall1(oidin,
-												   CStringGetDatum(string)));
-				if (*tupleOid == InvalidOid)
-					ereport(ERROR,
-							(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-							 errmsg("invalid OID in COPY data")));
-				cstate->cur_attname = NULL;
-				cstate->cur_attval = NULL;
-			}
-		}
-
-		/* Loop to read the user attributes on the line. */
-		foreach(cur, cstate->attnumlist)
-		{
-			int			attnum = lfirst_int(cur);
-			int			m = attnum - 1;
-
-			if (fieldno >= fldct)
-				ereport(ERROR,
-						(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
-						 errmsg("missing data for column \"%s\"",
-								NameStr(attr[m]->attname))));
-			string = field_strings[fieldno++];
-
-			if (cstate->convert_select_flags &&
-				!cstate->convert_select_flags[m])
-			{
-				/* ignore input field, leaving column as NULL */
-				continue;
-			}
-
-			if (cstate->csv_mode)
-			{
-				if (string == NULL &&
-					cstate->force_notnull_flags[m])
-				{
-					/*
-					 * FORCE_NOT_NULL option is set and column is NULL -
-					 * convert it to the NULL string.
-					 */
-					string = cstate->null_print;
-				}
-				else if (string != NULL && cstate->force_null_flags[m]
-						 && strcmp(string, cstate->null_print) == 0)
-				{
-					/*
-					 * FORCE_NULL option is set and column matches the NULL
-					 * string. It must have been quoted, or otherwise the
-					 * string would already have been set to NULL. Convert it
-					 * to NULL as specified.
-					 */
-					string = NULL;
-				}
-			}
-
-			cstate->cur_attname = NameStr(attr[m]->attname);
-			cstate->cur_attval = string;
-			values[m] = InputFunctionCall(&in_functions[m],
-										  string,
-										  typioparams[m],
-										  attr[m]->atttypmod);
-			if (string != NULL)
-				nulls[m] = false;
-			cstate->cur_attname = NULL;
-			cstate->cur_attval = NULL;
-		}
-
-		Assert(fieldno == nfields);
+		CopyFieldsToValues(cstate, field_strings, fldct,
+						   values, nulls, tupleOid);
 	}
 	else
 	{
@@ -3207,7 +3736,139 @@ NextCopyFrom(CopyState cstate, ExprContext *econtext,
 	 * provided by the input data.  Anything not processed here or above will
 	 * remain NULL.
 	 */
-	for (i = 0; i < num_defaults; i++)
+	CopyEvalDefaults(cstate, econtext, values, nulls);
+
+	return true;
+}
+
+/*
+ * Convert the raw fields of one line of text or csv input, as returned by
+ * CopyReadAttributesText/CSV, into 'values' and 'nulls'.  Columns not read
+ * from the input are left alone.
+ */
+static void
+CopyFieldsToValues(CopyState cstate, char **field_strings, int fldct,
+				   Datum *values, bool *nulls, Oid *tupleOid)
+{
+	Form_pg_attribute *attr = RelationGetDescr(cstate->rel)->attrs;
+	AttrNumber	attr_count = list_length(cstate->attnumlist);
+	FmgrInfo   *in_functions = cstate->in_functions;
+	Oid		   *typioparams = cstate->typioparams;
+	bool		file_has_oids = cstate->file_has_oids;
+	int			nfields;
+	ListCell   *cur;
+	int			fieldno;
+	char	   *string;
+
+	nfields = file_has_oids ? (attr_count + 1) : attr_count;
+
+	/* check for overflowing fields */
+	if (nfields > 0 && fldct > nfields)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("extra data after last expected column")));
+
+	fieldno = 0;
+
+	/* Read the OID field if present */
+	if (file_has_oids)
+	{
+		if (fieldno >= fldct)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("missing data for OID column")));
+		string = field_strings[fieldno++];
+
+		if (string == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("null OID in COPY data")));
+		else if (cstate->oids && tupleOid != NULL)
+		{
+			cstate->cur_attname = "oid";
+			cstate->cur_attval = string;
+			*tupleOid = DatumGetObjectId(DirectFunctionCall1(oidin,
+											   CStringGetDatum(string)));
+			if (*tupleOid == InvalidOid)
+				ereport(ERROR,
+						(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						 errmsg("invalid OID in COPY data")));
+			cstate->cur_attname = NULL;
+			cstate->cur_attval = NULL;
+		}
+	}
+
+	/* Loop to read the user attributes on the line. */
+	foreach(cur, cstate->attnumlist)
+	{
+		int			attnum = lfirst_int(cur);
+		int			m = attnum - 1;
+
+		if (fieldno >= fldct)
+			ereport(ERROR,
+					(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+					 errmsg("missing data for column \"%s\"",
+							NameStr(attr[m]->attname))));
+		string = field_strings[fieldno++];
+
+		if (cstate->convert_select_flags &&
+			!cstate->convert_select_flags[m])
+		{
+			/* ignore input field, leaving column as NULL */
+			continue;
+		}
+
+		if (cstate->csv_mode)
+		{
+			if (string == NULL &&
+				cstate->force_notnull_flags[m])
+			{
+				/*
+				 * FORCE_NOT_NULL option is set and column is NULL -
+				 * convert it to the NULL string.
+				 */
+				string = cstate->null_print;
+			}
+			else if (string != NULL && cstate->force_null_flags[m]
+					 && strcmp(string, cstate->null_print) == 0)
+			{
+				/*
+				 * FORCE_NULL option is set and column matches the NULL
+				 * string. It must have been quoted, or otherwise the
+				 * string would already have been set to NULL. Convert it
+				 * to NULL as specified.
+				 */
+				string = NULL;
+			}
+		}
+
+		cstate->cur_attname = NameStr(attr[m]->attname);
+		cstate->cur_attval = string;
+		values[m] = InputFunctionCall(&in_functions[m],
+									  string,
+									  typioparams[m],
+									  attr[m]->atttypmod);
+		if (string != NULL)
+			nulls[m] = false;
+		cstate->cur_attname = NULL;
+		cstate->cur_attval = NULL;
+	}
+
+	Assert(fieldno == nfields);
+}
+
+/*
+ * Compute the defaults for the columns not read from the input.
+ */
+static void
+CopyEvalDefaults(CopyState cstate, ExprContext *econtext,
+				 Datum *values, bool *nulls)
+{
+	int		   *defmap = cstate->defmap;
+	ExprState **defexprs = cstate->defexprs;
+	int			i;
+
+	for (i = 0; i < cstate->num_defaults; i++)
 	{
 		/*
 		 * The caller must supply econtext and have switched into the
@@ -3219,8 +3880,6 @@ NextCopyFrom(CopyState cstate, ExprContext *econtext,
 		values[defmap[i]] = ExecEvalExpr(defexprs[i], econtext,
 										 &nulls[defmap[i]], NULL);
 	}
-
-	return true;
 }
 
 /*
@@ -3349,6 +4008,11 @@ CopyReadLineText(CopyState cstate)
 	char		quotec = '\0';
 	char		escapec = '\0';
 
+	/* quotec, escapec and high bits repeated in every byte of a word */
+	uint64		quote_bytes;
+	uint64		escape_bytes;
+	uint64		highbit_bytes;
+
 	if (cstate->csv_mode)
 	{
 		quotec = cstate->quote[0];
@@ -3358,6 +4022,11 @@ CopyReadLineText(CopyState cstate)
 			escapec = '\0';
 	}
 
+	/* for the fast skip below; outside CSV mode these just match '\0' */
+	quote_bytes = COPY_BROADCAST_BYTE(quotec);
+	escape_bytes = COPY_BROADCAST_BYTE(escapec);
+	highbit_bytes = cstate->encoding_embeds_ascii ? COPY_BROADCAST_BYTE(0x80) : 0;
+
 	mblen_str[1] = '\0';
 
 	/*
@@ -3425,6 +4094,43 @@ CopyReadLineText(CopyState cstate)
 			need_data = false;
 		}
 
+		/*
+		 * Skip over runs of bytes that can't end the line or change the CSV
+		 * state, a word at a time.  Every word is checked for all of the
+		 * interesting characters at once; any hit, including a NUL when
+		 * there is no quote or escape character, just leaves the word to the
+		 * byte-at-a-time code below.  With an encoding that embeds ASCII,
+		 * words holding non-ASCII bytes are left to it as well.
+		 */
+		if (raw_buf_ptr + (int) sizeof(uint64) <= copy_buf_len)
+		{
+			int			skip_start = raw_buf_ptr;
+
+			do
+			{
+				uint64		chunk;
+
+				memcpy(&chunk, copy_raw_buf + raw_buf_ptr, sizeof(uint64));
+				if (COPY_HAS_ZERO_BYTE(chunk ^ COPY_BROADCAST_BYTE('\n')) |
+					COPY_HAS_ZERO_BYTE(chunk ^ COPY_BROADCAST_BYTE('\r')) |
+					COPY_HAS_ZERO_BYTE(chunk ^ COPY_BROADCAST_BYTE('\\')) |
+					COPY_HAS_ZERO_BYTE(chunk ^ quote_bytes) |
+					COPY_HAS_ZERO_BYTE(chunk ^ escape_bytes) |
+					(chunk & highbit_bytes))
+					break;
+				raw_buf_ptr += sizeof(uint64);
+			} while (raw_buf_ptr + (int) sizeof(uint64) <= copy_buf_len);
+
+			if (raw_buf_ptr > skip_start)
+			{
+				/* as the byte-at-a-time code would have left things */
+				first_char_in_line = false;
+				last_was_esc = false;
+				if (raw_buf_ptr >= copy_buf_len)
+					continue;
+			}
+		}
+
 		/* OK to fetch a character */
 		prev_raw_ptr = raw_buf_ptr;
 		c = copy_raw_buf[raw_buf_ptr++];
@@ -21,6 +21,7 @@
 #include "commands/prepare.h"
 #include "executor/hashjoin.h"
 #include "foreign/fdwapi.h"
+#include "jit/jit.h"
 #include "nodes/extensible.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
@@ -80,6 +81,8 @@ static void show_sort_keys(SortState *sortstate, List *ancestors,
 			   ExplainState *es);
 static void show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 					   ExplainState *es);
+static void show_gather_merge_keys(GatherMergeState *gmstate, List *ancestors,
+					   ExplainState *es);
 static void show_agg_keys(AggState *astate, List *ancestors,
 			  ExplainState *es);
 static void show_grouping_sets(PlanState *planstate, Agg *agg,
@@ -100,6 +103,9 @@ static void show_tablesample(TableSampleClause *tsc, PlanState *planstate,
 				 List *ancestors, ExplainState *es);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_memoize_info(MemoizeState *mstate, List *ancestors,
+				  ExplainState *es);
+static void show_hashagg_info(AggState *aggstate, ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 					ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
@@ -114,7 +120,7 @@ static void ExplainModifyTarget(ModifyTable *plan, ExplainState *es);
 static void ExplainTargetRel(Plan *plan, Index rti, ExplainState *es);
 static void show_modifytable_info(ModifyTableState *mtstate, List *ancestors,
 					  ExplainState *es);
-static void ExplainMemberNodes(List *plans, PlanState **planstates,
+static void ExplainMemberNodes(PlanState **planstates, int nplans,
 				   List *ancestors, ExplainState *es);
 static void ExplainSubPlans(List *plans, List *ancestors,
 				const char *relationship, ExplainState *es);
@@ -530,6 +536,9 @@ ExplainOnePlan(PlannedStmt *plannedstmt, IntoClause *into, ExplainState *es,
 	if (es->analyze)
 		ExplainPrintTriggers(es, queryDesc);
 
+	/* Print info about JIT compilation, if any was done */
+	ExplainPrintJIT(es, queryDesc);
+
 	/*
 	 * Close down the query and free resources.  Include time for this in the
 	 * total execution time (although it should be pretty minimal).
@@ -635,6 +644,39 @@ ExplainPrintTriggers(ExplainState *es, QueryDesc *queryDesc)
 	ExplainCloseGroup("Triggers", "Triggers", false, es);
 }
 
+/*
+ * ExplainPrintJIT -
+ *	  append information about JIT compilation of the query to es->str
+ *
+ * Nothing is printed if the query wasn't JIT compiled.
+ */
+void
+ExplainPrintJIT(ExplainState *es, QueryDesc *queryDesc)
+{
+	JitContext *jit = queryDesc->estate->es_jit;
+	double		gentime;
+
+	if (jit == NULL)
+		return;
+
+	gentime = 1000.0 * INSTR_TIME_GET_DOUBLE(jit->instr.generation_counter);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoString(es->str, "JIT:\n");
+		appendStringInfo(es->str, "  Functions: %d\n",
+						 jit->instr.created_functions);
+		appendStringInfo(es->str, "  Generation time: %.3f ms\n", gentime);
+	}
+	else
+	{
+		ExplainOpenGroup("JIT", "JIT", true, es);
+		ExplainPropertyInteger("Functions", jit->instr.created_functions, es);
+		ExplainPropertyFloat("Generation Time", gentime, 3, es);
+		ExplainCloseGroup("JIT", "JIT", true, es);
+	}
+}
+
 /*
  * ExplainQueryText -
  *	  add a "Query Text" node that contains the actual text of the query
@@ -879,6 +921,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Gather:
 			pname = sname = "Gather";
 			break;
+		case T_GatherMerge:
+			pname = sname = "Gather Merge";
+			break;
 		case T_IndexScan:
 			pname = sname = "Index Scan";
 			break;
@@ -945,6 +990,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Material:
 			pname = sname = "Materialize";
 			break;
+		case T_Memoize:
+			pname = sname = "Memoize";
+			break;
 		case T_Sort:
 			pname = sname = "Sort";
 			break;
@@ -1368,6 +1416,33 @@ ExplainNode(PlanState *planstate, List *ancestors,
 					ExplainPropertyBool("Single Copy", gather->single_copy, es);
 			}
 			break;
+		case T_GatherMerge:
+			{
+				GatherMerge *gm = (GatherMerge *) plan;
+
+				show_gather_merge_keys((GatherMergeState *) planstate,
+									   ancestors, es);
+				show_scan_qual(plan->qual, "Filter", planstate, ancestors, es);
+				if (plan->qual)
+					show_instrumentation_count("Rows Removed by Filter", 1,
+											   planstate, es);
+				ExplainPropertyInteger("Workers Planned",
+									   gm->num_workers, es);
+				if (es->analyze)
+				{
+					int			nworkers;
+
+					nworkers = ((GatherMergeState *) planstate)->nworkers_launched;
+					ExplainPropertyInteger("Workers Launched",
+										   nworkers, es);
+				}
+			}
+			break;
+		case T_Append:
+			if (((AppendState *) planstate)->as_nprunedplans > 0)
+				ExplainPropertyInteger("Subplans Removed",
+							((AppendState *) planstate)->as_nprunedplans, es);
+			break;
 		case T_FunctionScan:
 			if (es->verbose)
 			{
@@ -1465,10 +1540,14 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			break;
 		case T_Agg:
 			show_agg_keys((AggState *) planstate, ancestors, es);
+			if (((AggState *) planstate)->batch != NULL)
+				ExplainPropertyText("Batch Mode", "on", es);
 			show_upper_qual(plan->qual, "Filter", planstate, ancestors, es);
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			if (es->analyze)
+				show_hashagg_info((AggState *) planstate, es);
 			break;
 		case T_Group:
 			show_group_keys((GroupState *) planstate, ancestors, es);
@@ -1500,6 +1579,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Hash:
 			show_hash_info((HashState *) planstate, es);
 			break;
+		case T_Memoize:
+			show_memoize_info((MemoizeState *) planstate, ancestors, es);
+			break;
 		default:
 			break;
 	}
@@ -1613,28 +1695,28 @@ ExplainNode(PlanState *planstate, List *ancestors,
 	switch (nodeTag(plan))
 	{
 		case T_ModifyTable:
-			ExplainMemberNodes(((ModifyTable *) plan)->plans,
-							   ((ModifyTableState *) planstate)->mt_plans,
+			ExplainMemberNodes(((ModifyTableState *) planstate)->mt_plans,
+							   list_length(((ModifyTable *) plan)->plans),
 							   ancestors, es);
 			break;
 		case T_Append:
-			ExplainMemberNodes(((Append *) plan)->appendplans,
-							   ((AppendState *) planstate)->appendplans,
+			ExplainMemberNodes(((AppendState *) planstate)->appendplans,
+							   ((AppendState *) planstate)->as_nplans,
 							   ancestors, es);
 			break;
 		case T_MergeAppend:
-			ExplainMemberNodes(((MergeAppend *) plan)->mergeplans,
-							   ((MergeAppendState *) planstate)->mergeplans,
+			ExplainMemberNodes(((MergeAppendState *) planstate)->mergeplans,
+							   list_length(((MergeAppend *) plan)->mergeplans),
 							   ancestors, es);
 			break;
 		case T_BitmapAnd:
-			ExplainMemberNodes(((BitmapAnd *) plan)->bitmapplans,
-							   ((BitmapAndState *) planstate)->bitmapplans,
+			ExplainMemberNodes(((BitmapAndState *) planstate)->bitmapplans,
+							   list_length(((BitmapAnd *) plan)->bitmapplans),
 							   ancestors, es);
 			break;
 		case T_BitmapOr:
-			ExplainMemberNodes(((BitmapOr *) plan)->bitmapplans,
-							   ((BitmapOrState *) planstate)->bitmapplans,
+			ExplainMemberNodes(((BitmapOrState *) planstate)->bitmapplans,
+							   list_length(((BitmapOr *) plan)->bitmapplans),
 							   ancestors, es);
 			break;
 		case T_SubqueryScan:
@@ -1830,6 +1912,22 @@ show_merge_append_keys(MergeAppendState *mstate, List *ancestors,
 						 ancestors, es);
 }
 
+/*
+ * Likewise, for a GatherMerge node.
+ */
+static void
+show_gather_merge_keys(GatherMergeState *gmstate, List *ancestors,
+					   ExplainState *es)
+{
+	GatherMerge *plan = (GatherMerge *) gmstate->ps.plan;
+
+	show_sort_group_keys((PlanState *) gmstate, "Sort Key",
+						 plan->numCols, plan->sortColIdx,
+						 plan->sortOperators, plan->collations,
+						 plan->nullsFirst,
+						 ancestors, es);
+}
+
 /*
  * Show the grouping keys for an Agg node.
  */
@@ -2228,6 +2326,93 @@ show_hash_info(HashState *hashstate, ExplainState *es)
 	}
 }
 
+/*
+ * Show the cache keys of a Memoize node, and if it's EXPLAIN ANALYZE, how
+ * well the cache worked
+ */
+static void
+show_memoize_info(MemoizeState *mstate, List *ancestors, ExplainState *es)
+{
+	Memoize    *plan = (Memoize *) mstate->ss.ps.plan;
+	List	   *context;
+	StringInfoData keystr;
+	const char *separator = "";
+	bool		useprefix;
+	ListCell   *lc;
+
+	/* Set up deparsing context */
+	context = set_deparse_context_planstate(es->deparse_cxt,
+											(Node *) mstate,
+											ancestors);
+	useprefix = list_length(es->rtable) > 1;
+
+	initStringInfo(&keystr);
+	foreach(lc, plan->param_exprs)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+
+		appendStringInfoString(&keystr, separator);
+		appendStringInfoString(&keystr,
+							   deparse_expression(expr, context,
+												  useprefix, false));
+		separator = ", ";
+	}
+	ExplainPropertyText("Cache Key", keystr.data, es);
+	pfree(keystr.data);
+
+	if (!es->analyze)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Cache Hits", mstate->cache_hits, es);
+		ExplainPropertyLong("Cache Misses", mstate->cache_misses, es);
+		ExplainPropertyLong("Cache Evictions", mstate->cache_evictions, es);
+		ExplainPropertyLong("Cache Overflows", mstate->cache_overflows, es);
+		ExplainPropertyLong("Peak Memory Usage",
+							(mstate->mem_peak + 1023) / 1024, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Hits: %ld  Misses: %ld  Evictions: %ld  Overflows: %ld  Memory Usage: %ldkB\n",
+						 mstate->cache_hits, mstate->cache_misses,
+						 mstate->cache_evictions, mstate->cache_overflows,
+						 (long) ((mstate->mem_peak + 1023) / 1024));
+	}
+}
+
+/*
+ * Show the batches and memory used by a hashed Agg node
+ */
+static void
+show_hashagg_info(AggState *aggstate, ExplainState *es)
+{
+	Agg		   *agg = (Agg *) aggstate->ss.ps.plan;
+	long		memPeakKb = (aggstate->hash_mem_peak + 1023) / 1024;
+	long		diskKb = (aggstate->hash_disk_used + 1023) / 1024;
+
+	if (agg->aggstrategy != AGG_HASHED || aggstate->hash_batches_used == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Hash Batches", aggstate->hash_batches_used, es);
+		ExplainPropertyLong("Peak Memory Usage", memPeakKb, es);
+		ExplainPropertyLong("Disk Usage", diskKb, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Batches: %d  Memory Usage: %ldkB",
+						 aggstate->hash_batches_used, memPeakKb);
+		if (aggstate->hash_disk_used > 0)
+			appendStringInfo(es->str, "  Disk Usage: %ldkB", diskKb);
+		appendStringInfoChar(es->str, '\n');
+	}
+}
+
 /*
  * If it's EXPLAIN ANALYZE, show exact/lossy pages for a BitmapHeapScan node
  */
@@ -2777,14 +2962,13 @@ show_modifytable_info(ModifyTableState *mtstate, List *ancestors,
  * The ancestors list should already contain the immediate parent of these
  * plans.
  *
- * Note: we don't actually need to examine the Plan list members, but
- * we need the list in order to determine the length of the PlanState array.
+ * nplans is the length of the PlanState array, which for an Append can be
+ * shorter than its list of subplans, if some were pruned at startup.
  */
 static void
-ExplainMemberNodes(List *plans, PlanState **planstates,
+ExplainMemberNodes(PlanState **planstates, int nplans,
 				   List *ancestors, ExplainState *es)
 {
-	int			nplans = list_length(plans);
 	int			j;
 
 	for (j = 0; j < nplans; j++)
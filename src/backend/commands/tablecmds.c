@@ -7484,6 +7484,8 @@ validateForeignKeyConstraint(char *conname,
 		trigdata.tg_trigger = &trig;
 		trigdata.tg_trigtuplebuf = scan->rs_cbuf;
 		trigdata.tg_newtuplebuf = InvalidBuffer;
+		trigdata.tg_oldtable = NULL;
+		trigdata.tg_newtable = NULL;
 
 		fcinfo.context = (Node *) &trigdata;
 
@@ -7529,6 +7531,7 @@ CreateFKCheckTrigger(Oid myRelOid, Oid refRelOid, Constraint *fkconstraint,
 
 	fk_trigger->columns = NIL;
 	fk_trigger->whenClause = NULL;
+	fk_trigger->transitionRels = NIL;
 	fk_trigger->isconstraint = true;
 	fk_trigger->deferrable = fkconstraint->deferrable;
 	fk_trigger->initdeferred = fkconstraint->initdeferred;
@@ -7572,6 +7575,7 @@ createForeignKeyTriggers(Relation rel, Oid refRelOid, Constraint *fkconstraint,
 	fk_trigger->events = TRIGGER_TYPE_DELETE;
 	fk_trigger->columns = NIL;
 	fk_trigger->whenClause = NULL;
+	fk_trigger->transitionRels = NIL;
 	fk_trigger->isconstraint = true;
 	fk_trigger->constrrel = NULL;
 	switch (fkconstraint->fk_del_action)
@@ -7626,6 +7630,7 @@ createForeignKeyTriggers(Relation rel, Oid refRelOid, Constraint *fkconstraint,
 	fk_trigger->events = TRIGGER_TYPE_UPDATE;
 	fk_trigger->columns = NIL;
 	fk_trigger->whenClause = NULL;
+	fk_trigger->transitionRels = NIL;
 	fk_trigger->isconstraint = true;
 	fk_trigger->constrrel = NULL;
 	switch (fkconstraint->fk_upd_action)
@@ -73,6 +73,7 @@
 #include "postmaster/bgwriter.h"
 #include "storage/fd.h"
 #include "storage/lmgr.h"
+#include "storage/smgr.h"
 #include "storage/standby.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
@@ -241,6 +242,7 @@ CreateTableSpace(CreateTableSpaceStmt *stmt)
 	char	   *location;
 	Oid			ownerId;
 	Datum		newOptions;
+	TableSpaceOpts *opts;
 
 	/* Must be super user */
 	if (!superuser())
@@ -335,7 +337,7 @@ CreateTableSpace(CreateTableSpaceStmt *stmt)
 	newOptions = transformRelOptions((Datum) 0,
 									 stmt->options,
 									 NULL, NULL, false, false);
-	(void) tablespace_reloptions(newOptions, true);
+	opts = (TableSpaceOpts *) tablespace_reloptions(newOptions, true);
 	if (newOptions != (Datum) 0)
 		values[Anum_pg_tablespace_spcoptions - 1] = newOptions;
 	else
@@ -347,6 +349,11 @@ CreateTableSpace(CreateTableSpaceStmt *stmt)
 
 	CatalogUpdateIndexes(rel, tuple);
 
+	/* Publish the write budget, see TablespaceIOSetLimits */
+	if (opts != NULL)
+		TablespaceIOSetLimits(tablespaceoid, opts->max_write_rate,
+							  opts->max_write_iops);
+
 	heap_freetuple(tuple);
 
 	/* Record dependency on owner */
@@ -514,6 +521,9 @@ DropTableSpace(DropTableSpaceStmt *stmt)
 		}
 	}
 
+	/* Stop accounting for writes to the tablespace */
+	TablespaceIOForget(tablespaceoid);
+
 	/* Record the filesystem change in XLOG */
 	{
 		xl_tblspc_drop_rec xlrec;
@@ -1000,6 +1010,7 @@ AlterTableSpaceOptions(AlterTableSpaceOptionsStmt *stmt)
 	bool		repl_null[Natts_pg_tablespace];
 	bool		repl_repl[Natts_pg_tablespace];
 	HeapTuple	newtuple;
+	TableSpaceOpts *opts;
 
 	/* Search pg_tablespace */
 	rel = heap_open(TableSpaceRelationId, RowExclusiveLock);
@@ -1029,7 +1040,7 @@ AlterTableSpaceOptions(AlterTableSpaceOptionsStmt *stmt)
 	newOptions = transformRelOptions(isnull ? (Datum) 0 : datum,
 									 stmt->options, NULL, NULL, false,
 									 stmt->isReset);
-	(void) tablespace_reloptions(newOptions, true);
+	opts = (TableSpaceOpts *) tablespace_reloptions(newOptions, true);
 
 	/* Build new tuple. */
 	memset(repl_null, false, sizeof(repl_null));
@@ -1048,6 +1059,15 @@ AlterTableSpaceOptions(AlterTableSpaceOptionsStmt *stmt)
 
 	InvokeObjectPostAlterHook(TableSpaceRelationId, HeapTupleGetOid(tup), 0);
 
+	/*
+	 * Publish the new write budget right away.  This isn't transactional; if
+	 * we roll back, the committed values are published again the next time
+	 * a backend loads the tablespace's options.
+	 */
+	TablespaceIOSetLimits(tablespaceoid,
+						  opts ? opts->max_write_rate : 0,
+						  opts ? opts->max_write_iops : 0);
+
 	heap_freetuple(newtuple);
 
 	/* Conclude heap scan. */
@@ -162,6 +162,9 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 	char		internaltrigname[NAMEDATALEN];
 	char	   *trigname;
 	Oid			constrrelid = InvalidOid;
+	char	   *oldtablename = NULL;
+	char	   *newtablename = NULL;
+	ListCell   *lc;
 	ObjectAddress myself,
 				referenced;
 
@@ -309,6 +312,78 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 					 errmsg("INSTEAD OF triggers cannot have column lists")));
 	}
 
+	/*
+	 * Transition tables are collected for AFTER ... FOR EACH STATEMENT
+	 * triggers of plain tables only.  Each one is specific to a single event,
+	 * so that the tables always hold the rows of that event.
+	 */
+	foreach(lc, stmt->transitionRels)
+	{
+		TriggerTransition *tt = (TriggerTransition *) lfirst(lc);
+
+		Assert(IsA(tt, TriggerTransition));
+
+		if (rel->rd_rel->relkind != RELKIND_RELATION)
+			ereport(ERROR,
+					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+					 errmsg("\"%s\" is not a table",
+							RelationGetRelationName(rel)),
+					 errdetail("Triggers on views and foreign tables cannot have transition tables.")));
+		if (!TRIGGER_FOR_AFTER(tgtype) || TRIGGER_FOR_ROW(tgtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("transition tables can only be specified for AFTER ... FOR EACH STATEMENT triggers")));
+		if (stmt->isconstraint)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("constraint triggers cannot have transition tables")));
+		if (TRIGGER_FOR_TRUNCATE(tgtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+					 errmsg("TRUNCATE triggers cannot have transition tables")));
+		if ((TRIGGER_FOR_INSERT(tgtype) != 0) +
+			(TRIGGER_FOR_UPDATE(tgtype) != 0) +
+			(TRIGGER_FOR_DELETE(tgtype) != 0) != 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("transition tables cannot be specified for triggers with more than one event")));
+		if (stmt->columns != NIL)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("transition tables cannot be specified for triggers with column lists")));
+
+		if (tt->isNew)
+		{
+			if (TRIGGER_FOR_DELETE(tgtype))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+						 errmsg("NEW TABLE can only be specified for an INSERT or UPDATE trigger")));
+			if (newtablename != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+						 errmsg("NEW TABLE cannot be specified multiple times")));
+			newtablename = tt->name;
+		}
+		else
+		{
+			if (TRIGGER_FOR_INSERT(tgtype))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+						 errmsg("OLD TABLE can only be specified for a DELETE or UPDATE trigger")));
+			if (oldtablename != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+						 errmsg("OLD TABLE cannot be specified multiple times")));
+			oldtablename = tt->name;
+		}
+	}
+
+	if (oldtablename != NULL && newtablename != NULL &&
+		strcmp(oldtablename, newtablename) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+				 errmsg("OLD TABLE name and NEW TABLE name cannot be the same")));
+
 	/*
 	 * Parse the WHEN clause, if any
 	 */
@@ -317,7 +392,6 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 		ParseState *pstate;
 		RangeTblEntry *rte;
 		List	   *varList;
-		ListCell   *lc;
 
 		/* Set up a pstate to parse with */
 		pstate = make_parsestate(NULL);
@@ -664,6 +738,17 @@ CreateTrigger(CreateTrigStmt *stmt, const char *queryString,
 	else
 		nulls[Anum_pg_trigger_tgqual - 1] = true;
 
+	if (oldtablename)
+		values[Anum_pg_trigger_tgoldtable - 1] = DirectFunctionCall1(namein,
+											  CStringGetDatum(oldtablename));
+	else
+		nulls[Anum_pg_trigger_tgoldtable - 1] = true;
+	if (newtablename)
+		values[Anum_pg_trigger_tgnewtable - 1] = DirectFunctionCall1(namein,
+											  CStringGetDatum(newtablename));
+	else
+		nulls[Anum_pg_trigger_tgnewtable - 1] = true;
+
 	tuple = heap_form_tuple(tgrel->rd_att, values, nulls);
 
 	/* force tuple to have the desired OID */
@@ -1590,6 +1675,18 @@ RelationBuildTriggers(Relation relation)
 			build->tgqual = TextDatumGetCString(datum);
 		else
 			build->tgqual = NULL;
+		datum = fastgetattr(htup, Anum_pg_trigger_tgoldtable,
+							tgrel->rd_att, &isnull);
+		if (!isnull)
+			build->tgoldtable = pstrdup(NameStr(*DatumGetName(datum)));
+		else
+			build->tgoldtable = NULL;
+		datum = fastgetattr(htup, Anum_pg_trigger_tgnewtable,
+							tgrel->rd_att, &isnull);
+		if (!isnull)
+			build->tgnewtable = pstrdup(NameStr(*DatumGetName(datum)));
+		else
+			build->tgnewtable = NULL;
 
 		numtrigs++;
 	}
@@ -1680,6 +1777,15 @@ SetTriggerFlags(TriggerDesc *trigdesc, Trigger *trigger)
 	trigdesc->trig_truncate_after_statement |=
 		TRIGGER_TYPE_MATCHES(tgtype, TRIGGER_TYPE_STATEMENT,
 							 TRIGGER_TYPE_AFTER, TRIGGER_TYPE_TRUNCATE);
+
+	trigdesc->trig_insert_new_table |=
+		(TRIGGER_FOR_INSERT(tgtype) && trigger->tgnewtable != NULL);
+	trigdesc->trig_update_old_table |=
+		(TRIGGER_FOR_UPDATE(tgtype) && trigger->tgoldtable != NULL);
+	trigdesc->trig_update_new_table |=
+		(TRIGGER_FOR_UPDATE(tgtype) && trigger->tgnewtable != NULL);
+	trigdesc->trig_delete_old_table |=
+		(TRIGGER_FOR_DELETE(tgtype) && trigger->tgoldtable != NULL);
 }
 
 /*
@@ -1729,6 +1835,10 @@ CopyTriggerDesc(TriggerDesc *trigdesc)
 		}
 		if (trigger->tgqual)
 			trigger->tgqual = pstrdup(trigger->tgqual);
+		if (trigger->tgoldtable)
+			trigger->tgoldtable = pstrdup(trigger->tgoldtable);
+		if (trigger->tgnewtable)
+			trigger->tgnewtable = pstrdup(trigger->tgnewtable);
 		trigger++;
 	}
 
@@ -1761,6 +1871,10 @@ FreeTriggerDesc(TriggerDesc *trigdesc)
 		}
 		if (trigger->tgqual)
 			pfree(trigger->tgqual);
+		if (trigger->tgoldtable)
+			pfree(trigger->tgoldtable);
+		if (trigger->tgnewtable)
+			pfree(trigger->tgnewtable);
 		trigger++;
 	}
 	pfree(trigdesc->triggers);
@@ -1839,6 +1953,18 @@ equalTriggerDescs(TriggerDesc *trigdesc1, TriggerDesc *trigdesc2)
 				return false;
 			else if (strcmp(trig1->tgqual, trig2->tgqual) != 0)
 				return false;
+			if (trig1->tgoldtable == NULL && trig2->tgoldtable == NULL)
+				 /* ok */ ;
+			else if (trig1->tgoldtable == NULL || trig2->tgoldtable == NULL)
+				return false;
+			else if (strcmp(trig1->tgoldtable, trig2->tgoldtable) != 0)
+				return false;
+			if (trig1->tgnewtable == NULL && trig2->tgnewtable == NULL)
+				 /* ok */ ;
+			else if (trig1->tgnewtable == NULL || trig2->tgnewtable == NULL)
+				return false;
+			else if (strcmp(trig1->tgnewtable, trig2->tgnewtable) != 0)
+				return false;
 		}
 	}
 	else if (trigdesc2 != NULL)
@@ -1958,6 +2084,8 @@ ExecBSInsertTriggers(EState *estate, ResultRelInfo *relinfo)
 	LocTriggerData.tg_event = TRIGGER_EVENT_INSERT |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_trigtuple = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_trigtuplebuf = InvalidBuffer;
@@ -2016,6 +2144,8 @@ ExecBRInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_newtuplebuf = InvalidBuffer;
 	for (i = 0; i < trigdesc->numtriggers; i++)
@@ -2070,7 +2200,8 @@ ExecARInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_insert_after_row)
+	if (trigdesc &&
+		(trigdesc->trig_insert_after_row || trigdesc->trig_insert_new_table))
 		AfterTriggerSaveEvent(estate, relinfo, TRIGGER_EVENT_INSERT,
 							  true, NULL, trigtuple, recheckIndexes, NULL);
 }
@@ -2091,6 +2222,8 @@ ExecIRInsertTriggers(EState *estate, ResultRelInfo *relinfo,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_newtuplebuf = InvalidBuffer;
 	for (i = 0; i < trigdesc->numtriggers; i++)
@@ -2157,6 +2290,8 @@ ExecBSDeleteTriggers(EState *estate, ResultRelInfo *relinfo)
 	LocTriggerData.tg_event = TRIGGER_EVENT_DELETE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_trigtuple = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_trigtuplebuf = InvalidBuffer;
@@ -2229,6 +2364,8 @@ ExecBRDeleteTriggers(EState *estate, EPQState *epqstate,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_newtuplebuf = InvalidBuffer;
 	for (i = 0; i < trigdesc->numtriggers; i++)
@@ -2273,7 +2410,8 @@ ExecARDeleteTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_delete_after_row)
+	if (trigdesc &&
+		(trigdesc->trig_delete_after_row || trigdesc->trig_delete_old_table))
 	{
 		HeapTuple	trigtuple;
 
@@ -2309,6 +2447,8 @@ ExecIRDeleteTriggers(EState *estate, ResultRelInfo *relinfo,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_newtuplebuf = InvalidBuffer;
 	for (i = 0; i < trigdesc->numtriggers; i++)
@@ -2361,6 +2501,8 @@ ExecBSUpdateTriggers(EState *estate, ResultRelInfo *relinfo)
 	LocTriggerData.tg_event = TRIGGER_EVENT_UPDATE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_trigtuple = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_trigtuplebuf = InvalidBuffer;
@@ -2464,6 +2606,8 @@ ExecBRUpdateTriggers(EState *estate, EPQState *epqstate,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	updatedCols = GetUpdatedColumns(relinfo, estate);
 	for (i = 0; i < trigdesc->numtriggers; i++)
 	{
@@ -2528,7 +2672,8 @@ ExecARUpdateTriggers(EState *estate, ResultRelInfo *relinfo,
 {
 	TriggerDesc *trigdesc = relinfo->ri_TrigDesc;
 
-	if (trigdesc && trigdesc->trig_update_after_row)
+	if (trigdesc && (trigdesc->trig_update_after_row ||
+			trigdesc->trig_update_old_table || trigdesc->trig_update_new_table))
 	{
 		HeapTuple	trigtuple;
 
@@ -2567,6 +2712,8 @@ ExecIRUpdateTriggers(EState *estate, ResultRelInfo *relinfo,
 		TRIGGER_EVENT_ROW |
 		TRIGGER_EVENT_INSTEAD;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	for (i = 0; i < trigdesc->numtriggers; i++)
 	{
 		Trigger    *trigger = &trigdesc->triggers[i];
@@ -2633,6 +2780,8 @@ ExecBSTruncateTriggers(EState *estate, ResultRelInfo *relinfo)
 	LocTriggerData.tg_event = TRIGGER_EVENT_TRUNCATE |
 		TRIGGER_EVENT_BEFORE;
 	LocTriggerData.tg_relation = relinfo->ri_RelationDesc;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 	LocTriggerData.tg_trigtuple = NULL;
 	LocTriggerData.tg_newtuple = NULL;
 	LocTriggerData.tg_trigtuplebuf = InvalidBuffer;
@@ -3163,8 +3312,12 @@ typedef struct AfterTriggerEventList
  * fdw_tuplestores[query_depth] is a tuplestore containing the foreign tuples
  * needed for the current query.
  *
- * maxquerydepth is just the allocated length of query_stack and
- * fdw_tuplestores.
+ * transition_tables[query_depth] is a list of AfterTriggersTransitionTables,
+ * holding the rows the current query inserted, updated or deleted in tables
+ * whose statement-level triggers want them as transition tables.
+ *
+ * maxquerydepth is just the allocated length of query_stack, fdw_tuplestores
+ * and transition_tables.
  *
  * state_stack is a stack of pointers to saved copies of the SET CONSTRAINTS
  * state data; each subtransaction level that modifies that state first
@@ -3194,7 +3347,8 @@ typedef struct AfterTriggersData
 	int			query_depth;	/* current query list index */
 	AfterTriggerEventList *query_stack; /* events pending from each query */
 	Tuplestorestate **fdw_tuplestores;	/* foreign tuples from each query */
-	int			maxquerydepth;	/* allocated len of above array */
+	List	  **transition_tables;	/* transition tables of each query */
+	int			maxquerydepth;	/* allocated len of above arrays */
 	MemoryContext event_cxt;	/* memory context for events, if any */
 
 	/* these fields are just for resetting at subtrans abort: */
@@ -3208,6 +3362,24 @@ typedef struct AfterTriggersData
 
 static AfterTriggersData afterTriggers;
 
+/*
+ * Transition tables of one table and event (INSERT, UPDATE or DELETE),
+ * collected by one query.  A tuplestore is NULL until some trigger needs it.
+ */
+typedef struct AfterTriggersTransitionTables
+{
+	Oid			relid;			/* table the rows belong to */
+	TriggerEvent event;			/* TRIGGER_EVENT_INSERT/UPDATE/DELETE */
+	Tuplestorestate *old_tuplestore;	/* OLD TABLE rows */
+	Tuplestorestate *new_tuplestore;	/* NEW TABLE rows */
+} AfterTriggersTransitionTables;
+
+/*
+ * The innermost statement-level trigger being fired that has transition
+ * tables, for trigger_transition_table().
+ */
+static TriggerData *TransitionTriggerData = NULL;
+
 static void AfterTriggerExecute(AfterTriggerEvent event,
 					Relation rel, TriggerDesc *trigdesc,
 					FmgrInfo *finfo,
@@ -3215,12 +3387,49 @@ static void AfterTriggerExecute(AfterTriggerEvent event,
 					MemoryContext per_tuple_context,
 					TupleTableSlot *trig_tuple_slot1,
 					TupleTableSlot *trig_tuple_slot2);
+static AfterTriggersTransitionTables *GetTransitionTables(Oid relid,
+					TriggerEvent event, bool need_old, bool need_new);
+static void ReleaseTransitionTables(int query_depth);
 static SetConstraintState SetConstraintStateCreate(int numalloc);
 static SetConstraintState SetConstraintStateCopy(SetConstraintState state);
 static SetConstraintState SetConstraintStateAddItem(SetConstraintState state,
 						  Oid tgoid, bool tgisdeferred);
 
 
+/*
+ * Creates a tuplestore for the current query's AFTER trigger events
+ */
+static Tuplestorestate *
+MakeAfterTriggerTuplestore(void)
+{
+	Tuplestorestate *ret;
+	MemoryContext oldcxt;
+	ResourceOwner saveResourceOwner;
+
+	/*
+	 * Make the tuplestore valid until end of transaction.  This is the
+	 * allocation lifespan of the associated events list, but we really only
+	 * need it until AfterTriggerEndQuery().
+	 */
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	saveResourceOwner = CurrentResourceOwner;
+	PG_TRY();
+	{
+		CurrentResourceOwner = TopTransactionResourceOwner;
+		ret = tuplestore_begin_heap(false, false, work_mem);
+	}
+	PG_CATCH();
+	{
+		CurrentResourceOwner = saveResourceOwner;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	CurrentResourceOwner = saveResourceOwner;
+	MemoryContextSwitchTo(oldcxt);
+
+	return ret;
+}
+
 /*
  * Gets the current query fdw tuplestore and initializes it if necessary
  */
@@ -3231,35 +3440,72 @@ GetCurrentFDWTuplestore(void)
 
 	ret = afterTriggers.fdw_tuplestores[afterTriggers.query_depth];
 	if (ret == NULL)
+	{
+		ret = MakeAfterTriggerTuplestore();
+		afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = ret;
+	}
+
+	return ret;
+}
+
+/*
+ * Gets the current query's transition tables of the given table and event,
+ * creating the entry and the requested tuplestores if necessary
+ */
+static AfterTriggersTransitionTables *
+GetTransitionTables(Oid relid, TriggerEvent event, bool need_old, bool need_new)
+{
+	AfterTriggersTransitionTables *tables = NULL;
+	ListCell   *lc;
+
+	foreach(lc, afterTriggers.transition_tables[afterTriggers.query_depth])
+	{
+		tables = (AfterTriggersTransitionTables *) lfirst(lc);
+		if (tables->relid == relid && tables->event == event)
+			break;
+		tables = NULL;
+	}
+	if (tables == NULL)
 	{
 		MemoryContext oldcxt;
-		ResourceOwner saveResourceOwner;
 
-		/*
-		 * Make the tuplestore valid until end of transaction.  This is the
-		 * allocation lifespan of the associated events list, but we really
-		 * only need it until AfterTriggerEndQuery().
-		 */
 		oldcxt = MemoryContextSwitchTo(TopTransactionContext);
-		saveResourceOwner = CurrentResourceOwner;
-		PG_TRY();
-		{
-			CurrentResourceOwner = TopTransactionResourceOwner;
-			ret = tuplestore_begin_heap(false, false, work_mem);
-		}
-		PG_CATCH();
-		{
-			CurrentResourceOwner = saveResourceOwner;
-			PG_RE_THROW();
-		}
-		PG_END_TRY();
-		CurrentResourceOwner = saveResourceOwner;
+		tables = (AfterTriggersTransitionTables *)
+			palloc0(sizeof(AfterTriggersTransitionTables));
+		tables->relid = relid;
+		tables->event = event;
+		afterTriggers.transition_tables[afterTriggers.query_depth] =
+			lappend(afterTriggers.transition_tables[afterTriggers.query_depth],
+					tables);
 		MemoryContextSwitchTo(oldcxt);
-
-		afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = ret;
 	}
+	if (need_old && tables->old_tuplestore == NULL)
+		tables->old_tuplestore = MakeAfterTriggerTuplestore();
+	if (need_new && tables->new_tuplestore == NULL)
+		tables->new_tuplestore = MakeAfterTriggerTuplestore();
 
-	return ret;
+	return tables;
+}
+
+/*
+ * Releases the transition tables collected by a query
+ */
+static void
+ReleaseTransitionTables(int query_depth)
+{
+	ListCell   *lc;
+
+	foreach(lc, afterTriggers.transition_tables[query_depth])
+	{
+		AfterTriggersTransitionTables *tables = lfirst(lc);
+
+		if (tables->old_tuplestore)
+			tuplestore_end(tables->old_tuplestore);
+		if (tables->new_tuplestore)
+			tuplestore_end(tables->new_tuplestore);
+	}
+	list_free_deep(afterTriggers.transition_tables[query_depth]);
+	afterTriggers.transition_tables[query_depth] = NIL;
 }
 
 /* ----------
@@ -3555,6 +3801,14 @@ AfterTriggerExecute(AfterTriggerEvent event,
 	if (LocTriggerData.tg_trigger == NULL)
 		elog(ERROR, "could not find trigger %u", tgoid);
 
+	/*
+	 * Foreign key checks may have been put off to be done in a batch; do
+	 * them before firing any other kind of trigger, which could depend on
+	 * them.
+	 */
+	if (RI_FKey_trigger_type(LocTriggerData.tg_trigger->tgfoid) != RI_TRIGGER_FK)
+		RI_FKey_check_flush();
+
 	/*
 	 * If doing EXPLAIN ANALYZE, start charging time to this trigger. We want
 	 * to include time spent re-fetching tuples in the trigger cost.
@@ -3645,18 +3899,71 @@ AfterTriggerExecute(AfterTriggerEvent event,
 	LocTriggerData.tg_event =
 		evtshared->ats_event & (TRIGGER_EVENT_OPMASK | TRIGGER_EVENT_ROW);
 	LocTriggerData.tg_relation = rel;
+	LocTriggerData.tg_oldtable = NULL;
+	LocTriggerData.tg_newtable = NULL;
 
 	MemoryContextReset(per_tuple_context);
 
+	/*
+	 * A statement-level trigger with transition tables gets the rows its
+	 * query collected, from the beginning, even if the statement changed no
+	 * rows at all.  Statement-level triggers are never deferred, so they fire
+	 * at the end of the query that collected the rows.
+	 */
+	if (!TRIGGER_FIRED_FOR_ROW(LocTriggerData.tg_event) &&
+		(LocTriggerData.tg_trigger->tgoldtable != NULL ||
+		 LocTriggerData.tg_trigger->tgnewtable != NULL) &&
+		afterTriggers.query_depth >= 0)
+	{
+		AfterTriggersTransitionTables *tables;
+
+		if (afterTriggers.query_depth >= afterTriggers.maxquerydepth)
+			AfterTriggerEnlargeQueryState();
+		tables = GetTransitionTables(RelationGetRelid(rel),
+							LocTriggerData.tg_event & TRIGGER_EVENT_OPMASK,
+							  LocTriggerData.tg_trigger->tgoldtable != NULL,
+							 LocTriggerData.tg_trigger->tgnewtable != NULL);
+		LocTriggerData.tg_oldtable = tables->old_tuplestore;
+		LocTriggerData.tg_newtable = tables->new_tuplestore;
+		if (LocTriggerData.tg_oldtable)
+			tuplestore_rescan(LocTriggerData.tg_oldtable);
+		if (LocTriggerData.tg_newtable)
+			tuplestore_rescan(LocTriggerData.tg_newtable);
+	}
+
 	/*
 	 * Call the trigger and throw away any possibly returned updated tuple.
-	 * (Don't let ExecCallTriggerFunc measure EXPLAIN time.)
+	 * (Don't let ExecCallTriggerFunc measure EXPLAIN time.)  While a trigger
+	 * with transition tables runs, trigger_transition_table() reads them.
 	 */
-	rettuple = ExecCallTriggerFunc(&LocTriggerData,
-								   tgindx,
-								   finfo,
-								   NULL,
-								   per_tuple_context);
+	if (LocTriggerData.tg_oldtable != NULL ||
+		LocTriggerData.tg_newtable != NULL)
+	{
+		TriggerData *saveTransitionTriggerData = TransitionTriggerData;
+
+		TransitionTriggerData = &LocTriggerData;
+		PG_TRY();
+		{
+			rettuple = ExecCallTriggerFunc(&LocTriggerData,
+										   tgindx,
+										   finfo,
+										   NULL,
+										   per_tuple_context);
+		}
+		PG_CATCH();
+		{
+			TransitionTriggerData = saveTransitionTriggerData;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		TransitionTriggerData = saveTransitionTriggerData;
+	}
+	else
+		rettuple = ExecCallTriggerFunc(&LocTriggerData,
+									   tgindx,
+									   finfo,
+									   NULL,
+									   per_tuple_context);
 	if (rettuple != NULL &&
 		rettuple != LocTriggerData.tg_trigtuple &&
 		rettuple != LocTriggerData.tg_newtuple)
@@ -3875,6 +4182,10 @@ afterTriggerInvokeEvents(AfterTriggerEventList *events,
 				events->tailfree = chunk->freeptr;
 		}
 	}
+
+	/* Finish the foreign key checks, while the relations are still open */
+	RI_FKey_check_flush();
+
 	if (slot1 != NULL)
 	{
 		ExecDropSingleTupleTableSlot(slot1);
@@ -3927,6 +4238,7 @@ AfterTriggerBeginXact(void)
 	Assert(afterTriggers.state == NULL);
 	Assert(afterTriggers.query_stack == NULL);
 	Assert(afterTriggers.fdw_tuplestores == NULL);
+	Assert(afterTriggers.transition_tables == NULL);
 	Assert(afterTriggers.maxquerydepth == 0);
 	Assert(afterTriggers.event_cxt == NULL);
 	Assert(afterTriggers.events.head == NULL);
@@ -4051,6 +4363,7 @@ AfterTriggerEndQuery(EState *estate)
 		tuplestore_end(fdw_tuplestore);
 		afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = NULL;
 	}
+	ReleaseTransitionTables(afterTriggers.query_depth);
 	afterTriggerFreeEventList(&afterTriggers.query_stack[afterTriggers.query_depth]);
 
 	afterTriggers.query_depth--;
@@ -4127,6 +4440,9 @@ AfterTriggerFireDeferred(void)
 void
 AfterTriggerEndXact(bool isCommit)
 {
+	/* Forget any unfinished batch of foreign key checks */
+	RI_FKey_check_discard();
+
 	/*
 	 * Forget the pending-events list.
 	 *
@@ -4164,6 +4480,7 @@ AfterTriggerEndXact(bool isCommit)
 	 */
 	afterTriggers.query_stack = NULL;
 	afterTriggers.fdw_tuplestores = NULL;
+	afterTriggers.transition_tables = NULL;
 	afterTriggers.maxquerydepth = 0;
 	afterTriggers.state = NULL;
 
@@ -4278,6 +4595,9 @@ AfterTriggerEndSubXact(bool isCommit)
 		if (my_level >= afterTriggers.maxtransdepth)
 			return;
 
+		/* Forget any unfinished batch of foreign key checks */
+		RI_FKey_check_discard();
+
 		/*
 		 * Release any event lists from queries being aborted, and restore
 		 * query_depth to its pre-subxact value.  This assumes that a
@@ -4296,6 +4616,7 @@ AfterTriggerEndSubXact(bool isCommit)
 					tuplestore_end(ts);
 					afterTriggers.fdw_tuplestores[afterTriggers.query_depth] = NULL;
 				}
+				ReleaseTransitionTables(afterTriggers.query_depth);
 
 				afterTriggerFreeEventList(&afterTriggers.query_stack[afterTriggers.query_depth]);
 			}
@@ -4375,6 +4696,9 @@ AfterTriggerEnlargeQueryState(void)
 		afterTriggers.fdw_tuplestores = (Tuplestorestate **)
 			MemoryContextAllocZero(TopTransactionContext,
 								   new_alloc * sizeof(Tuplestorestate *));
+		afterTriggers.transition_tables = (List **)
+			MemoryContextAllocZero(TopTransactionContext,
+								   new_alloc * sizeof(List *));
 		afterTriggers.maxquerydepth = new_alloc;
 	}
 	else
@@ -4390,9 +4714,14 @@ AfterTriggerEnlargeQueryState(void)
 		afterTriggers.fdw_tuplestores = (Tuplestorestate **)
 			repalloc(afterTriggers.fdw_tuplestores,
 					 new_alloc * sizeof(Tuplestorestate *));
+		afterTriggers.transition_tables = (List **)
+			repalloc(afterTriggers.transition_tables,
+					 new_alloc * sizeof(List *));
 		/* Clear newly-allocated slots for subsequent lazy initialization. */
 		memset(afterTriggers.fdw_tuplestores + old_alloc,
 			   0, (new_alloc - old_alloc) * sizeof(Tuplestorestate *));
+		memset(afterTriggers.transition_tables + old_alloc,
+			   0, (new_alloc - old_alloc) * sizeof(List *));
 		afterTriggers.maxquerydepth = new_alloc;
 	}
 
@@ -4868,6 +5197,41 @@ AfterTriggerSaveEvent(EState *estate, ResultRelInfo *relinfo,
 	if (afterTriggers.query_depth >= afterTriggers.maxquerydepth)
 		AfterTriggerEnlargeQueryState();
 
+	/*
+	 * Add the row to the transition tables wanted by statement-level
+	 * triggers, whether or not any row-level triggers are queued below.
+	 */
+	if (row_trigger)
+	{
+		bool		need_old = false;
+		bool		need_new = false;
+
+		switch (event)
+		{
+			case TRIGGER_EVENT_INSERT:
+				need_new = trigdesc->trig_insert_new_table;
+				break;
+			case TRIGGER_EVENT_DELETE:
+				need_old = trigdesc->trig_delete_old_table;
+				break;
+			case TRIGGER_EVENT_UPDATE:
+				need_old = trigdesc->trig_update_old_table;
+				need_new = trigdesc->trig_update_new_table;
+				break;
+		}
+		if (need_old || need_new)
+		{
+			AfterTriggersTransitionTables *tables;
+
+			tables = GetTransitionTables(RelationGetRelid(rel), event,
+										 need_old, need_new);
+			if (need_old)
+				tuplestore_puttuple(tables->old_tuplestore, oldtup);
+			if (need_new)
+				tuplestore_puttuple(tables->new_tuplestore, newtup);
+		}
+	}
+
 	/*
 	 * Validate the event code and collect the associated tuple CTIDs.
 	 *
@@ -5054,3 +5418,84 @@ pg_trigger_depth(PG_FUNCTION_ARGS)
 {
 	PG_RETURN_INT32(MyTriggerDepth);
 }
+
+/*
+ * trigger_transition_table(rowtype, name) returns the rows of a transition
+ * table of the innermost statement-level trigger being fired, so that a
+ * trigger written in a procedural language can use it in queries.  The first
+ * argument is just a value of the table's row type, usually NULL::table.
+ */
+Datum
+trigger_transition_table(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TriggerData *trigdata = TransitionTriggerData;
+	Oid			rowtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+	char	   *name;
+	Tuplestorestate *source;
+	Tuplestorestate *result;
+	TupleDesc	tupdesc;
+	TupleTableSlot *slot;
+	MemoryContext oldcxt;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+	if (PG_ARGISNULL(1))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("transition table name must not be null")));
+	name = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	if (trigdata == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+				 errmsg("trigger_transition_table() can only be called by a trigger with transition tables")));
+
+	if (trigdata->tg_trigger->tgoldtable != NULL &&
+		strcmp(trigdata->tg_trigger->tgoldtable, name) == 0)
+		source = trigdata->tg_oldtable;
+	else if (trigdata->tg_trigger->tgnewtable != NULL &&
+			 strcmp(trigdata->tg_trigger->tgnewtable, name) == 0)
+		source = trigdata->tg_newtable;
+	else
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				 errmsg("trigger \"%s\" has no transition table \"%s\"",
+						trigdata->tg_trigger->tgname, name)));
+
+	if (rowtype != trigdata->tg_relation->rd_rel->reltype)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATATYPE_MISMATCH),
+				 errmsg("transition table \"%s\" has type %s, not %s",
+						name,
+						format_type_be(trigdata->tg_relation->rd_rel->reltype),
+						format_type_be(rowtype))));
+
+	/*
+	 * The executor releases the tuplestore we return, so hand it a copy.
+	 */
+	oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupdesc = CreateTupleDescCopy(RelationGetDescr(trigdata->tg_relation));
+	result = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+								   false, work_mem);
+	MemoryContextSwitchTo(oldcxt);
+
+	slot = MakeSingleTupleTableSlot(tupdesc);
+	tuplestore_rescan(source);
+	while (tuplestore_gettupleslot(source, true, false, slot))
+		tuplestore_puttupleslot(result, slot);
+	tuplestore_rescan(source);
+	ExecDropSingleTupleTableSlot(slot);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = result;
+	rsinfo->setDesc = tupdesc;
+
+	return (Datum) 0;
+}
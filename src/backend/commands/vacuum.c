@@ -42,6 +42,7 @@
 #include "storage/lmgr.h"
 #include "storage/proc.h"
 #include "storage/procarray.h"
+#include "storage/smgr.h"
 #include "utils/acl.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
@@ -286,6 +287,7 @@ vacuum(int options, RangeVar *relation, Oid relid, VacuumParams *params,
 
 		in_vacuum = true;
 		VacuumCostActive = (VacuumCostDelay > 0);
+		tablespace_io_throttle = true;
 		VacuumCostBalance = 0;
 		VacuumPageHit = 0;
 		VacuumPageMiss = 0;
@@ -332,12 +334,14 @@ vacuum(int options, RangeVar *relation, Oid relid, VacuumParams *params,
 	{
 		in_vacuum = false;
 		VacuumCostActive = false;
+		tablespace_io_throttle = false;
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
 
 	in_vacuum = false;
 	VacuumCostActive = false;
+	tablespace_io_throttle = false;
 
 	/*
 	 * Finish up processing.
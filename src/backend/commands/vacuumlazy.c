@@ -12,16 +12,25 @@
  *
  * We are willing to use at most maintenance_work_mem (or perhaps
  * autovacuum_work_mem) memory space to keep track of dead tuples.  We
- * initially allocate an array of TIDs of that size, with an upper limit that
- * depends on table size (this limit ensures we don't allocate a huge area
- * uselessly for vacuuming small tables).  If the array threatens to overflow,
- * we suspend the heap scan phase and perform a pass of index cleanup and page
- * compaction, then resume the heap scan with an empty TID array.
+ * initially allocate a TID storage area of that size, with an upper limit
+ * that depends on table size (this limit ensures we don't allocate a huge
+ * area uselessly for vacuuming small tables).  The TIDs are stored per heap
+ * block, as a short list of offset numbers or as a bitmap, so pages with many
+ * dead tuples cost only a few bits per tuple.  If the area threatens to
+ * overflow, we suspend the heap scan phase and perform a pass of index
+ * cleanup and page compaction, then resume the heap scan with an empty TID
+ * area.
  *
  * If we're processing a table with no indexes, we can just vacuum each page
  * as we go; there's no need to save up multiple tuples to minimize the number
  * of index scans performed.  So we don't use maintenance_work_mem memory for
- * the TID array, just enough to hold as many heap tuples as fit on one page.
+ * the TID area, just enough to hold as many heap tuples as fit on one page.
+ *
+ * When a table has several sizable indexes, each pass over the indexes is
+ * handed to parallel worker processes: the TID area is copied into a DSM
+ * segment and the leader and up to max_parallel_vacuum_workers workers each
+ * claim one index at a time until all of them have been processed.  The heap
+ * itself is still scanned and vacuumed by the leader alone.
  *
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
@@ -42,8 +51,10 @@
 #include "access/heapam_xlog.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
+#include "access/parallel.h"
 #include "access/transam.h"
 #include "access/visibilitymap.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
 #include "catalog/storage.h"
@@ -57,6 +68,8 @@
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
+#include "storage/proc.h"
+#include "storage/smgr.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
@@ -98,6 +111,42 @@
  */
 #define SKIP_PAGES_THRESHOLD	((BlockNumber) 32)
 
+/*
+ * Dead tuple storage.  The TIDs are kept per heap block: an LVDeadBlock entry
+ * holds the block number and where the block's offset numbers start in the
+ * data area.  They are stored there as a sorted array of OffsetNumbers or,
+ * once the block is complete and if that is smaller, as a bitmap with one
+ * bit per line pointer.  A block's data ends where the next block's begins.
+ * The data is filled in from the start of the allocation and the entries
+ * from its end backwards, so both share the one memory budget.
+ */
+typedef struct LVDeadBlock
+{
+	BlockNumber blkno;
+	uint32		start;			/* data offset, maybe with DEAD_BLOCK_BITMAP */
+} LVDeadBlock;
+
+#define DEAD_BLOCK_BITMAP		((uint32) 0x80000000)
+
+/* Entry for the i'th block with dead tuples, in ascending block order */
+#define DeadBlockEntry(vacrelstats, i) \
+	((LVDeadBlock *) ((vacrelstats)->dead_space + \
+					  (vacrelstats)->dead_space_size) - ((i) + 1))
+
+/* Most space ever needed to record the dead tuples of one heap page */
+#define LAZY_DEAD_PAGE_SPACE \
+	MAXALIGN(sizeof(LVDeadBlock) + MaxHeapTuplesPerPage * sizeof(OffsetNumber))
+
+/*
+ * Indexes smaller than this are not worth a parallel worker of their own;
+ * the leader gets through them while the workers handle the larger ones.
+ */
+#define PARALLEL_VACUUM_MIN_INDEX_PAGES ((BlockNumber) (512 * 1024 / BLCKSZ))
+
+/* DSM keys for parallel index vacuuming */
+#define PARALLEL_VACUUM_KEY_SHARED			UINT64CONST(0xE000000000000001)
+#define PARALLEL_VACUUM_KEY_DEAD_TUPLES		UINT64CONST(0xE000000000000002)
+
 typedef struct LVRelStats
 {
 	/* hasindex = true means two-pass strategy; false means one-pass */
@@ -116,16 +165,53 @@ typedef struct LVRelStats
 	BlockNumber pages_removed;
 	double		tuples_deleted;
 	BlockNumber nonempty_pages; /* actually, last nonempty page + 1 */
-	/* List of TIDs of tuples we intend to delete */
-	/* NB: this list is ordered by TID address */
-	int			num_dead_tuples;	/* current # of entries */
-	int			max_dead_tuples;	/* # slots allocated in array */
-	ItemPointer dead_tuples;	/* array of ItemPointerData */
+	/* TIDs of tuples we intend to delete, ordered by TID address */
+	int			num_dead_tuples;	/* current # of TIDs */
+	int			max_dead_tuples;	/* # of TIDs sure to fit */
+	int			num_dead_blocks;	/* # of LVDeadBlock entries */
+	Size		dead_used;		/* bytes of offset data in dead_space */
+	Size		dead_space_size;	/* allocated size of dead_space */
+	char	   *dead_space;		/* see LVDeadBlock */
 	int			num_index_scans;
 	TransactionId latestRemovedXid;
 	bool		lock_waiter_detected;
 } LVRelStats;
 
+/*
+ * Per-index result slot in the DSM segment of a parallel index pass.  The
+ * leader copies in the statistics of earlier passes, and whichever process
+ * vacuums the index leaves the new ones behind.
+ */
+typedef struct LVIndexStats
+{
+	bool		valid;			/* does stats hold anything yet? */
+	IndexBulkDeleteResult stats;
+} LVIndexStats;
+
+/*
+ * State shared between the leader and the workers of a parallel index pass.
+ * The dead tuple TIDs are kept under a separate key.
+ */
+typedef struct LVShared
+{
+	Oid			relid;			/* heap being vacuumed */
+	int			elevel;
+	bool		for_cleanup;	/* index_vacuum_cleanup, not bulk delete? */
+	BlockNumber rel_pages;
+	BlockNumber tupcount_pages;
+	double		old_rel_tuples;
+	double		new_rel_tuples;
+	int			num_dead_tuples;
+	int			num_dead_blocks;
+	Size		dead_used;
+	Size		dead_space_size;
+	pg_atomic_uint32 nextindex; /* next index to hand out */
+	int			nindexes;
+	LVIndexStats indstats[FLEXIBLE_ARRAY_MEMBER];
+} LVShared;
+
+/* GUC parameter */
+int			max_parallel_vacuum_workers = 2;
 
 /* A few variables that don't seem worth passing around as parameters */
 static int	elevel = -1;
@@ -143,14 +229,31 @@ static void lazy_scan_heap(Relation onerel, int options,
 			   bool aggressive);
 static void lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats);
 static bool lazy_check_needs_freeze(Buffer buf, bool *hastup);
+static void lazy_vacuum_all_indexes(Relation onerel, Relation *Irel,
+						int nindexes, IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats);
+static void lazy_cleanup_all_indexes(Relation onerel, Relation *Irel,
+						 int nindexes, IndexBulkDeleteResult **indstats,
+						 LVRelStats *vacrelstats);
 static void lazy_vacuum_index(Relation indrel,
 				  IndexBulkDeleteResult **stats,
 				  LVRelStats *vacrelstats);
 static void lazy_cleanup_index(Relation indrel,
 				   IndexBulkDeleteResult *stats,
 				   LVRelStats *vacrelstats);
+static IndexBulkDeleteResult *lazy_cleanup_index_scan(Relation indrel,
+						IndexBulkDeleteResult *stats,
+						LVRelStats *vacrelstats);
+static void lazy_update_index_stats(Relation indrel,
+						IndexBulkDeleteResult *stats, PGRUsage *ru0);
+static int	parallel_vacuum_workers(Relation *Irel, int nindexes);
+static bool lazy_parallel_vacuum_indexes(Relation onerel, Relation *Irel,
+							 int nindexes, IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats, bool for_cleanup);
+static void lazy_process_shared_indexes(Relation *Irel, LVShared *lvshared,
+							LVRelStats *vacrelstats);
 static int lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-				 int tupindex, LVRelStats *vacrelstats, Buffer *vmbuffer);
+				 int blockindex, LVRelStats *vacrelstats, Buffer *vmbuffer);
 static bool should_attempt_truncation(LVRelStats *vacrelstats);
 static void lazy_truncate_heap(Relation onerel, LVRelStats *vacrelstats);
 static BlockNumber count_nondeletable_pages(Relation onerel,
@@ -158,8 +261,13 @@ static BlockNumber count_nondeletable_pages(Relation onerel,
 static void lazy_space_alloc(LVRelStats *vacrelstats, BlockNumber relblocks);
 static void lazy_record_dead_tuple(LVRelStats *vacrelstats,
 					   ItemPointer itemptr);
+static void lazy_reset_dead_tuples(LVRelStats *vacrelstats);
+static void lazy_compact_dead_block(LVRelStats *vacrelstats);
+static Size lazy_dead_space_free(LVRelStats *vacrelstats);
+static Size lazy_dead_block_end(LVRelStats *vacrelstats, int blockindex);
+static int lazy_dead_block_offsets(LVRelStats *vacrelstats, int blockindex,
+						OffsetNumber *offsets);
 static bool lazy_tid_reaped(ItemPointer itemptr, void *state);
-static int	vac_cmp_itemptr(const void *left, const void *right);
 static bool heap_page_is_all_visible(Relation rel, Buffer buf,
 					 TransactionId *visibility_cutoff_xid, bool *all_frozen);
 
@@ -681,8 +789,11 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 		/*
 		 * If we are close to overrunning the available space for dead-tuple
 		 * TIDs, pause and do a cycle of vacuuming before we tackle this page.
+		 * Packing the previous page's TIDs first may leave enough room.
 		 */
-		if ((vacrelstats->max_dead_tuples - vacrelstats->num_dead_tuples) < MaxHeapTuplesPerPage &&
+		lazy_compact_dead_block(vacrelstats);
+		if ((lazy_dead_space_free(vacrelstats) < LAZY_DEAD_PAGE_SPACE ||
+			 vacrelstats->num_dead_tuples > INT_MAX - MaxHeapTuplesPerPage) &&
 			vacrelstats->num_dead_tuples > 0)
 		{
 			const int	hvp_index[] = {
@@ -711,10 +822,8 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 										 PROGRESS_VACUUM_PHASE_VACUUM_INDEX);
 
 			/* Remove index entries */
-			for (i = 0; i < nindexes; i++)
-				lazy_vacuum_index(Irel[i],
-								  &indstats[i],
-								  vacrelstats);
+			lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+									vacrelstats);
 
 			/*
 			 * Report that we are now vacuuming the heap.  We also increase
@@ -734,7 +843,7 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 			 * not to reset latestRemovedXid since we want that value to be
 			 * valid.
 			 */
-			vacrelstats->num_dead_tuples = 0;
+			lazy_reset_dead_tuples(vacrelstats);
 			vacrelstats->num_index_scans++;
 
 			/* Report that we are once again scanning the heap */
@@ -1140,7 +1249,7 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 			 * not to reset latestRemovedXid since we want that value to be
 			 * valid.
 			 */
-			vacrelstats->num_dead_tuples = 0;
+			lazy_reset_dead_tuples(vacrelstats);
 			vacuumed_pages++;
 		}
 
@@ -1290,10 +1399,8 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 									 PROGRESS_VACUUM_PHASE_VACUUM_INDEX);
 
 		/* Remove index entries */
-		for (i = 0; i < nindexes; i++)
-			lazy_vacuum_index(Irel[i],
-							  &indstats[i],
-							  vacrelstats);
+		lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+								vacrelstats);
 
 		/* Report that we are now vacuuming the heap */
 		hvp_val[0] = PROGRESS_VACUUM_PHASE_VACUUM_HEAP;
@@ -1313,8 +1420,7 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 								 PROGRESS_VACUUM_PHASE_INDEX_CLEANUP);
 
 	/* Do post-vacuum cleanup and statistics update for each index */
-	for (i = 0; i < nindexes; i++)
-		lazy_cleanup_index(Irel[i], indstats[i], vacrelstats);
+	lazy_cleanup_all_indexes(onerel, Irel, nindexes, indstats, vacrelstats);
 
 	/* If no indexes, make log report that lazy_vacuum_heap would've made */
 	if (vacuumed_pages)
@@ -1367,16 +1473,17 @@ lazy_scan_heap(Relation onerel, int options, LVRelStats *vacrelstats,
 static void
 lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 {
-	int			tupindex;
+	int			blockindex;
+	int			ntuples;
 	int			npages;
 	PGRUsage	ru0;
 	Buffer		vmbuffer = InvalidBuffer;
 
 	pg_rusage_init(&ru0);
+	ntuples = 0;
 	npages = 0;
 
-	tupindex = 0;
-	while (tupindex < vacrelstats->num_dead_tuples)
+	for (blockindex = 0; blockindex < vacrelstats->num_dead_blocks; blockindex++)
 	{
 		BlockNumber tblk;
 		Buffer		buf;
@@ -1385,16 +1492,15 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 
 		vacuum_delay_point();
 
-		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
+		tblk = DeadBlockEntry(vacrelstats, blockindex)->blkno;
 		buf = ReadBufferExtended(onerel, MAIN_FORKNUM, tblk, RBM_NORMAL,
 								 vac_strategy);
 		if (!ConditionalLockBufferForCleanup(buf))
 		{
 			ReleaseBuffer(buf);
-			++tupindex;
 			continue;
 		}
-		tupindex = lazy_vacuum_page(onerel, tblk, buf, tupindex, vacrelstats,
+		ntuples += lazy_vacuum_page(onerel, tblk, buf, blockindex, vacrelstats,
 									&vmbuffer);
 
 		/* Now that we've compacted the page, record its available space */
@@ -1415,7 +1521,7 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 	ereport(elevel,
 			(errmsg("\"%s\": removed %d row versions in %d pages",
 					RelationGetRelationName(onerel),
-					tupindex, npages),
+					ntuples, npages),
 			 errdetail_internal("%s", pg_rusage_show(&ru0))));
 }
 
@@ -1425,37 +1531,34 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
  *
  * Caller must hold pin and buffer cleanup lock on the buffer.
  *
- * tupindex is the index in vacrelstats->dead_tuples of the first dead
- * tuple for this page.  We assume the rest follow sequentially.
- * The return value is the first tupindex after the tuples of this page.
+ * blockindex is the index of the page's entry in the dead tuple storage.
+ * The return value is the number of dead tuples removed.
  */
 static int
 lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
-				 int tupindex, LVRelStats *vacrelstats, Buffer *vmbuffer)
+				 int blockindex, LVRelStats *vacrelstats, Buffer *vmbuffer)
 {
 	Page		page = BufferGetPage(buffer);
 	OffsetNumber unused[MaxOffsetNumber];
-	int			uncnt = 0;
+	int			uncnt;
+	int			i;
 	TransactionId visibility_cutoff_xid;
 	bool		all_frozen;
 
+	Assert(DeadBlockEntry(vacrelstats, blockindex)->blkno == blkno);
+
 	pgstat_progress_update_param(PROGRESS_VACUUM_HEAP_BLKS_VACUUMED, blkno);
 
+	uncnt = lazy_dead_block_offsets(vacrelstats, blockindex, unused);
+
 	START_CRIT_SECTION();
 
-	for (; tupindex < vacrelstats->num_dead_tuples; tupindex++)
+	for (i = 0; i < uncnt; i++)
 	{
-		BlockNumber tblk;
-		OffsetNumber toff;
 		ItemId		itemid;
 
-		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
-		if (tblk != blkno)
-			break;				/* past end of tuples for this block */
-		toff = ItemPointerGetOffsetNumber(&vacrelstats->dead_tuples[tupindex]);
-		itemid = PageGetItemId(page, toff);
+		itemid = PageGetItemId(page, unused[i]);
 		ItemIdSetUnused(itemid);
-		unused[uncnt++] = toff;
 	}
 
 	PageRepairFragmentation(page);
@@ -1517,7 +1620,7 @@ lazy_vacuum_page(Relation onerel, BlockNumber blkno, Buffer buffer,
 							  *vmbuffer, visibility_cutoff_xid, flags);
 	}
 
-	return tupindex;
+	return uncnt;
 }
 
 /*
@@ -1573,11 +1676,66 @@ lazy_check_needs_freeze(Buffer buf, bool *hastup)
 }
 
 
+/*
+ *	lazy_vacuum_all_indexes() -- remove the dead tuples from every index.
+ *
+ *		The indexes are handed to parallel workers if that's worthwhile,
+ *		otherwise they are vacuumed here one after another.
+ */
+static void
+lazy_vacuum_all_indexes(Relation onerel, Relation *Irel, int nindexes,
+						IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats)
+{
+	int			i;
+
+	if (lazy_parallel_vacuum_indexes(onerel, Irel, nindexes, indstats,
+									 vacrelstats, false))
+		return;
+
+	for (i = 0; i < nindexes; i++)
+		lazy_vacuum_index(Irel[i],
+						  &indstats[i],
+						  vacrelstats);
+}
+
+/*
+ *	lazy_cleanup_all_indexes() -- do post-vacuum cleanup for every index.
+ */
+static void
+lazy_cleanup_all_indexes(Relation onerel, Relation *Irel, int nindexes,
+						 IndexBulkDeleteResult **indstats,
+						 LVRelStats *vacrelstats)
+{
+	PGRUsage	ru0;
+	int			i;
+
+	pg_rusage_init(&ru0);
+
+	if (lazy_parallel_vacuum_indexes(onerel, Irel, nindexes, indstats,
+									 vacrelstats, true))
+	{
+		/*
+		 * Workers can't update pg_class while in parallel mode, so the
+		 * statistics they computed are stored from here.
+		 */
+		for (i = 0; i < nindexes; i++)
+		{
+			if (indstats[i] != NULL)
+				lazy_update_index_stats(Irel[i], indstats[i], &ru0);
+		}
+		return;
+	}
+
+	for (i = 0; i < nindexes; i++)
+		lazy_cleanup_index(Irel[i], indstats[i], vacrelstats);
+}
+
 /*
  *	lazy_vacuum_index() -- vacuum one index relation.
  *
- *		Delete all the index entries pointing to tuples listed in
- *		vacrelstats->dead_tuples, and update running statistics.
+ *		Delete all the index entries pointing to tuples recorded in
+ *		vacrelstats' dead tuple storage, and update running statistics.
  */
 static void
 lazy_vacuum_index(Relation indrel,
@@ -1615,11 +1773,30 @@ lazy_cleanup_index(Relation indrel,
 				   IndexBulkDeleteResult *stats,
 				   LVRelStats *vacrelstats)
 {
-	IndexVacuumInfo ivinfo;
 	PGRUsage	ru0;
 
 	pg_rusage_init(&ru0);
 
+	stats = lazy_cleanup_index_scan(indrel, stats, vacrelstats);
+
+	if (!stats)
+		return;
+
+	lazy_update_index_stats(indrel, stats, &ru0);
+}
+
+/*
+ *	lazy_cleanup_index_scan() -- let the index AM do its post-vacuum cleanup.
+ *
+ *		Returns the final statistics, or NULL if the AM has none to report.
+ */
+static IndexBulkDeleteResult *
+lazy_cleanup_index_scan(Relation indrel,
+						IndexBulkDeleteResult *stats,
+						LVRelStats *vacrelstats)
+{
+	IndexVacuumInfo ivinfo;
+
 	ivinfo.index = indrel;
 	ivinfo.analyze_only = false;
 	ivinfo.estimated_count = (vacrelstats->tupcount_pages < vacrelstats->rel_pages);
@@ -1627,11 +1804,18 @@ lazy_cleanup_index(Relation indrel,
 	ivinfo.num_heap_tuples = vacrelstats->new_rel_tuples;
 	ivinfo.strategy = vac_strategy;
 
-	stats = index_vacuum_cleanup(&ivinfo, stats);
-
-	if (!stats)
-		return;
+	return index_vacuum_cleanup(&ivinfo, stats);
+}
 
+/*
+ *	lazy_update_index_stats() -- store and report an index's final statistics.
+ *
+ *		This must not be called in parallel mode.  Frees stats.
+ */
+static void
+lazy_update_index_stats(Relation indrel, IndexBulkDeleteResult *stats,
+						PGRUsage *ru0)
+{
 	/*
 	 * Now update statistics in pg_class, but only if the index says the count
 	 * is accurate.
@@ -1656,11 +1840,252 @@ lazy_cleanup_index(Relation indrel,
 					   "%s.",
 					   stats->tuples_removed,
 					   stats->pages_deleted, stats->pages_free,
-					   pg_rusage_show(&ru0))));
+					   pg_rusage_show(ru0))));
 
 	pfree(stats);
 }
 
+/*
+ * parallel_vacuum_workers - how many workers to use for an index pass
+ *
+ * Only indexes of at least PARALLEL_VACUUM_MIN_INDEX_PAGES count; one of
+ * them is always left to the leader.
+ */
+static int
+parallel_vacuum_workers(Relation *Irel, int nindexes)
+{
+	int			nlarge = 0;
+	int			i;
+
+	if (max_parallel_vacuum_workers <= 0 || nindexes < 2 ||
+		!IsUnderPostmaster)
+		return 0;
+
+	for (i = 0; i < nindexes; i++)
+	{
+		if (RelationGetNumberOfBlocks(Irel[i]) >= PARALLEL_VACUUM_MIN_INDEX_PAGES)
+			nlarge++;
+	}
+
+	return Min(nlarge - 1, max_parallel_vacuum_workers);
+}
+
+/*
+ * lazy_parallel_vacuum_indexes - run one index pass with parallel workers
+ *
+ * Bulk-deletes the current dead tuples from all indexes, or with for_cleanup
+ * does the post-vacuum cleanup of all indexes, sharing the work between the
+ * leader and the workers.  indstats is updated in place.  For cleanup, the
+ * caller must still store the statistics, since nothing may be written to
+ * pg_class in parallel mode.
+ *
+ * Returns false, having done nothing, if the pass isn't worth parallelizing.
+ */
+static bool
+lazy_parallel_vacuum_indexes(Relation onerel, Relation *Irel, int nindexes,
+							 IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats, bool for_cleanup)
+{
+	ParallelContext *pcxt;
+	LVShared   *lvshared;
+	char	   *dead_space;
+	Size		shared_size;
+	Size		dead_size;
+	int			nworkers;
+	int			i;
+
+	nworkers = parallel_vacuum_workers(Irel, nindexes);
+	if (nworkers <= 0)
+		return false;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContextForExternalFunction("postgres",
+													"parallel_vacuum_main",
+													nworkers);
+
+	shared_size = add_size(offsetof(LVShared, indstats),
+						   mul_size(sizeof(LVIndexStats), nindexes));
+	dead_size = add_size(MAXALIGN(vacrelstats->dead_used),
+						 mul_size(sizeof(LVDeadBlock),
+								  Max(vacrelstats->num_dead_blocks, 1)));
+	shm_toc_estimate_chunk(&pcxt->estimator, shared_size);
+	shm_toc_estimate_chunk(&pcxt->estimator, dead_size);
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	lvshared = (LVShared *) shm_toc_allocate(pcxt->toc, shared_size);
+	lvshared->relid = RelationGetRelid(onerel);
+	lvshared->elevel = elevel;
+	lvshared->for_cleanup = for_cleanup;
+	lvshared->rel_pages = vacrelstats->rel_pages;
+	lvshared->tupcount_pages = vacrelstats->tupcount_pages;
+	lvshared->old_rel_tuples = vacrelstats->old_rel_tuples;
+	lvshared->new_rel_tuples = vacrelstats->new_rel_tuples;
+	lvshared->num_dead_tuples = vacrelstats->num_dead_tuples;
+	lvshared->num_dead_blocks = vacrelstats->num_dead_blocks;
+	lvshared->dead_used = vacrelstats->dead_used;
+	lvshared->dead_space_size = dead_size;
+	pg_atomic_init_u32(&lvshared->nextindex, 0);
+	lvshared->nindexes = nindexes;
+	for (i = 0; i < nindexes; i++)
+	{
+		lvshared->indstats[i].valid = (indstats[i] != NULL);
+		if (indstats[i] != NULL)
+			memcpy(&lvshared->indstats[i].stats, indstats[i],
+				   sizeof(IndexBulkDeleteResult));
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_SHARED, lvshared);
+
+	/* Same layout as our own storage, minus the free space in the middle */
+	dead_space = shm_toc_allocate(pcxt->toc, dead_size);
+	memcpy(dead_space, vacrelstats->dead_space, vacrelstats->dead_used);
+	if (vacrelstats->num_dead_blocks > 0)
+		memcpy(dead_space + dead_size -
+			   vacrelstats->num_dead_blocks * sizeof(LVDeadBlock),
+			   DeadBlockEntry(vacrelstats, vacrelstats->num_dead_blocks - 1),
+			   vacrelstats->num_dead_blocks * sizeof(LVDeadBlock));
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_DEAD_TUPLES, dead_space);
+
+	LaunchParallelWorkers(pcxt);
+
+	ereport(elevel,
+			(errmsg(for_cleanup ?
+					"launched %d parallel vacuum workers for index cleanup (planned: %d)" :
+			   "launched %d parallel vacuum workers for index vacuuming (planned: %d)",
+					pcxt->nworkers_launched, nworkers)));
+
+	/* The leader takes its share of the indexes, too */
+	lazy_process_shared_indexes(Irel, lvshared, vacrelstats);
+
+	WaitForParallelWorkersToFinish(pcxt);
+
+	for (i = 0; i < nindexes; i++)
+	{
+		if (!lvshared->indstats[i].valid)
+		{
+			if (indstats[i] != NULL)
+				pfree(indstats[i]);
+			indstats[i] = NULL;
+			continue;
+		}
+		if (indstats[i] == NULL)
+			indstats[i] = (IndexBulkDeleteResult *)
+				palloc(sizeof(IndexBulkDeleteResult));
+		memcpy(indstats[i], &lvshared->indstats[i].stats,
+			   sizeof(IndexBulkDeleteResult));
+	}
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+
+	return true;
+}
+
+/*
+ * lazy_process_shared_indexes - vacuum indexes until none are left
+ *
+ * Run by the leader and by each worker of a parallel index pass.  Irel must
+ * list the indexes in the same order in every process.
+ */
+static void
+lazy_process_shared_indexes(Relation *Irel, LVShared *lvshared,
+							LVRelStats *vacrelstats)
+{
+	for (;;)
+	{
+		uint32		idx = pg_atomic_fetch_add_u32(&lvshared->nextindex, 1);
+		LVIndexStats *slot;
+		IndexBulkDeleteResult *stats;
+
+		if (idx >= (uint32) lvshared->nindexes)
+			break;
+
+		slot = &lvshared->indstats[idx];
+		stats = slot->valid ? &slot->stats : NULL;
+
+		if (lvshared->for_cleanup)
+			stats = lazy_cleanup_index_scan(Irel[idx], stats, vacrelstats);
+		else
+			lazy_vacuum_index(Irel[idx], &stats, vacrelstats);
+
+		/* The AM may have returned its own copy rather than updating ours */
+		if (stats == NULL)
+			slot->valid = false;
+		else
+		{
+			if (stats != &slot->stats)
+				memcpy(&slot->stats, stats, sizeof(IndexBulkDeleteResult));
+			slot->valid = true;
+		}
+	}
+}
+
+/*
+ * parallel_vacuum_main - entry point of a parallel index vacuum worker
+ */
+void
+parallel_vacuum_main(dsm_segment *seg, shm_toc *toc)
+{
+	LVShared   *lvshared;
+	LVRelStats	vacrelstats;
+	Relation	onerel;
+	Relation   *Irel;
+	int			nindexes;
+
+	lvshared = (LVShared *) shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_SHARED);
+	Assert(lvshared != NULL);
+
+	/*
+	 * Like the leader, keep our snapshot out of other vacuums' xmin horizon;
+	 * see vacuum_rel.
+	 */
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	MyPgXact->vacuumFlags |= PROC_IN_VACUUM;
+	LWLockRelease(ProcArrayLock);
+
+	/*
+	 * The leader holds the same locks, but as members of one lock group we
+	 * don't conflict with it.
+	 */
+	onerel = heap_open(lvshared->relid, ShareUpdateExclusiveLock);
+	vac_open_indexes(onerel, RowExclusiveLock, &nindexes, &Irel);
+	if (nindexes != lvshared->nindexes)
+		elog(ERROR, "relation \"%s\" has %d indexes in parallel vacuum worker, expected %d",
+			 RelationGetRelationName(onerel), nindexes, lvshared->nindexes);
+
+	MemSet(&vacrelstats, 0, sizeof(LVRelStats));
+	vacrelstats.hasindex = true;
+	vacrelstats.rel_pages = lvshared->rel_pages;
+	vacrelstats.tupcount_pages = lvshared->tupcount_pages;
+	vacrelstats.old_rel_tuples = lvshared->old_rel_tuples;
+	vacrelstats.new_rel_tuples = lvshared->new_rel_tuples;
+	vacrelstats.num_dead_tuples = lvshared->num_dead_tuples;
+	vacrelstats.max_dead_tuples = lvshared->num_dead_tuples;
+	vacrelstats.num_dead_blocks = lvshared->num_dead_blocks;
+	vacrelstats.dead_used = lvshared->dead_used;
+	vacrelstats.dead_space_size = lvshared->dead_space_size;
+	vacrelstats.dead_space = shm_toc_lookup(toc,
+											PARALLEL_VACUUM_KEY_DEAD_TUPLES);
+	Assert(vacrelstats.dead_space != NULL);
+
+	elevel = lvshared->elevel;
+	vac_strategy = GetAccessStrategy(BAS_VACUUM);
+
+	/* Each worker is throttled on its own, as vacuum() does for the leader */
+	VacuumCostActive = (VacuumCostDelay > 0);
+	VacuumCostBalance = 0;
+	tablespace_io_throttle = true;
+
+	lazy_process_shared_indexes(Irel, lvshared, &vacrelstats);
+
+	VacuumCostActive = false;
+	tablespace_io_throttle = false;
+
+	vac_close_indexes(nindexes, Irel, RowExclusiveLock);
+	heap_close(onerel, ShareUpdateExclusiveLock);
+}
+
 /*
  * should_attempt_truncation - should we attempt to truncate the heap?
  *
@@ -1947,6 +2372,7 @@ count_nondeletable_pages(Relation onerel, LVRelStats *vacrelstats)
 static void
 lazy_space_alloc(LVRelStats *vacrelstats, BlockNumber relblocks)
 {
+	Size		space;
 	long		maxtuples;
 	int			vac_work_mem = IsAutoVacuumWorkerProcess() &&
 	autovacuum_work_mem != -1 ?
@@ -1954,99 +2380,276 @@ lazy_space_alloc(LVRelStats *vacrelstats, BlockNumber relblocks)
 
 	if (vacrelstats->hasindex)
 	{
-		maxtuples = (vac_work_mem * 1024L) / sizeof(ItemPointerData);
-		maxtuples = Min(maxtuples, INT_MAX);
-		maxtuples = Min(maxtuples, MaxAllocSize / sizeof(ItemPointerData));
+		space = (Size) vac_work_mem * 1024L;
+		space = Min(space, MaxAllocSize);
 
-		/* curious coding here to ensure the multiplication can't overflow */
-		if ((BlockNumber) (maxtuples / LAZY_ALLOC_TUPLES) > relblocks)
-			maxtuples = relblocks * LAZY_ALLOC_TUPLES;
+		/* no need for more than the whole table could possibly take */
+		if ((BlockNumber) (space / LAZY_DEAD_PAGE_SPACE) > relblocks)
+			space = relblocks * LAZY_DEAD_PAGE_SPACE;
 
 		/* stay sane if small maintenance_work_mem */
-		maxtuples = Max(maxtuples, MaxHeapTuplesPerPage);
+		space = Max(space, LAZY_DEAD_PAGE_SPACE);
 	}
 	else
 	{
-		maxtuples = MaxHeapTuplesPerPage;
+		space = LAZY_DEAD_PAGE_SPACE;
 	}
 
-	vacrelstats->num_dead_tuples = 0;
+	/* keep the block entries at the end of the space aligned */
+	space = MAXALIGN_DOWN(space);
+
+	/* a lone dead tuple on its page is the most expensive case */
+	maxtuples = space / (sizeof(LVDeadBlock) + sizeof(OffsetNumber));
+	maxtuples = Min(maxtuples, INT_MAX);
+
 	vacrelstats->max_dead_tuples = (int) maxtuples;
-	vacrelstats->dead_tuples = (ItemPointer)
-		palloc(maxtuples * sizeof(ItemPointerData));
+	vacrelstats->dead_space_size = space;
+	vacrelstats->dead_space = (char *) palloc(space);
+	lazy_reset_dead_tuples(vacrelstats);
 }
 
 /*
  * lazy_record_dead_tuple - remember one deletable tuple
+ *
+ * The tuples must be recorded in TID order.  The offsets of a block are
+ * appended to its list as they come; lazy_compact_dead_block may turn the
+ * list into a bitmap once we have moved on to another block.
  */
 static void
 lazy_record_dead_tuple(LVRelStats *vacrelstats,
 					   ItemPointer itemptr)
 {
+	BlockNumber blkno = ItemPointerGetBlockNumber(itemptr);
+	OffsetNumber offnum = ItemPointerGetOffsetNumber(itemptr);
+	LVDeadBlock *entry = NULL;
+	Size		needed = sizeof(OffsetNumber);
+
+	if (vacrelstats->num_dead_blocks > 0)
+		entry = DeadBlockEntry(vacrelstats, vacrelstats->num_dead_blocks - 1);
+
+	if (entry == NULL || entry->blkno != blkno)
+	{
+		Assert(entry == NULL || entry->blkno < blkno);
+		lazy_compact_dead_block(vacrelstats);
+		entry = NULL;
+		needed += sizeof(LVDeadBlock);
+	}
+	else
+		Assert((entry->start & DEAD_BLOCK_BITMAP) == 0);
+
 	/*
-	 * The array shouldn't overflow under normal behavior, but perhaps it
+	 * The space shouldn't run out under normal behavior, but perhaps it
 	 * could if we are given a really small maintenance_work_mem. In that
 	 * case, just forget the last few tuples (we'll get 'em next time).
 	 */
-	if (vacrelstats->num_dead_tuples < vacrelstats->max_dead_tuples)
+	if (lazy_dead_space_free(vacrelstats) < needed)
+		return;
+
+	if (entry == NULL)
 	{
-		vacrelstats->dead_tuples[vacrelstats->num_dead_tuples] = *itemptr;
-		vacrelstats->num_dead_tuples++;
-		pgstat_progress_update_param(PROGRESS_VACUUM_NUM_DEAD_TUPLES,
-									 vacrelstats->num_dead_tuples);
+		entry = DeadBlockEntry(vacrelstats, vacrelstats->num_dead_blocks);
+		entry->blkno = blkno;
+		entry->start = (uint32) vacrelstats->dead_used;
+		vacrelstats->num_dead_blocks++;
 	}
+
+	*((OffsetNumber *) (vacrelstats->dead_space + vacrelstats->dead_used)) = offnum;
+	vacrelstats->dead_used += sizeof(OffsetNumber);
+	vacrelstats->num_dead_tuples++;
+	pgstat_progress_update_param(PROGRESS_VACUUM_NUM_DEAD_TUPLES,
+								 vacrelstats->num_dead_tuples);
 }
 
 /*
- *	lazy_tid_reaped() -- is a particular tid deletable?
- *
- *		This has the right signature to be an IndexBulkDeleteCallback.
+ * lazy_reset_dead_tuples - forget all remembered dead tuples
+ */
+static void
+lazy_reset_dead_tuples(LVRelStats *vacrelstats)
+{
+	vacrelstats->num_dead_tuples = 0;
+	vacrelstats->num_dead_blocks = 0;
+	vacrelstats->dead_used = 0;
+}
+
+/*
+ * lazy_compact_dead_block - store the last block's offsets as a bitmap
  *
- *		Assumes dead_tuples array is in sorted order.
+ * This is done only if the bitmap is smaller than the list of offsets, and
+ * no more tuples may be recorded for the block afterwards.
  */
-static bool
-lazy_tid_reaped(ItemPointer itemptr, void *state)
+static void
+lazy_compact_dead_block(LVRelStats *vacrelstats)
 {
-	LVRelStats *vacrelstats = (LVRelStats *) state;
-	ItemPointer res;
+	LVDeadBlock *entry;
+	OffsetNumber offsets[MaxHeapTuplesPerPage];
+	OffsetNumber *list;
+	uint8	   *bitmap;
+	Size		nbytes;
+	int			noffsets;
+	int			i;
+
+	if (vacrelstats->num_dead_blocks == 0)
+		return;
+
+	entry = DeadBlockEntry(vacrelstats, vacrelstats->num_dead_blocks - 1);
+	if (entry->start & DEAD_BLOCK_BITMAP)
+		return;
+
+	list = (OffsetNumber *) (vacrelstats->dead_space + entry->start);
+	noffsets = (vacrelstats->dead_used - entry->start) / sizeof(OffsetNumber);
+	Assert(noffsets > 0 && noffsets <= MaxHeapTuplesPerPage);
+
+	/* bit N-1 stands for offset N; keep the next block's data aligned */
+	nbytes = SHORTALIGN((list[noffsets - 1] + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+	if (nbytes >= noffsets * sizeof(OffsetNumber))
+		return;
+
+	memcpy(offsets, list, noffsets * sizeof(OffsetNumber));
+	bitmap = (uint8 *) list;
+	memset(bitmap, 0, nbytes);
+	for (i = 0; i < noffsets; i++)
+		bitmap[(offsets[i] - 1) / BITS_PER_BYTE] |=
+			1 << ((offsets[i] - 1) % BITS_PER_BYTE);
+
+	vacrelstats->dead_used = entry->start + nbytes;
+	entry->start |= DEAD_BLOCK_BITMAP;
+}
 
-	res = (ItemPointer) bsearch((void *) itemptr,
-								(void *) vacrelstats->dead_tuples,
-								vacrelstats->num_dead_tuples,
-								sizeof(ItemPointerData),
-								vac_cmp_itemptr);
+/*
+ * lazy_dead_space_free - bytes left for more dead tuples
+ */
+static Size
+lazy_dead_space_free(LVRelStats *vacrelstats)
+{
+	return vacrelstats->dead_space_size - vacrelstats->dead_used -
+		vacrelstats->num_dead_blocks * sizeof(LVDeadBlock);
+}
 
-	return (res != NULL);
+/*
+ * lazy_dead_block_end - where a block's offset data ends
+ */
+static Size
+lazy_dead_block_end(LVRelStats *vacrelstats, int blockindex)
+{
+	if (blockindex + 1 < vacrelstats->num_dead_blocks)
+		return DeadBlockEntry(vacrelstats, blockindex + 1)->start &
+			~DEAD_BLOCK_BITMAP;
+	return vacrelstats->dead_used;
 }
 
 /*
- * Comparator routines for use with qsort() and bsearch().
+ * lazy_dead_block_offsets - extract the dead offsets of one block
+ *
+ * The offsets are written to the caller's array, in ascending order, and
+ * their number is returned.
  */
 static int
-vac_cmp_itemptr(const void *left, const void *right)
+lazy_dead_block_offsets(LVRelStats *vacrelstats, int blockindex,
+						OffsetNumber *offsets)
 {
-	BlockNumber lblk,
-				rblk;
-	OffsetNumber loff,
-				roff;
+	LVDeadBlock *entry = DeadBlockEntry(vacrelstats, blockindex);
+	Size		start = entry->start & ~DEAD_BLOCK_BITMAP;
+	Size		end = lazy_dead_block_end(vacrelstats, blockindex);
+	int			noffsets = 0;
+	Size		i;
 
-	lblk = ItemPointerGetBlockNumber((ItemPointer) left);
-	rblk = ItemPointerGetBlockNumber((ItemPointer) right);
+	if (entry->start & DEAD_BLOCK_BITMAP)
+	{
+		uint8	   *bitmap = (uint8 *) (vacrelstats->dead_space + start);
 
-	if (lblk < rblk)
-		return -1;
-	if (lblk > rblk)
-		return 1;
+		for (i = 0; i < end - start; i++)
+		{
+			uint8		byte = bitmap[i];
+			int			bit;
 
-	loff = ItemPointerGetOffsetNumber((ItemPointer) left);
-	roff = ItemPointerGetOffsetNumber((ItemPointer) right);
+			for (bit = 0; byte != 0; bit++, byte >>= 1)
+			{
+				if (byte & 1)
+					offsets[noffsets++] = i * BITS_PER_BYTE + bit + 1;
+			}
+		}
+	}
+	else
+	{
+		noffsets = (end - start) / sizeof(OffsetNumber);
+		memcpy(offsets, vacrelstats->dead_space + start,
+			   noffsets * sizeof(OffsetNumber));
+	}
 
-	if (loff < roff)
-		return -1;
-	if (loff > roff)
-		return 1;
+	return noffsets;
+}
 
-	return 0;
+/*
+ *	lazy_tid_reaped() -- is a particular tid deletable?
+ *
+ *		This has the right signature to be an IndexBulkDeleteCallback.
+ *
+ *		The block entries are in ascending block order, and so are the
+ *		offsets of each block that are kept as a list.
+ */
+static bool
+lazy_tid_reaped(ItemPointer itemptr, void *state)
+{
+	LVRelStats *vacrelstats = (LVRelStats *) state;
+	BlockNumber blkno = ItemPointerGetBlockNumber(itemptr);
+	OffsetNumber offnum = ItemPointerGetOffsetNumber(itemptr);
+	LVDeadBlock *entry = NULL;
+	Size		start;
+	Size		end;
+	int			low = 0;
+	int			high = vacrelstats->num_dead_blocks - 1;
+
+	while (low <= high)
+	{
+		int			mid = low + (high - low) / 2;
+		LVDeadBlock *midentry = DeadBlockEntry(vacrelstats, mid);
+
+		if (midentry->blkno < blkno)
+			low = mid + 1;
+		else if (midentry->blkno > blkno)
+			high = mid - 1;
+		else
+		{
+			entry = midentry;
+			low = mid;
+			break;
+		}
+	}
+
+	if (entry == NULL)
+		return false;
+
+	start = entry->start & ~DEAD_BLOCK_BITMAP;
+	end = lazy_dead_block_end(vacrelstats, low);
+
+	if (entry->start & DEAD_BLOCK_BITMAP)
+	{
+		uint8	   *bitmap = (uint8 *) (vacrelstats->dead_space + start);
+		Size		byteno = (offnum - 1) / BITS_PER_BYTE;
+
+		if (offnum == InvalidOffsetNumber || byteno >= end - start)
+			return false;
+		return (bitmap[byteno] & (1 << ((offnum - 1) % BITS_PER_BYTE))) != 0;
+	}
+	else
+	{
+		OffsetNumber *list = (OffsetNumber *) (vacrelstats->dead_space + start);
+
+		low = 0;
+		high = (end - start) / sizeof(OffsetNumber) - 1;
+		while (low <= high)
+		{
+			int			mid = low + (high - low) / 2;
+
+			if (list[mid] < offnum)
+				low = mid + 1;
+			else if (list[mid] > offnum)
+				high = mid - 1;
+			else
+				return true;
+		}
+		return false;
+	}
 }
 
 /*
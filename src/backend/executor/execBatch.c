@@ -0,0 +1,327 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.c
+ *	  Support for batch-at-a-time execution of simple scans.
+ *
+ * Normally executor nodes pass one tuple per ExecProcNode call.  For a
+ * plain aggregate directly over a sequential scan that is a lot of
+ * overhead per tuple, so such a pair can instead exchange batches: the scan
+ * deforms up to EXEC_BATCH_SIZE tuples into per-column arrays, evaluates
+ * its quals over whole columns, and the aggregate advances its transition
+ * states with tight loops over the qualifying rows.
+ *
+ * Only quals comparing a column of a fixed-width integer type with a
+ * constant of the same type are evaluated here; their loops are written
+ * without branches so that the compiler can vectorize them.  Scans with any
+ * other quals run in the normal tuple-at-a-time mode.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execBatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/stratnum.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "executor/execBatch.h"
+#include "nodes/primnodes.h"
+#include "utils/lsyscache.h"
+
+
+/* GUC */
+bool		enable_batch_execution = false;
+
+static bool build_batch_qual(Expr *clause, Index scanrelid,
+				 TupleBatch *batch, BatchQual *qual);
+
+
+/*
+ * Create an empty batch that can hold up to maxcols columns.
+ */
+TupleBatch *
+ExecCreateTupleBatch(int maxcols)
+{
+	TupleBatch *batch = (TupleBatch *) palloc0(sizeof(TupleBatch));
+
+	batch->maxcols = Max(maxcols, 1);
+	batch->attnos = (AttrNumber *) palloc(batch->maxcols * sizeof(AttrNumber));
+	batch->values = (Datum **) palloc(batch->maxcols * sizeof(Datum *));
+	batch->isnull = (bool **) palloc(batch->maxcols * sizeof(bool *));
+	batch->selection = (uint16 *) palloc(EXEC_BATCH_SIZE * sizeof(uint16));
+
+	return batch;
+}
+
+/*
+ * Return the column of the batch holding attribute attno of the scan tuple,
+ * adding it if it isn't there yet.
+ */
+int
+ExecBatchAddColumn(TupleBatch *batch, AttrNumber attno)
+{
+	int			col;
+
+	Assert(attno > 0);
+
+	for (col = 0; col < batch->ncols; col++)
+	{
+		if (batch->attnos[col] == attno)
+			return col;
+	}
+
+	if (batch->ncols >= batch->maxcols)
+		elog(ERROR, "too many columns in tuple batch");
+
+	col = batch->ncols++;
+	batch->attnos[col] = attno;
+	batch->values[col] = (Datum *) palloc(EXEC_BATCH_SIZE * sizeof(Datum));
+	batch->isnull[col] = (bool *) palloc(EXEC_BATCH_SIZE * sizeof(bool));
+	batch->maxattno = Max(batch->maxattno, attno);
+
+	return col;
+}
+
+/*
+ * Can values of the given type be processed by batch loops, and how?
+ */
+bool
+ExecBatchValueKind(Oid typid, BatchValueKind *kind)
+{
+	switch (typid)
+	{
+		case INT2OID:
+			*kind = BATCH_INT16;
+			return true;
+		case INT4OID:
+		case DATEOID:
+			*kind = BATCH_INT32;
+			return true;
+		case INT8OID:
+#ifdef USE_FLOAT8_BYVAL
+			*kind = BATCH_INT64;
+			return true;
+#else
+			return false;
+#endif
+		default:
+			return false;
+	}
+}
+
+/*
+ * Translate an implicitly-ANDed list of scan quals to BatchQuals, adding
+ * the columns they reference to the batch.  Returns false if any of the
+ * quals can't be evaluated in batch mode.
+ */
+bool
+ExecBuildBatchQuals(List *qual, Index scanrelid, TupleBatch *batch,
+					BatchQual **quals, int *nquals)
+{
+	BatchQual  *result;
+	ListCell   *lc;
+	int			n = 0;
+
+	result = (BatchQual *) palloc(Max(list_length(qual), 1) * sizeof(BatchQual));
+
+	foreach(lc, qual)
+	{
+		if (!build_batch_qual((Expr *) lfirst(lc), scanrelid, batch,
+							  &result[n]))
+		{
+			pfree(result);
+			return false;
+		}
+		n++;
+	}
+
+	*quals = result;
+	*nquals = n;
+
+	return true;
+}
+
+/*
+ * Translate one qual clause, see ExecBuildBatchQuals.
+ */
+static bool
+build_batch_qual(Expr *clause, Index scanrelid, TupleBatch *batch,
+				 BatchQual *qual)
+{
+	OpExpr	   *opexpr;
+	Var		   *var;
+	Const	   *con;
+	bool		varonleft;
+	Oid			opno;
+	Oid			lefttype;
+	Oid			righttype;
+	Oid			opclass;
+	Oid			opfamily;
+	int			strategy;
+
+	if (!IsA(clause, OpExpr))
+		return false;
+	opexpr = (OpExpr *) clause;
+	if (list_length(opexpr->args) != 2)
+		return false;
+
+	if (IsA(linitial(opexpr->args), Var) &&
+		IsA(lsecond(opexpr->args), Const))
+	{
+		var = (Var *) linitial(opexpr->args);
+		con = (Const *) lsecond(opexpr->args);
+		varonleft = true;
+	}
+	else if (IsA(linitial(opexpr->args), Const) &&
+			 IsA(lsecond(opexpr->args), Var))
+	{
+		con = (Const *) linitial(opexpr->args);
+		var = (Var *) lsecond(opexpr->args);
+		varonleft = false;
+	}
+	else
+		return false;
+
+	if (var->varno != scanrelid || var->varlevelsup != 0 ||
+		var->varattno <= 0)
+		return false;
+	if (con->constisnull || con->consttype != var->vartype)
+		return false;
+	if (!ExecBatchValueKind(var->vartype, &qual->kind))
+		return false;
+
+	/*
+	 * Find out what the operator means from the type's default btree opclass.
+	 * That only knows about <> as the negator of =.
+	 */
+	opno = opexpr->opno;
+	op_input_types(opno, &lefttype, &righttype);
+	if (lefttype != var->vartype || righttype != var->vartype)
+		return false;
+	opclass = GetDefaultOpClass(var->vartype, BTREE_AM_OID);
+	if (!OidIsValid(opclass))
+		return false;
+	opfamily = get_opclass_family(opclass);
+
+	strategy = get_op_opfamily_strategy(opno, opfamily);
+	switch (strategy)
+	{
+		case BTLessStrategyNumber:
+			qual->cmp = varonleft ? BATCH_LT : BATCH_GT;
+			break;
+		case BTLessEqualStrategyNumber:
+			qual->cmp = varonleft ? BATCH_LE : BATCH_GE;
+			break;
+		case BTEqualStrategyNumber:
+			qual->cmp = BATCH_EQ;
+			break;
+		case BTGreaterEqualStrategyNumber:
+			qual->cmp = varonleft ? BATCH_GE : BATCH_LE;
+			break;
+		case BTGreaterStrategyNumber:
+			qual->cmp = varonleft ? BATCH_GT : BATCH_LT;
+			break;
+		default:
+			opno = get_negator(opno);
+			if (!OidIsValid(opno) ||
+				get_op_opfamily_strategy(opno, opfamily) != BTEqualStrategyNumber)
+				return false;
+			qual->cmp = BATCH_NE;
+			break;
+	}
+
+	qual->col = ExecBatchAddColumn(batch, var->varattno);
+	qual->constval = con->constvalue;
+
+	return true;
+}
+
+/*
+ * Narrow the selection vector down to the rows satisfying one comparison.
+ * NULLs never qualify.  The loop body has no branches: every row is written
+ * to the selection, but only qualifying ones advance the output position.
+ */
+#define BATCH_FILTER_LOOP(ctype, getter, op) \
+	do { \
+		ctype		c = getter(qual->constval); \
+		\
+		for (j = 0; j < nsel; j++) \
+		{ \
+			int			i = sel[j]; \
+			\
+			sel[n] = i; \
+			n += (!isnull[i]) & (getter(values[i]) op c); \
+		} \
+	} while (0)
+
+#define BATCH_FILTER_KIND(ctype, getter) \
+	do { \
+		switch (qual->cmp) \
+		{ \
+			case BATCH_LT: \
+				BATCH_FILTER_LOOP(ctype, getter, <); \
+				break; \
+			case BATCH_LE: \
+				BATCH_FILTER_LOOP(ctype, getter, <=); \
+				break; \
+			case BATCH_EQ: \
+				BATCH_FILTER_LOOP(ctype, getter, ==); \
+				break; \
+			case BATCH_GE: \
+				BATCH_FILTER_LOOP(ctype, getter, >=); \
+				break; \
+			case BATCH_GT: \
+				BATCH_FILTER_LOOP(ctype, getter, >); \
+				break; \
+			case BATCH_NE: \
+				BATCH_FILTER_LOOP(ctype, getter, !=); \
+				break; \
+		} \
+	} while (0)
+
+/*
+ * Evaluate the quals over the tuples of the batch, setting its selection
+ * vector to the qualifying ones.
+ */
+void
+ExecBatchFilter(TupleBatch *batch, BatchQual *quals, int nquals)
+{
+	uint16	   *sel = batch->selection;
+	int			nsel = batch->ntuples;
+	int			q;
+	int			j;
+
+	for (j = 0; j < nsel; j++)
+		sel[j] = j;
+
+	for (q = 0; q < nquals && nsel > 0; q++)
+	{
+		BatchQual  *qual = &quals[q];
+		Datum	   *values = batch->values[qual->col];
+		bool	   *isnull = batch->isnull[qual->col];
+		int			n = 0;
+
+		switch (qual->kind)
+		{
+			case BATCH_INT16:
+				BATCH_FILTER_KIND(int16, DatumGetInt16);
+				break;
+			case BATCH_INT32:
+				BATCH_FILTER_KIND(int32, DatumGetInt32);
+				break;
+			case BATCH_INT64:
+				BATCH_FILTER_KIND(int64, DatumGetInt64);
+				break;
+		}
+
+		nsel = n;
+	}
+
+	batch->nselected = nsel;
+}
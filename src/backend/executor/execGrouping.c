@@ -458,6 +458,42 @@ FindTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 	return entry;
 }
 
+/*
+ * Remove the hashtable entry matching the given tuple, if there is one.
+ * The tuple must be the same type as the hashtable entries, and must not
+ * be stored in the hashtable's own tableslot.
+ *
+ * The entry's firstTuple is not freed; the caller should do that, after
+ * fetching it from the entry beforehand if need be.
+ */
+void
+RemoveTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot)
+{
+	MemoryContext oldContext;
+	TupleHashTable saveCurHT;
+	TupleHashEntryData dummy;
+
+	Assert(slot != hashtable->tableslot);
+
+	/* Need to run the hash functions in short-lived context */
+	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
+
+	/* Set up data needed by hash and match functions, as above */
+	hashtable->inputslot = slot;
+	hashtable->in_hash_funcs = hashtable->tab_hash_funcs;
+	hashtable->cur_eq_funcs = hashtable->tab_eq_funcs;
+
+	saveCurHT = CurTupleHashTable;
+	CurTupleHashTable = hashtable;
+
+	dummy.firstTuple = NULL;	/* flag to reference inputslot */
+	(void) hash_search(hashtable->hashtab, &dummy, HASH_REMOVE, NULL);
+
+	CurTupleHashTable = saveCurHT;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
 /*
  * Compute the hash value for a tuple
  *
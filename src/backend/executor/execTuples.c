@@ -123,6 +123,7 @@ MakeTupleTableSlot(void)
 	slot->tts_values = NULL;
 	slot->tts_isnull = NULL;
 	slot->tts_mintuple = NULL;
+	slot->tts_deform = NULL;
 
 	return slot;
 }
@@ -271,6 +272,9 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 	slot->tts_tupleDescriptor = tupdesc;
 	PinTupleDesc(tupdesc);
 
+	/* deforming code generated for the old descriptor doesn't apply */
+	slot->tts_deform = NULL;
+
 	/*
 	 * Allocate Datum/isnull arrays of the appropriate size.  These must have
 	 * the same lifetime as the slot, so allocate in the slot's own context.
@@ -140,6 +140,8 @@ CreateExecutorState(void)
 	estate->es_epqTupleSet = NULL;
 	estate->es_epqScanDone = NULL;
 
+	estate->es_jit = NULL;
+
 	/*
 	 * Return the executor state structure
 	 */
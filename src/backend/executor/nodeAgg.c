@@ -141,6 +141,31 @@
  *
  *	  TODO: AGG_HASHED doesn't support multiple grouping sets yet.
  *
+ *	  Spilling hashed aggregation:
+ *
+ *	  Once the hash table outgrows work_mem, no more groups are added to it.
+ *	  Input tuples of groups already in the table are still aggregated there,
+ *	  while the others are written out to one of a number of partition files,
+ *	  chosen by bits of their hash value.  After the groups in the table have
+ *	  been returned, each partition is processed in turn as a new batch, just
+ *	  like the original input; if it overflows again, it is partitioned again
+ *	  on the next bits of the hash value.  Every group thus lives in exactly
+ *	  one batch.  Only when the hash bits are used up does the table grow
+ *	  beyond work_mem.
+ *
+ *	  Batch mode:
+ *
+ *	  If enable_batch_execution is on, a plain aggregate directly over a
+ *	  sequential scan may consume the scan's output a batch of rows at a
+ *	  time (see execBatch.c), bypassing the per-tuple evaluation of the
+ *	  argument expressions and transition function calls.  That is only done
+ *	  when all aggregates are count, or sum/min/max of fixed-width integer
+ *	  columns, without FILTER, DISTINCT or ORDER BY, since their transition
+ *	  functions are reimplemented here as loops over the batch's columns.
+ *	  The transition values are the same as the transition functions would
+ *	  compute, so finalization doesn't know the difference.  Anything else
+ *	  runs in the normal tuple-at-a-time mode.
+ *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -152,6 +177,7 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/htup_details.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_aggregate.h"
@@ -159,14 +185,19 @@
 #include "catalog/pg_type.h"
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
+#include "executor/nodeSeqscan.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/tlist.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "parser/parsetree.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
@@ -174,6 +205,20 @@
 #include "utils/datum.h"
 
 
+/*
+ * Transition functions that batch mode implements itself, see
+ * advance_aggregates_batch().
+ */
+typedef enum AggBatchOp
+{
+	AGG_BATCH_NONE,
+	AGG_BATCH_COUNT_STAR,		/* int8inc, i.e. count(*) */
+	AGG_BATCH_COUNT,			/* int8inc_any */
+	AGG_BATCH_SUM,				/* int2_sum, int4_sum */
+	AGG_BATCH_MIN,				/* int2/int4/int8/date_smaller */
+	AGG_BATCH_MAX				/* int2/int4/int8/date_larger */
+} AggBatchOp;
+
 /*
  * AggStatePerTransData - per aggregate state value information
  *
@@ -334,6 +379,14 @@ typedef struct AggStatePerTransData
 	FunctionCallInfoData serialfn_fcinfo;
 
 	FunctionCallInfoData deserialfn_fcinfo;
+
+	/*
+	 * In batch mode, how the transition value is advanced, and which column
+	 * of the input batch holds the aggregated argument (-1 for count(*)).
+	 */
+	AggBatchOp	batchop;
+	int			batchcol;
+	BatchValueKind batchkind;
 }	AggStatePerTransData;
 
 /*
@@ -452,6 +505,35 @@ typedef struct AggHashEntryData
 	AggStatePerGroupData pergroup[FLEXIBLE_ARRAY_MEMBER];
 }	AggHashEntryData;
 
+/*
+ * Limits on the number of partitions a spilling hash table is split into.
+ * Each open partition costs a BufFile buffer, which is not counted against
+ * work_mem.
+ */
+#define HASHAGG_MIN_PARTITIONS		8
+#define HASHAGG_MAX_PARTITIONS		256
+
+/* number of hash value bits available for choosing partitions */
+#define HASHAGG_HASH_BITS			32
+
+/* Partition files being written while the hash table is spilling */
+typedef struct HashAggSpill
+{
+	int			npartitions;	/* number of partitions, a power of 2 */
+	int			partition_bits; /* log2(npartitions) */
+	int			used_bits;		/* hash bits used up by earlier spills */
+	BufFile   **partitions;		/* files, created on first write */
+	double	   *ntuples;		/* number of tuples in each partition */
+} HashAggSpill;
+
+/* A spilled partition waiting to be aggregated */
+typedef struct HashAggBatch
+{
+	BufFile    *file;			/* input tuples, rewound for reading */
+	double		ntuples;		/* number of tuples in file */
+	int			used_bits;		/* hash bits used up by spills so far */
+} HashAggBatch;
+
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
 static void initialize_aggregates(AggState *aggstate,
@@ -461,6 +543,8 @@ static void advance_transition_function(AggState *aggstate,
 							AggStatePerTrans pertrans,
 							AggStatePerGroup pergroupstate);
 static void advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup);
+static void advance_aggregates_batch(AggState *aggstate,
+						 AggStatePerGroup pergroup);
 static void advance_combine_function(AggState *aggstate,
 						 AggStatePerTrans pertrans,
 						 AggStatePerGroup pergroupstate);
@@ -492,8 +576,21 @@ static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
 static AggHashEntry lookup_hash_entry(AggState *aggstate,
 				  TupleTableSlot *inputslot);
+static Size hash_agg_update_peak(AggState *aggstate);
+static void hash_agg_check_limits(AggState *aggstate);
+static void hash_agg_enter_spill_mode(AggState *aggstate);
+static uint32 hash_agg_spill_hash(AggState *aggstate, TupleTableSlot *slot);
+static void hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot);
+static MinimalTuple hash_agg_read_spilled_tuple(BufFile *file);
+static void hash_agg_finish_spill(AggState *aggstate);
+static void hash_agg_reset_spill(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
+static TupleTableSlot *agg_retrieve_batch(AggState *aggstate);
+static void agg_batch_init(AggState *aggstate);
+static Var *agg_batch_input_var(Plan *outerplan, Aggref *aggref);
+static void agg_hash_input_tuple(AggState *aggstate, TupleTableSlot *slot);
 static void agg_fill_hash_table(AggState *aggstate);
+static bool agg_refill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
@@ -945,6 +1042,147 @@ advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
 	}
 }
 
+/*
+ * Advance the transition values with the selected rows of the input batch,
+ * in batch mode.
+ *
+ * This does what the transition functions named in AggBatchOp would do,
+ * one column at a time.  The pass-by-value int8 transition values of
+ * count and sum are updated in place.
+ */
+#define BATCH_SUM_LOOP(getter) \
+	do { \
+		for (j = 0; j < nsel; j++) \
+		{ \
+			int			i = sel[j]; \
+			bool		notnull = !isnull[i]; \
+			\
+			sum += notnull ? (int64) getter(values[i]) : 0; \
+			count += notnull; \
+		} \
+	} while (0)
+
+#define BATCH_MINMAX_LOOP(ctype, getter, todatum, op) \
+	do { \
+		ctype		result = 0; \
+		bool		found = false; \
+		\
+		if (!pergroupstate->noTransValue) \
+		{ \
+			result = getter(pergroupstate->transValue); \
+			found = true; \
+		} \
+		for (j = 0; j < nsel; j++) \
+		{ \
+			int			i = sel[j]; \
+			ctype		v = getter(values[i]); \
+			\
+			if (!isnull[i] && (!found || v op result)) \
+			{ \
+				result = v; \
+				found = true; \
+			} \
+		} \
+		if (found) \
+		{ \
+			pergroupstate->transValue = todatum(result); \
+			pergroupstate->transValueIsNull = false; \
+			pergroupstate->noTransValue = false; \
+		} \
+	} while (0)
+
+#define BATCH_MINMAX(op) \
+	do { \
+		switch (pertrans->batchkind) \
+		{ \
+			case BATCH_INT16: \
+				BATCH_MINMAX_LOOP(int16, DatumGetInt16, Int16GetDatum, op); \
+				break; \
+			case BATCH_INT32: \
+				BATCH_MINMAX_LOOP(int32, DatumGetInt32, Int32GetDatum, op); \
+				break; \
+			case BATCH_INT64: \
+				BATCH_MINMAX_LOOP(int64, DatumGetInt64, Int64GetDatum, op); \
+				break; \
+		} \
+	} while (0)
+
+static void
+advance_aggregates_batch(AggState *aggstate, AggStatePerGroup pergroup)
+{
+	TupleBatch *batch = aggstate->batch;
+	uint16	   *sel = batch->selection;
+	int			nsel = batch->nselected;
+	int			transno;
+
+	if (nsel == 0)
+		return;
+
+	for (transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		AggStatePerGroup pergroupstate = &pergroup[transno];
+		Datum	   *values;
+		bool	   *isnull;
+		int64		count = 0;
+		int64		sum = 0;
+		int			j;
+
+		if (pertrans->batchop == AGG_BATCH_COUNT_STAR)
+		{
+			pergroupstate->transValue =
+				Int64GetDatum(DatumGetInt64(pergroupstate->transValue) + nsel);
+			continue;
+		}
+
+		values = batch->values[pertrans->batchcol];
+		isnull = batch->isnull[pertrans->batchcol];
+
+		switch (pertrans->batchop)
+		{
+			case AGG_BATCH_COUNT:
+				for (j = 0; j < nsel; j++)
+					count += !isnull[sel[j]];
+				pergroupstate->transValue =
+					Int64GetDatum(DatumGetInt64(pergroupstate->transValue) + count);
+				break;
+
+			case AGG_BATCH_SUM:
+				if (pertrans->batchkind == BATCH_INT16)
+					BATCH_SUM_LOOP(DatumGetInt16);
+				else
+					BATCH_SUM_LOOP(DatumGetInt32);
+
+				/* like int4_sum, the state stays NULL until a non-NULL input */
+				if (count == 0)
+					break;
+				if (pergroupstate->transValueIsNull)
+				{
+					pergroupstate->transValue = Int64GetDatum(sum);
+					pergroupstate->transValueIsNull = false;
+					pergroupstate->noTransValue = false;
+				}
+				else
+					pergroupstate->transValue =
+						Int64GetDatum(DatumGetInt64(pergroupstate->transValue) + sum);
+				break;
+
+			case AGG_BATCH_MIN:
+				BATCH_MINMAX(<);
+				break;
+
+			case AGG_BATCH_MAX:
+				BATCH_MINMAX(>);
+				break;
+
+			default:
+				elog(ERROR, "unexpected batch aggregate operation: %d",
+					 (int) pertrans->batchop);
+				break;
+		}
+	}
+}
+
 /*
  * combine_aggregates replaces advance_aggregates in DO_AGGSPLIT_COMBINE
  * mode.  The principal difference is that here we may need to apply the
@@ -1797,6 +2035,9 @@ hash_agg_entry_size(int numAggs)
  * Find or create a hashtable entry for the tuple group containing the
  * given tuple.
  *
+ * While the table is spilling, no new entries are created; NULL is returned
+ * for a tuple whose group isn't in the table yet.
+ *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static AggHashEntry
@@ -1825,6 +2066,12 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 		hashslot->tts_isnull[varNumber] = inputslot->tts_isnull[varNumber];
 	}
 
+	/* while spilling, only look for an existing entry */
+	if (aggstate->hash_spill != NULL)
+		return (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
+												   hashslot,
+												   NULL);
+
 	/* find or create the hashtable entry using the filtered tuple */
 	entry = (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
 												hashslot,
@@ -1834,11 +2081,275 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 	{
 		/* initialize aggregates for new tuple group */
 		initialize_aggregates(aggstate, entry->pergroup, 0);
+
+		hash_agg_check_limits(aggstate);
 	}
 
 	return entry;
 }
 
+/*
+ * Check the hash table's memory use after adding a group, and start spilling
+ * if it has grown past work_mem.
+ *
+ * Transition values that grow later are only noticed when the next group is
+ * added, which is close enough.
+ */
+static void
+hash_agg_check_limits(AggState *aggstate)
+{
+	Size		mem = hash_agg_update_peak(aggstate);
+
+	if (mem > aggstate->hash_mem_limit && aggstate->hash_spill == NULL)
+		hash_agg_enter_spill_mode(aggstate);
+}
+
+/*
+ * Return the memory used by the hash table and its transition values, and
+ * remember it for EXPLAIN ANALYZE if it is a new peak.
+ */
+static Size
+hash_agg_update_peak(AggState *aggstate)
+{
+	Size		mem;
+
+	mem = MemoryContextMemAllocated(aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
+									true);
+	if (mem > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = mem;
+
+	return mem;
+}
+
+/*
+ * Stop adding groups to the hash table, and set up partition files for the
+ * input tuples of the groups that don't fit.
+ *
+ * The number of partitions is chosen so that each should fit in memory,
+ * going by the planner's estimate of the number of groups for the original
+ * input and by the number of input tuples for a spilled batch.
+ */
+static void
+hash_agg_enter_spill_mode(AggState *aggstate)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	HashAggSpill *spill;
+	long		ngroups;
+	double		estimate;
+	int			npartitions;
+	int			partition_bits;
+
+	ngroups = hash_get_num_entries(aggstate->hashtable->hashtab);
+	if (aggstate->hash_batch_tuples < 0)
+		estimate = node->numGroups;
+	else
+		estimate = aggstate->hash_batch_tuples;
+
+	estimate = estimate / Max(ngroups, 1);
+	if (estimate < HASHAGG_MIN_PARTITIONS)
+		npartitions = HASHAGG_MIN_PARTITIONS;
+	else if (estimate > HASHAGG_MAX_PARTITIONS)
+		npartitions = HASHAGG_MAX_PARTITIONS;
+	else
+		npartitions = (int) estimate;
+	partition_bits = my_log2(npartitions);
+
+	/* If the hash bits are used up, all we can do is let the table grow */
+	if (aggstate->hash_used_bits + partition_bits > HASHAGG_HASH_BITS)
+		partition_bits = HASHAGG_HASH_BITS - aggstate->hash_used_bits;
+	if (partition_bits <= 0)
+		return;
+
+	spill = (HashAggSpill *) palloc(sizeof(HashAggSpill));
+	spill->npartitions = 1 << partition_bits;
+	spill->partition_bits = partition_bits;
+	spill->used_bits = aggstate->hash_used_bits;
+	spill->partitions = (BufFile **)
+		palloc0(spill->npartitions * sizeof(BufFile *));
+	spill->ntuples = (double *) palloc0(spill->npartitions * sizeof(double));
+
+	aggstate->hash_spill = spill;
+	aggstate->hash_spilled = true;
+}
+
+/*
+ * Compute the hash value used to partition a spilled tuple.
+ *
+ * This combines the grouping columns the same way the hash table does, and
+ * mixes the result once more so that the partitioning bits are independent
+ * of the bits the table's buckets are chosen by.
+ */
+static uint32
+hash_agg_spill_hash(AggState *aggstate, TupleTableSlot *slot)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	MemoryContext oldContext;
+	uint32		hashkey = 0;
+	int			i;
+
+	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < node->numCols; i++)
+	{
+		Datum		attr;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		attr = slot_getattr(slot, node->grpColIdx[i], &isNull);
+
+		if (!isNull)			/* treat nulls as having hash key 0 */
+			hashkey ^= DatumGetUInt32(FunctionCall1(&aggstate->hashfunctions[i],
+													attr));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return DatumGetUInt32(hash_uint32(hashkey));
+}
+
+/*
+ * Write an input tuple whose group isn't in the hash table to its partition.
+ */
+static void
+hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot)
+{
+	HashAggSpill *spill = aggstate->hash_spill;
+	MemoryContext oldContext;
+	MinimalTuple tuple;
+	uint32		hashkey;
+	int			partition;
+	size_t		written;
+
+	hashkey = hash_agg_spill_hash(aggstate, slot);
+	partition = (hashkey << spill->used_bits) >>
+		(HASHAGG_HASH_BITS - spill->partition_bits);
+
+	if (spill->partitions[partition] == NULL)
+		spill->partitions[partition] = BufFileCreateTemp(false);
+
+	/* the copy goes away when the per-input-tuple context is reset */
+	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+	tuple = ExecCopySlotMinimalTuple(slot);
+	MemoryContextSwitchTo(oldContext);
+
+	written = BufFileWrite(spill->partitions[partition], (void *) tuple,
+						   tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			errmsg("could not write to hash aggregate temporary file: %m")));
+
+	spill->ntuples[partition] += 1;
+	aggstate->hash_disk_used += tuple->t_len;
+}
+
+/*
+ * Read the next tuple of a spilled batch, or return NULL at its end.
+ *
+ * The tuple is palloc'd in the current memory context.
+ */
+static MinimalTuple
+hash_agg_read_spilled_tuple(BufFile *file)
+{
+	MinimalTuple tuple;
+	uint32		t_len;
+	size_t		nread;
+
+	nread = BufFileRead(file, (void *) &t_len, sizeof(t_len));
+	if (nread == 0)
+		return NULL;
+	if (nread != sizeof(t_len))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			 errmsg("could not read from hash aggregate temporary file: %m")));
+
+	tuple = (MinimalTuple) palloc(t_len);
+	tuple->t_len = t_len;
+	nread = BufFileRead(file, (void *) ((char *) tuple + sizeof(uint32)),
+						t_len - sizeof(uint32));
+	if (nread != t_len - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			 errmsg("could not read from hash aggregate temporary file: %m")));
+
+	return tuple;
+}
+
+/*
+ * After the hash table's input is exhausted, queue up its non-empty
+ * partitions as batches to be processed later.
+ */
+static void
+hash_agg_finish_spill(AggState *aggstate)
+{
+	HashAggSpill *spill = aggstate->hash_spill;
+	int			i;
+
+	if (spill == NULL)
+		return;
+
+	for (i = 0; i < spill->npartitions; i++)
+	{
+		HashAggBatch *batch;
+
+		if (spill->partitions[i] == NULL)
+			continue;
+
+		if (BufFileSeek(spill->partitions[i], 0, 0L, SEEK_SET))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+			  errmsg("could not rewind hash aggregate temporary file: %m")));
+
+		batch = (HashAggBatch *) palloc(sizeof(HashAggBatch));
+		batch->file = spill->partitions[i];
+		batch->ntuples = spill->ntuples[i];
+		batch->used_bits = spill->used_bits + spill->partition_bits;
+		aggstate->hash_batches = lappend(aggstate->hash_batches, batch);
+	}
+
+	pfree(spill->partitions);
+	pfree(spill->ntuples);
+	pfree(spill);
+	aggstate->hash_spill = NULL;
+}
+
+/*
+ * Close all partition files and forget any batches not yet processed.
+ */
+static void
+hash_agg_reset_spill(AggState *aggstate)
+{
+	HashAggSpill *spill = aggstate->hash_spill;
+	ListCell   *lc;
+
+	if (spill != NULL)
+	{
+		int			i;
+
+		for (i = 0; i < spill->npartitions; i++)
+		{
+			if (spill->partitions[i] != NULL)
+				BufFileClose(spill->partitions[i]);
+		}
+		pfree(spill->partitions);
+		pfree(spill->ntuples);
+		pfree(spill);
+		aggstate->hash_spill = NULL;
+	}
+
+	foreach(lc, aggstate->hash_batches)
+	{
+		HashAggBatch *batch = (HashAggBatch *) lfirst(lc);
+
+		BufFileClose(batch->file);
+		pfree(batch);
+	}
+	list_free(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+}
+
 /*
  * ExecAgg -
  *
@@ -1889,7 +2400,10 @@ ExecAgg(AggState *node)
 				result = agg_retrieve_hash_table(node);
 				break;
 			default:
-				result = agg_retrieve_direct(node);
+				if (node->batch != NULL)
+					result = agg_retrieve_batch(node);
+				else
+					result = agg_retrieve_direct(node);
 				break;
 		}
 
@@ -2224,22 +2738,83 @@ agg_retrieve_direct(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * ExecAgg for plain aggregation in batch mode.
+ *
+ * There's a single group, accumulated from all batches of the outer
+ * SeqScan.
+ */
+static TupleTableSlot *
+agg_retrieve_batch(AggState *aggstate)
+{
+	ExprContext *econtext = aggstate->ss.ps.ps_ExprContext;
+	SeqScanState *scanstate = (SeqScanState *) outerPlanState(aggstate);
+	TupleTableSlot *firstSlot = aggstate->ss.ss_ScanTupleSlot;
+
+	ReScanExprContext(econtext);
+	ReScanExprContext(aggstate->aggcontexts[0]);
+
+	initialize_aggregates(aggstate, aggstate->pergroup, 1);
+
+	while (ExecSeqScanBatch(scanstate))
+		advance_aggregates_batch(aggstate, aggstate->pergroup);
+
+	aggstate->agg_done = true;
+
+	/*
+	 * A plain aggregate can't reference non-aggregated input columns, so the
+	 * representative input tuple stays empty, as it does for empty input in
+	 * agg_retrieve_direct.
+	 */
+	ExecClearTuple(firstSlot);
+	econtext->ecxt_outertuple = firstSlot;
+
+	prepare_projection_slot(aggstate, firstSlot, 0);
+
+	finalize_aggregates(aggstate, aggstate->peragg, aggstate->pergroup, 0);
+
+	return project_aggregates(aggstate);
+}
+
+/*
+ * Aggregate one input tuple into the hash table, or spill it if its group
+ * doesn't fit.
+ */
+static void
+agg_hash_input_tuple(AggState *aggstate, TupleTableSlot *slot)
+{
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	AggHashEntry entry;
+
+	/* set up for advance_aggregates call */
+	tmpcontext->ecxt_outertuple = slot;
+
+	/* Find or build hashtable entry for this tuple's group */
+	entry = lookup_hash_entry(aggstate, slot);
+
+	if (entry == NULL)
+		hash_agg_spill_tuple(aggstate, slot);
+	else if (DO_AGGSPLIT_COMBINE(aggstate->aggsplit))
+		combine_aggregates(aggstate, entry->pergroup);
+	else
+		advance_aggregates(aggstate, entry->pergroup);
+
+	/* Reset per-input-tuple context after each tuple */
+	ResetExprContext(tmpcontext);
+}
+
 /*
  * ExecAgg for hashed case: phase 1, read input and build hash table
  */
 static void
 agg_fill_hash_table(AggState *aggstate)
 {
-	ExprContext *tmpcontext;
-	AggHashEntry entry;
 	TupleTableSlot *outerslot;
 
-	/*
-	 * get state info from node
-	 *
-	 * tmpcontext is the per-input-tuple expression context
-	 */
-	tmpcontext = aggstate->tmpcontext;
+	aggstate->hash_spilled = false;
+	aggstate->hash_used_bits = 0;
+	aggstate->hash_batch_tuples = -1;
+	aggstate->hash_batches_used++;
 
 	/*
 	 * Process each outer-plan tuple, and then fetch the next one, until we
@@ -2250,25 +2825,65 @@ agg_fill_hash_table(AggState *aggstate)
 		outerslot = fetch_input_tuple(aggstate);
 		if (TupIsNull(outerslot))
 			break;
-		/* set up for advance_aggregates call */
-		tmpcontext->ecxt_outertuple = outerslot;
 
-		/* Find or build hashtable entry for this tuple's group */
-		entry = lookup_hash_entry(aggstate, outerslot);
+		agg_hash_input_tuple(aggstate, outerslot);
+	}
 
-		/* Advance the aggregates */
-		if (DO_AGGSPLIT_COMBINE(aggstate->aggsplit))
-			combine_aggregates(aggstate, entry->pergroup);
-		else
-			advance_aggregates(aggstate, entry->pergroup);
+	hash_agg_update_peak(aggstate);
+	hash_agg_finish_spill(aggstate);
+
+	aggstate->table_filled = true;
+	/* Initialize to walk the hash table */
+	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
+}
+
+/*
+ * ExecAgg for hashed case: rebuild the hash table from the next spilled
+ * batch, after all groups of the previous one have been returned.
+ *
+ * Returns false if there are no more batches.
+ */
+static bool
+agg_refill_hash_table(AggState *aggstate)
+{
+	HashAggBatch *batch;
+	MinimalTuple tuple;
 
-		/* Reset per-input-tuple context after each tuple */
-		ResetExprContext(tmpcontext);
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	batch = (HashAggBatch *) linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+
+	/*
+	 * Throw away the groups already returned.  As in ExecReScanAgg, we use
+	 * rescan so that any shutdown callbacks of the transition functions run.
+	 */
+	ExecClearTuple(aggstate->ss.ss_ScanTupleSlot);
+	ReScanExprContext(aggstate->aggcontexts[0]);
+	build_hash_table(aggstate);
+
+	aggstate->hash_used_bits = batch->used_bits;
+	aggstate->hash_batch_tuples = batch->ntuples;
+	aggstate->hash_batches_used++;
+
+	while ((tuple = hash_agg_read_spilled_tuple(batch->file)) != NULL)
+	{
+		ExecStoreMinimalTuple(tuple, aggstate->hash_spill_slot, true);
+		agg_hash_input_tuple(aggstate, aggstate->hash_spill_slot);
 	}
 
-	aggstate->table_filled = true;
+	ExecClearTuple(aggstate->hash_spill_slot);
+	BufFileClose(batch->file);
+	pfree(batch);
+
+	hash_agg_update_peak(aggstate);
+	hash_agg_finish_spill(aggstate);
+
 	/* Initialize to walk the hash table */
 	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
+
+	return true;
 }
 
 /*
@@ -2304,6 +2919,10 @@ agg_retrieve_hash_table(AggState *aggstate)
 		entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
 		if (entry == NULL)
 		{
+			/* Go on with the next spilled batch, if there is one */
+			if (agg_refill_hash_table(aggstate))
+				continue;
+
 			/* No more entries in hashtable, so done */
 			aggstate->agg_done = TRUE;
 			return NULL;
@@ -2397,6 +3016,12 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->pergroup = NULL;
 	aggstate->grp_firstTuple = NULL;
 	aggstate->hashtable = NULL;
+	aggstate->hash_mem_limit = work_mem * 1024L;
+	aggstate->hash_spill = NULL;
+	aggstate->hash_batches = NIL;
+	aggstate->hash_batches_used = 0;
+	aggstate->hash_mem_peak = 0;
+	aggstate->hash_disk_used = 0;
 	aggstate->sort_in = NULL;
 	aggstate->sort_out = NULL;
 
@@ -2636,6 +3261,10 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		aggstate->table_filled = false;
 		/* Compute the columns we actually need to hash on */
 		aggstate->hash_needed = find_hash_columns(aggstate);
+		/* Spilled input tuples are read back into this slot */
+		aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(aggstate->hash_spill_slot,
+						 aggstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
 	}
 	else
 	{
@@ -2949,9 +3578,144 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->numaggs = aggno + 1;
 	aggstate->numtrans = transno + 1;
 
+	/* consume the input in batches, if possible */
+	agg_batch_init(aggstate);
+
 	return aggstate;
 }
 
+/*
+ * Switch the node to batch mode, if enabled and both the aggregates and the
+ * input allow it.
+ */
+static void
+agg_batch_init(AggState *aggstate)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	PlanState  *outerstate = outerPlanState(aggstate);
+	List	   *attnos = NIL;
+	TupleBatch *batch;
+	int			transno;
+
+	if (!enable_batch_execution)
+		return;
+
+	if (node->aggstrategy != AGG_PLAIN ||
+		aggstate->numphases > 1 ||
+		aggstate->phase->numsets > 0 ||
+		DO_AGGSPLIT_COMBINE(aggstate->aggsplit) ||
+		aggstate->numtrans == 0 ||
+		!IsA(outerstate, SeqScanState))
+		return;
+
+	for (transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		Aggref	   *aggref = pertrans->aggref;
+		AggBatchOp	op;
+		Var		   *var;
+
+		if (aggref->aggfilter != NULL ||
+			aggref->aggdistinct != NIL ||
+			aggref->aggorder != NIL ||
+			aggref->aggkind != AGGKIND_NORMAL)
+			return;
+
+		switch (pertrans->transfn_oid)
+		{
+			case F_INT8INC:
+				op = AGG_BATCH_COUNT_STAR;
+				break;
+			case F_INT8INC_ANY:
+				op = AGG_BATCH_COUNT;
+				break;
+			case F_INT2_SUM:
+			case F_INT4_SUM:
+				op = AGG_BATCH_SUM;
+				break;
+			case F_INT2SMALLER:
+			case F_INT4SMALLER:
+			case F_INT8SMALLER:
+			case F_DATE_SMALLER:
+				op = AGG_BATCH_MIN;
+				break;
+			case F_INT2LARGER:
+			case F_INT4LARGER:
+			case F_INT8LARGER:
+			case F_DATE_LARGER:
+				op = AGG_BATCH_MAX;
+				break;
+			default:
+				return;
+		}
+
+		/* count and sum keep an int8 state, which we update in place */
+		if ((op == AGG_BATCH_COUNT_STAR || op == AGG_BATCH_COUNT ||
+			 op == AGG_BATCH_SUM) && !pertrans->transtypeByVal)
+			return;
+
+		pertrans->batchop = op;
+		pertrans->batchcol = -1;
+		if (op == AGG_BATCH_COUNT_STAR)
+			continue;
+
+		var = agg_batch_input_var(outerstate->plan, aggref);
+		if (var == NULL)
+			return;
+		if (op != AGG_BATCH_COUNT &&
+			!ExecBatchValueKind(var->vartype, &pertrans->batchkind))
+			return;
+
+		/* for now, remember the attribute number */
+		pertrans->batchcol = var->varattno;
+		attnos = lappend_int(attnos, var->varattno);
+	}
+
+	batch = ExecSeqScanInitBatch((SeqScanState *) outerstate, attnos);
+	if (batch == NULL)
+		return;
+
+	for (transno = 0; transno < aggstate->numtrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+
+		if (pertrans->batchcol > 0)
+			pertrans->batchcol = ExecBatchAddColumn(batch,
+												(AttrNumber) pertrans->batchcol);
+	}
+
+	aggstate->batch = batch;
+}
+
+/*
+ * Return the column of the scan relation an aggregate's single argument
+ * refers to, or NULL if the argument is anything else.
+ */
+static Var *
+agg_batch_input_var(Plan *outerplan, Aggref *aggref)
+{
+	TargetEntry *tle;
+	Var		   *var;
+
+	if (list_length(aggref->args) != 1)
+		return NULL;
+	tle = (TargetEntry *) linitial(aggref->args);
+	var = (Var *) tle->expr;
+	if (!IsA(var, Var) || var->varno != OUTER_VAR)
+		return NULL;
+
+	/* look through the outer plan's tlist */
+	tle = get_tle_by_resno(outerplan->targetlist, var->varattno);
+	if (tle == NULL || !IsA(tle->expr, Var))
+		return NULL;
+	var = (Var *) tle->expr;
+	if (var->varno != ((Scan *) outerplan)->scanrelid ||
+		var->varlevelsup != 0 || var->varattno <= 0)
+		return NULL;
+
+	return var;
+}
+
 /*
  * Build the state needed to calculate a state value for an aggregate.
  *
@@ -3425,6 +4189,9 @@ ExecEndAgg(AggState *node)
 	if (node->sort_out)
 		tuplesort_end(node->sort_out);
 
+	/* ... and any files of a spilled hash table */
+	hash_agg_reset_spill(node);
+
 	for (transno = 0; transno < node->numtrans; transno++)
 	{
 		AggStatePerTrans pertrans = &node->pertrans[transno];
@@ -3483,14 +4250,19 @@ ExecReScanAgg(AggState *node)
 		 * If we do have the hash table, and the subplan does not have any
 		 * parameter changes, and none of our own parameter changes affect
 		 * input expressions of the aggregated functions, then we can just
-		 * rescan the existing hash table; no need to build it again.
+		 * rescan the existing hash table; no need to build it again.  That
+		 * doesn't work if the table spilled, since it then holds only the
+		 * groups of the last batch.
 		 */
 		if (outerPlan->chgParam == NULL &&
-			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams))
+			!bms_overlap(node->ss.ps.chgParam, aggnode->aggParams) &&
+			!node->hash_spilled)
 		{
 			ResetTupleHashIterator(node->hashtable, &node->hashiter);
 			return;
 		}
+
+		hash_agg_reset_spill(node);
 	}
 
 	/* Make sure we have closed any open tuplesorts */
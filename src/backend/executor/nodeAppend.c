@@ -53,14 +53,40 @@
  *			  nil	nil		 Scan	 Scan	  Scan	   Scan
  *							  |		  |		   |		|
  *							person employee student student-emp
+ *
+ *		If some of the subplans are foreign scans whose FDW can fetch
+ *		rows asynchronously, those are all started at once, and rows are
+ *		returned from whichever of them has some ready; the other
+ *		subplans are run in order while the asynchronous ones have
+ *		nothing to offer.  The order of the output rows then depends on
+ *		how quickly the remote servers answer.
+ *
+ *		When scanning an inheritance tree whose restrictions on the
+ *		partition key could not be evaluated by the planner, because they
+ *		compare with a parameter or a stable function, the planner passes
+ *		them on and ExecInitAppend evaluates them to skip the subplans of
+ *		the children that cannot hold any matching rows.
  */
 
 #include "postgres.h"
 
 #include "executor/execdebug.h"
 #include "executor/nodeAppend.h"
+#include "foreign/fdwapi.h"
+#include "miscadmin.h"
+#include "storage/latch.h"
+#include "utils/partmap.h"
+
+/* GUC parameter */
+bool		enable_async_append = true;
 
 static bool exec_append_initialize_next(AppendState *appendstate);
+static bool *exec_append_prune(Append *node, EState *estate);
+static bool exec_append_async_capable(PlanState *subnode);
+static TupleTableSlot *exec_append_async(AppendState *node);
+static TupleTableSlot *exec_append_async_poll(AppendState *node);
+static void exec_append_async_wait(AppendState *node);
+static void exec_append_next_sync(AppendState *node);
 
 
 /* ----------------------------------------------------------------
@@ -105,6 +131,86 @@ exec_append_initialize_next(AppendState *appendstate)
 	}
 }
 
+/* ----------------------------------------------------------------
+ *		exec_append_prune
+ *
+ *		Evaluates the run-time partition pruning restrictions of the
+ *		append node, if any.  Returns an array telling which subplans
+ *		can produce rows, or NULL if all of them must be run.
+ * ----------------------------------------------------------------
+ */
+static bool *
+exec_append_prune(Append *node, EState *estate)
+{
+	PartitionMap *map;
+	ExprContext *econtext;
+	StrategyNumber *strategies;
+	Datum	   *values;
+	bool	   *live;
+	bool	   *result;
+	int			nquals;
+	int			i;
+	ListCell   *lc;
+	ListCell   *lc2;
+
+	if (!OidIsValid(node->part_relid))
+		return NULL;
+
+	nquals = list_length(node->part_exprs);
+	strategies = (StrategyNumber *) palloc(nquals * sizeof(StrategyNumber));
+	values = (Datum *) palloc(nquals * sizeof(Datum));
+
+	econtext = CreateExprContext(estate);
+	i = 0;
+	forboth(lc, node->part_strategies, lc2, node->part_exprs)
+	{
+		ExprState  *exprstate;
+		bool		isnull;
+
+		exprstate = ExecInitExpr((Expr *) lfirst(lc2), NULL);
+		values[i] = ExecEvalExprSwitchContext(exprstate, econtext,
+											  &isnull, NULL);
+		if (isnull)
+		{
+			/* the restriction is never true, but leave that to the scans */
+			FreeExprContext(econtext, true);
+			return NULL;
+		}
+		strategies[i] = (StrategyNumber) lfirst_int(lc);
+		i++;
+	}
+
+	/*
+	 * Fetch the map only now, as evaluating the expressions could have
+	 * invalidated it.  The children's constraints might have changed since
+	 * the plan was made, so only trust it if it still uses the same key.
+	 */
+	map = GetPartitionMap(node->part_relid, node->part_childoids);
+	if (map->keyattno != node->part_keyattno)
+		live = NULL;
+	else
+		live = PartitionMapPrune(map, nquals, strategies, values);
+	if (live == NULL)
+	{
+		FreeExprContext(econtext, true);
+		return NULL;
+	}
+
+	result = (bool *) palloc(list_length(node->appendplans) * sizeof(bool));
+	i = 0;
+	foreach(lc, node->part_childoids)
+	{
+		int			child = PartitionMapFindChild(map, lfirst_oid(lc));
+
+		result[i++] = (child < 0 || live[child]);
+	}
+
+	/* the datums might be pass-by-reference, so free them only now */
+	FreeExprContext(econtext, true);
+
+	return result;
+}
+
 /* ----------------------------------------------------------------
  *		ExecInitAppend
  *
@@ -121,17 +227,40 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 {
 	AppendState *appendstate = makeNode(AppendState);
 	PlanState **appendplanstates;
+	bool	   *validplans;
 	int			nplans;
 	int			i;
+	int			j;
 	ListCell   *lc;
 
 	/* check for unsupported flags */
 	Assert(!(eflags & EXEC_FLAG_MARK));
 
 	/*
-	 * Set up empty vector of subplan states
+	 * Find out which subplans the partition key restrictions leave, and set
+	 * up empty vector of subplan states for them.  If there are none, still
+	 * initialize the first one, so that EXPLAIN can show the target list;
+	 * its own quals keep it from returning anything.
 	 */
 	nplans = list_length(node->appendplans);
+	validplans = exec_append_prune(node, estate);
+	if (validplans != NULL)
+	{
+		int			nvalid = 0;
+
+		for (i = 0; i < nplans; i++)
+		{
+			if (validplans[i])
+				nvalid++;
+		}
+		if (nvalid == 0 && nplans > 0)
+		{
+			validplans[0] = true;
+			nvalid = 1;
+		}
+		appendstate->as_nprunedplans = nplans - nvalid;
+		nplans = nvalid;
+	}
 
 	appendplanstates = (PlanState **) palloc0(nplans * sizeof(PlanState *));
 
@@ -161,12 +290,42 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	 * results into the array "appendplans".
 	 */
 	i = 0;
+	j = 0;
 	foreach(lc, node->appendplans)
 	{
 		Plan	   *initNode = (Plan *) lfirst(lc);
 
-		appendplanstates[i] = ExecInitNode(initNode, estate, eflags);
-		i++;
+		if (validplans == NULL || validplans[j])
+			appendplanstates[i++] = ExecInitNode(initNode, estate, eflags);
+		j++;
+	}
+
+	/*
+	 * Decide which subplans, if any, to run asynchronously.  That reorders
+	 * the output rows, so don't do it if we might be asked to scan backward,
+	 * nor while rechecking a row for EvalPlanQual.  It's also pointless
+	 * unless there's something to overlap the asynchronous subplans with.
+	 */
+	appendstate->as_asyncplans = (bool *) palloc0(nplans * sizeof(bool));
+	if (enable_async_append && nplans > 1 &&
+		!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_EXPLAIN_ONLY)) &&
+		estate->es_epqTuple == NULL)
+	{
+		for (i = 0; i < nplans; i++)
+		{
+			if (exec_append_async_capable(appendplanstates[i]))
+			{
+				appendstate->as_asyncplans[i] = true;
+				appendstate->as_nasyncplans++;
+			}
+		}
+	}
+	if (appendstate->as_nasyncplans > 0)
+	{
+		appendstate->as_asyncdone = (bool *) palloc0(nplans * sizeof(bool));
+		appendstate->as_nasyncremaining = appendstate->as_nasyncplans;
+		appendstate->as_waitsocks =
+			(pgsocket *) palloc(nplans * sizeof(pgsocket));
 	}
 
 	/*
@@ -179,7 +338,10 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	 * initialize to scan first subplan
 	 */
 	appendstate->as_whichplan = 0;
-	exec_append_initialize_next(appendstate);
+	if (appendstate->as_nasyncplans > 0)
+		exec_append_next_sync(appendstate);
+	else
+		exec_append_initialize_next(appendstate);
 
 	return appendstate;
 }
@@ -193,6 +355,9 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 TupleTableSlot *
 ExecAppend(AppendState *node)
 {
+	if (node->as_nasyncplans > 0)
+		return exec_append_async(node);
+
 	for (;;)
 	{
 		PlanState  *subnode;
@@ -286,5 +451,169 @@ ExecReScanAppend(AppendState *node)
 			ExecReScan(subnode);
 	}
 	node->as_whichplan = 0;
-	exec_append_initialize_next(node);
+	if (node->as_nasyncplans > 0)
+	{
+		memset(node->as_asyncdone, 0, node->as_nplans * sizeof(bool));
+		node->as_nasyncremaining = node->as_nasyncplans;
+		node->as_nextasync = 0;
+		exec_append_next_sync(node);
+	}
+	else
+		exec_append_initialize_next(node);
+}
+
+/*
+ * Can this subplan be run asynchronously?
+ */
+static bool
+exec_append_async_capable(PlanState *subnode)
+{
+	ForeignScanState *fsstate;
+
+	if (!IsA(subnode, ForeignScanState))
+		return false;
+	fsstate = (ForeignScanState *) subnode;
+
+	/* Foreign scans that modify the table directly don't return rows */
+	if (((ForeignScan *) fsstate->ss.ps.plan)->operation != CMD_SELECT)
+		return false;
+
+	return fsstate->fdwroutine->ForeignAsyncPoll != NULL &&
+		fsstate->fdwroutine->IsForeignScanAsyncCapable != NULL &&
+		fsstate->fdwroutine->IsForeignScanAsyncCapable(fsstate);
+}
+
+/*
+ * ExecAppend for an Append with asynchronous subplans.
+ *
+ * We prefer rows from the asynchronous subplans, since returning those
+ * lets their FDWs send off the next request early.  When none of them has
+ * a row ready, we run the current synchronous subplan for a row instead,
+ * and only when those are all exhausted do we sleep until some remote
+ * server answers.
+ */
+static TupleTableSlot *
+exec_append_async(AppendState *node)
+{
+	for (;;)
+	{
+		TupleTableSlot *result;
+
+		if (node->as_nasyncremaining > 0)
+		{
+			result = exec_append_async_poll(node);
+			if (result != NULL)
+				return result;
+		}
+
+		if (node->as_whichplan < node->as_nplans)
+		{
+			result = ExecProcNode(node->appendplans[node->as_whichplan]);
+			if (!TupIsNull(result))
+				return result;
+
+			node->as_whichplan++;
+			exec_append_next_sync(node);
+			continue;
+		}
+
+		if (node->as_nasyncremaining == 0)
+			return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+		exec_append_async_wait(node);
+	}
+}
+
+/*
+ * Return a row from any asynchronous subplan that can produce one without
+ * waiting, or NULL if there's none.  In the latter case, the sockets the
+ * subplans are waiting on are left in as_waitsocks.
+ */
+static TupleTableSlot *
+exec_append_async_poll(AppendState *node)
+{
+	int			nplans = node->as_nplans;
+	int			k;
+
+	node->as_nwait = 0;
+
+	/* Start with the subplan we got a row from last time */
+	for (k = 0; k < nplans; k++)
+	{
+		int			i = (node->as_nextasync + k) % nplans;
+		ForeignScanState *fsstate;
+		TupleTableSlot *result;
+		pgsocket	sock;
+
+		if (!node->as_asyncplans[i] || node->as_asyncdone[i])
+			continue;
+
+		fsstate = (ForeignScanState *) node->appendplans[i];
+		if (!fsstate->fdwroutine->ForeignAsyncPoll(fsstate, &sock))
+		{
+			node->as_waitsocks[node->as_nwait++] = sock;
+			continue;
+		}
+
+		result = ExecProcNode(&fsstate->ss.ps);
+		if (!TupIsNull(result))
+		{
+			node->as_nextasync = i;
+			return result;
+		}
+
+		node->as_asyncdone[i] = true;
+		node->as_nasyncremaining--;
+	}
+
+	return NULL;
+}
+
+/*
+ * Sleep until one of the sockets found by exec_append_async_poll becomes
+ * readable, or our latch is set.
+ */
+static void
+exec_append_async_wait(AppendState *node)
+{
+	WaitEventSet *set;
+	WaitEvent	event;
+	int			i,
+				j;
+
+	set = CreateWaitEventSet(CurrentMemoryContext, node->as_nwait + 1);
+	AddWaitEventToSet(set, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	for (i = 0; i < node->as_nwait; i++)
+	{
+		/* Subplans sharing a connection report the same socket */
+		for (j = 0; j < i; j++)
+		{
+			if (node->as_waitsocks[j] == node->as_waitsocks[i])
+				break;
+		}
+		if (j == i)
+			AddWaitEventToSet(set, WL_SOCKET_READABLE, node->as_waitsocks[i],
+							  NULL, NULL);
+	}
+
+	(void) WaitEventSetWait(set, -1L, &event, 1);
+	FreeWaitEventSet(set);
+
+	if (event.events & WL_LATCH_SET)
+	{
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Advance as_whichplan to the next synchronous subplan, if any remain;
+ * otherwise it ends up equal to as_nplans.
+ */
+static void
+exec_append_next_sync(AppendState *node)
+{
+	while (node->as_whichplan < node->as_nplans &&
+		   node->as_asyncplans[node->as_whichplan])
+		node->as_whichplan++;
 }
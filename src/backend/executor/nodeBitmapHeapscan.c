@@ -32,16 +32,27 @@
  *		ExecInitBitmapHeapScan		creates and initializes state info.
  *		ExecReScanBitmapHeapScan	prepares to rescan the plan.
  *		ExecEndBitmapHeapScan		releases all storage.
+ *		ExecBitmapHeapEstimate		estimates DSM space needed for
+ *						parallel bitmap heap scan
+ *		ExecBitmapHeapInitializeDSM	initialize DSM for parallel
+ *						bitmap heap scan
+ *		ExecBitmapHeapReInitializeDSM	reinitialize DSM for fresh scan
+ *		ExecBitmapHeapInitializeWorker	attach to DSM info in parallel worker
  */
 #include "postgres.h"
 
 #include "access/relscan.h"
 #include "access/transam.h"
+#include "commands/tablespace.h"
 #include "executor/execdebug.h"
 #include "executor/nodeBitmapHeapscan.h"
+#include "miscadmin.h"
 #include "pgstat.h"
+#include "storage/buffile.h"
 #include "storage/bufmgr.h"
 #include "storage/predicate.h"
+#include "storage/proc.h"
+#include "storage/spin.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/spccache.h"
@@ -49,8 +60,59 @@
 #include "utils/tqual.h"
 
 
+/*
+ * Shared state of a parallel bitmap heap scan.
+ *
+ * The first participant to arrive runs the bitmap index scans and writes the
+ * pages of the resulting bitmap to two shared temporary files: the index
+ * file holds one fixed-size BitmapHeapSharedPage per page, in block order,
+ * and the data file holds the tuple offsets of the exact pages.  The other
+ * participants wait on their latches until that is done; pbhs_waiters holds
+ * the pgprocnos of those to wake up.  Then all of them claim pages one at a
+ * time, by bumping pbhs_nextpage.
+ */
+typedef enum
+{
+	BM_INITIAL,					/* nobody has started building the bitmap */
+	BM_INPROGRESS,				/* somebody is building it */
+	BM_FINISHED					/* the bitmap files are complete */
+} SharedBitmapState;
+
+typedef struct ParallelBitmapHeapState
+{
+	slock_t		pbhs_mutex;		/* protects everything below */
+	SharedBitmapState pbhs_state;	/* progress of building the bitmap */
+	int64		pbhs_npages;	/* number of pages in the bitmap */
+	int64		pbhs_nextpage;	/* next page to hand out */
+	Oid			pbhs_tablespace;	/* where the bitmap files are */
+	int			pbhs_leader_pid;	/* with pbhs_fileset, names the files */
+	uint32		pbhs_fileset;
+	int			pbhs_nparticipants;	/* allocated length of pbhs_waiters */
+	int			pbhs_nwaiters;	/* number of entries in pbhs_waiters */
+	int			pbhs_waiters[FLEXIBLE_ARRAY_MEMBER];
+} ParallelBitmapHeapState;
+
+/* an entry of the index file of a parallel bitmap heap scan */
+typedef struct BitmapHeapSharedPage
+{
+	BlockNumber blockno;		/* page number containing tuples */
+	int16		ntuples;		/* -1 indicates lossy result */
+	bool		recheck;		/* should the tuples be rechecked? */
+	uint64		dataoff;		/* where the tuple offsets are in data file */
+} BitmapHeapSharedPage;
+
 static TupleTableSlot *BitmapHeapNext(BitmapHeapScanState *node);
 static void bitgetpage(HeapScanDesc scan, TBMIterateResult *tbmres);
+static void BitmapHeapParallelBegin(BitmapHeapScanState *node);
+static void BitmapHeapBuildShared(BitmapHeapScanState *node);
+static TBMIterateResult *BitmapHeapParallelIterate(BitmapHeapScanState *node);
+static void BitmapHeapFileName(char *name, ParallelBitmapHeapState *pstate,
+				   bool index);
+static void BitmapHeapSeekFile(BufFile *file, uint64 offset);
+static void BitmapHeapReadFile(BufFile *file, void *ptr, size_t size);
+static void BitmapHeapCloseFiles(BitmapHeapScanState *node);
+static void BitmapHeapDeleteFiles(ParallelBitmapHeapState *pstate);
+static void ExecBitmapHeapDetach(dsm_segment *seg, Datum arg);
 
 
 /* ----------------------------------------------------------------
@@ -98,8 +160,19 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	 * desired prefetch distance, which starts small and increases up to the
 	 * node->prefetch_maximum.  This is to avoid doing a lot of prefetching in
 	 * a scan that stops after a few tuples because of a LIMIT.
+	 *
+	 * A parallel scan gets its pages from the bitmap shared by all the
+	 * participants instead, and doesn't prefetch.
 	 */
-	if (tbm == NULL)
+	if (node->pstate != NULL)
+	{
+		if (!node->pinitialized)
+		{
+			BitmapHeapParallelBegin(node);
+			node->tbmres = tbmres = NULL;
+		}
+	}
+	else if (tbm == NULL)
 	{
 		tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
 
@@ -130,7 +203,10 @@ BitmapHeapNext(BitmapHeapScanState *node)
 		 */
 		if (tbmres == NULL)
 		{
-			node->tbmres = tbmres = tbm_iterate(tbmiterator);
+			if (node->pstate != NULL)
+				node->tbmres = tbmres = BitmapHeapParallelIterate(node);
+			else
+				node->tbmres = tbmres = tbm_iterate(tbmiterator);
 			if (tbmres == NULL)
 			{
 				/* no more entries in the bitmap */
@@ -409,6 +485,260 @@ bitgetpage(HeapScanDesc scan, TBMIterateResult *tbmres)
 	scan->rs_ntuples = ntup;
 }
 
+/*
+ * BitmapHeapParallelBegin - join the shared bitmap of a parallel scan
+ *
+ * The first participant to get here builds the bitmap, the others wait for
+ * it to be done.  Then open the bitmap files for reading.
+ */
+static void
+BitmapHeapParallelBegin(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+	char		name[MAXPGPATH];
+	bool		build = false;
+
+	for (;;)
+	{
+		bool		exit_loop = false;
+
+		SpinLockAcquire(&pstate->pbhs_mutex);
+		if (pstate->pbhs_state == BM_INITIAL)
+		{
+			pstate->pbhs_state = BM_INPROGRESS;
+			build = true;
+			exit_loop = true;
+		}
+		else if (pstate->pbhs_state == BM_FINISHED)
+			exit_loop = true;
+		else
+		{
+			/* Somebody else is building the bitmap; ask to be woken up. */
+			int			i;
+
+			for (i = 0; i < pstate->pbhs_nwaiters; i++)
+			{
+				if (pstate->pbhs_waiters[i] == MyProc->pgprocno)
+					break;
+			}
+			if (i == pstate->pbhs_nwaiters &&
+				pstate->pbhs_nwaiters < pstate->pbhs_nparticipants)
+				pstate->pbhs_waiters[pstate->pbhs_nwaiters++] =
+					MyProc->pgprocno;
+		}
+		SpinLockRelease(&pstate->pbhs_mutex);
+		if (exit_loop)
+			break;
+
+		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	if (build)
+		BitmapHeapBuildShared(node);
+
+	BitmapHeapFileName(name, pstate, true);
+	node->pindexfile = BufFileOpenShared(pstate->pbhs_tablespace, name);
+	BitmapHeapFileName(name, pstate, false);
+	node->pdatafile = BufFileOpenShared(pstate->pbhs_tablespace, name);
+	if (node->pindexfile == NULL || node->pdatafile == NULL)
+		elog(ERROR, "could not open shared bitmap files");
+
+	if (node->ptbmres == NULL)
+		node->ptbmres = (TBMIterateResult *)
+			MemoryContextAlloc(node->ss.ps.state->es_query_cxt,
+							   offsetof(TBMIterateResult, offsets) +
+							   MaxHeapTuplesPerPage * sizeof(OffsetNumber));
+
+	node->pinitialized = true;
+}
+
+/*
+ * BitmapHeapBuildShared - build the shared bitmap of a parallel scan
+ *
+ * Run the bitmap index scans, write the pages of their result to the bitmap
+ * files, and wake up the participants waiting for that.
+ */
+static void
+BitmapHeapBuildShared(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+	TIDBitmap  *tbm;
+	TBMIterator *iterator;
+	TBMIterateResult *tbmres;
+	BufFile    *indexfile;
+	BufFile    *datafile;
+	char		name[MAXPGPATH];
+	int64		npages = 0;
+	uint64		dataoff = 0;
+
+	tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
+
+	if (!tbm || !IsA(tbm, TIDBitmap))
+		elog(ERROR, "unrecognized result from subplan");
+
+	BitmapHeapFileName(name, pstate, true);
+	indexfile = BufFileCreateShared(pstate->pbhs_tablespace, name);
+	BitmapHeapFileName(name, pstate, false);
+	datafile = BufFileCreateShared(pstate->pbhs_tablespace, name);
+
+	iterator = tbm_begin_iterate(tbm);
+	while ((tbmres = tbm_iterate(iterator)) != NULL)
+	{
+		BitmapHeapSharedPage page;
+
+		page.blockno = tbmres->blockno;
+		page.ntuples = (int16) tbmres->ntuples;
+		page.recheck = tbmres->recheck;
+		page.dataoff = dataoff;
+
+		if (BufFileWrite(indexfile, &page, sizeof(page)) != sizeof(page))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+				errmsg("could not write to bitmap heap scan temporary file: %m")));
+		if (tbmres->ntuples > 0)
+		{
+			size_t		size = tbmres->ntuples * sizeof(OffsetNumber);
+
+			if (BufFileWrite(datafile, tbmres->offsets, size) != size)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+				errmsg("could not write to bitmap heap scan temporary file: %m")));
+			dataoff += size;
+		}
+		npages++;
+	}
+	tbm_end_iterate(iterator);
+	tbm_free(tbm);
+
+	BufFileClose(indexfile);
+	BufFileClose(datafile);
+
+	SpinLockAcquire(&pstate->pbhs_mutex);
+	pstate->pbhs_npages = npages;
+	pstate->pbhs_state = BM_FINISHED;
+	SpinLockRelease(&pstate->pbhs_mutex);
+
+	/* Wake up everybody who waited for the bitmap. */
+	for (;;)
+	{
+		int			procno = -1;
+
+		SpinLockAcquire(&pstate->pbhs_mutex);
+		if (pstate->pbhs_nwaiters > 0)
+			procno = pstate->pbhs_waiters[--pstate->pbhs_nwaiters];
+		SpinLockRelease(&pstate->pbhs_mutex);
+
+		if (procno < 0)
+			break;
+		SetLatch(&ProcGlobal->allProcs[procno].procLatch);
+	}
+}
+
+/*
+ * BitmapHeapParallelIterate - claim the next page of a parallel scan
+ *
+ * Returns NULL when all the pages of the bitmap have been handed out.
+ */
+static TBMIterateResult *
+BitmapHeapParallelIterate(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+	TBMIterateResult *tbmres = node->ptbmres;
+	BitmapHeapSharedPage page;
+	int64		pageno;
+
+	SpinLockAcquire(&pstate->pbhs_mutex);
+	if (pstate->pbhs_nextpage >= pstate->pbhs_npages)
+	{
+		SpinLockRelease(&pstate->pbhs_mutex);
+		return NULL;
+	}
+	pageno = pstate->pbhs_nextpage++;
+	SpinLockRelease(&pstate->pbhs_mutex);
+
+	BitmapHeapSeekFile(node->pindexfile, pageno * sizeof(page));
+	BitmapHeapReadFile(node->pindexfile, &page, sizeof(page));
+
+	tbmres->blockno = page.blockno;
+	tbmres->ntuples = page.ntuples;
+	tbmres->recheck = page.recheck;
+	if (page.ntuples > 0)
+	{
+		BitmapHeapSeekFile(node->pdatafile, page.dataoff);
+		BitmapHeapReadFile(node->pdatafile, tbmres->offsets,
+						   page.ntuples * sizeof(OffsetNumber));
+	}
+
+	return tbmres;
+}
+
+/*
+ * BitmapHeapFileName - build the name of one of the shared bitmap files
+ */
+static void
+BitmapHeapFileName(char *name, ParallelBitmapHeapState *pstate, bool index)
+{
+	snprintf(name, MAXPGPATH, "%d.pbhs%u.%c",
+			 pstate->pbhs_leader_pid, pstate->pbhs_fileset,
+			 index ? 'i' : 'd');
+}
+
+/*
+ * BitmapHeapSeekFile - seek to a byte offset in one of the bitmap files
+ */
+static void
+BitmapHeapSeekFile(BufFile *file, uint64 offset)
+{
+	if (BufFileSeekBlock(file, (long) (offset / BLCKSZ)) != 0 ||
+		BufFileSeek(file, 0, (off_t) (offset % BLCKSZ), SEEK_CUR) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			errmsg("could not seek in bitmap heap scan temporary file: %m")));
+}
+
+/*
+ * BitmapHeapReadFile - read from one of the bitmap files
+ */
+static void
+BitmapHeapReadFile(BufFile *file, void *ptr, size_t size)
+{
+	if (BufFileRead(file, ptr, size) != size)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			errmsg("could not read from bitmap heap scan temporary file: %m")));
+}
+
+/*
+ * BitmapHeapCloseFiles - close our handles of the shared bitmap files
+ */
+static void
+BitmapHeapCloseFiles(BitmapHeapScanState *node)
+{
+	if (node->pindexfile)
+		BufFileClose(node->pindexfile);
+	if (node->pdatafile)
+		BufFileClose(node->pdatafile);
+	node->pindexfile = NULL;
+	node->pdatafile = NULL;
+	node->pinitialized = false;
+}
+
+/*
+ * BitmapHeapDeleteFiles - remove the shared bitmap files, if they exist
+ */
+static void
+BitmapHeapDeleteFiles(ParallelBitmapHeapState *pstate)
+{
+	char		name[MAXPGPATH];
+
+	BitmapHeapFileName(name, pstate, true);
+	BufFileDeleteShared(pstate->pbhs_tablespace, name);
+	BitmapHeapFileName(name, pstate, false);
+	BufFileDeleteShared(pstate->pbhs_tablespace, name);
+}
+
 /*
  * BitmapHeapRecheck -- access method routine to recheck a tuple in EvalPlanQual
  */
@@ -454,6 +784,9 @@ ExecReScanBitmapHeapScan(BitmapHeapScanState *node)
 	/* rescan to release any page pin */
 	heap_rescan(node->ss.ss_currentScanDesc, NULL);
 
+	/* the shared state is reset by ExecBitmapHeapReInitializeDSM */
+	BitmapHeapCloseFiles(node);
+
 	if (node->tbmiterator)
 		tbm_end_iterate(node->tbmiterator);
 	if (node->prefetch_iterator)
@@ -516,6 +849,7 @@ ExecEndBitmapHeapScan(BitmapHeapScanState *node)
 		tbm_end_iterate(node->prefetch_iterator);
 	if (node->tbm)
 		tbm_free(node->tbm);
+	BitmapHeapCloseFiles(node);
 
 	/*
 	 * close heap scan
@@ -567,6 +901,12 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	scanstate->prefetch_target = 0;
 	/* may be updated below */
 	scanstate->prefetch_maximum = target_prefetch_pages;
+	scanstate->pscan_len = 0;
+	scanstate->pstate = NULL;
+	scanstate->pinitialized = false;
+	scanstate->pindexfile = NULL;
+	scanstate->pdatafile = NULL;
+	scanstate->ptbmres = NULL;
 
 	/*
 	 * Miscellaneous initialization
@@ -653,3 +993,107 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	 */
 	return scanstate;
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Bitmap Heap Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapEstimate
+ *
+ *		estimates the space required for the shared state of a
+ *		parallel bitmap heap scan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapEstimate(BitmapHeapScanState *node,
+					   ParallelContext *pcxt)
+{
+	node->pscan_len = add_size(offsetof(ParallelBitmapHeapState, pbhs_waiters),
+							   mul_size(sizeof(int), pcxt->nworkers + 1));
+	shm_toc_estimate_chunk(&pcxt->estimator, node->pscan_len);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeDSM
+ *
+ *		Set up the shared state of a parallel bitmap heap scan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeDSM(BitmapHeapScanState *node,
+							ParallelContext *pcxt)
+{
+	static uint32 fileset_counter = 0;
+	ParallelBitmapHeapState *pstate;
+
+	pstate = shm_toc_allocate(pcxt->toc, node->pscan_len);
+
+	SpinLockInit(&pstate->pbhs_mutex);
+	pstate->pbhs_state = BM_INITIAL;
+	pstate->pbhs_npages = 0;
+	pstate->pbhs_nextpage = 0;
+	pstate->pbhs_nparticipants = pcxt->nworkers + 1;
+	pstate->pbhs_nwaiters = 0;
+
+	/*
+	 * Choose where the bitmap files go, and a name for them that no other
+	 * parallel bitmap heap scan in the instance uses.
+	 */
+	PrepareTempTablespaces();
+	pstate->pbhs_tablespace = GetNextTempTableSpace();
+	if (!OidIsValid(pstate->pbhs_tablespace))
+		pstate->pbhs_tablespace = MyDatabaseTableSpace;
+	pstate->pbhs_leader_pid = MyProcPid;
+	pstate->pbhs_fileset = ++fileset_counter;
+
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, pstate);
+	node->pstate = pstate;
+
+	/* Remove the bitmap files once the query is done with them. */
+	on_dsm_detach(pcxt->seg, ExecBitmapHeapDetach, PointerGetDatum(pstate));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapReInitializeDSM
+ *
+ *		Reset shared state before beginning a fresh scan.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapReInitializeDSM(BitmapHeapScanState *node,
+							  ParallelContext *pcxt)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+
+	BitmapHeapCloseFiles(node);
+	BitmapHeapDeleteFiles(pstate);
+
+	pstate->pbhs_state = BM_INITIAL;
+	pstate->pbhs_npages = 0;
+	pstate->pbhs_nextpage = 0;
+	pstate->pbhs_nwaiters = 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeWorker(BitmapHeapScanState *node, shm_toc *toc)
+{
+	node->pstate = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+}
+
+/*
+ * on_dsm_detach callback of the leader, removing the bitmap files
+ */
+static void
+ExecBitmapHeapDetach(dsm_segment *seg, Datum arg)
+{
+	BitmapHeapDeleteFiles((ParallelBitmapHeapState *) DatumGetPointer(arg));
+}
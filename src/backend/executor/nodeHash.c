@@ -32,6 +32,9 @@
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
+#include "storage/fd.h"
+#include "storage/proc.h"
+#include "storage/spin.h"
 #include "utils/dynahash.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
@@ -50,6 +53,29 @@ static void ExecHashRemoveNextSkewBucket(HashJoinTable hashtable);
 
 static void *dense_alloc(HashJoinTable hashtable, Size size);
 
+static Node *MultiExecParallelHash(HashState *node);
+static void ExecParallelHashChooseSize(Hash *node, int nparticipants,
+						   int *nbuckets, int *nbatch, int *nbuckets_max,
+						   Size *space_allowed);
+static void ExecParallelHashTableInsert(HashJoinTable hashtable,
+							TupleTableSlot *slot,
+							uint32 hashvalue);
+static HashJoinTuple ExecParallelHashAlloc(HashJoinTable hashtable,
+					  Size size);
+static void ExecParallelHashFlushCounts(HashJoinTable hashtable);
+static void ExecParallelHashSync(HashJoinTable hashtable);
+static void ExecParallelHashJoinGrowth(HashJoinTable hashtable);
+static void ExecParallelHashIncreaseNumBatches(HashJoinTable hashtable);
+static void ExecParallelHashIncreaseNumBuckets(HashJoinTable hashtable);
+static void ExecParallelHashBuildDone(HashJoinTable hashtable);
+static void ExecParallelHashWait(ParallelHashJoinState *pstate,
+					 int phase, uint32 generation);
+static void ExecParallelHashWakeAll(ParallelHashJoinState *pstate,
+						int nparticipants);
+static void ExecParallelHashFileName(char *name,
+						 ParallelHashJoinState *pstate,
+						 bool inner, int batchno, int participant);
+
 /* ----------------------------------------------------------------
  *		ExecHash
  *
@@ -80,6 +106,10 @@ MultiExecHash(HashState *node)
 	ExprContext *econtext;
 	uint32		hashvalue;
 
+	/* a parallel-aware hash join's table is built by all its participants */
+	if (node->parallel_state != NULL)
+		return MultiExecParallelHash(node);
+
 	/* must provide our own instrumentation support */
 	if (node->ps.instrument)
 		InstrStartNode(node->ps.instrument);
@@ -174,6 +204,7 @@ ExecInitHash(Hash *node, EState *estate, int eflags)
 	hashstate->ps.state = estate;
 	hashstate->hashtable = NULL;
 	hashstate->hashkeys = NIL;	/* will be set by parent HashJoin */
+	hashstate->parallel_state = NULL;	/* likewise, if parallel-aware */
 
 	/*
 	 * Miscellaneous initialization
@@ -243,12 +274,16 @@ ExecEndHash(HashState *node)
  * ----------------------------------------------------------------
  */
 HashJoinTable
-ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
+ExecHashTableCreate(HashState *state, List *hashOperators, bool keepNulls)
 {
+	Hash	   *node = (Hash *) state->ps.plan;
+	ParallelHashJoinState *pstate = state->parallel_state;
 	HashJoinTable hashtable;
 	Plan	   *outerNode;
+	double		rows;
 	int			nbuckets;
 	int			nbatch;
+	int			nbatch_original;
 	int			num_skew_mcvs;
 	int			log2_nbuckets;
 	int			nkeys;
@@ -259,13 +294,36 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	/*
 	 * Get information about the size of the relation to be hashed (it's the
 	 * "outer" subtree of this node, but the inner relation of the hashjoin).
-	 * Compute the appropriate size of the hash table.
+	 * Compute the appropriate size of the hash table.  A shared table has
+	 * been sized by ExecParallelHashInitialize already, and may even have
+	 * grown by now.
+	 *
+	 * If the hash join is parallel-aware, the outer subtree is a partial plan
+	 * and plan_rows is only one participant's share of the relation; use the
+	 * planner's estimate of the total instead.  That's also right for a
+	 * parallel-aware hash join that ends up running without parallel workers
+	 * and hence without a shared table, since the partial plan then returns
+	 * the whole relation.
 	 */
 	outerNode = outerPlan(node);
 
-	ExecChooseHashTableSize(outerNode->plan_rows, outerNode->plan_width,
-							OidIsValid(node->skewTable),
-							&nbuckets, &nbatch, &num_skew_mcvs);
+	if (pstate != NULL)
+	{
+		SpinLockAcquire(&pstate->mutex);
+		nbuckets = pstate->nbuckets;
+		nbatch = pstate->nbatch;
+		nbatch_original = pstate->nbatch_original;
+		SpinLockRelease(&pstate->mutex);
+		num_skew_mcvs = 0;
+	}
+	else
+	{
+		rows = node->rows_total > 0 ? node->rows_total : outerNode->plan_rows;
+		ExecChooseHashTableSize(rows, outerNode->plan_width,
+								OidIsValid(node->skewTable), 1,
+								&nbuckets, &nbatch, &num_skew_mcvs);
+		nbatch_original = nbatch;
+	}
 
 	/* nbuckets must be a power of 2 */
 	log2_nbuckets = my_log2(nbuckets);
@@ -292,7 +350,7 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	hashtable->skewBucketNums = NULL;
 	hashtable->nbatch = nbatch;
 	hashtable->curbatch = 0;
-	hashtable->nbatch_original = nbatch;
+	hashtable->nbatch_original = nbatch_original;
 	hashtable->nbatch_outstart = nbatch;
 	hashtable->growEnabled = true;
 	hashtable->totalTuples = 0;
@@ -306,6 +364,15 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	hashtable->spaceAllowedSkew =
 		hashtable->spaceAllowed * SKEW_WORK_MEM_PERCENT / 100;
 	hashtable->chunks = NULL;
+	hashtable->parallel_state = pstate;
+	hashtable->participant = -1;
+	hashtable->attached = false;
+	hashtable->shared = (pstate != NULL);
+	hashtable->generation = 0;
+	hashtable->chunk = 0;
+	hashtable->unflushedTuples = 0;
+	hashtable->unflushedInMemory = 0;
+	hashtable->curparticipant = 0;
 
 #ifdef HJDEBUG
 	printf("Hashjoin %p: initial nbatch = %d, nbuckets = %d\n",
@@ -354,10 +421,11 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 
 	oldcxt = MemoryContextSwitchTo(hashtable->hashCxt);
 
-	if (nbatch > 1)
+	if (nbatch > 1 || pstate != NULL)
 	{
 		/*
-		 * allocate and initialize the file arrays in hashCxt
+		 * allocate and initialize the file arrays in hashCxt (a parallel
+		 * hash join always needs them, see ExecParallelHashSync)
 		 */
 		hashtable->innerBatchFile = (BufFile **)
 			palloc0(nbatch * sizeof(BufFile *));
@@ -370,18 +438,21 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 
 	/*
 	 * Prepare context for the first-scan space allocations; allocate the
-	 * hashbucket array therein, and set each bucket "empty".
+	 * hashbucket array therein, and set each bucket "empty".  A shared table
+	 * has its buckets in shared memory.
 	 */
 	MemoryContextSwitchTo(hashtable->batchCxt);
 
-	hashtable->buckets = (HashJoinTuple *)
-		palloc0(nbuckets * sizeof(HashJoinTuple));
+	if (pstate == NULL)
+		hashtable->buckets = (HashJoinTuple *)
+			palloc0(nbuckets * sizeof(HashJoinTuple));
 
 	/*
 	 * Set up for skew optimization, if possible and there's a need for more
-	 * than one batch.  (In a one-batch join, there's no point in it.)
+	 * than one batch.  (In a one-batch join, there's no point in it.)  We
+	 * don't bother with it for a shared table.
 	 */
-	if (nbatch > 1)
+	if (nbatch > 1 && pstate == NULL)
 		ExecHashBuildSkewHash(hashtable, node, num_skew_mcvs);
 
 	MemoryContextSwitchTo(oldcxt);
@@ -394,6 +465,10 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
  * Compute appropriate size for hashtable given the estimated size of the
  * relation to be hashed (number of rows and average row width).
  *
+ * nparticipants is the number of processes sharing the hash table; each of
+ * them contributes work_mem to it.  It's 1 except for a parallel-aware hash
+ * join.
+ *
  * This is exported so that the planner's costsize.c can use it.
  */
 
@@ -402,6 +477,7 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 
 void
 ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
+						int nparticipants,
 						int *numbuckets,
 						int *numbatches,
 						int *num_skew_mcvs)
@@ -432,9 +508,9 @@ ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
 	inner_rel_bytes = ntuples * tupsize;
 
 	/*
-	 * Target in-memory hashtable size is work_mem kilobytes.
+	 * Target in-memory hashtable size is work_mem kilobytes per participant.
 	 */
-	hash_table_bytes = work_mem * 1024L;
+	hash_table_bytes = work_mem * 1024L * nparticipants;
 
 	/*
 	 * If skew optimization is possible, estimate the number of skew buckets
@@ -481,7 +557,7 @@ ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
 	 * Note that both nbuckets and nbatch must be powers of 2 to make
 	 * ExecHashGetBucketAndBatch fast.
 	 */
-	max_pointers = (work_mem * 1024L) / sizeof(HashJoinTuple);
+	max_pointers = (work_mem * 1024L * nparticipants) / sizeof(HashJoinTuple);
 	max_pointers = Min(max_pointers, MaxAllocSize / sizeof(HashJoinTuple));
 	/* If max_pointers isn't a power of 2, must round it down to one */
 	mppow2 = 1L << my_log2(max_pointers);
@@ -567,9 +643,12 @@ ExecHashTableDestroy(HashJoinTable hashtable)
 	/*
 	 * Make sure all the temp files are closed.  We skip batch 0, since it
 	 * can't have any temp files (and the arrays might not even exist if
-	 * nbatch is only 1).
+	 * nbatch is only 1), except in a parallel hash join.  Closing the shared
+	 * batch files of a parallel hash join doesn't remove them; that's left
+	 * to ExecParallelHashDeleteFiles.
 	 */
-	for (i = 1; i < hashtable->nbatch; i++)
+	for (i = (hashtable->parallel_state != NULL ? 0 : 1);
+		 i < hashtable->nbatch; i++)
 	{
 		if (hashtable->innerBatchFile[i])
 			BufFileClose(hashtable->innerBatchFile[i]);
@@ -703,7 +782,7 @@ ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 				memcpy(copyTuple, hashTuple, hashTupleSize);
 
 				/* and add it back to the appropriate bucket */
-				copyTuple->next = hashtable->buckets[bucketno];
+				copyTuple->next.unshared = hashtable->buckets[bucketno];
 				hashtable->buckets[bucketno] = copyTuple;
 			}
 			else
@@ -807,7 +886,7 @@ ExecHashIncreaseNumBuckets(HashJoinTable hashtable)
 									  &bucketno, &batchno);
 
 			/* add the tuple to the proper bucket */
-			hashTuple->next = hashtable->buckets[bucketno];
+			hashTuple->next.unshared = hashtable->buckets[bucketno];
 			hashtable->buckets[bucketno] = hashTuple;
 
 			/* advance index past the tuple */
@@ -869,7 +948,7 @@ ExecHashTableInsert(HashJoinTable hashtable,
 		HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
 
 		/* Push it onto the front of the bucket's list */
-		hashTuple->next = hashtable->buckets[bucketno];
+		hashTuple->next.unshared = hashtable->buckets[bucketno];
 		hashtable->buckets[bucketno] = hashTuple;
 
 		/*
@@ -1067,16 +1146,26 @@ ExecScanHashBucket(HashJoinState *hjstate,
 	HashJoinTable hashtable = hjstate->hj_HashTable;
 	HashJoinTuple hashTuple = hjstate->hj_CurTuple;
 	uint32		hashvalue = hjstate->hj_CurHashValue;
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
 
 	/*
 	 * hj_CurTuple is the address of the tuple last returned from the current
 	 * bucket, or NULL if it's time to start scanning a new bucket.
 	 *
 	 * If the tuple hashed to a skew bucket then scan the skew bucket
-	 * otherwise scan the standard hashtable bucket.
+	 * otherwise scan the standard hashtable bucket.  The shared table has no
+	 * skew buckets, and links its tuples by offset.
 	 */
-	if (hashTuple != NULL)
-		hashTuple = hashTuple->next;
+	if (hashtable->shared)
+	{
+		if (hashTuple != NULL)
+			hashTuple = ParallelHashTupleAt(pstate, hashTuple->next.shared);
+		else
+			hashTuple = ParallelHashTupleAt(pstate,
+						ParallelHashBuckets(pstate)[hjstate->hj_CurBucketNo]);
+	}
+	else if (hashTuple != NULL)
+		hashTuple = hashTuple->next.unshared;
 	else if (hjstate->hj_CurSkewBucketNo != INVALID_SKEW_BUCKET_NO)
 		hashTuple = hashtable->skewBucket[hjstate->hj_CurSkewBucketNo]->tuples;
 	else
@@ -1104,7 +1193,10 @@ ExecScanHashBucket(HashJoinState *hjstate,
 			}
 		}
 
-		hashTuple = hashTuple->next;
+		if (hashtable->shared)
+			hashTuple = ParallelHashTupleAt(pstate, hashTuple->next.shared);
+		else
+			hashTuple = hashTuple->next.unshared;
 	}
 
 	/*
@@ -1155,7 +1247,7 @@ ExecScanHashTableForUnmatched(HashJoinState *hjstate, ExprContext *econtext)
 		 * bucket.
 		 */
 		if (hashTuple != NULL)
-			hashTuple = hashTuple->next;
+			hashTuple = hashTuple->next.unshared;
 		else if (hjstate->hj_CurBucketNo < hashtable->nbuckets)
 		{
 			hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo];
@@ -1194,7 +1286,7 @@ ExecScanHashTableForUnmatched(HashJoinState *hjstate, ExprContext *econtext)
 				return true;
 			}
 
-			hashTuple = hashTuple->next;
+			hashTuple = hashTuple->next.unshared;
 		}
 	}
 
@@ -1247,7 +1339,7 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 	/* Reset all flags in the main table ... */
 	for (i = 0; i < hashtable->nbuckets; i++)
 	{
-		for (tuple = hashtable->buckets[i]; tuple != NULL; tuple = tuple->next)
+		for (tuple = hashtable->buckets[i]; tuple != NULL; tuple = tuple->next.unshared)
 			HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(tuple));
 	}
 
@@ -1257,7 +1349,7 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 		int			j = hashtable->skewBucketNums[i];
 		HashSkewBucket *skewBucket = hashtable->skewBucket[j];
 
-		for (tuple = skewBucket->tuples; tuple != NULL; tuple = tuple->next)
+		for (tuple = skewBucket->tuples; tuple != NULL; tuple = tuple->next.unshared)
 			HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(tuple));
 	}
 }
@@ -1509,7 +1601,7 @@ ExecHashSkewTableInsert(HashJoinTable hashtable,
 	HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
 
 	/* Push it onto the front of the skew bucket's list */
-	hashTuple->next = hashtable->skewBucket[bucketNumber]->tuples;
+	hashTuple->next.unshared = hashtable->skewBucket[bucketNumber]->tuples;
 	hashtable->skewBucket[bucketNumber]->tuples = hashTuple;
 
 	/* Account for space used, and back off if we've used too much */
@@ -1558,7 +1650,7 @@ ExecHashRemoveNextSkewBucket(HashJoinTable hashtable)
 	hashTuple = bucket->tuples;
 	while (hashTuple != NULL)
 	{
-		HashJoinTuple nextHashTuple = hashTuple->next;
+		HashJoinTuple nextHashTuple = hashTuple->next.unshared;
 		MinimalTuple tuple;
 		Size		tupleSize;
 
@@ -1584,7 +1676,7 @@ ExecHashRemoveNextSkewBucket(HashJoinTable hashtable)
 			memcpy(copyTuple, hashTuple, tupleSize);
 			pfree(hashTuple);
 
-			copyTuple->next = hashtable->buckets[bucketno];
+			copyTuple->next.unshared = hashtable->buckets[bucketno];
 			hashtable->buckets[bucketno] = copyTuple;
 
 			/* We have reduced skew space, but overall space doesn't change */
@@ -1716,3 +1808,1031 @@ dense_alloc(HashJoinTable hashtable, Size size)
 	/* return pointer to the start of the tuple memory */
 	return ptr;
 }
+
+
+/* ----------------------------------------------------------------
+ *		Parallel hash join support
+ *
+ * A parallel-aware hash join builds a single hash table in the dynamic
+ * shared memory segment of the query, described by a ParallelHashJoinState.
+ * Every participant (the leader and each worker running the join) runs its
+ * share of the partial inner plan and inserts the tuples concurrently: each
+ * participant takes chunks of the shared tuple space for itself, and links
+ * tuples into the buckets while holding one of PHJ_BUCKET_LOCKS spinlocks.
+ *
+ * When the tuple space runs out, or the buckets get too crowded, the table
+ * must grow.  The participant that notices requests the growth in the
+ * shared state; every participant checks for a request before inserting a
+ * tuple, and stops inserting until it's done.  Once all participants
+ * building the table are waiting, the last of them carries out the growth
+ * step and wakes up the others.  Doubling nbatch works like
+ * ExecHashIncreaseNumBatches: the tuples that now belong to a later batch
+ * are written out to the batch files of the participant doing the work, and
+ * the remaining ones are compacted at the start of the tuple space.  If
+ * that frees nothing (or everything), nbatch growth is disabled as in the
+ * serial case; batch 0 tuples that still don't fit are then written to batch
+ * files as well, and batch 0 is processed in private memory later like any
+ * other batch.
+ *
+ * The participants wait for each other at the end of the build, and, if
+ * nbatch > 1, again after writing all of the outer relation into their own
+ * outer batch files.  A participant that turns up once the build is over
+ * doesn't take part in the build; one that turns up after partitioning
+ * doesn't see any of the outer relation either, since the partial outer plan
+ * has already been run to completion by the others.  Once the table and the
+ * batch files are complete, each participant probes the shared table with
+ * its own outer tuples, and then takes batches from the shared state one by
+ * one, loading each into private memory from all participants' batch files.
+ * Nobody waits for anybody after that, which is important because a Gather
+ * leader executing the join may stop doing so at any time to read the tuple
+ * queues.
+ *
+ * Participants wait for each other on their process latches; we remember
+ * every participant's pgprocno so that we can wake them up.
+ * ----------------------------------------------------------------
+ */
+
+/*
+ * MultiExecParallelHash
+ *		MultiExecHash for a shared hash table
+ */
+static Node *
+MultiExecParallelHash(HashState *node)
+{
+	ParallelHashJoinState *pstate = node->parallel_state;
+	PlanState  *outerNode = outerPlanState(node);
+	HashJoinTable hashtable = node->hashtable;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	TupleTableSlot *slot;
+	uint32		hashvalue;
+	bool		building;
+
+	/* must provide our own instrumentation support */
+	if (node->ps.instrument)
+		InstrStartNode(node->ps.instrument);
+
+	/* Join the hash join, and find out whether we can still help build. */
+	SpinLockAcquire(&pstate->mutex);
+	if (pstate->nextparticipant >= pstate->nparticipants)
+	{
+		SpinLockRelease(&pstate->mutex);
+		elog(ERROR, "too many participants in parallel hash join");
+	}
+	hashtable->participant = pstate->nextparticipant++;
+	pstate->procnos[hashtable->participant] = MyProc->pgprocno;
+	building = (pstate->phase == PHJ_PHASE_BUILDING);
+	if (building)
+		pstate->nattached++;
+	SpinLockRelease(&pstate->mutex);
+
+	hashtable->attached = building;
+	ExecParallelHashSync(hashtable);
+
+	if (building)
+	{
+		for (;;)
+		{
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+				break;
+			econtext->ecxt_innertuple = slot;
+			if (ExecHashGetHashValue(hashtable, econtext, node->hashkeys,
+									 false, hashtable->keepNulls,
+									 &hashvalue))
+			{
+				ExecParallelHashTableInsert(hashtable, slot, hashvalue);
+				hashtable->totalTuples += 1;
+			}
+		}
+
+		ExecParallelHashBuildDone(hashtable);
+	}
+
+	/* must provide our own instrumentation support */
+	if (node->ps.instrument)
+		InstrStopNode(node->ps.instrument, hashtable->totalTuples);
+
+	/*
+	 * From here on, we want the numbers for the whole table, both to decide
+	 * whether it's empty and to report them in EXPLAIN ANALYZE.
+	 */
+	SpinLockAcquire(&pstate->mutex);
+	hashtable->totalTuples = pstate->totalTuples;
+	hashtable->spacePeak = pstate->spacePeak;
+	SpinLockRelease(&pstate->mutex);
+
+	return NULL;
+}
+
+/*
+ * ExecParallelHashChooseSize
+ *		Work out the initial size of a shared hash table
+ *
+ * The tuple space gets work_mem for each participant.  The bucket array
+ * can't be enlarged later, so we make room for as many buckets as the
+ * tuple space could possibly need, though only nbuckets of them are used
+ * at first.
+ */
+static void
+ExecParallelHashChooseSize(Hash *node, int nparticipants,
+						   int *nbuckets, int *nbatch, int *nbuckets_max,
+						   Size *space_allowed)
+{
+	Plan	   *outerNode = outerPlan(node);
+	int			num_skew_mcvs;
+	long		max_buckets;
+	long		mppow2;
+
+	ExecChooseHashTableSize(node->rows_total, outerNode->plan_width,
+							false, nparticipants,
+							nbuckets, nbatch, &num_skew_mcvs);
+
+	*space_allowed = (Size) work_mem * 1024L * nparticipants;
+
+	max_buckets = *space_allowed /
+		(HJTUPLE_OVERHEAD + MAXALIGN(SizeofMinimalTupleHeader));
+	max_buckets = Min(max_buckets, MaxAllocSize / sizeof(HashJoinTuple));
+	max_buckets = Min(max_buckets, INT_MAX / 2);
+	/* If max_buckets isn't a power of 2, must round it down to one */
+	mppow2 = 1L << my_log2(max_buckets);
+	if (max_buckets != mppow2)
+		max_buckets = mppow2 / 2;
+	*nbuckets_max = Max((int) max_buckets, *nbuckets);
+}
+
+/*
+ * ExecParallelHashEstimate
+ *		Size of the shared state of a parallel-aware hash join, including
+ *		the hash table itself
+ */
+Size
+ExecParallelHashEstimate(Hash *node, int nparticipants)
+{
+	int			nbuckets;
+	int			nbatch;
+	int			nbuckets_max;
+	Size		space_allowed;
+	Size		size;
+
+	ExecParallelHashChooseSize(node, nparticipants, &nbuckets, &nbatch,
+							   &nbuckets_max, &space_allowed);
+
+	size = MAXALIGN(add_size(offsetof(ParallelHashJoinState, procnos),
+							 mul_size(nparticipants, sizeof(int))));
+	size = add_size(size, MAXALIGN(mul_size(nbuckets_max, sizeof(Size))));
+	size = add_size(size, space_allowed);
+
+	return size;
+}
+
+/*
+ * ExecParallelHashInitialize
+ *		Set up the shared state of a parallel-aware hash join, in memory of
+ *		the size given by ExecParallelHashEstimate
+ *
+ * This is also used to start over when rescanning the join.
+ */
+void
+ExecParallelHashInitialize(ParallelHashJoinState *pstate, Hash *node,
+						   int nparticipants)
+{
+	static uint32 fileset_counter = 0;
+	int			nbuckets;
+	int			nbatch;
+	int			nbuckets_max;
+	Size		space_allowed;
+	int			i;
+
+	ExecParallelHashChooseSize(node, nparticipants, &nbuckets, &nbatch,
+							   &nbuckets_max, &space_allowed);
+
+	SpinLockInit(&pstate->mutex);
+	pstate->phase = PHJ_PHASE_BUILDING;
+	pstate->nparticipants = nparticipants;
+	pstate->nextparticipant = 0;
+	pstate->nattached = 0;
+	pstate->ndone = 0;
+	pstate->growth = 0;
+	pstate->ngrowwaiting = 0;
+	pstate->growing = false;
+	pstate->generation = 0;
+	pstate->growEnabled = true;
+	pstate->overflow = false;
+	pstate->nbuckets = nbuckets;
+	pstate->log2_nbuckets = my_log2(nbuckets);
+	pstate->nbuckets_max = nbuckets_max;
+	pstate->nbatch = nbatch;
+	pstate->nbatch_original = nbatch;
+	pstate->nextbatch = 1;
+	pstate->totalTuples = 0;
+	pstate->ntuples = 0;
+	pstate->spaceAllowed = space_allowed;
+	pstate->spaceUsed = 0;
+	pstate->spacePeak = 0;
+	pstate->buckets = MAXALIGN(offsetof(ParallelHashJoinState, procnos) +
+							   nparticipants * sizeof(int));
+	pstate->tuples = pstate->buckets + MAXALIGN(nbuckets_max * sizeof(Size));
+
+	/*
+	 * Choose where the batch files go, and a name for them that no other
+	 * parallel hash join in the instance uses: our PID, and a counter to tell
+	 * apart the joins of our queries.
+	 */
+	PrepareTempTablespaces();
+	pstate->tablespace = GetNextTempTableSpace();
+	if (!OidIsValid(pstate->tablespace))
+		pstate->tablespace = MyDatabaseTableSpace;
+	pstate->leader_pid = MyProcPid;
+	pstate->fileset = ++fileset_counter;
+
+	for (i = 0; i < PHJ_BUCKET_LOCKS; i++)
+		SpinLockInit(&pstate->bucket_locks[i]);
+
+	memset(ParallelHashBuckets(pstate), 0, nbuckets * sizeof(Size));
+}
+
+/*
+ * ExecParallelHashDeleteFiles
+ *		Remove all batch files that the participants of a parallel-aware hash
+ *		join may have written
+ */
+void
+ExecParallelHashDeleteFiles(ParallelHashJoinState *pstate)
+{
+	char		name[MAXPGPATH];
+	int			batchno;
+	int			participant;
+
+	for (batchno = 0; batchno < pstate->nbatch; batchno++)
+	{
+		for (participant = 0; participant < pstate->nextparticipant;
+			 participant++)
+		{
+			ExecParallelHashFileName(name, pstate, true, batchno, participant);
+			BufFileDeleteShared(pstate->tablespace, name);
+			ExecParallelHashFileName(name, pstate, false, batchno, participant);
+			BufFileDeleteShared(pstate->tablespace, name);
+		}
+	}
+}
+
+/*
+ * ExecParallelHashTableInsert
+ *		insert a tuple into the shared hash table, or into one of our batch
+ *		files if it belongs to a later batch
+ */
+static void
+ExecParallelHashTableInsert(HashJoinTable hashtable,
+							TupleTableSlot *slot,
+							uint32 hashvalue)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot);
+	HashJoinTuple hashTuple;
+	slock_t    *lock;
+	Size	   *buckets;
+	int			bucketno;
+	int			batchno;
+
+	hashtable->unflushedTuples += 1;
+
+	for (;;)
+	{
+		/* Help with growing the table, if that's been asked for. */
+		if (pstate->growth != 0)
+			ExecParallelHashJoinGrowth(hashtable);
+
+		ExecHashGetBucketAndBatch(hashtable, hashvalue, &bucketno, &batchno);
+		if (batchno != 0)
+		{
+			ExecParallelHashSaveTuple(hashtable, tuple, hashvalue, batchno,
+									  true);
+			return;
+		}
+
+		hashTuple = ExecParallelHashAlloc(hashtable,
+										  HJTUPLE_OVERHEAD + tuple->t_len);
+		if (hashTuple != NULL)
+			break;
+
+		/*
+		 * No room.  Either the table must grow first, or it can't and batch 0
+		 * will have to be processed from batch files too.
+		 */
+		if (pstate->overflow)
+		{
+			ExecParallelHashSaveTuple(hashtable, tuple, hashvalue, 0, true);
+			return;
+		}
+	}
+
+	hashTuple->hashvalue = hashvalue;
+	memcpy(HJTUPLE_MINTUPLE(hashTuple), tuple, tuple->t_len);
+	HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
+
+	/* Push it onto the front of the bucket's list */
+	buckets = ParallelHashBuckets(pstate);
+	lock = &pstate->bucket_locks[bucketno & (PHJ_BUCKET_LOCKS - 1)];
+	SpinLockAcquire(lock);
+	hashTuple->next.shared = buckets[bucketno];
+	buckets[bucketno] = ParallelHashTupleOffset(pstate, hashTuple);
+	SpinLockRelease(lock);
+
+	hashtable->unflushedInMemory += 1;
+}
+
+/*
+ * ExecParallelHashAlloc
+ *		Allocate space for a tuple in the shared tuple space
+ *
+ * Tuples go into our current chunk if there's room, otherwise we take a new
+ * chunk.  Returns NULL if the tuple space is exhausted; we then either
+ * request nbatch growth, or set pstate->overflow if that's been disabled.
+ * Every time we take a chunk, we also add our tuple counts to the shared
+ * ones, and check whether the buckets have got too crowded.
+ */
+static HashJoinTuple
+ExecParallelHashAlloc(HashJoinTable hashtable, Size size)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	SharedHashChunk chunk;
+	Size		chunksize;
+	Size		offset;
+	char	   *ptr;
+
+	size = MAXALIGN(size);
+
+	if (hashtable->chunk != 0 && size <= HASH_CHUNK_THRESHOLD)
+	{
+		chunk = (SharedHashChunk) ((char *) pstate + hashtable->chunk);
+		if (chunk->size - SHARED_HASH_CHUNK_HEADER - chunk->used >= size)
+		{
+			ptr = (char *) chunk + SHARED_HASH_CHUNK_HEADER + chunk->used;
+			chunk->used += size;
+			return (HashJoinTuple) ptr;
+		}
+	}
+
+	/* Big tuples get a chunk of their own, like in dense_alloc */
+	if (size > HASH_CHUNK_THRESHOLD)
+		chunksize = SHARED_HASH_CHUNK_HEADER + size;
+	else
+		chunksize = HASH_CHUNK_SIZE;
+
+	SpinLockAcquire(&pstate->mutex);
+	ExecParallelHashFlushCounts(hashtable);
+	if (pstate->nbatch == 1 &&
+		pstate->ntuples > (double) pstate->nbuckets * NTUP_PER_BUCKET &&
+		pstate->nbuckets < pstate->nbuckets_max)
+		pstate->growth |= PHJ_GROW_BUCKETS;
+	if (pstate->spaceUsed + chunksize > pstate->spaceAllowed)
+	{
+		if (pstate->growEnabled)
+			pstate->growth |= PHJ_GROW_BATCHES;
+		else
+			pstate->overflow = true;
+		SpinLockRelease(&pstate->mutex);
+		return NULL;
+	}
+	offset = pstate->tuples + pstate->spaceUsed;
+	pstate->spaceUsed += chunksize;
+	if (pstate->spaceUsed + pstate->nbuckets * sizeof(Size) > pstate->spacePeak)
+		pstate->spacePeak = pstate->spaceUsed + pstate->nbuckets * sizeof(Size);
+	SpinLockRelease(&pstate->mutex);
+
+	chunk = (SharedHashChunk) ((char *) pstate + offset);
+	chunk->size = chunksize;
+	chunk->used = size;
+
+	/* keep using the current chunk after storing a big tuple */
+	if (size <= HASH_CHUNK_THRESHOLD)
+		hashtable->chunk = offset;
+
+	return (HashJoinTuple) ((char *) chunk + SHARED_HASH_CHUNK_HEADER);
+}
+
+/*
+ * ExecParallelHashFlushCounts
+ *		Add the tuples we've inserted since last time to the shared counts
+ *
+ * The caller must hold pstate->mutex.
+ */
+static void
+ExecParallelHashFlushCounts(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+
+	pstate->totalTuples += hashtable->unflushedTuples;
+	pstate->ntuples += hashtable->unflushedInMemory;
+	hashtable->unflushedTuples = 0;
+	hashtable->unflushedInMemory = 0;
+}
+
+/*
+ * ExecParallelHashSync
+ *		Bring our copy of the shared table's size up to date
+ */
+static void
+ExecParallelHashSync(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	int			oldnbatch = hashtable->nbatch;
+	int			nbatch;
+	MemoryContext oldcxt;
+
+	SpinLockAcquire(&pstate->mutex);
+	hashtable->nbuckets = pstate->nbuckets;
+	hashtable->log2_nbuckets = pstate->log2_nbuckets;
+	hashtable->growEnabled = pstate->growEnabled;
+	hashtable->generation = pstate->generation;
+	nbatch = pstate->nbatch;
+	SpinLockRelease(&pstate->mutex);
+
+	hashtable->nbuckets_optimal = hashtable->nbuckets;
+	hashtable->log2_nbuckets_optimal = hashtable->log2_nbuckets;
+
+	if (nbatch == oldnbatch)
+		return;
+
+	/* The tuples have been moved around, including those in our chunk. */
+	hashtable->chunk = 0;
+
+	/* enlarge file arrays and zero out added entries */
+	oldcxt = MemoryContextSwitchTo(hashtable->hashCxt);
+	hashtable->innerBatchFile = (BufFile **)
+		repalloc(hashtable->innerBatchFile, nbatch * sizeof(BufFile *));
+	hashtable->outerBatchFile = (BufFile **)
+		repalloc(hashtable->outerBatchFile, nbatch * sizeof(BufFile *));
+	MemSet(hashtable->innerBatchFile + oldnbatch, 0,
+		   (nbatch - oldnbatch) * sizeof(BufFile *));
+	MemSet(hashtable->outerBatchFile + oldnbatch, 0,
+		   (nbatch - oldnbatch) * sizeof(BufFile *));
+	MemoryContextSwitchTo(oldcxt);
+
+	hashtable->nbatch = nbatch;
+}
+
+/*
+ * ExecParallelHashJoinGrowth
+ *		Take part in a growth step of the shared table
+ *
+ * The last participant to arrive does the work; the others wait for it to
+ * finish.
+ */
+static void
+ExecParallelHashJoinGrowth(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	uint32		generation;
+	int			growth;
+	int			nparticipants;
+
+	SpinLockAcquire(&pstate->mutex);
+	if (pstate->growth == 0)
+	{
+		/* it has been done already */
+		SpinLockRelease(&pstate->mutex);
+		ExecParallelHashSync(hashtable);
+		return;
+	}
+	ExecParallelHashFlushCounts(hashtable);
+	generation = pstate->generation;
+	pstate->ngrowwaiting++;
+	if (pstate->growing || pstate->ngrowwaiting < pstate->nattached)
+	{
+		SpinLockRelease(&pstate->mutex);
+		ExecParallelHashWait(pstate, PHJ_PHASE_BUILDING, generation);
+		ExecParallelHashSync(hashtable);
+		return;
+	}
+
+	/* Everybody's waiting, so it's up to us. */
+	pstate->growing = true;
+	growth = pstate->growth;
+	SpinLockRelease(&pstate->mutex);
+
+	ExecParallelHashSync(hashtable);
+	if (growth & PHJ_GROW_BATCHES)
+		ExecParallelHashIncreaseNumBatches(hashtable);
+	else
+		ExecParallelHashIncreaseNumBuckets(hashtable);
+
+	SpinLockAcquire(&pstate->mutex);
+	pstate->growth = 0;
+	pstate->ngrowwaiting = 0;
+	pstate->growing = false;
+	pstate->generation++;
+	nparticipants = pstate->nextparticipant;
+	SpinLockRelease(&pstate->mutex);
+
+	ExecParallelHashWakeAll(pstate, nparticipants);
+	ExecParallelHashSync(hashtable);
+}
+
+/*
+ * ExecParallelHashIncreaseNumBatches
+ *		double nbatch of the shared table, writing the tuples that no longer
+ *		belong to batch 0 out to our batch files
+ *
+ * The caller must be the only participant active.
+ */
+static void
+ExecParallelHashIncreaseNumBatches(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	Size	   *buckets = ParallelHashBuckets(pstate);
+	SharedHashChunk newchunk;
+	Size		offset;
+	Size		end;
+	Size		used;
+	char	   *dest;
+	long		ninmemory;
+	long		nfreed;
+
+	/* safety check to avoid overflow */
+	if (pstate->nbatch > Min(INT_MAX / 2, MaxAllocSize / (sizeof(void *) * 2)))
+	{
+		pstate->growEnabled = false;
+		return;
+	}
+
+	/*
+	 * If we were about to add buckets, do that now, since nbuckets must not
+	 * change anymore once there is more than one batch.
+	 */
+	if (pstate->nbatch == 1)
+	{
+		while (pstate->ntuples > (double) pstate->nbuckets * NTUP_PER_BUCKET &&
+			   pstate->nbuckets < pstate->nbuckets_max)
+		{
+			pstate->nbuckets *= 2;
+			pstate->log2_nbuckets += 1;
+		}
+	}
+	pstate->nbatch *= 2;
+	ExecParallelHashSync(hashtable);
+
+#ifdef HJDEBUG
+	printf("Hashjoin %p: increasing shared nbatch to %d because space = %zu\n",
+		   hashtable, hashtable->nbatch, pstate->spaceUsed);
+#endif
+
+	/*
+	 * Scan through all the chunks, moving the tuples we keep to the start of
+	 * the tuple space as one big chunk.  The destination never gets ahead of
+	 * the tuple being looked at, but it can overwrite the header of the chunk
+	 * we are scanning, so we remember that before we start on the chunk.
+	 */
+	memset(buckets, 0, hashtable->nbuckets * sizeof(Size));
+	ninmemory = nfreed = 0;
+	newchunk = (SharedHashChunk) ((char *) pstate + pstate->tuples);
+	dest = (char *) newchunk + SHARED_HASH_CHUNK_HEADER;
+	used = 0;
+	offset = pstate->tuples;
+	end = pstate->tuples + pstate->spaceUsed;
+	while (offset < end)
+	{
+		SharedHashChunk chunk = (SharedHashChunk) ((char *) pstate + offset);
+		Size		chunksize = chunk->size;
+		Size		chunkused = chunk->used;
+		char	   *data = (char *) chunk + SHARED_HASH_CHUNK_HEADER;
+		Size		idx = 0;
+
+		while (idx < chunkused)
+		{
+			HashJoinTuple hashTuple = (HashJoinTuple) (data + idx);
+			Size		hashTupleSize;
+			int			bucketno;
+			int			batchno;
+
+			hashTupleSize = MAXALIGN(HJTUPLE_OVERHEAD +
+									 HJTUPLE_MINTUPLE(hashTuple)->t_len);
+			ninmemory++;
+			ExecHashGetBucketAndBatch(hashtable, hashTuple->hashvalue,
+									  &bucketno, &batchno);
+
+			if (batchno == 0)
+			{
+				HashJoinTuple copyTuple = (HashJoinTuple) dest;
+
+				memmove(copyTuple, hashTuple, hashTupleSize);
+				copyTuple->next.shared = buckets[bucketno];
+				buckets[bucketno] = ParallelHashTupleOffset(pstate, copyTuple);
+				dest += hashTupleSize;
+				used += hashTupleSize;
+			}
+			else
+			{
+				ExecParallelHashSaveTuple(hashtable,
+										  HJTUPLE_MINTUPLE(hashTuple),
+										  hashTuple->hashvalue,
+										  batchno, true);
+				nfreed++;
+			}
+
+			idx += hashTupleSize;
+
+			/* allow this loop to be cancellable */
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		offset += chunksize;
+	}
+
+	newchunk->size = SHARED_HASH_CHUNK_HEADER + used;
+	newchunk->used = used;
+	pstate->spaceUsed = newchunk->size;
+	pstate->ntuples -= nfreed;
+
+#ifdef HJDEBUG
+	printf("Hashjoin %p: freed %ld of %ld shared tuples, space now %zu\n",
+		   hashtable, nfreed, ninmemory, pstate->spaceUsed);
+#endif
+
+	/* see ExecHashIncreaseNumBatches */
+	if (nfreed == 0 || nfreed == ninmemory)
+		pstate->growEnabled = false;
+}
+
+/*
+ * ExecParallelHashIncreaseNumBuckets
+ *		add buckets to the shared table until there are few enough tuples
+ *		per bucket, and relink all the tuples
+ *
+ * The caller must be the only participant active.
+ */
+static void
+ExecParallelHashIncreaseNumBuckets(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	Size	   *buckets = ParallelHashBuckets(pstate);
+	Size		offset;
+	Size		end;
+
+	/* nbuckets can't change anymore once we have batch files */
+	if (pstate->nbatch > 1)
+		return;
+
+	while (pstate->ntuples > (double) pstate->nbuckets * NTUP_PER_BUCKET &&
+		   pstate->nbuckets < pstate->nbuckets_max)
+	{
+		pstate->nbuckets *= 2;
+		pstate->log2_nbuckets += 1;
+	}
+	if (pstate->nbuckets == hashtable->nbuckets)
+		return;
+
+#ifdef HJDEBUG
+	printf("Hashjoin %p: increasing shared nbuckets %d => %d\n",
+		   hashtable, hashtable->nbuckets, pstate->nbuckets);
+#endif
+
+	ExecParallelHashSync(hashtable);
+
+	/* scan through all tuples in all chunks to rebuild the hash table */
+	memset(buckets, 0, hashtable->nbuckets * sizeof(Size));
+	offset = pstate->tuples;
+	end = pstate->tuples + pstate->spaceUsed;
+	while (offset < end)
+	{
+		SharedHashChunk chunk = (SharedHashChunk) ((char *) pstate + offset);
+		char	   *data = (char *) chunk + SHARED_HASH_CHUNK_HEADER;
+		Size		idx = 0;
+
+		while (idx < chunk->used)
+		{
+			HashJoinTuple hashTuple = (HashJoinTuple) (data + idx);
+			int			bucketno;
+			int			batchno;
+
+			ExecHashGetBucketAndBatch(hashtable, hashTuple->hashvalue,
+									  &bucketno, &batchno);
+
+			/* add the tuple to the proper bucket */
+			hashTuple->next.shared = buckets[bucketno];
+			buckets[bucketno] = ParallelHashTupleOffset(pstate, hashTuple);
+
+			/* advance index past the tuple */
+			idx += MAXALIGN(HJTUPLE_OVERHEAD +
+							HJTUPLE_MINTUPLE(hashTuple)->t_len);
+		}
+
+		offset += chunk->size;
+	}
+
+	if (pstate->spaceUsed + pstate->nbuckets * sizeof(Size) > pstate->spacePeak)
+		pstate->spacePeak = pstate->spaceUsed + pstate->nbuckets * sizeof(Size);
+}
+
+/*
+ * ExecParallelHashBuildDone
+ *		Wait for the other participants to finish building the shared table
+ *
+ * We keep helping with growth steps until then.  The last participant to
+ * finish adds buckets if needed, and moves on to the next phase.
+ */
+static void
+ExecParallelHashBuildDone(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	bool		arrived = false;
+	uint32		generation;
+	int			nparticipants;
+
+	for (;;)
+	{
+		SpinLockAcquire(&pstate->mutex);
+		if (!arrived)
+		{
+			ExecParallelHashFlushCounts(hashtable);
+			pstate->ndone++;
+			arrived = true;
+		}
+		if (pstate->phase != PHJ_PHASE_BUILDING)
+		{
+			SpinLockRelease(&pstate->mutex);
+			break;
+		}
+		if (pstate->growth != 0)
+		{
+			SpinLockRelease(&pstate->mutex);
+			ExecParallelHashJoinGrowth(hashtable);
+			continue;
+		}
+		if (pstate->ndone == pstate->nattached && !pstate->growing)
+		{
+			/* We're the last one; finish the table. */
+			if (pstate->nbatch == 1 &&
+				pstate->ntuples > (double) pstate->nbuckets * NTUP_PER_BUCKET &&
+				pstate->nbuckets < pstate->nbuckets_max)
+			{
+				pstate->growing = true;
+				SpinLockRelease(&pstate->mutex);
+				ExecParallelHashSync(hashtable);
+				ExecParallelHashIncreaseNumBuckets(hashtable);
+				SpinLockAcquire(&pstate->mutex);
+				pstate->growing = false;
+				pstate->generation++;
+			}
+			if (pstate->nbatch > 1)
+			{
+				/* the builders carry on with partitioning */
+				pstate->phase = PHJ_PHASE_PARTITIONING;
+				pstate->ndone = 0;
+			}
+			else
+			{
+				pstate->phase = PHJ_PHASE_PROBING;
+				pstate->nattached = 0;
+				pstate->ndone = 0;
+			}
+			if (pstate->overflow)
+				pstate->nextbatch = 0;
+			nparticipants = pstate->nextparticipant;
+			SpinLockRelease(&pstate->mutex);
+
+			ExecParallelHashWakeAll(pstate, nparticipants);
+			break;
+		}
+		generation = pstate->generation;
+		SpinLockRelease(&pstate->mutex);
+
+		ExecParallelHashWait(pstate, PHJ_PHASE_BUILDING, generation);
+	}
+
+	ExecParallelHashSync(hashtable);
+	if (hashtable->nbatch == 1)
+		hashtable->attached = false;
+}
+
+/*
+ * ExecParallelHashAttachPartitioning
+ *		Find out whether we take part in partitioning the outer relation
+ *
+ * Those who built the table do, and so does anybody who joins before
+ * partitioning is over.
+ */
+bool
+ExecParallelHashAttachPartitioning(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+
+	if (!hashtable->attached)
+	{
+		SpinLockAcquire(&pstate->mutex);
+		if (pstate->phase == PHJ_PHASE_PARTITIONING)
+		{
+			pstate->nattached++;
+			hashtable->attached = true;
+		}
+		SpinLockRelease(&pstate->mutex);
+	}
+
+	return hashtable->attached;
+}
+
+/*
+ * ExecParallelHashPartitionDone
+ *		Close our batch files, and wait for the other participants to finish
+ *		partitioning the outer relation
+ */
+void
+ExecParallelHashPartitionDone(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	uint32		generation;
+	int			nparticipants;
+	int			i;
+
+	for (i = 0; i < hashtable->nbatch; i++)
+	{
+		if (hashtable->innerBatchFile[i])
+			BufFileClose(hashtable->innerBatchFile[i]);
+		hashtable->innerBatchFile[i] = NULL;
+		if (hashtable->outerBatchFile[i])
+			BufFileClose(hashtable->outerBatchFile[i]);
+		hashtable->outerBatchFile[i] = NULL;
+	}
+
+	SpinLockAcquire(&pstate->mutex);
+	pstate->ndone++;
+	if (pstate->ndone == pstate->nattached)
+	{
+		pstate->phase = PHJ_PHASE_PROBING;
+		pstate->nattached = 0;
+		pstate->ndone = 0;
+		nparticipants = pstate->nextparticipant;
+		SpinLockRelease(&pstate->mutex);
+
+		ExecParallelHashWakeAll(pstate, nparticipants);
+	}
+	else
+	{
+		generation = pstate->generation;
+		SpinLockRelease(&pstate->mutex);
+		ExecParallelHashWait(pstate, PHJ_PHASE_PARTITIONING, generation);
+	}
+
+	hashtable->attached = false;
+}
+
+/*
+ * ExecParallelHashNextBatch
+ *		Claim a batch to process in private memory
+ *
+ * Returns the batch number, or -1 if there are no more.
+ */
+int
+ExecParallelHashNextBatch(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	int			batchno;
+
+	SpinLockAcquire(&pstate->mutex);
+	batchno = pstate->nextbatch;
+	if (batchno < pstate->nbatch)
+		pstate->nextbatch++;
+	else
+		batchno = -1;
+	SpinLockRelease(&pstate->mutex);
+
+	return batchno;
+}
+
+/*
+ * ExecParallelHashTableLoadShared
+ *		Insert the tuples of the shared table into our private one
+ *
+ * This is for processing batch 0 in private memory, if the shared table
+ * overflowed.  Returns the number of tuples.
+ */
+double
+ExecParallelHashTableLoadShared(HashJoinTable hashtable, TupleTableSlot *slot)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	Size		offset = pstate->tuples;
+	Size		end = pstate->tuples + pstate->spaceUsed;
+	double		ntuples = 0;
+
+	Assert(!hashtable->shared);
+
+	while (offset < end)
+	{
+		SharedHashChunk chunk = (SharedHashChunk) ((char *) pstate + offset);
+		char	   *data = (char *) chunk + SHARED_HASH_CHUNK_HEADER;
+		Size		idx = 0;
+
+		while (idx < chunk->used)
+		{
+			HashJoinTuple hashTuple = (HashJoinTuple) (data + idx);
+
+			ExecStoreMinimalTuple(HJTUPLE_MINTUPLE(hashTuple), slot, false);
+			ExecHashTableInsert(hashtable, slot, hashTuple->hashvalue);
+			ntuples += 1;
+
+			idx += MAXALIGN(HJTUPLE_OVERHEAD +
+							HJTUPLE_MINTUPLE(hashTuple)->t_len);
+		}
+
+		offset += chunk->size;
+	}
+
+	return ntuples;
+}
+
+/*
+ * ExecParallelHashWait
+ *		Sleep until the shared state moves past the given phase and
+ *		generation
+ */
+static void
+ExecParallelHashWait(ParallelHashJoinState *pstate, int phase,
+					 uint32 generation)
+{
+	for (;;)
+	{
+		bool		done;
+
+		SpinLockAcquire(&pstate->mutex);
+		done = (pstate->phase != phase || pstate->generation != generation);
+		SpinLockRelease(&pstate->mutex);
+		if (done)
+			break;
+
+		WaitLatch(MyLatch, WL_LATCH_SET, 0);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * ExecParallelHashWakeAll
+ *		Wake up the given number of participants, except ourselves
+ */
+static void
+ExecParallelHashWakeAll(ParallelHashJoinState *pstate, int nparticipants)
+{
+	int			i;
+
+	for (i = 0; i < nparticipants; i++)
+	{
+		int			procno = pstate->procnos[i];
+
+		if (procno != MyProc->pgprocno)
+			SetLatch(&ProcGlobal->allProcs[procno].procLatch);
+	}
+}
+
+/*
+ * ExecParallelHashFileName
+ *		Build the name of a batch file of a parallel-aware hash join
+ */
+static void
+ExecParallelHashFileName(char *name, ParallelHashJoinState *pstate,
+						 bool inner, int batchno, int participant)
+{
+	snprintf(name, MAXPGPATH, "%d.phj%u.%c%d.%d",
+			 pstate->leader_pid, pstate->fileset,
+			 inner ? 'i' : 'o', batchno, participant);
+}
+
+/*
+ * ExecParallelHashSaveTuple
+ *		Write a tuple to one of our inner or outer batch files, which the
+ *		other participants will be able to read
+ */
+void
+ExecParallelHashSaveTuple(HashJoinTable hashtable, MinimalTuple tuple,
+						  uint32 hashvalue, int batchno, bool inner)
+{
+	BufFile   **files = inner ? hashtable->innerBatchFile :
+		hashtable->outerBatchFile;
+
+	if (files[batchno] == NULL)
+	{
+		char		name[MAXPGPATH];
+
+		ExecParallelHashFileName(name, hashtable->parallel_state, inner,
+								 batchno, hashtable->participant);
+		files[batchno] = BufFileCreateShared(hashtable->parallel_state->tablespace,
+											 name);
+	}
+	ExecHashJoinSaveTuple(tuple, hashvalue, &files[batchno]);
+}
+
+/*
+ * ExecParallelHashOpenFile
+ *		Open a batch file written by the given participant for reading
+ *
+ * Returns NULL if there is no such file.
+ */
+BufFile *
+ExecParallelHashOpenFile(HashJoinTable hashtable, bool inner, int batchno,
+						 int participant)
+{
+	char		name[MAXPGPATH];
+
+	ExecParallelHashFileName(name, hashtable->parallel_state, inner,
+							 batchno, participant);
+	return BufFileOpenShared(hashtable->parallel_state->tablespace, name);
+}
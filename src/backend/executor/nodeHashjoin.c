@@ -21,6 +21,8 @@
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
+#include "storage/dsm.h"
+#include "storage/spin.h"
 #include "utils/memutils.h"
 
 
@@ -47,6 +49,12 @@ static TupleTableSlot *ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 						  uint32 *hashvalue,
 						  TupleTableSlot *tupleSlot);
 static bool ExecHashJoinNewBatch(HashJoinState *hjstate);
+static bool ExecParallelHashJoinPartitionOuter(HashJoinState *hjstate);
+static TupleTableSlot *ExecParallelHashJoinGetSavedOuterTuple(HashJoinState *hjstate,
+									   uint32 *hashvalue);
+static bool ExecParallelHashJoinNewBatch(HashJoinState *hjstate);
+static bool ExecParallelHashJoinLoadBatch(HashJoinState *hjstate, int batchno);
+static void ExecHashJoinDetach(dsm_segment *seg, Datum arg);
 
 
 /* ----------------------------------------------------------------
@@ -147,6 +155,15 @@ ExecHashJoin(HashJoinState *node)
 					/* no chance to not build the hash table */
 					node->hj_FirstOuterTupleSlot = NULL;
 				}
+				else if (hashNode->parallel_state != NULL)
+				{
+					/*
+					 * The outer relation is shared with the other
+					 * participants, so our share of it being empty doesn't
+					 * tell us much; better help building the hash table.
+					 */
+					node->hj_FirstOuterTupleSlot = NULL;
+				}
 				else if (HJ_FILL_OUTER(node) ||
 						 (outerNode->plan->startup_cost < hashNode->ps.plan->total_cost &&
 						  !node->hj_OuterNotEmpty))
@@ -166,7 +183,7 @@ ExecHashJoin(HashJoinState *node)
 				/*
 				 * create the hash table
 				 */
-				hashtable = ExecHashTableCreate((Hash *) hashNode->ps.plan,
+				hashtable = ExecHashTableCreate(hashNode,
 												node->hj_HashOperators,
 												HJ_FILL_INNER(node));
 				node->hj_HashTable = hashtable;
@@ -198,6 +215,21 @@ ExecHashJoin(HashJoinState *node)
 				 */
 				node->hj_OuterNotEmpty = false;
 
+				/*
+				 * With a shared hash table and more than one batch, the
+				 * participants first write out the whole outer relation to
+				 * batch files.  Then we probe the shared table with our own
+				 * batch 0 tuples, unless the shared table didn't have room for
+				 * all of batch 0, in which case we go straight on to the
+				 * batches processed in private memory.
+				 */
+				if (hashtable->parallel_state != NULL &&
+					!ExecParallelHashJoinPartitionOuter(node))
+				{
+					node->hj_JoinState = HJ_NEED_NEW_BATCH;
+					continue;
+				}
+
 				node->hj_JoinState = HJ_NEED_NEW_OUTER;
 
 				/* FALL THRU */
@@ -296,7 +328,9 @@ ExecHashJoin(HashJoinState *node)
 				if (joinqual == NIL || ExecQual(joinqual, econtext, false))
 				{
 					node->hj_MatchedOuter = true;
-					HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
+					/* (not needed for a shared table; no right or full joins) */
+					if (!hashtable->shared)
+						HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
 
 					/* In an antijoin, we never return a matched tuple */
 					if (node->js.jointype == JOIN_ANTI)
@@ -652,6 +686,13 @@ ExecHashJoinOuterGetTuple(PlanState *outerNode,
 	int			curbatch = hashtable->curbatch;
 	TupleTableSlot *slot;
 
+	/*
+	 * A parallel hash join with more than one batch has partitioned the
+	 * whole outer relation into batch files already.
+	 */
+	if (hashtable->parallel_state != NULL && hashtable->nbatch > 1)
+		return ExecParallelHashJoinGetSavedOuterTuple(hjstate, hashvalue);
+
 	if (curbatch == 0)			/* if it is the first pass */
 	{
 		/*
@@ -730,6 +771,9 @@ ExecHashJoinNewBatch(HashJoinState *hjstate)
 	TupleTableSlot *slot;
 	uint32		hashvalue;
 
+	if (hashtable->parallel_state != NULL)
+		return ExecParallelHashJoinNewBatch(hjstate);
+
 	nbatch = hashtable->nbatch;
 	curbatch = hashtable->curbatch;
 
@@ -947,17 +991,265 @@ ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 }
 
 
+/*
+ * ExecParallelHashJoinPartitionOuter
+ *		write our share of the outer relation to our outer batch files, if
+ *		the shared hash table has more than one batch
+ *
+ * Returns true if we should go on to probe the shared hash table, with the
+ * outer plan's tuples if there's just one batch, or else with the tuples of
+ * our own batch 0 file.
+ */
+static bool
+ExecParallelHashJoinPartitionOuter(HashJoinState *hjstate)
+{
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	PlanState  *outerNode = outerPlanState(hjstate);
+	ExprContext *econtext = hjstate->js.ps.ps_ExprContext;
+	TupleTableSlot *slot;
+	uint32		hashvalue;
+	int			bucketno;
+	int			batchno;
+	bool		overflow;
+
+	if (hashtable->nbatch == 1)
+		return true;
+
+	if (ExecParallelHashAttachPartitioning(hashtable))
+	{
+		for (;;)
+		{
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+				break;
+			econtext->ecxt_outertuple = slot;
+			if (ExecHashGetHashValue(hashtable, econtext,
+									 hjstate->hj_OuterHashKeys,
+									 true,		/* outer tuple */
+									 HJ_FILL_OUTER(hjstate),
+									 &hashvalue))
+			{
+				ExecHashGetBucketAndBatch(hashtable, hashvalue,
+										  &bucketno, &batchno);
+				ExecParallelHashSaveTuple(hashtable,
+										  ExecFetchSlotMinimalTuple(slot),
+										  hashvalue, batchno, false);
+			}
+		}
+
+		ExecParallelHashPartitionDone(hashtable);
+	}
+
+	SpinLockAcquire(&pstate->mutex);
+	overflow = pstate->overflow;
+	SpinLockRelease(&pstate->mutex);
+	if (overflow)
+		return false;
+
+	hashtable->outerBatchFile[0] =
+		ExecParallelHashOpenFile(hashtable, false, 0, hashtable->participant);
+	return hashtable->outerBatchFile[0] != NULL;
+}
+
+/*
+ * ExecParallelHashJoinGetSavedOuterTuple
+ *		get the next outer tuple of the current batch of a parallel hash join
+ *		with more than one batch
+ *
+ * While probing the shared table, we read just our own batch 0 file.  For a
+ * batch processed in private memory, we read the files of all participants
+ * in turn.
+ */
+static TupleTableSlot *
+ExecParallelHashJoinGetSavedOuterTuple(HashJoinState *hjstate,
+									   uint32 *hashvalue)
+{
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+	int			curbatch = hashtable->curbatch;
+	BufFile    *file;
+	TupleTableSlot *slot;
+
+	for (;;)
+	{
+		file = hashtable->outerBatchFile[curbatch];
+		if (file == NULL)
+		{
+			if (hashtable->shared ||
+				hashtable->curparticipant >=
+				hashtable->parallel_state->nparticipants)
+				return NULL;
+			file = ExecParallelHashOpenFile(hashtable, false, curbatch,
+											hashtable->curparticipant++);
+			if (file == NULL)
+				continue;
+			hashtable->outerBatchFile[curbatch] = file;
+		}
+
+		slot = ExecHashJoinGetSavedTuple(hjstate,
+										 file,
+										 hashvalue,
+										 hjstate->hj_OuterTupleSlot);
+		if (!TupIsNull(slot))
+			return slot;
+
+		BufFileClose(file);
+		hashtable->outerBatchFile[curbatch] = NULL;
+	}
+}
+
+/*
+ * ExecParallelHashJoinNewBatch
+ *		switch to a new batch of a parallel hash join
+ *
+ * We claim batches from the shared state until we find one that isn't
+ * empty, and load it into private memory.  Returns false if there are no
+ * more batches left.
+ */
+static bool
+ExecParallelHashJoinNewBatch(HashJoinState *hjstate)
+{
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+	int			curbatch = hashtable->curbatch;
+	int			batchno;
+
+	if (hashtable->outerBatchFile[curbatch])
+		BufFileClose(hashtable->outerBatchFile[curbatch]);
+	hashtable->outerBatchFile[curbatch] = NULL;
+
+	/* From now on, we work in private memory only */
+	hashtable->shared = false;
+	hashtable->growEnabled = false;
+
+	while ((batchno = ExecParallelHashNextBatch(hashtable)) >= 0)
+	{
+		hashtable->curbatch = batchno;
+		hashtable->curparticipant = 0;
+
+		/*
+		 * If the inner batch is empty, we can skip the outer one, unless we
+		 * have to null-fill its tuples.
+		 */
+		if (ExecParallelHashJoinLoadBatch(hjstate, batchno) ||
+			HJ_FILL_OUTER(hjstate))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * ExecParallelHashJoinLoadBatch
+ *		load the inner tuples of a batch of a parallel hash join into our
+ *		private hash table
+ *
+ * The batch's tuples can be in the batch files of all participants, and
+ * also in the files of the batches it was split off from as nbatch grew.
+ * In the latter, we skip the tuples that now belong to other batches.  If
+ * the shared table overflowed, batch 0 also comprises the tuples in the
+ * shared table.  Returns false if the batch turns out to be empty.
+ */
+static bool
+ExecParallelHashJoinLoadBatch(HashJoinState *hjstate, int batchno)
+{
+	HashJoinTable hashtable = hjstate->hj_HashTable;
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	double		ntuples = 0;
+	int			nbatch;
+	int			participant;
+
+	ExecHashTableReset(hashtable);
+
+	if (batchno == 0)
+		ntuples += ExecParallelHashTableLoadShared(hashtable,
+												   hjstate->hj_HashTupleSlot);
+
+	for (nbatch = pstate->nbatch_original;; nbatch *= 2)
+	{
+		int			filebatchno = batchno & (nbatch - 1);
+
+		/* skip batch numbers we've seen already */
+		if (nbatch == pstate->nbatch_original ||
+			filebatchno != (batchno & (nbatch / 2 - 1)))
+		{
+			for (participant = 0; participant < pstate->nparticipants;
+				 participant++)
+			{
+				BufFile    *file;
+				TupleTableSlot *slot;
+				uint32		hashvalue;
+				int			bucketno;
+				int			tuplebatchno;
+
+				file = ExecParallelHashOpenFile(hashtable, true, filebatchno,
+												participant);
+				if (file == NULL)
+					continue;
+
+				while ((slot = ExecHashJoinGetSavedTuple(hjstate,
+														 file,
+														 &hashvalue,
+												 hjstate->hj_HashTupleSlot)))
+				{
+					ExecHashGetBucketAndBatch(hashtable, hashvalue,
+											  &bucketno, &tuplebatchno);
+					if (tuplebatchno == batchno)
+					{
+						ExecHashTableInsert(hashtable, slot, hashvalue);
+						ntuples += 1;
+					}
+				}
+
+				BufFileClose(file);
+			}
+		}
+
+		if (nbatch == hashtable->nbatch)
+			break;
+	}
+
+	return ntuples > 0;
+}
+
+
 void
 ExecReScanHashJoin(HashJoinState *node)
 {
+	HashState  *hashNode = (HashState *) innerPlanState(node);
+
 	/*
 	 * In a multi-batch join, we currently have to do rescans the hard way,
 	 * primarily because batch temp files may have already been released. But
 	 * if it's a single-batch join, and there is no parameter change for the
 	 * inner subnode, then we can just re-use the existing hash table without
 	 * rebuilding it.
+	 *
+	 * A shared hash table is always rebuilt, by the new set of workers that
+	 * Gather will start.  Gather has shut down the old ones before rescanning
+	 * us, so we can reset the shared state now.
 	 */
-	if (node->hj_HashTable != NULL)
+	if (hashNode->parallel_state != NULL)
+	{
+		ParallelHashJoinState *pstate = hashNode->parallel_state;
+
+		if (node->hj_HashTable != NULL)
+		{
+			ExecHashTableDestroy(node->hj_HashTable);
+			node->hj_HashTable = NULL;
+		}
+		ExecParallelHashDeleteFiles(pstate);
+		ExecParallelHashInitialize(pstate, (Hash *) hashNode->ps.plan,
+								   pstate->nparticipants);
+		node->hj_JoinState = HJ_BUILD_HASHTABLE;
+
+		/*
+		 * if chgParam of subnode is not null then plan will be re-scanned by
+		 * first ExecProcNode.
+		 */
+		if (node->js.ps.righttree->chgParam == NULL)
+			ExecReScan(node->js.ps.righttree);
+	}
+	else if (node->hj_HashTable != NULL)
 	{
 		if (node->hj_HashTable->nbatch == 1 &&
 			node->js.ps.righttree->chgParam == NULL)
@@ -1018,3 +1310,73 @@ ExecReScanHashJoin(HashJoinState *node)
 	if (node->js.ps.lefttree->chgParam == NULL)
 		ExecReScan(node->js.ps.lefttree);
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Hash Join Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinEstimate
+ *
+ *		estimates the space required for the shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinEstimate(HashJoinState *state, ParallelContext *pcxt)
+{
+	HashState  *hashNode = (HashState *) innerPlanState(state);
+
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   ExecParallelHashEstimate((Hash *) hashNode->ps.plan,
+													pcxt->nworkers + 1));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinInitializeDSM
+ *
+ *		Set up the shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinInitializeDSM(HashJoinState *state, ParallelContext *pcxt)
+{
+	HashState  *hashNode = (HashState *) innerPlanState(state);
+	Hash	   *node = (Hash *) hashNode->ps.plan;
+	int			nparticipants = pcxt->nworkers + 1;
+	ParallelHashJoinState *pstate;
+
+	pstate = shm_toc_allocate(pcxt->toc,
+							  ExecParallelHashEstimate(node, nparticipants));
+	ExecParallelHashInitialize(pstate, node, nparticipants);
+	shm_toc_insert(pcxt->toc, state->js.ps.plan->plan_node_id, pstate);
+	hashNode->parallel_state = pstate;
+
+	/* Remove the batch files once the query is done with them. */
+	on_dsm_detach(pcxt->seg, ExecHashJoinDetach, PointerGetDatum(pstate));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinInitializeWorker
+ *
+ *		Attach to the shared hash table.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinInitializeWorker(HashJoinState *state, shm_toc *toc)
+{
+	HashState  *hashNode = (HashState *) innerPlanState(state);
+
+	hashNode->parallel_state =
+		shm_toc_lookup(toc, state->js.ps.plan->plan_node_id);
+}
+
+/*
+ * on_dsm_detach callback of the leader, removing the batch files
+ */
+static void
+ExecHashJoinDetach(dsm_segment *seg, Datum arg)
+{
+	ExecParallelHashDeleteFiles((ParallelHashJoinState *) DatumGetPointer(arg));
+}
@@ -0,0 +1,576 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeMemoize.c
+ *	  Routines to handle caching of the results of parameterized scans
+ *
+ * A Memoize node sits on the inner side of a nestloop join, above a scan
+ * that depends on parameters set by the nestloop.  It remembers the tuples
+ * each scan returned, keyed by the parameter values, and when the nestloop
+ * rescans it with values it has seen before, it returns the remembered
+ * tuples instead of running the subplan again.  That pays off when the
+ * outer side has many duplicate join keys, for example when joining to a
+ * small reference table.
+ *
+ * The cache is a TupleHashTable whose entries hold the list of tuples of
+ * one scan.  An entry becomes usable only once its scan has run to
+ * completion; an entry whose scan is interrupted by a rescan is thrown
+ * away.  The cache is limited to work_mem: when it outgrows that, the least
+ * recently used entries are evicted, and a single scan too big to fit by
+ * itself is simply not cached.
+ *
+ * If the subplan depends on any parameter other than the cache keys, a
+ * change in its value makes all the cached results stale, so the whole
+ * cache is purged.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeMemoize.c
+ *
+ *-------------------------------------------------------------------------
+ */
+/*
+ * INTERFACE ROUTINES
+ *		ExecMemoize			- return the cached or fresh output of a scan
+ *		ExecInitMemoize		- initialize node and subnodes
+ *		ExecEndMemoize		- shutdown node and subnodes
+ *		ExecReScanMemoize	- prepare for a scan with new parameters
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/nodeMemoize.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/memutils.h"
+
+/* states of the ExecMemoize state machine */
+#define MEMO_CACHE_LOOKUP			1	/* look up the keys of a new scan */
+#define MEMO_CACHE_FETCH_NEXT_TUPLE 2	/* return tuples of a cached scan */
+#define MEMO_FILLING_CACHE			3	/* run the subplan, caching its output */
+#define MEMO_CACHE_BYPASS_MODE		4	/* run the subplan without caching */
+#define MEMO_END_OF_SCAN			5	/* the scan is done */
+
+/* a cached tuple */
+typedef struct MemoizeTuple
+{
+	MinimalTuple mintuple;
+	struct MemoizeTuple *next;
+} MemoizeTuple;
+
+/* a cache entry, holding the tuples of one scan */
+typedef struct MemoizeEntry
+{
+	TupleHashEntryData shared;	/* common header for hash table entries */
+	dlist_node	lru_node;		/* link in MemoizeState's lru_list */
+	MemoizeTuple *tuplehead;	/* the tuples, in the order returned */
+	MemoizeTuple *tupletail;
+	Size		mem_used;		/* bytes charged for this entry */
+	bool		complete;		/* have all the tuples been cached? */
+} MemoizeEntry;
+
+static void build_hash_table(MemoizeState *node);
+static MemoizeEntry *cache_lookup(MemoizeState *node, bool *found);
+static bool cache_store_tuple(MemoizeState *node, TupleTableSlot *slot);
+static bool cache_reduce_memory(MemoizeState *node);
+static void remove_cache_entry(MemoizeState *node, MemoizeEntry *entry);
+static void cache_purge_all(MemoizeState *node);
+static bool collect_param_ids_walker(Node *node, Bitmapset **paramids);
+
+
+/*
+ * Initialize the hash table to empty.
+ */
+static void
+build_hash_table(MemoizeState *node)
+{
+	Memoize    *plan = (Memoize *) node->ss.ps.plan;
+
+	node->hashtable = BuildTupleHashTable(node->nkeys,
+										  node->keyColIdx,
+										  node->eqfunctions,
+										  node->hashfunctions,
+										  Max(plan->est_entries, 1),
+										  sizeof(MemoizeEntry),
+										  node->tableContext,
+								node->ss.ps.ps_ExprContext->ecxt_per_tuple_memory);
+	dlist_init(&node->lru_list);
+	node->mem_used = 0;
+}
+
+/*
+ * Compute the cache keys of the current scan into probeslot, and find or
+ * create the cache entry for them.  A new entry is made the most recently
+ * used one; so is an existing one.
+ */
+static MemoizeEntry *
+cache_lookup(MemoizeState *node, bool *found)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *probeslot = node->probeslot;
+	MemoizeEntry *entry;
+	MemoryContext oldcontext;
+	ListCell   *lc;
+	int			i;
+	bool		isnew;
+
+	ResetExprContext(econtext);
+	oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+	ExecClearTuple(probeslot);
+	i = 0;
+	foreach(lc, node->param_exprs)
+	{
+		ExprState  *keyexpr = (ExprState *) lfirst(lc);
+
+		probeslot->tts_values[i] = ExecEvalExpr(keyexpr, econtext,
+												&probeslot->tts_isnull[i],
+												NULL);
+		i++;
+	}
+	ExecStoreVirtualTuple(probeslot);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	entry = (MemoizeEntry *) LookupTupleHashEntry(node->hashtable, probeslot,
+												  &isnew);
+	if (isnew)
+	{
+		entry->tuplehead = NULL;
+		entry->tupletail = NULL;
+		entry->complete = false;
+		entry->mem_used = sizeof(MemoizeEntry) +
+			GetMemoryChunkSpace(entry->shared.firstTuple);
+		node->mem_used += entry->mem_used;
+	}
+	else
+		dlist_delete(&entry->lru_node);
+	dlist_push_tail(&node->lru_list, &entry->lru_node);
+
+	*found = !isnew;
+	return entry;
+}
+
+/*
+ * Add a tuple to the entry being filled.  Returns false if the entry no
+ * longer fits in the cache, in which case it has been removed.
+ */
+static bool
+cache_store_tuple(MemoizeState *node, TupleTableSlot *slot)
+{
+	MemoizeEntry *entry = node->entry;
+	MemoizeTuple *tuple;
+	MemoryContext oldcontext;
+	Size		size;
+
+	oldcontext = MemoryContextSwitchTo(node->tableContext);
+
+	tuple = (MemoizeTuple *) palloc(sizeof(MemoizeTuple));
+	tuple->mintuple = ExecCopySlotMinimalTuple(slot);
+	tuple->next = NULL;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (entry->tupletail)
+		entry->tupletail->next = tuple;
+	else
+		entry->tuplehead = tuple;
+	entry->tupletail = tuple;
+
+	size = GetMemoryChunkSpace(tuple) + GetMemoryChunkSpace(tuple->mintuple);
+	entry->mem_used += size;
+	node->mem_used += size;
+
+	return cache_reduce_memory(node);
+}
+
+/*
+ * Evict the least recently used entries until the cache fits in its memory
+ * limit again.  The entry being filled, which is the most recently used
+ * one, is removed only if it is too big all by itself; returns false then.
+ */
+static bool
+cache_reduce_memory(MemoizeState *node)
+{
+	if (node->mem_used > node->mem_peak)
+		node->mem_peak = node->mem_used;
+
+	while (node->mem_used > node->mem_limit)
+	{
+		MemoizeEntry *victim;
+
+		victim = dlist_head_element(MemoizeEntry, lru_node, &node->lru_list);
+		if (victim == node->entry)
+		{
+			remove_cache_entry(node, victim);
+			node->entry = NULL;
+			node->cache_overflows++;
+			return false;
+		}
+
+		remove_cache_entry(node, victim);
+		node->cache_evictions++;
+	}
+
+	return true;
+}
+
+/*
+ * Remove an entry from the cache, and free its tuples.
+ */
+static void
+remove_cache_entry(MemoizeState *node, MemoizeEntry *entry)
+{
+	MemoizeTuple *tuple = entry->tuplehead;
+	MinimalTuple key = entry->shared.firstTuple;
+
+	while (tuple != NULL)
+	{
+		MemoizeTuple *next = tuple->next;
+
+		pfree(tuple->mintuple);
+		pfree(tuple);
+		tuple = next;
+	}
+
+	dlist_delete(&entry->lru_node);
+	node->mem_used -= entry->mem_used;
+
+	/* the hash table finds the entry to remove by its key */
+	ExecStoreMinimalTuple(key, node->keyslot, false);
+	RemoveTupleHashEntry(node->hashtable, node->keyslot);
+	ExecClearTuple(node->keyslot);
+	pfree(key);
+}
+
+/*
+ * Throw away all the cached scans.
+ */
+static void
+cache_purge_all(MemoizeState *node)
+{
+	MemoryContextResetAndDeleteChildren(node->tableContext);
+	build_hash_table(node);
+	node->entry = NULL;
+	node->last_tuple = NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecMemoize
+ *
+ *		On the first call of a scan, look up its keys in the cache.  If
+ *		the cache has the scan's tuples, return them from there; else run
+ *		the subplan, and store its tuples in the cache as we return them.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecMemoize(MemoizeState *node)
+{
+	TupleTableSlot *outerslot;
+
+	switch (node->mstatus)
+	{
+		case MEMO_CACHE_LOOKUP:
+			{
+				MemoizeEntry *entry;
+				bool		found;
+
+				Assert(node->entry == NULL);
+
+				entry = cache_lookup(node, &found);
+
+				if (found)
+				{
+					/* Only complete scans are kept in the cache */
+					Assert(entry->complete);
+
+					node->cache_hits++;
+					node->entry = entry;
+					node->last_tuple = entry->tuplehead;
+					if (node->last_tuple == NULL)
+					{
+						node->mstatus = MEMO_END_OF_SCAN;
+						return NULL;
+					}
+					node->mstatus = MEMO_CACHE_FETCH_NEXT_TUPLE;
+					return ExecStoreMinimalTuple(node->last_tuple->mintuple,
+												 node->ss.ps.ps_ResultTupleSlot,
+												 false);
+				}
+
+				node->cache_misses++;
+				node->entry = entry;
+
+				/*
+				 * Make room for the new entry.  If it doesn't fit even in an
+				 * empty cache, which is unlikely, just run the subplan.
+				 */
+				if (!cache_reduce_memory(node))
+				{
+					node->mstatus = MEMO_CACHE_BYPASS_MODE;
+					return ExecProcNode(outerPlanState(node));
+				}
+
+				outerslot = ExecProcNode(outerPlanState(node));
+				if (TupIsNull(outerslot))
+				{
+					/* an empty scan; remember that too */
+					entry->complete = true;
+					node->mstatus = MEMO_END_OF_SCAN;
+					return NULL;
+				}
+
+				if (cache_store_tuple(node, outerslot))
+					node->mstatus = MEMO_FILLING_CACHE;
+				else
+					node->mstatus = MEMO_CACHE_BYPASS_MODE;
+				return outerslot;
+			}
+
+		case MEMO_CACHE_FETCH_NEXT_TUPLE:
+			{
+				Assert(node->entry != NULL && node->last_tuple != NULL);
+
+				node->last_tuple = node->last_tuple->next;
+				if (node->last_tuple == NULL)
+				{
+					node->mstatus = MEMO_END_OF_SCAN;
+					return NULL;
+				}
+				return ExecStoreMinimalTuple(node->last_tuple->mintuple,
+											 node->ss.ps.ps_ResultTupleSlot,
+											 false);
+			}
+
+		case MEMO_FILLING_CACHE:
+			{
+				Assert(node->entry != NULL);
+
+				outerslot = ExecProcNode(outerPlanState(node));
+				if (TupIsNull(outerslot))
+				{
+					/* the scan is complete, so the entry can now be used */
+					node->entry->complete = true;
+					node->mstatus = MEMO_END_OF_SCAN;
+					return NULL;
+				}
+
+				if (!cache_store_tuple(node, outerslot))
+					node->mstatus = MEMO_CACHE_BYPASS_MODE;
+				return outerslot;
+			}
+
+		case MEMO_CACHE_BYPASS_MODE:
+			{
+				Assert(node->entry == NULL);
+
+				outerslot = ExecProcNode(outerPlanState(node));
+				if (TupIsNull(outerslot))
+				{
+					node->mstatus = MEMO_END_OF_SCAN;
+					return NULL;
+				}
+				return outerslot;
+			}
+
+		case MEMO_END_OF_SCAN:
+
+			/*
+			 * We've already returned NULL for this scan, but just in case
+			 * something calls us again by mistake.
+			 */
+			return NULL;
+
+		default:
+			elog(ERROR, "unrecognized memoize state: %d",
+				 (int) node->mstatus);
+			return NULL;		/* keep compiler quiet */
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitMemoize
+ * ----------------------------------------------------------------
+ */
+MemoizeState *
+ExecInitMemoize(Memoize *node, EState *estate, int eflags)
+{
+	MemoizeState *mstate;
+	TupleDesc	keydesc;
+	ListCell   *lc;
+	int			i;
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	mstate = makeNode(MemoizeState);
+	mstate->ss.ps.plan = (Plan *) node;
+	mstate->ss.ps.state = estate;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * create expression context for node, used to compute the keys and
+	 * as the hash table's temporary context
+	 */
+	ExecAssignExprContext(estate, &mstate->ss.ps);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitResultTupleSlot(estate, &mstate->ss.ps);
+	mstate->probeslot = ExecInitExtraTupleSlot(estate);
+	mstate->keyslot = ExecInitExtraTupleSlot(estate);
+
+	/*
+	 * initialize child nodes
+	 */
+	outerPlanState(mstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	/*
+	 * initialize tuple type.  no need to initialize projection info because
+	 * this node doesn't do projections.
+	 */
+	ExecAssignResultTypeFromTL(&mstate->ss.ps);
+	mstate->ss.ps.ps_ProjInfo = NULL;
+
+	/*
+	 * initialize the cache keys
+	 */
+	mstate->nkeys = node->numKeys;
+	mstate->param_exprs = (List *)
+		ExecInitExpr((Expr *) node->param_exprs, (PlanState *) mstate);
+
+	keydesc = ExecTypeFromExprList(node->param_exprs);
+	ExecSetSlotDescriptor(mstate->probeslot, keydesc);
+	ExecSetSlotDescriptor(mstate->keyslot, keydesc);
+
+	mstate->keyColIdx = (AttrNumber *) palloc(node->numKeys *
+											  sizeof(AttrNumber));
+	for (i = 0; i < node->numKeys; i++)
+		mstate->keyColIdx[i] = i + 1;
+
+	execTuplesHashPrepare(node->numKeys,
+						  node->hashOperators,
+						  &mstate->eqfunctions,
+						  &mstate->hashfunctions);
+
+	mstate->keyparamids = NULL;
+	foreach(lc, node->param_exprs)
+		collect_param_ids_walker((Node *) lfirst(lc), &mstate->keyparamids);
+
+	/*
+	 * initialize the cache
+	 */
+	mstate->tableContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Memoize hash table",
+												 ALLOCSET_DEFAULT_SIZES);
+	mstate->mem_limit = work_mem * 1024L;
+	build_hash_table(mstate);
+
+	mstate->mstatus = MEMO_CACHE_LOOKUP;
+	mstate->entry = NULL;
+	mstate->last_tuple = NULL;
+
+	return mstate;
+}
+
+/*
+ * Collect the PARAM_EXEC params referenced in an expression.
+ */
+static bool
+collect_param_ids_walker(Node *node, Bitmapset **paramids)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param))
+	{
+		Param	   *param = (Param *) node;
+
+		if (param->paramkind == PARAM_EXEC)
+			*paramids = bms_add_member(*paramids, param->paramid);
+		return false;
+	}
+	return expression_tree_walker(node, collect_param_ids_walker,
+								  (void *) paramids);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndMemoize
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndMemoize(MemoizeState *node)
+{
+	/*
+	 * Free the exprcontext
+	 */
+	ExecFreeExprContext(&node->ss.ps);
+
+	/*
+	 * clean out the tuple table
+	 */
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->probeslot);
+	ExecClearTuple(node->keyslot);
+
+	/* free the cache */
+	MemoryContextDelete(node->tableContext);
+
+	/*
+	 * shut down the subplan
+	 */
+	ExecEndNode(outerPlanState(node));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecReScanMemoize
+ *
+ *		Prepare for a scan with (usually) new parameter values.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanMemoize(MemoizeState *node)
+{
+	PlanState  *outerPlan = outerPlanState(node);
+
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+
+	/* An entry whose scan we didn't finish can't be used */
+	if (node->entry != NULL && !node->entry->complete)
+		remove_cache_entry(node, node->entry);
+
+	node->mstatus = MEMO_CACHE_LOOKUP;
+	node->entry = NULL;
+	node->last_tuple = NULL;
+
+	/*
+	 * If a parameter other than the cache keys changed, the cached results
+	 * may no longer be right.
+	 */
+	if (bms_nonempty_difference(outerPlan->chgParam, node->keyparamids))
+		cache_purge_all(node);
+
+	/*
+	 * if chgParam of subnode is not null then plan will be re-scanned by
+	 * first ExecProcNode.
+	 */
+	if (outerPlan->chgParam == NULL)
+		ExecReScan(outerPlan);
+}
+
+/*
+ * ExecEstimateCacheEntryOverheadBytes
+ *		Estimate the memory a cache entry holding 'ntuples' tuples takes,
+ *		over and above the tuples themselves.  For the planner.
+ */
+double
+ExecEstimateCacheEntryOverheadBytes(double ntuples)
+{
+	return sizeof(MemoizeEntry) + sizeof(MemoizeTuple) * ntuples;
+}
@@ -61,6 +61,11 @@ static bool ExecOnConflictUpdate(ModifyTableState *mtstate,
 					 EState *estate,
 					 bool canSetTag,
 					 TupleTableSlot **returning);
+static void ExecBatchInsertAdd(ModifyTableState *mtstate,
+				   ResultRelInfo *resultRelInfo,
+				   TupleTableSlot *slot);
+static void ExecBatchInsert(ModifyTableState *mtstate,
+				ResultRelInfo *resultRelInfo);
 
 /*
  * Verify that the tuples to be produced by INSERT or UPDATE match the
@@ -326,6 +331,16 @@ ExecInsert(ModifyTableState *mtstate,
 	}
 	else if (resultRelInfo->ri_FdwRoutine)
 	{
+		/*
+		 * If the FDW inserts in batches, just queue the row; the rest of
+		 * the work is done by ExecBatchInsert when the batch is sent.
+		 */
+		if (resultRelInfo->ri_BatchSize > 1)
+		{
+			ExecBatchInsertAdd(mtstate, resultRelInfo, slot);
+			return NULL;
+		}
+
 		/*
 		 * insert into foreign table: let the FDW do it
 		 */
@@ -533,6 +548,86 @@ ExecInsert(ModifyTableState *mtstate,
 	return NULL;
 }
 
+/*
+ * Queue a row for a batched insert into a foreign table, sending off the
+ * batch first if it's already full.
+ */
+static void
+ExecBatchInsertAdd(ModifyTableState *mtstate,
+				   ResultRelInfo *resultRelInfo,
+				   TupleTableSlot *slot)
+{
+	EState	   *estate = mtstate->ps.state;
+	int			i;
+
+	if (resultRelInfo->ri_NumSlots >= resultRelInfo->ri_BatchSize)
+		ExecBatchInsert(mtstate, resultRelInfo);
+
+	/* The queue and its slots live until the end of the query */
+	if (resultRelInfo->ri_Slots == NULL)
+		resultRelInfo->ri_Slots = (TupleTableSlot **)
+			MemoryContextAllocZero(estate->es_query_cxt,
+								   resultRelInfo->ri_BatchSize *
+								   sizeof(TupleTableSlot *));
+
+	i = resultRelInfo->ri_NumSlots;
+	if (resultRelInfo->ri_Slots[i] == NULL)
+	{
+		MemoryContext oldcontext;
+
+		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+		resultRelInfo->ri_Slots[i] =
+			MakeSingleTupleTableSlot(RelationGetDescr(resultRelInfo->ri_RelationDesc));
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	ExecCopySlot(resultRelInfo->ri_Slots[i], slot);
+	resultRelInfo->ri_NumSlots++;
+}
+
+/*
+ * Send the queued rows to the FDW, then do for each row it reports as
+ * inserted what ExecInsert does after ExecForeignInsert.
+ */
+static void
+ExecBatchInsert(ModifyTableState *mtstate, ResultRelInfo *resultRelInfo)
+{
+	EState	   *estate = mtstate->ps.state;
+	TupleTableSlot **rslots;
+	int			numInserted = resultRelInfo->ri_NumSlots;
+	int			i;
+
+	if (numInserted == 0)
+		return;
+
+	rslots = resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert(estate,
+																  resultRelInfo,
+												   resultRelInfo->ri_Slots,
+																&numInserted);
+
+	for (i = 0; i < numInserted; i++)
+	{
+		TupleTableSlot *slot = rslots[i];
+		HeapTuple	tuple = ExecMaterializeSlot(slot);
+
+		tuple->t_tableOid = RelationGetRelid(resultRelInfo->ri_RelationDesc);
+
+		/* AFTER ROW INSERT Triggers */
+		ExecARInsertTriggers(estate, resultRelInfo, tuple, NIL);
+
+		/* Check any WITH CHECK OPTION constraints from parent views */
+		if (resultRelInfo->ri_WithCheckOptions != NIL)
+			ExecWithCheckOptions(WCO_VIEW_CHECK, resultRelInfo, slot, estate);
+	}
+
+	if (mtstate->canSetTag)
+		estate->es_processed += numInserted;
+
+	for (i = 0; i < resultRelInfo->ri_NumSlots; i++)
+		ExecClearTuple(resultRelInfo->ri_Slots[i]);
+	resultRelInfo->ri_NumSlots = 0;
+}
+
 /* ----------------------------------------------------------------
  *		ExecDelete
  *
@@ -1546,6 +1641,19 @@ ExecModifyTable(ModifyTableState *node)
 		}
 	}
 
+	/* Send off any rows still queued for batched foreign inserts */
+	if (operation == CMD_INSERT)
+	{
+		int			i;
+
+		for (i = 0; i < node->mt_nplans; i++)
+		{
+			resultRelInfo = node->resultRelInfo + i;
+			estate->es_result_relation_info = resultRelInfo;
+			ExecBatchInsert(node, resultRelInfo);
+		}
+	}
+
 	/* Restore es_result_relation_info before exiting */
 	estate->es_result_relation_info = saved_resultRelInfo;
 
@@ -1938,6 +2046,27 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 	if (estate->es_trig_tuple_slot == NULL)
 		estate->es_trig_tuple_slot = ExecInitExtraTupleSlot(estate);
 
+	/*
+	 * Ask FDWs of foreign result rels whether they want INSERTed rows handed
+	 * over in batches.  That's impossible if we need RETURNING output for
+	 * each row as it's inserted.
+	 */
+	if (operation == CMD_INSERT && !(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+	{
+		resultRelInfo = mtstate->resultRelInfo;
+		for (i = 0; i < nplans; i++)
+		{
+			if (!resultRelInfo->ri_usesFdwDirectModify &&
+				resultRelInfo->ri_FdwRoutine != NULL &&
+				resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize != NULL &&
+				resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert != NULL &&
+				resultRelInfo->ri_projectReturning == NULL)
+				resultRelInfo->ri_BatchSize =
+					resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize(resultRelInfo);
+			resultRelInfo++;
+		}
+	}
+
 	/*
 	 * Lastly, if this is not the primary (canSetTag) ModifyTable node, add it
 	 * to estate->es_auxmodifytables so that it will be run to completion by
@@ -1979,6 +2108,20 @@ ExecEndModifyTable(ModifyTableState *node)
 			resultRelInfo->ri_FdwRoutine->EndForeignModify != NULL)
 			resultRelInfo->ri_FdwRoutine->EndForeignModify(node->ps.state,
 														   resultRelInfo);
+
+		/* Release the slots of a batched insert queue */
+		if (resultRelInfo->ri_Slots != NULL)
+		{
+			int			j;
+
+			for (j = 0; j < resultRelInfo->ri_BatchSize; j++)
+			{
+				if (resultRelInfo->ri_Slots[j] != NULL)
+					ExecDropSingleTupleTableSlot(resultRelInfo->ri_Slots[j]);
+			}
+			resultRelInfo->ri_Slots = NULL;
+			resultRelInfo->ri_NumSlots = 0;
+		}
 	}
 
 	/*
@@ -20,6 +20,9 @@
  *		ExecEndSeqScan			releases any storage allocated.
  *		ExecReScanSeqScan		rescans the relation
  *
+ *		ExecSeqScanInitBatch	prepares for scanning in batch mode
+ *		ExecSeqScanBatch		retrieve next batch of tuples
+ *
  *		ExecSeqScanEstimate		estimates DSM space needed for parallel scan
  *		ExecSeqScanInitializeDSM initialize DSM for parallel scan
  *		ExecSeqScanInitializeWorker attach to DSM info in parallel worker
@@ -29,6 +32,7 @@
 #include "access/relscan.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
+#include "miscadmin.h"
 #include "utils/rel.h"
 
 static void InitScanRelation(SeqScanState *node, EState *estate, int eflags);
@@ -129,6 +133,120 @@ ExecSeqScan(SeqScanState *node)
 					(ExecScanRecheckMtd) SeqRecheck);
 }
 
+/* ----------------------------------------------------------------
+ *		ExecSeqScanInitBatch
+ *
+ *		Prepares the scan to be consumed a batch at a time, by
+ *		ExecSeqScanBatch rather than ExecProcNode, returning the batch.
+ *		The batch contains the given scan tuple attributes, plus those
+ *		needed by the quals.  Returns NULL if the quals can't be evaluated
+ *		in batch mode; the scan must then be run normally.
+ * ----------------------------------------------------------------
+ */
+TupleBatch *
+ExecSeqScanInitBatch(SeqScanState *node, List *attnos)
+{
+	SeqScan    *plan = (SeqScan *) node->ss.ps.plan;
+	TupleBatch *batch;
+	ListCell   *lc;
+
+	/* EvalPlanQual substitutes test tuples, see ExecScanFetch */
+	if (node->ss.ps.state->es_epqTuple != NULL)
+		return NULL;
+
+	batch = ExecCreateTupleBatch(RelationGetDescr(node->ss.ss_currentRelation)->natts);
+	foreach(lc, attnos)
+		(void) ExecBatchAddColumn(batch, (AttrNumber) lfirst_int(lc));
+
+	if (!ExecBuildBatchQuals(plan->plan.qual, plan->scanrelid, batch,
+							 &node->batchquals, &node->nbatchquals))
+		return NULL;
+
+	node->batch = batch;
+
+	return batch;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanBatch
+ *
+ *		Fills the scan's batch with the next tuples of the relation and
+ *		evaluates the quals over them.  Returns false once the relation
+ *		is exhausted.  Batches can have no qualifying tuples but more
+ *		to follow.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecSeqScanBatch(SeqScanState *node)
+{
+	TupleBatch *batch = node->batch;
+	EState	   *estate = node->ss.ps.state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	HeapScanDesc scandesc;
+	HeapTuple	tuple;
+	int			ntuples = 0;
+	int			col;
+
+	Assert(batch != NULL);
+
+	CHECK_FOR_INTERRUPTS();
+
+	/* as in ExecProcNode, rescan first if parameters changed */
+	if (node->ss.ps.chgParam != NULL)
+		ExecReScan((PlanState *) node);
+
+	/* heap_getnext would start over after returning the last tuple */
+	if (node->batchdone)
+		return false;
+
+	/* we bypass ExecProcNode, so account for the node ourselves */
+	if (node->ss.ps.instrument)
+		InstrStartNode(node->ss.ps.instrument);
+
+	scandesc = node->ss.ss_currentScanDesc;
+	if (scandesc == NULL)
+	{
+		/* see SeqNext */
+		scandesc = heap_beginscan(node->ss.ss_currentRelation,
+								  estate->es_snapshot,
+								  0, NULL);
+		node->ss.ss_currentScanDesc = scandesc;
+	}
+
+	while (ntuples < EXEC_BATCH_SIZE)
+	{
+		tuple = heap_getnext(scandesc, ForwardScanDirection);
+		if (tuple == NULL)
+		{
+			node->batchdone = true;
+			break;
+		}
+
+		ExecStoreTuple(tuple, slot, scandesc->rs_cbuf, false);
+		slot_getsomeattrs(slot, batch->maxattno);
+
+		for (col = 0; col < batch->ncols; col++)
+		{
+			int			attoff = batch->attnos[col] - 1;
+
+			batch->values[col][ntuples] = slot->tts_values[attoff];
+			batch->isnull[col][ntuples] = slot->tts_isnull[attoff];
+		}
+		ntuples++;
+	}
+	batch->ntuples = ntuples;
+
+	ExecBatchFilter(batch, node->batchquals, node->nbatchquals);
+
+	if (node->ss.ps.instrument)
+	{
+		InstrStopNode(node->ss.ps.instrument, batch->nselected);
+		InstrCountFiltered1(node, ntuples - batch->nselected);
+	}
+
+	return ntuples > 0;
+}
+
 /* ----------------------------------------------------------------
  *		InitScanRelation
  *
@@ -279,6 +397,7 @@ ExecReScanSeqScan(SeqScanState *node)
 	if (scan != NULL)
 		heap_rescan(scan,		/* scan desc */
 					NULL);		/* new scan keys */
+	node->batchdone = false;
 
 	ExecScanReScan((ScanState *) node);
 }
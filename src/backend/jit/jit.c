@@ -0,0 +1,282 @@
+/*-------------------------------------------------------------------------
+ *
+ * jit.c
+ *	  Provider independent JIT infrastructure.
+ *
+ * Code related to loading JIT providers, and handing them the parts of a
+ * query worth compiling.  Nothing specific to one JIT implementation
+ * belongs here.
+ *
+ * A query is compiled if its estimated total cost exceeds jit_above_cost;
+ * the planner records that decision in PlannedStmt.jitFlags, so that
+ * parallel workers compile the same things as the leader.  While the
+ * executor initializes the plan, we then ask the provider to compile each
+ * plan node's quals and target list expressions, and for scans a function
+ * to deform the tuples of the scanned relation.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/jit/jit.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <sys/stat.h>
+
+#include "executor/executor.h"
+#include "fmgr.h"
+#include "jit/jit.h"
+#include "miscadmin.h"
+
+
+/* GUCs */
+bool		jit_enabled = false;
+char	   *jit_provider = NULL;
+double		jit_above_cost = 100000;
+bool		jit_expressions = true;
+bool		jit_tuple_deforming = true;
+
+static JitProviderCallbacks provider;
+static bool provider_successfully_loaded = false;
+static bool provider_failed_loading = false;
+
+
+static bool provider_init(void);
+static JitContext *jit_get_context(EState *estate);
+static void jit_release_context(void *arg);
+static void jit_compile_expr(JitContext *context, ExprState *exprstate);
+static void jit_compile_deform(JitContext *context, TupleTableSlot *slot);
+
+
+/*
+ * Load the JIT provider, if that hasn't been done yet.  Returns false if it
+ * can't be loaded.
+ */
+static bool
+provider_init(void)
+{
+	char		path[MAXPGPATH];
+	struct stat st;
+	JitProviderInit init;
+
+	/* don't even try to load if not enabled */
+	if (!jit_enabled)
+		return false;
+
+	/*
+	 * Don't retry loading after failing - attempting to load JIT provider
+	 * isn't cheap.
+	 */
+	if (provider_failed_loading)
+		return false;
+	if (provider_successfully_loaded)
+		return true;
+
+	/*
+	 * Check whether the shared library exists.  We do that check before
+	 * loading the shared library (which'd error out if not present), so JIT
+	 * can be enabled in installations without the provider; queries are
+	 * then just executed without it.
+	 */
+	snprintf(path, MAXPGPATH, "%s/%s%s", pkglib_path, jit_provider, DLSUFFIX);
+	elog(DEBUG1, "probing availability of JIT provider at %s", path);
+	if (stat(path, &st) != 0)
+	{
+		elog(DEBUG1,
+			 "provider not available, disabling JIT for current session");
+		provider_failed_loading = true;
+		return false;
+	}
+
+	/*
+	 * If loading functions fails, signal failure.  We do so because
+	 * load_external_function() might error out despite the above check if
+	 * e.g. the library's dependencies aren't installed.  We want to signal
+	 * ERROR in that case, so the user is notified, but we don't want to
+	 * continually retry.
+	 */
+	provider_failed_loading = true;
+
+	/* and initialize */
+	init = (JitProviderInit)
+		load_external_function(path, "_PG_jit_provider_init", true, NULL);
+	init(&provider);
+
+	provider_successfully_loaded = true;
+	provider_failed_loading = false;
+
+	elog(DEBUG1, "successfully loaded JIT provider in current session");
+
+	return true;
+}
+
+/*
+ * Decide what to JIT compile in a plan of the given total cost.  Returns
+ * PGJIT_* flags.
+ */
+int
+jit_plan_flags(double total_cost)
+{
+	int			flags = PGJIT_NONE;
+
+	if (jit_enabled && jit_above_cost >= 0 && total_cost > jit_above_cost)
+	{
+		flags |= PGJIT_PERFORM;
+		if (jit_expressions)
+			flags |= PGJIT_EXPR;
+		if (jit_tuple_deforming)
+			flags |= PGJIT_DEFORM;
+	}
+
+	return flags;
+}
+
+/*
+ * Compile what's worth compiling in a freshly initialized plan node.
+ *
+ * This is called by ExecInitNode for every node.  It does nothing unless
+ * the planner decided that the query should be JIT compiled.
+ */
+void
+jit_compile_planstate(PlanState *planstate)
+{
+	EState	   *estate = planstate->state;
+	JitContext *context;
+	ListCell   *lc;
+	int			flags;
+
+	if (estate->es_plannedstmt == NULL)
+		return;
+	flags = estate->es_plannedstmt->jitFlags;
+	if (!(flags & PGJIT_PERFORM))
+		return;
+
+	/* no point in compiling what will never be executed */
+	if (estate->es_top_eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	context = jit_get_context(estate);
+	if (context == NULL)
+		return;
+
+	if (flags & PGJIT_EXPR)
+	{
+		foreach(lc, planstate->qual)
+			jit_compile_expr(context, (ExprState *) lfirst(lc));
+
+		foreach(lc, planstate->targetlist)
+		{
+			GenericExprState *gstate = (GenericExprState *) lfirst(lc);
+
+			jit_compile_expr(context, gstate->arg);
+		}
+	}
+
+	if (flags & PGJIT_DEFORM)
+	{
+		/* the nodes that deform tuples of a relation in their scan slot */
+		switch (nodeTag(planstate))
+		{
+			case T_SeqScanState:
+			case T_SampleScanState:
+			case T_IndexScanState:
+			case T_BitmapHeapScanState:
+			case T_TidScanState:
+				jit_compile_deform(context,
+							  ((ScanState *) planstate)->ss_ScanTupleSlot);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * Return the JIT context of the query, creating it if needed.  Returns NULL
+ * if no provider is available.
+ */
+static JitContext *
+jit_get_context(EState *estate)
+{
+	JitContext *context = estate->es_jit;
+
+	if (context != NULL)
+		return context;
+
+	if (!provider_init())
+		return NULL;
+
+	context = provider.create_context(estate->es_plannedstmt->jitFlags);
+	context->flags = estate->es_plannedstmt->jitFlags;
+	memset(&context->instr, 0, sizeof(JitInstrumentation));
+
+	/*
+	 * The generated code is needed as long as the EState exists, so release
+	 * it along with the EState's memory.  That also takes care of it if the
+	 * query fails.
+	 */
+	context->release_cb.func = jit_release_context;
+	context->release_cb.arg = context;
+	MemoryContextRegisterResetCallback(estate->es_query_cxt,
+									   &context->release_cb);
+
+	estate->es_jit = context;
+
+	return context;
+}
+
+/*
+ * Memory context callback releasing a JIT context.
+ */
+static void
+jit_release_context(void *arg)
+{
+	JitContext *context = (JitContext *) arg;
+
+	if (provider_successfully_loaded)
+		provider.release_context(context);
+}
+
+/*
+ * Ask the provider to compile an expression tree.
+ */
+static void
+jit_compile_expr(JitContext *context, ExprState *exprstate)
+{
+	instr_time	starttime;
+	instr_time	endtime;
+
+	if (exprstate == NULL)
+		return;
+
+	INSTR_TIME_SET_CURRENT(starttime);
+	if (provider.compile_expr(context, exprstate))
+		context->instr.created_functions++;
+	INSTR_TIME_SET_CURRENT(endtime);
+	INSTR_TIME_ACCUM_DIFF(context->instr.generation_counter,
+						  endtime, starttime);
+}
+
+/*
+ * Ask the provider to compile a tuple deforming function for a slot.
+ */
+static void
+jit_compile_deform(JitContext *context, TupleTableSlot *slot)
+{
+	instr_time	starttime;
+	instr_time	endtime;
+
+	if (slot == NULL || slot->tts_tupleDescriptor == NULL)
+		return;
+
+	INSTR_TIME_SET_CURRENT(starttime);
+	if (provider.compile_deform(context, slot))
+		context->instr.created_functions++;
+	INSTR_TIME_SET_CURRENT(endtime);
+	INSTR_TIME_ACCUM_DIFF(context->instr.generation_counter,
+						  endtime, starttime);
+}
@@ -228,6 +228,55 @@ pq_init(void)
 	AddWaitEventToSet(FeBeWaitSet, WL_POSTMASTER_DEATH, -1, NULL, NULL);
 }
 
+/* --------------------------------
+ *		pq_switch_socket - switch to the connection of another client
+ *
+ *		Used by pooled backends (see postmaster/sessionpool.c).  The current
+ *		connection is shut down together with its SSL and compression state,
+ *		and everything buffered for it is discarded.  Pass PGINVALID_SOCKET
+ *		to just close the current connection.
+ * --------------------------------
+ */
+void
+pq_switch_socket(pgsocket sock)
+{
+	secure_close(MyProcPort);
+	if (MyProcPort->zstream)
+	{
+		zpq_free(MyProcPort->zstream);
+		MyProcPort->zstream = NULL;
+	}
+	if (MyProcPort->sock != PGINVALID_SOCKET)
+		closesocket(MyProcPort->sock);
+	MyProcPort->sock = sock;
+
+	PqSendPointer = PqSendStart = PqRecvPointer = PqRecvLength = 0;
+	PqCommBusy = false;
+	PqCommReadingMsg = false;
+	DoingCopyOut = false;
+	ClientConnectionLost = false;
+
+	if (FeBeWaitSet)
+	{
+		FreeWaitEventSet(FeBeWaitSet);
+		FeBeWaitSet = NULL;
+	}
+	if (sock == PGINVALID_SOCKET)
+		return;
+
+	/* Same setup as in pq_init */
+#ifndef WIN32
+	if (!pg_set_noblock(sock))
+		ereport(COMMERROR,
+				(errmsg("could not set socket to nonblocking mode: %m")));
+#endif
+
+	FeBeWaitSet = CreateWaitEventSet(TopMemoryContext, 3);
+	AddWaitEventToSet(FeBeWaitSet, WL_SOCKET_WRITEABLE, sock, NULL, NULL);
+	AddWaitEventToSet(FeBeWaitSet, WL_LATCH_SET, -1, MyLatch, NULL);
+	AddWaitEventToSet(FeBeWaitSet, WL_POSTMASTER_DEATH, -1, NULL, NULL);
+}
+
 /* --------------------------------
  *		socket_comm_reset - reset libpq during error recovery
  *
@@ -906,6 +955,103 @@ socket_set_nonblocking(bool nonblocking)
 	MyProcPort->noblock = nonblocking;
 }
 
+/* --------------------------------
+ * Compression of the traffic.
+ *
+ * The compression stream sits between the send/receive buffers and
+ * secure_read/secure_write, so that it works on top of SSL.
+ * --------------------------------
+ */
+static ssize_t
+pq_zpq_read(void *arg, void *ptr, size_t len)
+{
+	return secure_read((Port *) arg, ptr, len);
+}
+
+static ssize_t
+pq_zpq_write(void *arg, void const *ptr, size_t len)
+{
+	return secure_write((Port *) arg, (void *) ptr, len);
+}
+
+/* --------------------------------
+ *		pq_configure_compression - reply to compression request of the client
+ *
+ *		algorithms is the list of algorithm codes supported by the client,
+ *		in the order of its preference.  The first one which we support is
+ *		reported to the client in a 'z' message ('n' if none), and then all
+ *		further traffic in both directions is compressed.  This must be done
+ *		before anything else is sent to the client.
+ * --------------------------------
+ */
+void
+pq_configure_compression(const char *algorithms)
+{
+	char		algorithm = ZPQ_NO_COMPRESSION;
+	const char *supported = zpq_algorithms();
+
+	for (; *algorithms; algorithms++)
+	{
+		if (strchr(supported, *algorithms) != NULL)
+		{
+			algorithm = *algorithms;
+			break;
+		}
+	}
+
+	/* The reply itself is not compressed */
+	if (pq_putmessage('z', &algorithm, 1) || pq_flush())
+		ereport(FATAL,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not send compression response to client")));
+
+	if (algorithm != ZPQ_NO_COMPRESSION)
+	{
+		/* Anything received after the startup packet is already compressed */
+		MyProcPort->zstream = zpq_create(algorithm, pq_zpq_write, pq_zpq_read,
+										 MyProcPort,
+										 PqRecvBuffer + PqRecvPointer,
+										 PqRecvLength - PqRecvPointer);
+		if (MyProcPort->zstream == NULL)
+			ereport(FATAL,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("could not initialize compression")));
+		PqRecvPointer = PqRecvLength = 0;
+	}
+}
+
+/* --------------------------------
+ *		pq_read_client - read data from the client, decompressing it if needed
+ *
+ *		Same conventions as secure_read.  Corrupted compressed data is
+ *		reported here and then treated as EOF.
+ * --------------------------------
+ */
+static ssize_t
+pq_read_client(void *ptr, size_t len)
+{
+	ssize_t		r;
+
+	if (MyProcPort->zstream == NULL)
+		return secure_read(MyProcPort, ptr, len);
+
+	r = zpq_read(MyProcPort->zstream, ptr, len);
+	if (r == ZPQ_DECOMPRESS_ERROR)
+	{
+		/*
+		 * Careful: an ereport() that tries to write to the client would
+		 * cause recursion to here, leading to stack overflow and core
+		 * dump!  This message must go *only* to the postmaster log.
+		 */
+		ereport(COMMERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("could not decompress data from client: %s",
+						zpq_error(MyProcPort->zstream))));
+		r = 0;
+	}
+	return r;
+}
+
 /* --------------------------------
  *		pq_recvbuf - load some bytes into the input buffer
  *
@@ -937,8 +1083,8 @@ pq_recvbuf(void)
 	{
 		int			r;
 
-		r = secure_read(MyProcPort, PqRecvBuffer + PqRecvLength,
-						PQ_RECV_BUFFER_SIZE - PqRecvLength);
+		r = pq_read_client(PqRecvBuffer + PqRecvLength,
+						   PQ_RECV_BUFFER_SIZE - PqRecvLength);
 
 		if (r < 0)
 		{
@@ -1029,7 +1175,7 @@ pq_getbyte_if_available(unsigned char *c)
 	/* Put the socket into non-blocking mode */
 	socket_set_nonblocking(true);
 
-	r = secure_read(MyProcPort, c, 1);
+	r = pq_read_client(c, 1);
 	if (r < 0)
 	{
 		/*
@@ -1403,11 +1549,23 @@ internal_flush(void)
 	char	   *bufptr = PqSendBuffer + PqSendStart;
 	char	   *bufend = PqSendBuffer + PqSendPointer;
 
-	while (bufptr < bufend)
+	/* with compression, the stream may also hold data not sent yet */
+	while (bufptr < bufend ||
+		   (MyProcPort->zstream && zpq_buffered_tx(MyProcPort->zstream) > 0))
 	{
 		int			r;
 
-		r = secure_write(MyProcPort, bufptr, bufend - bufptr);
+		if (MyProcPort->zstream)
+		{
+			size_t		processed = 0;
+
+			r = zpq_write(MyProcPort->zstream, bufptr, bufend - bufptr,
+						  &processed);
+			bufptr += processed;
+			PqSendStart += processed;
+		}
+		else
+			r = secure_write(MyProcPort, bufptr, bufend - bufptr);
 
 		if (r <= 0)
 		{
@@ -1454,8 +1612,11 @@ internal_flush(void)
 		}
 
 		last_reported_send_errno = 0;	/* reset after any successful send */
-		bufptr += r;
-		PqSendStart += r;
+		if (MyProcPort->zstream == NULL)
+		{
+			bufptr += r;
+			PqSendStart += r;
+		}
 	}
 
 	PqSendStart = PqSendPointer = 0;
@@ -1474,7 +1635,7 @@ socket_flush_if_writable(void)
 	int			res;
 
 	/* Quick exit if nothing to do */
-	if (PqSendPointer == PqSendStart)
+	if (!socket_is_send_pending())
 		return 0;
 
 	/* No-op if reentrant call */
@@ -1497,7 +1658,8 @@ socket_flush_if_writable(void)
 static bool
 socket_is_send_pending(void)
 {
-	return (PqSendStart < PqSendPointer);
+	return (PqSendStart < PqSendPointer ||
+			(MyProcPort->zstream && zpq_buffered_tx(MyProcPort->zstream) > 0));
 }
 
 /* --------------------------------
@@ -0,0 +1,320 @@
+/*-------------------------------------------------------------------------
+ *
+ * zpq_stream.c
+ *	  Streaming compression of frontend/backend protocol traffic
+ *
+ * Each direction of the connection is a single zlib stream.  Every write
+ * ends with Z_SYNC_FLUSH, so whatever the sender has flushed can be
+ * decompressed by the receiver right away, while the dictionary is shared
+ * by all messages of the connection.  That is what makes compression of
+ * small protocol messages (e.g. logical replication records) worthwhile.
+ *
+ * This file is compiled both into the backend and into libpq, so it must
+ * not use palloc or ereport.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/libpq/zpq_stream.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "c.h"
+
+#include "libpq/zpq_stream.h"
+
+#ifdef HAVE_LIBZ
+
+#include <zlib.h>
+
+/*
+ * Compression level: protocol traffic is compressed on the fly, so prefer
+ * speed over ratio.
+ */
+#define ZPQ_COMPRESSION_LEVEL	1
+
+struct ZpqStream
+{
+	z_stream	tx;				/* compression state */
+	z_stream	rx;				/* decompression state */
+
+	zpq_tx_func tx_func;
+	zpq_rx_func rx_func;
+	void	   *arg;
+
+	bool		tx_not_flushed; /* deflate may have more output to flush */
+	bool		rx_not_drained; /* inflate may have more output buffered */
+
+	size_t		tx_pos;			/* tx_buf[tx_pos..tx_size) is not sent yet */
+	size_t		tx_size;
+	size_t		rx_pos;			/* rx_buf[rx_pos..rx_size) is not inflated
+								 * yet */
+	size_t		rx_size;
+
+	char		tx_buf[ZPQ_BUFFER_SIZE];
+	char		rx_buf[ZPQ_BUFFER_SIZE];
+};
+
+/*
+ * Return codes of the algorithms supported by this build, in the order of
+ * preference.
+ */
+char const *
+zpq_algorithms(void)
+{
+	return "z";
+}
+
+/*
+ * Create compression stream.
+ *
+ * rx_data is compressed data which was already received from the transport
+ * before compression was negotiated: it is decompressed before anything
+ * else.  Returns NULL if the algorithm is not supported, rx_data is too
+ * large or out of memory.
+ */
+ZpqStream *
+zpq_create(char algorithm, zpq_tx_func tx_func, zpq_rx_func rx_func,
+		   void *arg, char const *rx_data, size_t rx_data_size)
+{
+	ZpqStream  *zs;
+
+	if (algorithm != ZPQ_ZLIB || rx_data_size > ZPQ_BUFFER_SIZE)
+		return NULL;
+
+	zs = (ZpqStream *) malloc(sizeof(ZpqStream));
+	if (zs == NULL)
+		return NULL;
+	memset(zs, 0, sizeof(ZpqStream));
+
+	zs->tx_func = tx_func;
+	zs->rx_func = rx_func;
+	zs->arg = arg;
+
+	if (deflateInit(&zs->tx, ZPQ_COMPRESSION_LEVEL) != Z_OK)
+	{
+		free(zs);
+		return NULL;
+	}
+	if (inflateInit(&zs->rx) != Z_OK)
+	{
+		deflateEnd(&zs->tx);
+		free(zs);
+		return NULL;
+	}
+
+	memcpy(zs->rx_buf, rx_data, rx_data_size);
+	zs->rx_size = rx_data_size;
+
+	return zs;
+}
+
+/*
+ * Read up to size bytes of decompressed data.
+ *
+ * The transport is read only if no decompressed data is available, so this
+ * blocks (or fails with EAGAIN) exactly when the transport would.  Returns
+ * number of bytes read, 0 on EOF, or a negative value on failure: either
+ * the result of rx_func (with errno set) or ZPQ_DECOMPRESS_ERROR.
+ */
+ssize_t
+zpq_read(ZpqStream *zs, void *buf, size_t size)
+{
+	for (;;)
+	{
+		if (zs->rx_pos < zs->rx_size || zs->rx_not_drained)
+		{
+			int			rc;
+
+			zs->rx.next_in = (Bytef *) zs->rx_buf + zs->rx_pos;
+			zs->rx.avail_in = zs->rx_size - zs->rx_pos;
+			zs->rx.next_out = (Bytef *) buf;
+			zs->rx.avail_out = size;
+
+			rc = inflate(&zs->rx, Z_SYNC_FLUSH);
+			if (rc != Z_OK && rc != Z_BUF_ERROR)
+				return ZPQ_DECOMPRESS_ERROR;
+
+			zs->rx_pos = zs->rx_size - zs->rx.avail_in;
+			zs->rx_not_drained = (zs->rx.avail_out == 0);
+
+			if (zs->rx.avail_out != size)
+				return size - zs->rx.avail_out;
+		}
+
+		/* Need more compressed data: make room for it and receive */
+		if (zs->rx_pos > 0)
+		{
+			memmove(zs->rx_buf, zs->rx_buf + zs->rx_pos,
+					zs->rx_size - zs->rx_pos);
+			zs->rx_size -= zs->rx_pos;
+			zs->rx_pos = 0;
+		}
+		if (zs->rx_size == ZPQ_BUFFER_SIZE)
+			return ZPQ_DECOMPRESS_ERROR;	/* inflate makes no progress */
+		{
+			ssize_t		rc;
+
+			rc = zs->rx_func(zs->arg, zs->rx_buf + zs->rx_size,
+							 ZPQ_BUFFER_SIZE - zs->rx_size);
+			if (rc <= 0)
+				return rc;
+			zs->rx_size += rc;
+		}
+	}
+}
+
+/*
+ * Compress size bytes of data and send them, together with whatever is left
+ * unsent by the previous calls.
+ *
+ * *processed is set to the number of input bytes consumed; they need not
+ * be passed again even if the call fails.  Returns a positive value if all
+ * consumed data was sent, or the failed result of tx_func (with errno set):
+ * in the latter case the caller has to retry, with the rest of its data or
+ * with size == 0, until zpq_buffered_tx() reports nothing pending.
+ */
+ssize_t
+zpq_write(ZpqStream *zs, void const *buf, size_t size, size_t *processed)
+{
+	size_t		consumed = 0;
+	ssize_t		sent = 0;
+
+	for (;;)
+	{
+		/* Compress more data if there is room for it */
+		if (zs->tx_size < ZPQ_BUFFER_SIZE &&
+			(consumed < size || zs->tx_not_flushed))
+		{
+			int			rc;
+
+			zs->tx.next_in = (Bytef *) buf + consumed;
+			zs->tx.avail_in = size - consumed;
+			zs->tx.next_out = (Bytef *) zs->tx_buf + zs->tx_size;
+			zs->tx.avail_out = ZPQ_BUFFER_SIZE - zs->tx_size;
+
+			rc = deflate(&zs->tx, Z_SYNC_FLUSH);
+			Assert(rc == Z_OK || rc == Z_BUF_ERROR);
+			(void) rc;
+
+			consumed = size - zs->tx.avail_in;
+			zs->tx_size = ZPQ_BUFFER_SIZE - zs->tx.avail_out;
+			zs->tx_not_flushed = (zs->tx.avail_out == 0);
+		}
+
+		if (zs->tx_pos == zs->tx_size)
+		{
+			*processed = consumed;
+			return sent > 0 ? sent : 1;
+		}
+
+		/* Send compressed data */
+		{
+			ssize_t		rc;
+
+			rc = zs->tx_func(zs->arg, zs->tx_buf + zs->tx_pos,
+							 zs->tx_size - zs->tx_pos);
+			if (rc <= 0)
+			{
+				*processed = consumed;
+				return rc;
+			}
+			sent += rc;
+			zs->tx_pos += rc;
+			if (zs->tx_pos == zs->tx_size)
+				zs->tx_pos = zs->tx_size = 0;
+		}
+	}
+}
+
+/*
+ * Is there received data which can be read without reading the transport?
+ * (Nonzero result doesn't guarantee that it decompresses to something.)
+ */
+size_t
+zpq_buffered_rx(ZpqStream *zs)
+{
+	return zs->rx_size - zs->rx_pos + (zs->rx_not_drained ? 1 : 0);
+}
+
+/*
+ * Amount of compressed data not sent to the transport yet.
+ */
+size_t
+zpq_buffered_tx(ZpqStream *zs)
+{
+	return zs->tx_size - zs->tx_pos + (zs->tx_not_flushed ? 1 : 0);
+}
+
+char const *
+zpq_error(ZpqStream *zs)
+{
+	return zs->rx.msg ? zs->rx.msg : "corrupted compressed data";
+}
+
+void
+zpq_free(ZpqStream *zs)
+{
+	if (zs)
+	{
+		deflateEnd(&zs->tx);
+		inflateEnd(&zs->rx);
+		free(zs);
+	}
+}
+
+#else							/* !HAVE_LIBZ */
+
+/* Without zlib, compression is never negotiated */
+
+char const *
+zpq_algorithms(void)
+{
+	return "";
+}
+
+ZpqStream *
+zpq_create(char algorithm, zpq_tx_func tx_func, zpq_rx_func rx_func,
+		   void *arg, char const *rx_data, size_t rx_data_size)
+{
+	return NULL;
+}
+
+ssize_t
+zpq_read(ZpqStream *zs, void *buf, size_t size)
+{
+	return ZPQ_DECOMPRESS_ERROR;
+}
+
+ssize_t
+zpq_write(ZpqStream *zs, void const *buf, size_t size, size_t *processed)
+{
+	*processed = 0;
+	return -1;
+}
+
+size_t
+zpq_buffered_rx(ZpqStream *zs)
+{
+	return 0;
+}
+
+size_t
+zpq_buffered_tx(ZpqStream *zs)
+{
+	return 0;
+}
+
+char const *
+zpq_error(ZpqStream *zs)
+{
+	return "compression is not supported by this build";
+}
+
+void
+zpq_free(ZpqStream *zs)
+{
+}
+
+#endif   /* HAVE_LIBZ */
@@ -43,7 +43,7 @@
 #include "access/htup_details.h"
 #include "nodes/bitmapset.h"
 #include "nodes/tidbitmap.h"
-#include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 /*
  * The maximum number of tuples per page is not large (typically 256 with
@@ -61,9 +61,9 @@
  * for that page in the page table.
  *
  * We actually store both exact pages and lossy chunks in the same hash
- * table, using identical data structures.  (This is because dynahash.c's
- * memory management doesn't allow space to be transferred easily from one
- * hashtable to another.)  Therefore it's best if PAGES_PER_CHUNK is the
+ * table, using identical data structures.  (This way the slots freed by
+ * pages converted to lossy storage are reused by chunks, and vice versa.)
+ * Therefore it's best if PAGES_PER_CHUNK is the
  * same as MAX_TUPLES_PER_PAGE, or at least not too different.  But we
  * also want PAGES_PER_CHUNK to be a power of 2 to avoid expensive integer
  * remainder operations.  So, define it like this:
@@ -97,22 +97,30 @@
 typedef struct PagetableEntry
 {
 	BlockNumber blockno;		/* page number (hashtable key) */
+	bool		inuse;			/* is the hashtable slot occupied? */
 	bool		ischunk;		/* T = lossy storage, F = exact */
 	bool		recheck;		/* should the tuples be rechecked? */
 	bitmapword	words[Max(WORDS_PER_PAGE, WORDS_PER_CHUNK)];
 } PagetableEntry;
 
 /*
- * dynahash.c is optimized for relatively large, long-lived hash tables.
- * This is not ideal for TIDBitMap, particularly when we are using a bitmap
- * scan on the inside of a nestloop join: a bitmap may well live only long
- * enough to accumulate one entry in such cases.  We therefore avoid creating
- * an actual hashtable until we need two pagetable entries.  When just one
- * pagetable entry is needed, we store it in a fixed field of TIDBitMap.
- * (NOTE: we don't get rid of the hashtable if the bitmap later shrinks down
- * to zero or one page again.  So, status can be TBM_HASH even when nentries
- * is zero or one.)
+ * The page table is an open-addressing hash table with linear probing, whose
+ * slots hold the PagetableEntry's themselves; it is a power of 2 in size and
+ * is doubled whenever it gets more than PAGETABLE_FILLFACTOR full.  Compared
+ * to dynahash.c there is no per-entry overhead besides the empty slots, and a
+ * lookup usually touches a single cache line.  Deletion moves later entries
+ * of the probe sequence back into the freed slot, so no tombstones are needed.
+ *
+ * Still, a bitmap scan on the inside of a nestloop join may well create
+ * bitmaps which live only long enough to accumulate one entry.  We therefore
+ * avoid creating an actual hashtable until we need two pagetable entries.
+ * When just one pagetable entry is needed, we store it in a fixed field of
+ * TIDBitMap.  (NOTE: we don't get rid of the hashtable if the bitmap later
+ * shrinks down to zero or one page again.  So, status can be TBM_HASH even
+ * when nentries is zero or one.)
  */
+#define PAGETABLE_INITIAL_SIZE	128
+#define PAGETABLE_FILLFACTOR	0.75
 typedef enum
 {
 	TBM_EMPTY,					/* no hashtable, nentries == 0 */
@@ -128,7 +136,9 @@ struct TIDBitmap
 	NodeTag		type;			/* to make it a valid Node */
 	MemoryContext mcxt;			/* memory context containing me */
 	TBMStatus	status;			/* see codes above */
-	HTAB	   *pagetable;		/* hash table of PagetableEntry's */
+	PagetableEntry *pagetable;	/* hash table of PagetableEntry's */
+	uint32		ptsize;			/* number of slots in pagetable */
+	uint32		ptmembers;		/* number of occupied slots */
 	int			nentries;		/* number of entries in pagetable */
 	int			maxentries;		/* limit on same to meet maxbytes */
 	int			npages;			/* number of exact entries in pagetable */
@@ -156,7 +166,37 @@ struct TBMIterator
 };
 
 
+/*
+ * Scan of the pagetable slots.  Slots are visited downwards, starting below a
+ * slot which was empty when the scan began; this way, entries moved back by
+ * deleting the current entry land in slots which were already visited, so
+ * the current entry can be deleted without disturbing the scan.
+ */
+typedef struct PagetableIterator
+{
+	uint32		cur;			/* next slot to visit */
+	uint32		end;			/* empty slot the scan ends at */
+} PagetableIterator;
+
+/*
+ * Sorted page lists with fewer entries than this are sorted with qsort,
+ * longer ones with a radix sort.
+ */
+#define TBM_RADIX_SORT_THRESHOLD	64
+
+
 /* Local function prototypes */
+static void tbm_create_pagetable(TIDBitmap *tbm);
+static PagetableEntry *tbm_pagetable_lookup(const TIDBitmap *tbm,
+					 BlockNumber pageno);
+static PagetableEntry *tbm_pagetable_insert(TIDBitmap *tbm, BlockNumber pageno,
+					 bool *found);
+static bool tbm_pagetable_delete(TIDBitmap *tbm, BlockNumber pageno);
+static void tbm_pagetable_grow(TIDBitmap *tbm);
+static void tbm_pagetable_start_iterate(const TIDBitmap *tbm,
+							PagetableIterator *iter);
+static PagetableEntry *tbm_pagetable_iterate(const TIDBitmap *tbm,
+					  PagetableIterator *iter);
 static void tbm_union_page(TIDBitmap *a, const PagetableEntry *bpage);
 static bool tbm_intersect_page(TIDBitmap *a, PagetableEntry *apage,
 				   const TIDBitmap *b);
@@ -166,6 +206,7 @@ static PagetableEntry *tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno);
 static bool tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_lossify(TIDBitmap *tbm);
+static void tbm_sort_pages(PagetableEntry **pages, int npages);
 static int	tbm_comparator(const void *left, const void *right);
 
 
@@ -180,6 +221,7 @@ TIDBitmap *
 tbm_create(long maxbytes)
 {
 	TIDBitmap  *tbm;
+	long		maxslots;
 	long		nbuckets;
 
 	/* Create the TIDBitmap struct and zero all its fields */
@@ -189,18 +231,20 @@ tbm_create(long maxbytes)
 	tbm->status = TBM_EMPTY;
 
 	/*
-	 * Estimate number of hashtable entries we can have within maxbytes. This
-	 * estimates the hash overhead at MAXALIGN(sizeof(HASHELEMENT)) plus a
-	 * pointer per hash entry, which is crude but good enough for our purpose.
-	 * Also count an extra Pointer per entry for the arrays created during
-	 * iteration readout.
+	 * Estimate number of hashtable entries we can have within maxbytes.  The
+	 * hashtable is a power of 2 in size, and while it is being doubled the
+	 * old array, half the size of the new one, is still allocated; so count
+	 * each slot of the final table at one and a half times its size.  Also
+	 * count an extra Pointer per slot for the arrays created during
+	 * iteration readout.  Then choose the largest table size that fits, and
+	 * allow as many entries as it holds without being doubled again.
 	 */
-	nbuckets = maxbytes /
-		(MAXALIGN(sizeof(HASHELEMENT)) + MAXALIGN(sizeof(PagetableEntry))
-		 + sizeof(Pointer) + sizeof(Pointer));
-	nbuckets = Min(nbuckets, INT_MAX - 1);		/* safety limit */
-	nbuckets = Max(nbuckets, 16);		/* sanity limit */
-	tbm->maxentries = (int) nbuckets;
+	maxslots = maxbytes /
+		(sizeof(PagetableEntry) * 3 / 2 + sizeof(Pointer));
+	nbuckets = PAGETABLE_INITIAL_SIZE;
+	while (nbuckets < (1L << 30) && nbuckets * 2 <= maxslots)	/* safety limit */
+		nbuckets *= 2;
+	tbm->maxentries = (int) (nbuckets * PAGETABLE_FILLFACTOR) - 1;
 
 	return tbm;
 }
@@ -212,20 +256,15 @@ tbm_create(long maxbytes)
 static void
 tbm_create_pagetable(TIDBitmap *tbm)
 {
-	HASHCTL		hash_ctl;
-
 	Assert(tbm->status != TBM_HASH);
 	Assert(tbm->pagetable == NULL);
 
-	/* Create the hashtable proper */
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(BlockNumber);
-	hash_ctl.entrysize = sizeof(PagetableEntry);
-	hash_ctl.hcxt = tbm->mcxt;
-	tbm->pagetable = hash_create("TIDBitmap",
-								 128,	/* start small and extend */
-								 &hash_ctl,
-								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	/* Create the hashtable proper, start small and extend */
+	tbm->pagetable = (PagetableEntry *)
+		MemoryContextAllocZero(tbm->mcxt,
+						 PAGETABLE_INITIAL_SIZE * sizeof(PagetableEntry));
+	tbm->ptsize = PAGETABLE_INITIAL_SIZE;
+	tbm->ptmembers = 0;
 
 	/* If entry1 is valid, push it into the hashtable */
 	if (tbm->status == TBM_ONE_PAGE)
@@ -233,16 +272,231 @@ tbm_create_pagetable(TIDBitmap *tbm)
 		PagetableEntry *page;
 		bool		found;
 
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &tbm->entry1.blockno,
-											  HASH_ENTER, &found);
+		page = tbm_pagetable_insert(tbm, tbm->entry1.blockno, &found);
 		Assert(!found);
 		memcpy(page, &tbm->entry1, sizeof(PagetableEntry));
+		page->inuse = true;
 	}
 
 	tbm->status = TBM_HASH;
 }
 
+/*
+ * Hash function for block numbers: the finalizer of MurmurHash3, which
+ * spreads runs of consecutive pages all over the table.
+ */
+static inline uint32
+tbm_hash_blockno(BlockNumber pageno)
+{
+	uint32		h = pageno;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/*
+ * tbm_pagetable_lookup - find the hashtable entry for the pageno
+ *
+ * Returns NULL if there is no entry for the pageno.
+ */
+static PagetableEntry *
+tbm_pagetable_lookup(const TIDBitmap *tbm, BlockNumber pageno)
+{
+	uint32		mask = tbm->ptsize - 1;
+	uint32		slot = tbm_hash_blockno(pageno) & mask;
+
+	for (;;)
+	{
+		PagetableEntry *page = &tbm->pagetable[slot];
+
+		if (!page->inuse)
+			return NULL;
+		if (page->blockno == pageno)
+			return page;
+		slot = (slot + 1) & mask;
+	}
+}
+
+/*
+ * tbm_pagetable_insert - find or create the hashtable entry for the pageno
+ *
+ * A new entry is zeroed except for its key; *found tells whether the entry
+ * already existed.  Entries are never moved by an insertion unless the
+ * hashtable has to be enlarged.
+ */
+static PagetableEntry *
+tbm_pagetable_insert(TIDBitmap *tbm, BlockNumber pageno, bool *found)
+{
+	uint32		mask;
+	uint32		slot;
+
+	if (tbm->ptmembers >= (uint32) (tbm->ptsize * PAGETABLE_FILLFACTOR))
+		tbm_pagetable_grow(tbm);
+
+	mask = tbm->ptsize - 1;
+	slot = tbm_hash_blockno(pageno) & mask;
+	for (;;)
+	{
+		PagetableEntry *page = &tbm->pagetable[slot];
+
+		if (!page->inuse)
+		{
+			MemSet(page, 0, sizeof(PagetableEntry));
+			page->blockno = pageno;
+			page->inuse = true;
+			tbm->ptmembers++;
+			*found = false;
+			return page;
+		}
+		if (page->blockno == pageno)
+		{
+			*found = true;
+			return page;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+/*
+ * tbm_pagetable_delete - remove the hashtable entry for the pageno
+ *
+ * Returns false if there is no entry for the pageno.  Entries which follow
+ * the deleted one in its probe sequence are moved back to close the gap, so
+ * this invalidates pointers to entries other than the deleted one.
+ */
+static bool
+tbm_pagetable_delete(TIDBitmap *tbm, BlockNumber pageno)
+{
+	uint32		mask = tbm->ptsize - 1;
+	uint32		hole;
+	uint32		slot;
+
+	hole = tbm_hash_blockno(pageno) & mask;
+	for (;;)
+	{
+		PagetableEntry *page = &tbm->pagetable[hole];
+
+		if (!page->inuse)
+			return false;
+		if (page->blockno == pageno)
+			break;
+		hole = (hole + 1) & mask;
+	}
+
+	/*
+	 * Move back each following entry of the cluster whose home slot does not
+	 * lie cyclically between the hole and the entry's slot, since a lookup
+	 * would stop at the hole before reaching it.
+	 */
+	slot = hole;
+	for (;;)
+	{
+		PagetableEntry *page;
+		uint32		home;
+
+		slot = (slot + 1) & mask;
+		page = &tbm->pagetable[slot];
+		if (!page->inuse)
+			break;
+
+		home = tbm_hash_blockno(page->blockno) & mask;
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			memcpy(&tbm->pagetable[hole], page, sizeof(PagetableEntry));
+			hole = slot;
+		}
+	}
+
+	tbm->pagetable[hole].inuse = false;
+	tbm->ptmembers--;
+	return true;
+}
+
+/*
+ * tbm_pagetable_grow - double the size of the hashtable
+ */
+static void
+tbm_pagetable_grow(TIDBitmap *tbm)
+{
+	PagetableEntry *oldtable = tbm->pagetable;
+	uint32		oldsize = tbm->ptsize;
+	uint32		newsize;
+	uint32		mask;
+	uint32		i;
+
+	if ((Size) oldsize * 2 > MaxAllocHugeSize / sizeof(PagetableEntry))
+		elog(ERROR, "TIDBitmap hashtable is too large");
+
+	newsize = oldsize * 2;
+	mask = newsize - 1;
+	tbm->pagetable = (PagetableEntry *)
+		MemoryContextAllocExtended(tbm->mcxt,
+								   (Size) newsize * sizeof(PagetableEntry),
+								   MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+	tbm->ptsize = newsize;
+
+	for (i = 0; i < oldsize; i++)
+	{
+		PagetableEntry *oldpage = &oldtable[i];
+		uint32		slot;
+
+		if (!oldpage->inuse)
+			continue;
+
+		slot = tbm_hash_blockno(oldpage->blockno) & mask;
+		while (tbm->pagetable[slot].inuse)
+			slot = (slot + 1) & mask;
+		memcpy(&tbm->pagetable[slot], oldpage, sizeof(PagetableEntry));
+	}
+
+	pfree(oldtable);
+}
+
+/*
+ * tbm_pagetable_start_iterate - begin a scan of all hashtable entries
+ *
+ * Entries inserted during the scan may or may not be visited.  The current
+ * entry may be deleted; other deletions may cause entries to be skipped.
+ */
+static void
+tbm_pagetable_start_iterate(const TIDBitmap *tbm, PagetableIterator *iter)
+{
+	uint32		mask = tbm->ptsize - 1;
+	uint32		end = 0;
+
+	/* the table is never full, so there is an empty slot */
+	while (tbm->pagetable[end].inuse)
+		end++;
+
+	iter->end = end;
+	iter->cur = (end - 1) & mask;
+}
+
+/*
+ * tbm_pagetable_iterate - return the next entry of the scan, or NULL
+ */
+static PagetableEntry *
+tbm_pagetable_iterate(const TIDBitmap *tbm, PagetableIterator *iter)
+{
+	uint32		mask = tbm->ptsize - 1;
+
+	while (iter->cur != iter->end)
+	{
+		PagetableEntry *page = &tbm->pagetable[iter->cur];
+
+		iter->cur = (iter->cur - 1) & mask;
+		if (page->inuse)
+			return page;
+	}
+
+	return NULL;
+}
+
 /*
  * tbm_free - free a TIDBitmap
  */
@@ -250,7 +504,7 @@ void
 tbm_free(TIDBitmap *tbm)
 {
 	if (tbm->pagetable)
-		hash_destroy(tbm->pagetable);
+		pfree(tbm->pagetable);
 	if (tbm->spages)
 		pfree(tbm->spages);
 	if (tbm->schunks)
@@ -357,12 +611,12 @@ tbm_union(TIDBitmap *a, const TIDBitmap *b)
 		tbm_union_page(a, &b->entry1);
 	else
 	{
-		HASH_SEQ_STATUS status;
+		PagetableIterator iter;
 		PagetableEntry *bpage;
 
 		Assert(b->status == TBM_HASH);
-		hash_seq_init(&status, b->pagetable);
-		while ((bpage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		tbm_pagetable_start_iterate(b, &iter);
+		while ((bpage = tbm_pagetable_iterate(b, &iter)) != NULL)
 			tbm_union_page(a, bpage);
 	}
 }
@@ -449,12 +703,12 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 	}
 	else
 	{
-		HASH_SEQ_STATUS status;
+		PagetableIterator iter;
 		PagetableEntry *apage;
 
 		Assert(a->status == TBM_HASH);
-		hash_seq_init(&status, a->pagetable);
-		while ((apage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		tbm_pagetable_start_iterate(a, &iter);
+		while ((apage = tbm_pagetable_iterate(a, &iter)) != NULL)
 		{
 			if (tbm_intersect_page(a, apage, b))
 			{
@@ -464,9 +718,7 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 				else
 					a->npages--;
 				a->nentries--;
-				if (hash_search(a->pagetable,
-								(void *) &apage->blockno,
-								HASH_REMOVE, NULL) == NULL)
+				if (!tbm_pagetable_delete(a, apage->blockno))
 					elog(ERROR, "hash table corrupted");
 			}
 		}
@@ -606,8 +858,8 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	 */
 	if (tbm->status == TBM_HASH && !tbm->iterating)
 	{
-		HASH_SEQ_STATUS status;
 		PagetableEntry *page;
+		uint32		i;
 		int			npages;
 		int			nchunks;
 
@@ -620,10 +872,12 @@ tbm_begin_iterate(TIDBitmap *tbm)
 				MemoryContextAlloc(tbm->mcxt,
 								   tbm->nchunks * sizeof(PagetableEntry *));
 
-		hash_seq_init(&status, tbm->pagetable);
 		npages = nchunks = 0;
-		while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		for (i = 0; i < tbm->ptsize; i++)
 		{
+			page = &tbm->pagetable[i];
+			if (!page->inuse)
+				continue;
 			if (page->ischunk)
 				tbm->schunks[nchunks++] = page;
 			else
@@ -631,12 +885,8 @@ tbm_begin_iterate(TIDBitmap *tbm)
 		}
 		Assert(npages == tbm->npages);
 		Assert(nchunks == tbm->nchunks);
-		if (npages > 1)
-			qsort(tbm->spages, npages, sizeof(PagetableEntry *),
-				  tbm_comparator);
-		if (nchunks > 1)
-			qsort(tbm->schunks, nchunks, sizeof(PagetableEntry *),
-				  tbm_comparator);
+		tbm_sort_pages(tbm->spages, npages);
+		tbm_sort_pages(tbm->schunks, nchunks);
 	}
 
 	tbm->iterating = true;
@@ -791,9 +1041,7 @@ tbm_find_pageentry(const TIDBitmap *tbm, BlockNumber pageno)
 		return page;
 	}
 
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &pageno,
-										  HASH_FIND, NULL);
+	page = tbm_pagetable_lookup(tbm, pageno);
 	if (page == NULL)
 		return NULL;
 	if (page->ischunk)
@@ -834,16 +1082,17 @@ tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno)
 		}
 
 		/* Look up or create an entry */
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &pageno,
-											  HASH_ENTER, &found);
+		page = tbm_pagetable_insert(tbm, pageno, &found);
 	}
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
-		MemSet(page, 0, sizeof(PagetableEntry));
-		page->blockno = pageno;
+		if (tbm->status == TBM_ONE_PAGE)
+		{
+			MemSet(page, 0, sizeof(PagetableEntry));
+			page->blockno = pageno;
+		}
 		/* must count it too */
 		tbm->nentries++;
 		tbm->npages++;
@@ -869,9 +1118,7 @@ tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno)
 
 	bitno = pageno % PAGES_PER_CHUNK;
 	chunk_pageno = pageno - bitno;
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_FIND, NULL);
+	page = tbm_pagetable_lookup(tbm, chunk_pageno);
 	if (page != NULL && page->ischunk)
 	{
 		int			wordnum = WORDNUM(bitno);
@@ -912,9 +1159,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	 */
 	if (bitno != 0)
 	{
-		if (hash_search(tbm->pagetable,
-						(void *) &pageno,
-						HASH_REMOVE, NULL) != NULL)
+		if (tbm_pagetable_delete(tbm, pageno))
 		{
 			/* It was present, so adjust counts */
 			tbm->nentries--;
@@ -923,15 +1168,11 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	}
 
 	/* Look up or create entry for chunk-header page */
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_ENTER, &found);
+	page = tbm_pagetable_insert(tbm, chunk_pageno, &found);
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
-		MemSet(page, 0, sizeof(PagetableEntry));
-		page->blockno = chunk_pageno;
 		page->ischunk = true;
 		/* must count it too */
 		tbm->nentries++;
@@ -942,6 +1183,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 		/* chunk header page was formerly non-lossy, make it lossy */
 		MemSet(page, 0, sizeof(PagetableEntry));
 		page->blockno = chunk_pageno;
+		page->inuse = true;
 		page->ischunk = true;
 		/* we assume it had some tuple bit(s) set, so mark it lossy */
 		page->words[0] = ((bitmapword) 1 << 0);
@@ -962,7 +1204,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 static void
 tbm_lossify(TIDBitmap *tbm)
 {
-	HASH_SEQ_STATUS status;
+	PagetableIterator iter;
 	PagetableEntry *page;
 
 	/*
@@ -977,8 +1219,8 @@ tbm_lossify(TIDBitmap *tbm)
 	Assert(!tbm->iterating);
 	Assert(tbm->status == TBM_HASH);
 
-	hash_seq_init(&status, tbm->pagetable);
-	while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+	tbm_pagetable_start_iterate(tbm, &iter);
+	while ((page = tbm_pagetable_iterate(tbm, &iter)) != NULL)
 	{
 		if (page->ischunk)
 			continue;			/* already a chunk header */
@@ -996,14 +1238,15 @@ tbm_lossify(TIDBitmap *tbm)
 		if (tbm->nentries <= tbm->maxentries / 2)
 		{
 			/* we have done enough */
-			hash_seq_term(&status);
 			break;
 		}
 
 		/*
-		 * Note: tbm_mark_page_lossy may have inserted a lossy chunk into the
-		 * hashtable.  We can continue the same seq_search scan since we do
-		 * not care whether we visit lossy chunks or not.
+		 * Note: tbm_mark_page_lossy deleted the current page, and may have
+		 * inserted a lossy chunk into the hashtable.  We can continue the
+		 * same scan since we do not care whether we visit lossy chunks or
+		 * not.  The hashtable is not enlarged, as the page was removed
+		 * before the chunk was added.
 		 */
 	}
 
@@ -1021,6 +1264,68 @@ tbm_lossify(TIDBitmap *tbm)
 		tbm->maxentries = Min(tbm->nentries, (INT_MAX - 1) / 2) * 2;
 }
 
+/*
+ * tbm_sort_pages - sort an array of PagetableEntry pointers by block number
+ *
+ * Long arrays are sorted by a least-significant-digit radix sort on the bytes
+ * of the block number.  Passes over a byte which is the same in all entries,
+ * such as the high-order bytes of small relations or the low-order byte of
+ * chunk headers, are skipped.
+ */
+static void
+tbm_sort_pages(PagetableEntry **pages, int npages)
+{
+	PagetableEntry **src;
+	PagetableEntry **dst;
+	PagetableEntry **buffer;
+	int			shift;
+
+	if (npages < TBM_RADIX_SORT_THRESHOLD)
+	{
+		if (npages > 1)
+			qsort(pages, npages, sizeof(PagetableEntry *), tbm_comparator);
+		return;
+	}
+
+	buffer = (PagetableEntry **) palloc(npages * sizeof(PagetableEntry *));
+	src = pages;
+	dst = buffer;
+
+	for (shift = 0; shift < 32; shift += 8)
+	{
+		int			count[256];
+		int			offset;
+		int			digit;
+		int			i;
+
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < npages; i++)
+			count[(src[i]->blockno >> shift) & 0xFF]++;
+
+		if (count[(src[0]->blockno >> shift) & 0xFF] == npages)
+			continue;
+
+		offset = 0;
+		for (digit = 0; digit < 256; digit++)
+		{
+			int			n = count[digit];
+
+			count[digit] = offset;
+			offset += n;
+		}
+
+		for (i = 0; i < npages; i++)
+			dst[count[(src[i]->blockno >> shift) & 0xFF]++] = src[i];
+
+		src = dst;
+		dst = (src == pages) ? buffer : pages;
+	}
+
+	if (src != pages)
+		memcpy(pages, src, npages * sizeof(PagetableEntry *));
+	pfree(buffer);
+}
+
 /*
  * qsort comparator to handle PagetableEntry pointers.
  */
@@ -81,6 +81,7 @@
 #include "access/tsmapi.h"
 #include "executor/executor.h"
 #include "executor/nodeHash.h"
+#include "executor/nodeMemoize.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
@@ -124,8 +125,11 @@ bool		enable_sort = true;
 bool		enable_hashagg = true;
 bool		enable_nestloop = true;
 bool		enable_material = true;
+bool		enable_memoize = false;
 bool		enable_mergejoin = true;
 bool		enable_hashjoin = true;
+bool		enable_parallel_hash = true;
+bool		enable_gathermerge = true;
 
 typedef struct
 {
@@ -139,6 +143,8 @@ static MergeScanSelCache *cached_scansel(PlannerInfo *root,
 			   PathKey *pathkey);
 static void cost_rescan(PlannerInfo *root, Path *path,
 			Cost *rescan_startup_cost, Cost *rescan_total_cost);
+static void cost_memoize_rescan(PlannerInfo *root, MemoizePath *mpath,
+					Cost *rescan_startup_cost, Cost *rescan_total_cost);
 static bool cost_qual_eval_walker(Node *node, cost_qual_eval_context *context);
 static void get_restriction_qual_cost(PlannerInfo *root, RelOptInfo *baserel,
 						  ParamPathInfo *param_info,
@@ -372,6 +378,77 @@ cost_gather(GatherPath *path, PlannerInfo *root,
 	path->path.total_cost = (startup_cost + run_cost);
 }
 
+/*
+ * cost_gather_merge
+ *	  Determines and returns the cost of gather merge path.
+ *
+ * GatherMerge merges several pre-sorted input streams, using a heap that at
+ * any given instant holds the next tuple from each stream.  If there are N
+ * streams, we need about N*log2(N) tuple comparisons to construct the heap at
+ * startup, and then for each output tuple, about log2(N) comparisons to
+ * replace the top heap entry with the next tuple from the same stream.
+ *
+ * 'input_startup_cost' and 'input_total_cost' are the costs of producing the
+ * sorted input of each participant; the other arguments are as for
+ * cost_gather.
+ */
+void
+cost_gather_merge(GatherMergePath *path, PlannerInfo *root,
+				  RelOptInfo *rel, ParamPathInfo *param_info,
+				  Cost input_startup_cost, Cost input_total_cost,
+				  double *rows)
+{
+	Cost		startup_cost = 0;
+	Cost		run_cost = 0;
+	Cost		comparison_cost;
+	double		N;
+	double		logN;
+
+	/* Mark the path with the correct row estimate */
+	if (rows)
+		path->path.rows = *rows;
+	else if (param_info)
+		path->path.rows = param_info->ppi_rows;
+	else
+		path->path.rows = rel->rows;
+
+	if (!enable_gathermerge)
+		startup_cost += disable_cost;
+
+	/*
+	 * Add one to the number of workers to account for the leader.  This might
+	 * be overgenerous since the leader will do less work than other workers
+	 * in typical cases, but we'll go with it for now.
+	 */
+	Assert(path->num_workers > 0);
+	N = (double) path->num_workers + 1;
+	logN = LOG2(N);
+
+	/* Assumed cost per tuple comparison */
+	comparison_cost = 2.0 * cpu_operator_cost;
+
+	/* Heap creation cost */
+	startup_cost += comparison_cost * N * logN;
+
+	/* Per-tuple heap maintenance cost */
+	run_cost += path->path.rows * comparison_cost * logN;
+
+	/* small cost for heap management, like cost_merge_append */
+	run_cost += cpu_operator_cost * path->path.rows;
+
+	/*
+	 * Parallel setup and communication cost.  Since Gather Merge, unlike
+	 * Gather, requires us to block until a tuple is available from every
+	 * worker, we bump the IPC cost up a little bit as compared with Gather.
+	 * For lack of a better idea, charge an extra 5%.
+	 */
+	startup_cost += parallel_setup_cost;
+	run_cost += parallel_tuple_cost * path->path.rows * 1.05;
+
+	path->path.startup_cost = startup_cost + input_startup_cost;
+	path->path.total_cost = (startup_cost + run_cost + input_total_cost);
+}
+
 /*
  * cost_index
  *	  Determines and returns the cost of scanning a relation using an index.
@@ -400,6 +477,7 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 	List	   *qpquals;
 	Cost		startup_cost = 0;
 	Cost		run_cost = 0;
+	Cost		cpu_run_cost = 0;
 	Cost		indexStartupCost;
 	Cost		indexTotalCost;
 	Selectivity indexSelectivity;
@@ -602,11 +680,31 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost += cpu_per_tuple * tuples_fetched;
 
 	/* tlist eval costs are paid per output row, not per tuple scanned */
 	startup_cost += path->path.pathtarget->cost.startup;
-	run_cost += path->path.pathtarget->cost.per_tuple * path->path.rows;
+	cpu_run_cost += path->path.pathtarget->cost.per_tuple * path->path.rows;
+
+	/* Adjust costing for parallelism, if used. */
+	if (path->path.parallel_workers > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(&path->path);
+
+		/*
+		 * The CPU cost is divided among all the workers.  As for a parallel
+		 * sequential scan, we assume the disk costs can't be amortized.
+		 */
+		cpu_run_cost /= parallel_divisor;
+
+		/*
+		 * In the case of a parallel plan, the row count needs to represent
+		 * the number of tuples processed per worker.
+		 */
+		path->path.rows = clamp_row_est(path->path.rows / parallel_divisor);
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->path.startup_cost = startup_cost;
 	path->path.total_cost = startup_cost + run_cost;
@@ -812,6 +910,7 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 {
 	Cost		startup_cost = 0;
 	Cost		run_cost = 0;
+	Cost		cpu_run_cost = 0;
 	Cost		indexTotalCost;
 	Selectivity indexSelectivity;
 	QualCost	qpqual_cost;
@@ -915,11 +1014,31 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost += cpu_per_tuple * tuples_fetched;
 
 	/* tlist eval costs are paid per output row, not per tuple scanned */
 	startup_cost += path->pathtarget->cost.startup;
-	run_cost += path->pathtarget->cost.per_tuple * path->rows;
+	cpu_run_cost += path->pathtarget->cost.per_tuple * path->rows;
+
+	/*
+	 * Adjust costing for parallelism, if used.  The bitmap itself is built by
+	 * just one of the participants, so its cost stays in the startup cost.
+	 */
+	if (path->parallel_workers > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(path);
+
+		/* The CPU cost is divided among all the workers. */
+		cpu_run_cost /= parallel_divisor;
+
+		/*
+		 * In the case of a parallel plan, the row count needs to represent
+		 * the number of tuples processed per worker.
+		 */
+		path->rows = clamp_row_est(path->rows / parallel_divisor);
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->startup_cost = startup_cost;
 	path->total_cost = startup_cost + run_cost;
@@ -1670,6 +1789,75 @@ cost_material(Path *path,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_memoize_rescan
+ *	  Determines the estimated cost of rescanning a Memoize node.
+ *
+ * The first scan costs what the subpath does, plus some bookkeeping; see
+ * create_memoize_path.  What a rescan costs depends on how often we expect
+ * to find its results in the cache.  We assume the keys of the 'calls'
+ * rescans take ndistinct different values, as estimated from the key
+ * expressions, and that repeats of the same value are spread evenly.  Each
+ * value misses the cache the first time, and if the cache can't hold
+ * entries for all the values, also a proportionate share of the later
+ * times.
+ *
+ * Also sets mpath->est_entries, the number of entries we expect the cache
+ * to hold, for sizing its hash table.
+ */
+static void
+cost_memoize_rescan(PlannerInfo *root, MemoizePath *mpath,
+					Cost *rescan_startup_cost, Cost *rescan_total_cost)
+{
+	Path	   *subpath = mpath->subpath;
+	double		tuples = subpath->rows;
+	double		calls = mpath->calls;
+	double		est_entry_bytes;
+	double		est_cache_entries;
+	double		ndistinct;
+	double		hit_ratio;
+	double		evict_ratio;
+	Cost		startup_cost;
+	Cost		total_cost;
+
+	/* How many entries fit in work_mem? */
+	est_entry_bytes = relation_byte_size(tuples, subpath->pathtarget->width) +
+		ExecEstimateCacheEntryOverheadBytes(tuples);
+	est_cache_entries = floor(work_mem * 1024.0 / est_entry_bytes);
+
+	/* How many distinct keys will we see? */
+	ndistinct = estimate_num_groups(root, mpath->param_exprs, calls, NULL);
+	ndistinct = Max(Min(ndistinct, calls), 1.0);
+
+	mpath->est_entries = (uint32) Min(Min(ndistinct, est_cache_entries),
+									  PG_UINT32_MAX);
+
+	/* Fraction of new entries that must evict an older one */
+	evict_ratio = 1.0 - Min(est_cache_entries, ndistinct) / ndistinct;
+
+	/* Fraction of rescans answered from the cache */
+	hit_ratio = (calls - ndistinct) / calls *
+		(Min(est_cache_entries, ndistinct) / ndistinct);
+	hit_ratio = Max(hit_ratio, 0.0);
+
+	/*
+	 * A miss costs a scan of the subpath, and storing its tuples; a hit
+	 * costs returning the cached tuples.  Every rescan computes and looks
+	 * up the keys, and an eviction costs about as much as a hit.
+	 */
+	startup_cost = (1.0 - hit_ratio) * subpath->startup_cost;
+	total_cost = (1.0 - hit_ratio) *
+		(subpath->total_cost + cpu_operator_cost * tuples);
+	total_cost += hit_ratio * cpu_operator_cost * tuples;
+	total_cost += evict_ratio * (1.0 - hit_ratio) * cpu_operator_cost * tuples;
+	total_cost += cpu_tuple_cost +
+		cpu_operator_cost * list_length(mpath->param_exprs);
+	startup_cost += cpu_tuple_cost;
+
+	*rescan_startup_cost = startup_cost;
+	*rescan_total_cost = total_cost;
+}
+
 /*
  * cost_agg
  *		Determines and returns the cost of performing an Agg plan node,
@@ -2687,6 +2875,8 @@ cached_scansel(PlannerInfo *root, RestrictInfo *rinfo, PathKey *pathkey)
  * 'inner_path' is the inner input to the join
  * 'sjinfo' is extra info about the join for selectivity estimation
  * 'semifactors' contains valid data if jointype is SEMI or ANTI
+ * 'parallel_hash' indicates that inner_path is partial and that a shared
+ *		hash table will be built from it by all participants
  */
 void
 initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
@@ -2694,13 +2884,16 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 					  List *hashclauses,
 					  Path *outer_path, Path *inner_path,
 					  SpecialJoinInfo *sjinfo,
-					  SemiAntiJoinFactors *semifactors)
+					  SemiAntiJoinFactors *semifactors,
+					  bool parallel_hash)
 {
 	Cost		startup_cost = 0;
 	Cost		run_cost = 0;
 	double		outer_path_rows = outer_path->rows;
 	double		inner_path_rows = inner_path->rows;
+	double		inner_path_rows_total = inner_path_rows;
 	int			num_hashclauses = list_length(hashclauses);
+	int			nparticipants = 1;
 	int			numbuckets;
 	int			numbatches;
 	int			num_skew_mcvs;
@@ -2724,6 +2917,18 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 		* inner_path_rows;
 	run_cost += cpu_operator_cost * num_hashclauses * outer_path_rows;
 
+	/*
+	 * A shared hash table holds the inner rows of all participants, and may
+	 * use the work_mem allowance of all of them.  Each participant only does
+	 * its share of the work of building it, though, so the costs above are
+	 * per-participant already.
+	 */
+	if (parallel_hash)
+	{
+		inner_path_rows_total = inner_path_rows * get_parallel_divisor(inner_path);
+		nparticipants = inner_path->parallel_workers + 1;
+	}
+
 	/*
 	 * Get hash table size that executor would use for inner relation.
 	 *
@@ -2734,9 +2939,10 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	 * XXX at some point it might be interesting to try to account for skew
 	 * optimization in the cost estimate, but for now, we don't.
 	 */
-	ExecChooseHashTableSize(inner_path_rows,
+	ExecChooseHashTableSize(inner_path_rows_total,
 							inner_path->pathtarget->width,
-							true,		/* useskew */
+							!parallel_hash,		/* useskew */
+							nparticipants,
 							&numbuckets,
 							&numbatches,
 							&num_skew_mcvs);
@@ -2768,6 +2974,7 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	workspace->run_cost = run_cost;
 	workspace->numbuckets = numbuckets;
 	workspace->numbatches = numbatches;
+	workspace->inner_rows_total = inner_path_rows_total;
 }
 
 /*
@@ -2791,7 +2998,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	Path	   *outer_path = path->jpath.outerjoinpath;
 	Path	   *inner_path = path->jpath.innerjoinpath;
 	double		outer_path_rows = outer_path->rows;
-	double		inner_path_rows = inner_path->rows;
+	double		inner_path_rows_total = workspace->inner_rows_total;
 	List	   *hashclauses = path->path_hashclauses;
 	Cost		startup_cost = workspace->startup_cost;
 	Cost		run_cost = workspace->run_cost;
@@ -2831,6 +3038,9 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	/* mark the path with estimated # of batches */
 	path->num_batches = numbatches;
 
+	/* store the total number of tuples (sum of partial row estimates) */
+	path->inner_rows_total = inner_path_rows_total;
+
 	/* and compute the number of "virtual" buckets in the whole join */
 	virtualbuckets = (double) numbuckets *(double) numbatches;
 
@@ -2933,7 +3143,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 
 		startup_cost += hash_qual_cost.startup;
 		run_cost += hash_qual_cost.per_tuple * outer_matched_rows *
-			clamp_row_est(inner_path_rows * innerbucketsize * inner_scan_frac) * 0.5;
+			clamp_row_est(inner_path_rows_total * innerbucketsize * inner_scan_frac) * 0.5;
 
 		/*
 		 * For unmatched outer-rel rows, the picture is quite a lot different.
@@ -2950,7 +3160,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 		 */
 		run_cost += hash_qual_cost.per_tuple *
 			(outer_path_rows - outer_matched_rows) *
-			clamp_row_est(inner_path_rows / virtualbuckets) * 0.05;
+			clamp_row_est(inner_path_rows_total / virtualbuckets) * 0.05;
 
 		/* Get # of tuples that will pass the basic join */
 		if (path->jpath.jointype == JOIN_SEMI)
@@ -2972,7 +3182,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 		 */
 		startup_cost += hash_qual_cost.startup;
 		run_cost += hash_qual_cost.per_tuple * outer_path_rows *
-			clamp_row_est(inner_path_rows * innerbucketsize) * 0.5;
+			clamp_row_est(inner_path_rows_total * innerbucketsize) * 0.5;
 
 		/*
 		 * Get approx # tuples passing the hashquals.  We use
@@ -3164,6 +3374,10 @@ cost_rescan(PlannerInfo *root, Path *path,
 				*rescan_total_cost = run_cost;
 			}
 			break;
+		case T_Memoize:
+			cost_memoize_rescan(root, (MemoizePath *) path,
+								rescan_startup_cost, rescan_total_cost);
+			break;
 		case T_Material:
 		case T_Sort:
 			{
@@ -114,6 +114,7 @@ static List *build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 				  ScanTypeControl scantype,
 				  bool *skip_nonnative_saop,
 				  bool *skip_lower_saop);
+static bool has_saop_index_clause(List *index_clauses);
 static List *build_paths_for_OR(PlannerInfo *root, RelOptInfo *rel,
 				   List *clauses, List *other_clauses);
 static List *generate_bitmap_or_paths(PlannerInfo *root, RelOptInfo *rel,
@@ -337,8 +338,22 @@ create_index_paths(PlannerInfo *root, RelOptInfo *rel)
 
 		bitmapqual = choose_bitmap_and(root, rel, bitindexpaths);
 		bpath = create_bitmap_heap_path(root, rel, bitmapqual,
-										rel->lateral_relids, 1.0);
+										rel->lateral_relids, 1.0, 0);
 		add_path(rel, (Path *) bpath);
+
+		/* If appropriate, consider parallel bitmap heap scan, too */
+		if (rel->consider_parallel && rel->lateral_relids == NULL)
+		{
+			int			parallel_workers;
+
+			parallel_workers = compute_parallel_worker(rel, rel->pages);
+			if (parallel_workers > 0)
+			{
+				bpath = create_bitmap_heap_path(root, rel, bitmapqual,
+												NULL, 1.0, parallel_workers);
+				add_partial_path(rel, (Path *) bpath);
+			}
+		}
 	}
 
 	/*
@@ -410,7 +425,7 @@ create_index_paths(PlannerInfo *root, RelOptInfo *rel)
 			required_outer = get_bitmap_tree_required_outer(bitmapqual);
 			loop_count = get_loop_count(root, rel->relid, required_outer);
 			bpath = create_bitmap_heap_path(root, rel, bitmapqual,
-											required_outer, loop_count);
+											required_outer, loop_count, 0);
 			add_path(rel, (Path *) bpath);
 		}
 	}
@@ -1042,8 +1057,41 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 								  NoMovementScanDirection,
 								  index_only_scan,
 								  outer_relids,
-								  loop_count);
+								  loop_count,
+								  0);
 		result = lappend(result, ipath);
+
+		/*
+		 * If appropriate, consider parallel index scan.  Bitmap index scans
+		 * are parallelized by the bitmap heap scan above them instead.  The
+		 * index AM can't divide a scan with array keys among workers.
+		 */
+		if (index->amcanparallel &&
+			rel->consider_parallel && outer_relids == NULL &&
+			scantype != ST_BITMAPSCAN &&
+			!has_saop_index_clause(index_clauses))
+		{
+			int			parallel_workers;
+
+			parallel_workers = compute_parallel_worker(rel, index->pages);
+			if (parallel_workers > 0)
+			{
+				ipath = create_index_path(root, index,
+										  index_clauses,
+										  clause_columns,
+										  orderbyclauses,
+										  orderbyclausecols,
+										  useful_pathkeys,
+										  index_is_ordered ?
+										  ForwardScanDirection :
+										  NoMovementScanDirection,
+										  index_only_scan,
+										  outer_relids,
+										  loop_count,
+										  parallel_workers);
+				add_partial_path(rel, (Path *) ipath);
+			}
+		}
 	}
 
 	/*
@@ -1066,7 +1114,8 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 									  BackwardScanDirection,
 									  index_only_scan,
 									  outer_relids,
-									  loop_count);
+									  loop_count,
+									  0);
 			result = lappend(result, ipath);
 		}
 	}
@@ -1074,6 +1123,25 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 	return result;
 }
 
+/*
+ * has_saop_index_clause
+ *	  Does the list of index clauses contain any ScalarArrayOpExpr?
+ */
+static bool
+has_saop_index_clause(List *index_clauses)
+{
+	ListCell   *lc;
+
+	foreach(lc, index_clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+		if (IsA(rinfo->clause, ScalarArrayOpExpr))
+			return true;
+	}
+	return false;
+}
+
 /*
  * build_paths_for_OR
  *	  Given a list of restriction clauses from one arm of an OR clause,
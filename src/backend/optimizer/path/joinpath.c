@@ -18,9 +18,14 @@
 
 #include "executor/executor.h"
 #include "foreign/fdwapi.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
+#include "optimizer/restrictinfo.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
 
 /* Hook for plugins to get control in add_paths_to_joinrel() */
 set_join_pathlist_hook_type set_join_pathlist_hook = NULL;
@@ -40,6 +45,9 @@ static void consider_parallel_nestloop(PlannerInfo *root,
 						   RelOptInfo *innerrel,
 						   JoinType jointype,
 						   JoinPathExtraData *extra);
+static Path *get_memoize_path(PlannerInfo *root, RelOptInfo *innerrel,
+				 RelOptInfo *outerrel, Path *inner_path,
+				 Path *outer_path, JoinType jointype);
 static void hash_inner_and_outer(PlannerInfo *root, RelOptInfo *joinrel,
 					 RelOptInfo *outerrel, RelOptInfo *innerrel,
 					 JoinType jointype, JoinPathExtraData *extra);
@@ -261,6 +269,103 @@ allow_star_schema_join(PlannerInfo *root,
 			bms_nonempty_difference(innerparams, outerrelids));
 }
 
+/*
+ * get_memoize_path
+ *	  If a Memoize node could usefully cache the results of the rescans of
+ *	  'inner_path' by a nestloop with 'outer_path', make and return a
+ *	  MemoizePath for that; else return NULL.
+ */
+static Path *
+get_memoize_path(PlannerInfo *root, RelOptInfo *innerrel,
+				 RelOptInfo *outerrel, Path *inner_path,
+				 Path *outer_path, JoinType jointype)
+{
+	List	   *param_exprs = NIL;
+	List	   *hash_operators = NIL;
+	ListCell   *lc;
+
+	if (!enable_memoize)
+		return NULL;
+
+	/* Pointless unless the inner side is rescanned several times */
+	if (outer_path->rows < 2)
+		return NULL;
+
+	/* The inner path must be parameterized, and only by the outer rel */
+	if (inner_path->param_info == NULL ||
+		!bms_is_subset(PATH_REQ_OUTER(inner_path), outerrel->relids))
+		return NULL;
+
+	/*
+	 * Semi and anti joins stop reading the inner side at the first match,
+	 * so we'd never get to cache a complete scan.
+	 */
+	if (jointype != JOIN_INNER && jointype != JOIN_LEFT)
+		return NULL;
+
+	/*
+	 * The parameters of a scan of a plain relation are just the outer sides
+	 * of its parameterized clauses.  Don't try to work them out for other
+	 * kinds of rels.
+	 */
+	if (innerrel->reloptkind != RELOPT_BASEREL ||
+		innerrel->rtekind != RTE_RELATION ||
+		innerrel->lateral_relids != NULL)
+		return NULL;
+
+	/*
+	 * The results of volatile expressions can't be cached.  The walker
+	 * doesn't look through RestrictInfos, so strip them first; pseudoconstant
+	 * clauses are never volatile.
+	 */
+	if (contain_volatile_functions((Node *) innerrel->reltarget->exprs) ||
+		contain_volatile_functions((Node *)
+						extract_actual_clauses(innerrel->baserestrictinfo,
+											   false)) ||
+		contain_volatile_functions((Node *)
+						extract_actual_clauses(inner_path->param_info->ppi_clauses,
+											   false)))
+		return NULL;
+
+	/* Find the cache keys, and how to hash and compare them */
+	foreach(lc, inner_path->param_info->ppi_clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr	   *opexpr = (OpExpr *) rinfo->clause;
+		Node	   *expr;
+		Oid			exprtype;
+		TypeCacheEntry *typentry;
+
+		if (!is_opclause(opexpr) || list_length(opexpr->args) != 2)
+			return NULL;
+
+		if (bms_is_subset(rinfo->left_relids, outerrel->relids) &&
+			bms_is_subset(rinfo->right_relids, innerrel->relids))
+			expr = (Node *) linitial(opexpr->args);
+		else if (bms_is_subset(rinfo->right_relids, outerrel->relids) &&
+				 bms_is_subset(rinfo->left_relids, innerrel->relids))
+			expr = (Node *) lsecond(opexpr->args);
+		else
+			return NULL;
+
+		exprtype = exprType(expr);
+		typentry = lookup_type_cache(exprtype, TYPECACHE_EQ_OPR);
+		if (!OidIsValid(typentry->eq_opr) ||
+			!op_hashjoinable(typentry->eq_opr, exprtype))
+			return NULL;
+
+		param_exprs = lappend(param_exprs, expr);
+		hash_operators = lappend_oid(hash_operators, typentry->eq_opr);
+	}
+
+	if (param_exprs == NIL)
+		return NULL;
+
+	return (Path *) create_memoize_path(root, innerrel, inner_path,
+										param_exprs, hash_operators,
+										outer_path->rows);
+}
+
 /*
  * try_nestloop_path
  *	  Consider a nestloop join path; if it appears useful, push it into
@@ -508,7 +613,8 @@ try_hashjoin_path(PlannerInfo *root,
 	 */
 	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
 						  outer_path, inner_path,
-						  extra->sjinfo, &extra->semifactors);
+						  extra->sjinfo, &extra->semifactors,
+						  false);
 
 	if (add_path_precheck(joinrel,
 						  workspace.startup_cost, workspace.total_cost,
@@ -525,7 +631,8 @@ try_hashjoin_path(PlannerInfo *root,
 									  inner_path,
 									  extra->restrictlist,
 									  required_outer,
-									  hashclauses));
+									  hashclauses,
+									  false));
 	}
 	else
 	{
@@ -538,6 +645,10 @@ try_hashjoin_path(PlannerInfo *root,
  * try_partial_hashjoin_path
  *	  Consider a partial hashjoin join path; if it appears useful, push it into
  *	  the joinrel's partial_pathlist via add_partial_path().
+ *
+ * If parallel_hash is true, inner_path is partial too, and the participants
+ * build one shared hash table from it; otherwise each participant builds its
+ * own copy of the whole inner relation's hash table.
  */
 static void
 try_partial_hashjoin_path(PlannerInfo *root,
@@ -546,7 +657,8 @@ try_partial_hashjoin_path(PlannerInfo *root,
 						  Path *inner_path,
 						  List *hashclauses,
 						  JoinType jointype,
-						  JoinPathExtraData *extra)
+						  JoinPathExtraData *extra,
+						  bool parallel_hash)
 {
 	JoinCostWorkspace workspace;
 
@@ -571,7 +683,8 @@ try_partial_hashjoin_path(PlannerInfo *root,
 	 */
 	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
 						  outer_path, inner_path,
-						  extra->sjinfo, &extra->semifactors);
+						  extra->sjinfo, &extra->semifactors,
+						  parallel_hash);
 	if (!add_partial_path_precheck(joinrel, workspace.total_cost, NIL))
 		return;
 
@@ -587,7 +700,8 @@ try_partial_hashjoin_path(PlannerInfo *root,
 										  inner_path,
 										  extra->restrictlist,
 										  NULL,
-										  hashclauses));
+										  hashclauses,
+										  parallel_hash));
 }
 
 /*
@@ -957,6 +1071,7 @@ match_unsorted_outer(PlannerInfo *root,
 			foreach(lc2, innerrel->cheapest_parameterized_paths)
 			{
 				Path	   *innerpath = (Path *) lfirst(lc2);
+				Path	   *mpath;
 
 				try_nestloop_path(root,
 								  joinrel,
@@ -965,6 +1080,18 @@ match_unsorted_outer(PlannerInfo *root,
 								  merge_pathkeys,
 								  jointype,
 								  extra);
+
+				/* Also consider caching the results of the inner scans */
+				mpath = get_memoize_path(root, innerrel, outerrel,
+										 innerpath, outerpath, jointype);
+				if (mpath != NULL)
+					try_nestloop_path(root,
+									  joinrel,
+									  outerpath,
+									  mpath,
+									  merge_pathkeys,
+									  jointype,
+									  extra);
 			}
 
 			/* Also consider materialized form of the cheapest inner path */
@@ -1266,6 +1393,18 @@ consider_parallel_nestloop(PlannerInfo *root,
 
 			try_partial_nestloop_path(root, joinrel, outerpath, innerpath,
 									  pathkeys, jointype, extra);
+
+			/* Also consider caching the results of the inner scans */
+			if (save_jointype != JOIN_UNIQUE_INNER)
+			{
+				Path	   *mpath;
+
+				mpath = get_memoize_path(root, innerrel, outerrel,
+										 innerpath, outerpath, jointype);
+				if (mpath != NULL)
+					try_partial_nestloop_path(root, joinrel, outerpath, mpath,
+											  pathkeys, jointype, extra);
+			}
 		}
 	}
 }
@@ -1498,7 +1637,31 @@ hash_inner_and_outer(PlannerInfo *root,
 				try_partial_hashjoin_path(root, joinrel,
 										  cheapest_partial_outer,
 										  cheapest_safe_inner,
-										  hashclauses, jointype, extra);
+										  hashclauses, jointype, extra,
+										  false);
+
+			/*
+			 * If the inner relation has a partial path too, we can also
+			 * consider a parallel-aware hash join, where the participants
+			 * build a single shared hash table from their shares of the
+			 * inner relation instead of each building a private copy of the
+			 * whole thing.  The inner path isn't unique-ified then, so
+			 * JOIN_UNIQUE_INNER is out.
+			 */
+			if (enable_parallel_hash &&
+				save_jointype != JOIN_UNIQUE_INNER &&
+				innerrel->partial_pathlist != NIL)
+			{
+				Path	   *cheapest_partial_inner;
+
+				cheapest_partial_inner =
+					(Path *) linitial(innerrel->partial_pathlist);
+				try_partial_hashjoin_path(root, joinrel,
+										  cheapest_partial_outer,
+										  cheapest_partial_inner,
+										  hashclauses, jointype, extra,
+										  true);
+			}
 		}
 	}
 }
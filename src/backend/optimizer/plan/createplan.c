@@ -83,9 +83,13 @@ static Plan *create_merge_append_plan(PlannerInfo *root, MergeAppendPath *best_p
 static Result *create_result_plan(PlannerInfo *root, ResultPath *best_path);
 static Material *create_material_plan(PlannerInfo *root, MaterialPath *best_path,
 					 int flags);
+static Memoize *create_memoize_plan(PlannerInfo *root, MemoizePath *best_path,
+					int flags);
 static Plan *create_unique_plan(PlannerInfo *root, UniquePath *best_path,
 				   int flags);
 static Gather *create_gather_plan(PlannerInfo *root, GatherPath *best_path);
+static GatherMerge *create_gather_merge_plan(PlannerInfo *root,
+						 GatherMergePath *best_path);
 static Plan *create_projection_plan(PlannerInfo *root, ProjectionPath *best_path);
 static Plan *inject_projection_plan(Plan *subplan, List *tlist);
 static Sort *create_sort_plan(PlannerInfo *root, SortPath *best_path, int flags);
@@ -246,6 +250,8 @@ static Sort *make_sort_from_groupcols(List *groupcls,
 						 AttrNumber *grpColIdx,
 						 Plan *lefttree);
 static Material *make_material(Plan *lefttree);
+static Memoize *make_memoize(Plan *lefttree, List *param_exprs,
+			 List *hash_operators, uint32 est_entries);
 static WindowAgg *make_windowagg(List *tlist, Index winref,
 			   int partNumCols, AttrNumber *partColIdx, Oid *partOperators,
 			   int ordNumCols, AttrNumber *ordColIdx, Oid *ordOperators,
@@ -397,6 +403,11 @@ create_plan_recurse(PlannerInfo *root, Path *best_path, int flags)
 												 (MaterialPath *) best_path,
 												 flags);
 			break;
+		case T_Memoize:
+			plan = (Plan *) create_memoize_plan(root,
+												(MemoizePath *) best_path,
+												flags);
+			break;
 		case T_Unique:
 			if (IsA(best_path, UpperUniquePath))
 			{
@@ -416,6 +427,10 @@ create_plan_recurse(PlannerInfo *root, Path *best_path, int flags)
 			plan = (Plan *) create_gather_plan(root,
 											   (GatherPath *) best_path);
 			break;
+		case T_GatherMerge:
+			plan = (Plan *) create_gather_merge_plan(root,
+											  (GatherMergePath *) best_path);
+			break;
 		case T_Sort:
 			plan = (Plan *) create_sort_plan(root,
 											 (SortPath *) best_path,
@@ -1012,6 +1027,38 @@ create_append_plan(PlannerInfo *root, AppendPath *best_path)
 
 	plan = make_append(subplans, tlist);
 
+	/*
+	 * For a scan of an inheritance tree, pass on the restrictions of the
+	 * partition key that only the executor can evaluate, so that it can skip
+	 * the children they exclude.
+	 */
+	plan->part_relid = get_runtime_partition_quals(root,
+												   best_path->path.parent,
+												   &plan->part_keyattno,
+												   &plan->part_strategies,
+												   &plan->part_exprs);
+	if (OidIsValid(plan->part_relid))
+	{
+		foreach(subpaths, best_path->subpaths)
+		{
+			Path	   *subpath = (Path *) lfirst(subpaths);
+			RangeTblEntry *rte;
+
+			rte = planner_rt_fetch(subpath->parent->relid, root);
+			if (subpath->parent->reloptkind != RELOPT_OTHER_MEMBER_REL ||
+				rte->rtekind != RTE_RELATION)
+			{
+				plan->part_relid = InvalidOid;
+				plan->part_childoids = NIL;
+				plan->part_strategies = NIL;
+				plan->part_exprs = NIL;
+				break;
+			}
+			plan->part_childoids = lappend_oid(plan->part_childoids,
+											   rte->relid);
+		}
+	}
+
 	copy_generic_path_info(&plan->plan, (Path *) best_path);
 
 	return (Plan *) plan;
@@ -1178,6 +1225,36 @@ create_material_plan(PlannerInfo *root, MaterialPath *best_path, int flags)
 	return plan;
 }
 
+/*
+ * create_memoize_plan
+ *	  Create a Memoize plan for 'best_path' and (recursively) plans
+ *	  for its subpaths.
+ *
+ *	  Returns a Plan node.
+ */
+static Memoize *
+create_memoize_plan(PlannerInfo *root, MemoizePath *best_path, int flags)
+{
+	Memoize    *plan;
+	Plan	   *subplan;
+	List	   *param_exprs;
+
+	/* As for Material, keep the cached tuples narrow */
+	subplan = create_plan_recurse(root, best_path->subpath,
+								  flags | CP_SMALL_TLIST);
+
+	/* The cache keys are computed from the nestloop params */
+	param_exprs = (List *) replace_nestloop_params(root,
+											(Node *) best_path->param_exprs);
+
+	plan = make_memoize(subplan, param_exprs, best_path->hash_operators,
+						best_path->est_entries);
+
+	copy_generic_path_info(&plan->plan, (Path *) best_path);
+
+	return plan;
+}
+
 /*
  * create_unique_plan
  *	  Create a Unique plan for 'best_path' and (recursively) plans
@@ -1416,6 +1493,95 @@ create_gather_plan(PlannerInfo *root, GatherPath *best_path)
 	return gather_plan;
 }
 
+/*
+ * create_gather_merge_plan
+ *
+ *	  Create a Gather Merge plan for 'best_path' and (recursively)
+ *	  plans for its subpaths.
+ */
+static GatherMerge *
+create_gather_merge_plan(PlannerInfo *root, GatherMergePath *best_path)
+{
+	GatherMerge *gm_plan = makeNode(GatherMerge);
+	Plan	   *plan = &gm_plan->plan;
+	Plan	   *subplan;
+	List	   *pathkeys = best_path->path.pathkeys;
+	int			numsortkeys;
+	AttrNumber *sortColIdx;
+	Oid		   *sortOperators;
+	Oid		   *collations;
+	bool	   *nullsFirst;
+
+	/* As with Gather, it's best to project away columns in the workers. */
+	subplan = create_plan_recurse(root, best_path->subpath, CP_EXACT_TLIST);
+
+	/*
+	 * As for MergeAppend, we compute the sort column info on the Gather
+	 * Merge node itself first, and then make sure the subplan returns the
+	 * same sort key columns.
+	 */
+	copy_generic_path_info(plan, &best_path->path);
+	plan->targetlist = build_path_tlist(root, &best_path->path);
+	plan->qual = NIL;
+	plan->lefttree = NULL;
+	plan->righttree = NULL;
+	gm_plan->num_workers = best_path->num_workers;
+
+	/* Gather Merge is pointless with no pathkeys; use Gather instead. */
+	Assert(pathkeys != NIL);
+
+	/* Compute sort column info, and adjust GatherMerge's tlist as needed */
+	(void) prepare_sort_from_pathkeys(plan, pathkeys,
+									  best_path->path.parent->relids,
+									  NULL,
+									  true,
+									  &gm_plan->numCols,
+									  &gm_plan->sortColIdx,
+									  &gm_plan->sortOperators,
+									  &gm_plan->collations,
+									  &gm_plan->nullsFirst);
+
+	/* Compute sort column info, and adjust subplan's tlist as needed */
+	subplan = prepare_sort_from_pathkeys(subplan, pathkeys,
+										 best_path->subpath->parent->relids,
+										 gm_plan->sortColIdx,
+										 false,
+										 &numsortkeys,
+										 &sortColIdx,
+										 &sortOperators,
+										 &collations,
+										 &nullsFirst);
+
+	Assert(numsortkeys == gm_plan->numCols);
+	if (memcmp(sortColIdx, gm_plan->sortColIdx,
+			   numsortkeys * sizeof(AttrNumber)) != 0)
+		elog(ERROR, "GatherMerge child's targetlist doesn't match GatherMerge");
+	Assert(memcmp(sortOperators, gm_plan->sortOperators,
+				  numsortkeys * sizeof(Oid)) == 0);
+	Assert(memcmp(collations, gm_plan->collations,
+				  numsortkeys * sizeof(Oid)) == 0);
+	Assert(memcmp(nullsFirst, gm_plan->nullsFirst,
+				  numsortkeys * sizeof(bool)) == 0);
+
+	/* Now, insert a Sort node if subplan isn't sufficiently ordered */
+	if (!pathkeys_contained_in(pathkeys, best_path->subpath->pathkeys))
+	{
+		Sort	   *sort = make_sort(subplan, numsortkeys,
+									 sortColIdx, sortOperators,
+									 collations, nullsFirst);
+
+		label_sort_with_costsize(root, sort, -1.0);
+		subplan = (Plan *) sort;
+	}
+
+	plan->lefttree = subplan;
+
+	/* use parallel mode for parallel plans. */
+	root->glob->parallelModeNeeded = true;
+
+	return gm_plan;
+}
+
 /*
  * create_projection_plan
  *
@@ -3252,8 +3418,16 @@ create_foreignscan_plan(PlannerInfo *root, ForeignPath *best_path,
 	/* Copy foreign server OID; likewise, no need to make FDW do this */
 	scan_plan->fs_server = rel->serverid;
 
-	/* Likewise, copy the relids that are represented by this foreign scan */
-	scan_plan->fs_relids = best_path->path.parent->relids;
+	/*
+	 * Likewise, copy the relids that are represented by this foreign scan.
+	 * An upper rel doesn't have relids set, but it covers all the base
+	 * relations participating in the underlying scan, so use root's
+	 * all_baserels.
+	 */
+	if (rel->reloptkind == RELOPT_UPPER_REL)
+		scan_plan->fs_relids = root->all_baserels;
+	else
+		scan_plan->fs_relids = best_path->path.parent->relids;
 
 	/*
 	 * If this is a foreign join, and to make it valid to push down we had to
@@ -3940,6 +4114,13 @@ create_hashjoin_plan(PlannerInfo *root,
 	copy_plan_costsize(&hash_plan->plan, inner_plan);
 	hash_plan->plan.startup_cost = hash_plan->plan.total_cost;
 
+	/*
+	 * If the join is parallel-aware, the executor sizes the shared hash table
+	 * for the inner rows of all participants, not just one participant's.
+	 */
+	if (best_path->jpath.path.parallel_aware)
+		hash_plan->rows_total = best_path->inner_rows_total;
+
 	join_plan = make_hashjoin(tlist,
 							  joinclauses,
 							  otherclauses,
@@ -5622,6 +5803,31 @@ make_material(Plan *lefttree)
 	return node;
 }
 
+static Memoize *
+make_memoize(Plan *lefttree, List *param_exprs, List *hash_operators,
+			 uint32 est_entries)
+{
+	Memoize    *node = makeNode(Memoize);
+	Plan	   *plan = &node->plan;
+	ListCell   *lc;
+	int			i;
+
+	plan->targetlist = lefttree->targetlist;
+	plan->qual = NIL;
+	plan->lefttree = lefttree;
+	plan->righttree = NULL;
+
+	node->numKeys = list_length(param_exprs);
+	node->hashOperators = (Oid *) palloc(node->numKeys * sizeof(Oid));
+	i = 0;
+	foreach(lc, hash_operators)
+		node->hashOperators[i++] = lfirst_oid(lc);
+	node->param_exprs = param_exprs;
+	node->est_entries = est_entries;
+
+	return node;
+}
+
 /*
  * materialize_finished_plan: stick a Material node atop a completed plan
  *
@@ -6189,6 +6395,7 @@ is_projection_capable_path(Path *path)
 	{
 		case T_Hash:
 		case T_Material:
+		case T_Memoize:
 		case T_Sort:
 		case T_Unique:
 		case T_SetOp:
@@ -6196,6 +6403,7 @@ is_projection_capable_path(Path *path)
 		case T_Limit:
 		case T_ModifyTable:
 		case T_MergeAppend:
+		case T_GatherMerge:
 		case T_RecursiveUnion:
 			return false;
 		case T_Append:
@@ -6225,6 +6433,7 @@ is_projection_capable_plan(Plan *plan)
 	{
 		case T_Hash:
 		case T_Material:
+		case T_Memoize:
 		case T_Sort:
 		case T_Unique:
 		case T_SetOp:
@@ -6233,6 +6442,7 @@ is_projection_capable_plan(Plan *plan)
 		case T_ModifyTable:
 		case T_Append:
 		case T_MergeAppend:
+		case T_GatherMerge:
 		case T_RecursiveUnion:
 			return false;
 		default:
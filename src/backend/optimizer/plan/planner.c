@@ -27,6 +27,7 @@
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
 #include "foreign/fdwapi.h"
+#include "jit/jit.h"
 #include "miscadmin.h"
 #include "lib/bipartite_match.h"
 #include "nodes/makefuncs.h"
@@ -400,6 +401,9 @@ standard_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	result->invalItems = glob->invalItems;
 	result->nParamExec = glob->nParamExec;
 
+	/* decide whether the query is expensive enough to be worth JIT */
+	result->jitFlags = jit_plan_flags(top_plan->total_cost);
+
 	return result;
 }
 
@@ -3730,6 +3734,55 @@ create_grouping_paths(PlannerInfo *root,
 										   (List *) parse->havingQual,
 										   dNumGroups));
 		}
+
+		/*
+		 * Partial paths that are already sorted by the grouping keys can
+		 * instead be collected by a Gather Merge, which preserves their
+		 * order, so that no sort is needed before the final aggregation.
+		 */
+		if (root->group_pathkeys)
+		{
+			foreach(lc, grouped_rel->partial_pathlist)
+			{
+				Path	   *path = (Path *) lfirst(lc);
+				double		total_groups;
+
+				if (!pathkeys_contained_in(root->group_pathkeys,
+										   path->pathkeys))
+					continue;
+
+				total_groups = path->rows * path->parallel_workers;
+				path = (Path *) create_gather_merge_path(root,
+														 grouped_rel,
+														 path,
+													 partial_grouping_target,
+														 root->group_pathkeys,
+														 NULL,
+														 &total_groups);
+
+				if (parse->hasAggs)
+					add_path(grouped_rel, (Path *)
+							 create_agg_path(root,
+											 grouped_rel,
+											 path,
+											 target,
+								 parse->groupClause ? AGG_SORTED : AGG_PLAIN,
+											 AGGSPLIT_FINAL_DESERIAL,
+											 parse->groupClause,
+											 (List *) parse->havingQual,
+											 &agg_final_costs,
+											 dNumGroups));
+				else
+					add_path(grouped_rel, (Path *)
+							 create_group_path(root,
+											   grouped_rel,
+											   path,
+											   target,
+											   parse->groupClause,
+											   (List *) parse->havingQual,
+											   dNumGroups));
+			}
+		}
 	}
 
 	if (can_hash)
@@ -4294,6 +4347,61 @@ create_ordered_paths(PlannerInfo *root,
 		}
 	}
 
+	/*
+	 * generate_gather_paths() will have already generated a simple Gather
+	 * path for the best parallel path, if any, and the loop above will have
+	 * considered sorting it.  Similarly, generate_gather_paths() will also
+	 * have generated order-preserving Gather Merge plans which can be used
+	 * without sorting if they happen to match the sort_pathkeys, and the loop
+	 * above will have handled those as well.  However, there's one more
+	 * possibility: it may make sense to sort the cheapest partial path
+	 * according to the required output order and then use Gather Merge.
+	 *
+	 * Only the partial paths of the scan/join relation produce the input
+	 * rows; those of a grouping relation are only partially aggregated.
+	 */
+	if (ordered_rel->consider_parallel && root->sort_pathkeys != NIL &&
+		input_rel->partial_pathlist != NIL &&
+		input_rel->reloptkind != RELOPT_UPPER_REL)
+	{
+		Path	   *cheapest_partial_path;
+
+		cheapest_partial_path = linitial(input_rel->partial_pathlist);
+
+		/*
+		 * If cheapest partial path doesn't need a sort, this is redundant
+		 * with what's already been tried.
+		 */
+		if (!pathkeys_contained_in(root->sort_pathkeys,
+								   cheapest_partial_path->pathkeys))
+		{
+			Path	   *path;
+			double		total_groups;
+
+			path = (Path *) create_sort_path(root,
+											 ordered_rel,
+											 cheapest_partial_path,
+											 root->sort_pathkeys,
+											 -1.0);
+
+			total_groups = cheapest_partial_path->rows *
+				cheapest_partial_path->parallel_workers;
+			path = (Path *)
+				create_gather_merge_path(root, ordered_rel,
+										 path,
+										 path->pathtarget,
+										 root->sort_pathkeys, NULL,
+										 &total_groups);
+
+			/* Add projection step if needed */
+			if (path->pathtarget != target)
+				path = apply_projection_to_path(root, ordered_rel,
+												path, target);
+
+			add_path(ordered_rel, path);
+		}
+	}
+
 	/*
 	 * If there is an FDW that's responsible for all baserels of the query,
 	 * let it consider adding ForeignPaths.
@@ -5257,7 +5365,7 @@ plan_cluster_use_sort(Oid tableOid, Oid indexOid)
 	indexScanPath = create_index_path(root, indexInfo,
 									  NIL, NIL, NIL, NIL, NIL,
 									  ForwardScanDirection, false,
-									  NULL, 1.0);
+									  NULL, 1.0, 0);
 
 	return (seqScanAndSortPath.total_cost < indexScanPath->path.total_cost);
 }
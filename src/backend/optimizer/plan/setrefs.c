@@ -605,6 +605,7 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 			break;
 
 		case T_Gather:
+		case T_GatherMerge:
 			set_upper_references(root, plan, rtoffset);
 			break;
 
@@ -629,6 +630,21 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 			 */
 			Assert(plan->qual == NIL);
 			break;
+		case T_Memoize:
+			{
+				Memoize    *mplan = (Memoize *) plan;
+
+				/*
+				 * Like the plan types above, Memoize doesn't evaluate its
+				 * tlist or quals, but it does evaluate its cache keys.
+				 */
+				set_dummy_tlist_references(plan, rtoffset);
+				Assert(plan->qual == NIL);
+
+				mplan->param_exprs = fix_scan_list(root, mplan->param_exprs,
+												   rtoffset);
+			}
+			break;
 		case T_LockRows:
 			{
 				LockRows   *splan = (LockRows *) plan;
@@ -866,6 +882,9 @@ set_plan_refs(PlannerInfo *root, Plan *plan, int rtoffset)
 											  (Plan *) lfirst(l),
 											  rtoffset);
 				}
+				/* the pruning expressions don't contain Vars */
+				splan->part_exprs =
+					fix_scan_list(root, splan->part_exprs, rtoffset);
 			}
 			break;
 		case T_MergeAppend:
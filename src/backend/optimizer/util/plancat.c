@@ -31,16 +31,19 @@
 #include "foreign/fdwapi.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/plancat.h"
 #include "optimizer/predtest.h"
 #include "optimizer/prep.h"
+#include "optimizer/var.h"
 #include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteManip.h"
 #include "storage/bufmgr.h"
 #include "utils/lsyscache.h"
+#include "utils/partmap.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 
@@ -242,6 +245,7 @@ get_relation_info(PlannerInfo *root, Oid relationObjectId, bool inhparent,
 			info->amsearchnulls = amroutine->amsearchnulls;
 			info->amhasgettuple = (amroutine->amgettuple != NULL);
 			info->amhasgetbitmap = (amroutine->amgetbitmap != NULL);
+			info->amcanparallel = amroutine->amcanparallel;
 			info->amcostestimate = amroutine->amcostestimate;
 			Assert(info->amcostestimate != NULL);
 
@@ -1342,6 +1346,205 @@ relation_excluded_by_constraints(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * match_partition_key_clause
+ *
+ * Is the clause "key op value" or "value op key", where key is the partition
+ * key column of the map, and op one of its btree operators?  If so, return
+ * the operator's strategy, with the key on the left, and the value.
+ */
+static bool
+match_partition_key_clause(PartitionMap *map, Index varno, Expr *clause,
+						   StrategyNumber *strategy, Expr **value)
+{
+	OpExpr	   *opclause = (OpExpr *) clause;
+	Node	   *left;
+	Node	   *right;
+	Oid			opno;
+	int			strat;
+	Oid			lefttype;
+	Oid			righttype;
+
+	if (!is_opclause(clause) || list_length(opclause->args) != 2)
+		return false;
+
+	left = strip_implicit_coercions(linitial(opclause->args));
+	right = strip_implicit_coercions(lsecond(opclause->args));
+	opno = opclause->opno;
+	if (!(IsA(left, Var) &&
+		  ((Var *) left)->varno == varno &&
+		  ((Var *) left)->varattno == map->keyattno &&
+		  ((Var *) left)->varlevelsup == 0))
+	{
+		Node	   *tmp = left;
+
+		left = right;
+		right = tmp;
+		opno = get_commutator(opno);
+		if (!(IsA(left, Var) &&
+			  ((Var *) left)->varno == varno &&
+			  ((Var *) left)->varattno == map->keyattno &&
+			  ((Var *) left)->varlevelsup == 0))
+			return false;
+	}
+
+	if (!OidIsValid(opno) ||
+		opclause->inputcollid != map->keycollation ||
+		!op_in_opfamily(opno, map->opfamily))
+		return false;
+	get_op_opfamily_properties(opno, map->opfamily, false,
+							   &strat, &lefttype, &righttype);
+	if (lefttype != map->cmptype || righttype != map->cmptype)
+		return false;
+
+	*strategy = (StrategyNumber) strat;
+	*value = (Expr *) right;
+	return true;
+}
+
+/*
+ * prune_append_rel_partitions
+ *
+ * Find the children of an inheritance appendrel that its restriction clauses
+ * exclude, according to the parent's partition map (see utils/partmap.h).
+ * Only clauses comparing the partition key with a constant are considered.
+ *
+ * This finds the children by binary search, so it's much cheaper than
+ * relation_excluded_by_constraints() for inheritance trees with many
+ * children.  Returns their RT indexes.
+ */
+Relids
+prune_append_rel_partitions(PlannerInfo *root, RelOptInfo *rel,
+							RangeTblEntry *rte)
+{
+	PartitionMap *map;
+	List	   *childoids = NIL;
+	List	   *childrtis = NIL;
+	StrategyNumber *strategies;
+	Datum	   *values;
+	int			nquals = 0;
+	bool	   *live;
+	Relids		result = NULL;
+	ListCell   *lc;
+	ListCell   *lc2;
+
+	if (constraint_exclusion == CONSTRAINT_EXCLUSION_OFF ||
+		rte->rtekind != RTE_RELATION || !rte->inh ||
+		rel->baserestrictinfo == NIL)
+		return NULL;
+
+	foreach(lc, root->append_rel_list)
+	{
+		AppendRelInfo *appinfo = (AppendRelInfo *) lfirst(lc);
+
+		if (appinfo->parent_relid != rel->relid)
+			continue;
+		childoids = lappend_oid(childoids,
+						 root->simple_rte_array[appinfo->child_relid]->relid);
+		childrtis = lappend_int(childrtis, appinfo->child_relid);
+	}
+
+	map = GetPartitionMap(rte->relid, childoids);
+	if (map->keyattno == InvalidAttrNumber)
+		return NULL;
+
+	strategies = (StrategyNumber *)
+		palloc(list_length(rel->baserestrictinfo) * sizeof(StrategyNumber));
+	values = (Datum *)
+		palloc(list_length(rel->baserestrictinfo) * sizeof(Datum));
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		Expr	   *value;
+
+		if (match_partition_key_clause(map, rel->relid, rinfo->clause,
+									   &strategies[nquals], &value) &&
+			IsA(value, Const) && !((Const *) value)->constisnull)
+			values[nquals++] = ((Const *) value)->constvalue;
+	}
+	if (nquals == 0)
+		return NULL;
+
+	live = PartitionMapPrune(map, nquals, strategies, values);
+
+	forboth(lc, childoids, lc2, childrtis)
+	{
+		int			child = PartitionMapFindChild(map, lfirst_oid(lc));
+
+		if (child >= 0 && !live[child])
+			result = bms_add_member(result, lfirst_int(lc2));
+	}
+
+	return result;
+}
+
+static bool
+contain_exec_param_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXEC)
+		return true;
+	return expression_tree_walker(node, contain_exec_param_walker, context);
+}
+
+/*
+ * get_runtime_partition_quals
+ *
+ * Find the restrictions of the partition key of an inheritance appendrel
+ * that prune_append_rel_partitions() couldn't use because they compare with
+ * a Param or a stable expression, but that can be evaluated at executor
+ * startup.  Returns the parent's OID, the partition key, and the
+ * restrictions as strategies and expressions, or InvalidOid if there are
+ * none.
+ */
+Oid
+get_runtime_partition_quals(PlannerInfo *root, RelOptInfo *rel,
+							AttrNumber *keyattno,
+							List **strategies, List **exprs)
+{
+	RangeTblEntry *rte;
+	PartitionMap *map;
+	ListCell   *lc;
+
+	*strategies = NIL;
+	*exprs = NIL;
+
+	if (constraint_exclusion == CONSTRAINT_EXCLUSION_OFF ||
+		rel->reloptkind != RELOPT_BASEREL ||
+		rel->baserestrictinfo == NIL)
+		return InvalidOid;
+	rte = planner_rt_fetch(rel->relid, root);
+	if (rte->rtekind != RTE_RELATION || !rte->inh)
+		return InvalidOid;
+
+	map = GetPartitionMap(rte->relid, NIL);
+	if (map->keyattno == InvalidAttrNumber)
+		return InvalidOid;
+
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		StrategyNumber strategy;
+		Expr	   *value;
+
+		if (match_partition_key_clause(map, rel->relid, rinfo->clause,
+									   &strategy, &value) &&
+			!IsA(value, Const) &&
+			!contain_var_clause((Node *) value) &&
+			!contain_volatile_functions((Node *) value) &&
+			!contain_subplans((Node *) value) &&
+			!contain_exec_param_walker((Node *) value, NULL))
+		{
+			*strategies = lappend_int(*strategies, strategy);
+			*exprs = lappend(*exprs, copyObject(value));
+		}
+	}
+
+	*keyattno = map->keyattno;
+	return *exprs != NIL ? rte->relid : InvalidOid;
+}
+
 
 /*
  * build_physical_tlist
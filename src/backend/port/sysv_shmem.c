@@ -30,6 +30,9 @@
 #ifdef HAVE_SYS_SHM_H
 #include <sys/shm.h>
 #endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "miscadmin.h"
 #include "portability/mem.h"
@@ -74,11 +77,28 @@ typedef int IpcMemoryId;		/* shared memory ID returned by shmget(2) */
 unsigned long UsedShmemSegID = 0;
 void	   *UsedShmemSegAddr = NULL;
 
+/* size of the System V segment, and page size of the main segment */
+static Size UsedShmemSegSize = 0;
+static Size UsedShmemPageSize = 0;
+
 #ifdef USE_ANONYMOUS_SHMEM
 static Size AnonymousShmemSize;
 static void *AnonymousShmem = NULL;
 #endif
 
+/*
+ * NUMA memory policy support.  We call mbind(2) directly rather than
+ * depending on libnuma; the constant is part of the stable kernel ABI.
+ */
+#if defined(__linux__) && defined(SYS_mbind)
+#define USE_NUMA_INTERLEAVE
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+/* highest number of NUMA nodes we are prepared to handle */
+#define MAX_NUMA_NODES 1024
+#endif
+
 static void *InternalIpcMemoryCreate(IpcMemoryKey memKey, Size size);
 static void IpcMemoryDetach(int status, Datum shmaddr);
 static void IpcMemoryDelete(int status, Datum shmId);
@@ -482,6 +502,8 @@ CreateAnonymousSegment(Size *size)
 		if (huge_pages == HUGE_PAGES_TRY && ptr == MAP_FAILED)
 			elog(DEBUG1, "mmap(%zu) with MAP_HUGETLB failed, huge pages disabled: %m",
 				 allocsize);
+		if (ptr != MAP_FAILED)
+			UsedShmemPageSize = hugepagesize;
 	}
 #endif
 
@@ -575,6 +597,9 @@ PGSharedMemoryCreate(Size size, bool makePrivate, int port,
 	/* Room for a header? */
 	Assert(size > MAXALIGN(sizeof(PGShmemHeader)));
 
+	/* CreateAnonymousSegment overrides this if it gets huge pages */
+	UsedShmemPageSize = (Size) sysconf(_SC_PAGESIZE);
+
 #ifdef USE_ANONYMOUS_SHMEM
 	AnonymousShmem = CreateAnonymousSegment(&size);
 	AnonymousShmemSize = size;
@@ -590,6 +615,7 @@ PGSharedMemoryCreate(Size size, bool makePrivate, int port,
 
 	/* Make sure PGSharedMemoryAttach doesn't fail without need */
 	UsedShmemSegAddr = NULL;
+	UsedShmemSegSize = sysvsize;
 
 	/* Loop till we find a free IPC key */
 	NextShmemSegID = port * 1000;
@@ -838,3 +864,188 @@ PGSharedMemoryAttach(IpcMemoryKey key, IpcMemoryId *shmid)
 
 	return hdr;
 }
+
+#ifdef USE_NUMA_INTERLEAVE
+/*
+ * Get the mask of online NUMA nodes from sysfs, which lists them as ranges
+ * like "0-1,4".  Returns the number of nodes, or 0 if it can't be read.
+ */
+static int
+GetOnlineNumaNodes(unsigned long *nodemask)
+{
+	FILE	   *fp;
+	char		buf[1024];
+	char	   *p;
+	int			nnodes = 0;
+
+	memset(nodemask, 0, MAX_NUMA_NODES / 8);
+
+	fp = AllocateFile("/sys/devices/system/node/online", "r");
+	if (fp == NULL)
+		return 0;
+	if (fgets(buf, sizeof(buf), fp) == NULL)
+		buf[0] = '\0';
+	FreeFile(fp);
+
+	p = buf;
+	while (*p >= '0' && *p <= '9')
+	{
+		long		first;
+		long		last;
+		long		node;
+
+		first = last = strtol(p, &p, 10);
+		if (*p == '-')
+			last = strtol(p + 1, &p, 10);
+		if (first < 0 || last >= MAX_NUMA_NODES || last < first)
+			return 0;
+
+		for (node = first; node <= last; node++)
+		{
+			nodemask[node / (8 * sizeof(unsigned long))] |=
+				1UL << (node % (8 * sizeof(unsigned long)));
+			nnodes++;
+		}
+
+		if (*p == ',')
+			p++;
+	}
+
+	return nnodes;
+}
+#endif   /* USE_NUMA_INTERLEAVE */
+
+/*
+ * PGSharedMemoryInterleave
+ *
+ * Ask the kernel to spread the pages of the given range of the main shared
+ * memory segment round-robin over all online NUMA nodes, instead of placing
+ * each on the node of whichever process happens to touch it first.  This
+ * only affects pages not yet touched, so it must be called before the memory
+ * is used.  The range is shrunk to whole pages of the segment's page size.
+ *
+ * Only supported on Linux; elsewhere, and on machines with a single NUMA
+ * node, this does nothing.
+ */
+void
+PGSharedMemoryInterleave(void *address, Size size)
+{
+#ifdef USE_NUMA_INTERLEAVE
+	unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+	int			nnodes;
+	char	   *start;
+	char	   *end;
+
+	nnodes = GetOnlineNumaNodes(nodemask);
+	if (nnodes <= 1)
+	{
+		elog(DEBUG1, "not interleaving shared memory, found %d NUMA nodes",
+			 nnodes);
+		return;
+	}
+
+	start = (char *) TYPEALIGN(UsedShmemPageSize, address);
+	end = (char *) TYPEALIGN_DOWN(UsedShmemPageSize, (char *) address + size);
+	if (start >= end)
+		return;
+
+	if (syscall(SYS_mbind, start, (unsigned long) (end - start),
+				MPOL_INTERLEAVE, nodemask, MAX_NUMA_NODES + 1, 0) != 0)
+		ereport(WARNING,
+				(errmsg("could not interleave shared memory across NUMA nodes: %m")));
+	else
+		ereport(LOG,
+				(errmsg("interleaving %zu kB of shared memory across %d NUMA nodes",
+						(Size) (end - start) / 1024, nnodes)));
+#else
+	ereport(WARNING,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("NUMA interleaving of shared memory is not supported on this platform")));
+#endif
+}
+
+#ifdef __linux__
+/*
+ * Report how much of one shared memory segment is backed by huge pages,
+ * based on the page size the kernel reports in /proc/self/smaps for each
+ * mapping covering it.
+ */
+static void
+ReportSegmentPageSizes(const char *kind, void *address, Size size, int elevel)
+{
+	FILE	   *fp;
+	char		buf[MAXPGPATH + 128];
+	uintptr_t	segstart = (uintptr_t) address;
+	uintptr_t	segend = segstart + size;
+	uintptr_t	overlap = 0;
+	Size		hugebytes = 0;
+	Size		systempagesize = (Size) sysconf(_SC_PAGESIZE);
+
+	fp = AllocateFile("/proc/self/smaps", "r");
+	if (fp == NULL)
+	{
+		elog(DEBUG1, "could not open \"/proc/self/smaps\": %m");
+		return;
+	}
+
+	while (fgets(buf, sizeof(buf), fp))
+	{
+		unsigned long start;
+		unsigned long end;
+		size_t		kernelpagesize;
+
+		/* mapping header lines look like "start-end perms offset ..." */
+		if (sscanf(buf, "%lx-%lx ", &start, &end) == 2)
+		{
+			if (start < segend && end > segstart)
+				overlap = Min(end, segend) - Max(start, segstart);
+			else
+				overlap = 0;
+		}
+		else if (overlap > 0 &&
+				 sscanf(buf, "KernelPageSize: %zu kB", &kernelpagesize) == 1)
+		{
+			elog(DEBUG1, "%s shared memory mapping of %zu kB uses %zu kB pages",
+				 kind, (Size) overlap / 1024, kernelpagesize);
+			if (kernelpagesize * 1024 > systempagesize)
+				hugebytes += overlap;
+			overlap = 0;
+		}
+	}
+	FreeFile(fp);
+
+	ereport(elevel,
+			(errmsg("%s shared memory segment of %zu kB: %zu kB backed by huge pages",
+					kind, size / 1024, hugebytes / 1024)));
+}
+#endif   /* __linux__ */
+
+/*
+ * PGSharedMemoryReportHugePages
+ *
+ * Report how much of the main shared memory segment, whether anonymous or
+ * System V, is actually backed by huge pages.  This is read back from the
+ * kernel rather than inferred from whether mmap() with MAP_HUGETLB
+ * succeeded.  The System V interlock segment that accompanies an anonymous
+ * segment is too small to matter and isn't reported.  The report is logged
+ * at LOG level unless huge_pages is off.  Only supported on Linux.
+ */
+void
+PGSharedMemoryReportHugePages(void)
+{
+#ifdef __linux__
+	int			elevel = (huge_pages == HUGE_PAGES_OFF) ? DEBUG1 : LOG;
+
+#ifdef USE_ANONYMOUS_SHMEM
+	if (AnonymousShmem != NULL)
+	{
+		ReportSegmentPageSizes("anonymous", AnonymousShmem,
+							   AnonymousShmemSize, elevel);
+		return;
+	}
+#endif
+	if (UsedShmemSegAddr != NULL)
+		ReportSegmentPageSizes("System V", UsedShmemSegAddr,
+							   UsedShmemSegSize, elevel);
+#endif
+}
@@ -368,6 +368,30 @@ PGSharedMemoryDetach(void)
 }
 
 
+/*
+ * PGSharedMemoryInterleave
+ *
+ * NUMA interleaving of shared memory is not supported on Windows.
+ */
+void
+PGSharedMemoryInterleave(void *address, Size size)
+{
+	ereport(WARNING,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("NUMA interleaving of shared memory is not supported on this platform")));
+}
+
+/*
+ * PGSharedMemoryReportHugePages
+ *
+ * Huge pages are not used on Windows, so there is nothing to report.
+ */
+void
+PGSharedMemoryReportHugePages(void)
+{
+}
+
+
 /*
  * pgwin32_SharedMemoryDelete
  *
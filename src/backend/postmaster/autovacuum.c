@@ -61,11 +61,14 @@
  */
 #include "postgres.h"
 
+#include <math.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#include "access/brin.h"
+#include "access/gin_private.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
@@ -181,6 +184,14 @@ typedef struct av_relation
 								 * reloptions, or NULL if none */
 } av_relation;
 
+/* struct to rank the tables to vacuum and/or analyze, in 1st pass */
+typedef struct av_candidate
+{
+	Oid			ac_relid;
+	double		ac_priority;
+	bool		ac_wraparound;
+} av_candidate;
+
 /* struct to keep track of tables to vacuum and/or analyze, after rechecking */
 typedef struct autovac_table
 {
@@ -242,6 +253,23 @@ typedef enum
 	AutoVacNumSignals			/* must be last */
 }	AutoVacuumSignal;
 
+/*
+ * Structure to hold an autovacuum work item, requested by some backend for
+ * processing by a worker connected to the same database; see
+ * AutoVacuumRequestWork.
+ */
+typedef struct AutoVacuumWorkItem
+{
+	AutoVacuumWorkItemType avw_type;
+	bool		avw_used;		/* below data is valid */
+	bool		avw_active;		/* being processed */
+	Oid			avw_database;
+	Oid			avw_relation;
+	BlockNumber avw_blockNumber;
+} AutoVacuumWorkItem;
+
+#define NUM_WORKITEMS	256
+
 /*-------------
  * The main autovacuum shmem struct.  On shared memory we store this main
  * struct and the array of WorkerInfo structs.  This struct keeps:
@@ -252,6 +280,9 @@ typedef enum
  * av_runningWorkers the WorkerInfo non-free queue
  * av_startingWorker pointer to WorkerInfo currently being started (cleared by
  *					the worker itself as soon as it's up and running)
+ * av_workItems		work item array
+ * av_queue			tables waiting to be processed, in no particular order;
+ *					see autovac_queue_next
  *
  * This struct is protected by AutovacuumLock, except for av_signal and parts
  * of the worker list (see above).
@@ -264,8 +295,17 @@ typedef struct
 	dlist_head	av_freeWorkers;
 	dlist_head	av_runningWorkers;
 	WorkerInfo	av_startingWorker;
+	AutoVacuumWorkItem av_workItems[NUM_WORKITEMS];
+	int			av_queueLen;
+	AutoVacuumQueueEntry av_queue[AUTOVACUUM_QUEUE_SIZE];
 } AutoVacuumShmemStruct;
 
+/*
+ * Tables at risk of wraparound are given at least this priority, so that
+ * they come before all others.
+ */
+#define AV_WRAPAROUND_PRIORITY	1.0e9
+
 static AutoVacuumShmemStruct *AutoVacuumShmem;
 
 /*
@@ -303,19 +343,22 @@ static void FreeWorkerInfo(int code, Datum arg);
 static autovac_table *table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 					  TupleDesc pg_class_desc,
 					  int effective_multixact_freeze_max_age);
+static int	av_candidate_comparator(const void *a, const void *b);
+static Oid autovac_queue_next(av_candidate *cands, int ncands, int *next);
+static void autovac_queue_release(void);
 static void relation_needs_vacanalyze(Oid relid, AutoVacOpts *relopts,
 						  Form_pg_class classForm,
 						  PgStat_StatTabEntry *tabentry,
 						  int effective_multixact_freeze_max_age,
-						  bool *dovacuum, bool *doanalyze, bool *wraparound);
+						  bool *dovacuum, bool *doanalyze, bool *wraparound,
+						  double *priority);
 
 static void autovacuum_do_vac_analyze(autovac_table *tab,
 						  BufferAccessStrategy bstrategy);
 static AutoVacOpts *extract_autovac_opts(HeapTuple tup,
 					 TupleDesc pg_class_desc);
-static PgStat_StatTabEntry *get_pgstat_tabentry_relid(Oid relid, bool isshared,
-						  PgStat_StatDBEntry *shared,
-						  PgStat_StatDBEntry *dbentry);
+static PgStat_StatTabEntry *get_pgstat_tabentry_relid(Oid relid, bool isshared);
+static void perform_work_item(AutoVacuumWorkItem *workitem);
 static void autovac_report_activity(autovac_table *tab);
 static void av_sighup_handler(SIGNAL_ARGS);
 static void avl_sigusr2_handler(SIGNAL_ARGS);
@@ -726,6 +769,8 @@ AutoVacLauncherMain(int argc, char *argv[])
 					dlist_push_head(&AutoVacuumShmem->av_freeWorkers,
 									&worker->wi_links);
 					AutoVacuumShmem->av_startingWorker = NULL;
+		memset(AutoVacuumShmem->av_workItems, 0,
+			   sizeof(AutoVacuumWorkItem) * NUM_WORKITEMS);
 					elog(WARNING, "worker took too long to start; canceled");
 				}
 			}
@@ -1680,6 +1725,9 @@ FreeWorkerInfo(int code, Datum arg)
 		 */
 		AutovacuumLauncherPid = AutoVacuumShmem->av_launcherpid;
 
+		/* give back the table we were processing, if any */
+		autovac_queue_release();
+
 		dlist_delete(&MyWorkerInfo->wi_links);
 		MyWorkerInfo->wi_dboid = InvalidOid;
 		MyWorkerInfo->wi_tableoid = InvalidOid;
@@ -1885,12 +1933,14 @@ do_autovacuum(void)
 	HeapTuple	tuple;
 	HeapScanDesc relScan;
 	Form_pg_database dbForm;
-	List	   *table_oids = NIL;
+	List	   *candidates = NIL;
+	av_candidate *cands;
+	int			ncands;
+	int			nextcand;
 	HASHCTL		ctl;
 	HTAB	   *table_toast_map;
-	ListCell   *volatile cell;
-	PgStat_StatDBEntry *shared;
-	PgStat_StatDBEntry *dbentry;
+	ListCell   *cell;
+	int			i;
 	BufferAccessStrategy bstrategy;
 	ScanKeyData key;
 	TupleDesc	pg_class_desc;
@@ -1908,12 +1958,6 @@ do_autovacuum(void)
 										  ALLOCSET_DEFAULT_SIZES);
 	MemoryContextSwitchTo(AutovacMemCxt);
 
-	/*
-	 * may be NULL if we couldn't find an entry (only happens if we are
-	 * forcing a vacuum for anti-wrap purposes).
-	 */
-	dbentry = pgstat_fetch_stat_dbentry(MyDatabaseId);
-
 	/* Start a transaction so our commands have one to play into. */
 	StartTransactionCommand();
 
@@ -1961,9 +2005,6 @@ do_autovacuum(void)
 	/* StartTransactionCommand changed elsewhere */
 	MemoryContextSwitchTo(AutovacMemCxt);
 
-	/* The database hash where pgstat keeps shared relations */
-	shared = pgstat_fetch_stat_dbentry(InvalidOid);
-
 	classRel = heap_open(RelationRelationId, AccessShareLock);
 
 	/* create a copy so we can use it after closing pg_class */
@@ -2008,6 +2049,7 @@ do_autovacuum(void)
 		bool		dovacuum;
 		bool		doanalyze;
 		bool		wraparound;
+		double		priority;
 
 		if (classForm->relkind != RELKIND_RELATION &&
 			classForm->relkind != RELKIND_MATVIEW)
@@ -2017,13 +2059,13 @@ do_autovacuum(void)
 
 		/* Fetch reloptions and the pgstat entry for this table */
 		relopts = extract_autovac_opts(tuple, pg_class_desc);
-		tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared,
-											 shared, dbentry);
+		tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared);
 
 		/* Check if it needs vacuum or analyze */
 		relation_needs_vacanalyze(relid, relopts, classForm, tabentry,
 								  effective_multixact_freeze_max_age,
-								  &dovacuum, &doanalyze, &wraparound);
+								  &dovacuum, &doanalyze, &wraparound,
+								  &priority);
 
 		/*
 		 * Check if it is a temp table (presumably, of some other backend's).
@@ -2070,9 +2112,16 @@ do_autovacuum(void)
 		}
 		else
 		{
-			/* relations that need work are added to table_oids */
+			/* relations that need work are added to candidates */
 			if (dovacuum || doanalyze)
-				table_oids = lappend_oid(table_oids, relid);
+			{
+				av_candidate *cand = palloc(sizeof(av_candidate));
+
+				cand->ac_relid = relid;
+				cand->ac_priority = priority;
+				cand->ac_wraparound = wraparound;
+				candidates = lappend(candidates, cand);
+			}
 
 			/*
 			 * Remember the association for the second pass.  Note: we must do
@@ -2122,6 +2171,7 @@ do_autovacuum(void)
 		bool		dovacuum;
 		bool		doanalyze;
 		bool		wraparound;
+		double		priority;
 
 		/*
 		 * We cannot safely process other backends' temp tables, so skip 'em.
@@ -2147,21 +2197,42 @@ do_autovacuum(void)
 		}
 
 		/* Fetch the pgstat entry for this table */
-		tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared,
-											 shared, dbentry);
+		tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared);
 
 		relation_needs_vacanalyze(relid, relopts, classForm, tabentry,
 								  effective_multixact_freeze_max_age,
-								  &dovacuum, &doanalyze, &wraparound);
+								  &dovacuum, &doanalyze, &wraparound,
+								  &priority);
 
 		/* ignore analyze for toast tables */
 		if (dovacuum)
-			table_oids = lappend_oid(table_oids, relid);
+		{
+			av_candidate *cand = palloc(sizeof(av_candidate));
+
+			cand->ac_relid = relid;
+			cand->ac_priority = priority;
+			cand->ac_wraparound = wraparound;
+			candidates = lappend(candidates, cand);
+		}
 	}
 
 	heap_endscan(relScan);
 	heap_close(classRel, AccessShareLock);
 
+	/*
+	 * Rank the collected tables, most urgent first.  We don't process them
+	 * in this order directly, but through the shared queue, so that all the
+	 * workers in this database work on the most urgent tables first.
+	 */
+	ncands = list_length(candidates);
+	cands = palloc(Max(ncands, 1) * sizeof(av_candidate));
+	i = 0;
+	foreach(cell, candidates)
+		cands[i++] = *(av_candidate *) lfirst(cell);
+	list_free_deep(candidates);
+	qsort(cands, ncands, sizeof(av_candidate), av_candidate_comparator);
+	nextcand = 0;
+
 	/*
 	 * Create a buffer access strategy object for VACUUM to use.  We want to
 	 * use the same one across all the vacuum operations we perform, since the
@@ -2180,9 +2251,9 @@ do_autovacuum(void)
 	/*
 	 * Perform operations on collected tables.
 	 */
-	foreach(cell, table_oids)
+	for (;;)
 	{
-		Oid			relid = lfirst_oid(cell);
+		Oid			relid;
 		autovac_table *tab;
 		bool		skipit;
 		int			stdVacuumCostDelay;
@@ -2209,11 +2280,21 @@ do_autovacuum(void)
 
 		/*
 		 * hold schedule lock from here until we're sure that this table still
-		 * needs vacuuming.  We also need the AutovacuumLock to walk the
-		 * worker array, but we'll let go of that one quickly.
+		 * needs vacuuming.  We also need the AutovacuumLock to pick the next
+		 * table from the queue and walk the worker array, but we'll let go of
+		 * that one quickly.
 		 */
 		LWLockAcquire(AutovacuumScheduleLock, LW_EXCLUSIVE);
-		LWLockAcquire(AutovacuumLock, LW_SHARED);
+		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+
+		relid = autovac_queue_next(cands, ncands, &nextcand);
+		if (!OidIsValid(relid))
+		{
+			/* nothing left to do in this database */
+			LWLockRelease(AutovacuumLock);
+			LWLockRelease(AutovacuumScheduleLock);
+			break;
+		}
 
 		/*
 		 * Check whether the table is being vacuumed concurrently by another
@@ -2239,6 +2320,8 @@ do_autovacuum(void)
 				break;
 			}
 		}
+		if (skipit)
+			autovac_queue_release();
 		LWLockRelease(AutovacuumLock);
 		if (skipit)
 		{
@@ -2262,6 +2345,9 @@ do_autovacuum(void)
 		if (tab == NULL)
 		{
 			/* someone else vacuumed the table, or it went away */
+			LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+			autovac_queue_release();
+			LWLockRelease(AutovacuumLock);
 			LWLockRelease(AutovacuumScheduleLock);
 			continue;
 		}
@@ -2386,6 +2472,7 @@ deleted:
 		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
 		MyWorkerInfo->wi_tableoid = InvalidOid;
 		MyWorkerInfo->wi_sharedrel = false;
+		autovac_queue_release();
 		LWLockRelease(AutovacuumLock);
 
 		/* restore vacuum cost GUCs for the next iteration */
@@ -2393,6 +2480,37 @@ deleted:
 		VacuumCostLimit = stdVacuumCostLimit;
 	}
 
+	/*
+	 * Perform additional work items, as requested by backends.
+	 */
+	LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+	for (i = 0; i < NUM_WORKITEMS; i++)
+	{
+		AutoVacuumWorkItem *workitem = &AutoVacuumShmem->av_workItems[i];
+
+		if (!workitem->avw_used)
+			continue;
+		if (workitem->avw_active)
+			continue;
+		if (workitem->avw_database != MyDatabaseId)
+			continue;
+
+		/* claim this one, and release lock while performing it */
+		workitem->avw_active = true;
+		LWLockRelease(AutovacuumLock);
+
+		perform_work_item(workitem);
+
+		CHECK_FOR_INTERRUPTS();
+
+		LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+
+		/* and mark it done */
+		workitem->avw_active = false;
+		workitem->avw_used = false;
+	}
+	LWLockRelease(AutovacuumLock);
+
 	/*
 	 * We leak table_toast_map here (among other things), but since we're
 	 * going away soon, it's not a problem.
@@ -2425,6 +2543,264 @@ deleted:
 	CommitTransactionCommand();
 }
 
+/* qsort comparator for av_candidate, by descending priority */
+static int
+av_candidate_comparator(const void *a, const void *b)
+{
+	double		pa = ((const av_candidate *) a)->ac_priority;
+	double		pb = ((const av_candidate *) b)->ac_priority;
+
+	if (pa > pb)
+		return -1;
+	if (pa < pb)
+		return 1;
+	return 0;
+}
+
+/*
+ * autovac_queue_next
+ *		Claim the most urgent table of our database in the shared queue.
+ *
+ * The queue holds, for every database being processed, the most urgent of
+ * the tables its workers found to need work, and all the workers of a
+ * database take their tables from it.  This way, a worker that starts while
+ * another one is busy in the same database helps with the most urgent tables
+ * first, instead of walking its own list.  When no entry of our database is
+ * left, the queue is refilled from the next candidates in cands, which is
+ * sorted by descending priority; *next is the first one not queued yet.
+ *
+ * Each database gets a share of the queue, so that one with many tables
+ * doesn't lock out the others; entries of databases no worker is processing
+ * anymore are dropped.  If the queue is full anyway, the next candidate is
+ * returned without queuing it.
+ *
+ * Returns InvalidOid when there is nothing left to do.  Caller must hold
+ * AutovacuumLock exclusively, and must call autovac_queue_release once done
+ * with the table.
+ */
+static Oid
+autovac_queue_next(av_candidate *cands, int ncands, int *next)
+{
+	AutoVacuumQueueEntry *queue = AutoVacuumShmem->av_queue;
+	int			best = -1;
+	int			i;
+
+	for (i = 0; i < AutoVacuumShmem->av_queueLen; i++)
+	{
+		if (queue[i].datid != MyDatabaseId || queue[i].pid != 0)
+			continue;
+		if (best < 0 || queue[i].priority > queue[best].priority)
+			best = i;
+	}
+
+	if (best < 0 && *next < ncands)
+	{
+		int			share = Max(AUTOVACUUM_QUEUE_SIZE / autovacuum_max_workers, 1);
+		int			nqueued = 0;
+
+		/* forget the waiting entries of databases no worker is in */
+		i = 0;
+		while (i < AutoVacuumShmem->av_queueLen)
+		{
+			bool		active = (queue[i].pid != 0);
+			dlist_iter	iter;
+
+			dlist_foreach(iter, &AutoVacuumShmem->av_runningWorkers)
+			{
+				WorkerInfo	worker = dlist_container(WorkerInfoData, wi_links, iter.cur);
+
+				if (worker->wi_dboid == queue[i].datid)
+					active = true;
+			}
+
+			if (active)
+				i++;
+			else
+				queue[i] = queue[--AutoVacuumShmem->av_queueLen];
+		}
+
+		while (*next < ncands && nqueued < share &&
+			   AutoVacuumShmem->av_queueLen < AUTOVACUUM_QUEUE_SIZE)
+		{
+			av_candidate *cand = &cands[(*next)++];
+			AutoVacuumQueueEntry *entry;
+
+			/* skip tables already in the queue */
+			for (i = 0; i < AutoVacuumShmem->av_queueLen; i++)
+			{
+				if (queue[i].datid == MyDatabaseId &&
+					queue[i].relid == cand->ac_relid)
+					break;
+			}
+			if (i < AutoVacuumShmem->av_queueLen)
+				continue;
+
+			entry = &queue[AutoVacuumShmem->av_queueLen++];
+			entry->datid = MyDatabaseId;
+			entry->relid = cand->ac_relid;
+			entry->priority = cand->ac_priority;
+			entry->wraparound = cand->ac_wraparound;
+			entry->pid = 0;
+			if (best < 0)
+				best = AutoVacuumShmem->av_queueLen - 1;
+			nqueued++;
+		}
+
+		/* no room in the queue; just take the next candidate */
+		if (best < 0 && *next < ncands)
+			return cands[(*next)++].ac_relid;
+	}
+
+	if (best < 0)
+		return InvalidOid;
+
+	queue[best].pid = MyProcPid;
+	return queue[best].relid;
+}
+
+/*
+ * autovac_queue_release
+ *		Remove the queue entry we claimed, if any.
+ *
+ * Caller must hold AutovacuumLock exclusively.
+ */
+static void
+autovac_queue_release(void)
+{
+	AutoVacuumQueueEntry *queue = AutoVacuumShmem->av_queue;
+	int			i;
+
+	for (i = 0; i < AutoVacuumShmem->av_queueLen; i++)
+	{
+		if (queue[i].pid == MyProcPid)
+		{
+			queue[i] = queue[--AutoVacuumShmem->av_queueLen];
+			break;
+		}
+	}
+}
+
+/*
+ * AutoVacuumGetQueue
+ *		Copy the entries of the autovacuum queue into the given array, which
+ *		must have room for AUTOVACUUM_QUEUE_SIZE entries.
+ *
+ * Returns the number of entries.
+ */
+int
+AutoVacuumGetQueue(AutoVacuumQueueEntry *entries)
+{
+	int			n;
+
+	LWLockAcquire(AutovacuumLock, LW_SHARED);
+	n = AutoVacuumShmem->av_queueLen;
+	memcpy(entries, AutoVacuumShmem->av_queue,
+		   n * sizeof(AutoVacuumQueueEntry));
+	LWLockRelease(AutovacuumLock);
+
+	return n;
+}
+
+/*
+ * Execute a previously registered work item.
+ */
+static void
+perform_work_item(AutoVacuumWorkItem *workitem)
+{
+	char	   *cur_datname = NULL;
+	char	   *cur_nspname = NULL;
+	char	   *cur_relname = NULL;
+
+	/*
+	 * Note we do not store table info in MyWorkerInfo, since this is not
+	 * vacuuming proper.
+	 */
+
+	/* clean up memory before each work item */
+	MemoryContextResetAndDeleteChildren(PortalContext);
+
+	/*
+	 * Save the relation name for a possible error message, to avoid a catalog
+	 * lookup in case of an error.  If any of these return NULL, then the
+	 * relation has been dropped since last we checked; skip it.
+	 */
+	MemoryContextSwitchTo(AutovacMemCxt);
+	cur_relname = get_rel_name(workitem->avw_relation);
+	cur_nspname = get_namespace_name(get_rel_namespace(workitem->avw_relation));
+	cur_datname = get_database_name(MyDatabaseId);
+	if (!cur_relname || !cur_nspname || !cur_datname)
+		goto deleted;
+
+	/*
+	 * We will abort the current work item if something errors out, and
+	 * continue with the next one; in particular, this happens if we are
+	 * interrupted with SIGINT.
+	 */
+	PG_TRY();
+	{
+		/* have at it */
+		MemoryContextSwitchTo(TopTransactionContext);
+		PushActiveSnapshot(GetTransactionSnapshot());
+
+		switch (workitem->avw_type)
+		{
+			case AVW_BRINSummarizeRange:
+				/* this also picks up any other unsummarized ranges */
+				DirectFunctionCall1(brin_summarize_new_values,
+									ObjectIdGetDatum(workitem->avw_relation));
+				break;
+			case AVW_GINCleanPendingList:
+				DirectFunctionCall1(gin_clean_pending_list,
+									ObjectIdGetDatum(workitem->avw_relation));
+				break;
+			default:
+				elog(WARNING, "unrecognized work item found: type %d",
+					 workitem->avw_type);
+				break;
+		}
+
+		PopActiveSnapshot();
+
+		/*
+		 * Clear a possible query-cancel signal, to avoid a late reaction to
+		 * an automatically-sent signal because of vacuuming the current table
+		 * (we're done with it, so it would make no sense to cancel at this
+		 * point.)
+		 */
+		QueryCancelPending = false;
+	}
+	PG_CATCH();
+	{
+		/*
+		 * Abort the transaction, start a new one, and proceed with the next
+		 * work item in our list.
+		 */
+		HOLD_INTERRUPTS();
+		errcontext("processing work entry for relation \"%s.%s.%s\"",
+				   cur_datname, cur_nspname, cur_relname);
+		EmitErrorReport();
+
+		/* this resets the PGXACT flags too */
+		AbortOutOfAnyTransaction();
+		FlushErrorState();
+		MemoryContextResetAndDeleteChildren(PortalContext);
+
+		/* restart our transaction for the following operations */
+		StartTransactionCommand();
+		RESUME_INTERRUPTS();
+	}
+	PG_END_TRY();
+
+	/* be tidy */
+deleted:
+	if (cur_datname)
+		pfree(cur_datname);
+	if (cur_nspname)
+		pfree(cur_nspname);
+	if (cur_relname)
+		pfree(cur_relname);
+}
+
 /*
  * extract_autovac_opts
  *
@@ -2458,22 +2834,10 @@ extract_autovac_opts(HeapTuple tup, TupleDesc pg_class_desc)
  * Fetch the pgstat entry of a table, either local to a database or shared.
  */
 static PgStat_StatTabEntry *
-get_pgstat_tabentry_relid(Oid relid, bool isshared, PgStat_StatDBEntry *shared,
-						  PgStat_StatDBEntry *dbentry)
+get_pgstat_tabentry_relid(Oid relid, bool isshared)
 {
-	PgStat_StatTabEntry *tabentry = NULL;
-
-	if (isshared)
-	{
-		if (PointerIsValid(shared))
-			tabentry = hash_search(shared->tables, &relid,
-								   HASH_FIND, NULL);
-	}
-	else if (PointerIsValid(dbentry))
-		tabentry = hash_search(dbentry->tables, &relid,
-							   HASH_FIND, NULL);
-
-	return tabentry;
+	return pgstat_fetch_stat_tabentry_db(isshared ? InvalidOid : MyDatabaseId,
+										 relid);
 }
 
 /*
@@ -2495,17 +2859,13 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 	bool		doanalyze;
 	autovac_table *tab = NULL;
 	PgStat_StatTabEntry *tabentry;
-	PgStat_StatDBEntry *shared;
-	PgStat_StatDBEntry *dbentry;
 	bool		wraparound;
+	double		priority;
 	AutoVacOpts *avopts;
 
 	/* use fresh stats */
 	autovac_refresh_stats();
 
-	shared = pgstat_fetch_stat_dbentry(InvalidOid);
-	dbentry = pgstat_fetch_stat_dbentry(MyDatabaseId);
-
 	/* fetch the relation's relcache entry */
 	classTup = SearchSysCacheCopy1(RELOID, ObjectIdGetDatum(relid));
 	if (!HeapTupleIsValid(classTup))
@@ -2529,12 +2889,11 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
 	}
 
 	/* fetch the pgstat table entry */
-	tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared,
-										 shared, dbentry);
+	tabentry = get_pgstat_tabentry_relid(relid, classForm->relisshared);
 
 	relation_needs_vacanalyze(relid, avopts, classForm, tabentry,
 							  effective_multixact_freeze_max_age,
-							  &dovacuum, &doanalyze, &wraparound);
+							  &dovacuum, &doanalyze, &wraparound, &priority);
 
 	/* ignore ANALYZE for toast tables */
 	if (classForm->relkind == RELKIND_TOASTVALUE)
@@ -2665,6 +3024,14 @@ table_recheck_autovac(Oid relid, HTAB *table_toast_map,
  * autovacuum_vacuum_threshold GUC variable.  Similarly, a vac_scale_factor
  * value < 0 is substituted with the value of
  * autovacuum_vacuum_scale_factor GUC variable.  Ditto for analyze.
+ *
+ * *priority is set to rank the tables that need work; higher is more
+ * urgent.  Tables at risk of wraparound come first, oldest first.  The
+ * others are ranked by how far they are past their vacuum or analyze
+ * threshold, weighted by their fraction of dead tuples and by the rate at
+ * which dead tuples accumulated since the table was last vacuumed.  So a
+ * small, busy table far past its threshold goes before a large table that
+ * barely crossed it.
  */
 static void
 relation_needs_vacanalyze(Oid relid,
@@ -2675,7 +3042,8 @@ relation_needs_vacanalyze(Oid relid,
  /* output params below */
 						  bool *dovacuum,
 						  bool *doanalyze,
-						  bool *wraparound)
+						  bool *wraparound,
+						  double *priority)
 {
 	bool		force_vacuum;
 	bool		av_enabled;
@@ -2704,6 +3072,8 @@ relation_needs_vacanalyze(Oid relid,
 	AssertArg(classForm != NULL);
 	AssertArg(OidIsValid(relid));
 
+	*priority = 0;
+
 	/*
 	 * Determine vacuum/analyze equation parameters.  We have two possible
 	 * sources: the passed reloptions (which could be a main table or a toast
@@ -2754,6 +3124,18 @@ relation_needs_vacanalyze(Oid relid,
 	}
 	*wraparound = force_vacuum;
 
+	if (force_vacuum)
+	{
+		double		xid_age = 0;
+		double		multi_age = 0;
+
+		if (TransactionIdIsNormal(classForm->relfrozenxid))
+			xid_age = (double) (int32) (recentXid - classForm->relfrozenxid);
+		if (MultiXactIdIsValid(classForm->relminmxid))
+			multi_age = (double) (int32) (recentMulti - classForm->relminmxid);
+		*priority = AV_WRAPAROUND_PRIORITY + Max(xid_age, multi_age);
+	}
+
 	/* User disabled it in pg_class.reloptions?  (But ignore if at risk) */
 	if (!av_enabled && !force_vacuum)
 	{
@@ -2790,6 +3172,36 @@ relation_needs_vacanalyze(Oid relid,
 		/* Determine if this table needs vacuum or analyze. */
 		*dovacuum = force_vacuum || (vactuples > vacthresh);
 		*doanalyze = (anltuples > anlthresh);
+
+		if (!force_vacuum && (*dovacuum || *doanalyze))
+		{
+			double		overshoot;
+			double		dead_fraction;
+			double		dead_rate = 0;
+			TimestampTz last_vacuum;
+
+			overshoot = Max(vactuples / Max(vacthresh, 1.0),
+							anltuples / Max(anlthresh, 1.0));
+			dead_fraction = vactuples / (reltuples + vactuples + 1.0);
+
+			/* dead tuples per second since the last vacuum */
+			last_vacuum = Max(tabentry->vacuum_timestamp,
+							  tabentry->autovac_vacuum_timestamp);
+			if (last_vacuum != 0)
+			{
+				long		secs;
+				int			usecs;
+
+				TimestampDifference(last_vacuum,
+									GetCurrentTransactionStartTimestamp(),
+									&secs, &usecs);
+				if (secs > 0)
+					dead_rate = vactuples / secs;
+			}
+
+			*priority = overshoot * (1.0 + dead_fraction) *
+				(1.0 + log10(1.0 + dead_rate));
+		}
 	}
 	else
 	{
@@ -2937,6 +3349,66 @@ AutoVacuumShmemSize(void)
 	return size;
 }
 
+/*
+ * AutoVacuumRequestWork
+ *		Request a work item to the next autovacuum run processing our database.
+ *
+ * Returns false if the request could not be recorded because the work item
+ * array is full.  A request that duplicates one still waiting to be processed
+ * is not recorded again, but counts as success.
+ */
+bool
+AutoVacuumRequestWork(AutoVacuumWorkItemType type, Oid relationId,
+					  BlockNumber blkno)
+{
+	int			i;
+	bool		result = false;
+
+	LWLockAcquire(AutovacuumLock, LW_EXCLUSIVE);
+
+	/* Is the same request already queued? */
+	for (i = 0; i < NUM_WORKITEMS; i++)
+	{
+		AutoVacuumWorkItem *workitem = &AutoVacuumShmem->av_workItems[i];
+
+		if (workitem->avw_used && !workitem->avw_active &&
+			workitem->avw_type == type &&
+			workitem->avw_database == MyDatabaseId &&
+			workitem->avw_relation == relationId &&
+			workitem->avw_blockNumber == blkno)
+		{
+			LWLockRelease(AutovacuumLock);
+			return true;
+		}
+	}
+
+	/*
+	 * Locate an unused work item and fill it with the given data.
+	 */
+	for (i = 0; i < NUM_WORKITEMS; i++)
+	{
+		AutoVacuumWorkItem *workitem = &AutoVacuumShmem->av_workItems[i];
+
+		if (workitem->avw_used)
+			continue;
+
+		workitem->avw_used = true;
+		workitem->avw_active = false;
+		workitem->avw_type = type;
+		workitem->avw_database = MyDatabaseId;
+		workitem->avw_relation = relationId;
+		workitem->avw_blockNumber = blkno;
+		result = true;
+
+		/* done */
+		break;
+	}
+
+	LWLockRelease(AutovacuumLock);
+
+	return result;
+}
+
 /*
  * AutoVacuumShmemInit
  *		Allocate and initialize autovacuum-related shared memory
@@ -2962,6 +3434,7 @@ AutoVacuumShmemInit(void)
 		dlist_init(&AutoVacuumShmem->av_freeWorkers);
 		dlist_init(&AutoVacuumShmem->av_runningWorkers);
 		AutoVacuumShmem->av_startingWorker = NULL;
+		AutoVacuumShmem->av_queueLen = 0;
 
 		worker = (WorkerInfo) ((char *) AutoVacuumShmem +
 							   MAXALIGN(sizeof(AutoVacuumShmemStruct)));
@@ -165,6 +165,9 @@ BackgroundWriterMain(void)
 
 	WritebackContextInit(&wb_context, &bgwriter_flush_after);
 
+	/* Our writes count against the per-tablespace write budgets */
+	tablespace_io_throttle = true;
+
 	/*
 	 * If an exception is encountered, processing resumes here.
 	 *
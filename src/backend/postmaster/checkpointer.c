@@ -99,10 +99,15 @@
  * because the checkpointer failed to absorb their request.
  *
  * The requests array holds fsync requests sent by backends and not yet
- * absorbed by the checkpointer.
+ * absorbed by the checkpointer.  CheckpointerRequestHash holds the set of
+ * distinct requests in the array, so that a backend asking again for the
+ * fsync of a segment it (or another backend) already queued doesn't use
+ * another slot.  Most writes are to segments already queued, so the array
+ * fills up only when more distinct segments are dirtied between two
+ * absorptions than there are slots.
  *
- * Unlike the checkpoint fields, num_backend_writes, num_backend_fsync, and
- * the requests fields are protected by CheckpointerCommLock.
+ * Unlike the checkpoint fields, num_backend_writes, num_backend_fsync, the
+ * requests fields and the hash table are protected by CheckpointerCommLock.
  *----------
  */
 typedef struct
@@ -135,6 +140,25 @@ typedef struct
 
 static CheckpointerShmemStruct *CheckpointerShmem;
 
+static HTAB *CheckpointerRequestHash;
+
+/*
+ * md.c uses segment numbers beyond those of any real segment to ask for
+ * forgetting the fsync requests of a relation or a database, or for
+ * unlinking a relation.  A request to forget cancels the requests queued
+ * before it, so a later request can't be absorbed into one of those.
+ */
+#define IsSpecialFsyncRequest(segno) ((segno) > MaxBlockNumber / RELSEG_SIZE)
+
+/*
+ * How many times, and for how long each time, a backend waits for the
+ * checkpointer to make room in a full request queue, before doing its own
+ * fsync.  The backend may hold a buffer the checkpointer is waiting for,
+ * so it can't wait indefinitely.
+ */
+#define FSYNC_FORWARD_RETRIES	10
+#define FSYNC_FORWARD_WAIT_USEC	1000L
+
 /* interval for calling AbsorbFsyncRequests in CheckpointWriteDelay */
 #define WRITES_PER_ABSORB		1000
 
@@ -171,6 +195,7 @@ static void CheckArchiveTimeout(void);
 static bool IsCheckpointOnSchedule(double progress);
 static bool ImmediateCheckpointRequested(void);
 static bool CompactCheckpointerRequestQueue(void);
+static void ResetCheckpointerRequestHash(void);
 static void UpdateSharedMemoryConfig(void);
 
 /* Signal handlers */
@@ -283,6 +308,8 @@ CheckpointerMain(void)
 		AtEOXact_SMgr();
 		AtEOXact_Files();
 		AtEOXact_HashTables(false);
+		/* BufferSync may have been interrupted while throttled */
+		tablespace_io_throttle = false;
 
 		/* Warn any waiting backends that the checkpoint failed. */
 		if (ckpt_active)
@@ -898,6 +925,8 @@ CheckpointerShmemSize(void)
 	 */
 	size = offsetof(CheckpointerShmemStruct, requests);
 	size = add_size(size, mul_size(NBuffers, sizeof(CheckpointerRequest)));
+	size = add_size(size, hash_estimate_size(NBuffers,
+											 sizeof(CheckpointerRequest)));
 
 	return size;
 }
@@ -909,14 +938,26 @@ CheckpointerShmemSize(void)
 void
 CheckpointerShmemInit(void)
 {
-	Size		size = CheckpointerShmemSize();
+	Size		size;
 	bool		found;
+	HASHCTL		info;
+
+	size = offsetof(CheckpointerShmemStruct, requests);
+	size = add_size(size, mul_size(NBuffers, sizeof(CheckpointerRequest)));
 
 	CheckpointerShmem = (CheckpointerShmemStruct *)
 		ShmemInitStruct("Checkpointer Data",
 						size,
 						&found);
 
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(CheckpointerRequest);
+	info.entrysize = sizeof(CheckpointerRequest);
+	CheckpointerRequestHash = ShmemInitHash("Checkpointer Request Hash",
+											NBuffers, NBuffers,
+											&info,
+											HASH_ELEM | HASH_BLOBS);
+
 	if (!found)
 	{
 		/*
@@ -1093,21 +1134,23 @@ RequestCheckpoint(int flags)
  * use high values for special flags; that's all internal to md.c, which
  * see for details.)
  *
- * To avoid holding the lock for longer than necessary, we normally write
- * to the requests[] queue without checking for duplicates.  The checkpointer
- * will have to eliminate dups internally anyway.  However, if we discover
- * that the queue is full, we make a pass over the entire queue to compact
- * it.  This is somewhat expensive, but the alternative is for the backend
- * to perform its own fsync, which is far more expensive in practice.  It
- * is theoretically possible a backend fsync might still be necessary, if
- * the queue is full and contains no duplicate entries.  In that case, we
- * let the backend know by returning false.
+ * A request identical to one already in the requests[] queue is absorbed
+ * by it, found by a lookup in CheckpointerRequestHash.  If the queue is full
+ * nonetheless, we make a pass over the entire queue to compact it, which can
+ * still remove the duplicates queued on both sides of a request to forget.
+ * If that doesn't help, we wake the checkpointer and wait a little for it to
+ * absorb the queue, since the alternative is for the backend to perform its
+ * own fsync, which is far more expensive in practice.  Only if the queue is
+ * still full after that, or if the checkpointer isn't running, do we let the
+ * backend know by returning false.
  */
 bool
 ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 {
+	CheckpointerRequest key;
 	CheckpointerRequest *request;
 	bool		too_full;
+	int			retries = 0;
 
 	if (!IsUnderPostmaster)
 		return false;			/* probably shouldn't even get here */
@@ -1115,20 +1158,54 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 	if (AmCheckpointerProcess())
 		elog(ERROR, "ForwardFsyncRequest must not be called in checkpointer");
 
+	/* the request is used as a hash key, so zero any padding */
+	MemSet(&key, 0, sizeof(key));
+	key.rnode = rnode;
+	key.forknum = forknum;
+	key.segno = segno;
+
 	LWLockAcquire(CheckpointerCommLock, LW_EXCLUSIVE);
 
 	/* Count all backend writes regardless of if they fit in the queue */
 	if (!AmBackgroundWriterProcess())
 		CheckpointerShmem->num_backend_writes++;
 
-	/*
-	 * If the checkpointer isn't running or the request queue is full, the
-	 * backend will have to perform its own fsync request.  But before forcing
-	 * that to happen, we can try to compact the request queue.
-	 */
+	for (;;)
+	{
+		/*
+		 * If the checkpointer isn't running, the backend will have to perform
+		 * its own fsync request.
+		 */
+		if (CheckpointerShmem->checkpointer_pid == 0)
+			break;
+
+		/* Nothing to do if the same request is queued already */
+		if (!IsSpecialFsyncRequest(segno) &&
+			hash_search(CheckpointerRequestHash, &key, HASH_FIND, NULL) != NULL)
+		{
+			LWLockRelease(CheckpointerCommLock);
+			return true;
+		}
+
+		/*
+		 * Before making the backend fsync, try to compact the request queue,
+		 * then give the checkpointer a chance to absorb it.
+		 */
+		if (CheckpointerShmem->num_requests < CheckpointerShmem->max_requests ||
+			CompactCheckpointerRequestQueue())
+			break;
+		if (retries++ >= FSYNC_FORWARD_RETRIES)
+			break;
+
+		LWLockRelease(CheckpointerCommLock);
+		if (ProcGlobal->checkpointerLatch)
+			SetLatch(ProcGlobal->checkpointerLatch);
+		pg_usleep(FSYNC_FORWARD_WAIT_USEC);
+		LWLockAcquire(CheckpointerCommLock, LW_EXCLUSIVE);
+	}
+
 	if (CheckpointerShmem->checkpointer_pid == 0 ||
-		(CheckpointerShmem->num_requests >= CheckpointerShmem->max_requests &&
-		 !CompactCheckpointerRequestQueue()))
+		CheckpointerShmem->num_requests >= CheckpointerShmem->max_requests)
 	{
 		/*
 		 * Count the subset of writes where backends have to do their own
@@ -1142,9 +1219,16 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 
 	/* OK, insert request */
 	request = &CheckpointerShmem->requests[CheckpointerShmem->num_requests++];
-	request->rnode = rnode;
-	request->forknum = forknum;
-	request->segno = segno;
+	*request = key;
+
+	/*
+	 * Requests queued before a request to forget can't absorb later ones, so
+	 * start over with an empty set after one.
+	 */
+	if (IsSpecialFsyncRequest(segno))
+		ResetCheckpointerRequestHash();
+	else
+		hash_search(CheckpointerRequestHash, &key, HASH_ENTER, NULL);
 
 	/* If queue is more than half full, nudge the checkpointer to empty it */
 	too_full = (CheckpointerShmem->num_requests >=
@@ -1159,6 +1243,33 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
 	return true;
 }
 
+/*
+ * ResetCheckpointerRequestHash
+ *		Empty the set of queued requests.
+ *
+ * The entries are removed by looking up the requests in the queue, rather
+ * than by scanning the hash table, which is sized for the largest possible
+ * queue.  Must hold CheckpointerCommLock in exclusive mode, and be called
+ * before the queue is emptied.
+ */
+static void
+ResetCheckpointerRequestHash(void)
+{
+	int			n;
+
+	if (hash_get_num_entries(CheckpointerRequestHash) == 0)
+		return;
+
+	for (n = 0; n < CheckpointerShmem->num_requests; n++)
+	{
+		CheckpointerRequest *request = &CheckpointerShmem->requests[n];
+
+		if (!IsSpecialFsyncRequest(request->segno))
+			hash_search(CheckpointerRequestHash, request, HASH_REMOVE, NULL);
+	}
+	Assert(hash_get_num_entries(CheckpointerRequestHash) == 0);
+}
+
 /*
  * CompactCheckpointerRequestQueue
  *		Remove duplicates from the request queue to avoid backend fsyncs.
@@ -1171,9 +1282,11 @@ ForwardFsyncRequest(RelFileNode rnode, ForkNumber forknum, BlockNumber segno)
  * logic, each backend begins doing an fsync for every block written, which
  * gets very expensive and can slow down the whole system.
  *
- * Trying to do this every time the queue is full could lose if there
- * aren't any removable entries.  But that should be vanishingly rare in
- * practice: there's one queue entry per shared buffer.
+ * Since ForwardFsyncRequest doesn't queue a request identical to one
+ * queued since the last request to forget, the only duplicates left are
+ * those on both sides of such requests.  Removing the earlier occurrence
+ * leaves the later one in the queue, so CheckpointerRequestHash, which only
+ * tells what is in the queue, is still right.
  */
 static bool
 CompactCheckpointerRequestQueue(void)
@@ -1321,6 +1434,7 @@ AbsorbFsyncRequests(void)
 
 	START_CRIT_SECTION();
 
+	ResetCheckpointerRequestHash();
 	CheckpointerShmem->num_requests = 0;
 
 	LWLockRelease(CheckpointerCommLock);
@@ -58,6 +58,7 @@
 #include "storage/lmgr.h"
 #include "storage/pg_shmem.h"
 #include "storage/procsignal.h"
+#include "storage/shmem.h"
 #include "storage/sinvaladt.h"
 #include "utils/ascii.h"
 #include "utils/guc.h"
@@ -104,6 +105,13 @@
 #define PGSTAT_TAB_HASH_SIZE	512
 #define PGSTAT_FUNCTION_HASH_SIZE	512
 
+/* Number of partitions of the shared table statistics hash */
+#define NUM_TABSTAT_PARTITIONS	16
+
+/* Where the shared table statistics are kept across a clean restart */
+#define PGSTAT_TABLES_FILENAME	PGSTAT_STAT_PERMANENT_DIRECTORY "/tables.stat"
+#define PGSTAT_TABLES_TMPFILE	PGSTAT_STAT_PERMANENT_DIRECTORY "/tables.tmp"
+
 
 /* ----------
  * GUC parameters
@@ -113,6 +121,7 @@ bool		pgstat_track_activities = false;
 bool		pgstat_track_counts = false;
 int			pgstat_track_functions = TRACK_FUNC_OFF;
 int			pgstat_track_activity_query_size = 1024;
+int			pgstat_max_tables = 10000;
 
 /* ----------
  * Built from GUC parameter
@@ -195,6 +204,7 @@ static int	pgStatXactCommit = 0;
 static int	pgStatXactRollback = 0;
 PgStat_Counter pgStatBlockReadTime = 0;
 PgStat_Counter pgStatBlockWriteTime = 0;
+PgStat_Counter pgStatFastPathOverflows = 0;
 
 /* Record that's written to 2PC state file when pgstat state is persisted */
 typedef struct TwoPhasePgStatRecord
@@ -210,11 +220,55 @@ typedef struct TwoPhasePgStatRecord
 	bool		t_truncated;	/* was the relation truncated? */
 } TwoPhasePgStatRecord;
 
+/*
+ * Shared table statistics.  Backends add their per-table counts to this
+ * hash table directly instead of sending them to the collector, so that
+ * looking at the statistics of a few tables doesn't require the collector
+ * to write, and the backend to read, the statistics of every table in the
+ * database.  The hash table is partitioned, and each partition is protected
+ * by its own LWLock.
+ */
+typedef struct PgStat_TableStatKey
+{
+	Oid			databaseid;		/* InvalidOid for shared relations */
+	Oid			tableid;
+} PgStat_TableStatKey;
+
+typedef struct PgStat_SharedTabEntry
+{
+	PgStat_TableStatKey key;	/* hash key; must be first */
+	PgStat_StatTabEntry stats;
+} PgStat_SharedTabEntry;
+
+typedef struct PgStat_TableStatsShared
+{
+	LWLockPadded locks[NUM_TABSTAT_PARTITIONS];
+} PgStat_TableStatsShared;
+
+static PgStat_TableStatsShared *TableStatsShared = NULL;
+static HTAB *TableStatsHash = NULL;
+static LWLockTranche TableStatsLWLockTranche;
+
+/* Have we complained about the shared hash being full? */
+static bool table_stats_full_reported = false;
+
+/*
+ * Backend-local copy of a shared table entry, taken on first access so that
+ * repeated lookups in one transaction return the same values.
+ */
+typedef struct PgStat_TabSnapshotEntry
+{
+	PgStat_TableStatKey key;	/* hash key; must be first */
+	bool		found;			/* does the table have shared statistics? */
+	PgStat_StatTabEntry stats;
+} PgStat_TabSnapshotEntry;
+
 /*
  * Info about current "snapshot" of stats file
  */
 static MemoryContext pgStatLocalContext = NULL;
 static HTAB *pgStatDBHash = NULL;
+static HTAB *pgStatTabSnapshot = NULL;
 static LocalPgBackendStatus *localBackendStatusTable = NULL;
 static int	localNumBackends = 0;
 
@@ -259,12 +313,16 @@ static void pgstat_beshutdown_hook(int code, Datum arg);
 static void pgstat_sighup_handler(SIGNAL_ARGS);
 
 static PgStat_StatDBEntry *pgstat_get_db_entry(Oid databaseid, bool create);
-static PgStat_StatTabEntry *pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry,
-					 Oid tableoid, bool create);
+static LWLock *pgstat_table_partition_lock(PgStat_TableStatKey *key,
+							uint32 *hashcode);
+static PgStat_StatTabEntry *pgstat_get_shared_tabentry(PgStat_TableStatKey *key,
+						   uint32 hashcode, bool create);
+static void pgstat_flush_tabentry(Oid databaseid, PgStat_TableStatus *entry);
+static void pgstat_remove_table_stats(Oid databaseid, HTAB *keep_oids);
 static void pgstat_write_statsfiles(bool permanent, bool allDbs);
 static void pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent);
 static HTAB *pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep);
-static void pgstat_read_db_statsfile(Oid databaseid, HTAB *tabhash, HTAB *funchash, bool permanent);
+static void pgstat_read_db_statsfile(Oid databaseid, HTAB *funchash, bool permanent);
 static void backend_read_statsfile(void);
 static void pgstat_read_current_status(void);
 
@@ -284,14 +342,11 @@ static void pgstat_send(void *msg, int len);
 
 static void pgstat_recv_inquiry(PgStat_MsgInquiry *msg, int len);
 static void pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len);
-static void pgstat_recv_tabpurge(PgStat_MsgTabpurge *msg, int len);
 static void pgstat_recv_dropdb(PgStat_MsgDropdb *msg, int len);
 static void pgstat_recv_resetcounter(PgStat_MsgResetcounter *msg, int len);
 static void pgstat_recv_resetsharedcounter(PgStat_MsgResetsharedcounter *msg, int len);
 static void pgstat_recv_resetsinglecounter(PgStat_MsgResetsinglecounter *msg, int len);
 static void pgstat_recv_autovac(PgStat_MsgAutovacStart *msg, int len);
-static void pgstat_recv_vacuum(PgStat_MsgVacuum *msg, int len);
-static void pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len);
 static void pgstat_recv_archiver(PgStat_MsgArchiver *msg, int len);
 static void pgstat_recv_bgwriter(PgStat_MsgBgWriter *msg, int len);
 static void pgstat_recv_funcstat(PgStat_MsgFuncstat *msg, int len);
@@ -615,6 +670,8 @@ pgstat_reset_remove_files(const char *directory)
 		 */
 		if (strncmp(entry->d_name, "global.", 7) == 0)
 			nchars = 7;
+		else if (strncmp(entry->d_name, "tables.", 7) == 0)
+			nchars = 7;
 		else
 		{
 			nchars = 0;
@@ -764,8 +821,9 @@ allow_immediate_pgstat_restart(void)
 /* ----------
  * pgstat_report_stat() -
  *
- *	Called from tcop/postgres.c to send the so far collected per-table
- *	and function usage statistics to the collector.  Note that this is
+ *	Called from tcop/postgres.c to flush the so far collected per-table
+ *	statistics to shared memory and to send the database-wide totals and
+ *	the function usage statistics to the collector.  Note that this is
  *	called only when not within a transaction, so it is fair to use
  *	transaction stop time as an approximation of current time.
  * ----------
@@ -780,6 +838,8 @@ pgstat_report_stat(bool force)
 	TimestampTz now;
 	PgStat_MsgTabstat regular_msg;
 	PgStat_MsgTabstat shared_msg;
+	bool		have_regular;
+	bool		have_shared;
 	TabStatusArray *tsa;
 	int			i;
 
@@ -801,14 +861,16 @@ pgstat_report_stat(bool force)
 
 	/*
 	 * Scan through the TabStatusArray struct(s) to find tables that actually
-	 * have counts, and build messages to send.  We have to separate shared
-	 * relations from regular ones because the databaseid field in the message
-	 * header has to depend on that.
+	 * have counts, add them to the shared table statistics, and sum them up
+	 * for the database-wide counters.  We have to separate shared relations
+	 * from regular ones because they are kept under a different database ID.
 	 */
+	MemSet(&regular_msg, 0, sizeof(regular_msg));
+	MemSet(&shared_msg, 0, sizeof(shared_msg));
 	regular_msg.m_databaseid = MyDatabaseId;
 	shared_msg.m_databaseid = InvalidOid;
-	regular_msg.m_nentries = 0;
-	shared_msg.m_nentries = 0;
+	have_regular = false;
+	have_shared = false;
 
 	for (tsa = pgStatTabList; tsa != NULL; tsa = tsa->tsa_next)
 	{
@@ -816,7 +878,6 @@ pgstat_report_stat(bool force)
 		{
 			PgStat_TableStatus *entry = &tsa->tsa_entries[i];
 			PgStat_MsgTabstat *this_msg;
-			PgStat_TableEntry *this_ent;
 
 			/* Shouldn't have any pending transaction-dependent counts */
 			Assert(entry->trans == NULL);
@@ -829,19 +890,28 @@ pgstat_report_stat(bool force)
 					   sizeof(PgStat_TableCounts)) == 0)
 				continue;
 
-			/*
-			 * OK, insert data into the appropriate message, and send if full.
-			 */
-			this_msg = entry->t_shared ? &shared_msg : &regular_msg;
-			this_ent = &this_msg->m_entry[this_msg->m_nentries];
-			this_ent->t_id = entry->t_id;
-			memcpy(&this_ent->t_counts, &entry->t_counts,
-				   sizeof(PgStat_TableCounts));
-			if (++this_msg->m_nentries >= PGSTAT_NUM_TABENTRIES)
+			/* OK, add the counts to the table's shared entry */
+			pgstat_flush_tabentry(entry->t_shared ? InvalidOid : MyDatabaseId,
+								  entry);
+
+			/* and to the appropriate message */
+			if (entry->t_shared)
 			{
-				pgstat_send_tabstat(this_msg);
-				this_msg->m_nentries = 0;
+				this_msg = &shared_msg;
+				have_shared = true;
 			}
+			else
+			{
+				this_msg = &regular_msg;
+				have_regular = true;
+			}
+			this_msg->m_tuples_returned += entry->t_counts.t_tuples_returned;
+			this_msg->m_tuples_fetched += entry->t_counts.t_tuples_fetched;
+			this_msg->m_tuples_inserted += entry->t_counts.t_tuples_inserted;
+			this_msg->m_tuples_updated += entry->t_counts.t_tuples_updated;
+			this_msg->m_tuples_deleted += entry->t_counts.t_tuples_deleted;
+			this_msg->m_blocks_fetched += entry->t_counts.t_blocks_fetched;
+			this_msg->m_blocks_hit += entry->t_counts.t_blocks_hit;
 		}
 		/* zero out TableStatus structs after use */
 		MemSet(tsa->tsa_entries, 0,
@@ -850,13 +920,12 @@ pgstat_report_stat(bool force)
 	}
 
 	/*
-	 * Send partial messages.  Make sure that any pending xact commit/abort
-	 * gets counted, even if there are no table stats to send.
+	 * Send the messages.  Make sure that any pending xact commit/abort gets
+	 * counted, even if there are no table stats to send.
 	 */
-	if (regular_msg.m_nentries > 0 ||
-		pgStatXactCommit > 0 || pgStatXactRollback > 0)
+	if (have_regular || pgStatXactCommit > 0 || pgStatXactRollback > 0)
 		pgstat_send_tabstat(&regular_msg);
-	if (shared_msg.m_nentries > 0)
+	if (have_shared)
 		pgstat_send_tabstat(&shared_msg);
 
 	/* Now, send function statistics */
@@ -869,9 +938,6 @@ pgstat_report_stat(bool force)
 static void
 pgstat_send_tabstat(PgStat_MsgTabstat *tsmsg)
 {
-	int			n;
-	int			len;
-
 	/* It's unlikely we'd get here with no socket, but maybe not impossible */
 	if (pgStatSock == PGINVALID_SOCKET)
 		return;
@@ -886,10 +952,12 @@ pgstat_send_tabstat(PgStat_MsgTabstat *tsmsg)
 		tsmsg->m_xact_rollback = pgStatXactRollback;
 		tsmsg->m_block_read_time = pgStatBlockReadTime;
 		tsmsg->m_block_write_time = pgStatBlockWriteTime;
+		tsmsg->m_fastpath_overflows = pgStatFastPathOverflows;
 		pgStatXactCommit = 0;
 		pgStatXactRollback = 0;
 		pgStatBlockReadTime = 0;
 		pgStatBlockWriteTime = 0;
+		pgStatFastPathOverflows = 0;
 	}
 	else
 	{
@@ -897,14 +965,11 @@ pgstat_send_tabstat(PgStat_MsgTabstat *tsmsg)
 		tsmsg->m_xact_rollback = 0;
 		tsmsg->m_block_read_time = 0;
 		tsmsg->m_block_write_time = 0;
+		tsmsg->m_fastpath_overflows = 0;
 	}
 
-	n = tsmsg->m_nentries;
-	len = offsetof(PgStat_MsgTabstat, m_entry[0]) +
-		n * sizeof(PgStat_TableEntry);
-
 	pgstat_setheader(&tsmsg->m_hdr, PGSTAT_MTYPE_TABSTAT);
-	pgstat_send(tsmsg, len);
+	pgstat_send(tsmsg, sizeof(PgStat_MsgTabstat));
 }
 
 /*
@@ -966,21 +1031,28 @@ pgstat_send_funcstats(void)
 /* ----------
  * pgstat_vacuum_stat() -
  *
- *	Will tell the collector about objects he can get rid of.
+ *	Will remove the shared statistics of dropped tables, and tell the
+ *	collector about other objects he can get rid of.
  * ----------
  */
 void
 pgstat_vacuum_stat(void)
 {
 	HTAB	   *htab;
-	PgStat_MsgTabpurge msg;
 	PgStat_MsgFuncpurge f_msg;
 	HASH_SEQ_STATUS hstat;
 	PgStat_StatDBEntry *dbentry;
-	PgStat_StatTabEntry *tabentry;
 	PgStat_StatFuncEntry *funcentry;
 	int			len;
 
+	/*
+	 * Make a list of all known relations in this DB, and forget the table
+	 * statistics of all others.
+	 */
+	htab = pgstat_collect_oids(RelationRelationId);
+	pgstat_remove_table_stats(MyDatabaseId, htab);
+	hash_destroy(htab);
+
 	if (pgStatSock == PGINVALID_SOCKET)
 		return;
 
@@ -1021,69 +1093,9 @@ pgstat_vacuum_stat(void)
 	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
 												 (void *) &MyDatabaseId,
 												 HASH_FIND, NULL);
-	if (dbentry == NULL || dbentry->tables == NULL)
+	if (dbentry == NULL)
 		return;
 
-	/*
-	 * Similarly to above, make a list of all known relations in this DB.
-	 */
-	htab = pgstat_collect_oids(RelationRelationId);
-
-	/*
-	 * Initialize our messages table counter to zero
-	 */
-	msg.m_nentries = 0;
-
-	/*
-	 * Check for all tables listed in stats hashtable if they still exist.
-	 */
-	hash_seq_init(&hstat, dbentry->tables);
-	while ((tabentry = (PgStat_StatTabEntry *) hash_seq_search(&hstat)) != NULL)
-	{
-		Oid			tabid = tabentry->tableid;
-
-		CHECK_FOR_INTERRUPTS();
-
-		if (hash_search(htab, (void *) &tabid, HASH_FIND, NULL) != NULL)
-			continue;
-
-		/*
-		 * Not there, so add this table's Oid to the message
-		 */
-		msg.m_tableid[msg.m_nentries++] = tabid;
-
-		/*
-		 * If the message is full, send it out and reinitialize to empty
-		 */
-		if (msg.m_nentries >= PGSTAT_NUM_TABPURGE)
-		{
-			len = offsetof(PgStat_MsgTabpurge, m_tableid[0])
-				+msg.m_nentries * sizeof(Oid);
-
-			pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_TABPURGE);
-			msg.m_databaseid = MyDatabaseId;
-			pgstat_send(&msg, len);
-
-			msg.m_nentries = 0;
-		}
-	}
-
-	/*
-	 * Send the rest
-	 */
-	if (msg.m_nentries > 0)
-	{
-		len = offsetof(PgStat_MsgTabpurge, m_tableid[0])
-			+msg.m_nentries * sizeof(Oid);
-
-		pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_TABPURGE);
-		msg.m_databaseid = MyDatabaseId;
-		pgstat_send(&msg, len);
-	}
-
-	/* Clean up */
-	hash_destroy(htab);
-
 	/*
 	 * Now repeat the above steps for functions.  However, we needn't bother
 	 * in the common case where no function stats are being collected.
@@ -1192,7 +1204,8 @@ pgstat_collect_oids(Oid catalogid)
 /* ----------
  * pgstat_drop_database() -
  *
- *	Tell the collector that we just dropped a database.
+ *	Forget the table statistics of a database we just dropped, and tell
+ *	the collector about it.
  *	(If the message gets lost, we will still clean the dead DB eventually
  *	via future invocations of pgstat_vacuum_stat().)
  * ----------
@@ -1202,6 +1215,8 @@ pgstat_drop_database(Oid databaseid)
 {
 	PgStat_MsgDropdb msg;
 
+	pgstat_remove_table_stats(databaseid, NULL);
+
 	if (pgStatSock == PGINVALID_SOCKET)
 		return;
 
@@ -1214,9 +1229,7 @@ pgstat_drop_database(Oid databaseid)
 /* ----------
  * pgstat_drop_relation() -
  *
- *	Tell the collector that we just dropped a relation.
- *	(If the message gets lost, we will still clean the dead entry eventually
- *	via future invocations of pgstat_vacuum_stat().)
+ *	Forget the statistics of a relation we just dropped.
  *
  *	Currently not used for lack of any good place to call it; we rely
  *	entirely on pgstat_vacuum_stat() to clean out stats for dead rels.
@@ -1226,20 +1239,18 @@ pgstat_drop_database(Oid databaseid)
 void
 pgstat_drop_relation(Oid relid)
 {
-	PgStat_MsgTabpurge msg;
-	int			len;
-
-	if (pgStatSock == PGINVALID_SOCKET)
-		return;
-
-	msg.m_tableid[0] = relid;
-	msg.m_nentries = 1;
-
-	len = offsetof(PgStat_MsgTabpurge, m_tableid[0]) +sizeof(Oid);
-
-	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_TABPURGE);
-	msg.m_databaseid = MyDatabaseId;
-	pgstat_send(&msg, len);
+	PgStat_TableStatKey key;
+	LWLock	   *partitionLock;
+	uint32		hashcode;
+
+	key.databaseid = MyDatabaseId;
+	key.tableid = relid;
+	partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+	(void) hash_search_with_hash_value(TableStatsHash, &key, hashcode,
+									   HASH_REMOVE, NULL);
+	LWLockRelease(partitionLock);
 }
 #endif   /* NOT_USED */
 
@@ -1247,7 +1258,8 @@ pgstat_drop_relation(Oid relid)
 /* ----------
  * pgstat_reset_counters() -
  *
- *	Tell the statistics collector to reset counters for our database.
+ *	Reset the table statistics of our database, and tell the statistics
+ *	collector to reset its counters for it.
  *
  *	Permission checking for this function is managed through the normal
  *	GRANT system.
@@ -1258,6 +1270,8 @@ pgstat_reset_counters(void)
 {
 	PgStat_MsgResetcounter msg;
 
+	pgstat_remove_table_stats(MyDatabaseId, NULL);
+
 	if (pgStatSock == PGINVALID_SOCKET)
 		return;
 
@@ -1311,6 +1325,24 @@ pgstat_reset_single_counter(Oid objoid, PgStat_Single_Reset_Type type)
 {
 	PgStat_MsgResetsinglecounter msg;
 
+	/* Table statistics are reset right here */
+	if (type == RESET_TABLE)
+	{
+		PgStat_TableStatKey key;
+		LWLock	   *partitionLock;
+		uint32		hashcode;
+
+		key.databaseid = MyDatabaseId;
+		key.tableid = objoid;
+		partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+		LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+		(void) hash_search_with_hash_value(TableStatsHash, &key, hashcode,
+										   HASH_REMOVE, NULL);
+		LWLockRelease(partitionLock);
+	}
+
+	/* The collector still needs to set the database's reset timestamp */
 	if (pgStatSock == PGINVALID_SOCKET)
 		return;
 
@@ -1349,32 +1381,55 @@ pgstat_report_autovac(Oid dboid)
 /* ---------
  * pgstat_report_vacuum() -
  *
- *	Tell the collector about the table we just vacuumed.
+ *	Store the results of the VACUUM of a table in its shared statistics.
  * ---------
  */
 void
 pgstat_report_vacuum(Oid tableoid, bool shared,
 					 PgStat_Counter livetuples, PgStat_Counter deadtuples)
 {
-	PgStat_MsgVacuum msg;
+	PgStat_TableStatKey key;
+	PgStat_StatTabEntry *tabentry;
+	LWLock	   *partitionLock;
+	uint32		hashcode;
+	TimestampTz vacuumtime;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
-	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_VACUUM);
-	msg.m_databaseid = shared ? InvalidOid : MyDatabaseId;
-	msg.m_tableoid = tableoid;
-	msg.m_autovacuum = IsAutoVacuumWorkerProcess();
-	msg.m_vacuumtime = GetCurrentTimestamp();
-	msg.m_live_tuples = livetuples;
-	msg.m_dead_tuples = deadtuples;
-	pgstat_send(&msg, sizeof(msg));
+	vacuumtime = GetCurrentTimestamp();
+
+	key.databaseid = shared ? InvalidOid : MyDatabaseId;
+	key.tableid = tableoid;
+	partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+	tabentry = pgstat_get_shared_tabentry(&key, hashcode, true);
+	if (tabentry != NULL)
+	{
+		tabentry->n_live_tuples = livetuples;
+		tabentry->n_dead_tuples = deadtuples;
+
+		if (IsAutoVacuumWorkerProcess())
+		{
+			tabentry->autovac_vacuum_timestamp = vacuumtime;
+			tabentry->autovac_vacuum_count++;
+		}
+		else
+		{
+			tabentry->vacuum_timestamp = vacuumtime;
+			tabentry->vacuum_count++;
+		}
+	}
+
+	LWLockRelease(partitionLock);
 }
 
 /* --------
  * pgstat_report_analyze() -
  *
- *	Tell the collector about the table we just analyzed.
+ *	Store the results of the ANALYZE of a table in its shared statistics.
  *
  * Caller must provide new live- and dead-tuples estimates, as well as a
  * flag indicating whether to reset the changes_since_analyze counter.
@@ -1385,9 +1440,13 @@ pgstat_report_analyze(Relation rel,
 					  PgStat_Counter livetuples, PgStat_Counter deadtuples,
 					  bool resetcounter)
 {
-	PgStat_MsgAnalyze msg;
+	PgStat_TableStatKey key;
+	PgStat_StatTabEntry *tabentry;
+	LWLock	   *partitionLock;
+	uint32		hashcode;
+	TimestampTz analyzetime;
 
-	if (pgStatSock == PGINVALID_SOCKET || !pgstat_track_counts)
+	if (!pgstat_track_counts)
 		return;
 
 	/*
@@ -1395,10 +1454,9 @@ pgstat_report_analyze(Relation rel,
 	 * already inserted and/or deleted rows in the target table. ANALYZE will
 	 * have counted such rows as live or dead respectively. Because we will
 	 * report our counts of such rows at transaction end, we should subtract
-	 * off these counts from what we send to the collector now, else they'll
-	 * be double-counted after commit.  (This approach also ensures that the
-	 * collector ends up with the right numbers if we abort instead of
-	 * committing.)
+	 * off these counts from what we store now, else they'll be double-counted
+	 * after commit.  (This approach also ensures that we end up with the
+	 * right numbers if we abort instead of committing.)
 	 */
 	if (rel->pgstat_info != NULL)
 	{
@@ -1416,15 +1474,41 @@ pgstat_report_analyze(Relation rel,
 		deadtuples = Max(deadtuples, 0);
 	}
 
-	pgstat_setheader(&msg.m_hdr, PGSTAT_MTYPE_ANALYZE);
-	msg.m_databaseid = rel->rd_rel->relisshared ? InvalidOid : MyDatabaseId;
-	msg.m_tableoid = RelationGetRelid(rel);
-	msg.m_autovacuum = IsAutoVacuumWorkerProcess();
-	msg.m_resetcounter = resetcounter;
-	msg.m_analyzetime = GetCurrentTimestamp();
-	msg.m_live_tuples = livetuples;
-	msg.m_dead_tuples = deadtuples;
-	pgstat_send(&msg, sizeof(msg));
+	analyzetime = GetCurrentTimestamp();
+
+	key.databaseid = rel->rd_rel->relisshared ? InvalidOid : MyDatabaseId;
+	key.tableid = RelationGetRelid(rel);
+	partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+	tabentry = pgstat_get_shared_tabentry(&key, hashcode, true);
+	if (tabentry != NULL)
+	{
+		tabentry->n_live_tuples = livetuples;
+		tabentry->n_dead_tuples = deadtuples;
+
+		/*
+		 * If commanded, reset changes_since_analyze to zero.  This forgets
+		 * any changes that were committed while the ANALYZE was in progress,
+		 * but we have no good way to estimate how many of those there were.
+		 */
+		if (resetcounter)
+			tabentry->changes_since_analyze = 0;
+
+		if (IsAutoVacuumWorkerProcess())
+		{
+			tabentry->autovac_analyze_timestamp = analyzetime;
+			tabentry->autovac_analyze_count++;
+		}
+		else
+		{
+			tabentry->analyze_timestamp = analyzetime;
+			tabentry->analyze_count++;
+		}
+	}
+
+	LWLockRelease(partitionLock);
 }
 
 /* --------
@@ -2333,56 +2417,79 @@ pgstat_fetch_stat_dbentry(Oid dbid)
  *
  *	Support function for the SQL-callable pgstat* functions. Returns
  *	the collected statistics for one table or NULL. NULL doesn't mean
- *	that the table doesn't exist, it is just not yet known by the
- *	collector, so the caller is better off to report ZERO instead.
+ *	that the table doesn't exist, it is just not yet known to the
+ *	statistics system, so the caller is better off to report ZERO instead.
  * ----------
  */
 PgStat_StatTabEntry *
 pgstat_fetch_stat_tabentry(Oid relid)
 {
-	Oid			dbid;
-	PgStat_StatDBEntry *dbentry;
 	PgStat_StatTabEntry *tabentry;
 
-	/*
-	 * If not done for this transaction, read the statistics collector stats
-	 * file into some hash tables.
-	 */
-	backend_read_statsfile();
+	/* Look in our own database first ... */
+	tabentry = pgstat_fetch_stat_tabentry_db(MyDatabaseId, relid);
+	if (tabentry != NULL)
+		return tabentry;
 
-	/*
-	 * Lookup our database, then look in its table hash table.
-	 */
-	dbid = MyDatabaseId;
-	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												 (void *) &dbid,
-												 HASH_FIND, NULL);
-	if (dbentry != NULL && dbentry->tables != NULL)
+	/* ... and if we didn't find it, maybe it's a shared table. */
+	return pgstat_fetch_stat_tabentry_db(InvalidOid, relid);
+}
+
+
+/* ----------
+ * pgstat_fetch_stat_tabentry_db() -
+ *
+ *	Returns the statistics of a table in the given database (InvalidOid
+ *	for shared relations), or NULL.  The shared entry is copied the first
+ *	time it is looked up in a transaction, and the copy is returned until
+ *	pgstat_clear_snapshot() is called.
+ * ----------
+ */
+PgStat_StatTabEntry *
+pgstat_fetch_stat_tabentry_db(Oid dbid, Oid relid)
+{
+	PgStat_TableStatKey key;
+	PgStat_TabSnapshotEntry *snapentry;
+	PgStat_StatTabEntry *tabentry;
+	LWLock	   *partitionLock;
+	uint32		hashcode;
+	bool		found;
+
+	key.databaseid = dbid;
+	key.tableid = relid;
+
+	if (pgStatTabSnapshot == NULL)
 	{
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													   (void *) &relid,
-													   HASH_FIND, NULL);
-		if (tabentry)
-			return tabentry;
+		HASHCTL		hash_ctl;
+
+		pgstat_setup_memcxt();
+
+		memset(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(PgStat_TableStatKey);
+		hash_ctl.entrysize = sizeof(PgStat_TabSnapshotEntry);
+		hash_ctl.hcxt = pgStatLocalContext;
+		pgStatTabSnapshot = hash_create("Table statistics snapshot",
+										PGSTAT_TAB_HASH_SIZE,
+										&hash_ctl,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 	}
 
-	/*
-	 * If we didn't find it, maybe it's a shared table.
-	 */
-	dbid = InvalidOid;
-	dbentry = (PgStat_StatDBEntry *) hash_search(pgStatDBHash,
-												 (void *) &dbid,
-												 HASH_FIND, NULL);
-	if (dbentry != NULL && dbentry->tables != NULL)
+	snapentry = (PgStat_TabSnapshotEntry *) hash_search(pgStatTabSnapshot,
+														&key, HASH_ENTER,
+														&found);
+	if (!found)
 	{
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													   (void *) &relid,
-													   HASH_FIND, NULL);
-		if (tabentry)
-			return tabentry;
+		partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+		LWLockAcquire(partitionLock, LW_SHARED);
+		tabentry = pgstat_get_shared_tabentry(&key, hashcode, false);
+		snapentry->found = (tabentry != NULL);
+		if (tabentry != NULL)
+			memcpy(&snapentry->stats, tabentry, sizeof(PgStat_StatTabEntry));
+		LWLockRelease(partitionLock);
 	}
 
-	return NULL;
+	return snapentry->found ? &snapentry->stats : NULL;
 }
 
 
@@ -2657,88 +2764,480 @@ CreateSharedBackendStatus(void)
 }
 
 
-/* ----------
- * pgstat_initialize() -
- *
- *	Initialize pgstats state, and set up our on-proc-exit hook.
- *	Called from InitPostgres.  MyBackendId must be set,
- *	but we must not have started any transaction yet (since the
- *	exit hook must run after the last transaction exit).
- *	NOTE: MyDatabaseId isn't set yet; so the shutdown hook has to be careful.
- * ----------
+/*
+ * Report shared-memory space needed by CreateSharedTableStats.
+ */
+Size
+TableStatsShmemSize(void)
+{
+	Size		size;
+
+	size = MAXALIGN(sizeof(PgStat_TableStatsShared));
+	size = add_size(size, hash_estimate_size(pgstat_max_tables,
+											 sizeof(PgStat_SharedTabEntry)));
+	return size;
+}
+
+/*
+ * Initialize the shared table statistics hash table and the locks
+ * protecting its partitions during postmaster startup.
  */
 void
-pgstat_initialize(void)
+CreateSharedTableStats(void)
 {
-	/* Initialize MyBEEntry */
-	Assert(MyBackendId >= 1 && MyBackendId <= MaxBackends);
-	MyBEEntry = &BackendStatusArray[MyBackendId - 1];
+	HASHCTL		info;
+	bool		found;
+	int			i;
 
-	/* Set up a process-exit hook to clean up */
-	on_shmem_exit(pgstat_beshutdown_hook, 0);
+	TableStatsShared = (PgStat_TableStatsShared *)
+		ShmemInitStruct("Table Statistics", sizeof(PgStat_TableStatsShared),
+						&found);
+
+	if (!found)
+	{
+		for (i = 0; i < NUM_TABSTAT_PARTITIONS; i++)
+			LWLockInitialize(&TableStatsShared->locks[i].lock,
+							 LWTRANCHE_TABLE_STATS);
+	}
+
+	TableStatsLWLockTranche.name = "table_stats";
+	TableStatsLWLockTranche.array_base = TableStatsShared->locks;
+	TableStatsLWLockTranche.array_stride = sizeof(LWLockPadded);
+	LWLockRegisterTranche(LWTRANCHE_TABLE_STATS, &TableStatsLWLockTranche);
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(PgStat_TableStatKey);
+	info.entrysize = sizeof(PgStat_SharedTabEntry);
+	info.num_partitions = NUM_TABSTAT_PARTITIONS;
+
+	TableStatsHash = ShmemInitHash("Table Statistics Hash",
+								   pgstat_max_tables,
+								   pgstat_max_tables,
+								   &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
 }
 
-/* ----------
- * pgstat_bestart() -
+/*
+ * Compute the hash code of a table statistics key, and return the lock
+ * protecting the partition it falls into.
+ */
+static LWLock *
+pgstat_table_partition_lock(PgStat_TableStatKey *key, uint32 *hashcode)
+{
+	*hashcode = get_hash_value(TableStatsHash, key);
+
+	return &TableStatsShared->locks[*hashcode % NUM_TABSTAT_PARTITIONS].lock;
+}
+
+/*
+ * Look up the shared statistics entry of a table, optionally creating it
+ * with zeroed counters.  Returns NULL if the entry doesn't exist and can't
+ * be created.
  *
- *	Initialize this backend's entry in the PgBackendStatus array.
- *	Called from InitPostgres.
- *	MyDatabaseId, session userid, and application_name must be set
- *	(hence, this cannot be combined with pgstat_initialize).
- * ----------
+ * The caller must hold the partition lock of the key; exclusively if
+ * 'create' is true.
  */
-void
-pgstat_bestart(void)
+static PgStat_StatTabEntry *
+pgstat_get_shared_tabentry(PgStat_TableStatKey *key, uint32 hashcode,
+						   bool create)
 {
-	TimestampTz proc_start_timestamp;
-	Oid			userid;
-	SockAddr	clientaddr;
-	volatile PgBackendStatus *beentry;
+	PgStat_SharedTabEntry *entry;
+	bool		found;
 
-	/*
-	 * To minimize the time spent modifying the PgBackendStatus entry, fetch
-	 * all the needed data first.
-	 *
-	 * If we have a MyProcPort, use its session start time (for consistency,
-	 * and to save a kernel call).
-	 */
-	if (MyProcPort)
-		proc_start_timestamp = MyProcPort->SessionStartTime;
-	else
-		proc_start_timestamp = GetCurrentTimestamp();
-	userid = GetSessionUserId();
+	entry = (PgStat_SharedTabEntry *)
+		hash_search_with_hash_value(TableStatsHash, key, hashcode,
+									HASH_FIND, NULL);
+	if (entry != NULL)
+		return &entry->stats;
+	if (!create)
+		return NULL;
 
 	/*
-	 * We may not have a MyProcPort (eg, if this is the autovacuum process).
-	 * If so, use all-zeroes client address, which is dealt with specially in
-	 * pg_stat_get_backend_client_addr and pg_stat_get_backend_client_port.
+	 * The hash table is sized for pgstat_max_tables entries, but a partitioned
+	 * shared hash can borrow free entries beyond that; enforce the limit
+	 * ourselves so that it means the same thing as the GUC says.
 	 */
-	if (MyProcPort)
-		memcpy(&clientaddr, &MyProcPort->raddr, sizeof(clientaddr));
-	else
-		MemSet(&clientaddr, 0, sizeof(clientaddr));
+	entry = NULL;
+	if (hash_get_num_entries(TableStatsHash) < pgstat_max_tables)
+		entry = (PgStat_SharedTabEntry *)
+			hash_search_with_hash_value(TableStatsHash, key, hashcode,
+										HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		if (!table_stats_full_reported)
+		{
+			ereport(LOG,
+					(errmsg("shared table statistics hash table is full"),
+					 errhint("Consider increasing the configuration parameter \"stats_max_tables\".")));
+			table_stats_full_reported = true;
+		}
+		return NULL;
+	}
 
-	/*
-	 * Initialize my status entry, following the protocol of bumping
-	 * st_changecount before and after; and make sure it's even afterwards. We
-	 * use a volatile pointer here to ensure the compiler doesn't try to get
-	 * cute.
-	 */
-	beentry = MyBEEntry;
-	do
+	if (!found)
 	{
-		pgstat_increment_changecount_before(beentry);
-	} while ((beentry->st_changecount & 1) == 0);
+		MemSet(&entry->stats, 0, sizeof(PgStat_StatTabEntry));
+		entry->stats.tableid = key->tableid;
+	}
 
-	beentry->st_procpid = MyProcPid;
-	beentry->st_proc_start_timestamp = proc_start_timestamp;
-	beentry->st_activity_start_timestamp = 0;
-	beentry->st_state_start_timestamp = 0;
-	beentry->st_xact_start_timestamp = 0;
-	beentry->st_databaseid = MyDatabaseId;
-	beentry->st_userid = userid;
-	beentry->st_clientaddr = clientaddr;
-	if (MyProcPort && MyProcPort->remote_hostname)
+	return &entry->stats;
+}
+
+/*
+ * Add the counts accumulated by this backend for one table to its shared
+ * statistics entry.
+ */
+static void
+pgstat_flush_tabentry(Oid databaseid, PgStat_TableStatus *entry)
+{
+	PgStat_TableStatKey key;
+	PgStat_StatTabEntry *tabentry;
+	PgStat_TableCounts *counts = &entry->t_counts;
+	LWLock	   *partitionLock;
+	uint32		hashcode;
+
+	key.databaseid = databaseid;
+	key.tableid = entry->t_id;
+	partitionLock = pgstat_table_partition_lock(&key, &hashcode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+	tabentry = pgstat_get_shared_tabentry(&key, hashcode, true);
+	if (tabentry != NULL)
+	{
+		tabentry->numscans += counts->t_numscans;
+		tabentry->tuples_returned += counts->t_tuples_returned;
+		tabentry->tuples_fetched += counts->t_tuples_fetched;
+		tabentry->tuples_inserted += counts->t_tuples_inserted;
+		tabentry->tuples_updated += counts->t_tuples_updated;
+		tabentry->tuples_deleted += counts->t_tuples_deleted;
+		tabentry->tuples_hot_updated += counts->t_tuples_hot_updated;
+		/* If table was truncated, first reset the live/dead counters */
+		if (counts->t_truncated)
+		{
+			tabentry->n_live_tuples = 0;
+			tabentry->n_dead_tuples = 0;
+		}
+		tabentry->n_live_tuples += counts->t_delta_live_tuples;
+		tabentry->n_dead_tuples += counts->t_delta_dead_tuples;
+		tabentry->changes_since_analyze += counts->t_changed_tuples;
+		tabentry->blocks_fetched += counts->t_blocks_fetched;
+		tabentry->blocks_hit += counts->t_blocks_hit;
+
+		/* Clamp n_live_tuples in case of negative delta_live_tuples */
+		tabentry->n_live_tuples = Max(tabentry->n_live_tuples, 0);
+		/* Likewise for n_dead_tuples */
+		tabentry->n_dead_tuples = Max(tabentry->n_dead_tuples, 0);
+	}
+
+	LWLockRelease(partitionLock);
+}
+
+/*
+ * Remove the shared statistics of the tables of a database, except those
+ * whose OIDs are in 'keep_oids'.  If 'keep_oids' is NULL, all entries of the
+ * database are removed.
+ */
+static void
+pgstat_remove_table_stats(Oid databaseid, HTAB *keep_oids)
+{
+	HASH_SEQ_STATUS hstat;
+	PgStat_SharedTabEntry *entry;
+	PgStat_TableStatKey *victims;
+	int			nvictims = 0;
+	int			maxvictims = 64;
+	int			i;
+
+	victims = (PgStat_TableStatKey *)
+		palloc(maxvictims * sizeof(PgStat_TableStatKey));
+
+	/*
+	 * Collect the keys to remove with all partitions locked in shared mode,
+	 * then remove them one partition lock at a time, so that we never hold
+	 * every partition exclusively.  An entry recreated in between by a
+	 * concurrent flush is removed anyway, which is no worse than what a
+	 * tabpurge message used to do.
+	 */
+	for (i = 0; i < NUM_TABSTAT_PARTITIONS; i++)
+		LWLockAcquire(&TableStatsShared->locks[i].lock, LW_SHARED);
+
+	hash_seq_init(&hstat, TableStatsHash);
+	while ((entry = (PgStat_SharedTabEntry *) hash_seq_search(&hstat)) != NULL)
+	{
+		if (entry->key.databaseid != databaseid)
+			continue;
+		if (keep_oids != NULL &&
+			hash_search(keep_oids, &entry->key.tableid, HASH_FIND, NULL) != NULL)
+			continue;
+
+		if (nvictims >= maxvictims)
+		{
+			maxvictims *= 2;
+			victims = (PgStat_TableStatKey *)
+				repalloc(victims, maxvictims * sizeof(PgStat_TableStatKey));
+		}
+		victims[nvictims++] = entry->key;
+	}
+
+	for (i = NUM_TABSTAT_PARTITIONS; --i >= 0;)
+		LWLockRelease(&TableStatsShared->locks[i].lock);
+
+	for (i = 0; i < nvictims; i++)
+	{
+		LWLock	   *partitionLock;
+		uint32		hashcode;
+
+		partitionLock = pgstat_table_partition_lock(&victims[i], &hashcode);
+		LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+		(void) hash_search_with_hash_value(TableStatsHash, &victims[i],
+										   hashcode, HASH_REMOVE, NULL);
+		LWLockRelease(partitionLock);
+	}
+
+	pfree(victims);
+}
+
+/* ----------
+ * pgstat_write_table_stats() -
+ *
+ *	Write the shared table statistics to the permanent stats directory.
+ *	Called by the checkpointer at shutdown, after all backends have exited.
+ * ----------
+ */
+void
+pgstat_write_table_stats(void)
+{
+	HASH_SEQ_STATUS hstat;
+	PgStat_SharedTabEntry *entry;
+	FILE	   *fpout;
+	int32		format_id;
+	int			rc;
+	int			i;
+
+	elog(DEBUG2, "writing stats file \"%s\"", PGSTAT_TABLES_FILENAME);
+
+	fpout = AllocateFile(PGSTAT_TABLES_TMPFILE, PG_BINARY_W);
+	if (fpout == NULL)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not open temporary statistics file \"%s\": %m",
+						PGSTAT_TABLES_TMPFILE)));
+		return;
+	}
+
+	format_id = PGSTAT_FILE_FORMAT_ID;
+	rc = fwrite(&format_id, sizeof(format_id), 1, fpout);
+	(void) rc;					/* we'll check for error with ferror */
+
+	for (i = 0; i < NUM_TABSTAT_PARTITIONS; i++)
+		LWLockAcquire(&TableStatsShared->locks[i].lock, LW_SHARED);
+
+	hash_seq_init(&hstat, TableStatsHash);
+	while ((entry = (PgStat_SharedTabEntry *) hash_seq_search(&hstat)) != NULL)
+	{
+		fputc('T', fpout);
+		rc = fwrite(entry, sizeof(PgStat_SharedTabEntry), 1, fpout);
+		(void) rc;				/* we'll check for error with ferror */
+	}
+
+	for (i = NUM_TABSTAT_PARTITIONS; --i >= 0;)
+		LWLockRelease(&TableStatsShared->locks[i].lock);
+
+	fputc('E', fpout);
+
+	if (ferror(fpout))
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+			   errmsg("could not write temporary statistics file \"%s\": %m",
+					  PGSTAT_TABLES_TMPFILE)));
+		FreeFile(fpout);
+		unlink(PGSTAT_TABLES_TMPFILE);
+	}
+	else if (FreeFile(fpout) < 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+			   errmsg("could not close temporary statistics file \"%s\": %m",
+					  PGSTAT_TABLES_TMPFILE)));
+		unlink(PGSTAT_TABLES_TMPFILE);
+	}
+	else if (rename(PGSTAT_TABLES_TMPFILE, PGSTAT_TABLES_FILENAME) < 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not rename temporary statistics file \"%s\" to \"%s\": %m",
+						PGSTAT_TABLES_TMPFILE, PGSTAT_TABLES_FILENAME)));
+		unlink(PGSTAT_TABLES_TMPFILE);
+	}
+}
+
+/* ----------
+ * pgstat_read_table_stats() -
+ *
+ *	Load the table statistics written at the last clean shutdown into the
+ *	shared hash table, and remove the file.  Called by the startup process
+ *	before any backend can access the statistics.
+ * ----------
+ */
+void
+pgstat_read_table_stats(void)
+{
+	PgStat_SharedTabEntry buf;
+	PgStat_StatTabEntry *tabentry;
+	FILE	   *fpin;
+	int32		format_id;
+
+	if ((fpin = AllocateFile(PGSTAT_TABLES_FILENAME, PG_BINARY_R)) == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not open statistics file \"%s\": %m",
+							PGSTAT_TABLES_FILENAME)));
+		return;
+	}
+
+	if (fread(&format_id, 1, sizeof(format_id), fpin) != sizeof(format_id) ||
+		format_id != PGSTAT_FILE_FORMAT_ID)
+	{
+		ereport(LOG,
+				(errmsg("corrupted statistics file \"%s\"",
+						PGSTAT_TABLES_FILENAME)));
+		goto done;
+	}
+
+	for (;;)
+	{
+		switch (fgetc(fpin))
+		{
+				/*
+				 * 'T'	A PgStat_SharedTabEntry follows.
+				 */
+			case 'T':
+				if (fread(&buf, 1, sizeof(buf), fpin) != sizeof(buf))
+				{
+					ereport(LOG,
+							(errmsg("corrupted statistics file \"%s\"",
+									PGSTAT_TABLES_FILENAME)));
+					goto done;
+				}
+
+				/*
+				 * Nobody else can be looking at the hash table yet, so we
+				 * don't bother with the partition locks.
+				 */
+				tabentry = pgstat_get_shared_tabentry(&buf.key,
+									  get_hash_value(TableStatsHash, &buf.key),
+													  true);
+				if (tabentry == NULL)
+					goto done;
+				memcpy(tabentry, &buf.stats, sizeof(PgStat_StatTabEntry));
+				break;
+
+			case 'E':
+				goto done;
+
+			default:
+				ereport(LOG,
+						(errmsg("corrupted statistics file \"%s\"",
+								PGSTAT_TABLES_FILENAME)));
+				goto done;
+		}
+	}
+
+done:
+	FreeFile(fpin);
+
+	elog(DEBUG2, "removing permanent stats file \"%s\"",
+		 PGSTAT_TABLES_FILENAME);
+	unlink(PGSTAT_TABLES_FILENAME);
+}
+
+
+/* ----------
+ * pgstat_initialize() -
+ *
+ *	Initialize pgstats state, and set up our on-proc-exit hook.
+ *	Called from InitPostgres.  MyBackendId must be set,
+ *	but we must not have started any transaction yet (since the
+ *	exit hook must run after the last transaction exit).
+ *	NOTE: MyDatabaseId isn't set yet; so the shutdown hook has to be careful.
+ * ----------
+ */
+void
+pgstat_initialize(void)
+{
+	/* Initialize MyBEEntry */
+	Assert(MyBackendId >= 1 && MyBackendId <= MaxBackends);
+	MyBEEntry = &BackendStatusArray[MyBackendId - 1];
+
+	/* Set up a process-exit hook to clean up */
+	on_shmem_exit(pgstat_beshutdown_hook, 0);
+}
+
+/* ----------
+ * pgstat_bestart() -
+ *
+ *	Initialize this backend's entry in the PgBackendStatus array.
+ *	Called from InitPostgres.
+ *	MyDatabaseId, session userid, and application_name must be set
+ *	(hence, this cannot be combined with pgstat_initialize).
+ * ----------
+ */
+void
+pgstat_bestart(void)
+{
+	TimestampTz proc_start_timestamp;
+	Oid			userid;
+	SockAddr	clientaddr;
+	volatile PgBackendStatus *beentry;
+
+	/*
+	 * To minimize the time spent modifying the PgBackendStatus entry, fetch
+	 * all the needed data first.
+	 *
+	 * If we have a MyProcPort, use its session start time (for consistency,
+	 * and to save a kernel call).
+	 */
+	if (MyProcPort)
+		proc_start_timestamp = MyProcPort->SessionStartTime;
+	else
+		proc_start_timestamp = GetCurrentTimestamp();
+	userid = GetSessionUserId();
+
+	/*
+	 * We may not have a MyProcPort (eg, if this is the autovacuum process).
+	 * If so, use all-zeroes client address, which is dealt with specially in
+	 * pg_stat_get_backend_client_addr and pg_stat_get_backend_client_port.
+	 */
+	if (MyProcPort)
+		memcpy(&clientaddr, &MyProcPort->raddr, sizeof(clientaddr));
+	else
+		MemSet(&clientaddr, 0, sizeof(clientaddr));
+
+	/*
+	 * Initialize my status entry, following the protocol of bumping
+	 * st_changecount before and after; and make sure it's even afterwards. We
+	 * use a volatile pointer here to ensure the compiler doesn't try to get
+	 * cute.
+	 */
+	beentry = MyBEEntry;
+	do
+	{
+		pgstat_increment_changecount_before(beentry);
+	} while ((beentry->st_changecount & 1) == 0);
+
+	beentry->st_procpid = MyProcPid;
+	beentry->st_proc_start_timestamp = proc_start_timestamp;
+	beentry->st_activity_start_timestamp = 0;
+	beentry->st_state_start_timestamp = 0;
+	beentry->st_xact_start_timestamp = 0;
+	beentry->st_databaseid = MyDatabaseId;
+	beentry->st_userid = userid;
+	beentry->st_clientaddr = clientaddr;
+	if (MyProcPort && MyProcPort->remote_hostname)
 		strlcpy(beentry->st_clienthostname, MyProcPort->remote_hostname,
 				NAMEDATALEN);
 	else
@@ -2767,6 +3266,7 @@ pgstat_bestart(void)
 	beentry->st_clienthostname[NAMEDATALEN - 1] = '\0';
 	beentry->st_appname[NAMEDATALEN - 1] = '\0';
 	beentry->st_activity[pgstat_track_activity_query_size - 1] = '\0';
+	beentry->st_sinval_resets = 0;
 	beentry->st_progress_command = PROGRESS_COMMAND_INVALID;
 	beentry->st_progress_command_target = InvalidOid;
 
@@ -3046,6 +3546,24 @@ pgstat_report_xact_timestamp(TimestampTz tstamp)
 	pgstat_increment_changecount_after(beentry);
 }
 
+/*
+ * Report that the backend had to discard its caches, because it fell too far
+ * behind in reading shared invalidation messages.  This is counted even if
+ * track_activities is off, as it's cheap and rare.
+ */
+void
+pgstat_report_sinval_reset(void)
+{
+	volatile PgBackendStatus *beentry = MyBEEntry;
+
+	if (!beentry)
+		return;
+
+	pgstat_increment_changecount_before(beentry);
+	beentry->st_sinval_resets++;
+	pgstat_increment_changecount_after(beentry);
+}
+
 /* ----------
  * pgstat_read_current_status() -
  *
@@ -3649,10 +4167,6 @@ PgstatCollectorMain(int argc, char *argv[])
 					pgstat_recv_tabstat((PgStat_MsgTabstat *) &msg, len);
 					break;
 
-				case PGSTAT_MTYPE_TABPURGE:
-					pgstat_recv_tabpurge((PgStat_MsgTabpurge *) &msg, len);
-					break;
-
 				case PGSTAT_MTYPE_DROPDB:
 					pgstat_recv_dropdb((PgStat_MsgDropdb *) &msg, len);
 					break;
@@ -3678,14 +4192,6 @@ PgstatCollectorMain(int argc, char *argv[])
 					pgstat_recv_autovac((PgStat_MsgAutovacStart *) &msg, len);
 					break;
 
-				case PGSTAT_MTYPE_VACUUM:
-					pgstat_recv_vacuum((PgStat_MsgVacuum *) &msg, len);
-					break;
-
-				case PGSTAT_MTYPE_ANALYZE:
-					pgstat_recv_analyze((PgStat_MsgAnalyze *) &msg, len);
-					break;
-
 				case PGSTAT_MTYPE_ARCHIVER:
 					pgstat_recv_archiver((PgStat_MsgArchiver *) &msg, len);
 					break;
@@ -3787,7 +4293,7 @@ pgstat_sighup_handler(SIGNAL_ARGS)
 /*
  * Subroutine to clear stats in a database entry
  *
- * Tables and functions hashes are initialized to empty.
+ * Functions hash is initialized to empty.
  */
 static void
 reset_dbentry_counters(PgStat_StatDBEntry *dbentry)
@@ -3814,18 +4320,12 @@ reset_dbentry_counters(PgStat_StatDBEntry *dbentry)
 	dbentry->n_deadlocks = 0;
 	dbentry->n_block_read_time = 0;
 	dbentry->n_block_write_time = 0;
+	dbentry->n_fastpath_overflows = 0;
 
 	dbentry->stat_reset_timestamp = GetCurrentTimestamp();
 	dbentry->stats_timestamp = 0;
 
 	memset(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(Oid);
-	hash_ctl.entrysize = sizeof(PgStat_StatTabEntry);
-	dbentry->tables = hash_create("Per-database table",
-								  PGSTAT_TAB_HASH_SIZE,
-								  &hash_ctl,
-								  HASH_ELEM | HASH_BLOBS);
-
 	hash_ctl.keysize = sizeof(Oid);
 	hash_ctl.entrysize = sizeof(PgStat_StatFuncEntry);
 	dbentry->functions = hash_create("Per-database function",
@@ -3855,8 +4355,8 @@ pgstat_get_db_entry(Oid databaseid, bool create)
 		return NULL;
 
 	/*
-	 * If not found, initialize the new one.  This creates empty hash tables
-	 * for tables and functions, too.
+	 * If not found, initialize the new one.  This creates an empty hash
+	 * table for functions, too.
 	 */
 	if (!found)
 		reset_dbentry_counters(result);
@@ -3865,55 +4365,6 @@ pgstat_get_db_entry(Oid databaseid, bool create)
 }
 
 
-/*
- * Lookup the hash table entry for the specified table. If no hash
- * table entry exists, initialize it, if the create parameter is true.
- * Else, return NULL.
- */
-static PgStat_StatTabEntry *
-pgstat_get_tab_entry(PgStat_StatDBEntry *dbentry, Oid tableoid, bool create)
-{
-	PgStat_StatTabEntry *result;
-	bool		found;
-	HASHACTION	action = (create ? HASH_ENTER : HASH_FIND);
-
-	/* Lookup or create the hash table entry for this table */
-	result = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-												 &tableoid,
-												 action, &found);
-
-	if (!create && !found)
-		return NULL;
-
-	/* If not found, initialize the new one. */
-	if (!found)
-	{
-		result->numscans = 0;
-		result->tuples_returned = 0;
-		result->tuples_fetched = 0;
-		result->tuples_inserted = 0;
-		result->tuples_updated = 0;
-		result->tuples_deleted = 0;
-		result->tuples_hot_updated = 0;
-		result->n_live_tuples = 0;
-		result->n_dead_tuples = 0;
-		result->changes_since_analyze = 0;
-		result->blocks_fetched = 0;
-		result->blocks_hit = 0;
-		result->vacuum_timestamp = 0;
-		result->vacuum_count = 0;
-		result->autovac_vacuum_timestamp = 0;
-		result->autovac_vacuum_count = 0;
-		result->analyze_timestamp = 0;
-		result->analyze_count = 0;
-		result->autovac_analyze_timestamp = 0;
-		result->autovac_analyze_count = 0;
-	}
-
-	return result;
-}
-
-
 /* ----------
  * pgstat_write_statsfiles() -
  *		Write the global statistics file, as well as requested DB files.
@@ -3997,11 +4448,11 @@ pgstat_write_statsfiles(bool permanent, bool allDbs)
 		}
 
 		/*
-		 * Write out the DB entry. We don't write the tables or functions
-		 * pointers, since they're of no use to any other process.
+		 * Write out the DB entry. We don't write the functions pointer,
+		 * since it's of no use to any other process.
 		 */
 		fputc('D', fpout);
-		rc = fwrite(dbentry, offsetof(PgStat_StatDBEntry, tables), 1, fpout);
+		rc = fwrite(dbentry, offsetof(PgStat_StatDBEntry, functions), 1, fpout);
 		(void) rc;				/* we'll check for error with ferror */
 	}
 
@@ -4082,9 +4533,7 @@ get_dbstat_filename(bool permanent, bool tempname, Oid databaseid,
 static void
 pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
 {
-	HASH_SEQ_STATUS tstat;
 	HASH_SEQ_STATUS fstat;
-	PgStat_StatTabEntry *tabentry;
 	PgStat_StatFuncEntry *funcentry;
 	FILE	   *fpout;
 	int32		format_id;
@@ -4118,17 +4567,6 @@ pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
 	rc = fwrite(&format_id, sizeof(format_id), 1, fpout);
 	(void) rc;					/* we'll check for error with ferror */
 
-	/*
-	 * Walk through the database's access stats per table.
-	 */
-	hash_seq_init(&tstat, dbentry->tables);
-	while ((tabentry = (PgStat_StatTabEntry *) hash_seq_search(&tstat)) != NULL)
-	{
-		fputc('T', fpout);
-		rc = fwrite(tabentry, sizeof(PgStat_StatTabEntry), 1, fpout);
-		(void) rc;				/* we'll check for error with ferror */
-	}
-
 	/*
 	 * Walk through the database's function stats table.
 	 */
@@ -4190,7 +4628,7 @@ pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
  *
  *	If 'onlydb' is not InvalidOid, it means we only want data for that DB
  *	plus the shared catalogs ("DB 0").  We'll still populate the DB hash
- *	table for all databases, but we don't bother even creating table/function
+ *	table for all databases, but we don't bother even creating function
  *	hash tables for other databases.
  *
  *	'permanent' specifies reading from the permanent files not temporary ones.
@@ -4198,8 +4636,8 @@ pgstat_write_db_statsfile(PgStat_StatDBEntry *dbentry, bool permanent)
  *	files after reading; the in-memory status is now authoritative, and the
  *	files would be out of date in case somebody else reads them.
  *
- *	If a 'deep' read is requested, table/function stats are read, otherwise
- *	the table/function hash tables remain empty.
+ *	If a 'deep' read is requested, function stats are read, otherwise
+ *	the function hash tables remain empty.
  * ----------
  */
 static HTAB *
@@ -4318,8 +4756,8 @@ pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
 				 * follows.
 				 */
 			case 'D':
-				if (fread(&dbbuf, 1, offsetof(PgStat_StatDBEntry, tables),
-						  fpin) != offsetof(PgStat_StatDBEntry, tables))
+				if (fread(&dbbuf, 1, offsetof(PgStat_StatDBEntry, functions),
+						  fpin) != offsetof(PgStat_StatDBEntry, functions))
 				{
 					ereport(pgStatRunningInCollector ? LOG : WARNING,
 							(errmsg("corrupted statistics file \"%s\"",
@@ -4343,7 +4781,6 @@ pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
 				}
 
 				memcpy(dbentry, &dbbuf, sizeof(PgStat_StatDBEntry));
-				dbentry->tables = NULL;
 				dbentry->functions = NULL;
 
 				/*
@@ -4356,7 +4793,7 @@ pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
 					dbentry->stats_timestamp = 0;
 
 				/*
-				 * Don't create tables/functions hashtables for uninteresting
+				 * Don't create a functions hashtable for uninteresting
 				 * databases.
 				 */
 				if (onlydb != InvalidOid)
@@ -4367,14 +4804,6 @@ pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
 				}
 
 				memset(&hash_ctl, 0, sizeof(hash_ctl));
-				hash_ctl.keysize = sizeof(Oid);
-				hash_ctl.entrysize = sizeof(PgStat_StatTabEntry);
-				hash_ctl.hcxt = pgStatLocalContext;
-				dbentry->tables = hash_create("Per-database table",
-											  PGSTAT_TAB_HASH_SIZE,
-											  &hash_ctl,
-									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
 				hash_ctl.keysize = sizeof(Oid);
 				hash_ctl.entrysize = sizeof(PgStat_StatFuncEntry);
 				hash_ctl.hcxt = pgStatLocalContext;
@@ -4385,11 +4814,10 @@ pgstat_read_statsfiles(Oid onlydb, bool permanent, bool deep)
 
 				/*
 				 * If requested, read the data from the database-specific
-				 * file.  Otherwise we just leave the hashtables empty.
+				 * file.  Otherwise we just leave the hashtable empty.
 				 */
 				if (deep)
 					pgstat_read_db_statsfile(dbentry->databaseid,
-											 dbentry->tables,
 											 dbentry->functions,
 											 permanent);
 
@@ -4424,22 +4852,18 @@ done:
  * pgstat_read_db_statsfile() -
  *
  *	Reads in the existing statistics collector file for the given database,
- *	filling the passed-in tables and functions hash tables.
+ *	filling the passed-in functions hash table.
  *
  *	As in pgstat_read_statsfiles, if the permanent file is requested, it is
  *	removed after reading.
  *
- *	Note: this code has the ability to skip storing per-table or per-function
- *	data, if NULL is passed for the corresponding hashtable.  That's not used
- *	at the moment though.
+ *	Note: this code has the ability to skip storing per-function data, if
+ *	NULL is passed for the hashtable.  That's not used at the moment though.
  * ----------
  */
 static void
-pgstat_read_db_statsfile(Oid databaseid, HTAB *tabhash, HTAB *funchash,
-						 bool permanent)
+pgstat_read_db_statsfile(Oid databaseid, HTAB *funchash, bool permanent)
 {
-	PgStat_StatTabEntry *tabentry;
-	PgStat_StatTabEntry tabbuf;
 	PgStat_StatFuncEntry funcbuf;
 	PgStat_StatFuncEntry *funcentry;
 	FILE	   *fpin;
@@ -4487,40 +4911,6 @@ pgstat_read_db_statsfile(Oid databaseid, HTAB *tabhash, HTAB *funchash,
 	{
 		switch (fgetc(fpin))
 		{
-				/*
-				 * 'T'	A PgStat_StatTabEntry follows.
-				 */
-			case 'T':
-				if (fread(&tabbuf, 1, sizeof(PgStat_StatTabEntry),
-						  fpin) != sizeof(PgStat_StatTabEntry))
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				/*
-				 * Skip if table data not wanted.
-				 */
-				if (tabhash == NULL)
-					break;
-
-				tabentry = (PgStat_StatTabEntry *) hash_search(tabhash,
-													(void *) &tabbuf.tableid,
-														 HASH_ENTER, &found);
-
-				if (found)
-				{
-					ereport(pgStatRunningInCollector ? LOG : WARNING,
-							(errmsg("corrupted statistics file \"%s\"",
-									statfile)));
-					goto done;
-				}
-
-				memcpy(tabentry, &tabbuf, sizeof(tabbuf));
-				break;
-
 				/*
 				 * 'F'	A PgStat_StatFuncEntry follows.
 				 */
@@ -4673,8 +5063,8 @@ pgstat_read_db_statsfile_timestamp(Oid databaseid, bool permanent,
 				 * follows.
 				 */
 			case 'D':
-				if (fread(&dbentry, 1, offsetof(PgStat_StatDBEntry, tables),
-						  fpin) != offsetof(PgStat_StatDBEntry, tables))
+				if (fread(&dbentry, 1, offsetof(PgStat_StatDBEntry, functions),
+						  fpin) != offsetof(PgStat_StatDBEntry, functions))
 				{
 					ereport(pgStatRunningInCollector ? LOG : WARNING,
 							(errmsg("corrupted statistics file \"%s\"",
@@ -4879,6 +5269,7 @@ pgstat_clear_snapshot(void)
 	/* Reset variables */
 	pgStatLocalContext = NULL;
 	pgStatDBHash = NULL;
+	pgStatTabSnapshot = NULL;
 	localBackendStatusTable = NULL;
 	localNumBackends = 0;
 }
@@ -4980,16 +5371,14 @@ pgstat_recv_inquiry(PgStat_MsgInquiry *msg, int len)
 /* ----------
  * pgstat_recv_tabstat() -
  *
- *	Count what the backend has done.
+ *	Count what the backend has done.  The per-table counts have already
+ *	been added to the shared table statistics by the backend.
  * ----------
  */
 static void
 pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 {
 	PgStat_StatDBEntry *dbentry;
-	PgStat_StatTabEntry *tabentry;
-	int			i;
-	bool		found;
 
 	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
 
@@ -5000,120 +5389,14 @@ pgstat_recv_tabstat(PgStat_MsgTabstat *msg, int len)
 	dbentry->n_xact_rollback += (PgStat_Counter) (msg->m_xact_rollback);
 	dbentry->n_block_read_time += msg->m_block_read_time;
 	dbentry->n_block_write_time += msg->m_block_write_time;
-
-	/*
-	 * Process all table entries in the message.
-	 */
-	for (i = 0; i < msg->m_nentries; i++)
-	{
-		PgStat_TableEntry *tabmsg = &(msg->m_entry[i]);
-
-		tabentry = (PgStat_StatTabEntry *) hash_search(dbentry->tables,
-													(void *) &(tabmsg->t_id),
-													   HASH_ENTER, &found);
-
-		if (!found)
-		{
-			/*
-			 * If it's a new table entry, initialize counters to the values we
-			 * just got.
-			 */
-			tabentry->numscans = tabmsg->t_counts.t_numscans;
-			tabentry->tuples_returned = tabmsg->t_counts.t_tuples_returned;
-			tabentry->tuples_fetched = tabmsg->t_counts.t_tuples_fetched;
-			tabentry->tuples_inserted = tabmsg->t_counts.t_tuples_inserted;
-			tabentry->tuples_updated = tabmsg->t_counts.t_tuples_updated;
-			tabentry->tuples_deleted = tabmsg->t_counts.t_tuples_deleted;
-			tabentry->tuples_hot_updated = tabmsg->t_counts.t_tuples_hot_updated;
-			tabentry->n_live_tuples = tabmsg->t_counts.t_delta_live_tuples;
-			tabentry->n_dead_tuples = tabmsg->t_counts.t_delta_dead_tuples;
-			tabentry->changes_since_analyze = tabmsg->t_counts.t_changed_tuples;
-			tabentry->blocks_fetched = tabmsg->t_counts.t_blocks_fetched;
-			tabentry->blocks_hit = tabmsg->t_counts.t_blocks_hit;
-
-			tabentry->vacuum_timestamp = 0;
-			tabentry->vacuum_count = 0;
-			tabentry->autovac_vacuum_timestamp = 0;
-			tabentry->autovac_vacuum_count = 0;
-			tabentry->analyze_timestamp = 0;
-			tabentry->analyze_count = 0;
-			tabentry->autovac_analyze_timestamp = 0;
-			tabentry->autovac_analyze_count = 0;
-		}
-		else
-		{
-			/*
-			 * Otherwise add the values to the existing entry.
-			 */
-			tabentry->numscans += tabmsg->t_counts.t_numscans;
-			tabentry->tuples_returned += tabmsg->t_counts.t_tuples_returned;
-			tabentry->tuples_fetched += tabmsg->t_counts.t_tuples_fetched;
-			tabentry->tuples_inserted += tabmsg->t_counts.t_tuples_inserted;
-			tabentry->tuples_updated += tabmsg->t_counts.t_tuples_updated;
-			tabentry->tuples_deleted += tabmsg->t_counts.t_tuples_deleted;
-			tabentry->tuples_hot_updated += tabmsg->t_counts.t_tuples_hot_updated;
-			/* If table was truncated, first reset the live/dead counters */
-			if (tabmsg->t_counts.t_truncated)
-			{
-				tabentry->n_live_tuples = 0;
-				tabentry->n_dead_tuples = 0;
-			}
-			tabentry->n_live_tuples += tabmsg->t_counts.t_delta_live_tuples;
-			tabentry->n_dead_tuples += tabmsg->t_counts.t_delta_dead_tuples;
-			tabentry->changes_since_analyze += tabmsg->t_counts.t_changed_tuples;
-			tabentry->blocks_fetched += tabmsg->t_counts.t_blocks_fetched;
-			tabentry->blocks_hit += tabmsg->t_counts.t_blocks_hit;
-		}
-
-		/* Clamp n_live_tuples in case of negative delta_live_tuples */
-		tabentry->n_live_tuples = Max(tabentry->n_live_tuples, 0);
-		/* Likewise for n_dead_tuples */
-		tabentry->n_dead_tuples = Max(tabentry->n_dead_tuples, 0);
-
-		/*
-		 * Add per-table stats to the per-database entry, too.
-		 */
-		dbentry->n_tuples_returned += tabmsg->t_counts.t_tuples_returned;
-		dbentry->n_tuples_fetched += tabmsg->t_counts.t_tuples_fetched;
-		dbentry->n_tuples_inserted += tabmsg->t_counts.t_tuples_inserted;
-		dbentry->n_tuples_updated += tabmsg->t_counts.t_tuples_updated;
-		dbentry->n_tuples_deleted += tabmsg->t_counts.t_tuples_deleted;
-		dbentry->n_blocks_fetched += tabmsg->t_counts.t_blocks_fetched;
-		dbentry->n_blocks_hit += tabmsg->t_counts.t_blocks_hit;
-	}
-}
-
-
-/* ----------
- * pgstat_recv_tabpurge() -
- *
- *	Arrange for dead table removal.
- * ----------
- */
-static void
-pgstat_recv_tabpurge(PgStat_MsgTabpurge *msg, int len)
-{
-	PgStat_StatDBEntry *dbentry;
-	int			i;
-
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, false);
-
-	/*
-	 * No need to purge if we don't even know the database.
-	 */
-	if (!dbentry || !dbentry->tables)
-		return;
-
-	/*
-	 * Process all table entries in the message.
-	 */
-	for (i = 0; i < msg->m_nentries; i++)
-	{
-		/* Remove from hashtable if present; we don't care if it's not. */
-		(void) hash_search(dbentry->tables,
-						   (void *) &(msg->m_tableid[i]),
-						   HASH_REMOVE, NULL);
-	}
+	dbentry->n_fastpath_overflows += msg->m_fastpath_overflows;
+	dbentry->n_tuples_returned += msg->m_tuples_returned;
+	dbentry->n_tuples_fetched += msg->m_tuples_fetched;
+	dbentry->n_tuples_inserted += msg->m_tuples_inserted;
+	dbentry->n_tuples_updated += msg->m_tuples_updated;
+	dbentry->n_tuples_deleted += msg->m_tuples_deleted;
+	dbentry->n_blocks_fetched += msg->m_blocks_fetched;
+	dbentry->n_blocks_hit += msg->m_blocks_hit;
 }
 
 
@@ -5146,8 +5429,6 @@ pgstat_recv_dropdb(PgStat_MsgDropdb *msg, int len)
 		elog(DEBUG2, "removing stats file \"%s\"", statfile);
 		unlink(statfile);
 
-		if (dbentry->tables != NULL)
-			hash_destroy(dbentry->tables);
 		if (dbentry->functions != NULL)
 			hash_destroy(dbentry->functions);
 
@@ -5180,20 +5461,18 @@ pgstat_recv_resetcounter(PgStat_MsgResetcounter *msg, int len)
 		return;
 
 	/*
-	 * We simply throw away all the database's table entries by recreating a
-	 * new hash table for them.
+	 * We simply throw away all the database's function entries by recreating
+	 * a new hash table for them.  The backend has already reset the table
+	 * statistics.
 	 */
-	if (dbentry->tables != NULL)
-		hash_destroy(dbentry->tables);
 	if (dbentry->functions != NULL)
 		hash_destroy(dbentry->functions);
 
-	dbentry->tables = NULL;
 	dbentry->functions = NULL;
 
 	/*
-	 * Reset database-level stats, too.  This creates empty hash tables for
-	 * tables and functions.
+	 * Reset database-level stats, too.  This creates an empty hash table for
+	 * functions.
 	 */
 	reset_dbentry_counters(dbentry);
 }
@@ -5245,11 +5524,11 @@ pgstat_recv_resetsinglecounter(PgStat_MsgResetsinglecounter *msg, int len)
 	/* Set the reset timestamp for the whole database */
 	dbentry->stat_reset_timestamp = GetCurrentTimestamp();
 
-	/* Remove object if it exists, ignore it if not */
-	if (msg->m_resettype == RESET_TABLE)
-		(void) hash_search(dbentry->tables, (void *) &(msg->m_objectid),
-						   HASH_REMOVE, NULL);
-	else if (msg->m_resettype == RESET_FUNCTION)
+	/*
+	 * Remove object if it exists, ignore it if not.  Tables have been taken
+	 * care of by the backend.
+	 */
+	if (msg->m_resettype == RESET_FUNCTION)
 		(void) hash_search(dbentry->functions, (void *) &(msg->m_objectid),
 						   HASH_REMOVE, NULL);
 }
@@ -5273,83 +5552,6 @@ pgstat_recv_autovac(PgStat_MsgAutovacStart *msg, int len)
 	dbentry->last_autovac_time = msg->m_start_time;
 }
 
-/* ----------
- * pgstat_recv_vacuum() -
- *
- *	Process a VACUUM message.
- * ----------
- */
-static void
-pgstat_recv_vacuum(PgStat_MsgVacuum *msg, int len)
-{
-	PgStat_StatDBEntry *dbentry;
-	PgStat_StatTabEntry *tabentry;
-
-	/*
-	 * Store the data in the table's hashtable entry.
-	 */
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
-
-	tabentry = pgstat_get_tab_entry(dbentry, msg->m_tableoid, true);
-
-	tabentry->n_live_tuples = msg->m_live_tuples;
-	tabentry->n_dead_tuples = msg->m_dead_tuples;
-
-	if (msg->m_autovacuum)
-	{
-		tabentry->autovac_vacuum_timestamp = msg->m_vacuumtime;
-		tabentry->autovac_vacuum_count++;
-	}
-	else
-	{
-		tabentry->vacuum_timestamp = msg->m_vacuumtime;
-		tabentry->vacuum_count++;
-	}
-}
-
-/* ----------
- * pgstat_recv_analyze() -
- *
- *	Process an ANALYZE message.
- * ----------
- */
-static void
-pgstat_recv_analyze(PgStat_MsgAnalyze *msg, int len)
-{
-	PgStat_StatDBEntry *dbentry;
-	PgStat_StatTabEntry *tabentry;
-
-	/*
-	 * Store the data in the table's hashtable entry.
-	 */
-	dbentry = pgstat_get_db_entry(msg->m_databaseid, true);
-
-	tabentry = pgstat_get_tab_entry(dbentry, msg->m_tableoid, true);
-
-	tabentry->n_live_tuples = msg->m_live_tuples;
-	tabentry->n_dead_tuples = msg->m_dead_tuples;
-
-	/*
-	 * If commanded, reset changes_since_analyze to zero.  This forgets any
-	 * changes that were committed while the ANALYZE was in progress, but we
-	 * have no good way to estimate how many of those there were.
-	 */
-	if (msg->m_resetcounter)
-		tabentry->changes_since_analyze = 0;
-
-	if (msg->m_autovacuum)
-	{
-		tabentry->autovac_analyze_timestamp = msg->m_analyzetime;
-		tabentry->autovac_analyze_count++;
-	}
-	else
-	{
-		tabentry->analyze_timestamp = msg->m_analyzetime;
-		tabentry->analyze_count++;
-	}
-}
-
-
 /* ----------
  * pgstat_recv_archiver() -
  *
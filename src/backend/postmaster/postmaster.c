@@ -112,6 +112,7 @@
 #include "postmaster/fork_process.h"
 #include "postmaster/pgarch.h"
 #include "postmaster/postmaster.h"
+#include "postmaster/sessionpool.h"
 #include "postmaster/syslogger.h"
 #include "replication/walsender.h"
 #include "storage/fd.h"
@@ -175,11 +176,30 @@ typedef struct bkend
 	int			bkend_type;
 	bool		dead_end;		/* is it going to send an error and quit? */
 	bool		bgworker_notify;	/* gets bgworker start/stop notifications */
+	pgsocket	pool_sock;		/* channel to pooled backend, if any */
 	dlist_node	elem;			/* list link in BackendList */
 } Backend;
 
 static dlist_head BackendList = DLIST_STATIC_INIT(BackendList);
 
+/*
+ * New connections waiting for their startup packet, to be passed to an idle
+ * pooled backend if one matches (see postmaster/sessionpool.c).
+ */
+#define MAX_POOL_PENDING	64
+#define POOL_PEEK_TIMEOUT	100		/* ms to wait for the startup packet */
+#define POOL_EVICT_TIMEOUT	1000	/* ms to wait for an evicted backend */
+
+typedef struct PoolPendingConn
+{
+	Port	   *port;
+	TimestampTz since;			/* when accepted */
+	TimestampTz evicted_at;		/* when an idle backend was evicted for it */
+} PoolPendingConn;
+
+static PoolPendingConn PoolPending[MAX_POOL_PENDING];
+static int	nPoolPending = 0;
+
 #ifdef EXEC_BACKEND
 static Backend *ShmemBackendArray;
 #endif
@@ -396,11 +416,17 @@ static void HandleChildCrash(int pid, int exitstatus, const char *procname);
 static void LogChildExit(int lev, const char *procname,
 			 int pid, int exitstatus);
 static void PostmasterStateMachine(void);
+static void BackendSetRemoteHost(Port *port, char *remote_ps_data);
 static void BackendInitialize(Port *port);
 static void BackendRun(Port *port) pg_attribute_noreturn();
 static void ExitPostmaster(int status) pg_attribute_noreturn();
 static int	ServerLoop(void);
 static int	BackendStartup(Port *port);
+static bool HaveIdlePooledBackend(void);
+static bool AssignPooledBackend(Port *port, const SessionPoolKey *key);
+static bool EvictPooledBackend(void);
+static void ProcessPoolPending(void);
+static void TrimSessionPool(bool disable);
 static int	ProcessStartupPacket(Port *port, bool SSLdone);
 static void processCancelRequest(Port *port, void *pkt);
 static int	initMasks(fd_set *rmask);
@@ -1538,6 +1564,14 @@ DetermineSleepTime(struct timeval * timeout)
 {
 	TimestampTz next_wakeup = 0;
 
+	/* Poll connections waiting for a pooled backend */
+	if (nPoolPending > 0)
+	{
+		timeout->tv_sec = 0;
+		timeout->tv_usec = 10000;
+		return;
+	}
+
 	/*
 	 * Normal case: either there are no background workers at all, or we're in
 	 * a shutdown sequence (during which we ignore bgworkers altogether).
@@ -1714,7 +1748,17 @@ ServerLoop(void)
 					Port	   *port;
 
 					port = ConnCreate(ListenSocket[i]);
-					if (port)
+					if (port &&
+						nPoolPending < MAX_POOL_PENDING &&
+						HaveIdlePooledBackend())
+					{
+						/* Look for a pooled backend once we see the startup packet */
+						PoolPending[nPoolPending].port = port;
+						PoolPending[nPoolPending].since = GetCurrentTimestamp();
+						PoolPending[nPoolPending].evicted_at = 0;
+						nPoolPending++;
+					}
+					else if (port)
 					{
 						BackendStartup(port);
 
@@ -1729,6 +1773,9 @@ ServerLoop(void)
 			}
 		}
 
+		if (nPoolPending > 0)
+			ProcessPoolPending();
+
 		/* If we have lost the log collector, try to start a new one */
 		if (SysLoggerPID == 0 && Logging_collector)
 			SysLoggerPID = SysLogger_Start();
@@ -1913,6 +1960,7 @@ ProcessStartupPacket(Port *port, bool SSLdone)
 	void	   *buf;
 	ProtocolVersion proto;
 	MemoryContext oldcontext;
+	char	   *compression = NULL;
 
 	pq_startmsgread();
 	if (pq_getbytes((char *) &len, 4) == EOF)
@@ -2040,6 +2088,10 @@ retry1:
 	 */
 	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
 
+	/* Remember what we can serve when we return to the session pool */
+	if (MyPoolSocket != PGINVALID_SOCKET)
+		SessionPoolRememberStartup(buf, len);
+
 	if (PG_PROTOCOL_MAJOR(proto) >= 3)
 	{
 		int32		offset = sizeof(ProtocolVersion);
@@ -2092,6 +2144,11 @@ retry1:
 								valptr),
 							 errhint("Valid values are: \"false\", 0, \"true\", 1, \"database\".")));
 			}
+			else if (strcmp(nameptr, "compression") == 0)
+			{
+				/* List of compression algorithms supported by the client */
+				compression = pstrdup(valptr);
+			}
 			else
 			{
 				/* Assume it's a generic GUC option */
@@ -2221,6 +2278,13 @@ retry1:
 			break;
 	}
 
+	/*
+	 * Reply to compression request.  Everything following the reply,
+	 * including authentication exchange, is compressed.
+	 */
+	if (compression != NULL)
+		pq_configure_compression(compression);
+
 	return STATUS_OK;
 }
 
@@ -2424,6 +2488,7 @@ void
 ClosePostmasterPorts(bool am_syslogger)
 {
 	int			i;
+	dlist_iter	iter;
 
 #ifndef WIN32
 
@@ -2449,6 +2514,21 @@ ClosePostmasterPorts(bool am_syslogger)
 		}
 	}
 
+	/* Close session pool channels and connections waiting for them */
+	dlist_foreach(iter, &BackendList)
+	{
+		Backend    *bp = dlist_container(Backend, elem, iter.cur);
+
+		if (bp->pool_sock != PGINVALID_SOCKET)
+		{
+			StreamClose(bp->pool_sock);
+			bp->pool_sock = PGINVALID_SOCKET;
+		}
+	}
+	for (i = 0; i < nPoolPending; i++)
+		StreamClose(PoolPending[i].port->sock);
+	nPoolPending = 0;
+
 	/* If using syslogger, close the read side of the pipe */
 	if (!am_syslogger)
 	{
@@ -2505,6 +2585,7 @@ SIGHUP_handler(SIGNAL_ARGS)
 				(errmsg("received SIGHUP, reloading configuration files")));
 		ProcessConfigFile(PGC_SIGHUP);
 		SignalChildren(SIGHUP);
+		TrimSessionPool(SessionPoolSize == 0);
 		if (StartupPID != 0)
 			signal_child(StartupPID, SIGHUP);
 		if (BgWriterPID != 0)
@@ -2573,6 +2654,9 @@ pmdie(SIGNAL_ARGS)
 			Shutdown = SmartShutdown;
 			ereport(LOG,
 					(errmsg("received smart shutdown request")));
+
+			/* Pooled backends must exit when their clients disconnect */
+			TrimSessionPool(true);
 #ifdef USE_SYSTEMD
 			sd_notify(0, "STOPPING=1");
 #endif
@@ -3208,6 +3292,8 @@ CleanupBackend(int pid,
 				 */
 				BackgroundWorkerStopNotifications(bp->pid);
 			}
+			if (bp->pool_sock != PGINVALID_SOCKET)
+				StreamClose(bp->pool_sock);
 			dlist_delete(iter.cur);
 			free(bp);
 			break;
@@ -3311,6 +3397,8 @@ HandleChildCrash(int pid, int exitstatus, const char *procname)
 				ShmemBackendArrayRemove(bp);
 #endif
 			}
+			if (bp->pool_sock != PGINVALID_SOCKET)
+				StreamClose(bp->pool_sock);
 			dlist_delete(iter.cur);
 			free(bp);
 			/* Keep looping so we can signal remaining backends */
@@ -3947,12 +4035,24 @@ BackendStartup(Port *port)
 	/* Hasn't asked to be notified about any bgworkers yet */
 	bn->bgworker_notify = false;
 
+	/* Let the backend return to the session pool, if it's enabled */
+	bn->pool_sock = MyPoolSocket = PGINVALID_SOCKET;
+	if (!bn->dead_end)
+	{
+		SessionPoolResetSlot(bn->child_slot);
+		if (SessionPoolSize > 0 &&
+			SessionPoolCreateChannel(&bn->pool_sock, &MyPoolSocket))
+			SessionPoolCountMiss();
+	}
+
 #ifdef EXEC_BACKEND
 	pid = backend_forkexec(port);
 #else							/* !EXEC_BACKEND */
 	pid = fork_process();
 	if (pid == 0)				/* child */
 	{
+		if (bn->pool_sock != PGINVALID_SOCKET)
+			StreamClose(bn->pool_sock);
 		free(bn);
 
 		/* Detangle from postmaster */
@@ -3969,6 +4069,13 @@ BackendStartup(Port *port)
 	}
 #endif   /* EXEC_BACKEND */
 
+	/* The backend's end of the pool channel is not needed in postmaster */
+	if (MyPoolSocket != PGINVALID_SOCKET)
+	{
+		StreamClose(MyPoolSocket);
+		MyPoolSocket = PGINVALID_SOCKET;
+	}
+
 	if (pid < 0)
 	{
 		/* in parent, fork failed */
@@ -3976,6 +4083,8 @@ BackendStartup(Port *port)
 
 		if (!bn->dead_end)
 			(void) ReleasePostmasterChildSlot(bn->child_slot);
+		if (bn->pool_sock != PGINVALID_SOCKET)
+			StreamClose(bn->pool_sock);
 		free(bn);
 		errno = save_errno;
 		ereport(LOG,
@@ -4005,6 +4114,183 @@ BackendStartup(Port *port)
 	return STATUS_OK;
 }
 
+/*
+ * Is there a backend waiting in the session pool?
+ */
+static bool
+HaveIdlePooledBackend(void)
+{
+	dlist_iter	iter;
+
+	if (SessionPoolSize <= 0)
+		return false;
+
+	dlist_foreach(iter, &BackendList)
+	{
+		Backend    *bp = dlist_container(Backend, elem, iter.cur);
+
+		if (bp->pool_sock != PGINVALID_SOCKET &&
+			SessionPoolIsIdle(bp->child_slot))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Pass the connection to an idle pooled backend serving the same database,
+ * user and options.  Returns false if there is none.
+ */
+static bool
+AssignPooledBackend(Port *port, const SessionPoolKey *key)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &BackendList)
+	{
+		Backend    *bp = dlist_container(Backend, elem, iter.cur);
+		long		cancel_key;
+
+		if (bp->pool_sock == PGINVALID_SOCKET ||
+			!SessionPoolClaim(bp->child_slot, key))
+			continue;
+
+		/* The new client must not be able to cancel queries of the old one */
+		cancel_key = PostmasterRandom();
+		if (SessionPoolSendClient(bp->pool_sock, port->sock, cancel_key))
+		{
+			bp->cancel_key = cancel_key;
+			return true;
+		}
+
+		/* Make the backend exit, and try another one */
+		StreamClose(bp->pool_sock);
+		bp->pool_sock = PGINVALID_SOCKET;
+	}
+	return false;
+}
+
+/*
+ * Make an idle pooled backend exit, to free its connection slot.
+ */
+static bool
+EvictPooledBackend(void)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &BackendList)
+	{
+		Backend    *bp = dlist_container(Backend, elem, iter.cur);
+
+		if (bp->pool_sock != PGINVALID_SOCKET &&
+			SessionPoolClaim(bp->child_slot, NULL))
+		{
+			/* The backend sees EOF on its channel and exits */
+			StreamClose(bp->pool_sock);
+			bp->pool_sock = PGINVALID_SOCKET;
+			SessionPoolCountEviction();
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Evict idle pooled backends in excess of session_pool_size.  If disable is
+ * true, close the channels of all backends, so that busy ones exit rather
+ * than return to the pool when their clients disconnect.
+ */
+static void
+TrimSessionPool(bool disable)
+{
+	dlist_iter	iter;
+	int			idle = 0;
+
+	dlist_foreach(iter, &BackendList)
+	{
+		Backend    *bp = dlist_container(Backend, elem, iter.cur);
+		bool		is_idle;
+
+		if (bp->pool_sock == PGINVALID_SOCKET)
+			continue;
+		is_idle = SessionPoolIsIdle(bp->child_slot);
+		if (!disable && (!is_idle || ++idle <= SessionPoolSize))
+			continue;
+
+		StreamClose(bp->pool_sock);
+		bp->pool_sock = PGINVALID_SOCKET;
+		if (is_idle)
+			SessionPoolCountEviction();
+	}
+}
+
+/*
+ * Dispatch the connections waiting for their startup packet.
+ *
+ * A connection whose startup packet matches an idle pooled backend is
+ * passed to it.  Others get a new backend, as do connections which don't
+ * send the packet within POOL_PEEK_TIMEOUT.  If idle pooled backends hold
+ * all connection slots, one of them is evicted first, and the connection
+ * waits for it to exit.
+ */
+static void
+ProcessPoolPending(void)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	int			i = 0;
+
+	while (i < nPoolPending)
+	{
+		PoolPendingConn *pc = &PoolPending[i];
+		Port	   *port = pc->port;
+		bool		accepting = (canAcceptConnections() == CAC_OK);
+		SessionPoolPeekResult result = SESSION_POOL_NOT_POOLABLE;
+		SessionPoolKey key;
+
+		if (accepting)
+			result = SessionPoolPeekStartup(port->sock, &key);
+
+		if (result == SESSION_POOL_INCOMPLETE &&
+			!TimestampDifferenceExceeds(pc->since, now, POOL_PEEK_TIMEOUT))
+		{
+			i++;
+			continue;
+		}
+
+		if (result != SESSION_POOL_POOLABLE ||
+			!AssignPooledBackend(port, &key))
+		{
+			/* Needs a new backend; is there room for it? */
+			if (accepting &&
+				CountChildren(BACKEND_TYPE_NORMAL | BACKEND_TYPE_WALSND) >=
+				MaxConnections)
+			{
+				if (pc->evicted_at == 0 && EvictPooledBackend())
+					pc->evicted_at = now;
+				if (pc->evicted_at != 0 &&
+					!TimestampDifferenceExceeds(pc->evicted_at, now,
+												POOL_EVICT_TIMEOUT))
+				{
+					i++;
+					continue;
+				}
+			}
+
+			/*
+			 * Forget the connection before forking, since the child closes
+			 * pending connections in ClosePostmasterPorts.
+			 */
+			PoolPending[i] = PoolPending[--nPoolPending];
+			BackendStartup(port);
+		}
+		else
+			PoolPending[i] = PoolPending[--nPoolPending];
+
+		/* The socket now belongs to the backend */
+		StreamClose(port->sock);
+		ConnFree(port);
+	}
+}
+
 /*
  * Try to report backend fork() failure to client before we close the
  * connection.  Since we do not care to risk blocking the postmaster on
@@ -4036,6 +4322,72 @@ report_fork_failure_to_client(Port *port, int errnum)
 }
 
 
+/*
+ * BackendSetRemoteHost -- look up the remote host name and port of the
+ *				client, and issue the Log_connections message.
+ *
+ * remote_ps_data (of NI_MAXHOST bytes) receives the text for ps display.
+ */
+static void
+BackendSetRemoteHost(Port *port, char *remote_ps_data)
+{
+	int			ret;
+	char		remote_host[NI_MAXHOST];
+	char		remote_port[NI_MAXSERV];
+
+	remote_host[0] = '\0';
+	remote_port[0] = '\0';
+	if ((ret = pg_getnameinfo_all(&port->raddr.addr, port->raddr.salen,
+								  remote_host, sizeof(remote_host),
+								  remote_port, sizeof(remote_port),
+				 (log_hostname ? 0 : NI_NUMERICHOST) | NI_NUMERICSERV)) != 0)
+		ereport(WARNING,
+				(errmsg_internal("pg_getnameinfo_all() failed: %s",
+								 gai_strerror(ret))));
+	if (remote_port[0] == '\0')
+		snprintf(remote_ps_data, NI_MAXHOST, "%s", remote_host);
+	else
+		snprintf(remote_ps_data, NI_MAXHOST, "%s(%s)", remote_host, remote_port);
+
+	/*
+	 * Save remote_host and remote_port in port structure (after this, they
+	 * will appear in log_line_prefix data for log messages).
+	 */
+	port->remote_host = strdup(remote_host);
+	port->remote_port = strdup(remote_port);
+
+	/* And now we can issue the Log_connections message, if wanted */
+	if (Log_connections)
+	{
+		if (remote_port[0])
+			ereport(LOG,
+					(errmsg("connection received: host=%s port=%s",
+							remote_host,
+							remote_port)));
+		else
+			ereport(LOG,
+					(errmsg("connection received: host=%s",
+							remote_host)));
+	}
+
+	/*
+	 * If we did a reverse lookup to name, we might as well save the results
+	 * rather than possibly repeating the lookup during authentication.
+	 *
+	 * Note that we don't want to specify NI_NAMEREQD above, because then we'd
+	 * get nothing useful for a client without an rDNS entry.  Therefore, we
+	 * must check whether we got a numeric IPv4 or IPv6 address, and not save
+	 * it into remote_hostname if so.  (This test is conservative and might
+	 * sometimes classify a hostname as numeric, but an error in that
+	 * direction is safe; it only results in a possible extra lookup.)
+	 */
+	if (log_hostname &&
+		ret == 0 &&
+		strspn(remote_host, "0123456789.") < strlen(remote_host) &&
+		strspn(remote_host, "0123456789ABCDEFabcdef:") < strlen(remote_host))
+		port->remote_hostname = strdup(remote_host);
+}
+
 /*
  * BackendInitialize -- initialize an interactive (postmaster-child)
  *				backend process, and collect the client's startup packet.
@@ -4050,9 +4402,6 @@ static void
 BackendInitialize(Port *port)
 {
 	int			status;
-	int			ret;
-	char		remote_host[NI_MAXHOST];
-	char		remote_port[NI_MAXSERV];
 	char		remote_ps_data[NI_MAXHOST];
 
 	/* Save port etc. for ps status */
@@ -4109,57 +4458,7 @@ BackendInitialize(Port *port)
 	/*
 	 * Get the remote host name and port for logging and status display.
 	 */
-	remote_host[0] = '\0';
-	remote_port[0] = '\0';
-	if ((ret = pg_getnameinfo_all(&port->raddr.addr, port->raddr.salen,
-								  remote_host, sizeof(remote_host),
-								  remote_port, sizeof(remote_port),
-				 (log_hostname ? 0 : NI_NUMERICHOST) | NI_NUMERICSERV)) != 0)
-		ereport(WARNING,
-				(errmsg_internal("pg_getnameinfo_all() failed: %s",
-								 gai_strerror(ret))));
-	if (remote_port[0] == '\0')
-		snprintf(remote_ps_data, sizeof(remote_ps_data), "%s", remote_host);
-	else
-		snprintf(remote_ps_data, sizeof(remote_ps_data), "%s(%s)", remote_host, remote_port);
-
-	/*
-	 * Save remote_host and remote_port in port structure (after this, they
-	 * will appear in log_line_prefix data for log messages).
-	 */
-	port->remote_host = strdup(remote_host);
-	port->remote_port = strdup(remote_port);
-
-	/* And now we can issue the Log_connections message, if wanted */
-	if (Log_connections)
-	{
-		if (remote_port[0])
-			ereport(LOG,
-					(errmsg("connection received: host=%s port=%s",
-							remote_host,
-							remote_port)));
-		else
-			ereport(LOG,
-					(errmsg("connection received: host=%s",
-							remote_host)));
-	}
-
-	/*
-	 * If we did a reverse lookup to name, we might as well save the results
-	 * rather than possibly repeating the lookup during authentication.
-	 *
-	 * Note that we don't want to specify NI_NAMEREQD above, because then we'd
-	 * get nothing useful for a client without an rDNS entry.  Therefore, we
-	 * must check whether we got a numeric IPv4 or IPv6 address, and not save
-	 * it into remote_hostname if so.  (This test is conservative and might
-	 * sometimes classify a hostname as numeric, but an error in that
-	 * direction is safe; it only results in a possible extra lookup.)
-	 */
-	if (log_hostname &&
-		ret == 0 &&
-		strspn(remote_host, "0123456789.") < strlen(remote_host) &&
-		strspn(remote_host, "0123456789ABCDEFabcdef:") < strlen(remote_host))
-		port->remote_hostname = strdup(remote_host);
+	BackendSetRemoteHost(port, remote_ps_data);
 
 	/*
 	 * Ready to begin client interaction.  We will give up and exit(1) after a
@@ -4219,6 +4518,101 @@ BackendInitialize(Port *port)
 }
 
 
+/*
+ * BackendReinitialize -- switch a pooled backend to a new client passed by
+ *				the postmaster, and collect the client's startup packet.
+ *
+ * returns: nothing.  Will not return at all if there's any failure.
+ *
+ * The backend is initialized already, so the client is authenticated by
+ * InitPooledSession rather than InitPostgres.  The postmaster has seen the
+ * whole startup packet, so reading it doesn't block.
+ */
+void
+BackendReinitialize(pgsocket sock)
+{
+	Port	   *port = MyProcPort;
+	char		remote_ps_data[NI_MAXHOST];
+	int			status;
+
+	pq_switch_socket(sock);
+	whereToSendOutput = DestRemote;
+
+	/* This flag will remain set until InitPooledSession finishes */
+	ClientAuthInProgress = true;
+
+	port->SessionStartTime = GetCurrentTimestamp();
+	MyStartTime = timestamptz_to_time_t(port->SessionStartTime);
+
+	/* Fill in the addresses, as StreamConnection does */
+	port->raddr.salen = sizeof(port->raddr.addr);
+	if (getpeername(sock, (struct sockaddr *) & port->raddr.addr,
+					&port->raddr.salen) < 0)
+		ereport(FATAL,
+				(errcode_for_socket_access(),
+				 errmsg("getpeername() failed: %m")));
+	port->laddr.salen = sizeof(port->laddr.addr);
+	if (getsockname(sock, (struct sockaddr *) & port->laddr.addr,
+					&port->laddr.salen) < 0)
+		ereport(FATAL,
+				(errcode_for_socket_access(),
+				 errmsg("getsockname() failed: %m")));
+
+	/* The postmaster has applied the keepalive parameters to the socket */
+	port->default_keepalives_idle = port->keepalives_idle = 0;
+	port->default_keepalives_interval = port->keepalives_interval = 0;
+	port->default_keepalives_count = port->keepalives_count = 0;
+	if (!IS_AF_UNIX(port->laddr.addr.ss_family))
+	{
+		(void) pq_setkeepalivesidle(tcp_keepalives_idle, port);
+		(void) pq_setkeepalivesinterval(tcp_keepalives_interval, port);
+		(void) pq_setkeepalivescount(tcp_keepalives_count, port);
+	}
+
+	/* Forget the previous client */
+	free(port->remote_host);
+	free(port->remote_port);
+	if (port->remote_hostname)
+		free(port->remote_hostname);
+	port->remote_hostname = NULL;
+	port->remote_hostname_resolv = 0;
+	port->remote_hostname_errcode = 0;
+	port->remote_host = "";
+	port->remote_port = "";
+	pfree(port->database_name);
+	pfree(port->user_name);
+	if (port->cmdline_options)
+		pfree(port->cmdline_options);
+	port->cmdline_options = NULL;
+	list_free_deep(port->guc_options);
+	port->guc_options = NIL;
+	port->hba = NULL;
+#ifdef ENABLE_GSS
+	{
+		OM_uint32	min_s;
+
+		if (port->gss->ctx != GSS_C_NO_CONTEXT)
+			gss_delete_sec_context(&min_s, &port->gss->ctx, NULL);
+		if (port->gss->cred != GSS_C_NO_CREDENTIAL)
+			gss_release_cred(&min_s, &port->gss->cred);
+	}
+#endif
+#if defined(ENABLE_GSS) || defined(ENABLE_SSPI)
+	MemSet(port->gss, 0, sizeof(pg_gssinfo));
+#endif
+
+	BackendSetRemoteHost(port, remote_ps_data);
+
+	port->canAcceptConnections = CAC_OK;
+	status = ProcessStartupPacket(port, false);
+	if (status != STATUS_OK)
+		proc_exit(0);
+
+	init_ps_display(port->user_name, port->database_name, remote_ps_data,
+					update_process_title ? "authentication" : "");
+}
+
+
 /*
  * BackendRun -- set up the backend's argument list and invoke PostgresMain()
  *
@@ -5342,6 +5736,7 @@ StartAutovacuumWorker(void)
 			bn->dead_end = false;
 			bn->child_slot = MyPMChildSlot = AssignPostmasterChildSlot();
 			bn->bgworker_notify = false;
+			bn->pool_sock = PGINVALID_SOCKET;
 
 			bn->pid = StartAutoVacWorker();
 			if (bn->pid > 0)
@@ -5704,6 +6099,7 @@ assign_backendlist_entry(RegisteredBgWorker *rw)
 	bn->bkend_type = BACKEND_TYPE_BGWORKER;
 	bn->dead_end = false;
 	bn->bgworker_notify = false;
+	bn->pool_sock = PGINVALID_SOCKET;
 
 	rw->rw_backend = bn;
 	rw->rw_child_slot = bn->child_slot;
@@ -0,0 +1,574 @@
+/*-------------------------------------------------------------------------
+ *
+ * sessionpool.c
+ *
+ * The session pool lets a backend serve another client after its client
+ * has disconnected, instead of exiting.  The new client gets a backend
+ * with warm system caches, and the cost of fork and backend startup is
+ * paid only once.
+ *
+ * A backend can be pooled if it was forked while session_pool_size > 0:
+ * then the postmaster creates a socket pair, one end of which it keeps in
+ * its Backend entry while the other one is inherited by the backend.  When
+ * the client disconnects outside of a transaction block, the backend resets
+ * its session state (as DISCARD ALL does), publishes the database, user
+ * and startup options it can serve in its slot of the shared array indexed
+ * by PMChildSlot, and waits on the socket pair.
+ *
+ * When a new connection arrives and there are idle pooled backends, the
+ * postmaster peeks at the startup packet without consuming it.  If an
+ * idle backend serves the same database, user and options, the postmaster
+ * claims it and passes the client socket over the socket pair (SCM_RIGHTS)
+ * together with a new cancel key.  The backend then reads the startup
+ * packet itself and authenticates the client as usual.  Otherwise, or if
+ * the packet does not arrive promptly, a new backend is forked.  SSL,
+ * cancel and replication connections are never pooled.
+ *
+ * Since only clients with identical startup options are matched, resetting
+ * GUCs to their session-start values gives the new client the same state
+ * as a freshly started backend would have.
+ *
+ * Idle pooled backends hold connection slots.  When a new backend is
+ * needed and max_connections would be exceeded, the postmaster evicts an
+ * idle one by closing its socket pair.
+ *
+ * The postmaster touches the shared slots only with atomic operations, so
+ * that it can't be blocked by a backend.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/postmaster/sessionpool.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "access/hash.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/postmaster.h"
+#include "postmaster/sessionpool.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/sinval.h"
+
+/* States of a slot */
+#define SESSION_POOL_ACTIVE		0	/* serving a client, or not pooled */
+#define SESSION_POOL_IDLE		1	/* waiting for a client */
+#define SESSION_POOL_CLAIMED	2	/* postmaster is passing a client to it */
+
+typedef struct SessionPoolSlot
+{
+	pg_atomic_uint32 state;
+	SessionPoolKey key;			/* valid while state is IDLE */
+} SessionPoolSlot;
+
+typedef struct SessionPoolData
+{
+	pg_atomic_uint64 hits;		/* clients passed to pooled backends */
+	pg_atomic_uint64 misses;	/* backends forked while pool is enabled */
+	pg_atomic_uint64 returns;	/* backends returned to the pool */
+	pg_atomic_uint64 evictions; /* idle backends evicted by postmaster */
+	int			nslots;
+	SessionPoolSlot slots[FLEXIBLE_ARRAY_MEMBER];	/* by PMChildSlot - 1 */
+} SessionPoolData;
+
+int			SessionPoolSize = 0;
+
+pgsocket	MyPoolSocket = PGINVALID_SOCKET;
+
+static SessionPoolData *SessionPool = NULL;
+
+/* What this backend can serve, from the startup packet of its first client */
+static SessionPoolKey MyPoolKey;
+static bool MyPoolKeyValid = false;
+
+
+/*
+ * Report shared-memory space needed by SessionPoolShmemInit
+ */
+Size
+SessionPoolShmemSize(void)
+{
+	Size		size;
+
+	size = offsetof(SessionPoolData, slots);
+	size = add_size(size, mul_size(MaxLivePostmasterChildren(),
+								   sizeof(SessionPoolSlot)));
+	return size;
+}
+
+/*
+ * Allocate and initialize shared memory of the session pool
+ */
+void
+SessionPoolShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	SessionPool = (SessionPoolData *)
+		ShmemInitStruct("Session Pool", SessionPoolShmemSize(), &found);
+
+	if (!found)
+	{
+		pg_atomic_init_u64(&SessionPool->hits, 0);
+		pg_atomic_init_u64(&SessionPool->misses, 0);
+		pg_atomic_init_u64(&SessionPool->returns, 0);
+		pg_atomic_init_u64(&SessionPool->evictions, 0);
+		SessionPool->nslots = MaxLivePostmasterChildren();
+		for (i = 0; i < SessionPool->nslots; i++)
+		{
+			pg_atomic_init_u32(&SessionPool->slots[i].state,
+							   SESSION_POOL_ACTIVE);
+			MemSet(&SessionPool->slots[i].key, 0, sizeof(SessionPoolKey));
+		}
+	}
+}
+
+/*
+ * Extract the session pool key from the body of a startup packet (starting
+ * with the protocol version).  Returns false if the connection can't be
+ * pooled.  This must see exactly what ProcessStartupPacket sees.
+ */
+static bool
+parse_startup_packet(const char *buf, int len, SessionPoolKey *key)
+{
+	ProtocolVersion proto;
+	const char *database = NULL;
+	const char *user = NULL;
+	uint32		hash = 0;
+	int			offset = sizeof(ProtocolVersion);
+
+	if (len < (int) sizeof(ProtocolVersion))
+		return false;
+	memcpy(&proto, buf, sizeof(proto));
+	proto = ntohl(proto);
+
+	/* This also excludes cancel and SSL requests */
+	if (PG_PROTOCOL_MAJOR(proto) != 3)
+		return false;
+
+	while (offset < len)
+	{
+		const char *name = buf + offset;
+		const char *name_end;
+		const char *value;
+		const char *value_end;
+
+		name_end = memchr(name, '\0', len - offset);
+		if (name_end == NULL)
+			return false;
+		if (name_end == name)
+			break;				/* packet terminator */
+		value = name_end + 1;
+		if (value >= buf + len)
+			return false;
+		value_end = memchr(value, '\0', buf + len - value);
+		if (value_end == NULL)
+			return false;
+
+		if (strcmp(name, "database") == 0)
+			database = value;
+		else if (strcmp(name, "user") == 0)
+			user = value;
+		else if (strcmp(name, "replication") == 0)
+			return false;
+		else if (strcmp(name, "compression") != 0)
+		{
+			/* Any other option must match exactly, in the same order */
+			hash = (hash << 1) | (hash >> 31);
+			hash ^= DatumGetUInt32(hash_any((const unsigned char *) name,
+											value_end + 1 - name));
+		}
+		offset = value_end + 1 - buf;
+	}
+
+	if (user == NULL || user[0] == '\0')
+		return false;
+	if (database == NULL || database[0] == '\0')
+		database = user;
+
+	MemSet(key, 0, sizeof(SessionPoolKey));
+	strlcpy(key->database, database, NAMEDATALEN);
+	strlcpy(key->user, user, NAMEDATALEN);
+	key->options_hash = hash;
+	return true;
+}
+
+/* ----------
+ * Postmaster side
+ * ----------
+ */
+
+/*
+ * Create the socket pair connecting the postmaster with a new backend.
+ */
+bool
+SessionPoolCreateChannel(pgsocket *postmaster_end, pgsocket *backend_end)
+{
+#if !defined(WIN32) && !defined(EXEC_BACKEND)
+	int			fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+	{
+		ereport(LOG,
+				(errcode_for_socket_access(),
+				 errmsg("could not create session pool channel: %m")));
+		return false;
+	}
+	*postmaster_end = fds[0];
+	*backend_end = fds[1];
+	return true;
+#else
+
+	/*
+	 * Passing sockets between processes is not implemented on Windows, and
+	 * EXEC_BACKEND builds don't pass the channel to the new backend.
+	 */
+	return false;
+#endif
+}
+
+/*
+ * Check the startup packet of a new connection without consuming it.
+ */
+SessionPoolPeekResult
+SessionPoolPeekStartup(pgsocket sock, SessionPoolKey *key)
+{
+#ifndef WIN32
+	char		buf[MAX_STARTUP_PACKET_LENGTH];
+	ssize_t		n;
+	int32		len;
+
+	n = recv(sock, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+	if (n < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return SESSION_POOL_INCOMPLETE;
+		return SESSION_POOL_NOT_POOLABLE;
+	}
+	if (n == 0)
+		return SESSION_POOL_NOT_POOLABLE;	/* let the backend see the EOF */
+	if (n < (ssize_t) sizeof(len))
+		return SESSION_POOL_INCOMPLETE;
+
+	memcpy(&len, buf, sizeof(len));
+	len = ntohl(len);
+	if (len < (int32) (sizeof(len) + sizeof(ProtocolVersion)) ||
+		len > MAX_STARTUP_PACKET_LENGTH)
+		return SESSION_POOL_NOT_POOLABLE;
+	if (n < len)
+		return SESSION_POOL_INCOMPLETE;
+
+	return parse_startup_packet(buf + sizeof(len), len - sizeof(len), key) ?
+		SESSION_POOL_POOLABLE : SESSION_POOL_NOT_POOLABLE;
+#else
+	return SESSION_POOL_NOT_POOLABLE;
+#endif
+}
+
+/*
+ * Mark slot of a new child process as not pooled.
+ */
+void
+SessionPoolResetSlot(int child_slot)
+{
+	Assert(child_slot > 0 && child_slot <= SessionPool->nslots);
+	pg_atomic_write_u32(&SessionPool->slots[child_slot - 1].state,
+						SESSION_POOL_ACTIVE);
+}
+
+/*
+ * Is the backend waiting for a client?
+ */
+bool
+SessionPoolIsIdle(int child_slot)
+{
+	Assert(child_slot > 0 && child_slot <= SessionPool->nslots);
+	return pg_atomic_read_u32(&SessionPool->slots[child_slot - 1].state) ==
+		SESSION_POOL_IDLE;
+}
+
+/*
+ * Claim an idle backend serving the given key (any idle backend if key is
+ * NULL).  After a successful claim the postmaster must either pass a client
+ * to the backend or close its channel.
+ */
+bool
+SessionPoolClaim(int child_slot, const SessionPoolKey *key)
+{
+	SessionPoolSlot *slot;
+	uint32		expected = SESSION_POOL_IDLE;
+
+	Assert(child_slot > 0 && child_slot <= SessionPool->nslots);
+	slot = &SessionPool->slots[child_slot - 1];
+
+	if (pg_atomic_read_u32(&slot->state) != SESSION_POOL_IDLE)
+		return false;
+	pg_read_barrier();
+	if (key != NULL &&
+		(key->options_hash != slot->key.options_hash ||
+		 strcmp(key->database, slot->key.database) != 0 ||
+		 strcmp(key->user, slot->key.user) != 0))
+		return false;
+
+	return pg_atomic_compare_exchange_u32(&slot->state, &expected,
+										  SESSION_POOL_CLAIMED);
+}
+
+/*
+ * Pass client socket and the new cancel key to a claimed backend.
+ */
+bool
+SessionPoolSendClient(pgsocket channel, pgsocket client, long cancel_key)
+{
+#ifndef WIN32
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union
+	{
+		struct cmsghdr hdr;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	}			control;
+	int32		key = (int32) cancel_key;
+	ssize_t		rc;
+
+	MemSet(&msg, 0, sizeof(msg));
+	MemSet(&control, 0, sizeof(control));
+	iov.iov_base = &key;
+	iov.iov_len = sizeof(key);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &client, sizeof(int));
+
+	/* The channel is empty, so this can't block */
+	do
+	{
+		rc = sendmsg(channel, &msg, MSG_DONTWAIT);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc != sizeof(key))
+	{
+		ereport(LOG,
+				(errcode_for_socket_access(),
+				 errmsg("could not pass connection to pooled backend: %m")));
+		return false;
+	}
+	pg_atomic_fetch_add_u64(&SessionPool->hits, 1);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void
+SessionPoolCountMiss(void)
+{
+	pg_atomic_fetch_add_u64(&SessionPool->misses, 1);
+}
+
+void
+SessionPoolCountEviction(void)
+{
+	pg_atomic_fetch_add_u64(&SessionPool->evictions, 1);
+}
+
+/* ----------
+ * Backend side
+ * ----------
+ */
+
+/*
+ * Remember what the startup packet of our client asked for.  Called by
+ * ProcessStartupPacket with the packet body.
+ */
+void
+SessionPoolRememberStartup(const char *packet, int len)
+{
+	MyPoolKeyValid = parse_startup_packet(packet, len, &MyPoolKey);
+}
+
+/*
+ * Does our current client have the given key?
+ */
+bool
+SessionPoolSameKey(const SessionPoolKey *key)
+{
+	return MyPoolKeyValid &&
+		memcmp(key, &MyPoolKey, sizeof(SessionPoolKey)) == 0;
+}
+
+void
+SessionPoolGetMyKey(SessionPoolKey *key)
+{
+	*key = MyPoolKey;
+}
+
+/*
+ * Receive a client socket passed by the postmaster.
+ */
+static bool
+receive_client(pgsocket *client, long *cancel_key)
+{
+#ifndef WIN32
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union
+	{
+		struct cmsghdr hdr;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	}			control;
+	int32		key;
+	ssize_t		rc;
+
+	MemSet(&msg, 0, sizeof(msg));
+	iov.iov_base = &key;
+	iov.iov_len = sizeof(key);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	do
+	{
+		rc = recvmsg(MyPoolSocket, &msg, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc != sizeof(key))
+	{
+		/* EOF: postmaster has evicted us */
+		if (rc < 0)
+			ereport(LOG,
+					(errcode_for_socket_access(),
+					 errmsg("could not receive connection from postmaster: %m")));
+		return false;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+		cmsg->cmsg_type != SCM_RIGHTS ||
+		cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+	{
+		ereport(LOG,
+				(errmsg("invalid session pool message from postmaster")));
+		return false;
+	}
+	memcpy(client, CMSG_DATA(cmsg), sizeof(int));
+	*cancel_key = key;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Wait in the pool until the postmaster passes us a new client.
+ *
+ * Returns false if the backend should exit instead: the pool is full or
+ * disabled, we were evicted, or the postmaster died.  Exits on SIGTERM.
+ * Session state must have been reset by the caller.
+ */
+bool
+SessionPoolWaitForClient(pgsocket *client, long *cancel_key)
+{
+	SessionPoolSlot *slot;
+	uint32		expected;
+	int			idle = 0;
+	int			i;
+
+	if (MyPoolSocket == PGINVALID_SOCKET || !MyPoolKeyValid ||
+		SessionPoolSize <= 0 || MyPMChildSlot <= 0)
+		return false;
+
+	for (i = 0; i < SessionPool->nslots; i++)
+	{
+		if (pg_atomic_read_u32(&SessionPool->slots[i].state) == SESSION_POOL_IDLE)
+			idle++;
+	}
+	if (idle >= SessionPoolSize)
+		return false;
+
+	slot = &SessionPool->slots[MyPMChildSlot - 1];
+	slot->key = MyPoolKey;
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->state, SESSION_POOL_IDLE);
+	pg_atomic_fetch_add_u64(&SessionPool->returns, 1);
+
+	for (;;)
+	{
+		int			rc;
+
+		rc = WaitLatchOrSocket(MyLatch,
+							   WL_LATCH_SET | WL_SOCKET_READABLE |
+							   WL_POSTMASTER_DEATH,
+							   MyPoolSocket, -1L);
+
+		if (rc & WL_SOCKET_READABLE)
+		{
+			/* Claimed by postmaster, or the channel was closed */
+			bool		received = receive_client(client, cancel_key);
+
+			pg_atomic_write_u32(&slot->state, SESSION_POOL_ACTIVE);
+			return received;
+		}
+
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			pg_atomic_write_u32(&slot->state, SESSION_POOL_ACTIVE);
+			return false;
+		}
+
+		ResetLatch(MyLatch);
+
+		if (ProcDiePending)
+		{
+			/* Leave the pool, unless postmaster is already passing a client */
+			expected = SESSION_POOL_IDLE;
+			(void) pg_atomic_compare_exchange_u32(&slot->state, &expected,
+												  SESSION_POOL_ACTIVE);
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		/* Keep our caches up to date while waiting */
+		if (catchupInterruptPending)
+			ProcessCatchupInterrupt();
+	}
+}
+
+/*
+ * Statistics for pg_stat_session_pool
+ */
+void
+SessionPoolGetStats(int *idle, int64 *hits, int64 *misses,
+					int64 *returns, int64 *evictions)
+{
+	int			i;
+
+	*idle = 0;
+	for (i = 0; i < SessionPool->nslots; i++)
+	{
+		if (pg_atomic_read_u32(&SessionPool->slots[i].state) == SESSION_POOL_IDLE)
+			(*idle)++;
+	}
+	*hits = (int64) pg_atomic_read_u64(&SessionPool->hits);
+	*misses = (int64) pg_atomic_read_u64(&SessionPool->misses);
+	*returns = (int64) pg_atomic_read_u64(&SessionPool->returns);
+	*evictions = (int64) pg_atomic_read_u64(&SessionPool->evictions);
+}
@@ -33,6 +33,9 @@
 static void scancolormap(struct colormap * cm, int co,
 			 union tree * t, int level, chr partial,
 			 pg_wchar **chars, int *chars_len);
+static size_t cnfasize(struct cnfa * cnfa);
+static size_t subresize(struct subre * t);
+static size_t colormapsize(struct colormap * cm, union tree * t, int level);
 
 
 /*
@@ -332,3 +335,101 @@ scancolormap(struct colormap * cm, int co,
 		}
 	}
 }
+
+/*
+ * Get the approximate amount of memory used by a compiled regex.
+ *
+ * This counts the main allocations of the regex: its guts, the compacted
+ * NFAs of the search and of all subexpressions and lookaround constraints,
+ * and the colormap.  It's meant for callers that cache compiled regexes and
+ * want to bound their memory use, not for exact accounting.
+ */
+size_t
+pg_reg_getmemsize(const regex_t *regex)
+{
+	struct guts *g;
+	size_t		size;
+	int			i;
+
+	assert(regex != NULL && regex->re_magic == REMAGIC);
+	g = (struct guts *) regex->re_guts;
+
+	size = sizeof(struct guts);
+	size += cnfasize(&g->search);
+	if (g->tree != NULL)
+		size += subresize(g->tree);
+	if (g->lacons != NULL)
+	{
+		size += g->nlacons * sizeof(struct subre);
+		for (i = 1; i < g->nlacons; i++)
+			size += cnfasize(&g->lacons[i].cnfa);
+	}
+	if (g->cmap.cd != g->cmap.cdspace)
+		size += g->cmap.ncds * sizeof(struct colordesc);
+	size += colormapsize(&g->cmap, &g->cmap.tree[0], 0);
+
+	return size;
+}
+
+/*
+ * cnfasize - size of the arrays of a compacted NFA
+ */
+static size_t
+cnfasize(struct cnfa * cnfa)
+{
+	size_t		size;
+	int			i;
+	struct carc *ca;
+
+	if (NULLCNFA(*cnfa))
+		return 0;
+
+	size = cnfa->nstates * (sizeof(struct carc *) + sizeof(char));
+	for (i = 0; i < cnfa->nstates; i++)
+	{
+		/* count the arcs of the state, and its list terminator */
+		for (ca = cnfa->states[i]; ca->co != COLORLESS; ca++)
+			size += sizeof(struct carc);
+		size += sizeof(struct carc);
+	}
+	return size;
+}
+
+/*
+ * subresize - size of a subexpression tree
+ */
+static size_t
+subresize(struct subre * t)
+{
+	size_t		size = sizeof(struct subre) + cnfasize(&t->cnfa);
+
+	if (t->left != NULL)
+		size += subresize(t->left);
+	if (t->right != NULL)
+		size += subresize(t->right);
+	return size;
+}
+
+/*
+ * colormapsize - size of the separately allocated blocks of a colormap
+ *
+ * The all-white fill blocks are part of the colormap struct itself, see
+ * scancolormap().
+ */
+static size_t
+colormapsize(struct colormap * cm, union tree * t, int level)
+{
+	size_t		size = 0;
+	int			i;
+
+	if (level >= NBYTS - 1)
+		return 0;
+
+	for (i = 0; i < BYTTAB; i++)
+	{
+		if (t->tptr[i] == &cm->tree[level + 1])
+			continue;
+		size += sizeof(union tree) + colormapsize(cm, t->tptr[i], level + 1);
+	}
+	return size;
+}
@@ -16,6 +16,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
 
 #include "access/xlog_internal.h"		/* for pg_start/stop_backup */
 #include "catalog/catalog.h"
@@ -34,6 +37,7 @@
 #include "storage/ipc.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
+#include "utils/memutils.h"
 #include "utils/ps_status.h"
 #include "utils/timestamp.h"
 
@@ -47,6 +51,8 @@ typedef struct
 	bool		includewal;
 	uint32		maxrate;
 	bool		sendtblspcmapfile;
+	BackupCompression compression;
+	int			compression_level;
 } basebackup_options;
 
 
@@ -67,6 +73,9 @@ static void parse_basebackup_options(List *options, basebackup_options *opt);
 static void SendXlogRecPtrResult(XLogRecPtr ptr, TimeLineID tli);
 static int	compareWalFileNames(const void *a, const void *b);
 static void throttle(size_t increment);
+static void beginTarStream(void);
+static int	sendTarData(const void *data, size_t len);
+static void endTarStream(void);
 
 /* Was the backup currently in-progress initiated in recovery mode? */
 static bool backup_started_in_recovery = false;
@@ -96,6 +105,22 @@ static int64 elapsed_min_unit;
 /* The last check of the transfer rate. */
 static int64 throttled_last;
 
+/* Compression method of the tar streams of the current backup. */
+static BackupCompression tar_compression = BACKUP_COMPRESSION_NONE;
+
+#ifdef USE_LZ4
+/*
+ * LZ4 frame compression state.  The context is kept across backups; a new
+ * frame is started for each tar stream.  Compressed data is collected in
+ * compress_buf, and sent off in CopyData messages of about TAR_SEND_SIZE.
+ */
+static LZ4F_compressionContext_t lz4_ctx = NULL;
+static LZ4F_preferences_t lz4_prefs;
+static char *compress_buf = NULL;
+static size_t compress_buflen = 0;
+static size_t compress_bufused = 0;
+#endif
+
 /*
  * Called when ERROR or FATAL happens in perform_base_backup() after
  * we have started the backup - make sure we end it!
@@ -194,17 +219,40 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 			throttling_counter = -1;
 		}
 
+		tar_compression = opt->compression;
+#ifdef USE_LZ4
+		if (tar_compression == BACKUP_COMPRESSION_LZ4)
+		{
+			MemSet(&lz4_prefs, 0, sizeof(lz4_prefs));
+			lz4_prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+			lz4_prefs.compressionLevel = opt->compression_level;
+
+			if (lz4_ctx == NULL)
+			{
+				LZ4F_errorCode_t err;
+
+				err = LZ4F_createCompressionContext(&lz4_ctx, LZ4F_VERSION);
+				if (LZ4F_isError(err))
+					ereport(ERROR,
+							(errmsg("could not create LZ4 compression context: %s",
+									LZ4F_getErrorName(err))));
+			}
+			if (compress_buf == NULL)
+			{
+				compress_buflen = TAR_SEND_SIZE +
+					LZ4F_compressBound(TAR_SEND_SIZE, &lz4_prefs);
+				compress_buf = MemoryContextAlloc(TopMemoryContext,
+												  compress_buflen);
+			}
+		}
+#endif
+
 		/* Send off our tablespaces one by one */
 		foreach(lc, tablespaces)
 		{
 			tablespaceinfo *ti = (tablespaceinfo *) lfirst(lc);
-			StringInfoData buf;
 
-			/* Send CopyOutResponse message */
-			pq_beginmessage(&buf, 'H');
-			pq_sendbyte(&buf, 0);		/* overall format */
-			pq_sendint(&buf, 0, 2);		/* natts */
-			pq_endmessage(&buf);
+			beginTarStream();
 
 			if (ti->path == NULL)
 			{
@@ -247,7 +295,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 				Assert(lnext(lc) == NULL);
 			}
 			else
-				pq_putemptymessage('c');		/* CopyDone */
+				endTarStream();
 		}
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(base_backup_cleanup, (Datum) 0);
@@ -423,7 +471,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 			{
 				CheckXLogRemoved(segno, tli);
 				/* Send the chunk as a CopyData message */
-				if (pq_putmessage('d', buf, cnt))
+				if (sendTarData(buf, cnt))
 					ereport(ERROR,
 							(errmsg("base backup could not send data, aborting backup")));
 
@@ -484,7 +532,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		}
 
 		/* Send CopyDone message for the last tar file */
-		pq_putemptymessage('c');
+		endTarStream();
 	}
 	SendXlogRecPtrResult(endptr, endtli);
 }
@@ -516,6 +564,8 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 	bool		o_wal = false;
 	bool		o_maxrate = false;
 	bool		o_tablespace_map = false;
+	bool		o_compression = false;
+	bool		o_compression_level = false;
 
 	MemSet(opt, 0, sizeof(*opt));
 	foreach(lopt, options)
@@ -586,6 +636,53 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 			opt->maxrate = (uint32) maxrate;
 			o_maxrate = true;
 		}
+		else if (strcmp(defel->defname, "compression") == 0)
+		{
+			char	   *method = strVal(defel->arg);
+
+			if (o_compression)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			if (pg_strcasecmp(method, "none") == 0)
+				opt->compression = BACKUP_COMPRESSION_NONE;
+			else if (pg_strcasecmp(method, "lz4") == 0)
+			{
+#ifdef USE_LZ4
+				opt->compression = BACKUP_COMPRESSION_LZ4;
+#else
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("LZ4 compression is not supported by this build")));
+#endif
+			}
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("unrecognized compression method \"%s\"",
+								method)));
+			o_compression = true;
+		}
+		else if (strcmp(defel->defname, "compression_level") == 0)
+		{
+			long		level;
+
+			if (o_compression_level)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			level = intVal(defel->arg);
+			if (level < 0 || level > 12)
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("%d is outside the valid range for parameter \"%s\" (%d .. %d)",
+								(int) level, "COMPRESSION_LEVEL", 0, 12)));
+
+			opt->compression_level = (int) level;
+			o_compression_level = true;
+		}
 		else if (strcmp(defel->defname, "tablespace_map") == 0)
 		{
 			if (o_tablespace_map)
@@ -811,7 +908,7 @@ sendFileWithContent(const char *filename, const char *content)
 
 	_tarWriteHeader(filename, NULL, &statbuf);
 	/* Send the contents as a CopyData message */
-	pq_putmessage('d', content, len);
+	sendTarData(content, len);
 
 	/* Pad to 512 byte boundary, per tar format requirements */
 	pad = ((len + 511) & ~511) - len;
@@ -820,7 +917,7 @@ sendFileWithContent(const char *filename, const char *content)
 		char		buf[512];
 
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		sendTarData(buf, pad);
 	}
 }
 
@@ -1155,7 +1252,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	while ((cnt = fread(buf, 1, Min(sizeof(buf), statbuf->st_size - len), fp)) > 0)
 	{
 		/* Send the chunk as a CopyData message */
-		if (pq_putmessage('d', buf, cnt))
+		if (sendTarData(buf, cnt))
 			ereport(ERROR,
 			   (errmsg("base backup could not send data, aborting backup")));
 
@@ -1180,7 +1277,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 		while (len < statbuf->st_size)
 		{
 			cnt = Min(sizeof(buf), statbuf->st_size - len);
-			pq_putmessage('d', buf, cnt);
+			sendTarData(buf, cnt);
 			len += cnt;
 			throttle(cnt);
 		}
@@ -1194,7 +1291,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	if (pad > 0)
 	{
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		sendTarData(buf, pad);
 	}
 
 	FreeFile(fp);
@@ -1232,7 +1329,7 @@ _tarWriteHeader(const char *filename, const char *linktarget,
 			elog(ERROR, "unrecognized tar error: %d", rc);
 	}
 
-	pq_putmessage('d', h, 512);
+	sendTarData(h, 512);
 }
 
 /*
@@ -1316,3 +1413,126 @@ throttle(size_t increment)
 	 */
 	throttled_last = GetCurrentIntegerTimestamp();
 }
+
+/*
+ * Send a CopyOutResponse message, to start the tar stream of a tablespace.
+ */
+static void
+beginTarStream(void)
+{
+	StringInfoData buf;
+
+	pq_beginmessage(&buf, 'H');
+	pq_sendbyte(&buf, 0);		/* overall format */
+	pq_sendint(&buf, 0, 2);		/* natts */
+	pq_endmessage(&buf);
+
+#ifdef USE_LZ4
+	if (tar_compression == BACKUP_COMPRESSION_LZ4)
+	{
+		size_t		ret;
+
+		ret = LZ4F_compressBegin(lz4_ctx, compress_buf, compress_buflen,
+								 &lz4_prefs);
+		if (LZ4F_isError(ret))
+			ereport(ERROR,
+					(errmsg("could not start LZ4 frame: %s",
+							LZ4F_getErrorName(ret))));
+		compress_bufused = ret;
+	}
+#endif
+}
+
+#ifdef USE_LZ4
+/*
+ * Send the compressed data collected so far as a CopyData message.
+ */
+static void
+flushCompressedData(void)
+{
+	if (compress_bufused == 0)
+		return;
+	if (pq_putmessage('d', compress_buf, compress_bufused))
+		ereport(ERROR,
+				(errmsg("base backup could not send data, aborting backup")));
+	compress_bufused = 0;
+}
+#endif
+
+/*
+ * Send a piece of the current tar stream.  Without compression, it is sent
+ * as a CopyData message of its own; otherwise it is compressed, and sent
+ * when enough compressed data has been collected.
+ *
+ * Returns 0 if OK, EOF if trouble, like pq_putmessage().
+ */
+static int
+sendTarData(const void *data, size_t len)
+{
+#ifdef USE_LZ4
+	if (tar_compression == BACKUP_COMPRESSION_LZ4)
+	{
+		const char *p = data;
+
+		while (len > 0)
+		{
+			size_t		chunk = Min(len, TAR_SEND_SIZE);
+			size_t		ret;
+
+			if (compress_buflen - compress_bufused <
+				LZ4F_compressBound(chunk, &lz4_prefs))
+				flushCompressedData();
+
+			ret = LZ4F_compressUpdate(lz4_ctx,
+									  compress_buf + compress_bufused,
+									  compress_buflen - compress_bufused,
+									  p, chunk, NULL);
+			if (LZ4F_isError(ret))
+				ereport(ERROR,
+						(errmsg("could not compress data: %s",
+								LZ4F_getErrorName(ret))));
+			compress_bufused += ret;
+
+			if (compress_bufused >= TAR_SEND_SIZE)
+				flushCompressedData();
+
+			p += chunk;
+			len -= chunk;
+		}
+		return 0;
+	}
+#endif
+
+	return pq_putmessage('d', data, len);
+}
+
+/*
+ * Finish the current tar stream, and send a CopyDone message.
+ */
+static void
+endTarStream(void)
+{
+#ifdef USE_LZ4
+	if (tar_compression == BACKUP_COMPRESSION_LZ4)
+	{
+		size_t		ret;
+
+		if (compress_buflen - compress_bufused <
+			LZ4F_compressBound(0, &lz4_prefs))
+			flushCompressedData();
+
+		ret = LZ4F_compressEnd(lz4_ctx,
+							   compress_buf + compress_bufused,
+							   compress_buflen - compress_bufused,
+							   NULL);
+		if (LZ4F_isError(ret))
+			ereport(ERROR,
+					(errmsg("could not end LZ4 frame: %s",
+							LZ4F_getErrorName(ret))));
+		compress_bufused += ret;
+		flushCompressedData();
+	}
+#endif
+
+	pq_putemptymessage('c');	/* CopyDone */
+}
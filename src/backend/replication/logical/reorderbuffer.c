@@ -32,9 +32,11 @@
  *
  *	  In order to cope with large transactions - which can be several times as
  *	  big as the available memory - this module supports spooling the contents
- *	  of a large transactions to disk. When the transaction is replayed the
- *	  contents of individual (sub-)transactions will be read from disk in
- *	  chunks.
+ *	  of a large transactions to disk. The memory used by the changes of all
+ *	  transactions is tracked, and whenever it exceeds
+ *	  logical_decoding_work_mem the largest (sub-)transaction is spilled.
+ *	  When the transaction is replayed the contents of individual
+ *	  (sub-)transactions will be read from disk in chunks.
  *
  *	  This module also has to deal with reassembling toast records from the
  *	  individual chunks stored in WAL. When a new (or initial) version of a
@@ -64,10 +66,10 @@
 #include "replication/snapbuild.h"		/* just for SnapBuildSnapDecRefcount */
 #include "storage/bufmgr.h"
 #include "storage/fd.h"
+#include "storage/procarray.h"
 #include "storage/sinval.h"
 #include "utils/builtins.h"
 #include "utils/combocid.h"
-#include "utils/memdebug.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/relfilenodemap.h"
@@ -136,29 +138,16 @@ typedef struct ReorderBufferDiskChange
 } ReorderBufferDiskChange;
 
 /*
- * Maximum number of changes kept in memory, per transaction. After that,
- * changes are spooled to disk.
- *
- * The current value should be sufficient to decode the entire transaction
- * without hitting disk in OLTP workloads, while starting to spool to disk in
- * other workloads reasonably fast.
- *
- * At some point in the future it probably makes sense to have a more elaborate
- * resource management here, but it's not entirely clear what that would look
- * like.
+ * Maximum amount of memory used by the changes of all transactions of a
+ * reorder buffer, in kilobytes. When it is exceeded, the largest transaction
+ * is spooled to disk.
  */
-static const Size max_changes_in_memory = 4096;
+int			logical_decoding_work_mem;
 
 /*
- * We use a very simple form of a slab allocator for frequently allocated
- * objects, simply keeping a fixed number in a linked list when unused,
- * instead pfree()ing them. Without that in many workloads aset.c becomes a
- * major bottleneck, especially when spilling to disk while decoding batch
- * workloads.
+ * Maximum number of changes restored from disk at once, per transaction.
  */
-static const Size max_cached_changes = 4096 * 2;
-static const Size max_cached_tuplebufs = 4096 * 2;		/* ~8MB */
-static const Size max_cached_transactions = 512;
+static const Size max_changes_in_memory = 4096;
 
 /* ---------------------------------------
  * primary reorderbuffer support routines
@@ -192,7 +181,18 @@ static void ReorderBufferExecuteInvalidations(ReorderBuffer *rb, ReorderBufferTX
  * Disk serialization support functions
  * ---------------------------------------
  */
-static void ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static Size ReorderBufferChangeSize(ReorderBufferChange *change);
+static void ReorderBufferChangeMemoryAdd(ReorderBuffer *rb, ReorderBufferTXN *txn,
+							 ReorderBufferChange *change);
+static void ReorderBufferChangeMemoryRemove(ReorderBuffer *rb,
+								ReorderBufferChange *change);
+static void ReorderBufferCheckMemoryLimit(ReorderBuffer *rb);
+static ReorderBufferTXN *ReorderBufferLargestTXN(ReorderBuffer *rb);
+static void ReorderBufferCheckStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+							ReorderBufferChange *change);
+static void ReorderBufferReplayTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+					   XLogRecPtr commit_lsn, bool streaming);
+static void ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 							 int fd, ReorderBufferChange *change);
@@ -240,6 +240,27 @@ ReorderBufferAllocate(void)
 
 	buffer->context = new_ctx;
 
+	/*
+	 * Changes and transactions are allocated and freed at a high rate and
+	 * all have the same size, so they go into slab contexts.  Tuples vary in
+	 * size but are freed roughly in the order they were decoded, which suits
+	 * a generation context.  Both return memory to the OS as soon as a block
+	 * empties, unlike an AllocSet.
+	 */
+	buffer->change_context = SlabContextCreate(new_ctx,
+											   "Change",
+											   SLAB_DEFAULT_BLOCK_SIZE,
+											   sizeof(ReorderBufferChange));
+
+	buffer->txn_context = SlabContextCreate(new_ctx,
+											"TXN",
+											SLAB_DEFAULT_BLOCK_SIZE,
+											sizeof(ReorderBufferTXN));
+
+	buffer->tup_context = GenerationContextCreate(new_ctx,
+												  "Tuples",
+												  SLAB_LARGE_BLOCK_SIZE);
+
 	hash_ctl.keysize = sizeof(TransactionId);
 	hash_ctl.entrysize = sizeof(ReorderBufferTXNByIdEnt);
 	hash_ctl.hcxt = buffer->context;
@@ -250,19 +271,22 @@ ReorderBufferAllocate(void)
 	buffer->by_txn_last_xid = InvalidTransactionId;
 	buffer->by_txn_last_txn = NULL;
 
-	buffer->nr_cached_transactions = 0;
-	buffer->nr_cached_changes = 0;
-	buffer->nr_cached_tuplebufs = 0;
-
 	buffer->outbuf = NULL;
 	buffer->outbufsize = 0;
 
+	buffer->size = 0;
+	buffer->spillTxns = 0;
+	buffer->spillCount = 0;
+	buffer->spillBytes = 0;
+
 	buffer->current_restart_decoding_lsn = InvalidXLogRecPtr;
 
+	buffer->stream_start = NULL;
+	buffer->stream_stop = NULL;
+	buffer->stream_abort = NULL;
+	buffer->stream_threshold = 0;
+
 	dlist_init(&buffer->toplevel_by_lsn);
-	dlist_init(&buffer->cached_transactions);
-	dlist_init(&buffer->cached_changes);
-	slist_init(&buffer->cached_tuplebufs);
 
 	return buffer;
 }
@@ -283,26 +307,15 @@ ReorderBufferFree(ReorderBuffer *rb)
 }
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferTXN.
+ * Get a fresh ReorderBufferTXN.
  */
 static ReorderBufferTXN *
 ReorderBufferGetTXN(ReorderBuffer *rb)
 {
 	ReorderBufferTXN *txn;
 
-	/* check the slab cache */
-	if (rb->nr_cached_transactions > 0)
-	{
-		rb->nr_cached_transactions--;
-		txn = (ReorderBufferTXN *)
-			dlist_container(ReorderBufferTXN, node,
-							dlist_pop_head_node(&rb->cached_transactions));
-	}
-	else
-	{
-		txn = (ReorderBufferTXN *)
-			MemoryContextAlloc(rb->context, sizeof(ReorderBufferTXN));
-	}
+	txn = (ReorderBufferTXN *)
+		MemoryContextAlloc(rb->txn_context, sizeof(ReorderBufferTXN));
 
 	memset(txn, 0, sizeof(ReorderBufferTXN));
 
@@ -315,9 +328,6 @@ ReorderBufferGetTXN(ReorderBuffer *rb)
 
 /*
  * Free a ReorderBufferTXN.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 static void
 ReorderBufferReturnTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
@@ -343,41 +353,19 @@ ReorderBufferReturnTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		txn->invalidations = NULL;
 	}
 
-	/* check whether to put into the slab cache */
-	if (rb->nr_cached_transactions < max_cached_transactions)
-	{
-		rb->nr_cached_transactions++;
-		dlist_push_head(&rb->cached_transactions, &txn->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(txn, sizeof(ReorderBufferTXN));
-		VALGRIND_MAKE_MEM_DEFINED(&txn->node, sizeof(txn->node));
-	}
-	else
-	{
-		pfree(txn);
-	}
+	pfree(txn);
 }
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferChange.
+ * Get a fresh ReorderBufferChange.
  */
 ReorderBufferChange *
 ReorderBufferGetChange(ReorderBuffer *rb)
 {
 	ReorderBufferChange *change;
 
-	/* check the slab cache */
-	if (rb->nr_cached_changes)
-	{
-		rb->nr_cached_changes--;
-		change = (ReorderBufferChange *)
-			dlist_container(ReorderBufferChange, node,
-							dlist_pop_head_node(&rb->cached_changes));
-	}
-	else
-	{
-		change = (ReorderBufferChange *)
-			MemoryContextAlloc(rb->context, sizeof(ReorderBufferChange));
-	}
+	change = (ReorderBufferChange *)
+		MemoryContextAlloc(rb->change_context, sizeof(ReorderBufferChange));
 
 	memset(change, 0, sizeof(ReorderBufferChange));
 	return change;
@@ -385,13 +373,13 @@ ReorderBufferGetChange(ReorderBuffer *rb)
 
 /*
  * Free an ReorderBufferChange.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 void
 ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 {
+	/* the change no longer uses memory of its transaction */
+	ReorderBufferChangeMemoryRemove(rb, change);
+
 	/* free contained data */
 	switch (change->action)
 	{
@@ -433,24 +421,13 @@ ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 			break;
 	}
 
-	/* check whether to put into the slab cache */
-	if (rb->nr_cached_changes < max_cached_changes)
-	{
-		rb->nr_cached_changes++;
-		dlist_push_head(&rb->cached_changes, &change->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(change, sizeof(ReorderBufferChange));
-		VALGRIND_MAKE_MEM_DEFINED(&change->node, sizeof(change->node));
-	}
-	else
-	{
-		pfree(change);
-	}
+	pfree(change);
 }
 
 
 /*
- * Get an unused, possibly preallocated, ReorderBufferTupleBuf fitting at
- * least a tuple of size tuple_len (excluding header overhead).
+ * Get a fresh ReorderBufferTupleBuf fitting at least a tuple of size
+ * tuple_len (excluding header overhead).
  */
 ReorderBufferTupleBuf *
 ReorderBufferGetTupleBuf(ReorderBuffer *rb, Size tuple_len)
@@ -460,70 +437,23 @@ ReorderBufferGetTupleBuf(ReorderBuffer *rb, Size tuple_len)
 
 	alloc_len = tuple_len + SizeofHeapTupleHeader;
 
-	/*
-	 * Most tuples are below MaxHeapTupleSize, so we use a slab allocator for
-	 * those. Thus always allocate at least MaxHeapTupleSize. Note that tuples
-	 * generated for oldtuples can be bigger, as they don't have out-of-line
-	 * toast columns.
-	 */
-	if (alloc_len < MaxHeapTupleSize)
-		alloc_len = MaxHeapTupleSize;
-
-
-	/* if small enough, check the slab cache */
-	if (alloc_len <= MaxHeapTupleSize && rb->nr_cached_tuplebufs)
-	{
-		rb->nr_cached_tuplebufs--;
-		tuple = slist_container(ReorderBufferTupleBuf, node,
-								slist_pop_head_node(&rb->cached_tuplebufs));
-		Assert(tuple->alloc_tuple_size == MaxHeapTupleSize);
-#ifdef USE_ASSERT_CHECKING
-		memset(&tuple->tuple, 0xa9, sizeof(HeapTupleData));
-		VALGRIND_MAKE_MEM_UNDEFINED(&tuple->tuple, sizeof(HeapTupleData));
-#endif
-		tuple->tuple.t_data = ReorderBufferTupleBufData(tuple);
-#ifdef USE_ASSERT_CHECKING
-		memset(tuple->tuple.t_data, 0xa8, tuple->alloc_tuple_size);
-		VALGRIND_MAKE_MEM_UNDEFINED(tuple->tuple.t_data, tuple->alloc_tuple_size);
-#endif
-	}
-	else
-	{
-		tuple = (ReorderBufferTupleBuf *)
-			MemoryContextAlloc(rb->context,
-							   sizeof(ReorderBufferTupleBuf) +
-							   MAXIMUM_ALIGNOF + alloc_len);
-		tuple->alloc_tuple_size = alloc_len;
-		tuple->tuple.t_data = ReorderBufferTupleBufData(tuple);
-	}
+	tuple = (ReorderBufferTupleBuf *)
+		MemoryContextAlloc(rb->tup_context,
+						   sizeof(ReorderBufferTupleBuf) +
+						   MAXIMUM_ALIGNOF + alloc_len);
+	tuple->alloc_tuple_size = alloc_len;
+	tuple->tuple.t_data = ReorderBufferTupleBufData(tuple);
 
 	return tuple;
 }
 
 /*
  * Free an ReorderBufferTupleBuf.
- *
- * Deallocation might be delayed for efficiency purposes, for details check
- * the comments above max_cached_changes's definition.
  */
 void
 ReorderBufferReturnTupleBuf(ReorderBuffer *rb, ReorderBufferTupleBuf *tuple)
 {
-	/* check whether to put into the slab cache, oversized tuples never are */
-	if (tuple->alloc_tuple_size == MaxHeapTupleSize &&
-		rb->nr_cached_tuplebufs < max_cached_tuplebufs)
-	{
-		rb->nr_cached_tuplebufs++;
-		slist_push_head(&rb->cached_tuplebufs, &tuple->node);
-		VALGRIND_MAKE_MEM_UNDEFINED(tuple->tuple.t_data, tuple->alloc_tuple_size);
-		VALGRIND_MAKE_MEM_UNDEFINED(tuple, sizeof(ReorderBufferTupleBuf));
-		VALGRIND_MAKE_MEM_DEFINED(&tuple->node, sizeof(tuple->node));
-		VALGRIND_MAKE_MEM_DEFINED(&tuple->alloc_tuple_size, sizeof(tuple->alloc_tuple_size));
-	}
-	else
-	{
-		pfree(tuple);
-	}
+	pfree(tuple);
 }
 
 /*
@@ -628,8 +558,10 @@ ReorderBufferQueueChange(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn,
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries++;
 	txn->nentries_mem++;
+	ReorderBufferChangeMemoryAdd(rb, txn, change);
 
-	ReorderBufferCheckSerializeTXN(rb, txn);
+	ReorderBufferCheckStreamTXN(rb, txn, change);
+	ReorderBufferCheckMemoryLimit(rb);
 }
 
 /*
@@ -1357,10 +1289,6 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					RepOriginId origin_id, XLogRecPtr origin_lsn)
 {
 	ReorderBufferTXN *txn;
-	volatile Snapshot snapshot_now;
-	volatile CommandId command_id = FirstCommandId;
-	bool		using_subtxn;
-	ReorderBufferIterTXNState *volatile iterstate = NULL;
 
 	txn = ReorderBufferTXNByXid(rb, xid, false, NULL, InvalidXLogRecPtr,
 								false);
@@ -1386,11 +1314,33 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 	 */
 	if (txn->base_snapshot == NULL)
 	{
-		Assert(txn->ninvalidations == 0);
+		/* changes filtered by origin may still have touched the catalog */
+		if (txn->ninvalidations > 0)
+			ReorderBufferImmediateInvalidation(rb, txn->ninvalidations,
+											   txn->invalidations);
 		ReorderBufferCleanupTXN(rb, txn);
 		return;
 	}
 
+	ReorderBufferReplayTXN(rb, txn, commit_lsn, false);
+}
+
+/*
+ * Replay the changes of a transaction collected so far: either at commit
+ * (streaming is false) or ahead of commit when a large in-progress
+ * transaction is streamed. In the latter case the replayed changes are
+ * released, but the transaction itself is kept to collect further changes.
+ */
+static void
+ReorderBufferReplayTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+					   XLogRecPtr commit_lsn, bool streaming)
+{
+	volatile Snapshot snapshot_now;
+	volatile CommandId command_id = FirstCommandId;
+	bool		using_subtxn;
+	bool		accepted = true;
+	ReorderBufferIterTXNState *volatile iterstate = NULL;
+
 	snapshot_now = txn->base_snapshot;
 
 	/* build data to be able to lookup the CommandIds of catalog tuples */
@@ -1421,10 +1371,22 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		else
 			StartTransactionCommand();
 
-		rb->begin(rb, txn);
+		/*
+		 * Changes of a transaction which was already streamed are also
+		 * preceded by stream start, so that the plugin can distinguish them
+		 * from a new transaction.
+		 */
+		if (streaming)
+			accepted = rb->stream_start(rb, txn, !txn->streamed);
+		else if (txn->streamed)
+			(void) rb->stream_start(rb, txn, false);
+		else
+			rb->begin(rb, txn);
 
-		iterstate = ReorderBufferIterTXNInit(rb, txn);
-		while ((change = ReorderBufferIterTXNNext(rb, iterstate)) != NULL)
+		if (accepted)
+			iterstate = ReorderBufferIterTXNInit(rb, txn);
+		while (iterstate != NULL &&
+			   (change = ReorderBufferIterTXNNext(rb, iterstate)) != NULL)
 		{
 			Relation	relation = NULL;
 			Oid			reloid;
@@ -1648,11 +1610,20 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		}
 
 		/* clean up the iterator */
-		ReorderBufferIterTXNFinish(rb, iterstate);
+		if (iterstate)
+			ReorderBufferIterTXNFinish(rb, iterstate);
 		iterstate = NULL;
 
 		/* call commit callback */
-		rb->commit(rb, txn, commit_lsn);
+		if (!streaming)
+			rb->commit(rb, txn, commit_lsn);
+		else if (accepted)
+		{
+			rb->stream_stop(rb, txn);
+			txn->streamed = true;
+		}
+		else
+			txn->stream_disabled = true;
 
 		/* this is just a sanity check against bad output plugin behaviour */
 		if (GetCurrentTransactionIdIfAny() != InvalidTransactionId)
@@ -1679,8 +1650,14 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		if (snapshot_now->copied)
 			ReorderBufferFreeSnap(rb, snapshot_now);
 
-		/* remove potential on-disk data, and deallocate */
-		ReorderBufferCleanupTXN(rb, txn);
+		/*
+		 * Release streamed changes, or remove potential on-disk data and
+		 * deallocate.
+		 */
+		if (!streaming)
+			ReorderBufferCleanupTXN(rb, txn);
+		else if (accepted)
+			ReorderBufferTruncateTXN(rb, txn);
 	}
 	PG_CATCH();
 	{
@@ -1705,8 +1682,13 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		if (snapshot_now->copied)
 			ReorderBufferFreeSnap(rb, snapshot_now);
 
-		/* remove potential on-disk data, and deallocate */
-		ReorderBufferCleanupTXN(rb, txn);
+		/*
+		 * Remove potential on-disk data, and deallocate. Transaction being
+		 * streamed is still in progress, so keep it: decoding is restarted
+		 * after the error anyway.
+		 */
+		if (!streaming)
+			ReorderBufferCleanupTXN(rb, txn);
 
 		PG_RE_THROW();
 	}
@@ -1767,6 +1749,10 @@ ReorderBufferAbort(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/* cosmetic... */
 	txn->final_lsn = lsn;
 
+	/* let the receiver discard already streamed changes */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -1800,6 +1786,9 @@ ReorderBufferAbortOld(ReorderBuffer *rb, TransactionId oldestRunningXid)
 		{
 			elog(DEBUG2, "aborting old transaction %u", txn->xid);
 
+			if (txn->streamed)
+				rb->stream_abort(rb, txn, InvalidXLogRecPtr);
+
 			/* remove potential on-disk data, and deallocate this tx */
 			ReorderBufferCleanupTXN(rb, txn);
 		}
@@ -1839,13 +1828,17 @@ ReorderBufferForget(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/*
 	 * Process cache invalidation messages if there are any. Even if we're not
 	 * interested in the transaction's contents, it could have manipulated the
-	 * catalog and we need to update the caches according to that.
+	 * catalog and we need to update the caches according to that. This holds
+	 * for transactions without a base snapshot too, as changes filtered by
+	 * origin don't take one.
 	 */
-	if (txn->base_snapshot != NULL && txn->ninvalidations > 0)
+	if (txn->ninvalidations > 0)
 		ReorderBufferImmediateInvalidation(rb, txn->ninvalidations,
 										   txn->invalidations);
-	else
-		Assert(txn->ninvalidations == 0);
+
+	/* changes which were already streamed should not be applied */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
 
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
@@ -2105,22 +2098,215 @@ ReorderBufferSerializeReserve(ReorderBuffer *rb, Size sz)
 }
 
 /*
- * Check whether the transaction tx should spill its data to disk.
+ * Memory used by a change, including the data it points to.
+ */
+static Size
+ReorderBufferChangeSize(ReorderBufferChange *change)
+{
+	Size		sz = sizeof(ReorderBufferChange);
+
+	switch (change->action)
+	{
+			/* fall through these, they're all similar enough */
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		case REORDER_BUFFER_CHANGE_DELETE:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			if (change->data.tp.oldtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.oldtuple->alloc_tuple_size;
+			if (change->data.tp.newtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.newtuple->alloc_tuple_size;
+			break;
+		case REORDER_BUFFER_CHANGE_MESSAGE:
+			sz += strlen(change->data.msg.prefix) + 1 +
+				change->data.msg.message_size;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
+			sz += sizeof(SnapshotData) +
+				sizeof(TransactionId) * change->data.snapshot->xcnt +
+				sizeof(TransactionId) * change->data.snapshot->subxcnt;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+		case REORDER_BUFFER_CHANGE_INTERNAL_COMMAND_ID:
+		case REORDER_BUFFER_CHANGE_INTERNAL_TUPLECID:
+			/* ReorderBufferChange contains everything important */
+			break;
+	}
+
+	return sz;
+}
+
+/*
+ * Charge the memory of a change to the transaction it was just queued in.
  */
 static void
-ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+ReorderBufferChangeMemoryAdd(ReorderBuffer *rb, ReorderBufferTXN *txn,
+							 ReorderBufferChange *change)
 {
-	/*
-	 * TODO: improve accounting so we cheaply can take subtransactions into
-	 * account here.
-	 */
-	if (txn->nentries_mem >= max_changes_in_memory)
+	Assert(change->txn == NULL);
+
+	change->txn = txn;
+	change->size = ReorderBufferChangeSize(change);
+
+	txn->size += change->size;
+	rb->size += change->size;
+}
+
+/*
+ * Release the memory charged for a change, if any. The charged size is
+ * remembered in the change, since replay may modify its data in place.
+ */
+static void
+ReorderBufferChangeMemoryRemove(ReorderBuffer *rb, ReorderBufferChange *change)
+{
+	if (change->txn == NULL)
+		return;
+
+	Assert(change->txn->size >= change->size);
+	Assert(rb->size >= change->size);
+
+	change->txn->size -= change->size;
+	rb->size -= change->size;
+
+	change->txn = NULL;
+	change->size = 0;
+}
+
+/*
+ * Spill the largest transactions to disk until the memory used by the
+ * changes is back within logical_decoding_work_mem.
+ */
+static void
+ReorderBufferCheckMemoryLimit(ReorderBuffer *rb)
+{
+	while (rb->size >= (Size) logical_decoding_work_mem * 1024L)
 	{
+		ReorderBufferTXN *txn = ReorderBufferLargestTXN(rb);
+
 		ReorderBufferSerializeTXN(rb, txn);
+		Assert(txn->size == 0);
 		Assert(txn->nentries_mem == 0);
 	}
 }
 
+/*
+ * Find the (sub-)transaction whose in-memory changes use the most memory.
+ *
+ * This is a linear scan over all transactions, but it only happens when the
+ * memory limit is hit, and spilling the found transaction typically frees a
+ * large part of the budget.
+ */
+static ReorderBufferTXN *
+ReorderBufferLargestTXN(ReorderBuffer *rb)
+{
+	HASH_SEQ_STATUS hash_seq;
+	ReorderBufferTXNByIdEnt *ent;
+	ReorderBufferTXN *largest = NULL;
+
+	hash_seq_init(&hash_seq, rb->by_txn);
+	while ((ent = hash_seq_search(&hash_seq)) != NULL)
+	{
+		ReorderBufferTXN *txn = ent->txn;
+
+		if (largest == NULL || txn->size > largest->size)
+			largest = txn;
+	}
+
+	Assert(largest != NULL && largest->size > 0);
+
+	return largest;
+}
+
+/*
+ * Stream the changes of a large in-progress transaction to the output plugin,
+ * so that the receiver can start applying it before the commit record is
+ * decoded.
+ *
+ * Only toplevel transactions which neither modify the catalog nor have
+ * subtransactions are streamed: otherwise changes of not yet assigned
+ * subtransactions or catalog snapshots could be replayed out of order. Once
+ * such a transaction is detected, its remaining changes are decoded at commit
+ * as usual.
+ */
+static void
+ReorderBufferCheckStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+							ReorderBufferChange *change)
+{
+	if (rb->stream_threshold == 0 || txn->stream_disabled)
+		return;
+
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		case REORDER_BUFFER_CHANGE_DELETE:
+		case REORDER_BUFFER_CHANGE_MESSAGE:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			/* wait for the confirmation of speculative insertion */
+			return;
+		default:
+			/*
+			 * New snapshot or command id: streaming is not able to switch
+			 * snapshots in the middle of the transaction.
+			 */
+			txn->stream_disabled = true;
+			return;
+	}
+
+	if (txn->nentries < rb->stream_threshold)
+		return;
+
+	if (txn->is_known_as_subxact || txn->nsubtxns != 0 ||
+		txn->has_catalog_changes || txn->base_snapshot == NULL ||
+		!BackendXidIsPlainToplevel(txn->xid))
+	{
+		txn->stream_disabled = true;
+		return;
+	}
+
+	elog(DEBUG2, "stream " UINT64_FORMAT " changes of in-progress XID %u",
+		 txn->nentries, txn->xid);
+
+	/* changes spilled to disk are restored up to this position */
+	txn->final_lsn = change->lsn;
+
+	ReorderBufferReplayTXN(rb, txn, InvalidXLogRecPtr, true);
+}
+
+/*
+ * Release the changes of a transaction which were streamed to the output
+ * plugin. Toast chunks not yet assigned to a tuple stay in the toast hash.
+ */
+static void
+ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &txn->changes)
+	{
+		ReorderBufferChange *change;
+
+		change = dlist_container(ReorderBufferChange, node, iter.cur);
+
+		dlist_delete(&change->node);
+		ReorderBufferReturnChange(rb, change);
+	}
+
+	/* remove entries spilled to disk, new ones will be appended */
+	if (txn->serialized)
+	{
+		ReorderBufferRestoreCleanup(rb, txn);
+		txn->serialized = false;
+	}
+
+	txn->nentries = 0;
+	txn->nentries_mem = 0;
+}
+
 /*
  * Spill data of a large transaction (and its subtransactions) to disk.
  */
@@ -2134,8 +2320,8 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	Size		spilled = 0;
 	char		path[MAXPGPATH];
 
-	elog(DEBUG2, "spill %u changes in XID %u to disk",
-		 (uint32) txn->nentries_mem, txn->xid);
+	elog(DEBUG2, "spill %u changes (%zu bytes) in XID %u to disk",
+		 (uint32) txn->nentries_mem, txn->size, txn->xid);
 
 	/* do the same to all child TXs */
 	dlist_foreach(subtxn_i, &txn->subtxns)
@@ -2196,6 +2382,14 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 
 	Assert(spilled == txn->nentries_mem);
 	Assert(dlist_is_empty(&txn->changes));
+
+	if (spilled > 0)
+	{
+		if (!txn->serialized)
+			rb->spillTxns++;
+		rb->spillCount++;
+	}
+
 	txn->nentries_mem = 0;
 	txn->serialized = true;
 
@@ -2349,6 +2543,7 @@ ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 	}
 
 	ondisk->size = sz;
+	rb->spillBytes += sz;
 
 	if (write(fd, rb->outbuf, ondisk->size) != ondisk->size)
 	{
@@ -2515,6 +2710,10 @@ ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 	/* copy static part */
 	memcpy(change, &ondisk->change, sizeof(ReorderBufferChange));
 
+	/* the pointer written to disk is stale, accounting is redone below */
+	change->txn = NULL;
+	change->size = 0;
+
 	data += sizeof(ReorderBufferDiskChange);
 
 	/* restore individual stuff */
@@ -2628,6 +2827,7 @@ ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries_mem++;
+	ReorderBufferChangeMemoryAdd(rb, txn, change);
 }
 
 /*
@@ -2973,6 +3173,22 @@ ReorderBufferToastReplace(ReorderBuffer *rb, ReorderBufferTXN *txn,
 	Assert(newtup->tuple.t_len <= MaxHeapTupleSize);
 	Assert(ReorderBufferTupleBufData(newtup) == newtup->tuple.t_data);
 
+	/*
+	 * Tuple buffers are sized to fit the decoded tuple exactly, so get a
+	 * bigger one if the reconstructed tuple doesn't fit.
+	 */
+	if (tmphtup->t_len > newtup->alloc_tuple_size)
+	{
+		ReorderBufferTupleBuf *bigtup;
+
+		bigtup = ReorderBufferGetTupleBuf(rb,
+										  tmphtup->t_len - SizeofHeapTupleHeader);
+		bigtup->tuple.t_self = newtup->tuple.t_self;
+		bigtup->tuple.t_tableOid = newtup->tuple.t_tableOid;
+		ReorderBufferReturnTupleBuf(rb, newtup);
+		change->data.tp.newtuple = newtup = bigtup;
+	}
+
 	memcpy(newtup->tuple.t_data, tmphtup->t_data, tmphtup->t_len);
 	newtup->tuple.t_len = tmphtup->t_len;
 
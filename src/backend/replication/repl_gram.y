@@ -72,6 +72,8 @@ Node *replication_parse_result;
 %token K_MAX_RATE
 %token K_WAL
 %token K_TABLESPACE_MAP
+%token K_COMPRESSION
+%token K_COMPRESSION_LEVEL
 %token K_TIMELINE
 %token K_PHYSICAL
 %token K_LOGICAL
@@ -125,7 +127,8 @@ identify_system:
 
 /*
  * BASE_BACKUP [LABEL '<label>'] [PROGRESS] [FAST] [WAL] [NOWAIT]
- * [MAX_RATE %d] [TABLESPACE_MAP]
+ * [MAX_RATE %d] [TABLESPACE_MAP] [COMPRESSION '<method>']
+ * [COMPRESSION_LEVEL %d]
  */
 base_backup:
 			K_BASE_BACKUP base_backup_opt_list
@@ -180,6 +183,16 @@ base_backup_opt:
 				  $$ = makeDefElem("tablespace_map",
 								   (Node *)makeInteger(TRUE));
 				}
+			| K_COMPRESSION SCONST
+				{
+				  $$ = makeDefElem("compression",
+								   (Node *)makeString($2));
+				}
+			| K_COMPRESSION_LEVEL UCONST
+				{
+				  $$ = makeDefElem("compression_level",
+								   (Node *)makeInteger($2));
+				}
 			;
 
 create_replication_slot:
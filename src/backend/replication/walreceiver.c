@@ -57,11 +57,13 @@
 #include "miscadmin.h"
 #include "replication/walreceiver.h"
 #include "replication/walsender.h"
+#include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/pmsignal.h"
 #include "storage/procarray.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/pg_lsn.h"
 #include "utils/ps_status.h"
 #include "utils/resowner.h"
@@ -72,6 +74,7 @@
 int			wal_receiver_status_interval;
 int			wal_receiver_timeout;
 bool		hot_standby_feedback;
+int			wal_receiver_buffer_size;
 
 /* libpqreceiver hooks to these when loaded */
 walrcv_connect_type walrcv_connect = NULL;
@@ -116,6 +119,17 @@ static struct
 static StringInfoData reply_message;
 static StringInfoData incoming_message;
 
+/*
+ * Received WAL that is not written out yet.  Consecutive WAL messages are
+ * collected here, so that a burst of small messages costs a few large writes
+ * instead of a write per message.  The buffered data never crosses a segment
+ * boundary, and it is written out before every flush.
+ */
+static char *recvBuf = NULL;
+static Size recvBufSize = 0;
+static Size recvBufLen = 0;
+static XLogRecPtr recvBufStart = InvalidXLogRecPtr;
+
 /*
  * About SIGTERM handling:
  *
@@ -142,6 +156,8 @@ static void WalRcvFetchTimeLineHistoryFiles(TimeLineID first, TimeLineID last);
 static void WalRcvWaitForStartPosition(XLogRecPtr *startpoint, TimeLineID *startpointTLI);
 static void WalRcvDie(int code, Datum arg);
 static void XLogWalRcvProcessMsg(unsigned char type, char *buf, Size len);
+static void XLogWalRcvBufferWrite(char *buf, Size nbytes, XLogRecPtr recptr);
+static void XLogWalRcvWriteBuffered(bool startWriteback);
 static void XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr);
 static void XLogWalRcvFlush(bool dying);
 static void XLogWalRcvSendReply(bool force, bool requestReply);
@@ -885,7 +901,7 @@ XLogWalRcvProcessMsg(unsigned char type, char *buf, Size len)
 
 				buf += hdrlen;
 				len -= hdrlen;
-				XLogWalRcvWrite(buf, len, dataStart);
+				XLogWalRcvBufferWrite(buf, len, dataStart);
 				break;
 			}
 		case 'k':				/* Keepalive */
@@ -919,6 +935,73 @@ XLogWalRcvProcessMsg(unsigned char type, char *buf, Size len)
 	}
 }
 
+/*
+ * Queue XLOG data for writing to disk.
+ *
+ * The data is appended to the write buffer if it directly follows the
+ * buffered data in the same segment, otherwise the buffer is written out
+ * first.  Data that doesn't fit into an empty buffer is written directly.
+ */
+static void
+XLogWalRcvBufferWrite(char *buf, Size nbytes, XLogRecPtr recptr)
+{
+	Size		bufsize = (Size) wal_receiver_buffer_size * 1024;
+
+	if (nbytes == 0)
+		return;
+
+	if (recvBufLen > 0 &&
+		(recptr != recvBufStart + recvBufLen ||
+		 recvBufLen + nbytes > recvBufSize ||
+		 !XLByteInSeg(recptr + nbytes - 1, recvBufStart / XLogSegSize)))
+		XLogWalRcvWriteBuffered(true);
+
+	/* wal_receiver_buffer_size may have been changed by a reload */
+	if (recvBufLen == 0 && recvBufSize != bufsize)
+	{
+		if (recvBuf != NULL)
+			pfree(recvBuf);
+		recvBuf = bufsize > 0 ? MemoryContextAlloc(TopMemoryContext, bufsize) : NULL;
+		recvBufSize = bufsize;
+	}
+
+	if (recvBufLen + nbytes > recvBufSize ||
+		!XLByteInSeg(recptr + nbytes - 1, recptr / XLogSegSize))
+	{
+		Assert(recvBufLen == 0);
+		XLogWalRcvWrite(buf, nbytes, recptr);
+		return;
+	}
+
+	if (recvBufLen == 0)
+		recvBufStart = recptr;
+	memcpy(recvBuf + recvBufLen, buf, nbytes);
+	recvBufLen += nbytes;
+}
+
+/*
+ * Write out the buffered XLOG data.
+ *
+ * If 'startWriteback' is set, more data is expected to follow before the next
+ * flush, so ask the kernel to start writing the data back now; the fsync in
+ * XLogWalRcvFlush then has less left to do.
+ */
+static void
+XLogWalRcvWriteBuffered(bool startWriteback)
+{
+	Size		nbytes = recvBufLen;
+
+	if (nbytes == 0)
+		return;
+
+	/* A segment switch in XLogWalRcvWrite flushes, which comes back here */
+	recvBufLen = 0;
+	XLogWalRcvWrite(recvBuf, nbytes, recvBufStart);
+
+	if (startWriteback)
+		pg_flush_data(recvFile, (off_t) (recvOff - nbytes), (off_t) nbytes);
+}
+
 /*
  * Write XLOG data to disk.
  */
@@ -1023,6 +1106,11 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 
 		LogstreamResult.Write = recptr;
 	}
+
+	/* Update shared-memory status */
+	SpinLockAcquire(&WalRcv->mutex);
+	WalRcv->writtenUpto = LogstreamResult.Write;
+	SpinLockRelease(&WalRcv->mutex);
 }
 
 /*
@@ -1034,6 +1122,8 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 static void
 XLogWalRcvFlush(bool dying)
 {
+	XLogWalRcvWriteBuffered(false);
+
 	if (LogstreamResult.Flush < LogstreamResult.Write)
 	{
 		WalRcvData *walrcv = WalRcv;
@@ -1345,6 +1435,7 @@ pg_stat_get_wal_receiver(PG_FUNCTION_ARGS)
 	TimeLineID	receive_start_tli;
 	XLogRecPtr	received_lsn;
 	TimeLineID	received_tli;
+	XLogRecPtr	written_lsn;
 	TimestampTz last_send_time;
 	TimestampTz last_receipt_time;
 	XLogRecPtr	latest_end_lsn;
@@ -1373,6 +1464,7 @@ pg_stat_get_wal_receiver(PG_FUNCTION_ARGS)
 	receive_start_tli = walrcv->receiveStartTLI;
 	received_lsn = walrcv->receivedUpto;
 	received_tli = walrcv->receivedTLI;
+	written_lsn = walrcv->writtenUpto;
 	last_send_time = walrcv->lastMsgSendTime;
 	last_receipt_time = walrcv->lastMsgReceiptTime;
 	latest_end_lsn = walrcv->latestWalEnd;
@@ -1430,6 +1522,10 @@ pg_stat_get_wal_receiver(PG_FUNCTION_ARGS)
 			nulls[11] = true;
 		else
 			values[11] = CStringGetTextDatum(conninfo);
+		if (XLogRecPtrIsInvalid(written_lsn))
+			nulls[12] = true;
+		else
+			values[12] = LSNGetDatum(written_lsn);
 	}
 
 	/* Returns the record as Datum */
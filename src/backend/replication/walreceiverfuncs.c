@@ -264,13 +264,15 @@ RequestXLogStreaming(TimeLineID tli, XLogRecPtr recptr, const char *conninfo,
 
 	/*
 	 * If this is the first startup of walreceiver (on this timeline),
-	 * initialize receivedUpto and latestChunkStart to the starting point.
+	 * initialize receivedUpto, latestChunkStart and writtenUpto to the
+	 * starting point.
 	 */
 	if (walrcv->receiveStart == 0 || walrcv->receivedTLI != tli)
 	{
 		walrcv->receivedUpto = recptr;
 		walrcv->receivedTLI = tli;
 		walrcv->latestChunkStart = recptr;
+		walrcv->writtenUpto = recptr;
 	}
 	walrcv->receiveStart = recptr;
 	walrcv->receiveStartTLI = tli;
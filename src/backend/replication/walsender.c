@@ -114,6 +114,10 @@ bool		am_db_walsender = false;	/* Connected to a database? */
 int			max_wal_senders = 0;	/* the maximum number of concurrent walsenders */
 int			wal_sender_timeout = 60 * 1000;		/* maximum time to send one
 												 * WAL data message */
+int			wal_sender_batch_size = 64; /* flush logical output once this
+										 * many kB are buffered */
+int			wal_sender_batch_delay = 0; /* maximum time to keep decoding
+										 * before flushing output */
 bool		log_replication_commands = false;
 
 /*
@@ -175,6 +179,14 @@ static bool streamingDoneReceiving;
 /* Are we there yet? */
 static bool WalSndCaughtUp = false;
 
+/* Bytes queued in the output buffer since it was last completely flushed */
+static Size batch_bytes = 0;
+
+/* Output statistics, advertised in MyWalSnd together with sentPtr */
+static int64 sentMessages = 0;
+static int64 sentBytes = 0;
+static int64 sentFlushes = 0;
+
 /* Flags set by signal handlers for later service in main loop */
 static volatile sig_atomic_t got_SIGUSR2 = false;
 static volatile sig_atomic_t got_STOPPING = false;
@@ -190,6 +202,33 @@ static volatile sig_atomic_t replication_active = false;
 static LogicalDecodingContext *logical_decoding_ctx = NULL;
 static XLogRecPtr logical_startptr = InvalidXLogRecPtr;
 
+/*
+ * A sample associating a WAL location with the time it was sent.
+ */
+typedef struct
+{
+	XLogRecPtr	lsn;
+	TimestampTz time;
+} WalTimeSample;
+
+/* The size of our buffer of time samples. */
+#define LAG_TRACKER_BUFFER_SIZE 8192
+
+/*
+ * A mechanism for tracking replication lag.  Physical walsenders remember
+ * when each WAL location was sent; when the standby reports that it has
+ * written, flushed or applied WAL up to some location, the lag is the time
+ * since that location was sent.  There is a read head per reported position.
+ */
+static struct
+{
+	XLogRecPtr	last_lsn;
+	WalTimeSample buffer[LAG_TRACKER_BUFFER_SIZE];
+	int			write_head;
+	int			read_heads[NUM_SYNC_REP_WAIT_MODE];
+	WalTimeSample last_read[NUM_SYNC_REP_WAIT_MODE];
+}	LagTracker;
+
 /* Signal handlers */
 static void WalSndLastCycleHandler(SIGNAL_ARGS);
 
@@ -198,6 +237,8 @@ typedef void (*WalSndSendDataCallback) (void);
 static void WalSndLoop(WalSndSendDataCallback send_data);
 static void InitWalSenderSlot(void);
 static void WalSndKill(int code, Datum arg);
+static void WalSndFlush(void);
+static bool WalSndContinueBatch(TimestampTz batch_start);
 static void WalSndShutdown(void) pg_attribute_noreturn();
 static void XLogSendPhysical(void);
 static void XLogSendLogical(void);
@@ -222,6 +263,9 @@ static XLogRecPtr WalSndWaitForWal(XLogRecPtr loc);
 
 static void XLogRead(char *buf, XLogRecPtr startptr, Size count);
 
+static void LagTrackerWrite(XLogRecPtr lsn, TimestampTz local_flush_time);
+static int64 LagTrackerRead(int head, XLogRecPtr lsn, TimestampTz now);
+
 
 /* Initialize walsender process before entering the main command loop */
 void
@@ -232,6 +276,9 @@ InitWalSender(void)
 	/* Create a per-walsender data structure in shared memory */
 	InitWalSenderSlot();
 
+	/* Initialize empty timestamp buffer for lag tracking. */
+	memset(&LagTracker, 0, sizeof(LagTracker));
+
 	/* Set up resource owner */
 	CurrentResourceOwner = ResourceOwnerCreate(NULL, "walsender top-level resource owner");
 
@@ -1078,9 +1125,6 @@ static void
 WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 				bool last_write)
 {
-	/* output previously gathered data in a CopyData packet */
-	pq_putmessage_noblock('d', ctx->out->data, ctx->out->len);
-
 	/*
 	 * Fill the send timestamp last, so that it is taken as late as possible.
 	 * This is somewhat ugly, but the protocol's set as it's already used for
@@ -1091,10 +1135,23 @@ WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 	memcpy(&ctx->out->data[1 + sizeof(int64) + sizeof(int64)],
 		   tmpbuf.data, sizeof(int64));
 
+	/* output previously gathered data in a CopyData packet */
+	pq_putmessage_noblock('d', ctx->out->data, ctx->out->len);
+
+	sentMessages++;
+	sentBytes += ctx->out->len;
+	batch_bytes += ctx->out->len;
+
+	/*
+	 * Leave the message in the output buffer until the batch is full. The
+	 * rest is flushed by WalSndLoop once XLogSendLogical is done.
+	 */
+	if (batch_bytes < (Size) wal_sender_batch_size * 1024)
+		return;
+
 	/* fast path */
 	/* Try to flush pending output to the client */
-	if (pq_flush_if_writable() != 0)
-		WalSndShutdown();
+	WalSndFlush();
 
 	if (!pq_is_send_pending())
 		return;
@@ -1129,8 +1186,7 @@ WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 		ProcessRepliesIfAny();
 
 		/* Try to flush pending output to the client */
-		if (pq_flush_if_writable() != 0)
-			WalSndShutdown();
+		WalSndFlush();
 
 		/* If we finished clearing the buffered data, we're done here. */
 		if (!pq_is_send_pending())
@@ -1266,8 +1322,7 @@ WalSndWaitForWal(XLogRecPtr loc)
 		/*
 		 * Try to flush any pending output to the client.
 		 */
-		if (pq_flush_if_writable() != 0)
-			WalSndShutdown();
+		WalSndFlush();
 
 		/*
 		 * If we have received CopyDone from the client, sent CopyDone
@@ -1598,6 +1653,13 @@ ProcessStandbyReplyMessage(void)
 				flushPtr,
 				applyPtr;
 	bool		replyRequested;
+	int64		writeLag,
+				flushLag,
+				applyLag;
+	bool		clearLagTimes;
+	TimestampTz now;
+
+	static bool fullyAppliedLastTime = false;
 
 	/* the caller already consumed the msgtype byte */
 	writePtr = pq_getmsgint64(&reply_message);
@@ -1612,6 +1674,30 @@ ProcessStandbyReplyMessage(void)
 		 (uint32) (applyPtr >> 32), (uint32) applyPtr,
 		 replyRequested ? " (reply requested)" : "");
 
+	/* See if we can compute the round-trip lag for these positions. */
+	now = GetCurrentTimestamp();
+	writeLag = LagTrackerRead(SYNC_REP_WAIT_WRITE, writePtr, now);
+	flushLag = LagTrackerRead(SYNC_REP_WAIT_FLUSH, flushPtr, now);
+	applyLag = LagTrackerRead(SYNC_REP_WAIT_APPLY, applyPtr, now);
+
+	/*
+	 * If the standby reports that it has fully replayed the WAL in two
+	 * consecutive reply messages, then the second such message must result
+	 * from wal_receiver_status_interval expiring on the standby.  This is a
+	 * convenient time to forget the lag times measured when it last
+	 * wrote/flushed/applied a WAL record, to avoid displaying stale lag data
+	 * until more WAL traffic arrives.
+	 */
+	clearLagTimes = false;
+	if (applyPtr == sentPtr)
+	{
+		if (fullyAppliedLastTime)
+			clearLagTimes = true;
+		fullyAppliedLastTime = true;
+	}
+	else
+		fullyAppliedLastTime = false;
+
 	/* Send a reply if the standby requested one. */
 	if (replyRequested)
 		WalSndKeepalive(false);
@@ -1627,6 +1713,12 @@ ProcessStandbyReplyMessage(void)
 		walsnd->write = writePtr;
 		walsnd->flush = flushPtr;
 		walsnd->apply = applyPtr;
+		if (writeLag != -1 || clearLagTimes)
+			walsnd->writeLag = writeLag;
+		if (flushLag != -1 || clearLagTimes)
+			walsnd->flushLag = flushLag;
+		if (applyLag != -1 || clearLagTimes)
+			walsnd->applyLag = applyLag;
 		SpinLockRelease(&walsnd->mutex);
 	}
 
@@ -1904,8 +1996,7 @@ WalSndLoop(WalSndSendDataCallback send_data)
 			WalSndCaughtUp = false;
 
 		/* Try to flush pending output to the client */
-		if (pq_flush_if_writable() != 0)
-			WalSndShutdown();
+		WalSndFlush();
 
 		/* If nothing remains to be sent right now ... */
 		if (WalSndCaughtUp && !pq_is_send_pending())
@@ -2012,6 +2103,15 @@ InitWalSenderSlot(void)
 			walsnd->write = InvalidXLogRecPtr;
 			walsnd->flush = InvalidXLogRecPtr;
 			walsnd->apply = InvalidXLogRecPtr;
+			walsnd->spillTxns = 0;
+			walsnd->spillCount = 0;
+			walsnd->spillBytes = 0;
+			walsnd->sentMessages = 0;
+			walsnd->sentBytes = 0;
+			walsnd->sentFlushes = 0;
+			walsnd->writeLag = -1;
+			walsnd->flushLag = -1;
+			walsnd->applyLag = -1;
 			walsnd->state = WALSNDSTATE_STARTUP;
 			walsnd->latch = &MyProc->procLatch;
 			SpinLockRelease(&walsnd->mutex);
@@ -2415,6 +2515,12 @@ XLogSendPhysical(void)
 	nbytes = endptr - startptr;
 	Assert(nbytes <= MAX_SEND_SIZE);
 
+	/*
+	 * Record the current system time as an approximation of the time at
+	 * which this WAL location was written for the purposes of lag tracking.
+	 */
+	LagTrackerWrite(SendRqstPtr, GetCurrentTimestamp());
+
 	/*
 	 * OK to read and send the slice.
 	 */
@@ -2444,6 +2550,9 @@ XLogSendPhysical(void)
 
 	pq_putmessage_noblock('d', output_message.data, output_message.len);
 
+	sentMessages++;
+	sentBytes += output_message.len;
+
 	sentPtr = endptr;
 
 	/* Update shared memory status */
@@ -2452,6 +2561,9 @@ XLogSendPhysical(void)
 
 		SpinLockAcquire(&walsnd->mutex);
 		walsnd->sentPtr = sentPtr;
+		walsnd->sentMessages = sentMessages;
+		walsnd->sentBytes = sentBytes;
+		walsnd->sentFlushes = sentFlushes;
 		SpinLockRelease(&walsnd->mutex);
 	}
 
@@ -2476,6 +2588,7 @@ XLogSendLogical(void)
 {
 	XLogRecord *record;
 	char	   *errm;
+	TimestampTz batch_start = GetCurrentTimestamp();
 
 	/*
 	 * Don't know whether we've caught up yet. We'll set it to true in
@@ -2485,50 +2598,120 @@ XLogSendLogical(void)
 	 */
 	WalSndCaughtUp = false;
 
-	record = XLogReadRecord(logical_decoding_ctx->reader, logical_startptr, &errm);
-	logical_startptr = InvalidXLogRecPtr;
+	/*
+	 * Decode records until the output batch is complete, so that the output
+	 * of several small transactions is flushed together.
+	 */
+	do
+	{
+		CHECK_FOR_INTERRUPTS();
 
-	/* xlog record was invalid */
-	if (errm != NULL)
-		elog(ERROR, "%s", errm);
+		record = XLogReadRecord(logical_decoding_ctx->reader, logical_startptr, &errm);
+		logical_startptr = InvalidXLogRecPtr;
 
-	if (record != NULL)
-	{
-		LogicalDecodingProcessRecord(logical_decoding_ctx, logical_decoding_ctx->reader);
+		/* xlog record was invalid */
+		if (errm != NULL)
+			elog(ERROR, "%s", errm);
 
-		sentPtr = logical_decoding_ctx->reader->EndRecPtr;
-	}
-	else
-	{
-		/*
-		 * If the record we just wanted read is at or beyond the flushed
-		 * point, then we're caught up.
-		 */
-		if (logical_decoding_ctx->reader->EndRecPtr >= GetFlushRecPtr())
+		if (record != NULL)
 		{
-			WalSndCaughtUp = true;
+			LogicalDecodingProcessRecord(logical_decoding_ctx, logical_decoding_ctx->reader);
 
+			sentPtr = logical_decoding_ctx->reader->EndRecPtr;
+		}
+		else
+		{
 			/*
-			 * Have WalSndLoop() terminate the connection in an orderly
-			 * manner, after writing out all the pending data.
+			 * If the record we just wanted read is at or beyond the flushed
+			 * point, then we're caught up.
 			 */
-			if (got_STOPPING)
-				got_SIGUSR2 = true;
+			if (logical_decoding_ctx->reader->EndRecPtr >= GetFlushRecPtr())
+			{
+				WalSndCaughtUp = true;
 
-			LogicalDecodingCaughtUp(logical_decoding_ctx);
+				/*
+				 * Have WalSndLoop() terminate the connection in an orderly
+				 * manner, after writing out all the pending data.
+				 */
+				if (got_STOPPING)
+					got_SIGUSR2 = true;
+
+				LogicalDecodingCaughtUp(logical_decoding_ctx);
+			}
+			break;
 		}
-	}
+	} while (WalSndContinueBatch(batch_start));
 
 	/* Update shared memory status */
 	{
 		WalSnd	   *walsnd = MyWalSnd;
+		ReorderBuffer *rb = logical_decoding_ctx->reorder;
 
 		SpinLockAcquire(&walsnd->mutex);
 		walsnd->sentPtr = sentPtr;
+		walsnd->spillTxns = rb->spillTxns;
+		walsnd->spillCount = rb->spillCount;
+		walsnd->spillBytes = rb->spillBytes;
+		walsnd->sentMessages = sentMessages;
+		walsnd->sentBytes = sentBytes;
+		walsnd->sentFlushes = sentFlushes;
 		SpinLockRelease(&walsnd->mutex);
 	}
 }
 
+/*
+ * Should XLogSendLogical decode another record before returning to
+ * WalSndLoop, which flushes the output and processes replies?
+ *
+ * Decoding continues for at most wal_sender_batch_delay, and only while
+ * there's more WAL to decode, the output batch isn't full and nothing else
+ * needs attention.  The batch also ends after a PREPARE record: the origin
+ * of a two-phase transaction waits for the prepare to be applied by the
+ * receiving side, so its output shouldn't wait for unrelated changes.
+ */
+static bool
+WalSndContinueBatch(TimestampTz batch_start)
+{
+	XLogReaderState *reader = logical_decoding_ctx->reader;
+
+	if (wal_sender_batch_delay <= 0 || wal_sender_batch_size <= 0)
+		return false;
+
+	if (XLogRecGetRmid(reader) == RM_XACT_ID &&
+		(XLogRecGetInfo(reader) & XLOG_XACT_OPMASK) == XLOG_XACT_PREPARE)
+		return false;
+
+	if (WalSndCaughtUp || got_SIGUSR2 || got_STOPPING || ConfigReloadPending ||
+		streamingDoneReceiving)
+		return false;
+
+	/* the socket didn't take the last flush, so wait in WalSndLoop */
+	if (pq_is_send_pending() && batch_bytes >= (Size) wal_sender_batch_size * 1024)
+		return false;
+
+	return !TimestampDifferenceExceeds(batch_start, GetCurrentTimestamp(),
+									   wal_sender_batch_delay);
+}
+
+/*
+ * Try to flush pending output to the client, shutting down if the connection
+ * is broken.
+ */
+static void
+WalSndFlush(void)
+{
+	if (pq_is_send_pending())
+	{
+		if (pq_flush_if_writable() != 0)
+			WalSndShutdown();
+
+		sentFlushes++;
+	}
+
+	if (!pq_is_send_pending())
+		batch_bytes = 0;
+}
+
 /*
  * Shutdown if the sender is caught up.
  *
@@ -2866,6 +3049,23 @@ WalSndGetStateString(WalSndState state)
 }
 
 
+/*
+ * Convert a lag in microseconds to an interval.
+ */
+static Interval *
+lag_to_interval(int64 lag)
+{
+	Interval   *result = palloc0(sizeof(Interval));
+
+#ifdef HAVE_INT64_TIMESTAMP
+	result->time = lag;
+#else
+	result->time = (double) lag / USECS_PER_SEC;
+#endif
+
+	return result;
+}
+
 /*
  * Returns activity of walsenders, including pids and xlog locations sent to
  * standby servers.
@@ -2873,7 +3073,7 @@ WalSndGetStateString(WalSndState state)
 Datum
 pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 {
-#define PG_STAT_GET_WAL_SENDERS_COLS	8
+#define PG_STAT_GET_WAL_SENDERS_COLS	17
 	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
 	TupleDesc	tupdesc;
 	Tuplestorestate *tupstore;
@@ -2922,6 +3122,15 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 		XLogRecPtr	flush;
 		XLogRecPtr	apply;
 		int			priority;
+		int64		spillTxns;
+		int64		spillCount;
+		int64		spillBytes;
+		int64		messages;
+		int64		bytes;
+		int64		flushes;
+		int64		writeLag;
+		int64		flushLag;
+		int64		applyLag;
 		WalSndState state;
 		Datum		values[PG_STAT_GET_WAL_SENDERS_COLS];
 		bool		nulls[PG_STAT_GET_WAL_SENDERS_COLS];
@@ -2936,6 +3145,15 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 		flush = walsnd->flush;
 		apply = walsnd->apply;
 		priority = walsnd->sync_standby_priority;
+		spillTxns = walsnd->spillTxns;
+		spillCount = walsnd->spillCount;
+		spillBytes = walsnd->spillBytes;
+		messages = walsnd->sentMessages;
+		bytes = walsnd->sentBytes;
+		flushes = walsnd->sentFlushes;
+		writeLag = walsnd->writeLag;
+		flushLag = walsnd->flushLag;
+		applyLag = walsnd->applyLag;
 		SpinLockRelease(&walsnd->mutex);
 
 		memset(nulls, 0, sizeof(nulls));
@@ -2988,6 +3206,28 @@ pg_stat_get_wal_senders(PG_FUNCTION_ARGS)
 				values[7] = CStringGetTextDatum("sync");
 			else
 				values[7] = CStringGetTextDatum("potential");
+
+			values[8] = Int64GetDatum(spillTxns);
+			values[9] = Int64GetDatum(spillCount);
+			values[10] = Int64GetDatum(spillBytes);
+			values[11] = Int64GetDatum(messages);
+			values[12] = Int64GetDatum(bytes);
+			values[13] = Int64GetDatum(flushes);
+
+			if (writeLag < 0)
+				nulls[14] = true;
+			else
+				values[14] = IntervalPGetDatum(lag_to_interval(writeLag));
+
+			if (flushLag < 0)
+				nulls[15] = true;
+			else
+				values[15] = IntervalPGetDatum(lag_to_interval(flushLag));
+
+			if (applyLag < 0)
+				nulls[16] = true;
+			else
+				values[16] = IntervalPGetDatum(lag_to_interval(applyLag));
 		}
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
@@ -3051,7 +3291,175 @@ WalSndKeepaliveIfNecessary(TimestampTz now)
 		waiting_for_ping_response = true;
 
 		/* Try to flush pending output to the client */
-		if (pq_flush_if_writable() != 0)
-			WalSndShutdown();
+		WalSndFlush();
 	}
 }
+
+/*
+ * Record the end of the WAL and the time it was flushed locally, so that
+ * LagTrackerRead can compute the elapsed time (lag) when this WAL location is
+ * eventually reported to have been written, flushed and applied by the
+ * standby in a reply message.
+ */
+static void
+LagTrackerWrite(XLogRecPtr lsn, TimestampTz local_flush_time)
+{
+	bool		buffer_full;
+	int			new_write_head;
+	int			i;
+
+	if (!am_walsender)
+		return;
+
+	/*
+	 * If the lsn hasn't advanced since last time, then do nothing.  This way
+	 * we only record a new sample when new WAL has been written.
+	 */
+	if (LagTracker.last_lsn == lsn)
+		return;
+	LagTracker.last_lsn = lsn;
+
+	/*
+	 * If advancing the write head of the circular buffer would crash into any
+	 * of the read heads, then the buffer is full.  In other words, the
+	 * slowest reader (presumably apply) is the one that controls the release
+	 * of space.
+	 */
+	new_write_head = (LagTracker.write_head + 1) % LAG_TRACKER_BUFFER_SIZE;
+	buffer_full = false;
+	for (i = 0; i < NUM_SYNC_REP_WAIT_MODE; ++i)
+	{
+		if (new_write_head == LagTracker.read_heads[i])
+			buffer_full = true;
+	}
+
+	/*
+	 * If the buffer is full, for now we just rewind by one slot and overwrite
+	 * the last sample, as a simple (if somewhat uneven) way to lower the
+	 * sampling rate.  There may be better adaptive compaction algorithms.
+	 */
+	if (buffer_full)
+	{
+		new_write_head = LagTracker.write_head;
+		if (LagTracker.write_head > 0)
+			LagTracker.write_head--;
+		else
+			LagTracker.write_head = LAG_TRACKER_BUFFER_SIZE - 1;
+	}
+
+	/* Store a sample at the current write head position. */
+	LagTracker.buffer[LagTracker.write_head].lsn = lsn;
+	LagTracker.buffer[LagTracker.write_head].time = local_flush_time;
+	LagTracker.write_head = new_write_head;
+}
+
+/*
+ * Find out how much time has elapsed between the moment WAL location 'lsn'
+ * (or the highest known earlier LSN) was sent and the time 'now'.  We have a
+ * separate read head for each of the reported LSN locations we receive in
+ * replies from the standby, so that we can compute write, flush and apply
+ * lag times.  Return the lag in microseconds, or -1 if no new sample data is
+ * available.  This allows callers to retain the previous values when
+ * unchanged lag is reported.
+ */
+static int64
+LagTrackerRead(int head, XLogRecPtr lsn, TimestampTz now)
+{
+	TimestampTz time = 0;
+
+	/* Read all unread samples up to this LSN or end of buffer. */
+	while (LagTracker.read_heads[head] != LagTracker.write_head &&
+		   LagTracker.buffer[LagTracker.read_heads[head]].lsn <= lsn)
+	{
+		time = LagTracker.buffer[LagTracker.read_heads[head]].time;
+		LagTracker.last_read[head] =
+			LagTracker.buffer[LagTracker.read_heads[head]];
+		LagTracker.read_heads[head] =
+			(LagTracker.read_heads[head] + 1) % LAG_TRACKER_BUFFER_SIZE;
+	}
+
+	/*
+	 * If the lag tracker is empty, that means the standby has processed
+	 * everything we've ever sent so we should now clear 'last_read'.  If we
+	 * didn't do that, we'd risk using a stale and irrelevant sample for
+	 * interpolation at the beginning of the next burst of WAL after a period
+	 * of idleness.
+	 */
+	if (LagTracker.read_heads[head] == LagTracker.write_head)
+		LagTracker.last_read[head].time = 0;
+
+	if (time > now)
+	{
+		/* If the clock somehow went backwards, treat as not found. */
+		return -1;
+	}
+	else if (time == 0)
+	{
+		/*
+		 * We didn't cross a time.  If there is a future sample that we
+		 * haven't reached yet, and we've already reached at least one sample,
+		 * let's interpolate the local flushed time.  This is mainly useful
+		 * for reporting a completely stuck apply position as having
+		 * increasing lag, since otherwise we'd have to wait for it to
+		 * eventually start moving again and cross one of our samples before
+		 * we can show the lag increasing.
+		 */
+		if (LagTracker.read_heads[head] == LagTracker.write_head)
+		{
+			/* There are no future samples, so we can't interpolate. */
+			return -1;
+		}
+		else if (LagTracker.last_read[head].time != 0)
+		{
+			/* We can interpolate between last_read and the next sample. */
+			double		fraction;
+			WalTimeSample prev = LagTracker.last_read[head];
+			WalTimeSample next = LagTracker.buffer[LagTracker.read_heads[head]];
+
+			if (lsn < prev.lsn)
+			{
+				/*
+				 * Reported LSNs shouldn't normally go backwards, but it's
+				 * possible when there is a timeline change.  Treat as not
+				 * found.
+				 */
+				return -1;
+			}
+
+			Assert(prev.lsn < next.lsn);
+
+			if (prev.time > next.time)
+			{
+				/* If the clock somehow went backwards, treat as not found. */
+				return -1;
+			}
+
+			/* See how far we are between the previous and next samples. */
+			fraction =
+				(double) (lsn - prev.lsn) / (double) (next.lsn - prev.lsn);
+
+			/* Scale the local flush time proportionally. */
+			time = (TimestampTz)
+				((double) prev.time + (next.time - prev.time) * fraction);
+		}
+		else
+		{
+			/*
+			 * We have only a future sample, implying that we were entirely
+			 * caught up and now there is a new burst of WAL and the
+			 * standby hasn't processed the first sample yet.  Until the
+			 * standby reaches the future sample the best we can do is report
+			 * the hypothetical lag if that sample were to be replayed now.
+			 */
+			time = LagTracker.buffer[LagTracker.read_heads[head]].time;
+		}
+	}
+
+	/* Return the elapsed time since local flush time in microseconds. */
+	Assert(time != 0);
+#ifdef HAVE_INT64_TIMESTAMP
+	return now - time;
+#else
+	return (int64) ((now - time) * USECS_PER_SEC);
+#endif
+}
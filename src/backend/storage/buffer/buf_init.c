@@ -16,6 +16,7 @@
 
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
+#include "storage/pg_shmem.h"
 
 
 BufferDescPadded *BufferDescriptors;
@@ -26,6 +27,9 @@ LWLockTranche BufferContentLWLockTranche;
 WritebackContext BackendWritebackContext;
 CkptSortItem *CkptBufferIds;
 
+/* GUC variable */
+bool		numa_interleave_buffers = false;
+
 
 /*
  * Data Structures:
@@ -84,6 +88,14 @@ InitBufferPool(void)
 		ShmemInitStruct("Buffer Blocks",
 						NBuffers * (Size) BLCKSZ, &foundBufs);
 
+	/*
+	 * Nothing has touched the buffer blocks yet, so if asked, this is the
+	 * time to have their pages spread over all NUMA nodes.  Otherwise they'd
+	 * all end up on whichever node the processes first using them run on.
+	 */
+	if (numa_interleave_buffers && !foundBufs)
+		PGSharedMemoryInterleave(BufferBlocks, NBuffers * (Size) BLCKSZ);
+
 	/* Align lwlocks to cacheline boundary */
 	BufferIOLWLockArray = (LWLockMinimallyPadded *)
 		ShmemInitStruct("Buffer IO Locks",
@@ -48,6 +48,7 @@
 #include "storage/proc.h"
 #include "storage/smgr.h"
 #include "storage/standby.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/resowner_private.h"
 #include "utils/timestamp.h"
@@ -61,9 +62,10 @@
 #define LocalBufHdrGetBlock(bufHdr) \
 	LocalBufferBlockPointers[-((bufHdr)->buf_id + 2)]
 
-/* Bits in SyncOneBuffer's return value */
+/* Bits in SyncOneBuffer's and CollectOneBuffer's return value */
 #define BUF_WRITTEN				0x01
 #define BUF_REUSABLE			0x02
+#define BUF_NEEDS_WRITE			0x04
 
 #define DROP_RELS_BSEARCH_THRESHOLD		20
 
@@ -128,6 +130,12 @@ int			backend_flush_after = 0;
  */
 int			target_prefetch_pages = 0;
 
+/*
+ * How many blocks ahead of a sequential scan ReadStreamPrefetch should
+ * initiate reads for.  Zero means to rely on the kernel's readahead.
+ */
+int			seqscan_prefetch_distance = 0;
+
 /* local state for StartBufferIO and related functions */
 static BufferDesc *InProgressBuf = NULL;
 static bool IsForInput;
@@ -438,6 +446,7 @@ static void UnpinBuffer(BufferDesc *buf, bool fixOwner);
 static void BufferSync(int flags);
 static uint32 WaitBufHdrUnlocked(BufferDesc *buf);
 static int	SyncOneBuffer(int buf_id, bool skip_recently_used, WritebackContext *flush_context);
+static int	CollectOneBuffer(int buf_id, CkptSortItem *item);
 static void WaitIO(BufferDesc *buf);
 static bool StartBufferIO(BufferDesc *buf, bool forInput);
 static void TerminateBufferIO(BufferDesc *buf, bool clear_dirty,
@@ -517,6 +526,71 @@ ComputeIoConcurrency(int io_concurrency, double *target)
 	return (new_prefetch_pages >= 0.0 && new_prefetch_pages < (double) INT_MAX);
 }
 
+#ifdef USE_PREFETCH
+/*
+ * SharedBufferIsCached -- is a block in the shared buffer pool already?
+ *
+ * The answer may be out of date as soon as we release the partition lock,
+ * which is good enough for deciding whether to prefetch the block.
+ */
+static bool
+SharedBufferIsCached(SMgrRelation smgr_reln, ForkNumber forkNum,
+					 BlockNumber blockNum)
+{
+	BufferTag	newTag;			/* identity of requested block */
+	uint32		newHash;		/* hash value for newTag */
+	LWLock	   *newPartitionLock;	/* buffer partition lock for it */
+	int			buf_id;
+
+	Assert(BlockNumberIsValid(blockNum));
+
+	/* create a tag so we can lookup the buffer */
+	INIT_BUFFERTAG(newTag, smgr_reln->smgr_rnode.node,
+				   forkNum, blockNum);
+
+	/* determine its hash code and partition lock ID */
+	newHash = BufTableHashCode(&newTag);
+	newPartitionLock = BufMappingPartitionLock(newHash);
+
+	/* see if the block is in the buffer pool already */
+	LWLockAcquire(newPartitionLock, LW_SHARED);
+	buf_id = BufTableLookup(&newTag, newHash);
+	LWLockRelease(newPartitionLock);
+
+	return buf_id >= 0;
+}
+#endif   /* USE_PREFETCH */
+
+/*
+ * PrefetchSharedBuffer -- initiate asynchronous read of a shared block
+ *
+ * Like PrefetchBuffer, but works at the smgr level, for callers such as WAL
+ * replay that have no relcache entry for the relation.  The relation must not
+ * use local buffers.
+ */
+void
+PrefetchSharedBuffer(SMgrRelation smgr_reln, ForkNumber forkNum,
+					 BlockNumber blockNum)
+{
+#ifdef USE_PREFETCH
+	/* If not in buffers, initiate prefetch */
+	if (!SharedBufferIsCached(smgr_reln, forkNum, blockNum))
+		smgrprefetch(smgr_reln, forkNum, blockNum, 1);
+
+	/*
+	 * If the block *is* in buffers, we do nothing.  This is not really
+	 * ideal: the block might be just about to be evicted, which would be
+	 * stupid since we know we are going to need it soon.  But the only easy
+	 * answer is to bump the usage_count, which does not seem like a great
+	 * solution: when the caller does ultimately touch the block, usage_count
+	 * would get bumped again, resulting in too much favoritism for blocks
+	 * that are involved in a prefetch sequence. A real fix would involve some
+	 * additional per-buffer state, and it's not clear that there's enough of
+	 * a problem to justify that.
+	 */
+#endif   /* USE_PREFETCH */
+}
+
 /*
  * PrefetchBuffer -- initiate asynchronous read of a block of a relation
  *
@@ -548,43 +622,139 @@ PrefetchBuffer(Relation reln, ForkNumber forkNum, BlockNumber blockNum)
 	}
 	else
 	{
-		BufferTag	newTag;		/* identity of requested block */
-		uint32		newHash;	/* hash value for newTag */
-		LWLock	   *newPartitionLock;	/* buffer partition lock for it */
-		int			buf_id;
-
-		/* create a tag so we can lookup the buffer */
-		INIT_BUFFERTAG(newTag, reln->rd_smgr->smgr_rnode.node,
-					   forkNum, blockNum);
-
-		/* determine its hash code and partition lock ID */
-		newHash = BufTableHashCode(&newTag);
-		newPartitionLock = BufMappingPartitionLock(newHash);
-
-		/* see if the block is in the buffer pool already */
-		LWLockAcquire(newPartitionLock, LW_SHARED);
-		buf_id = BufTableLookup(&newTag, newHash);
-		LWLockRelease(newPartitionLock);
+		/* pass it to the shared buffer version */
+		PrefetchSharedBuffer(reln->rd_smgr, forkNum, blockNum);
+	}
+#endif   /* USE_PREFETCH */
+}
 
-		/* If not in buffers, initiate prefetch */
-		if (buf_id < 0)
-			smgrprefetch(reln->rd_smgr, forkNum, blockNum);
+/*
+ * PrefetchBufferRange -- initiate asynchronous read of a range of blocks
+ *
+ * Like calling PrefetchBuffer for each block, but each run of adjacent blocks
+ * not in buffers is passed down as a single request, so that the kernel can
+ * read it with larger I/Os.
+ */
+void
+PrefetchBufferRange(Relation reln, ForkNumber forkNum, BlockNumber blockNum,
+					BlockNumber nblocks)
+{
+#ifdef USE_PREFETCH
+	Assert(RelationIsValid(reln));
 
-		/*
-		 * If the block *is* in buffers, we do nothing.  This is not really
-		 * ideal: the block might be just about to be evicted, which would be
-		 * stupid since we know we are going to need it soon.  But the only
-		 * easy answer is to bump the usage_count, which does not seem like a
-		 * great solution: when the caller does ultimately touch the block,
-		 * usage_count would get bumped again, resulting in too much
-		 * favoritism for blocks that are involved in a prefetch sequence. A
-		 * real fix would involve some additional per-buffer state, and it's
-		 * not clear that there's enough of a problem to justify that.
-		 */
+	if (RelationUsesLocalBuffers(reln))
+	{
+		/* temp tables are small and private, don't bother combining */
+		while (nblocks-- > 0)
+			PrefetchBuffer(reln, forkNum, blockNum++);
+		return;
+	}
+
+	/* Open it at the smgr level if not already done */
+	RelationOpenSmgr(reln);
+
+	while (nblocks > 0)
+	{
+		BlockNumber nfetch = 0;
+
+		while (nfetch < nblocks &&
+			   !SharedBufferIsCached(reln->rd_smgr, forkNum, blockNum + nfetch))
+			nfetch++;
+
+		if (nfetch > 0)
+			smgrprefetch(reln->rd_smgr, forkNum, blockNum, nfetch);
+
+		/* skip the cached block which ended the run, if any */
+		if (nfetch < nblocks)
+			nfetch++;
+
+		nblocks -= nfetch;
+		blockNum += nfetch;
 	}
 #endif   /* USE_PREFETCH */
 }
 
+/*
+ * ReadStreamBegin -- set up read-ahead for a scan reading blocks in order
+ *
+ * The scan reads "length" blocks starting at "start", wrapping around to
+ * block 0 at the end of the relation, which has "nblocks" blocks.  This fits
+ * both plain and synchronized sequential scans.  Read-ahead is disabled if
+ * seqscan_prefetch_distance is zero.
+ */
+void
+ReadStreamBegin(ReadStream *stream, BlockNumber start, BlockNumber length,
+				BlockNumber nblocks)
+{
+	stream->start = start;
+	stream->length = Min(length, nblocks);
+	stream->nblocks = nblocks;
+	stream->distance = seqscan_prefetch_distance;
+	stream->chunk = Min(stream->distance, READ_STREAM_CHUNK_BLOCKS);
+
+	if (stream->distance <= 0)
+		stream->length = 0;
+}
+
+/*
+ * ReadStreamPrefetch -- initiate reads for the blocks a scan needs next
+ *
+ * To be called for each block the scan reads, before reading it.  Reads are
+ * initiated a chunk of READ_STREAM_CHUNK_BLOCKS blocks at a time, to keep the
+ * blocks from the start of the chunk up to "distance" blocks ahead of the
+ * scan in flight: at the first block for everything up to then, and at the
+ * start of each chunk for the chunk "distance" blocks ahead.
+ *
+ * Since the blocks to prefetch depend only on the block being read, blocks
+ * can be handed out to any number of cooperating processes, as in a parallel
+ * scan, and each block is still prefetched exactly once.
+ */
+void
+ReadStreamPrefetch(ReadStream *stream, Relation reln, BlockNumber blockNum)
+{
+	uint64		pos;
+	uint64		from;
+	uint64		to;
+	BlockNumber first;
+	BlockNumber n;
+
+	if (stream->length == 0)
+		return;
+
+	/* position of the block in the stream */
+	pos = ((uint64) blockNum + stream->nblocks - stream->start) %
+		stream->nblocks;
+
+	if (pos == 0)
+	{
+		from = 1;
+		to = stream->distance + stream->chunk;
+	}
+	else if (pos % stream->chunk == 0)
+	{
+		from = pos + stream->distance;
+		to = from + stream->chunk;
+	}
+	else
+		return;
+
+	to = Min(to, stream->length);
+	if (from >= to)
+		return;
+
+	/* map positions to blocks, splitting at the end of the relation */
+	first = (BlockNumber) (((uint64) stream->start + from) % stream->nblocks);
+	n = (BlockNumber) (to - from);
+	if ((uint64) first + n > stream->nblocks)
+	{
+		PrefetchBufferRange(reln, MAIN_FORKNUM, first,
+							stream->nblocks - first);
+		n -= stream->nblocks - first;
+		first = 0;
+	}
+	PrefetchBufferRange(reln, MAIN_FORKNUM, first, n);
+}
+
 
 /*
  * ReadBuffer -- a shorthand for ReadBufferExtended, for reading from main
@@ -1951,7 +2121,12 @@ BufferSync(int flags)
 	 * marked with BM_CHECKPOINT_NEEDED. The writes are balanced between
 	 * tablespaces; otherwise the sorting would lead to only one tablespace
 	 * receiving writes at a time, making inefficient use of the hardware.
+	 *
+	 * Unless the checkpoint is to be done as fast as possible, the writes
+	 * are also held to the write budgets of their tablespaces, so that a
+	 * slow tablespace only slows down its own writes.
 	 */
+	tablespace_io_throttle = !(flags & CHECKPOINT_IMMEDIATE);
 	num_processed = 0;
 	num_written = 0;
 	while (!binaryheap_empty(ts_heap))
@@ -2014,6 +2189,8 @@ BufferSync(int flags)
 		CheckpointWriteDelay(flags, (double) num_processed / num_to_scan);
 	}
 
+	tablespace_io_throttle = false;
+
 	/* issue all pending flushes */
 	IssuePendingWritebacks(&wb_context);
 
@@ -2079,7 +2256,13 @@ BgBufferSync(WritebackContext *wb_context)
 	/* Variables for the scanning loop proper */
 	int			num_to_scan;
 	int			num_written;
+	int			num_batched;
 	int			reusable_buffers;
+	int			i;
+
+	/* Buffers to write in this round, sorted before writing */
+	static CkptSortItem *batch = NULL;
+	static int	batch_size = 0;
 
 	/* Variables for final smoothed_density update */
 	long		new_strategy_delta;
@@ -2251,24 +2434,36 @@ BgBufferSync(WritebackContext *wb_context)
 	}
 
 	/*
-	 * Now write out dirty reusable buffers, working forward from the
-	 * next_to_clean point, until we have lapped the strategy scan, or cleaned
+	 * Now collect dirty reusable buffers, working forward from the
+	 * next_to_clean point, until we have lapped the strategy scan, or found
 	 * enough buffers to match our estimate of the next cycle's allocation
 	 * requirements, or hit the bgwriter_lru_maxpages limit.
+	 *
+	 * Rather than writing each buffer as the scan finds it, which issues the
+	 * writes in the essentially random order of buffer ids, we write the
+	 * batch sorted by tablespace, relation, fork and block number, just like
+	 * a checkpoint does.  Adjacent blocks then reach the kernel one after the
+	 * other, and the writeback requests for them are merged into one.
 	 */
-
-	/* Make sure we can handle the pin inside SyncOneBuffer */
-	ResourceOwnerEnlargeBuffers(CurrentResourceOwner);
+	if (batch_size < bgwriter_lru_maxpages)
+	{
+		if (batch != NULL)
+			pfree(batch);
+		batch = (CkptSortItem *)
+			MemoryContextAlloc(TopMemoryContext,
+							   bgwriter_lru_maxpages * sizeof(CkptSortItem));
+		batch_size = bgwriter_lru_maxpages;
+	}
 
 	num_to_scan = bufs_to_lap;
-	num_written = 0;
+	num_batched = 0;
 	reusable_buffers = reusable_buffers_est;
 
 	/* Execute the LRU scan */
 	while (num_to_scan > 0 && reusable_buffers < upcoming_alloc_est)
 	{
-		int			sync_state = SyncOneBuffer(next_to_clean, true,
-											   wb_context);
+		int			sync_state = CollectOneBuffer(next_to_clean,
+												  &batch[num_batched]);
 
 		if (++next_to_clean >= NBuffers)
 		{
@@ -2277,10 +2472,10 @@ BgBufferSync(WritebackContext *wb_context)
 		}
 		num_to_scan--;
 
-		if (sync_state & BUF_WRITTEN)
+		if (sync_state & BUF_NEEDS_WRITE)
 		{
 			reusable_buffers++;
-			if (++num_written >= bgwriter_lru_maxpages)
+			if (++num_batched >= bgwriter_lru_maxpages)
 			{
 				BgWriterStats.m_maxwritten_clean++;
 				break;
@@ -2290,6 +2485,24 @@ BgBufferSync(WritebackContext *wb_context)
 			reusable_buffers++;
 	}
 
+	/* Make sure we can handle the pin inside SyncOneBuffer */
+	ResourceOwnerEnlargeBuffers(CurrentResourceOwner);
+
+	/*
+	 * Write the batch.  SyncOneBuffer rechecks each buffer, so one that has
+	 * been pinned, used or cleaned since we looked at it is skipped.
+	 */
+	if (num_batched > 1)
+		qsort(batch, num_batched, sizeof(CkptSortItem),
+			  ckpt_buforder_comparator);
+
+	num_written = 0;
+	for (i = 0; i < num_batched; i++)
+	{
+		if (SyncOneBuffer(batch[i].buf_id, true, wb_context) & BUF_WRITTEN)
+			num_written++;
+	}
+
 	BgWriterStats.m_buf_written_clean += num_written;
 
 #ifdef BGW_DEBUG
@@ -2404,6 +2617,46 @@ SyncOneBuffer(int buf_id, bool skip_recently_used, WritebackContext *wb_context)
 	return result | BUF_WRITTEN;
 }
 
+/*
+ * CollectOneBuffer -- check whether the background writer should write out
+ * a buffer.
+ *
+ * Like SyncOneBuffer with skip_recently_used, but instead of writing the
+ * buffer, only fills *item with its sort key.  Returns BUF_REUSABLE if the
+ * buffer is a replacement candidate, plus BUF_NEEDS_WRITE if it is also
+ * dirty and *item has been filled.
+ */
+static int
+CollectOneBuffer(int buf_id, CkptSortItem *item)
+{
+	BufferDesc *bufHdr = GetBufferDescriptor(buf_id);
+	int			result = 0;
+	uint32		buf_state;
+
+	/* See SyncOneBuffer for why the header spinlock is enough */
+	buf_state = LockBufHdr(bufHdr);
+
+	if (BUF_STATE_GET_REFCOUNT(buf_state) == 0 &&
+		BUF_STATE_GET_USAGECOUNT(buf_state) == 0)
+	{
+		result |= BUF_REUSABLE;
+
+		if ((buf_state & BM_VALID) && (buf_state & BM_DIRTY))
+		{
+			item->buf_id = buf_id;
+			item->tsId = bufHdr->tag.rnode.spcNode;
+			item->relNode = bufHdr->tag.rnode.relNode;
+			item->forkNum = bufHdr->tag.forkNum;
+			item->blockNum = bufHdr->tag.blockNum;
+			result |= BUF_NEEDS_WRITE;
+		}
+	}
+
+	UnlockBufHdr(bufHdr, buf_state);
+
+	return result;
+}
+
 /*
  *		AtEOXact_Buffers - clean up at end of transaction.
  *
@@ -16,12 +16,24 @@
 #include "postgres.h"
 
 #include "port/atomics.h"
+#include "portability/instr_time.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
 #include "storage/proc.h"
 
 #define INT_ACCESS_ONCE(var)	((int)(*((volatile int *)&(var))))
 
+/*
+ * With the partitioned clock policy, every partition covers at least this
+ * many buffers (128MB with the default block size), and there are never more
+ * than MAX_SWEEP_PARTITIONS of them.
+ */
+#define SWEEP_PARTITION_MIN_BUFFERS		16384
+#define MAX_SWEEP_PARTITIONS			64
+
+/* GUC variable */
+int			buffer_replacement_policy = BUFFER_REPLACEMENT_CLOCK;
+
 
 /*
  * The shared freelist control information.
@@ -58,10 +70,46 @@ typedef struct
 	 * StrategyNotifyBgWriter.
 	 */
 	int			bgwprocno;
+
+	/* Number of entries in SweepPartitions */
+	int			numSweepPartitions;
 } BufferStrategyControl;
 
+/*
+ * A clock sweep partition.  With buffer_replacement_policy set to
+ * partitioned_clock, the buffer pool is divided into contiguous ranges of
+ * buffers, each with its own clock hand, so that backends looking for a
+ * victim buffer concurrently don't all advance the same atomic counter.
+ * With the plain clock policy there is a single partition, whose hand is
+ * unused; it only holds the statistics.
+ */
+typedef struct
+{
+	int			firstBuffer;	/* first buffer id in this partition */
+	int			numBuffers;		/* number of buffers in this partition */
+
+	/*
+	 * Clock hand, relative to firstBuffer.  Like nextVictimBuffer it only
+	 * ever increases, but it is 64 bits wide so that it never wraps around.
+	 */
+	pg_atomic_uint64 nextVictimBuffer;
+
+	/* Statistics about clock sweeps that started in this partition */
+	pg_atomic_uint64 numSearches;	/* number of sweeps */
+	pg_atomic_uint64 numScanned;	/* buffers inspected by them */
+	pg_atomic_uint64 searchTime;	/* time spent, in microseconds */
+} BufferSweepPartition;
+
+/* Pad each partition to a cache line, so that their hands don't share one */
+typedef union BufferSweepPartitionPadded
+{
+	BufferSweepPartition part;
+	char		pad[PG_CACHE_LINE_SIZE];
+} BufferSweepPartitionPadded;
+
 /* Pointers to shared state */
 static BufferStrategyControl *StrategyControl = NULL;
+static BufferSweepPartitionPadded *SweepPartitions = NULL;
 
 /*
  * Private (non-shared) state for managing a ring of shared buffers to re-use.
@@ -98,6 +146,9 @@ typedef struct BufferAccessStrategyData
 
 
 /* Prototypes for internal functions */
+static int	SweepPartitionCount(void);
+static BufferDesc *ClockSweep(BufferSweepPartition *part, uint32 *buf_state,
+		   uint64 *num_scanned);
 static BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy,
 				  uint32 *buf_state);
 static void AddBufferToRing(BufferAccessStrategy strategy,
@@ -168,6 +219,83 @@ ClockSweepTick(void)
 	return victim;
 }
 
+/*
+ * PartitionSweepTick - Helper routine for ClockSweep()
+ *
+ * Like ClockSweepTick(), but for the hand of a single partition.
+ */
+static inline int
+PartitionSweepTick(BufferSweepPartition *part)
+{
+	uint64		victim;
+
+	victim = pg_atomic_fetch_add_u64(&part->nextVictimBuffer, 1);
+
+	return part->firstBuffer + (int) (victim % part->numBuffers);
+}
+
+/*
+ * ClockSweep - Helper routine for StrategyGetBuffer()
+ *
+ * Run the clock sweep until a buffer with zero pin count and zero usage count
+ * is found; that buffer is returned with its header spinlock held.  If part
+ * is NULL, the global hand is advanced over the whole buffer pool, otherwise
+ * the hand of the given partition over the buffers of that partition.
+ * Returns NULL if a full cycle went by without finding an unpinned buffer.
+ *
+ * The number of buffers inspected is added to *num_scanned.
+ */
+static BufferDesc *
+ClockSweep(BufferSweepPartition *part, uint32 *buf_state, uint64 *num_scanned)
+{
+	int			numBuffers = (part != NULL) ? part->numBuffers : NBuffers;
+	int			trycounter = numBuffers;
+
+	for (;;)
+	{
+		BufferDesc *buf;
+		uint32		local_buf_state;
+
+		if (part != NULL)
+			buf = GetBufferDescriptor(PartitionSweepTick(part));
+		else
+			buf = GetBufferDescriptor(ClockSweepTick());
+		(*num_scanned)++;
+
+		/*
+		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
+		 * it; decrement the usage_count (unless pinned) and keep scanning.
+		 */
+		local_buf_state = LockBufHdr(buf);
+
+		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0)
+		{
+			if (BUF_STATE_GET_USAGECOUNT(local_buf_state) != 0)
+			{
+				local_buf_state -= BUF_USAGECOUNT_ONE;
+
+				trycounter = numBuffers;
+			}
+			else
+			{
+				/* Found a usable buffer */
+				*buf_state = local_buf_state;
+				return buf;
+			}
+		}
+		else if (--trycounter == 0)
+		{
+			/*
+			 * We've scanned all the buffers without making any state changes,
+			 * so all the buffers are pinned (or were when we looked at them).
+			 */
+			UnlockBufHdr(buf, local_buf_state);
+			return NULL;
+		}
+		UnlockBufHdr(buf, local_buf_state);
+	}
+}
+
 /*
  * StrategyGetBuffer
  *
@@ -185,8 +313,11 @@ StrategyGetBuffer(BufferAccessStrategy strategy, uint32 *buf_state)
 {
 	BufferDesc *buf;
 	int			bgwprocno;
-	int			trycounter;
 	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
+	BufferSweepPartition *home;
+	uint64		num_scanned = 0;
+	instr_time	search_start;
+	instr_time	search_time;
 
 	/*
 	 * If given a strategy object, see whether it can select a buffer. We
@@ -296,48 +427,71 @@ StrategyGetBuffer(BufferAccessStrategy strategy, uint32 *buf_state)
 	}
 
 	/* Nothing on the freelist, so run the "clock sweep" algorithm */
-	trycounter = NBuffers;
-	for (;;)
+	if (track_io_timing)
+		INSTR_TIME_SET_CURRENT(search_start);
+
+	if (buffer_replacement_policy == BUFFER_REPLACEMENT_PARTITIONED_CLOCK)
 	{
-		buf = GetBufferDescriptor(ClockSweepTick());
+		int			nparts = StrategyControl->numSweepPartitions;
+		int			first;
+		int			i;
 
 		/*
-		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
-		 * it; decrement the usage_count (unless pinned) and keep scanning.
+		 * Start in a partition chosen by our PGPROC slot, so that concurrent
+		 * backends tend to sweep different partitions.  Only if every buffer
+		 * there is pinned do we move on to the next partition.
 		 */
-		local_buf_state = LockBufHdr(buf);
+		first = (MyProc != NULL) ? MyProc->pgprocno % nparts : 0;
+		home = &SweepPartitions[first].part;
 
-		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0)
-		{
-			if (BUF_STATE_GET_USAGECOUNT(local_buf_state) != 0)
-			{
-				local_buf_state -= BUF_USAGECOUNT_ONE;
+		buf = NULL;
+		for (i = 0; i < nparts && buf == NULL; i++)
+			buf = ClockSweep(&SweepPartitions[(first + i) % nparts].part,
+							 &local_buf_state, &num_scanned);
+	}
+	else
+	{
+		home = &SweepPartitions[0].part;
+		buf = ClockSweep(NULL, &local_buf_state, &num_scanned);
+	}
 
-				trycounter = NBuffers;
-			}
-			else
-			{
-				/* Found a usable buffer */
-				if (strategy != NULL)
-					AddBufferToRing(strategy, buf);
-				*buf_state = local_buf_state;
-				return buf;
-			}
-		}
-		else if (--trycounter == 0)
-		{
-			/*
-			 * We've scanned all the buffers without making any state changes,
-			 * so all the buffers are pinned (or were when we looked at them).
-			 * We could hope that someone will free one eventually, but it's
-			 * probably better to fail than to risk getting stuck in an
-			 * infinite loop.
-			 */
-			UnlockBufHdr(buf, local_buf_state);
-			elog(ERROR, "no unpinned buffers available");
-		}
-		UnlockBufHdr(buf, local_buf_state);
+	/*
+	 * If all the buffers are pinned, we could hope that someone will free one
+	 * eventually, but it's probably better to fail than to risk getting stuck
+	 * in an infinite loop.
+	 */
+	if (buf == NULL)
+		elog(ERROR, "no unpinned buffers available");
+
+	pg_atomic_fetch_add_u64(&home->numSearches, 1);
+	pg_atomic_fetch_add_u64(&home->numScanned, num_scanned);
+	if (track_io_timing)
+	{
+		INSTR_TIME_SET_CURRENT(search_time);
+		INSTR_TIME_SUBTRACT(search_time, search_start);
+		pg_atomic_fetch_add_u64(&home->searchTime,
+								INSTR_TIME_GET_MICROSEC(search_time));
 	}
+
+	if (strategy != NULL)
+		AddBufferToRing(strategy, buf);
+	*buf_state = local_buf_state;
+	return buf;
+}
+
+/*
+ * have_free_buffer -- a lockless check to see if there is a free buffer in
+ *					   the buffer pool.
+ *
+ * The answer can be stale by the time the caller looks at it, so this is
+ * only good for deciding whether it's worth reading more blocks in, as
+ * autoprewarm does; it doesn't promise that the next allocation won't evict
+ * anything.
+ */
+bool
+have_free_buffer(void)
+{
+	return StrategyControl->firstFreeBuffer >= 0;
 }
 
 /*
@@ -373,26 +527,47 @@ StrategyFreeBuffer(BufferDesc *buf)
  * the higher-order bits of nextVictimBuffer) and the count of recent buffer
  * allocs if non-NULL pointers are passed.  The alloc count is reset after
  * being read.
+ *
+ * With the partitioned clock policy there is no single hand.  We then report
+ * the sum of the partition hands, that is the total number of buffers swept,
+ * as though it were one.  That keeps the sweep rate the bgwriter derives from
+ * successive calls accurate; the start point itself is only approximate.
  */
 int
 StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc)
 {
-	uint32		nextVictimBuffer;
 	int			result;
 
 	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
-	nextVictimBuffer = pg_atomic_read_u32(&StrategyControl->nextVictimBuffer);
-	result = nextVictimBuffer % NBuffers;
+	if (buffer_replacement_policy == BUFFER_REPLACEMENT_PARTITIONED_CLOCK)
+	{
+		uint64		swept = 0;
+		int			i;
+
+		for (i = 0; i < StrategyControl->numSweepPartitions; i++)
+			swept += pg_atomic_read_u64(&SweepPartitions[i].part.nextVictimBuffer);
 
-	if (complete_passes)
+		result = swept % NBuffers;
+		if (complete_passes)
+			*complete_passes = (uint32) (swept / NBuffers);
+	}
+	else
 	{
-		*complete_passes = StrategyControl->completePasses;
+		uint32		nextVictimBuffer;
 
-		/*
-		 * Additionally add the number of wraparounds that happened before
-		 * completePasses could be incremented. C.f. ClockSweepTick().
-		 */
-		*complete_passes += nextVictimBuffer / NBuffers;
+		nextVictimBuffer = pg_atomic_read_u32(&StrategyControl->nextVictimBuffer);
+		result = nextVictimBuffer % NBuffers;
+
+		if (complete_passes)
+		{
+			*complete_passes = StrategyControl->completePasses;
+
+			/*
+			 * Additionally add the number of wraparounds that happened before
+			 * completePasses could be incremented. C.f. ClockSweepTick().
+			 */
+			*complete_passes += nextVictimBuffer / NBuffers;
+		}
 	}
 
 	if (num_buf_alloc)
@@ -403,6 +578,35 @@ StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc)
 	return result;
 }
 
+/*
+ * StrategyGetStatistics -- report victim buffer search statistics
+ *
+ * Returns the number of clock sweep partitions in use, and the number of
+ * clock sweeps, the buffers they inspected and the time they took (in
+ * microseconds, and only measured while track_io_timing is on) summed over
+ * all partitions since the server started.
+ */
+void
+StrategyGetStatistics(int *nparts, uint64 *num_searches,
+					  uint64 *num_scanned, uint64 *search_time)
+{
+	int			i;
+
+	*nparts = StrategyControl->numSweepPartitions;
+	*num_searches = 0;
+	*num_scanned = 0;
+	*search_time = 0;
+
+	for (i = 0; i < StrategyControl->numSweepPartitions; i++)
+	{
+		BufferSweepPartition *part = &SweepPartitions[i].part;
+
+		*num_searches += pg_atomic_read_u64(&part->numSearches);
+		*num_scanned += pg_atomic_read_u64(&part->numScanned);
+		*search_time += pg_atomic_read_u64(&part->searchTime);
+	}
+}
+
 /*
  * StrategyNotifyBgWriter -- set or clear allocation notification latch
  *
@@ -425,6 +629,19 @@ StrategyNotifyBgWriter(int bgwprocno)
 }
 
 
+/*
+ * SweepPartitionCount -- number of clock sweep partitions to use
+ */
+static int
+SweepPartitionCount(void)
+{
+	if (buffer_replacement_policy != BUFFER_REPLACEMENT_PARTITIONED_CLOCK)
+		return 1;
+
+	return Max(1, Min(MAX_SWEEP_PARTITIONS,
+					  NBuffers / SWEEP_PARTITION_MIN_BUFFERS));
+}
+
 /*
  * StrategyShmemSize
  *
@@ -444,6 +661,11 @@ StrategyShmemSize(void)
 	/* size of the shared replacement strategy control block */
 	size = add_size(size, MAXALIGN(sizeof(BufferStrategyControl)));
 
+	/* size of the clock sweep partitions, plus alignment padding */
+	size = add_size(size, mul_size(SweepPartitionCount(),
+								   sizeof(BufferSweepPartitionPadded)));
+	size = add_size(size, PG_CACHE_LINE_SIZE);
+
 	return size;
 }
 
@@ -458,6 +680,8 @@ void
 StrategyInitialize(bool init)
 {
 	bool		found;
+	bool		found_parts;
+	int			nparts;
 
 	/*
 	 * Initialize the shared buffer lookup hashtable.
@@ -479,12 +703,22 @@ StrategyInitialize(bool init)
 						sizeof(BufferStrategyControl),
 						&found);
 
+	/* Align the partitions to cache lines, as for the buffer descriptors */
+	nparts = SweepPartitionCount();
+	SweepPartitions = (BufferSweepPartitionPadded *)
+		CACHELINEALIGN(ShmemInitStruct("Buffer Sweep Partitions",
+									   nparts * sizeof(BufferSweepPartitionPadded)
+									   + PG_CACHE_LINE_SIZE,
+									   &found_parts));
+
 	if (!found)
 	{
+		int			i;
+
 		/*
 		 * Only done once, usually in postmaster
 		 */
-		Assert(init);
+		Assert(init && !found_parts);
 
 		SpinLockInit(&StrategyControl->buffer_strategy_lock);
 
@@ -504,6 +738,21 @@ StrategyInitialize(bool init)
 
 		/* No pending notification */
 		StrategyControl->bgwprocno = -1;
+
+		/* Divide the buffers evenly between the clock sweep partitions */
+		StrategyControl->numSweepPartitions = nparts;
+		for (i = 0; i < nparts; i++)
+		{
+			BufferSweepPartition *part = &SweepPartitions[i].part;
+
+			part->firstBuffer = (int) ((int64) NBuffers * i / nparts);
+			part->numBuffers = (int) ((int64) NBuffers * (i + 1) / nparts) -
+				part->firstBuffer;
+			pg_atomic_init_u64(&part->nextVictimBuffer, 0);
+			pg_atomic_init_u64(&part->numSearches, 0);
+			pg_atomic_init_u64(&part->numScanned, 0);
+			pg_atomic_init_u64(&part->searchTime, 0);
+		}
 	}
 	else
 		Assert(!init);
@@ -31,6 +31,12 @@
  * BufFile also supports temporary files that exceed the OS file size limit
  * (by opening multiple fd.c temporary files).  This is an essential feature
  * for sorts and hashjoins on large amounts of data.
+ *
+ * A "shared" BufFile is a temporary file with a caller-chosen name that is
+ * written by one backend and can then be read by others, for example by the
+ * workers of a parallel query.  Its component files are named after it, with
+ * the segment number appended.  Shared BufFiles are not deleted when closed;
+ * the caller removes them with BufFileDeleteShared.
  *-------------------------------------------------------------------------
  */
 
@@ -71,6 +77,10 @@ struct BufFile
 	bool		isInterXact;	/* keep open over transactions? */
 	bool		dirty;			/* does buffer need to be written? */
 
+	/* for a shared BufFile being written, where to create more segments */
+	Oid			tblspcOid;
+	char	   *name;			/* NULL if not shared */
+
 	/*
 	 * resowner is the ResourceOwner to use for underlying temp files.  (We
 	 * don't need to remember the memory context we're using explicitly,
@@ -90,6 +100,7 @@ struct BufFile
 };
 
 static BufFile *makeBufFile(File firstfile);
+static void SharedSegmentName(char *segname, const char *name, int segment);
 static void extendBufFile(BufFile *file);
 static void BufFileLoadBuffer(BufFile *file);
 static void BufFileDumpBuffer(BufFile *file);
@@ -113,6 +124,8 @@ makeBufFile(File firstfile)
 	file->isTemp = false;
 	file->isInterXact = false;
 	file->dirty = false;
+	file->tblspcOid = InvalidOid;
+	file->name = NULL;
 	file->resowner = CurrentResourceOwner;
 	file->curFile = 0;
 	file->curOffset = 0L;
@@ -136,7 +149,15 @@ extendBufFile(BufFile *file)
 	CurrentResourceOwner = file->resowner;
 
 	Assert(file->isTemp);
-	pfile = OpenTemporaryFile(file->isInterXact);
+	if (file->name != NULL)
+	{
+		char		segname[MAXPGPATH];
+
+		SharedSegmentName(segname, file->name, file->numFiles);
+		pfile = OpenSharedTemporaryFile(file->tblspcOid, segname, true);
+	}
+	else
+		pfile = OpenTemporaryFile(file->isInterXact);
 	Assert(pfile >= 0);
 
 	CurrentResourceOwner = oldowner;
@@ -178,6 +199,99 @@ BufFileCreateTemp(bool interXact)
 	return file;
 }
 
+/*
+ * Build the name of one component file of a shared BufFile.
+ */
+static void
+SharedSegmentName(char *segname, const char *name, int segment)
+{
+	snprintf(segname, MAXPGPATH, "%s.%d", name, segment);
+}
+
+/*
+ * Create a shared BufFile for writing.
+ *
+ * The name must be unique within the database instance; see
+ * OpenSharedTemporaryFile.  Once the writer has closed the file, other
+ * backends can read it with BufFileOpenShared.
+ */
+BufFile *
+BufFileCreateShared(Oid tblspcOid, const char *name)
+{
+	BufFile    *file;
+	File		pfile;
+	char		segname[MAXPGPATH];
+
+	SharedSegmentName(segname, name, 0);
+	pfile = OpenSharedTemporaryFile(tblspcOid, segname, true);
+
+	file = makeBufFile(pfile);
+	file->isTemp = true;
+	file->tblspcOid = tblspcOid;
+	file->name = pstrdup(name);
+
+	return file;
+}
+
+/*
+ * Open a shared BufFile that another backend has written, for reading.
+ *
+ * Returns NULL if there is no such file.
+ */
+BufFile *
+BufFileOpenShared(Oid tblspcOid, const char *name)
+{
+	BufFile    *file;
+	File		pfile;
+	char		segname[MAXPGPATH];
+
+	SharedSegmentName(segname, name, 0);
+	pfile = OpenSharedTemporaryFile(tblspcOid, segname, false);
+	if (pfile < 0)
+		return NULL;
+
+	file = makeBufFile(pfile);
+
+	/* pick up any further segments */
+	for (;;)
+	{
+		SharedSegmentName(segname, name, file->numFiles);
+		pfile = OpenSharedTemporaryFile(tblspcOid, segname, false);
+		if (pfile < 0)
+			break;
+
+		file->files = (File *) repalloc(file->files,
+									  (file->numFiles + 1) * sizeof(File));
+		file->offsets = (off_t *) repalloc(file->offsets,
+									   (file->numFiles + 1) * sizeof(off_t));
+		file->files[file->numFiles] = pfile;
+		file->offsets[file->numFiles] = 0L;
+		file->numFiles++;
+	}
+
+	return file;
+}
+
+/*
+ * Remove all the component files of a shared BufFile.
+ *
+ * It's OK if the file does not exist, or if backends still have it open.
+ */
+void
+BufFileDeleteShared(Oid tblspcOid, const char *name)
+{
+	char		segname[MAXPGPATH];
+	int			segment = 0;
+
+	for (;;)
+	{
+		SharedSegmentName(segname, name, segment);
+		if (!DeleteSharedTemporaryFile(tblspcOid, segname))
+			break;
+		segment++;
+	}
+}
+
 #ifdef NOT_USED
 /*
  * Create a BufFile and attach it to an already-opened virtual File.
@@ -211,6 +325,8 @@ BufFileClose(BufFile *file)
 	/* release the buffer space */
 	pfree(file->files);
 	pfree(file->offsets);
+	if (file->name)
+		pfree(file->name);
 	pfree(file);
 }
 
@@ -302,6 +302,8 @@ static void FreeVfd(File file);
 
 static int	FileAccess(File file);
 static File OpenTemporaryFileInTablespace(Oid tblspcOid, bool rejectError);
+static void TempTablespacePath(char *path, Oid tblspcOid);
+static void RegisterTemporaryFile(File file);
 static bool reserveAllocatedDesc(void);
 static int	FreeDesc(AllocateDesc *desc);
 static struct dirent *ReadDirExtended(DIR *dir, const char *dirname, int elevel);
@@ -1368,49 +1370,64 @@ OpenTemporaryFile(bool interXact)
 
 	/* Register it with the current resource owner */
 	if (!interXact)
-	{
-		VfdCache[file].fdstate |= FD_XACT_TEMPORARY;
-
-		ResourceOwnerEnlargeFiles(CurrentResourceOwner);
-		ResourceOwnerRememberFile(CurrentResourceOwner, file);
-		VfdCache[file].resowner = CurrentResourceOwner;
-
-		/* ensure cleanup happens at eoxact */
-		have_xact_temporary_files = true;
-	}
+		RegisterTemporaryFile(file);
 
 	return file;
 }
 
 /*
- * Open a temporary file in a specific tablespace.
- * Subroutine for OpenTemporaryFile, which see for details.
+ * Remember a transaction-local temporary file with the current resource
+ * owner, so that it is closed at end of transaction.
  */
-static File
-OpenTemporaryFileInTablespace(Oid tblspcOid, bool rejectError)
+static void
+RegisterTemporaryFile(File file)
 {
-	char		tempdirpath[MAXPGPATH];
-	char		tempfilepath[MAXPGPATH];
-	File		file;
+	VfdCache[file].fdstate |= FD_XACT_TEMPORARY;
 
-	/*
-	 * Identify the tempfile directory for this tablespace.
-	 *
-	 * If someone tries to specify pg_global, use pg_default instead.
-	 */
-	if (tblspcOid == DEFAULTTABLESPACE_OID ||
+	ResourceOwnerEnlargeFiles(CurrentResourceOwner);
+	ResourceOwnerRememberFile(CurrentResourceOwner, file);
+	VfdCache[file].resowner = CurrentResourceOwner;
+
+	/* ensure cleanup happens at eoxact */
+	have_xact_temporary_files = true;
+}
+
+/*
+ * Construct the path of the temporary file directory of a tablespace.
+ *
+ * If someone tries to specify pg_global, use pg_default instead.
+ */
+static void
+TempTablespacePath(char *path, Oid tblspcOid)
+{
+	if (tblspcOid == InvalidOid ||
+		tblspcOid == DEFAULTTABLESPACE_OID ||
 		tblspcOid == GLOBALTABLESPACE_OID)
 	{
 		/* The default tablespace is {datadir}/base */
-		snprintf(tempdirpath, sizeof(tempdirpath), "base/%s",
-				 PG_TEMP_FILES_DIR);
+		snprintf(path, MAXPGPATH, "base/%s", PG_TEMP_FILES_DIR);
 	}
 	else
 	{
 		/* All other tablespaces are accessed via symlinks */
-		snprintf(tempdirpath, sizeof(tempdirpath), "pg_tblspc/%u/%s/%s",
+		snprintf(path, MAXPGPATH, "pg_tblspc/%u/%s/%s",
 				 tblspcOid, TABLESPACE_VERSION_DIRECTORY, PG_TEMP_FILES_DIR);
 	}
+}
+
+/*
+ * Open a temporary file in a specific tablespace.
+ * Subroutine for OpenTemporaryFile, which see for details.
+ */
+static File
+OpenTemporaryFileInTablespace(Oid tblspcOid, bool rejectError)
+{
+	char		tempdirpath[MAXPGPATH];
+	char		tempfilepath[MAXPGPATH];
+	File		file;
+
+	/* Identify the tempfile directory for this tablespace. */
+	TempTablespacePath(tempdirpath, tblspcOid);
 
 	/*
 	 * Generate a tempfile name that should be unique within the current
@@ -1449,6 +1466,108 @@ OpenTemporaryFileInTablespace(Oid tblspcOid, bool rejectError)
 	return file;
 }
 
+/*
+ * Construct the path of a shared temporary file in the given directory.
+ *
+ * The name comes from the caller, so fail rather than silently operate on
+ * a truncated path.
+ */
+static void
+SharedTemporaryFilePath(char *path, const char *tempdirpath, const char *name)
+{
+	if (snprintf(path, MAXPGPATH, "%s/%s%s",
+				 tempdirpath, PG_TEMP_FILE_PREFIX, name) >= MAXPGPATH)
+		ereport(ERROR,
+				(errcode(ERRCODE_NAME_TOO_LONG),
+				 errmsg("temporary file name \"%s\" is too long", name)));
+}
+
+/*
+ * Open a named temporary file that other backends can open too.
+ *
+ * This is meant for temporary data that several processes cooperating on
+ * one query exchange, such as the batch files of a parallel hash join.  The
+ * file lives in the temporary file directory of the given tablespace
+ * (InvalidOid means pg_default), and its name is the given
+ * name with PG_TEMP_FILE_PREFIX prepended; it is up to the caller to choose
+ * a name that is unique within the database instance.
+ *
+ * If create is true, the file is created (or truncated) and opened for
+ * writing; otherwise an existing file is opened read-only, and -1 is
+ * returned if it does not exist.  Either way the File is closed at end of
+ * transaction, but unlike one from OpenTemporaryFile it is not deleted when
+ * closed: the caller has to remove it with DeleteSharedTemporaryFile once
+ * nobody needs it anymore.  Files that are left behind after a crash are
+ * removed by RemovePgTempFiles at the next startup.
+ */
+File
+OpenSharedTemporaryFile(Oid tblspcOid, const char *name, bool create)
+{
+	char		tempdirpath[MAXPGPATH];
+	char		tempfilepath[MAXPGPATH];
+	File		file;
+
+	TempTablespacePath(tempdirpath, tblspcOid);
+	SharedTemporaryFilePath(tempfilepath, tempdirpath, name);
+
+	if (create)
+	{
+		file = PathNameOpenFile(tempfilepath,
+								O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+								0600);
+		if (file <= 0)
+		{
+			/* the directory might not exist yet, see above */
+			mkdir(tempdirpath, S_IRWXU);
+
+			file = PathNameOpenFile(tempfilepath,
+									O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+									0600);
+			if (file <= 0)
+				elog(ERROR, "could not create temporary file \"%s\": %m",
+					 tempfilepath);
+		}
+	}
+	else
+	{
+		file = PathNameOpenFile(tempfilepath, O_RDONLY | PG_BINARY, 0);
+		if (file <= 0)
+		{
+			if (errno == ENOENT)
+				return -1;
+			elog(ERROR, "could not open temporary file \"%s\": %m",
+				 tempfilepath);
+		}
+	}
+
+	RegisterTemporaryFile(file);
+
+	return file;
+}
+
+/*
+ * Remove a file made by OpenSharedTemporaryFile.
+ *
+ * Returns false if there was no such file.
+ */
+bool
+DeleteSharedTemporaryFile(Oid tblspcOid, const char *name)
+{
+	char		tempdirpath[MAXPGPATH];
+	char		tempfilepath[MAXPGPATH];
+
+	TempTablespacePath(tempdirpath, tblspcOid);
+	SharedTemporaryFilePath(tempfilepath, tempdirpath, name);
+
+	if (unlink(tempfilepath) < 0)
+	{
+		if (errno != ENOENT)
+			elog(LOG, "could not unlink file \"%s\": %m", tempfilepath);
+		return false;
+	}
+	return true;
+}
+
 /*
  * close a file when done with it
  */
@@ -1913,6 +2032,44 @@ FileTruncate(File file, off_t offset)
 	return returnCode;
 }
 
+/*
+ * FileFallocate - allocate zero-filled disk space for a range of a file
+ *
+ * The file is extended if the range reaches past its end.  Returns 0 on
+ * success.  On failure, including when posix_fallocate() isn't available or
+ * the filesystem doesn't support it, returns -1 with errno set; the caller
+ * may then fall back to writing out zeroes.
+ */
+int
+FileFallocate(File file, off_t offset, off_t amount)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileFallocate %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) amount));
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return returnCode;
+
+	/* posix_fallocate() reports errors by return value, not errno */
+	returnCode = posix_fallocate(VfdCache[file].fd, offset, amount);
+	if (returnCode != 0)
+	{
+		errno = returnCode;
+		return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 /*
  * Return the pathname associated with an open file.
  *
@@ -190,6 +190,59 @@ RecordPageWithFreeSpace(Relation rel, BlockNumber heapBlk, Size spaceAvail)
 	fsm_set_and_search(rel, addr, slot, new_cat, 0);
 }
 
+/*
+ * RecordPagesWithFreeSpace - like RecordPageWithFreeSpace, for a range of
+ *		heap blocks that all have the same amount of free space.
+ *
+ * Each FSM page covering the range is locked and dirtied only once, which
+ * makes this much cheaper than calling RecordPageWithFreeSpace for every
+ * block after a bulk extension.  As with RecordPageWithFreeSpace, only the
+ * bottom level is updated; see UpdateFreeSpaceMap.
+ */
+void
+RecordPagesWithFreeSpace(Relation rel, BlockNumber startBlkNum,
+						 BlockNumber endBlkNum, Size spaceAvail)
+{
+	int			new_cat = fsm_space_avail_to_cat(spaceAvail);
+	BlockNumber blockNum = startBlkNum;
+
+	while (blockNum <= endBlkNum)
+	{
+		FSMAddress	addr;
+		uint16		slot;
+		BlockNumber lastBlkOnPage;
+		Buffer		buf;
+		Page		page;
+		bool		changed = false;
+
+		/* Find the FSM page for this block, and the last block it covers */
+		addr = fsm_get_location(blockNum, &slot);
+		lastBlkOnPage = Min(fsm_get_lastblckno(rel, addr), endBlkNum);
+
+		buf = fsm_readbuf(rel, addr, true);
+		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buf);
+
+		for (;;)
+		{
+			if (fsm_set_avail(page, slot, new_cat))
+				changed = true;
+			if (blockNum == lastBlkOnPage)
+				break;
+			blockNum++;
+			slot++;
+		}
+
+		if (changed)
+			MarkBufferDirtyHint(buf, false);
+		UnlockReleaseBuffer(buf);
+
+		if (blockNum == endBlkNum)
+			break;
+		blockNum++;
+	}
+}
+
 /*
  * Update the upper levels of the free space map all the way up to the root
  * to make sure we don't lose track of new blocks we just inserted.  This is
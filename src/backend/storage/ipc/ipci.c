@@ -17,6 +17,7 @@
 #include "access/clog.h"
 #include "access/commit_ts.h"
 #include "access/heapam.h"
+#include "access/hio.h"
 #include "access/multixact.h"
 #include "access/nbtree.h"
 #include "access/subtrans.h"
@@ -28,6 +29,7 @@
 #include "postmaster/bgworker_internals.h"
 #include "postmaster/bgwriter.h"
 #include "postmaster/postmaster.h"
+#include "postmaster/sessionpool.h"
 #include "replication/slot.h"
 #include "replication/walreceiver.h"
 #include "replication/walsender.h"
@@ -42,7 +44,10 @@
 #include "storage/procarray.h"
 #include "storage/procsignal.h"
 #include "storage/sinvaladt.h"
+#include "storage/smgr.h"
 #include "storage/spin.h"
+#include "utils/memutils.h"
+#include "utils/sharedplancache.h"
 #include "utils/snapmgr.h"
 
 
@@ -115,6 +120,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, hash_estimate_size(SHMEM_INDEX_SIZE,
 												 sizeof(ShmemIndexEnt)));
 		size = add_size(size, BufferShmemSize());
+		size = add_size(size, TablespaceIOShmemSize());
 		size = add_size(size, LockShmemSize());
 		size = add_size(size, PredicateLockShmemSize());
 		size = add_size(size, ProcGlobalShmemSize());
@@ -128,8 +134,10 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, LWLockShmemSize());
 		size = add_size(size, ProcArrayShmemSize());
 		size = add_size(size, BackendStatusShmemSize());
+		size = add_size(size, TableStatsShmemSize());
 		size = add_size(size, SInvalShmemSize());
 		size = add_size(size, PMSignalShmemSize());
+		size = add_size(size, SessionPoolShmemSize());
 		size = add_size(size, ProcSignalShmemSize());
 		size = add_size(size, CheckpointerShmemSize());
 		size = add_size(size, AutoVacuumShmemSize());
@@ -140,7 +148,10 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		size = add_size(size, SnapMgrShmemSize());
 		size = add_size(size, BTreeShmemSize());
 		size = add_size(size, SyncScanShmemSize());
+		size = add_size(size, HeapExtensionShmemSize());
 		size = add_size(size, AsyncShmemSize());
+		size = add_size(size, SharedPlanCacheShmemSize());
+		size = add_size(size, MemoryContextReportShmemSize());
 #ifdef EXEC_BACKEND
 		size = add_size(size, ShmemBackendArraySize());
 #endif
@@ -199,6 +210,12 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	 */
 	InitShmemIndex();
 
+	/*
+	 * LWLock wait statistics are looked up through the index, so they can
+	 * only be set up now
+	 */
+	LWLockWaitStatsShmemInit();
+
 	/*
 	 * Set up xlog, clog, and buffers
 	 */
@@ -208,6 +225,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	SUBTRANSShmemInit();
 	MultiXactShmemInit();
 	InitBufferPool();
+	TablespaceIOShmemInit();
 
 	/*
 	 * Set up lock manager
@@ -226,6 +244,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		InitProcGlobal();
 	CreateSharedProcArray();
 	CreateSharedBackendStatus();
+	CreateSharedTableStats();
 	TwoPhaseShmemInit();
 	BackgroundWorkerShmemInit();
 
@@ -238,6 +257,7 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	 * Set up interprocess signaling mechanisms
 	 */
 	PMSignalShmemInit();
+	SessionPoolShmemInit();
 	ProcSignalShmemInit();
 	CheckpointerShmemInit();
 	AutoVacuumShmemInit();
@@ -252,7 +272,10 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	SnapMgrInit();
 	BTreeShmemInit();
 	SyncScanShmemInit();
+	HeapExtensionShmemInit();
 	AsyncShmemInit();
+	SharedPlanCacheShmemInit();
+	MemoryContextReportShmemInit();
 
 #ifdef EXEC_BACKEND
 
@@ -267,6 +290,10 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	if (!IsUnderPostmaster)
 		dsm_postmaster_startup(shim);
 
+	/* Now that the segment is laid out, report its huge page coverage */
+	if (!IsUnderPostmaster)
+		PGSharedMemoryReportHugePages();
+
 	/*
 	 * Now give loadable modules a chance to set up their shmem allocations
 	 */
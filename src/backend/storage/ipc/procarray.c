@@ -174,6 +174,8 @@ static void KnownAssignedXidsReset(void);
 static inline void ProcArrayEndTransactionInternal(PGPROC *proc,
 								PGXACT *pgxact, TransactionId latestXid);
 static void ProcArrayGroupClearXid(PGPROC *proc, TransactionId latestXid);
+static bool GetSnapshotDataReuse(Snapshot snapshot);
+static void GetSnapshotDataInitOldSnapshot(Snapshot snapshot);
 
 /*
  * Report shared-memory space needed by CreateSharedProcArray.
@@ -248,6 +250,9 @@ CreateSharedProcArray(void)
 		procArray->lastOverflowedXid = InvalidTransactionId;
 		procArray->replication_slot_xmin = InvalidTransactionId;
 		procArray->replication_slot_catalog_xmin = InvalidTransactionId;
+
+		/* 0 is reserved for snapshots that can not be reused */
+		ShmemVariableCache->xactCompletionCount = 1;
 	}
 
 	allProcs = ProcGlobal->allProcs;
@@ -358,6 +363,9 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 		if (TransactionIdPrecedes(ShmemVariableCache->latestCompletedXid,
 								  latestXid))
 			ShmemVariableCache->latestCompletedXid = latestXid;
+
+		/* Same with xactCompletionCount */
+		ShmemVariableCache->xactCompletionCount++;
 	}
 	else
 	{
@@ -473,6 +481,9 @@ ProcArrayEndTransactionInternal(PGPROC *proc, PGXACT *pgxact,
 	if (TransactionIdPrecedes(ShmemVariableCache->latestCompletedXid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
+
+	/* Same with xactCompletionCount */
+	ShmemVariableCache->xactCompletionCount++;
 }
 
 /*
@@ -612,11 +623,15 @@ ProcArrayClearTransaction(PGPROC *proc)
 	PGXACT	   *pgxact = &allPgXact[proc->pgprocno];
 
 	/*
-	 * We can skip locking ProcArrayLock here, because this action does not
-	 * actually change anyone's view of the set of running XIDs: our entry is
-	 * duplicate with the gxact that has already been inserted into the
-	 * ProcArray.
+	 * This action does not actually change anyone's view of the set of
+	 * running XIDs: our entry is duplicate with the gxact that has already
+	 * been inserted into the ProcArray.  But our own snapshots omit our XID,
+	 * so we must advance xactCompletionCount to keep GetSnapshotData from
+	 * reusing them as if the prepared transaction were not running, and that
+	 * requires ProcArrayLock.
 	 */
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+
 	pgxact->xid = InvalidTransactionId;
 	proc->lxid = InvalidLocalTransactionId;
 	pgxact->xmin = InvalidTransactionId;
@@ -629,6 +644,10 @@ ProcArrayClearTransaction(PGPROC *proc)
 	/* Clear the subtransaction-XID cache too */
 	pgxact->nxids = 0;
 	pgxact->overflowed = false;
+
+	ShmemVariableCache->xactCompletionCount++;
+
+	LWLockRelease(ProcArrayLock);
 }
 
 /*
@@ -881,6 +900,9 @@ ProcArrayApplyRecoveryInfo(RunningTransactions running)
 
 	Assert(TransactionIdIsNormal(ShmemVariableCache->latestCompletedXid));
 
+	/* KnownAssignedXids has changed, so snapshots must be rebuilt */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 
 	/*
@@ -1580,6 +1602,12 @@ PgGetSnapshotData(Snapshot snapshot)
 	 */
 	LWLockAcquire(ProcArrayLock, LW_SHARED);
 
+	if (GetSnapshotDataReuse(snapshot))
+	{
+		LWLockRelease(ProcArrayLock);
+		return snapshot;
+	}
+
 	/* xmax is always latestCompletedXid + 1 */
 	xmax = ShmemVariableCache->latestCompletedXid;
 	Assert(TransactionIdIsNormal(xmax));
@@ -1731,6 +1759,8 @@ PgGetSnapshotData(Snapshot snapshot)
 	if (!TransactionIdIsValid(MyPgXact->xmin))
 		MyPgXact->xmin = TransactionXmin = xmin;
 
+	snapshot->snapXactCompletionCount = ShmemVariableCache->xactCompletionCount;
+
 	LWLockRelease(ProcArrayLock);
 
 	/*
@@ -1780,6 +1810,63 @@ PgGetSnapshotData(Snapshot snapshot)
 	snapshot->regd_count = 0;
 	snapshot->copied = false;
 
+	GetSnapshotDataInitOldSnapshot(snapshot);
+
+	return snapshot;
+}
+
+/*
+ * GetSnapshotDataReuse -- try to reuse the previous contents of a snapshot
+ *
+ * If no transaction has completed since GetSnapshotData last built this
+ * snapshot, scanning the ProcArray again would produce the same xmin, xmax
+ * and XID arrays: a transaction that started in the meantime has an XID
+ * >= xmax, and so is considered running anyway.  Then we only need to redo
+ * the cheap per-call bookkeeping.  RecentGlobalXmin and friends are left
+ * alone; keeping their previous values is merely conservative.
+ *
+ * Caller must hold ProcArrayLock, so that the completion count cannot
+ * change concurrently.  Returns false if the snapshot must be rebuilt.
+ */
+static bool
+GetSnapshotDataReuse(Snapshot snapshot)
+{
+	Assert(LWLockHeldByMe(ProcArrayLock));
+
+	if (snapshot->snapXactCompletionCount == 0 ||
+		snapshot->snapXactCompletionCount !=
+		ShmemVariableCache->xactCompletionCount)
+		return false;
+
+	/*
+	 * Since the set of running transactions is the same as when the snapshot
+	 * was built, none of the rows it can see could have been removed, and it
+	 * is safe to advertise its xmin again.  A concurrent GetSnapshotData()
+	 * would compute the same xmin anyway.
+	 */
+	if (!TransactionIdIsValid(MyPgXact->xmin))
+		MyPgXact->xmin = TransactionXmin = snapshot->xmin;
+
+	RecentXmin = snapshot->xmin;
+	Assert(TransactionIdPrecedesOrEquals(TransactionXmin, RecentXmin));
+
+	snapshot->curcid = GetCurrentCommandId(false);
+	snapshot->active_count = 0;
+	snapshot->regd_count = 0;
+	snapshot->copied = false;
+
+	GetSnapshotDataInitOldSnapshot(snapshot);
+
+	return true;
+}
+
+/*
+ * Set up the "snapshot too old" fields of a snapshot returned by
+ * GetSnapshotData.
+ */
+static void
+GetSnapshotDataInitOldSnapshot(Snapshot snapshot)
+{
 	if (old_snapshot_threshold < 0)
 	{
 		/*
@@ -1798,10 +1885,8 @@ PgGetSnapshotData(Snapshot snapshot)
 		 */
 		snapshot->lsn = GetXLogInsertRecPtr();
 		snapshot->whenTaken = GetSnapshotCurrentTimestamp();
-		MaintainOldSnapshotTimeMapping(snapshot->whenTaken, xmin);
+		MaintainOldSnapshotTimeMapping(snapshot->whenTaken, snapshot->xmin);
 	}
-
-	return snapshot;
 }
 
 /*
@@ -2450,6 +2535,47 @@ BackendXidGetPid(TransactionId xid)
 	return result;
 }
 
+/*
+ * BackendXidIsPlainToplevel -- is a given XID the main XID of a running
+ * transaction without subtransactions
+ *
+ * Returns false if the transaction is not running (or it is a prepared
+ * transaction), or it has subtransactions with assigned XIDs which were not
+ * aborted, or the subxid cache overflowed.  Used by logical decoding to
+ * check that an in-progress transaction has no subtransactions not yet
+ * reported by XLOG_XACT_ASSIGNMENT records.
+ */
+bool
+BackendXidIsPlainToplevel(TransactionId xid)
+{
+	bool		result = false;
+	ProcArrayStruct *arrayP = procArray;
+	int			index;
+
+	if (xid == InvalidTransactionId)	/* never match invalid xid */
+		return false;
+
+	LWLockAcquire(ProcArrayLock, LW_SHARED);
+
+	for (index = 0; index < arrayP->numProcs; index++)
+	{
+		int			pgprocno = arrayP->pgprocnos[index];
+		volatile PGPROC *proc = &allProcs[pgprocno];
+		volatile PGXACT *pgxact = &allPgXact[pgprocno];
+
+		if (pgxact->xid == xid)
+		{
+			result = proc->pid != 0 && pgxact->nxids == 0 &&
+				!pgxact->overflowed;
+			break;
+		}
+	}
+
+	LWLockRelease(ProcArrayLock);
+
+	return result;
+}
+
 /*
  * IsBackendPid -- is a given pid a running backend
  *
@@ -3095,6 +3221,9 @@ XidCacheRemoveRunningXids(TransactionId xid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
 
+	/* Same with xactCompletionCount */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3278,6 +3407,9 @@ ExpireTreeKnownAssignedTransactionIds(TransactionId xid, int nsubxids,
 							  max_xid))
 		ShmemVariableCache->latestCompletedXid = max_xid;
 
+	/* ... and xactCompletionCount */
+	ShmemVariableCache->xactCompletionCount++;
+
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3290,6 +3422,7 @@ ExpireAllKnownAssignedTransactionIds(void)
 {
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	KnownAssignedXidsRemovePreceding(InvalidTransactionId);
+	ShmemVariableCache->xactCompletionCount++;
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3302,6 +3435,7 @@ ExpireOldKnownAssignedTransactionIds(TransactionId xid)
 {
 	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
 	KnownAssignedXidsRemovePreceding(xid);
+	ShmemVariableCache->xactCompletionCount++;
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -3973,6 +4107,7 @@ KnownAssignedXidsReset(void)
 	pArray->numKnownAssignedXids = 0;
 	pArray->tailKnownAssignedXids = 0;
 	pArray->headKnownAssignedXids = 0;
+	ShmemVariableCache->xactCompletionCount++;
 
 	LWLockRelease(ProcArrayLock);
 }
@@ -17,6 +17,7 @@
 #include "access/xact.h"
 #include "commands/async.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/ipc.h"
 #include "storage/proc.h"
 #include "storage/sinvaladt.h"
@@ -105,6 +106,7 @@ ReceiveSharedInvalidMessages(
 			/* got a reset message */
 			elog(DEBUG4, "cache state reset");
 			SharedInvalidMessageCounter++;
+			pgstat_report_sinval_reset();
 			resetFunction();
 			break;				/* nothing more to do */
 		}
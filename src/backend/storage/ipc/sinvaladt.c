@@ -43,16 +43,24 @@
  * smallest nextMsgNum --- it may lag behind.  We only update it when
  * SICleanupQueue is called, and we try not to do that often.)
  *
- * In reality, the messages are stored in a circular buffer of MAXNUMMESSAGES
- * entries.  We translate MsgNum values into circular-buffer indexes by
- * computing MsgNum % MAXNUMMESSAGES (this should be fast as long as
- * MAXNUMMESSAGES is a constant and a power of 2).  As long as maxMsgNum
- * doesn't exceed minMsgNum by more than MAXNUMMESSAGES, we have enough space
- * in the buffer.  If the buffer does overflow, we recover by setting the
- * "reset" flag for each backend that has fallen too far behind.  A backend
- * that is in "reset" state is ignored while determining minMsgNum.  When
- * it does finally attempt to receive inval messages, it must discard all
- * its invalidatable state, since it won't know what it missed.
+ * In reality, the messages are stored in a circular buffer of numMessages
+ * entries, shared_invalidation_queue_size rounded up to a power of 2.  We
+ * translate MsgNum values into circular-buffer indexes by computing
+ * MsgNum & (numMessages - 1).  As long as maxMsgNum doesn't exceed minMsgNum
+ * by more than numMessages, we have enough space in the buffer.  If the
+ * buffer does overflow, we recover by setting the "reset" flag for each
+ * backend that has fallen too far behind.  A backend that is in "reset"
+ * state is ignored while determining minMsgNum.  When it does finally
+ * attempt to receive inval messages, it must discard all its invalidatable
+ * state, since it won't know what it missed.
+ *
+ * Most messages concern a single database, though, and a backend ignores
+ * messages for databases other than its own.  So before resetting a backend
+ * we try to move it past the messages to be discarded instead, keeping the
+ * ones which concern its database in a small per-backend array of saved
+ * messages, which it reads before the queue.  A backend thus gets reset only
+ * if the messages it missed for its own database are too many to be saved,
+ * rather than whenever DDL in any database overflows the queue.
  *
  * To reduce the probability of needing resets, we send a "catchup" interrupt
  * to any backend that seems to be falling unreasonably far behind.  The
@@ -74,7 +82,7 @@
  * whenever minMsgNum exceeds MSGNUMWRAPAROUND, we subtract MSGNUMWRAPAROUND
  * from all the MsgNum variables simultaneously.  MSGNUMWRAPAROUND can be
  * large so that we don't need to do this often.  It must be a multiple of
- * MAXNUMMESSAGES so that the existing circular-buffer entries don't need
+ * numMessages so that the existing circular-buffer entries don't need
  * to be moved when we do it.
  *
  * Access to the shared sinval array is protected by two locks, SInvalReadLock
@@ -107,11 +115,12 @@
 /*
  * Configurable parameters.
  *
- * MAXNUMMESSAGES: max number of shared-inval messages we can buffer.
- * Must be a power of 2 for speed.
+ * shared_invalidation_queue_size: max number of shared-inval messages we can
+ * buffer.  Rounded up to a power of 2 for speed, and at most
+ * MAX_SINVAL_QUEUE_SIZE.
  *
  * MSGNUMWRAPAROUND: how often to reduce MsgNum variables to avoid overflow.
- * Must be a multiple of MAXNUMMESSAGES.  Should be large.
+ * Must be a multiple of the buffer size.  Should be large.
  *
  * CLEANUP_MIN: the minimum number of messages that must be in the buffer
  * before we bother to call SICleanupQueue.
@@ -126,14 +135,19 @@
  * iteration of SIInsertDataEntries.  Noncritical but should be less than
  * CLEANUP_QUANTUM, because we only consider calling SICleanupQueue once
  * per iteration.
+ *
+ * MAXSAVEDMESSAGES: the max number of distinct messages kept for a backend
+ * which fell too far behind, before it has to be reset instead.
  */
 
-#define MAXNUMMESSAGES 4096
-#define MSGNUMWRAPAROUND (MAXNUMMESSAGES * 262144)
-#define CLEANUP_MIN (MAXNUMMESSAGES / 2)
-#define CLEANUP_QUANTUM (MAXNUMMESSAGES / 16)
-#define SIG_THRESHOLD (MAXNUMMESSAGES / 2)
+#define MSGNUMWRAPAROUND (MAX_SINVAL_QUEUE_SIZE * 1024)
+#define CLEANUP_MIN(segP) ((segP)->numMessages / 2)
+#define CLEANUP_QUANTUM(segP) ((segP)->numMessages / 16)
+#define SIG_THRESHOLD(segP) ((segP)->numMessages / 2)
 #define WRITE_QUANTUM 64
+#define MAXSAVEDMESSAGES 32
+
+int			shared_invalidation_queue_size = 4096;
 
 /* Per-backend state in shared invalidation structure */
 typedef struct ProcState
@@ -155,6 +169,14 @@ typedef struct ProcState
 	 */
 	bool		sendOnly;		/* backend only sends, never receives */
 
+	/*
+	 * Messages concerning the backend's database which were removed from the
+	 * queue before the backend read them.  They are returned before those
+	 * in the queue.  nsaved is meaningless if resetState is true.
+	 */
+	int			nsaved;			/* number of messages in saved[] */
+	SharedInvalidationMessage saved[MAXSAVEDMESSAGES];
+
 	/*
 	 * Next LocalTransactionId to use for each idle backend slot.  We keep
 	 * this here because it is indexed by BackendId and it is convenient to
@@ -175,13 +197,15 @@ typedef struct SISeg
 	int			nextThreshold;	/* # of messages to call SICleanupQueue */
 	int			lastBackend;	/* index of last active procState entry, +1 */
 	int			maxBackends;	/* size of procState array */
+	int			numMessages;	/* size of buffer array, a power of 2 */
 
 	slock_t		msgnumLock;		/* spinlock protecting maxMsgNum */
 
 	/*
-	 * Circular buffer holding shared-inval messages
+	 * Circular buffer holding shared-inval messages (has numMessages
+	 * entries, and follows the procState array).
 	 */
-	SharedInvalidationMessage buffer[MAXNUMMESSAGES];
+	SharedInvalidationMessage *buffer;
 
 	/*
 	 * Per-backend invalidation state info (has MaxBackends entries).
@@ -189,13 +213,35 @@ typedef struct SISeg
 	ProcState	procState[FLEXIBLE_ARRAY_MEMBER];
 } SISeg;
 
+#define SIMessage(segP, msgnum) \
+	((segP)->buffer[(msgnum) & ((segP)->numMessages - 1)])
+
 static SISeg *shmInvalBuffer;	/* pointer to the shared inval buffer */
 
 
 static LocalTransactionId nextLocalTransactionId;
 
 static void CleanupInvalidationState(int status, Datum arg);
+static bool SISkipMessages(SISeg *segP, ProcState *stateP, int upto);
+static bool SIMessageConcernsDatabase(const SharedInvalidationMessage *msg,
+						  Oid dbId);
+static bool SIMessagesEqual(const SharedInvalidationMessage *a,
+				const SharedInvalidationMessage *b);
+
 
+/*
+ * SInvalQueueSize --- return the size of the message buffer
+ */
+static int
+SInvalQueueSize(void)
+{
+	int			size = 1;
+
+	while (size < shared_invalidation_queue_size)
+		size <<= 1;
+
+	return size;
+}
 
 /*
  * SInvalShmemSize --- return shared-memory space needed
@@ -207,6 +253,9 @@ SInvalShmemSize(void)
 
 	size = offsetof(SISeg, procState);
 	size = add_size(size, mul_size(sizeof(ProcState), MaxBackends));
+	size = MAXALIGN(size);
+	size = add_size(size, mul_size(sizeof(SharedInvalidationMessage),
+								   SInvalQueueSize()));
 
 	return size;
 }
@@ -230,11 +279,17 @@ CreateSharedInvalidationState(void)
 	/* Clear message counters, save size of procState array, init spinlock */
 	shmInvalBuffer->minMsgNum = 0;
 	shmInvalBuffer->maxMsgNum = 0;
-	shmInvalBuffer->nextThreshold = CLEANUP_MIN;
+	shmInvalBuffer->nextThreshold = SInvalQueueSize() / 2;
 	shmInvalBuffer->lastBackend = 0;
 	shmInvalBuffer->maxBackends = MaxBackends;
+	shmInvalBuffer->numMessages = SInvalQueueSize();
 	SpinLockInit(&shmInvalBuffer->msgnumLock);
 
+	shmInvalBuffer->buffer = (SharedInvalidationMessage *)
+		((char *) shmInvalBuffer +
+		 MAXALIGN(offsetof(SISeg, procState) +
+				  sizeof(ProcState) * MaxBackends));
+
 	/* The buffer[] array is initially all unused, so we need not fill it */
 
 	/* Mark all backends inactive, and initialize nextLXID */
@@ -246,6 +301,7 @@ CreateSharedInvalidationState(void)
 		shmInvalBuffer->procState[i].resetState = false;
 		shmInvalBuffer->procState[i].signaled = false;
 		shmInvalBuffer->procState[i].hasMessages = false;
+		shmInvalBuffer->procState[i].nsaved = 0;
 		shmInvalBuffer->procState[i].nextLXID = InvalidLocalTransactionId;
 	}
 }
@@ -315,6 +371,7 @@ SharedInvalBackendInit(bool sendOnly)
 	stateP->signaled = false;
 	stateP->hasMessages = false;
 	stateP->sendOnly = sendOnly;
+	stateP->nsaved = 0;
 
 	LWLockRelease(SInvalWriteLock);
 
@@ -354,6 +411,7 @@ CleanupInvalidationState(int status, Datum arg)
 	stateP->nextMsgNum = 0;
 	stateP->resetState = false;
 	stateP->signaled = false;
+	stateP->nsaved = 0;
 
 	/* Recompute index of last active backend */
 	for (i = segP->lastBackend; i > 0; i--)
@@ -467,7 +525,7 @@ SIInsertDataEntries(const SharedInvalidationMessage *data, int n)
 		for (;;)
 		{
 			numMsgs = segP->maxMsgNum - segP->minMsgNum;
-			if (numMsgs + nthistime > MAXNUMMESSAGES ||
+			if (numMsgs + nthistime > segP->numMessages ||
 				numMsgs >= segP->nextThreshold)
 				SICleanupQueue(true, nthistime);
 			else
@@ -480,7 +538,7 @@ SIInsertDataEntries(const SharedInvalidationMessage *data, int n)
 		max = segP->maxMsgNum;
 		while (nthistime-- > 0)
 		{
-			segP->buffer[max % MAXNUMMESSAGES] = *data++;
+			SIMessage(segP, max) = *data++;
 			max++;
 		}
 
@@ -588,10 +646,24 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 		stateP->nextMsgNum = max;
 		stateP->resetState = false;
 		stateP->signaled = false;
+		stateP->nsaved = 0;
 		LWLockRelease(SInvalReadLock);
 		return -1;
 	}
 
+	/*
+	 * Retrieve the messages saved when we fell behind, which are older than
+	 * those in the queue.
+	 */
+	n = Min(stateP->nsaved, datasize);
+	if (n > 0)
+	{
+		memcpy(data, stateP->saved, n * sizeof(SharedInvalidationMessage));
+		stateP->nsaved -= n;
+		memmove(stateP->saved, stateP->saved + n,
+				stateP->nsaved * sizeof(SharedInvalidationMessage));
+	}
+
 	/*
 	 * Retrieve messages and advance backend's counter, until data array is
 	 * full or there are no more messages.
@@ -600,10 +672,9 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 	 * cannot delete them here.  SICleanupQueue() will eventually remove them
 	 * from the queue.
 	 */
-	n = 0;
 	while (n < datasize && stateP->nextMsgNum < max)
 	{
-		data[n++] = segP->buffer[stateP->nextMsgNum % MAXNUMMESSAGES];
+		data[n++] = SIMessage(segP, stateP->nextMsgNum);
 		stateP->nextMsgNum++;
 	}
 
@@ -614,7 +685,7 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
 	 * If we haven't caught up completely, reset the hasMessages flag so that
 	 * we see the remaining messages next time.
 	 */
-	if (stateP->nextMsgNum >= max)
+	if (stateP->nextMsgNum >= max && stateP->nsaved == 0)
 		stateP->signaled = false;
 	else
 		stateP->hasMessages = true;
@@ -630,8 +701,10 @@ SIGetDataEntries(SharedInvalidationMessage *data, int datasize)
  * callerHasWriteLock is TRUE if caller is holding SInvalWriteLock.
  * minFree is the minimum number of message slots to make free.
  *
- * Possible side effects of this routine include marking one or more
- * backends as "reset" in the array, and sending PROCSIG_CATCHUP_INTERRUPT
+ * Possible side effects of this routine include moving backends which are
+ * too far behind past the messages to be removed, saving the ones they need,
+ * marking one or more such backends as "reset" in the array if their saved
+ * messages would not fit, and sending PROCSIG_CATCHUP_INTERRUPT
  * to some backend that seems to be getting too far behind.  We signal at
  * most one backend at a time, for reasons explained at the top of the file.
  *
@@ -663,8 +736,8 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 	 * a problem even when they are the only active backend.
 	 */
 	min = segP->maxMsgNum;
-	minsig = min - SIG_THRESHOLD;
-	lowbound = min - MAXNUMMESSAGES + minFree;
+	minsig = min - SIG_THRESHOLD(segP);
+	lowbound = min - segP->numMessages + minFree;
 
 	for (i = 0; i < segP->lastBackend; i++)
 	{
@@ -676,14 +749,20 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 			continue;
 
 		/*
-		 * If we must free some space and this backend is preventing it, force
-		 * him into reset state and then ignore until he catches up.
+		 * If we must free some space and this backend is preventing it, move
+		 * him past the messages to be removed.  If he needs too many of them,
+		 * force him into reset state instead and then ignore until he catches
+		 * up.
 		 */
 		if (n < lowbound)
 		{
-			stateP->resetState = true;
-			/* no point in signaling him ... */
-			continue;
+			if (!SISkipMessages(segP, stateP, lowbound))
+			{
+				stateP->resetState = true;
+				/* no point in signaling him ... */
+				continue;
+			}
+			n = lowbound;
 		}
 
 		/* Track the global minimum nextMsgNum */
@@ -720,10 +799,11 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 	 * threshold at which we should repeat SICleanupQueue().
 	 */
 	numMsgs = segP->maxMsgNum - segP->minMsgNum;
-	if (numMsgs < CLEANUP_MIN)
-		segP->nextThreshold = CLEANUP_MIN;
+	if (numMsgs < CLEANUP_MIN(segP))
+		segP->nextThreshold = CLEANUP_MIN(segP);
 	else
-		segP->nextThreshold = (numMsgs / CLEANUP_QUANTUM + 1) * CLEANUP_QUANTUM;
+		segP->nextThreshold = (numMsgs / CLEANUP_QUANTUM(segP) + 1) *
+			CLEANUP_QUANTUM(segP);
 
 	/*
 	 * Lastly, signal anyone who needs a catchup interrupt.  Since
@@ -752,6 +832,118 @@ SICleanupQueue(bool callerHasWriteLock, int minFree)
 }
 
 
+/*
+ * SISkipMessages
+ *		Move a backend which fell behind past the messages up to "upto",
+ *		saving those it needs.
+ *
+ * Returns false if the messages the backend needs don't fit in its saved
+ * messages array, or if we don't know which ones it needs; it has to be
+ * reset then.  Caller must hold both SInvalWriteLock and SInvalReadLock
+ * exclusively.
+ */
+static bool
+SISkipMessages(SISeg *segP, ProcState *stateP, int upto)
+{
+	Oid			dbId = stateP->proc->databaseId;
+	int			nsaved = stateP->nsaved;
+	int			msgnum;
+
+	/* a backend not yet connected to a database may need any message */
+	if (!OidIsValid(dbId))
+		return false;
+
+	for (msgnum = stateP->nextMsgNum; msgnum < upto; msgnum++)
+	{
+		SharedInvalidationMessage *msg = &SIMessage(segP, msgnum);
+		int			i;
+
+		if (!SIMessageConcernsDatabase(msg, dbId))
+			continue;
+
+		for (i = 0; i < nsaved; i++)
+		{
+			if (SIMessagesEqual(&stateP->saved[i], msg))
+				break;
+		}
+		if (i < nsaved)
+			continue;			/* already saved */
+
+		if (nsaved >= MAXSAVEDMESSAGES)
+			return false;
+		stateP->saved[nsaved++] = *msg;
+	}
+
+	stateP->nsaved = nsaved;
+	stateP->nextMsgNum = upto;
+	return true;
+}
+
+/*
+ * SIMessageConcernsDatabase
+ *		Would a backend connected to the given database act on the message?
+ *
+ * Messages for shared catalogs and relations concern all databases, and so
+ * do smgr messages, since any backend may have the relation open at smgr
+ * level.
+ */
+static bool
+SIMessageConcernsDatabase(const SharedInvalidationMessage *msg, Oid dbId)
+{
+	Oid			msgDbId;
+
+	if (msg->id >= 0)
+		msgDbId = msg->cc.dbId;
+	else if (msg->id == SHAREDINVALCATALOG_ID)
+		msgDbId = msg->cat.dbId;
+	else if (msg->id == SHAREDINVALRELCACHE_ID)
+		msgDbId = msg->rc.dbId;
+	else if (msg->id == SHAREDINVALRELMAP_ID)
+		msgDbId = msg->rm.dbId;
+	else if (msg->id == SHAREDINVALSNAPSHOT_ID)
+		msgDbId = msg->sn.dbId;
+	else
+		return true;
+
+	return !OidIsValid(msgDbId) || msgDbId == dbId;
+}
+
+/*
+ * SIMessagesEqual
+ *		Do two messages invalidate the same thing?
+ *
+ * Messages can't be compared with memcmp, as they may contain padding.
+ */
+static bool
+SIMessagesEqual(const SharedInvalidationMessage *a,
+				const SharedInvalidationMessage *b)
+{
+	if (a->id != b->id)
+		return false;
+
+	if (a->id >= 0)
+		return a->cc.dbId == b->cc.dbId && a->cc.hashValue == b->cc.hashValue;
+
+	switch (a->id)
+	{
+		case SHAREDINVALCATALOG_ID:
+			return a->cat.dbId == b->cat.dbId && a->cat.catId == b->cat.catId;
+		case SHAREDINVALRELCACHE_ID:
+			return a->rc.dbId == b->rc.dbId && a->rc.relId == b->rc.relId;
+		case SHAREDINVALSMGR_ID:
+			return a->sm.backend_hi == b->sm.backend_hi &&
+				a->sm.backend_lo == b->sm.backend_lo &&
+				RelFileNodeEquals(a->sm.rnode, b->sm.rnode);
+		case SHAREDINVALRELMAP_ID:
+			return a->rm.dbId == b->rm.dbId;
+		case SHAREDINVALSNAPSHOT_ID:
+			return a->sn.dbId == b->sn.dbId && a->sn.relId == b->sn.relId;
+		default:
+			return false;
+	}
+}
+
+
 /*
  * GetNextLocalTransactionId --- allocate a new LocalTransactionId
  *
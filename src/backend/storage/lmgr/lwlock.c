@@ -79,6 +79,7 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "pg_trace.h"
+#include "portability/instr_time.h"
 #include "postmaster/postmaster.h"
 #include "replication/slot.h"
 #include "storage/ipc.h"
@@ -130,6 +131,7 @@ static LWLockTranche MainLWLockTranche;
 static LWLockTranche BufMappingLWLockTranche;
 static LWLockTranche LockManagerLWLockTranche;
 static LWLockTranche PredicateLockManagerLWLockTranche;
+static LWLockTranche TwoPhaseStateLWLockTranche;
 
 /*
  * We use this structure to keep track of locked LWLocks for release
@@ -149,6 +151,19 @@ typedef struct LWLockHandle
 static int	num_held_lwlocks = 0;
 static LWLockHandle held_lwlocks[MAX_SIMUL_LWLOCKS];
 
+/*
+ * Wait statistics in shared memory, LWLOCK_STATS_SLOTS entries for each
+ * PGPROC that can run a process.  Only the owning process writes its
+ * entries, so they can be updated without atomics; readers add up the rows
+ * of all processes and can tolerate slightly stale values.  The entries are
+ * never reset, so the sums cover the whole lifetime of the server.
+ * Processes without a PGPROC count into a local dummy entry.
+ */
+static LWLockWaitStats *LWLockWaitStatsArray = NULL;
+static LWLockWaitStats LWLockWaitStatsDummy;
+
+#define NumLWLockStatsProcs()	(MaxBackends + NUM_AUXILIARY_PROCS)
+
 /* struct representing the LWLock tranche request for named tranche */
 typedef struct NamedLWLockTrancheRequest
 {
@@ -169,6 +184,8 @@ static void RegisterLWLockTranches(void);
 
 static inline void LWLockReportWaitStart(LWLock *lock);
 static inline void LWLockReportWaitEnd(void);
+static inline LWLockWaitStats *GetLWLockWaitStatsEntry(LWLock *lock);
+static void LWLockRecordWait(LWLockWaitStats *waitstats, instr_time start);
 
 #ifdef LWLOCK_STATS
 typedef struct lwlock_stats_key
@@ -397,6 +414,11 @@ LWLockShmemSize(void)
 	for (i = 0; i < NamedLWLockTrancheRequests; i++)
 		size = add_size(size, strlen(NamedLWLockTrancheRequestArray[i].tranche_name) + 1);
 
+	/* space for wait statistics */
+	size = add_size(size, mul_size(mul_size(NumLWLockStatsProcs(),
+											LWLOCK_STATS_SLOTS),
+								   sizeof(LWLockWaitStats)));
+
 	/* Disallow named LWLocks' requests after startup */
 	lock_named_request_allowed = false;
 
@@ -449,6 +471,27 @@ CreateLWLocks(void)
 	RegisterLWLockTranches();
 }
 
+/*
+ * Allocate and zero the LWLock wait statistics.
+ *
+ * This can't be done in CreateLWLocks, because ShmemInitStruct needs the
+ * shmem index, which in turn needs the LWLocks.  The space is accounted for
+ * in LWLockShmemSize.
+ */
+void
+LWLockWaitStatsShmemInit(void)
+{
+	Size		spaceStats;
+	bool		found;
+
+	spaceStats = mul_size(mul_size(NumLWLockStatsProcs(), LWLOCK_STATS_SLOTS),
+						  sizeof(LWLockWaitStats));
+	LWLockWaitStatsArray = (LWLockWaitStats *)
+		ShmemInitStruct("LWLock Wait Statistics", spaceStats, &found);
+	if (!found)
+		MemSet(LWLockWaitStatsArray, 0, spaceStats);
+}
+
 /*
  * Initialize LWLocks that are fixed and those belonging to named tranches.
  */
@@ -481,6 +524,11 @@ InitializeLWLocks(void)
 	for (id = 0; id < NUM_PREDICATELOCK_PARTITIONS; id++, lock++)
 		LWLockInitialize(&lock->lock, LWTRANCHE_PREDICATE_LOCK_MANAGER);
 
+	/* Initialize prepared transactions table LWLocks in main array */
+	lock = MainLWLockArray + TWOPHASE_STATE_LWLOCK_OFFSET;
+	for (id = 0; id < NUM_TWOPHASE_PARTITIONS; id++, lock++)
+		LWLockInitialize(&lock->lock, LWTRANCHE_TWOPHASE_STATE);
+
 	/* Initialize named tranches. */
 	if (NamedLWLockTrancheRequests > 0)
 	{
@@ -555,6 +603,11 @@ RegisterLWLockTranches(void)
 	PredicateLockManagerLWLockTranche.array_stride = sizeof(LWLockPadded);
 	LWLockRegisterTranche(LWTRANCHE_PREDICATE_LOCK_MANAGER, &PredicateLockManagerLWLockTranche);
 
+	TwoPhaseStateLWLockTranche.name = "twophase_state";
+	TwoPhaseStateLWLockTranche.array_base = MainLWLockArray + TWOPHASE_STATE_LWLOCK_OFFSET;
+	TwoPhaseStateLWLockTranche.array_stride = sizeof(LWLockPadded);
+	LWLockRegisterTranche(LWTRANCHE_TWOPHASE_STATE, &TwoPhaseStateLWLockTranche);
+
 	/* Register named tranches. */
 	for (i = 0; i < NamedLWLockTrancheRequests; i++)
 		LWLockRegisterTranche(NamedLWLockTrancheArray[i].trancheId,
@@ -768,6 +821,125 @@ GetLWLockIdentifier(uint8 classId, uint16 eventId)
 	return LWLockTrancheArray[eventId]->name;
 }
 
+/*
+ * Return the wait statistics entry of the current process for a lock.
+ *
+ * The individual locks of the main array each get their own entry, other
+ * locks are summed up per tranche.  Locks of tranches beyond
+ * LWLOCK_STATS_TRANCHES are not tracked.
+ */
+static inline LWLockWaitStats *
+GetLWLockWaitStatsEntry(LWLock *lock)
+{
+	int			slot;
+
+	if (MyProc == NULL || LWLockWaitStatsArray == NULL)
+		return &LWLockWaitStatsDummy;
+
+	if (lock->tranche == LWTRANCHE_MAIN &&
+		(char *) lock >= (char *) MainLWLockArray &&
+		(char *) lock < (char *) (MainLWLockArray + NUM_INDIVIDUAL_LWLOCKS))
+		slot = (LWLockPadded *) lock - MainLWLockArray;
+	else if (lock->tranche < LWLOCK_STATS_TRANCHES)
+		slot = NUM_INDIVIDUAL_LWLOCKS + lock->tranche;
+	else
+		return &LWLockWaitStatsDummy;
+
+	return &LWLockWaitStatsArray[MyProc->pgprocno * LWLOCK_STATS_SLOTS + slot];
+}
+
+/*
+ * Account for one sleep on a lock that started at the given time.
+ */
+static void
+LWLockRecordWait(LWLockWaitStats *waitstats, instr_time start)
+{
+	instr_time	duration;
+	uint64		waited;
+	uint64		limit;
+	int			bucket;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	waited = INSTR_TIME_GET_MICROSEC(duration);
+
+	waitstats->block_count++;
+	waitstats->wait_time += waited;
+	if (waited > waitstats->max_wait_time)
+		waitstats->max_wait_time = waited;
+
+	for (bucket = 0, limit = 10;
+		 bucket < LWLOCK_WAIT_BUCKETS - 1 && waited >= limit;
+		 bucket++, limit *= 10)
+		;
+	waitstats->wait_histogram[bucket]++;
+}
+
+/*
+ * LWLockGetWaitStats - sum up the wait statistics of all processes
+ *
+ * Returns a palloc'd array of LWLOCK_STATS_SLOTS entries; use
+ * LWLockWaitStatsName() to label them.
+ */
+LWLockWaitStats *
+LWLockGetWaitStats(void)
+{
+	LWLockWaitStats *result;
+	int			nprocs = NumLWLockStatsProcs();
+	int			procno;
+	int			slot;
+	int			i;
+
+	result = (LWLockWaitStats *)
+		palloc0(LWLOCK_STATS_SLOTS * sizeof(LWLockWaitStats));
+
+	for (procno = 0; procno < nprocs; procno++)
+	{
+		LWLockWaitStats *row = &LWLockWaitStatsArray[procno * LWLOCK_STATS_SLOTS];
+
+		for (slot = 0; slot < LWLOCK_STATS_SLOTS; slot++)
+		{
+			LWLockWaitStats *src = &row[slot];
+			LWLockWaitStats *dst = &result[slot];
+
+			dst->acquire_count += src->acquire_count;
+			dst->block_count += src->block_count;
+			dst->wait_time += src->wait_time;
+			if (src->max_wait_time > dst->max_wait_time)
+				dst->max_wait_time = src->max_wait_time;
+			for (i = 0; i < LWLOCK_WAIT_BUCKETS; i++)
+				dst->wait_histogram[i] += src->wait_histogram[i];
+		}
+	}
+
+	return result;
+}
+
+/*
+ * LWLockWaitStatsName - name of a wait statistics slot
+ *
+ * Like GetLWLockIdentifier, this falls back to "extension" for tranches
+ * that are not registered in the current process.
+ */
+const char *
+LWLockWaitStatsName(int slot)
+{
+	int			tranche_id;
+
+	Assert(slot >= 0 && slot < LWLOCK_STATS_SLOTS);
+
+	if (slot < NUM_INDIVIDUAL_LWLOCKS)
+		return MainLWLockNames[slot];
+
+	tranche_id = slot - NUM_INDIVIDUAL_LWLOCKS;
+	if (tranche_id >= LWLockTranchesAllocated ||
+		LWLockTrancheArray[tranche_id] == NULL ||
+		LWLockTrancheArray[tranche_id]->name == NULL)
+		return "extension";
+
+	return LWLockTrancheArray[tranche_id]->name;
+}
+
 /*
  * Internal function that tries to atomically acquire the lwlock in the passed
  * in mode.
@@ -1167,6 +1339,8 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 	PGPROC	   *proc = MyProc;
 	bool		result = true;
 	int			extraWaits = 0;
+	LWLockWaitStats *waitstats = GetLWLockWaitStatsEntry(lock);
+	instr_time	waitStart;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1177,6 +1351,8 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 
 	PRINT_LWDEBUG("LWLockAcquire", lock, mode);
 
+	waitstats->acquire_count++;
+
 #ifdef LWLOCK_STATS
 	/* Count lock acquisition attempts */
 	if (mode == LW_EXCLUSIVE)
@@ -1279,6 +1455,7 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 		lwstats->block_count++;
 #endif
 
+		INSTR_TIME_SET_CURRENT(waitStart);
 		LWLockReportWaitStart(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
@@ -1304,6 +1481,7 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 		LWLockReportWaitEnd();
+		LWLockRecordWait(waitstats, waitStart);
 
 		LOG_LWDEBUG("LWLockAcquire", lock, "awakened");
 
@@ -1342,6 +1520,8 @@ LWLockConditionalAcquire(LWLock *lock, LWLockMode mode)
 
 	PRINT_LWDEBUG("LWLockConditionalAcquire", lock, mode);
 
+	GetLWLockWaitStatsEntry(lock)->acquire_count++;
+
 	/* Ensure we will have room to remember the lock */
 	if (num_held_lwlocks >= MAX_SIMUL_LWLOCKS)
 		elog(ERROR, "too many LWLocks taken");
@@ -1394,6 +1574,8 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 	PGPROC	   *proc = MyProc;
 	bool		mustwait;
 	int			extraWaits = 0;
+	LWLockWaitStats *waitstats = GetLWLockWaitStatsEntry(lock);
+	instr_time	waitStart;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1404,6 +1586,8 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 
 	PRINT_LWDEBUG("LWLockAcquireOrWait", lock, mode);
 
+	waitstats->acquire_count++;
+
 	/* Ensure we will have room to remember the lock */
 	if (num_held_lwlocks >= MAX_SIMUL_LWLOCKS)
 		elog(ERROR, "too many LWLocks taken");
@@ -1440,6 +1624,7 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 			lwstats->block_count++;
 #endif
 
+			INSTR_TIME_SET_CURRENT(waitStart);
 			LWLockReportWaitStart(lock);
 			TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
@@ -1461,6 +1646,7 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 #endif
 			TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 			LWLockReportWaitEnd();
+			LWLockRecordWait(waitstats, waitStart);
 
 			LOG_LWDEBUG("LWLockAcquireOrWait", lock, "awakened");
 		}
@@ -1579,6 +1765,8 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 	PGPROC	   *proc = MyProc;
 	int			extraWaits = 0;
 	bool		result = false;
+	LWLockWaitStats *waitstats = GetLWLockWaitStatsEntry(lock);
+	instr_time	waitStart;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1657,6 +1845,7 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		lwstats->block_count++;
 #endif
 
+		INSTR_TIME_SET_CURRENT(waitStart);
 		LWLockReportWaitStart(lock);
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock),
 										   LW_EXCLUSIVE);
@@ -1681,6 +1870,7 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock),
 										  LW_EXCLUSIVE);
 		LWLockReportWaitEnd();
+		LWLockRecordWait(waitstats, waitStart);
 
 		LOG_LWDEBUG("LWLockWaitForVar", lock, "awakened");
 
@@ -194,6 +194,7 @@
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "miscadmin.h"
+#include "port/atomics.h"
 #include "storage/bufmgr.h"
 #include "storage/predicate.h"
 #include "storage/predicate_internals.h"
@@ -356,6 +357,27 @@ static SERIALIZABLEXACT *OldCommittedSxact;
 /* This configuration variable is used to set the predicate lock table size */
 int			max_predicate_locks_per_xact;		/* set by guc.c */
 
+/* These configuration variables are used to set the promotion thresholds */
+int			max_predicate_locks_per_relation;	/* set by guc.c */
+int			max_predicate_locks_per_page;		/* set by guc.c */
+
+/*
+ * Counters of lock promotions and serialization failures, for
+ * pg_stat_serializable.  They are only ever incremented, with atomic
+ * operations, so that no lock is needed.
+ */
+typedef struct PredicateLockStatsData
+{
+	pg_atomic_uint64 page_promotions;
+	pg_atomic_uint64 relation_promotions;
+	pg_atomic_uint64 failures[NUM_SSI_FAILURE_CAUSES];
+} PredicateLockStatsData;
+
+static PredicateLockStatsData *PredLockStats;
+
+#define CountSerializationFailure(cause) \
+	pg_atomic_fetch_add_u64(&PredLockStats->failures[cause], 1)
+
 /*
  * This provides a list of objects in order to track transactions
  * participating in predicate locking.  Entries in the list are fixed size,
@@ -1300,6 +1322,24 @@ InitPredicateLocks(void)
 	if (!found)
 		SHMQueueInit(FinishedSerializableTransactions);
 
+	/*
+	 * Create or attach to the statistics counters.
+	 */
+	PredLockStats = (PredicateLockStatsData *)
+		ShmemInitStruct("PredicateLockStats",
+						sizeof(PredicateLockStatsData),
+						&found);
+	Assert(found == IsUnderPostmaster);
+	if (!found)
+	{
+		int			i;
+
+		pg_atomic_init_u64(&PredLockStats->page_promotions, 0);
+		pg_atomic_init_u64(&PredLockStats->relation_promotions, 0);
+		for (i = 0; i < NUM_SSI_FAILURE_CAUSES; i++)
+			pg_atomic_init_u64(&PredLockStats->failures[i], 0);
+	}
+
 	/*
 	 * Initialize the SLRU storage for old committed serializable
 	 * transactions.
@@ -1352,6 +1392,9 @@ PredicateLockShmemSize(void)
 	/* Head for list of finished serializable transactions. */
 	size = add_size(size, sizeof(SHM_QUEUE));
 
+	/* Statistics counters. */
+	size = add_size(size, sizeof(PredicateLockStatsData));
+
 	/* Shared memory structures for SLRU tracking of old committed xids. */
 	size = add_size(size, sizeof(OldSerXidControlData));
 	size = add_size(size, SimpleLruShmemSize(NUM_OLDSERXID_BUFFERS, 0));
@@ -1449,6 +1492,23 @@ GetPredicateLockStatusData(void)
 	return data;
 }
 
+/*
+ * GetPredicateLockStats
+ *		Return the counters of lock promotions and serialization failures
+ *		since server start, for the pg_stat_serializable view.
+ */
+void
+GetPredicateLockStats(PredicateLockStats *stats)
+{
+	int			i;
+
+	stats->page_promotions = pg_atomic_read_u64(&PredLockStats->page_promotions);
+	stats->relation_promotions =
+		pg_atomic_read_u64(&PredLockStats->relation_promotions);
+	for (i = 0; i < NUM_SSI_FAILURE_CAUSES; i++)
+		stats->failures[i] = pg_atomic_read_u64(&PredLockStats->failures[i]);
+}
+
 /*
  * Free up shared memory structures by pushing the oldest sxact (the one at
  * the front of the SummarizeOldestCommittedSxact queue) into summary form.
@@ -2150,11 +2210,16 @@ DeleteChildTargetLocks(const PREDICATELOCKTARGETTAG *newtargettag)
  * descendants, e.g. both tuples and pages for a relation lock.
  *
  * TODO SSI: We should do something more intelligent about what the
- * thresholds are, either making it proportional to the number of
- * tuples in a page & pages in a relation, or at least making it a
- * GUC. Currently the threshold is 3 for a page lock, and
- * max_pred_locks_per_transaction/2 for a relation lock, chosen
- * entirely arbitrarily (and without benchmarking).
+ * thresholds are, making it proportional to the number of tuples in a
+ * page & pages in a relation.
+ *
+ * A page lock is taken once more than max_pred_locks_per_page tuples of
+ * the page are locked.  A relation lock is taken once more than
+ * max_pred_locks_per_relation pages and tuples of the relation are locked;
+ * a negative setting means max_pred_locks_per_transaction divided by its
+ * absolute value, so that the threshold follows the size of the lock table.
+ * The thresholds are the number of child locks that may be held, so the
+ * value returned here is one more.
  */
 static int
 PredicateLockPromotionThreshold(const PREDICATELOCKTARGETTAG *tag)
@@ -2162,10 +2227,13 @@ PredicateLockPromotionThreshold(const PREDICATELOCKTARGETTAG *tag)
 	switch (GET_PREDICATELOCKTARGETTAG_TYPE(*tag))
 	{
 		case PREDLOCKTAG_RELATION:
-			return max_predicate_locks_per_xact / 2;
+			if (max_predicate_locks_per_relation < 0)
+				return max_predicate_locks_per_xact /
+					-max_predicate_locks_per_relation;
+			return max_predicate_locks_per_relation + 1;
 
 		case PREDLOCKTAG_PAGE:
-			return 3;
+			return max_predicate_locks_per_page + 1;
 
 		case PREDLOCKTAG_TUPLE:
 
@@ -2237,6 +2305,10 @@ CheckAndPromotePredicateLockRequest(const PREDICATELOCKTARGETTAG *reqtag)
 	if (promote)
 	{
 		/* acquire coarsest ancestor eligible for promotion */
+		if (GET_PREDICATELOCKTARGETTAG_TYPE(promotiontag) == PREDLOCKTAG_PAGE)
+			pg_atomic_fetch_add_u64(&PredLockStats->page_promotions, 1);
+		else
+			pg_atomic_fetch_add_u64(&PredLockStats->relation_promotions, 1);
 		PredicateLockAcquire(&promotiontag);
 		return true;
 	}
@@ -3894,6 +3966,7 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 	SERIALIZABLEXID *sxid;
 	SERIALIZABLEXACT *sxact;
 	HTSV_Result htsvResult;
+	LWLockMode	lockmode;
 
 	if (!SerializationNeededForRead(relation, snapshot))
 		return;
@@ -3901,6 +3974,7 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 	/* Check if someone else has already decided that we need to die */
 	if (SxactIsDoomed(MySerializableXact))
 	{
+		CountSerializationFailure(SSI_FAILURE_DOOMED);
 		ereport(ERROR,
 				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 				 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -3916,7 +3990,6 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 	 * is going on with it.
 	 */
 	htsvResult = HeapTupleSatisfiesVacuum(tuple, TransactionXmin, buffer);
-	elog(LOG, "HeapTupleSatisfiesVacuum(%d) = %d, TransactionXmin=%d", HeapTupleHeaderGetXmin(tuple->t_data), htsvResult, TransactionXmin);
 	switch (htsvResult)
 	{
 		case HEAPTUPLE_LIVE:
@@ -3971,9 +4044,16 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 
 	/*
 	 * Find sxact or summarized info for the top level xid.
+	 *
+	 * Most of the time there's nothing to do, because the conflict has
+	 * already been recorded or can't matter, and a shared lock is enough to
+	 * find that out.  Only if we need to change something do we come back
+	 * with an exclusive lock, and look again.
 	 */
 	sxidtag.xid = xid;
-	LWLockAcquire(SerializableXactHashLock, LW_EXCLUSIVE);
+	lockmode = LW_SHARED;
+retry:
+	LWLockAcquire(SerializableXactHashLock, lockmode);
 	sxid = (SERIALIZABLEXID *)
 		hash_search(SerializableXidHash, &sxidtag, HASH_FIND, NULL);
 	if (!sxid)
@@ -3991,21 +4071,36 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 				&& (!SxactIsReadOnly(MySerializableXact)
 					|| conflictCommitSeqNo
 					<= MySerializableXact->SeqNo.lastCommitBeforeSnapshot))
+			{
+				CountSerializationFailure(SSI_FAILURE_SUMMARIZED);
 				ereport(ERROR,
 						(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 						 errmsg("could not serialize access due to read/write dependencies among transactions"),
 						 errdetail_internal("Reason code: Canceled on conflict out to old pivot %u.", xid),
 					  errhint("The transaction might succeed if retried.")));
+			}
 
 			if (SxactHasSummaryConflictIn(MySerializableXact)
 				|| !SHMQueueEmpty(&MySerializableXact->inConflicts))
+			{
+				CountSerializationFailure(SSI_FAILURE_SUMMARIZED);
 				ereport(ERROR,
 						(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 						 errmsg("could not serialize access due to read/write dependencies among transactions"),
 						 errdetail_internal("Reason code: Canceled on identification as a pivot, with conflict out to old committed transaction %u.", xid),
 					  errhint("The transaction might succeed if retried.")));
+			}
 
-			MySerializableXact->flags |= SXACT_FLAG_SUMMARY_CONFLICT_OUT;
+			if (!SxactHasSummaryConflictOut(MySerializableXact))
+			{
+				if (lockmode == LW_SHARED)
+				{
+					LWLockRelease(SerializableXactHashLock);
+					lockmode = LW_EXCLUSIVE;
+					goto retry;
+				}
+				MySerializableXact->flags |= SXACT_FLAG_SUMMARY_CONFLICT_OUT;
+			}
 		}
 
 		/* It's not serializable or otherwise not important. */
@@ -4031,6 +4126,12 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 	{
 		if (!SxactIsPrepared(sxact))
 		{
+			if (lockmode == LW_SHARED)
+			{
+				LWLockRelease(SerializableXactHashLock);
+				lockmode = LW_EXCLUSIVE;
+				goto retry;
+			}
 			sxact->flags |= SXACT_FLAG_DOOMED;
 			LWLockRelease(SerializableXactHashLock);
 			return;
@@ -4038,6 +4139,7 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 		else
 		{
 			LWLockRelease(SerializableXactHashLock);
+			CountSerializationFailure(SSI_FAILURE_SUMMARIZED);
 			ereport(ERROR,
 					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 					 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -4076,6 +4178,13 @@ CheckForSerializableConflictOut(bool visible, Relation relation,
 		return;
 	}
 
+	if (lockmode == LW_SHARED)
+	{
+		LWLockRelease(SerializableXactHashLock);
+		lockmode = LW_EXCLUSIVE;
+		goto retry;
+	}
+
 	/*
 	 * Flag the conflict.  But first, if this conflict creates a dangerous
 	 * structure, ereport an error.
@@ -4277,11 +4386,14 @@ CheckForSerializableConflictIn(Relation relation, HeapTuple tuple,
 
 	/* Check if someone else has already decided that we need to die */
 	if (SxactIsDoomed(MySerializableXact))
+	{
+		CountSerializationFailure(SSI_FAILURE_DOOMED);
 		ereport(ERROR,
 				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 				 errmsg("could not serialize access due to read/write dependencies among transactions"),
 				 errdetail_internal("Reason code: Canceled on identification as a pivot, during conflict in checking."),
 				 errhint("The transaction might succeed if retried.")));
+	}
 
 	/*
 	 * We're doing a write which might cause rw-conflicts now or later.
@@ -4614,6 +4726,7 @@ OnConflict_CheckForSerializationFailure(const SERIALIZABLEXACT *reader,
 		if (MySerializableXact == writer)
 		{
 			LWLockRelease(SerializableXactHashLock);
+			CountSerializationFailure(SSI_FAILURE_PIVOT_WRITE);
 			ereport(ERROR,
 					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 					 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -4626,6 +4739,7 @@ OnConflict_CheckForSerializationFailure(const SERIALIZABLEXACT *reader,
 
 			/* if we're not the writer, we have to be the reader */
 			Assert(MySerializableXact == reader);
+			CountSerializationFailure(SSI_FAILURE_PIVOT_READ);
 			ereport(ERROR,
 					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 					 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -4668,6 +4782,7 @@ PreCommit_CheckForSerializationFailure(void)
 	if (SxactIsDoomed(MySerializableXact))
 	{
 		LWLockRelease(SerializableXactHashLock);
+		CountSerializationFailure(SSI_FAILURE_DOOMED);
 		ereport(ERROR,
 				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 				 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -4706,6 +4821,7 @@ PreCommit_CheckForSerializationFailure(void)
 					if (SxactIsPrepared(nearConflict->sxactOut))
 					{
 						LWLockRelease(SerializableXactHashLock);
+						CountSerializationFailure(SSI_FAILURE_PREPARED_PIVOT);
 						ereport(ERROR,
 								(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
 								 errmsg("could not serialize access due to read/write dependencies among transactions"),
@@ -87,6 +87,7 @@ static DeadLockState deadlock_state = DS_NOT_YET_CHECKED;
 /* Is a deadlock check pending? */
 static volatile sig_atomic_t got_deadlock_timeout;
 
+static Size FastPathLockShmemSize(void);
 static void RemoveProcFromArray(int code, Datum arg);
 static void ProcKill(int code, Datum arg);
 static void AuxiliaryProcKill(int code, Datum arg);
@@ -109,6 +110,11 @@ ProcGlobalShmemSize(void)
 	size = add_size(size, mul_size(NUM_AUXILIARY_PROCS, sizeof(PGPROC)));
 	/* Prepared xacts */
 	size = add_size(size, mul_size(max_prepared_xacts, sizeof(PGPROC)));
+	/* Fast-path lock arrays of all of the above */
+	size = add_size(size, mul_size(add_size(add_size(MaxBackends,
+													 NUM_AUXILIARY_PROCS),
+											max_prepared_xacts),
+								   FastPathLockShmemSize()));
 	/* ProcStructLock */
 	size = add_size(size, sizeof(slock_t));
 
@@ -119,6 +125,19 @@ ProcGlobalShmemSize(void)
 	return size;
 }
 
+/*
+ * Size of the fast-path lock arrays of one PGPROC: a word of lock mode bits
+ * per slot group, followed by the relation OIDs of all the slots.
+ */
+static Size
+FastPathLockShmemSize(void)
+{
+	return add_size(MAXALIGN(mul_size(FastPathLockGroupsPerBackend,
+									  sizeof(uint64))),
+					MAXALIGN(mul_size(FP_LOCK_SLOTS_PER_BACKEND,
+									  sizeof(Oid))));
+}
+
 /*
  * Report number of semaphores needed by InitProcGlobal.
  */
@@ -161,6 +180,7 @@ InitProcGlobal(void)
 {
 	PGPROC	   *procs;
 	PGXACT	   *pgxacts;
+	char	   *fpPtr;
 	int			i,
 				j;
 	bool		found;
@@ -215,10 +235,23 @@ InitProcGlobal(void)
 	MemSet(pgxacts, 0, TotalProcs * sizeof(PGXACT));
 	ProcGlobal->allPgXact = pgxacts;
 
+	/*
+	 * The fast-path lock arrays are sized by max_fastpath_locks, so they are
+	 * allocated separately as well.
+	 */
+	fpPtr = ShmemAlloc(TotalProcs * FastPathLockShmemSize());
+	MemSet(fpPtr, 0, TotalProcs * FastPathLockShmemSize());
+
 	for (i = 0; i < TotalProcs; i++)
 	{
 		/* Common initialization for all PGPROCs, regardless of type. */
 
+		/* Point the PGPROC at its fast-path lock arrays. */
+		procs[i].fpLockBits = (uint64 *) fpPtr;
+		fpPtr += MAXALIGN(FastPathLockGroupsPerBackend * sizeof(uint64));
+		procs[i].fpRelId = (Oid *) fpPtr;
+		fpPtr += MAXALIGN(FP_LOCK_SLOTS_PER_BACKEND * sizeof(Oid));
+
 		/*
 		 * Set up per-PGPROC semaphore, latch, and backendLock. Prepared xact
 		 * dummy PGPROCs don't need these though - they're never associated
@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/time.h>
 
 #include "miscadmin.h"
 #include "access/xlog.h"
@@ -32,8 +33,11 @@
 #include "postmaster/bgwriter.h"
 #include "storage/fd.h"
 #include "storage/bufmgr.h"
+#include "storage/lwlock.h"
 #include "storage/relfilenode.h"
+#include "storage/shmem.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "pg_trace.h"
@@ -162,6 +166,57 @@ static MemoryContext pendingOpsCxt;		/* context for the above  */
 static CycleCtr mdsync_cycle_ctr = 0;
 static CycleCtr mdckpt_cycle_ctr = 0;
 
+/*
+ * Per-tablespace write accounting and throttling.
+ *
+ * Every mdwrite() is counted in a shared slot belonging to the tablespace of
+ * the relation.  The slot also holds the write budget of the tablespace, set
+ * from its max_write_rate and max_write_iops options.  Processes that have
+ * set tablespace_io_throttle (the checkpointer during a non-immediate
+ * checkpoint, the background writer and VACUUM) are paced to stay within the
+ * budget: each write reserves the next free slot of a per-tablespace virtual
+ * clock, and the writer sleeps until its slot comes up.  Since the throttled
+ * processes share the clock, the budget is for all of them together.
+ *
+ * The sleep happens with the buffer being written locked, just as a write to
+ * a genuinely slow device would keep it locked.  Ordinary backends are never
+ * delayed, so a backend forced to evict a dirty buffer doesn't wait for the
+ * budget of the tablespace.
+ */
+#define TSIO_LOCAL_CACHE_SIZE		8
+#define TSIO_RATE_WINDOW_USEC		1000000
+
+typedef struct TablespaceIOSlot
+{
+	slock_t		mutex;			/* protects all the fields below */
+	Oid			spcNode;		/* InvalidOid if the slot is unused */
+	int			max_write_rate; /* kilobytes per second, 0 = unlimited */
+	int			max_write_iops; /* writes per second, 0 = unlimited */
+	int64		next_write_time;	/* pacing clock, in microseconds */
+	uint64		writes;			/* total number of writes */
+	uint64		delayed_writes; /* number of throttled writes that slept */
+	uint64		delay_time;		/* total time slept, in microseconds */
+	int64		window_start;	/* start of the current rate window */
+	uint64		window_writes;	/* writes in the current rate window */
+	double		write_iops;		/* writes per second in the last window */
+} TablespaceIOSlot;
+
+typedef struct TablespaceIOShmemStruct
+{
+	slock_t		mutex;			/* protects slot assignment */
+	TablespaceIOSlot slots[MAX_TABLESPACE_IO_SLOTS];
+} TablespaceIOShmemStruct;
+
+static TablespaceIOShmemStruct *TablespaceIOShmem = NULL;
+
+/* Recently used slots of this process; revalidated on every use */
+static Oid	tsio_cache_spc[TSIO_LOCAL_CACHE_SIZE];
+static int	tsio_cache_slot[TSIO_LOCAL_CACHE_SIZE];
+static int	tsio_cache_next = 0;
+
+/* Should this process's writes be held to the tablespace budgets? */
+bool		tablespace_io_throttle = false;
+
 
 /*** behavior for mdopen & _mdfd_getseg ***/
 /* ereport if segment not present */
@@ -196,6 +251,9 @@ static MdfdVec *_mdfd_openseg(SMgrRelation reln, ForkNumber forkno,
 			  BlockNumber segno, int oflags);
 static MdfdVec *_mdfd_getseg(SMgrRelation reln, ForkNumber forkno,
 			 BlockNumber blkno, bool skipFsync, int behavior);
+static int64 tsio_now(void);
+static TablespaceIOSlot *tsio_get_slot(Oid spcNode, bool create);
+static void tsio_count_write(Oid spcNode);
 static BlockNumber _mdnblocks(SMgrRelation reln, ForkNumber forknum,
 		   MdfdVec *seg);
 
@@ -561,6 +619,95 @@ mdextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 	Assert(_mdnblocks(reln, forknum, v) <= ((BlockNumber) RELSEG_SIZE));
 }
 
+/*
+ *	mdzeroextend() -- Add nblocks zeroed blocks to the specified relation.
+ *
+ *		Like mdextend(), but the new blocks are all zeroes, so rather than
+ *		writing them one at a time we ask the kernel to allocate the space
+ *		with one posix_fallocate() call per segment touched.  If that isn't
+ *		possible, zero blocks are written out as mdextend() would.
+ */
+void
+mdzeroextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+			 int nblocks, bool skipFsync)
+{
+	char	   *zerobuf = NULL;
+
+	/* This assert is too expensive to have on normally ... */
+#ifdef CHECK_WRITE_VS_EXTEND
+	Assert(blocknum >= mdnblocks(reln, forknum));
+#endif
+
+	/* As in mdextend(), never create a block numbered InvalidBlockNumber */
+	if ((uint64) blocknum + nblocks >= (uint64) InvalidBlockNumber)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("cannot extend file \"%s\" beyond %u blocks",
+						relpath(reln->smgr_rnode, forknum),
+						InvalidBlockNumber)));
+
+	while (nblocks > 0)
+	{
+		MdfdVec    *v;
+		off_t		seekpos;
+		int			segblocks;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, skipFsync, EXTENSION_CREATE);
+
+		seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+		segblocks = Min(nblocks,
+						RELSEG_SIZE - blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		if (FileFallocate(v->mdfd_vfd, seekpos,
+						  (off_t) BLCKSZ * segblocks) != 0)
+		{
+			int			i;
+
+			if (zerobuf == NULL)
+				zerobuf = palloc0(BLCKSZ);
+
+			if (FileSeek(v->mdfd_vfd, seekpos, SEEK_SET) != seekpos)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not seek to block %u in file \"%s\": %m",
+								blocknum, FilePathName(v->mdfd_vfd))));
+
+			for (i = 0; i < segblocks; i++)
+			{
+				int			nbytes;
+
+				if ((nbytes = FileWrite(v->mdfd_vfd, zerobuf, BLCKSZ)) != BLCKSZ)
+				{
+					if (nbytes < 0)
+						ereport(ERROR,
+								(errcode_for_file_access(),
+								 errmsg("could not extend file \"%s\": %m",
+										FilePathName(v->mdfd_vfd)),
+								 errhint("Check free disk space.")));
+					/* short write: complain appropriately */
+					ereport(ERROR,
+							(errcode(ERRCODE_DISK_FULL),
+							 errmsg("could not extend file \"%s\": wrote only %d of %d bytes at block %u",
+									FilePathName(v->mdfd_vfd),
+									nbytes, BLCKSZ, blocknum + i),
+							 errhint("Check free disk space.")));
+				}
+			}
+		}
+
+		if (!skipFsync && !SmgrIsTemp(reln))
+			register_dirty_segment(reln, forknum, v);
+
+		Assert(_mdnblocks(reln, forknum, v) <= ((BlockNumber) RELSEG_SIZE));
+
+		blocknum += segblocks;
+		nblocks -= segblocks;
+	}
+
+	if (zerobuf != NULL)
+		pfree(zerobuf);
+}
+
 /*
  *	mdopen() -- Open the specified relation.
  *
@@ -650,22 +797,46 @@ mdclose(SMgrRelation reln, ForkNumber forknum)
 }
 
 /*
- *	mdprefetch() -- Initiate asynchronous read of the specified block of a relation
+ *	mdprefetch() -- Initiate asynchronous read of the specified blocks of a
+ *					relation
+ *
+ * Like mdwriteback, this accepts a range of blocks, so that the kernel can
+ * read adjacent blocks with fewer, larger I/Os.
  */
 void
-mdprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
+mdprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+		   BlockNumber nblocks)
 {
 #ifdef USE_PREFETCH
-	off_t		seekpos;
-	MdfdVec    *v;
+	/* have to split at segment boundaries, as in mdwriteback */
+	while (nblocks > 0)
+	{
+		BlockNumber nfetch = nblocks;
+		off_t		seekpos;
+		MdfdVec    *v;
 
-	v = _mdfd_getseg(reln, forknum, blocknum, false, EXTENSION_FAIL);
+		/*
+		 * During recovery the prefetcher looks ahead in the WAL, so the block
+		 * may belong to a relation that is only created by a later record.
+		 * Quietly skip such blocks, and never create segments for them.
+		 */
+		v = _mdfd_getseg(reln, forknum, blocknum, false,
+						 InRecovery ? EXTENSION_RETURN_NULL : EXTENSION_FAIL);
+		if (v == NULL)
+			return;
 
-	seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+		if (blocknum / RELSEG_SIZE != (blocknum + nblocks - 1) / RELSEG_SIZE)
+			nfetch = RELSEG_SIZE - (blocknum % ((BlockNumber) RELSEG_SIZE));
 
-	Assert(seekpos < (off_t) BLCKSZ * RELSEG_SIZE);
+		seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		Assert(seekpos < (off_t) BLCKSZ * RELSEG_SIZE);
+
+		(void) FilePrefetch(v->mdfd_vfd, seekpos, BLCKSZ * nfetch);
 
-	(void) FilePrefetch(v->mdfd_vfd, seekpos, BLCKSZ);
+		nblocks -= nfetch;
+		blocknum += nfetch;
+	}
 #endif   /* USE_PREFETCH */
 }
 
@@ -827,6 +998,8 @@ mdwrite(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 				 errmsg("could not seek to block %u in file \"%s\": %m",
 						blocknum, FilePathName(v->mdfd_vfd))));
 
+	tsio_count_write(reln->smgr_rnode.node.spcNode);
+
 	nbytes = FileWrite(v->mdfd_vfd, buffer, BLCKSZ);
 
 	TRACE_POSTGRESQL_SMGR_MD_WRITE_DONE(forknum, blocknum,
@@ -1701,6 +1874,307 @@ ForgetDatabaseFsyncRequests(Oid dbid)
 	}
 }
 
+/*
+ * TablespaceIOShmemSize -- report shared memory needed for tablespace I/O
+ * accounting
+ */
+Size
+TablespaceIOShmemSize(void)
+{
+	return sizeof(TablespaceIOShmemStruct);
+}
+
+/*
+ * TablespaceIOShmemInit -- initialize tablespace I/O accounting during
+ * postmaster startup
+ */
+void
+TablespaceIOShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	TablespaceIOShmem = (TablespaceIOShmemStruct *)
+		ShmemInitStruct("Tablespace IO Slots", TablespaceIOShmemSize(),
+						&found);
+
+	if (!found)
+	{
+		MemSet(TablespaceIOShmem, 0, TablespaceIOShmemSize());
+		for (i = 0; i < MAX_TABLESPACE_IO_SLOTS; i++)
+			SpinLockInit(&TablespaceIOShmem->slots[i].mutex);
+	}
+}
+
+/*
+ * TablespaceIOSetLimits -- set the write budget of a tablespace
+ *
+ * Called whenever the options of a tablespace are read from pg_tablespace,
+ * since the checkpointer and the background writer can't read catalogs
+ * themselves.  A rate or IOPS limit <= 0 means unlimited.
+ */
+void
+TablespaceIOSetLimits(Oid spcNode, int max_write_rate, int max_write_iops)
+{
+	TablespaceIOSlot *slot;
+
+	if (TablespaceIOShmem == NULL)
+		return;
+
+	/* Don't use up a slot just to record that there is no limit */
+	slot = tsio_get_slot(spcNode, max_write_rate > 0 || max_write_iops > 0);
+	if (slot == NULL)
+		return;
+
+	slot->max_write_rate = Max(max_write_rate, 0);
+	slot->max_write_iops = Max(max_write_iops, 0);
+	SpinLockRelease(&slot->mutex);
+}
+
+/*
+ * TablespaceIOForget -- release the slot of a dropped tablespace
+ */
+void
+TablespaceIOForget(Oid spcNode)
+{
+	int			i;
+
+	if (TablespaceIOShmem == NULL)
+		return;
+
+	LWLockAcquire(TablespaceIOLock, LW_EXCLUSIVE);
+	for (i = 0; i < MAX_TABLESPACE_IO_SLOTS; i++)
+	{
+		TablespaceIOSlot *slot = &TablespaceIOShmem->slots[i];
+
+		if (slot->spcNode != spcNode)
+			continue;
+
+		SpinLockAcquire(&slot->mutex);
+		slot->spcNode = InvalidOid;
+		SpinLockRelease(&slot->mutex);
+		break;
+	}
+	LWLockRelease(TablespaceIOLock);
+}
+
+/*
+ * TablespaceIOGetStats -- copy out the counters of all tablespaces that have
+ * been written to or have a budget
+ *
+ * 'stats' must have room for MAX_TABLESPACE_IO_SLOTS entries.  Returns the
+ * number of entries filled in.
+ */
+int
+TablespaceIOGetStats(TablespaceIOStats *stats)
+{
+	int64		now = tsio_now();
+	int			n = 0;
+	int			i;
+
+	if (TablespaceIOShmem == NULL)
+		return 0;
+
+	LWLockAcquire(TablespaceIOLock, LW_SHARED);
+	for (i = 0; i < MAX_TABLESPACE_IO_SLOTS; i++)
+	{
+		TablespaceIOSlot *slot = &TablespaceIOShmem->slots[i];
+		TablespaceIOStats *entry = &stats[n];
+
+		if (slot->spcNode == InvalidOid)
+			continue;
+
+		SpinLockAcquire(&slot->mutex);
+		entry->spcNode = slot->spcNode;
+		entry->max_write_rate = slot->max_write_rate;
+		entry->max_write_iops = slot->max_write_iops;
+		entry->writes = slot->writes;
+		entry->delayed_writes = slot->delayed_writes;
+		entry->delay_time = slot->delay_time;
+
+		/*
+		 * If the current window is already over, nobody has written since;
+		 * let the rate decay instead of showing the last busy window.
+		 */
+		if (slot->window_start != 0 &&
+			now - slot->window_start >= TSIO_RATE_WINDOW_USEC)
+			entry->write_iops = (double) slot->window_writes * 1000000.0 /
+				(now - slot->window_start);
+		else
+			entry->write_iops = slot->write_iops;
+		SpinLockRelease(&slot->mutex);
+
+		n++;
+	}
+	LWLockRelease(TablespaceIOLock);
+
+	return n;
+}
+
+/*
+ * tsio_now -- current time in microseconds, for pacing
+ */
+static int64
+tsio_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * tsio_get_slot -- find the shared slot of a tablespace, and lock it
+ *
+ * If the tablespace has no slot yet and 'create' is true, one is assigned,
+ * unless all of them are in use.  Returns NULL if there is no slot, else the
+ * slot with its spinlock held.
+ */
+static TablespaceIOSlot *
+tsio_get_slot(Oid spcNode, bool create)
+{
+	TablespaceIOSlot *slot;
+	int			slotno = -1;
+	int			i;
+
+	/* Try the slots we used recently; they may have been reassigned since */
+	for (i = 0; i < TSIO_LOCAL_CACHE_SIZE; i++)
+	{
+		if (tsio_cache_spc[i] != spcNode || spcNode == InvalidOid)
+			continue;
+
+		slot = &TablespaceIOShmem->slots[tsio_cache_slot[i]];
+		SpinLockAcquire(&slot->mutex);
+		if (slot->spcNode == spcNode)
+			return slot;
+		SpinLockRelease(&slot->mutex);
+		tsio_cache_spc[i] = InvalidOid;
+	}
+
+	LWLockAcquire(TablespaceIOLock, LW_SHARED);
+	for (i = 0; i < MAX_TABLESPACE_IO_SLOTS; i++)
+	{
+		if (TablespaceIOShmem->slots[i].spcNode == spcNode)
+		{
+			slotno = i;
+			break;
+		}
+	}
+	LWLockRelease(TablespaceIOLock);
+
+	if (slotno < 0 && create)
+	{
+		LWLockAcquire(TablespaceIOLock, LW_EXCLUSIVE);
+		for (i = 0; i < MAX_TABLESPACE_IO_SLOTS; i++)
+		{
+			slot = &TablespaceIOShmem->slots[i];
+			if (slot->spcNode == spcNode)
+			{
+				slotno = i;
+				break;
+			}
+			if (slotno < 0 && slot->spcNode == InvalidOid)
+				slotno = i;
+		}
+		if (slotno >= 0 && TablespaceIOShmem->slots[slotno].spcNode != spcNode)
+		{
+			slot = &TablespaceIOShmem->slots[slotno];
+			SpinLockAcquire(&slot->mutex);
+			slot->spcNode = spcNode;
+			slot->max_write_rate = 0;
+			slot->max_write_iops = 0;
+			slot->next_write_time = 0;
+			slot->writes = 0;
+			slot->delayed_writes = 0;
+			slot->delay_time = 0;
+			slot->window_start = 0;
+			slot->window_writes = 0;
+			slot->write_iops = 0;
+			SpinLockRelease(&slot->mutex);
+		}
+		LWLockRelease(TablespaceIOLock);
+	}
+
+	if (slotno < 0)
+		return NULL;
+
+	/* The slot might have been released again meanwhile; if so, give up */
+	slot = &TablespaceIOShmem->slots[slotno];
+	SpinLockAcquire(&slot->mutex);
+	if (slot->spcNode != spcNode)
+	{
+		SpinLockRelease(&slot->mutex);
+		return NULL;
+	}
+
+	tsio_cache_spc[tsio_cache_next] = spcNode;
+	tsio_cache_slot[tsio_cache_next] = slotno;
+	tsio_cache_next = (tsio_cache_next + 1) % TSIO_LOCAL_CACHE_SIZE;
+
+	return slot;
+}
+
+/*
+ * tsio_count_write -- account for one block write, and throttle it if this
+ * process is subject to the tablespace budget
+ */
+static void
+tsio_count_write(Oid spcNode)
+{
+	TablespaceIOSlot *slot;
+	int64		now;
+	int64		delay = 0;
+
+	if (TablespaceIOShmem == NULL)
+		return;
+
+	slot = tsio_get_slot(spcNode, true);
+	if (slot == NULL)
+		return;
+
+	now = tsio_now();
+
+	slot->writes++;
+	if (now - slot->window_start >= TSIO_RATE_WINDOW_USEC)
+	{
+		if (slot->window_start != 0)
+			slot->write_iops = (double) slot->window_writes * 1000000.0 /
+				(now - slot->window_start);
+		slot->window_start = now;
+		slot->window_writes = 0;
+	}
+	slot->window_writes++;
+
+	if (tablespace_io_throttle &&
+		(slot->max_write_rate > 0 || slot->max_write_iops > 0))
+	{
+		int64		interval = 0;
+
+		if (slot->max_write_rate > 0)
+			interval = (int64) BLCKSZ *1000000 /
+				((int64) slot->max_write_rate * 1024);
+		if (slot->max_write_iops > 0)
+			interval = Max(interval, 1000000 / slot->max_write_iops);
+
+		/* Unused budget is not saved up for later */
+		if (slot->next_write_time < now)
+			slot->next_write_time = now;
+		delay = slot->next_write_time - now;
+		slot->next_write_time += interval;
+
+		if (delay > 0)
+		{
+			slot->delayed_writes++;
+			slot->delay_time += delay;
+		}
+	}
+
+	SpinLockRelease(&slot->mutex);
+
+	if (delay > 0)
+		pg_usleep(delay);
+}
+
 
 /*
  *	_fdvec_alloc() -- Make a MdfdVec object.
@@ -47,8 +47,10 @@ typedef struct f_smgr
 											bool isRedo);
 	void		(*smgr_extend) (SMgrRelation reln, ForkNumber forknum,
 						 BlockNumber blocknum, char *buffer, bool skipFsync);
+	void		(*smgr_zeroextend) (SMgrRelation reln, ForkNumber forknum,
+						   BlockNumber blocknum, int nblocks, bool skipFsync);
 	void		(*smgr_prefetch) (SMgrRelation reln, ForkNumber forknum,
-											  BlockNumber blocknum);
+								  BlockNumber blocknum, BlockNumber nblocks);
 	void		(*smgr_read) (SMgrRelation reln, ForkNumber forknum,
 										  BlockNumber blocknum, char *buffer);
 	void		(*smgr_write) (SMgrRelation reln, ForkNumber forknum,
@@ -68,7 +70,7 @@ typedef struct f_smgr
 static const f_smgr smgrsw[] = {
 	/* magnetic disk */
 	{mdinit, NULL, mdclose, mdcreate, mdexists, mdunlink, mdextend,
-		mdprefetch, mdread, mdwrite, mdwriteback, mdnblocks, mdtruncate,
+		mdzeroextend, mdprefetch, mdread, mdwrite, mdwriteback, mdnblocks, mdtruncate,
 		mdimmedsync, mdpreckpt, mdsync, mdpostckpt
 	}
 };
@@ -605,12 +607,32 @@ smgrextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 }
 
 /*
- *	smgrprefetch() -- Initiate asynchronous read of the specified block of a relation.
+ *	smgrzeroextend() -- Add several zeroed blocks to a file.
+ *
+ *		Like smgrextend(), but adds nblocks all-zero blocks starting at
+ *		blocknum in one call, which lets the storage manager allocate the
+ *		space more cheaply than by writing each block.  The caller is
+ *		responsible for initializing the pages afterwards, through shared
+ *		buffers.
+ */
+void
+smgrzeroextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+			   int nblocks, bool skipFsync)
+{
+	(*(smgrsw[reln->smgr_which].smgr_zeroextend)) (reln, forknum, blocknum,
+												   nblocks, skipFsync);
+}
+
+/*
+ *	smgrprefetch() -- Initiate asynchronous read of the specified blocks of a
+ *					  relation.
  */
 void
-smgrprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
+smgrprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
+			 BlockNumber nblocks)
 {
-	(*(smgrsw[reln->smgr_which].smgr_prefetch)) (reln, forknum, blocknum);
+	(*(smgrsw[reln->smgr_which].smgr_prefetch)) (reln, forknum, blocknum,
+												 nblocks);
 }
 
 /*
@@ -41,6 +41,7 @@
 #include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/async.h"
+#include "commands/discard.h"
 #include "commands/prepare.h"
 #include "commands/defrem.h"
 #include "libpq/libpq.h"
@@ -57,6 +58,7 @@
 #include "pg_getopt.h"
 #include "postmaster/autovacuum.h"
 #include "postmaster/postmaster.h"
+#include "postmaster/sessionpool.h"
 #include "replication/slot.h"
 #include "replication/walsender.h"
 #include "rewrite/rewriteHandler.h"
@@ -138,6 +140,12 @@ static bool xact_started = false;
  */
 static bool DoingCommandRead = false;
 
+/*
+ * Flag to keep track of whether we are waiting in the session pool, i.e.
+ * the session has ended and been logged already.
+ */
+static bool InSessionPool = false;
+
 /*
  * Flags to implement skip-till-Sync-after-error behavior for messages of
  * the extended query protocol.
@@ -184,6 +192,7 @@ static bool IsTransactionExitStmtList(List *parseTrees);
 static bool IsTransactionStmtList(List *parseTrees);
 static void drop_unnamed_stmt(void);
 static void log_disconnections(int code, Datum arg);
+static bool ReturnToSessionPool(void);
 static bool exec_cached_query(const char* query, List *parsetree_list);
 static void exec_prepared_plan(Portal portal, const char *portal_name, long max_rows, CommandDest dest);
 static void begin_exec_simple(void);
@@ -3037,6 +3046,9 @@ ProcessInterrupts(void)
 
 	if (ParallelMessagePending)
 		HandleParallelMessages();
+
+	if (MemoryContextReportPending)
+		ProcessMemoryContextReport();
 }
 
 
@@ -3766,7 +3778,7 @@ PostgresMain(int argc, char *argv[],
 	 * ... else we'd need to copy the Port data first.  Also, subsidiary data
 	 * such as the username isn't lost either; see ProcessStartupPacket().
 	 */
-	if (PostmasterContext)
+	if (PostmasterContext && MyPoolSocket == PGINVALID_SOCKET)
 	{
 		MemoryContextDelete(PostmasterContext);
 		PostmasterContext = NULL;
@@ -4308,6 +4320,13 @@ PostgresMain(int argc, char *argv[],
 				if (whereToSendOutput == DestRemote)
 					whereToSendOutput = DestNone;
 
+				/* Serve another client if we can return to the pool */
+				if (ReturnToSessionPool())
+				{
+					send_ready_for_query = true;
+					break;
+				}
+
 				/*
 				 * NOTE: if you are tempted to add more code here, DON'T!
 				 * Whatever you had in mind to do should be set up as an
@@ -4515,6 +4534,10 @@ log_disconnections(int code, Datum arg)
 				minutes,
 				seconds;
 
+	/* The last session of a pooled backend has been logged already */
+	if (InSessionPool)
+		return;
+
 	TimestampDifference(port->SessionStartTime,
 						GetCurrentTimestamp(),
 						&secs, &usecs);
@@ -4533,6 +4556,81 @@ log_disconnections(int code, Datum arg)
 				  port->remote_port[0] ? " port=" : "", port->remote_port)));
 }
 
+/*
+ * ReturnToSessionPool -- let the backend serve another client when its
+ * client has disconnected, see postmaster/sessionpool.c.
+ *
+ * Returns true once a new client is connected and authenticated, false if
+ * the backend should exit.
+ */
+static bool
+ReturnToSessionPool(void)
+{
+	sigjmp_buf *save_exception_stack = PG_exception_stack;
+	SessionPoolKey key;
+	DiscardStmt discard;
+	pgsocket	client;
+	long		cancel_key;
+
+	if (MyPoolSocket == PGINVALID_SOCKET || SessionPoolSize <= 0 ||
+		am_walsender || IsTransactionOrTransactionBlock())
+		return false;
+
+	if (Log_disconnections)
+		log_disconnections(0, 0);
+	InSessionPool = true;
+
+	/*
+	 * Until the new client is authenticated, any error is fatal, as it is
+	 * in a new backend.
+	 */
+	PG_exception_stack = NULL;
+
+	/* Reset the session, as DISCARD ALL does */
+	discard.type = T_DiscardStmt;
+	discard.target = DISCARD_ALL;
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	DiscardCommand(&discard, true);
+	CommitTransactionCommand();
+
+	pq_switch_socket(PGINVALID_SOCKET);
+	set_ps_display("pooled", false);
+
+	SessionPoolGetMyKey(&key);
+	if (!SessionPoolWaitForClient(&client, &cancel_key))
+		return false;
+
+	/* A cancel sent by the previous client must not hit the new one */
+	QueryCancelPending = false;
+
+	MyCancelKey = cancel_key;
+	BackendReinitialize(client);
+
+	/* The postmaster matched the startup packet, but let's make sure */
+	if (!SessionPoolSameKey(&key))
+		ereport(FATAL,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("startup packet does not match the pooled session")));
+
+	InitPooledSession();
+
+	PG_exception_stack = save_exception_stack;
+	InSessionPool = false;
+
+	BeginReportingGUCOptions();
+	if (PG_PROTOCOL_MAJOR(FrontendProtocol) >= 2)
+	{
+		StringInfoData buf;
+
+		pq_beginmessage(&buf, 'K');
+		pq_sendint(&buf, (int32) MyProcPid, sizeof(int32));
+		pq_sendint(&buf, (int32) MyCancelKey, sizeof(int32));
+		pq_endmessage(&buf);
+	}
+	return true;
+}
+
 
 /*
  * Autoprepare implementation.
@@ -13,9 +13,14 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "tsearch/ts_cache.h"
 #include "tsearch/ts_utils.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
 
 
 typedef struct MorphOpaque
@@ -24,6 +29,39 @@ typedef struct MorphOpaque
 	int			qoperator;		/* query operator */
 } MorphOpaque;
 
+/*
+ * Cache of parsed queries.
+ *
+ * Applications tend to run the same queries over and over, and parsing one
+ * runs each of its words through the dictionaries of the configuration, so
+ * to_tsquery() and friends remember the queries they have parsed in this
+ * backend.  Like the other text search caches, the cache is flushed when any
+ * configuration, dictionary or parser changes; it is also flushed when it
+ * gets full, which is simpler than evicting entries one by one.
+ *
+ * Entries are hashed by the text of the query, which is compared to make
+ * sure it's the right one.
+ */
+#define TSQUERY_CACHE_SIZE		256
+
+typedef struct TSQueryCacheKey
+{
+	Oid			cfg_id;
+	int32		qoperator;		/* operator between the words */
+	int32		isplain;		/* plainto_tsquery() or phraseto_tsquery()? */
+	uint32		hash;			/* hash of the query text */
+} TSQueryCacheKey;
+
+typedef struct TSQueryCacheEntry
+{
+	TSQueryCacheKey key;		/* hash key --- must be first */
+	text	   *in;				/* query text */
+	TSQuery		query;			/* parsed query */
+} TSQueryCacheEntry;
+
+static HTAB *TSQueryCache = NULL;
+static MemoryContext TSQueryCacheContext = NULL;
+
 
 Datum
 get_current_ts_config(PG_FUNCTION_ARGS)
@@ -261,6 +299,53 @@ to_tsvector(PG_FUNCTION_ARGS)
  */
 
 
+/*
+ * Flush the cache of parsed queries, on any change of the text search
+ * configurations, dictionaries or parsers.
+ */
+static void
+InvalidateTSQueryCache(Datum arg, int cacheid, uint32 hashvalue)
+{
+	if (TSQueryCache != NULL)
+	{
+		MemoryContextReset(TSQueryCacheContext);
+		TSQueryCache = NULL;
+	}
+}
+
+static void
+InitTSQueryCache(void)
+{
+	HASHCTL		ctl;
+
+	if (TSQueryCacheContext == NULL)
+	{
+		TSQueryCacheContext = AllocSetContextCreate(TopMemoryContext,
+													"Text search query cache",
+													ALLOCSET_DEFAULT_SIZES);
+
+		CacheRegisterSyscacheCallback(TSCONFIGOID, InvalidateTSQueryCache,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSCONFIGMAP, InvalidateTSQueryCache,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSDICTOID, InvalidateTSQueryCache,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSTEMPLATEOID, InvalidateTSQueryCache,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSPARSEROID, InvalidateTSQueryCache,
+									  (Datum) 0);
+	}
+	else
+		MemoryContextReset(TSQueryCacheContext);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(TSQueryCacheKey);
+	ctl.entrysize = sizeof(TSQueryCacheEntry);
+	ctl.hcxt = TSQueryCacheContext;
+	TSQueryCache = hash_create("Text search query cache", TSQUERY_CACHE_SIZE,
+							   &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
 /*
  * This function is used for morph parsing.
  *
@@ -359,20 +444,87 @@ pushval_morph(Datum opaque, TSQueryParserState state, char *strval, int lenval,
 		pushStop(state);
 }
 
-Datum
-to_tsquery_byid(PG_FUNCTION_ARGS)
+/*
+ * Parse a query with the given configuration, using the cache of parsed
+ * queries.  The result is palloc'd in the caller's memory context.
+ */
+static TSQuery
+parse_tsquery_cached(Oid cfg_id, int qoperator, bool isplain, text *in)
 {
-	text	   *in = PG_GETARG_TEXT_P(1);
+	TSQueryCacheKey key;
+	TSQueryCacheEntry *entry;
 	TSQuery		query;
 	MorphOpaque data;
+	bool		found;
 
-	data.cfg_id = PG_GETARG_OID(0);
-	data.qoperator = OP_AND;
+	key.cfg_id = cfg_id;
+	key.qoperator = qoperator;
+	key.isplain = isplain;
+	key.hash = DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(in),
+									   VARSIZE_ANY_EXHDR(in)));
+
+	if (TSQueryCache != NULL)
+	{
+		entry = (TSQueryCacheEntry *) hash_search(TSQueryCache, &key,
+												  HASH_FIND, NULL);
+		if (entry != NULL &&
+			VARSIZE_ANY_EXHDR(entry->in) == VARSIZE_ANY_EXHDR(in) &&
+			memcmp(VARDATA_ANY(entry->in), VARDATA_ANY(in),
+				   VARSIZE_ANY_EXHDR(in)) == 0)
+		{
+			query = (TSQuery) palloc(VARSIZE(entry->query));
+			memcpy(query, entry->query, VARSIZE(entry->query));
+			return query;
+		}
+	}
+
+	data.cfg_id = cfg_id;
+	data.qoperator = qoperator;
 
 	query = parse_tsquery(text_to_cstring(in),
 						  pushval_morph,
 						  PointerGetDatum(&data),
-						  false);
+						  isplain);
+
+	/*
+	 * Parsing a query without lexemes emits a NOTICE, so keep doing it every
+	 * time.
+	 */
+	if (query->size == 0)
+		return query;
+
+	/*
+	 * (Re)create the cache only now: parsing could have accepted invalidation
+	 * messages that flushed it.
+	 */
+	if (TSQueryCache == NULL ||
+		hash_get_num_entries(TSQueryCache) >= TSQUERY_CACHE_SIZE)
+		InitTSQueryCache();
+
+	entry = (TSQueryCacheEntry *) hash_search(TSQueryCache, &key,
+											  HASH_ENTER, &found);
+	if (found)
+	{
+		/* another text with the same hash, replace it */
+		pfree(entry->in);
+		pfree(entry->query);
+	}
+	entry->in = (text *) MemoryContextAlloc(TSQueryCacheContext, VARSIZE(in));
+	memcpy(entry->in, in, VARSIZE(in));
+	entry->query = (TSQuery) MemoryContextAlloc(TSQueryCacheContext,
+												VARSIZE(query));
+	memcpy(entry->query, query, VARSIZE(query));
+
+	return query;
+}
+
+Datum
+to_tsquery_byid(PG_FUNCTION_ARGS)
+{
+	text	   *in = PG_GETARG_TEXT_P(1);
+	TSQuery		query;
+
+	query = parse_tsquery_cached(PG_GETARG_OID(0), OP_AND, false, in);
 
 	PG_RETURN_TSQUERY(query);
 }
@@ -394,15 +546,8 @@ plainto_tsquery_byid(PG_FUNCTION_ARGS)
 {
 	text	   *in = PG_GETARG_TEXT_P(1);
 	TSQuery		query;
-	MorphOpaque data;
-
-	data.cfg_id = PG_GETARG_OID(0);
-	data.qoperator = OP_AND;
 
-	query = parse_tsquery(text_to_cstring(in),
-						  pushval_morph,
-						  PointerGetDatum(&data),
-						  true);
+	query = parse_tsquery_cached(PG_GETARG_OID(0), OP_AND, true, in);
 
 	PG_RETURN_POINTER(query);
 }
@@ -425,15 +570,8 @@ phraseto_tsquery_byid(PG_FUNCTION_ARGS)
 {
 	text	   *in = PG_GETARG_TEXT_P(1);
 	TSQuery		query;
-	MorphOpaque data;
 
-	data.cfg_id = PG_GETARG_OID(0);
-	data.qoperator = OP_PHRASE;
-
-	query = parse_tsquery(text_to_cstring(in),
-						  pushval_morph,
-						  PointerGetDatum(&data),
-						  true);
+	query = parse_tsquery_cached(PG_GETARG_OID(0), OP_PHRASE, true, in);
 
 	PG_RETURN_TSQUERY(query);
 }
@@ -14,6 +14,7 @@
 #include "postgres.h"
 
 #include "access/hash.h"
+#include "access/tuptoaster.h"
 #include "catalog/pg_collation.h"
 #include "miscadmin.h"
 #include "utils/builtins.h"
@@ -32,6 +33,13 @@
 #define JSONB_MAX_ELEMS (Min(MaxAllocSize / sizeof(JsonbValue), JB_CMASK))
 #define JSONB_MAX_PAIRS (Min(MaxAllocSize / sizeof(JsonbPair), JB_CMASK))
 
+/*
+ * Out-of-line values smaller than this are detoasted as a whole even when a
+ * key lookup could fetch slices of them; a few chunks are cheaper to read in
+ * one go than in three separate index scans of the toast table.
+ */
+#define JSONB_SLICE_MIN_SIZE	(8 * TOAST_MAX_CHUNK_SIZE)
+
 static void fillJsonbValue(JsonbContainer *container, int index,
 			   char *base_addr, uint32 offset,
 			   JsonbValue *result);
@@ -54,6 +62,10 @@ static JsonbParseState *pushState(JsonbParseState **pstate);
 static void appendKey(JsonbParseState *pstate, JsonbValue *scalarVal);
 static void appendValue(JsonbParseState *pstate, JsonbValue *scalarVal);
 static void appendElement(JsonbParseState *pstate, JsonbValue *scalarVal);
+static JsonbValue *findJsonbValueFromSlices(struct varlena * attr,
+						 char *keyVal, uint32 keyLen);
+static char *fetchJsonbSlice(struct varlena * attr, uint32 offset,
+				uint32 length);
 static int	lengthCompareJsonbStringValue(const void *a, const void *b);
 static int	lengthCompareJsonbPair(const void *a, const void *b, void *arg);
 static void uniqueifyJsonbObject(JsonbValue *object);
@@ -409,6 +421,167 @@ findJsonbValueFromContainer(JsonbContainer *container, uint32 flags,
 	return NULL;
 }
 
+/*
+ * Find the value of a key in a jsonb datum whose root is an object.
+ *
+ * This does the same as findJsonbValueFromContainer() on the root object,
+ * but takes the datum as is, possibly still toasted.  A large document
+ * stored out of line without compression (SET STORAGE EXTERNAL) isn't
+ * detoasted as a whole: we fetch just the root's JEntries, its keys and
+ * finally the value we're after, each as a slice of the toasted datum.
+ *
+ * Returns NULL if the root isn't an object or has no such key; otherwise a
+ * palloc()'d value as findJsonbValueFromContainer() returns it.
+ */
+JsonbValue *
+findJsonbValueFromDatum(Datum jsonb, char *keyVal, uint32 keyLen)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(jsonb);
+	Jsonb	   *jb;
+	JsonbValue	key;
+
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+		if (!VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer) &&
+			toast_pointer.va_extsize >= JSONB_SLICE_MIN_SIZE)
+			return findJsonbValueFromSlices(attr, keyVal, keyLen);
+	}
+
+	jb = DatumGetJsonb(jsonb);
+	if (!JB_ROOT_IS_OBJECT(jb))
+		return NULL;
+
+	key.type = jbvString;
+	key.val.string.val = keyVal;
+	key.val.string.len = keyLen;
+
+	return findJsonbValueFromContainer(&jb->root, JB_FOBJECT, &key);
+}
+
+/*
+ * Workhorse of findJsonbValueFromDatum() for uncompressed external values.
+ *
+ * Offsets of slices are relative to the start of the root container, which
+ * is also where the varlena's data begins.  The binary search mirrors the
+ * one in findJsonbValueFromContainer(), and the value is filled in as
+ * fillJsonbValue() would, except that it points into the fetched slice.
+ */
+static JsonbValue *
+findJsonbValueFromSlices(struct varlena * attr, char *keyVal, uint32 keyLen)
+{
+	JsonbContainer *container;
+	uint32		count;
+	uint32		entsize;
+	char	   *keys;
+	uint32		stopLow,
+				stopHigh;
+	JsonbValue	key;
+
+	/* The root header tells us how many JEntries there are */
+	container = (JsonbContainer *) fetchJsonbSlice(attr, 0, sizeof(uint32));
+	if (!(container->header & JB_FOBJECT))
+		return NULL;
+	count = container->header & JB_CMASK;
+	if (count == 0)
+		return NULL;
+
+	/* Key and value JEntries, and then the keys, which are stored first */
+	entsize = offsetof(JsonbContainer, children) + 2 * count * sizeof(JEntry);
+	container = (JsonbContainer *) fetchJsonbSlice(attr, 0, entsize);
+	keys = fetchJsonbSlice(attr, entsize, getJsonbOffset(container, count));
+
+	key.type = jbvString;
+	key.val.string.val = keyVal;
+	key.val.string.len = keyLen;
+
+	stopLow = 0;
+	stopHigh = count;
+	while (stopLow < stopHigh)
+	{
+		uint32		stopMiddle;
+		int			difference;
+		JsonbValue	candidate;
+
+		stopMiddle = stopLow + (stopHigh - stopLow) / 2;
+
+		candidate.type = jbvString;
+		candidate.val.string.val = keys + getJsonbOffset(container, stopMiddle);
+		candidate.val.string.len = getJsonbLength(container, stopMiddle);
+
+		difference = lengthCompareJsonbStringValue(&candidate, &key);
+
+		if (difference == 0)
+		{
+			int			index = stopMiddle + count;
+			JEntry		entry = container->children[index];
+			uint32		offset = getJsonbOffset(container, index);
+			uint32		len = getJsonbLength(container, index);
+			JsonbValue *result = palloc(sizeof(JsonbValue));
+
+			if (JBE_ISNULL(entry))
+				result->type = jbvNull;
+			else if (JBE_ISBOOL_TRUE(entry) || JBE_ISBOOL_FALSE(entry))
+			{
+				result->type = jbvBool;
+				result->val.boolean = JBE_ISBOOL_TRUE(entry);
+			}
+			else if (JBE_ISSTRING(entry))
+			{
+				result->type = jbvString;
+				result->val.string.val =
+					fetchJsonbSlice(attr, entsize + offset, len);
+				result->val.string.len = len;
+			}
+			else
+			{
+				/* Numerics and containers are preceded by alignment padding */
+				uint32		padding = INTALIGN(offset) - offset;
+				char	   *data;
+
+				data = fetchJsonbSlice(attr, entsize + offset + padding,
+									   len - padding);
+				if (JBE_ISNUMERIC(entry))
+				{
+					result->type = jbvNumeric;
+					result->val.numeric = (Numeric) data;
+				}
+				else
+				{
+					Assert(JBE_ISCONTAINER(entry));
+					result->type = jbvBinary;
+					result->val.binary.data = (JsonbContainer *) data;
+					result->val.binary.len = len - padding;
+				}
+			}
+
+			return result;
+		}
+		else if (difference < 0)
+			stopLow = stopMiddle + 1;
+		else
+			stopHigh = stopMiddle;
+	}
+
+	return NULL;
+}
+
+/*
+ * Fetch length bytes at offset of the data of a toasted jsonb value.
+ *
+ * The slice comes back as a palloc'd varlena; only its data is of interest.
+ * Everything in a jsonb container is int-aligned relative to the start of
+ * the root, and so is the data of a palloc'd varlena, so the result can be
+ * used in place.
+ */
+static char *
+fetchJsonbSlice(struct varlena * attr, uint32 offset, uint32 length)
+{
+	return VARDATA(heap_tuple_untoast_attr_slice(attr, offset, length));
+}
+
 /*
  * Get i-th value of a Jsonb array.
  *
@@ -0,0 +1,392 @@
+/*-------------------------------------------------------------------------
+ *
+ * mcxtfuncs.c
+ *	  Functions to show the memory contexts of a backend.
+ *
+ * A backend can only walk its own memory contexts, so to report those of
+ * another backend we ask it to do so with a procsignal.  There is a single
+ * report slot in shared memory: the requester claims it, signals the target
+ * and sleeps on its latch until the target has copied its context tree into
+ * the slot at its next CHECK_FOR_INTERRUPTS().
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/adt/mcxtfuncs.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
+#include "storage/procsignal.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* Maximum number of contexts included in one report */
+#define MAX_REPORTED_CONTEXTS	1024
+
+/* How long to wait for the target backend to report, in milliseconds */
+#define MEMORY_CONTEXT_REPORT_TIMEOUT	10000
+
+typedef struct MemoryContextReportEntry
+{
+	char		name[NAMEDATALEN];
+	int			level;			/* depth below TopMemoryContext */
+	int			parent;			/* index of the parent entry, or -1 */
+	MemoryContextCounters counters;
+} MemoryContextReportEntry;
+
+typedef struct MemoryContextReport
+{
+	slock_t		mutex;			/* protects all the fields below */
+	int			requester;		/* PID of the requester, 0 if slot is free */
+	int			requesterProcno;	/* pgprocno of the requester */
+	int			target;			/* PID of the backend to report */
+	bool		done;			/* target has filled in the entries */
+	int			ncontexts;		/* number of valid entries */
+	bool		truncated;		/* target has more than MAX_REPORTED_CONTEXTS */
+	MemoryContextReportEntry entries[MAX_REPORTED_CONTEXTS];
+} MemoryContextReport;
+
+static MemoryContextReport *ContextReport = NULL;
+
+volatile bool MemoryContextReportPending = false;
+
+typedef struct MemoryContextCollectState
+{
+	MemoryContextReportEntry *entries;
+	int			ncontexts;
+	bool		truncated;
+} MemoryContextCollectState;
+
+static void MemoryContextCollect(MemoryContextCollectState *state,
+					 MemoryContext context, int level, int parent);
+static void MemoryContextReportRelease(int code, Datum arg);
+
+
+Size
+MemoryContextReportShmemSize(void)
+{
+	return sizeof(MemoryContextReport);
+}
+
+void
+MemoryContextReportShmemInit(void)
+{
+	bool		found;
+
+	ContextReport = (MemoryContextReport *)
+		ShmemInitStruct("Memory Context Report", MemoryContextReportShmemSize(),
+						&found);
+	if (!found)
+	{
+		SpinLockInit(&ContextReport->mutex);
+		ContextReport->requester = 0;
+		ContextReport->requesterProcno = -1;
+		ContextReport->target = 0;
+		ContextReport->done = false;
+		ContextReport->ncontexts = 0;
+		ContextReport->truncated = false;
+	}
+}
+
+/*
+ * Walk the context tree depth-first, so that every context follows its
+ * parent.  Contexts beyond the capacity of the array are counted as
+ * truncation, not reported.
+ */
+static void
+MemoryContextCollect(MemoryContextCollectState *state, MemoryContext context,
+					 int level, int parent)
+{
+	MemoryContextReportEntry *entry;
+	MemoryContext child;
+	int			self;
+
+	if (state->ncontexts >= MAX_REPORTED_CONTEXTS)
+	{
+		state->truncated = true;
+		return;
+	}
+
+	self = state->ncontexts++;
+	entry = &state->entries[self];
+	strlcpy(entry->name, context->name, NAMEDATALEN);
+	entry->level = level;
+	entry->parent = parent;
+	/* stats methods accumulate into the counters */
+	memset(&entry->counters, 0, sizeof(entry->counters));
+	(*context->methods->stats) (context, level, false, &entry->counters);
+
+	for (child = context->firstchild; child != NULL; child = child->nextchild)
+		MemoryContextCollect(state, child, level + 1, self);
+}
+
+/*
+ * HandleMemoryContextReportInterrupt
+ *		Handle receipt of an interrupt asking for a memory context report.
+ *
+ * Called from procsignal_sigusr1_handler; the report is made by
+ * ProcessMemoryContextReport at the next CHECK_FOR_INTERRUPTS().
+ */
+void
+HandleMemoryContextReportInterrupt(void)
+{
+	InterruptPending = true;
+	MemoryContextReportPending = true;
+	/* latch will be set by procsignal_sigusr1_handler */
+}
+
+/*
+ * ProcessMemoryContextReport
+ *		Copy our memory context tree into the shared report slot, if a
+ *		backend is waiting for it.
+ */
+void
+ProcessMemoryContextReport(void)
+{
+	MemoryContextCollectState state;
+	int			requesterProcno = -1;
+
+	MemoryContextReportPending = false;
+
+	/* The requester may have given up already */
+	SpinLockAcquire(&ContextReport->mutex);
+	if (ContextReport->target != MyProcPid || ContextReport->done)
+	{
+		SpinLockRelease(&ContextReport->mutex);
+		return;
+	}
+	SpinLockRelease(&ContextReport->mutex);
+
+	/*
+	 * Collect into local memory first, as walking the contexts is too long to
+	 * do under a spinlock.  Don't fail the query we are interrupting if we
+	 * can't; the requester will just report an empty tree.
+	 */
+	state.entries = (MemoryContextReportEntry *)
+		MemoryContextAllocExtended(TopMemoryContext,
+						MAX_REPORTED_CONTEXTS * sizeof(MemoryContextReportEntry),
+								   MCXT_ALLOC_NO_OOM);
+	state.ncontexts = 0;
+	state.truncated = false;
+	if (state.entries != NULL)
+		MemoryContextCollect(&state, TopMemoryContext, 0, -1);
+
+	SpinLockAcquire(&ContextReport->mutex);
+	if (ContextReport->target == MyProcPid && !ContextReport->done)
+	{
+		if (state.ncontexts > 0)
+			memcpy(ContextReport->entries, state.entries,
+				   state.ncontexts * sizeof(MemoryContextReportEntry));
+		ContextReport->ncontexts = state.ncontexts;
+		ContextReport->truncated = state.truncated;
+		ContextReport->done = true;
+		requesterProcno = ContextReport->requesterProcno;
+	}
+	SpinLockRelease(&ContextReport->mutex);
+
+	if (requesterProcno >= 0)
+		SetLatch(&ProcGlobal->allProcs[requesterProcno].procLatch);
+
+	if (state.entries != NULL)
+		pfree(state.entries);
+}
+
+/*
+ * Free the report slot if we hold it, also when exiting on FATAL.
+ */
+static void
+MemoryContextReportRelease(int code, Datum arg)
+{
+	SpinLockAcquire(&ContextReport->mutex);
+	if (ContextReport->requester == MyProcPid)
+	{
+		ContextReport->requester = 0;
+		ContextReport->requesterProcno = -1;
+		ContextReport->target = 0;
+		ContextReport->done = false;
+	}
+	SpinLockRelease(&ContextReport->mutex);
+}
+
+/*
+ * Ask backend pid for its memory contexts and copy them into state,
+ * waiting up to MEMORY_CONTEXT_REPORT_TIMEOUT for the slot and the reply.
+ */
+static void
+MemoryContextRequestReport(int pid, MemoryContextCollectState *state)
+{
+	PGPROC	   *proc = BackendPidGetProc(pid);
+	TimestampTz deadline;
+	bool		claimed = false;
+	bool		done = false;
+
+	if (proc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("PID %d is not a PostgreSQL server process", pid)));
+
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+										   MEMORY_CONTEXT_REPORT_TIMEOUT);
+
+	PG_ENSURE_ERROR_CLEANUP(MemoryContextReportRelease, (Datum) 0);
+	{
+		for (;;)
+		{
+			int			rc;
+
+			SpinLockAcquire(&ContextReport->mutex);
+			if (!claimed && ContextReport->requester == 0)
+			{
+				ContextReport->requester = MyProcPid;
+				ContextReport->requesterProcno = MyProc->pgprocno;
+				ContextReport->target = pid;
+				ContextReport->done = false;
+				claimed = true;
+				SpinLockRelease(&ContextReport->mutex);
+
+				if (SendProcSignal(pid, PROCSIG_MEMORY_CONTEXTS,
+								   proc->backendId) < 0)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							 errmsg("could not send signal to process %d: %m",
+									pid)));
+				continue;
+			}
+			if (claimed && ContextReport->done)
+			{
+				state->ncontexts = ContextReport->ncontexts;
+				state->truncated = ContextReport->truncated;
+				memcpy(state->entries, ContextReport->entries,
+					   state->ncontexts * sizeof(MemoryContextReportEntry));
+				done = true;
+			}
+			SpinLockRelease(&ContextReport->mutex);
+
+			if (done || GetCurrentTimestamp() >= deadline)
+				break;
+
+			rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   100L);
+			if (rc & WL_POSTMASTER_DEATH)
+				proc_exit(1);
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(MemoryContextReportRelease, (Datum) 0);
+	MemoryContextReportRelease(0, (Datum) 0);
+
+	if (!done)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("process %d did not report its memory contexts",
+						pid),
+				 claimed ? 0 :
+				 errdetail("Another memory context report is in progress.")));
+}
+
+/*
+ * pg_get_memory_contexts
+ *		Show the memory contexts of the backend with the given PID.
+ */
+Datum
+pg_get_memory_contexts(PG_FUNCTION_ARGS)
+{
+#define PG_GET_MEMORY_CONTEXTS_COLS	8
+	int			pid = PG_GETARG_INT32(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	MemoryContextCollectState state;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (pid != MyProcPid && !superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to show memory contexts of other backends"))));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	state.entries = (MemoryContextReportEntry *)
+		palloc(MAX_REPORTED_CONTEXTS * sizeof(MemoryContextReportEntry));
+	state.ncontexts = 0;
+	state.truncated = false;
+
+	if (pid == MyProcPid)
+		MemoryContextCollect(&state, TopMemoryContext, 0, -1);
+	else
+		MemoryContextRequestReport(pid, &state);
+
+	if (state.truncated)
+		ereport(NOTICE,
+				(errmsg("only the first %d memory contexts are shown",
+						MAX_REPORTED_CONTEXTS)));
+
+	for (i = 0; i < state.ncontexts; i++)
+	{
+		MemoryContextReportEntry *entry = &state.entries[i];
+		Datum		values[PG_GET_MEMORY_CONTEXTS_COLS];
+		bool		nulls[PG_GET_MEMORY_CONTEXTS_COLS];
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(entry->name);
+		if (entry->parent >= 0)
+			values[1] = CStringGetTextDatum(state.entries[entry->parent].name);
+		else
+			nulls[1] = true;
+		values[2] = Int32GetDatum(entry->level);
+		values[3] = Int64GetDatum(entry->counters.totalspace);
+		values[4] = Int64GetDatum(entry->counters.nblocks);
+		values[5] = Int64GetDatum(entry->counters.freespace);
+		values[6] = Int64GetDatum(entry->counters.freechunks);
+		values[7] = Int64GetDatum(entry->counters.totalspace -
+								  entry->counters.freespace);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(state.entries);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -277,6 +277,57 @@ typedef struct NumericVar
 } NumericVar;
 
 
+/* ----------
+ * Fast path for small values
+ *
+ * A value whose magnitude, with its decimal point shifted right by a scale
+ * of at most NUMERIC_FAST_DIGITS, stays below 10^NUMERIC_FAST_DIGITS fits in
+ * an int64 as a scaled integer.  Sums and products of two such values fit in
+ * an int128, so on platforms that have one, numeric_add(), numeric_sub() and
+ * numeric_mul() compute them that way instead of through add_var() and
+ * mul_var().  The numeric aggregates likewise keep a scaled int128 sum of
+ * such inputs, which is folded into their NumericVar sums only when those
+ * are needed or the int128 sum grows past NUMERIC_FAST_SUM_LIMIT.
+ * ----------
+ */
+#ifdef HAVE_INT128
+#define NUMERIC_FAST_DIGITS		18
+
+/* Inputs to sum(X*X) must be smaller, to leave room for many squares */
+#define NUMERIC_FAST_SQUARE_DIGITS	15
+
+/* 10^37, comfortably below the int128 limit of about 1.7 * 10^38 */
+#define NUMERIC_FAST_SUM_LIMIT \
+	((int128) INT64CONST(1000000000000000000) * \
+	 INT64CONST(1000000000000000000) * 10)
+
+/* Enough NBASE digits for any int128, plus a partial fractional digit */
+#define NUMERIC_FAST_MAX_NDIGITS	(40 / DEC_DIGITS + 2)
+
+static const int64 numeric_fast_pow10[NUMERIC_FAST_DIGITS + 1] = {
+	INT64CONST(1),
+	INT64CONST(10),
+	INT64CONST(100),
+	INT64CONST(1000),
+	INT64CONST(10000),
+	INT64CONST(100000),
+	INT64CONST(1000000),
+	INT64CONST(10000000),
+	INT64CONST(100000000),
+	INT64CONST(1000000000),
+	INT64CONST(10000000000),
+	INT64CONST(100000000000),
+	INT64CONST(1000000000000),
+	INT64CONST(10000000000000),
+	INT64CONST(100000000000000),
+	INT64CONST(1000000000000000),
+	INT64CONST(10000000000000000),
+	INT64CONST(100000000000000000),
+	INT64CONST(1000000000000000000)
+};
+#endif
+
+
 /* ----------
  * Data for generate_series
  * ----------
@@ -438,6 +489,14 @@ static void int64_to_numericvar(int64 val, NumericVar *var);
 #ifdef HAVE_INT128
 static bool numericvar_to_int128(NumericVar *var, int128 *result);
 static void int128_to_numericvar(int128 val, NumericVar *var);
+static bool numericvar_to_scaled_int64(NumericVar *var, int scale,
+						   int64 *result);
+static void scaled_int128_to_numericvar(int128 val, int scale,
+							NumericVar *var, NumericDigit *digits);
+static bool numeric_fast_add(NumericVar *var1, NumericVar *var2, bool sub,
+				 Numeric *result);
+static bool numeric_fast_mul(NumericVar *var1, NumericVar *var2,
+				 Numeric *result);
 #endif
 static double numeric_to_double_no_overflow(Numeric num);
 static double numericvar_to_double_no_overflow(NumericVar *var);
@@ -2216,6 +2275,11 @@ numeric_add(PG_FUNCTION_ARGS)
 	init_var_from_num(num1, &arg1);
 	init_var_from_num(num2, &arg2);
 
+#ifdef HAVE_INT128
+	if (numeric_fast_add(&arg1, &arg2, false, &res))
+		PG_RETURN_NUMERIC(res);
+#endif
+
 	init_var(&result);
 	add_var(&arg1, &arg2, &result);
 
@@ -2254,6 +2318,11 @@ numeric_sub(PG_FUNCTION_ARGS)
 	init_var_from_num(num1, &arg1);
 	init_var_from_num(num2, &arg2);
 
+#ifdef HAVE_INT128
+	if (numeric_fast_add(&arg1, &arg2, true, &res))
+		PG_RETURN_NUMERIC(res);
+#endif
+
 	init_var(&result);
 	sub_var(&arg1, &arg2, &result);
 
@@ -2296,6 +2365,11 @@ numeric_mul(PG_FUNCTION_ARGS)
 	init_var_from_num(num1, &arg1);
 	init_var_from_num(num2, &arg2);
 
+#ifdef HAVE_INT128
+	if (numeric_fast_mul(&arg1, &arg2, &res))
+		PG_RETURN_NUMERIC(res);
+#endif
+
 	init_var(&result);
 	mul_var(&arg1, &arg2, &result, arg1.dscale + arg2.dscale);
 
@@ -3145,6 +3219,13 @@ typedef struct NumericAggState
 	int			maxScale;		/* maximum scale seen so far */
 	int64		maxScaleCount;	/* number of values seen with maximum scale */
 	int64		NaNcount;		/* count of NaN values (not included in N!) */
+#ifdef HAVE_INT128
+	/* Small inputs not yet added to sumX and sumX2; see numeric_agg_flush */
+	int64		pendingN;		/* count of such inputs (included in N) */
+	int			pendingScale;	/* scale of pendingSumX */
+	int128		pendingSumX;	/* their sum, scaled by 10^pendingScale */
+	int128		pendingSumX2;	/* sum of squares, scaled by 10^(2*scale) */
+#endif
 } NumericAggState;
 
 /*
@@ -3188,6 +3269,96 @@ makeNumericAggStateCurrentContext(bool calcSumX2)
 	return state;
 }
 
+/*
+ * Add the pending sums of small inputs to sumX and sumX2.
+ *
+ * Anything that looks at sumX or sumX2 must call this first.
+ */
+static void
+numeric_agg_flush(NumericAggState *state)
+{
+#ifdef HAVE_INT128
+	NumericVar	X;
+	NumericDigit digits[NUMERIC_FAST_MAX_NDIGITS];
+	bool		first;
+	MemoryContext old_context;
+
+	if (state->pendingN == 0)
+		return;
+
+	/* If all inputs are pending, the sums are yet to be initialized */
+	first = (state->N == state->pendingN);
+
+	old_context = MemoryContextSwitchTo(state->agg_context);
+
+	scaled_int128_to_numericvar(state->pendingSumX, state->pendingScale,
+								&X, digits);
+	if (first)
+		set_var_from_var(&X, &(state->sumX));
+	else
+		add_var(&X, &(state->sumX), &(state->sumX));
+
+	if (state->calcSumX2)
+	{
+		scaled_int128_to_numericvar(state->pendingSumX2,
+									state->pendingScale * 2, &X, digits);
+		if (first)
+			set_var_from_var(&X, &(state->sumX2));
+		else
+			add_var(&X, &(state->sumX2), &(state->sumX2));
+	}
+
+	MemoryContextSwitchTo(old_context);
+
+	state->pendingN = 0;
+	state->pendingSumX = 0;
+	state->pendingSumX2 = 0;
+#endif
+}
+
+#ifdef HAVE_INT128
+/*
+ * Try to accumulate X into the pending sums of small inputs.
+ *
+ * Returns false if X is too large, in which case the caller takes the
+ * NumericVar path.
+ */
+static bool
+do_numeric_accum_fast(NumericAggState *state, NumericVar *X)
+{
+	int64		val;
+
+	/* Pending sums can't change scale, so start over at the larger one */
+	if (X->dscale > state->pendingScale)
+	{
+		if (X->dscale > NUMERIC_FAST_DIGITS)
+			return false;
+		numeric_agg_flush(state);
+		state->pendingScale = X->dscale;
+	}
+
+	if (!numericvar_to_scaled_int64(X, state->pendingScale, &val))
+		return false;
+	if (state->calcSumX2 &&
+		(val >= numeric_fast_pow10[NUMERIC_FAST_SQUARE_DIGITS] ||
+		 val <= -numeric_fast_pow10[NUMERIC_FAST_SQUARE_DIGITS]))
+		return false;
+
+	if (state->pendingSumX >= NUMERIC_FAST_SUM_LIMIT ||
+		state->pendingSumX <= -NUMERIC_FAST_SUM_LIMIT ||
+		state->pendingSumX2 >= NUMERIC_FAST_SUM_LIMIT)
+		numeric_agg_flush(state);
+
+	state->pendingSumX += val;
+	if (state->calcSumX2)
+		state->pendingSumX2 += (int128) val * val;
+	state->pendingN++;
+	state->N++;
+
+	return true;
+}
+#endif
+
 /*
  * Accumulate a new input value for numeric aggregate functions.
  */
@@ -3220,6 +3391,14 @@ do_numeric_accum(NumericAggState *state, Numeric newval)
 	else if (X.dscale == state->maxScale)
 		state->maxScaleCount++;
 
+#ifdef HAVE_INT128
+	if (do_numeric_accum_fast(state, &X))
+		return;
+#endif
+
+	/* Keep N an honest count of the inputs in sumX below */
+	numeric_agg_flush(state);
+
 	/* if we need X^2, calculate that in short-lived context */
 	if (state->calcSumX2)
 	{
@@ -3279,6 +3458,8 @@ do_numeric_discard(NumericAggState *state, Numeric newval)
 		return true;
 	}
 
+	numeric_agg_flush(state);
+
 	/* load processed number in short-lived context */
 	init_var_from_num(newval, &X);
 
@@ -3381,6 +3562,10 @@ numeric_combine(PG_FUNCTION_ARGS)
 	if (state2 == NULL)
 		PG_RETURN_POINTER(state1);
 
+	numeric_agg_flush(state2);
+	if (state1 != NULL)
+		numeric_agg_flush(state1);
+
 	/* manually copy all fields from state2 to state1 */
 	if (state1 == NULL)
 	{
@@ -3472,6 +3657,10 @@ numeric_avg_combine(PG_FUNCTION_ARGS)
 	if (state2 == NULL)
 		PG_RETURN_POINTER(state1);
 
+	numeric_agg_flush(state2);
+	if (state1 != NULL)
+		numeric_agg_flush(state1);
+
 	/* manually copy all fields from state2 to state1 */
 	if (state1 == NULL)
 	{
@@ -3538,6 +3727,7 @@ numeric_avg_serialize(PG_FUNCTION_ARGS)
 		elog(ERROR, "aggregate function called in non-aggregate context");
 
 	state = (NumericAggState *) PG_GETARG_POINTER(0);
+	numeric_agg_flush(state);
 
 	/*
 	 * This is a little wasteful since make_result converts the NumericVar
@@ -3643,6 +3833,7 @@ numeric_serialize(PG_FUNCTION_ARGS)
 		elog(ERROR, "aggregate function called in non-aggregate context");
 
 	state = (NumericAggState *) PG_GETARG_POINTER(0);
+	numeric_agg_flush(state);
 
 	/*
 	 * This is a little wasteful since make_result converts the NumericVar
@@ -4544,6 +4735,8 @@ numeric_avg(PG_FUNCTION_ARGS)
 	if (state->NaNcount > 0)	/* there was at least one NaN input */
 		PG_RETURN_NUMERIC(make_result(&const_nan));
 
+	numeric_agg_flush(state);
+
 	N_datum = DirectFunctionCall1(int8_numeric, Int64GetDatum(state->N));
 	sumX_datum = NumericGetDatum(make_result(&state->sumX));
 
@@ -4564,6 +4757,8 @@ numeric_sum(PG_FUNCTION_ARGS)
 	if (state->NaNcount > 0)	/* there was at least one NaN input */
 		PG_RETURN_NUMERIC(make_result(&const_nan));
 
+	numeric_agg_flush(state);
+
 	PG_RETURN_NUMERIC(make_result(&(state->sumX)));
 }
 
@@ -4603,6 +4798,8 @@ numeric_stddev_internal(NumericAggState *state,
 	if (state->NaNcount > 0)
 		return make_result(&const_nan);
 
+	numeric_agg_flush(state);
+
 	init_var(&vN);
 	init_var(&vsumX);
 	init_var(&vsumX2);
@@ -4743,6 +4940,7 @@ numeric_poly_stddev_internal(Int128AggState *state,
 	init_var(&numstate.sumX2);
 	numstate.NaNcount = 0;
 	numstate.agg_context = NULL;
+	numstate.pendingN = 0;
 
 	if (state)
 	{
@@ -6229,6 +6427,153 @@ int128_to_numericvar(int128 val, NumericVar *var)
 	var->ndigits = ndigits;
 	var->weight = ndigits - 1;
 }
+
+/*
+ * Convert var to an integer scaled by 10^scale, for the small-value fast
+ * paths.
+ *
+ * Returns FALSE if the result would not be below 10^NUMERIC_FAST_DIGITS in
+ * absolute value, or if scale is less than var's dscale and so would lose
+ * digits.  Return TRUE if okay.
+ */
+static bool
+numericvar_to_scaled_int64(NumericVar *var, int scale, int64 *result)
+{
+	int128		val = 0;
+	int			fracdigits;
+	int			exp;
+	int			i;
+
+	if (var->dscale > scale || scale > NUMERIC_FAST_DIGITS)
+		return false;
+	if (var->ndigits == 0)
+	{
+		*result = 0;
+		return true;
+	}
+
+	/* The value is below NBASE^(weight + 1) */
+	if ((var->weight + 1) * DEC_DIGITS + scale > NUMERIC_FAST_DIGITS)
+		return false;
+
+	/* Don't trust an unstripped var not to have digits beyond its dscale */
+	fracdigits = var->ndigits - var->weight - 1;
+	if (fracdigits * DEC_DIGITS >= scale + DEC_DIGITS)
+		return false;
+
+	for (i = 0; i < var->ndigits; i++)
+		val = val * NBASE + var->digits[i];
+
+	/* val has fracdigits NBASE digits after the decimal point */
+	exp = scale - fracdigits * DEC_DIGITS;
+	if (exp >= 0)
+		val *= numeric_fast_pow10[exp];
+	else
+	{
+		if (val % numeric_fast_pow10[-exp] != 0)
+			return false;
+		val /= numeric_fast_pow10[-exp];
+	}
+
+	*result = (int64) (var->sign == NUMERIC_NEG ? -val : val);
+	return true;
+}
+
+/*
+ * Set var to val / 10^scale, with dscale scale.
+ *
+ * The digits are stored in the caller's buffer, which must have room for
+ * NUMERIC_FAST_MAX_NDIGITS of them; var->buf is left NULL, so var must be
+ * copied or passed to make_result() rather than freed.
+ */
+static void
+scaled_int128_to_numericvar(int128 val, int scale, NumericVar *var,
+							NumericDigit *digits)
+{
+	uint128		uval;
+	NumericDigit *ptr = digits + NUMERIC_FAST_MAX_NDIGITS;
+	int			partial = scale % DEC_DIGITS;
+	int			ndigits = 0;
+
+	if (val < 0)
+	{
+		var->sign = NUMERIC_NEG;
+		uval = -val;
+	}
+	else
+	{
+		var->sign = NUMERIC_POS;
+		uval = val;
+	}
+
+	/* The last NBASE digit may hold fewer than DEC_DIGITS decimal digits */
+	if (partial > 0)
+	{
+		*--ptr = (NumericDigit) ((uval % numeric_fast_pow10[partial]) *
+								 numeric_fast_pow10[DEC_DIGITS - partial]);
+		uval /= numeric_fast_pow10[partial];
+		ndigits++;
+	}
+	while (uval != 0)
+	{
+		*--ptr = (NumericDigit) (uval % NBASE);
+		uval /= NBASE;
+		ndigits++;
+	}
+
+	var->ndigits = ndigits;
+	var->weight = ndigits - 1 - (scale + DEC_DIGITS - 1) / DEC_DIGITS;
+	var->dscale = scale;
+	var->buf = NULL;
+	var->digits = ptr;
+}
+
+/*
+ * Compute var1 + var2, or var1 - var2 if sub, into *result if both are
+ * small enough for the scaled-integer fast path.  The result is what
+ * add_var() or sub_var() would produce.  Returns FALSE if not applicable.
+ */
+static bool
+numeric_fast_add(NumericVar *var1, NumericVar *var2, bool sub,
+				 Numeric *result)
+{
+	int			scale = Max(var1->dscale, var2->dscale);
+	int64		val1,
+				val2;
+	NumericVar	sum;
+	NumericDigit digits[NUMERIC_FAST_MAX_NDIGITS];
+
+	if (!numericvar_to_scaled_int64(var1, scale, &val1) ||
+		!numericvar_to_scaled_int64(var2, scale, &val2))
+		return false;
+
+	scaled_int128_to_numericvar(sub ? (int128) val1 - val2 :
+								(int128) val1 + val2,
+								scale, &sum, digits);
+	*result = make_result(&sum);
+	return true;
+}
+
+/*
+ * Like numeric_fast_add(), for the exact product var1 * var2.
+ */
+static bool
+numeric_fast_mul(NumericVar *var1, NumericVar *var2, Numeric *result)
+{
+	int64		val1,
+				val2;
+	NumericVar	prod;
+	NumericDigit digits[NUMERIC_FAST_MAX_NDIGITS];
+
+	if (!numericvar_to_scaled_int64(var1, var1->dscale, &val1) ||
+		!numericvar_to_scaled_int64(var2, var2->dscale, &val2))
+		return false;
+
+	scaled_int128_to_numericvar((int128) val1 * val2,
+								var1->dscale + var2->dscale, &prod, digits);
+	*result = make_result(&prod);
+	return true;
+}
 #endif
 
 /*
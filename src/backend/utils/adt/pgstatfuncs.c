@@ -20,9 +20,15 @@
 #include "libpq/ip.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "postmaster/autovacuum.h"
+#include "postmaster/sessionpool.h"
+#include "storage/buf_internals.h"
+#include "storage/predicate.h"
 #include "storage/proc.h"
 #include "storage/procarray.h"
+#include "storage/smgr.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/inet.h"
 #include "utils/timestamp.h"
@@ -66,6 +72,7 @@ extern Datum pg_stat_get_backend_wait_event_type(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_wait_event(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_activity_start(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_xact_start(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_backend_sinval_resets(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_start(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_client_addr(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_client_port(PG_FUNCTION_ARGS);
@@ -93,6 +100,7 @@ extern Datum pg_stat_get_db_temp_files(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_db_temp_bytes(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_db_blk_read_time(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_db_blk_write_time(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_db_fastpath_overflows(PG_FUNCTION_ARGS);
 
 extern Datum pg_stat_get_archiver(PG_FUNCTION_ARGS);
 
@@ -107,6 +115,12 @@ extern Datum pg_stat_get_bgwriter_stat_reset_time(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_buf_written_backend(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_buf_fsync_backend(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_buf_alloc(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_buffer_replacement(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_lwlocks(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_tablespace_io(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_session_pool(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_serializable(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_autovacuum_queue(PG_FUNCTION_ARGS);
 
 extern Datum pg_stat_get_xact_numscans(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_xact_tuples_returned(PG_FUNCTION_ARGS);
@@ -565,6 +579,8 @@ pg_stat_get_progress_info(PG_FUNCTION_ARGS)
 	/* Translate command name into command type code. */
 	if (pg_strcasecmp(cmd, "VACUUM") == 0)
 		cmdtype = PROGRESS_COMMAND_VACUUM;
+	else if (pg_strcasecmp(cmd, "COPY") == 0)
+		cmdtype = PROGRESS_COMMAND_COPY;
 	else
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
@@ -1080,6 +1096,19 @@ pg_stat_get_backend_xact_start(PG_FUNCTION_ARGS)
 }
 
 
+Datum
+pg_stat_get_backend_sinval_resets(PG_FUNCTION_ARGS)
+{
+	int32		beid = PG_GETARG_INT32(0);
+	PgBackendStatus *beentry;
+
+	if ((beentry = pgstat_fetch_stat_beentry(beid)) == NULL)
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(beentry->st_sinval_resets);
+}
+
+
 Datum
 pg_stat_get_backend_start(PG_FUNCTION_ARGS)
 {
@@ -1552,6 +1581,21 @@ pg_stat_get_db_blk_write_time(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8(result);
 }
 
+Datum
+pg_stat_get_db_fastpath_overflows(PG_FUNCTION_ARGS)
+{
+	Oid			dbid = PG_GETARG_OID(0);
+	int64		result;
+	PgStat_StatDBEntry *dbentry;
+
+	if ((dbentry = pgstat_fetch_stat_dbentry(dbid)) == NULL)
+		result = 0;
+	else
+		result = (int64) (dbentry->n_fastpath_overflows);
+
+	PG_RETURN_INT64(result);
+}
+
 Datum
 pg_stat_get_bgwriter_timed_checkpoints(PG_FUNCTION_ARGS)
 {
@@ -1620,6 +1664,378 @@ pg_stat_get_buf_alloc(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(pgstat_fetch_global()->buf_alloc);
 }
 
+/*
+ * Returns statistics about victim buffer searches of the buffer replacement
+ * policy.  Unlike the functions above, these are read straight from the
+ * buffer manager's shared memory rather than from the statistics collector.
+ */
+Datum
+pg_stat_get_buffer_replacement(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[5];
+	bool		nulls[5];
+	int			nparts;
+	uint64		num_searches;
+	uint64		num_scanned;
+	uint64		search_time;
+
+	/* Initialise values and NULL flags arrays */
+	MemSet(values, 0, sizeof(values));
+	MemSet(nulls, 0, sizeof(nulls));
+
+	/* Initialise attributes information in the tuple descriptor */
+	tupdesc = CreateTemplateTupleDesc(5, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "policy",
+					   TEXTOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "sweep_partitions",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "victim_searches",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "buffers_scanned",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "search_time",
+					   FLOAT8OID, -1, 0);
+
+	BlessTupleDesc(tupdesc);
+
+	StrategyGetStatistics(&nparts, &num_searches, &num_scanned, &search_time);
+
+	/* Fill values */
+	if (buffer_replacement_policy == BUFFER_REPLACEMENT_PARTITIONED_CLOCK)
+		values[0] = CStringGetTextDatum("partitioned_clock");
+	else
+		values[0] = CStringGetTextDatum("clock");
+	values[1] = Int32GetDatum(nparts);
+	values[2] = Int64GetDatum((int64) num_searches);
+	values[3] = Int64GetDatum((int64) num_scanned);
+	/* convert microseconds to milliseconds */
+	values[4] = Float8GetDatum((double) search_time / 1000.0);
+
+	/* Returns the record as Datum */
+	PG_RETURN_DATUM(HeapTupleGetDatum(
+								   heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Returns the cumulative wait statistics of LWLocks, one row for each
+ * individual lock and each tranche that has been used.
+ */
+Datum
+pg_stat_get_lwlocks(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_LWLOCKS_COLS	6
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	LWLockWaitStats *waitstats;
+	int			slot;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	waitstats = LWLockGetWaitStats();
+
+	for (slot = 0; slot < LWLOCK_STATS_SLOTS; slot++)
+	{
+		LWLockWaitStats *entry = &waitstats[slot];
+		Datum		values[PG_STAT_GET_LWLOCKS_COLS];
+		bool		nulls[PG_STAT_GET_LWLOCKS_COLS];
+		Datum		buckets[LWLOCK_WAIT_BUCKETS];
+		int			i;
+
+		/* skip locks that were never taken */
+		if (entry->acquire_count == 0 && entry->block_count == 0)
+			continue;
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		for (i = 0; i < LWLOCK_WAIT_BUCKETS; i++)
+			buckets[i] = Int64GetDatum((int64) entry->wait_histogram[i]);
+
+		values[0] = CStringGetTextDatum(LWLockWaitStatsName(slot));
+		values[1] = Int64GetDatum((int64) entry->acquire_count);
+		values[2] = Int64GetDatum((int64) entry->block_count);
+		/* convert microseconds to milliseconds */
+		values[3] = Float8GetDatum((double) entry->wait_time / 1000.0);
+		values[4] = Float8GetDatum((double) entry->max_wait_time / 1000.0);
+		values[5] = PointerGetDatum(construct_array(buckets,
+													LWLOCK_WAIT_BUCKETS,
+													INT8OID, sizeof(int64),
+													FLOAT8PASSBYVAL, 'd'));
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(waitstats);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Returns the write counters and budgets of tablespaces.
+ */
+Datum
+pg_stat_get_tablespace_io(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_TABLESPACE_IO_COLS	9
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TablespaceIOStats *stats;
+	int			nstats;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	stats = (TablespaceIOStats *)
+		palloc(MAX_TABLESPACE_IO_SLOTS * sizeof(TablespaceIOStats));
+	nstats = TablespaceIOGetStats(stats);
+
+	for (i = 0; i < nstats; i++)
+	{
+		TablespaceIOStats *entry = &stats[i];
+		Datum		values[PG_STAT_GET_TABLESPACE_IO_COLS];
+		bool		nulls[PG_STAT_GET_TABLESPACE_IO_COLS];
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(entry->spcNode);
+		values[1] = Int64GetDatum((int64) entry->writes);
+		values[2] = Int64GetDatum((int64) entry->writes * BLCKSZ);
+		values[3] = Float8GetDatum(entry->write_iops * BLCKSZ);
+		values[4] = Float8GetDatum(entry->write_iops);
+		values[5] = Int64GetDatum((int64) entry->delayed_writes);
+		/* convert microseconds to milliseconds */
+		values[6] = Float8GetDatum((double) entry->delay_time / 1000.0);
+		if (entry->max_write_rate > 0)
+			values[7] = Int32GetDatum(entry->max_write_rate);
+		else
+			nulls[7] = true;
+		if (entry->max_write_iops > 0)
+			values[8] = Int32GetDatum(entry->max_write_iops);
+		else
+			nulls[8] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(stats);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Returns usage statistics of the session pool.
+ */
+Datum
+pg_stat_get_session_pool(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[5];
+	bool		nulls[5];
+	int			idle;
+	int64		hits,
+				misses,
+				returns,
+				evictions;
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	tupdesc = CreateTemplateTupleDesc(5, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "idle_backends",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "hits",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "misses",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "returns",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "evictions",
+					   INT8OID, -1, 0);
+	BlessTupleDesc(tupdesc);
+
+	SessionPoolGetStats(&idle, &hits, &misses, &returns, &evictions);
+
+	values[0] = Int32GetDatum(idle);
+	values[1] = Int64GetDatum(hits);
+	values[2] = Int64GetDatum(misses);
+	values[3] = Int64GetDatum(returns);
+	values[4] = Int64GetDatum(evictions);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Returns the counters of predicate lock promotions and serialization
+ * failures, by cause, kept by the predicate lock manager.
+ */
+Datum
+pg_stat_get_serializable(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[7];
+	bool		nulls[7];
+	PredicateLockStats stats;
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	tupdesc = CreateTemplateTupleDesc(7, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "page_promotions",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "relation_promotions",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "doomed_failures",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "pivot_write_failures",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 5, "pivot_read_failures",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 6, "summarized_failures",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 7, "prepared_pivot_failures",
+					   INT8OID, -1, 0);
+	BlessTupleDesc(tupdesc);
+
+	GetPredicateLockStats(&stats);
+
+	values[0] = Int64GetDatum((int64) stats.page_promotions);
+	values[1] = Int64GetDatum((int64) stats.relation_promotions);
+	values[2] = Int64GetDatum((int64) stats.failures[SSI_FAILURE_DOOMED]);
+	values[3] = Int64GetDatum((int64) stats.failures[SSI_FAILURE_PIVOT_WRITE]);
+	values[4] = Int64GetDatum((int64) stats.failures[SSI_FAILURE_PIVOT_READ]);
+	values[5] = Int64GetDatum((int64) stats.failures[SSI_FAILURE_SUMMARIZED]);
+	values[6] = Int64GetDatum((int64) stats.failures[SSI_FAILURE_PREPARED_PIVOT]);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Returns the tables waiting to be processed by autovacuum workers, or being
+ * processed, with their priority.
+ */
+Datum
+pg_stat_get_autovacuum_queue(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_AUTOVACUUM_QUEUE_COLS	5
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	AutoVacuumQueueEntry *entries;
+	int			nentries;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	entries = (AutoVacuumQueueEntry *)
+		palloc(AUTOVACUUM_QUEUE_SIZE * sizeof(AutoVacuumQueueEntry));
+	nentries = AutoVacuumGetQueue(entries);
+
+	for (i = 0; i < nentries; i++)
+	{
+		AutoVacuumQueueEntry *entry = &entries[i];
+		Datum		values[PG_STAT_GET_AUTOVACUUM_QUEUE_COLS];
+		bool		nulls[PG_STAT_GET_AUTOVACUUM_QUEUE_COLS];
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(entry->datid);
+		values[1] = ObjectIdGetDatum(entry->relid);
+		values[2] = Float8GetDatum(entry->priority);
+		values[3] = BoolGetDatum(entry->wraparound);
+		if (entry->pid != 0)
+			values[4] = Int32GetDatum(entry->pid);
+		else
+			nulls[4] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(entries);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 Datum
 pg_stat_get_xact_numscans(PG_FUNCTION_ARGS)
 {
@@ -29,12 +29,16 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
+#include "lib/ilist.h"
 #include "miscadmin.h"
 #include "regex/regex.h"
+#include "regex/regexport.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 
 #define PG_GETARG_TEXT_PP_IF_EXISTS(_n) \
 	(PG_NARGS() > (_n) ? PG_GETARG_TEXT_PP(_n) : NULL)
@@ -63,46 +67,45 @@ typedef struct regexp_matches_ctx
 } regexp_matches_ctx;
 
 /*
- * We cache precompiled regular expressions using a "self organizing list"
- * structure, in which recently-used items tend to be near the front.
- * Whenever we use an entry, it's moved up to the front of the list.
- * Over time, an item's average position corresponds to its frequency of use.
+ * We cache precompiled regular expressions in a hash table, keyed by the
+ * pattern and the options it was compiled with, up to regex_cache_size
+ * kilobytes.  Compiling a regular expression is expensive, and queries tend
+ * to use the same patterns over and over, usually many more of them than fit
+ * in a small fixed-size cache when they come from configuration tables.
  *
- * When we first create an entry, it's inserted at the front of
- * the array, dropping the entry at the end of the array if necessary to
- * make room.  (This might seem to be weighting the new entry too heavily,
- * but if we insert new entries further back, we'll be unable to adjust to
- * a sudden shift in the query mix where we are presented with MAX_CACHED_RES
- * never-before-seen items used circularly.  We ought to be able to handle
- * that case, so we have to insert at the front.)
- *
- * Knuth mentions a variant strategy in which a used item is moved up just
- * one place in the list.  Although he says this uses fewer comparisons on
- * average, it seems not to adapt very well to the situation where you have
- * both some reusable patterns and a steady stream of non-reusable patterns.
- * A reusable pattern that isn't used at least as often as non-reusable
- * patterns are seen will "fail to keep up" and will drop off the end of the
- * cache.  With move-to-front, a reusable pattern is guaranteed to stay in
- * the cache as long as it's used at least once in every MAX_CACHED_RES uses.
+ * The entries are also kept in a list in order of use, most recently used
+ * first, so that when the cache is full, the least recently used entries are
+ * discarded to make room.  A reusable pattern stays in the cache as long as
+ * fewer than regex_cache_size kilobytes of other patterns are used between
+ * two of its uses.  The memory use of an entry is estimated from its pattern
+ * and compiled form, see pg_reg_getmemsize().
  */
 
-/* this is the maximum number of cached regular expressions */
-#ifndef MAX_CACHED_RES
-#define MAX_CACHED_RES	32
-#endif
+/* hash key of a cached regular expression */
+typedef struct cached_re_key
+{
+	uint32		cre_hash;		/* hash of the original RE */
+	int			cre_pat_len;	/* length of original RE, in bytes */
+	int			cre_flags;		/* compile flags: extended,icase etc */
+	Oid			cre_collation;	/* collation to use */
+} cached_re_key;
 
 /* this structure describes one cached regular expression */
 typedef struct cached_re_str
 {
+	cached_re_key cre_key;		/* hash key --- must be first */
 	char	   *cre_pat;		/* original RE (not null terminated!) */
-	int			cre_pat_len;	/* length of original RE, in bytes */
-	int			cre_flags;		/* compile flags: extended,icase etc */
-	Oid			cre_collation;	/* collation to use */
+	Size		cre_size;		/* estimated memory use of the entry */
+	dlist_node	cre_node;		/* link in the list of cached re's */
 	regex_t		cre_re;			/* the compiled regular expression */
 } cached_re_str;
 
-static int	num_res = 0;		/* # of cached re's */
-static cached_re_str re_array[MAX_CACHED_RES];	/* cached re's */
+/* GUC: maximum memory for cached re's, in kB */
+int			regex_cache_size = 1024;
+
+static HTAB *re_hash = NULL;	/* cached re's */
+static dlist_head re_list = DLIST_STATIC_INIT(re_list);	/* in LRU order */
+static Size re_cache_used = 0;	/* total cre_size of cached re's */
 
 
 /* Local functions */
@@ -136,35 +139,39 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 	char	   *text_re_val = VARDATA_ANY(text_re);
 	pg_wchar   *pattern;
 	int			pattern_len;
-	int			i;
 	int			regcomp_result;
-	cached_re_str re_temp;
+	cached_re_key key;
+	cached_re_str *re;
+	regex_t		re_temp;
+	char	   *pat;
+	bool		found;
 	char		errMsg[100];
 
-	/*
-	 * Look for a match among previously compiled REs.  Since the data
-	 * structure is self-organizing with most-used entries at the front, our
-	 * search strategy can just be to scan from the front.
-	 */
-	for (i = 0; i < num_res; i++)
+	if (re_hash == NULL)
 	{
-		if (re_array[i].cre_pat_len == text_re_len &&
-			re_array[i].cre_flags == cflags &&
-			re_array[i].cre_collation == collation &&
-			memcmp(re_array[i].cre_pat, text_re_val, text_re_len) == 0)
-		{
-			/*
-			 * Found a match; move it to front if not there already.
-			 */
-			if (i > 0)
-			{
-				re_temp = re_array[i];
-				memmove(&re_array[1], &re_array[0], i * sizeof(cached_re_str));
-				re_array[0] = re_temp;
-			}
+		HASHCTL		ctl;
 
-			return &re_array[0].cre_re;
-		}
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(cached_re_key);
+		ctl.entrysize = sizeof(cached_re_str);
+		re_hash = hash_create("Regular expression cache", 256, &ctl,
+							  HASH_ELEM | HASH_BLOBS);
+	}
+
+	/* Look for a match among previously compiled REs */
+	MemSet(&key, 0, sizeof(key));
+	key.cre_hash = DatumGetUInt32(hash_any((unsigned char *) text_re_val,
+										   text_re_len));
+	key.cre_pat_len = text_re_len;
+	key.cre_flags = cflags;
+	key.cre_collation = collation;
+
+	re = (cached_re_str *) hash_search(re_hash, &key, HASH_FIND, NULL);
+	if (re != NULL && memcmp(re->cre_pat, text_re_val, text_re_len) == 0)
+	{
+		/* Found a match; move it to front of the list */
+		dlist_move_head(&re_list, &re->cre_node);
+		return &re->cre_re;
 	}
 
 	/*
@@ -178,7 +185,7 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 									   pattern,
 									   text_re_len);
 
-	regcomp_result = pg_regcomp(&re_temp.cre_re,
+	regcomp_result = pg_regcomp(&re_temp,
 								pattern,
 								pattern_len,
 								cflags,
@@ -198,7 +205,7 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 		 */
 		CHECK_FOR_INTERRUPTS();
 
-		pg_regerror(regcomp_result, &re_temp.cre_re, errMsg, sizeof(errMsg));
+		pg_regerror(regcomp_result, &re_temp, errMsg, sizeof(errMsg));
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_REGULAR_EXPRESSION),
 				 errmsg("invalid regular expression: %s", errMsg)));
@@ -210,38 +217,53 @@ RE_compile_and_cache(text *text_re, int cflags, Oid collation)
 	 * out-of-memory.  The Max() is because some malloc implementations return
 	 * NULL for malloc(0).
 	 */
-	re_temp.cre_pat = malloc(Max(text_re_len, 1));
-	if (re_temp.cre_pat == NULL)
+	pat = malloc(Max(text_re_len, 1));
+	if (pat == NULL)
 	{
-		pg_regfree(&re_temp.cre_re);
+		pg_regfree(&re_temp);
 		ereport(ERROR,
 				(errcode(ERRCODE_OUT_OF_MEMORY),
 				 errmsg("out of memory")));
 	}
-	memcpy(re_temp.cre_pat, text_re_val, text_re_len);
-	re_temp.cre_pat_len = text_re_len;
-	re_temp.cre_flags = cflags;
-	re_temp.cre_collation = collation;
+	memcpy(pat, text_re_val, text_re_len);
 
 	/*
-	 * Okay, we have a valid new item in re_temp; insert it into the storage
-	 * array.  Discard last entry if needed.
+	 * Okay, we have a valid new item; enter it into the cache.  A different
+	 * pattern with the same hash key is possible, if unlikely: it's replaced.
 	 */
-	if (num_res >= MAX_CACHED_RES)
+	re = (cached_re_str *) hash_search(re_hash, &key, HASH_ENTER, &found);
+	if (found)
 	{
-		--num_res;
-		Assert(num_res < MAX_CACHED_RES);
-		pg_regfree(&re_array[num_res].cre_re);
-		free(re_array[num_res].cre_pat);
+		dlist_delete(&re->cre_node);
+		re_cache_used -= re->cre_size;
+		pg_regfree(&re->cre_re);
+		free(re->cre_pat);
 	}
+	re->cre_pat = pat;
+	re->cre_re = re_temp;
+	re->cre_size = sizeof(cached_re_str) + text_re_len +
+		pg_reg_getmemsize(&re_temp);
+	dlist_push_head(&re_list, &re->cre_node);
+	re_cache_used += re->cre_size;
 
-	if (num_res > 0)
-		memmove(&re_array[1], &re_array[0], num_res * sizeof(cached_re_str));
-
-	re_array[0] = re_temp;
-	num_res++;
+	/*
+	 * Discard least recently used entries as needed to stay within the
+	 * limit.  The new entry is always kept.
+	 */
+	while (re_cache_used > (Size) regex_cache_size * 1024 &&
+		   dlist_tail_node(&re_list) != &re->cre_node)
+	{
+		cached_re_str *old = dlist_container(cached_re_str, cre_node,
+											 dlist_tail_node(&re_list));
+
+		dlist_delete(&old->cre_node);
+		re_cache_used -= old->cre_size;
+		pg_regfree(&old->cre_re);
+		free(old->cre_pat);
+		hash_search(re_hash, &old->cre_key, HASH_REMOVE, NULL);
+	}
 
-	return &re_array[0].cre_re;
+	return &re->cre_re;
 }
 
 /*
@@ -46,6 +46,7 @@
 #include "miscadmin.h"
 #include "storage/bufmgr.h"
 #include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
@@ -57,6 +58,7 @@
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/tqual.h"
+#include "utils/typcache.h"
 
 
 /* ----------
@@ -77,16 +79,17 @@
 /* these queries are executed against the PK (referenced) table: */
 #define RI_PLAN_CHECK_LOOKUPPK			1
 #define RI_PLAN_CHECK_LOOKUPPK_FROM_PK	2
-#define RI_PLAN_LAST_ON_PK				RI_PLAN_CHECK_LOOKUPPK_FROM_PK
+#define RI_PLAN_CHECK_LOOKUPPK_BATCH	3
+#define RI_PLAN_LAST_ON_PK				RI_PLAN_CHECK_LOOKUPPK_BATCH
 /* these queries are executed against the FK (referencing) table: */
-#define RI_PLAN_CASCADE_DEL_DODELETE	3
-#define RI_PLAN_CASCADE_UPD_DOUPDATE	4
-#define RI_PLAN_RESTRICT_DEL_CHECKREF	5
-#define RI_PLAN_RESTRICT_UPD_CHECKREF	6
-#define RI_PLAN_SETNULL_DEL_DOUPDATE	7
-#define RI_PLAN_SETNULL_UPD_DOUPDATE	8
-#define RI_PLAN_SETDEFAULT_DEL_DOUPDATE 9
-#define RI_PLAN_SETDEFAULT_UPD_DOUPDATE 10
+#define RI_PLAN_CASCADE_DEL_DODELETE	4
+#define RI_PLAN_CASCADE_UPD_DOUPDATE	5
+#define RI_PLAN_RESTRICT_DEL_CHECKREF	6
+#define RI_PLAN_RESTRICT_UPD_CHECKREF	7
+#define RI_PLAN_SETNULL_DEL_DOUPDATE	8
+#define RI_PLAN_SETNULL_UPD_DOUPDATE	9
+#define RI_PLAN_SETDEFAULT_DEL_DOUPDATE 10
+#define RI_PLAN_SETDEFAULT_UPD_DOUPDATE 11
 
 #define MAX_QUOTED_NAME_LEN  (NAMEDATALEN*2+3)
 #define MAX_QUOTED_REL_NAME_LEN  (MAX_QUOTED_NAME_LEN*2)
@@ -181,6 +184,33 @@ typedef struct RI_CompareHashEntry
 } RI_CompareHashEntry;
 
 
+/* ----------
+ * RI_CheckBatch
+ *
+ *	FK rows of one constraint whose check has been put off, to be done with
+ *	a single query for all of them.  Rows with equal keys are only kept
+ *	once, the first one seen.
+ * ----------
+ */
+typedef struct RI_CheckBatch
+{
+	Oid			constraint_id;	/* OID of pg_constraint entry */
+	Relation	fk_rel;			/* referencing relation */
+	MemoryContext context;		/* holds the batch and the rows */
+	int			maxrows;		/* size of the arrays below */
+	int			nrows;
+	HeapTuple  *rows;			/* copies of the rows, in arrival order */
+	bool		hashable;		/* can we look for duplicates by hashing? */
+	FmgrInfo	hash_procs[RI_MAX_NUMKEYS];	/* hash functions of FK keys */
+	int			nbuckets;		/* a power of 2 */
+	int		   *buckets;		/* first row in each bucket, or -1 */
+	int		   *chain;			/* next row in the same bucket, or -1 */
+} RI_CheckBatch;
+
+
+/* GUC parameter */
+int			foreign_key_check_batch_size = 1024;
+
 /* ----------
  * Local data
  * ----------
@@ -190,6 +220,7 @@ static HTAB *ri_query_cache = NULL;
 static HTAB *ri_compare_cache = NULL;
 static dlist_head ri_constraint_cache_valid_list;
 static int	ri_constraint_cache_valid_count = 0;
+static List *ri_check_batches = NIL;
 
 
 /* ----------
@@ -199,6 +230,11 @@ static int	ri_constraint_cache_valid_count = 0;
 static bool ri_Check_Pk_Match(Relation pk_rel, Relation fk_rel,
 				  HeapTuple old_row,
 				  const RI_ConstraintInfo *riinfo);
+static bool ri_QueueCheck(const RI_ConstraintInfo *riinfo, Relation fk_rel,
+			  HeapTuple new_row);
+static uint32 ri_HashKey(RI_CheckBatch *batch,
+		   const RI_ConstraintInfo *riinfo, HeapTuple row);
+static void ri_PerformBatchCheck(RI_CheckBatch *batch);
 static Datum ri_restrict_del(TriggerData *trigdata, bool is_no_action);
 static Datum ri_restrict_upd(TriggerData *trigdata, bool is_no_action);
 static void quoteOneName(char *buffer, const char *name);
@@ -336,8 +372,10 @@ RI_FKey_check(TriggerData *trigdata)
 
 					/*
 					 * Not allowed - MATCH FULL says either all or none of the
-					 * attributes can be NULLs
+					 * attributes can be NULLs.  Rows put off to be checked
+					 * in a batch came first, so report them first.
 					 */
+					RI_FKey_check_flush();
 					ereport(ERROR,
 							(errcode(ERRCODE_FOREIGN_KEY_VIOLATION),
 							 errmsg("insert or update on table \"%s\" violates foreign key constraint \"%s\"",
@@ -387,6 +425,16 @@ RI_FKey_check(TriggerData *trigdata)
 			break;
 	}
 
+	/*
+	 * Preferably, put the row aside to be checked together with the others
+	 * of the statement.
+	 */
+	if (ri_QueueCheck(riinfo, fk_rel, new_row))
+	{
+		heap_close(pk_rel, RowShareLock);
+		return PointerGetDatum(NULL);
+	}
+
 	if (SPI_connect() != SPI_OK_CONNECT)
 		elog(ERROR, "SPI_connect failed");
 
@@ -498,6 +546,400 @@ RI_FKey_check_upd(PG_FUNCTION_ARGS)
 }
 
 
+/* ----------
+ * ri_QueueCheck -
+ *
+ *	Add a row that needs its foreign key checked to the batch of its
+ *	constraint, unless an earlier row of the batch has the same key.
+ *	The check is done when the trigger manager calls RI_FKey_check_flush(),
+ *	or when the batch is full.  Returns false if the key can't be checked
+ *	in a batch, and the caller should do it right away.
+ * ----------
+ */
+static bool
+ri_QueueCheck(const RI_ConstraintInfo *riinfo, Relation fk_rel,
+			  HeapTuple new_row)
+{
+	RI_CheckBatch *batch = NULL;
+	MemoryContext oldcxt;
+	uint32		hash;
+	int			bucket;
+	int			i;
+	ListCell   *lc;
+
+	if (foreign_key_check_batch_size <= 1)
+		return false;
+
+	foreach(lc, ri_check_batches)
+	{
+		RI_CheckBatch *b = (RI_CheckBatch *) lfirst(lc);
+
+		if (b->constraint_id == riinfo->constraint_id &&
+			b->fk_rel == fk_rel)
+		{
+			batch = b;
+			break;
+		}
+	}
+
+	if (batch == NULL)
+	{
+		MemoryContext batchcxt;
+
+		/* the batch query passes the keys in arrays */
+		for (i = 0; i < riinfo->nkeys; i++)
+		{
+			if (!OidIsValid(get_array_type(RIAttType(fk_rel,
+												riinfo->fk_attnums[i]))))
+				return false;
+		}
+
+		batchcxt = AllocSetContextCreate(TopTransactionContext,
+										 "RI check batch",
+										 ALLOCSET_DEFAULT_SIZES);
+		batch = (RI_CheckBatch *) MemoryContextAllocZero(batchcxt,
+													 sizeof(RI_CheckBatch));
+		batch->constraint_id = riinfo->constraint_id;
+		batch->fk_rel = fk_rel;
+		batch->context = batchcxt;
+		batch->maxrows = foreign_key_check_batch_size;
+		batch->rows = (HeapTuple *)
+			MemoryContextAlloc(batchcxt, batch->maxrows * sizeof(HeapTuple));
+
+		batch->hashable = true;
+		for (i = 0; i < riinfo->nkeys; i++)
+		{
+			TypeCacheEntry *typentry;
+
+			typentry = lookup_type_cache(RIAttType(fk_rel,
+												   riinfo->fk_attnums[i]),
+										 TYPECACHE_HASH_PROC_FINFO);
+			if (!OidIsValid(typentry->hash_proc_finfo.fn_oid))
+			{
+				batch->hashable = false;
+				break;
+			}
+			fmgr_info_copy(&batch->hash_procs[i], &typentry->hash_proc_finfo,
+						   batchcxt);
+		}
+		if (batch->hashable)
+		{
+			batch->nbuckets = 1;
+			while (batch->nbuckets < batch->maxrows)
+				batch->nbuckets <<= 1;
+			batch->buckets = (int *)
+				MemoryContextAlloc(batchcxt, batch->nbuckets * sizeof(int));
+			memset(batch->buckets, -1, batch->nbuckets * sizeof(int));
+			batch->chain = (int *)
+				MemoryContextAlloc(batchcxt, batch->maxrows * sizeof(int));
+		}
+
+		oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+		ri_check_batches = lappend(ri_check_batches, batch);
+		MemoryContextSwitchTo(oldcxt);
+	}
+
+	/*
+	 * Skip the row if an earlier one has the same key.  Without hash
+	 * functions, we only look at the latest row, which still catches runs
+	 * of equal keys, as in a bulk load of sorted data.
+	 */
+	if (batch->hashable)
+	{
+		hash = ri_HashKey(batch, riinfo, new_row);
+		bucket = hash & (batch->nbuckets - 1);
+		for (i = batch->buckets[bucket]; i >= 0; i = batch->chain[i])
+		{
+			if (ri_KeysEqual(fk_rel, batch->rows[i], new_row, riinfo, false))
+				return true;
+		}
+	}
+	else
+	{
+		bucket = 0;				/* keep compiler quiet */
+		if (batch->nrows > 0 &&
+			ri_KeysEqual(fk_rel, batch->rows[batch->nrows - 1], new_row,
+						 riinfo, false))
+			return true;
+	}
+
+	oldcxt = MemoryContextSwitchTo(batch->context);
+	batch->rows[batch->nrows] = heap_copytuple(new_row);
+	MemoryContextSwitchTo(oldcxt);
+	if (batch->hashable)
+	{
+		batch->chain[batch->nrows] = batch->buckets[bucket];
+		batch->buckets[bucket] = batch->nrows;
+	}
+	batch->nrows++;
+
+	if (batch->nrows >= batch->maxrows)
+	{
+		ri_check_batches = list_delete_ptr(ri_check_batches, batch);
+		ri_PerformBatchCheck(batch);
+	}
+
+	return true;
+}
+
+/*
+ * Compute a hash value of the FK key of a row, for ri_QueueCheck.
+ */
+static uint32
+ri_HashKey(RI_CheckBatch *batch, const RI_ConstraintInfo *riinfo,
+		   HeapTuple row)
+{
+	Relation	fk_rel = batch->fk_rel;
+	uint32		hash = 0;
+	int			i;
+
+	for (i = 0; i < riinfo->nkeys; i++)
+	{
+		Datum		value;
+		bool		isnull;
+
+		value = heap_getattr(row, riinfo->fk_attnums[i],
+							 RelationGetDescr(fk_rel), &isnull);
+		Assert(!isnull);
+		hash = (hash << 1) | (hash >> 31);
+		hash ^= DatumGetUInt32(FunctionCall1Coll(&batch->hash_procs[i],
+								RIAttCollation(fk_rel, riinfo->fk_attnums[i]),
+												 value));
+	}
+
+	return hash;
+}
+
+/* ----------
+ * ri_PerformBatchCheck -
+ *
+ *	Check that the keys of all the rows of a batch exist in the PK table,
+ *	and free the batch.  If some don't, the error names the first of the
+ *	rows, like checking them one at a time would.
+ * ----------
+ */
+static void
+ri_PerformBatchCheck(RI_CheckBatch *batch)
+{
+	const RI_ConstraintInfo *riinfo;
+	Relation	fk_rel = batch->fk_rel;
+	Relation	pk_rel;
+	RI_QueryKey qkey;
+	SPIPlanPtr	qplan;
+	Datum		vals[RI_MAX_NUMKEYS + 1];
+	Datum	   *elems;
+	bool	   *found;
+	int			spi_result;
+	Oid			save_userid;
+	int			save_sec_context;
+	uint64		r;
+	int			i;
+	int			j;
+
+	riinfo = ri_LoadConstraintInfo(batch->constraint_id);
+
+	pk_rel = heap_open(riinfo->pk_relid, RowShareLock);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	/*
+	 * Fetch or prepare a saved plan for the check
+	 */
+	ri_BuildQueryKey(&qkey, riinfo, RI_PLAN_CHECK_LOOKUPPK_BATCH);
+
+	if ((qplan = ri_FetchPreparedPlan(&qkey)) == NULL)
+	{
+		StringInfoData querybuf;
+		char		pkrelname[MAX_QUOTED_REL_NAME_LEN];
+		char		attname[MAX_QUOTED_NAME_LEN];
+		char		leftop[MAX_QUOTED_NAME_LEN + 3];
+		char		rightop[32];
+		const char *querysep;
+		Oid			queryoids[RI_MAX_NUMKEYS + 1];
+
+		/* ----------
+		 * The query string built is
+		 *	SELECT k.i FROM ONLY <pktable> x,
+		 *		   ROWS FROM(pg_catalog.unnest($1) [, ...],
+		 *					 pg_catalog.unnest($n)) k(k1 [, ...], i)
+		 *		   WHERE x.pkatt1 = k.k1 [AND ...] FOR KEY SHARE OF x
+		 * The parameters but the last are arrays of the FK attributes'
+		 * types, holding the keys; the last one holds the positions of
+		 * the rows in the batch, which the query returns for the keys
+		 * found.  The multi-argument form of unnest() can't be used, since
+		 * it is only recognized when not schema-qualified.
+		 * ----------
+		 */
+		initStringInfo(&querybuf);
+		quoteRelationName(pkrelname, pk_rel);
+		appendStringInfo(&querybuf,
+						 "SELECT k.i FROM ONLY %s x, ROWS FROM(",
+						 pkrelname);
+		for (i = 0; i <= riinfo->nkeys; i++)
+			appendStringInfo(&querybuf, "%spg_catalog.unnest($%d)",
+							 i > 0 ? ", " : "", i + 1);
+		appendStringInfoString(&querybuf, ") k(");
+		for (i = 0; i < riinfo->nkeys; i++)
+			appendStringInfo(&querybuf, "k%d, ", i + 1);
+		appendStringInfoString(&querybuf, "i)");
+		querysep = "WHERE";
+		for (i = 0; i < riinfo->nkeys; i++)
+		{
+			Oid			pk_type = RIAttType(pk_rel, riinfo->pk_attnums[i]);
+			Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[i]);
+
+			quoteOneName(attname,
+						 RIAttName(pk_rel, riinfo->pk_attnums[i]));
+			sprintf(leftop, "x.%s", attname);
+			sprintf(rightop, "k.k%d", i + 1);
+			ri_GenerateQual(&querybuf, querysep,
+							leftop, pk_type,
+							riinfo->pf_eq_oprs[i],
+							rightop, fk_type);
+			querysep = "AND";
+			queryoids[i] = get_array_type(fk_type);
+		}
+		queryoids[riinfo->nkeys] = INT4ARRAYOID;
+		appendStringInfoString(&querybuf, " FOR KEY SHARE OF x");
+
+		/* Prepare and save the plan */
+		qplan = ri_PlanCheck(querybuf.data, riinfo->nkeys + 1, queryoids,
+							 &qkey, fk_rel, pk_rel, true);
+	}
+
+	/*
+	 * Build the arrays of keys.  They mustn't hold toast pointers, so
+	 * detoast the values first.
+	 */
+	elems = (Datum *) palloc(batch->nrows * sizeof(Datum));
+	for (i = 0; i < riinfo->nkeys; i++)
+	{
+		Oid			fk_type = RIAttType(fk_rel, riinfo->fk_attnums[i]);
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+
+		get_typlenbyvalalign(fk_type, &typlen, &typbyval, &typalign);
+		for (j = 0; j < batch->nrows; j++)
+		{
+			bool		isnull;
+
+			elems[j] = heap_getattr(batch->rows[j], riinfo->fk_attnums[i],
+									RelationGetDescr(fk_rel), &isnull);
+			if (typlen == -1)
+				elems[j] = PointerGetDatum(PG_DETOAST_DATUM(elems[j]));
+		}
+		vals[i] = PointerGetDatum(construct_array(elems, batch->nrows,
+												  fk_type, typlen, typbyval,
+												  typalign));
+	}
+	for (j = 0; j < batch->nrows; j++)
+		elems[j] = Int32GetDatum(j);
+	vals[riinfo->nkeys] = PointerGetDatum(construct_array(elems, batch->nrows,
+														  INT4OID, 4, true,
+														  'i'));
+
+	/* Switch to proper UID to perform check as */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(RelationGetForm(pk_rel)->relowner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE |
+						   SECURITY_NOFORCE_RLS);
+
+	/* Like ri_PerformCheck(), the default SPI snapshot is fine here */
+	spi_result = SPI_execute_snapshot(qplan, vals, NULL,
+									  InvalidSnapshot, InvalidSnapshot,
+									  false, false, 0);
+
+	/* Restore UID and security context */
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	if (spi_result < 0)
+		elog(ERROR, "SPI_execute_snapshot returned %d", spi_result);
+
+	if (spi_result != SPI_OK_SELECT)
+		ri_ReportViolation(riinfo,
+						   pk_rel, fk_rel,
+						   batch->rows[0], NULL,
+						   RI_PLAN_CHECK_LOOKUPPK, true);
+
+	found = (bool *) palloc0(batch->nrows * sizeof(bool));
+	for (r = 0; r < SPI_processed; r++)
+	{
+		bool		isnull;
+		int32		pos;
+
+		pos = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[r],
+										  SPI_tuptable->tupdesc, 1,
+										  &isnull));
+		Assert(!isnull && pos >= 0 && pos < batch->nrows);
+		found[pos] = true;
+	}
+
+	for (j = 0; j < batch->nrows; j++)
+	{
+		if (!found[j])
+			ri_ReportViolation(riinfo,
+							   pk_rel, fk_rel,
+							   batch->rows[j], NULL,
+							   RI_PLAN_CHECK_LOOKUPPK, false);
+	}
+
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+
+	heap_close(pk_rel, RowShareLock);
+
+	MemoryContextDelete(batch->context);
+}
+
+/* ----------
+ * RI_FKey_check_flush -
+ *
+ *	Do the foreign key checks put off by RI_FKey_check.  The trigger manager
+ *	calls this after firing a set of AFTER trigger events, and before firing
+ *	any trigger that isn't an RI check, since such a trigger could rely on
+ *	the checks having been done, or change the rows they look at.
+ * ----------
+ */
+void
+RI_FKey_check_flush(void)
+{
+	List	   *batches = ri_check_batches;
+	ListCell   *lc;
+
+	/*
+	 * Detach the list first, so that nothing done by the check queries can
+	 * see the batches again.
+	 */
+	ri_check_batches = NIL;
+
+	foreach(lc, batches)
+		ri_PerformBatchCheck((RI_CheckBatch *) lfirst(lc));
+
+	list_free(batches);
+}
+
+/* ----------
+ * RI_FKey_check_discard -
+ *
+ *	Forget the foreign key checks put off by RI_FKey_check, at transaction
+ *	or subtransaction abort.
+ * ----------
+ */
+void
+RI_FKey_check_discard(void)
+{
+	ListCell   *lc;
+
+	foreach(lc, ri_check_batches)
+		MemoryContextDelete(((RI_CheckBatch *) lfirst(lc))->context);
+
+	list_free(ri_check_batches);
+	ri_check_batches = NIL;
+}
+
+
 /* ----------
  * ri_Check_Pk_Match
  *
@@ -34,8 +34,21 @@ static const float weights[] = {0.1f, 0.2f, 0.4f, 1.0f};
 #define RANK_NORM_RDIVRPLUS1	0x20
 #define DEF_NORM_METHOD			RANK_NO_NORM
 
-static float calc_rank_or(const float *w, TSVector t, TSQuery q);
-static float calc_rank_and(const float *w, TSVector t, TSQuery q);
+/*
+ * A query prepared for ts_rank(): its operands, sorted and de-duplicated.
+ * They depend only on the query, which is nearly always the same for all the
+ * documents ranked by a scan, so the prepared query is kept in fn_extra and
+ * only rebuilt when the query changes.
+ */
+typedef struct
+{
+	TSQuery		query;			/* copy of the query */
+	QueryOperand **items;		/* sorted operands, pointing into query */
+	int			nitems;
+} RankQuery;
+
+static float calc_rank_or(const float *w, TSVector t, RankQuery *rq);
+static float calc_rank_and(const float *w, TSVector t, RankQuery *rq);
 
 /*
  * Returns a weight of a word collocation
@@ -196,8 +209,45 @@ SortAndUniqItems(TSQuery q, int *size)
 	return res;
 }
 
+/*
+ * Get the prepared form of the query, from fn_extra if the query is the same
+ * as in the previous call.
+ */
+static RankQuery *
+getRankQuery(FunctionCallInfo fcinfo, TSQuery query)
+{
+	RankQuery  *rq = (RankQuery *) fcinfo->flinfo->fn_extra;
+	MemoryContext oldcontext;
+
+	if (rq != NULL &&
+		VARSIZE(rq->query) == VARSIZE(query) &&
+		memcmp(rq->query, query, VARSIZE(query)) == 0)
+		return rq;
+
+	if (rq == NULL)
+	{
+		rq = (RankQuery *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+											  sizeof(RankQuery));
+		fcinfo->flinfo->fn_extra = (void *) rq;
+	}
+	else
+	{
+		pfree(rq->items);
+		pfree(rq->query);
+	}
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	rq->query = (TSQuery) palloc(VARSIZE(query));
+	memcpy(rq->query, query, VARSIZE(query));
+	rq->nitems = query->size;
+	rq->items = SortAndUniqItems(rq->query, &rq->nitems);
+	MemoryContextSwitchTo(oldcontext);
+
+	return rq;
+}
+
 static float
-calc_rank_and(const float *w, TSVector t, TSQuery q)
+calc_rank_and(const float *w, TSVector t, RankQuery *rq)
 {
 	WordEntryPosVector **pos;
 	WordEntryPosVector1 posnull;
@@ -215,16 +265,13 @@ calc_rank_and(const float *w, TSVector t, TSQuery q)
 				dist,
 				nitem;
 	float		res = -1.0;
-	QueryOperand **item;
-	int			size = q->size;
+	TSQuery		q = rq->query;
+	QueryOperand **item = rq->items;
+	int			size = rq->nitems;
 
-	item = SortAndUniqItems(q, &size);
 	if (size < 2)
-	{
-		pfree(item);
-		return calc_rank_or(w, t, q);
-	}
-	pos = (WordEntryPosVector **) palloc0(sizeof(WordEntryPosVector *) * q->size);
+		return calc_rank_or(w, t, rq);
+	pos = (WordEntryPosVector **) palloc0(sizeof(WordEntryPosVector *) * size);
 
 	/* A dummy WordEntryPos array to use when haspos is false */
 	posnull.npos = 1;
@@ -275,12 +322,11 @@ calc_rank_and(const float *w, TSVector t, TSQuery q)
 		}
 	}
 	pfree(pos);
-	pfree(item);
 	return res;
 }
 
 static float
-calc_rank_or(const float *w, TSVector t, TSQuery q)
+calc_rank_or(const float *w, TSVector t, RankQuery *rq)
 {
 	WordEntry  *entry,
 			   *firstentry;
@@ -291,15 +337,14 @@ calc_rank_or(const float *w, TSVector t, TSQuery q)
 				i,
 				nitem;
 	float		res = 0.0;
-	QueryOperand **item;
-	int			size = q->size;
+	TSQuery		q = rq->query;
+	QueryOperand **item = rq->items;
+	int			size = rq->nitems;
 
 	/* A dummy WordEntryPos array to use when haspos is false */
 	posnull.npos = 1;
 	posnull.pos[0] = 0;
 
-	item = SortAndUniqItems(q, &size);
-
 	for (i = 0; i < size; i++)
 	{
 		float		resj,
@@ -349,25 +394,28 @@ calc_rank_or(const float *w, TSVector t, TSQuery q)
 	}
 	if (size > 0)
 		res = res / size;
-	pfree(item);
 	return res;
 }
 
 static float
-calc_rank(const float *w, TSVector t, TSQuery q, int32 method)
+calc_rank(FunctionCallInfo fcinfo, const float *w, TSVector t, TSQuery q,
+		  int32 method)
 {
 	QueryItem  *item = GETQUERY(q);
+	RankQuery  *rq;
 	float		res = 0.0;
 	int			len;
 
 	if (!t->size || !q->size)
 		return 0.0;
 
+	rq = getRankQuery(fcinfo, q);
+
 	/* XXX: What about NOT? */
 	res = (item->type == QI_OPR && (item->qoperator.oper == OP_AND ||
 									item->qoperator.oper == OP_PHRASE)) ?
-		calc_rank_and(w, t, q) :
-		calc_rank_or(w, t, q);
+		calc_rank_and(w, t, rq) :
+		calc_rank_or(w, t, rq);
 
 	if (res < 0)
 		res = 1e-20f;
@@ -443,7 +491,7 @@ ts_rank_wttf(PG_FUNCTION_ARGS)
 	int			method = PG_GETARG_INT32(3);
 	float		res;
 
-	res = calc_rank(getWeights(win), txt, query, method);
+	res = calc_rank(fcinfo, getWeights(win), txt, query, method);
 
 	PG_FREE_IF_COPY(win, 0);
 	PG_FREE_IF_COPY(txt, 1);
@@ -459,7 +507,7 @@ ts_rank_wtt(PG_FUNCTION_ARGS)
 	TSQuery		query = PG_GETARG_TSQUERY(2);
 	float		res;
 
-	res = calc_rank(getWeights(win), txt, query, DEF_NORM_METHOD);
+	res = calc_rank(fcinfo, getWeights(win), txt, query, DEF_NORM_METHOD);
 
 	PG_FREE_IF_COPY(win, 0);
 	PG_FREE_IF_COPY(txt, 1);
@@ -475,7 +523,7 @@ ts_rank_ttf(PG_FUNCTION_ARGS)
 	int			method = PG_GETARG_INT32(2);
 	float		res;
 
-	res = calc_rank(getWeights(NULL), txt, query, method);
+	res = calc_rank(fcinfo, getWeights(NULL), txt, query, method);
 
 	PG_FREE_IF_COPY(txt, 0);
 	PG_FREE_IF_COPY(query, 1);
@@ -489,7 +537,7 @@ ts_rank_tt(PG_FUNCTION_ARGS)
 	TSQuery		query = PG_GETARG_TSQUERY(1);
 	float		res;
 
-	res = calc_rank(getWeights(NULL), txt, query, DEF_NORM_METHOD);
+	res = calc_rank(fcinfo, getWeights(NULL), txt, query, DEF_NORM_METHOD);
 
 	PG_FREE_IF_COPY(txt, 0);
 	PG_FREE_IF_COPY(query, 1);
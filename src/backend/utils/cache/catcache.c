@@ -14,6 +14,9 @@
  */
 #include "postgres.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "access/genam.h"
 #include "access/hash.h"
 #include "access/heapam.h"
@@ -22,13 +25,15 @@
 #include "access/tuptoaster.h"
 #include "access/valid.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
 #include "miscadmin.h"
-#ifdef CATCACHE_STATS
-#include "storage/ipc.h"		/* for on_proc_exit */
-#endif
+#include "postmaster/autovacuum.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
 #include "storage/lmgr.h"
+#include "storage/sinval.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
@@ -69,9 +74,33 @@
 #define CACHE6_elog(a,b,c,d,e,f,g)
 #endif
 
+#define CATCACHE_INIT_FILEMAGIC		0x436331	/* version ID value */
+
 /* Cache management header --- pointer is NULL until created */
 static CatCacheHeader *CacheHdr = NULL;
 
+/* GUC: max size of the catcache init file in kB, 0 disables it */
+int			catcache_init_file_size = 0;
+
+/*
+ * Count of catcache invalidation events received by this backend; used to
+ * detect that the init file became stale while it was being loaded.
+ */
+static long catcacheInvalsReceived = 0L;
+
+/* Number of entries loaded from the init file, and whether it is stale */
+static int	catcacheInitFileLoaded = 0;
+static bool catcacheInitFileStale = false;
+
+/* Header of a tuple in the catcache init file, followed by t_len bytes */
+typedef struct CatCacheInitFileEntry
+{
+	int			cache_id;
+	uint32		t_len;
+	ItemPointerData t_self;
+	Oid			t_tableOid;
+} CatCacheInitFileEntry;
+
 
 static uint32 CatalogCacheComputeHashValue(CatCache *cache, int nkeys,
 							 ScanKey cur_skey);
@@ -88,6 +117,7 @@ static CatCTup *CatalogCacheCreateEntry(CatCache *cache, HeapTuple ntp,
 						uint32 hashValue, Index hashIndex,
 						bool negative);
 static HeapTuple build_dummy_tuple(CatCache *cache, int nkeys, ScanKey skeys);
+static void CatalogCacheWriteInitFile(int code, Datum arg);
 
 
 /*
@@ -452,6 +482,8 @@ CatCacheInvalidate(CatCache *cache, uint32 hashValue)
 
 	CACHE1_elog(DEBUG2, "CatCacheInvalidate: called");
 
+	catcacheInvalsReceived++;
+
 	/*
 	 * We don't bother to check whether the cache has finished initialization
 	 * yet; if not, there will be no entries in it so no problem.
@@ -588,6 +620,8 @@ ResetCatalogCaches(void)
 
 	CACHE1_elog(DEBUG2, "ResetCatalogCaches called");
 
+	catcacheInvalsReceived++;
+
 	slist_foreach(iter, &CacheHdr->ch_caches)
 	{
 		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
@@ -618,6 +652,8 @@ CatalogCacheFlushCatalog(Oid catId)
 
 	CACHE2_elog(DEBUG2, "CatalogCacheFlushCatalog called for %u", catId);
 
+	catcacheInvalsReceived++;
+
 	slist_foreach(iter, &CacheHdr->ch_caches)
 	{
 		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
@@ -1842,6 +1878,343 @@ PrepareToInvalidateCacheTuple(Relation relation,
 }
 
 
+/*
+ * The catcache init file
+ *
+ * Catalog lookups made by the first queries of a new backend can take a
+ * long time if the database has many relations, since every catcache starts
+ * out empty.  So when catcache_init_file_size is set, an exiting backend
+ * saves the positive entries of its catcaches to a per-database file, and
+ * new backends connecting to the database preload their catcaches from it.
+ * Entries of caches on shared catalogs are not saved, as the file is only
+ * invalidated by changes of the database's own catalogs.
+ *
+ * The file is maintained like the local relcache init file (see relcache.c):
+ * a transaction changing catalog contents removes it before sending the SI
+ * messages (inval.c asks for that), and a backend writing it renames it into
+ * place only if no relevant SI messages were sent meanwhile.  Thus, like
+ * with the relcache init file, the contents of an existing file reflect all
+ * SI messages sent before it is opened.
+ */
+
+/*
+ * CatalogCacheLoadInitFile
+ *
+ * Load the catcache init file of the current database, if any, and arrange
+ * for the file to be written at backend exit.  Must be called inside a
+ * transaction, after the backend has started receiving SI messages.
+ */
+void
+CatalogCacheLoadInitFile(void)
+{
+	char		initfilename[MAXPGPATH];
+	FILE	   *fp;
+	MemoryContext loadcxt;
+	MemoryContext oldcxt;
+	CatCache  **caches;
+	int			ncaches = 0;
+	List	   *tuples = NIL;
+	List	   *tuplecaches = NIL;
+	ListCell   *lc1;
+	ListCell   *lc2;
+	long		invals;
+	int			magic;
+	slist_iter	iter;
+
+	if (catcache_init_file_size <= 0 || !IsUnderPostmaster ||
+		!OidIsValid(MyDatabaseId) || IsAutoVacuumWorkerProcess() ||
+		RecoveryInProgress())
+		return;
+
+	/* Whatever happens below, we may save our catcaches on exit */
+	before_shmem_exit(CatalogCacheWriteInitFile, 0);
+
+	/*
+	 * Entries we read are up to date with respect to the SI messages sent
+	 * before we open the file; any later message must be processed after the
+	 * entries are in the cache.  Initializing the caches might process SI
+	 * messages, so if any of them concerns catcaches, just give up.
+	 */
+	invals = catcacheInvalsReceived;
+
+	snprintf(initfilename, sizeof(initfilename), "%s/%s",
+			 DatabasePath, CATCACHE_INIT_FILENAME);
+
+	fp = AllocateFile(initfilename, PG_BINARY_R);
+	if (fp == NULL)
+		return;
+
+	loadcxt = AllocSetContextCreate(CurrentMemoryContext,
+									"catcache init file",
+									ALLOCSET_DEFAULT_SIZES);
+	oldcxt = MemoryContextSwitchTo(loadcxt);
+
+	/* Map cache IDs to caches */
+	slist_foreach(iter, &CacheHdr->ch_caches)
+	{
+		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
+
+		ncaches = Max(ncaches, cache->id + 1);
+	}
+	caches = (CatCache **) palloc0(ncaches * sizeof(CatCache *));
+	slist_foreach(iter, &CacheHdr->ch_caches)
+	{
+		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
+
+		caches[cache->id] = cache;
+	}
+
+	if (fread(&magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+		magic != CATCACHE_INIT_FILEMAGIC)
+		goto read_failed;
+
+	for (;;)
+	{
+		CatCacheInitFileEntry entry;
+		HeapTuple	tuple;
+		size_t		nread;
+
+		nread = fread(&entry, 1, sizeof(entry), fp);
+		if (nread != sizeof(entry))
+		{
+			if (nread == 0)
+				break;			/* end of file */
+			goto read_failed;
+		}
+
+		if (entry.cache_id < 0 || entry.cache_id >= ncaches ||
+			caches[entry.cache_id] == NULL ||
+			caches[entry.cache_id]->cc_relisshared ||
+			entry.t_len < SizeofHeapTupleHeader ||
+			entry.t_len > MaxHeapTupleSize)
+			goto read_failed;
+
+		tuple = (HeapTuple) palloc(HEAPTUPLESIZE + entry.t_len);
+		tuple->t_len = entry.t_len;
+		tuple->t_self = entry.t_self;
+		tuple->t_tableOid = entry.t_tableOid;
+		tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+		if (fread(tuple->t_data, 1, entry.t_len, fp) != entry.t_len)
+			goto read_failed;
+
+		tuples = lappend(tuples, tuple);
+		tuplecaches = lappend(tuplecaches, caches[entry.cache_id]);
+	}
+
+	FreeFile(fp);
+	fp = NULL;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	foreach(lc1, tuplecaches)
+	{
+		CatCache   *cache = (CatCache *) lfirst(lc1);
+
+		if (cache->cc_tupdesc == NULL)
+			CatalogCacheInitializeCache(cache);
+	}
+
+	if (catcacheInvalsReceived != invals)
+	{
+		MemoryContextDelete(loadcxt);
+		return;
+	}
+
+	/*
+	 * Now enter the tuples.  Nothing below can process SI messages: the
+	 * tuples were flattened when they were first cached.
+	 */
+	forboth(lc1, tuples, lc2, tuplecaches)
+	{
+		HeapTuple	tuple = (HeapTuple) lfirst(lc1);
+		CatCache   *cache = (CatCache *) lfirst(lc2);
+		uint32		hashValue;
+		Index		hashIndex;
+		dlist_iter	biter;
+		bool		found = false;
+
+		hashValue = CatalogCacheComputeTupleHashValue(cache, tuple);
+		hashIndex = HASH_INDEX(hashValue, cache->cc_nbuckets);
+
+		/* Skip tuples we have cached already */
+		dlist_foreach(biter, &cache->cc_bucket[hashIndex])
+		{
+			CatCTup    *ct = dlist_container(CatCTup, cache_elem, biter.cur);
+
+			if (ct->hash_value == hashValue)
+			{
+				found = true;
+				break;
+			}
+		}
+		if (found)
+			continue;
+
+		CatalogCacheCreateEntry(cache, tuple, hashValue, hashIndex, false);
+		catcacheInitFileLoaded++;
+	}
+
+	MemoryContextDelete(loadcxt);
+	return;
+
+read_failed:
+	/* The file is corrupt or truncated; ignore it, exit will rewrite it */
+	FreeFile(fp);
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(loadcxt);
+}
+
+/*
+ * SI message callbacks of CatalogCacheWriteInitFile: they don't process the
+ * messages, only check if the file being written may be stale.
+ */
+static void
+CatalogCacheInitFileInval(SharedInvalidationMessage *msg)
+{
+	if (msg->id >= 0)
+	{
+		if (msg->cc.dbId == MyDatabaseId)
+			catcacheInitFileStale = true;
+	}
+	else if (msg->id == SHAREDINVALCATALOG_ID)
+	{
+		if (msg->cat.dbId == MyDatabaseId)
+			catcacheInitFileStale = true;
+	}
+}
+
+static void
+CatalogCacheInitFileReset(void)
+{
+	catcacheInitFileStale = true;
+}
+
+/*
+ * CatalogCacheWriteInitFile
+ *
+ * before_shmem_exit callback saving the catcaches to the init file, if they
+ * hold noticeably more than was loaded from it or there is no file.
+ */
+static void
+CatalogCacheWriteInitFile(int code, Datum arg)
+{
+	char		tempfilename[MAXPGPATH];
+	char		finalfilename[MAXPGPATH];
+	struct stat st;
+	FILE	   *fp;
+	Size		maxsize = (Size) catcache_init_file_size * 1024;
+	Size		size;
+	int			ntup = 0;
+	int			magic;
+	slist_iter	iter;
+
+	/*
+	 * Our caches are only consistent with the SI messages we have processed
+	 * if we exit normally, outside of a transaction.
+	 */
+	if (code != 0 || IsTransactionOrTransactionBlock())
+		return;
+
+	snprintf(tempfilename, sizeof(tempfilename), "%s/%s.%d",
+			 DatabasePath, CATCACHE_INIT_FILENAME, MyProcPid);
+	snprintf(finalfilename, sizeof(finalfilename), "%s/%s",
+			 DatabasePath, CATCACHE_INIT_FILENAME);
+
+	slist_foreach(iter, &CacheHdr->ch_caches)
+	{
+		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
+
+		if (cache->cc_tupdesc != NULL && !cache->cc_relisshared)
+			ntup += cache->cc_ntup;
+	}
+	if (ntup <= catcacheInitFileLoaded + catcacheInitFileLoaded / 10 &&
+		stat(finalfilename, &st) == 0)
+		return;
+
+	unlink(tempfilename);		/* in case it exists w/wrong permissions */
+
+	fp = AllocateFile(tempfilename, PG_BINARY_W);
+	if (fp == NULL)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not create catalog cache initialization file \"%s\": %m",
+						tempfilename)));
+		return;
+	}
+
+	magic = CATCACHE_INIT_FILEMAGIC;
+	if (fwrite(&magic, 1, sizeof(magic), fp) != sizeof(magic))
+		goto write_failed;
+	size = sizeof(magic);
+
+	slist_foreach(iter, &CacheHdr->ch_caches)
+	{
+		CatCache   *cache = slist_container(CatCache, cc_next, iter.cur);
+		int			i;
+
+		if (cache->cc_tupdesc == NULL || cache->cc_relisshared)
+			continue;
+
+		for (i = 0; i < cache->cc_nbuckets && size < maxsize; i++)
+		{
+			dlist_iter	biter;
+
+			dlist_foreach(biter, &cache->cc_bucket[i])
+			{
+				CatCTup    *ct = dlist_container(CatCTup, cache_elem, biter.cur);
+				CatCacheInitFileEntry entry;
+
+				if (ct->dead || ct->negative)
+					continue;
+
+				entry.cache_id = cache->id;
+				entry.t_len = ct->tuple.t_len;
+				entry.t_self = ct->tuple.t_self;
+				entry.t_tableOid = ct->tuple.t_tableOid;
+				if (fwrite(&entry, 1, sizeof(entry), fp) != sizeof(entry) ||
+					fwrite(ct->tuple.t_data, 1, entry.t_len, fp) != entry.t_len)
+					goto write_failed;
+				size += sizeof(entry) + entry.t_len;
+			}
+		}
+	}
+
+	if (FreeFile(fp))
+	{
+		fp = NULL;
+		goto write_failed;
+	}
+
+	/*
+	 * Check whether any catalog change was committed since the last SI
+	 * messages we processed.  The SI messages are consumed without being
+	 * processed, which is fine as we are exiting.  See also
+	 * write_relcache_init_file.
+	 */
+	LWLockAcquire(RelCacheInitLock, LW_EXCLUSIVE);
+
+	catcacheInitFileStale = false;
+	ReceiveSharedInvalidMessages(CatalogCacheInitFileInval,
+								 CatalogCacheInitFileReset);
+
+	if (catcacheInitFileStale || rename(tempfilename, finalfilename) < 0)
+		unlink(tempfilename);
+
+	LWLockRelease(RelCacheInitLock);
+	return;
+
+write_failed:
+	ereport(LOG,
+			(errcode_for_file_access(),
+			 errmsg("could not write catalog cache initialization file \"%s\": %m",
+					tempfilename)));
+	if (fp)
+		FreeFile(fp);
+	unlink(tempfilename);
+}
+
+
 /*
  * Subroutines for warning about reference leaks.  These are exported so
  * that resowner.c can call them.
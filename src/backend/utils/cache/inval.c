@@ -481,6 +481,10 @@ RegisterCatcacheInvalidation(int cacheId,
 {
 	AddCatcacheInvalidationMessage(&transInvalInfo->CurrentCmdInvalidMsgs,
 								   cacheId, hashValue, dbId);
+
+	/* The catcache init file is removed along with the relcache one */
+	if (catcache_init_file_size > 0 && OidIsValid(dbId))
+		transInvalInfo->RelcacheInitFileInval = true;
 }
 
 /*
@@ -493,6 +497,10 @@ RegisterCatalogInvalidation(Oid dbId, Oid catId)
 {
 	AddCatalogInvalidationMessage(&transInvalInfo->CurrentCmdInvalidMsgs,
 								  dbId, catId);
+
+	/* As above */
+	if (catcache_init_file_size > 0 && OidIsValid(dbId))
+		transInvalInfo->RelcacheInitFileInval = true;
 }
 
 /*
@@ -0,0 +1,830 @@
+/*-------------------------------------------------------------------------
+ *
+ * partmap.c
+ *	  Partition maps of inheritance trees, for partition pruning.
+ *
+ * A partition map describes which values of a partition key column each
+ * table of an inheritance tree can hold, as found in the tables' validated
+ * CHECK constraints: ranges like "key >= 10 AND key < 20", and lists like
+ * "key IN (1, 2, 3)".  The ranges are kept sorted, so that the children that
+ * can hold rows matching a restriction of the key can be found by binary
+ * search, instead of trying to refute each child's constraints separately.
+ *
+ * The key column is the one that most children's constraints restrict.
+ * Children whose constraints don't restrict it are not mapped, and can't be
+ * pruned by the map.  Maps are cached per parent, and rebuilt when the
+ * parent or any of the children is invalidated, or the tree has gained a
+ * child.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/cache/partmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/nbtree.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_constraint.h"
+#include "catalog/pg_inherits_fn.h"
+#include "commands/defrem.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/catcache.h"
+#include "utils/datum.h"
+#include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/partmap.h"
+#include "utils/rel.h"
+
+/* Hash table of the partition maps, by parent OID */
+static HTAB *PartitionMapHash = NULL;
+
+typedef struct
+{
+	Oid			parentrelid;	/* lookup key - must be first */
+	PartitionMap *map;
+} PartitionMapHashEntry;
+
+/*
+ * A restriction "column op value" found in a CHECK constraint.  For
+ * "column IN (...)", there are several values, and op is the equality
+ * operator.
+ */
+typedef struct CheckBound
+{
+	char	   *attname;
+	Oid			opno;
+	Oid			inputcollid;
+	bool		is_list;
+	int			nvalues;
+	Datum	   *values;
+} CheckBound;
+
+/* A range of key values, with the bounds found so far */
+typedef struct KeyRange
+{
+	bool		has_lower;
+	bool		has_upper;
+	bool		lower_incl;
+	bool		upper_incl;
+	Datum		lower;
+	Datum		upper;
+} KeyRange;
+
+static void PartitionMapInvalidateCallback(Datum arg, Oid relid);
+static PartitionMap *build_partition_map(Oid parentrelid, List *childoids);
+static List *get_check_bounds(Relation conrel, Oid childrelid);
+static void add_check_bounds(List **bounds, Node *clause, Oid childrelid);
+static bool set_partition_key(PartitionMap *map, List **childbounds);
+static void add_child_entries(PartitionMap *map, int child, List *bounds);
+static void add_entry(PartitionMap *map, int child, KeyRange *range);
+static void range_restrict(PartitionMap *map, KeyRange *range,
+			   StrategyNumber strategy, Datum value);
+static bool range_is_empty(PartitionMap *map, KeyRange *range);
+static bool entry_below(PartitionMap *map, PartitionMapEntry *entry,
+			KeyRange *range);
+static bool entry_above(PartitionMap *map, PartitionMapEntry *entry,
+			KeyRange *range);
+static int	entry_cmp(const void *a, const void *b, void *arg);
+static int	oid_cmp(const void *a, const void *b);
+
+static inline int
+key_cmp(PartitionMap *map, Datum a, Datum b)
+{
+	return DatumGetInt32(FunctionCall2Coll(&map->cmpproc, map->keycollation,
+										   a, b));
+}
+
+/*
+ * PartitionMapInvalidateCallback
+ *		Flush the maps of the inheritance trees the relation belongs to.
+ */
+static void
+PartitionMapInvalidateCallback(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	PartitionMapHashEntry *entry;
+
+	/* callback only gets registered after creating the hash */
+	Assert(PartitionMapHash != NULL);
+
+	hash_seq_init(&status, PartitionMapHash);
+	while ((entry = (PartitionMapHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid ||		/* complete reset */
+			entry->parentrelid == relid ||
+			PartitionMapFindChild(entry->map, relid) >= 0)
+		{
+			MemoryContextDelete(entry->map->mcxt);
+			if (hash_search(PartitionMapHash,
+							(void *) &entry->parentrelid,
+							HASH_REMOVE,
+							NULL) == NULL)
+				elog(ERROR, "hash table corrupted");
+		}
+	}
+}
+
+/*
+ * GetPartitionMap
+ *		Get the partition map of the inheritance tree below parentrelid.
+ *
+ * childoids lists the tables of the tree the caller knows of; the cached map
+ * is rebuilt if it lacks any of them.  If NIL, the tables are looked up in
+ * pg_inherits when the map needs to be built.
+ *
+ * The result is never NULL, but has keyattno == InvalidAttrNumber if no
+ * partition key could be found.  It is valid only until the next cache
+ * invalidation, so the caller must be done with it before acquiring any
+ * lock.
+ */
+PartitionMap *
+GetPartitionMap(Oid parentrelid, List *childoids)
+{
+	PartitionMapHashEntry *entry;
+	PartitionMap *map;
+	bool		found;
+
+	if (PartitionMapHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		/* Make sure we've initialized CacheMemoryContext. */
+		if (CacheMemoryContext == NULL)
+			CreateCacheMemoryContext();
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(PartitionMapHashEntry);
+		ctl.hcxt = CacheMemoryContext;
+		PartitionMapHash = hash_create("Partition map cache", 16, &ctl,
+									   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		/* Watch for invalidation events. */
+		CacheRegisterRelcacheCallback(PartitionMapInvalidateCallback,
+									  (Datum) 0);
+	}
+
+	entry = (PartitionMapHashEntry *) hash_search(PartitionMapHash,
+												  (void *) &parentrelid,
+												  HASH_FIND, &found);
+	if (found)
+	{
+		ListCell   *lc;
+
+		foreach(lc, childoids)
+		{
+			if (PartitionMapFindChild(entry->map, lfirst_oid(lc)) < 0)
+				break;
+		}
+		if (lc == NULL)
+			return entry->map;
+
+		/* the tree has gained a child since the map was built */
+		MemoryContextDelete(entry->map->mcxt);
+		hash_search(PartitionMapHash, (void *) &parentrelid,
+					HASH_REMOVE, NULL);
+	}
+
+	if (childoids == NIL)
+		childoids = find_all_inheritors(parentrelid, NoLock, NULL);
+
+	map = build_partition_map(parentrelid, childoids);
+
+	entry = (PartitionMapHashEntry *) hash_search(PartitionMapHash,
+												  (void *) &parentrelid,
+												  HASH_ENTER, &found);
+	Assert(!found);
+	entry->map = map;
+
+	return map;
+}
+
+/*
+ * PartitionMapFindChild
+ *		Return the index of a table in map->children, or -1.
+ */
+int
+PartitionMapFindChild(PartitionMap *map, Oid childrelid)
+{
+	Oid		   *found;
+
+	found = (Oid *) bsearch(&childrelid, map->children, map->nchildren,
+							sizeof(Oid), oid_cmp);
+	return found ? found - map->children : -1;
+}
+
+/*
+ * PartitionMapPrune
+ *		Find the children that can hold rows satisfying all of the
+ *		restrictions "key strategies[i] values[i]".
+ *
+ * Returns an array parallel to map->children.  Children that aren't mapped
+ * are always included.
+ */
+bool *
+PartitionMapPrune(PartitionMap *map, int nquals,
+				  StrategyNumber *strategies, Datum *values)
+{
+	bool	   *live;
+	KeyRange	range;
+	int			i;
+
+	Assert(map->keyattno != InvalidAttrNumber);
+
+	live = (bool *) palloc(map->nchildren * sizeof(bool));
+	for (i = 0; i < map->nchildren; i++)
+		live[i] = !map->mapped[i];
+
+	MemSet(&range, 0, sizeof(range));
+	for (i = 0; i < nquals; i++)
+		range_restrict(map, &range, strategies[i], values[i]);
+
+	/* contradictory restrictions match nothing */
+	if (range_is_empty(map, &range))
+		return live;
+
+	if (map->disjoint)
+	{
+		int			lo = 0;
+		int			hi = map->nentries;
+
+		/*
+		 * The entries are disjoint and sorted, so those entirely below the
+		 * range come first, then those overlapping it, then those above.
+		 */
+		while (lo < hi)
+		{
+			int			mid = (lo + hi) / 2;
+
+			if (entry_below(map, &map->entries[mid], &range))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (i = lo; i < map->nentries; i++)
+		{
+			if (entry_above(map, &map->entries[i], &range))
+				break;
+			live[map->entries[i].child] = true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < map->nentries; i++)
+		{
+			PartitionMapEntry *entry = &map->entries[i];
+
+			if (!entry_below(map, entry, &range) &&
+				!entry_above(map, entry, &range))
+				live[entry->child] = true;
+		}
+	}
+
+	return live;
+}
+
+/*
+ * Build the partition map of a tree, from its tables' CHECK constraints.
+ */
+static PartitionMap *
+build_partition_map(Oid parentrelid, List *childoids)
+{
+	MemoryContext mcxt;
+	MemoryContext tmpcxt;
+	MemoryContext oldcxt;
+	PartitionMap *map;
+	Relation	conrel;
+	List	  **childbounds;
+	ListCell   *lc;
+	int			i;
+
+	/*
+	 * Build the map in a context of its own, only attached to
+	 * CacheMemoryContext when complete, so that nothing leaks on error.
+	 */
+	mcxt = AllocSetContextCreate(CurrentMemoryContext,
+								 "partition map",
+								 ALLOCSET_SMALL_SIZES);
+	tmpcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "partition map build",
+								   ALLOCSET_DEFAULT_SIZES);
+
+	map = (PartitionMap *) MemoryContextAllocZero(mcxt, sizeof(PartitionMap));
+	map->mcxt = mcxt;
+	map->parentrelid = parentrelid;
+	map->keyattno = InvalidAttrNumber;
+	map->disjoint = true;
+
+	/* sorted, duplicate-free array of the children */
+	map->children = (Oid *) MemoryContextAlloc(mcxt,
+									list_length(childoids) * sizeof(Oid));
+	foreach(lc, childoids)
+		map->children[map->nchildren++] = lfirst_oid(lc);
+	qsort(map->children, map->nchildren, sizeof(Oid), oid_cmp);
+	if (map->nchildren > 1)
+	{
+		int			n = 1;
+
+		for (i = 1; i < map->nchildren; i++)
+		{
+			if (map->children[i] != map->children[n - 1])
+				map->children[n++] = map->children[i];
+		}
+		map->nchildren = n;
+	}
+	map->mapped = (bool *) MemoryContextAllocZero(mcxt,
+											map->nchildren * sizeof(bool));
+
+	oldcxt = MemoryContextSwitchTo(tmpcxt);
+
+	/* collect the restrictions in the CHECK constraints of each child */
+	childbounds = (List **) palloc0(map->nchildren * sizeof(List *));
+	conrel = heap_open(ConstraintRelationId, AccessShareLock);
+	for (i = 0; i < map->nchildren; i++)
+		childbounds[i] = get_check_bounds(conrel, map->children[i]);
+	heap_close(conrel, AccessShareLock);
+
+	if (set_partition_key(map, childbounds))
+	{
+		int			maxentries = 0;
+
+		/* a child has one entry per IN list value, or a single range */
+		for (i = 0; i < map->nchildren; i++)
+		{
+			maxentries++;
+			foreach(lc, childbounds[i])
+				maxentries += ((CheckBound *) lfirst(lc))->nvalues;
+		}
+		map->entries = (PartitionMapEntry *)
+			MemoryContextAlloc(mcxt, maxentries * sizeof(PartitionMapEntry));
+
+		for (i = 0; i < map->nchildren; i++)
+			add_child_entries(map, i, childbounds[i]);
+
+		qsort_arg(map->entries, map->nentries, sizeof(PartitionMapEntry),
+				  entry_cmp, map);
+
+		for (i = 0; i + 1 < map->nentries; i++)
+		{
+			PartitionMapEntry *a = &map->entries[i];
+			PartitionMapEntry *b = &map->entries[i + 1];
+			int			c;
+
+			if (a->upper_inf || b->lower_inf)
+				c = 1;
+			else
+				c = key_cmp(map, a->upper, b->lower);
+			if (c > 0 || (c == 0 && a->upper_incl && b->lower_incl))
+			{
+				map->disjoint = false;
+				break;
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(tmpcxt);
+
+	MemoryContextSetParent(mcxt, CacheMemoryContext);
+
+	return map;
+}
+
+/*
+ * Get the restrictions of single columns in a table's validated CHECK
+ * constraints.
+ */
+static List *
+get_check_bounds(Relation conrel, Oid childrelid)
+{
+	List	   *bounds = NIL;
+	ScanKeyData key;
+	SysScanDesc scan;
+	HeapTuple	tup;
+
+	ScanKeyInit(&key,
+				Anum_pg_constraint_conrelid,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(childrelid));
+	scan = systable_beginscan(conrel, ConstraintRelidIndexId, true,
+							  NULL, 1, &key);
+
+	while (HeapTupleIsValid(tup = systable_getnext(scan)))
+	{
+		Form_pg_constraint con = (Form_pg_constraint) GETSTRUCT(tup);
+		Datum		conbin;
+		bool		isnull;
+
+		if (con->contype != CONSTRAINT_CHECK || !con->convalidated)
+			continue;
+
+		conbin = heap_getattr(tup, Anum_pg_constraint_conbin,
+							  RelationGetDescr(conrel), &isnull);
+		if (isnull)
+			continue;
+
+		add_check_bounds(&bounds,
+						 (Node *) stringToNode(TextDatumGetCString(conbin)),
+						 childrelid);
+	}
+
+	systable_endscan(scan);
+
+	return bounds;
+}
+
+/*
+ * Add the restrictions "Var op Const" and "Var IN (Consts)" among the
+ * conjuncts of a CHECK constraint to *bounds.
+ */
+static void
+add_check_bounds(List **bounds, Node *clause, Oid childrelid)
+{
+	CheckBound *bound;
+	Node	   *left;
+	Node	   *right;
+	Oid			opno;
+
+	if (and_clause(clause))
+	{
+		ListCell   *lc;
+
+		foreach(lc, ((BoolExpr *) clause)->args)
+			add_check_bounds(bounds, (Node *) lfirst(lc), childrelid);
+		return;
+	}
+
+	if (is_opclause(clause) && list_length(((OpExpr *) clause)->args) == 2)
+	{
+		OpExpr	   *opclause = (OpExpr *) clause;
+
+		left = strip_implicit_coercions(linitial(opclause->args));
+		right = strip_implicit_coercions(lsecond(opclause->args));
+		opno = opclause->opno;
+		if (IsA(right, Var) && IsA(left, Const))
+		{
+			Node	   *tmp = left;
+
+			left = right;
+			right = tmp;
+			opno = get_commutator(opno);
+		}
+		if (!IsA(left, Var) || !IsA(right, Const) ||
+			((Const *) right)->constisnull || !OidIsValid(opno))
+			return;
+
+		bound = (CheckBound *) palloc0(sizeof(CheckBound));
+		bound->opno = opno;
+		bound->inputcollid = opclause->inputcollid;
+		bound->nvalues = 1;
+		bound->values = &((Const *) right)->constvalue;
+	}
+	else if (IsA(clause, ScalarArrayOpExpr))
+	{
+		ScalarArrayOpExpr *saop = (ScalarArrayOpExpr *) clause;
+		ArrayType  *arr;
+		int16		elmlen;
+		bool		elmbyval;
+		char		elmalign;
+		Datum	   *elems;
+		bool	   *nulls;
+		int			nelems;
+		int			i;
+
+		if (!saop->useOr)
+			return;
+		left = strip_implicit_coercions(linitial(saop->args));
+		right = strip_implicit_coercions(lsecond(saop->args));
+		if (!IsA(left, Var) || !IsA(right, Const) ||
+			((Const *) right)->constisnull)
+			return;
+
+		arr = DatumGetArrayTypeP(((Const *) right)->constvalue);
+		get_typlenbyvalalign(ARR_ELEMTYPE(arr),
+							 &elmlen, &elmbyval, &elmalign);
+		deconstruct_array(arr, ARR_ELEMTYPE(arr), elmlen, elmbyval, elmalign,
+						  &elems, &nulls, &nelems);
+
+		bound = (CheckBound *) palloc0(sizeof(CheckBound));
+		bound->opno = saop->opno;
+		bound->inputcollid = saop->inputcollid;
+		bound->is_list = true;
+		bound->values = (Datum *) palloc(nelems * sizeof(Datum));
+		for (i = 0; i < nelems; i++)
+		{
+			/* NULL never equals the key */
+			if (!nulls[i])
+				bound->values[bound->nvalues++] = elems[i];
+		}
+	}
+	else
+		return;
+
+	if (((Var *) left)->varlevelsup != 0 || ((Var *) left)->varattno <= 0)
+		return;
+	bound->attname = get_attname(childrelid, ((Var *) left)->varattno);
+	if (bound->attname == NULL)
+		return;
+
+	*bounds = lappend(*bounds, bound);
+}
+
+/*
+ * Choose the partition key: the column restricted by the most children.
+ * Returns false if there is none usable.
+ */
+static bool
+set_partition_key(PartitionMap *map, List **childbounds)
+{
+	List	   *names = NIL;
+	List	   *counts = NIL;
+	char	   *keyname = NULL;
+	int			best = 0;
+	Oid			keytype;
+	int32		keytypmod;
+	Oid			opclass;
+	Oid			cmpproc;
+	ListCell   *lc;
+	int			i;
+
+	for (i = 0; i < map->nchildren; i++)
+	{
+		List	   *seen = NIL;
+
+		foreach(lc, childbounds[i])
+		{
+			CheckBound *bound = (CheckBound *) lfirst(lc);
+			ListCell   *lcn;
+			ListCell   *lcc;
+
+			/* count each child once per column */
+			if (list_member(seen, makeString(bound->attname)))
+				continue;
+			seen = lappend(seen, makeString(bound->attname));
+
+			forboth(lcn, names, lcc, counts)
+			{
+				if (strcmp(strVal(lfirst(lcn)), bound->attname) == 0)
+					break;
+			}
+			if (lcn == NULL)
+			{
+				names = lappend(names, makeString(bound->attname));
+				counts = lappend_int(counts, 0);
+				lcc = list_tail(counts);
+			}
+			if (++lfirst_int(lcc) > best)
+			{
+				best = lfirst_int(lcc);
+				keyname = bound->attname;
+			}
+		}
+	}
+	if (keyname == NULL)
+		return false;
+
+	map->keyattno = get_attnum(map->parentrelid, keyname);
+	if (map->keyattno == InvalidAttrNumber)
+		return false;
+	get_atttypetypmodcoll(map->parentrelid, map->keyattno,
+						  &keytype, &keytypmod, &map->keycollation);
+
+	opclass = GetDefaultOpClass(keytype, BTREE_AM_OID);
+	if (!OidIsValid(opclass))
+	{
+		map->keyattno = InvalidAttrNumber;
+		return false;
+	}
+	map->opfamily = get_opclass_family(opclass);
+	map->cmptype = get_opclass_input_type(opclass);
+	cmpproc = get_opfamily_proc(map->opfamily, map->cmptype, map->cmptype,
+								BTORDER_PROC);
+	if (!OidIsValid(cmpproc))
+	{
+		map->keyattno = InvalidAttrNumber;
+		return false;
+	}
+	fmgr_info_cxt(cmpproc, &map->cmpproc, map->mcxt);
+	get_typlenbyval(map->cmptype, &map->cmptyplen, &map->cmptypbyval);
+
+	/* keep only the restrictions of the key */
+	for (i = 0; i < map->nchildren; i++)
+	{
+		List	   *keybounds = NIL;
+
+		foreach(lc, childbounds[i])
+		{
+			CheckBound *bound = (CheckBound *) lfirst(lc);
+
+			if (strcmp(bound->attname, keyname) == 0)
+				keybounds = lappend(keybounds, bound);
+		}
+		childbounds[i] = keybounds;
+	}
+
+	return true;
+}
+
+/*
+ * Add the entries for a child, given the restrictions of the key in its
+ * constraints.  All the constraints hold for every row, so the child's
+ * range is the intersection of the restrictions; an IN list or equality
+ * restricts it to its values.
+ */
+static void
+add_child_entries(PartitionMap *map, int child, List *bounds)
+{
+	KeyRange	range;
+	CheckBound *list = NULL;
+	bool		restricted = false;
+	ListCell   *lc;
+	int			i;
+
+	MemSet(&range, 0, sizeof(range));
+	foreach(lc, bounds)
+	{
+		CheckBound *bound = (CheckBound *) lfirst(lc);
+		int			strategy;
+		Oid			lefttype;
+		Oid			righttype;
+
+		if (bound->inputcollid != map->keycollation ||
+			!op_in_opfamily(bound->opno, map->opfamily))
+			continue;
+		get_op_opfamily_properties(bound->opno, map->opfamily, false,
+								   &strategy, &lefttype, &righttype);
+		if (lefttype != map->cmptype || righttype != map->cmptype)
+			continue;
+
+		if (bound->is_list || strategy == BTEqualStrategyNumber)
+		{
+			if (strategy != BTEqualStrategyNumber)
+				continue;
+			if (list == NULL)
+				list = bound;
+		}
+		else
+			range_restrict(map, &range, strategy, bound->values[0]);
+		restricted = true;
+	}
+	if (!restricted)
+		return;
+
+	map->mapped[child] = true;
+
+	if (list != NULL)
+	{
+		for (i = 0; i < list->nvalues; i++)
+		{
+			KeyRange	point;
+
+			point.has_lower = point.has_upper = true;
+			point.lower_incl = point.upper_incl = true;
+			point.lower = point.upper = list->values[i];
+			add_entry(map, child, &point);
+		}
+	}
+	else if (!range_is_empty(map, &range))
+		add_entry(map, child, &range);
+
+	/* else, the child can only hold NULL keys, so it has no entry */
+}
+
+static void
+add_entry(PartitionMap *map, int child, KeyRange *range)
+{
+	PartitionMapEntry *entry = &map->entries[map->nentries++];
+
+	entry->child = child;
+	entry->lower_inf = !range->has_lower;
+	entry->upper_inf = !range->has_upper;
+	entry->lower_incl = range->lower_incl;
+	entry->upper_incl = range->upper_incl;
+	entry->lower = entry->upper = (Datum) 0;
+	if (range->has_lower)
+		entry->lower = datumCopy(range->lower, map->cmptypbyval,
+								 map->cmptyplen);
+	if (range->has_upper)
+		entry->upper = datumCopy(range->upper, map->cmptypbyval,
+								 map->cmptyplen);
+}
+
+/*
+ * Narrow a range by the restriction "key strategy value".
+ */
+static void
+range_restrict(PartitionMap *map, KeyRange *range,
+			   StrategyNumber strategy, Datum value)
+{
+	bool		incl = (strategy == BTLessEqualStrategyNumber ||
+						strategy == BTEqualStrategyNumber ||
+						strategy == BTGreaterEqualStrategyNumber);
+	int			c = 0;
+
+	if (strategy == BTLessStrategyNumber ||
+		strategy == BTLessEqualStrategyNumber ||
+		strategy == BTEqualStrategyNumber)
+	{
+		if (range->has_upper)
+			c = key_cmp(map, value, range->upper);
+		if (!range->has_upper || c < 0 || (c == 0 && !incl))
+		{
+			range->has_upper = true;
+			range->upper = value;
+			range->upper_incl = incl;
+		}
+	}
+	if (strategy == BTGreaterStrategyNumber ||
+		strategy == BTGreaterEqualStrategyNumber ||
+		strategy == BTEqualStrategyNumber)
+	{
+		if (range->has_lower)
+			c = key_cmp(map, value, range->lower);
+		if (!range->has_lower || c > 0 || (c == 0 && !incl))
+		{
+			range->has_lower = true;
+			range->lower = value;
+			range->lower_incl = incl;
+		}
+	}
+}
+
+static bool
+range_is_empty(PartitionMap *map, KeyRange *range)
+{
+	int			c;
+
+	if (!range->has_lower || !range->has_upper)
+		return false;
+	c = key_cmp(map, range->lower, range->upper);
+	return c > 0 || (c == 0 && !(range->lower_incl && range->upper_incl));
+}
+
+/* Is the entry entirely below the range? */
+static bool
+entry_below(PartitionMap *map, PartitionMapEntry *entry, KeyRange *range)
+{
+	int			c;
+
+	if (!range->has_lower || entry->upper_inf)
+		return false;
+	c = key_cmp(map, entry->upper, range->lower);
+	return c < 0 || (c == 0 && !(entry->upper_incl && range->lower_incl));
+}
+
+/* Is the entry entirely above the range? */
+static bool
+entry_above(PartitionMap *map, PartitionMapEntry *entry, KeyRange *range)
+{
+	int			c;
+
+	if (!range->has_upper || entry->lower_inf)
+		return false;
+	c = key_cmp(map, entry->lower, range->upper);
+	return c > 0 || (c == 0 && !(entry->lower_incl && range->upper_incl));
+}
+
+/*
+ * qsort comparator for entries, by lower bound.
+ */
+static int
+entry_cmp(const void *a, const void *b, void *arg)
+{
+	const PartitionMapEntry *ea = (const PartitionMapEntry *) a;
+	const PartitionMapEntry *eb = (const PartitionMapEntry *) b;
+	int			c;
+
+	if (ea->lower_inf || eb->lower_inf)
+		return (int) eb->lower_inf - (int) ea->lower_inf;
+	c = key_cmp((PartitionMap *) arg, ea->lower, eb->lower);
+	if (c != 0)
+		return c;
+	return (int) eb->lower_incl - (int) ea->lower_incl;
+}
+
+static int
+oid_cmp(const void *a, const void *b)
+{
+	Oid			oa = *(const Oid *) a;
+	Oid			ob = *(const Oid *) b;
+
+	if (oa < ob)
+		return -1;
+	if (oa > ob)
+		return 1;
+	return 0;
+}
@@ -68,6 +68,7 @@
 #include "utils/memutils.h"
 #include "utils/resowner_private.h"
 #include "utils/rls.h"
+#include "utils/sharedplancache.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 
@@ -93,6 +94,8 @@ static List *RevalidateCachedQuery(CachedPlanSource *plansource);
 static bool CheckCachedPlan(CachedPlanSource *plansource);
 static CachedPlan *BuildCachedPlan(CachedPlanSource *plansource, List *qlist,
 				ParamListInfo boundParams);
+static CachedPlan *BuildSharedCachedPlan(CachedPlanSource *plansource,
+					  SharedPlanKey *key, uint64 inval_count);
 static bool choose_custom_plan(CachedPlanSource *plansource,
 				   ParamListInfo boundParams);
 static double cached_plan_cost(CachedPlan *plan, bool include_planner);
@@ -1018,6 +1021,85 @@ BuildCachedPlan(CachedPlanSource *plansource, List *qlist,
 	return plan;
 }
 
+/*
+ * BuildSharedCachedPlan: construct a generic plan from the shared plan cache
+ *
+ * Returns NULL if the shared cache has no usable plan for the statement,
+ * in which case the caller should plan it the usual way.  inval_count is the
+ * shared invalidation count the caller read before revalidating the
+ * querytree.
+ */
+static CachedPlan *
+BuildSharedCachedPlan(CachedPlanSource *plansource, SharedPlanKey *key,
+					  uint64 inval_count)
+{
+	CachedPlan *plan;
+	List	   *plist;
+	char	   *plan_string;
+	MemoryContext plan_context;
+	MemoryContext oldcxt = CurrentMemoryContext;
+	ListCell   *lc;
+
+	Assert(!plansource->is_oneshot);
+
+	if (!plansource->is_valid)
+		return NULL;
+
+	if (!SharedPlanCacheLookup(key, plansource, &plan_string, NULL, NULL))
+		return NULL;
+
+	plan_context = AllocSetContextCreate(CurrentMemoryContext,
+										 "CachedPlan",
+										 ALLOCSET_START_SMALL_SIZES);
+	MemoryContextSwitchTo(plan_context);
+
+	plist = (List *) stringToNode(plan_string);
+
+	plan = (CachedPlan *) palloc(sizeof(CachedPlan));
+	plan->magic = CACHEDPLAN_MAGIC;
+	plan->stmt_list = plist;
+	plan->planRoleId = GetUserId();
+	plan->dependsOnRole = plansource->dependsOnRLS;
+	foreach(lc, plist)
+	{
+		PlannedStmt *plannedstmt = (PlannedStmt *) lfirst(lc);
+
+		Assert(IsA(plannedstmt, PlannedStmt));
+		Assert(!plannedstmt->transientPlan);
+		if (plannedstmt->dependsOnRole)
+			plan->dependsOnRole = true;
+	}
+	plan->saved_xmin = InvalidTransactionId;
+	plan->refcount = 0;
+	plan->context = plan_context;
+	plan->is_oneshot = false;
+	plan->is_saved = false;
+	plan->is_valid = true;
+
+	MemoryContextSwitchTo(oldcxt);
+	pfree(plan_string);
+
+	/*
+	 * The planner would have locked the relations the plan uses; we have to
+	 * do it ourselves.  That may process invalidations that make the
+	 * querytree or the plan stale, in which case give up on it.
+	 */
+	AcquireExecutorLocks(plist, true);
+
+	if (!plansource->is_valid ||
+		SharedPlanCacheInvalCount() != inval_count)
+	{
+		AcquireExecutorLocks(plist, false);
+		MemoryContextDelete(plan_context);
+		return NULL;
+	}
+
+	/* assign generation number to new plan */
+	plan->generation = ++(plansource->generation);
+
+	return plan;
+}
+
 /*
  * choose_custom_plan: choose whether to use custom or generic plan
  *
@@ -1146,6 +1228,9 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 	CachedPlan *plan = NULL;
 	List	   *qlist;
 	bool		customplan;
+	bool		use_shared = false;
+	SharedPlanKey shared_key;
+	uint64		shared_inval_count = 0;
 
 	/* Assert caller is doing things in a sane order */
 	Assert(plansource->magic == CACHEDPLANSOURCE_MAGIC);
@@ -1154,9 +1239,37 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 	if (useResOwner && !plansource->is_saved)
 		elog(ERROR, "cannot apply ResourceOwner to non-saved cached plan");
 
+	/*
+	 * If we may have to make a generic plan, and could use the shared plan
+	 * cache for it, note the shared invalidation count before catching up
+	 * with pending invalidations.  See sharedplancache.c.
+	 */
+	if (SharedPlanCacheEnabled() && plansource->is_saved &&
+		!(plansource->gplan && plansource->gplan->is_valid))
+	{
+		shared_inval_count = SharedPlanCacheInvalCount();
+		AcceptInvalidationMessages();
+		use_shared = true;
+	}
+
 	/* Make sure the querytree list is valid and we have parse-time locks */
 	qlist = RevalidateCachedQuery(plansource);
 
+	if (use_shared)
+		use_shared = SharedPlanCacheComputeKey(plansource, &shared_key);
+
+	/*
+	 * A fresh plansource would plan the first few executions with custom
+	 * plans to find out whether they're worth it.  If some other backend has
+	 * already been through that and ended up sharing a generic plan, adopt
+	 * its statistics so we can go straight to the generic plan.
+	 */
+	if (use_shared && boundParams &&
+		plansource->num_custom_plans == 0 && plansource->generic_cost < 0)
+		(void) SharedPlanCacheLookup(&shared_key, plansource, NULL,
+									 &plansource->num_custom_plans,
+									 &plansource->total_custom_cost);
+
 	/* Decide whether to use a custom plan */
 	customplan = choose_custom_plan(plansource, boundParams);
 
@@ -1170,8 +1283,18 @@ GetCachedPlan(CachedPlanSource *plansource, ParamListInfo boundParams,
 		}
 		else
 		{
-			/* Build a new generic plan */
-			plan = BuildCachedPlan(plansource, qlist, NULL);
+			/* Build a new generic plan, or copy it from the shared cache */
+			plan = NULL;
+			if (use_shared)
+				plan = BuildSharedCachedPlan(plansource, &shared_key,
+											 shared_inval_count);
+			if (plan == NULL)
+			{
+				plan = BuildCachedPlan(plansource, qlist, NULL);
+				if (use_shared)
+					SharedPlanCacheStore(&shared_key, plansource,
+										 plan->stmt_list, shared_inval_count);
+			}
 			/* Just make real sure plansource->gplan is clear */
 			ReleaseGenericPlan(plansource);
 			/* Link the new generic plan into the plansource */
@@ -1697,6 +1820,8 @@ PlanCacheRelCallback(Datum arg, Oid relid)
 {
 	CachedPlanSource *plansource;
 
+	SharedPlanCacheInvalidateRel(relid);
+
 	for (plansource = first_saved_plan; plansource; plansource = plansource->next_saved)
 	{
 		Assert(plansource->magic == CACHEDPLANSOURCE_MAGIC);
@@ -1763,6 +1888,8 @@ PlanCacheFuncCallback(Datum arg, int cacheid, uint32 hashvalue)
 {
 	CachedPlanSource *plansource;
 
+	SharedPlanCacheInvalidateItem(cacheid, hashvalue);
+
 	for (plansource = first_saved_plan; plansource; plansource = plansource->next_saved)
 	{
 		ListCell   *lc;
@@ -1841,6 +1968,7 @@ PlanCacheFuncCallback(Datum arg, int cacheid, uint32 hashvalue)
 static void
 PlanCacheSysCallback(Datum arg, int cacheid, uint32 hashvalue)
 {
+	SharedPlanCacheReset();
 	ResetPlanCache();
 }
 
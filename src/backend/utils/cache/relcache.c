@@ -5502,6 +5502,19 @@ RelationCacheInitFilePreInvalidate(void)
 					 errmsg("could not remove cache file \"%s\": %m",
 							initfilename)));
 	}
+
+	/* The catcache init file is protected the same way (see catcache.c) */
+	snprintf(initfilename, sizeof(initfilename), "%s/%s",
+			 DatabasePath, CATCACHE_INIT_FILENAME);
+
+	if (unlink(initfilename) < 0)
+	{
+		if (errno != ENOENT)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not remove cache file \"%s\": %m",
+							initfilename)));
+	}
 }
 
 void
@@ -5586,6 +5599,9 @@ RelationCacheInitFileRemoveInDir(const char *tblspcpath)
 			snprintf(initfilename, sizeof(initfilename), "%s/%s/%s",
 					 tblspcpath, de->d_name, RELCACHE_INIT_FILENAME);
 			unlink_initfile(initfilename);
+			snprintf(initfilename, sizeof(initfilename), "%s/%s/%s",
+					 tblspcpath, de->d_name, CATCACHE_INIT_FILENAME);
+			unlink_initfile(initfilename);
 		}
 	}
 
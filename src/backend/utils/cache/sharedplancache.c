@@ -0,0 +1,727 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedplancache.c
+ *	  Cache of generic plans shared between backends.
+ *
+ * plancache.c keeps its plans in backend-local memory, so every new session
+ * plans its prepared statements from scratch.  With many short-lived
+ * sessions executing the same statements, that is a lot of repeated work.
+ * When shared_plan_cache_entries is set, a backend that builds a generic
+ * plan for a saved CachedPlanSource also stores it here, serialized with
+ * nodeToString, and other backends copy it in instead of planning.  Parse
+ * analysis and rewriting are still done locally; only the planner is
+ * skipped.
+ *
+ * Entries are identified by database, role, query text, search_path,
+ * parameter types, cursor options, session_replication_role and the values
+ * of the settings that affect planning (see GetPlannerConfigHash).  Each
+ * entry occupies a slot of shared_plan_cache_entry_size bytes holding the
+ * query text and the plan; plans that don't fit are not shared.  When all
+ * slots are in use, one is recycled with a clock sweep.
+ *
+ * Invalidation rides on the existing sinval messages: plancache.c's
+ * relcache and syscache callbacks also remove the shared entries depending
+ * on the object in question.  Every backend runs those callbacks for every
+ * message, so an entry is dropped by whichever backend gets to the message
+ * first.  What remains is the race of a backend storing a plan made from a
+ * catalog state that other backends have already invalidated.  To close
+ * it, every invalidation bumps a shared counter.  A backend reads the
+ * counter and then accepts pending invalidation messages before it
+ * revalidates and plans the query, and it stores the plan only if the
+ * counter hasn't moved since.  So a stored plan was made with every
+ * invalidation seen by any backend up to that point, and any message it
+ * missed will still remove it when processed.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/cache/sharedplancache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "commands/trigger.h"
+#include "miscadmin.h"
+#include "nodes/plannodes.h"
+#include "port/atomics.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/sharedplancache.h"
+
+
+/* limits on the dependencies a shared plan may have */
+#define SHARED_PLAN_MAX_RELS		32
+#define SHARED_PLAN_MAX_INVAL_ITEMS	32
+
+/* maximum usage count of a slot, for the clock sweep */
+#define SHARED_PLAN_MAX_USAGE		5
+
+/* a PlanInvalItem, without the node header */
+typedef struct SharedPlanInvalItem
+{
+	int			cacheId;
+	uint32		hashValue;
+} SharedPlanInvalItem;
+
+/*
+ * A slot of the cache.  The query text and the serialized plan, both
+ * null-terminated, follow the fixed part.
+ *
+ * Slots are protected by SharedPlanCacheLock, except that the usage count is
+ * bumped by lookups holding the lock in shared mode.
+ */
+typedef struct SharedPlanSlot
+{
+	bool		in_use;
+	SharedPlanKey key;
+	pg_atomic_uint32 usage;		/* recent uses, for the clock sweep */
+	int			cursor_options;
+	int			num_params;
+	/* custom plan statistics of the backend that made the plan */
+	int			num_custom_plans;
+	double		total_custom_cost;
+	/* relations and other objects the plan depends on */
+	int			nrels;
+	Oid			rels[SHARED_PLAN_MAX_RELS];
+	int			nitems;
+	SharedPlanInvalItem items[SHARED_PLAN_MAX_INVAL_ITEMS];
+	int			query_len;		/* strlen of the query text */
+	int			plan_len;		/* strlen of the plan */
+	char		data[FLEXIBLE_ARRAY_MEMBER];
+} SharedPlanSlot;
+
+typedef struct SharedPlanCacheControl
+{
+	pg_atomic_uint64 inval_count;	/* invalidation events processed */
+	int			clock_hand;		/* next slot for the clock sweep */
+} SharedPlanCacheControl;
+
+/* hash table entry mapping a key to its slot */
+typedef struct SharedPlanHashEntry
+{
+	SharedPlanKey key;			/* hash key, must be first */
+	int			slotno;
+} SharedPlanHashEntry;
+
+/* GUCs */
+int			shared_plan_cache_entries = 0;
+int			shared_plan_cache_entry_size = 16;
+
+static SharedPlanCacheControl *SharedPlanCache = NULL;
+static char *SharedPlanSlots = NULL;
+static HTAB *SharedPlanHash = NULL;
+
+#define SharedPlanSlotSize() \
+	MAXALIGN((Size) shared_plan_cache_entry_size * 1024)
+#define GetSharedPlanSlot(slotno) \
+	((SharedPlanSlot *) (SharedPlanSlots + (Size) (slotno) * SharedPlanSlotSize()))
+#define SharedPlanSlotCapacity() \
+	(SharedPlanSlotSize() - offsetof(SharedPlanSlot, data))
+
+static bool plan_is_shareable(Plan *plan);
+static int	shared_plan_get_slot(void);
+static void shared_plan_remove_slot(int slotno);
+static bool shared_plan_slot_matches(SharedPlanSlot *slot, Oid relid,
+						 int cacheid, uint32 hashvalue);
+static void shared_plan_invalidate(Oid relid, int cacheid, uint32 hashvalue);
+
+
+/*
+ * Report shared memory space needed by SharedPlanCacheShmemInit
+ */
+Size
+SharedPlanCacheShmemSize(void)
+{
+	Size		size;
+
+	if (shared_plan_cache_entries <= 0)
+		return 0;
+
+	size = MAXALIGN(sizeof(SharedPlanCacheControl));
+	size = add_size(size, mul_size(shared_plan_cache_entries,
+								   SharedPlanSlotSize()));
+	size = add_size(size, hash_estimate_size(shared_plan_cache_entries,
+											 sizeof(SharedPlanHashEntry)));
+	return size;
+}
+
+/*
+ * Initialize the shared plan cache during postmaster startup
+ */
+void
+SharedPlanCacheShmemInit(void)
+{
+	HASHCTL		info;
+	bool		found;
+	int			i;
+
+	if (shared_plan_cache_entries <= 0)
+		return;
+
+	if (offsetof(SharedPlanSlot, data) + 2 > SharedPlanSlotSize())
+		elog(FATAL, "shared_plan_cache_entry_size is too small");
+
+	SharedPlanCache = (SharedPlanCacheControl *)
+		ShmemInitStruct("Shared Plan Cache",
+						MAXALIGN(sizeof(SharedPlanCacheControl)) +
+						mul_size(shared_plan_cache_entries,
+								 SharedPlanSlotSize()),
+						&found);
+	SharedPlanSlots = (char *) SharedPlanCache +
+		MAXALIGN(sizeof(SharedPlanCacheControl));
+
+	if (!found)
+	{
+		pg_atomic_init_u64(&SharedPlanCache->inval_count, 0);
+		SharedPlanCache->clock_hand = 0;
+		for (i = 0; i < shared_plan_cache_entries; i++)
+		{
+			SharedPlanSlot *slot = GetSharedPlanSlot(i);
+
+			slot->in_use = false;
+			pg_atomic_init_u32(&slot->usage, 0);
+		}
+	}
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedPlanKey);
+	info.entrysize = sizeof(SharedPlanHashEntry);
+
+	SharedPlanHash = ShmemInitHash("Shared Plan Cache Hash",
+								   shared_plan_cache_entries,
+								   shared_plan_cache_entries,
+								   &info,
+								   HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * Is the shared plan cache in use?
+ */
+bool
+SharedPlanCacheEnabled(void)
+{
+	return SharedPlanCache != NULL;
+}
+
+/*
+ * Mix a value into a running hash.
+ */
+static inline uint32
+shared_plan_hash_mix(uint32 hash, uint32 value)
+{
+	return ((hash << 1) | (hash >> 31)) ^ value;
+}
+
+/*
+ * Compute the shared plan cache key of a CachedPlanSource.  Returns false if
+ * plans of this statement can't be shared.
+ */
+bool
+SharedPlanCacheComputeKey(CachedPlanSource *plansource, SharedPlanKey *key)
+{
+	uint32		env_hash;
+	ListCell   *lc;
+
+	if (!SharedPlanCacheEnabled())
+		return false;
+
+	/* Only long-lived statements are worth it */
+	if (!plansource->is_saved || plansource->is_oneshot ||
+		plansource->query_string == NULL)
+		return false;
+
+	/*
+	 * With parser hooks, such as those of PL/pgSQL, the same text can mean
+	 * different things in different places.  Row security makes plans
+	 * depend on more than the role.
+	 */
+	if (plansource->parserSetup != NULL || plansource->dependsOnRLS)
+		return false;
+
+	/*
+	 * Plans made outside serializable transactions might be parallel, which
+	 * serializable transactions can't execute.
+	 */
+	if (IsolationIsSerializable())
+		return false;
+
+	/* Utility statements have no plans */
+	foreach(lc, plansource->query_list)
+	{
+		Query	   *query = (Query *) lfirst(lc);
+
+		if (query->commandType == CMD_UTILITY)
+			return false;
+	}
+
+	key->dbid = MyDatabaseId;
+	key->userid = GetUserId();
+	key->query_hash = DatumGetUInt32(hash_any((const unsigned char *) plansource->query_string,
+										  strlen(plansource->query_string)));
+
+	env_hash = GetPlannerConfigHash();
+	if (namespace_search_path)
+		env_hash = shared_plan_hash_mix(env_hash,
+			DatumGetUInt32(hash_any((const unsigned char *) namespace_search_path,
+									strlen(namespace_search_path))));
+	if (plansource->num_params > 0)
+		env_hash = shared_plan_hash_mix(env_hash,
+			DatumGetUInt32(hash_any((const unsigned char *) plansource->param_types,
+									plansource->num_params * sizeof(Oid))));
+	env_hash = shared_plan_hash_mix(env_hash,
+									(uint32) plansource->cursor_options);
+	/* this one decides which rules the rewriter applies */
+	env_hash = shared_plan_hash_mix(env_hash,
+									(uint32) SessionReplicationRole);
+	key->env_hash = env_hash;
+
+	return true;
+}
+
+/*
+ * Return the number of invalidation events processed so far.
+ */
+uint64
+SharedPlanCacheInvalCount(void)
+{
+	Assert(SharedPlanCacheEnabled());
+
+	return pg_atomic_read_u64(&SharedPlanCache->inval_count);
+}
+
+/*
+ * Look up the shared plan of a statement.
+ *
+ * If one is found, returns true and the custom plan statistics of the
+ * backend that made it, and, if plan_string isn't NULL, a palloc'd copy of
+ * the serialized plan.
+ */
+bool
+SharedPlanCacheLookup(SharedPlanKey *key, CachedPlanSource *plansource,
+					  char **plan_string,
+					  int *num_custom_plans, double *total_custom_cost)
+{
+	SharedPlanHashEntry *entry;
+	SharedPlanSlot *slot;
+	ListCell   *lc;
+	bool		found = false;
+
+	LWLockAcquire(SharedPlanCacheLock, LW_SHARED);
+
+	entry = (SharedPlanHashEntry *) hash_search(SharedPlanHash, key,
+												HASH_FIND, NULL);
+	if (entry == NULL)
+		goto done;
+
+	slot = GetSharedPlanSlot(entry->slotno);
+	Assert(slot->in_use);
+
+	if (slot->num_params != plansource->num_params ||
+		slot->cursor_options != plansource->cursor_options ||
+		strcmp(slot->data, plansource->query_string) != 0)
+		goto done;
+
+	/*
+	 * The query text could still refer to different relations, for example
+	 * temporary tables, so check that the relations our querytree depends
+	 * on are among the plan's.
+	 */
+	foreach(lc, plansource->relationOids)
+	{
+		Oid			relid = lfirst_oid(lc);
+		int			i;
+
+		for (i = 0; i < slot->nrels; i++)
+		{
+			if (slot->rels[i] == relid)
+				break;
+		}
+		if (i >= slot->nrels)
+			goto done;
+	}
+
+	if (pg_atomic_read_u32(&slot->usage) < SHARED_PLAN_MAX_USAGE)
+		pg_atomic_fetch_add_u32(&slot->usage, 1);
+
+	if (num_custom_plans)
+		*num_custom_plans = slot->num_custom_plans;
+	if (total_custom_cost)
+		*total_custom_cost = slot->total_custom_cost;
+	if (plan_string)
+	{
+		*plan_string = palloc(slot->plan_len + 1);
+		memcpy(*plan_string, slot->data + slot->query_len + 1,
+			   slot->plan_len + 1);
+	}
+	found = true;
+
+done:
+	LWLockRelease(SharedPlanCacheLock);
+
+	return found;
+}
+
+/*
+ * Store a generic plan of a statement in the shared cache, replacing any
+ * plan it already has there.
+ *
+ * inval_count is the invalidation count read before the querytree was
+ * revalidated, see the file header comment.  Plans that aren't shareable,
+ * or don't fit in a slot, are silently ignored.
+ */
+void
+SharedPlanCacheStore(SharedPlanKey *key, CachedPlanSource *plansource,
+					 List *stmt_list, uint64 inval_count)
+{
+	Oid			rels[SHARED_PLAN_MAX_RELS];
+	SharedPlanInvalItem items[SHARED_PLAN_MAX_INVAL_ITEMS];
+	int			nrels = 0;
+	int			nitems = 0;
+	char	   *plan_string;
+	int			query_len;
+	int			plan_len;
+	SharedPlanHashEntry *entry;
+	SharedPlanSlot *slot;
+	bool		found;
+	ListCell   *lc;
+
+	/* Collect the dependencies, and check that the plan can be shared */
+	foreach(lc, stmt_list)
+	{
+		PlannedStmt *plannedstmt = (PlannedStmt *) lfirst(lc);
+		ListCell   *lc2;
+
+		if (!IsA(plannedstmt, PlannedStmt) ||
+			plannedstmt->utilityStmt != NULL ||
+			plannedstmt->transientPlan)
+			return;
+
+		if (!plan_is_shareable(plannedstmt->planTree))
+			return;
+		foreach(lc2, plannedstmt->subplans)
+		{
+			if (!plan_is_shareable((Plan *) lfirst(lc2)))
+				return;
+		}
+
+		foreach(lc2, plannedstmt->relationOids)
+		{
+			Oid			relid = lfirst_oid(lc2);
+
+			/* Plans on temporary tables are of no use to anyone else */
+			if (get_rel_persistence(relid) == RELPERSISTENCE_TEMP)
+				return;
+			if (nrels >= SHARED_PLAN_MAX_RELS)
+				return;
+			rels[nrels++] = relid;
+		}
+		foreach(lc2, plannedstmt->invalItems)
+		{
+			PlanInvalItem *item = (PlanInvalItem *) lfirst(lc2);
+
+			if (nitems >= SHARED_PLAN_MAX_INVAL_ITEMS)
+				return;
+			items[nitems].cacheId = item->cacheId;
+			items[nitems].hashValue = item->hashValue;
+			nitems++;
+		}
+	}
+
+	query_len = strlen(plansource->query_string);
+	plan_string = nodeToString(stmt_list);
+	plan_len = strlen(plan_string);
+	if ((Size) query_len + plan_len + 2 > SharedPlanSlotCapacity())
+	{
+		pfree(plan_string);
+		return;
+	}
+
+	LWLockAcquire(SharedPlanCacheLock, LW_EXCLUSIVE);
+
+	/* Give up if anything was invalidated since we began */
+	if (pg_atomic_read_u64(&SharedPlanCache->inval_count) != inval_count)
+	{
+		LWLockRelease(SharedPlanCacheLock);
+		pfree(plan_string);
+		return;
+	}
+
+	entry = (SharedPlanHashEntry *) hash_search(SharedPlanHash, key,
+												HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		int			slotno = shared_plan_get_slot();
+
+		entry = (SharedPlanHashEntry *) hash_search(SharedPlanHash, key,
+													HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			/* shouldn't happen, the table has room for every slot */
+			LWLockRelease(SharedPlanCacheLock);
+			pfree(plan_string);
+			return;
+		}
+		Assert(!found);
+		entry->slotno = slotno;
+	}
+
+	slot = GetSharedPlanSlot(entry->slotno);
+	slot->in_use = true;
+	slot->key = *key;
+	pg_atomic_write_u32(&slot->usage, 1);
+	slot->cursor_options = plansource->cursor_options;
+	slot->num_params = plansource->num_params;
+	slot->num_custom_plans = plansource->num_custom_plans;
+	slot->total_custom_cost = plansource->total_custom_cost;
+	slot->nrels = nrels;
+	memcpy(slot->rels, rels, nrels * sizeof(Oid));
+	slot->nitems = nitems;
+	memcpy(slot->items, items, nitems * sizeof(SharedPlanInvalItem));
+	slot->query_len = query_len;
+	slot->plan_len = plan_len;
+	memcpy(slot->data, plansource->query_string, query_len + 1);
+	memcpy(slot->data + query_len + 1, plan_string, plan_len + 1);
+
+	LWLockRelease(SharedPlanCacheLock);
+
+	pfree(plan_string);
+}
+
+/*
+ * Can this plan tree be serialized and read back by another backend?
+ *
+ * Custom scan providers might keep private state outside the plan tree, or
+ * not be loaded in other backends, so we don't share their plans.
+ */
+static bool
+plan_is_shareable(Plan *plan)
+{
+	ListCell   *lc;
+
+	if (plan == NULL)
+		return true;
+
+	switch (nodeTag(plan))
+	{
+		case T_CustomScan:
+			return false;
+		case T_Append:
+			foreach(lc, ((Append *) plan)->appendplans)
+			{
+				if (!plan_is_shareable((Plan *) lfirst(lc)))
+					return false;
+			}
+			break;
+		case T_MergeAppend:
+			foreach(lc, ((MergeAppend *) plan)->mergeplans)
+			{
+				if (!plan_is_shareable((Plan *) lfirst(lc)))
+					return false;
+			}
+			break;
+		case T_ModifyTable:
+			foreach(lc, ((ModifyTable *) plan)->plans)
+			{
+				if (!plan_is_shareable((Plan *) lfirst(lc)))
+					return false;
+			}
+			break;
+		case T_BitmapAnd:
+			foreach(lc, ((BitmapAnd *) plan)->bitmapplans)
+			{
+				if (!plan_is_shareable((Plan *) lfirst(lc)))
+					return false;
+			}
+			break;
+		case T_BitmapOr:
+			foreach(lc, ((BitmapOr *) plan)->bitmapplans)
+			{
+				if (!plan_is_shareable((Plan *) lfirst(lc)))
+					return false;
+			}
+			break;
+		case T_SubqueryScan:
+			if (!plan_is_shareable(((SubqueryScan *) plan)->subplan))
+				return false;
+			break;
+		default:
+			break;
+	}
+
+	return plan_is_shareable(plan->lefttree) &&
+		plan_is_shareable(plan->righttree);
+}
+
+/*
+ * Find a slot for a new entry, evicting an old one if need be.
+ *
+ * Caller must hold SharedPlanCacheLock exclusively.
+ */
+static int
+shared_plan_get_slot(void)
+{
+	for (;;)
+	{
+		int			slotno = SharedPlanCache->clock_hand;
+		SharedPlanSlot *slot = GetSharedPlanSlot(slotno);
+		uint32		usage;
+
+		SharedPlanCache->clock_hand = (slotno + 1) % shared_plan_cache_entries;
+
+		if (!slot->in_use)
+			return slotno;
+
+		usage = pg_atomic_read_u32(&slot->usage);
+		if (usage == 0)
+		{
+			shared_plan_remove_slot(slotno);
+			return slotno;
+		}
+		pg_atomic_write_u32(&slot->usage, usage - 1);
+	}
+}
+
+/*
+ * Remove the entry in a slot.  Caller must hold SharedPlanCacheLock
+ * exclusively.
+ */
+static void
+shared_plan_remove_slot(int slotno)
+{
+	SharedPlanSlot *slot = GetSharedPlanSlot(slotno);
+
+	Assert(slot->in_use);
+	hash_search(SharedPlanHash, &slot->key, HASH_REMOVE, NULL);
+	slot->in_use = false;
+}
+
+/*
+ * Does the entry in a slot depend on the given object?
+ *
+ * cacheid < 0 means relation relid, or any relation if relid is InvalidOid.
+ * Otherwise it's the syscache entry with the given hash value, or any
+ * entry of the cache if hashvalue is zero.
+ */
+static bool
+shared_plan_slot_matches(SharedPlanSlot *slot, Oid relid,
+						 int cacheid, uint32 hashvalue)
+{
+	int			i;
+
+	if (!slot->in_use)
+		return false;
+
+	if (cacheid < 0)
+	{
+		if (relid == InvalidOid)
+			return slot->nrels > 0;
+		for (i = 0; i < slot->nrels; i++)
+		{
+			if (slot->rels[i] == relid)
+				return true;
+		}
+	}
+	else
+	{
+		for (i = 0; i < slot->nitems; i++)
+		{
+			if (slot->items[i].cacheId == cacheid &&
+				(hashvalue == 0 || slot->items[i].hashValue == hashvalue))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Remove the entries depending on an object, see shared_plan_slot_matches.
+ */
+static void
+shared_plan_invalidate(Oid relid, int cacheid, uint32 hashvalue)
+{
+	bool		any = false;
+	int			i;
+
+	/* Must count the event before looking, see file header comment */
+	pg_atomic_fetch_add_u64(&SharedPlanCache->inval_count, 1);
+
+	/*
+	 * Every backend processes every invalidation message, and most of the
+	 * time the entries are gone already, so check that in shared mode first.
+	 */
+	LWLockAcquire(SharedPlanCacheLock, LW_SHARED);
+	for (i = 0; i < shared_plan_cache_entries && !any; i++)
+		any = shared_plan_slot_matches(GetSharedPlanSlot(i), relid,
+									   cacheid, hashvalue);
+	LWLockRelease(SharedPlanCacheLock);
+
+	if (!any)
+		return;
+
+	LWLockAcquire(SharedPlanCacheLock, LW_EXCLUSIVE);
+	for (i = 0; i < shared_plan_cache_entries; i++)
+	{
+		if (shared_plan_slot_matches(GetSharedPlanSlot(i), relid,
+									 cacheid, hashvalue))
+			shared_plan_remove_slot(i);
+	}
+	LWLockRelease(SharedPlanCacheLock);
+}
+
+/*
+ * Remove the entries depending on a relation, or on any relation if relid
+ * is InvalidOid.
+ */
+void
+SharedPlanCacheInvalidateRel(Oid relid)
+{
+	if (!SharedPlanCacheEnabled())
+		return;
+
+	shared_plan_invalidate(relid, -1, 0);
+}
+
+/*
+ * Remove the entries depending on a syscache entry, or on any entry of the
+ * cache if hashvalue is zero.
+ */
+void
+SharedPlanCacheInvalidateItem(int cacheid, uint32 hashvalue)
+{
+	if (!SharedPlanCacheEnabled())
+		return;
+
+	shared_plan_invalidate(InvalidOid, cacheid, hashvalue);
+}
+
+/*
+ * Remove all entries.
+ */
+void
+SharedPlanCacheReset(void)
+{
+	int			i;
+
+	if (!SharedPlanCacheEnabled())
+		return;
+
+	pg_atomic_fetch_add_u64(&SharedPlanCache->inval_count, 1);
+
+	LWLockAcquire(SharedPlanCacheLock, LW_EXCLUSIVE);
+	for (i = 0; i < shared_plan_cache_entries; i++)
+	{
+		if (GetSharedPlanSlot(i)->in_use)
+			shared_plan_remove_slot(i);
+	}
+	LWLockRelease(SharedPlanCacheLock);
+}
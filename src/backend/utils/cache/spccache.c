@@ -24,6 +24,7 @@
 #include "miscadmin.h"
 #include "optimizer/cost.h"
 #include "storage/bufmgr.h"
+#include "storage/smgr.h"
 #include "utils/catcache.h"
 #include "utils/hsearch.h"
 #include "utils/inval.h"
@@ -155,6 +156,14 @@ get_tablespace(Oid spcid)
 			memcpy(opts, bytea_opts, VARSIZE(bytea_opts));
 		}
 		ReleaseSysCache(tp);
+
+		/*
+		 * The checkpointer and the background writer can't read the
+		 * catalogs, so publish the write budget for them whenever we do.
+		 */
+		TablespaceIOSetLimits(spcid,
+							  opts ? opts->max_write_rate : 0,
+							  opts ? opts->max_write_iops : 0);
 	}
 
 	/*
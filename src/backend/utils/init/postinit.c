@@ -50,6 +50,7 @@
 #include "storage/smgr.h"
 #include "tcop/tcopprot.h"
 #include "utils/acl.h"
+#include "utils/catcache.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
@@ -65,6 +66,8 @@
 static HeapTuple GetDatabaseTuple(const char *dbname);
 static HeapTuple GetDatabaseTupleByOid(Oid dboid);
 static void PerformAuthentication(Port *port);
+static void CheckDatabaseAccess(const char *name, Form_pg_database dbform,
+					bool am_superuser);
 static void CheckMyDatabase(const char *name, bool am_superuser);
 static void InitCommunication(void);
 static void ShutdownPostgres(int code, Datum arg);
@@ -280,34 +283,13 @@ PerformAuthentication(Port *port)
 
 
 /*
- * CheckMyDatabase -- fetch information from the pg_database entry for our DB
+ * CheckDatabaseAccess -- check permissions to connect to the database
  */
 static void
-CheckMyDatabase(const char *name, bool am_superuser)
+CheckDatabaseAccess(const char *name, Form_pg_database dbform,
+					bool am_superuser)
 {
-	HeapTuple	tup;
-	Form_pg_database dbform;
-	char	   *collate;
-	char	   *ctype;
-
-	/* Fetch our pg_database row normally, via syscache */
-	tup = SearchSysCache1(DATABASEOID, ObjectIdGetDatum(MyDatabaseId));
-	if (!HeapTupleIsValid(tup))
-		elog(ERROR, "cache lookup failed for database %u", MyDatabaseId);
-	dbform = (Form_pg_database) GETSTRUCT(tup);
-
-	/* This recheck is strictly paranoia */
-	if (strcmp(name, NameStr(dbform->datname)) != 0)
-		ereport(FATAL,
-				(errcode(ERRCODE_UNDEFINED_DATABASE),
-				 errmsg("database \"%s\" has disappeared from pg_database",
-						name),
-				 errdetail("Database OID %u now seems to belong to \"%s\".",
-						   MyDatabaseId, NameStr(dbform->datname))));
-
 	/*
-	 * Check permissions to connect to the database.
-	 *
 	 * These checks are not enforced when in standalone mode, so that there is
 	 * a way to recover from disabling all access to all databases, for
 	 * example "UPDATE pg_database SET datallowconn = false;".
@@ -356,6 +338,35 @@ CheckMyDatabase(const char *name, bool am_superuser)
 					 errmsg("too many connections for database \"%s\"",
 							name)));
 	}
+}
+
+/*
+ * CheckMyDatabase -- fetch information from the pg_database entry for our DB
+ */
+static void
+CheckMyDatabase(const char *name, bool am_superuser)
+{
+	HeapTuple	tup;
+	Form_pg_database dbform;
+	char	   *collate;
+	char	   *ctype;
+
+	/* Fetch our pg_database row normally, via syscache */
+	tup = SearchSysCache1(DATABASEOID, ObjectIdGetDatum(MyDatabaseId));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for database %u", MyDatabaseId);
+	dbform = (Form_pg_database) GETSTRUCT(tup);
+
+	/* This recheck is strictly paranoia */
+	if (strcmp(name, NameStr(dbform->datname)) != 0)
+		ereport(FATAL,
+				(errcode(ERRCODE_UNDEFINED_DATABASE),
+				 errmsg("database \"%s\" has disappeared from pg_database",
+						name),
+				 errdetail("Database OID %u now seems to belong to \"%s\".",
+						   MyDatabaseId, NameStr(dbform->datname))));
+
+	CheckDatabaseAccess(name, dbform, am_superuser);
 
 	/*
 	 * OK, we're golden.  Next to-do item is to save the encoding info out of
@@ -981,6 +992,10 @@ InitPostgres(const char *in_dbname, Oid dboid, const char *username,
 	 */
 	RelationCacheInitializePhase3();
 
+	/* Preload catcaches from the init file, if enabled */
+	if (!bootstrap)
+		CatalogCacheLoadInitFile();
+
 	/* set up ACL framework (so CheckMyDatabase can check permissions) */
 	initialize_acl();
 
@@ -1028,6 +1043,72 @@ InitPostgres(const char *in_dbname, Oid dboid, const char *username,
 		CommitTransactionCommand();
 }
 
+/*
+ * InitPooledSession
+ *		Set up the session of a new client of a pooled backend.
+ *
+ * The client connects to the same database as the same user with the same
+ * options as the previous one (see postmaster/sessionpool.c), and session
+ * state has been reset already.  So only authentication and the checks of
+ * InitPostgres whose outcome might have changed since are repeated.
+ */
+void
+InitPooledSession(void)
+{
+	HeapTuple	tuple;
+	Form_pg_authid rform;
+	bool		am_superuser;
+
+	/*
+	 * Authentication must follow the current pg_hba.conf.  PostgresMain
+	 * keeps PostmasterContext, where it is loaded, in pooled backends.
+	 */
+	if (!load_hba())
+		ereport(FATAL,
+				(errmsg("could not load pg_hba.conf")));
+	(void) load_ident();
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+
+	PerformAuthentication(MyProcPort);
+
+	/* Same checks as InitializeSessionUserId */
+	tuple = SearchSysCache1(AUTHOID, ObjectIdGetDatum(GetSessionUserId()));
+	if (!HeapTupleIsValid(tuple))
+		ereport(FATAL,
+				(errcode(ERRCODE_INVALID_AUTHORIZATION_SPECIFICATION),
+				 errmsg("role \"%s\" does not exist",
+						MyProcPort->user_name)));
+	rform = (Form_pg_authid) GETSTRUCT(tuple);
+	am_superuser = rform->rolsuper;
+	if (!rform->rolcanlogin)
+		ereport(FATAL,
+				(errcode(ERRCODE_INVALID_AUTHORIZATION_SPECIFICATION),
+				 errmsg("role \"%s\" is not permitted to log in",
+						NameStr(rform->rolname))));
+	if (rform->rolconnlimit >= 0 &&
+		!am_superuser &&
+		CountUserBackends(HeapTupleGetOid(tuple)) > rform->rolconnlimit)
+		ereport(FATAL,
+				(errcode(ERRCODE_TOO_MANY_CONNECTIONS),
+				 errmsg("too many connections for role \"%s\"",
+						NameStr(rform->rolname))));
+	ReleaseSysCache(tuple);
+
+	tuple = SearchSysCache1(DATABASEOID, ObjectIdGetDatum(MyDatabaseId));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for database %u", MyDatabaseId);
+	CheckDatabaseAccess(MyProcPort->database_name,
+						(Form_pg_database) GETSTRUCT(tuple), am_superuser);
+	ReleaseSysCache(tuple);
+
+	CommitTransactionCommand();
+
+	/* Report the new client to the stats collector */
+	pgstat_bestart();
+}
+
 /*
  * Process any command-line switches and any additional GUC variable
  * settings passed in the startup packet.
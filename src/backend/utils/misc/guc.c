@@ -26,21 +26,32 @@
 #include <syslog.h>
 #endif
 
+#include "access/clog.h"
+#include "access/hash.h"
 #include "access/commit_ts.h"
 #include "access/gin.h"
+#include "access/multixact.h"
+#include "access/nbtree.h"
+#include "access/parallelredo.h"
+#include "access/subtrans.h"
 #include "access/transam.h"
+#include "access/tuptoaster.h"
 #include "access/twophase.h"
 #include "access/xact.h"
+#include "catalog/index.h"
 #include "catalog/namespace.h"
 #include "commands/async.h"
 #include "commands/prepare.h"
 #include "commands/vacuum.h"
 #include "commands/variable.h"
 #include "commands/trigger.h"
+#include "executor/execBatch.h"
+#include "executor/nodeAppend.h"
 #include "funcapi.h"
 #include "libpq/auth.h"
 #include "libpq/be-fsstubs.h"
 #include "libpq/libpq.h"
+#include "jit/jit.h"
 #include "libpq/pqformat.h"
 #include "miscadmin.h"
 #include "optimizer/cost.h"
@@ -56,8 +67,10 @@
 #include "postmaster/bgworker.h"
 #include "postmaster/bgwriter.h"
 #include "postmaster/postmaster.h"
+#include "postmaster/sessionpool.h"
 #include "postmaster/syslogger.h"
 #include "postmaster/walwriter.h"
+#include "replication/reorderbuffer.h"
 #include "replication/slot.h"
 #include "replication/syncrep.h"
 #include "replication/walreceiver.h"
@@ -69,10 +82,12 @@
 #include "storage/pg_shmem.h"
 #include "storage/proc.h"
 #include "storage/predicate.h"
+#include "storage/sinvaladt.h"
 #include "tcop/tcopprot.h"
 #include "tsearch/ts_cache.h"
 #include "utils/builtins.h"
 #include "utils/bytea.h"
+#include "utils/catcache.h"
 #include "utils/guc_tables.h"
 #include "utils/memutils.h"
 #include "utils/pg_locale.h"
@@ -80,6 +95,7 @@
 #include "utils/portal.h"
 #include "utils/ps_status.h"
 #include "utils/rls.h"
+#include "utils/sharedplancache.h"
 #include "utils/snapmgr.h"
 #include "utils/tzparser.h"
 #include "utils/xml.h"
@@ -199,6 +215,14 @@ static const struct config_enum_entry bytea_output_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry default_toast_compression_options[] = {
+	{"pglz", TOAST_PGLZ_COMPRESSION, false},
+#ifdef USE_LZ4
+	{"lz4", TOAST_LZ4_COMPRESSION, false},
+#endif
+	{NULL, 0, false}
+};
+
 /*
  * We have different sets for client and server message level options because
  * they sort slightly different (see "log" level)
@@ -380,6 +404,12 @@ static const struct config_enum_entry huge_pages_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry buffer_replacement_policy_options[] = {
+	{"clock", BUFFER_REPLACEMENT_CLOCK, false},
+	{"partitioned_clock", BUFFER_REPLACEMENT_PARTITIONED_CLOCK, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry force_parallel_mode_options[] = {
 	{"off", FORCE_PARALLEL_OFF, false},
 	{"on", FORCE_PARALLEL_ON, false},
@@ -854,6 +884,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_memoize", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of memoization of parameterized inner scans."),
+			NULL
+		},
+		&enable_memoize,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_nestloop", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of nested-loop join plans."),
@@ -881,6 +920,71 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_parallel_hash", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of parallel hash plans."),
+			NULL
+		},
+		&enable_parallel_hash,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_gathermerge", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of gather merge plans."),
+			NULL
+		},
+		&enable_gathermerge,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_batch_execution", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables batch-at-a-time execution of simple aggregates over sequential scans."),
+			NULL
+		},
+		&enable_batch_execution,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"enable_async_append", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables asynchronous execution of foreign scans under append nodes."),
+			NULL
+		},
+		&enable_async_append,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"jit", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Allow JIT compilation."),
+			NULL
+		},
+		&jit_enabled,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"jit_expressions", PGC_USERSET, DEVELOPER_OPTIONS,
+			gettext_noop("Allow JIT compilation of expressions."),
+			NULL,
+			GUC_NOT_IN_SAMPLE
+		},
+		&jit_expressions,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"jit_tuple_deforming", PGC_USERSET, DEVELOPER_OPTIONS,
+			gettext_noop("Allow JIT compilation of tuple deforming."),
+			NULL,
+			GUC_NOT_IN_SAMPLE
+		},
+		&jit_tuple_deforming,
+		true,
+		NULL, NULL, NULL
+	},
 
 	{
 		{"geqo", PGC_USERSET, QUERY_TUNING_GEQO,
@@ -966,6 +1070,15 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"numa_interleave_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Interleaves shared buffers across NUMA nodes."),
+			NULL
+		},
+		&numa_interleave_buffers,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"zero_damaged_pages", PGC_SUSET, DEVELOPER_OPTIONS,
 			gettext_noop("Continues processing past damaged page headers."),
@@ -1807,6 +1920,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wal_receiver_buffer_size", PGC_SIGHUP, REPLICATION_STANDBY,
+			gettext_noop("Sets the amount of received WAL collected before it is written out."),
+			gettext_noop("Zero writes every WAL message immediately."),
+			GUC_UNIT_KB
+		},
+		&wal_receiver_buffer_size,
+		128, 0, XLOG_SEG_SIZE / 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_receiver_timeout", PGC_SIGHUP, REPLICATION_STANDBY,
 			gettext_noop("Sets the maximum wait time to receive data from the primary."),
@@ -1838,6 +1962,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"session_pool_size", PGC_SIGHUP, CONN_AUTH_SETTINGS,
+			gettext_noop("Sets the maximum number of idle backends kept for reuse by new connections."),
+			gettext_noop("Zero disables the session pool.")
+		},
+		&SessionPoolSize,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	/*
 	 * We sometimes multiply the number of shared buffers by two without
 	 * checking for overflow, so we mustn't allow more than INT_MAX / 2.
@@ -1864,6 +1998,50 @@ static struct config_int ConfigureNamesInt[] =
 		check_temp_buffers, NULL, NULL
 	},
 
+	{
+		{"clog_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers in shared memory for the transaction commit log."),
+			gettext_noop("0 sizes them based on shared_buffers."),
+			GUC_UNIT_BLOCKS
+		},
+		&clog_buffers,
+		0, 0, 8192,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"subtrans_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers in shared memory for the subtransaction log."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&subtrans_buffers,
+		32, 4, 8192,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_offset_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers in shared memory for multixact offsets."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_offset_buffers,
+		8, 4, 8192,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_member_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of buffers in shared memory for multixact members."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_member_buffers,
+		16, 4, 8192,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"port", PGC_POSTMASTER, CONN_AUTH_SETTINGS,
 			gettext_noop("Sets the TCP port the server listens on."),
@@ -1927,6 +2105,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"catcache_init_file_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the maximum size of the catalog cache contents saved for new sessions."),
+			gettext_noop("Zero disables saving the catalog cache."),
+			GUC_UNIT_KB
+		},
+		&catcache_init_file_size,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"regex_cache_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for caching compiled regular expressions."),
+			NULL,
+			GUC_UNIT_KB
+		},
+		&regex_cache_size,
+		1024, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"replacement_sort_tuples", PGC_USERSET, RESOURCES_MEM,
 			gettext_noop("Sets the maximum number of tuples to be sorted using replacement selection."),
@@ -2081,6 +2281,60 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"twophase_state_cache_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the maximum size of the state data of a prepared transaction kept in shared memory."),
+			gettext_noop("State data of larger prepared transactions is read back from WAL at COMMIT PREPARED."),
+			GUC_UNIT_KB
+		},
+		&twophase_state_cache_size,
+		2, 0, MaxAllocSize / 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_plan_cache_entries", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of generic plans kept in the shared plan cache."),
+			gettext_noop("Zero disables the shared plan cache.")
+		},
+		&shared_plan_cache_entries,
+		0, 0, INT_MAX / 2,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_plan_cache_entry_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the size of an entry of the shared plan cache."),
+			gettext_noop("Plans that don't fit in an entry are not shared."),
+			GUC_UNIT_KB
+		},
+		&shared_plan_cache_entry_size,
+		16, 1, MaxAllocSize / 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"shared_invalidation_queue_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of shared cache invalidation messages buffered."),
+			gettext_noop("Backends which fall further behind have to discard their caches "
+						 "if the messages for their database are too many to keep.")
+		},
+		&shared_invalidation_queue_size,
+		4096, 4096, MAX_SINVAL_QUEUE_SIZE,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"backend_memory_limit", PGC_SUSET, RESOURCES_MEM,
+			gettext_noop("Limits the total size of memory contexts of each process."),
+			gettext_noop("0 means no limit."),
+			GUC_UNIT_KB
+		},
+		&backend_memory_limit,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 #ifdef LOCK_DEBUG
 	{
 		{"trace_lock_oidmin", PGC_SUSET, DEVELOPER_OPTIONS,
@@ -2202,6 +2456,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_fastpath_locks", PGC_POSTMASTER, LOCK_MANAGEMENT,
+			gettext_noop("Sets the number of relation locks each backend can hold in fast-path slots."),
+			gettext_noop("The value is rounded up to a multiple of 16.")
+		},
+		&max_fastpath_locks,
+		16, 16, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_pred_locks_per_transaction", PGC_POSTMASTER, LOCK_MANAGEMENT,
 			gettext_noop("Sets the maximum number of predicate locks per transaction."),
@@ -2214,6 +2478,30 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_pred_locks_per_relation", PGC_SIGHUP, LOCK_MANAGEMENT,
+			gettext_noop("Sets the maximum number of predicate-locked pages and tuples per relation."),
+			gettext_noop("If more than this total of pages and tuples in the same relation are locked "
+						 "by a connection, those locks are replaced by a relation-level lock. "
+						 "Negative values mean max_pred_locks_per_transaction divided by "
+						 "the absolute value.")
+		},
+		&max_predicate_locks_per_relation,
+		-2, INT_MIN, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_pred_locks_per_page", PGC_SIGHUP, LOCK_MANAGEMENT,
+			gettext_noop("Sets the maximum number of predicate-locked tuples per page."),
+			gettext_noop("If more than this number of tuples on the same page are locked "
+						 "by a connection, those locks are replaced by a page-level lock.")
+		},
+		&max_predicate_locks_per_page,
+		2, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"authentication_timeout", PGC_SIGHUP, CONN_AUTH_SECURITY,
 			gettext_noop("Sets the maximum allowed time to complete client authentication."),
@@ -2316,6 +2604,16 @@ static struct config_int ConfigureNamesInt[] =
 		check_wal_buffers, NULL, NULL
 	},
 
+	{
+		{"wal_insert_locks", PGC_POSTMASTER, WAL_SETTINGS,
+			gettext_noop("Sets the number of locks allowing concurrent insertion of WAL records."),
+			gettext_noop("-1 sets it based on the number of CPUs.")
+		},
+		&XLOGinsertLocks,
+		-1, -1, 128,
+		check_wal_insert_locks, NULL, NULL
+	},
+
 	{
 		{"wal_writer_delay", PGC_SIGHUP, WAL_SETTINGS,
 			gettext_noop("Time between WAL flushes performed in the WAL writer."),
@@ -2371,6 +2669,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wal_sender_batch_size", PGC_SIGHUP, REPLICATION_SENDING,
+			gettext_noop("Sets the amount of logical replication output buffered before it is sent."),
+			gettext_noop("Zero sends every message immediately."),
+			GUC_UNIT_KB
+		},
+		&wal_sender_batch_size,
+		64, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"wal_sender_batch_delay", PGC_SIGHUP, REPLICATION_SENDING,
+			gettext_noop("Sets the maximum time to keep decoding WAL before logical replication output is sent."),
+			gettext_noop("Zero sends the output after every WAL record."),
+			GUC_UNIT_MS
+		},
+		&wal_sender_batch_delay,
+		0, 0, 10000,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"commit_delay", PGC_SUSET, WAL_SETTINGS,
 			gettext_noop("Sets the delay in microseconds between transaction commit and "
@@ -2394,6 +2714,27 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"recovery_prefetch_distance", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Sets how far ahead of replay the WAL is scanned for blocks to prefetch."),
+			gettext_noop("0 disables prefetching during recovery."),
+			GUC_UNIT_KB
+		},
+		&recovery_prefetch_distance,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"parallel_redo_workers", PGC_POSTMASTER, WAL_SETTINGS,
+			gettext_noop("Sets the number of background workers that replay WAL during crash recovery."),
+			gettext_noop("0 replays all WAL in the startup process.")
+		},
+		&parallel_redo_workers,
+		0, 0, MAX_PARALLEL_REDO_WORKERS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"extra_float_digits", PGC_USERSET, CLIENT_CONN_LOCALE,
 			gettext_noop("Sets the number of digits displayed for floating-point values."),
@@ -2478,6 +2819,21 @@ static struct config_int ConfigureNamesInt[] =
 		check_effective_io_concurrency, assign_effective_io_concurrency, NULL
 	},
 
+	{
+		{"seqscan_prefetch_distance", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Number of pages sequential scans read ahead of the page being scanned."),
+			gettext_noop("Zero relies on the readahead of the operating system."),
+			GUC_UNIT_BLOCKS
+		},
+		&seqscan_prefetch_distance,
+#ifdef USE_PREFETCH
+		0, 0, MAX_SEQSCAN_PREFETCH_DISTANCE,
+#else
+		0, 0, 0,
+#endif
+		NULL, NULL, NULL
+	},
+
 	{
 		{"backend_flush_after", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
 			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
@@ -2684,6 +3040,26 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_parallel_vacuum_workers", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel processes used to vacuum the indexes of one table."),
+			NULL
+		},
+		&max_parallel_vacuum_workers,
+		2, 0, 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_parallel_index_build_workers", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel processes used to build one B-tree or GIN index."),
+			NULL
+		},
+		&max_parallel_index_build_workers,
+		2, 0, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"autovacuum_work_mem", PGC_SIGHUP, RESOURCES_MEM,
 			gettext_noop("Sets the maximum memory to be used by each autovacuum worker process."),
@@ -2695,6 +3071,18 @@ static struct config_int ConfigureNamesInt[] =
 		check_autovacuum_work_mem, NULL, NULL
 	},
 
+	{
+		{"logical_decoding_work_mem", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for logical decoding."),
+			gettext_noop("This much memory can be used by each internal "
+						 "reorder buffer before spilling to disk."),
+			GUC_UNIT_KB
+		},
+		&logical_decoding_work_mem,
+		65536, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"old_snapshot_threshold", PGC_POSTMASTER, RESOURCES_ASYNCHRONOUS,
 			gettext_noop("Time before a snapshot is too old to read pages changed after the snapshot was taken."),
@@ -2824,6 +3212,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"stats_max_tables", PGC_POSTMASTER, STATS_COLLECTOR,
+			gettext_noop("Sets the maximum number of tables whose statistics are kept in shared memory."),
+			NULL
+		},
+		&pgstat_max_tables,
+		10000, 100, INT_MAX / 2,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"gin_pending_list_limit", PGC_USERSET, CLIENT_CONN_STATEMENT,
 			gettext_noop("Sets the maximum size of the pending list for GIN index."),
@@ -2835,6 +3233,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"foreign_key_check_batch_size", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Sets the maximum number of rows whose foreign keys are checked together."),
+			gettext_noop("A value of 1 checks every row on its own.")
+		},
+		&foreign_key_check_batch_size,
+		1024, 1, 65536,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, 0, NULL, NULL}, NULL, 0, 0, 0, NULL, NULL, NULL
@@ -2914,6 +3322,15 @@ static struct config_real ConfigureNamesReal[] =
 		DEFAULT_PARALLEL_SETUP_COST, 0, DBL_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"jit_above_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Perform JIT compilation if query is more expensive."),
+			gettext_noop("-1 disables JIT compilation.")
+		},
+		&jit_above_cost,
+		100000, -1, DBL_MAX,
+		NULL, NULL, NULL
+	},
 
 	{
 		{"cursor_tuple_fraction", PGC_USERSET, QUERY_TUNING_OTHER,
@@ -3212,6 +3629,17 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"jit_provider", PGC_POSTMASTER, CLIENT_CONN_PRELOAD,
+			gettext_noop("JIT provider to use."),
+			NULL,
+			GUC_SUPERUSER_ONLY
+		},
+		&jit_provider,
+		"llvmjit",
+		NULL, NULL, NULL
+	},
+
 	{
 		{"search_path", PGC_USERSET, CLIENT_CONN_STATEMENT,
 			gettext_noop("Sets the schema search order for names that are not schema-qualified."),
@@ -3607,6 +4035,16 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"default_toast_compression", PGC_USERSET, CLIENT_CONN_STATEMENT,
+			gettext_noop("Sets the default compression method for compressible values."),
+			gettext_noop("Used for columns that don't set the \"compression\" option.")
+		},
+		&default_toast_compression,
+		TOAST_PGLZ_COMPRESSION, default_toast_compression_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"client_min_messages", PGC_USERSET, LOGGING_WHEN,
 			gettext_noop("Sets the message levels that are sent to the client."),
@@ -3824,6 +4262,16 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"buffer_replacement_policy", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Selects the algorithm used to choose shared buffers for replacement."),
+			NULL
+		},
+		&buffer_replacement_policy,
+		BUFFER_REPLACEMENT_CLOCK, buffer_replacement_policy_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"force_parallel_mode", PGC_USERSET, QUERY_TUNING_OTHER,
 			gettext_noop("Forces use of parallel query facilities."),
@@ -8263,6 +8711,72 @@ GetNumConfigOptions(void)
 	return num_guc_variables;
 }
 
+/*
+ * Compute a hash of the current values of the settings that can affect the
+ * planner's choices, that is those in the memory, asynchronous behavior,
+ * query tuning and developer groups.  Used by the shared plan cache to tell
+ * whether a plan made by another backend could have come out differently
+ * here.
+ */
+uint32
+GetPlannerConfigHash(void)
+{
+	uint32		result = 0;
+	int			i;
+
+	for (i = 0; i < num_guc_variables; i++)
+	{
+		struct config_generic *conf = guc_variables[i];
+		uint32		h = 0;
+
+		switch (conf->group)
+		{
+			case RESOURCES_MEM:
+			case RESOURCES_ASYNCHRONOUS:
+			case QUERY_TUNING_METHOD:
+			case QUERY_TUNING_COST:
+			case QUERY_TUNING_GEQO:
+			case QUERY_TUNING_OTHER:
+			case DEVELOPER_OPTIONS:
+				break;
+			default:
+				continue;
+		}
+
+		switch (conf->vartype)
+		{
+			case PGC_BOOL:
+				h = *((struct config_bool *) conf)->variable ? 1 : 0;
+				break;
+			case PGC_INT:
+				h = (uint32) *((struct config_int *) conf)->variable;
+				break;
+			case PGC_REAL:
+				h = DatumGetUInt32(hash_any((const unsigned char *)
+											((struct config_real *) conf)->variable,
+											sizeof(double)));
+				break;
+			case PGC_STRING:
+				{
+					char	   *val = *((struct config_string *) conf)->variable;
+
+					if (val)
+						h = DatumGetUInt32(hash_any((const unsigned char *) val,
+													strlen(val)));
+				}
+				break;
+			case PGC_ENUM:
+				h = (uint32) *((struct config_enum *) conf)->variable;
+				break;
+		}
+
+		result = ((result << 1) | (result >> 31)) ^
+			DatumGetUInt32(hash_uint32(h));
+	}
+
+	return result;
+}
+
 /*
  * show_config_by_name - equiv to SHOW X command but implemented as
  * a function.
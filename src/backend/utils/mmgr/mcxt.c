@@ -51,6 +51,13 @@ MemoryContext CurTransactionContext = NULL;
 /* This is a transient link to the active portal's memory context: */
 MemoryContext PortalContext = NULL;
 
+/*
+ * Total bytes all memory contexts of this process got from malloc, and the
+ * limit on it (in kilobytes, 0 means no limit).
+ */
+Size		MemoryAllocatedTotal = 0;
+int			backend_memory_limit = 0;
+
 static void MemoryContextCallResetCallbacks(MemoryContext context);
 static void MemoryContextStatsInternal(MemoryContext context, int level,
 						   bool print, int max_children,
@@ -471,6 +478,105 @@ MemoryContextIsEmpty(MemoryContext context)
 	return (*context->methods->is_empty) (context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Bytes the context, and with recurse its descendants, got from malloc.
+ *
+ * This is cheap enough to be checked often, unlike MemoryContextStats.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total = context->mem_allocated;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
+/*
+ * MemoryContextMallocBlock
+ *		Get a block of memory for a context from malloc().
+ *
+ * Context implementations obtain all their memory through this function, so
+ * that it is accounted in the context's mem_allocated and in the process
+ * total.  Returns NULL if malloc fails, or if the block would take the
+ * process over backend_memory_limit; the caller then reports out of memory
+ * as usual.  The limit is not enforced in critical sections or while
+ * interrupts are held off, as during error recovery, nor for ErrorContext,
+ * so that an error can still be reported and cleaned up after.
+ */
+void *
+MemoryContextMallocBlock(MemoryContext context, Size size)
+{
+	void	   *block;
+
+	if (backend_memory_limit > 0 &&
+		MemoryAllocatedTotal + size > (Size) backend_memory_limit * 1024 &&
+		CritSectionCount == 0 && InterruptHoldoffCount == 0 &&
+		context != ErrorContext)
+		return NULL;
+
+	block = malloc(size);
+	if (block != NULL)
+	{
+		context->mem_allocated += size;
+		MemoryAllocatedTotal += size;
+	}
+
+	return block;
+}
+
+/*
+ * MemoryContextReallocBlock
+ *		Resize a block got from MemoryContextMallocBlock.
+ *
+ * Returns NULL, leaving the block alone, if it can't be resized.
+ */
+void *
+MemoryContextReallocBlock(MemoryContext context, void *block,
+						  Size oldsize, Size size)
+{
+	if (backend_memory_limit > 0 && size > oldsize &&
+		MemoryAllocatedTotal + (size - oldsize) > (Size) backend_memory_limit * 1024 &&
+		CritSectionCount == 0 && InterruptHoldoffCount == 0 &&
+		context != ErrorContext)
+		return NULL;
+
+	block = realloc(block, size);
+	if (block != NULL)
+	{
+		context->mem_allocated += size - oldsize;
+		MemoryAllocatedTotal += size - oldsize;
+	}
+
+	return block;
+}
+
+/*
+ * MemoryContextFreeBlock
+ *		Give back a block of the given size got from MemoryContextMallocBlock.
+ */
+void
+MemoryContextFreeBlock(MemoryContext context, void *block, Size size)
+{
+	Assert(context->mem_allocated >= size);
+
+	context->mem_allocated -= size;
+	MemoryAllocatedTotal -= size;
+	free(block);
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
@@ -110,6 +110,16 @@
  * we preread from a tape, so as to maintain the locality of access described
  * above.  Nonetheless, with large workMem we can have many tapes.
  *
+ * A sort can also be done in parallel (see SortCoordinate in tuplesort.h).
+ * Each worker tuplesort sorts its share of the input the usual way, with
+ * its share of the memory, except that its output, a single sorted run, is
+ * written to a shared BufFile: when the sort is external, the last merge
+ * pass writes into that file instead of being done on-the-fly.  The leader
+ * tuplesort then merges the workers' runs on-the-fly, keeping the frontmost
+ * tuple of each run in a heap much like the final merge of a serial sort.
+ * The logical tapes of the workers can't be handed over directly, since
+ * logtape.c keeps its block lists in backend-local memory.
+ *
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -133,6 +143,8 @@
 #include "miscadmin.h"
 #include "pg_trace.h"
 #include "utils/datum.h"
+#include "storage/buffile.h"
+#include "storage/spin.h"
 #include "utils/logtape.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
@@ -215,7 +227,9 @@ typedef enum
 	TSS_BUILDRUNS,				/* Loading tuples; writing to tape */
 	TSS_SORTEDINMEM,			/* Sort completed entirely in memory */
 	TSS_SORTEDONTAPE,			/* Sort completed, final run is on tape */
-	TSS_FINALMERGE				/* Performing final merge on-the-fly */
+	TSS_FINALMERGE,				/* Performing final merge on-the-fly */
+	TSS_WORKERDONE,				/* Worker's run written out for the leader */
+	TSS_LEADERMERGE				/* Merging the workers' runs on-the-fly */
 } TupSortStatus;
 
 /*
@@ -242,6 +256,29 @@ typedef enum
 #define HEAP_RUN_NEXT	INT_MAX
 #define RUN_SECOND		1
 
+/*
+ * Tape number that stands for a worker's shared run file in the tape I/O
+ * routines.  (The leader's inputs are numbered from 0 by participant.)
+ */
+#define TAPE_SHARED_RUN	(-1)
+
+/*
+ * Shared state of a parallel sort.  The worker tuplesorts number themselves
+ * in the order they start, and each writes its run to a shared BufFile named
+ * after the leader's PID, a counter that tells apart the parallel sorts of
+ * that leader, and the worker's number.  The leader learns from
+ * nparticipants which files there are to merge.
+ */
+struct Sharedsort
+{
+	slock_t		mutex;			/* protects the counters below */
+	int			nparticipants;	/* # of worker tuplesorts started */
+	int			nfinished;		/* # of those that wrote their run */
+	Oid			tablespace;		/* where the run files go */
+	int			leader_pid;
+	uint32		fileset;
+};
+
 typedef int (*SortTupleComparator) (const SortTuple *a, const SortTuple *b,
 												Tuplesortstate *state);
 
@@ -465,6 +502,18 @@ struct Tuplesortstate
 	/* These are specific to the index_hash subcase: */
 	uint32		hash_mask;		/* mask for sortable part of hash code */
 
+	/*
+	 * These variables are specific to parallel sorts; shared is NULL
+	 * otherwise.  A worker has a participant number, and writes its run to
+	 * sharedRun.  The leader's participant is -1; it reads the run of
+	 * participant i from sharedRuns[i].
+	 */
+	Sharedsort *shared;
+	int			participant;
+	BufFile    *sharedRun;
+	BufFile   **sharedRuns;
+	int			nSharedRuns;
+
 	/*
 	 * These variables are specific to the Datum case; they are set by
 	 * tuplesort_begin_datum and used only by the DatumTuple routines.
@@ -486,6 +535,8 @@ struct Tuplesortstate
 #define WRITETUP(state,tape,stup)	((*(state)->writetup) (state, tape, stup))
 #define READTUP(state,stup,tape,len) ((*(state)->readtup) (state, stup, tape, len))
 #define MOVETUP(dest,src,len) ((*(state)->movetup) (dest, src, len))
+#define WORKER(state)		((state)->shared && (state)->participant != -1)
+#define LEADER(state)		((state)->shared && (state)->participant == -1)
 #define LACKMEM(state)		((state)->availMem < 0 && !(state)->batchUsed)
 #define USEMEM(state,amt)	((state)->availMem -= (amt))
 #define FREEMEM(state,amt)	((state)->availMem += (amt))
@@ -538,9 +589,9 @@ struct Tuplesortstate
  */
 
 /* When using this macro, beware of double evaluation of len */
-#define LogicalTapeReadExact(tapeset, tapenum, ptr, len) \
+#define TapeReadExact(state, tapenum, ptr, len) \
 	do { \
-		if (LogicalTapeRead(tapeset, tapenum, ptr, len) != (size_t) (len)) \
+		if (tape_read(state, tapenum, ptr, len) != (size_t) (len)) \
 			elog(ERROR, "unexpected end of data"); \
 	} while(0)
 
@@ -552,7 +603,7 @@ static bool useselection(Tuplesortstate *state);
 static void inittapes(Tuplesortstate *state);
 static void selectnewtape(Tuplesortstate *state);
 static void mergeruns(Tuplesortstate *state);
-static void mergeonerun(Tuplesortstate *state);
+static void mergeonerun(Tuplesortstate *state, int destTape);
 static void beginmerge(Tuplesortstate *state, bool finalMergeBatch);
 static void batchmemtuples(Tuplesortstate *state);
 static void mergebatch(Tuplesortstate *state, int64 spacePerTape);
@@ -574,6 +625,16 @@ static void tuplesort_heap_siftup(Tuplesortstate *state, bool checkIndex);
 static void reversedirection(Tuplesortstate *state);
 static unsigned int getlen(Tuplesortstate *state, int tapenum, bool eofOK);
 static void markrunend(Tuplesortstate *state, int tapenum);
+static void tape_write(Tuplesortstate *state, int tapenum,
+		   void *ptr, size_t size);
+static size_t tape_read(Tuplesortstate *state, int tapenum,
+		  void *ptr, size_t size);
+static void initcoordinate(Tuplesortstate *state, SortCoordinate coordinate);
+static void shared_run_name(char *name, Sharedsort *shared, int participant);
+static void worker_create_run(Tuplesortstate *state);
+static void worker_freeze_run(Tuplesortstate *state);
+static void leader_takeover_runs(Tuplesortstate *state);
+static void leader_delete_runs(Tuplesortstate *state);
 static void *readtup_alloc(Tuplesortstate *state, int tapenum, Size tuplen);
 static int comparetup_heap(const SortTuple *a, const SortTuple *b,
 				Tuplesortstate *state);
@@ -896,7 +957,8 @@ Tuplesortstate *
 tuplesort_begin_index_btree(Relation heapRel,
 							Relation indexRel,
 							bool enforceUnique,
-							int workMem, bool randomAccess)
+							int workMem, SortCoordinate coordinate,
+							bool randomAccess)
 {
 	Tuplesortstate *state = tuplesort_begin_common(workMem, randomAccess);
 	ScanKey		indexScanKey;
@@ -905,6 +967,9 @@ tuplesort_begin_index_btree(Relation heapRel,
 
 	oldcontext = MemoryContextSwitchTo(state->sortcontext);
 
+	if (coordinate)
+		initcoordinate(state, coordinate);
+
 #ifdef TRACE_SORT
 	if (trace_sort)
 		elog(LOG,
@@ -950,8 +1015,12 @@ tuplesort_begin_index_btree(Relation heapRel,
 		sortKey->ssup_nulls_first =
 			(scanKey->sk_flags & SK_BT_NULLS_FIRST) != 0;
 		sortKey->ssup_attno = scanKey->sk_attno;
-		/* Convey if abbreviation optimization is applicable in principle */
-		sortKey->abbreviate = (i == 0);
+		/*
+		 * Convey if abbreviation optimization is applicable in principle.
+		 * It isn't for a parallel sort's leader, which only ever sees tuples
+		 * read back from the workers' runs.
+		 */
+		sortKey->abbreviate = (i == 0 && !LEADER(state));
 
 		AssertState(sortKey->ssup_attno != 0);
 
@@ -1005,6 +1074,64 @@ tuplesort_begin_index_hash(Relation heapRel,
 	return state;
 }
 
+Tuplesortstate *
+tuplesort_begin_index_gist(Relation heapRel,
+						   Relation indexRel,
+						   int workMem, bool randomAccess)
+{
+	Tuplesortstate *state = tuplesort_begin_common(workMem, randomAccess);
+	MemoryContext oldcontext;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(state->sortcontext);
+
+#ifdef TRACE_SORT
+	if (trace_sort)
+		elog(LOG,
+			 "begin index sort: workMem = %d, randomAccess = %c",
+			 workMem, randomAccess ? 't' : 'f');
+#endif
+
+	state->nKeys = RelationGetNumberOfAttributes(indexRel);
+
+	/* GiST build sorts index tuples like btree does, with no unique check */
+	state->comparetup = comparetup_index_btree;
+	state->copytup = copytup_index;
+	state->writetup = writetup_index;
+	state->readtup = readtup_index;
+	state->movetup = movetup_index;
+	state->abbrevNext = 10;
+
+	state->heapRel = heapRel;
+	state->indexRel = indexRel;
+	state->enforceUnique = false;
+
+	/* Prepare SortSupport data for each column */
+	state->sortKeys = (SortSupport) palloc0(state->nKeys *
+											sizeof(SortSupportData));
+
+	for (i = 0; i < state->nKeys; i++)
+	{
+		SortSupport sortKey = state->sortKeys + i;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = indexRel->rd_indcollation[i];
+		sortKey->ssup_nulls_first = false;
+		sortKey->ssup_attno = i + 1;
+		/* Convey if abbreviation optimization is applicable in principle */
+		sortKey->abbreviate = (i == 0);
+
+		AssertState(sortKey->ssup_attno != 0);
+
+		/* Look for a sort support function */
+		PrepareSortSupportFromGistIndexRel(indexRel, sortKey);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return state;
+}
+
 Tuplesortstate *
 tuplesort_begin_datum(Oid datumType, Oid sortOperator, Oid sortCollation,
 					  bool nullsFirstFlag,
@@ -1158,6 +1285,10 @@ tuplesort_end(Tuplesortstate *state)
 	 */
 	if (state->tapeset)
 		LogicalTapeSetClose(state->tapeset);
+	if (state->sharedRun)
+		BufFileClose(state->sharedRun);
+	if (LEADER(state))
+		leader_delete_runs(state);
 
 #ifdef TRACE_SORT
 	if (trace_sort)
@@ -1538,6 +1669,9 @@ tuplesort_putdatum(Tuplesortstate *state, Datum val, bool isNull)
 static void
 puttuple_common(Tuplesortstate *state, SortTuple *tuple)
 {
+	/* The leader of a parallel sort gets its input from the workers */
+	Assert(!LEADER(state));
+
 	switch (state->status)
 	{
 		case TSS_INITIAL:
@@ -1755,6 +1889,16 @@ tuplesort_performsort(Tuplesortstate *state)
 	{
 		case TSS_INITIAL:
 
+			/*
+			 * A parallel sort's leader has no tuples of its own.  It goes on
+			 * to merge the runs of the workers, which are all done by now.
+			 */
+			if (LEADER(state))
+			{
+				leader_takeover_runs(state);
+				break;
+			}
+
 			/*
 			 * We were able to accumulate all the tuples within the allowed
 			 * amount of memory.  Just qsort 'em and we're done.
@@ -1787,8 +1931,9 @@ tuplesort_performsort(Tuplesortstate *state)
 			/*
 			 * Finish tape-based sort.  First, flush all tuples remaining in
 			 * memory out to tape; then merge until we have a single remaining
-			 * run (or, if !randomAccess, one run per tape). Note that
-			 * mergeruns sets the correct state->status.
+			 * run (or, if !randomAccess, one run per tape; or, in a parallel
+			 * sort's worker, a run in the shared file). Note that mergeruns
+			 * sets the correct state->status.
 			 */
 			dumptuples(state, true);
 			mergeruns(state);
@@ -1803,6 +1948,10 @@ tuplesort_performsort(Tuplesortstate *state)
 			break;
 	}
 
+	/* A parallel sort's worker hands its sorted output over to the leader */
+	if (WORKER(state))
+		worker_freeze_run(state);
+
 #ifdef TRACE_SORT
 	if (trace_sort)
 	{
@@ -2028,6 +2177,31 @@ tuplesort_gettuple_common(Tuplesortstate *state, bool forward,
 			}
 			return false;
 
+		case TSS_LEADERMERGE:
+
+			/*
+			 * Like the final merge, except that the runs are the workers'
+			 * shared files, and we just read one tuple at a time from them:
+			 * BufFile does the buffering.
+			 */
+			Assert(forward);
+			*should_free = true;
+			if (state->memtupcount > 0)
+			{
+				int			srcRun = state->memtuples[0].tupindex;
+				SortTuple	newtup;
+
+				*stup = state->memtuples[0];
+				tuplesort_heap_siftup(state, false);
+				if ((tuplen = getlen(state, srcRun, true)) != 0)
+				{
+					READTUP(state, &newtup, srcRun, tuplen);
+					tuplesort_heap_insert(state, &newtup, srcRun, false);
+				}
+				return true;
+			}
+			return false;
+
 		default:
 			elog(ERROR, "invalid tuplesort state");
 			return false;		/* keep compiler quiet */
@@ -2280,6 +2454,222 @@ tuplesort_merge_order(int64 allowedMem)
 	return mOrder;
 }
 
+/*
+ * Parallel sort support
+ */
+
+/*
+ * tuplesort_estimate_shared - size of the shared state of a parallel sort
+ */
+Size
+tuplesort_estimate_shared(void)
+{
+	return sizeof(Sharedsort);
+}
+
+/*
+ * tuplesort_initialize_shared - set up the shared state of a parallel sort
+ *
+ * Called by the leader, before it launches the workers.
+ */
+void
+tuplesort_initialize_shared(Sharedsort *shared)
+{
+	static uint32 fileset_counter = 0;
+
+	SpinLockInit(&shared->mutex);
+	shared->nparticipants = 0;
+	shared->nfinished = 0;
+
+	/* All the runs go to the same temp tablespace */
+	PrepareTempTablespaces();
+	shared->tablespace = GetNextTempTableSpace();
+	if (!OidIsValid(shared->tablespace))
+		shared->tablespace = MyDatabaseTableSpace;
+	shared->leader_pid = MyProcPid;
+	shared->fileset = ++fileset_counter;
+}
+
+/*
+ * initcoordinate - make a tuplesort a worker or the leader of a parallel sort
+ */
+static void
+initcoordinate(Tuplesortstate *state, SortCoordinate coordinate)
+{
+	Sharedsort *shared = coordinate->sharedsort;
+
+	/* The run files can only be read from front to back */
+	if (state->randomAccess)
+		elog(ERROR, "parallel sort does not support random access");
+
+	state->shared = shared;
+	if (coordinate->isWorker)
+	{
+		SpinLockAcquire(&shared->mutex);
+		state->participant = shared->nparticipants++;
+		SpinLockRelease(&shared->mutex);
+	}
+	else
+		state->participant = -1;
+}
+
+/*
+ * shared_run_name - name of the shared BufFile holding a worker's run
+ */
+static void
+shared_run_name(char *name, Sharedsort *shared, int participant)
+{
+	snprintf(name, MAXPGPATH, "%d.sort%u.%d",
+			 shared->leader_pid, shared->fileset, participant);
+}
+
+/*
+ * worker_create_run - create the shared file for a worker's run
+ */
+static void
+worker_create_run(Tuplesortstate *state)
+{
+	char		name[MAXPGPATH];
+
+	Assert(WORKER(state) && state->sharedRun == NULL);
+
+	shared_run_name(name, state->shared, state->participant);
+	state->sharedRun = BufFileCreateShared(state->shared->tablespace, name);
+}
+
+/*
+ * worker_freeze_run - finish a worker's part of a parallel sort
+ *
+ * An external sort has already written its last merge pass to the shared
+ * file (see mergeruns); an internal sort writes out its sorted array now.
+ * The file is closed, but stays in place for the leader.
+ */
+static void
+worker_freeze_run(Tuplesortstate *state)
+{
+	int			i;
+
+	if (state->status == TSS_SORTEDINMEM)
+	{
+		worker_create_run(state);
+		for (i = 0; i < state->memtupcount; i++)
+			WRITETUP(state, TAPE_SHARED_RUN, &state->memtuples[i]);
+		state->memtupcount = 0;
+		markrunend(state, TAPE_SHARED_RUN);
+		state->status = TSS_WORKERDONE;
+	}
+	Assert(state->status == TSS_WORKERDONE);
+
+	BufFileClose(state->sharedRun);
+	state->sharedRun = NULL;
+
+	SpinLockAcquire(&state->shared->mutex);
+	state->shared->nfinished++;
+	SpinLockRelease(&state->shared->mutex);
+
+#ifdef TRACE_SORT
+	if (trace_sort)
+		elog(LOG, "parallel sort participant %d wrote its run: %s",
+			 state->participant, pg_rusage_show(&state->ru_start));
+#endif
+}
+
+/*
+ * leader_takeover_runs - start the leader's merge of the workers' runs
+ *
+ * The heap is loaded with the first tuple of each run; the rest of the merge
+ * happens on-the-fly in tuplesort_gettuple_common.  Since the workers have
+ * checked any uniqueness within their own runs, and equal tuples from
+ * different runs are bound to be compared during the merge, enforceUnique
+ * still works as in a serial sort.
+ */
+static void
+leader_takeover_runs(Tuplesortstate *state)
+{
+	Sharedsort *shared = state->shared;
+	int			nparticipants;
+	int			nfinished;
+	int			i;
+
+	SpinLockAcquire(&shared->mutex);
+	nparticipants = shared->nparticipants;
+	nfinished = shared->nfinished;
+	SpinLockRelease(&shared->mutex);
+
+	if (nfinished != nparticipants)
+		elog(ERROR, "%d of %d parallel sort participants have not finished",
+			 nparticipants - nfinished, nparticipants);
+
+	/* The heap holds at most one tuple per run */
+	if (state->memtupsize < nparticipants)
+	{
+		FREEMEM(state, GetMemoryChunkSpace(state->memtuples));
+		state->memtupsize = nparticipants;
+		state->memtuples = (SortTuple *)
+			repalloc(state->memtuples, nparticipants * sizeof(SortTuple));
+		USEMEM(state, GetMemoryChunkSpace(state->memtuples));
+	}
+
+	state->sharedRuns = (BufFile **) palloc0(Max(nparticipants, 1) *
+											 sizeof(BufFile *));
+	for (i = 0; i < nparticipants; i++)
+	{
+		char		name[MAXPGPATH];
+		unsigned int tuplen;
+
+		shared_run_name(name, shared, i);
+		state->sharedRuns[i] = BufFileOpenShared(shared->tablespace, name);
+		if (state->sharedRuns[i] == NULL)
+			elog(ERROR, "could not open parallel sort run file \"%s\"", name);
+		state->nSharedRuns++;
+
+		if ((tuplen = getlen(state, i, true)) != 0)
+		{
+			SortTuple	stup;
+
+			READTUP(state, &stup, i, tuplen);
+			tuplesort_heap_insert(state, &stup, i, false);
+		}
+	}
+
+	state->status = TSS_LEADERMERGE;
+
+#ifdef TRACE_SORT
+	if (trace_sort)
+		elog(LOG, "leader starting %d-way merge of parallel sort runs: %s",
+			 nparticipants, pg_rusage_show(&state->ru_start));
+#endif
+}
+
+/*
+ * leader_delete_runs - remove the workers' run files
+ *
+ * This covers runs the leader never got to merge, too.
+ */
+static void
+leader_delete_runs(Tuplesortstate *state)
+{
+	Sharedsort *shared = state->shared;
+	int			nparticipants;
+	int			i;
+
+	for (i = 0; i < state->nSharedRuns; i++)
+		BufFileClose(state->sharedRuns[i]);
+	state->nSharedRuns = 0;
+
+	SpinLockAcquire(&shared->mutex);
+	nparticipants = shared->nparticipants;
+	SpinLockRelease(&shared->mutex);
+
+	for (i = 0; i < nparticipants; i++)
+	{
+		char		name[MAXPGPATH];
+
+		shared_run_name(name, shared, i);
+		BufFileDeleteShared(shared->tablespace, name);
+	}
+}
+
 /*
  * useselection - determine algorithm to use to sort first run.
  *
@@ -2503,8 +2893,10 @@ mergeruns(Tuplesortstate *state)
 	 * but something we particular count on when input is presorted), we can
 	 * just use that tape as the finished output, rather than doing a useless
 	 * merge.  (This obvious optimization is not in Knuth's algorithm.)
+	 * A parallel sort's worker has to copy its run to the shared file all
+	 * the same, which the merge loop below takes care of.
 	 */
-	if (state->currentRun == RUN_SECOND)
+	if (state->currentRun == RUN_SECOND && !WORKER(state))
 	{
 		state->result_tape = state->tp_tapenum[state->destTape];
 		/* must freeze and rewind the finished output tape */
@@ -2542,6 +2934,19 @@ mergeruns(Tuplesortstate *state)
 			{
 				/* Tell logtape.c we won't be writing anymore */
 				LogicalTapeSetForgetFreeSpace(state->tapeset);
+
+				/*
+				 * A parallel sort's worker does the final merge now, into
+				 * the shared file that the leader will read.
+				 */
+				if (WORKER(state))
+				{
+					worker_create_run(state);
+					mergeonerun(state, TAPE_SHARED_RUN);
+					state->status = TSS_WORKERDONE;
+					return;
+				}
+
 				/* Initialize for the final merge pass */
 				beginmerge(state, state->tuples);
 				state->status = TSS_FINALMERGE;
@@ -2571,7 +2976,7 @@ mergeruns(Tuplesortstate *state)
 					state->tp_dummy[tapenum]--;
 			}
 			else
-				mergeonerun(state);
+				mergeonerun(state, state->tp_tapenum[state->tapeRange]);
 		}
 
 		/* Step D6: decrease level */
@@ -2618,13 +3023,12 @@ mergeruns(Tuplesortstate *state)
 /*
  * Merge one run from each input tape, except ones with dummy runs.
  *
- * This is the inner loop of Algorithm D step D5.  We know that the
- * output tape is TAPE[T].
+ * This is the inner loop of Algorithm D step D5.  The output tape is
+ * TAPE[T], or TAPE_SHARED_RUN for a worker's last merge pass.
  */
 static void
-mergeonerun(Tuplesortstate *state)
+mergeonerun(Tuplesortstate *state, int destTape)
 {
-	int			destTape = state->tp_tapenum[state->tapeRange];
 	int			srcTape;
 	int			tupIndex;
 	SortTuple  *tup;
@@ -3862,8 +4266,8 @@ getlen(Tuplesortstate *state, int tapenum, bool eofOK)
 {
 	unsigned int len;
 
-	if (LogicalTapeRead(state->tapeset, tapenum,
-						&len, sizeof(len)) != sizeof(len))
+	if (tape_read(state, tapenum,
+				  &len, sizeof(len)) != sizeof(len))
 		elog(ERROR, "unexpected end of tape");
 	if (len == 0 && !eofOK)
 		elog(ERROR, "unexpected end of data");
@@ -3875,7 +4279,35 @@ markrunend(Tuplesortstate *state, int tapenum)
 {
 	unsigned int len = 0;
 
-	LogicalTapeWrite(state->tapeset, tapenum, (void *) &len, sizeof(len));
+	tape_write(state, tapenum, (void *) &len, sizeof(len));
+}
+
+/*
+ * Write to a logical tape, or to a worker's shared run file
+ */
+static void
+tape_write(Tuplesortstate *state, int tapenum, void *ptr, size_t size)
+{
+	if (tapenum == TAPE_SHARED_RUN)
+	{
+		if (BufFileWrite(state->sharedRun, ptr, size) != size)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to parallel sort run file: %m")));
+	}
+	else
+		LogicalTapeWrite(state->tapeset, tapenum, ptr, size);
+}
+
+/*
+ * Read from a logical tape, or in the leader, from a worker's run file
+ */
+static size_t
+tape_read(Tuplesortstate *state, int tapenum, void *ptr, size_t size)
+{
+	if (state->sharedRuns)
+		return BufFileRead(state->sharedRuns[tapenum], ptr, size);
+	return LogicalTapeRead(state->tapeset, tapenum, ptr, size);
 }
 
 /*
@@ -4071,13 +4503,13 @@ writetup_heap(Tuplesortstate *state, int tapenum, SortTuple *stup)
 	/* total on-disk footprint: */
 	unsigned int tuplen = tupbodylen + sizeof(int);
 
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 (void *) &tuplen, sizeof(tuplen));
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 (void *) tupbody, tupbodylen);
+	tape_write(state, tapenum,
+			   (void *) &tuplen, sizeof(tuplen));
+	tape_write(state, tapenum,
+			   (void *) tupbody, tupbodylen);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeWrite(state->tapeset, tapenum,
-						 (void *) &tuplen, sizeof(tuplen));
+		tape_write(state, tapenum,
+				   (void *) &tuplen, sizeof(tuplen));
 
 	FREEMEM(state, GetMemoryChunkSpace(tuple));
 	heap_free_minimal_tuple(tuple);
@@ -4095,11 +4527,11 @@ readtup_heap(Tuplesortstate *state, SortTuple *stup,
 
 	/* read in the tuple proper */
 	tuple->t_len = tuplen;
-	LogicalTapeReadExact(state->tapeset, tapenum,
-						 tupbody, tupbodylen);
+	TapeReadExact(state, tapenum,
+				  tupbody, tupbodylen);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 &tuplen, sizeof(tuplen));
+		TapeReadExact(state, tapenum,
+					  &tuplen, sizeof(tuplen));
 	stup->tuple = (void *) tuple;
 	/* set up first-column key value */
 	htup.t_len = tuple->t_len + MINIMAL_TUPLE_OFFSET;
@@ -4312,15 +4744,15 @@ writetup_cluster(Tuplesortstate *state, int tapenum, SortTuple *stup)
 	unsigned int tuplen = tuple->t_len + sizeof(ItemPointerData) + sizeof(int);
 
 	/* We need to store t_self, but not other fields of HeapTupleData */
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 &tuplen, sizeof(tuplen));
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 &tuple->t_self, sizeof(ItemPointerData));
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 tuple->t_data, tuple->t_len);
+	tape_write(state, tapenum,
+			   &tuplen, sizeof(tuplen));
+	tape_write(state, tapenum,
+			   &tuple->t_self, sizeof(ItemPointerData));
+	tape_write(state, tapenum,
+			   tuple->t_data, tuple->t_len);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeWrite(state->tapeset, tapenum,
-						 &tuplen, sizeof(tuplen));
+		tape_write(state, tapenum,
+				   &tuplen, sizeof(tuplen));
 
 	FREEMEM(state, GetMemoryChunkSpace(tuple));
 	heap_freetuple(tuple);
@@ -4338,16 +4770,16 @@ readtup_cluster(Tuplesortstate *state, SortTuple *stup,
 	/* Reconstruct the HeapTupleData header */
 	tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
 	tuple->t_len = t_len;
-	LogicalTapeReadExact(state->tapeset, tapenum,
-						 &tuple->t_self, sizeof(ItemPointerData));
+	TapeReadExact(state, tapenum,
+				  &tuple->t_self, sizeof(ItemPointerData));
 	/* We don't currently bother to reconstruct t_tableOid */
 	tuple->t_tableOid = InvalidOid;
 	/* Read in the tuple body */
-	LogicalTapeReadExact(state->tapeset, tapenum,
-						 tuple->t_data, tuple->t_len);
+	TapeReadExact(state, tapenum,
+				  tuple->t_data, tuple->t_len);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 &tuplen, sizeof(tuplen));
+		TapeReadExact(state, tapenum,
+					  &tuplen, sizeof(tuplen));
 	stup->tuple = (void *) tuple;
 	/* set up first-column key value, if it's a simple column */
 	if (state->indexInfo->ii_KeyAttrNumbers[0] != 0)
@@ -4629,13 +5061,13 @@ writetup_index(Tuplesortstate *state, int tapenum, SortTuple *stup)
 	unsigned int tuplen;
 
 	tuplen = IndexTupleSize(tuple) + sizeof(tuplen);
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 (void *) &tuplen, sizeof(tuplen));
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 (void *) tuple, IndexTupleSize(tuple));
+	tape_write(state, tapenum,
+			   (void *) &tuplen, sizeof(tuplen));
+	tape_write(state, tapenum,
+			   (void *) tuple, IndexTupleSize(tuple));
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeWrite(state->tapeset, tapenum,
-						 (void *) &tuplen, sizeof(tuplen));
+		tape_write(state, tapenum,
+				   (void *) &tuplen, sizeof(tuplen));
 
 	FREEMEM(state, GetMemoryChunkSpace(tuple));
 	pfree(tuple);
@@ -4648,11 +5080,11 @@ readtup_index(Tuplesortstate *state, SortTuple *stup,
 	unsigned int tuplen = len - sizeof(unsigned int);
 	IndexTuple	tuple = (IndexTuple) readtup_alloc(state, tapenum, tuplen);
 
-	LogicalTapeReadExact(state->tapeset, tapenum,
-						 tuple, tuplen);
+	TapeReadExact(state, tapenum,
+				  tuple, tuplen);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 &tuplen, sizeof(tuplen));
+		TapeReadExact(state, tapenum,
+					  &tuplen, sizeof(tuplen));
 	stup->tuple = (void *) tuple;
 	/* set up first-column key value */
 	stup->datum1 = index_getattr(tuple,
@@ -4725,13 +5157,13 @@ writetup_datum(Tuplesortstate *state, int tapenum, SortTuple *stup)
 
 	writtenlen = tuplen + sizeof(unsigned int);
 
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 (void *) &writtenlen, sizeof(writtenlen));
-	LogicalTapeWrite(state->tapeset, tapenum,
-					 waddr, tuplen);
+	tape_write(state, tapenum,
+			   (void *) &writtenlen, sizeof(writtenlen));
+	tape_write(state, tapenum,
+			   waddr, tuplen);
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeWrite(state->tapeset, tapenum,
-						 (void *) &writtenlen, sizeof(writtenlen));
+		tape_write(state, tapenum,
+				   (void *) &writtenlen, sizeof(writtenlen));
 
 	if (stup->tuple)
 	{
@@ -4756,8 +5188,8 @@ readtup_datum(Tuplesortstate *state, SortTuple *stup,
 	else if (!state->tuples)
 	{
 		Assert(tuplen == sizeof(Datum));
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 &stup->datum1, tuplen);
+		TapeReadExact(state, tapenum,
+					  &stup->datum1, tuplen);
 		stup->isnull1 = false;
 		stup->tuple = NULL;
 	}
@@ -4765,16 +5197,16 @@ readtup_datum(Tuplesortstate *state, SortTuple *stup,
 	{
 		void	   *raddr = readtup_alloc(state, tapenum, tuplen);
 
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 raddr, tuplen);
+		TapeReadExact(state, tapenum,
+					  raddr, tuplen);
 		stup->datum1 = PointerGetDatum(raddr);
 		stup->isnull1 = false;
 		stup->tuple = raddr;
 	}
 
 	if (state->randomAccess)	/* need trailing length word? */
-		LogicalTapeReadExact(state->tapeset, tapenum,
-							 &tuplen, sizeof(tuplen));
+		TapeReadExact(state, tapenum,
+					  &tuplen, sizeof(tuplen));
 }
 
 static void
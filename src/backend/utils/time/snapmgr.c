@@ -596,6 +596,8 @@ SetTransactionSnapshot(Snapshot sourcesnap, TransactionId sourcexid,
 		   sourcesnap->subxcnt * sizeof(TransactionId));
 	CurrentSnapshot->suboverflowed = sourcesnap->suboverflowed;
 	CurrentSnapshot->takenDuringRecovery = sourcesnap->takenDuringRecovery;
+	/* contents no longer match what GetSnapshotData last computed */
+	CurrentSnapshot->snapXactCompletionCount = 0;
 	/* NB: curcid should NOT be copied, it's a local matter */
 
 	/*
@@ -2100,6 +2102,7 @@ RestoreSnapshot(char *start_address)
 	snapshot->curcid = serialized_snapshot.curcid;
 	snapshot->whenTaken = serialized_snapshot.whenTaken;
 	snapshot->lsn = serialized_snapshot.lsn;
+	snapshot->snapXactCompletionCount = 0;
 
 	/* Copy XIDs, if present. */
 	if (serialized_snapshot.xcnt > 0)
@@ -82,6 +82,9 @@ SnapshotData SnapshotAnyData = {HeapTupleSatisfiesAny};
 
 /* local functions */
 static bool XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
+static inline bool XidInMVCCSnapshotMemo(TransactionId xid, Snapshot snapshot,
+					  XidVisibilityMemo *memo);
+static void XidVisibilityMemoQueue(XidVisibilityMemo *memo, TransactionId xid);
 
 /*
  * SetHintBits()
@@ -960,9 +963,9 @@ HeapTupleSatisfiesDirty(HeapTuple htup, Snapshot snapshot,
  * inserting/deleting transaction was still running --- which was more cycles
  * and more contention on the PGXACT array.
  */
-bool
-HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
-					   Buffer buffer)
+static inline bool
+HeapTupleSatisfiesMVCCInternal(HeapTuple htup, Snapshot snapshot,
+							   Buffer buffer, XidVisibilityMemo *memo)
 {
 	HeapTupleHeader tuple = htup->t_data;
 
@@ -981,7 +984,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 
 			if (TransactionIdIsCurrentTransactionId(xvac))
 				return false;
-			if (!XidInMVCCSnapshot(xvac, snapshot))
+			if (!XidInMVCCSnapshotMemo(xvac, snapshot, memo))
 			{
 				if (TransactionIdDidCommit(xvac))
 				{
@@ -1001,7 +1004,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 
 			if (!TransactionIdIsCurrentTransactionId(xvac))
 			{
-				if (XidInMVCCSnapshot(xvac, snapshot))
+				if (XidInMVCCSnapshotMemo(xvac, snapshot, memo))
 					return false;
 				if (TransactionIdDidCommit(xvac))
 					SetHintBits(tuple, buffer, HEAP_XMIN_COMMITTED,
@@ -1057,7 +1060,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 			else
 				return false;	/* deleted before scan started */
 		}
-		else if (XidInMVCCSnapshot(HeapTupleHeaderGetRawXmin(tuple), snapshot))
+		else if (XidInMVCCSnapshotMemo(HeapTupleHeaderGetRawXmin(tuple), snapshot, memo))
 			return false;
 		else if (TransactionIdDidCommit(HeapTupleHeaderGetRawXmin(tuple)))
 			SetHintBits(tuple, buffer, HEAP_XMIN_COMMITTED,
@@ -1075,7 +1078,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 	{
 		/* xmin is committed, but maybe not according to our snapshot */
 		if (!HeapTupleHeaderXminFrozen(tuple) &&
-			XidInMVCCSnapshot(HeapTupleHeaderGetRawXmin(tuple), snapshot))
+			XidInMVCCSnapshotMemo(HeapTupleHeaderGetRawXmin(tuple), snapshot, memo))
 			return false;		/* treat as still in progress */
 	}
 
@@ -1106,7 +1109,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 			else
 				return false;	/* deleted before scan started */
 		}
-		if (XidInMVCCSnapshot(xmax, snapshot))
+		if (XidInMVCCSnapshotMemo(xmax, snapshot, memo))
 			return true;
 		if (TransactionIdDidCommit(xmax))
 			return false;		/* updating transaction committed */
@@ -1124,7 +1127,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 				return false;	/* deleted before scan started */
 		}
 
-		if (XidInMVCCSnapshot(HeapTupleHeaderGetRawXmax(tuple), snapshot))
+		if (XidInMVCCSnapshotMemo(HeapTupleHeaderGetRawXmax(tuple), snapshot, memo))
 			return true;
 
 		if (!TransactionIdDidCommit(HeapTupleHeaderGetRawXmax(tuple)))
@@ -1143,7 +1146,7 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 	else
 	{
 		/* xmax is committed, but maybe not according to our snapshot */
-		if (XidInMVCCSnapshot(HeapTupleHeaderGetRawXmax(tuple), snapshot))
+		if (XidInMVCCSnapshotMemo(HeapTupleHeaderGetRawXmax(tuple), snapshot, memo))
 			return true;		/* treat as still in progress */
 	}
 
@@ -1153,6 +1156,32 @@ HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
 }
 
 
+bool
+HeapTupleSatisfiesMVCC(HeapTuple htup, Snapshot snapshot,
+					   Buffer buffer)
+{
+	return HeapTupleSatisfiesMVCCInternal(htup, snapshot, buffer, NULL);
+}
+
+/*
+ * HeapTupleSatisfiesMVCCMemo
+ *		Same as HeapTupleSatisfiesMVCC, but looks up the snapshot status of
+ *		xmin and xmax in the given memo before asking the transaction manager.
+ *
+ * The memo must have been created for this snapshot.  Page-at-a-time heap
+ * scans fill it with XidVisibilityMemoQueueTuple and XidVisibilityMemoFlush
+ * before checking the tuples of a page.
+ */
+bool
+HeapTupleSatisfiesMVCCMemo(HeapTuple htup, Snapshot snapshot,
+						   Buffer buffer, XidVisibilityMemo *memo)
+{
+	Assert(memo == NULL || memo->snapshot == snapshot);
+
+	return HeapTupleSatisfiesMVCCInternal(htup, snapshot, buffer, memo);
+}
+
+
 /*
  * HeapTupleSatisfiesVacuum
  *
@@ -1462,6 +1491,161 @@ XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 	return TM->IsInSnapshot(xid, snapshot);
 }
 
+/*
+ * XidInMVCCSnapshotMemo
+ *		XidInMVCCSnapshot, answered from the memo if it knows the XID.
+ */
+static inline bool
+XidInMVCCSnapshotMemo(TransactionId xid, Snapshot snapshot,
+					  XidVisibilityMemo *memo)
+{
+	if (memo != NULL)
+	{
+		int			slot = xid % XID_VISIBILITY_MEMO_SIZE;
+
+		if (memo->xids[slot] == xid)
+			return memo->inSnapshot[slot];
+	}
+	return XidInMVCCSnapshot(xid, snapshot);
+}
+
+/*
+ * CreateXidVisibilityMemo
+ *		Create a memo of XidInMVCCSnapshot results for the given snapshot.
+ *
+ * With the standard transaction manager XidInMVCCSnapshot is a cheap check
+ * against the snapshot's own arrays, and a memo would only add overhead, so
+ * NULL is returned in that case and for non-MVCC snapshots.  A distributed
+ * transaction manager may have to consult remote state or wait for in-doubt
+ * transactions, so asking it once per distinct XID, in batches, pays off.
+ */
+XidVisibilityMemo *
+CreateXidVisibilityMemo(Snapshot snapshot)
+{
+	XidVisibilityMemo *memo;
+
+	if (snapshot == NULL || snapshot->satisfies != HeapTupleSatisfiesMVCC ||
+		TM->IsInSnapshot == PgXidInMVCCSnapshot)
+		return NULL;
+
+	memo = (XidVisibilityMemo *) palloc(sizeof(XidVisibilityMemo));
+	ResetXidVisibilityMemo(memo, snapshot);
+	return memo;
+}
+
+/*
+ * ResetXidVisibilityMemo
+ *		Forget all remembered XIDs and bind the memo to a new snapshot.
+ */
+void
+ResetXidVisibilityMemo(XidVisibilityMemo *memo, Snapshot snapshot)
+{
+	StaticAssertStmt(InvalidTransactionId == 0,
+					 "memo relies on zeroed slots being invalid");
+
+	memo->snapshot = snapshot;
+	memo->nbatch = 0;
+	memset(memo->xids, 0, sizeof(memo->xids));
+}
+
+/*
+ * XidVisibilityMemoQueue
+ *		Schedule the XID for the next XidVisibilityMemoFlush, unless the memo
+ *		already knows it.
+ */
+static void
+XidVisibilityMemoQueue(XidVisibilityMemo *memo, TransactionId xid)
+{
+	if (!TransactionIdIsNormal(xid) ||
+		memo->xids[xid % XID_VISIBILITY_MEMO_SIZE] == xid)
+		return;
+
+	/* consecutive tuples usually come from the same transaction */
+	if (memo->nbatch > 0 && memo->batch[memo->nbatch - 1] == xid)
+		return;
+
+	if (memo->nbatch == XID_VISIBILITY_MEMO_SIZE)
+		XidVisibilityMemoFlush(memo);
+	memo->batch[memo->nbatch++] = xid;
+}
+
+/*
+ * XidVisibilityMemoQueueTuple
+ *		Schedule the XIDs that HeapTupleSatisfiesMVCC may have to check
+ *		against the snapshot for the given tuple.
+ *
+ * This mirrors the hint bit tests of HeapTupleSatisfiesMVCC, so that XIDs
+ * that are known to be committed-and-frozen, aborted or our own are not sent
+ * to the transaction manager.  The caller must hold at least a share lock on
+ * the tuple's buffer.  Queueing an XID which turns out not to be consulted is
+ * harmless; missing one only means it is checked individually later.
+ */
+void
+XidVisibilityMemoQueueTuple(XidVisibilityMemo *memo, HeapTupleHeader tuple)
+{
+	uint16		infomask = tuple->t_infomask;
+
+	if (HeapTupleHeaderXminInvalid(tuple))
+		return;
+
+	if (!(infomask & (HEAP_MOVED_OFF | HEAP_MOVED_IN)))
+	{
+		TransactionId xmin = HeapTupleHeaderGetRawXmin(tuple);
+
+		if (!HeapTupleHeaderXminFrozen(tuple) &&
+			((infomask & HEAP_XMIN_COMMITTED) ||
+			 !TransactionIdIsCurrentTransactionId(xmin)))
+			XidVisibilityMemoQueue(memo, xmin);
+	}
+
+	if (!(infomask & HEAP_XMAX_INVALID) &&
+		!HEAP_XMAX_IS_LOCKED_ONLY(infomask) &&
+		!(infomask & HEAP_XMAX_IS_MULTI))
+	{
+		TransactionId xmax = HeapTupleHeaderGetRawXmax(tuple);
+
+		if ((infomask & HEAP_XMAX_COMMITTED) ||
+			!TransactionIdIsCurrentTransactionId(xmax))
+			XidVisibilityMemoQueue(memo, xmax);
+	}
+}
+
+/*
+ * XidVisibilityMemoFlush
+ *		Ask the transaction manager about all queued XIDs and remember the
+ *		answers.
+ *
+ * This may block inside the transaction manager, so callers should not hold
+ * buffer locks.
+ */
+void
+XidVisibilityMemoFlush(XidVisibilityMemo *memo)
+{
+	int			i;
+
+	if (memo->nbatch == 0)
+		return;
+
+	if (TM->IsInSnapshotBatch != NULL)
+		TM->IsInSnapshotBatch(memo->nbatch, memo->batch,
+							  memo->batchInSnapshot, memo->snapshot);
+	else
+	{
+		for (i = 0; i < memo->nbatch; i++)
+			memo->batchInSnapshot[i] = TM->IsInSnapshot(memo->batch[i],
+														memo->snapshot);
+	}
+
+	for (i = 0; i < memo->nbatch; i++)
+	{
+		int			slot = memo->batch[i] % XID_VISIBILITY_MEMO_SIZE;
+
+		memo->xids[slot] = memo->batch[i];
+		memo->inSnapshot[slot] = memo->batchInSnapshot[i];
+	}
+	memo->nbatch = 0;
+}
+
 /*
  * XidInMVCCSnapshot
  *		Is the given XID still-in-progress according to the snapshot?
@@ -1584,6 +1768,21 @@ PgXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 	return false;
 }
 
+/*
+ * PgXidInMVCCSnapshotBatch
+ *		Batch variant of PgXidInMVCCSnapshot, for transaction managers that
+ *		want to fall back to the local snapshot check.
+ */
+void
+PgXidInMVCCSnapshotBatch(int nxids, TransactionId *xids, bool *inSnapshot,
+						 Snapshot snapshot)
+{
+	int			i;
+
+	for (i = 0; i < nxids; i++)
+		inSnapshot[i] = PgXidInMVCCSnapshot(xids[i], snapshot);
+}
+
 /*
  * Is the tuple really only locked?  That is, is it not updated?
  *
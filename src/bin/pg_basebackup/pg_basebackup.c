@@ -26,6 +26,9 @@
 #ifdef HAVE_LIBZ
 #include <zlib.h>
 #endif
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
 
 #include "common/string.h"
 #include "getopt_long.h"
@@ -40,6 +43,9 @@
 
 #define atooid(x)  ((Oid) strtoul((x), NULL, 10))
 
+/* Size of the pieces of server-compressed tar streams we process at once */
+#define TAR_RECEIVE_SIZE 65536
+
 typedef struct TablespaceListCell
 {
 	struct TablespaceListCell *next;
@@ -69,6 +75,8 @@ static bool writerecoveryconf = false;
 static int	standby_message_timeout = 10 * 1000;		/* 10 sec = default */
 static pg_time_t last_progress_report = 0;
 static int32 maxrate = 0;		/* no limit by default */
+static BackupCompression server_compression = BACKUP_COMPRESSION_NONE;
+static int	server_compresslevel = 0;
 
 
 /* Progress counters */
@@ -96,12 +104,27 @@ static volatile LONG has_xlogendptr = 0;
 /* Contents of recovery.conf to be generated */
 static PQExpBuffer recoveryconfcontents = NULL;
 
+/* Last CopyData message received, see GetCopyData() */
+static char *copymsg = NULL;
+
+#ifdef USE_LZ4
+/* Decompression state for server-compressed tar streams */
+static LZ4F_decompressionContext_t lz4_dctx = NULL;
+static int	copymsg_len = 0;
+static int	copymsg_pos = 0;
+static bool copy_ended = false;
+static size_t lz4_hint = 0;
+static char *decompress_buf = NULL;
+static int	decompress_buflen = 0;
+#endif
+
 /* Function headers */
 static void usage(void);
 static void disconnect_and_exit(int code);
 static void verify_dir_is_empty_or_create(char *dirname);
 static void progress_report(int tablespacenum, const char *filename, bool force);
 
+static int	GetCopyData(PGconn *conn, char **buffer, int maxlen);
 static void ReceiveTarFile(PGconn *conn, PGresult *res, int rownum);
 static void ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum);
 static void GenerateRecoveryConf(PGconn *conn);
@@ -250,6 +273,8 @@ usage(void)
 	printf(_("      --xlogdir=XLOGDIR  location for the transaction log directory\n"));
 	printf(_("  -z, --gzip             compress tar output\n"));
 	printf(_("  -Z, --compress=0-9     compress tar output with given compression level\n"));
+	printf(_("      --server-compress=lz4[:LEVEL]\n"
+			 "                         compress the data sent by the server\n"));
 	printf(_("\nGeneral options:\n"));
 	printf(_("  -c, --checkpoint=fast|spread\n"
 			 "                         set fast or spread checkpointing\n"));
@@ -641,6 +666,44 @@ progress_report(int tablespacenum, const char *filename, bool force)
 	fprintf(stderr, "\r");
 }
 
+/*
+ * Parse the argument of --server-compress, METHOD[:LEVEL]
+ */
+static void
+parse_server_compress(char *src)
+{
+	char	   *sep = strchr(src, ':');
+	size_t		methodlen = sep ? sep - src : strlen(src);
+
+	if (methodlen == 3 && pg_strncasecmp(src, "lz4", 3) == 0)
+		server_compression = BACKUP_COMPRESSION_LZ4;
+	else
+	{
+		fprintf(stderr,
+				_("%s: invalid server compression method \"%s\", must be \"lz4\"\n"),
+				progname, src);
+		exit(1);
+	}
+
+	if (sep != NULL)
+	{
+		char	   *endptr;
+		long		level;
+
+		errno = 0;
+		level = strtol(sep + 1, &endptr, 10);
+		if (errno != 0 || endptr == sep + 1 || *endptr != '\0' ||
+			level < 0 || level > 12)
+		{
+			fprintf(stderr,
+					_("%s: invalid server compression level \"%s\", must be between 0 and 12\n"),
+					progname, sep + 1);
+			exit(1);
+		}
+		server_compresslevel = (int) level;
+	}
+}
+
 static int32
 parse_max_rate(char *src)
 {
@@ -733,6 +796,116 @@ parse_max_rate(char *src)
 	return (int32) result;
 }
 
+/*
+ * Get the next piece of the current tar stream, like PQgetCopyData().
+ *
+ * Without server-side compression, this returns the CopyData messages as
+ * they come; the server sends tar headers and padding in messages of their
+ * own, which ReceiveAndUnpackTarFile() relies on.  With it, the stream is
+ * decompressed and returned in pieces of maxlen bytes, fewer only at the
+ * end of the stream, so that the same holds.
+ *
+ * The returned buffer is valid until the next call.
+ */
+static int
+GetCopyData(PGconn *conn, char **buffer, int maxlen)
+{
+	int			r;
+#ifdef USE_LZ4
+	int			len = 0;
+#endif
+
+	if (server_compression == BACKUP_COMPRESSION_NONE)
+	{
+		if (copymsg != NULL)
+		{
+			PQfreemem(copymsg);
+			copymsg = NULL;
+		}
+		r = PQgetCopyData(conn, &copymsg, 0);
+		*buffer = copymsg;
+		return r;
+	}
+
+#ifdef USE_LZ4
+	if (lz4_dctx == NULL)
+	{
+		LZ4F_errorCode_t err;
+
+		err = LZ4F_createDecompressionContext(&lz4_dctx, LZ4F_VERSION);
+		if (LZ4F_isError(err))
+		{
+			fprintf(stderr,
+					_("%s: could not create LZ4 decompression context: %s\n"),
+					progname, LZ4F_getErrorName(err));
+			disconnect_and_exit(1);
+		}
+	}
+	if (decompress_buflen < maxlen)
+	{
+		decompress_buf = pg_realloc(decompress_buf, maxlen);
+		decompress_buflen = maxlen;
+	}
+
+	while (len < maxlen && !copy_ended)
+	{
+		size_t		dstsize;
+		size_t		srcsize;
+
+		if (copymsg_pos == copymsg_len)
+		{
+			if (copymsg != NULL)
+			{
+				PQfreemem(copymsg);
+				copymsg = NULL;
+			}
+			copymsg_len = copymsg_pos = 0;
+
+			r = PQgetCopyData(conn, &copymsg, 0);
+			if (r == -2)
+				return -2;
+			if (r == -1)
+			{
+				if (lz4_hint != 0)
+				{
+					fprintf(stderr,
+							_("%s: compressed COPY stream ended unexpectedly\n"),
+							progname);
+					disconnect_and_exit(1);
+				}
+				copy_ended = true;
+				break;
+			}
+			copymsg_len = r;
+		}
+
+		dstsize = maxlen - len;
+		srcsize = copymsg_len - copymsg_pos;
+		lz4_hint = LZ4F_decompress(lz4_dctx, decompress_buf + len, &dstsize,
+								   copymsg + copymsg_pos, &srcsize, NULL);
+		if (LZ4F_isError(lz4_hint))
+		{
+			fprintf(stderr, _("%s: could not decompress COPY data: %s\n"),
+					progname, LZ4F_getErrorName(lz4_hint));
+			disconnect_and_exit(1);
+		}
+		len += dstsize;
+		copymsg_pos += srcsize;
+	}
+
+	*buffer = decompress_buf;
+	if (len > 0)
+		return len;
+
+	/* end of this stream; get ready for the next one */
+	copy_ended = false;
+	return -1;
+#else
+	/* can't happen, rejected in main() */
+	return -2;
+#endif
+}
+
 /*
  * Write a piece of tar data
  */
@@ -920,13 +1093,7 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 	{
 		int			r;
 
-		if (copybuf != NULL)
-		{
-			PQfreemem(copybuf);
-			copybuf = NULL;
-		}
-
-		r = PQgetCopyData(conn, &copybuf, 0);
+		r = GetCopyData(conn, &copybuf, TAR_RECEIVE_SIZE);
 		if (r == -1)
 		{
 			/*
@@ -1117,9 +1284,6 @@ ReceiveTarFile(PGconn *conn, PGresult *res, int rownum)
 		progress_report(rownum, filename, false);
 	}							/* while (1) */
 	progress_report(rownum, filename, true);
-
-	if (copybuf != NULL)
-		PQfreemem(copybuf);
 }
 
 
@@ -1184,13 +1348,17 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 	{
 		int			r;
 
-		if (copybuf != NULL)
-		{
-			PQfreemem(copybuf);
-			copybuf = NULL;
-		}
-
-		r = PQgetCopyData(conn, &copybuf, 0);
+		/*
+		 * Ask for exactly as much as we expect the server to send in one
+		 * message: a tar header, file data, or the file's padding.
+		 */
+		if (file == NULL)
+			r = GetCopyData(conn, &copybuf, 512);
+		else if (current_len_left > 0)
+			r = GetCopyData(conn, &copybuf,
+							(int) Min(current_len_left, TAR_RECEIVE_SIZE));
+		else
+			r = GetCopyData(conn, &copybuf, current_padding);
 
 		if (r == -1)
 		{
@@ -1391,9 +1559,6 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 		disconnect_and_exit(1);
 	}
 
-	if (copybuf != NULL)
-		PQfreemem(copybuf);
-
 	if (basetablespace && writerecoveryconf)
 		WriteRecoveryConf();
 }
@@ -1604,6 +1769,7 @@ BaseBackup(void)
 	char	   *basebkp;
 	char		escaped_label[MAXPGPATH];
 	char	   *maxrate_clause = NULL;
+	char	   *compression_clause = NULL;
 	int			i;
 	char		xlogstart[64];
 	char		xlogend[64];
@@ -1665,6 +1831,10 @@ BaseBackup(void)
 	if (maxrate > 0)
 		maxrate_clause = psprintf("MAX_RATE %u", maxrate);
 
+	if (server_compression == BACKUP_COMPRESSION_LZ4)
+		compression_clause = psprintf("COMPRESSION 'lz4' COMPRESSION_LEVEL %d",
+									  server_compresslevel);
+
 	if (verbose)
 		fprintf(stderr,
 				_("%s: initiating base backup, waiting for checkpoint to complete\n"),
@@ -1674,14 +1844,15 @@ BaseBackup(void)
 		fprintf(stderr, "waiting for checkpoint\r");
 
 	basebkp =
-		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s",
+		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s %s",
 				 escaped_label,
 				 showprogress ? "PROGRESS" : "",
 				 includewal && !streamwal ? "WAL" : "",
 				 fastcheckpoint ? "FAST" : "",
 				 includewal ? "NOWAIT" : "",
 				 maxrate_clause ? maxrate_clause : "",
-				 format == 't' ? "TABLESPACE_MAP" : "");
+				 format == 't' ? "TABLESPACE_MAP" : "",
+				 compression_clause ? compression_clause : "");
 
 	if (PQsendQuery(conn, basebkp) == 0)
 	{
@@ -1982,6 +2153,7 @@ main(int argc, char **argv)
 		{"verbose", no_argument, NULL, 'v'},
 		{"progress", no_argument, NULL, 'P'},
 		{"xlogdir", required_argument, NULL, 1},
+		{"server-compress", required_argument, NULL, 2},
 		{NULL, 0, NULL, 0}
 	};
 	int			c;
@@ -2078,6 +2250,9 @@ main(int argc, char **argv)
 			case 1:
 				xlog_dir = pg_strdup(optarg);
 				break;
+			case 2:
+				parse_server_compress(optarg);
+				break;
 			case 'l':
 				label = pg_strdup(optarg);
 				break;
@@ -2244,6 +2419,16 @@ main(int argc, char **argv)
 	}
 #endif
 
+#ifndef USE_LZ4
+	if (server_compression == BACKUP_COMPRESSION_LZ4)
+	{
+		fprintf(stderr,
+				_("%s: this build does not support LZ4 compression\n"),
+				progname);
+		exit(1);
+	}
+#endif
+
 	/*
 	 * Verify that the target directory exists, or create it. For plaintext
 	 * backups, always require the directory. For tar backups, require it
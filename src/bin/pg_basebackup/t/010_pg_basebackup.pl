@@ -4,7 +4,7 @@ use Cwd;
 use Config;
 use PostgresNode;
 use TestLib;
-use Test::More tests => 52;
+use Test::More tests => 54;
 
 program_help_ok('pg_basebackup');
 program_version_ok('pg_basebackup');
@@ -86,6 +86,14 @@ $node->command_fails(
 $node->command_fails(
 	[ 'pg_basebackup', '-D', "$tempdir/backup_foo", '-Fp', "-Tfoo" ],
 	'-T with invalid format fails');
+$node->command_fails(
+	[   'pg_basebackup', '-D', "$tempdir/backup_foo",
+		'--server-compress=zip' ],
+	'--server-compress with invalid method fails');
+$node->command_fails(
+	[   'pg_basebackup', '-D', "$tempdir/backup_foo",
+		'--server-compress=lz4:13' ],
+	'--server-compress with invalid level fails');
 
 # Tar format doesn't support filenames longer than 100 bytes.
 my $superlongname = "superlongname_" . ("x" x 100);
@@ -0,0 +1,70 @@
+use strict;
+use warnings;
+use Archive::Tar;
+use PostgresNode;
+use TestLib;
+use Test::More tests => 9;
+
+my $tempdir = TestLib::tempdir;
+
+my $node = get_new_node('main');
+$node->init(allows_streaming => 1);
+$node->start;
+
+$node->safe_psql(
+	'postgres', q{
+	CREATE TABLE backup_data AS
+		SELECT g AS id, repeat(md5(g::text), 20) AS payload
+		FROM generate_series(1, 20000) g;
+});
+
+my $check_query =
+  q{SELECT count(*), md5(string_agg(payload, ',' ORDER BY id)) FROM backup_data};
+my $expected = $node->safe_psql('postgres', $check_query);
+
+# Plain format backup, compressed by the server and decompressed on arrival
+my $backup_path = $node->backup_dir . '/lz4_plain';
+my $stderr      = '';
+my $result      = run_log(
+	[   'pg_basebackup', '-p', $node->port, '-D', $backup_path, '-X',
+		'fetch', '--server-compress=lz4' ],
+	'2>', \$stderr);
+
+SKIP:
+{
+	skip "LZ4 not supported by this build", 9
+	  if $stderr =~ /does not support LZ4 compression/;
+
+	ok($result, 'plain format backup with server-side LZ4 compression');
+	ok(-f "$backup_path/PG_VERSION", 'backup was created');
+
+	my $restored = get_new_node('restored');
+	$restored->init_from_backup($node, 'lz4_plain');
+	$restored->start;
+	is($restored->safe_psql('postgres', $check_query),
+		$expected, 'node started from the backup has the same data');
+	$restored->stop;
+
+	# Tar format, with a compression level selecting LZ4 HC
+	$node->command_ok(
+		[   'pg_basebackup', '-D', "$tempdir/lz4_tar", '-Ft',
+			'--server-compress=lz4:9' ],
+		'tar format backup with server-side LZ4 compression');
+	ok(-f "$tempdir/lz4_tar/base.tar", 'backup tar was created');
+	my $tar = Archive::Tar->new("$tempdir/lz4_tar/base.tar");
+	ok($tar && $tar->contains_file('PG_VERSION'),
+		'backup tar can be read');
+
+	# -R injects recovery.conf into the decompressed stream
+	$node->command_ok(
+		[   'pg_basebackup', '-D', "$tempdir/lz4_tar_R", '-Ft', '-R',
+			'--server-compress=lz4' ],
+		'tar format backup with -R and server-side LZ4 compression');
+	$tar = Archive::Tar->new("$tempdir/lz4_tar_R/base.tar");
+	ok($tar && $tar->contains_file('recovery.conf'),
+		'recovery.conf was added to the backup tar');
+	like(
+		$tar ? $tar->get_content('recovery.conf') : '',
+		qr/^standby_mode = 'on'\n/m,
+		'recovery.conf sets standby_mode');
+}
@@ -15,6 +15,11 @@
  * the second API uses gzip headers, so the resulting files can be easily
  * manipulated with the gzip utility.
  *
+ * Alternatively, both APIs can use LZ4, which compresses several times
+ * faster than zlib at the cost of a somewhat worse ratio.  The data is
+ * written in the LZ4 frame format, so files written by the second API can
+ * be manipulated with the lz4 utility.
+ *
  * Compressor API
  * --------------
  *
@@ -41,10 +46,10 @@
  *	libz's gzopen() APIs. It allows you to use the same functions for
  *	compressed and uncompressed streams. cfopen_read() first tries to open
  *	the file with given name, and if it fails, it tries to open the same
- *	file with the .gz suffix. cfopen_write() opens a file for writing, an
- *	extra argument specifies if the file should be compressed, and adds the
- *	.gz suffix to the filename if so. This allows you to easily handle both
- *	compressed and uncompressed files.
+ *	file with the .gz and then the .lz4 suffix. cfopen_write() opens a file
+ *	for writing, an extra argument specifies if the file should be
+ *	compressed, and adds the .gz or .lz4 suffix to the filename if so. This
+ *	allows you to easily handle both compressed and uncompressed files.
  *
  * IDENTIFICATION
  *	   src/bin/pg_dump/compress_io.c
@@ -56,6 +61,10 @@
 #include "compress_io.h"
 #include "pg_backup_utils.h"
 
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+
 /*----------------------
  * Compressor API
  *----------------------
@@ -72,6 +81,14 @@ struct CompressorState
 	char	   *zlibOut;
 	size_t		zlibOutSize;
 #endif
+
+#ifdef USE_LZ4
+	LZ4F_compressionContext_t lz4ctx;
+	LZ4F_preferences_t lz4prefs;
+	bool		lz4Begun;		/* frame header written yet? */
+	char	   *lz4Out;
+	size_t		lz4OutSize;
+#endif
 };
 
 /* translator: this is a module name */
@@ -91,6 +108,15 @@ static void WriteDataToArchiveZlib(ArchiveHandle *AH, CompressorState *cs,
 static void EndCompressorZlib(ArchiveHandle *AH, CompressorState *cs);
 #endif
 
+/* Routines that support LZ4 compressed data I/O */
+#ifdef USE_LZ4
+static void InitCompressorLZ4(CompressorState *cs, int level);
+static void ReadDataFromArchiveLZ4(ArchiveHandle *AH, ReadFunc readF);
+static void WriteDataToArchiveLZ4(ArchiveHandle *AH, CompressorState *cs,
+					  const char *data, size_t dLen);
+static void EndCompressorLZ4(ArchiveHandle *AH, CompressorState *cs);
+#endif
+
 /* Routines that support uncompressed data I/O */
 static void ReadDataFromArchiveNone(ArchiveHandle *AH, ReadFunc readF);
 static void WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
@@ -98,8 +124,8 @@ static void WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
 
 /*
  * Interprets a numeric 'compression' value. The algorithm implied by the
- * value (zlib or none at the moment), is returned in *alg, and the
- * zlib compression level in *level.
+ * value (zlib, LZ4 or none), is returned in *alg, and the compression level
+ * in *level.
  */
 static void
 ParseCompressionOption(int compression, CompressionAlgorithm *alg, int *level)
@@ -107,6 +133,9 @@ ParseCompressionOption(int compression, CompressionAlgorithm *alg, int *level)
 	if (compression == Z_DEFAULT_COMPRESSION ||
 		(compression > 0 && compression <= 9))
 		*alg = COMPR_ALG_LIBZ;
+	else if (compression >= COMPRESSION_LZ4 &&
+			 compression <= COMPRESSION_LZ4 + 9)
+		*alg = COMPR_ALG_LZ4;
 	else if (compression == 0)
 		*alg = COMPR_ALG_NONE;
 	else
@@ -116,9 +145,8 @@ ParseCompressionOption(int compression, CompressionAlgorithm *alg, int *level)
 		*alg = COMPR_ALG_NONE;	/* keep compiler quiet */
 	}
 
-	/* The level is just the passed-in value. */
 	if (level)
-		*level = compression;
+		*level = COMPRESSION_LEVEL(compression);
 }
 
 /* Public interface routines */
@@ -137,6 +165,10 @@ AllocateCompressor(int compression, WriteFunc writeF)
 	if (alg == COMPR_ALG_LIBZ)
 		exit_horribly(modulename, "not built with zlib support\n");
 #endif
+#ifndef USE_LZ4
+	if (alg == COMPR_ALG_LZ4)
+		exit_horribly(modulename, "not built with LZ4 support\n");
+#endif
 
 	cs = (CompressorState *) pg_malloc0(sizeof(CompressorState));
 	cs->writeF = writeF;
@@ -149,6 +181,10 @@ AllocateCompressor(int compression, WriteFunc writeF)
 	if (alg == COMPR_ALG_LIBZ)
 		InitCompressorZlib(cs, level);
 #endif
+#ifdef USE_LZ4
+	if (alg == COMPR_ALG_LZ4)
+		InitCompressorLZ4(cs, level);
+#endif
 
 	return cs;
 }
@@ -172,6 +208,14 @@ ReadDataFromArchive(ArchiveHandle *AH, int compression, ReadFunc readF)
 		ReadDataFromArchiveZlib(AH, readF);
 #else
 		exit_horribly(modulename, "not built with zlib support\n");
+#endif
+	}
+	if (alg == COMPR_ALG_LZ4)
+	{
+#ifdef USE_LZ4
+		ReadDataFromArchiveLZ4(AH, readF);
+#else
+		exit_horribly(modulename, "not built with LZ4 support\n");
 #endif
 	}
 }
@@ -190,6 +234,13 @@ WriteDataToArchive(ArchiveHandle *AH, CompressorState *cs,
 			WriteDataToArchiveZlib(AH, cs, data, dLen);
 #else
 			exit_horribly(modulename, "not built with zlib support\n");
+#endif
+			break;
+		case COMPR_ALG_LZ4:
+#ifdef USE_LZ4
+			WriteDataToArchiveLZ4(AH, cs, data, dLen);
+#else
+			exit_horribly(modulename, "not built with LZ4 support\n");
 #endif
 			break;
 		case COMPR_ALG_NONE:
@@ -208,6 +259,10 @@ EndCompressor(ArchiveHandle *AH, CompressorState *cs)
 #ifdef HAVE_LIBZ
 	if (cs->comprAlg == COMPR_ALG_LIBZ)
 		EndCompressorZlib(AH, cs);
+#endif
+#ifdef USE_LZ4
+	if (cs->comprAlg == COMPR_ALG_LZ4)
+		EndCompressorLZ4(AH, cs);
 #endif
 	free(cs);
 }
@@ -390,6 +445,150 @@ ReadDataFromArchiveZlib(ArchiveHandle *AH, ReadFunc readF)
 }
 #endif   /* HAVE_LIBZ */
 
+#ifdef USE_LZ4
+/*
+ * Functions for LZ4 compressed output.
+ */
+
+static void
+InitCompressorLZ4(CompressorState *cs, int level)
+{
+	size_t		status;
+
+	status = LZ4F_createCompressionContext(&cs->lz4ctx, LZ4F_VERSION);
+	if (LZ4F_isError(status))
+		exit_horribly(modulename,
+					  "could not initialize compression library: %s\n",
+					  LZ4F_getErrorName(status));
+
+	memset(&cs->lz4prefs, 0, sizeof(cs->lz4prefs));
+	cs->lz4prefs.compressionLevel = level;
+
+	/* big enough for the frame header and footer, too */
+	cs->lz4OutSize = LZ4F_compressBound(LZ4_IN_SIZE, &cs->lz4prefs);
+	cs->lz4Out = pg_malloc(cs->lz4OutSize);
+}
+
+/*
+ * Write out the LZ4 frame header, if not done yet.
+ */
+static void
+BeginCompressorLZ4(ArchiveHandle *AH, CompressorState *cs)
+{
+	size_t		len;
+
+	if (cs->lz4Begun)
+		return;
+
+	len = LZ4F_compressBegin(cs->lz4ctx, cs->lz4Out, cs->lz4OutSize,
+							 &cs->lz4prefs);
+	if (LZ4F_isError(len))
+		exit_horribly(modulename, "could not compress data: %s\n",
+					  LZ4F_getErrorName(len));
+	cs->writeF(AH, cs->lz4Out, len);
+	cs->lz4Begun = true;
+}
+
+static void
+WriteDataToArchiveLZ4(ArchiveHandle *AH, CompressorState *cs,
+					  const char *data, size_t dLen)
+{
+	BeginCompressorLZ4(AH, cs);
+
+	while (dLen > 0)
+	{
+		size_t		chunk = Min(dLen, LZ4_IN_SIZE);
+		size_t		len;
+
+		len = LZ4F_compressUpdate(cs->lz4ctx, cs->lz4Out, cs->lz4OutSize,
+								  data, chunk, NULL);
+		if (LZ4F_isError(len))
+			exit_horribly(modulename, "could not compress data: %s\n",
+						  LZ4F_getErrorName(len));
+
+		/*
+		 * LZ4 buffers input until it has a full block.  Don't pass on
+		 * zero-length chunks, they are the EOF marker in the custom format.
+		 */
+		if (len > 0)
+			cs->writeF(AH, cs->lz4Out, len);
+
+		data += chunk;
+		dLen -= chunk;
+	}
+}
+
+static void
+EndCompressorLZ4(ArchiveHandle *AH, CompressorState *cs)
+{
+	size_t		len;
+
+	BeginCompressorLZ4(AH, cs);
+
+	len = LZ4F_compressEnd(cs->lz4ctx, cs->lz4Out, cs->lz4OutSize, NULL);
+	if (LZ4F_isError(len))
+		exit_horribly(modulename, "could not compress data: %s\n",
+					  LZ4F_getErrorName(len));
+	cs->writeF(AH, cs->lz4Out, len);
+
+	LZ4F_freeCompressionContext(cs->lz4ctx);
+	free(cs->lz4Out);
+}
+
+static void
+ReadDataFromArchiveLZ4(ArchiveHandle *AH, ReadFunc readF)
+{
+	LZ4F_decompressionContext_t ctx;
+	size_t		status;
+	size_t		cnt;
+	char	   *buf;
+	size_t		buflen;
+	char	   *out;
+
+	status = LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION);
+	if (LZ4F_isError(status))
+		exit_horribly(modulename,
+					  "could not initialize compression library: %s\n",
+					  LZ4F_getErrorName(status));
+
+	buf = pg_malloc(LZ4_IN_SIZE);
+	buflen = LZ4_IN_SIZE;
+
+	out = pg_malloc(LZ4_OUT_SIZE + 1);
+
+	while ((cnt = readF(AH, &buf, &buflen)))
+	{
+		size_t		consumed = 0;
+		size_t		outlen = 0;
+
+		/*
+		 * Decompress until all input is consumed, and the output buffer
+		 * isn't filled up anymore (otherwise there might be more output
+		 * pending in the decompressor).
+		 */
+		while (consumed < cnt || outlen == LZ4_OUT_SIZE)
+		{
+			size_t		inlen = cnt - consumed;
+
+			outlen = LZ4_OUT_SIZE;
+			status = LZ4F_decompress(ctx, out, &outlen, buf + consumed, &inlen,
+									 NULL);
+			if (LZ4F_isError(status))
+				exit_horribly(modulename, "could not uncompress data: %s\n",
+							  LZ4F_getErrorName(status));
+			consumed += inlen;
+
+			out[outlen] = '\0';
+			ahwrite(out, 1, outlen, AH);
+		}
+	}
+
+	LZ4F_freeDecompressionContext(ctx);
+	free(buf);
+	free(out);
+}
+#endif   /* USE_LZ4 */
+
 
 /*
  * Functions for uncompressed output.
@@ -427,9 +626,39 @@ WriteDataToArchiveNone(ArchiveHandle *AH, CompressorState *cs,
  *----------------------
  */
 
+#ifdef USE_LZ4
 /*
- * cfp represents an open stream, wrapping the underlying FILE or gzFile
- * pointer. This is opaque to the callers.
+ * An LZ4 compressed file.  There's no stdio-like library for that, so we
+ * do our own buffering on top of a plain FILE.
+ */
+typedef struct LZ4File
+{
+	FILE	   *fp;
+	bool		writing;
+	LZ4F_compressionContext_t cctx;
+	LZ4F_decompressionContext_t dctx;
+	LZ4F_preferences_t prefs;
+	char	   *buf;			/* compressed data */
+	size_t		buflen;
+	size_t		bufpos;			/* when reading, buf[bufpos..bufused) is not
+								 * decompressed yet */
+	size_t		bufused;
+	char	   *out;			/* when reading, decompressed data */
+	size_t		outpos;			/* out[outpos..outused) is not returned yet */
+	size_t		outused;
+	bool		eof;			/* reached end of the underlying file */
+	const char *errmsg;			/* LZ4 error, if any */
+} LZ4File;
+
+static LZ4File *lz4_open(const char *path, const char *mode, int level);
+static int	lz4_read(void *ptr, int size, LZ4File *fs);
+static int	lz4_write(const void *ptr, int size, LZ4File *fs);
+static int	lz4_close(LZ4File *fs);
+#endif
+
+/*
+ * cfp represents an open stream, wrapping the underlying FILE, gzFile or
+ * LZ4File pointer. This is opaque to the callers.
  */
 struct cfp
 {
@@ -437,9 +666,12 @@ struct cfp
 #ifdef HAVE_LIBZ
 	gzFile		compressedfp;
 #endif
+#ifdef USE_LZ4
+	LZ4File    *lz4fp;
+#endif
 };
 
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) || defined(USE_LZ4)
 static int	hasSuffix(const char *filename, const char *suffix);
 #endif
 
@@ -457,9 +689,9 @@ free_keep_errno(void *p)
  * Open a file for reading. 'path' is the file to open, and 'mode' should
  * be either "r" or "rb".
  *
- * If the file at 'path' does not exist, we append the ".gz" suffix (if 'path'
- * doesn't already have it) and try again. So if you pass "foo" as 'path',
- * this will open either "foo" or "foo.gz".
+ * If the file at 'path' does not exist, we append the ".gz" and ".lz4"
+ * suffixes (if 'path' doesn't already have one) and try again. So if you
+ * pass "foo" as 'path', this will open either "foo", "foo.gz" or "foo.lz4".
  *
  * On failure, return NULL with an error code in errno.
  */
@@ -472,6 +704,11 @@ cfopen_read(const char *path, const char *mode)
 	if (hasSuffix(path, ".gz"))
 		fp = cfopen(path, mode, 1);
 	else
+#endif
+#ifdef USE_LZ4
+	if (hasSuffix(path, ".lz4"))
+		fp = cfopen(path, mode, COMPRESSION_LZ4);
+	else
 #endif
 	{
 		fp = cfopen(path, mode, 0);
@@ -484,6 +721,16 @@ cfopen_read(const char *path, const char *mode)
 			fp = cfopen(fname, mode, 1);
 			free_keep_errno(fname);
 		}
+#endif
+#ifdef USE_LZ4
+		if (fp == NULL)
+		{
+			char	   *fname;
+
+			fname = psprintf("%s.lz4", path);
+			fp = cfopen(fname, mode, COMPRESSION_LZ4);
+			free_keep_errno(fname);
+		}
 #endif
 	}
 	return fp;
@@ -494,9 +741,9 @@ cfopen_read(const char *path, const char *mode)
  * be a filemode as accepted by fopen() and gzopen() that indicates writing
  * ("w", "wb", "a", or "ab").
  *
- * If 'compression' is non-zero, a gzip compressed stream is opened, and
- * 'compression' indicates the compression level used. The ".gz" suffix
- * is automatically added to 'path' in that case.
+ * If 'compression' is non-zero, a gzip or LZ4 compressed stream is opened,
+ * and 'compression' indicates the method and the compression level used.
+ * The ".gz" or ".lz4" suffix is automatically added to 'path' in that case.
  *
  * On failure, return NULL with an error code in errno.
  */
@@ -507,6 +754,19 @@ cfopen_write(const char *path, const char *mode, int compression)
 
 	if (compression == 0)
 		fp = cfopen(path, mode, 0);
+	else if (COMPRESSION_IS_LZ4(compression))
+	{
+#ifdef USE_LZ4
+		char	   *fname;
+
+		fname = psprintf("%s.lz4", path);
+		fp = cfopen(fname, mode, compression);
+		free_keep_errno(fname);
+#else
+		exit_horribly(modulename, "not built with LZ4 support\n");
+		fp = NULL;				/* keep compiler quiet */
+#endif
+	}
 	else
 	{
 #ifdef HAVE_LIBZ
@@ -524,7 +784,8 @@ cfopen_write(const char *path, const char *mode, int compression)
 }
 
 /*
- * Opens file 'path' in 'mode'. If 'compression' is non-zero, the file
+ * Opens file 'path' in 'mode'. If 'compression' indicates LZ4, the file is
+ * read or written as an LZ4 frame, otherwise if it is non-zero, the file
  * is opened with libz gzopen(), otherwise with plain fopen().
  *
  * On failure, return NULL with an error code in errno.
@@ -532,9 +793,22 @@ cfopen_write(const char *path, const char *mode, int compression)
 cfp *
 cfopen(const char *path, const char *mode, int compression)
 {
-	cfp		   *fp = pg_malloc(sizeof(cfp));
+	cfp		   *fp = pg_malloc0(sizeof(cfp));
 
-	if (compression != 0)
+	if (COMPRESSION_IS_LZ4(compression))
+	{
+#ifdef USE_LZ4
+		fp->lz4fp = lz4_open(path, mode, COMPRESSION_LEVEL(compression));
+		if (fp->lz4fp == NULL)
+		{
+			free_keep_errno(fp);
+			fp = NULL;
+		}
+#else
+		exit_horribly(modulename, "not built with LZ4 support\n");
+#endif
+	}
+	else if (compression != 0)
 	{
 #ifdef HAVE_LIBZ
 		if (compression != Z_DEFAULT_COMPRESSION)
@@ -587,6 +861,17 @@ cfread(void *ptr, int size, cfp *fp)
 	if (size == 0)
 		return 0;
 
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+	{
+		ret = lz4_read(ptr, size, fp->lz4fp);
+		if (ret < 0)
+			exit_horribly(modulename,
+						  "could not read from input file: %s\n",
+						  get_cfp_error(fp));
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -614,6 +899,11 @@ cfread(void *ptr, int size, cfp *fp)
 int
 cfwrite(const void *ptr, int size, cfp *fp)
 {
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+		return lz4_write(ptr, size, fp->lz4fp);
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 		return gzwrite(fp->compressedfp, ptr, size);
@@ -627,6 +917,25 @@ cfgetc(cfp *fp)
 {
 	int			ret;
 
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+	{
+		unsigned char c;
+
+		if (lz4_read(&c, 1, fp->lz4fp) != 1)
+		{
+			if (!cfeof(fp))
+				exit_horribly(modulename,
+							  "could not read from input file: %s\n",
+							  get_cfp_error(fp));
+			else
+				exit_horribly(modulename,
+							"could not read from input file: end of file\n");
+		}
+		ret = c;
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -655,6 +964,26 @@ cfgetc(cfp *fp)
 char *
 cfgets(cfp *fp, char *buf, int len)
 {
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+	{
+		int			i = 0;
+
+		/* like fgets(), read up to and including a newline */
+		while (i < len - 1)
+		{
+			if (lz4_read(&buf[i], 1, fp->lz4fp) != 1)
+				break;
+			if (buf[i++] == '\n')
+				break;
+		}
+		if (i == 0)
+			return NULL;
+		buf[i] = '\0';
+		return buf;
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 		return gzgets(fp->compressedfp, buf, len);
@@ -673,6 +1002,14 @@ cfclose(cfp *fp)
 		errno = EBADF;
 		return EOF;
 	}
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+	{
+		result = lz4_close(fp->lz4fp);
+		fp->lz4fp = NULL;
+	}
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -693,6 +1030,13 @@ cfclose(cfp *fp)
 int
 cfeof(cfp *fp)
 {
+#ifdef USE_LZ4
+	if (fp->lz4fp)
+		return fp->lz4fp->eof &&
+			fp->lz4fp->bufpos == fp->lz4fp->bufused &&
+			fp->lz4fp->outpos == fp->lz4fp->outused;
+	else
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 		return gzeof(fp->compressedfp);
@@ -704,6 +1048,10 @@ cfeof(cfp *fp)
 const char *
 get_cfp_error(cfp *fp)
 {
+#ifdef USE_LZ4
+	if (fp->lz4fp && fp->lz4fp->errmsg)
+		return fp->lz4fp->errmsg;
+#endif
 #ifdef HAVE_LIBZ
 	if (fp->compressedfp)
 	{
@@ -717,7 +1065,7 @@ get_cfp_error(cfp *fp)
 	return strerror(errno);
 }
 
-#ifdef HAVE_LIBZ
+#if defined(HAVE_LIBZ) || defined(USE_LZ4)
 static int
 hasSuffix(const char *filename, const char *suffix)
 {
@@ -733,3 +1081,205 @@ hasSuffix(const char *filename, const char *suffix)
 }
 
 #endif
+
+#ifdef USE_LZ4
+/*
+ * Open an LZ4 compressed file.  A new frame is started when writing, so
+ * appending to an existing file works too: the frames are simply
+ * concatenated, and read back as one stream.
+ *
+ * On failure, return NULL with an error code in errno.
+ */
+static LZ4File *
+lz4_open(const char *path, const char *mode, int level)
+{
+	LZ4File    *fs = pg_malloc0(sizeof(LZ4File));
+	size_t		status;
+
+	fs->writing = (strchr(mode, 'w') != NULL || strchr(mode, 'a') != NULL);
+	fs->fp = fopen(path, mode);
+	if (fs->fp == NULL)
+	{
+		free_keep_errno(fs);
+		return NULL;
+	}
+
+	if (fs->writing)
+	{
+		fs->prefs.compressionLevel = level;
+		status = LZ4F_createCompressionContext(&fs->cctx, LZ4F_VERSION);
+		if (LZ4F_isError(status))
+			exit_horribly(modulename,
+						  "could not initialize compression library: %s\n",
+						  LZ4F_getErrorName(status));
+		fs->buflen = LZ4F_compressBound(LZ4_IN_SIZE, &fs->prefs);
+		fs->buf = pg_malloc(fs->buflen);
+
+		status = LZ4F_compressBegin(fs->cctx, fs->buf, fs->buflen, &fs->prefs);
+		if (LZ4F_isError(status))
+			exit_horribly(modulename, "could not compress data: %s\n",
+						  LZ4F_getErrorName(status));
+		fs->bufused = status;
+	}
+	else
+	{
+		status = LZ4F_createDecompressionContext(&fs->dctx, LZ4F_VERSION);
+		if (LZ4F_isError(status))
+			exit_horribly(modulename,
+						  "could not initialize compression library: %s\n",
+						  LZ4F_getErrorName(status));
+		fs->buflen = LZ4_IN_SIZE;
+		fs->buf = pg_malloc(fs->buflen);
+		fs->out = pg_malloc(LZ4_OUT_SIZE);
+	}
+
+	return fs;
+}
+
+/*
+ * Read up to 'size' bytes of decompressed data.  Returns the number of
+ * bytes read, which is less than 'size' only at end of file, or -1 on
+ * error.
+ */
+static int
+lz4_read(void *ptr, int size, LZ4File *fs)
+{
+	int			done = 0;
+
+	while (done < size)
+	{
+		size_t		inlen;
+		size_t		outlen;
+		size_t		status;
+
+		/* Return what we have decompressed already */
+		if (fs->outpos < fs->outused)
+		{
+			size_t		n = Min(fs->outused - fs->outpos, size - done);
+
+			memcpy((char *) ptr + done, fs->out + fs->outpos, n);
+			fs->outpos += n;
+			done += n;
+			continue;
+		}
+
+		/* Need more compressed data? */
+		if (fs->bufpos == fs->bufused)
+		{
+			if (fs->eof)
+				break;
+			fs->bufused = fread(fs->buf, 1, fs->buflen, fs->fp);
+			fs->bufpos = 0;
+			if (fs->bufused < fs->buflen)
+			{
+				if (ferror(fs->fp))
+					return -1;
+				fs->eof = true;
+			}
+		}
+
+		/*
+		 * Decompress.  This might consume input without producing output,
+		 * e.g. for the frame header, or produce output without consuming
+		 * input that is already buffered in the decompressor.
+		 */
+		inlen = fs->bufused - fs->bufpos;
+		outlen = LZ4_OUT_SIZE;
+		status = LZ4F_decompress(fs->dctx, fs->out, &outlen,
+								 fs->buf + fs->bufpos, &inlen, NULL);
+		if (LZ4F_isError(status))
+		{
+			fs->errmsg = LZ4F_getErrorName(status);
+			return -1;
+		}
+		fs->bufpos += inlen;
+		fs->outpos = 0;
+		fs->outused = outlen;
+
+		if (inlen == 0 && outlen == 0 && fs->eof)
+			break;
+	}
+
+	return done;
+}
+
+/*
+ * Compress and write 'size' bytes.  Returns 'size', or 0 on error.
+ */
+static int
+lz4_write(const void *ptr, int size, LZ4File *fs)
+{
+	int			done = 0;
+
+	while (done < size)
+	{
+		size_t		chunk = Min(size - done, LZ4_IN_SIZE);
+		size_t		status;
+
+		/* Make sure the compressed output of this chunk fits */
+		if (fs->buflen - fs->bufused < LZ4F_compressBound(chunk, &fs->prefs))
+		{
+			if (fwrite(fs->buf, 1, fs->bufused, fs->fp) != fs->bufused)
+				return 0;
+			fs->bufused = 0;
+		}
+
+		status = LZ4F_compressUpdate(fs->cctx, fs->buf + fs->bufused,
+									 fs->buflen - fs->bufused,
+									 (const char *) ptr + done, chunk, NULL);
+		if (LZ4F_isError(status))
+		{
+			fs->errmsg = LZ4F_getErrorName(status);
+			return 0;
+		}
+		fs->bufused += status;
+		done += chunk;
+	}
+
+	return size;
+}
+
+/*
+ * Finish the frame when writing, and close the file.  Returns 0 on success,
+ * EOF on failure.
+ */
+static int
+lz4_close(LZ4File *fs)
+{
+	int			result = 0;
+
+	if (fs->writing)
+	{
+		size_t		status;
+
+		if (fs->buflen - fs->bufused < LZ4F_compressBound(0, &fs->prefs))
+		{
+			if (fwrite(fs->buf, 1, fs->bufused, fs->fp) != fs->bufused)
+				result = EOF;
+			fs->bufused = 0;
+		}
+		status = LZ4F_compressEnd(fs->cctx, fs->buf + fs->bufused,
+								  fs->buflen - fs->bufused, NULL);
+		if (LZ4F_isError(status))
+			exit_horribly(modulename, "could not compress data: %s\n",
+						  LZ4F_getErrorName(status));
+		fs->bufused += status;
+		if (fwrite(fs->buf, 1, fs->bufused, fs->fp) != fs->bufused)
+			result = EOF;
+
+		LZ4F_freeCompressionContext(fs->cctx);
+	}
+	else
+	{
+		LZ4F_freeDecompressionContext(fs->dctx);
+		free(fs->out);
+	}
+
+	if (fclose(fs->fp) != 0)
+		result = EOF;
+	free(fs->buf);
+	free_keep_errno(fs);
+
+	return result;
+}
+#endif   /* USE_LZ4 */
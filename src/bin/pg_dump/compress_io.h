@@ -21,10 +21,15 @@
 #define ZLIB_OUT_SIZE	4096
 #define ZLIB_IN_SIZE	4096
 
+/* Buffer sizes used in LZ4 compression. */
+#define LZ4_OUT_SIZE	65536
+#define LZ4_IN_SIZE		65536
+
 typedef enum
 {
 	COMPR_ALG_NONE,
-	COMPR_ALG_LIBZ
+	COMPR_ALG_LIBZ,
+	COMPR_ALG_LZ4
 } CompressionAlgorithm;
 
 /* Prototype for callback function to WriteDataToArchive() */
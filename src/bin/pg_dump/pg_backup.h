@@ -50,6 +50,15 @@ typedef enum _archiveMode
 	archModeRead
 } ArchiveMode;
 
+/*
+ * The compression value of an archive is a zlib compression level, 0 for no
+ * compression, or COMPRESSION_LZ4 plus an LZ4 compression level (0 for the
+ * LZ4 default) for LZ4 compression.
+ */
+#define COMPRESSION_LZ4			0x100
+#define COMPRESSION_IS_LZ4(c)	((c) >= COMPRESSION_LZ4)
+#define COMPRESSION_LEVEL(c)	(COMPRESSION_IS_LZ4(c) ? (c) - COMPRESSION_LZ4 : (c))
+
 typedef enum _teSection
 {
 	SECTION_NONE = 1,			/* COMMENTs, ACLs, etc; can be anywhere */
@@ -151,6 +160,8 @@ typedef struct _dumpOptions
 	int			outputNoTablespaces;
 	int			use_setsessauth;
 	int			enable_row_security;
+	int			split_table_size;	/* split data of tables larger than
+									 * this many MB; 0 = never */
 
 	/* default, if no "inclusion" switches appear, is to dump everything */
 	bool		include_everything;
@@ -357,7 +357,8 @@ RestoreArchive(Archive *AHX)
 	 * Make sure we won't need (de)compression we haven't got
 	 */
 #ifndef HAVE_LIBZ
-	if (AH->compression != 0 && AH->PrintTocDataPtr !=NULL)
+	if (AH->compression != 0 && !COMPRESSION_IS_LZ4(AH->compression) &&
+		AH->PrintTocDataPtr !=NULL)
 	{
 		for (te = AH->toc->next; te != AH->toc; te = te->next)
 		{
@@ -366,6 +367,16 @@ RestoreArchive(Archive *AHX)
 		}
 	}
 #endif
+#ifndef USE_LZ4
+	if (COMPRESSION_IS_LZ4(AH->compression) && AH->PrintTocDataPtr !=NULL)
+	{
+		for (te = AH->toc->next; te != AH->toc; te = te->next)
+		{
+			if (te->hadDumper && (te->reqs & REQ_DATA) != 0)
+				exit_horribly(modulename, "cannot restore from LZ4 compressed archive (LZ4 not supported in this installation)\n");
+		}
+	}
+#endif
 
 	/*
 	 * Prepare index arrays, so we can assume we have them throughout restore.
@@ -1124,9 +1135,13 @@ PrintTOCSummary(Archive *AHX)
 		strcpy(stamp_str, "[unknown]");
 
 	ahprintf(AH, ";\n; Archive created at %s\n", stamp_str);
-	ahprintf(AH, ";     dbname: %s\n;     TOC Entries: %d\n;     Compression: %d\n",
-			 replace_line_endings(AH->archdbname),
-			 AH->tocCount, AH->compression);
+	ahprintf(AH, ";     dbname: %s\n;     TOC Entries: %d\n",
+			 replace_line_endings(AH->archdbname), AH->tocCount);
+	if (COMPRESSION_IS_LZ4(AH->compression))
+		ahprintf(AH, ";     Compression: lz4:%d\n",
+				 COMPRESSION_LEVEL(AH->compression));
+	else
+		ahprintf(AH, ";     Compression: %d\n", AH->compression);
 
 	switch (AH->format)
 	{
@@ -1847,6 +1862,7 @@ buildTocEntryArrays(ArchiveHandle *AH)
 
 	AH->tocsByDumpId = (TocEntry **) pg_malloc0((maxDumpId + 1) * sizeof(TocEntry *));
 	AH->tableDataId = (DumpId *) pg_malloc0((maxDumpId + 1) * sizeof(DumpId));
+	AH->tableDataNext = (DumpId *) pg_malloc0((maxDumpId + 1) * sizeof(DumpId));
 
 	for (te = AH->toc->next; te != AH->toc; te = te->next)
 	{
@@ -1862,6 +1878,10 @@ buildTocEntryArrays(ArchiveHandle *AH)
 		 * TOC entry that has a DATA item.  We compute this by reversing the
 		 * TABLE DATA item's dependency, knowing that a TABLE DATA item has
 		 * just one dependency and it is the TABLE item.
+		 *
+		 * The data of a large table may have been split into several TABLE
+		 * DATA items, each dumping a range of rows.  These are chained
+		 * through tableDataNext.
 		 */
 		if (strcmp(te->desc, "TABLE DATA") == 0 && te->nDeps > 0)
 		{
@@ -1875,6 +1895,7 @@ buildTocEntryArrays(ArchiveHandle *AH)
 			if (tableId <= 0 || tableId > maxDumpId)
 				exit_horribly(modulename, "bad table dumpId for TABLE DATA item\n");
 
+			AH->tableDataNext[te->dumpId] = AH->tableDataId[tableId];
 			AH->tableDataId[tableId] = te->dumpId;
 		}
 	}
@@ -3683,9 +3704,13 @@ ReadHead(ArchiveHandle *AH)
 		AH->compression = Z_DEFAULT_COMPRESSION;
 
 #ifndef HAVE_LIBZ
-	if (AH->compression != 0)
+	if (AH->compression != 0 && !COMPRESSION_IS_LZ4(AH->compression))
 		write_msg(modulename, "WARNING: archive is compressed, but this installation does not support compression -- no data will be available\n");
 #endif
+#ifndef USE_LZ4
+	if (COMPRESSION_IS_LZ4(AH->compression))
+		write_msg(modulename, "WARNING: archive is LZ4 compressed, but this installation does not support LZ4 -- no data will be available\n");
+#endif
 
 	if (AH->version >= K_VERS_1_4)
 	{
@@ -4436,7 +4461,8 @@ fix_dependencies(ArchiveHandle *AH)
 
 /*
  * Change dependencies on table items to depend on table data items instead,
- * but only in POST_DATA items.
+ * but only in POST_DATA items.  If the table's data was split into several
+ * items, the entry depends on all of them.
  */
 static void
 repoint_table_dependencies(ArchiveHandle *AH)
@@ -4444,20 +4470,36 @@ repoint_table_dependencies(ArchiveHandle *AH)
 	TocEntry   *te;
 	int			i;
 	DumpId		olddep;
+	DumpId		datadep;
 
 	for (te = AH->toc->next; te != AH->toc; te = te->next)
 	{
+		int			nDeps;
+
 		if (te->section != SECTION_POST_DATA)
 			continue;
-		for (i = 0; i < te->nDeps; i++)
+		nDeps = te->nDeps;
+		for (i = 0; i < nDeps; i++)
 		{
 			olddep = te->dependencies[i];
 			if (olddep <= AH->maxDumpId &&
 				AH->tableDataId[olddep] != 0)
 			{
-				te->dependencies[i] = AH->tableDataId[olddep];
+				datadep = AH->tableDataId[olddep];
+				te->dependencies[i] = datadep;
 				ahlog(AH, 2, "transferring dependency %d -> %d to %d\n",
-					  te->dumpId, olddep, AH->tableDataId[olddep]);
+					  te->dumpId, olddep, datadep);
+
+				while ((datadep = AH->tableDataNext[datadep]) != 0)
+				{
+					te->dependencies = (DumpId *)
+						pg_realloc(te->dependencies,
+								   (te->nDeps + 1) * sizeof(DumpId));
+					te->dependencies[te->nDeps++] = datadep;
+					te->depCount++;
+					ahlog(AH, 2, "adding dependency %d -> %d\n",
+						  te->dumpId, datadep);
+				}
 			}
 		}
 	}
@@ -4562,13 +4604,19 @@ reduce_dependencies(ArchiveHandle *AH, TocEntry *te, TocEntry *ready_list)
 /*
  * Set the created flag on the DATA member corresponding to the given
  * TABLE member
+ *
+ * This is not done if the table's data was split into several members,
+ * since those are restored concurrently, and the TRUNCATE issued for a
+ * freshly created table would wipe out the rows loaded by the others.
  */
 static void
 mark_create_done(ArchiveHandle *AH, TocEntry *te)
 {
-	if (AH->tableDataId[te->dumpId] != 0)
+	DumpId		dataId = AH->tableDataId[te->dumpId];
+
+	if (dataId != 0 && AH->tableDataNext[dataId] == 0)
 	{
-		TocEntry   *ted = AH->tocsByDumpId[AH->tableDataId[te->dumpId]];
+		TocEntry   *ted = AH->tocsByDumpId[dataId];
 
 		ted->created = true;
 	}
@@ -4581,12 +4629,15 @@ mark_create_done(ArchiveHandle *AH, TocEntry *te)
 static void
 inhibit_data_for_failed_table(ArchiveHandle *AH, TocEntry *te)
 {
+	DumpId		dataId;
+
 	ahlog(AH, 1, "table \"%s\" could not be created, will not restore its data\n",
 		  te->tag);
 
-	if (AH->tableDataId[te->dumpId] != 0)
+	for (dataId = AH->tableDataId[te->dumpId]; dataId != 0;
+		 dataId = AH->tableDataNext[dataId])
 	{
-		TocEntry   *ted = AH->tocsByDumpId[AH->tableDataId[te->dumpId]];
+		TocEntry   *ted = AH->tocsByDumpId[dataId];
 
 		ted->reqs = 0;
 	}
@@ -224,6 +224,8 @@ static void addBoundaryDependencies(DumpableObject **dobjs, int numObjs,
 static void getDomainConstraints(Archive *fout, TypeInfo *tyinfo);
 static void getTableData(DumpOptions *dopt, TableInfo *tblinfo, int numTables, bool oids);
 static void makeTableDataInfo(DumpOptions *dopt, TableInfo *tbinfo, bool oids);
+static void splitTableData(Archive *fout, TableInfo *tblinfo, int numTables);
+static void splitTableDataByKey(Archive *fout, TableInfo *tbinfo, int nchunks);
 static void buildMatViewRefreshDependencies(Archive *fout);
 static void getTableDataFKConstraints(void);
 static char *format_function_arguments(FuncInfo *finfo, char *funcargs,
@@ -347,6 +349,7 @@ main(int argc, char **argv)
 		{"section", required_argument, NULL, 5},
 		{"serializable-deferrable", no_argument, &dopt.serializable_deferrable, 1},
 		{"snapshot", required_argument, NULL, 6},
+		{"split-table-size", required_argument, NULL, 7},
 		{"strict-names", no_argument, &strict_names, 1},
 		{"use-set-session-authorization", no_argument, &dopt.use_setsessauth, 1},
 		{"no-security-labels", no_argument, &dopt.no_security_labels, 1},
@@ -500,6 +503,22 @@ main(int argc, char **argv)
 				break;
 
 			case 'Z':			/* Compression Level */
+				if (pg_strncasecmp(optarg, "lz4", 3) == 0 &&
+					(optarg[3] == '\0' || optarg[3] == ':'))
+				{
+					/* lz4[:level], levels above 2 select LZ4 HC */
+					int			level = 0;
+
+					if (optarg[3] == ':')
+						level = atoi(optarg + 4);
+					if (level < 0 || level > 12)
+					{
+						write_msg(NULL, "LZ4 compression level must be in range 0..12\n");
+						exit_nicely(1);
+					}
+					compressLevel = COMPRESSION_LZ4 + level;
+					break;
+				}
 				compressLevel = atoi(optarg);
 				if (compressLevel < 0 || compressLevel > 9)
 				{
@@ -532,6 +551,15 @@ main(int argc, char **argv)
 				dumpsnapshot = pg_strdup(optarg);
 				break;
 
+			case 7:				/* split-table-size */
+				dopt.split_table_size = atoi(optarg);
+				if (dopt.split_table_size <= 0)
+				{
+					write_msg(NULL, "split table size must be a positive number of megabytes\n");
+					exit_nicely(1);
+				}
+				break;
+
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit_nicely(1);
@@ -599,11 +627,24 @@ main(int argc, char **argv)
 			compressLevel = 0;
 	}
 
-#ifndef HAVE_LIBZ
-	if (compressLevel != 0)
+	if (COMPRESSION_IS_LZ4(compressLevel))
+	{
+		if (archiveFormat != archCustom && archiveFormat != archDirectory)
+			exit_horribly(NULL, "LZ4 compression is only supported by the custom and directory formats\n");
+#ifndef USE_LZ4
 		write_msg(NULL, "WARNING: requested compression not available in this "
 				  "installation -- archive will be uncompressed\n");
-	compressLevel = 0;
+		compressLevel = 0;
+#endif
+	}
+#ifndef HAVE_LIBZ
+	else
+	{
+		if (compressLevel != 0)
+			write_msg(NULL, "WARNING: requested compression not available in this "
+					  "installation -- archive will be uncompressed\n");
+		compressLevel = 0;
+	}
 #endif
 
 	/*
@@ -760,6 +801,8 @@ main(int argc, char **argv)
 		buildMatViewRefreshDependencies(fout);
 		if (dopt.dataOnly)
 			getTableDataFKConstraints();
+		if (dopt.split_table_size > 0)
+			splitTableData(fout, tblinfo, numTables);
 	}
 
 	/*
@@ -905,7 +948,8 @@ help(const char *progname)
 	printf(_("  -j, --jobs=NUM               use this many parallel jobs to dump\n"));
 	printf(_("  -v, --verbose                verbose mode\n"));
 	printf(_("  -V, --version                output version information, then exit\n"));
-	printf(_("  -Z, --compress=0-9           compression level for compressed formats\n"));
+	printf(_("  -Z, --compress=0-9|lz4[:N]   compression level, or LZ4 compression, for\n"
+			 "                               compressed formats\n"));
 	printf(_("  --lock-wait-timeout=TIMEOUT  fail after waiting TIMEOUT for a table lock\n"));
 	printf(_("  -?, --help                   show this help, then exit\n"));
 
@@ -942,6 +986,7 @@ help(const char *progname)
 	printf(_("  --section=SECTION            dump named section (pre-data, data, or post-data)\n"));
 	printf(_("  --serializable-deferrable    wait until the dump can run without anomalies\n"));
 	printf(_("  --snapshot=SNAPSHOT          use given snapshot for the dump\n"));
+	printf(_("  --split-table-size=MB        split data of larger tables into several parts\n"));
 	printf(_("  --strict-names               require table and/or schema include patterns to\n"
 		 "                               match at least one entity each\n"));
 	printf(_("  --use-set-session-authorization\n"
@@ -1710,7 +1755,7 @@ dumpTableData_copy(Archive *fout, void *dcontext)
 		}
 		else
 			appendPQExpBufferStr(q, "* ");
-		appendPQExpBuffer(q, "FROM %s %s) TO stdout;",
+		appendPQExpBuffer(q, "FROM ONLY %s %s) TO stdout;",
 						  fmtQualifiedId(fout->remoteVersion,
 										 tbinfo->dobj.namespace->dobj.name,
 										 classname),
@@ -2180,6 +2225,229 @@ makeTableDataInfo(DumpOptions *dopt, TableInfo *tbinfo, bool oids)
 	tbinfo->dataObj = tdinfo;
 }
 
+/*
+ * splitTableData -
+ *	  split the data of large tables into several TABLE DATA objects
+ *
+ * Each of the objects dumps a range of the table's primary key, so that a
+ * single huge table can be dumped, and restored, by several parallel
+ * workers.  All of them see the same synchronized snapshot, so together
+ * they still dump a consistent copy of the table.
+ */
+static void
+splitTableData(Archive *fout, TableInfo *tblinfo, int numTables)
+{
+	int64		splitPages;
+	int			i;
+
+	/* we need COPY (SELECT ...), see dumpTableData_copy */
+	if (fout->remoteVersion < 80200)
+		return;
+
+	splitPages = (int64) fout->dopt->split_table_size * (1024 * 1024 / BLCKSZ);
+
+	for (i = 0; i < numTables; i++)
+	{
+		TableInfo  *tbinfo = &tblinfo[i];
+		TableDataInfo *tdinfo = tbinfo->dataObj;
+		int64		nchunks;
+
+		if (tdinfo == NULL || tdinfo->dobj.objType != DO_TABLE_DATA)
+			continue;
+
+		/*
+		 * Extension configuration tables already have a filter, and data
+		 * dumped WITH OIDS can't be filtered.
+		 */
+		if (tdinfo->filtercond != NULL || (tdinfo->oids && tbinfo->hasoids))
+			continue;
+
+		if (tbinfo->relpages <= splitPages)
+			continue;
+
+		nchunks = (tbinfo->relpages + splitPages - 1) / splitPages;
+		splitTableDataByKey(fout, tbinfo, (int) Min(nchunks, 1000));
+	}
+}
+
+/*
+ * splitTableDataByKey -
+ *	  split the data of one table into up to nchunks ranges of its primary key
+ *
+ * The range boundaries are taken from the histogram of the first primary
+ * key column in pg_stats, so the ranges are of about equal size.  Tables
+ * without a primary key or without statistics are not split.  The ranges
+ * are open at both ends, so that rows added after the last ANALYZE are
+ * dumped too.
+ */
+static void
+splitTableDataByKey(Archive *fout, TableInfo *tbinfo, int nchunks)
+{
+	TableDataInfo *tdinfo = tbinfo->dataObj;
+	PQExpBuffer query = createPQExpBuffer();
+	PGresult   *res;
+	char	  **bounds = NULL;
+	int			nbounds;
+	const char **splits;
+	int			nsplits;
+	char	   *colname;
+	char	   *coltype;
+	DumpableObject **dobjs;
+	int			numObjs;
+	TableDataInfo **chunks;
+	int			i;
+	int			j;
+
+	appendPQExpBuffer(query,
+					  "SELECT a.attname, "
+					  "pg_catalog.format_type(a.atttypid, NULL) AS atttype, "
+					  "s.histogram_bounds::pg_catalog.text AS bounds "
+					  "FROM pg_catalog.pg_index i "
+					  "JOIN pg_catalog.pg_attribute a "
+					  "ON a.attrelid = i.indrelid AND a.attnum = i.indkey[0] "
+					  "JOIN pg_catalog.pg_stats s "
+					  "ON s.attname = a.attname AND NOT s.inherited "
+					  "AND s.schemaname = ");
+	appendStringLiteralAH(query, tbinfo->dobj.namespace->dobj.name, fout);
+	appendPQExpBufferStr(query, " AND s.tablename = ");
+	appendStringLiteralAH(query, tbinfo->dobj.name, fout);
+	appendPQExpBuffer(query,
+					  " WHERE i.indrelid = '%u'::pg_catalog.oid "
+					  "AND i.indisprimary "
+					  "AND s.histogram_bounds IS NOT NULL",
+					  tbinfo->dobj.catId.oid);
+
+	res = ExecuteSqlQuery(fout, query->data, PGRES_TUPLES_OK);
+
+	if (PQntuples(res) != 1 ||
+		!parsePGArray(PQgetvalue(res, 0, 2), &bounds, &nbounds) ||
+		nbounds < 3)
+	{
+		if (g_verbose)
+			write_msg(NULL, "not splitting data of table \"%s.%s\": no primary key statistics\n",
+					  tbinfo->dobj.namespace->dobj.name, tbinfo->dobj.name);
+		if (bounds)
+			free(bounds);
+		PQclear(res);
+		destroyPQExpBuffer(query);
+		return;
+	}
+
+	/*
+	 * The nbounds histogram bounds delimit nbounds - 1 buckets of equal
+	 * population; pick nchunks - 1 of them as evenly spaced split points,
+	 * skipping duplicates.
+	 */
+	nchunks = Min(nchunks, nbounds - 1);
+	splits = (const char **) pg_malloc(nchunks * sizeof(char *));
+	nsplits = 0;
+	for (i = 1; i < nchunks; i++)
+	{
+		const char *b = bounds[(int) ((int64) i * (nbounds - 1) / nchunks)];
+
+		if (nsplits == 0 || strcmp(b, splits[nsplits - 1]) != 0)
+			splits[nsplits++] = b;
+	}
+
+	if (nsplits == 0)
+	{
+		free(splits);
+		free(bounds);
+		PQclear(res);
+		destroyPQExpBuffer(query);
+		return;
+	}
+
+	colname = pg_strdup(fmtId(PQgetvalue(res, 0, 0)));
+	coltype = PQgetvalue(res, 0, 1);
+
+	if (g_verbose)
+		write_msg(NULL, "splitting data of table \"%s.%s\" into %d parts\n",
+				  tbinfo->dobj.namespace->dobj.name, tbinfo->dobj.name,
+				  nsplits + 1);
+
+	/*
+	 * The existing data object dumps the first range.  The others copy its
+	 * dependencies, which are on the table, and on the data of referenced
+	 * tables in a data-only dump.
+	 */
+	chunks = (TableDataInfo **) pg_malloc((nsplits + 1) * sizeof(TableDataInfo *));
+	chunks[0] = tdinfo;
+	for (i = 0; i <= nsplits; i++)
+	{
+		TableDataInfo *chunk = chunks[0];
+
+		resetPQExpBuffer(query);
+		appendPQExpBufferStr(query, "WHERE ");
+		if (i > 0)
+		{
+			appendPQExpBuffer(query, "%s >= ", colname);
+			appendStringLiteralAH(query, splits[i - 1], fout);
+			appendPQExpBuffer(query, "::%s", coltype);
+		}
+		if (i > 0 && i < nsplits)
+			appendPQExpBufferStr(query, " AND ");
+		if (i < nsplits)
+		{
+			appendPQExpBuffer(query, "%s < ", colname);
+			appendStringLiteralAH(query, splits[i], fout);
+			appendPQExpBuffer(query, "::%s", coltype);
+		}
+
+		if (i > 0)
+		{
+			chunk = (TableDataInfo *) pg_malloc(sizeof(TableDataInfo));
+			chunk->dobj.objType = DO_TABLE_DATA;
+			chunk->dobj.catId = tdinfo->dobj.catId;
+			AssignDumpId(&chunk->dobj);
+			chunk->dobj.name = tdinfo->dobj.name;
+			chunk->dobj.namespace = tdinfo->dobj.namespace;
+			chunk->dobj.dump = tdinfo->dobj.dump;
+			chunk->dobj.dump_contains = tdinfo->dobj.dump_contains;
+			chunk->tdtable = tbinfo;
+			chunk->oids = tdinfo->oids;
+			for (j = 0; j < tdinfo->dobj.nDeps; j++)
+				addObjectDependency(&chunk->dobj, tdinfo->dobj.dependencies[j]);
+			chunks[i] = chunk;
+		}
+		chunk->filtercond = pg_strdup(query->data);
+	}
+
+	/*
+	 * Whatever depends on the table's data, such as the data of referencing
+	 * tables in a data-only dump, must wait for all of it.
+	 */
+	getDumpableObjects(&dobjs, &numObjs);
+	for (i = 0; i < numObjs; i++)
+	{
+		DumpableObject *dobj = dobjs[i];
+		int			nDeps = dobj->nDeps;
+
+		if (dobj->objType == DO_TABLE_DATA &&
+			((TableDataInfo *) dobj)->tdtable == tbinfo)
+			continue;
+		for (j = 0; j < nDeps; j++)
+		{
+			if (dobj->dependencies[j] == tdinfo->dobj.dumpId)
+			{
+				int			k;
+
+				for (k = 1; k <= nsplits; k++)
+					addObjectDependency(dobj, chunks[k]->dobj.dumpId);
+				break;
+			}
+		}
+	}
+	free(dobjs);
+
+	free(chunks);
+	free(colname);
+	free(splits);
+	free(bounds);
+	PQclear(res);
+	destroyPQExpBuffer(query);
+}
+
 /*
  * The refresh for a materialized view must be dependent on the refresh for
  * any materialized view that this one is dependent on.
@@ -4,7 +4,7 @@ use warnings;
 use Config;
 use PostgresNode;
 use TestLib;
-use Test::More tests => 15;
+use Test::More tests => 18;
 
 my $tempdir       = TestLib::tempdir;
 my $tempdir_short = TestLib::tempdir_short;
@@ -48,3 +48,12 @@ command_exit_is([ 'pg_dump', '-j' ],
 
 command_exit_is([ 'pg_dump', '-j3' ],
 	1, 'pg_dump: parallel backup only supported by the directory format');
+
+command_exit_is([ 'pg_dump', '-Z', 'lz4', '-Fp' ],
+	1, 'pg_dump: LZ4 compression is only supported by the custom and directory formats');
+
+command_exit_is([ 'pg_dump', '-Z', 'lz4:13', '-Fc' ],
+	1, 'pg_dump: LZ4 compression level must be in range 0..12');
+
+command_exit_is([ 'pg_dump', '--split-table-size=0' ],
+	1, 'pg_dump: split table size must be a positive number of megabytes');
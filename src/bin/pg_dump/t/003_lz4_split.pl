@@ -0,0 +1,90 @@
+use strict;
+use warnings;
+
+use PostgresNode;
+use TestLib;
+use Test::More tests => 13;
+
+my $tempdir = TestLib::tempdir;
+
+my $node = get_new_node('main');
+$node->init;
+$node->start;
+
+$node->safe_psql(
+	'postgres', q{
+	CREATE TABLE big_table (id int PRIMARY KEY, payload text);
+	INSERT INTO big_table
+		SELECT g, repeat(md5(g::text), 10) FROM generate_series(1, 50000) g;
+	CREATE TABLE small_table (id int, note text);
+	INSERT INTO small_table VALUES (1, 'one'), (2, 'two');
+	ANALYZE;
+});
+
+my $check_query = q{
+	SELECT count(*), md5(string_agg(id || ':' || payload, ',' ORDER BY id))
+	FROM big_table
+	UNION ALL
+	SELECT count(*), md5(string_agg(id || ':' || note, ',' ORDER BY id))
+	FROM small_table};
+my $expected = $node->safe_psql('postgres', $check_query);
+
+#########################################
+# Round trip of LZ4 compressed custom and directory format dumps
+
+my $stderr;
+foreach my $format ('custom', 'directory')
+{
+	my $dumpfile = "$tempdir/lz4_$format";
+
+	$stderr = '';
+	ok( run_log(
+			[   'pg_dump', '-p', $node->port, "--format=$format", '-Z', 'lz4',
+				'-f', $dumpfile, 'postgres' ],
+			'2>', \$stderr),
+		"pg_dump -Z lz4 with $format format");
+
+	$node->safe_psql('postgres', "CREATE DATABASE lz4_$format");
+	$node->command_ok([ 'pg_restore', '-d', "lz4_$format", $dumpfile ],
+		"pg_restore of $format format LZ4 dump");
+	is($node->safe_psql("lz4_$format", $check_query),
+		$expected, "$format format LZ4 dump restores the same data");
+}
+
+SKIP:
+{
+	skip "LZ4 not supported by this build", 1
+	  if $stderr =~ /requested compression not available/;
+
+	my @lz4_files = glob("$tempdir/lz4_directory/*.dat.lz4");
+	ok(scalar(@lz4_files) >= 2,
+		'directory format dump writes LZ4 compressed data files');
+}
+
+#########################################
+# Round trip of a parallel dump splitting the large table
+
+$node->command_ok(
+	[   'pg_dump', '--format=directory', '-j', '2', '-Z', 'lz4:9',
+		'--split-table-size=1', '-f', "$tempdir/split", 'postgres' ],
+	'parallel pg_dump with --split-table-size');
+
+my $toc_list = '';
+run_log([ 'pg_restore', '-l', "$tempdir/split" ], '>', \$toc_list);
+my $big_parts = () = $toc_list =~ /TABLE DATA public big_table /g;
+my $small_parts = () = $toc_list =~ /TABLE DATA public small_table /g;
+ok($big_parts > 1, 'large table is dumped in several parts');
+is($small_parts, 1, 'small table is dumped in one part');
+
+$node->safe_psql('postgres', 'CREATE DATABASE split_restore');
+$node->command_ok(
+	[ 'pg_restore', '-j', '2', '-d', 'split_restore', "$tempdir/split" ],
+	'parallel pg_restore of split dump');
+is($node->safe_psql('split_restore', $check_query),
+	$expected, 'split dump restores the same data');
+is( $node->safe_psql(
+		'split_restore',
+		q{SELECT count(*) FROM pg_index
+		  WHERE indrelid = 'big_table'::regclass AND indisprimary}),
+	'1',
+	'primary key is restored after all parts');
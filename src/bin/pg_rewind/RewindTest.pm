@@ -223,6 +223,17 @@ sub run_pg_rewind
 				"--target-pgdata=$master_pgdata" ],
 			'pg_rewind remote');
 	}
+	elsif ($test_mode eq "remote_parallel")
+	{
+
+		# Same as remote, but fetch through several connections
+		command_ok(
+			[   'pg_rewind',       "--debug",
+				"--source-server", $standby_connstr,
+				"--jobs=4",
+				"--target-pgdata=$master_pgdata" ],
+			'pg_rewind remote parallel');
+	}
 	else
 	{
 
@@ -14,6 +14,9 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 /* for ntohl/htonl */
 #include <netinet/in.h>
@@ -32,29 +35,68 @@
 
 static PGconn *conn = NULL;
 
+/*
+ * Connections that fetch file chunks, num_jobs of them.  The first one is
+ * "conn", the others are only opened for fetching.  Each file is fetched
+ * through a single connection, and fetch_queued tracks how many bytes have
+ * been queued to each connection, to spread the work evenly.
+ */
+static PGconn **fetch_conns = NULL;
+static uint64 *fetch_queued = NULL;
+
 /*
  * Files are fetched max CHUNKSIZE bytes at a time.
  *
  * (This only applies to files that are copied in whole, or for truncated
  * files where we copy the tail. Relation files, where we know the individual
- * blocks that need to be fetched, are fetched in BLCKSZ chunks.)
+ * blocks that need to be fetched, are fetched in runs of adjacent blocks,
+ * split into CHUNKSIZE chunks as well.)
  */
 #define CHUNKSIZE 1000000
 
+static PGconn *connectSource(const char *connstr);
 static void receiveFileChunks(const char *sql);
-static void execute_pagemap(datapagemap_t *pagemap, const char *path);
+static void processFileChunk(PGresult *res);
+static void execute_pagemap(int connidx, datapagemap_t *pagemap,
+				const char *path);
 static char *run_simple_query(const char *sql);
 
+/*
+ * Open a connection to the source server.
+ */
+static PGconn *
+connectSource(const char *connstr)
+{
+	PGconn	   *newconn;
+	PGresult   *res;
+
+	newconn = PQconnectdb(connstr);
+	if (PQstatus(newconn) == CONNECTION_BAD)
+		pg_fatal("could not connect to server: %s",
+				 PQerrorMessage(newconn));
+
+	/*
+	 * Although we don't do any "real" updates, we do work with a temporary
+	 * table. We don't care about synchronous commit for that. It doesn't
+	 * otherwise matter much, but if the server is using synchronous
+	 * replication, and replication isn't working for some reason, we don't
+	 * want to get stuck, waiting for it to start working again.
+	 */
+	res = PQexec(newconn, "SET synchronous_commit = off");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		pg_fatal("could not set up connection context: %s",
+				 PQresultErrorMessage(res));
+	PQclear(res);
+
+	return newconn;
+}
+
 void
 libpqConnect(const char *connstr)
 {
 	char	   *str;
-	PGresult   *res;
 
-	conn = PQconnectdb(connstr);
-	if (PQstatus(conn) == CONNECTION_BAD)
-		pg_fatal("could not connect to server: %s",
-				 PQerrorMessage(conn));
+	conn = connectSource(connstr);
 
 	pg_log(PG_PROGRESS, "connected to server\n");
 
@@ -78,19 +120,6 @@ libpqConnect(const char *connstr)
 	if (strcmp(str, "on") != 0)
 		pg_fatal("full_page_writes must be enabled in the source server\n");
 	pg_free(str);
-
-	/*
-	 * Although we don't do any "real" updates, we do work with a temporary
-	 * table. We don't care about synchronous commit for that. It doesn't
-	 * otherwise matter much, but if the server is using synchronous
-	 * replication, and replication isn't working for some reason, we don't
-	 * want to get stuck, waiting for it to start working again.
-	 */
-	res = PQexec(conn, "SET synchronous_commit = off");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK)
-		pg_fatal("could not set up connection context: %s",
-				 PQresultErrorMessage(res));
-	PQclear(res);
 }
 
 /*
@@ -244,122 +273,199 @@ pg_recvint64(int64 value)
 }
 
 /*----
- * Runs a query, which returns pieces of files from the remote source data
- * directory, and overwrites the corresponding parts of target files with
- * the received parts. The result set is expected to be of format:
+ * Runs a query on all fetch connections, which returns pieces of files from
+ * the remote source data directory, and overwrites the corresponding parts
+ * of target files with the received parts. The result set is expected to be
+ * of format:
  *
  * path		text	-- path in the data directory, e.g "base/1/123"
  * begin	int8	-- offset within the file
  * chunk	bytea	-- file content
+ *
+ * The results are processed in whatever order they arrive from the
+ * connections.
  *----
  */
 static void
 receiveFileChunks(const char *sql)
 {
-	PGresult   *res;
+	bool	   *finished;
+	int			nactive = num_jobs;
+	int			i;
 
-	if (PQsendQueryParams(conn, sql, 0, NULL, NULL, NULL, NULL, 1) != 1)
-		pg_fatal("could not send query: %s", PQerrorMessage(conn));
+	finished = pg_malloc0(num_jobs * sizeof(bool));
 
-	pg_log(PG_DEBUG, "getting file chunks\n");
+	for (i = 0; i < num_jobs; i++)
+	{
+		if (PQsendQueryParams(fetch_conns[i], sql, 0, NULL, NULL, NULL, NULL, 1) != 1)
+			pg_fatal("could not send query: %s", PQerrorMessage(fetch_conns[i]));
 
-	if (PQsetSingleRowMode(conn) != 1)
-		pg_fatal("could not set libpq connection to single row mode\n");
+		if (PQsetSingleRowMode(fetch_conns[i]) != 1)
+			pg_fatal("could not set libpq connection to single row mode\n");
+	}
 
-	while ((res = PQgetResult(conn)) != NULL)
-	{
-		char	   *filename;
-		int			filenamelen;
-		int64		chunkoff;
-		char		chunkoff_str[32];
-		int			chunksize;
-		char	   *chunk;
-
-		switch (PQresultStatus(res))
-		{
-			case PGRES_SINGLE_TUPLE:
-				break;
+	pg_log(PG_DEBUG, "getting file chunks\n");
 
-			case PGRES_TUPLES_OK:
-				PQclear(res);
-				continue;		/* final zero-row result */
+	while (nactive > 0)
+	{
+		bool		gotresult = false;
+		fd_set		input_mask;
+		int			maxfd = -1;
 
-			default:
-				pg_fatal("unexpected result while fetching remote files: %s",
-						 PQresultErrorMessage(res));
+		/* Process all the results that have arrived */
+		for (i = 0; i < num_jobs; i++)
+		{
+			PGresult   *res;
+
+			while (!finished[i] && !PQisBusy(fetch_conns[i]))
+			{
+				res = PQgetResult(fetch_conns[i]);
+				gotresult = true;
+
+				if (res == NULL)
+				{
+					finished[i] = true;
+					nactive--;
+				}
+				else
+					processFileChunk(res);
+			}
 		}
 
-		/* sanity check the result set */
-		if (PQnfields(res) != 3 || PQntuples(res) != 1)
-			pg_fatal("unexpected result set size while fetching remote files\n");
+		if (gotresult || nactive == 0)
+			continue;
 
-		if (PQftype(res, 0) != TEXTOID ||
-			PQftype(res, 1) != INT8OID ||
-			PQftype(res, 2) != BYTEAOID)
+		/* Wait for more data on any of the connections */
+		FD_ZERO(&input_mask);
+		for (i = 0; i < num_jobs; i++)
 		{
-			pg_fatal("unexpected data types in result set while fetching remote files: %u %u %u\n",
-					 PQftype(res, 0), PQftype(res, 1), PQftype(res, 2));
+			int			sock = PQsocket(fetch_conns[i]);
+
+			if (finished[i])
+				continue;
+			if (sock < 0)
+				pg_fatal("invalid socket: %s", PQerrorMessage(fetch_conns[i]));
+			FD_SET(sock, &input_mask);
+			if (sock > maxfd)
+				maxfd = sock;
 		}
 
-		if (PQfformat(res, 0) != 1 &&
-			PQfformat(res, 1) != 1 &&
-			PQfformat(res, 2) != 1)
+		if (select(maxfd + 1, &input_mask, NULL, NULL, NULL) < 0)
 		{
-			pg_fatal("unexpected result format while fetching remote files\n");
+			if (errno == EINTR)
+				continue;
+			pg_fatal("select() failed: %s\n", strerror(errno));
 		}
 
-		if (PQgetisnull(res, 0, 0) ||
-			PQgetisnull(res, 0, 1))
+		for (i = 0; i < num_jobs; i++)
 		{
-			pg_fatal("unexpected null values in result while fetching remote files\n");
+			if (!finished[i] && PQconsumeInput(fetch_conns[i]) != 1)
+				pg_fatal("could not receive data from server: %s",
+						 PQerrorMessage(fetch_conns[i]));
 		}
+	}
 
-		if (PQgetlength(res, 0, 1) != sizeof(int64))
-			pg_fatal("unexpected result length while fetching remote files\n");
+	pg_free(finished);
+}
 
-		/* Read result set to local variables */
-		memcpy(&chunkoff, PQgetvalue(res, 0, 1), sizeof(int64));
-		chunkoff = pg_recvint64(chunkoff);
-		chunksize = PQgetlength(res, 0, 2);
+/*
+ * Write one row received by receiveFileChunks() to the target file, and
+ * free the result.
+ */
+static void
+processFileChunk(PGresult *res)
+{
+	char	   *filename;
+	int			filenamelen;
+	int64		chunkoff;
+	char		chunkoff_str[32];
+	int			chunksize;
+	char	   *chunk;
+
+	switch (PQresultStatus(res))
+	{
+		case PGRES_SINGLE_TUPLE:
+			break;
 
-		filenamelen = PQgetlength(res, 0, 0);
-		filename = pg_malloc(filenamelen + 1);
-		memcpy(filename, PQgetvalue(res, 0, 0), filenamelen);
-		filename[filenamelen] = '\0';
+		case PGRES_TUPLES_OK:
+			PQclear(res);
+			return;				/* final zero-row result */
 
-		chunk = PQgetvalue(res, 0, 2);
+		default:
+			pg_fatal("unexpected result while fetching remote files: %s",
+					 PQresultErrorMessage(res));
+	}
 
-		/*
-		 * It's possible that the file was deleted on remote side after we
-		 * created the file map. In this case simply ignore it, as if it was
-		 * not there in the first place, and move on.
-		 */
-		if (PQgetisnull(res, 0, 2))
-		{
-			pg_log(PG_DEBUG,
-				   "received null value for chunk for file \"%s\", file has been deleted\n",
-				   filename);
-			pg_free(filename);
-			PQclear(res);
-			continue;
-		}
+	/* sanity check the result set */
+	if (PQnfields(res) != 3 || PQntuples(res) != 1)
+		pg_fatal("unexpected result set size while fetching remote files\n");
+
+	if (PQftype(res, 0) != TEXTOID ||
+		PQftype(res, 1) != INT8OID ||
+		PQftype(res, 2) != BYTEAOID)
+	{
+		pg_fatal("unexpected data types in result set while fetching remote files: %u %u %u\n",
+				 PQftype(res, 0), PQftype(res, 1), PQftype(res, 2));
+	}
 
-		/*
-		 * Separate step to keep platform-dependent format code out of
-		 * translatable strings.
-		 */
-		snprintf(chunkoff_str, sizeof(chunkoff_str), INT64_FORMAT, chunkoff);
-		pg_log(PG_DEBUG, "received chunk for file \"%s\", offset %s, size %d\n",
-			   filename, chunkoff_str, chunksize);
+	if (PQfformat(res, 0) != 1 &&
+		PQfformat(res, 1) != 1 &&
+		PQfformat(res, 2) != 1)
+	{
+		pg_fatal("unexpected result format while fetching remote files\n");
+	}
+
+	if (PQgetisnull(res, 0, 0) ||
+		PQgetisnull(res, 0, 1))
+	{
+		pg_fatal("unexpected null values in result while fetching remote files\n");
+	}
 
-		open_target_file(filename, false);
+	if (PQgetlength(res, 0, 1) != sizeof(int64))
+		pg_fatal("unexpected result length while fetching remote files\n");
 
-		write_target_range(chunk, chunkoff, chunksize);
+	/* Read result set to local variables */
+	memcpy(&chunkoff, PQgetvalue(res, 0, 1), sizeof(int64));
+	chunkoff = pg_recvint64(chunkoff);
+	chunksize = PQgetlength(res, 0, 2);
 
-		pg_free(filename);
+	filenamelen = PQgetlength(res, 0, 0);
+	filename = pg_malloc(filenamelen + 1);
+	memcpy(filename, PQgetvalue(res, 0, 0), filenamelen);
+	filename[filenamelen] = '\0';
 
+	chunk = PQgetvalue(res, 0, 2);
+
+	/*
+	 * It's possible that the file was deleted on remote side after we
+	 * created the file map. In this case simply ignore it, as if it was not
+	 * there in the first place, and move on.
+	 */
+	if (PQgetisnull(res, 0, 2))
+	{
+		pg_log(PG_DEBUG,
+			   "received null value for chunk for file \"%s\", file has been deleted\n",
+			   filename);
+		pg_free(filename);
 		PQclear(res);
+		return;
 	}
+
+	/*
+	 * Separate step to keep platform-dependent format code out of
+	 * translatable strings.
+	 */
+	snprintf(chunkoff_str, sizeof(chunkoff_str), INT64_FORMAT, chunkoff);
+	pg_log(PG_DEBUG, "received chunk for file \"%s\", offset %s, size %d\n",
+		   filename, chunkoff_str, chunksize);
+
+	open_target_file(filename, false);
+
+	write_target_range(chunk, chunkoff, chunksize);
+
+	pg_free(filename);
+
+	PQclear(res);
 }
 
 /*
@@ -405,11 +511,11 @@ libpqGetFile(const char *filename, size_t *filesize)
  * Write a file range to a temporary table in the server.
  *
  * The range is sent to the server as a COPY formatted line, to be inserted
- * into the 'fetchchunks' temporary table. It is used in receiveFileChunks()
- * function to actually fetch the data.
+ * into the 'fetchchunks' temporary table of the given fetch connection. It is
+ * used in receiveFileChunks() function to actually fetch the data.
  */
 static void
-fetch_file_range(const char *path, uint64 begin, uint64 end)
+fetch_file_range(int connidx, const char *path, uint64 begin, uint64 end)
 {
 	char		linebuf[MAXPGPATH + 23];
 
@@ -426,10 +532,11 @@ fetch_file_range(const char *path, uint64 begin, uint64 end)
 
 		snprintf(linebuf, sizeof(linebuf), "%s\t" UINT64_FORMAT "\t%u\n", path, begin, len);
 
-		if (PQputCopyData(conn, linebuf, strlen(linebuf)) != 1)
+		if (PQputCopyData(fetch_conns[connidx], linebuf, strlen(linebuf)) != 1)
 			pg_fatal("could not send COPY data: %s",
-					 PQerrorMessage(conn));
+					 PQerrorMessage(fetch_conns[connidx]));
 
+		fetch_queued[connidx] += len;
 		begin += len;
 	}
 }
@@ -444,33 +551,53 @@ libpq_executeFileMap(filemap_t *map)
 	const char *sql;
 	PGresult   *res;
 	int			i;
+	int			j;
+
+	/* Open the additional connections for fetching in parallel */
+	fetch_conns = pg_malloc(num_jobs * sizeof(PGconn *));
+	fetch_queued = pg_malloc0(num_jobs * sizeof(uint64));
+	fetch_conns[0] = conn;
+	for (j = 1; j < num_jobs; j++)
+		fetch_conns[j] = connectSource(connstr_source);
 
 	/*
-	 * First create a temporary table, and load it with the blocks that we
-	 * need to fetch.
+	 * First create a temporary table in each connection, and load them with
+	 * the blocks that we need to fetch.
 	 */
-	sql = "CREATE TEMPORARY TABLE fetchchunks(path text, begin int8, len int4);";
-	res = PQexec(conn, sql);
+	for (j = 0; j < num_jobs; j++)
+	{
+		sql = "CREATE TEMPORARY TABLE fetchchunks(path text, begin int8, len int4);";
+		res = PQexec(fetch_conns[j], sql);
 
-	if (PQresultStatus(res) != PGRES_COMMAND_OK)
-		pg_fatal("could not create temporary table: %s",
-				 PQresultErrorMessage(res));
-	PQclear(res);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			pg_fatal("could not create temporary table: %s",
+					 PQresultErrorMessage(res));
+		PQclear(res);
 
-	sql = "COPY fetchchunks FROM STDIN";
-	res = PQexec(conn, sql);
+		sql = "COPY fetchchunks FROM STDIN";
+		res = PQexec(fetch_conns[j], sql);
 
-	if (PQresultStatus(res) != PGRES_COPY_IN)
-		pg_fatal("could not send file list: %s",
-				 PQresultErrorMessage(res));
-	PQclear(res);
+		if (PQresultStatus(res) != PGRES_COPY_IN)
+			pg_fatal("could not send file list: %s",
+					 PQresultErrorMessage(res));
+		PQclear(res);
+	}
 
 	for (i = 0; i < map->narray; i++)
 	{
+		int			connidx = 0;
+
 		entry = map->array[i];
 
+		/* Fetch the file through the connection with the least work queued */
+		for (j = 1; j < num_jobs; j++)
+		{
+			if (fetch_queued[j] < fetch_queued[connidx])
+				connidx = j;
+		}
+
 		/* If this is a relation file, copy the modified blocks */
-		execute_pagemap(&entry->pagemap, entry->path);
+		execute_pagemap(connidx, &entry->pagemap, entry->path);
 
 		switch (entry->action)
 		{
@@ -481,7 +608,7 @@ libpq_executeFileMap(filemap_t *map)
 			case FILE_ACTION_COPY:
 				/* Truncate the old file out of the way, if any */
 				open_target_file(entry->path, true);
-				fetch_file_range(entry->path, 0, entry->newsize);
+				fetch_file_range(connidx, entry->path, 0, entry->newsize);
 				break;
 
 			case FILE_ACTION_TRUNCATE:
@@ -489,7 +616,8 @@ libpq_executeFileMap(filemap_t *map)
 				break;
 
 			case FILE_ACTION_COPY_TAIL:
-				fetch_file_range(entry->path, entry->oldsize, entry->newsize);
+				fetch_file_range(connidx, entry->path, entry->oldsize,
+								 entry->newsize);
 				break;
 
 			case FILE_ACTION_REMOVE:
@@ -502,21 +630,24 @@ libpq_executeFileMap(filemap_t *map)
 		}
 	}
 
-	if (PQputCopyEnd(conn, NULL) != 1)
-		pg_fatal("could not send end-of-COPY: %s",
-				 PQerrorMessage(conn));
-
-	while ((res = PQgetResult(conn)) != NULL)
+	for (j = 0; j < num_jobs; j++)
 	{
-		if (PQresultStatus(res) != PGRES_COMMAND_OK)
-			pg_fatal("unexpected result while sending file list: %s",
-					 PQresultErrorMessage(res));
-		PQclear(res);
+		if (PQputCopyEnd(fetch_conns[j], NULL) != 1)
+			pg_fatal("could not send end-of-COPY: %s",
+					 PQerrorMessage(fetch_conns[j]));
+
+		while ((res = PQgetResult(fetch_conns[j])) != NULL)
+		{
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				pg_fatal("unexpected result while sending file list: %s",
+						 PQresultErrorMessage(res));
+			PQclear(res);
+		}
 	}
 
 	/*
 	 * We've now copied the list of file ranges that we need to fetch to the
-	 * temporary table. Now, actually fetch all of those ranges.
+	 * temporary tables. Now, actually fetch all of those ranges.
 	 */
 	sql =
 		"SELECT path, begin, \n"
@@ -524,21 +655,44 @@ libpq_executeFileMap(filemap_t *map)
 		"FROM fetchchunks\n";
 
 	receiveFileChunks(sql);
+
+	for (j = 1; j < num_jobs; j++)
+		PQfinish(fetch_conns[j]);
+	pg_free(fetch_conns);
+	pg_free(fetch_queued);
+	fetch_conns = NULL;
+	fetch_queued = NULL;
 }
 
+/*
+ * Queue the modified blocks of a relation file for fetching.  Runs of
+ * adjacent blocks are fetched as one range, rather than block by block.
+ */
 static void
-execute_pagemap(datapagemap_t *pagemap, const char *path)
+execute_pagemap(int connidx, datapagemap_t *pagemap, const char *path)
 {
 	datapagemap_iterator_t *iter;
 	BlockNumber blkno;
-	off_t		offset;
+	BlockNumber runstart = InvalidBlockNumber;
+	BlockNumber runlen = 0;
 
 	iter = datapagemap_iterate(pagemap);
 	while (datapagemap_next(iter, &blkno))
 	{
-		offset = blkno * BLCKSZ;
+		if (runlen > 0 && blkno == runstart + runlen)
+		{
+			runlen++;
+			continue;
+		}
 
-		fetch_file_range(path, offset, offset + BLCKSZ);
+		if (runlen > 0)
+			fetch_file_range(connidx, path, (uint64) runstart * BLCKSZ,
+							 (uint64) (runstart + runlen) * BLCKSZ);
+		runstart = blkno;
+		runlen = 1;
 	}
+	if (runlen > 0)
+		fetch_file_range(connidx, path, (uint64) runstart * BLCKSZ,
+						 (uint64) (runstart + runlen) * BLCKSZ);
 	pg_free(iter);
 }
@@ -53,6 +53,7 @@ char	   *connstr_source = NULL;
 bool		debug = false;
 bool		showprogress = false;
 bool		dry_run = false;
+int			num_jobs = 1;
 
 /* Target history */
 TimeLineHistoryEntry *targetHistory;
@@ -67,6 +68,7 @@ usage(const char *progname)
 	printf(_("  -D, --target-pgdata=DIRECTORY  existing data directory to modify\n"));
 	printf(_("      --source-pgdata=DIRECTORY  source data directory to synchronize with\n"));
 	printf(_("      --source-server=CONNSTR    source server to synchronize with\n"));
+	printf(_("  -j, --jobs=NUM                 use this many connections to fetch files\n"));
 	printf(_("  -n, --dry-run                  stop before modifying anything\n"));
 	printf(_("  -P, --progress                 write progress messages\n"));
 	printf(_("      --debug                    write a lot of debug messages\n"));
@@ -88,6 +90,7 @@ main(int argc, char **argv)
 		{"dry-run", no_argument, NULL, 'n'},
 		{"progress", no_argument, NULL, 'P'},
 		{"debug", no_argument, NULL, 3},
+		{"jobs", required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	int			option_index;
@@ -122,7 +125,7 @@ main(int argc, char **argv)
 		}
 	}
 
-	while ((c = getopt_long(argc, argv, "D:nP", long_options, &option_index)) != -1)
+	while ((c = getopt_long(argc, argv, "D:j:nP", long_options, &option_index)) != -1)
 	{
 		switch (c)
 		{
@@ -142,6 +145,16 @@ main(int argc, char **argv)
 				debug = true;
 				break;
 
+			case 'j':
+				num_jobs = atoi(optarg);
+				if (num_jobs <= 0)
+				{
+					fprintf(stderr, _("%s: invalid number of jobs \"%s\"\n"),
+							progname, optarg);
+					exit(1);
+				}
+				break;
+
 			case 'D':			/* -D or --target-pgdata */
 				datadir_target = pg_strdup(optarg);
 				break;
@@ -169,6 +182,13 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (num_jobs > 1 && connstr_source == NULL)
+	{
+		fprintf(stderr, _("%s: parallel jobs can only be used with --source-server\n"), progname);
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
+		exit(1);
+	}
+
 	if (datadir_target == NULL)
 	{
 		fprintf(stderr, _("%s: no target data directory specified (--target-pgdata)\n"), progname);
@@ -1,7 +1,7 @@
 use strict;
 use warnings;
 use TestLib;
-use Test::More tests => 8;
+use Test::More tests => 12;
 
 use RewindTest;
 
@@ -89,8 +89,9 @@ in master, before promotion
 	RewindTest::clean_rewind_test();
 }
 
-# Run the test in both modes
+# Run the test in all modes
 run_test('local');
 run_test('remote');
+run_test('remote_parallel');
 
 exit(0);
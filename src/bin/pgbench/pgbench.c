@@ -139,6 +139,18 @@ int64		throttle_delay = 0;
  */
 int64		latency_limit = 0;
 
+/*
+ * Number of times a transaction is tried before it's counted as failed, if
+ * it fails with a serialization failure or other error that a concurrent
+ * transaction can cause.
+ */
+int			max_tries = 1;
+
+/*
+ * write the latency distribution in HdrHistogram's percentile format here
+ */
+char	   *hdr_histogram_file = NULL;
+
 /*
  * tablespace selection
  */
@@ -184,6 +196,26 @@ const char *progname;
 
 #define WSEP '@'				/* weight separator */
 
+/*
+ * Servers to run the benchmark against.  -h and -p accept comma-separated
+ * lists, and the clients are distributed over the hosts in proportion to
+ * their weights, for benchmarking a multi-master cluster.
+ */
+typedef struct BenchHost
+{
+	char	   *host;			/* host name, or "" for the default */
+	char	   *port;			/* port, or "" for the default */
+	int			weight;			/* share of the clients */
+	int			nclients;		/* number of clients assigned */
+} BenchHost;
+
+static BenchHost *hosts;
+static int	nhosts = 0;
+static int64 total_host_weight = 0;
+
+/* collect latency statistics per host? */
+static bool per_host_stats = false;
+
 volatile bool timer_exceeded = false;	/* flag from signal handler */
 
 /*
@@ -226,14 +258,44 @@ typedef struct SimpleStats
  */
 typedef struct StatsData
 {
-	long		start_time;		/* interval start time, for aggregates */
+	time_t		start_time;		/* interval start time, for aggregates */
 	int64		cnt;			/* number of transactions */
 	int64		skipped;		/* number of transactions skipped under --rate
 								 * and --latency-limit */
+	int64		retries;		/* number of transaction retries */
+	int64		failures;		/* number of transactions that failed on all
+								 * tries */
 	SimpleStats latency;
 	SimpleStats lag;
 } StatsData;
 
+/*
+ * Latency histogram, in the style of HdrHistogram: each power of two of
+ * microseconds is divided into HIST_SUB_BUCKETS linear buckets, so that the
+ * relative error of a recorded value is below 1/HIST_SUB_BUCKETS.  Values
+ * up to 2^(HIST_MAGNITUDES + 7) us, about 76 hours, are recorded exactly
+ * that way; larger ones go to the last bucket.
+ */
+#define HIST_SUB_BITS		7
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_MAGNITUDES		32
+#define HIST_SIZE			((HIST_MAGNITUDES + 2) * HIST_SUB_BUCKETS)
+
+typedef struct Histogram
+{
+	int64	   *counts;			/* HIST_SIZE buckets */
+	int64		total;			/* number of values recorded */
+} Histogram;
+
+/*
+ * Statistics collected per host, by each thread
+ */
+typedef struct HostStats
+{
+	StatsData	stats;
+	Histogram	hist;
+} HostStats;
+
 /*
  * Connection state
  */
@@ -255,6 +317,8 @@ typedef struct
 	instr_time	stmt_begin;		/* used for measuring statement latencies */
 	int			use_file;		/* index in sql_scripts for this client */
 	bool		prepared[MAX_SCRIPTS];	/* whether client prepared the script */
+	int			host;			/* index in hosts[] for this client */
+	int			tries;			/* failed tries of the current transaction */
 
 	/* per client collected stats */
 	int64		cnt;			/* transaction count */
@@ -279,6 +343,7 @@ typedef struct
 	instr_time	conn_time;
 	StatsData	stats;
 	int64		latency_late;	/* executed but late transactions */
+	HostStats  *host_stats;		/* per-host stats, if per_host_stats */
 } TState;
 
 #define INVALID_THREAD		((pthread_t) 0)
@@ -378,7 +443,7 @@ static const BuiltinScript builtin_script[] =
 static void setIntValue(PgBenchValue *pv, int64 ival);
 static void setDoubleValue(PgBenchValue *pv, double dval);
 static bool evaluateExpr(TState *, CState *, PgBenchExpr *, PgBenchValue *);
-static void doLog(TState *thread, CState *st, instr_time *now,
+static void doLog(TState *thread, CState *st,
 	  StatsData *agg, bool skipped, double latency, double lag);
 static void processXactStats(TState *thread, CState *st, instr_time *now,
 				 bool skipped, StatsData *agg);
@@ -439,12 +504,17 @@ usage(void)
 		 "  -T, --time=NUM           duration of benchmark test in seconds\n"
 		   "  -v, --vacuum-all         vacuum all four standard tables before tests\n"
 		   "  --aggregate-interval=NUM aggregate data over NUM seconds\n"
+		   "  --hdr-histogram=FILENAME write latency distribution to FILENAME\n"
+		   "  --max-tries=NUM          try transactions failing on concurrency errors\n"
+		   "                           up to NUM times (default: 1)\n"
 		"  --progress-timestamp     use Unix epoch timestamps for progress\n"
 		   "  --sampling-rate=NUM      fraction of transactions to log (e.g., 0.01 for 1%%)\n"
 		   "\nCommon options:\n"
 		   "  -d, --debug              print debugging output\n"
-	  "  -h, --host=HOSTNAME      database server host or socket directory\n"
-		   "  -p, --port=PORT          database server port number\n"
+	  "  -h, --host=HOSTNAME[@W],...\n"
+		   "                           database server host(s) or socket directory,\n"
+		   "                           with clients distributed by weight W (default: 1)\n"
+		   "  -p, --port=PORT,...      database server port number(s)\n"
 		   "  -U, --username=USERNAME  connect as specified database user\n"
 		 "  -V, --version            output version information, then exit\n"
 		   "  -?, --help               show this help, then exit\n"
@@ -707,15 +777,102 @@ mergeSimpleStats(SimpleStats *acc, SimpleStats *ss)
  * the given value.
  */
 static void
-initStats(StatsData *sd, double start_time)
+initStats(StatsData *sd, time_t start_time)
 {
 	sd->start_time = start_time;
 	sd->cnt = 0;
 	sd->skipped = 0;
+	sd->retries = 0;
+	sd->failures = 0;
 	initSimpleStats(&sd->latency);
 	initSimpleStats(&sd->lag);
 }
 
+/*
+ * Merge the counters and latencies of two StatsData structs
+ */
+static void
+mergeStats(StatsData *acc, StatsData *sd)
+{
+	acc->cnt += sd->cnt;
+	acc->skipped += sd->skipped;
+	acc->retries += sd->retries;
+	acc->failures += sd->failures;
+	mergeSimpleStats(&acc->latency, &sd->latency);
+	mergeSimpleStats(&acc->lag, &sd->lag);
+}
+
+static void
+initHistogram(Histogram *hist)
+{
+	hist->counts = (int64 *) pg_malloc0(HIST_SIZE * sizeof(int64));
+	hist->total = 0;
+}
+
+/*
+ * Record a latency, in microseconds, in a histogram.
+ *
+ * Values below 2 * HIST_SUB_BUCKETS map to their own bucket; above that,
+ * values are shifted right by their magnitude until they are in the range
+ * [HIST_SUB_BUCKETS, 2 * HIST_SUB_BUCKETS).
+ */
+static void
+addToHistogram(Histogram *hist, double val)
+{
+	int64		v = (val < 0.0) ? 0 : (int64) val;
+	int			mag = 0;
+	int			idx;
+
+	while ((v >> mag) >= 2 * HIST_SUB_BUCKETS && mag < HIST_MAGNITUDES)
+		mag++;
+	idx = mag * HIST_SUB_BUCKETS + (int) Min(v >> mag, 2 * HIST_SUB_BUCKETS - 1);
+
+	hist->counts[idx]++;
+	hist->total++;
+}
+
+/* Highest value, in microseconds, that is recorded in the given bucket */
+static double
+histogramBucketValue(int idx)
+{
+	int			mag = (idx < 2 * HIST_SUB_BUCKETS) ? 0 : idx / HIST_SUB_BUCKETS - 1;
+	int64		sub = idx - mag * HIST_SUB_BUCKETS;
+
+	return (double) (((sub + 1) << mag) - 1);
+}
+
+static void
+mergeHistogram(Histogram *acc, Histogram *hist)
+{
+	int			i;
+
+	for (i = 0; i < HIST_SIZE; i++)
+		acc->counts[i] += hist->counts[i];
+	acc->total += hist->total;
+}
+
+/*
+ * Return the latency, in microseconds, below which the given percentage of
+ * the values recorded in the histogram are
+ */
+static double
+histogramPercentile(Histogram *hist, double percentile)
+{
+	int64		target = (int64) ceil(hist->total * percentile / 100.0);
+	int64		count = 0;
+	int			i;
+
+	if (target < 1)
+		target = 1;
+	for (i = 0; i < HIST_SIZE; i++)
+	{
+		count += hist->counts[i];
+		if (count >= target)
+			return histogramBucketValue(i);
+	}
+	return 0.0;
+}
+
 /*
  * Accumulate one additional item into the given stats object.
  */
@@ -769,9 +926,9 @@ tryExecuteStatement(PGconn *con, const char *sql)
 	PQclear(res);
 }
 
-/* set up a connection to the backend */
+/* set up a connection to the backend of the given host */
 static PGconn *
-doConnect(void)
+doConnect(int host)
 {
 	PGconn	   *conn;
 	static char *password = NULL;
@@ -789,9 +946,9 @@ doConnect(void)
 		const char *values[PARAMS_ARRAY_SIZE];
 
 		keywords[0] = "host";
-		values[0] = pghost;
+		values[0] = hosts[host].host;
 		keywords[1] = "port";
-		values[1] = pgport;
+		values[1] = hosts[host].port;
 		keywords[2] = "user";
 		values[2] = login;
 		keywords[3] = "password";
@@ -1761,6 +1918,98 @@ chooseScript(TState *thread)
 	return i - 1;
 }
 
+/*
+ * Is the error that the given result reports one that a concurrent
+ * transaction can cause, so that the transaction should be tried again?
+ *
+ * These are serialization failures, deadlocks and the other errors of
+ * SQLSTATE class 40, "transaction rollback".  In a multi-master cluster,
+ * a distributed transaction that loses a conflict is only aborted at
+ * commit, with an error code that depends on the reason, so an error
+ * reported by a COMMIT, END or PREPARE TRANSACTION command is retried too.
+ */
+static bool
+isRetryableError(const Command *command, PGresult *res)
+{
+	static const char *const commit_commands[] = {"commit", "end", "prepare"};
+	const char *sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+	const char *sql = command->argv[0];
+	int			i;
+
+	if (sqlstate != NULL && strncmp(sqlstate, "40", 2) == 0)
+		return true;
+
+	while (isspace((unsigned char) *sql))
+		sql++;
+	for (i = 0; i < lengthof(commit_commands); i++)
+	{
+		int			len = strlen(commit_commands[i]);
+
+		if (pg_strncasecmp(sql, commit_commands[i], len) == 0 &&
+			!isalnum((unsigned char) sql[len]) && sql[len] != '_')
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Handle a retryable error of the client's current transaction: roll back,
+ * and start the transaction over, unless it has failed max_tries times
+ * already, in which case it's counted as failed, and the client goes on
+ * with the next one.  Returns false if the client is done.
+ */
+static bool
+retryTransaction(TState *thread, CState *st)
+{
+	StatsData  *hoststats = NULL;
+
+	if (thread->host_stats)
+		hoststats = &thread->host_stats[st->host].stats;
+
+	/* the error may have left the script's transaction block open */
+	if (PQtransactionStatus(st->con) != PQTRANS_IDLE)
+	{
+		PGresult   *res = PQexec(st->con, "ROLLBACK");
+
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			fprintf(stderr, "client %d aborted while rolling back: %s",
+					st->id, PQerrorMessage(st->con));
+			PQclear(res);
+			return false;
+		}
+		PQclear(res);
+	}
+
+	st->state = 0;
+	st->listen = false;
+
+	if (++st->tries < max_tries)
+	{
+		if (debug)
+			fprintf(stderr, "client %d retrying transaction (try %d)\n",
+					st->id, st->tries + 1);
+		thread->stats.retries++;
+		if (hoststats)
+			hoststats->retries++;
+		return true;
+	}
+
+	thread->stats.failures++;
+	if (hoststats)
+		hoststats->failures++;
+	st->tries = 0;
+
+	/* failed transactions count towards -t, so that the client finishes */
+	++st->cnt;
+	if ((st->cnt >= nxacts && duration <= 0) || timer_exceeded)
+		return false;
+
+	st->use_file = chooseScript(thread);
+	st->is_throttled = false;
+	return true;
+}
+
 /* return false iff client should be disconnected */
 static bool
 doCustom(TState *thread, CState *st, StatsData *agg)
@@ -1879,16 +2128,6 @@ top:
 							 INSTR_TIME_GET_DOUBLE(st->stmt_begin));
 		}
 
-		/* transaction finished: calculate latency and log the transaction */
-		if (commands[st->state + 1] == NULL)
-		{
-			if (progress || throttle_delay || latency_limit ||
-				per_script_stats || use_log)
-				processXactStats(thread, st, &now, false, agg);
-			else
-				thread->stats.cnt++;
-		}
-
 		if (commands[st->state]->type == SQL_COMMAND)
 		{
 			/*
@@ -1902,6 +2141,17 @@ top:
 				case PGRES_TUPLES_OK:
 					break;		/* OK */
 				default:
+					if (isRetryableError(commands[st->state], res))
+					{
+						if (debug)
+							fprintf(stderr, "client %d transaction failed in state %d: %s",
+									st->id, st->state, PQerrorMessage(st->con));
+						PQclear(res);
+						discard_response(st);
+						if (!retryTransaction(thread, st))
+							return clientDone(st);
+						goto top;
+					}
 					fprintf(stderr, "client %d aborted in state %d: %s",
 							st->id, st->state, PQerrorMessage(st->con));
 					PQclear(res);
@@ -1911,6 +2161,17 @@ top:
 			discard_response(st);
 		}
 
+		/* transaction finished: calculate latency and log the transaction */
+		if (commands[st->state + 1] == NULL)
+		{
+			if (progress || throttle_delay || latency_limit ||
+				per_script_stats || use_log || per_host_stats)
+				processXactStats(thread, st, &now, false, agg);
+			else
+				thread->stats.cnt++;
+			st->tries = 0;
+		}
+
 		if (commands[st->state + 1] == NULL)
 		{
 			if (is_connect)
@@ -1954,7 +2215,7 @@ top:
 					end;
 
 		INSTR_TIME_SET_CURRENT(start);
-		if ((st->con = doConnect()) == NULL)
+		if ((st->con = doConnect(st->host)) == NULL)
 		{
 			fprintf(stderr, "client %d aborted while establishing connection\n",
 					st->id);
@@ -1981,9 +2242,14 @@ top:
 		goto top;
 	}
 
-	/* Record transaction start time under logging, progress or throttling */
+	/*
+	 * Record transaction start time under logging, progress or throttling.
+	 * A retried transaction keeps its original start time, so that its
+	 * latency includes the failed tries.
+	 */
 	if ((use_log || progress || throttle_delay || latency_limit ||
-		 per_script_stats) && st->state == 0)
+		 per_script_stats || per_host_stats) && st->state == 0 &&
+		st->tries == 0)
 	{
 		INSTR_TIME_SET_CURRENT(st->txn_begin);
 
@@ -2184,7 +2450,7 @@ top:
  * print log entry after completing one transaction.
  */
 static void
-doLog(TState *thread, CState *st, instr_time *now,
+doLog(TState *thread, CState *st,
 	  StatsData *agg, bool skipped, double latency, double lag)
 {
 	FILE	   *logfile = thread->logfile;
@@ -2203,15 +2469,18 @@ doLog(TState *thread, CState *st, instr_time *now,
 	if (agg_interval > 0)
 	{
 		/*
-		 * Loop until we reach the interval of the current transaction, and
-		 * print all the empty intervals in between (this may happen with very
-		 * low tps, e.g. --rate=0.1).
+		 * Loop until we reach the interval of the current moment, and print
+		 * all the empty intervals in between (this may happen with very low
+		 * tps, e.g. --rate=0.1).  instr_time isn't necessarily related to
+		 * the time of day, so we ask the system clock.
 		 */
-		while (agg->start_time + agg_interval < INSTR_TIME_GET_DOUBLE(*now))
+		time_t		now_sec = time(NULL);
+
+		while (agg->start_time + agg_interval <= now_sec)
 		{
 			/* print aggregated report to logfile */
 			fprintf(logfile, "%ld " INT64_FORMAT " %.0f %.0f %.0f %.0f",
-					agg->start_time,
+					(long) agg->start_time,
 					agg->cnt,
 					agg->latency.sum,
 					agg->latency.sum2,
@@ -2239,27 +2508,18 @@ doLog(TState *thread, CState *st, instr_time *now,
 	else
 	{
 		/* no, print raw transactions */
-#ifndef WIN32
+		struct timeval tv;
 
-		/* This is more than we really ought to know about instr_time */
+		/* instr_time doesn't necessarily provide a timestamp, so get one */
+		gettimeofday(&tv, NULL);
 		if (skipped)
 			fprintf(logfile, "%d " INT64_FORMAT " skipped %d %ld %ld",
 					st->id, st->cnt, st->use_file,
-					(long) now->tv_sec, (long) now->tv_usec);
+					(long) tv.tv_sec, (long) tv.tv_usec);
 		else
 			fprintf(logfile, "%d " INT64_FORMAT " %.0f %d %ld %ld",
 					st->id, st->cnt, latency, st->use_file,
-					(long) now->tv_sec, (long) now->tv_usec);
-#else
-
-		/* On Windows, instr_time doesn't provide a timestamp anyway */
-		if (skipped)
-			fprintf(logfile, "%d " INT64_FORMAT " skipped %d 0 0",
-					st->id, st->cnt, st->use_file);
-		else
-			fprintf(logfile, "%d " INT64_FORMAT " %.0f %d 0 0",
-					st->id, st->cnt, latency, st->use_file);
-#endif
+					(long) tv.tv_sec, (long) tv.tv_usec);
 		if (throttle_delay)
 			fprintf(logfile, " %.0f", lag);
 		fputc('\n', logfile);
@@ -2288,7 +2548,7 @@ processXactStats(TState *thread, CState *st, instr_time *now,
 		lag = INSTR_TIME_GET_MICROSEC(st->txn_begin) - st->txn_scheduled;
 	}
 
-	if (progress || throttle_delay || latency_limit)
+	if (progress || throttle_delay || latency_limit || per_host_stats)
 	{
 		accumStats(&thread->stats, skipped, latency, lag);
 
@@ -2299,8 +2559,17 @@ processXactStats(TState *thread, CState *st, instr_time *now,
 	else
 		thread->stats.cnt++;
 
+	if (per_host_stats)
+	{
+		HostStats  *hs = &thread->host_stats[st->host];
+
+		accumStats(&hs->stats, skipped, latency, lag);
+		if (!skipped)
+			addToHistogram(&hs->hist, latency);
+	}
+
 	if (use_log)
-		doLog(thread, st, now, agg, skipped, latency, lag);
+		doLog(thread, st, agg, skipped, latency, lag);
 
 	/* XXX could use a mutex here, but we choose not to */
 	if (per_script_stats)
@@ -2407,7 +2676,7 @@ init(bool is_no_vacuum)
 				remaining_sec;
 	int			log_interval = 1;
 
-	if ((con = doConnect()) == NULL)
+	if ((con = doConnect(0)) == NULL)
 		exit(1);
 
 	for (i = 0; i < lengthof(DDLs); i++)
@@ -2962,7 +3231,7 @@ ParseScript(const char *script, const char *desc, int weight)
 	ps.desc = desc;
 	ps.weight = weight;
 	ps.commands = (Command **) pg_malloc(sizeof(Command *) * alloc_num);
-	initStats(&ps.stats, 0.0);
+	initStats(&ps.stats, 0);
 
 	/* Prepare to parse script */
 	sstate = psql_scan_create(&pgbench_callbacks);
@@ -3231,6 +3500,130 @@ addScript(ParsedScript script)
 	num_scripts++;
 }
 
+/*
+ * Split a comma-separated list in place.
+ */
+static char **
+splitCommaList(char *str, int *nitems)
+{
+	char	  **items = (char **) pg_malloc(sizeof(char *) * (strlen(str) + 1));
+	int			n = 0;
+
+	items[n++] = str;
+	while ((str = strchr(str, ',')) != NULL)
+	{
+		*str++ = '\0';
+		items[n++] = str;
+	}
+
+	*nitems = n;
+	return items;
+}
+
+/*
+ * Set up hosts[] from the -h and -p options.  Each host may have a weight
+ * for the distribution of clients, using the same syntax as the scripts.
+ * There may be a single port for all hosts, or one per host.
+ */
+static void
+parseHosts(const char *hostlist, const char *portlist)
+{
+	char	  **hostnames;
+	char	  **ports;
+	int			nports;
+	int			i;
+
+	hostnames = splitCommaList(pg_strdup(hostlist), &nhosts);
+	ports = splitCommaList(pg_strdup(portlist), &nports);
+
+	if (nports != 1 && nports != nhosts)
+	{
+		fprintf(stderr, "number of ports (%d) does not match number of hosts (%d)\n",
+				nports, nhosts);
+		exit(1);
+	}
+
+	hosts = (BenchHost *) pg_malloc0(sizeof(BenchHost) * nhosts);
+	for (i = 0; i < nhosts; i++)
+	{
+		hosts[i].weight = parseScriptWeight(hostnames[i], &hosts[i].host);
+		hosts[i].port = ports[nports == 1 ? 0 : i];
+		total_host_weight += hosts[i].weight;
+	}
+
+	if (total_host_weight == 0)
+	{
+		fprintf(stderr, "total host weight must not be zero\n");
+		exit(1);
+	}
+
+	free(hostnames);
+	free(ports);
+}
+
+/*
+ * Write a latency histogram in HdrHistogram's percentile distribution
+ * format, with values in milliseconds, as understood by its plotting tools.
+ */
+static void
+writeHdrHistogram(const char *filename, Histogram *hist, SimpleStats *latency)
+{
+	FILE	   *f;
+	double		percentile = 0.0;
+	int64		count = 0;
+	int			nbuckets = 0;
+	int			i;
+
+	if (hist->total == 0)
+		return;
+
+	if ((f = fopen(filename, "w")) == NULL)
+	{
+		fprintf(stderr, "could not open histogram file \"%s\": %s\n",
+				filename, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "%12s %14s %10s %14s\n\n",
+			"Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+	for (i = 0; i < HIST_SIZE; i++)
+	{
+		if (hist->counts[i] == 0)
+			continue;
+		nbuckets++;
+		count += hist->counts[i];
+
+		/*
+		 * Report the percentiles reached in this bucket, with five steps per
+		 * halving of the distance to 100%, like HdrHistogram does.
+		 */
+		while (count >= hist->total * percentile / 100.0 && count < hist->total)
+		{
+			fprintf(f, "%12.3f %2.12f %10" INT64_MODIFIER "d %14.2f\n",
+					0.001 * histogramBucketValue(i),
+					(double) count / hist->total, count,
+					1.0 / (1.0 - (double) count / hist->total));
+			percentile += 100.0 /
+				(5 * pow(2.0, floor(log(100.0 / (100.0 - percentile)) / log(2.0)) + 1));
+		}
+		if (count == hist->total)
+			fprintf(f, "%12.3f %2.12f %10" INT64_MODIFIER "d\n",
+					0.001 * histogramBucketValue(i), 1.0, count);
+	}
+
+	fprintf(f, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+			0.001 * latency->sum / latency->count,
+			0.001 * sqrt(latency->sum2 / latency->count -
+						 pow(latency->sum / latency->count, 2)));
+	fprintf(f, "#[Max     = %12.3f, Total count    = %12" INT64_MODIFIER "d]\n",
+			0.001 * latency->max, hist->total);
+	fprintf(f, "#[Buckets = %12d, SubBuckets     = %12d]\n",
+			nbuckets, HIST_SUB_BUCKETS);
+
+	fclose(f);
+}
+
 static void
 printSimpleStats(char *prefix, SimpleStats *ss)
 {
@@ -3242,10 +3635,23 @@ printSimpleStats(char *prefix, SimpleStats *ss)
 	printf("%s stddev = %.3f ms\n", prefix, 0.001 * stddev);
 }
 
+/* print latency percentiles from a histogram */
+static void
+printPercentiles(char *prefix, Histogram *hist)
+{
+	printf("%s percentiles: 50%% = %.3f ms, 90%% = %.3f ms, 99%% = %.3f ms, 99.9%% = %.3f ms\n",
+		   prefix,
+		   0.001 * histogramPercentile(hist, 50.0),
+		   0.001 * histogramPercentile(hist, 90.0),
+		   0.001 * histogramPercentile(hist, 99.0),
+		   0.001 * histogramPercentile(hist, 99.9));
+}
+
 /* print out results */
 static void
-printResults(TState *threads, StatsData *total, instr_time total_time,
-			 instr_time conn_total_time, int latency_late)
+printResults(TState *threads, StatsData *total, HostStats *host_stats,
+			 instr_time total_time, instr_time conn_total_time,
+			 int latency_late)
 {
 	double		time_include,
 				tps_include,
@@ -3290,7 +3696,14 @@ printResults(TState *threads, StatsData *total, instr_time total_time,
 			   latency_limit / 1000.0, latency_late,
 			   100.0 * latency_late / (total->skipped + total->cnt));
 
-	if (throttle_delay || progress || latency_limit)
+	if (max_tries > 1)
+		printf("number of retries: " INT64_FORMAT "\n", total->retries);
+	if (max_tries > 1 || total->failures > 0)
+		printf("number of failed transactions: " INT64_FORMAT " (%.3f %%)\n",
+			   total->failures,
+			   100.0 * total->failures / (total->failures + total->cnt));
+
+	if (throttle_delay || progress || latency_limit || per_host_stats)
 		printSimpleStats("latency", &total->latency);
 	else
 	{
@@ -3314,6 +3727,58 @@ printResults(TState *threads, StatsData *total, instr_time total_time,
 	printf("tps = %f (including connections establishing)\n", tps_include);
 	printf("tps = %f (excluding connections establishing)\n", tps_exclude);
 
+	/* Report per-host statistics, and write the histograms */
+	if (per_host_stats)
+	{
+		Histogram	total_hist;
+		int			i;
+
+		initHistogram(&total_hist);
+		for (i = 0; i < nhosts; i++)
+			mergeHistogram(&total_hist, &host_stats[i].hist);
+
+		if (nhosts > 1)
+			printPercentiles("latency", &total_hist);
+
+		for (i = 0; i < nhosts && nhosts > 1; i++)
+		{
+			StatsData  *hs = &host_stats[i].stats;
+
+			printf("host %d: %s%s%s\n"
+				   " - weight: %d, %d clients\n"
+				   " - " INT64_FORMAT " transactions (%.1f%% of total, tps = %f)\n",
+				   i + 1,
+				   *hosts[i].host ? hosts[i].host : "(default)",
+				   *hosts[i].port ? ":" : "", hosts[i].port,
+				   hosts[i].weight, hosts[i].nclients,
+				   hs->cnt, 100.0 * hs->cnt / total->cnt,
+				   hs->cnt / time_include);
+			if (max_tries > 1)
+				printf(" - number of retries: " INT64_FORMAT "\n", hs->retries);
+			if (max_tries > 1 || hs->failures > 0)
+				printf(" - number of failed transactions: " INT64_FORMAT "\n",
+					   hs->failures);
+			if (hs->cnt > 0)
+			{
+				printSimpleStats(" - latency", &hs->latency);
+				printPercentiles(" - latency", &host_stats[i].hist);
+			}
+		}
+
+		if (hdr_histogram_file)
+		{
+			writeHdrHistogram(hdr_histogram_file, &total_hist, &total->latency);
+			for (i = 0; i < nhosts && nhosts > 1; i++)
+			{
+				char		path[MAXPGPATH];
+
+				snprintf(path, sizeof(path), "%s.%d", hdr_histogram_file, i + 1);
+				writeHdrHistogram(path, &host_stats[i].hist,
+								  &host_stats[i].stats.latency);
+			}
+		}
+	}
+
 	/* Report per-script/command statistics */
 	if (per_script_stats || latency_limit || is_latencies)
 	{
@@ -3402,6 +3867,8 @@ main(int argc, char **argv)
 		{"sampling-rate", required_argument, NULL, 4},
 		{"aggregate-interval", required_argument, NULL, 5},
 		{"progress-timestamp", no_argument, NULL, 6},
+		{"max-tries", required_argument, NULL, 7},
+		{"hdr-histogram", required_argument, NULL, 8},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -3424,6 +3891,7 @@ main(int argc, char **argv)
 	instr_time	conn_total_time;
 	int64		latency_late = 0;
 	StatsData	stats;
+	HostStats  *host_stats = NULL;
 	int			weight;
 
 	int			i;
@@ -3749,6 +4217,20 @@ main(int argc, char **argv)
 				progress_timestamp = true;
 				benchmarking_option_set = true;
 				break;
+			case 7:
+				benchmarking_option_set = true;
+				max_tries = atoi(optarg);
+				if (max_tries <= 0)
+				{
+					fprintf(stderr, "invalid number of tries: \"%s\"\n",
+							optarg);
+					exit(1);
+				}
+				break;
+			case 8:
+				benchmarking_option_set = true;
+				hdr_histogram_file = pg_strdup(optarg);
+				break;
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
@@ -3779,6 +4261,12 @@ main(int argc, char **argv)
 	if (num_scripts > 1)
 		per_script_stats = true;
 
+	parseHosts(pghost, pgport);
+
+	/* show per host stats if several hosts are used */
+	if (nhosts > 1 || hdr_histogram_file != NULL)
+		per_host_stats = true;
+
 	/*
 	 * Don't need more threads than there are clients.  (This is not merely an
 	 * optimization; throttle_delay is calculated incorrectly below if some
@@ -3895,6 +4383,21 @@ main(int argc, char **argv)
 		}
 	}
 
+	/*
+	 * Assign the clients to hosts in proportion to the host weights, taking
+	 * turns so that the threads get a similar mix of hosts.
+	 */
+	for (i = 0; i < nclients; i++)
+	{
+		int64		w = i % total_host_weight;
+		int			h = 0;
+
+		while (w >= hosts[h].weight)
+			w -= hosts[h++].weight;
+		state[i].host = h;
+		hosts[h].nclients++;
+	}
+
 	if (debug)
 	{
 		if (duration <= 0)
@@ -3906,7 +4409,7 @@ main(int argc, char **argv)
 	}
 
 	/* opening connection... */
-	con = doConnect();
+	con = doConnect(0);
 	if (con == NULL)
 		exit(1);
 
@@ -4016,7 +4519,20 @@ main(int argc, char **argv)
 		thread->random_state[2] = random();
 		thread->logfile = NULL; /* filled in later */
 		thread->latency_late = 0;
-		initStats(&thread->stats, 0.0);
+		initStats(&thread->stats, 0);
+		thread->host_stats = NULL;
+		if (per_host_stats)
+		{
+			int			h;
+
+			thread->host_stats = (HostStats *)
+				pg_malloc(sizeof(HostStats) * nhosts);
+			for (h = 0; h < nhosts; h++)
+			{
+				initStats(&thread->host_stats[h].stats, 0);
+				initHistogram(&thread->host_stats[h].hist);
+			}
+		}
 
 		nclients_dealt += thread->nstate;
 	}
@@ -4070,7 +4586,7 @@ main(int argc, char **argv)
 #endif   /* ENABLE_THREAD_SAFETY */
 
 	/* wait for threads and accumulate results */
-	initStats(&stats, 0.0);
+	initStats(&stats, 0);
 	INSTR_TIME_SET_ZERO(conn_total_time);
 	for (i = 0; i < nthreads; i++)
 	{
@@ -4088,11 +4604,25 @@ main(int argc, char **argv)
 #endif   /* ENABLE_THREAD_SAFETY */
 
 		/* aggregate thread level stats */
-		mergeSimpleStats(&stats.latency, &thread->stats.latency);
-		mergeSimpleStats(&stats.lag, &thread->stats.lag);
-		stats.cnt += thread->stats.cnt;
-		stats.skipped += thread->stats.skipped;
+		mergeStats(&stats, &thread->stats);
 		latency_late += thread->latency_late;
+		if (per_host_stats)
+		{
+			int			h;
+
+			if (host_stats == NULL)
+				host_stats = thread->host_stats;
+			else
+			{
+				for (h = 0; h < nhosts; h++)
+				{
+					mergeStats(&host_stats[h].stats,
+							   &thread->host_stats[h].stats);
+					mergeHistogram(&host_stats[h].hist,
+								   &thread->host_stats[h].hist);
+				}
+			}
+		}
 		INSTR_TIME_ADD(conn_total_time, thread->conn_time);
 	}
 	disconnect_all(state, nclients);
@@ -4109,7 +4639,8 @@ main(int argc, char **argv)
 	 */
 	INSTR_TIME_SET_CURRENT(total_time);
 	INSTR_TIME_SUBTRACT(total_time, start_time);
-	printResults(threads, &stats, total_time, conn_total_time, latency_late);
+	printResults(threads, &stats, host_stats, total_time, conn_total_time,
+				 latency_late);
 
 	return 0;
 }
@@ -4167,7 +4698,7 @@ threadRun(void *arg)
 		/* make connections to the database */
 		for (i = 0; i < nstate; i++)
 		{
-			if ((state[i].con = doConnect()) == NULL)
+			if ((state[i].con = doConnect(state[i].host)) == NULL)
 				goto done;
 		}
 	}
@@ -4176,7 +4707,7 @@ threadRun(void *arg)
 	INSTR_TIME_SET_CURRENT(thread->conn_time);
 	INSTR_TIME_SUBTRACT(thread->conn_time, thread->start_time);
 
-	initStats(&aggs, INSTR_TIME_GET_DOUBLE(thread->start_time));
+	initStats(&aggs, time(NULL));
 	last = aggs;
 
 	/* send start up queries in async manner */
@@ -4393,7 +4924,7 @@ threadRun(void *arg)
 				 * (If a read from a 64-bit integer is not atomic, you might
 				 * get a "torn" read and completely bogus latencies though!)
 				 */
-				initStats(&cur, 0.0);
+				initStats(&cur, 0);
 				for (i = 0; i < nthreads; i++)
 				{
 					mergeSimpleStats(&cur.latency, &thread[i].stats.latency);
@@ -4413,8 +4944,17 @@ threadRun(void *arg)
 					(cur.cnt - last.cnt);
 
 				if (progress_timestamp)
-					sprintf(tbuf, "%.03f s",
-							INSTR_TIME_GET_MILLISEC(now_time) / 1000.0);
+				{
+					/*
+					 * now_time need not be related to the time of day, so
+					 * spend an extra system call to get a real timestamp.
+					 */
+					struct timeval tv;
+
+					gettimeofday(&tv, NULL);
+					sprintf(tbuf, "%ld.%03ld s",
+							(long) tv.tv_sec, (long) (tv.tv_usec / 1000));
+				}
 				else
 					sprintf(tbuf, "%.1f s", total_run);
 
@@ -4456,7 +4996,7 @@ done:
 		if (agg_interval)
 		{
 			/* log aggregated but not yet reported transactions */
-			doLog(thread, state, &end, &aggs, false, 0, 0);
+			doLog(thread, state, &aggs, false, 0, 0);
 		}
 		fclose(thread->logfile);
 	}
@@ -1448,11 +1448,13 @@ psql_completion(const char *text, int start, int end)
 		COMPLETE_WITH_CONST("(");
 	/* ALTER INDEX <foo> SET|RESET ( */
 	else if (Matches5("ALTER", "INDEX", MatchAny, "RESET", "("))
-		COMPLETE_WITH_LIST3("fillfactor", "fastupdate",
-							"gin_pending_list_limit");
+		COMPLETE_WITH_LIST5("fillfactor", "fastupdate",
+							"gin_pending_list_limit", "deduplicate_items",
+							"autosummarize");
 	else if (Matches5("ALTER", "INDEX", MatchAny, "SET", "("))
-		COMPLETE_WITH_LIST3("fillfactor =", "fastupdate =",
-							"gin_pending_list_limit =");
+		COMPLETE_WITH_LIST5("fillfactor =", "fastupdate =",
+							"gin_pending_list_limit =", "deduplicate_items =",
+							"autosummarize =");
 
 	/* ALTER LANGUAGE <name> */
 	else if (Matches3("ALTER", "LANGUAGE", MatchAny))
@@ -1843,8 +1845,9 @@ psql_completion(const char *text, int start, int end)
 		COMPLETE_WITH_CONST("(");
 	/* ALTER TABLESPACE <foo> SET|RESET ( */
 	else if (Matches5("ALTER", "TABLESPACE", MatchAny, "SET|RESET", "("))
-		COMPLETE_WITH_LIST3("seq_page_cost", "random_page_cost",
-							"effective_io_concurrency");
+		COMPLETE_WITH_LIST5("seq_page_cost", "random_page_cost",
+							"effective_io_concurrency", "max_write_rate",
+							"max_write_iops");
 
 	/* ALTER TEXT SEARCH */
 	else if (Matches3("ALTER", "TEXT", "SEARCH"))
@@ -29,6 +29,9 @@ typedef int XidStatus;
 #define TRANSACTION_STATUS_SUB_COMMITTED	0x03
 #define TRANSACTION_STATUS_UNKNOWN			0x03
 
+/* GUC variable */
+extern int	clog_buffers;
+
 
 extern void TransactionIdSetTreeStatus(TransactionId xid, int nsubxids,
 				   TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
@@ -15,6 +15,8 @@
 #include "access/itup.h"
 #include "fmgr.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
 #include "lib/rbtree.h"
 
 
@@ -335,6 +337,12 @@ typedef struct GinOptions
 	 ((GinOptions *) (relation)->rd_options)->pendingListCleanupSize : \
 	 gin_pending_list_limit)
 
+/*
+ * Inserters leave pending list cleanup to autovacuum until the list grows
+ * to this many times the cleanup size; see ginHeapTupleFastInsert.
+ */
+#define GIN_PENDING_LIST_EMERGENCY_FACTOR	8
+
 
 /* Macros for buffer lock/unlock operations */
 #define GIN_UNLOCK	BUFFER_LOCK_UNLOCK
@@ -623,6 +631,7 @@ extern void ginEntryInsert(GinState *ginstate,
 			   OffsetNumber attnum, Datum key, GinNullCategory category,
 			   ItemPointerData *items, uint32 nitem,
 			   GinStatsData *buildStats);
+extern void ginParallelBuildMain(dsm_segment *seg, shm_toc *toc);
 
 /* ginbtree.c */
 
@@ -42,4 +42,7 @@ extern Buffer RelationGetBufferForTuple(Relation relation, Size len,
 						  BulkInsertState bistate,
 						  Buffer *vmbuffer, Buffer *vmbuffer_other);
 
+extern Size HeapExtensionShmemSize(void);
+extern void HeapExtensionShmemInit(void);
+
 #endif   /* HIO_H */
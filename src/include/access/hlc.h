@@ -0,0 +1,120 @@
+/*-------------------------------------------------------------------------
+ *
+ * hlc.h
+ *	  Hybrid logical clock used by distributed transaction managers to
+ *	  assign commit sequence numbers (CSN).
+ *
+ * CSN is a timestamp in microseconds.  Clock value is the maximum of the
+ * local physical time and of all timestamps received from other nodes; the
+ * logical counter is folded into the low digits: when physical time has not
+ * advanced past the last issued value, the next value is the previous one
+ * plus one.  Unlike shifting the system time, a timestamp received from a
+ * node whose clock runs ahead doesn't advance the local clock permanently:
+ * as soon as local physical time passes it, the clock follows physical time
+ * again.
+ *
+ * All functions expect the caller to hold the lock protecting the clock,
+ * except HlcNow() which only reads it.
+ *
+ * src/include/access/hlc.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef HLC_H
+#define HLC_H
+
+#include <sys/time.h>
+
+typedef struct HybridLogicalClock
+{
+	uint64		last;			/* last issued or received timestamp */
+	uint64		nAhead;			/* number of received timestamps which were
+								 * ahead of local physical time */
+	uint64		maxDrift;		/* maximal advance of received timestamp over
+								 * local physical time (usec) */
+	uint64		nRejected;		/* number of received timestamps rejected
+								 * because of too large drift */
+} HybridLogicalClock;
+
+/* Local physical time in microseconds */
+static inline uint64
+HlcPhysicalTime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static inline void
+HlcInit(HybridLogicalClock *clock)
+{
+	clock->last = HlcPhysicalTime();
+	clock->nAhead = 0;
+	clock->maxDrift = 0;
+	clock->nRejected = 0;
+}
+
+/* Current clock value, without issuing new timestamp */
+static inline uint64
+HlcNow(HybridLogicalClock *clock)
+{
+	uint64		now = HlcPhysicalTime();
+	uint64		last = clock->last;
+
+	return now > last ? now : last;
+}
+
+/* Advance of the clock over local physical time (usec) */
+static inline uint64
+HlcDrift(HybridLogicalClock *clock)
+{
+	uint64		now = HlcPhysicalTime();
+	uint64		last = clock->last;
+
+	return last > now ? last - now : 0;
+}
+
+/* Issue unique ascending timestamp */
+static inline uint64
+HlcTick(HybridLogicalClock *clock)
+{
+	uint64		now = HlcPhysicalTime();
+
+	if (now > clock->last)
+		clock->last = now;
+	else
+		clock->last += 1;
+	return clock->last;
+}
+
+/*
+ * Merge timestamp received from other node and issue new local timestamp
+ * which is greater than it.  If maxDrift is not zero and received timestamp
+ * is ahead of local physical time by more than maxDrift, it is rejected:
+ * clock is not changed and zero is returned.
+ */
+static inline uint64
+HlcUpdate(HybridLogicalClock *clock, uint64 remote, uint64 maxDrift)
+{
+	uint64		now = HlcPhysicalTime();
+
+	if (remote > now)
+	{
+		uint64		drift = remote - now;
+
+		if (maxDrift != 0 && drift > maxDrift)
+		{
+			clock->nRejected += 1;
+			return 0;
+		}
+		clock->nAhead += 1;
+		if (drift > clock->maxDrift)
+			clock->maxDrift = drift;
+	}
+	if (remote > clock->last)
+		clock->last = remote;
+	return HlcTick(clock);
+}
+
+#endif							/* HLC_H */
@@ -21,6 +21,8 @@
 #include "catalog/pg_index.h"
 #include "lib/stringinfo.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
 
 /* There's room for a 16-bit vacuum cycle ID in BTPageOpaqueData */
 typedef uint16 BTCycleId;
@@ -132,6 +134,77 @@ typedef struct BTMetaPageData
 #define BTREE_DEFAULT_FILLFACTOR	90
 #define BTREE_NONLEAF_FILLFACTOR	70
 
+/*
+ * Minimum tree height at which _bt_doinsert() remembers the rightmost leaf
+ * page, to insert monotonically increasing keys without descending from the
+ * root.
+ */
+#define BTREE_FASTPATH_MIN_LEVEL	2
+
+/*
+ * Storage type for btree's reloptions.  fillfactor must stay at the same
+ * offset as in StdRdOptions, since RelationGetFillFactor() is used on
+ * btree indexes too.
+ */
+typedef struct BTOptions
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	int			fillfactor;		/* page fill factor in percent (0..100) */
+	bool		deduplicate_items;	/* merge duplicates into posting lists? */
+} BTOptions;
+
+#define BTGetDeduplicateItems(relation) \
+	((relation)->rd_options ? \
+	 ((BTOptions *) (relation)->rd_options)->deduplicate_items : true)
+
+/*
+ * Posting lists
+ *
+ * On a leaf page of a non-unique index, a run of tuples with bitwise
+ * identical keys can be merged into a single "posting list" tuple.  Such a
+ * tuple has INDEX_AM_RESERVED_BIT set in t_info, and its key data is
+ * followed (at a MAXALIGN'd offset) by an array of heap TIDs.  Since
+ * t_tid is not needed to point at a heap tuple, it is reused to hold the
+ * offset of the array within the tuple (in the block number) and the number
+ * of TIDs it contains (in the offset number, which is always at least 2).
+ *
+ * Pivot tuples (high keys and internal page items) are never posting lists;
+ * see _bt_split().  Since we only merge tuples that are bitwise equal, an
+ * index-only scan returns the same key data as it would have without the
+ * merge, whatever the datatype's notion of equality is.
+ */
+#define BT_IS_POSTING				INDEX_AM_RESERVED_BIT
+
+#define BTreeTupleIsPosting(itup) \
+	(((itup)->t_info & BT_IS_POSTING) != 0)
+#define BTreeTupleGetNPosting(itup) \
+	((int) (itup)->t_tid.ip_posid)
+#define BTreeTupleGetPostingOffset(itup) \
+	((Size) BlockIdGetBlockNumber(&(itup)->t_tid.ip_blkid))
+#define BTreeTupleGetPosting(itup) \
+	((ItemPointer) ((char *) (itup) + BTreeTupleGetPostingOffset(itup)))
+#define BTreeTupleGetPostingN(itup, n) \
+	(BTreeTupleGetPosting(itup) + (n))
+#define BTreeTupleGetKeySize(itup) \
+	(BTreeTupleIsPosting(itup) ? BTreeTupleGetPostingOffset(itup) : \
+	 IndexTupleSize(itup))
+#define BTreeTupleSetPosting(itup, nhtids, off) \
+	do { \
+		(itup)->t_info |= BT_IS_POSTING; \
+		BlockIdSet(&(itup)->t_tid.ip_blkid, (off)); \
+		(itup)->t_tid.ip_posid = (nhtids); \
+	} while (0)
+
+/*
+ * Upper bound on the number of heap TIDs a single leaf page can point to.
+ * A posting list needs 6 bytes per TID, which is less than the space taken
+ * by any plain index tuple, so this also bounds the number of items on a
+ * page.  Index scans size their per-page arrays using this.
+ */
+#define MaxBTreeTIDsPerPage \
+	((int) ((BLCKSZ - SizeOfPageHeaderData - sizeof(BTPageOpaqueData)) / \
+			sizeof(ItemPointerData)))
+
 /*
  *	Test whether two btree entries are "the same".
  *
@@ -226,6 +299,7 @@ typedef struct BTMetaPageData
 										 * vacuum */
 #define XLOG_BTREE_REUSE_PAGE	0xD0	/* old page is about to be reused from
 										 * FSM */
+#define XLOG_BTREE_DEDUP		0xE0	/* merge duplicates into posting lists */
 
 /*
  * All that we need to regenerate the meta-data page
@@ -348,15 +422,47 @@ typedef struct xl_btree_reuse_page
  *
  * Note that the *last* WAL record in any vacuum of an index is allowed to
  * have a zero length array of offsets. Earlier records must have at least one.
+ *
+ * Posting list tuples that lose some but not all of their TIDs are replaced
+ * in place by a smaller tuple.  Those replacements are applied before the
+ * deletions, so both sets of offsets refer to the page as it was.
+ *
+ * Backup Blk 0: index page (data contains the deleted offsets, then the
+ * updated offsets, then the replacement tuples)
  */
 typedef struct xl_btree_vacuum
 {
 	BlockNumber lastBlockVacuumed;
+	uint16		ndeleted;
+	uint16		nupdated;
 
 	/* TARGET OFFSET NUMBERS FOLLOW */
 } xl_btree_vacuum;
 
-#define SizeOfBtreeVacuum	(offsetof(xl_btree_vacuum, lastBlockVacuumed) + sizeof(BlockNumber))
+#define SizeOfBtreeVacuum	(offsetof(xl_btree_vacuum, nupdated) + sizeof(uint16))
+
+/*
+ * This is what we need to know about merging duplicates on a leaf page into
+ * posting lists.  Each interval names a run of consecutive items (starting
+ * at baseoff on the page as it was) that replay merges into one posting list
+ * tuple, exactly as _bt_dedup_one_page() did.
+ *
+ * Backup Blk 0: index page (data contains the intervals)
+ */
+typedef struct BTDedupInterval
+{
+	OffsetNumber baseoff;
+	uint16		nitems;
+} BTDedupInterval;
+
+typedef struct xl_btree_dedup
+{
+	uint16		nintervals;
+
+	/* BTDedupInterval ARRAY FOLLOWS */
+} xl_btree_dedup;
+
+#define SizeOfBtreeDedup	(offsetof(xl_btree_dedup, nintervals) + sizeof(uint16))
 
 /*
  * This is what we need to know about marking an empty branch for deletion.
@@ -507,7 +613,8 @@ typedef BTStackData *BTStack;
  * If we are doing an index-only scan, we save the entire IndexTuple for each
  * matched item, otherwise only its heap TID and offset.  The IndexTuples go
  * into a separate workspace array; each BTScanPosItem stores its tuple's
- * offset within that array.
+ * offset within that array.  A posting list tuple yields one item per heap
+ * TID, all sharing a single copy of the tuple's key in the workspace.
  */
 
 typedef struct BTScanPosItem	/* what we remember about each match */
@@ -551,7 +658,7 @@ typedef struct BTScanPosData
 	int			lastItem;		/* last valid index in items[] */
 	int			itemIndex;		/* current index in items[] */
 
-	BTScanPosItem items[MaxIndexTuplesPerPage]; /* MUST BE LAST */
+	BTScanPosItem items[MaxBTreeTIDsPerPage];	/* MUST BE LAST */
 } BTScanPosData;
 
 typedef BTScanPosData *BTScanPos;
@@ -655,8 +762,6 @@ typedef BTScanOpaqueData *BTScanOpaque;
  * prototypes for functions in nbtree.c (external entry points for btree)
  */
 extern Datum bthandler(PG_FUNCTION_ARGS);
-extern IndexBuildResult *btbuild(Relation heap, Relation index,
-		struct IndexInfo *indexInfo);
 extern void btbuildempty(Relation index);
 extern bool btinsert(Relation rel, Datum *values, bool *isnull,
 		 ItemPointer ht_ctid, Relation heapRel,
@@ -669,6 +774,9 @@ extern void btrescan(IndexScanDesc scan, ScanKey scankey, int nscankeys,
 extern void btendscan(IndexScanDesc scan);
 extern void btmarkpos(IndexScanDesc scan);
 extern void btrestrpos(IndexScanDesc scan);
+extern Size btestimateparallelscan(void);
+extern void btinitparallelscan(void *target);
+extern void btparallelrescan(IndexScanDesc scan);
 extern IndexBulkDeleteResult *btbulkdelete(IndexVacuumInfo *info,
 			 IndexBulkDeleteResult *stats,
 			 IndexBulkDeleteCallback callback,
@@ -677,6 +785,13 @@ extern IndexBulkDeleteResult *btvacuumcleanup(IndexVacuumInfo *info,
 				IndexBulkDeleteResult *stats);
 extern bool btcanreturn(Relation index, int attno);
 
+/*
+ * prototypes for internal functions in nbtree.c
+ */
+extern bool _bt_parallel_seize(IndexScanDesc scan, BlockNumber *pageno);
+extern void _bt_parallel_release(IndexScanDesc scan, BlockNumber scan_page);
+extern void _bt_parallel_done(IndexScanDesc scan);
+
 /*
  * prototypes for functions in nbtinsert.c
  */
@@ -685,6 +800,17 @@ extern bool _bt_doinsert(Relation rel, IndexTuple itup,
 extern Buffer _bt_getstackbuf(Relation rel, BTStack stack, int access);
 extern void _bt_finish_split(Relation rel, Buffer bbuf, BTStack stack);
 
+/*
+ * prototypes for functions in nbtdedup.c
+ */
+extern bool _bt_dedup_one_page(Relation rel, Buffer buf);
+extern Page _bt_dedup_build_page(Page page, BTDedupInterval *intervals,
+					 int nintervals);
+extern IndexTuple _bt_form_posting(IndexTuple base, ItemPointer htids,
+				 int nhtids);
+extern void _bt_update_posting(Page page, OffsetNumber offnum,
+				   IndexTuple itup);
+
 /*
  * prototypes for functions in nbtpage.c
  */
@@ -703,7 +829,8 @@ extern void _bt_delitems_delete(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems, Relation heapRel);
 extern void _bt_delitems_vacuum(Relation rel, Buffer buf,
 					OffsetNumber *itemnos, int nitems,
-					BlockNumber lastBlockVacuumed);
+					OffsetNumber *updatenos, IndexTuple *updated,
+					int nupdated, BlockNumber lastBlockVacuumed);
 extern int	_bt_pagedel(Relation rel, Buffer buf);
 
 /*
@@ -762,12 +889,15 @@ extern bool btvalidate(Oid opclassoid);
  */
 typedef struct BTSpool BTSpool; /* opaque type known only within nbtsort.c */
 
+extern IndexBuildResult *btbuild(Relation heap, Relation index,
+		struct IndexInfo *indexInfo);
 extern BTSpool *_bt_spoolinit(Relation heap, Relation index,
 			  bool isunique, bool isdead);
 extern void _bt_spooldestroy(BTSpool *btspool);
 extern void _bt_spool(BTSpool *btspool, ItemPointer self,
 		  Datum *values, bool *isnull);
 extern void _bt_leafbuild(BTSpool *btspool, BTSpool *spool2);
+extern void _bt_parallel_build_main(dsm_segment *seg, shm_toc *toc);
 
 /*
  * prototypes for functions in nbtxlog.c
@@ -44,6 +44,7 @@ typedef struct ParallelContext
 	void	   *private_memory;
 	shm_toc    *toc;
 	ParallelWorkerInfo *worker;
+	bool		leader_writes;	/* leader may leave parallel mode early */
 } ParallelContext;
 
 extern volatile bool ParallelMessagePending;
@@ -0,0 +1,38 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallelredo.h
+ *	  Replay of WAL records by parallel redo worker processes
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/access/parallelredo.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PARALLELREDO_H
+#define PARALLELREDO_H
+
+#include "access/xlogreader.h"
+#include "storage/relfilenode.h"
+
+/* upper limit for parallel_redo_workers */
+#define MAX_PARALLEL_REDO_WORKERS	64
+
+/* GUC variable */
+extern int	parallel_redo_workers;
+
+extern bool AmParallelRedoWorker;
+
+/* in the startup process */
+extern void ParallelRedoStart(void);
+extern bool ParallelRedoDispatch(XLogReaderState *record);
+extern void ParallelRedoEnd(void);
+extern void ParallelRedoForgetRelation(RelFileNode rnode, ForkNumber forknum,
+						   BlockNumber nblocks);
+extern void ParallelRedoForgetDatabase(Oid dbid);
+
+/* in the workers */
+extern void ParallelRedoWorkerMain(Datum main_arg);
+
+#endif   /* PARALLELREDO_H */
@@ -19,6 +19,7 @@
 #include "access/htup_details.h"
 #include "access/itup.h"
 #include "access/tupdesc.h"
+#include "storage/bufmgr.h"
 
 /*
  * Shared state for parallel heap scan.
@@ -50,6 +51,8 @@ typedef struct HeapScanDescData
 	bool		rs_bitmapscan;	/* true if this is really a bitmap scan */
 	bool		rs_samplescan;	/* true if this is really a sample scan */
 	bool		rs_pageatatime; /* verify visibility page-at-a-time? */
+	struct XidVisibilityMemo *rs_xidmemo;	/* batched XID snapshot checks, or
+											 * NULL */
 	bool		rs_allow_strat; /* allow or disallow use of access strategy */
 	bool		rs_allow_sync;	/* allow or disallow use of syncscan */
 	bool		rs_temp_snap;	/* unregister snapshot at scan end? */
@@ -69,6 +72,7 @@ typedef struct HeapScanDescData
 	Buffer		rs_cbuf;		/* current buffer in scan, if any */
 	/* NB: if rs_cbuf is not InvalidBuffer, we hold a pin on that buffer */
 	ParallelHeapScanDesc rs_parallel;	/* parallel scan information */
+	ReadStream	rs_stream;		/* read-ahead state of forward scans */
 
 	/* these fields only used in page-at-a-time mode and for bitmap scans */
 	int			rs_cindex;		/* current tuple's index in vistuples */
@@ -125,8 +129,31 @@ typedef struct IndexScanDescData
 
 	/* state data for traversing HOT chains in index_getnext */
 	bool		xs_continue_hot;	/* T if must keep walking HOT chain */
+
+	bool		xs_temp_snap;	/* unregister snapshot at scan end? */
+
+	/* parallel index scan information, in shared memory */
+	ParallelIndexScanDesc parallel_scan;
 }	IndexScanDescData;
 
+/*
+ * Shared state for parallel index scan.
+ *
+ * Like ParallelHeapScanDescData, this carries what each participant needs
+ * to join the scan.  The index AM keeps its own shared state (such as the
+ * next page to read) after the serialized snapshot, at ps_offset.
+ */
+typedef struct ParallelIndexScanDescData
+{
+	Oid			ps_relid;		/* OID of heap relation */
+	Oid			ps_indexid;		/* OID of index */
+	Size		ps_offset;		/* offset of AM-specific state */
+	char		ps_snapshot_data[FLEXIBLE_ARRAY_MEMBER];
+}	ParallelIndexScanDescData;
+
+#define ParallelIndexScanGetAMState(pscan) \
+	((void *) ((char *) (pscan) + (pscan)->ps_offset))
+
 /* Struct for heap-or-index scans of system tables */
 typedef struct SysScanDescData
 {
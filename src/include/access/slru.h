@@ -73,6 +73,13 @@ typedef struct SlruSharedData
 	int		   *page_number;
 	int		   *page_lru_count;
 
+	/*
+	 * Per-slot counter for lock-free readers (see SimpleLruPeekSlot).  It is
+	 * odd while the slot's page is being replaced, and advances whenever the
+	 * slot is invalidated and when it becomes valid again.
+	 */
+	uint32	   *page_change_count;
+
 	/*
 	 * Optional array of WAL flush LSNs associated with entries in the SLRU
 	 * pages.  If not zero/NULL, we must flush WAL before writing pages (true
@@ -150,6 +157,10 @@ extern int SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 				  TransactionId xid);
 extern int SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno,
 						   TransactionId xid);
+extern bool SimpleLruPeekSlot(SlruCtl ctl, int slotno, int pageno,
+				  uint32 *changecount);
+extern bool SimpleLruSlotUnchanged(SlruCtl ctl, int slotno,
+					   uint32 changecount);
 extern void SimpleLruWritePage(SlruCtl ctl, int slotno);
 extern void SimpleLruFlush(SlruCtl ctl, bool allow_redirtied);
 extern void SimpleLruTruncate(SlruCtl ctl, int cutoffPage);
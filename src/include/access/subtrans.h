@@ -11,8 +11,8 @@
 #ifndef SUBTRANS_H
 #define SUBTRANS_H
 
-/* Number of SLRU buffers to use for subtrans */
-#define NUM_SUBTRANS_BUFFERS	32
+/* GUC: number of SLRU buffers to use for subtrans */
+extern int	subtrans_buffers;
 
 extern void SubTransSetParent(TransactionId xid, TransactionId parent, bool overwriteOK);
 extern TransactionId SubTransGetParent(TransactionId xid);
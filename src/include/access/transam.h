@@ -134,6 +134,13 @@ typedef struct VariableCacheData
 	 */
 	TransactionId latestCompletedXid;	/* newest XID that has committed or
 										 * aborted */
+
+	/*
+	 * Number of top-level transactions with XIDs completed since startup;
+	 * any change to the set of running XIDs advances it.  GetSnapshotData
+	 * uses it to detect that a snapshot it built earlier is still current.
+	 */
+	uint64		xactCompletionCount;
 } VariableCacheData;
 
 typedef VariableCacheData *VariableCache;
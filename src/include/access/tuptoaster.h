@@ -111,6 +111,19 @@
 #define VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer) \
 	((toast_pointer).va_extsize < (toast_pointer).va_rawsize - VARHDRSZ)
 
+/*
+ * Compression methods of compressed datums, stored in the top bits of their
+ * va_rawsize (see postgres.h).  The compressed data of an external datum
+ * starts with the same header, so it is marked the same way.
+ */
+#define TOAST_PGLZ_COMPRESSION	0
+#define TOAST_LZ4_COMPRESSION	1
+
+#define TOAST_COMPRESS_METHOD(ptr)	VARCOMPRESS_4B_C(ptr)
+
+/* GUC: compression method for columns that don't set one */
+extern int	default_toast_compression;
+
 /*
  * Macro to fetch the possibly-unaligned contents of an EXTERNAL datum
  * into a local "struct varatt_external" toast pointer.  This should be
@@ -199,7 +212,24 @@ extern Datum toast_flatten_tuple_to_datum(HeapTupleHeader tup,
  *	Create a compressed version of a varlena datum, if possible
  * ----------
  */
-extern Datum toast_compress_datum(Datum value);
+extern Datum toast_compress_datum(Datum value, int method);
+
+/* ----------
+ * toast_get_compression -
+ *
+ *	Return the compression method for a column of a relation
+ * ----------
+ */
+extern int	toast_get_compression(Relation rel, int attnum);
+
+/* ----------
+ * toast_compression_method -
+ *
+ *	Look up a compression method by name, return -1 if not supported
+ * ----------
+ */
+extern int	toast_compression_method(const char *name);
+extern void validateToastCompressionOption(char *value);
 
 /* ----------
  * toast_raw_datum_size -
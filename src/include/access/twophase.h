@@ -35,6 +35,7 @@ typedef struct GlobalTransactionData *GlobalTransaction;
 
 /* GUC variable */
 extern int	max_prepared_xacts;
+extern int	twophase_state_cache_size;
 
 extern Size TwoPhaseShmemSize(void);
 extern void TwoPhaseShmemInit(void);
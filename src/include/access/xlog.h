@@ -97,8 +97,10 @@ extern int	min_wal_size;
 extern int	max_wal_size;
 extern int	wal_keep_segments;
 extern int	XLOGbuffers;
+extern int	XLOGinsertLocks;
 extern int	XLogArchiveTimeout;
 extern int	wal_retrieve_retry_interval;
+extern int	recovery_prefetch_distance;
 extern char *XLogArchiveCommand;
 extern bool EnableHotStandby;
 extern bool fullPageWrites;
@@ -16,6 +16,11 @@
 #include "utils/snapmgr.h"
 #include "utils/relcache.h"
 
+/*
+ * Transaction managers should be initialized with designated initializers:
+ * extensions may be built against cores with additional members, and members
+ * left out are NULL.
+ */
 typedef struct
 {
 	/*
@@ -94,6 +99,24 @@ typedef struct
 	 */
 	void        (*InitializeSequence)(int64* start, int64* step);
 
+	/*
+	 * Batch variant of IsInSnapshot: set inSnapshot[i] to the result of
+	 * IsInSnapshot(xids[i], snapshot) for every given XID.  Heap scans use it
+	 * to check all XIDs of a page in one call, without holding the buffer
+	 * lock.  May be NULL, in which case IsInSnapshot is called for each XID.
+	 */
+	void		(*IsInSnapshotBatch) (int nxids, TransactionId *xids, bool *inSnapshot, Snapshot snapshot);
+
+	/*
+	 * Save the transaction manager's state of the current transaction when a
+	 * subtransaction starts, and get it back if the subtransaction is rolled
+	 * back; otherwise the saved context is released when the subtransaction
+	 * commits.  May be NULL, in which case nothing is saved.
+	 */
+	void	   *(*CreateSavepointContext) (void);
+	void		(*RestoreSavepointContext) (void *ctx);
+	void		(*ReleaseSavepointContext) (void *ctx);
+
 }	TransactionManager;
 
 /* Get pointer to transaction manager: actually returns content of TM variable */
@@ -105,6 +128,8 @@ extern TransactionManager PgTM; /* Standard PostgreSQL transaction manager */
 
 /* Standard PostgreSQL function implementing TM interface */
 extern bool PgXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
+extern void PgXidInMVCCSnapshotBatch(int nxids, TransactionId *xids,
+						 bool *inSnapshot, Snapshot snapshot);
 
 extern void PgTransactionIdSetTreeStatus(TransactionId xid, int nsubxids,
 				   TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
@@ -128,6 +153,9 @@ extern size_t PgGetTransactionStateSize(void);
 extern void PgSerializeTransactionState(void* ctx);
 extern void PgDeserializeTransactionState(void* ctx);
 extern void PgInitializeSequence(int64* start, int64* step);
+extern void *PgCreateSavepointContext(void);
+extern void PgRestoreSavepointContext(void *ctx);
+extern void PgReleaseSavepointContext(void *ctx);
 
 
 #endif
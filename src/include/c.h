@@ -311,12 +311,21 @@ typedef unsigned long long int uint64;
  * 128-bit signed and unsigned integers
  *		There currently is only a limited support for the type. E.g. 128bit
  *		literals and snprintf are not supported; but math is.
+ *
+ * palloc() only guarantees MAXALIGN, but compilers may assume 16-byte
+ * alignment for these and use instructions that trap on anything less, so
+ * where possible tell them not to.  (pg_attribute_aligned isn't defined yet.)
  */
 #if defined(PG_INT128_TYPE)
 #define HAVE_INT128
+#if defined(__GNUC__) || defined(__SUNPRO_C) || defined(__IBMC__)
+typedef PG_INT128_TYPE int128 __attribute__((aligned(MAXIMUM_ALIGNOF)));
+typedef unsigned PG_INT128_TYPE uint128 __attribute__((aligned(MAXIMUM_ALIGNOF)));
+#else
 typedef PG_INT128_TYPE int128;
 typedef unsigned PG_INT128_TYPE uint128;
 #endif
+#endif
 
 /*
  * stdint.h limits aren't guaranteed to be present and aren't guaranteed to
@@ -649,6 +658,14 @@ typedef NameData *Name;
 #define pg_attribute_noreturn()
 #endif
 
+/*
+ * GCC and clang support compiling individual functions for an extended
+ * instruction set.  Callers must check for the CPU support at runtime.
+ */
+#ifdef __GNUC__
+#define pg_attribute_target(t) __attribute__((target(t)))
+#endif
+
 /* ----------------------------------------------------------------
  *				Section 6:	assertions
  * ----------------------------------------------------------------
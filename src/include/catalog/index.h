@@ -28,6 +28,8 @@ typedef void (*IndexBuildCallback) (Relation index,
 												bool tupleIsAlive,
 												void *state);
 
+extern int	max_parallel_index_build_workers;
+
 /* Action code for index_set_state_flags */
 typedef enum
 {
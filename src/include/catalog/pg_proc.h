@@ -2751,9 +2751,9 @@ DATA(insert OID = 2022 (  pg_stat_get_activity			PGNSP PGUID 12 1 100 0 0 f f f
 DESCR("statistics: information about currently active backends");
 DATA(insert OID = 3318 (  pg_stat_get_progress_info			  PGNSP PGUID 12 1 100 0 0 f f f f t t s r 1 0 2249 "25" "{25,23,26,26,20,20,20,20,20,20,20,20,20,20}" "{i,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{cmdtype,pid,datid,relid,param1,param2,param3,param4,param5,param6,param7,param8,param9,param10}" _null_ _null_ pg_stat_get_progress_info _null_ _null_ _null_ ));
 DESCR("statistics: information about progress of backends running maintenance command");
-DATA(insert OID = 3099 (  pg_stat_get_wal_senders	PGNSP PGUID 12 1 10 0 0 f f f f f t s r 0 0 2249 "" "{23,25,3220,3220,3220,3220,23,25}" "{o,o,o,o,o,o,o,o}" "{pid,state,sent_location,write_location,flush_location,replay_location,sync_priority,sync_state}" _null_ _null_ pg_stat_get_wal_senders _null_ _null_ _null_ ));
+DATA(insert OID = 3099 (  pg_stat_get_wal_senders	PGNSP PGUID 12 1 10 0 0 f f f f f t s r 0 0 2249 "" "{23,25,3220,3220,3220,3220,23,25,20,20,20,20,20,20,1186,1186,1186}" "{o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{pid,state,sent_location,write_location,flush_location,replay_location,sync_priority,sync_state,spill_txns,spill_count,spill_bytes,sent_messages,sent_bytes,flushes,write_lag,flush_lag,replay_lag}" _null_ _null_ pg_stat_get_wal_senders _null_ _null_ _null_ ));
 DESCR("statistics: information about currently active replication");
-DATA(insert OID = 3317 (  pg_stat_get_wal_receiver	PGNSP PGUID 12 1 0 0 0 f f f f f f s r 0 0 2249 "" "{23,25,3220,23,3220,23,1184,1184,3220,1184,25,25}" "{o,o,o,o,o,o,o,o,o,o,o,o}" "{pid,status,receive_start_lsn,receive_start_tli,received_lsn,received_tli,last_msg_send_time,last_msg_receipt_time,latest_end_lsn,latest_end_time,slot_name,conninfo}" _null_ _null_ pg_stat_get_wal_receiver _null_ _null_ _null_ ));
+DATA(insert OID = 3317 (  pg_stat_get_wal_receiver	PGNSP PGUID 12 1 0 0 0 f f f f f f s r 0 0 2249 "" "{23,25,3220,23,3220,23,1184,1184,3220,1184,25,25,3220}" "{o,o,o,o,o,o,o,o,o,o,o,o,o}" "{pid,status,receive_start_lsn,receive_start_tli,received_lsn,received_tli,last_msg_send_time,last_msg_receipt_time,latest_end_lsn,latest_end_time,slot_name,conninfo,written_lsn}" _null_ _null_ pg_stat_get_wal_receiver _null_ _null_ _null_ ));
 DESCR("statistics: information about WAL receiver");
 DATA(insert OID = 2026 (  pg_backend_pid				PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 23 "" _null_ _null_ _null_ _null_ _null_ pg_backend_pid _null_ _null_ _null_ ));
 DESCR("statistics: current backend PID");
@@ -2773,6 +2773,10 @@ DATA(insert OID = 2094 (  pg_stat_get_backend_activity_start PGNSP PGUID 12 1 0
 DESCR("statistics: start time for current query of backend");
 DATA(insert OID = 2857 (  pg_stat_get_backend_xact_start PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 1184 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_xact_start _null_ _null_ _null_ ));
 DESCR("statistics: start time for backend's current transaction");
+DATA(insert OID = 4119 (  pg_stat_get_backend_sinval_resets PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 20 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_sinval_resets _null_ _null_ _null_ ));
+DESCR("statistics: number of cache resets of backend");
+DATA(insert OID = 4120 (  pg_get_memory_contexts	PGNSP PGUID 12 1 100 0 0 f f f f t t v r 1 0 2249 "23" "{23,25,25,23,20,20,20,20,20}" "{i,o,o,o,o,o,o,o,o}" "{pid,name,parent,level,total_bytes,total_nblocks,free_bytes,free_chunks,used_bytes}" _null_ _null_ pg_get_memory_contexts _null_ _null_ _null_ ));
+DESCR("memory contexts of a backend");
 DATA(insert OID = 1391 ( pg_stat_get_backend_start PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 1184 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_start _null_ _null_ _null_ ));
 DESCR("statistics: start time for current backend session");
 DATA(insert OID = 1392 ( pg_stat_get_backend_client_addr PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 869 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_client_addr _null_ _null_ _null_ ));
@@ -2823,6 +2827,18 @@ DATA(insert OID = 2844 (  pg_stat_get_db_blk_read_time	PGNSP PGUID 12 1 0 0 0 f
 DESCR("statistics: block read time, in msec");
 DATA(insert OID = 2845 (  pg_stat_get_db_blk_write_time PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 701 "26" _null_ _null_ _null_ _null_ _null_ pg_stat_get_db_blk_write_time _null_ _null_ _null_ ));
 DESCR("statistics: block write time, in msec");
+DATA(insert OID = 4111 (  pg_stat_get_db_fastpath_overflows PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 20 "26" _null_ _null_ _null_ _null_ _null_ pg_stat_get_db_fastpath_overflows _null_ _null_ _null_ ));
+DESCR("statistics: relation locks that did not fit in the fast-path slots");
+DATA(insert OID = 4112 (  pg_stat_get_lwlocks	PGNSP PGUID 12 1 100 0 0 f f f f t t v r 0 0 2249 "" "{25,20,20,701,701,1016}" "{o,o,o,o,o,o}" "{name,acquires,contended,wait_time,max_wait_time,wait_histogram}" _null_ _null_ pg_stat_get_lwlocks _null_ _null_ _null_ ));
+DESCR("statistics: cumulative waits on lightweight locks");
+DATA(insert OID = 4113 (  pg_stat_get_tablespace_io	PGNSP PGUID 12 1 10 0 0 f f f f t t v r 0 0 2249 "" "{26,20,20,701,701,20,701,23,23}" "{o,o,o,o,o,o,o,o,o}" "{spcid,writes,write_bytes,write_rate,write_iops,delayed_writes,delay_time,max_write_rate,max_write_iops}" _null_ _null_ pg_stat_get_tablespace_io _null_ _null_ _null_ ));
+DESCR("statistics: writes and write budgets of tablespaces");
+DATA(insert OID = 4114 (  pg_stat_get_session_pool	PGNSP PGUID 12 1 0 0 0 f f f f t f v r 0 0 2249 "" "{23,20,20,20,20}" "{o,o,o,o,o}" "{idle_backends,hits,misses,returns,evictions}" _null_ _null_ pg_stat_get_session_pool _null_ _null_ _null_ ));
+DESCR("statistics: usage of the session pool");
+DATA(insert OID = 4115 (  pg_stat_get_serializable	PGNSP PGUID 12 1 0 0 0 f f f f t f v r 0 0 2249 "" "{20,20,20,20,20,20,20}" "{o,o,o,o,o,o,o}" "{page_promotions,relation_promotions,doomed_failures,pivot_write_failures,pivot_read_failures,summarized_failures,prepared_pivot_failures}" _null_ _null_ pg_stat_get_serializable _null_ _null_ _null_ ));
+DESCR("statistics: predicate lock promotions and serialization failures");
+DATA(insert OID = 4116 (  pg_stat_get_autovacuum_queue	PGNSP PGUID 12 1 100 0 0 f f f f t t v r 0 0 2249 "" "{26,26,701,16,23}" "{o,o,o,o,o}" "{datid,relid,priority,wraparound,pid}" _null_ _null_ pg_stat_get_autovacuum_queue _null_ _null_ _null_ ));
+DESCR("statistics: tables waiting to be processed by autovacuum");
 DATA(insert OID = 3195 (  pg_stat_get_archiver		PGNSP PGUID 12 1 0 0 0 f f f f f f s r 0 0 2249 "" "{20,25,1184,20,25,1184,1184}" "{o,o,o,o,o,o,o}" "{archived_count,last_archived_wal,last_archived_time,failed_count,last_failed_wal,last_failed_time,stats_reset}" _null_ _null_ pg_stat_get_archiver _null_ _null_ _null_ ));
 DESCR("statistics: information about WAL archiver");
 DATA(insert OID = 2769 ( pg_stat_get_bgwriter_timed_checkpoints PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pg_stat_get_bgwriter_timed_checkpoints _null_ _null_ _null_ ));
@@ -2847,6 +2863,8 @@ DATA(insert OID = 3063 ( pg_stat_get_buf_fsync_backend PGNSP PGUID 12 1 0 0 0 f
 DESCR("statistics: number of backend buffer writes that did their own fsync");
 DATA(insert OID = 2859 ( pg_stat_get_buf_alloc			PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pg_stat_get_buf_alloc _null_ _null_ _null_ ));
 DESCR("statistics: number of buffer allocations");
+DATA(insert OID = 4110 (  pg_stat_get_buffer_replacement	PGNSP PGUID 12 1 0 0 0 f f f f t f v r 0 0 2249 "" "{25,23,20,20,701}" "{o,o,o,o,o}" "{policy,sweep_partitions,victim_searches,buffers_scanned,search_time}" _null_ _null_ pg_stat_get_buffer_replacement _null_ _null_ _null_ ));
+DESCR("statistics: victim buffer searches of the buffer replacement policy");
 
 DATA(insert OID = 2978 (  pg_stat_get_function_calls		PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 20 "26" _null_ _null_ _null_ _null_ _null_ pg_stat_get_function_calls _null_ _null_ _null_ ));
 DESCR("statistics: number of function calls");
@@ -2895,6 +2913,8 @@ DESCR("statistics: reset collected statistics for a single function in the curre
 
 DATA(insert OID = 3163 (  pg_trigger_depth				PGNSP PGUID 12 1 0 0 0 f f f f t f s s 0 0 23 "" _null_ _null_ _null_ _null_ _null_ pg_trigger_depth _null_ _null_ _null_ ));
 DESCR("current trigger depth");
+DATA(insert OID = 4118 (  trigger_transition_table	PGNSP PGUID 12 1 1000 0 0 f f f f f t v r 2 0 2283 "2283 25" _null_ _null_ _null_ _null_ _null_ trigger_transition_table _null_ _null_ _null_ ));
+DESCR("rows of a transition table of the current trigger");
 
 DATA(insert OID = 3778 ( pg_tablespace_location PGNSP PGUID 12 1 0 0 0 f f f f t f s s 1 0 25 "26" _null_ _null_ _null_ _null_ _null_ pg_tablespace_location _null_ _null_ _null_ ));
 DESCR("tablespace location");
@@ -4188,6 +4208,8 @@ DATA(insert OID = 1030 (  gist_point_compress	PGNSP PGUID 12 1 0 0 0 f f f f t f
 DESCR("GiST support");
 DATA(insert OID = 3282 (  gist_point_fetch	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 1 0 2281 "2281" _null_ _null_ _null_ _null_ _null_ gist_point_fetch _null_ _null_ _null_ ));
 DESCR("GiST support");
+DATA(insert OID = 4117 (  gist_point_sortsupport	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 1 0 2278 "2281" _null_ _null_ _null_ _null_ _null_ gist_point_sortsupport _null_ _null_ _null_ ));
+DESCR("GiST support");
 DATA(insert OID = 2179 (  gist_point_consistent PGNSP PGUID 12 1 0 0 0 f f f f t f i s 5 0 16 "2281 600 21 26 2281" _null_ _null_ _null_ _null_ _null_	gist_point_consistent _null_ _null_ _null_ ));
 DESCR("GiST support");
 DATA(insert OID = 3064 (  gist_point_distance	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 5 0 701 "2281 600 21 26 2281" _null_ _null_ _null_ _null_ _null_ gist_point_distance _null_ _null_ _null_ ));
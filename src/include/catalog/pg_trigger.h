@@ -59,6 +59,8 @@ CATALOG(pg_trigger,2620)
 #ifdef CATALOG_VARLEN
 	bytea tgargs BKI_FORCE_NOT_NULL;	/* first\000second\000tgnargs\000 */
 	pg_node_tree tgqual;		/* WHEN expression, or NULL if none */
+	NameData	tgoldtable;		/* OLD transition table, or NULL if none */
+	NameData	tgnewtable;		/* NEW transition table, or NULL if none */
 #endif
 } FormData_pg_trigger;
 
@@ -73,7 +75,7 @@ typedef FormData_pg_trigger *Form_pg_trigger;
  *		compiler constants for pg_trigger
  * ----------------
  */
-#define Natts_pg_trigger				15
+#define Natts_pg_trigger				17
 #define Anum_pg_trigger_tgrelid			1
 #define Anum_pg_trigger_tgname			2
 #define Anum_pg_trigger_tgfoid			3
@@ -89,6 +91,8 @@ typedef FormData_pg_trigger *Form_pg_trigger;
 #define Anum_pg_trigger_tgattr			13
 #define Anum_pg_trigger_tgargs			14
 #define Anum_pg_trigger_tgqual			15
+#define Anum_pg_trigger_tgoldtable		16
+#define Anum_pg_trigger_tgnewtable		17
 
 /* Bits within tgtype */
 #define TRIGGER_TYPE_ROW				(1 << 0)
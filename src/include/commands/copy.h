@@ -16,6 +16,8 @@
 
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
 #include "tcop/dest.h"
 
 /* CopyStateData is private in commands/copy.c */
@@ -33,6 +35,7 @@ extern bool NextCopyFrom(CopyState cstate, ExprContext *econtext,
 extern bool NextCopyFromRawFields(CopyState cstate,
 					  char ***fields, int *nfields);
 extern void CopyFromErrorCallback(void *arg);
+extern void ParallelCopyMain(dsm_segment *seg, shm_toc *toc);
 
 extern DestReceiver *CreateCopyDestReceiver(void);
 
@@ -34,4 +34,9 @@
 #define PROGRESS_VACUUM_PHASE_TRUNCATE			5
 #define PROGRESS_VACUUM_PHASE_FINAL_CLEANUP		6
 
+/* Progress parameters for COPY FROM */
+#define PROGRESS_COPY_LINES_PROCESSED			0
+#define PROGRESS_COPY_TUPLES_INSERTED			1
+#define PROGRESS_COPY_BUFFER_FLUSHES			2
+
 #endif
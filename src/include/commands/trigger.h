@@ -37,6 +37,8 @@ typedef struct TriggerData
 	Trigger    *tg_trigger;
 	Buffer		tg_trigtuplebuf;
 	Buffer		tg_newtuplebuf;
+	Tuplestorestate *tg_oldtable;	/* OLD TABLE of a statement trigger */
+	Tuplestorestate *tg_newtable;	/* NEW TABLE of a statement trigger */
 } TriggerData;
 
 /*
@@ -210,6 +212,12 @@ extern bool RI_Initial_Check(Trigger *trigger,
 
 extern int	RI_FKey_trigger_type(Oid tgfoid);
 
+extern void RI_FKey_check_flush(void);
+extern void RI_FKey_check_discard(void);
+
+extern int	foreign_key_check_batch_size;
+
 extern Datum pg_trigger_depth(PG_FUNCTION_ARGS);
+extern Datum trigger_transition_table(PG_FUNCTION_ARGS);
 
 #endif   /* TRIGGER_H */
@@ -0,0 +1,85 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.h
+ *	  Support for batch-at-a-time execution of simple scans.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/execBatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXECBATCH_H
+#define EXECBATCH_H
+
+#include "access/attnum.h"
+#include "nodes/pg_list.h"
+
+
+/* maximum number of tuples in a batch; must fit in the selection vector */
+#define EXEC_BATCH_SIZE		1024
+
+/*
+ * A batch of scanned tuples, stored column by column.
+ *
+ * Only the columns some consumer asked for are deformed.  values[col] and
+ * isnull[col] hold the col'th of those for ntuples consecutive tuples.  The
+ * values of pass-by-reference columns point into the scanned buffers and
+ * must not be dereferenced; consumers only look at their null flags.
+ *
+ * selection lists the indexes of the nselected tuples that passed the
+ * scan's quals, in ascending order.
+ */
+typedef struct TupleBatch
+{
+	int			ncols;			/* number of columns */
+	int			maxcols;		/* allocated length of the arrays below */
+	AttrNumber *attnos;			/* scan tuple attribute number of each column */
+	AttrNumber	maxattno;		/* largest of attnos */
+	Datum	  **values;			/* per-column arrays of values */
+	bool	  **isnull;			/* per-column arrays of null flags */
+	int			ntuples;		/* number of tuples in the batch */
+	int			nselected;		/* number of tuples passing the quals */
+	uint16	   *selection;		/* indexes of tuples passing the quals */
+} TupleBatch;
+
+/* in-memory representation of a vectorizable column's values */
+typedef enum BatchValueKind
+{
+	BATCH_INT16,
+	BATCH_INT32,
+	BATCH_INT64
+} BatchValueKind;
+
+typedef enum BatchCompare
+{
+	BATCH_LT,
+	BATCH_LE,
+	BATCH_EQ,
+	BATCH_GE,
+	BATCH_GT,
+	BATCH_NE
+} BatchCompare;
+
+/* a qual of the form "column <op> constant", evaluated a batch at a time */
+typedef struct BatchQual
+{
+	int			col;			/* column in the batch */
+	BatchValueKind kind;		/* how to interpret the column's values */
+	BatchCompare cmp;			/* comparison to perform */
+	Datum		constval;		/* the constant, never NULL */
+} BatchQual;
+
+/* GUC */
+extern bool enable_batch_execution;
+
+extern TupleBatch *ExecCreateTupleBatch(int maxcols);
+extern int	ExecBatchAddColumn(TupleBatch *batch, AttrNumber attno);
+extern bool ExecBatchValueKind(Oid typid, BatchValueKind *kind);
+extern bool ExecBuildBatchQuals(List *qual, Index scanrelid,
+					TupleBatch *batch,
+					BatchQual **quals, int *nquals);
+extern void ExecBatchFilter(TupleBatch *batch, BatchQual *quals, int nquals);
+
+#endif   /* EXECBATCH_H */
@@ -16,6 +16,7 @@
 
 #include "nodes/execnodes.h"
 #include "storage/buffile.h"
+#include "storage/s_lock.h"
 
 /* ----------------------------------------------------------------
  *				hash-join hash table structures
@@ -54,6 +55,19 @@
  * inner batch file.  Subsequently, while reading either inner or outer batch
  * files, we might find tuples that no longer belong to the current batch;
  * if so, we just dump them out to the correct batch file.
+ *
+ * A parallel-aware hash join (one whose inner side is a partial plan below
+ * a Gather) uses one hash table for all the processes executing it, kept in
+ * the query's dynamic shared memory segment and described by a
+ * ParallelHashJoinState.  Every participant runs its share of the inner
+ * plan and inserts the tuples into the shared table, then runs its share of
+ * the outer plan and probes the shared table.  If nbatch > 1, each
+ * participant writes the tuples of other batches to batch files of its own,
+ * which are named so that the others can read them; the outer relation is
+ * partitioned completely before any participant starts probing, and each
+ * batch after the first is then handed to a single participant, which
+ * processes it in private memory like the serial case.  See the notes in
+ * nodeHash.c for the details.
  * ----------------------------------------------------------------
  */
 
@@ -63,7 +77,12 @@
 
 typedef struct HashJoinTupleData
 {
-	struct HashJoinTupleData *next;		/* link to next tuple in same bucket */
+	/* link to next tuple in same bucket */
+	union
+	{
+		struct HashJoinTupleData *unshared;	/* in a private table */
+		Size		shared;		/* offset in a shared table, or 0 */
+	}			next;
 	uint32		hashvalue;		/* tuple's hash code */
 	/* Tuple data, in MinimalTuple format, follows on a MAXALIGN boundary */
 }	HashJoinTupleData;
@@ -123,6 +142,97 @@ typedef struct HashMemoryChunkData *HashMemoryChunk;
 #define HASH_CHUNK_SIZE			(32 * 1024L)
 #define HASH_CHUNK_THRESHOLD	(HASH_CHUNK_SIZE / 4)
 
+/*
+ * The tuple space of a shared hash table is handed out to the participants
+ * in chunks, too.  Chunks are laid out one after another, each starting with
+ * this header; "size" includes the header.
+ */
+typedef struct SharedHashChunkData
+{
+	Size		size;			/* size of the chunk */
+	Size		used;			/* bytes used after the header */
+} SharedHashChunkData;
+
+typedef struct SharedHashChunkData *SharedHashChunk;
+
+#define SHARED_HASH_CHUNK_HEADER	MAXALIGN(sizeof(SharedHashChunkData))
+
+/*
+ * Shared state of a parallel-aware hash join.
+ *
+ * The bucket array and then the tuple space follow this struct in the
+ * dynamic shared memory segment.  They are addressed by offsets from the
+ * start of this struct, since the segment may be mapped at different
+ * addresses in different participants; offset 0 means "no tuple".
+ *
+ * The participants that are building the table, or partitioning the outer
+ * relation, wait for each other at the end of that phase.  Nobody waits for
+ * anybody once the join has started to return tuples, since the leader might
+ * stop executing the join at any point to read the tuple queues.
+ */
+#define PHJ_PHASE_BUILDING		0	/* inserting the inner relation */
+#define PHJ_PHASE_PARTITIONING	1	/* writing outer batch files */
+#define PHJ_PHASE_PROBING		2	/* hash table and batch files complete */
+
+#define PHJ_GROW_BATCHES		1	/* out of tuple space */
+#define PHJ_GROW_BUCKETS		2	/* too many tuples per bucket */
+
+/* number of spinlocks protecting the buckets; must be a power of 2 */
+#define PHJ_BUCKET_LOCKS		128
+
+typedef struct ParallelHashJoinState
+{
+	slock_t		mutex;			/* protects everything below but the
+								 * bucket array */
+
+	int			phase;			/* PHJ_PHASE_xxx */
+	int			nparticipants;	/* maximum number of participants */
+	int			nextparticipant;	/* next participant number to hand out */
+	int			nattached;		/* participants in the current phase */
+	int			ndone;			/* ... that have finished their share */
+
+	/* growing the hash table while building it */
+	int			growth;			/* PHJ_GROW_xxx bits requested, or 0 */
+	int			ngrowwaiting;	/* participants ready for it */
+	bool		growing;		/* being carried out by one of them? */
+	uint32		generation;		/* incremented by each growth step */
+	bool		growEnabled;	/* flag to shut off nbatch increases */
+	bool		overflow;		/* batch 0 didn't fit in the tuple space */
+
+	int			nbuckets;		/* # buckets in use */
+	int			log2_nbuckets;	/* its log2 */
+	int			nbuckets_max;	/* size of the bucket array */
+	int			nbatch;			/* number of batches */
+	int			nbatch_original;	/* nbatch when we started building */
+	int			nextbatch;		/* next batch to hand out after probing */
+
+	double		totalTuples;	/* # inner tuples of all participants */
+	double		ntuples;		/* # of them in the tuple space */
+	Size		spaceAllowed;	/* size of the tuple space */
+	Size		spaceUsed;		/* bytes of it handed out as chunks */
+	Size		spacePeak;		/* peak space used, including buckets */
+	Size		buckets;		/* offset of the bucket array */
+	Size		tuples;			/* offset of the tuple space */
+
+	/* what the batch files of this join are called, and where they are */
+	Oid			tablespace;
+	int			leader_pid;
+	uint32		fileset;
+
+	slock_t		bucket_locks[PHJ_BUCKET_LOCKS];
+
+	/* pgprocno of each participant, to wake it up */
+	int			procnos[FLEXIBLE_ARRAY_MEMBER];
+} ParallelHashJoinState;
+
+#define ParallelHashBuckets(pstate) \
+	((Size *) ((char *) (pstate) + (pstate)->buckets))
+#define ParallelHashTupleAt(pstate, offset) \
+	((offset) == 0 ? NULL : \
+	 (HashJoinTuple) ((char *) (pstate) + (offset)))
+#define ParallelHashTupleOffset(pstate, tuple) \
+	((Size) ((char *) (tuple) - (char *) (pstate)))
+
 typedef struct HashJoinTableData
 {
 	int			nbuckets;		/* # buckets in the in-memory hash table */
@@ -186,6 +296,28 @@ typedef struct HashJoinTableData
 
 	/* used for dense allocation of tuples (into linked chunks) */
 	HashMemoryChunk chunks;		/* one list for the whole batch */
+
+	/*
+	 * For a parallel-aware hash join, the shared state and our participant
+	 * number.  "shared" is true while the current batch is the one in shared
+	 * memory, that is, while building the table and probing batch 0; batches
+	 * handed to us afterwards are processed in private memory, with nbatch
+	 * growth disabled.  innerBatchFile[] and outerBatchFile[] hold our own
+	 * batch files while we write them, including the zero'th ones; while
+	 * processing a batch handed to us, outerBatchFile[curbatch] holds the
+	 * file of participant curparticipant that we are reading.
+	 */
+	struct ParallelHashJoinState *parallel_state;
+	int			participant;	/* our participant number */
+	bool		attached;		/* counted in parallel_state->nattached? */
+	bool		shared;			/* is the current batch the shared one? */
+	uint32		generation;		/* parallel_state->generation seen last */
+	Size		chunk;			/* offset of our current shared chunk, or 0 */
+	double		unflushedTuples;	/* inner tuples not yet counted in
+									 * parallel_state->totalTuples */
+	double		unflushedInMemory;	/* ... and of those, how many went to
+									 * the tuple space */
+	int			curparticipant; /* whose outer batch file we are reading */
 }	HashJoinTableData;
 
 #endif   /* HASHJOIN_H */
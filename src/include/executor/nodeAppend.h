@@ -16,6 +16,9 @@
 
 #include "nodes/execnodes.h"
 
+/* GUC parameter */
+extern bool enable_async_append;
+
 extern AppendState *ExecInitAppend(Append *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecAppend(AppendState *node);
 extern void ExecEndAppend(AppendState *node);
@@ -15,6 +15,7 @@
 #define NODEHASH_H
 
 #include "nodes/execnodes.h"
+#include "storage/buffile.h"
 
 extern HashState *ExecInitHash(Hash *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecHash(HashState *node);
@@ -22,7 +23,7 @@ extern Node *MultiExecHash(HashState *node);
 extern void ExecEndHash(HashState *node);
 extern void ExecReScanHash(HashState *node);
 
-extern HashJoinTable ExecHashTableCreate(Hash *node, List *hashOperators,
+extern HashJoinTable ExecHashTableCreate(HashState *state, List *hashOperators,
 					bool keepNulls);
 extern void ExecHashTableDestroy(HashJoinTable hashtable);
 extern void ExecHashTableInsert(HashJoinTable hashtable,
@@ -45,9 +46,25 @@ extern bool ExecScanHashTableForUnmatched(HashJoinState *hjstate,
 extern void ExecHashTableReset(HashJoinTable hashtable);
 extern void ExecHashTableResetMatchFlags(HashJoinTable hashtable);
 extern void ExecChooseHashTableSize(double ntuples, int tupwidth, bool useskew,
+						int nparticipants,
 						int *numbuckets,
 						int *numbatches,
 						int *num_skew_mcvs);
 extern int	ExecHashGetSkewBucket(HashJoinTable hashtable, uint32 hashvalue);
 
+extern Size ExecParallelHashEstimate(Hash *node, int nparticipants);
+extern void ExecParallelHashInitialize(struct ParallelHashJoinState *pstate,
+						   Hash *node, int nparticipants);
+extern void ExecParallelHashDeleteFiles(struct ParallelHashJoinState *pstate);
+extern bool ExecParallelHashAttachPartitioning(HashJoinTable hashtable);
+extern void ExecParallelHashPartitionDone(HashJoinTable hashtable);
+extern int	ExecParallelHashNextBatch(HashJoinTable hashtable);
+extern double ExecParallelHashTableLoadShared(HashJoinTable hashtable,
+								TupleTableSlot *slot);
+extern void ExecParallelHashSaveTuple(HashJoinTable hashtable,
+						  MinimalTuple tuple, uint32 hashvalue,
+						  int batchno, bool inner);
+extern BufFile *ExecParallelHashOpenFile(HashJoinTable hashtable, bool inner,
+						 int batchno, int participant);
+
 #endif   /* NODEHASH_H */
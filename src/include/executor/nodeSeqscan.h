@@ -15,6 +15,7 @@
 #define NODESEQSCAN_H
 
 #include "access/parallel.h"
+#include "executor/execBatch.h"
 #include "nodes/execnodes.h"
 
 extern SeqScanState *ExecInitSeqScan(SeqScan *node, EState *estate, int eflags);
@@ -22,6 +23,10 @@ extern TupleTableSlot *ExecSeqScan(SeqScanState *node);
 extern void ExecEndSeqScan(SeqScanState *node);
 extern void ExecReScanSeqScan(SeqScanState *node);
 
+/* batch mode support */
+extern TupleBatch *ExecSeqScanInitBatch(SeqScanState *node, List *attnos);
+extern bool ExecSeqScanBatch(SeqScanState *node);
+
 /* parallel scan support */
 extern void ExecSeqScanEstimate(SeqScanState *node, ParallelContext *pcxt);
 extern void ExecSeqScanInitializeDSM(SeqScanState *node, ParallelContext *pcxt);
@@ -107,7 +107,10 @@
  * extraction to treat the case identically to regular physical tuples.
  *
  * tts_slow/tts_off are saved state for slot_deform_tuple, and should not
- * be touched by any other code.
+ * be touched by any other code.  tts_deform, if not NULL, is a specialized
+ * replacement for slot_deform_tuple's generic loop, generated for the
+ * slot's tuple descriptor by a JIT provider (see jit.h); it must maintain
+ * tts_nvalid, tts_slow and tts_off the same way.
  *----------
  */
 typedef struct TupleTableSlot
@@ -127,6 +130,8 @@ typedef struct TupleTableSlot
 	MinimalTuple tts_mintuple;	/* minimal tuple, or NULL if none */
 	HeapTupleData tts_minhdr;	/* workspace for minimal-tuple-only case */
 	long		tts_off;		/* saved state for slot_deform_tuple */
+	/* generated deforming code, or NULL */
+	void		(*tts_deform) (struct TupleTableSlot *slot, int natts);
 } TupleTableSlot;
 
 #define TTS_HAS_PHYSICAL_TUPLE(slot)  \
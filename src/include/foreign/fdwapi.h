@@ -84,6 +84,13 @@ typedef TupleTableSlot *(*ExecForeignInsert_function) (EState *estate,
 														TupleTableSlot *slot,
 												   TupleTableSlot *planSlot);
 
+typedef TupleTableSlot **(*ExecForeignBatchInsert_function) (EState *estate,
+														ResultRelInfo *rinfo,
+													   TupleTableSlot **slots,
+															  int *numSlots);
+
+typedef int (*GetForeignModifyBatchSize_function) (ResultRelInfo *rinfo);
+
 typedef TupleTableSlot *(*ExecForeignUpdate_function) (EState *estate,
 														ResultRelInfo *rinfo,
 														TupleTableSlot *slot,
@@ -148,6 +155,9 @@ typedef Size (*EstimateDSMForeignScan_function) (ForeignScanState *node,
 typedef void (*InitializeDSMForeignScan_function) (ForeignScanState *node,
 													   ParallelContext *pcxt,
 														   void *coordinate);
+typedef void (*ReInitializeDSMForeignScan_function) (ForeignScanState *node,
+													   ParallelContext *pcxt,
+														   void *coordinate);
 typedef void (*InitializeWorkerForeignScan_function) (ForeignScanState *node,
 																shm_toc *toc,
 														   void *coordinate);
@@ -155,6 +165,10 @@ typedef bool (*IsForeignScanParallelSafe_function) (PlannerInfo *root,
 															 RelOptInfo *rel,
 														 RangeTblEntry *rte);
 
+typedef bool (*IsForeignScanAsyncCapable_function) (ForeignScanState *node);
+typedef bool (*ForeignAsyncPoll_function) (ForeignScanState *node,
+													   pgsocket *waitsock);
+
 /*
  * FdwRoutine is the struct returned by a foreign-data wrapper's handler
  * function.  It provides pointers to the callback functions needed by the
@@ -223,7 +237,16 @@ typedef struct FdwRoutine
 	IsForeignScanParallelSafe_function IsForeignScanParallelSafe;
 	EstimateDSMForeignScan_function EstimateDSMForeignScan;
 	InitializeDSMForeignScan_function InitializeDSMForeignScan;
+	ReInitializeDSMForeignScan_function ReInitializeDSMForeignScan;
 	InitializeWorkerForeignScan_function InitializeWorkerForeignScan;
+
+	/* Support functions for asynchronous execution under Append node */
+	IsForeignScanAsyncCapable_function IsForeignScanAsyncCapable;
+	ForeignAsyncPoll_function ForeignAsyncPoll;
+
+	/* Support functions for batched inserts into foreign tables */
+	GetForeignModifyBatchSize_function GetForeignModifyBatchSize;
+	ExecForeignBatchInsert_function ExecForeignBatchInsert;
 } FdwRoutine;
 
 
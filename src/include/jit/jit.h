@@ -0,0 +1,93 @@
+/*-------------------------------------------------------------------------
+ *
+ * jit.h
+ *	  Provider independent JIT infrastructure.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/jit/jit.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef JIT_H
+#define JIT_H
+
+#include "executor/instrument.h"
+#include "nodes/execnodes.h"
+
+
+/* Flags determining what kind of JIT operations to perform */
+#define PGJIT_NONE		0
+#define PGJIT_PERFORM	(1 << 0)
+#define PGJIT_EXPR		(1 << 1)
+#define PGJIT_DEFORM	(1 << 2)
+
+
+typedef struct JitInstrumentation
+{
+	/* number of functions generated */
+	int			created_functions;
+
+	/* accumulated time to generate code */
+	instr_time	generation_counter;
+} JitInstrumentation;
+
+/*
+ * State of JIT compilation for one query, created by the provider.  A
+ * provider embeds this as the first member of a struct of its own.  The
+ * context lives as long as the query's EState, and is released when the
+ * EState's memory context goes away, also after an error.
+ */
+typedef struct JitContext
+{
+	/* PGJIT_* flags */
+	int			flags;
+
+	JitInstrumentation instr;
+
+	/* arranges for the release of the context, see jit.c */
+	MemoryContextCallback release_cb;
+} JitContext;
+
+
+typedef struct JitProviderCallbacks JitProviderCallbacks;
+
+extern void _PG_jit_provider_init(JitProviderCallbacks *cb);
+typedef void (*JitProviderInit) (JitProviderCallbacks *cb);
+typedef JitContext *(*JitProviderCreateContextCB) (int flags);
+typedef void (*JitProviderReleaseContextCB) (JitContext *context);
+typedef bool (*JitProviderCompileExprCB) (JitContext *context,
+										  ExprState *exprstate);
+typedef bool (*JitProviderCompileDeformCB) (JitContext *context,
+											TupleTableSlot *slot);
+
+/*
+ * The functions a JIT provider implements.
+ *
+ * compile_expr may replace the evalfunc of the given expression tree's top
+ * node with generated code that evaluates the whole tree.  compile_deform
+ * may set the slot's tts_deform to generated code for deforming tuples of
+ * the slot's tuple descriptor.  Both return false if they left things alone.
+ */
+struct JitProviderCallbacks
+{
+	JitProviderCreateContextCB create_context;
+	JitProviderReleaseContextCB release_context;
+	JitProviderCompileExprCB compile_expr;
+	JitProviderCompileDeformCB compile_deform;
+};
+
+
+/* GUCs */
+extern bool jit_enabled;
+extern char *jit_provider;
+extern double jit_above_cost;
+extern bool jit_expressions;
+extern bool jit_tuple_deforming;
+
+
+extern int	jit_plan_flags(double total_cost);
+extern void jit_compile_planstate(PlanState *planstate);
+
+#endif   /* JIT_H */
@@ -68,6 +68,7 @@ typedef struct
 #include "datatype/timestamp.h"
 #include "libpq/hba.h"
 #include "libpq/pqcomm.h"
+#include "libpq/zpq_stream.h"
 
 
 typedef enum CAC_state
@@ -178,6 +179,12 @@ typedef struct Port
 	void	   *gss;
 #endif
 
+	/*
+	 * Compression of the traffic, if negotiated in the startup packet.
+	 * It works on top of SSL.
+	 */
+	ZpqStream  *zstream;
+
 	/*
 	 * SSL structures.
 	 */
@@ -0,0 +1,50 @@
+/*-------------------------------------------------------------------------
+ *
+ * zpq_stream.h
+ *	  Streaming compression of frontend/backend protocol traffic
+ *
+ * The stream sits between the protocol buffers and the transport (raw
+ * socket or SSL): data written to it is compressed and passed to the
+ * transport, data read from it is received from the transport and
+ * decompressed.  It is shared by the backend (pqcomm.c) and libpq.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ * src/include/libpq/zpq_stream.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef ZPQ_STREAM_H
+#define ZPQ_STREAM_H
+
+#include <sys/types.h>
+
+/* Algorithm codes used in compression negotiation */
+#define ZPQ_NO_COMPRESSION	'n'
+#define ZPQ_ZLIB			'z'
+
+/* zpq_read result if the received data can't be decompressed */
+#define ZPQ_DECOMPRESS_ERROR	(-2)
+
+/* Size of buffers of compressed data */
+#define ZPQ_BUFFER_SIZE		8192
+
+typedef struct ZpqStream ZpqStream;
+
+/* Transport callbacks: same conventions as secure_read/secure_write */
+typedef ssize_t (*zpq_tx_func) (void *arg, void const *data, size_t size);
+typedef ssize_t (*zpq_rx_func) (void *arg, void *data, size_t size);
+
+extern char const *zpq_algorithms(void);
+extern ZpqStream *zpq_create(char algorithm, zpq_tx_func tx_func,
+		   zpq_rx_func rx_func, void *arg,
+		   char const *rx_data, size_t rx_data_size);
+extern ssize_t zpq_read(ZpqStream *zs, void *buf, size_t size);
+extern ssize_t zpq_write(ZpqStream *zs, void const *buf, size_t size,
+		  size_t *processed);
+extern size_t zpq_buffered_rx(ZpqStream *zs);
+extern size_t zpq_buffered_tx(ZpqStream *zs);
+extern char const *zpq_error(ZpqStream *zs);
+extern void zpq_free(ZpqStream *zs);
+
+#endif   /* ZPQ_STREAM_H */
@@ -421,6 +421,7 @@ extern void pg_split_opts(char **argv, int *argcp, const char *optstr);
 extern void InitializeMaxBackends(void);
 extern void InitPostgres(const char *in_dbname, Oid dboid, const char *username,
 			 Oid useroid, char *out_dbname);
+extern void InitPooledSession(void);
 extern void BaseInit(void);
 
 /* in utils/init/miscinit.c */
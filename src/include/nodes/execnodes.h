@@ -17,6 +17,7 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "executor/instrument.h"
+#include "lib/ilist.h"
 #include "lib/pairingheap.h"
 #include "nodes/params.h"
 #include "nodes/plannodes.h"
@@ -312,6 +313,10 @@ typedef struct JunkFilter
  *		FdwRoutine				FDW callback functions, if foreign table
  *		FdwState				available to save private state of FDW
  *		usesFdwDirectModify		true when modifying foreign table directly
+ *		BatchSize				max # of rows per FDW batch insert (0 or 1
+ *								means no batching)
+ *		NumSlots				# of rows currently queued for the FDW
+ *		Slots					the queued rows
  *		WithCheckOptions		list of WithCheckOption's to be checked
  *		WithCheckOptionExprs	list of WithCheckOption expr states
  *		ConstraintExprs			array of constraint-checking expr states
@@ -336,6 +341,9 @@ typedef struct ResultRelInfo
 	struct FdwRoutine *ri_FdwRoutine;
 	void	   *ri_FdwState;
 	bool		ri_usesFdwDirectModify;
+	int			ri_BatchSize;
+	int			ri_NumSlots;
+	TupleTableSlot **ri_Slots;
 	List	   *ri_WithCheckOptions;
 	List	   *ri_WithCheckOptionExprs;
 	List	  **ri_ConstraintExprs;
@@ -421,6 +429,9 @@ typedef struct EState
 	HeapTuple  *es_epqTuple;	/* array of EPQ substitute tuples */
 	bool	   *es_epqTupleSet; /* true if EPQ tuple is provided */
 	bool	   *es_epqScanDone; /* true if EPQ tuple has been fetched */
+
+	/* JIT compilation state of the query, or NULL, see jit.h */
+	struct JitContext *es_jit;
 } EState;
 
 
@@ -1152,6 +1163,16 @@ typedef struct AppendState
 	PlanState **appendplans;	/* array of PlanStates for my inputs */
 	int			as_nplans;
 	int			as_whichplan;
+	int			as_nprunedplans;	/* # of subplans skipped by run-time
+									 * partition pruning */
+	/* these are used only if some subplans are run asynchronously: */
+	int			as_nasyncplans; /* # of asynchronous subplans */
+	bool	   *as_asyncplans;	/* which subplans are asynchronous */
+	bool	   *as_asyncdone;	/* which of those are exhausted */
+	int			as_nasyncremaining;		/* # of those not yet exhausted */
+	int			as_nextasync;	/* asynchronous subplan to poll first */
+	pgsocket   *as_waitsocks;	/* sockets they are waiting on */
+	int			as_nwait;		/* # of valid entries in as_waitsocks */
 } AppendState;
 
 /* ----------------
@@ -1260,6 +1281,11 @@ typedef struct SeqScanState
 {
 	ScanState	ss;				/* its first field is NodeTag */
 	Size		pscan_len;		/* size of parallel heap scan descriptor */
+	/* these fields are used in batch mode, see execBatch.c: */
+	struct TupleBatch *batch;	/* current batch, or NULL if not batching */
+	struct BatchQual *batchquals;	/* vectorized quals */
+	int			nbatchquals;	/* number of batchquals */
+	bool		batchdone;		/* relation exhausted in batch mode? */
 } SeqScanState;
 
 /* ----------------
@@ -1317,6 +1343,7 @@ typedef struct
  *		RuntimeContext	   expr context for evaling runtime Skeys
  *		RelationDesc	   index relation descriptor
  *		ScanDesc		   index scan descriptor
+ *		PscanLen		   size of parallel index scan descriptor
  *
  *		ReorderQueue	   tuples that need reordering due to re-check
  *		ReachedEnd		   have we fetched all tuples from index already?
@@ -1342,6 +1369,7 @@ typedef struct IndexScanState
 	ExprContext *iss_RuntimeContext;
 	Relation	iss_RelationDesc;
 	IndexScanDesc iss_ScanDesc;
+	Size		iss_PscanLen;
 
 	/* These are needed for re-checking ORDER BY expr ordering */
 	pairingheap *iss_ReorderQueue;
@@ -1369,6 +1397,7 @@ typedef struct IndexScanState
  *		ScanDesc		   index scan descriptor
  *		VMBuffer		   buffer in use for visibility map testing, if any
  *		HeapFetches		   number of tuples we were forced to fetch from heap
+ *		PscanLen		   size of parallel index-only scan descriptor
  * ----------------
  */
 typedef struct IndexOnlyScanState
@@ -1387,6 +1416,7 @@ typedef struct IndexOnlyScanState
 	IndexScanDesc ioss_ScanDesc;
 	Buffer		ioss_VMBuffer;
 	long		ioss_HeapFetches;
+	Size		ioss_PscanLen;
 } IndexOnlyScanState;
 
 /* ----------------
@@ -1434,6 +1464,12 @@ typedef struct BitmapIndexScanState
  *		prefetch_pages	   # pages prefetch iterator is ahead of current
  *		prefetch_target    current target prefetch distance
  *		prefetch_maximum   maximum value for prefetch_target
+ *		pscan_len		   size of the shared state of a parallel scan
+ *		pstate			   shared state of a parallel scan, or NULL
+ *		pinitialized	   have we joined the parallel scan yet?
+ *		pindexfile		   shared list of bitmap pages, when parallel
+ *		pdatafile		   shared tuple offsets of those pages
+ *		ptbmres			   workspace for a page read from those files
  * ----------------
  */
 typedef struct BitmapHeapScanState
@@ -1449,6 +1485,12 @@ typedef struct BitmapHeapScanState
 	int			prefetch_pages;
 	int			prefetch_target;
 	int			prefetch_maximum;
+	Size		pscan_len;
+	struct ParallelBitmapHeapState *pstate;
+	bool		pinitialized;
+	struct BufFile *pindexfile;
+	struct BufFile *pdatafile;
+	TBMIterateResult *ptbmres;
 } BitmapHeapScanState;
 
 /* ----------------
@@ -1774,6 +1816,45 @@ typedef struct MaterialState
 	Tuplestorestate *tuplestorestate;
 } MaterialState;
 
+/* ----------------
+ *	 MemoizeState information
+ *
+ *		memoize nodes cache the tuples of the scans of their subplan,
+ *		keyed by the values of the parameters of each scan.  Cache
+ *		entries are kept in a list in LRU order, and the least recently
+ *		used ones are evicted when the cache outgrows work_mem.
+ * ----------------
+ */
+struct MemoizeEntry;			/* private in nodeMemoize.c */
+struct MemoizeTuple;
+
+typedef struct MemoizeState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	int			mstatus;		/* state of ExecMemoize's state machine */
+	int			nkeys;			/* number of cache keys */
+	List	   *param_exprs;	/* ExprStates computing the keys */
+	AttrNumber *keyColIdx;		/* key columns in probeslot, 1..nkeys */
+	FmgrInfo   *eqfunctions;	/* equality functions for the keys */
+	FmgrInfo   *hashfunctions;	/* hash functions for the keys */
+	TupleHashTable hashtable;	/* the cache; entries are MemoizeEntrys */
+	MemoryContext tableContext; /* memory context for the cache */
+	TupleTableSlot *probeslot;	/* virtual slot holding the current keys */
+	TupleTableSlot *keyslot;	/* slot for the keys of an entry to remove */
+	Size		mem_used;		/* bytes of memory used by the cache */
+	Size		mem_limit;		/* maximum bytes the cache may use */
+	dlist_head	lru_list;		/* entries, least recently used first */
+	struct MemoizeEntry *entry; /* entry being read or filled, or NULL */
+	struct MemoizeTuple *last_tuple;	/* last tuple returned from entry */
+	Bitmapset  *keyparamids;	/* params the keys depend on */
+	/* statistics for EXPLAIN ANALYZE */
+	long		cache_hits;		/* rescans answered from the cache */
+	long		cache_misses;	/* rescans that ran the subplan */
+	long		cache_evictions;	/* entries evicted to make room */
+	long		cache_overflows;	/* scans too big to cache */
+	Size		mem_peak;		/* peak value of mem_used */
+} MemoizeState;
+
 /* ----------------
  *	 SortState information
  * ----------------
@@ -1857,6 +1938,18 @@ typedef struct AggState
 	List	   *hash_needed;	/* list of columns needed in hash table */
 	bool		table_filled;	/* hash table filled yet? */
 	TupleHashIterator hashiter; /* for iterating through hash table */
+	Size		hash_mem_limit; /* spill new groups beyond this much memory */
+	struct HashAggSpill *hash_spill;	/* partitions being written, or NULL */
+	List	   *hash_batches;	/* spilled HashAggBatches still to process */
+	bool		hash_spilled;	/* spilled since the table was last filled? */
+	int			hash_used_bits; /* hash bits used up by earlier spills */
+	double		hash_batch_tuples;	/* input tuples of current batch, or -1 */
+	TupleTableSlot *hash_spill_slot;	/* slot for reading spilled tuples */
+	int			hash_batches_used;	/* # of batches processed */
+	Size		hash_mem_peak;	/* peak memory used by the hash table */
+	uint64		hash_disk_used; /* bytes of tuples written to disk */
+	/* input batch of outer SeqScan, if consuming batches (AGG_PLAIN only) */
+	struct TupleBatch *batch;
 } AggState;
 
 /* ----------------
@@ -1962,6 +2055,40 @@ typedef struct GatherState
 	bool		need_to_scan_locally;
 } GatherState;
 
+/* ----------------
+ * GatherMergeState information
+ *
+ *		Gather Merge nodes launch 1 or more parallel workers, run a
+ *		subplan which produces sorted output in each worker, and then
+ *		merge the results into a single sorted stream.
+ *
+ *		nkeys			number of sort key columns
+ *		sortkeys		sort keys in SortSupport representation
+ *		slots			current tuple of each participant; the leader's
+ *						is the first one
+ *		heap			heap of participants with a current tuple
+ *		tuple_buffers	tuples read ahead from each worker
+ *		gm_initialized	true if the heap has been filled
+ * ----------------
+ */
+typedef struct GatherMergeState
+{
+	PlanState	ps;				/* its first field is NodeTag */
+	bool		initialized;	/* workers launched? */
+	struct ParallelExecutorInfo *pei;
+	int			nreaders;		/* number of worker tuple queues */
+	int			nworkers_launched;
+	struct TupleQueueReader **reader;
+	TupleDesc	tupDesc;		/* descriptor of the subplan's tuples */
+	bool		need_to_scan_locally;
+	int			gm_nkeys;
+	SortSupport gm_sortkeys;	/* array of length gm_nkeys */
+	TupleTableSlot **gm_slots;	/* array of length num_workers + 1 */
+	struct binaryheap *gm_heap; /* binary heap of slot indices */
+	struct GMReaderTupleBuffer *gm_tuple_buffers;	/* num_workers of them */
+	bool		gm_initialized; /* is the heap set up? */
+} GatherMergeState;
+
 /* ----------------
  *	 HashState information
  * ----------------
@@ -1972,6 +2099,8 @@ typedef struct HashState
 	HashJoinTable hashtable;	/* hash table for the hashjoin */
 	List	   *hashkeys;		/* list of ExprState nodes */
 	/* hashkeys is same as parent's hj_InnerHashKeys */
+	/* shared state, if the parent is a parallel-aware hash join */
+	struct ParallelHashJoinState *parallel_state;
 } HashState;
 
 /* ----------------
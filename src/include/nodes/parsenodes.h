@@ -2102,6 +2102,7 @@ typedef struct CreateTrigStmt
 	int16		events;			/* "OR" of INSERT/UPDATE/DELETE/TRUNCATE */
 	List	   *columns;		/* column names, or NIL for all columns */
 	Node	   *whenClause;		/* qual expression, or NULL if none */
+	List	   *transitionRels; /* TriggerTransition nodes, or NIL if none */
 	bool		isconstraint;	/* This is a constraint trigger */
 	/* The remaining fields are only used for constraint triggers */
 	bool		deferrable;		/* [NOT] DEFERRABLE */
@@ -2109,6 +2110,17 @@ typedef struct CreateTrigStmt
 	RangeVar   *constrrel;		/* opposite relation, if RI trigger */
 } CreateTrigStmt;
 
+/*
+ * TriggerTransition -
+ *	   a transition table named in the REFERENCING clause of CREATE TRIGGER
+ */
+typedef struct TriggerTransition
+{
+	NodeTag		type;
+	char	   *name;			/* name the trigger refers to the table by */
+	bool		isNew;			/* NEW TABLE rather than OLD TABLE */
+} TriggerTransition;
+
 /* ----------------------
  *		Create EVENT TRIGGER Statement
  * ----------------------
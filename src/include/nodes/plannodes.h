@@ -73,6 +73,8 @@ typedef struct PlannedStmt
 	List	   *invalItems;		/* other dependencies, as PlanInvalItems */
 
 	int			nParamExec;		/* number of PARAM_EXEC Params used */
+
+	int			jitFlags;		/* which forms of JIT to use, see jit.h */
 } PlannedStmt;
 
 /* macro for fetching the Plan associated with a SubPlan node */
@@ -208,6 +210,12 @@ typedef struct Append
 {
 	Plan		plan;
 	List	   *appendplans;
+	/* run-time partition pruning of an inheritance tree, see nodeAppend.c */
+	Oid			part_relid;		/* parent of the tree, or InvalidOid */
+	AttrNumber	part_keyattno;	/* its partition key column */
+	List	   *part_childoids; /* OID of the table each subplan scans */
+	List	   *part_strategies;	/* btree strategies of the restrictions */
+	List	   *part_exprs;		/* values the partition key is compared to */
 } Append;
 
 /* ----------------
@@ -665,6 +673,25 @@ typedef struct Material
 	Plan		plan;
 } Material;
 
+/* ----------------
+ *		memoize node
+ *
+ * Caches the output of the scans of its subplan, keyed by the values of
+ * param_exprs, so that a rescan with key values seen before can be answered
+ * without running the subplan.  The param_exprs are in terms of the
+ * nestloop params the subplan depends on.
+ * ----------------
+ */
+typedef struct Memoize
+{
+	Plan		plan;
+	int			numKeys;		/* number of cache keys */
+	Oid		   *hashOperators;	/* hash equality operators for the keys */
+	List	   *param_exprs;	/* expressions computing the keys */
+	uint32		est_entries;	/* planner's estimate of the number of
+								 * entries the cache will hold */
+} Memoize;
+
 /* ----------------
  *		sort node
  * ----------------
@@ -765,6 +792,25 @@ typedef struct Gather
 	bool		invisible;		/* suppress EXPLAIN display (for testing)? */
 } Gather;
 
+/* ------------
+ *		gather merge node
+ *
+ * Like Gather, but each participant's output is sorted, and the node merges
+ * the streams so that its own output is sorted too.
+ * ------------
+ */
+typedef struct GatherMerge
+{
+	Plan		plan;
+	int			num_workers;
+	/* remaining fields are just like the sort-key info in struct Sort */
+	int			numCols;		/* number of sort-key columns */
+	AttrNumber *sortColIdx;		/* their indexes in the target list */
+	Oid		   *sortOperators;	/* OIDs of operators to sort them by */
+	Oid		   *collations;		/* OIDs of collations */
+	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
+} GatherMerge;
+
 /* ----------------
  *		hash build node
  *
@@ -782,6 +828,8 @@ typedef struct Hash
 	bool		skewInherit;	/* is outer join rel an inheritance tree? */
 	Oid			skewColType;	/* datatype of the outer key column */
 	int32		skewColTypmod;	/* typmod of the outer key column */
+	double		rows_total;		/* estimated inner rows of all participants,
+								 * if the join is parallel-aware */
 	/* all other info is in the parent HashJoin node */
 } Hash;
 
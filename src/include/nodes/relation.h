@@ -620,6 +620,7 @@ typedef struct IndexOptInfo
 	bool		amsearchnulls;	/* can AM search for NULL/NOT NULL entries? */
 	bool		amhasgettuple;	/* does AM have amgettuple interface? */
 	bool		amhasgetbitmap; /* does AM have amgetbitmap interface? */
+	bool		amcanparallel;	/* does AM support parallel scan? */
 	/* Rather than include amapi.h here, we declare amcostestimate like this */
 	void		(*amcostestimate) ();	/* AM's cost estimator */
 } IndexOptInfo;
@@ -1151,6 +1152,23 @@ typedef struct MaterialPath
 	Path	   *subpath;
 } MaterialPath;
 
+/*
+ * MemoizePath represents use of a Memoize plan node, which caches the
+ * results of the scans of a parameterized subpath by parameter values.
+ * param_exprs are the outer-relation expressions the subpath is
+ * parameterized by, and calls is the number of times it's expected to be
+ * rescanned.
+ */
+typedef struct MemoizePath
+{
+	Path		path;
+	Path	   *subpath;
+	List	   *hash_operators; /* hash equality operators for param_exprs */
+	List	   *param_exprs;	/* cache keys */
+	double		calls;			/* expected number of rescans */
+	uint32		est_entries;	/* estimated number of cache entries */
+} MemoizePath;
+
 /*
  * UniquePath represents elimination of distinct rows from the output of
  * its subpath.
@@ -1192,6 +1210,19 @@ typedef struct GatherPath
 	int			num_workers;	/* number of workers sought to help */
 } GatherPath;
 
+/*
+ * GatherMergePath runs several copies of a plan in parallel and collects
+ * the results, merging them on the path's pathkeys.  If the subpath isn't
+ * sorted that way, the plan sorts its output in each participant; the
+ * leader also executes it.
+ */
+typedef struct GatherMergePath
+{
+	Path		path;
+	Path	   *subpath;		/* path for each worker */
+	int			num_workers;	/* number of workers sought to help */
+} GatherMergePath;
+
 /*
  * All join-type paths share these fields.
  */
@@ -1271,6 +1302,7 @@ typedef struct HashPath
 	JoinPath	jpath;
 	List	   *path_hashclauses;		/* join clauses used for hashing */
 	int			num_batches;	/* number of batches expected */
+	double		inner_rows_total;		/* total inner rows expected */
 } HashPath;
 
 /*
@@ -2052,6 +2084,7 @@ typedef struct JoinCostWorkspace
 	/* private for cost_hashjoin code */
 	int			numbuckets;
 	int			numbatches;
+	double		inner_rows_total;
 } JoinCostWorkspace;
 
 #endif   /* RELATION_H */
@@ -38,6 +38,13 @@ extern int32 get_relation_data_width(Oid relid, int32 *attr_widths);
 extern bool relation_excluded_by_constraints(PlannerInfo *root,
 								 RelOptInfo *rel, RangeTblEntry *rte);
 
+extern Relids prune_append_rel_partitions(PlannerInfo *root,
+							RelOptInfo *rel, RangeTblEntry *rte);
+
+extern Oid get_runtime_partition_quals(PlannerInfo *root, RelOptInfo *rel,
+							AttrNumber *keyattno,
+							List **strategies, List **exprs);
+
 extern List *build_physical_tlist(PlannerInfo *root, RelOptInfo *rel);
 
 extern bool has_unique_index(RelOptInfo *rel, AttrNumber attno);
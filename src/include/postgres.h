@@ -146,11 +146,21 @@ typedef union
 	struct						/* Compressed-in-line format */
 	{
 		uint32		va_header;
-		uint32		va_rawsize; /* Original data size (excludes header) */
+		uint32		va_rawsize; /* Original data size (excludes header) and
+								 * compression method, see below */
 		char		va_data[FLEXIBLE_ARRAY_MEMBER];		/* Compressed data */
 	}			va_compressed;
 } varattrib_4b;
 
+/*
+ * A datum can't be larger than 1GB, so the top two bits of va_rawsize of a
+ * compressed-in-line datum are free.  They hold the compression method
+ * (see TOAST_*_COMPRESSION in access/tuptoaster.h); zero, which is what
+ * older versions stored, means pglz.
+ */
+#define VARLENA_RAWSIZE_BITS	30
+#define VARLENA_RAWSIZE_MASK	((1U << VARLENA_RAWSIZE_BITS) - 1)
+
 typedef struct
 {
 	uint8		va_header;
@@ -282,7 +292,9 @@ typedef struct
 #define VARDATA_1B_E(PTR)	(((varattrib_1b_e *) (PTR))->va_data)
 
 #define VARRAWSIZE_4B_C(PTR) \
-	(((varattrib_4b *) (PTR))->va_compressed.va_rawsize)
+	(((varattrib_4b *) (PTR))->va_compressed.va_rawsize & VARLENA_RAWSIZE_MASK)
+#define VARCOMPRESS_4B_C(PTR) \
+	(((varattrib_4b *) (PTR))->va_compressed.va_rawsize >> VARLENA_RAWSIZE_BITS)
 
 /* Externally visible macros */
 
@@ -14,6 +14,33 @@
 #ifndef AUTOVACUUM_H
 #define AUTOVACUUM_H
 
+#include "storage/block.h"
+
+/*
+ * Other processes can request specific work from autovacuum, identified by
+ * AutoVacuumWorkItem elements.
+ */
+typedef enum
+{
+	AVW_BRINSummarizeRange,
+	AVW_GINCleanPendingList
+} AutoVacuumWorkItemType;
+
+/*
+ * Tables waiting to be processed by autovacuum workers are kept in a shared
+ * queue, ranked by priority; see do_autovacuum.
+ */
+#define AUTOVACUUM_QUEUE_SIZE	1024
+
+typedef struct AutoVacuumQueueEntry
+{
+	Oid			datid;
+	Oid			relid;
+	double		priority;		/* higher is more urgent */
+	bool		wraparound;		/* vacuum to prevent wraparound */
+	int			pid;			/* worker processing it, or 0 if waiting */
+} AutoVacuumQueueEntry;
+
 
 /* GUC variables */
 extern bool autovacuum_start_daemon;
@@ -50,6 +77,11 @@ extern int	StartAutoVacWorker(void);
 /* called from postmaster when a worker could not be forked */
 extern void AutoVacWorkerFailed(void);
 
+extern bool AutoVacuumRequestWork(AutoVacuumWorkItemType type,
+					  Oid relationId, BlockNumber blkno);
+
+extern int	AutoVacuumGetQueue(AutoVacuumQueueEntry *entries);
+
 /* autovacuum cost-delay balancer */
 extern void AutoVacuumUpdateDelay(void);
 
@@ -48,6 +48,7 @@ extern const char *progname;
 
 extern void PostmasterMain(int argc, char *argv[]) pg_attribute_noreturn();
 extern void ClosePostmasterPorts(bool am_syslogger);
+extern void BackendReinitialize(pgsocket sock);
 
 extern int	MaxLivePostmasterChildren(void);
 
@@ -0,0 +1,67 @@
+/*-------------------------------------------------------------------------
+ *
+ * sessionpool.h
+ *	  Exports from postmaster/sessionpool.c.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ * src/include/postmaster/sessionpool.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef _SESSIONPOOL_H
+#define _SESSIONPOOL_H
+
+#include "libpq/pqcomm.h"
+
+/*
+ * What a pooled backend can serve: clients connecting to the same database
+ * as the same user with the same startup options.
+ */
+typedef struct SessionPoolKey
+{
+	char		database[NAMEDATALEN];
+	char		user[NAMEDATALEN];
+	uint32		options_hash;	/* hash of all other startup options */
+} SessionPoolKey;
+
+/* Result of SessionPoolPeekStartup */
+typedef enum
+{
+	SESSION_POOL_INCOMPLETE,	/* startup packet not received yet */
+	SESSION_POOL_POOLABLE,		/* can be served by a pooled backend */
+	SESSION_POOL_NOT_POOLABLE	/* needs a new backend */
+} SessionPoolPeekResult;
+
+/* GUC */
+extern int	SessionPoolSize;
+
+/* Backend's end of the channel to the postmaster, if it can be pooled */
+extern pgsocket MyPoolSocket;
+
+extern Size SessionPoolShmemSize(void);
+extern void SessionPoolShmemInit(void);
+
+/* postmaster side */
+extern bool SessionPoolCreateChannel(pgsocket *postmaster_end,
+						 pgsocket *backend_end);
+extern SessionPoolPeekResult SessionPoolPeekStartup(pgsocket sock,
+					   SessionPoolKey *key);
+extern void SessionPoolResetSlot(int child_slot);
+extern bool SessionPoolIsIdle(int child_slot);
+extern bool SessionPoolClaim(int child_slot, const SessionPoolKey *key);
+extern bool SessionPoolSendClient(pgsocket channel, pgsocket client,
+					  long cancel_key);
+extern void SessionPoolCountMiss(void);
+extern void SessionPoolCountEviction(void);
+
+/* backend side */
+extern void SessionPoolRememberStartup(const char *packet, int len);
+extern bool SessionPoolSameKey(const SessionPoolKey *key);
+extern void SessionPoolGetMyKey(SessionPoolKey *key);
+extern bool SessionPoolWaitForClient(pgsocket *client, long *cancel_key);
+
+extern void SessionPoolGetStats(int *idle, int64 *hits, int64 *misses,
+					int64 *returns, int64 *evictions);
+
+#endif   /* _SESSIONPOOL_H */
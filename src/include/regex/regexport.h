@@ -54,4 +54,7 @@ extern int	pg_reg_getnumcharacters(const regex_t *regex, int co);
 extern void pg_reg_getcharacters(const regex_t *regex, int co,
 					 pg_wchar *chars, int chars_len);
 
+/* Function for estimating memory use */
+extern size_t pg_reg_getmemsize(const regex_t *regex);
+
 #endif   /* _REGEXPORT_H_ */
@@ -20,6 +20,16 @@
 #define MAX_RATE_LOWER	32
 #define MAX_RATE_UPPER	1048576
 
+/*
+ * Compression methods for the tar streams, COMPRESSION option of the
+ * BASE_BACKUP command.
+ */
+typedef enum BackupCompression
+{
+	BACKUP_COMPRESSION_NONE,
+	BACKUP_COMPRESSION_LZ4
+} BackupCompression;
+
 
 typedef struct
 {
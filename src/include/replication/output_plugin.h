@@ -26,6 +26,12 @@ typedef enum OutputPluginOutputType
 typedef struct OutputPluginOptions
 {
 	OutputPluginOutputType output_type;
+
+	/*
+	 * Number of changes after which in-progress transaction is streamed to the
+	 * plugin (see stream_start_cb). Zero disables streaming.
+	 */
+	int			stream_threshold;
 } OutputPluginOptions;
 
 /*
@@ -94,6 +100,32 @@ typedef void (*LogicalDecodeShutdownCB) (struct LogicalDecodingContext *ctx);
  */
 typedef void (*LogicalDecodeCaughtUpCB) (struct LogicalDecodingContext * ctx);
 
+/*
+ * Called before changes of a large in-progress transaction are passed to
+ * change_cb ahead of its commit. "first" is true for the first block of the
+ * transaction; the plugin may return false in this case to have the
+ * transaction decoded at commit time as usual. Once a transaction has been
+ * streamed, its remaining changes are also preceded by stream_start_cb
+ * (instead of begin_cb) and followed by commit_cb or stream_abort_cb.
+ */
+typedef bool (*LogicalDecodeStreamStartCB) (struct LogicalDecodingContext *ctx,
+														ReorderBufferTXN *txn,
+														bool first);
+
+/*
+ * Called after a block of changes of an in-progress transaction was streamed.
+ */
+typedef void (*LogicalDecodeStreamStopCB) (struct LogicalDecodingContext *ctx,
+													   ReorderBufferTXN *txn);
+
+/*
+ * Called when a streamed transaction was aborted (explicitly or because of
+ * server crash), so the receiver should discard the changes it already got.
+ */
+typedef void (*LogicalDecodeStreamAbortCB) (struct LogicalDecodingContext *ctx,
+														ReorderBufferTXN *txn,
+														XLogRecPtr abort_lsn);
+
 /*
  * Output plugin callbacks
  */
@@ -107,6 +139,9 @@ typedef struct OutputPluginCallbacks
 	LogicalDecodeFilterByOriginCB filter_by_origin_cb;
 	LogicalDecodeShutdownCB shutdown_cb;
 	LogicalDecodeCaughtUpCB caughtup_cb;
+	LogicalDecodeStreamStartCB stream_start_cb;
+	LogicalDecodeStreamStopCB stream_stop_cb;
+	LogicalDecodeStreamAbortCB stream_abort_cb;
 } OutputPluginCallbacks;
 
 /* Functions in replication/logical/logical.c */
@@ -21,13 +21,10 @@
 /* an individual tuple, stored in one chunk of memory */
 typedef struct ReorderBufferTupleBuf
 {
-	/* position in preallocated list */
-	slist_node	node;
-
 	/* tuple header, the interesting bit for users of logical decoding */
 	HeapTupleData tuple;
 
-	/* pre-allocated size of tuple buffer, different from tuple size */
+	/* allocated size of tuple buffer, different from tuple size */
 	Size		alloc_tuple_size;
 
 	/* actual tuple data follows */
@@ -79,6 +76,13 @@ typedef struct ReorderBufferChange
 
 	RepOriginId origin_id;
 
+	/*
+	 * Transaction this change is queued in, and the memory charged to it for
+	 * the change. NULL and 0 while the change isn't accounted.
+	 */
+	struct ReorderBufferTXN *txn;
+	Size		size;
+
 	/*
 	 * Context data for the change. Which part of the union is valid depends
 	 * on action.
@@ -222,6 +226,21 @@ typedef struct ReorderBufferTXN
 	 */
 	uint64		nentries_mem;
 
+	/*
+	 * Memory used by the in-memory changes of this txn. Like nentries, this
+	 * doesn't include subtransactions.
+	 */
+	Size		size;
+
+	/*
+	 * Have some changes of this transaction already been streamed to the
+	 * output plugin before its commit? Streaming is never tried again once
+	 * stream_disabled is set (transaction touched catalog, has subtransactions
+	 * or was rejected by the plugin).
+	 */
+	bool		streamed;
+	bool		stream_disabled;
+
 	/*
 	 * Has this transaction been spilled to disk?  It's not always possible to
 	 * deduce that fact by comparing nentries with nentries_mem, because
@@ -302,6 +321,23 @@ typedef void (*ReorderBufferCommitCB) (
 												   ReorderBufferTXN *txn,
 												   XLogRecPtr commit_lsn);
 
+/* stream start callback signature */
+typedef bool (*ReorderBufferStreamStartCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn,
+														bool first);
+
+/* stream stop callback signature */
+typedef void (*ReorderBufferStreamStopCB) (
+													   ReorderBuffer *rb,
+													   ReorderBufferTXN *txn);
+
+/* stream abort callback signature */
+typedef void (*ReorderBufferStreamAbortCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn,
+														XLogRecPtr abort_lsn);
+
 /* message callback signature */
 typedef void (*ReorderBufferMessageCB) (
 													ReorderBuffer *rb,
@@ -344,6 +380,15 @@ struct ReorderBuffer
 	ReorderBufferCommitCB commit;
 	ReorderBufferMessageCB message;
 
+	/*
+	 * Callbacks used to stream large in-progress transactions. Streaming is
+	 * enabled when stream_threshold (number of changes) is non-zero.
+	 */
+	ReorderBufferStreamStartCB stream_start;
+	ReorderBufferStreamStopCB stream_stop;
+	ReorderBufferStreamAbortCB stream_abort;
+	uint64		stream_threshold;
+
 	/*
 	 * Pointer that will be passed untouched to the callbacks.
 	 */
@@ -355,34 +400,33 @@ struct ReorderBuffer
 	MemoryContext context;
 
 	/*
-	 * Data structure slab cache.
-	 *
-	 * We allocate/deallocate some structures very frequently, to avoid bigger
-	 * overhead we cache some unused ones here.
-	 *
-	 * The maximum number of cached entries is controlled by const variables
-	 * on top of reorderbuffer.c
+	 * Memory contexts for specific types objects
 	 */
-
-	/* cached ReorderBufferTXNs */
-	dlist_head	cached_transactions;
-	Size		nr_cached_transactions;
-
-	/* cached ReorderBufferChanges */
-	dlist_head	cached_changes;
-	Size		nr_cached_changes;
-
-	/* cached ReorderBufferTupleBufs */
-	slist_head	cached_tuplebufs;
-	Size		nr_cached_tuplebufs;
+	MemoryContext change_context;
+	MemoryContext txn_context;
+	MemoryContext tup_context;
 
 	XLogRecPtr	current_restart_decoding_lsn;
 
 	/* buffer for disk<->memory conversions */
 	char	   *outbuf;
 	Size		outbufsize;
+
+	/* memory used by the in-memory changes of all transactions */
+	Size		size;
+
+	/*
+	 * Statistics about transactions spilled to disk: number of transactions
+	 * spilled, number of times any transaction was spilled (a transaction
+	 * may be spilled repeatedly) and total number of bytes written.
+	 */
+	int64		spillTxns;
+	int64		spillCount;
+	int64		spillBytes;
 };
 
+/* GUC variables */
+extern PGDLLIMPORT int logical_decoding_work_mem;
 
 ReorderBuffer *ReorderBufferAllocate(void);
 void		ReorderBufferFree(ReorderBuffer *);
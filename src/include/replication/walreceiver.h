@@ -23,6 +23,7 @@
 extern int	wal_receiver_status_interval;
 extern int	wal_receiver_timeout;
 extern bool hot_standby_feedback;
+extern int	wal_receiver_buffer_size;
 
 /*
  * MAXCONNINFO: maximum size of a connection string.
@@ -87,6 +88,13 @@ typedef struct
 	 */
 	XLogRecPtr	latestChunkStart;
 
+	/*
+	 * writtenUpto-1 is the last byte position that has been written out by
+	 * walreceiver, but not necessarily flushed.  The gap between it and
+	 * receivedUpto shows how far flushing lags behind writing.
+	 */
+	XLogRecPtr	writtenUpto;
+
 	/*
 	 * Time of send and receive of any message received.
 	 */
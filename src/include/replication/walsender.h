@@ -25,6 +25,8 @@ extern bool wake_wal_senders;
 /* user-settable parameters */
 extern int	max_wal_senders;
 extern int	wal_sender_timeout;
+extern int	wal_sender_batch_size;
+extern int	wal_sender_batch_delay;
 extern bool log_replication_commands;
 
 extern void InitWalSender(void);
@@ -48,6 +48,24 @@ typedef struct WalSnd
 	XLogRecPtr	flush;
 	XLogRecPtr	apply;
 
+	/* Statistics about transactions spilled to disk by logical decoding. */
+	int64		spillTxns;
+	int64		spillCount;
+	int64		spillBytes;
+
+	/* Statistics about the output sent to the client. */
+	int64		sentMessages;
+	int64		sentBytes;
+	int64		sentFlushes;
+
+	/*
+	 * Time in microseconds between sending WAL and the standby reporting it
+	 * as written, flushed and applied, or -1 if not known (yet).
+	 */
+	int64		writeLag;
+	int64		flushLag;
+	int64		applyLag;
+
 	/* Protects shared variables shown above. */
 	slock_t		mutex;
 
@@ -24,6 +24,9 @@
 
 typedef void *Block;
 
+/* in smgr.h */
+struct SMgrRelationData;
+
 /* Possible arguments for GetAccessStrategy() */
 typedef enum BufferAccessStrategyType
 {
@@ -47,6 +50,33 @@ typedef enum
 								 * replay; otherwise same as RBM_NORMAL */
 } ReadBufferMode;
 
+/*
+ * Read-ahead state of a scan reading a range of blocks in order, see
+ * ReadStreamPrefetch().
+ */
+typedef struct ReadStream
+{
+	BlockNumber start;			/* first block of the scan */
+	BlockNumber length;			/* number of blocks in the scan, 0 if
+								 * read-ahead is off */
+	BlockNumber nblocks;		/* relation size, the scan wraps around here */
+	int			distance;		/* how many blocks to read ahead */
+	int			chunk;			/* blocks to initiate reads for at once */
+} ReadStream;
+
+/* max number of blocks ReadStreamPrefetch initiates reads for at once */
+#define READ_STREAM_CHUNK_BLOCKS	16
+
+/* upper limit for seqscan_prefetch_distance, 1GB */
+#define MAX_SEQSCAN_PREFETCH_DISTANCE	((1024 * 1024 * 1024) / BLCKSZ)
+
+/* Possible values for buffer_replacement_policy */
+typedef enum
+{
+	BUFFER_REPLACEMENT_CLOCK,	/* single clock hand over all buffers */
+	BUFFER_REPLACEMENT_PARTITIONED_CLOCK	/* one hand per buffer partition */
+} BufferReplacementPolicy;
+
 /* forward declared, to avoid having to expose buf_internals.h here */
 struct WritebackContext;
 
@@ -59,13 +89,18 @@ extern int	bgwriter_lru_maxpages;
 extern double bgwriter_lru_multiplier;
 extern bool track_io_timing;
 extern int	target_prefetch_pages;
+extern int	seqscan_prefetch_distance;
 
 extern int	checkpoint_flush_after;
 extern int	backend_flush_after;
 extern int	bgwriter_flush_after;
 
+/* in freelist.c */
+extern int	buffer_replacement_policy;
+
 /* in buf_init.c */
 extern PGDLLIMPORT char *BufferBlocks;
+extern bool numa_interleave_buffers;
 
 /* in guc.c */
 extern int	effective_io_concurrency;
@@ -163,8 +198,16 @@ extern PGDLLIMPORT int32 *LocalRefCount;
  * prototypes for functions in bufmgr.c
  */
 extern bool ComputeIoConcurrency(int io_concurrency, double *target);
+extern void PrefetchSharedBuffer(struct SMgrRelationData *smgr_reln,
+					 ForkNumber forkNum, BlockNumber blockNum);
 extern void PrefetchBuffer(Relation reln, ForkNumber forkNum,
 			   BlockNumber blockNum);
+extern void PrefetchBufferRange(Relation reln, ForkNumber forkNum,
+					BlockNumber blockNum, BlockNumber nblocks);
+extern void ReadStreamBegin(ReadStream *stream, BlockNumber start,
+				BlockNumber length, BlockNumber nblocks);
+extern void ReadStreamPrefetch(ReadStream *stream, Relation reln,
+				   BlockNumber blockNum);
 extern Buffer ReadBuffer(Relation reln, BlockNumber blockNum);
 extern Buffer ReadBufferExtended(Relation reln, ForkNumber forkNum,
 				   BlockNumber blockNum, ReadBufferMode mode,
@@ -228,6 +271,7 @@ extern void AtProcExit_LocalBuffers(void);
 extern void TestForOldSnapshot_impl(Snapshot snapshot, Relation relation);
 
 /* in freelist.c */
+extern bool have_free_buffer(void);
 extern BufferAccessStrategy GetAccessStrategy(BufferAccessStrategyType btype);
 extern void FreeAccessStrategy(BufferAccessStrategy strategy);
 
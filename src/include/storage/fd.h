@@ -67,6 +67,9 @@ extern int	max_safe_fds;
 /* Operations on virtual Files --- equivalent to Unix kernel file ops */
 extern File PathNameOpenFile(FileName fileName, int fileFlags, int fileMode);
 extern File OpenTemporaryFile(bool interXact);
+extern File OpenSharedTemporaryFile(Oid tblspcOid, const char *name,
+						bool create);
+extern bool DeleteSharedTemporaryFile(Oid tblspcOid, const char *name);
 extern void FileClose(File file);
 extern int	FilePrefetch(File file, off_t offset, int amount);
 extern int	FileRead(File file, char *buffer, int amount);
@@ -74,6 +77,7 @@ extern int	FileWrite(File file, char *buffer, int amount);
 extern int	FileSync(File file);
 extern off_t FileSeek(File file, off_t offset, int whence);
 extern int	FileTruncate(File file, off_t offset);
+extern int	FileFallocate(File file, off_t offset, off_t amount);
 extern void FileWriteback(File file, off_t offset, off_t nbytes);
 extern char *FilePathName(File file);
 extern int	FileGetRawDesc(File file);
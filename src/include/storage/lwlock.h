@@ -145,14 +145,40 @@ extern PGDLLIMPORT int NamedLWLockTrancheRequests;
 #define LOG2_NUM_PREDICATELOCK_PARTITIONS  4
 #define NUM_PREDICATELOCK_PARTITIONS  (1 << LOG2_NUM_PREDICATELOCK_PARTITIONS)
 
+/* Number of partitions of the prepared transactions table */
+#define LOG2_NUM_TWOPHASE_PARTITIONS  4
+#define NUM_TWOPHASE_PARTITIONS  (1 << LOG2_NUM_TWOPHASE_PARTITIONS)
+
 /* Offsets for various chunks of preallocated lwlocks. */
 #define BUFFER_MAPPING_LWLOCK_OFFSET	NUM_INDIVIDUAL_LWLOCKS
 #define LOCK_MANAGER_LWLOCK_OFFSET		\
 	(BUFFER_MAPPING_LWLOCK_OFFSET + NUM_BUFFER_PARTITIONS)
 #define PREDICATELOCK_MANAGER_LWLOCK_OFFSET \
 	(LOCK_MANAGER_LWLOCK_OFFSET + NUM_LOCK_PARTITIONS)
-#define NUM_FIXED_LWLOCKS \
+#define TWOPHASE_STATE_LWLOCK_OFFSET \
 	(PREDICATELOCK_MANAGER_LWLOCK_OFFSET + NUM_PREDICATELOCK_PARTITIONS)
+#define NUM_FIXED_LWLOCKS \
+	(TWOPHASE_STATE_LWLOCK_OFFSET + NUM_TWOPHASE_PARTITIONS)
+
+/*
+ * Cumulative wait statistics, kept in shared memory for every individual
+ * lock of the main array and for every tranche ID below
+ * LWLOCK_STATS_TRANCHES.  Wait times are in microseconds; bucket i of the
+ * histogram counts waits shorter than 10^(i+1) microseconds, and the last
+ * bucket everything longer.
+ */
+#define LWLOCK_STATS_TRANCHES	64
+#define LWLOCK_STATS_SLOTS		(NUM_INDIVIDUAL_LWLOCKS + LWLOCK_STATS_TRANCHES)
+#define LWLOCK_WAIT_BUCKETS		7
+
+typedef struct LWLockWaitStats
+{
+	uint64		acquire_count;	/* acquisition attempts */
+	uint64		block_count;	/* times we had to sleep */
+	uint64		wait_time;		/* total time slept */
+	uint64		max_wait_time;	/* longest single sleep */
+	uint64		wait_histogram[LWLOCK_WAIT_BUCKETS];
+} LWLockWaitStats;
 
 typedef enum LWLockMode
 {
@@ -181,10 +207,14 @@ extern void LWLockUpdateVar(LWLock *lock, uint64 *valptr, uint64 value);
 
 extern Size LWLockShmemSize(void);
 extern void CreateLWLocks(void);
+extern void LWLockWaitStatsShmemInit(void);
 extern void InitLWLockAccess(void);
 
 extern const char *GetLWLockIdentifier(uint8 classId, uint16 eventId);
 
+extern LWLockWaitStats *LWLockGetWaitStats(void);
+extern const char *LWLockWaitStatsName(int slot);
+
 /*
  * Extensions (or core code) can obtain an LWLocks by calling
  * RequestNamedLWLockTranche() during postmaster startup.  Subsequently,
@@ -234,6 +264,8 @@ typedef enum BuiltinTrancheIds
 	LWTRANCHE_BUFFER_MAPPING,
 	LWTRANCHE_LOCK_MANAGER,
 	LWTRANCHE_PREDICATE_LOCK_MANAGER,
+	LWTRANCHE_TWOPHASE_STATE,
+	LWTRANCHE_TABLE_STATS,
 	LWTRANCHE_FIRST_USER_DEFINED
 }	BuiltinTrancheIds;
 
@@ -68,5 +68,7 @@ extern PGShmemHeader *PGSharedMemoryCreate(Size size, bool makePrivate,
 					 int port, PGShmemHeader **shim);
 extern bool PGSharedMemoryIsInUse(unsigned long id1, unsigned long id2);
 extern void PGSharedMemoryDetach(void);
+extern void PGSharedMemoryInterleave(void *address, Size size);
+extern void PGSharedMemoryReportHugePages(void);
 
 #endif   /* PG_SHMEM_H */
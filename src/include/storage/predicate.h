@@ -22,12 +22,35 @@
  * GUC variables
  */
 extern int	max_predicate_locks_per_xact;
+extern int	max_predicate_locks_per_relation;
+extern int	max_predicate_locks_per_page;
 
 
 /* Number of SLRU buffers to use for predicate locking */
 #define NUM_OLDSERXID_BUFFERS	16
 
 
+/*
+ * Causes of serialization failures, counted in shared memory
+ */
+typedef enum SSIFailureCause
+{
+	SSI_FAILURE_DOOMED,			/* canceled by another transaction */
+	SSI_FAILURE_PIVOT_WRITE,	/* became a pivot by writing */
+	SSI_FAILURE_PIVOT_READ,		/* read data written by a prepared pivot */
+	SSI_FAILURE_SUMMARIZED,		/* conflict with a summarized transaction */
+	SSI_FAILURE_PREPARED_PIVOT, /* conflict in from a prepared pivot */
+	NUM_SSI_FAILURE_CAUSES
+} SSIFailureCause;
+
+typedef struct PredicateLockStats
+{
+	uint64		page_promotions;	/* tuple locks promoted to a page lock */
+	uint64		relation_promotions;	/* promoted to a relation lock */
+	uint64		failures[NUM_SSI_FAILURE_CAUSES];
+} PredicateLockStats;
+
+
 /*
  * function prototypes
  */
@@ -35,6 +58,7 @@ extern int	max_predicate_locks_per_xact;
 /* housekeeping for shared memory predicate lock structures */
 extern void InitPredicateLocks(void);
 extern Size PredicateLockShmemSize(void);
+extern void GetPredicateLockStats(PredicateLockStats *stats);
 
 extern void CheckPointPredicate(void);
 
@@ -55,8 +55,17 @@ struct XidCache
  * RowShareLock, RowExclusiveLock) to be recorded in the PGPROC structure
  * rather than the main lock table.  This eases contention on the lock
  * manager LWLocks.  See storage/lmgr/README for additional details.
+ *
+ * The slots come in groups of FP_LOCK_SLOTS_PER_GROUP, the lock mode bits of
+ * each group fitting in one uint64.  max_fastpath_locks determines how many
+ * groups every backend has.
  */
-#define		FP_LOCK_SLOTS_PER_BACKEND 16
+#define		FP_LOCK_SLOTS_PER_GROUP 16
+#define		FP_LOCK_GROUPS_PER_BACKEND_MAX 64
+#define		FastPathLockGroupsPerBackend \
+	((max_fastpath_locks + FP_LOCK_SLOTS_PER_GROUP - 1) / FP_LOCK_SLOTS_PER_GROUP)
+#define		FP_LOCK_SLOTS_PER_BACKEND \
+	(FP_LOCK_SLOTS_PER_GROUP * FastPathLockGroupsPerBackend)
 
 /*
  * An invalid pgprocno.  Must be larger than the maximum number of PGPROC
@@ -161,8 +170,8 @@ struct PGPROC
 	LWLock		backendLock;
 
 	/* Lock manager data, recording fast-path locks taken by this backend. */
-	uint64		fpLockBits;		/* lock modes held for each fast-path slot */
-	Oid			fpRelId[FP_LOCK_SLOTS_PER_BACKEND];		/* slots for rel oids */
+	uint64	   *fpLockBits;		/* lock modes held, one word per slot group */
+	Oid		   *fpRelId;		/* rel oids, FP_LOCK_SLOTS_PER_BACKEND slots */
 	bool		fpVXIDLock;		/* are we holding a fast-path VXID lock? */
 	LocalTransactionId fpLocalTransactionId;	/* lxid for fast-path VXID
 												 * lock */
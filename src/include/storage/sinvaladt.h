@@ -25,6 +25,11 @@
 #include "storage/lock.h"
 #include "storage/sinval.h"
 
+/* upper limit of shared_invalidation_queue_size, a power of 2 */
+#define MAX_SINVAL_QUEUE_SIZE	(1024 * 1024)
+
+extern int	shared_invalidation_queue_size;
+
 /*
  * prototypes for functions in sinvaladt.c
  */
@@ -76,6 +76,21 @@ typedef SMgrRelationData *SMgrRelation;
 #define SmgrIsTemp(smgr) \
 	RelFileNodeBackendIsTemp((smgr)->smgr_rnode)
 
+/* maximum number of tablespaces with write accounting, see md.c */
+#define MAX_TABLESPACE_IO_SLOTS		64
+
+/* Per-tablespace write counters, as returned by TablespaceIOGetStats */
+typedef struct TablespaceIOStats
+{
+	Oid			spcNode;
+	int			max_write_rate; /* kilobytes per second, 0 = unlimited */
+	int			max_write_iops; /* writes per second, 0 = unlimited */
+	uint64		writes;			/* blocks written */
+	uint64		delayed_writes; /* writes delayed by throttling */
+	uint64		delay_time;		/* total delay, in microseconds */
+	double		write_iops;		/* recent writes per second */
+} TablespaceIOStats;
+
 extern void smgrinit(void);
 extern SMgrRelation smgropen(RelFileNode rnode, BackendId backend);
 extern bool smgrexists(SMgrRelation reln, ForkNumber forknum);
@@ -90,8 +105,10 @@ extern void smgrdounlinkall(SMgrRelation *rels, int nrels, bool isRedo);
 extern void smgrdounlinkfork(SMgrRelation reln, ForkNumber forknum, bool isRedo);
 extern void smgrextend(SMgrRelation reln, ForkNumber forknum,
 		   BlockNumber blocknum, char *buffer, bool skipFsync);
+extern void smgrzeroextend(SMgrRelation reln, ForkNumber forknum,
+			   BlockNumber blocknum, int nblocks, bool skipFsync);
 extern void smgrprefetch(SMgrRelation reln, ForkNumber forknum,
-			 BlockNumber blocknum);
+			 BlockNumber blocknum, BlockNumber nblocks);
 extern void smgrread(SMgrRelation reln, ForkNumber forknum,
 		 BlockNumber blocknum, char *buffer);
 extern void smgrwrite(SMgrRelation reln, ForkNumber forknum,
@@ -111,6 +128,8 @@ extern void AtEOXact_SMgr(void);
 /* internals: move me elsewhere -- ay 7/94 */
 
 /* in md.c */
+extern bool tablespace_io_throttle;
+
 extern void mdinit(void);
 extern void mdclose(SMgrRelation reln, ForkNumber forknum);
 extern void mdcreate(SMgrRelation reln, ForkNumber forknum, bool isRedo);
@@ -118,8 +137,10 @@ extern bool mdexists(SMgrRelation reln, ForkNumber forknum);
 extern void mdunlink(RelFileNodeBackend rnode, ForkNumber forknum, bool isRedo);
 extern void mdextend(SMgrRelation reln, ForkNumber forknum,
 		 BlockNumber blocknum, char *buffer, bool skipFsync);
+extern void mdzeroextend(SMgrRelation reln, ForkNumber forknum,
+			 BlockNumber blocknum, int nblocks, bool skipFsync);
 extern void mdprefetch(SMgrRelation reln, ForkNumber forknum,
-		   BlockNumber blocknum);
+		   BlockNumber blocknum, BlockNumber nblocks);
 extern void mdread(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 	   char *buffer);
 extern void mdwrite(SMgrRelation reln, ForkNumber forknum,
@@ -134,6 +155,13 @@ extern void mdpreckpt(void);
 extern void mdsync(void);
 extern void mdpostckpt(void);
 
+extern Size TablespaceIOShmemSize(void);
+extern void TablespaceIOShmemInit(void);
+extern void TablespaceIOSetLimits(Oid spcNode, int max_write_rate,
+					  int max_write_iops);
+extern void TablespaceIOForget(Oid spcNode);
+extern int	TablespaceIOGetStats(TablespaceIOStats *stats);
+
 extern void SetForwardFsyncRequests(void);
 extern void RememberFsyncRequest(RelFileNode rnode, ForkNumber forknum,
 					 BlockNumber segno);
@@ -505,6 +505,9 @@ extern Datum pg_read_binary_file_all(PG_FUNCTION_ARGS);
 extern Datum pg_ls_dir(PG_FUNCTION_ARGS);
 extern Datum pg_ls_dir_1arg(PG_FUNCTION_ARGS);
 
+/* mcxtfuncs.c */
+extern Datum pg_get_memory_contexts(PG_FUNCTION_ARGS);
+
 /* misc.c */
 extern Datum pg_num_nulls(PG_FUNCTION_ARGS);
 extern Datum pg_num_nonnulls(PG_FUNCTION_ARGS);
@@ -616,6 +619,7 @@ extern Datum pg_ddl_command_recv(PG_FUNCTION_ARGS);
 extern Datum pg_ddl_command_send(PG_FUNCTION_ARGS);
 
 /* regexp.c */
+extern int	regex_cache_size;
 extern Datum nameregexeq(PG_FUNCTION_ARGS);
 extern Datum nameregexne(PG_FUNCTION_ARGS);
 extern Datum textregexeq(PG_FUNCTION_ARGS);
@@ -158,6 +158,15 @@ typedef struct catcacheheader
 } CatCacheHeader;
 
 
+/*
+ * Name of the per-database file the catcache contents are saved to; it is
+ * removed together with the local relcache init file (see relcache.c).
+ */
+#define CATCACHE_INIT_FILENAME	"pg_catcache.init"
+
+/* GUC */
+extern int	catcache_init_file_size;
+
 /* this extern duplicates utils/memutils.h... */
 extern PGDLLIMPORT MemoryContext CacheMemoryContext;
 
@@ -190,6 +199,8 @@ extern void PrepareToInvalidateCacheTuple(Relation relation,
 							  HeapTuple newtuple,
 							  void (*function) (int, uint32, Oid));
 
+extern void CatalogCacheLoadInitFile(void);
+
 extern void PrintCatCacheLeakWarning(HeapTuple tuple);
 extern void PrintCatCacheListLeakWarning(CatCList *list);
 
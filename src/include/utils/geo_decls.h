@@ -425,6 +425,7 @@ extern Datum gist_point_compress(PG_FUNCTION_ARGS);
 extern Datum gist_point_consistent(PG_FUNCTION_ARGS);
 extern Datum gist_point_distance(PG_FUNCTION_ARGS);
 extern Datum gist_point_fetch(PG_FUNCTION_ARGS);
+extern Datum gist_point_sortsupport(PG_FUNCTION_ARGS);
 
 /* utils/adt/geo_spgist.c */
 Datum		spg_box_quad_config(PG_FUNCTION_ARGS);
@@ -0,0 +1,64 @@
+/*-------------------------------------------------------------------------
+ *
+ * partmap.h
+ *	  Partition maps of inheritance trees, for partition pruning.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/partmap.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PARTMAP_H
+#define PARTMAP_H
+
+#include "access/stratnum.h"
+#include "fmgr.h"
+#include "nodes/pg_list.h"
+
+/*
+ * A range of partition key values a child table can hold, according to its
+ * CHECK constraints.  A list partition has one entry per value, with equal
+ * inclusive bounds.
+ */
+typedef struct PartitionMapEntry
+{
+	Datum		lower;
+	Datum		upper;
+	bool		lower_inf;		/* no lower bound */
+	bool		upper_inf;		/* no upper bound */
+	bool		lower_incl;		/* lower bound is inclusive */
+	bool		upper_incl;		/* upper bound is inclusive */
+	int			child;			/* index into PartitionMap.children */
+} PartitionMapEntry;
+
+typedef struct PartitionMap
+{
+	Oid			parentrelid;	/* parent of the inheritance tree */
+	AttrNumber	keyattno;		/* partition key column of the parent, or
+								 * InvalidAttrNumber if there is none */
+	Oid			keycollation;	/* collation of the key column */
+	Oid			cmptype;		/* type the key's btree opclass compares */
+	Oid			opfamily;		/* btree operator family of the key */
+	int16		cmptyplen;
+	bool		cmptypbyval;
+	FmgrInfo	cmpproc;		/* btree comparison function */
+
+	int			nchildren;
+	Oid		   *children;		/* all tables of the tree, sorted by OID */
+	bool	   *mapped;			/* does the child's range appear below? */
+
+	int			nentries;
+	PartitionMapEntry *entries; /* sorted by lower bound */
+	bool		disjoint;		/* entries don't overlap */
+
+	MemoryContext mcxt;			/* holds everything above */
+} PartitionMap;
+
+extern PartitionMap *GetPartitionMap(Oid parentrelid, List *childoids);
+extern int	PartitionMapFindChild(PartitionMap *map, Oid childrelid);
+extern bool *PartitionMapPrune(PartitionMap *map, int nquals,
+				  StrategyNumber *strategies, Datum *values);
+
+#endif   /* PARTMAP_H */
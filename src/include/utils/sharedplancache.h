@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------
+ *
+ * sharedplancache.h
+ *	  Cache of generic plans shared between backends.
+ *
+ * See sharedplancache.c for comments.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/utils/sharedplancache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef SHAREDPLANCACHE_H
+#define SHAREDPLANCACHE_H
+
+#include "nodes/pg_list.h"
+#include "utils/plancache.h"
+
+/*
+ * Identity of a statement in the shared plan cache.  The query text itself
+ * is compared too, so hash collisions on it are harmless.
+ */
+typedef struct SharedPlanKey
+{
+	Oid			dbid;			/* database */
+	Oid			userid;			/* role the plan was made for */
+	uint32		query_hash;		/* hash of the query text */
+	uint32		env_hash;		/* hash of search_path, parameter types,
+								 * cursor options and other settings */
+} SharedPlanKey;
+
+/* GUCs */
+extern int	shared_plan_cache_entries;
+extern int	shared_plan_cache_entry_size;
+
+extern Size SharedPlanCacheShmemSize(void);
+extern void SharedPlanCacheShmemInit(void);
+
+extern bool SharedPlanCacheEnabled(void);
+extern bool SharedPlanCacheComputeKey(CachedPlanSource *plansource,
+						  SharedPlanKey *key);
+extern uint64 SharedPlanCacheInvalCount(void);
+extern bool SharedPlanCacheLookup(SharedPlanKey *key,
+					  CachedPlanSource *plansource,
+					  char **plan_string,
+					  int *num_custom_plans,
+					  double *total_custom_cost);
+extern void SharedPlanCacheStore(SharedPlanKey *key,
+					 CachedPlanSource *plansource,
+					 List *stmt_list,
+					 uint64 inval_count);
+
+extern void SharedPlanCacheInvalidateRel(Oid relid);
+extern void SharedPlanCacheInvalidateItem(int cacheid, uint32 hashvalue);
+extern void SharedPlanCacheReset(void);
+
+#endif   /* SHAREDPLANCACHE_H */
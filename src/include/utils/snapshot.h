@@ -109,6 +109,12 @@ typedef struct SnapshotData
 
 	int64		whenTaken;		/* timestamp when snapshot was taken */
 	XLogRecPtr	lsn;			/* position in the WAL stream when taken */
+
+	/*
+	 * ShmemVariableCache->xactCompletionCount when GetSnapshotData built
+	 * the contents of this snapshot, or 0 if they have been set otherwise.
+	 */
+	uint64		snapXactCompletionCount;
 } SnapshotData;
 
 /*
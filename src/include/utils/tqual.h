@@ -81,6 +81,33 @@ extern void HeapTupleSetHintBits(HeapTupleHeader tuple, Buffer buffer,
 					 uint16 infomask, TransactionId xid);
 extern bool HeapTupleHeaderIsOnlyLocked(HeapTupleHeader tuple);
 
+/*
+ * Memo of XidInMVCCSnapshot results for one snapshot, used by page-at-a-time
+ * heap scans when an external transaction manager is installed.  The XIDs of
+ * a page are queued under the buffer lock and then resolved with a single
+ * IsInSnapshotBatch call after releasing it.  The memo is direct-mapped by
+ * XID; an InvalidTransactionId slot is empty.
+ */
+#define XID_VISIBILITY_MEMO_SIZE	1024
+
+typedef struct XidVisibilityMemo
+{
+	Snapshot	snapshot;		/* snapshot the answers are valid for */
+	TransactionId xids[XID_VISIBILITY_MEMO_SIZE];
+	bool		inSnapshot[XID_VISIBILITY_MEMO_SIZE];
+	int			nbatch;			/* number of XIDs queued for the manager */
+	TransactionId batch[XID_VISIBILITY_MEMO_SIZE];
+	bool		batchInSnapshot[XID_VISIBILITY_MEMO_SIZE];
+} XidVisibilityMemo;
+
+extern XidVisibilityMemo *CreateXidVisibilityMemo(Snapshot snapshot);
+extern void ResetXidVisibilityMemo(XidVisibilityMemo *memo, Snapshot snapshot);
+extern void XidVisibilityMemoQueueTuple(XidVisibilityMemo *memo,
+							HeapTupleHeader tuple);
+extern void XidVisibilityMemoFlush(XidVisibilityMemo *memo);
+extern bool HeapTupleSatisfiesMVCCMemo(HeapTuple htup, Snapshot snapshot,
+						   Buffer buffer, XidVisibilityMemo *memo);
+
 /*
  * To avoid leaking too much knowledge about reorderbuffer implementation
  * details this is implemented in reorderbuffer.c not tqual.c.
@@ -31,6 +31,35 @@
  */
 typedef struct Tuplesortstate Tuplesortstate;
 
+/*
+ * Sharedsort is the state of a parallel sort that lives in shared memory;
+ * it too is opaque outside tuplesort.c.  The caller sets aside
+ * tuplesort_estimate_shared() bytes for it in the DSM segment of its
+ * parallel context and prepares it with tuplesort_initialize_shared().
+ */
+typedef struct Sharedsort Sharedsort;
+
+/*
+ * A parallel sort has any number of worker tuplesorts, each of which sorts
+ * a part of the input into one run in a temporary file, and one leader
+ * tuplesort, which takes no input of its own but merges the workers' runs.
+ * The leader process can also run a worker tuplesort, to sort a part of the
+ * input itself.  Each of them is started with a SortCoordinate, allocated
+ * by the caller in local memory, that says which role it has; serial sorts
+ * pass NULL.
+ *
+ * The worker tuplesorts must all be finished, that is, have gone through
+ * tuplesort_performsort(), before tuplesort_performsort() is called on the
+ * leader tuplesort.
+ */
+typedef struct SortCoordinateData
+{
+	bool		isWorker;		/* worker tuplesort, or the leader's merge? */
+	Sharedsort *sharedsort;		/* shared state of the parallel sort */
+} SortCoordinateData;
+
+typedef struct SortCoordinateData *SortCoordinate;
+
 /*
  * We provide multiple interfaces to what is essentially the same code,
  * since different callers have different data to be sorted and want to
@@ -53,9 +82,14 @@ typedef struct Tuplesortstate Tuplesortstate;
  *
  * The "index_btree" API stores/sorts IndexTuples (preserving all their
  * header fields).  The sort keys are specified by a btree index definition.
+ * This is the only API that can be used for a parallel sort, at present.
  *
  * The "index_hash" API is similar to index_btree, but the tuples are
  * actually sorted by their hash codes not the raw data.
+ *
+ * The "index_gist" API is also similar to index_btree, but the sort order
+ * is defined by the sortsupport functions of the GiST opclasses, typically
+ * a space-filling curve, and there is no uniqueness check.
  */
 
 extern Tuplesortstate *tuplesort_begin_heap(TupleDesc tupDesc,
@@ -69,11 +103,15 @@ extern Tuplesortstate *tuplesort_begin_cluster(TupleDesc tupDesc,
 extern Tuplesortstate *tuplesort_begin_index_btree(Relation heapRel,
 							Relation indexRel,
 							bool enforceUnique,
-							int workMem, bool randomAccess);
+							int workMem, SortCoordinate coordinate,
+							bool randomAccess);
 extern Tuplesortstate *tuplesort_begin_index_hash(Relation heapRel,
 						   Relation indexRel,
 						   uint32 hash_mask,
 						   int workMem, bool randomAccess);
+extern Tuplesortstate *tuplesort_begin_index_gist(Relation heapRel,
+						   Relation indexRel,
+						   int workMem, bool randomAccess);
 extern Tuplesortstate *tuplesort_begin_datum(Oid datumType,
 					  Oid sortOperator, Oid sortCollation,
 					  bool nullsFirstFlag,
@@ -113,6 +151,9 @@ extern void tuplesort_get_stats(Tuplesortstate *state,
 
 extern int	tuplesort_merge_order(int64 allowedMem);
 
+extern Size tuplesort_estimate_shared(void);
+extern void tuplesort_initialize_shared(Sharedsort *shared);
+
 /*
  * These routines may only be called if randomAccess was specified 'true'.
  * Likewise, backwards scan in gettuple/getdatum is only allowed if
@@ -297,6 +297,10 @@ static const internalPQconninfoOption PQconninfoOptions[] = {
 		"Require-Peer", "", 10,
 	offsetof(struct pg_conn, requirepeer)},
 
+	{"compression", "PGCOMPRESSION", "0", NULL,
+		"Compression", "", 1,
+	offsetof(struct pg_conn, compression)},
+
 #if defined(ENABLE_GSS) || defined(ENABLE_SSPI)
 	/* Kerberos and GSSAPI authentication support specifying the service name */
 	{"krbsrvname", "PGKRBSRVNAME", PG_KRB_SRVNAM, NULL,
@@ -398,6 +402,8 @@ static char *PasswordFromFile(char *hostname, char *port, char *dbname,
 static bool getPgPassFilename(char *pgpassfile);
 static void dot_pg_pass_warning(PGconn *conn);
 static void default_threadlock(int acquire);
+static ssize_t pqCompressionWrite(void *arg, void const *ptr, size_t len);
+static ssize_t pqCompressionRead(void *arg, void *ptr, size_t len);
 
 
 /* global variable because fe-auth.c needs to access it */
@@ -421,6 +427,10 @@ pqDropConnection(PGconn *conn, bool flushInput)
 	/* Drop any SSL state */
 	pqsecure_close(conn);
 
+	/* Drop compression state */
+	zpq_free(conn->zstream);
+	conn->zstream = NULL;
+
 	/* Close the socket itself */
 	if (conn->sock != PGINVALID_SOCKET)
 		closesocket(conn->sock);
@@ -473,6 +483,34 @@ pqDropConnection(PGconn *conn, bool flushInput)
 }
 
 
+/*
+ * pqCompressionRequested: should we ask the server to compress the traffic?
+ */
+bool
+pqCompressionRequested(const PGconn *conn)
+{
+	return conn->compression != NULL && conn->compression[0] != '\0' &&
+		strcmp(conn->compression, "0") != 0 &&
+		zpq_algorithms()[0] != '\0';
+}
+
+/*
+ * Transport callbacks of the compression stream: compressed data is sent
+ * and received through SSL, if it is in use.
+ */
+static ssize_t
+pqCompressionWrite(void *arg, void const *ptr, size_t len)
+{
+	return pqsecure_write((PGconn *) arg, ptr, len);
+}
+
+static ssize_t
+pqCompressionRead(void *arg, void *ptr, size_t len)
+{
+	return pqsecure_read((PGconn *) arg, ptr, len);
+}
+
+
 /*
  *		Connecting to a Database
  *
@@ -2318,7 +2356,9 @@ keep_going:						/* We will come back to here until there is
 				 * request or an error here.  Anything else probably means
 				 * it's not Postgres on the other end at all.
 				 */
-				if (!(beresp == 'R' || beresp == 'E'))
+				if (!(beresp == 'R' || beresp == 'E' ||
+					  (beresp == 'z' && conn->zstream == NULL &&
+					   pqCompressionRequested(conn))))
 				{
 					appendPQExpBuffer(&conn->errorMessage,
 									  libpq_gettext(
@@ -2361,6 +2401,54 @@ keep_going:						/* We will come back to here until there is
 					goto error_return;
 				}
 
+				/*
+				 * Compression response: a single byte telling which
+				 * algorithm the server has chosen.  All following traffic is
+				 * compressed, including what we may have received already.
+				 */
+				if (beresp == 'z')
+				{
+					char		algorithm;
+
+					if (msgLength != 5)
+					{
+						appendPQExpBuffer(&conn->errorMessage,
+										  libpq_gettext("invalid compression response length: %d\n"),
+										  msgLength);
+						goto error_return;
+					}
+					if (pqGetc(&algorithm, conn))
+					{
+						/* We'll come back when there is more data */
+						return PGRES_POLLING_READING;
+					}
+					conn->inStart = conn->inCursor;
+
+					if (algorithm != ZPQ_NO_COMPRESSION)
+					{
+						conn->zstream = zpq_create(algorithm,
+												   pqCompressionWrite,
+												   pqCompressionRead,
+												   conn,
+												   conn->inBuffer + conn->inStart,
+											  conn->inEnd - conn->inStart);
+						if (conn->zstream == NULL)
+						{
+							appendPQExpBuffer(&conn->errorMessage,
+											  libpq_gettext("could not initialize compression \"%c\" chosen by the server\n"),
+											  algorithm);
+							goto error_return;
+						}
+						conn->inEnd = conn->inStart;
+
+						/* Decompress data received along with the response */
+						if (zpq_buffered_rx(conn->zstream) > 0 &&
+							pqReadData(conn) < 0)
+							goto error_return;
+					}
+					goto keep_going;
+				}
+
 				if (beresp == 'E' && (msgLength < 8 || msgLength > 30000))
 				{
 					/* Handle error from a pre-3.0 server */
@@ -2831,6 +2919,7 @@ makeEmptyPGconn(void)
 
 	conn->status = CONNECTION_BAD;
 	conn->asyncStatus = PGASYNC_IDLE;
+	conn->pipelineStatus = PQ_PIPELINE_OFF;
 	conn->xactStatus = PQTRANS_IDLE;
 	conn->options_valid = false;
 	conn->nonblocking = false;
@@ -2960,6 +3049,8 @@ freePGconn(PGconn *conn)
 		free(conn->sslcompression);
 	if (conn->requirepeer)
 		free(conn->requirepeer);
+	if (conn->compression)
+		free(conn->compression);
 #if defined(ENABLE_GSS) || defined(ENABLE_SSPI)
 	if (conn->krbsrvname)
 		free(conn->krbsrvname);
@@ -3032,6 +3123,8 @@ closePGconn(PGconn *conn)
 										 * absent */
 	conn->asyncStatus = PGASYNC_IDLE;
 	pqClearAsyncResult(conn);	/* deallocate result */
+	pqClearCmdQueue(conn);		/* forget pipelined commands */
+	conn->pipelineStatus = PQ_PIPELINE_OFF;
 	resetPQExpBuffer(&conn->errorMessage);
 	pg_freeaddrinfo_all(conn->addrlist_family, conn->addrlist);
 	conn->addrlist = NULL;
@@ -5448,6 +5541,14 @@ PQtransactionStatus(const PGconn *conn)
 	return conn->xactStatus;
 }
 
+PGpipelineStatus
+PQpipelineStatus(const PGconn *conn)
+{
+	if (!conn)
+		return PQ_PIPELINE_OFF;
+	return conn->pipelineStatus;
+}
+
 const char *
 PQparameterStatus(const PGconn *conn, const char *paramName)
 {
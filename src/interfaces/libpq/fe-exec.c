@@ -40,7 +40,9 @@ char	   *const pgresStatus[] = {
 	"PGRES_NONFATAL_ERROR",
 	"PGRES_FATAL_ERROR",
 	"PGRES_COPY_BOTH",
-	"PGRES_SINGLE_TUPLE"
+	"PGRES_SINGLE_TUPLE",
+	"PGRES_PIPELINE_SYNC",
+	"PGRES_PIPELINE_ABORTED"
 };
 
 /*
@@ -55,6 +57,11 @@ static PGEvent *dupEvents(PGEvent *events, int count);
 static bool pqAddTuple(PGresult *res, PGresAttValue *tup,
 		   const char **errmsgp);
 static bool PQsendQueryStart(PGconn *conn);
+static PGcmdQueueEntry *pqAllocCmdQueueEntry(PGconn *conn);
+static int pqSendQueryFinish(PGconn *conn, PGcmdQueueEntry *entry,
+				  PGQueryClass queryclass, const char *query);
+static void pqCommandQueueAdvance(PGconn *conn);
+static void pqPipelineProcessQueue(PGconn *conn);
 static int PQsendQueryGuts(PGconn *conn,
 				const char *command,
 				const char *stmtName,
@@ -183,6 +190,7 @@ PQmakeEmptyPGresult(PGconn *conn, ExecStatusType status)
 			case PGRES_COPY_IN:
 			case PGRES_COPY_BOTH:
 			case PGRES_SINGLE_TUPLE:
+			case PGRES_PIPELINE_SYNC:
 				/* non-error cases */
 				break;
 			default:
@@ -1185,6 +1193,14 @@ PQsendQuery(PGconn *conn, const char *query)
 	if (!PQsendQueryStart(conn))
 		return 0;
 
+	/* simple Query protocol can't be mixed with pipelined commands */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+				 libpq_gettext("PQsendQuery not allowed in pipeline mode\n"));
+		return 0;
+	}
+
 	/* check the argument */
 	if (!query)
 	{
@@ -1280,6 +1296,8 @@ PQsendPrepare(PGconn *conn,
 			  const char *stmtName, const char *query,
 			  int nParams, const Oid *paramTypes)
 {
+	PGcmdQueueEntry *entry = NULL;
+
 	if (!PQsendQueryStart(conn))
 		return 0;
 
@@ -1311,6 +1329,10 @@ PQsendPrepare(PGconn *conn,
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF &&
+		(entry = pqAllocCmdQueueEntry(conn)) == NULL)
+		return 0;
+
 	/* construct the Parse message */
 	if (pqPutMsgStart('P', false, conn) < 0 ||
 		pqPuts(stmtName, conn) < 0 ||
@@ -1337,32 +1359,14 @@ PQsendPrepare(PGconn *conn,
 	if (pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
+	/* remember we are doing just a Parse, and push it out */
+	if (!pqSendQueryFinish(conn, entry, PGQUERY_PREPARE, query))
 		goto sendFailed;
-
-	/* remember we are doing just a Parse */
-	conn->queryclass = PGQUERY_PREPARE;
-
-	/* and remember the query text too, if possible */
-	/* if insufficient memory, last_query just winds up NULL */
-	if (conn->last_query)
-		free(conn->last_query);
-	conn->last_query = strdup(query);
-
-	/*
-	 * Give the data a push.  In nonblock mode, don't complain if we're unable
-	 * to send it all; PQgetResult() will do any additional flushing needed.
-	 */
-	if (pqFlush(conn) < 0)
-		goto sendFailed;
-
-	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
 	return 1;
 
 sendFailed:
+	if (entry)
+		free(entry);
 	pqHandleSendFailure(conn);
 	return 0;
 }
@@ -1428,8 +1432,25 @@ PQsendQueryStart(PGconn *conn)
 						  libpq_gettext("no connection to the server\n"));
 		return false;
 	}
-	/* Can't send while already busy, either. */
-	if (conn->asyncStatus != PGASYNC_IDLE)
+	/*
+	 * Can't send while already busy, either, unless the command is just
+	 * queued behind the pending ones in pipeline mode.
+	 */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		if (conn->asyncStatus == PGASYNC_COPY_IN ||
+			conn->asyncStatus == PGASYNC_COPY_OUT ||
+			conn->asyncStatus == PGASYNC_COPY_BOTH)
+		{
+			printfPQExpBuffer(&conn->errorMessage,
+							  libpq_gettext("cannot queue commands during COPY\n"));
+			return false;
+		}
+		/* results of queued commands are still to be collected */
+		if (conn->asyncStatus != PGASYNC_IDLE)
+			return true;
+	}
+	else if (conn->asyncStatus != PGASYNC_IDLE)
 	{
 		printfPQExpBuffer(&conn->errorMessage,
 				  libpq_gettext("another command is already in progress\n"));
@@ -1464,6 +1485,7 @@ PQsendQueryGuts(PGconn *conn,
 				const int *paramFormats,
 				int resultFormat)
 {
+	PGcmdQueueEntry *entry = NULL;
 	int			i;
 
 	/* This isn't gonna work on a 2.0 server */
@@ -1474,9 +1496,14 @@ PQsendQueryGuts(PGconn *conn,
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF &&
+		(entry = pqAllocCmdQueueEntry(conn)) == NULL)
+		return 0;
+
 	/*
-	 * We will send Parse (if needed), Bind, Describe Portal, Execute, Sync,
-	 * using specified statement name and the unnamed portal.
+	 * We will send Parse (if needed), Bind, Describe Portal, Execute, Sync
+	 * (unless pipelining), using specified statement name and the unnamed
+	 * portal.
 	 */
 
 	if (command)
@@ -1586,37 +1613,192 @@ PQsendQueryGuts(PGconn *conn,
 		pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
+	/* remember we are using extended query protocol, and push it out */
+	if (!pqSendQueryFinish(conn, entry, PGQUERY_EXTENDED, command))
 		goto sendFailed;
+	return 1;
 
-	/* remember we are using extended query protocol */
-	conn->queryclass = PGQUERY_EXTENDED;
+sendFailed:
+	if (entry)
+		free(entry);
+	pqHandleSendFailure(conn);
+	return 0;
+}
 
-	/* and remember the query text too, if possible */
-	/* if insufficient memory, last_query just winds up NULL */
-	if (conn->last_query)
-		free(conn->last_query);
-	if (command)
-		conn->last_query = strdup(command);
-	else
-		conn->last_query = NULL;
+/*
+ * pqSendQueryFinish
+ *		Common code to complete sending of an extended-protocol command
+ *
+ * Outside pipeline mode (entry == NULL) the command is terminated with Sync
+ * and becomes the current query.  In pipeline mode it is appended to the
+ * command queue instead, and the server will not respond to it until a
+ * sync point or flush request follows.
+ *
+ * Returns 1 on success, 0 if sending failed; in the latter case entry is
+ * not linked into the queue and remains owned by the caller.
+ */
+static int
+pqSendQueryFinish(PGconn *conn, PGcmdQueueEntry *entry,
+				  PGQueryClass queryclass, const char *query)
+{
+	if (entry == NULL)
+	{
+		/* construct the Sync message */
+		if (pqPutMsgStart('S', false, conn) < 0 ||
+			pqPutMsgEnd(conn) < 0)
+			return 0;
+
+		conn->queryclass = queryclass;
+
+		/* and remember the query text too, if possible */
+		/* if insufficient memory, last_query just winds up NULL */
+		if (conn->last_query)
+			free(conn->last_query);
+		conn->last_query = query ? strdup(query) : NULL;
+
+		/*
+		 * Give the data a push.  In nonblock mode, don't complain if we're
+		 * unable to send it all; PQgetResult() will do any additional
+		 * flushing needed.
+		 */
+		if (pqFlush(conn) < 0)
+			return 0;
+
+		/* OK, it's launched! */
+		conn->asyncStatus = PGASYNC_BUSY;
+		return 1;
+	}
 
 	/*
-	 * Give the data a push.  In nonblock mode, don't complain if we're unable
-	 * to send it all; PQgetResult() will do any additional flushing needed.
+	 * In pipeline mode, don't push every command: let the output buffer fill
+	 * up and send it together with the sync point.  Once the buffer grows
+	 * large, do send it, so that the server can start working meanwhile.
 	 */
-	if (pqFlush(conn) < 0)
-		goto sendFailed;
+	if (conn->outCount >= 8192 && pqFlush(conn) < 0)
+		return 0;
 
-	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
+	entry->queryclass = queryclass;
+	entry->query = query ? strdup(query) : NULL;
+	entry->next = NULL;
+	if (conn->cmd_queue_tail)
+		conn->cmd_queue_tail->next = entry;
+	else
+		conn->cmd_queue_head = entry;
+	conn->cmd_queue_tail = entry;
+
+	/* If nothing is pending, this command is the current one */
+	if (conn->asyncStatus == PGASYNC_IDLE)
+		pqPipelineProcessQueue(conn);
 	return 1;
+}
 
-sendFailed:
-	pqHandleSendFailure(conn);
-	return 0;
+/*
+ * pqAllocCmdQueueEntry
+ *		Allocate queue entry for a command sent in pipeline mode
+ *
+ * It is allocated before anything is written to the output buffer, so that
+ * running out of memory can't leave a sent command without its entry.
+ */
+static PGcmdQueueEntry *
+pqAllocCmdQueueEntry(PGconn *conn)
+{
+	PGcmdQueueEntry *entry;
+
+	entry = (PGcmdQueueEntry *) malloc(sizeof(PGcmdQueueEntry));
+	if (entry == NULL)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("out of memory\n"));
+		return NULL;
+	}
+	entry->query = NULL;
+	entry->next = NULL;
+	return entry;
+}
+
+/*
+ * pqPipelineProcessQueue
+ *		Make the head of the command queue the current query
+ *
+ * If a previous command of the pipeline has failed, the server skips
+ * everything up to the next sync point, so there is nothing to wait for:
+ * report PGRES_PIPELINE_ABORTED for such commands right away.
+ */
+static void
+pqPipelineProcessQueue(PGconn *conn)
+{
+	PGcmdQueueEntry *entry = conn->cmd_queue_head;
+
+	if (entry == NULL)
+	{
+		conn->asyncStatus = PGASYNC_IDLE;
+		return;
+	}
+
+	conn->queryclass = entry->queryclass;
+	if (conn->last_query)
+		free(conn->last_query);
+	conn->last_query = entry->query;
+	entry->query = NULL;
+	conn->singleRowMode = false;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_ABORTED &&
+		entry->queryclass != PGQUERY_SYNC)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("pipeline aborted\n"));
+		conn->result = PQmakeEmptyPGresult(conn, PGRES_PIPELINE_ABORTED);
+		if (!conn->result)
+		{
+			printfPQExpBuffer(&conn->errorMessage,
+							  libpq_gettext("out of memory\n"));
+			pqSaveErrorResult(conn);
+		}
+		conn->asyncStatus = PGASYNC_READY;
+	}
+	else
+		conn->asyncStatus = PGASYNC_BUSY;
+}
+
+/*
+ * pqCommandQueueAdvance
+ *		Forget the current pipelined command and proceed to the next one
+ */
+static void
+pqCommandQueueAdvance(PGconn *conn)
+{
+	PGcmdQueueEntry *entry = conn->cmd_queue_head;
+
+	if (entry == NULL)
+		return;
+
+	conn->cmd_queue_head = entry->next;
+	if (conn->cmd_queue_head == NULL)
+		conn->cmd_queue_tail = NULL;
+	if (entry->query)
+		free(entry->query);
+	free(entry);
+
+	pqPipelineProcessQueue(conn);
+}
+
+/*
+ * pqClearCmdQueue
+ *		Discard all pipelined commands, e.g. when the connection is closed
+ */
+void
+pqClearCmdQueue(PGconn *conn)
+{
+	while (conn->cmd_queue_head)
+	{
+		PGcmdQueueEntry *entry = conn->cmd_queue_head;
+
+		conn->cmd_queue_head = entry->next;
+		if (entry->query)
+			free(entry->query);
+		free(entry);
+	}
+	conn->cmd_queue_tail = NULL;
 }
 
 /*
@@ -1673,6 +1855,178 @@ PQsetSingleRowMode(PGconn *conn)
 	return 1;
 }
 
+/*
+ * PQenterPipelineMode
+ *		Put the connection in pipeline mode
+ *
+ * In pipeline mode PQsendQueryParams, PQsendPrepare, PQsendQueryPrepared and
+ * PQsendDescribe* only queue their commands: the application may send many
+ * of them without waiting for results, which are then returned by
+ * PQgetResult in the order the commands were sent, each command's results
+ * terminated by NULL.  PQpipelineSync marks the end of a group of commands;
+ * if one of them fails, the rest of the group is reported as
+ * PGRES_PIPELINE_ABORTED.  Since each command doesn't end with its own Sync,
+ * the whole group runs in a single implicit transaction unless it contains
+ * explicit transaction control commands.
+ *
+ * Returns 1 on success, 0 if a command is in progress.
+ */
+int
+PQenterPipelineMode(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	/* succeed with no action if already in pipeline mode */
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+		return 1;
+
+	if (PG_PROTOCOL_MAJOR(conn->pversion) < 3)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+		 libpq_gettext("function requires at least protocol version 3.0\n"));
+		return 0;
+	}
+
+	if (conn->asyncStatus != PGASYNC_IDLE)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot enter pipeline mode, connection not idle\n"));
+		return 0;
+	}
+
+	conn->pipelineStatus = PQ_PIPELINE_ON;
+	return 1;
+}
+
+/*
+ * PQexitPipelineMode
+ *		Leave pipeline mode
+ *
+ * This is only possible once the results of all queued commands, including
+ * the last sync point, have been collected.
+ *
+ * Returns 1 on success, 0 otherwise.
+ */
+int
+PQexitPipelineMode(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+		return 1;
+
+	if (conn->asyncStatus != PGASYNC_IDLE || conn->cmd_queue_head != NULL)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot exit pipeline mode with uncollected results\n"));
+		return 0;
+	}
+
+	/* the server would still skip commands until it sees a Sync */
+	if (conn->pipelineStatus == PQ_PIPELINE_ABORTED)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot exit aborted pipeline without a sync point\n"));
+		return 0;
+	}
+
+	conn->pipelineStatus = PQ_PIPELINE_OFF;
+	return 1;
+}
+
+/*
+ * PQpipelineSync
+ *		Send a sync point: terminate the current group of pipelined commands
+ *		and flush the output buffer
+ *
+ * The server then sends the results of all commands of the group;
+ * PQgetResult reports reaching the sync point with a PGRES_PIPELINE_SYNC
+ * result, which is not followed by NULL.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+int
+PQpipelineSync(PGconn *conn)
+{
+	PGcmdQueueEntry *entry;
+
+	if (!conn)
+		return 0;
+
+	if (conn->pipelineStatus == PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot send pipeline sync when not in pipeline mode\n"));
+		return 0;
+	}
+
+	if (conn->asyncStatus == PGASYNC_COPY_IN ||
+		conn->asyncStatus == PGASYNC_COPY_OUT ||
+		conn->asyncStatus == PGASYNC_COPY_BOTH)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("cannot queue commands during COPY\n"));
+		return 0;
+	}
+
+	if ((entry = pqAllocCmdQueueEntry(conn)) == NULL)
+		return 0;
+
+	/* construct the Sync message */
+	if (pqPutMsgStart('S', false, conn) < 0 ||
+		pqPutMsgEnd(conn) < 0)
+		goto sendFailed;
+
+	/* queue it, and give all the pipelined commands a push */
+	if (!pqSendQueryFinish(conn, entry, PGQUERY_SYNC, NULL))
+		goto sendFailed;
+	if (pqFlush(conn) < 0)
+		return 0;
+	return 1;
+
+sendFailed:
+	free(entry);
+	pqHandleSendFailure(conn);
+	return 0;
+}
+
+/*
+ * PQsendFlushRequest
+ *		Ask the server to send the results of the commands pipelined so far
+ *		without waiting for a sync point
+ *
+ * The request is only queued; PQflush (or PQgetResult) sends it.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+int
+PQsendFlushRequest(PGconn *conn)
+{
+	if (!conn)
+		return 0;
+
+	if (conn->status != CONNECTION_OK)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("no connection to the server\n"));
+		return 0;
+	}
+
+	if (PG_PROTOCOL_MAJOR(conn->pversion) < 3)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+		 libpq_gettext("function requires at least protocol version 3.0\n"));
+		return 0;
+	}
+
+	if (pqPutMsgStart('H', false, conn) < 0 ||
+		pqPutMsgEnd(conn) < 0)
+		return 0;
+	return 1;
+}
+
 /*
  * Consume any available input from the backend
  * 0 return: some kind of trouble
@@ -1789,6 +2143,7 @@ PQgetResult(PGconn *conn)
 			 */
 			pqSaveErrorResult(conn);
 			conn->asyncStatus = PGASYNC_IDLE;
+			pqClearCmdQueue(conn);
 			return pqPrepareAsyncResult(conn);
 		}
 
@@ -1804,8 +2159,28 @@ PQgetResult(PGconn *conn)
 			break;
 		case PGASYNC_READY:
 			res = pqPrepareAsyncResult(conn);
-			/* Set the state back to BUSY, allowing parsing to proceed. */
-			conn->asyncStatus = PGASYNC_BUSY;
+			if (conn->pipelineStatus != PQ_PIPELINE_OFF &&
+				(res == NULL || res->resultStatus != PGRES_SINGLE_TUPLE))
+			{
+				/*
+				 * This was the last result of the current pipelined command.
+				 * A sync point result isn't followed by NULL, so proceed to
+				 * the next command at once; otherwise return NULL first.
+				 */
+				if (res && res->resultStatus == PGRES_PIPELINE_SYNC)
+					pqCommandQueueAdvance(conn);
+				else
+					conn->asyncStatus = PGASYNC_PIPELINE_IDLE;
+			}
+			else
+			{
+				/* Set the state back to BUSY, allowing parsing to proceed. */
+				conn->asyncStatus = PGASYNC_BUSY;
+			}
+			break;
+		case PGASYNC_PIPELINE_IDLE:
+			res = NULL;			/* current pipelined command is complete */
+			pqCommandQueueAdvance(conn);
 			break;
 		case PGASYNC_COPY_IN:
 			res = getCopyResult(conn, PGRES_COPY_IN);
@@ -1983,6 +2358,13 @@ PQexecStart(PGconn *conn)
 	if (!conn)
 		return false;
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("synchronous command execution functions are not allowed in pipeline mode\n"));
+		return false;
+	}
+
 	/*
 	 * Silently discard any prior query result that application didn't eat.
 	 * This is probably poor design, but it's here for backward compatibility.
@@ -2177,6 +2559,8 @@ PQsendDescribePortal(PGconn *conn, const char *portal)
 static int
 PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 {
+	PGcmdQueueEntry *entry = NULL;
+
 	/* Treat null desc_target as empty string */
 	if (!desc_target)
 		desc_target = "";
@@ -2192,6 +2576,10 @@ PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 		return 0;
 	}
 
+	if (conn->pipelineStatus != PQ_PIPELINE_OFF &&
+		(entry = pqAllocCmdQueueEntry(conn)) == NULL)
+		return 0;
+
 	/* construct the Describe message */
 	if (pqPutMsgStart('D', false, conn) < 0 ||
 		pqPutc(desc_type, conn) < 0 ||
@@ -2199,33 +2587,14 @@ PQsendDescribe(PGconn *conn, char desc_type, const char *desc_target)
 		pqPutMsgEnd(conn) < 0)
 		goto sendFailed;
 
-	/* construct the Sync message */
-	if (pqPutMsgStart('S', false, conn) < 0 ||
-		pqPutMsgEnd(conn) < 0)
-		goto sendFailed;
-
-	/* remember we are doing a Describe */
-	conn->queryclass = PGQUERY_DESCRIBE;
-
-	/* reset last-query string (not relevant now) */
-	if (conn->last_query)
-	{
-		free(conn->last_query);
-		conn->last_query = NULL;
-	}
-
-	/*
-	 * Give the data a push.  In nonblock mode, don't complain if we're unable
-	 * to send it all; PQgetResult() will do any additional flushing needed.
-	 */
-	if (pqFlush(conn) < 0)
+	/* remember we are doing a Describe (query text is not relevant now) */
+	if (!pqSendQueryFinish(conn, entry, PGQUERY_DESCRIBE, NULL))
 		goto sendFailed;
-
-	/* OK, it's launched! */
-	conn->asyncStatus = PGASYNC_BUSY;
 	return 1;
 
 sendFailed:
+	if (entry)
+		free(entry);
 	pqHandleSendFailure(conn);
 	return 0;
 }
@@ -2621,7 +2990,7 @@ PQfn(PGconn *conn,
 	resetPQExpBuffer(&conn->errorMessage);
 
 	if (conn->sock == PGINVALID_SOCKET || conn->asyncStatus != PGASYNC_IDLE ||
-		conn->result != NULL)
+		conn->result != NULL || conn->pipelineStatus != PQ_PIPELINE_OFF)
 	{
 		printfPQExpBuffer(&conn->errorMessage,
 						  libpq_gettext("connection in wrong state\n"));
@@ -59,6 +59,10 @@
 #include "pg_config_paths.h"
 
 
+/* Is there data consumed by the compression stream but not sent yet? */
+#define pqCompressedPending(conn) \
+	((conn)->zstream != NULL && zpq_buffered_tx((conn)->zstream) > 0)
+
 static int	pqPutMsgBytes(const void *buf, size_t len, PGconn *conn);
 static int	pqSendSome(PGconn *conn, int len);
 static int pqSocketCheck(PGconn *conn, int forRead, int forWrite,
@@ -619,6 +623,30 @@ pqPutMsgEnd(PGconn *conn)
 	return 0;
 }
 
+/*
+ * pqReadSome: read data from the server, decompressing it if compression
+ * was negotiated.  Same conventions as pqsecure_read.
+ */
+static ssize_t
+pqReadSome(PGconn *conn, void *ptr, size_t len)
+{
+	ssize_t		n;
+
+	if (conn->zstream == NULL)
+		return pqsecure_read(conn, ptr, len);
+
+	n = zpq_read(conn->zstream, ptr, len);
+	if (n == ZPQ_DECOMPRESS_ERROR)
+	{
+		printfPQExpBuffer(&conn->errorMessage,
+						  libpq_gettext("could not decompress data from server: %s\n"),
+						  zpq_error(conn->zstream));
+		SOCK_ERRNO_SET(EIO);
+		return -1;
+	}
+	return n;
+}
+
 /* ----------
  * pqReadData: read more data, if any is available
  * Possible return values:
@@ -683,8 +711,8 @@ pqReadData(PGconn *conn)
 
 	/* OK, try to read some data */
 retry3:
-	nread = pqsecure_read(conn, conn->inBuffer + conn->inEnd,
-						  conn->inBufSize - conn->inEnd);
+	nread = pqReadSome(conn, conn->inBuffer + conn->inEnd,
+					   conn->inBufSize - conn->inEnd);
 	if (nread < 0)
 	{
 		if (SOCK_ERRNO == EINTR)
@@ -710,6 +738,22 @@ retry3:
 	{
 		conn->inEnd += nread;
 
+		/*
+		 * The compression stream may hold more data already received from
+		 * the socket.  Get all of it now, as the caller can't learn about it
+		 * by waiting for the socket to become readable.
+		 */
+		if (conn->zstream && zpq_buffered_rx(conn->zstream) > 0)
+		{
+			if (conn->inBufSize - conn->inEnd < 8192)
+				(void) pqCheckInBufferSpace(conn->inEnd + (size_t) 8192, conn);
+			if (conn->inBufSize - conn->inEnd >= 100)
+			{
+				someread = 1;
+				goto retry3;
+			}
+		}
+
 		/*
 		 * Hack to deal with the fact that some kernels will only give us back
 		 * 1 packet per recv() call, even if we asked for more and there is
@@ -773,8 +817,8 @@ retry3:
 	 * arrived.
 	 */
 retry4:
-	nread = pqsecure_read(conn, conn->inBuffer + conn->inEnd,
-						  conn->inBufSize - conn->inEnd);
+	nread = pqReadSome(conn, conn->inBuffer + conn->inEnd,
+					   conn->inBufSize - conn->inEnd);
 	if (nread < 0)
 	{
 		if (SOCK_ERRNO == EINTR)
@@ -846,22 +890,37 @@ pqSendSome(PGconn *conn, int len)
 		return -1;
 	}
 
-	/* while there's still data to send */
-	while (len > 0)
+	/*
+	 * while there's still data to send (with compression, including data
+	 * already consumed by the compression stream but not sent yet)
+	 */
+	while (len > 0 || pqCompressedPending(conn))
 	{
 		int			sent;
 
+		if (conn->zstream)
+		{
+			size_t		processed = 0;
+
+			sent = zpq_write(conn->zstream, ptr, len, &processed);
+			ptr += processed;
+			len -= processed;
+			remaining -= processed;
+		}
+		else
+		{
 #ifndef WIN32
-		sent = pqsecure_write(conn, ptr, len);
+			sent = pqsecure_write(conn, ptr, len);
 #else
 
-		/*
-		 * Windows can fail on large sends, per KB article Q201213. The
-		 * failure-point appears to be different in different versions of
-		 * Windows, but 64k should always be safe.
-		 */
-		sent = pqsecure_write(conn, ptr, Min(len, 65536));
+			/*
+			 * Windows can fail on large sends, per KB article Q201213. The
+			 * failure-point appears to be different in different versions of
+			 * Windows, but 64k should always be safe.
+			 */
+			sent = pqsecure_write(conn, ptr, Min(len, 65536));
 #endif
+		}
 
 		if (sent < 0)
 		{
@@ -894,14 +953,14 @@ pqSendSome(PGconn *conn, int len)
 					return -1;
 			}
 		}
-		else
+		else if (conn->zstream == NULL)
 		{
 			ptr += sent;
 			len -= sent;
 			remaining -= sent;
 		}
 
-		if (len > 0)
+		if (len > 0 || pqCompressedPending(conn))
 		{
 			/*
 			 * We didn't send it all, wait till we can send more.
@@ -968,7 +1027,7 @@ pqFlush(PGconn *conn)
 	if (conn->Pfdebug)
 		fflush(conn->Pfdebug);
 
-	if (conn->outCount > 0)
+	if (conn->outCount > 0 || pqCompressedPending(conn))
 		return pqSendSome(conn, conn->outCount);
 
 	return 0;
@@ -1071,6 +1130,10 @@ pqSocketCheck(PGconn *conn, int forRead, int forWrite, time_t end_time)
 	}
 #endif
 
+	/* Likewise for compression stream */
+	if (forRead && conn->zstream && zpq_buffered_rx(conn->zstream) > 0)
+		return 1;
+
 	/* We will retry as long as we get EINTR */
 	do
 		result = pqSocketPoll(conn->sock, forRead, forWrite, end_time);
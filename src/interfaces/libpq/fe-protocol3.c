@@ -218,12 +218,33 @@ pqParseInput3(PGconn *conn)
 				case 'E':		/* error return */
 					if (pqGetErrorNotice3(conn, true))
 						return;
+					/* server skips the rest of the pipeline up to Sync */
+					if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+						conn->pipelineStatus = PQ_PIPELINE_ABORTED;
 					conn->asyncStatus = PGASYNC_READY;
 					break;
 				case 'Z':		/* backend is ready for new query */
 					if (getReadyForQuery(conn))
 						return;
-					conn->asyncStatus = PGASYNC_IDLE;
+					if (conn->pipelineStatus != PQ_PIPELINE_OFF)
+					{
+						/*
+						 * Sync point of a pipeline: report it to the
+						 * application and stop parsing until it's collected.
+						 */
+						conn->result = PQmakeEmptyPGresult(conn,
+														PGRES_PIPELINE_SYNC);
+						if (!conn->result)
+						{
+							printfPQExpBuffer(&conn->errorMessage,
+											  libpq_gettext("out of memory"));
+							pqSaveErrorResult(conn);
+						}
+						conn->pipelineStatus = PQ_PIPELINE_ON;
+						conn->asyncStatus = PGASYNC_READY;
+					}
+					else
+						conn->asyncStatus = PGASYNC_IDLE;
 					break;
 				case 'I':		/* empty query */
 					if (conn->result == NULL)
@@ -2174,6 +2195,8 @@ build_startup_packet(const PGconn *conn, char *packet,
 		ADD_STARTUP_OPTION("replication", conn->replication);
 	if (conn->pgoptions && conn->pgoptions[0])
 		ADD_STARTUP_OPTION("options", conn->pgoptions);
+	if (pqCompressionRequested(conn))
+		ADD_STARTUP_OPTION("compression", zpq_algorithms());
 	if (conn->send_appname)
 	{
 		/* Use appname if present, otherwise use fallback */
@@ -91,7 +91,10 @@ typedef enum
 	PGRES_NONFATAL_ERROR,		/* notice or warning message */
 	PGRES_FATAL_ERROR,			/* query failed */
 	PGRES_COPY_BOTH,			/* Copy In/Out data transfer in progress */
-	PGRES_SINGLE_TUPLE			/* single tuple from larger resultset */
+	PGRES_SINGLE_TUPLE,			/* single tuple from larger resultset */
+	PGRES_PIPELINE_SYNC,		/* pipeline synchronization point */
+	PGRES_PIPELINE_ABORTED		/* command didn't run because of an earlier
+								 * error in the pipeline */
 } ExecStatusType;
 
 typedef enum
@@ -117,6 +120,14 @@ typedef enum
 	PQSHOW_CONTEXT_ALWAYS		/* always show CONTEXT field */
 } PGContextVisibility;
 
+typedef enum
+{
+	PQ_PIPELINE_OFF,			/* one command at a time (default) */
+	PQ_PIPELINE_ON,				/* commands are queued without waiting */
+	PQ_PIPELINE_ABORTED			/* a queued command failed, the rest up to
+								 * the next sync point are skipped */
+} PGpipelineStatus;
+
 /*
  * PGPing - The ordering of this enum should not be altered because the
  * values are exposed externally via pg_isready.
@@ -417,6 +428,13 @@ extern int PQsendQueryPrepared(PGconn *conn,
 extern int	PQsetSingleRowMode(PGconn *conn);
 extern PGresult *PQgetResult(PGconn *conn);
 
+/* Routines for pipelining several queries without waiting for results */
+extern int	PQenterPipelineMode(PGconn *conn);
+extern int	PQexitPipelineMode(PGconn *conn);
+extern int	PQpipelineSync(PGconn *conn);
+extern int	PQsendFlushRequest(PGconn *conn);
+extern PGpipelineStatus PQpipelineStatus(const PGconn *conn);
+
 /* Routines for managing an asynchronous query */
 extern int	PQisBusy(PGconn *conn);
 extern int	PQconsumeInput(PGconn *conn);
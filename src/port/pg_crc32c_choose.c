@@ -3,9 +3,11 @@
  * pg_crc32c_choose.c
  *	  Choose which CRC-32C implementation to use, at runtime.
  *
- * Try to the special CRC instructions introduced in Intel SSE 4.2,
- * if available on the platform we're running on, but fall back to the
- * slicing-by-8 implementation otherwise.
+ * Try to use the special CRC instructions introduced in Intel SSE 4.2 or
+ * the ARMv8 CRC Extension, if available on the platform we're running on,
+ * but fall back to the slicing-by-8 implementation otherwise.  On x86, if
+ * the CPU also has carry-less multiplication, use it to process longer
+ * inputs in several independent lanes, 512 bits wide with AVX-512.
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -19,16 +21,22 @@
 
 #include "c.h"
 
-#ifdef HAVE__GET_CPUID
+#if defined(USE_SSE42_CRC32C_WITH_RUNTIME_CHECK) && defined(HAVE__GET_CPUID)
 #include <cpuid.h>
 #endif
 
-#ifdef HAVE__CPUID
+#if defined(USE_SSE42_CRC32C_WITH_RUNTIME_CHECK) && defined(HAVE__CPUID)
 #include <intrin.h>
 #endif
 
+#ifdef USE_ARMV8_CRC32C_WITH_RUNTIME_CHECK
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
 #include "port/pg_crc32c.h"
 
+#ifdef USE_SSE42_CRC32C_WITH_RUNTIME_CHECK
 static bool
 pg_crc32c_sse42_available(void)
 {
@@ -44,6 +52,15 @@ pg_crc32c_sse42_available(void)
 
 	return (exx[2] & (1 << 20)) != 0;	/* SSE 4.2 */
 }
+#endif
+
+#ifdef USE_ARMV8_CRC32C_WITH_RUNTIME_CHECK
+static bool
+pg_crc32c_armv8_available(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#endif
 
 /*
  * This gets called on the first call. It replaces the function pointer
@@ -52,10 +69,31 @@ pg_crc32c_sse42_available(void)
 static pg_crc32c
 pg_comp_crc32c_choose(pg_crc32c crc, const void *data, size_t len)
 {
+#if defined(USE_SSE42_CRC32C)
+	/* SSE 4.2 is known to be there, only the rest needs checking */
+	pg_comp_crc32c = pg_comp_crc32c_sse42;
+#elif defined(USE_SSE42_CRC32C_WITH_RUNTIME_CHECK)
 	if (pg_crc32c_sse42_available())
 		pg_comp_crc32c = pg_comp_crc32c_sse42;
 	else
 		pg_comp_crc32c = pg_comp_crc32c_sb8;
+#elif defined(USE_ARMV8_CRC32C_WITH_RUNTIME_CHECK)
+	if (pg_crc32c_armv8_available())
+		pg_comp_crc32c = pg_comp_crc32c_armv8;
+	else
+		pg_comp_crc32c = pg_comp_crc32c_sb8;
+#endif
+
+#ifdef USE_PCLMUL_CRC32C_WITH_RUNTIME_CHECK
+	if (pg_comp_crc32c == pg_comp_crc32c_sse42)
+	{
+		if (__builtin_cpu_supports("avx512vl") &&
+			__builtin_cpu_supports("vpclmulqdq"))
+			pg_comp_crc32c = pg_comp_crc32c_avx512;
+		else if (__builtin_cpu_supports("pclmul"))
+			pg_comp_crc32c = pg_comp_crc32c_pclmul;
+	}
+#endif
 
 	return pg_comp_crc32c(crc, data, len);
 }
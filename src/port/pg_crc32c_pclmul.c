@@ -0,0 +1,203 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_crc32c_pclmul.c
+ *	  Compute CRC-32C checksum using carry-less multiplication.
+ *
+ * The SSE 4.2 CRC32 instruction has a latency of three cycles, so a
+ * single dependency chain of them processes at most 8 bytes per three
+ * cycles.  For longer inputs, it is much faster to "fold" several
+ * independent 128-bit lanes of input forward with PCLMULQDQ, and use the
+ * CRC32 instruction only to reduce the final 128 bits and for the tail.
+ * See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" by Intel for the method.
+ *
+ * The folding constants are x^(D+32) mod P and x^(D-32) mod P, bit-reflected
+ * and shifted left by one, for folding distance D.
+ *
+ * The functions use target attributes, so that the rest of the code need
+ * not be compiled for these instruction sets; pg_crc32c_choose.c checks
+ * that the CPU supports them before they are used.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/port/pg_crc32c_pclmul.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "c.h"
+
+#include "port/pg_crc32c.h"
+
+#include <immintrin.h>
+
+/* Folding constants for distances of 128, 512 and 2048 bits */
+#define CRC32C_K128_LO	0x0f20c0dfe		/* x^160 */
+#define CRC32C_K128_HI	0x14cd00bd6		/* x^96 */
+#define CRC32C_K512_LO	0x0740eef02		/* x^544 */
+#define CRC32C_K512_HI	0x09e4addf8		/* x^480 */
+#define CRC32C_K2048_LO 0x0dcb17aa4		/* x^2080 */
+#define CRC32C_K2048_HI 0x0b9e02b86		/* x^2016 */
+
+/*
+ * Fold 128-bit lane(s) x forward over the distance of constants k, and
+ * add in y.
+ */
+#define FOLD128(x, k, y) \
+	_mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00), \
+								_mm_clmulepi64_si128((x), (k), 0x11)), (y))
+#define FOLD512(x, k, y) \
+	_mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128((x), (k), 0x00), \
+							  _mm512_clmulepi64_epi128((x), (k), 0x11), \
+							  (y), 0x96)
+
+/*
+ * Compute the CRC of the remaining bytes after folding, given the CRC of
+ * the data folded so far.
+ */
+pg_attribute_target("sse4.2")
+static inline pg_crc32c
+crc32c_tail(pg_crc32c crc, const unsigned char *p, const unsigned char *pend)
+{
+	while (p + 8 <= pend)
+	{
+		crc = (uint32) _mm_crc32_u64(crc, *((const uint64 *) p));
+		p += 8;
+	}
+	while (p < pend)
+	{
+		crc = _mm_crc32_u8(crc, *p);
+		p++;
+	}
+	return crc;
+}
+
+/*
+ * Reduce the 128 bits left after folding to the CRC of the data so far.
+ */
+pg_attribute_target("sse4.2")
+static inline pg_crc32c
+crc32c_reduce128(__m128i x)
+{
+	pg_crc32c	crc;
+
+	crc = (uint32) _mm_crc32_u64(0, _mm_cvtsi128_si64(x));
+	return (uint32) _mm_crc32_u64(crc, _mm_extract_epi64(x, 1));
+}
+
+/*
+ * Use four 128-bit lanes, for CPUs with PCLMULQDQ.
+ */
+pg_attribute_target("sse4.2,pclmul")
+pg_crc32c
+pg_comp_crc32c_pclmul(pg_crc32c crc, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	const unsigned char *pend = p + len;
+
+	if (len >= 64)
+	{
+		__m128i		x0,
+					x1,
+					x2,
+					x3;
+		__m128i		k;
+
+		/* The initial CRC is simply added to the first bytes of data */
+		x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) p),
+						   _mm_cvtsi32_si128(crc));
+		x1 = _mm_loadu_si128((const __m128i *) (p + 16));
+		x2 = _mm_loadu_si128((const __m128i *) (p + 32));
+		x3 = _mm_loadu_si128((const __m128i *) (p + 48));
+		p += 64;
+
+		k = _mm_set_epi64x(CRC32C_K512_HI, CRC32C_K512_LO);
+		while (p + 64 <= pend)
+		{
+			x0 = FOLD128(x0, k, _mm_loadu_si128((const __m128i *) p));
+			x1 = FOLD128(x1, k, _mm_loadu_si128((const __m128i *) (p + 16)));
+			x2 = FOLD128(x2, k, _mm_loadu_si128((const __m128i *) (p + 32)));
+			x3 = FOLD128(x3, k, _mm_loadu_si128((const __m128i *) (p + 48)));
+			p += 64;
+		}
+
+		/* Fold the lanes into one */
+		k = _mm_set_epi64x(CRC32C_K128_HI, CRC32C_K128_LO);
+		x1 = FOLD128(x0, k, x1);
+		x2 = FOLD128(x1, k, x2);
+		x3 = FOLD128(x2, k, x3);
+
+		crc = crc32c_reduce128(x3);
+	}
+
+	return crc32c_tail(crc, p, pend);
+}
+
+/*
+ * Use four 512-bit registers of four 128-bit lanes each, for CPUs with
+ * AVX-512 and VPCLMULQDQ.  Below 512 bytes, that doesn't pay off the cost of
+ * the final reduction over the other lanes.
+ */
+pg_attribute_target("sse4.2,pclmul,avx512f,avx512vl,vpclmulqdq")
+pg_crc32c
+pg_comp_crc32c_avx512(pg_crc32c crc, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	const unsigned char *pend = p + len;
+
+	if (len < 512)
+		return pg_comp_crc32c_pclmul(crc, data, len);
+
+	{
+		__m512i		x0,
+					x1,
+					x2,
+					x3;
+		__m512i		k;
+		__m128i		k128;
+		__m128i		l0,
+					l1,
+					l2,
+					l3;
+
+		x0 = _mm512_xor_si512(_mm512_loadu_si512(p),
+							  _mm512_castsi128_si512(_mm_cvtsi32_si128(crc)));
+		x1 = _mm512_loadu_si512(p + 64);
+		x2 = _mm512_loadu_si512(p + 128);
+		x3 = _mm512_loadu_si512(p + 192);
+		p += 256;
+
+		k = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32C_K2048_HI,
+												  CRC32C_K2048_LO));
+		while (p + 256 <= pend)
+		{
+			x0 = FOLD512(x0, k, _mm512_loadu_si512(p));
+			x1 = FOLD512(x1, k, _mm512_loadu_si512(p + 64));
+			x2 = FOLD512(x2, k, _mm512_loadu_si512(p + 128));
+			x3 = FOLD512(x3, k, _mm512_loadu_si512(p + 192));
+			p += 256;
+		}
+
+		/* Fold the registers into one, then its lanes into one */
+		k = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32C_K512_HI,
+												  CRC32C_K512_LO));
+		x1 = FOLD512(x0, k, x1);
+		x2 = FOLD512(x1, k, x2);
+		x3 = FOLD512(x2, k, x3);
+
+		k128 = _mm_set_epi64x(CRC32C_K128_HI, CRC32C_K128_LO);
+		l0 = _mm512_extracti32x4_epi32(x3, 0);
+		l1 = _mm512_extracti32x4_epi32(x3, 1);
+		l2 = _mm512_extracti32x4_epi32(x3, 2);
+		l3 = _mm512_extracti32x4_epi32(x3, 3);
+		l1 = FOLD128(l0, k128, l1);
+		l2 = FOLD128(l1, k128, l2);
+		l3 = FOLD128(l2, k128, l3);
+
+		crc = crc32c_reduce128(l3);
+	}
+
+	return crc32c_tail(crc, p, pend);
+}
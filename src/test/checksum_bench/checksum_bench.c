@@ -0,0 +1,194 @@
+/*-------------------------------------------------------------------------
+ *
+ * checksum_bench.c
+ *		Micro-benchmark of the page checksum and CRC-32C implementations
+ *
+ * Every implementation this build has and the CPU supports is run over the
+ * same buffers, reporting throughput in GB/s.  The results of all the
+ * implementations are also compared, so this doubles as a quick check of
+ * the vectorized variants on a new platform.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ *	src/test/checksum_bench/checksum_bench.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include "port/pg_crc32c.h"
+#include "portability/instr_time.h"
+#include "storage/checksum.h"
+#include "storage/checksum_impl.h"
+
+/* total amount of data to process per variant and size */
+#define BENCH_BYTES		((int64) 1 << 30)
+
+/*
+ * Input sizes for CRC-32C: a WAL record header, small and medium records,
+ * a full page and a large WAL record.
+ */
+static const int crc_sizes[] = {24, 256, 1024, BLCKSZ, 8 * BLCKSZ};
+
+typedef uint32 (*block_func) (char *data, uint32 size);
+typedef pg_crc32c (*crc_func) (pg_crc32c crc, const void *data, size_t len);
+
+static char *buffer;
+static int	errors = 0;
+
+/*
+ * Run a checksum implementation over all the pages of the buffer and report
+ * its throughput.  Returns a hash of the checksums, for comparison.
+ */
+static uint32
+bench_block(const char *name, block_func fn, int npages)
+{
+	instr_time	start,
+				duration;
+	int64		loops = BENCH_BYTES / ((int64) npages * BLCKSZ);
+	int64		i;
+	uint32		result = 0;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < loops; i++)
+	{
+		int			p;
+
+		for (p = 0; p < npages; p++)
+			result = result * 31 + fn(buffer + p * BLCKSZ, BLCKSZ);
+	}
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	printf("checksum %-10s %8d %10.2f GB/s  %08x\n", name, BLCKSZ,
+		   (double) loops * npages * BLCKSZ /
+		   INSTR_TIME_GET_DOUBLE(duration) / 1e9,
+		   result);
+	return result;
+}
+
+/*
+ * Same for a CRC-32C implementation, with input of the given size.
+ */
+static pg_crc32c
+bench_crc(const char *name, crc_func fn, int size, int nbufs)
+{
+	instr_time	start,
+				duration;
+	int64		loops = BENCH_BYTES / ((int64) nbufs * size);
+	int64		i;
+	pg_crc32c	result = 0;
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (i = 0; i < loops; i++)
+	{
+		int			b;
+
+		for (b = 0; b < nbufs; b++)
+		{
+			pg_crc32c	crc;
+
+			/* odd offsets, to exercise unaligned input and the tail code */
+			crc = 0xFFFFFFFF;
+			crc = fn(crc, buffer + b * size + (b & 7), size - (b & 7));
+			result = result * 31 + (crc ^ 0xFFFFFFFF);
+		}
+	}
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	printf("crc32c   %-10s %8d %10.2f GB/s  %08x\n", name, size,
+		   (double) loops * nbufs * size /
+		   INSTR_TIME_GET_DOUBLE(duration) / 1e9,
+		   result);
+	return result;
+}
+
+/* The implementation the build uses, chosen at runtime where applicable */
+static pg_crc32c
+default_crc(pg_crc32c crc, const void *data, size_t len)
+{
+	COMP_CRC32C(crc, data, len);
+	return crc;
+}
+
+static void
+check(const char *what, const char *name, uint32 expected, uint32 got)
+{
+	if (expected != got)
+	{
+		fprintf(stderr, "%s %s: result %08x does not match %08x\n",
+				what, name, got, expected);
+		errors++;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	/* fits in a typical L2 cache, so that memory bandwidth isn't measured */
+	int			npages = 16;
+	int			i;
+	uint32		expected;
+
+	buffer = malloc(npages * BLCKSZ);
+	if (buffer == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	srandom(42);
+	for (i = 0; i < npages * BLCKSZ; i++)
+		buffer[i] = (char) random();
+
+	expected = bench_block("generic", pg_checksum_block_generic, npages);
+#ifdef HAVE_AVX512_TARGET_INTRINSICS
+	if (__builtin_cpu_supports("avx2"))
+		check("checksum", "avx2", expected,
+			  bench_block("avx2", pg_checksum_block_avx2, npages));
+	if (__builtin_cpu_supports("avx512f"))
+		check("checksum", "avx512", expected,
+			  bench_block("avx512", pg_checksum_block_avx512, npages));
+#endif
+
+	for (i = 0; i < lengthof(crc_sizes); i++)
+	{
+		int			size = crc_sizes[i];
+		int			nbufs = npages * BLCKSZ / size;
+
+		expected = bench_crc("default", default_crc, size, nbufs);
+#if !defined(USE_SSE42_CRC32C) && !defined(USE_ARMV8_CRC32C)
+		check("crc32c", "sb8", expected,
+			  bench_crc("sb8", pg_comp_crc32c_sb8, size, nbufs));
+#endif
+#if defined(USE_SSE42_CRC32C) || defined(USE_SSE42_CRC32C_WITH_RUNTIME_CHECK)
+		if (__builtin_cpu_supports("sse4.2"))
+			check("crc32c", "sse42", expected,
+				  bench_crc("sse42", pg_comp_crc32c_sse42, size, nbufs));
+#endif
+#ifdef USE_PCLMUL_CRC32C_WITH_RUNTIME_CHECK
+		if (__builtin_cpu_supports("pclmul"))
+			check("crc32c", "pclmul", expected,
+				  bench_crc("pclmul", pg_comp_crc32c_pclmul, size, nbufs));
+		if (__builtin_cpu_supports("avx512vl") &&
+			__builtin_cpu_supports("vpclmulqdq"))
+			check("crc32c", "avx512", expected,
+				  bench_crc("avx512", pg_comp_crc32c_avx512, size, nbufs));
+#endif
+#if defined(USE_ARMV8_CRC32C_WITH_RUNTIME_CHECK)
+		if (pg_comp_crc32c == pg_comp_crc32c_armv8)
+			check("crc32c", "armv8", expected,
+				  bench_crc("armv8", pg_comp_crc32c_armv8, size, nbufs));
+#endif
+	}
+
+	free(buffer);
+
+	if (errors > 0)
+	{
+		fprintf(stderr, "%d implementations gave wrong results\n", errors);
+		return 1;
+	}
+	return 0;
+}
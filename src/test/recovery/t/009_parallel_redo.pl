@@ -0,0 +1,101 @@
+# Test crash recovery with parallel redo workers.
+#
+# Runs the same workload on two nodes, one replaying WAL in the startup
+# process only and one with parallel_redo_workers, crashes both and checks
+# that they recover to the same contents.  The time each node needs to
+# recover is reported, to compare redo throughput.
+use strict;
+use warnings;
+
+use PostgresNode;
+use TestLib;
+use Test::More tests => 4;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $workload = qq{
+create table t1 (a int primary key, b text);
+create table t2 (a int, b int);
+create index t2_b on t2 (b);
+checkpoint;
+insert into t1 select i, md5(i::text) from generate_series(1, 100000) i;
+insert into t2 select i, i % 1000 from generate_series(1, 100000) i;
+update t1 set b = md5(b) where a % 3 = 0;
+update t2 set b = b + 1 where a % 5 = 0;
+delete from t1 where a % 7 = 0;
+create table t3 as select * from t2;
+insert into t3 select * from t2;
+drop table t3;
+create table t4 as select * from t1;
+truncate t4;
+insert into t4 select * from t1 where a < 1000;
+};
+
+my $check = qq{
+select (select count(*) || ':' || md5(string_agg(a || b, ',' order by a))
+		from t1),
+	   (select count(*) || ':' || sum(b) from t2 where b between 100 and 200),
+	   (select count(*) from t4);
+};
+
+# Run the workload, crash the node, and return the time recovery took.
+sub crash_and_recover
+{
+	my ($node) = @_;
+	my $t0;
+
+	$node->start;
+	$node->safe_psql('postgres', $workload);
+	$node->stop('immediate');
+
+	$t0 = [gettimeofday];
+	$node->start;
+	$node->safe_psql('postgres', 'select 1');
+	return tv_interval($t0);
+}
+
+my $node_serial = get_new_node('serial');
+$node_serial->init;
+$node_serial->append_conf('postgresql.conf', qq{
+max_wal_size = 1GB
+checkpoint_timeout = 1h
+autovacuum = off
+});
+
+my $node_parallel = get_new_node('parallel');
+$node_parallel->init;
+$node_parallel->append_conf('postgresql.conf', qq{
+max_wal_size = 1GB
+checkpoint_timeout = 1h
+autovacuum = off
+max_worker_processes = 8
+parallel_redo_workers = 4
+});
+
+my $serial_time = crash_and_recover($node_serial);
+my $parallel_time = crash_and_recover($node_parallel);
+
+my $expected = $node_serial->safe_psql('postgres', $check);
+my $result = $node_parallel->safe_psql('postgres', $check);
+is($result, $expected, 'parallel redo recovers the same contents');
+
+my $log = slurp_file($node_parallel->logfile);
+like($log, qr/parallel redo starts with 4 workers/,
+	'parallel redo workers were started');
+
+# Indexes must have been rebuilt consistently too
+$result = $node_parallel->safe_psql('postgres',
+	"set enable_seqscan = off; select count(*) from t2 where b = 500");
+$expected = $node_serial->safe_psql('postgres',
+	"set enable_seqscan = off; select count(*) from t2 where b = 500");
+is($result, $expected, 'index scans agree after parallel redo');
+
+# The node must survive a second crash right after recovering in parallel
+$node_parallel->safe_psql('postgres', 'insert into t4 values (0, 0)');
+$expected = $node_parallel->safe_psql('postgres', 'select count(*) from t4');
+$node_parallel->stop('immediate');
+$node_parallel->start;
+$result = $node_parallel->safe_psql('postgres', 'select count(*) from t4');
+is($result, $expected, 'second crash recovery after parallel redo');
+
+note(sprintf("recovery took %.3fs serially, %.3fs with 4 workers",
+	$serial_time, $parallel_time));
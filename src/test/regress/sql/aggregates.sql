@@ -824,3 +824,44 @@ create aggregate my_half_sum(int4)
 select my_sum(one),my_half_sum(one) from (values(1),(2),(3),(4)) t(one);
 
 rollback;
+
+-- Hashed aggregation must spill to disk, not outgrow work_mem, when the
+-- planner underestimates the number of groups
+set work_mem = '64kB';
+set enable_sort = off;
+explain (costs off)
+select g % 20000 as k, count(*) from generate_series(1, 40000) g group by g % 20000;
+-- every group must come out exactly once, with all of its rows
+select count(*), sum(k), sum(c), min(c), max(c)
+from (select g % 20000 as k, count(*) as c
+      from generate_series(1, 40000) g group by g % 20000) s;
+-- pass-by-reference transition values
+select sum(array_length(a, 1)), sum(length(t))
+from (select g % 20000 as k, array_agg(g) as a, string_agg(g::text, ',') as t
+      from generate_series(1, 40000) g group by g % 20000) s;
+reset enable_sort;
+reset work_mem;
+
+-- Batch-at-a-time execution of plain aggregates over a sequential scan
+set enable_batch_execution = on;
+explain (costs off)
+select count(*), count(unique1), sum(unique1), min(two), max(ten)
+from tenk1 where ten > 2 and four <> 1;
+select count(*), count(unique1), sum(unique1), min(two), max(ten)
+from tenk1 where ten > 2 and four <> 1;
+select count(*), count(q2), min(q2), max(q1) from int8_tbl where 200::int8 < q1;
+create temp table batch_tbl as
+select case when g % 7 = 0 then null else g end as a,
+       g::int2 as b, ('2000-01-01'::date + g) as d
+from generate_series(1, 3000) g;
+select count(*), count(a), sum(a), min(a), max(a), sum(b), min(d), max(d)
+from batch_tbl where b <> 5::int2 and b >= 3::int2;
+select count(*), count(a), sum(a), min(a), max(a)
+from batch_tbl where b > 5000;
+-- other aggregates and quals run a tuple at a time
+explain (costs off)
+select avg(unique1) from tenk1 where ten > 2;
+explain (costs off)
+select count(*) from tenk1 where ten + 1 > 3;
+drop table batch_tbl;
+reset enable_batch_execution;
@@ -421,3 +421,12 @@ UPDATE brintest SET textcol = '' WHERE textcol IS NOT NULL;
 SELECT brin_summarize_new_values('brintest'); -- error, not an index
 SELECT brin_summarize_new_values('tenk1_unique1'); -- error, not a BRIN index
 SELECT brin_summarize_new_values('brinidx'); -- ok, no change expected
+
+-- Test the autosummarize reloption
+CREATE TABLE brin_autosum_tbl (a int);
+CREATE INDEX brin_autosum_idx ON brin_autosum_tbl USING brin (a)
+	WITH (pages_per_range = 1, autosummarize = on);
+INSERT INTO brin_autosum_tbl SELECT g FROM generate_series(1, 1000) g;
+ALTER INDEX brin_autosum_idx SET (autosummarize = off);
+ALTER INDEX brin_autosum_idx SET (autosummarize = maybe); -- error
+DROP TABLE brin_autosum_tbl;
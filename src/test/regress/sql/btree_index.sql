@@ -92,3 +92,30 @@ vacuum btree_tall_tbl;
 -- need to insert some rows to cause the fast root page to split.
 insert into btree_tall_tbl (id, t)
   select g, repeat('x', 100) from generate_series(1, 500) g;
+
+--
+-- Test B-tree posting lists.  Inserting many duplicates after the index
+-- exists makes full leaf pages merge them rather than split.
+--
+create table btree_dedup_tbl (a int4, b text, c int4);
+create index btree_dedup_idx on btree_dedup_tbl (a, b);
+insert into btree_dedup_tbl
+  select g % 10, 'x', g from generate_series(1, 20000) g;
+set enable_seqscan to false;
+set enable_bitmapscan to false;
+select count(*) from btree_dedup_tbl where a = 3;
+select count(*) from btree_dedup_tbl where a = 3 and b = 'x';
+-- Remove all of some posting lists and part of others, and vacuum
+delete from btree_dedup_tbl where a = 5;
+delete from btree_dedup_tbl where a = 3 and c % 4 = 1;
+vacuum btree_dedup_tbl;
+select count(*) from btree_dedup_tbl where a >= 3;
+select a, count(*) from btree_dedup_tbl where a between 2 and 4
+  group by a order by a desc;
+alter index btree_dedup_idx set (deduplicate_items = off);
+insert into btree_dedup_tbl
+  select 3, 'x', g from generate_series(1, 1000) g;
+select count(*) from btree_dedup_tbl where a = 3;
+reset enable_seqscan;
+reset enable_bitmapscan;
+drop table btree_dedup_tbl;
@@ -0,0 +1,57 @@
+--
+-- TOAST compression methods
+--
+
+CREATE TABLE cmdata (descr text, f1 text, f2 text);
+ALTER TABLE cmdata ALTER COLUMN f2 SET (compression = lz4);
+SELECT attname, attoptions FROM pg_attribute
+  WHERE attrelid = 'cmdata'::regclass AND attnum > 0 ORDER BY attnum;
+
+-- f1 is compressed with pglz, f2 with lz4 if this build supports it
+INSERT INTO cmdata VALUES ('inline', repeat('1234567890', 1000), repeat('1234567890', 1000));
+INSERT INTO cmdata VALUES ('external', repeat('1234567890', 50000), repeat('1234567890', 50000));
+INSERT INTO cmdata
+  SELECT 'mixed', string_agg(md5(g::text), ''), string_agg(md5(g::text), '')
+  FROM generate_series(1, 100) g, generate_series(1, 20) r;
+
+-- the values are stored compressed and read back unchanged
+SELECT descr, length(f1), length(f2), f1 = f2 AS same,
+       pg_column_size(f1) < length(f1) AS f1_compressed,
+       pg_column_size(f2) < length(f2) AS f2_compressed
+  FROM cmdata ORDER BY descr;
+SELECT descr, md5(f1) = md5(repeat('1234567890', length(f1) / 10)) AS f1_ok,
+       md5(f2) = md5(repeat('1234567890', length(f2) / 10)) AS f2_ok
+  FROM cmdata WHERE descr <> 'mixed' ORDER BY descr;
+
+-- slices are decompressed through the slice path
+SELECT descr, substr(f1, 4995, 20) = substr(f2, 4995, 20) AS same_slice,
+       substr(f2, 4995, 20)
+  FROM cmdata ORDER BY descr;
+
+-- compressed values keep their method when copied to another column
+CREATE TABLE cmcopy (f1 text, f2 text);
+INSERT INTO cmcopy SELECT f2, f1 FROM cmdata;
+SELECT length(f1), f1 = f2 AS same FROM cmcopy ORDER BY 1;
+
+-- changing the method leaves existing values readable
+ALTER TABLE cmdata ALTER COLUMN f2 SET (compression = pglz);
+INSERT INTO cmdata VALUES ('after', repeat('0987654321', 1000), repeat('0987654321', 1000));
+SELECT descr, f1 = f2 AS same FROM cmdata ORDER BY descr;
+ALTER TABLE cmdata ALTER COLUMN f2 RESET (compression);
+
+-- default for columns without the option
+SHOW default_toast_compression;
+SET default_toast_compression = lz4;
+CREATE TABLE cmdefault (f1 text);
+INSERT INTO cmdefault VALUES (repeat('1234567890', 1000));
+SELECT length(f1), pg_column_size(f1) < length(f1) AS compressed,
+       f1 = repeat('1234567890', 1000) AS same
+  FROM cmdefault;
+RESET default_toast_compression;
+SELECT f1 = repeat('1234567890', 1000) AS same FROM cmdefault;
+
+-- invalid methods
+ALTER TABLE cmdata ALTER COLUMN f1 SET (compression = zstd);
+SET default_toast_compression = zstd;
+
+DROP TABLE cmdata, cmcopy, cmdefault;
@@ -387,6 +387,31 @@ COPY rls_t1 (a, b) TO stdout;
 
 RESET SESSION AUTHORIZATION;
 
+-- parallel COPY FROM
+CREATE TABLE parallel_copy (a int, b text, c int DEFAULT 42);
+COPY parallel_copy (a, b) FROM stdin (PARALLEL 2);
+1	one
+2	two
+3	\N
+\.
+COPY parallel_copy FROM stdin (FORMAT csv, HEADER, PARALLEL 2);
+a,b,c
+4,"fo
+ur",4
+5,five,5
+\.
+SELECT a, replace(b, E'\n', '<nl>') AS b, c FROM parallel_copy ORDER BY a;
+-- errors are reported against the line they occurred in
+SET force_parallel_mode = regress;
+COPY parallel_copy (a, b) FROM stdin (PARALLEL 2);
+6	six
+seven	7
+\.
+RESET force_parallel_mode;
+COPY parallel_copy TO stdout (PARALLEL 2);
+COPY parallel_copy FROM stdin (PARALLEL -1);
+DROP TABLE parallel_copy;
+
 DROP TABLE forcetest;
 DROP TABLE vistest;
 DROP FUNCTION truncate_in_subxact();
@@ -1055,3 +1055,19 @@ alter table fktable2 drop constraint fktable2_f1_fkey;
 commit;
 
 drop table pktable2, fktable2;
+
+--
+-- Test foreign key checks done in batches
+--
+create table pktable3 (f1 int primary key);
+create table fktable3 (f1 int references pktable3, f2 text);
+insert into pktable3 select g from generate_series(1, 10) g;
+insert into fktable3 select g % 10 + 1 from generate_series(1, 100) g;
+-- the first row with a missing key is reported
+insert into fktable3 values (1), (12), (2), (11), (12);
+set foreign_key_check_batch_size = 2;
+insert into fktable3 values (1), (2), (1), (3), (13), (14);
+insert into fktable3 select g % 10 + 1 from generate_series(1, 10) g;
+reset foreign_key_check_batch_size;
+select count(*) from fktable3;
+drop table pktable3, fktable3;
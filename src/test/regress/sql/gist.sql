@@ -24,6 +24,18 @@ delete from gist_point_tbl where id < 10000;
 
 vacuum analyze gist_point_tbl;
 
+-- Rebuild the index, by sorting this time as the point opclass has a
+-- sortsupport function, and check that it finds the same rows.
+reindex index gist_pointidx;
+set enable_seqscan=off;
+set enable_bitmapscan=off;
+select count(*) from gist_point_tbl where p <@ box(point(0,0), point(100000, 100000));
+select count(*) from gist_point_tbl where p <@ box(point(50000,50000), point(60000, 60000));
+select p from gist_point_tbl where p <@ box(point(95000,95000), point(95100, 95100))
+order by p <-> point(95000, 95000);
+reset enable_seqscan;
+reset enable_bitmapscan;
+
 
 --
 -- Test Index-only plans on GiST indexes
@@ -1758,3 +1758,30 @@ from fkest f
 where f.c = 1;
 
 rollback;
+
+--
+-- test memoization of parameterized inner scans
+--
+
+set enable_memoize = on;
+set enable_hashjoin = off;
+set enable_mergejoin = off;
+
+select count(*), sum(t2.unique1)
+from tenk1 t1 join tenk1 t2 on t2.unique1 = t1.twenty
+where t1.unique1 < 1000;
+
+select count(*), count(t2.unique1)
+from tenk1 t1 left join tenk1 t2 on t2.unique1 = t1.twenty + 9990
+where t1.unique1 < 1000;
+
+-- make the cache evict entries
+set work_mem = '64kB';
+select count(*), sum(t2.unique1)
+from tenk1 t1 join tenk1 t2 on t2.unique1 = t1.thousand
+where t1.unique1 < 5000;
+
+reset work_mem;
+reset enable_mergejoin;
+reset enable_hashjoin;
+reset enable_memoize;
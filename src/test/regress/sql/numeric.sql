@@ -997,3 +997,40 @@ select scale(1.12345);
 select scale(110123.12475871856128);
 select scale(-1123.12471856128);
 select scale(-13.000000000000000);
+
+--
+-- Tests for the small-value fast paths, including overflow into the
+-- general code
+--
+
+select 123.45 + 0.055;
+select 123.45 - 1000;
+select 0.05 * -1.10;
+select 99999999.99 * 99999999.99;
+select 999999999999999999::numeric + 1;
+select sum(x) from (values (1.5), (2.25), (null), (-0.125), (1000000000000000000)) v(x);
+select avg(x), var_samp(x), stddev(x)
+  from (select g * 0.01 as x from generate_series(1, 1000) g) s;
+-- inputs too large for the pending sum of squares, and a change of scale
+select avg(x), var_samp(x), stddev(x)
+  from (values (1.5), (1000000000000000.5), (-2.25), (0.001)) v(x);
+-- the inverse transition function must see the pending sums
+select x, sum(x) over w, avg(x) over w, var_pop(x) over w
+  from (values (1, 1.1), (2, 2.25), (3, 3), (4, -4.5), (5, 0.125)) v(i, x)
+  window w as (order by i rows between 1 preceding and current row);
+-- partial aggregates are combined and serialized
+create table num_fast_agg as
+  select g * 0.5 as x from generate_series(1, 10000) g;
+analyze num_fast_agg;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_relation_size = 0;
+set max_parallel_workers_per_gather = 4;
+explain (costs off)
+  select sum(x), avg(x), var_samp(x) from num_fast_agg;
+select sum(x), avg(x), var_samp(x) from num_fast_agg;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_relation_size;
+reset max_parallel_workers_per_gather;
+drop table num_fast_agg;
@@ -39,6 +39,50 @@ explain (costs off)
 	select  sum(parallel_restricted(unique1)) from tenk1
 	group by(parallel_restricted(unique1));
 
+-- test parallel hash joins, which may build a shared hash table
+select count(*) from tenk1 t1 join tenk1 t2 using (unique1);
+select count(*) from tenk1 t1 left join tenk1 t2 on t1.unique1 = t2.unique2
+  where t2.unique2 is null;
+-- the same with too little work_mem for a single batch
+set work_mem = '64kB';
+select count(*) from tenk1 t1 join tenk1 t2 using (unique1);
+select count(*) from tenk1 t1 left join tenk1 t2 on t1.unique1 = t2.unique2
+  where t2.unique2 is null;
+reset work_mem;
+
+-- test parallel index scans
+set enable_seqscan to off;
+set enable_bitmapscan to off;
+explain (costs off)
+	select count((unique1)) from tenk1 where hundred > 1;
+select count((unique1)) from tenk1 where hundred > 1;
+
+-- test parallel index-only scans
+explain (costs off)
+	select count(*) from tenk1 where thousand > 95;
+select count(*) from tenk1 where thousand > 95;
+
+reset enable_bitmapscan;
+
+-- test parallel bitmap heap scans, which share one bitmap among the workers
+set enable_indexscan to off;
+explain (costs off)
+	select count((unique1)) from tenk1 where hundred > 1;
+select count((unique1)) from tenk1 where hundred > 1;
+
+reset enable_seqscan;
+reset enable_indexscan;
+
+-- test gather merge, which preserves the sort order of the workers' output
+set enable_hashagg to off;
+explain (costs off)
+	select twenty, count(*) from tenk1 group by twenty;
+select twenty, count(*) from tenk1 group by twenty;
+reset enable_hashagg;
+
+explain (costs off)
+	select ten from tenk1 order by ten;
+
 set force_parallel_mode=1;
 
 explain (costs off)
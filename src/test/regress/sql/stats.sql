@@ -164,5 +164,14 @@ SELECT st.heap_blks_read + st.heap_blks_hit >= pr.heap_blks + cl.relpages,
 SELECT pr.snap_ts < pg_stat_get_snapshot_timestamp() as snapshot_newer
 FROM prevstats AS pr;
 
+-- LWLock wait statistics are always collected
+SELECT acquires > 0 AS procarray_used FROM pg_stat_lwlocks
+ WHERE name = 'ProcArrayLock';
+SELECT count(*) AS buffer_mapping_used FROM pg_stat_lwlocks
+ WHERE name = 'buffer_mapping' AND acquires > 0;
+
+-- The session pool is disabled by default
+SELECT idle_backends, hits FROM pg_stat_session_pool;
+
 DROP TABLE trunc_stats_test, trunc_stats_test1, trunc_stats_test2, trunc_stats_test3, trunc_stats_test4;
 -- End of Stats Test
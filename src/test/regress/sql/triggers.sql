@@ -1240,3 +1240,76 @@ select * from upsert;
 drop table upsert;
 drop function upsert_before_func();
 drop function upsert_after_func();
+
+--
+-- Statement-level triggers with transition tables
+--
+create table transition_table_base (id int primary key, val text);
+create table transition_table_audit (op text, id int, val text);
+
+create function transition_table_audit_func()
+  returns trigger language plpgsql as
+$$
+declare
+  nrows int;
+begin
+  if (TG_OP = 'INSERT') then
+    insert into transition_table_audit
+      select 'insert', id, val
+        from trigger_transition_table(null::transition_table_base, 'new_rows');
+  elsif (TG_OP = 'UPDATE') then
+    insert into transition_table_audit
+      select 'update', n.id, o.val || ' -> ' || n.val
+        from trigger_transition_table(null::transition_table_base, 'old_rows') o
+        join trigger_transition_table(null::transition_table_base, 'new_rows') n
+          on o.id = n.id;
+  else
+    insert into transition_table_audit
+      select 'delete', id, val
+        from trigger_transition_table(null::transition_table_base, 'old_rows');
+  end if;
+  get diagnostics nrows = row_count;
+  raise notice '% % fired once for % rows', TG_NAME, TG_OP, nrows;
+  return null;
+end;
+$$;
+
+create trigger transition_table_ins after insert on transition_table_base
+  referencing new table as new_rows
+  for each statement execute procedure transition_table_audit_func();
+create trigger transition_table_upd after update on transition_table_base
+  referencing old table as old_rows new table as new_rows
+  for each statement execute procedure transition_table_audit_func();
+create trigger transition_table_del after delete on transition_table_base
+  referencing old table as old_rows
+  for each statement execute procedure transition_table_audit_func();
+
+SELECT pg_get_triggerdef(oid) FROM pg_trigger WHERE tgrelid = 'transition_table_base'::regclass AND tgname = 'transition_table_upd';
+
+-- invalid transition tables
+create trigger transition_table_bad after insert on transition_table_base
+  referencing new table as new_rows
+  for each row execute procedure transition_table_audit_func();
+create trigger transition_table_bad after insert on transition_table_base
+  referencing old table as old_rows
+  for each statement execute procedure transition_table_audit_func();
+create trigger transition_table_bad after insert or delete on transition_table_base
+  referencing old table as old_rows
+  for each statement execute procedure transition_table_audit_func();
+create trigger transition_table_bad after update on transition_table_base
+  referencing old table as old_rows new table as old_rows
+  for each statement execute procedure transition_table_audit_func();
+
+insert into transition_table_base select g, 'v' || g from generate_series(1, 5) g;
+update transition_table_base set val = val || 'x' where id <= 3;
+update transition_table_base set val = 'none' where id < 0;
+delete from transition_table_base where id > 3;
+
+select * from transition_table_audit order by op, id;
+
+-- only usable while such a trigger is being fired
+select * from trigger_transition_table(null::transition_table_base, 'new_rows');
+
+drop table transition_table_base;
+drop table transition_table_audit;
+drop function transition_table_audit_func();